@@ -37,6 +37,8 @@ ComputationNetworkPtr GetModelFromConfig(const ConfigRecordType& config, const s
 template <class ConfigRecordType, typename ElemType>
 void DoTrain(const ConfigRecordType& config);
 template <typename ElemType>
+void DoBenchmark(const ConfigParameters& config);
+template <typename ElemType>
 void DoAdapt(const ConfigParameters& config);
 template <typename ElemType>
 void DoEdit(const ConfigParameters& config);
@@ -58,6 +60,8 @@ template <typename ElemType>
 void DoWriteWordAndClassInfo(const ConfigParameters& config);
 template <typename ElemType>
 void DoTopologyPlot(const ConfigParameters& config);
+template <typename ElemType>
+void DoOptimizeForInference(const ConfigParameters& config);
 
 // special purpose (SpecialPurposeActions.cpp)
 template <typename ElemType>
@@ -134,12 +134,18 @@ void DoCrossValidate(const ConfigParameters& config)
         evalNodeNamesVector.push_back(evalNodeNames[i]);
     }
 
+    // with numModelsPerPass > 1, that many models are loaded together and evaluated in a single pass over the data
+    size_t numModelsPerPass = config(L"numModelsPerPass", (size_t)1);
+    if (numModelsPerPass == 0)
+        InvalidArgument("cv command: numModelsPerPass must be at least 1");
+
     std::vector<std::vector<EpochCriterion>> cvErrorResults;
     std::vector<std::wstring> cvModels;
 
     DataReader cvDataReader(readerConfig);
 
     bool finalModelEvaluated = false;
+    std::vector<std::wstring> cvModelPaths;
     for (size_t i = cvInterval[0]; i <= cvInterval[2]; i += cvInterval[1])
     {
         wstring cvModelPath = msra::strfun::wstrprintf(L"%ls.%lld", modelPath.c_str(), i);
@@ -155,17 +161,32 @@ void DoCrossValidate(const ConfigParameters& config)
                 finalModelEvaluated = true;
             }
         }
+        cvModelPaths.push_back(cvModelPath);
+    }
+
+    for (size_t first = 0; first < cvModelPaths.size(); first += numModelsPerPass)
+    {
+        std::vector<ComputationNetworkPtr> nets;
+        for (size_t k = first; k < cvModelPaths.size() && k < first + numModelsPerPass; k++)
+        {
+            cvModels.push_back(cvModelPaths[k]);
+            nets.push_back(ComputationNetwork::CreateFromFile<ElemType>(deviceId, cvModelPaths[k]));
+            // BUGBUG: ^^ Should use GetModelFromConfig()
+        }
 
-        cvModels.push_back(cvModelPath);
-        auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, cvModelPath);
-        // BUGBUG: ^^ Should use GetModelFromConfig()
-        
-        SimpleEvaluator<ElemType> eval(net, MPIWrapper::GetInstance(), enableDistributedMBReading, numMBsToShowResult,
+        SimpleEvaluator<ElemType> eval(nets[0], MPIWrapper::GetInstance(), enableDistributedMBReading, numMBsToShowResult,
             firstMBsToShowResult, traceLevel, maxSamplesInRAM, numSubminiBatches);
 
-        fprintf(stderr, "Model %ls --> \n", cvModelPath.c_str());
-        auto evalErrors = eval.Evaluate(&cvDataReader, evalNodeNamesVector, mbSize[0], epochSize);
-        cvErrorResults.push_back(evalErrors);
+        for (size_t k = 0; k < nets.size(); k++)
+        {
+            if (nets.size() > 1) // the results are then labeled with the index of the network
+                fprintf(stderr, "Model %ls --> Network[%d]\n", cvModelPaths[first + k].c_str(), (int) k + 1);
+            else
+                fprintf(stderr, "Model %ls --> \n", cvModelPaths[first + k].c_str());
+        }
+
+        auto evalErrors = eval.Evaluate(&cvDataReader, nets, evalNodeNamesVector, mbSize[0], epochSize);
+        cvErrorResults.insert(cvErrorResults.end(), evalErrors.begin(), evalErrors.end());
 
         ::Sleep(1000 * sleepSecondsBetweenRuns);
     }
@@ -212,6 +233,17 @@ template void DoCrossValidate<double>(const ConfigParameters& config);
 template <typename ElemType>
 void DoWriteOutput(const ConfigParameters& config)
 {
+    // with several MPI workers, each writes its share of the data to its own files: with distributedMBReading its shard of the data,
+    // with mergeShards its share of each minibatch, which the main worker merges in input order; else only the main worker writes
+    bool enableDistributedMBReading = config(L"distributedMBReading", false);
+    bool mergeShards = config(L"mergeShards", false);
+    if (enableDistributedMBReading && mergeShards)
+        InvalidArgument("write command: distributedMBReading and mergeShards cannot be combined");
+    let mpi = MPIWrapper::GetInstance();
+    bool sharded = mpi && mpi->NumNodesInUse() > 1 && (enableDistributedMBReading || mergeShards);
+    if (mpi && !sharded && !mpi->IsMainNode())
+        return;
+
     ConfigParameters readerConfig(config(L"reader"));
     readerConfig.Insert("randomize", "None"); // we don't want randomization when output results
 
@@ -235,10 +267,12 @@ void DoWriteOutput(const ConfigParameters& config)
                            config(L"traceNodeNamesCategory", ConfigParameters::Array(stringargvector())),
                            config(L"traceNodeNamesSparse",   ConfigParameters::Array(stringargvector())));
 
-    SimpleOutputWriter<ElemType> writer(net, 1);
+    SimpleOutputWriter<ElemType> writer(net, 1, sharded ? mpi : nullptr, mergeShards);
 
     if (config.Exists("writer"))
     {
+        if (sharded)
+            InvalidArgument("write command: distributedMBReading and mergeShards are only supported with 'outputPath'");
         ConfigParameters writerConfig(config(L"writer"));
         bool writerUnittest = writerConfig(L"unittest", "false");
         DataWriter testDataWriter(writerConfig);
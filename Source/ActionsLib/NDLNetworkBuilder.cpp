@@ -146,14 +146,15 @@ void NDLNodeEvaluatorImpl<ElemType>::Evaluate(NDLNode<ElemType>* node, const wst
             ElemType initValueScale = node->GetOptionalParameter("initValueScale", "1");
             ElemType value = node->GetOptionalParameter("value", "0");
             bool initOnCPUOnly = node->GetOptionalParameter("initOnCPUOnly", "false");
+            bool parallelInit = node->GetOptionalParameter("parallelInit", "false");
             int forcedRandomSeed = node->GetOptionalParameter("randomSeed", "-1" /*disabled*/);
 
             if (EqualCI(initString, L"fixedValue"))
                 nodePtr->Value().SetValue(value);
             else if (EqualCI(initString, L"uniform"))
-                m_net->InitLearnableParameters(nodePtr, true, forcedRandomSeed < 0 ? randomSeed++ : (unsigned long) forcedRandomSeed, initValueScale, initOnCPUOnly);
+                m_net->InitLearnableParameters(nodePtr, true, forcedRandomSeed < 0 ? randomSeed++ : (unsigned long) forcedRandomSeed, initValueScale, initOnCPUOnly, parallelInit);
             else if (EqualCI(initString, L"gaussian"))
-                m_net->InitLearnableParameters(nodePtr, false, forcedRandomSeed < 0 ? randomSeed++ : (unsigned long) forcedRandomSeed, initValueScale, initOnCPUOnly);
+                m_net->InitLearnableParameters(nodePtr, false, forcedRandomSeed < 0 ? randomSeed++ : (unsigned long) forcedRandomSeed, initValueScale, initOnCPUOnly, parallelInit);
             else if (EqualCI(initString, L"fromFile"))
             {
                 std::string initFromFilePath = node->GetOptionalParameter("initFromFilePath", "");
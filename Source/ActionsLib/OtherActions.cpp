@@ -203,6 +203,40 @@ void DoParameterSVD(const ConfigParameters& config)
 template void DoParameterSVD<float>(const ConfigParameters& config);
 template void DoParameterSVD<double>(const ConfigParameters& config);
 
+// ===========================================================================
+// DoOptimizeForInference() - implements CNTK "optimizeForInference" command
+// ===========================================================================
+
+// Write a serving-only model (see ComputationNetwork::OptimizeForInference()): the network of the output nodes only, without
+// Dropout, with BatchNormalization and constant subgraphs folded and TransposeTimes weights pre-transposed, and with the
+// memory plan embedded. The eval DLL loads it like any model, and needs none of its optimization options for it.
+//  modelPath        -- the trained model
+//  outputModelPath  -- where to write the serving model
+//  outputNodeNames  -- the nodes to serve (default: the output nodes of the model)
+//  minibatchSize    -- the number of samples per evaluation that the memory is planned for (default: 1)
+template <typename ElemType>
+void DoOptimizeForInference(const ConfigParameters& config)
+{
+    wstring outputModelPath = config(L"outputModelPath", L"");
+    if (outputModelPath.empty())
+        InvalidArgument("optimizeForInference: outputModelPath must be specified.");
+    size_t minibatchSize = config(L"minibatchSize", "1");
+
+    // the plan assumes that values are shared among the nodes, as the eval DLL does in inferenceMode
+    bool shareNodeValueMatrices = g_shareNodeValueMatrices;
+    g_shareNodeValueMatrices = true;
+
+    vector<wstring> outputNodeNames;
+    ComputationNetworkPtr net = GetModelFromConfig<ConfigParameters, ElemType>(config, L"outputNodeNames", outputNodeNames);
+    net->OptimizeForInference(minibatchSize);
+    net->Save(outputModelPath);
+    g_shareNodeValueMatrices = shareNodeValueMatrices;
+    fprintf(stderr, "Saved the model optimized for inference to %ls.\n", outputModelPath.c_str());
+}
+
+template void DoOptimizeForInference<float>(const ConfigParameters& config);
+template void DoOptimizeForInference<double>(const ConfigParameters& config);
+
 // ===========================================================================
 // DoWriteWordAndClassInfo() - implements CNTK "writeWordAndClass" command
 // ===========================================================================
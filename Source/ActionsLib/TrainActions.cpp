@@ -35,6 +35,7 @@
 #include <queue>
 #include <set>
 #include <memory>
+#include <random>
 
 #ifndef let
 #define let const auto
@@ -66,6 +67,16 @@ shared_ptr<C> CreateObject(const ConfigParameters& config, const wchar_t* id)
     return make_shared<C>(readerConfig);                           // old CNTK config specifies a dictionary which then must be explicitly instantiated
 }
 
+// description of the reader, for the key of SGD's preComputeCache
+static wstring ReaderConfigDescription(const ConfigParameters& config)
+{
+    return msra::strfun::utf16(config(L"reader")); // the text of the reader section
+}
+static wstring ReaderConfigDescription(const ScriptableObjects::IConfigRecord&)
+{
+    return wstring(); // BrainScript has already turned the reader section into a DataReader object
+}
+
 template <class ConfigRecordType, typename ElemType>
 void DoTrain(const ConfigRecordType& config)
 {
@@ -96,6 +107,7 @@ void DoTrain(const ConfigRecordType& config)
     }
 
     optimizer->InitMPI(MPIWrapper::GetInstance());
+    optimizer->SetReaderConfigDescription(ReaderConfigDescription(config));
     optimizer->Train(createNetworkFn, deviceId, dataReader.get(), cvDataReader.get(), makeMode);
 }
 
@@ -134,6 +146,158 @@ template void DoTrain<ScriptableObjects::IConfigRecord, double>(const Scriptable
 template void DoTrain<ConfigParameters, float>(const ConfigParameters& config);
 template void DoTrain<ConfigParameters, double>(const ConfigParameters& config);
 
+// ===========================================================================
+// DoBenchmark() - implements CNTK "benchmark" command
+// Trains for numSteps minibatches of random inputs shaped like the network's inputs, to measure its compute
+// throughput without the reader, see SGD::Benchmark().
+// ===========================================================================
+
+// random minibatches for the input nodes of a network
+// Each distinct MBLayout of the inputs gets sequences with lengths drawn uniformly from [minSequenceLength, maxSequenceLength]
+// until they add up to minibatchSize samples, packed into parallel sequences as the readers do. Label nodes and sparse
+// inputs get one-hot columns, the others uniform random values in [-1, 1]; gaps are zero.
+// Inputs without an MBLayout are drawn once.
+template <class ElemType>
+class SyntheticInputs
+{
+public:
+    SyntheticInputs(size_t minibatchSize, size_t minSequenceLength, size_t maxSequenceLength,
+                    const set<ComputationNodeBasePtr>& oneHotNodes, unsigned long seed)
+        : m_minibatchSize(minibatchSize), m_minSequenceLength(minSequenceLength), m_maxSequenceLength(maxSequenceLength),
+          m_oneHotNodes(oneHotNodes), m_rng(seed), m_nextSequenceId(0)
+    {
+    }
+
+    // fill the inputs with the next minibatch and return its number of samples (that of the first input with an MBLayout)
+    size_t operator()(const vector<ComputationNodeBasePtr>& inputNodes)
+    {
+        set<MBLayoutPtr> layoutsDrawn;
+        size_t numSamples = 0;
+        for (const auto& inputNode : inputNodes)
+        {
+            auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(inputNode);
+            if (!node)
+                InvalidArgument("benchmark: Input node '%ls' does not have the precision of the benchmark.", inputNode->NodeName().c_str());
+            let& pMBLayout = node->GetMBLayout();
+            if (pMBLayout && layoutsDrawn.insert(pMBLayout).second)
+            {
+                DrawLayout(*pMBLayout);
+                if (numSamples == 0)
+                    numSamples = pMBLayout->GetActualNumSamples();
+            }
+            else if (!pMBLayout && m_drawnOnce.find(inputNode) != m_drawnOnce.end())
+                continue;
+            FillValue(*node, m_oneHotNodes.find(inputNode) != m_oneHotNodes.end() || node->Value().GetMatrixType() == SPARSE);
+            if (!pMBLayout)
+                m_drawnOnce.insert(inputNode);
+        }
+        return numSamples;
+    }
+
+private:
+    void DrawLayout(MBLayout& layout)
+    {
+        uniform_int_distribution<size_t> sequenceLength(m_minSequenceLength, m_maxSequenceLength);
+        vector<MBLayout::SequenceInfo> sequences;
+        for (size_t numSamples = 0; numSamples < m_minibatchSize;)
+        {
+            MBLayout::SequenceInfo info;
+            info.seqId = m_nextSequenceId++;
+            info.s = 0;
+            info.tBegin = 0;
+            info.tEnd = sequenceLength(m_rng);
+            numSamples += info.tEnd;
+            sequences.push_back(info);
+        }
+        layout.InitAsPackedSequences(sequences, m_placement, m_rowAllocations);
+    }
+
+    void FillValue(ComputationNode<ElemType>& node, bool oneHot)
+    {
+        let& pMBLayout = node.GetMBLayout();
+        size_t numRows = node.GetSampleMatrixNumRows();
+        size_t numCols = node.GetSampleMatrixNumCols();
+        auto& value = node.Value();
+        if (!oneHot)
+        {
+            value.Resize(numRows, numCols);
+            value.SetUniformRandomValue(-1, 1, m_rng());
+            if (pMBLayout)
+                node.MaskMissingValueColumnsToZero(FrameRange(pMBLayout));
+            return;
+        }
+
+        // columns are time steps times parallel sequences, see MBLayout
+        vector<CPUSPARSE_INDEX_TYPE> colStarts(numCols + 1, 0);
+        vector<CPUSPARSE_INDEX_TYPE> rowIndices;
+        uniform_int_distribution<size_t> row(0, numRows - 1);
+        for (size_t j = 0; j < numCols; j++)
+        {
+            if (!pMBLayout || !pMBLayout->IsGap(FrameRange(pMBLayout, j / pMBLayout->GetNumParallelSequences()).Sequence(j % pMBLayout->GetNumParallelSequences())))
+                rowIndices.push_back((CPUSPARSE_INDEX_TYPE) row(m_rng));
+            colStarts[j + 1] = (CPUSPARSE_INDEX_TYPE) rowIndices.size();
+        }
+        if (value.GetMatrixType() == SPARSE)
+        {
+            vector<ElemType> ones(rowIndices.size(), 1);
+            value.SetMatrixFromCSCFormat(colStarts.data(), rowIndices.data(), ones.data(), ones.size(), numRows, numCols);
+        }
+        else
+        {
+            vector<ElemType> dense(numRows * numCols, 0);
+            for (size_t j = 0; j < numCols; j++)
+                for (auto k = colStarts[j]; k < colStarts[j + 1]; k++)
+                    dense[j * numRows + rowIndices[k]] = 1;
+            value.SetValue(numRows, numCols, value.GetDeviceId(), dense.data());
+        }
+    }
+
+    size_t m_minibatchSize;
+    size_t m_minSequenceLength;
+    size_t m_maxSequenceLength;
+    set<ComputationNodeBasePtr> m_oneHotNodes;
+    set<ComputationNodeBasePtr> m_drawnOnce;
+    mt19937 m_rng;
+    UniqueSequenceId m_nextSequenceId;
+    vector<pair<size_t, size_t>> m_placement; // temp buffers of InitAsPackedSequences()
+    vector<size_t> m_rowAllocations;
+};
+
+template <typename ElemType>
+void DoBenchmark(const ConfigParameters& config)
+{
+    // the network to measure, with its criterion and learning parameters from the SGD section as for training
+    vector<wstring> outputNodeNamesVector;
+    ComputationNetworkPtr net = GetModelFromConfig<ConfigParameters, ElemType>(config, L"outputNodeNames", outputNodeNamesVector);
+    ConfigParameters configSGD(config(L"SGD"));
+    SGD<ElemType> sgd(configSGD);
+    MPIWrapperPtr mpi = MPIWrapper::GetInstance();
+    sgd.InitMPI(mpi);
+
+    // as with distributed reading, each worker gets its share of the minibatch
+    intargvector mbSize = configSGD(L"minibatchSize", ConfigParameters::Array(intargvector(vector<int>{256})));
+    size_t numWorkers = mpi ? mpi->NumNodesInUse() : 1;
+    size_t minibatchSize = max((size_t) 1, ((size_t) mbSize[0] + numWorkers - 1) / numWorkers);
+
+    size_t sequenceLength = config(L"sequenceLength", (size_t) 1);
+    size_t minSequenceLength = config(L"minSequenceLength", sequenceLength);
+    size_t maxSequenceLength = config(L"maxSequenceLength", sequenceLength);
+    if (minSequenceLength == 0 || minSequenceLength > maxSequenceLength)
+        InvalidArgument("benchmark: minSequenceLength (%d) must be positive and not exceed maxSequenceLength (%d).", (int) minSequenceLength, (int) maxSequenceLength);
+    size_t numSteps = config(L"numSteps", (size_t) 100);
+    size_t numWarmupSteps = config(L"numWarmupSteps", (size_t) 10);
+    unsigned long randomSeed = config(L"randomSeed", (unsigned long) 1);
+
+    set<ComputationNodeBasePtr> oneHotNodes(net->LabelNodes().begin(), net->LabelNodes().end());
+    SyntheticInputs<ElemType> inputs(minibatchSize, minSequenceLength, maxSequenceLength, oneHotNodes,
+                                     randomSeed + (unsigned long) (mpi ? mpi->CurrentNodeRank() : 0));
+    LOGPRINTF(stderr, "benchmark: %d samples per worker in sequences of %d to %d steps.\n", (int) minibatchSize, (int) minSequenceLength, (int) maxSequenceLength);
+    sgd.Benchmark(net, [&inputs](const vector<ComputationNodeBasePtr>& inputNodes) { return inputs(inputNodes); }, numSteps, numWarmupSteps);
+}
+
+template void DoBenchmark<float>(const ConfigParameters& config);
+template void DoBenchmark<double>(const ConfigParameters& config);
+
 // ===========================================================================
 // DoAdapt() - implements CNTK "adapt" command
 // ===========================================================================
@@ -404,6 +404,30 @@ static ConfigValuePtr MakeEvaluateThunkPtr(const ExpressionPtr &expr, const ICon
 // main evaluator function (highly recursive)
 // -----------------------------------------------------------------------
 
+// the operations of Evaluate(), interned from Expression::op so that evaluating an expression does not compare strings
+enum OpCode
+{
+    opDouble, opString, opBool, opNew, opIf, opLambda, opApply, opRecord, opId, opMemberAccess,
+    opArrayConcat, opArrayConstructor, opArrayIndex, opUnaryPlus, opUnaryMinus, opNot,
+    opInfix // all others, looked up in infixOps[]
+};
+
+static OpCode GetOpCode(const Expression &e)
+{
+    if (e.opCode < 0)
+    {
+        static const map<wstring, OpCode> opCodes =
+        {
+            { L"d", opDouble }, { L"s", opString }, { L"b", opBool }, { L"new", opNew }, { L"if", opIf }, { L"=>", opLambda }, { L"(", opApply },
+            { L"[]", opRecord }, { L"id", opId }, { L".", opMemberAccess }, { L":", opArrayConcat }, { L"array", opArrayConstructor },
+            { L"[", opArrayIndex }, { L"+(", opUnaryPlus }, { L"-(", opUnaryMinus }, { L"!(", opNot }
+        };
+        let iter = opCodes.find(e.op);
+        e.opCode = iter != opCodes.end() ? iter->second : opInfix;
+    }
+    return (OpCode) e.opCode;
+}
+
 // Evaluate()
 //  - input:  expression
 //  - output: ConfigValuePtr that holds the evaluated value of the expression
@@ -429,13 +453,14 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
         if (trace)
             TextLocation::Trace(e->location, msra::strfun::wstrprintf(L"eval SP=0x%p", &exprPath).c_str(), e->op.c_str(), exprPath.c_str());
         // --- literals
-        if (e->op == L"d")
+        let op = GetOpCode(*e);
+        if (op == opDouble)
             return MakePrimitiveConfigValuePtr(e->d, MakeFailFn(e->location), exprPath); // === double literal
-        else if (e->op == L"s")
+        else if (op == opString)
             return ConfigValuePtr(make_shared<String>(e->s), MakeFailFn(e->location), exprPath); // === string literal
-        else if (e->op == L"b")
+        else if (op == opBool)
             return MakePrimitiveConfigValuePtr(e->b, MakeFailFn(e->location), exprPath); // === bool literal
-        else if (e->op == L"new")                                                        // === 'new' expression: instantiate C++ runtime object right here
+        else if (op == opNew)                                                        // === 'new' expression: instantiate C++ runtime object right here
         {
             // find the constructor lambda
             let rtInfo = FindRuntimeTypeInfo(e->id);
@@ -451,7 +476,7 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
                 valueWithName->SetName(value.GetExpressionName());
             return value; // we return the created but not initialized object as the value, so others can reference it
         }
-        else if (e->op == L"if") // === conditional expression
+        else if (op == opIf) // === conditional expression
         {
             let condition = ToBoolean(Evaluate(e->args[0], scope, exprPath, L"if"), e->args[0]);
             if (condition)
@@ -460,7 +485,7 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
                 return Evaluate(e->args[2], scope, exprPath, L"");
         }
         // --- functions
-        else if (e->op == L"=>") // === lambda (all macros are stored as lambdas)
+        else if (op == opLambda) // === lambda (all macros are stored as lambdas)
         {
             // on scope: The lambda expression remembers the lexical scope of the '=>'; this is how it captures its context.
             let &argListExpr = e->args[0]; // [0] = argument list ("()" expression of identifiers, possibly optional args)
@@ -536,7 +561,7 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
             }
             return ConfigValuePtr(make_shared<ConfigLambda>(move(paramNames), move(namedParams), f), MakeFailFn(e->location), exprPath);
         }
-        else if (e->op == L"(") // === apply a function to its arguments
+        else if (op == opApply) // === apply a function to its arguments
         {
             let &lambdaExpr = e->args[0]; // [0] = function
             let &argsExpr = e->args[1];   // [1] = arguments passed to the function ("()" expression of expressions)
@@ -584,7 +609,7 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
             return lambda->Apply(move(argVals), move(namedArgVals), exprPath);
         }
         // --- variable access
-        else if (e->op == L"[]") // === record (-> ConfigRecord)
+        else if (op == opRecord) // === record (-> ConfigRecord)
         {
             let newScope = make_shared<ConfigRecord>(scope, MakeFailFn(e->location)); // new scope: inside this record, all symbols from above are also visible
             // ^^ The failfn here will be used if C++ code uses operator[] to retrieve a value. It will report the text location where the record was defined.
@@ -604,15 +629,15 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
             // BUGBUG: wrong text location passed in. Should be the one of the identifier, not the RHS. NamedArgs store no location for their identifier.
             return ConfigValuePtr(newScope, MakeFailFn(e->location), exprPath);
         }
-        else if (e->op == L"id")
+        else if (op == opId)
             return ResolveIdentifier(e->id, e->location, scope); // === variable/macro access within current scope
-        else if (e->op == L".")                                  // === variable/macro access in given ConfigRecord element
+        else if (op == opMemberAccess)                                  // === variable/macro access in given ConfigRecord element
         {
             let &recordExpr = e->args[0];
             return RecordLookup(recordExpr, e->id, e->location, scope /*for evaluating recordExpr*/, exprPath);
         }
         // --- arrays
-        else if (e->op == L":") // === array expression (-> ConfigArray)
+        else if (op == opArrayConcat) // === array expression (-> ConfigArray)
         {
             // this returns a flattened list of all members as a ConfigArray type
             let arr = make_shared<ConfigArray>();       // note: we could speed this up by keeping the left arg and appending to it
@@ -623,7 +648,7 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
             }
             return ConfigValuePtr(arr, MakeFailFn(e->location), exprPath); // location will be that of the first ':', not sure if that is best way
         }
-        else if (e->op == L"array") // === array constructor from lambda function
+        else if (op == opArrayConstructor) // === array constructor from lambda function
         {
             let &firstIndexExpr = e->args[0]; // first index
             let &lastIndexExpr = e->args[1];  // last index
@@ -660,7 +685,7 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
             auto arr = make_shared<ConfigArray>(firstIndex, move(elementThunks));
             return ConfigValuePtr(arr, MakeFailFn(e->location), exprPath);
         }
-        else if (e->op == L"[") // === access array element by index
+        else if (op == opArrayIndex) // === access array element by index
         {
             let arrValue = Evaluate(e->args[0], scope, exprPath, L"_vector");
             let &indexExpr = e->args[1];
@@ -669,25 +694,25 @@ static ConfigValuePtr Evaluate(const ExpressionPtr &e, const IConfigRecordPtr &s
             return arr->At(index, MakeFailFn(indexExpr->location)); // note: the array element may be as of now unresolved; this resolved it
         }
         // --- unary operators '+' '-' and '!'
-        else if (e->op == L"+(" || e->op == L"-(") // === unary operators + and -
+        else if (op == opUnaryPlus || op == opUnaryMinus) // === unary operators + and -
         {
             let &argExpr = e->args[0];
-            let argValPtr = Evaluate(argExpr, scope, exprPath, e->op == L"+(" ? L"" : L"_negate");
+            let argValPtr = Evaluate(argExpr, scope, exprPath, op == opUnaryPlus ? L"" : L"_negate");
             // note on exprPath: since - has only one argument, we do not include it in the expessionPath
             if (argValPtr.Is<Double>())
-                if (e->op == L"+(")
+                if (op == opUnaryPlus)
                     return argValPtr;
                 else
                     return MakePrimitiveConfigValuePtr(-(double) argValPtr, MakeFailFn(e->location), exprPath);
             else if (argValPtr.Is<ComputationNodeObject>()) // -ComputationNode becomes NegateNode(arg)
-                if (e->op == L"+(")
+                if (op == opUnaryPlus)
                     return argValPtr;
                 else
                     return NodeOp(e, argValPtr, ConfigValuePtr(), scope, exprPath);
             else
                 Fail(L"operator '" + e->op.substr(0, 1) + L"' cannot be applied to this operand (which has type " + msra::strfun::utf16(argValPtr.TypeName()) + L")", e->location);
         }
-        else if (e->op == L"!(") // === unary operator !
+        else if (op == opNot) // === unary operator !
         {
             let arg = ToBoolean(Evaluate(e->args[0], scope, exprPath, L"_not"), e->args[0]);
             return MakePrimitiveConfigValuePtr(!arg, MakeFailFn(e->location), exprPath);
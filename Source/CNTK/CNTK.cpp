@@ -19,6 +19,7 @@
 #include "ModelEditLanguage.h"
 #include "CPUMatrix.h" // used for SetNumThreads()
 #include "CommonMatrix.h"
+#include "CuDnnAlgorithmCache.h"
 #include "SGD.h"
 #include "MPIWrapper.h"
 #include "Config.h"
@@ -26,6 +27,7 @@
 #include "SimpleOutputWriter.h"
 #include "BestGpu.h"
 #include "ProgressTracing.h"
+#include "Metrics.h"
 #include "fileutil.h"
 #include "ScriptableObjects.h"
 #include "BrainScriptEvaluator.h"
@@ -150,9 +152,40 @@ static void DisableLegacyUsage(const ConfigParameters& TopLevelConfig, const Con
     }
 }
 
+// binds the CPU threads of the main thread to a NUMA node, e.g. when running one process per socket
+static void BindThreadsToNumaNode(int numaNode)
+{
+    if (numaNode < 0)
+        return;
+    if (CPUNumaPlacement::BindThreadsToNode(numaNode))
+        LOGPRINTF(stderr, "Bound CPU threads to NUMA node %d.\n", numaNode);
+    else
+        LOGPRINTF(stderr, "Could not bind CPU threads to NUMA node %d (%d nodes).\n", numaNode, (int) CPUNumaPlacement::GetNumNodes());
+}
+
+// exports the runtime metrics (see Metrics.h); with several workers, each writes its own file and listens on its own port
+template <class ConfigRecordType>
+static void StartMetricsExport(const ConfigRecordType& config, const shared_ptr<MPIWrapper>& mpi)
+{
+    wstring metricsFile = config(L"metricsFile", L"");
+    int metricsPort = config(L"metricsPort", 0);
+    size_t metricsInterval = config(L"metricsInterval", (size_t) 10);
+    string labels;
+    if (mpi && mpi->NumNodesInUse() > 1)
+    {
+        int rank = (int) mpi->CurrentNodeRank();
+        if (!metricsFile.empty())
+            metricsFile += msra::strfun::wstrprintf(L".rank%d", rank);
+        if (metricsPort > 0)
+            metricsPort += rank;
+        labels = msra::strfun::strprintf("rank=\"%d\"", rank);
+    }
+    Metrics::StartExport(metricsFile, metricsPort, metricsInterval, labels);
+}
+
 // When running in parallel with MPI, only commands in 'commandstoRunOnAllRanks' should
 // be run in parallel across multiple ranks. Others should only run on rank 0
-const std::set<std::string> commandstoRunOnAllRanks = { "train", "trainRNN", "adapt", "test", "eval", "cv", "devtest" };
+const std::set<std::string> commandstoRunOnAllRanks = { "train", "trainRNN", "benchmark", "adapt", "test", "eval", "cv", "devtest", "write" };
 
 // process the command
 template <typename ElemType>
@@ -167,6 +200,7 @@ void DoCommands(const ConfigParameters& config, const shared_ptr<MPIWrapper>& mp
     {
         LOGPRINTF(stderr, "Using %d CPU threads.\n", numCPUThreads);
     }
+    BindThreadsToNumaNode(config(L"numaNode", "-1"));
 
     bool progressTracing = config(L"progressTracing", false);
 
@@ -241,6 +275,10 @@ void DoCommands(const ConfigParameters& config, const shared_ptr<MPIWrapper>& mp
                     LOGPRINTF(stderr, "CNTKCommandTrainEnd: %s\n", command[i].c_str());
                     fullEpochsOffset += GetMaxEpochs(commandParams);
                 }
+                else if (thisAction == "benchmark")
+                {
+                    DoBenchmark<ElemType>(commandParams);
+                }
                 else if (thisAction == "adapt")
                 {
                     DoAdapt<ElemType>(commandParams);
@@ -293,6 +331,10 @@ void DoCommands(const ConfigParameters& config, const shared_ptr<MPIWrapper>& mp
                 {
                     DoParameterSVD<ElemType>(commandParams);
                 }
+                else if (thisAction == "optimizeForInference")
+                {
+                    DoOptimizeForInference<ElemType>(commandParams);
+                }
                 else
                 {
                     RuntimeError("unknown action: %s  in command set: %s", thisAction.c_str(), command[i].c_str());
@@ -370,6 +412,30 @@ void PrintUsageInfo()
     LOGPRINTF(stderr, "-------------------------------------------------------------------\n");
 }
 
+// cuDNN autotuning results are reused across runs through a file, and shared with the other ranks through MPI.
+// Only the main node reads and appends to the file, so that concurrent ranks do not write it at the same time.
+static void OpenCuDnnAlgorithmCache(const wstring& path, const shared_ptr<MPIWrapper>& mpi)
+{
+    if (path.empty())
+        return;
+
+    bool isMainNode = !mpi || mpi->IsMainNode();
+    if (isMainNode)
+        CuDnnAlgorithmCache::Open(path, /*writable=*/true);
+
+    if (mpi && mpi->NumNodesInUse() > 1)
+    {
+        string contents = isMainNode ? CuDnnAlgorithmCache::Serialize() : string();
+        size_t size = contents.size();
+        mpi->Bcast(&size, 1, mpi->MainNodeRank());
+        contents.resize(size);
+        if (size > 0)
+            mpi->Bcast(&contents[0], size, mpi->MainNodeRank());
+        if (!isMainNode)
+            CuDnnAlgorithmCache::Deserialize(contents);
+    }
+}
+
 // ---------------------------------------------------------------------------
 // main() for use with BrainScript
 // ---------------------------------------------------------------------------
@@ -481,6 +547,13 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     g_shareNodeValueMatrices = config(L"shareNodeValueMatrices", false);
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
+    TracingGPUMemoryAllocator::SetCachingEnabled(config(L"cacheGPUMemoryAllocations", true));
+    GPUHalfPrecision::SetHalfPrecisionGEMM(config(L"halfPrecisionGEMM", false));
+    CPUNumaPlacement::SetPolicy(CPUNumaPlacement::Parse(config(L"numaPolicy", L"none")));
+    ComputationNetwork::SetNumConcurrentStreams(config(L"concurrentStreams", (size_t) 0));
+    ComputationNetwork::SetUseCompilationCache(config(L"compilationCache", false));
+    auto ensureMetricsExportStopped = MakeScopeExit(&Metrics::StopExport);
+    StartMetricsExport(config, mpi);
 
     // logging
     wstring logpath = config(L"stderr", L"");
@@ -499,12 +572,15 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     // echo config info to log
     PrintBuiltInfo();
 
+    OpenCuDnnAlgorithmCache(config(L"cudnnAlgorithmCache", L""), mpi);
+
     // execute the actions
     // std::string type = config(L"precision", "float");
     int numCPUThreads = config(L"numCPUThreads", 0);
     numCPUThreads = CPUMatrix<float /*any will do*/>::SetNumThreads(numCPUThreads);
     if (numCPUThreads > 0)
         LOGPRINTF(stderr, "Using %d CPU threads.\n", numCPUThreads);
+    BindThreadsToNumaNode(config(L"numaNode", -1));
 
     bool progressTracing = config(L"progressTracing", false);
     size_t fullTotalMaxEpochs = 1; // BUGBUG: BS does not allow me to read out the max epochs parameters, as that would instantiate and thus execute the objects
@@ -579,6 +655,13 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
     g_shareNodeValueMatrices = config(L"shareNodeValueMatrices", false);
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
+    TracingGPUMemoryAllocator::SetCachingEnabled(config(L"cacheGPUMemoryAllocations", true));
+    GPUHalfPrecision::SetHalfPrecisionGEMM(config(L"halfPrecisionGEMM", false));
+    CPUNumaPlacement::SetPolicy(CPUNumaPlacement::Parse(config(L"numaPolicy", L"none")));
+    ComputationNetwork::SetNumConcurrentStreams(config(L"concurrentStreams", (size_t) 0));
+    ComputationNetwork::SetUseCompilationCache(config(L"compilationCache", false));
+    auto ensureMetricsExportStopped = MakeScopeExit(&Metrics::StopExport);
+    StartMetricsExport(config, mpi);
 
     if (logpath != L"")
     {
@@ -599,6 +682,7 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
     }
 
     PrintBuiltInfo(); // this one goes to log file
+    OpenCuDnnAlgorithmCache(config(L"cudnnAlgorithmCache", L""), mpi);
     std::string timestamp = TimeDateStamp();
 
     // dump config info
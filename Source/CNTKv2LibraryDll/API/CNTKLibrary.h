@@ -17,6 +17,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <future>
+#include <limits>
 
 namespace CNTK
 {
@@ -85,6 +87,20 @@ namespace CNTK
         // TODO: FPGA
     };
 
+    ///
+    /// Counters of the caching allocator that the storage of NDArrayView objects and Function computations on a GPU device is allocated from.
+    /// A hit is an allocation served from a cached free buffer, a miss one that had to allocate memory from the device.
+    ///
+    struct DeviceMemoryCacheStatistics
+    {
+        size_t numHits;
+        size_t numMisses;
+        size_t numCachedBuffers; // free buffers currently held by the cache
+        size_t cachedBytes;      // bytes held by those buffers
+        size_t allocatedBytes;   // bytes of all buffers owned by the cache, in use or free
+        size_t peakInUseBytes;   // high-water mark of the bytes in use
+    };
+
     ///
     /// Denotes a compute device instance.
     ///
@@ -129,6 +145,21 @@ namespace CNTK
         ///
         CNTK_API static DeviceDescriptor DefaultDevice();
 
+        ///
+        /// Returns the counters of the caching allocator of 'this' device; all zero for the CPU device, whose allocations are not cached.
+        ///
+        CNTK_API DeviceMemoryCacheStatistics MemoryCacheStatistics() const;
+
+        ///
+        /// Returns the free buffers cached by the allocator of 'this' device to the device. Does nothing for the CPU device.
+        ///
+        CNTK_API void ReleaseCachedMemory() const;
+
+        ///
+        /// Static method to enable or disable (it is enabled by default) the caching of freed device buffers for reuse by later allocations on that device.
+        ///
+        CNTK_API static void SetMemoryCachingEnabled(bool enabled);
+
     private:
         DeviceDescriptor(unsigned int deviceId, DeviceType deviceType)
             : m_deviceId(deviceId), m_deviceType(deviceType)
@@ -297,8 +328,14 @@ namespace CNTK
     class CNTK_API NDArrayView final : public _Internal::_ReferenceCounter
     {
         friend class CompositeFunction;
+        friend class BuiltInLearner;
 
     public:
+        ///
+        /// Function called to release a user owned data buffer underlying NDArrayView objects, with the 'deleterContext' specified along with it.
+        ///
+        typedef void (*BufferDeleter)(void* dataBuffer, void* deleterContext);
+
         ///
         /// Construct a NDArrayView with the specified 'dataBuffer' as the backing storage.
         /// The 'dataBuffer' must have been allocated on the specified 'device', must be at least
@@ -306,6 +343,14 @@ namespace CNTK
         ///
         NDArrayView(CNTK::DataType dataType, const NDShape& viewShape, void* dataBuffer, size_t bufferSizeInBytes, const DeviceDescriptor& device, bool readOnly = false);
 
+        ///
+        /// Construct a NDArrayView with the specified user owned 'dataBuffer' as the backing storage, without copying it.
+        /// The 'dataBuffer' must have been allocated on the specified 'device' and must be at least as large as the total size of the specified 'viewShape'.
+        /// Once the created NDArrayView object and all its aliases are destructed, the 'deleter' is called with the 'dataBuffer' and 'deleterContext'.
+        /// A Value over the created view, supplied as a Function argument, is used by Forward in place when the data is dense and on the compute device.
+        ///
+        NDArrayView(CNTK::DataType dataType, const NDShape& viewShape, void* dataBuffer, size_t bufferSizeInBytes, const DeviceDescriptor& device, BufferDeleter deleter, void* deleterContext, bool readOnly = false);
+
         ///
         /// Construct a NDArrayView with newly allocated sparse storage in SparseCSC format on the specified 'device' and initialize its contents
         // with the specified Sparse CSC format data.
@@ -439,6 +484,28 @@ namespace CNTK
         ///
         void CopyFrom(const NDArrayView& source);
 
+        ///
+        /// Asynchronous variant of CopyFrom, which enqueues the copy and returns right away.
+        /// The copies involving a GPU device are issued one at a time and in order by a thread of that device's own, to a stream of its own;
+        /// copies between CPU views are carried out by a CPU copy thread. The returned future is ready once the copy has completed, or rethrows
+        /// the exception that it failed with. Both views must stay alive, and 'this' view must not be accessed, until then.
+        ///
+        std::future<void> CopyFromAsync(const NDArrayView& source)
+        {
+            NDArrayView* thisView = this;
+            const NDArrayView* sourceView = &source;
+            std::unique_ptr<std::packaged_task<void()>> task(new std::packaged_task<void()>([thisView, sourceView]() {
+                thisView->_CopyFromOnCopyStream(*sourceView);
+            }));
+            auto result = task->get_future();
+            _EnqueueCopyAsync(source, [](void* taskContext) {
+                std::unique_ptr<std::packaged_task<void()>> enqueuedTask((std::packaged_task<void()>*)taskContext);
+                (*enqueuedTask)();
+            }, task.get());
+            task.release();
+            return result;
+        }
+
         ///
         /// Static method to construct a new NDArrayView object whose contents are drawn from a normal distribution with the specified mean and standard deviation..
         ///
@@ -484,6 +551,11 @@ namespace CNTK
         void SetValue(float value);
         void SetValue(double value);
 
+        // Runs 'task(taskContext)' on the copy thread of the device of the copy of 'source' to 'this' view, after the copies enqueued there before
+        void _EnqueueCopyAsync(const NDArrayView& source, void (*task)(void* taskContext), void* taskContext);
+        // CopyFrom() on the copy thread, returning once the copy has completed on the stream of that thread
+        void _CopyFromOnCopyStream(const NDArrayView& source);
+
     private:
         CNTK::DataType m_dataType;
         DeviceDescriptor m_device;
@@ -492,6 +564,7 @@ namespace CNTK
         bool m_isReadOnly;
 
         void* m_tensorView;
+        void* m_externalBuffer; // the user owned buffer underlying 'this' view and its aliases, if any
     };
 
     ///
@@ -508,6 +581,14 @@ namespace CNTK
         /// 
         explicit NDMask(const NDShape& shape, const DeviceDescriptor& device = DeviceDescriptor::DefaultDevice());
 
+        ///
+        /// Construct a new Mask object of shape { maxNumTimeSteps, sequenceLengths.size() }, with the first 'sequenceLengths[i]' steps of each sequence 'i'
+        /// unmasked and its remaining ones masked.
+        /// As long as only trailing sections of a mask are masked, the mask is stored as these sequence lengths; the flags of its individual
+        /// elements are only materialized on the mask's device once a section that does not extend to the end of its sequences is masked.
+        ///
+        NDMask(const std::vector<size_t>& sequenceLengths, size_t maxNumTimeSteps, const DeviceDescriptor& device = DeviceDescriptor::DefaultDevice());
+
         ///
         /// Destruct 'this' mask object
         /// 
@@ -556,9 +637,13 @@ namespace CNTK
         void CopyFrom(const NDMask& source);
 
     private:
-        NDMask(const NDShape& shape, Microsoft::MSR::CNTK::Matrix<char>* matrix);
+        NDMask(const NDShape& shape, const DeviceDescriptor& device, void* state);
         Microsoft::MSR::CNTK::Matrix<char>* GetMatrix() const;
 
+        // Returns false, or true with the number of leading unmasked steps of each sequence, i.e. column, of 'this' mask
+        // if it is stored as such
+        bool GetSequenceLengths(std::vector<size_t>& sequenceLengths) const;
+
         // Disallow copy construction and assignment
         NDMask(const NDMask&) = delete;
         NDMask& operator=(const NDMask&) = delete;
@@ -571,7 +656,7 @@ namespace CNTK
         DeviceDescriptor m_device;
         NDShape m_maskShape;
 
-        Microsoft::MSR::CNTK::Matrix<char>* m_matrixView;
+        void* m_state; // the contents of 'this' mask, shared with its aliases
     };
 
     /// 
@@ -833,6 +918,7 @@ namespace CNTK
     {
         friend bool operator==(const Variable& first, const Variable& second);
         friend class Function;
+        friend class ModelSerializer;
 
         template <typename T>
         friend struct std::hash;
@@ -1314,6 +1400,40 @@ namespace CNTK
                 backPropagatedGradientValuesForInputs[iter->first] = abisSafeBackPropagatedGradientValuesForInputs[iter->first];
         }
 
+        ///
+        /// Asynchronous variant of Forward, which enqueues the computation and returns right away, letting the caller overlap other work with it.
+        /// The computations enqueued on a Function are carried out one at a time, in the order of enqueueing, on a thread of the Function's own.
+        /// The 'arguments' and 'outputsToRetainBackwardStateFor' are copied, and 'this' Function is kept alive until the computation is done. The 'outputs'
+        /// map however is filled in place and must neither be destructed nor accessed until the returned future is ready.
+        /// The future yields the BackPropState of the computation, or rethrows the exception that it failed with.
+        ///
+        std::future<BackPropStatePtr> ForwardAsync(const std::unordered_map<Variable, const ValuePtr>& arguments,
+                                                   std::unordered_map<Variable, ValuePtr>& outputs,
+                                                   const DeviceDescriptor& computeDevice = DeviceDescriptor::DefaultDevice(),
+                                                   const std::unordered_set<Variable>& outputsToRetainBackwardStateFor = {})
+        {
+            FunctionPtr thisFunction = this;
+            auto outputsPtr = &outputs;
+            return EnqueueAsync<BackPropStatePtr>([thisFunction, arguments, outputsPtr, computeDevice, outputsToRetainBackwardStateFor]() {
+                return thisFunction->Forward(arguments, *outputsPtr, computeDevice, outputsToRetainBackwardStateFor);
+            });
+        }
+
+        ///
+        /// Asynchronous variant of Backward, which enqueues the computation behind those enqueued on 'this' Function before and returns right away.
+        /// As with ForwardAsync, the 'backPropagatedGradientValuesForInputs' map is filled in place and must be left alone until the returned future is ready.
+        ///
+        std::future<void> BackwardAsync(const BackPropStatePtr& state,
+                                        const std::unordered_map<Variable, const ValuePtr>& rootGradientValues,
+                                        std::unordered_map<Variable, ValuePtr>& backPropagatedGradientValuesForInputs)
+        {
+            FunctionPtr thisFunction = this;
+            auto backPropagatedGradientValuesForInputsPtr = &backPropagatedGradientValuesForInputs;
+            return EnqueueAsync<void>([thisFunction, state, rootGradientValues, backPropagatedGradientValuesForInputsPtr]() {
+                thisFunction->Backward(state, rootGradientValues, *backPropagatedGradientValuesForInputsPtr);
+            });
+        }
+
     protected:
         // Mandatory methods to be overriden by new 'Function' types.
 
@@ -1335,6 +1455,7 @@ namespace CNTK
         ///
         virtual ~Function()
         {
+            _DeleteAsyncExecutor();
             delete[] m_name;
         }
 
@@ -1460,6 +1581,24 @@ namespace CNTK
         _Internal::_SimpleVector<Variable> _Inputs() const;
         virtual void _ReplacePlaceholders(const _Internal::_SimpleMap<Placeholder, Variable>& placeholderReplacements, _Internal::_SimpleSet<const Function*>& visitedFunctions, _Internal::_SimpleSet<Placeholder>& replacedPlaceholders);
 
+        // Wraps the 'computation' into a task handed to the thread of 'this' Function, and returns the future of its result
+        template <typename ResultType, typename Computation>
+        std::future<ResultType> EnqueueAsync(Computation&& computation)
+        {
+            std::unique_ptr<std::packaged_task<ResultType()>> task(new std::packaged_task<ResultType()>(std::forward<Computation>(computation)));
+            auto result = task->get_future();
+            _EnqueueAsync([](void* taskContext) {
+                std::unique_ptr<std::packaged_task<ResultType()>> enqueuedTask((std::packaged_task<ResultType()>*)taskContext);
+                (*enqueuedTask)();
+            }, task.get());
+            task.release();
+            return result;
+        }
+
+        // Runs 'task(taskContext)' on the thread of 'this' Function after the tasks enqueued before, starting the thread if not done yet
+        void _EnqueueAsync(void (*task)(void* taskContext), void* taskContext);
+        void _DeleteAsyncExecutor();
+
         // Disallow copy and move construction and assignment
         Function(const Function&) = delete;
         Function(Function&&) = delete;
@@ -1472,7 +1611,7 @@ namespace CNTK
         /// All 'inputs' specified must be Variables of type Constant, Parameter or Input.
         ///
         Function(const std::vector<Variable>& inputs, const std::vector<Variable>& outputs, const FunctionPtr& rootFunction = nullptr, const std::wstring& name = L"")
-            : m_rootFunction(rootFunction), m_name(nullptr)
+            : m_rootFunction(rootFunction), m_name(nullptr), m_asyncExecutor(nullptr)
         {
             for (size_t i = 0; i < inputs.size(); ++i)
             {
@@ -1517,6 +1656,7 @@ namespace CNTK
 
         FunctionPtr m_rootFunction;
         wchar_t* m_name;
+        void* m_asyncExecutor; // the thread running the computations of ForwardAsync/BackwardAsync, once started
     };
 #pragma warning(pop)
 
@@ -1582,6 +1722,12 @@ namespace CNTK
     ///
     CNTK_API FunctionPtr ReduceSum(const Variable& operand, const std::wstring& name = L"");
 
+    ///
+    /// Create an instance of the CNTK built-in stack of 'numLayers' LSTM or GRU layers of 'hiddenSize' cells each ('recurrentOp' is "lstm" or "gru"),
+    /// computed over the lone dynamic axis of the specified operand. 'weights' holds all weights and biases of the stack as one vector.
+    ///
+    CNTK_API FunctionPtr OptimizedRNNStack(const Variable& weights, const Variable& operand, size_t hiddenSize, size_t numLayers, bool bidirectional = false, const std::wstring& recurrentOp = L"lstm", const std::wstring& name = L"");
+
     ///
     /// Create a new Function instance which just combines the outputs of the specified list of 'operands' Functions such that the 'Outputs' of the 
     /// new 'Function' are union of the 'Outputs' of each of the specified 'operands' Functions.
@@ -1591,4 +1737,152 @@ namespace CNTK
         auto operandVector = _Internal::_SimpleVector<FunctionPtr>::CreateSimpleVector(operands);
         return _Combine(operandVector, name);
     }
+
+    ///
+    /// Save the graph of the specified Function, along with the values of all its Parameters and Constants, to 'modelFile' in a compact binary format.
+    /// The values are stored as one blob at the end of the file, with each of them aligned such that it can be used in place from a memory mapping of the file.
+    ///
+    CNTK_API void SaveModel(const FunctionPtr& rootFunction, const std::wstring& modelFile);
+
+    ///
+    /// Load a Function graph saved by SaveModel, with its Parameters and Constants located on the specified 'computeDevice'.
+    /// For the CPU device the file is memory-mapped and the values of the Parameters and Constants are views of the mapping, paged in
+    /// as they are used; for a GPU device they are copied straight from the mapping. Updates of loaded Parameters never change the file.
+    ///
+    CNTK_API FunctionPtr LoadModel(const std::wstring& modelFile, const DeviceDescriptor& computeDevice = DeviceDescriptor::DefaultDevice());
+
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+
+    ///
+    /// Abstraction for learning a subset of the Parameters of a Function from their gradients, as computed by Function::Backward.
+    /// The Parameter values are updated in place, on the device they are on, where a learner also keeps its per-Parameter state.
+    ///
+    class CNTK_API Learner : public _Internal::_ReferenceCounter
+    {
+    public:
+        ///
+        /// Update the Parameters of 'this' learner with the specified 'gradientValues' of a minibatch of 'trainingSampleCount' samples.
+        /// Parameters that have no gradient in 'gradientValues' are left unchanged. Returns a boolean indicating if any Parameter was updated.
+        ///
+        bool Update(const std::unordered_map<Variable, ValuePtr>& gradientValues, size_t trainingSampleCount)
+        {
+            auto abiSafeGradientValuesMap = _Internal::_SimpleMap<Variable, ValuePtr>::CreateSimpleMap(gradientValues);
+            return Update(abiSafeGradientValuesMap, trainingSampleCount);
+        }
+
+        ///
+        /// Returns the set of Parameters updated by 'this' learner.
+        ///
+        std::unordered_set<Parameter> Parameters() const
+        {
+            std::unordered_set<Parameter> parameters;
+            _Internal::_SimpleVector<Variable> parameterVector = m_parameters;
+            for (size_t i = 0; i < parameterVector.Size(); ++i)
+                parameters.insert(Parameter(parameterVector[i]));
+
+            return parameters;
+        }
+
+        ///
+        /// Destruct this Learner.
+        ///
+        virtual ~Learner()
+        {
+        }
+
+    protected:
+        ///
+        /// Protected constructor for derived 'Learner' types to specify the Parameters they update.
+        ///
+        Learner(const _Internal::_SimpleSet<Variable>& parameters)
+            : m_parameters(parameters)
+        {
+        }
+
+        virtual bool Update(const _Internal::_SimpleMap<Variable, ValuePtr>& gradientValues, size_t trainingSampleCount) = 0;
+
+        _Internal::_SimpleSet<Variable> m_parameters;
+
+    private:
+        // Disallow copy and move construction and assignment
+        Learner(const Learner&) = delete;
+        Learner(Learner&&) = delete;
+        Learner& operator=(const Learner&) = delete;
+        Learner& operator=(Learner&&) = delete;
+    };
+#pragma warning(pop)
+
+    ///
+    /// Options common to the built-in learners, with the meaning of the SGD options of CNTK with the same names.
+    /// As there, the weights and the threshold are per sample, and get multiplied with the number of samples of the minibatch.
+    ///
+    struct AdditionalLearningOptions
+    {
+        double l1RegularizationWeight = 0.0;
+        double l2RegularizationWeight = 0.0;
+        double gradientClippingThresholdPerSample = std::numeric_limits<double>::infinity();
+        bool gradientClippingWithTruncation = true;
+    };
+
+    CNTK_API LearnerPtr _SGDLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, const AdditionalLearningOptions& additionalOptions);
+    CNTK_API LearnerPtr _MomentumSGDLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, double momentumPerSample, bool useNesterovMomentum, const AdditionalLearningOptions& additionalOptions);
+    CNTK_API LearnerPtr _AdaGradLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, bool needAveMultiplier, const AdditionalLearningOptions& additionalOptions);
+    CNTK_API LearnerPtr _FSAdaGradLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, double momentumPerSample, const AdditionalLearningOptions& additionalOptions);
+    CNTK_API LearnerPtr _RMSPropLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, double gamma, double inc, double dec, double max, double min, bool needAveMultiplier, const AdditionalLearningOptions& additionalOptions);
+
+    inline _Internal::_SimpleSet<Variable> _LearnerParameters(const std::unordered_set<Parameter>& parameters)
+    {
+        _Internal::_SimpleSet<Variable> parameterSet;
+        for (auto iter = parameters.begin(); iter != parameters.end(); ++iter)
+            parameterSet.Insert(*iter);
+
+        return parameterSet;
+    }
+
+    ///
+    /// Create an instance of the CNTK built-in plain SGD learner.
+    ///
+    inline LearnerPtr SGDLearner(const std::unordered_set<Parameter>& parameters, double learningRatePerSample, const AdditionalLearningOptions& additionalOptions = AdditionalLearningOptions())
+    {
+        return _SGDLearner(_LearnerParameters(parameters), learningRatePerSample, additionalOptions);
+    }
+
+    ///
+    /// Create an instance of the CNTK built-in momentum SGD learner. The momentum is per sample, i.e. momentumPerSample^N for a minibatch of N samples.
+    /// Dense Parameters on the same device are updated together, with a few kernel launches for all of them.
+    ///
+    inline LearnerPtr MomentumSGDLearner(const std::unordered_set<Parameter>& parameters, double learningRatePerSample, double momentumPerSample, bool useNesterovMomentum = false,
+                                         const AdditionalLearningOptions& additionalOptions = AdditionalLearningOptions())
+    {
+        return _MomentumSGDLearner(_LearnerParameters(parameters), learningRatePerSample, momentumPerSample, useNesterovMomentum, additionalOptions);
+    }
+
+    ///
+    /// Create an instance of the CNTK built-in AdaGrad learner.
+    ///
+    inline LearnerPtr AdaGradLearner(const std::unordered_set<Parameter>& parameters, double learningRatePerSample, bool needAveMultiplier = true,
+                                     const AdditionalLearningOptions& additionalOptions = AdditionalLearningOptions())
+    {
+        return _AdaGradLearner(_LearnerParameters(parameters), learningRatePerSample, needAveMultiplier, additionalOptions);
+    }
+
+    ///
+    /// Create an instance of the CNTK built-in FSAdaGrad learner. Sparse gradients are updated with AdaGrad, as in CNTK's SGD.
+    ///
+    inline LearnerPtr FSAdaGradLearner(const std::unordered_set<Parameter>& parameters, double learningRatePerSample, double momentumPerSample,
+                                       const AdditionalLearningOptions& additionalOptions = AdditionalLearningOptions())
+    {
+        return _FSAdaGradLearner(_LearnerParameters(parameters), learningRatePerSample, momentumPerSample, additionalOptions);
+    }
+
+    ///
+    /// Create an instance of the CNTK built-in RMSProp learner, with the defaults of CNTK's SGD. Sparse gradients are updated with AdaGrad, as there.
+    ///
+    inline LearnerPtr RMSPropLearner(const std::unordered_set<Parameter>& parameters, double learningRatePerSample,
+                                     double gamma = 0.99, double inc = 1.2, double dec = 0.75, double max = 10.0, double min = 0.1, bool needAveMultiplier = true,
+                                     const AdditionalLearningOptions& additionalOptions = AdditionalLearningOptions())
+    {
+        return _RMSPropLearner(_LearnerParameters(parameters), learningRatePerSample, gamma, inc, dec, max, min, needAveMultiplier, additionalOptions);
+    }
 }
@@ -0,0 +1,85 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+namespace CNTK
+{
+    // A thread that carries out the tasks enqueued on it one at a time and in order, e.g. those of Function::ForwardAsync/BackwardAsync.
+    // If the executor is deleted by one of its own tasks (e.g. by releasing the last reference to the Function owning it), the thread
+    // is detached, and keeps the state it shares with the executor alive until it has run out of tasks.
+    class AsyncExecutor
+    {
+        struct State
+        {
+            State() : m_stop(false) {}
+
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::deque<std::pair<void (*)(void*), void*>> m_tasks;
+            bool m_stop;
+        };
+
+    public:
+        AsyncExecutor() : m_state(std::make_shared<State>())
+        {
+            auto state = m_state;
+            m_thread = std::thread([state]() { Run(*state); });
+        }
+
+        ~AsyncExecutor()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_state->m_mutex);
+                m_state->m_stop = true;
+            }
+            m_state->m_condition.notify_one();
+
+            if (m_thread.get_id() == std::this_thread::get_id())
+                m_thread.detach();
+            else
+                m_thread.join();
+        }
+
+        void Enqueue(void (*task)(void*), void* taskContext)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_state->m_mutex);
+                m_state->m_tasks.push_back(std::make_pair(task, taskContext));
+            }
+            m_state->m_condition.notify_one();
+        }
+
+    private:
+        static void Run(State& state)
+        {
+            for (;;)
+            {
+                std::pair<void (*)(void*), void*> task;
+                {
+                    std::unique_lock<std::mutex> lock(state.m_mutex);
+                    state.m_condition.wait(lock, [&state]() { return state.m_stop || !state.m_tasks.empty(); });
+                    if (state.m_tasks.empty())
+                        return;
+
+                    task = state.m_tasks.front();
+                    state.m_tasks.pop_front();
+                }
+
+                // The task reports its errors through its future
+                task.first(task.second);
+            }
+        }
+
+        std::shared_ptr<State> m_state;
+        std::thread m_thread;
+    };
+}
@@ -5,6 +5,9 @@
 
 #include "stdafx.h"
 #include "CNTKLibrary.h"
+#include "CommonMatrix.h"
+
+using namespace Microsoft::MSR::CNTK;
 
 namespace CNTK
 {
@@ -14,6 +17,34 @@ namespace CNTK
         return GPUDevice(0);
     }
 
+    DeviceMemoryCacheStatistics DeviceDescriptor::MemoryCacheStatistics() const
+    {
+        DeviceMemoryCacheStatistics statistics = {};
+        if (Type() == DeviceType::GPU)
+        {
+            auto cacheStatistics = TracingGPUMemoryAllocator::GetCacheStatistics(Id());
+            statistics.numHits = cacheStatistics.numHits;
+            statistics.numMisses = cacheStatistics.numMisses;
+            statistics.numCachedBuffers = cacheStatistics.numCachedBuffers;
+            statistics.cachedBytes = cacheStatistics.cachedBytes;
+            statistics.allocatedBytes = cacheStatistics.allocatedBytes;
+            statistics.peakInUseBytes = cacheStatistics.peakInUseBytes;
+        }
+
+        return statistics;
+    }
+
+    void DeviceDescriptor::ReleaseCachedMemory() const
+    {
+        if (Type() == DeviceType::GPU)
+            TracingGPUMemoryAllocator::ReleaseCachedMemory(Id());
+    }
+
+    /*static*/ void DeviceDescriptor::SetMemoryCachingEnabled(bool enabled)
+    {
+        TracingGPUMemoryAllocator::SetCachingEnabled(enabled);
+    }
+
     /*static*/ Axis Axis::DefaultDynamicAxis = Axis(L"defaultDynamicAxis");
     /*static*/ Axis Axis::BatchAxis = Axis(L"batchAxis");
     /*static*/ Axis Axis::AllAxes = Axis(L"allAxes");
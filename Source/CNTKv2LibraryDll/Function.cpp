@@ -10,6 +10,7 @@
 #include "Utils.h"
 #include "ComputationNode.h"
 #include "ReshapingNodes.h"
+#include "AsyncExecutor.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -17,6 +18,25 @@ bool g_shareNodeValueMatrices = true;
 
 namespace CNTK
 {
+    static std::mutex s_asyncExecutorCreationMutex;
+
+    void Function::_EnqueueAsync(void (*task)(void* taskContext), void* taskContext)
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_asyncExecutorCreationMutex);
+            if (m_asyncExecutor == nullptr)
+                m_asyncExecutor = new AsyncExecutor();
+        }
+
+        ((AsyncExecutor*)m_asyncExecutor)->Enqueue(task, taskContext);
+    }
+
+    void Function::_DeleteAsyncExecutor()
+    {
+        delete (AsyncExecutor*)m_asyncExecutor;
+        m_asyncExecutor = nullptr;
+    }
+
     _Internal::_SimpleVector<Variable> Function::_Inputs() const
     {
         const CompositeFunction* compositeFunction = dynamic_cast<const CompositeFunction*>(this);
@@ -179,6 +199,13 @@ namespace CNTK
                 computationNodePtr = builder.Sum(input0Node, function->Name());
                 break;
             }
+            case PrimitiveOpType::OptimizedRNNStack:
+            {
+                auto& functionConfig = primitiveFunction->FunctionConfig();
+                computationNodePtr = builder.OptimizedRNNStack(input0Node, input1Node, functionConfig[L"hiddenSize"].GetValue<size_t>(), functionConfig[L"numLayers"].GetValue<size_t>(),
+                                                               functionConfig[L"bidirectional"].GetValue<bool>(), functionConfig[L"useGRU"].GetValue<bool>() ? L"gru" : L"lstm", function->Name());
+                break;
+            }
             case PrimitiveOpType::Combine:
                 for (size_t i = 0; i < functionInputs.size(); ++i)
                     GetNode(functionInputs[i], network, builder, variableToNodeMap, isVariableRootMap);
@@ -210,15 +237,44 @@ namespace CNTK
     {
         if (m_computationNetwork != nullptr)
         {
-            // TODO: We should either invalidate and readapt the network if he backpropRoots change compared to what was specified when the network
-            // was last constructed, to just recreate a new network.
-            // For now just disallow changing the backpropRoots after the network is created
-            if (m_currentBackpropRoots != *backpropRoots.m_set)
-                LogicError("Changing backprop roots across different Forward calls on a CNTK composite Function is currently unsupported");
-
             // TODO: Support changing the device across different invocations of the forward method on a Function instance
+            // The LearnableParameter nodes of the network refer to the values of the Parameters in place, on their device
             if (AsDeviceDescriptor(m_computationNetwork->GetDeviceId()) != device)
                 LogicError("Changing device across different Forward calls on a CNTK composite Function is currently unsupported");
+
+            // Each set of backprop roots gets a network of its own; the current one is parked, and the one previously built
+            // for the new backprop roots, if any, is switched back to instead of building and compiling it anew.
+            // Changes of the batch size or sequence lengths need neither, since those are evaluated by the same network.
+            if (m_currentBackpropRoots != *backpropRoots.m_set)
+            {
+                // The parked network must not refer to the data of the Values of the last Forward call
+                UnbindNetworkInputs();
+
+                CachedComputationNetwork current;
+                current.m_variableToNodeMap = std::move(m_variableToNodeMap);
+                current.m_isVariableRootMap = std::move(m_isVariableRootMap);
+                current.m_computationNetwork = std::move(m_computationNetwork);
+                current.m_backpropRoots = std::move(m_currentBackpropRoots);
+                m_variableToNodeMap.clear();
+                m_isVariableRootMap.clear();
+                m_computationNetwork = nullptr;
+                m_currentBackpropRoots.clear();
+
+                auto cached = std::find_if(m_cachedComputationNetworks.begin(), m_cachedComputationNetworks.end(), [&backpropRoots](const CachedComputationNetwork& network)
+                {
+                    return network.m_backpropRoots == *backpropRoots.m_set;
+                });
+                if (cached != m_cachedComputationNetworks.end())
+                {
+                    m_variableToNodeMap = std::move(cached->m_variableToNodeMap);
+                    m_isVariableRootMap = std::move(cached->m_isVariableRootMap);
+                    m_computationNetwork = std::move(cached->m_computationNetwork);
+                    m_currentBackpropRoots = std::move(cached->m_backpropRoots);
+                    m_cachedComputationNetworks.erase(cached);
+                }
+
+                m_cachedComputationNetworks.push_back(std::move(current));
+            }
         }
 
         if (m_computationNetwork == nullptr)
@@ -350,7 +406,8 @@ namespace CNTK
         else
         {
             std::vector<size_t> sequenceLengths(numSequences, maxNumTimeSteps);
-            if (mask != nullptr)
+            // A mask stored as sequence lengths needs no scan of its flags
+            if ((mask != nullptr) && !mask->GetSequenceLengths(sequenceLengths))
             {
                 // Determine the sequence lengths from the mask
                 std::unique_ptr<char[]> maskData(mask->GetMatrix()->CopyToArray());
@@ -492,18 +549,59 @@ namespace CNTK
         // Create the mask if needed
         NDMaskPtr mask;
         if (!sequencesShorterThanLongestSequence.empty())
+            mask = NDMaskPtr(new NDMask(sequenceLengths, maxNumTimeSteps, AsDeviceDescriptor(matrix.GetDeviceId())), [](_ReferenceCounter* ptr) { delete ptr; });
+
+        auto tensorView = new TensorView<ElementType>(shuffledMatrixData, AsTensorShape(valueDataShape));
+        auto data = NDArrayViewPtr(new NDArrayView(AsDataType<ElementType>(), AsDeviceDescriptor(matrix.GetDeviceId()), StorageFormat::Dense, valueDataShape, true, tensorView), [](_ReferenceCounter* ptr) { delete ptr; });
+        return ValuePtr(new Value(data, mask), [](_ReferenceCounter* ptr) { delete ptr; });
+    }
+
+    template <typename ElementType>
+    MBLayoutPtr CompositeFunction::PopulateNetworkInput(const Variable& argument, const ValuePtr& argumentValue, const ComputationNodeBasePtr& argumentComputationNode)
+    {
+        auto CNTKMatrixAndMBLayout = GetCNTKImplMatrixAndMBLayoutFromValueObject<ElementType>(argument, argumentValue);
+        auto& nodeData = argumentComputationNode->As<ComputationNode<ElementType>>()->Value();
+
+        // Dense data in a user owned buffer on the device of the network, that needs no reshuffling into the CNTK layout,
+        // is used as the value of the input node in place; the Value is kept alive for as long as the node refers to it
+        auto argumentData = argumentValue->Data();
+        if ((argumentData->m_externalBuffer != nullptr) && !argumentData->IsSparse() &&
+            (CNTKMatrixAndMBLayout.first->GetDeviceId() == nodeData.GetDeviceId()) &&
+            (CNTKMatrixAndMBLayout.first->Data() == argumentData->GetMatrix<ElementType>()->Data()))
         {
-            mask = NDMaskPtr(new NDMask({ maxNumTimeSteps, numSequences }, AsDeviceDescriptor(matrix.GetDeviceId())), [](_ReferenceCounter* ptr) { delete ptr; });
-            for (size_t i = 0; i < sequencesShorterThanLongestSequence.size(); ++i)
+            nodeData = CNTKMatrixAndMBLayout.first->AsReference();
+            m_boundArgumentValues[argument] = argumentValue;
+            return CNTKMatrixAndMBLayout.second;
+        }
+
+        // Give the node a matrix of its own again before copying, if it referred to the data of a Value before
+        if (m_boundArgumentValues.erase(argument) > 0)
+            nodeData = Matrix<ElementType>(nodeData.GetDeviceId());
+
+        // Switch the node matrix to the right matrix type
+        nodeData.SwitchToMatrixType(CNTKMatrixAndMBLayout.first->GetMatrixType(), CNTKMatrixAndMBLayout.first->GetFormat(), false);
+        nodeData.AssignValuesOf(*CNTKMatrixAndMBLayout.first);
+        return CNTKMatrixAndMBLayout.second;
+    }
+
+    void CompositeFunction::UnbindNetworkInputs()
+    {
+        for (auto iter = m_boundArgumentValues.begin(); iter != m_boundArgumentValues.end(); ++iter)
+        {
+            auto argumentComputationNode = m_variableToNodeMap[iter->first];
+            if (iter->second->Data()->GetDataType() == DataType::Float)
+            {
+                auto& nodeData = argumentComputationNode->As<ComputationNode<float>>()->Value();
+                nodeData = Matrix<float>(nodeData.GetDeviceId());
+            }
+            else
             {
-                size_t shorterSequenceIdx = sequencesShorterThanLongestSequence[i];
-                mask->MaskSection({ sequenceLengths[shorterSequenceIdx], shorterSequenceIdx }, { NDShape::InferredDimension, 1 });
+                auto& nodeData = argumentComputationNode->As<ComputationNode<double>>()->Value();
+                nodeData = Matrix<double>(nodeData.GetDeviceId());
             }
         }
 
-        auto tensorView = new TensorView<ElementType>(shuffledMatrixData, AsTensorShape(valueDataShape));
-        auto data = NDArrayViewPtr(new NDArrayView(AsDataType<ElementType>(), AsDeviceDescriptor(matrix.GetDeviceId()), StorageFormat::Dense, valueDataShape, true, tensorView), [](_ReferenceCounter* ptr) { delete ptr; });
-        return ValuePtr(new Value(data, mask), [](_ReferenceCounter* ptr) { delete ptr; });
+        m_boundArgumentValues.clear();
     }
 
     void CompositeFunction::PopulateNetworkInputs(const _Internal::_SimpleMap<Variable, const ValuePtr>& arguments)
@@ -525,27 +623,11 @@ namespace CNTK
             switch (argumentValue->Data()->GetDataType())
             {
             case DataType::Float:
-            {
-                auto CNTKMatrixAndMBLayout = GetCNTKImplMatrixAndMBLayoutFromValueObject<float>(*iter, argumentValue);
-                layout = CNTKMatrixAndMBLayout.second;
-
-                auto& nodeData = argumentComputationNode->As<ComputationNode<float>>()->Value();
-                // Switch the node matrix to the right matrix type
-                nodeData.SwitchToMatrixType(CNTKMatrixAndMBLayout.first->GetMatrixType(), CNTKMatrixAndMBLayout.first->GetFormat(), false);
-                nodeData.AssignValuesOf(*CNTKMatrixAndMBLayout.first);
+                layout = PopulateNetworkInput<float>(*iter, argumentValue, argumentComputationNode);
                 break;
-            }
             case DataType::Double:
-            {
-                auto CNTKMatrixAndMBLayout = GetCNTKImplMatrixAndMBLayoutFromValueObject<double>(*iter, argumentValue);
-                layout = CNTKMatrixAndMBLayout.second;
-
-                auto& nodeData = argumentComputationNode->As<ComputationNode<double>>()->Value();
-                // Switch the node matrix to the right matrix type
-                nodeData.SwitchToMatrixType(CNTKMatrixAndMBLayout.first->GetMatrixType(), CNTKMatrixAndMBLayout.first->GetFormat(), false);
-                nodeData.AssignValuesOf(*CNTKMatrixAndMBLayout.first);
+                layout = PopulateNetworkInput<double>(*iter, argumentValue, argumentComputationNode);
                 break;
-            }
             default:
                 LogicError("Unsupported DataType %s", DataTypeName(argumentValue->Data()->GetDataType()));
                 break;
@@ -917,4 +999,20 @@ namespace CNTK
     {
         return CompositeFunction::Create(new PrimitiveFunction(PrimitiveOpType::ReduceSum, { operand }, Dictionary(), name), name);
     }
+
+    FunctionPtr OptimizedRNNStack(const Variable& weights, const Variable& operand, size_t hiddenSize, size_t numLayers, bool bidirectional/* = false*/, const std::wstring& recurrentOp/* = L"lstm"*/, const std::wstring& name/* = L""*/)
+    {
+        if ((recurrentOp != L"lstm") && (recurrentOp != L"gru"))
+            InvalidArgument("OptimizedRNNStack: Unknown recurrent operation '%ls', must be 'lstm' or 'gru'", recurrentOp.c_str());
+
+        if (operand.DynamicAxes().size() != 1)
+            InvalidArgument("OptimizedRNNStack can only be used for operands with exactly one dynamic axis");
+
+        auto additionalProperties = Dictionary();
+        additionalProperties[L"hiddenSize"] = DictionaryValue(hiddenSize);
+        additionalProperties[L"numLayers"] = DictionaryValue(numLayers);
+        additionalProperties[L"bidirectional"] = DictionaryValue(bidirectional);
+        additionalProperties[L"useGRU"] = DictionaryValue(recurrentOp == L"gru");
+        return CompositeFunction::Create(new PrimitiveFunction(PrimitiveOpType::OptimizedRNNStack, { weights, operand }, std::move(additionalProperties), name), name);
+    }
 }
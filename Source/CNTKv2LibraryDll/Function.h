@@ -24,7 +24,8 @@ namespace CNTK
         PastValue,
         FutureValue,
         ElementTimes,
-        ReduceSum
+        ReduceSum,
+        OptimizedRNNStack
     };
 
     inline const char* PrimitiveOpTypeName(PrimitiveOpType opType)
@@ -53,6 +54,8 @@ namespace CNTK
             return "ElementTimes";
         else if (opType == PrimitiveOpType::ReduceSum)
             return "ReduceSum";
+        else if (opType == PrimitiveOpType::OptimizedRNNStack)
+            return "OptimizedRNNStack";
         else
             LogicError("Unknown PrimitiveOpType");
     }
@@ -61,7 +64,7 @@ namespace CNTK
     {
     public:
         PrimitiveFunction(PrimitiveOpType op, const std::vector<Variable>& inputs, Dictionary&& functionConfig, const std::wstring& functionName = L"")
-            : Function(inputs, GetOutputVariables(op, inputs, this), nullptr, functionName), m_op(op), m_functionConfig(std::move(functionConfig))
+            : Function(inputs, GetOutputVariables(op, inputs, functionConfig, this), nullptr, functionName), m_op(op), m_functionConfig(std::move(functionConfig))
         {
         }
 
@@ -166,7 +169,7 @@ namespace CNTK
             return NDShape(std::move(outputDims));
         }
 
-        static std::vector<Variable> GetOutputVariables(PrimitiveOpType op, const std::vector<Variable>& inputs, Function* owner)
+        static std::vector<Variable> GetOutputVariables(PrimitiveOpType op, const std::vector<Variable>& inputs, const Dictionary& functionConfig, Function* owner)
         {
             std::vector<Variable> outputs;
 
@@ -243,6 +246,15 @@ namespace CNTK
                 outputs.push_back(Variable(ReductionOpOutputShape(op, inputs[0].Shape(), reductionAxes), outputDataType, owner, reductionOutputDynamicAxes));
                 break;
             }
+            case PrimitiveOpType::OptimizedRNNStack:
+            {
+                assert(inputs.size() == 2);
+
+                // The output (the hidden state of all directions of the top layer) has the dynamic axes of the operand, not of the weights
+                size_t numDirections = functionConfig[L"bidirectional"].GetValue<bool>() ? 2 : 1;
+                outputs.push_back(Variable(NDShape({ numDirections * functionConfig[L"hiddenSize"].GetValue<size_t>() }), inputs[1].GetDataType(), owner, inputs[1].DynamicAxes()));
+                break;
+            }
             case PrimitiveOpType::Combine:
                 outputs = inputs;
                 break;
@@ -350,6 +362,14 @@ namespace CNTK
         static Microsoft::MSR::CNTK::ComputationNodeBasePtr GetNode(const Variable& variable, Microsoft::MSR::CNTK::ComputationNetworkPtr& network, Microsoft::MSR::CNTK::ComputationNetworkBuilder<ElementType>& builder, std::unordered_map<Variable, Microsoft::MSR::CNTK::ComputationNodeBasePtr>& variableToNodeMap, std::unordered_map<Variable, bool>& isVariableRootMap);
 
         void PopulateNetworkInputs(const _Internal::_SimpleMap<Variable, const ValuePtr>& arguments);
+
+        // Returns the MBLayout of the argument
+        template <typename ElementType>
+        Microsoft::MSR::CNTK::MBLayoutPtr PopulateNetworkInput(const Variable& argument, const ValuePtr& argumentValue, const Microsoft::MSR::CNTK::ComputationNodeBasePtr& argumentComputationNode);
+
+        // Gives the input nodes that refer to the data of argument Values matrices of their own again
+        void UnbindNetworkInputs();
+
         void PopulateNetworkGradients(const _Internal::_SimpleMap<Variable, const ValuePtr>& gradients);
 
         void GetNetworkOutputs(std::unordered_map<Variable, ValuePtr>& outputs);
@@ -367,5 +387,19 @@ namespace CNTK
         std::unordered_map<Variable, bool> m_isVariableRootMap;
         Microsoft::MSR::CNTK::ComputationNetworkPtr m_computationNetwork;
         std::unordered_set<Variable> m_currentBackpropRoots;
+
+        // Arguments of the last Forward call whose data the input nodes of the network refer to in place
+        std::unordered_map<Variable, ValuePtr> m_boundArgumentValues;
+
+        // A network built for other backprop roots than the current ones, kept compiled and with its matrices allocated,
+        // to be switched back to when Forward is called with those backprop roots again
+        struct CachedComputationNetwork
+        {
+            std::unordered_map<Variable, Microsoft::MSR::CNTK::ComputationNodeBasePtr> m_variableToNodeMap;
+            std::unordered_map<Variable, bool> m_isVariableRootMap;
+            Microsoft::MSR::CNTK::ComputationNetworkPtr m_computationNetwork;
+            std::unordered_set<Variable> m_backpropRoots;
+        };
+        std::vector<CachedComputationNetwork> m_cachedComputationNetworks;
     };
 }
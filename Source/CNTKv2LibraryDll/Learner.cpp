@@ -0,0 +1,304 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CNTKLibrary.h"
+#include "Utils.h"
+#include "Matrix.h"
+#include <cmath>
+#include <map>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace CNTK
+{
+    // The built-in learners implement the weight updates of CNTK's SGD (see SGD<ElemType>::UpdateWeightsS()), with the same
+    // per-sample semantics of the learning rate, momentum, regularization weights and clipping threshold. The Parameter values
+    // are updated in place through their Matrix, on the device the Parameter is on, where the learner also keeps the smoothed gradients.
+    // Like in SGD, the specified gradients are modified by clipping and L2 regularization.
+    class BuiltInLearner final : public Learner
+    {
+    public:
+        enum class UpdateType
+        {
+            SGD,
+            AdaGrad,
+            FSAdaGrad,
+            RmsProp
+        };
+
+        struct RmsPropParameters
+        {
+            double gamma = 0.99;
+            double inc = 1.2;
+            double dec = 0.75;
+            double max = 10.0;
+            double min = 0.1;
+        };
+
+        BuiltInLearner(const _Internal::_SimpleSet<Variable>& parameters, UpdateType updateType, double learningRatePerSample, double momentumPerSample,
+                       bool useNesterovMomentum, bool needAveMultiplier, const RmsPropParameters& rmsPropParameters, const AdditionalLearningOptions& additionalOptions)
+            : Learner(parameters), m_updateType(updateType), m_learningRatePerSample(learningRatePerSample), m_momentumPerSample(momentumPerSample),
+              m_useNesterovMomentum(useNesterovMomentum), m_needAveMultiplier(needAveMultiplier), m_rmsPropParameters(rmsPropParameters), m_additionalOptions(additionalOptions)
+        {
+            if (parameters.Size() == 0)
+                InvalidArgument("A learner needs at least one Parameter to update");
+
+            if (learningRatePerSample < 0)
+                InvalidArgument("The learning rate of a learner must not be negative");
+
+            if ((momentumPerSample < 0) || (momentumPerSample >= 1))
+                InvalidArgument("The momentum per sample of a learner must be in [0, 1)");
+
+            // Allocate the smoothed gradients up front, on the device of their Parameter, like SGD does before the first epoch
+            _Internal::_SimpleVector<Variable> parameterVector = parameters;
+            for (size_t i = 0; i < parameterVector.Size(); ++i)
+            {
+                Parameter parameter(parameterVector[i]);
+                auto value = parameter.Value();
+                switch (value->GetDataType())
+                {
+                case DataType::Float:
+                    m_smoothedGradients[parameter] = CreateSmoothedGradient<float>(value);
+                    break;
+                case DataType::Double:
+                    m_smoothedGradients[parameter] = CreateSmoothedGradient<double>(value);
+                    break;
+                default:
+                    LogicError("Unsupported DataType %s", DataTypeName(value->GetDataType()));
+                    break;
+                }
+            }
+        }
+
+    protected:
+        bool Update(const _Internal::_SimpleMap<Variable, ValuePtr>& gradientValues, size_t trainingSampleCount) override
+        {
+            if (trainingSampleCount == 0)
+                InvalidArgument("The number of training samples of a minibatch must be positive");
+
+            // Dense gradients of SGD and momentum SGD are updated together, with one fused update per device and data type
+            std::map<DEVICEID_TYPE, MultiTensorUpdate<float>> floatUpdates;
+            std::map<DEVICEID_TYPE, MultiTensorUpdate<double>> doubleUpdates;
+
+            bool anyParameterUpdated = false;
+            _Internal::_SimpleVector<Variable> parameterVector = m_parameters;
+            for (size_t i = 0; i < parameterVector.Size(); ++i)
+            {
+                Parameter parameter(parameterVector[i]);
+                if (!gradientValues.Contains(parameter))
+                    continue;
+
+                auto gradientValue = gradientValues[parameter];
+                if (gradientValue == nullptr)
+                    continue;
+
+                auto value = parameter.Value();
+                auto gradient = gradientValue->Data();
+                if (gradient->Shape() != value->Shape())
+                    InvalidArgument("The gradient of a Parameter must have the shape of the Parameter");
+
+                if (gradient->GetDataType() != value->GetDataType())
+                    InvalidArgument("The gradient of a Parameter must have the DataType of the Parameter");
+
+                switch (value->GetDataType())
+                {
+                case DataType::Float:
+                    ScheduleUpdate<float>(parameter, *value, *gradient, trainingSampleCount, floatUpdates);
+                    break;
+                case DataType::Double:
+                    ScheduleUpdate<double>(parameter, *value, *gradient, trainingSampleCount, doubleUpdates);
+                    break;
+                default:
+                    LogicError("Unsupported DataType %s", DataTypeName(value->GetDataType()));
+                    break;
+                }
+
+                anyParameterUpdated = true;
+            }
+
+            ApplyMultiTensorUpdates(floatUpdates, trainingSampleCount);
+            ApplyMultiTensorUpdates(doubleUpdates, trainingSampleCount);
+
+            return anyParameterUpdated;
+        }
+
+    private:
+        template <typename ElementType>
+        struct MultiTensorUpdate
+        {
+            std::vector<std::shared_ptr<Matrix<ElementType>>> m_matrices; // keeps the views of the values and gradients alive
+            std::vector<Matrix<ElementType>*> m_smoothedGradients;
+            std::vector<Matrix<ElementType>*> m_gradients;
+            std::vector<Matrix<ElementType>*> m_values;
+            std::vector<ElementType> m_learningRatesPerSample;
+        };
+
+        template <typename ElementType>
+        static std::shared_ptr<MatrixBase> CreateSmoothedGradient(const NDArrayViewPtr& value)
+        {
+            auto valueMatrix = value->GetMatrix<ElementType>();
+            auto smoothedGradient = std::make_shared<Matrix<ElementType>>(valueMatrix->GetNumRows(), valueMatrix->GetNumCols(), AsCNTKImplDeviceId(value->Device()));
+            smoothedGradient->SetValue(0);
+            return smoothedGradient;
+        }
+
+        // we use simple linear (instead of log linear) scaling here, as SGD's MomentumPerMB()
+        static double MomentumPerMB(double momentumPerSample, size_t minibatchSize)
+        {
+            return pow(momentumPerSample, minibatchSize);
+        }
+
+        template <typename ElementType>
+        void ScheduleUpdate(const Parameter& parameter, NDArrayView& value, NDArrayView& gradient, size_t trainingSampleCount, std::map<DEVICEID_TYPE, MultiTensorUpdate<ElementType>>& multiTensorUpdates)
+        {
+            auto valueMatrix = value.GetWritableMatrix<ElementType>();
+            auto gradientMatrix = gradient.GetWritableMatrix<ElementType>();
+            auto smoothedGradientMatrix = std::static_pointer_cast<Matrix<ElementType>>(m_smoothedGradients.at(parameter));
+
+            if ((m_updateType == UpdateType::SGD) && (gradientMatrix->GetMatrixType() == MatrixType::DENSE))
+            {
+                // this is applied after all Parameters were visited, see ApplyMultiTensorUpdates()
+                auto& multiTensorUpdate = multiTensorUpdates[valueMatrix->GetDeviceId()];
+                multiTensorUpdate.m_matrices.push_back(valueMatrix);
+                multiTensorUpdate.m_matrices.push_back(gradientMatrix);
+                multiTensorUpdate.m_smoothedGradients.push_back(smoothedGradientMatrix.get());
+                multiTensorUpdate.m_gradients.push_back(gradientMatrix.get());
+                multiTensorUpdate.m_values.push_back(valueMatrix.get());
+                multiTensorUpdate.m_learningRatesPerSample.push_back((ElementType)m_learningRatePerSample);
+                return;
+            }
+
+            UpdateParameter(*valueMatrix, *gradientMatrix, *smoothedGradientMatrix, trainingSampleCount);
+        }
+
+        template <typename ElementType>
+        void ApplyMultiTensorUpdates(std::map<DEVICEID_TYPE, MultiTensorUpdate<ElementType>>& multiTensorUpdates, size_t trainingSampleCount) const
+        {
+            // as in UpdateWeightsS() and ClipGradient(), the regularization weights and clipping threshold are per minibatch
+            for (auto& deviceUpdate : multiTensorUpdates)
+            {
+                auto& multiTensorUpdate = deviceUpdate.second;
+                Matrix<ElementType>::MultiTensorNormalGrad(multiTensorUpdate.m_smoothedGradients, multiTensorUpdate.m_gradients, multiTensorUpdate.m_values, multiTensorUpdate.m_learningRatesPerSample,
+                                                           (ElementType)MomentumPerMB(m_momentumPerSample, trainingSampleCount), m_useNesterovMomentum,
+                                                           (ElementType)(m_additionalOptions.gradientClippingThresholdPerSample * trainingSampleCount), m_additionalOptions.gradientClippingWithTruncation,
+                                                           (ElementType)(m_additionalOptions.l2RegularizationWeight * trainingSampleCount), (ElementType)(m_additionalOptions.l1RegularizationWeight * trainingSampleCount));
+            }
+        }
+
+        // the update of a single Parameter, as SGD<ElemType>::UpdateWeightsS()
+        template <typename ElementType>
+        void UpdateParameter(Matrix<ElementType>& value, Matrix<ElementType>& gradient, Matrix<ElementType>& smoothedGradient, size_t trainingSampleCount) const
+        {
+            const double momentum = MomentumPerMB(m_momentumPerSample, trainingSampleCount);
+            const bool isSparseGradient = (gradient.GetMatrixType() == MatrixType::SPARSE);
+
+            // clipping gradients to prevent outliers
+            if (m_additionalOptions.gradientClippingThresholdPerSample != std::numeric_limits<double>::infinity())
+            {
+                double maxGradientPerMB = m_additionalOptions.gradientClippingThresholdPerSample * trainingSampleCount;
+                if (m_additionalOptions.gradientClippingWithTruncation)
+                    gradient.InplaceTruncate((ElementType)maxGradientPerMB);
+                else
+                {
+                    // norm2 normalized
+                    double gradientNorm = gradient.FrobeniusNorm();
+                    if (gradientNorm > maxGradientPerMB)
+                        gradient *= (ElementType)(maxGradientPerMB / gradientNorm);
+                }
+            }
+
+            // L2 regularizer; a block-sparse gradient stays sparse, so that only the columns seen in the minibatch decay
+            if (m_additionalOptions.l2RegularizationWeight > 0)
+            {
+                if (isSparseGradient)
+                    Matrix<ElementType>::ScaleAndAddOnSparseBlocks((ElementType)(m_additionalOptions.l2RegularizationWeight * trainingSampleCount), value, gradient);
+                else
+                    Matrix<ElementType>::ScaleAndAdd((ElementType)(m_additionalOptions.l2RegularizationWeight * trainingSampleCount), value, gradient);
+            }
+
+            if (m_updateType == UpdateType::SGD)
+            {
+                smoothedGradient.NormalGrad(gradient, value, (ElementType)m_learningRatePerSample, (ElementType)momentum, m_useNesterovMomentum);
+            }
+            else if ((m_updateType == UpdateType::AdaGrad) || isSparseGradient)
+            {
+                // rmsprop and fsadagrad for sparse are not implemented yet, delegate them to adagrad
+                double aveMultiplier = smoothedGradient.Adagrad(gradient, m_needAveMultiplier);
+                Matrix<ElementType>::ScaleAndAdd((ElementType)(-m_learningRatePerSample / aveMultiplier), gradient, value);
+            }
+            else if (m_updateType == UpdateType::FSAdaGrad)
+            {
+                smoothedGradient.FSAdagrad(trainingSampleCount, gradient, value, (ElementType)m_learningRatePerSample, (ElementType)momentum);
+            }
+            else if (m_updateType == UpdateType::RmsProp)
+            {
+                double aveMultiplier = smoothedGradient.RmsProp(gradient, (ElementType)m_rmsPropParameters.gamma, (ElementType)m_rmsPropParameters.inc, (ElementType)m_rmsPropParameters.max,
+                                                                (ElementType)m_rmsPropParameters.dec, (ElementType)m_rmsPropParameters.min, m_needAveMultiplier);
+                Matrix<ElementType>::ScaleAndAdd((ElementType)(-m_learningRatePerSample / aveMultiplier), gradient, value);
+            }
+
+            // L1 regularizer with proximal gradient descent method
+            if (m_additionalOptions.l1RegularizationWeight > 0)
+                value.InplaceSoftThreshold((ElementType)(m_learningRatePerSample * m_additionalOptions.l1RegularizationWeight * trainingSampleCount));
+        }
+
+    private:
+        UpdateType m_updateType;
+        double m_learningRatePerSample;
+        double m_momentumPerSample;
+        bool m_useNesterovMomentum;
+        bool m_needAveMultiplier;
+        RmsPropParameters m_rmsPropParameters;
+        AdditionalLearningOptions m_additionalOptions;
+
+        std::unordered_map<Variable, std::shared_ptr<MatrixBase>> m_smoothedGradients;
+    };
+
+    static LearnerPtr CreateBuiltInLearner(const _Internal::_SimpleSet<Variable>& parameters, BuiltInLearner::UpdateType updateType, double learningRatePerSample, double momentumPerSample, bool useNesterovMomentum,
+                                           bool needAveMultiplier, const BuiltInLearner::RmsPropParameters& rmsPropParameters, const AdditionalLearningOptions& additionalOptions)
+    {
+        return LearnerPtr(new BuiltInLearner(parameters, updateType, learningRatePerSample, momentumPerSample, useNesterovMomentum, needAveMultiplier, rmsPropParameters, additionalOptions),
+                          [](_Internal::_ReferenceCounter* ptr) { delete ptr; });
+    }
+
+    LearnerPtr _SGDLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, const AdditionalLearningOptions& additionalOptions)
+    {
+        return CreateBuiltInLearner(parameters, BuiltInLearner::UpdateType::SGD, learningRatePerSample, /*momentumPerSample =*/ 0.0, /*useNesterovMomentum =*/ false,
+                                    /*needAveMultiplier =*/ false, BuiltInLearner::RmsPropParameters(), additionalOptions);
+    }
+
+    LearnerPtr _MomentumSGDLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, double momentumPerSample, bool useNesterovMomentum, const AdditionalLearningOptions& additionalOptions)
+    {
+        return CreateBuiltInLearner(parameters, BuiltInLearner::UpdateType::SGD, learningRatePerSample, momentumPerSample, useNesterovMomentum,
+                                    /*needAveMultiplier =*/ false, BuiltInLearner::RmsPropParameters(), additionalOptions);
+    }
+
+    LearnerPtr _AdaGradLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, bool needAveMultiplier, const AdditionalLearningOptions& additionalOptions)
+    {
+        return CreateBuiltInLearner(parameters, BuiltInLearner::UpdateType::AdaGrad, learningRatePerSample, /*momentumPerSample =*/ 0.0, /*useNesterovMomentum =*/ false,
+                                    needAveMultiplier, BuiltInLearner::RmsPropParameters(), additionalOptions);
+    }
+
+    LearnerPtr _FSAdaGradLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, double momentumPerSample, const AdditionalLearningOptions& additionalOptions)
+    {
+        return CreateBuiltInLearner(parameters, BuiltInLearner::UpdateType::FSAdaGrad, learningRatePerSample, momentumPerSample, /*useNesterovMomentum =*/ false,
+                                    /*needAveMultiplier =*/ true, BuiltInLearner::RmsPropParameters(), additionalOptions);
+    }
+
+    LearnerPtr _RMSPropLearner(const _Internal::_SimpleSet<Variable>& parameters, double learningRatePerSample, double gamma, double inc, double dec, double max, double min,
+                               bool needAveMultiplier, const AdditionalLearningOptions& additionalOptions)
+    {
+        BuiltInLearner::RmsPropParameters rmsPropParameters;
+        rmsPropParameters.gamma = gamma;
+        rmsPropParameters.inc = inc;
+        rmsPropParameters.dec = dec;
+        rmsPropParameters.max = max;
+        rmsPropParameters.min = min;
+
+        return CreateBuiltInLearner(parameters, BuiltInLearner::UpdateType::RmsProp, learningRatePerSample, /*momentumPerSample =*/ 0.0, /*useNesterovMomentum =*/ false,
+                                    needAveMultiplier, rmsPropParameters, additionalOptions);
+    }
+}
@@ -10,6 +10,8 @@
 #include "Matrix.h"
 #include <algorithm>
 #include "TensorShape.h"
+#include "AsyncExecutor.h"
+#include <map>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -81,9 +83,36 @@ namespace CNTK
         }
     }
 
+    // A user owned buffer underlying NDArrayView objects; handed to its deleter, if any, once the last of the views is destructed
+    struct ExternalBuffer
+    {
+        ExternalBuffer(void* dataBuffer, NDArrayView::BufferDeleter deleter, void* deleterContext)
+            : m_dataBuffer(dataBuffer), m_deleter(deleter), m_deleterContext(deleterContext)
+        {
+        }
+
+        ~ExternalBuffer()
+        {
+            if (m_deleter != nullptr)
+                m_deleter(m_dataBuffer, m_deleterContext);
+        }
+
+        void* m_dataBuffer;
+        NDArrayView::BufferDeleter m_deleter;
+        void* m_deleterContext;
+    };
+
+    typedef std::shared_ptr<ExternalBuffer> ExternalBufferPtr;
+
     NDArrayView::NDArrayView(CNTK::DataType dataType, const NDShape& viewShape, void* dataBuffer, size_t bufferSizeInBytes, const DeviceDescriptor& device, bool readOnly/* = false*/)
+        : NDArrayView(dataType, viewShape, dataBuffer, bufferSizeInBytes, device, nullptr, nullptr, readOnly)
+    {
+    }
+
+    NDArrayView::NDArrayView(CNTK::DataType dataType, const NDShape& viewShape, void* dataBuffer, size_t bufferSizeInBytes, const DeviceDescriptor& device, BufferDeleter deleter, void* deleterContext, bool readOnly/* = false*/)
         : NDArrayView(dataType, device, StorageFormat::Dense, viewShape, readOnly, AllocateTensorView(dataType, viewShape, device, dataBuffer, bufferSizeInBytes))
     {
+        m_externalBuffer = new ExternalBufferPtr(std::make_shared<ExternalBuffer>(dataBuffer, deleter, deleterContext));
     }
 
     template <typename ElementType>
@@ -99,7 +128,7 @@ namespace CNTK
     }
 
     NDArrayView::NDArrayView(CNTK::DataType dataType, const DeviceDescriptor& device, CNTK::StorageFormat storageType, const NDShape& viewShape, bool readOnly, void* tensorView)
-        : m_dataType(dataType), m_device(device), m_storageFormat(storageType), m_viewShape(viewShape), m_isReadOnly(readOnly), m_tensorView(tensorView)
+        : m_dataType(dataType), m_device(device), m_storageFormat(storageType), m_viewShape(viewShape), m_isReadOnly(readOnly), m_tensorView(tensorView), m_externalBuffer(nullptr)
     {
     }
 
@@ -138,6 +167,8 @@ namespace CNTK
             LogicError("Unsupported DataType %s", DataTypeName(m_dataType));
             break;
         }
+
+        delete (ExternalBufferPtr*)m_externalBuffer;
     }
 
     template <typename ElementType>
@@ -269,6 +300,54 @@ namespace CNTK
         }
     }
 
+    // The thread and stream that the copies of NDArrayView::CopyFromAsync involving a device are issued from and to.
+    // The queues are never deleted, so that no copy thread has to be joined while the process exits.
+    struct CopyQueue
+    {
+        CopyQueue(const DeviceDescriptor& device)
+            : m_stream((device.Type() == DeviceType::GPU) ? new GPUStream(AsCNTKImplDeviceId(device)) : nullptr)
+        {
+            if (m_stream)
+                m_executor.Enqueue([](void* stream) { ((const GPUStream*)stream)->MakeCurrent(); }, m_stream.get());
+        }
+
+        std::unique_ptr<GPUStream> m_stream;
+        AsyncExecutor m_executor;
+    };
+
+    // The GPU device of a copy between two views, or the CPU for a copy between CPU views
+    static DeviceDescriptor CopyDevice(const NDArrayView& target, const NDArrayView& source)
+    {
+        return (target.Device().Type() == DeviceType::GPU) ? target.Device() : source.Device();
+    }
+
+    static CopyQueue& GetCopyQueue(const DeviceDescriptor& device)
+    {
+        static std::mutex s_copyQueuesMutex;
+        static std::map<std::pair<DeviceType, unsigned int>, CopyQueue*> s_copyQueues;
+
+        std::lock_guard<std::mutex> lock(s_copyQueuesMutex);
+        auto& copyQueue = s_copyQueues[std::make_pair(device.Type(), device.Id())];
+        if (copyQueue == nullptr)
+            copyQueue = new CopyQueue(device);
+
+        return *copyQueue;
+    }
+
+    void NDArrayView::_EnqueueCopyAsync(const NDArrayView& source, void (*task)(void* taskContext), void* taskContext)
+    {
+        GetCopyQueue(CopyDevice(*this, source)).m_executor.Enqueue(task, taskContext);
+    }
+
+    void NDArrayView::_CopyFromOnCopyStream(const NDArrayView& source)
+    {
+        CopyFrom(source);
+
+        auto& copyQueue = GetCopyQueue(CopyDevice(*this, source));
+        if (copyQueue.m_stream)
+            copyQueue.m_stream->Synchronize();
+    }
+
     NDArrayViewPtr NDArrayView::Alias(bool readOnly/* = false*/) const
     {
         void* tensorView = nullptr;
@@ -286,6 +365,9 @@ namespace CNTK
         }
 
         auto aliasView = new NDArrayView(GetDataType(), Device(), GetStorageFormat(), Shape(), IsReadOnly() || readOnly, tensorView);;
+        if (m_externalBuffer != nullptr)
+            aliasView->m_externalBuffer = new ExternalBufferPtr(*(ExternalBufferPtr*)m_externalBuffer);
+
         return NDArrayViewPtr(aliasView, [](_ReferenceCounter* ptr) { delete ptr; });
     }
 
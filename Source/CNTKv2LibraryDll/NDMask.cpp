@@ -14,30 +14,63 @@ using namespace Microsoft::MSR::CNTK;
 
 namespace CNTK
 {
-    static Matrix<char>* AllocateMatrix(const NDShape& viewShape, const DeviceDescriptor& device)
+    // The contents of a mask and its aliases. As long as only trailing sections of the sequences (columns) have been masked, these are the
+    // numbers of leading unmasked steps of the sequences, and the matrix of the flags of the elements is only filled in from them when asked for.
+    struct MaskState
     {
-        auto matrixDims = GetMatrixDimensions(viewShape);
-        auto maskMatrix = new Matrix<char>(matrixDims.first, matrixDims.second, AsCNTKImplDeviceId(device));
-        maskMatrix->SetValue(1);
+        MaskState(size_t numRows, size_t numCols, const DeviceDescriptor& device)
+            : m_numRows(numRows), m_device(device), m_sequenceLengths(numCols, numRows), m_hasSequenceLengths(true), m_isMatrixUpToDate(false)
+        {
+        }
+
+        size_t m_numRows;
+        DeviceDescriptor m_device;
+        std::vector<size_t> m_sequenceLengths;
+        bool m_hasSequenceLengths;
+        std::unique_ptr<Matrix<char>> m_matrix; // null until first asked for
+        bool m_isMatrixUpToDate;                // whether m_matrix reflects m_sequenceLengths
+    };
+
+    typedef std::shared_ptr<MaskState> MaskStatePtr;
+
+    static MaskStatePtr& GetState(void* state)
+    {
+        return *(MaskStatePtr*)state;
+    }
 
-        return maskMatrix;
+    static void* AllocateState(const NDShape& shape, const DeviceDescriptor& device)
+    {
+        auto matrixDims = GetMatrixDimensions(shape);
+        return new MaskStatePtr(std::make_shared<MaskState>(matrixDims.first, matrixDims.second, device));
     }
 
-    NDMask::NDMask(const NDShape& shape, Matrix<char>* matrix)
-        : m_device(AsDeviceDescriptor(matrix->GetDeviceId())), m_maskShape(shape), m_matrixView(matrix)
+    NDMask::NDMask(const NDShape& shape, const DeviceDescriptor& device, void* state)
+        : m_device(device), m_maskShape(shape), m_state(state)
     {
     }
 
     NDMask::NDMask(const NDShape& shape, const DeviceDescriptor& device/* = DeviceDescriptor::DefaultDevice()*/)
-        : NDMask(shape, AllocateMatrix(shape, device))
+        : NDMask(shape, device, AllocateState(shape, device))
     {
         if (shape.NumAxes() > 2)
             LogicError("NDMask instances with more than 2 axes are currently unsupported");
     }
 
+    NDMask::NDMask(const std::vector<size_t>& sequenceLengths, size_t maxNumTimeSteps, const DeviceDescriptor& device/* = DeviceDescriptor::DefaultDevice()*/)
+        : NDMask({ maxNumTimeSteps, sequenceLengths.size() }, device)
+    {
+        for (size_t i = 0; i < sequenceLengths.size(); ++i)
+        {
+            if (sequenceLengths[i] > maxNumTimeSteps)
+                InvalidArgument("NDMask: The sequence length %d exceeds the maximum number of time steps %d of the mask", (int)sequenceLengths[i], (int)maxNumTimeSteps);
+        }
+
+        GetState(m_state)->m_sequenceLengths = sequenceLengths;
+    }
+
     NDMask::~NDMask()
     {
-        delete m_matrixView;
+        delete (MaskStatePtr*)m_state;
     }
 
     void NDMask::MaskSection(const std::vector<size_t>& sectionOffset, const NDShape& sectionShape)
@@ -57,11 +90,26 @@ namespace CNTK
 
         NDShape shape = sectionShape.AppendShape(NDShape(m_maskShape.NumAxes() - sectionShape.NumAxes(), NDShape::InferredDimension));
 
-        auto maskMatrix = GetMatrix();
+        auto& state = GetState(m_state);
+        auto matrixDims = GetMatrixDimensions(m_maskShape);
         size_t rowOffset = offset[0];
         size_t colOffset = offset[1];
-        size_t sliceRowLength = (shape[0] != NDShape::InferredDimension) ? shape[0] : (maskMatrix->GetNumRows() - rowOffset);
-        size_t sliceColLength = (shape[1] != NDShape::InferredDimension) ? shape[1] : (maskMatrix->GetNumCols() - colOffset);
+        size_t sliceRowLength = (shape[0] != NDShape::InferredDimension) ? shape[0] : (matrixDims.first - rowOffset);
+        size_t sliceColLength = (shape[1] != NDShape::InferredDimension) ? shape[1] : (matrixDims.second - colOffset);
+
+        // A section reaching to the end of its sequences just shortens them
+        if (state->m_hasSequenceLengths && ((rowOffset + sliceRowLength) == matrixDims.first))
+        {
+            for (size_t i = colOffset; i < (colOffset + sliceColLength); ++i)
+                state->m_sequenceLengths[i] = (std::min)(state->m_sequenceLengths[i], rowOffset);
+
+            state->m_isMatrixUpToDate = false;
+            return;
+        }
+
+        // Otherwise the mask is stored as the flags of its elements from now on
+        auto maskMatrix = GetMatrix();
+        state->m_hasSequenceLengths = false;
         if ((rowOffset == 0) && (sliceRowLength == maskMatrix->GetNumRows()))
             maskMatrix->ColumnSlice(colOffset, sliceColLength).SetValue(0);
         else
@@ -78,12 +126,45 @@ namespace CNTK
 
     void NDMask::Clear()
     {
-        GetMatrix()->SetValue(1);
+        auto& state = GetState(m_state);
+        std::fill(state->m_sequenceLengths.begin(), state->m_sequenceLengths.end(), state->m_numRows);
+        state->m_hasSequenceLengths = true;
+        state->m_isMatrixUpToDate = false;
     }
 
     Matrix<char>* NDMask::GetMatrix() const
     {
-        return m_matrixView;
+        auto& state = GetState(m_state);
+        if (state->m_matrix == nullptr)
+        {
+            auto matrixDims = GetMatrixDimensions(m_maskShape);
+            state->m_matrix.reset(new Matrix<char>(matrixDims.first, matrixDims.second, AsCNTKImplDeviceId(m_device)));
+        }
+
+        if (state->m_hasSequenceLengths && !state->m_isMatrixUpToDate)
+        {
+            // Fill in the flags on the host, and upload them in one go
+            size_t numRows = state->m_numRows;
+            size_t numCols = state->m_sequenceLengths.size();
+            std::vector<char> flags(numRows * numCols, 0);
+            for (size_t i = 0; i < numCols; ++i)
+                std::fill(flags.begin() + (i * numRows), flags.begin() + (i * numRows) + state->m_sequenceLengths[i], (char)1);
+
+            state->m_matrix->SetValue(numRows, numCols, state->m_matrix->GetDeviceId(), flags.data(), matrixFlagNormal);
+            state->m_isMatrixUpToDate = true;
+        }
+
+        return state->m_matrix.get();
+    }
+
+    bool NDMask::GetSequenceLengths(std::vector<size_t>& sequenceLengths) const
+    {
+        auto& state = GetState(m_state);
+        if (!state->m_hasSequenceLengths)
+            return false;
+
+        sequenceLengths = state->m_sequenceLengths;
+        return true;
     }
 
     void NDMask::CopyFrom(const NDMask& source)
@@ -91,7 +172,17 @@ namespace CNTK
         if (source.Shape() != Shape())
             InvalidArgument("NDMask::CopyFrom: The 'source' mask's shape must be same as the shape of this NDMask");
 
-        GetMatrix()->AssignValuesOf(*source.GetMatrix());
+        auto& state = GetState(m_state);
+        if (source.GetSequenceLengths(state->m_sequenceLengths))
+        {
+            state->m_hasSequenceLengths = true;
+            state->m_isMatrixUpToDate = false;
+        }
+        else
+        {
+            state->m_hasSequenceLengths = false;
+            GetMatrix()->AssignValuesOf(*source.GetMatrix());
+        }
     }
 
     NDMaskPtr NDMask::DeepClone() const
@@ -104,6 +195,6 @@ namespace CNTK
 
     NDMaskPtr NDMask::Alias() const
     {
-        return NDMaskPtr(new NDMask(this->Shape(), new Matrix<char>(GetMatrix()->AsReference())), [](_ReferenceCounter* ptr) { delete ptr; });
+        return NDMaskPtr(new NDMask(this->Shape(), this->Device(), new MaskStatePtr(GetState(m_state))), [](_ReferenceCounter* ptr) { delete ptr; });
     }
 }
@@ -0,0 +1,543 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Serialization.cpp -- SaveModel() and LoadModel(), the binary model format of the v2 library
+//
+// A model file consists of
+//  - a ModelFileHeader,
+//  - the table of the leaf Variables of the graph (Inputs, Parameters, Constants and Placeholders),
+//  - the table of the primitive Functions of the graph in topological order, each referring to its inputs
+//    either as an entry of the Variable table or as an output of a preceding Function, and
+//  - the blob holding the values of the Parameters and Constants, each of them aligned to s_valueAlignment bytes.
+// All numbers are stored in the byte order of the saving machine, strings as UTF-8.
+//
+
+#include "stdafx.h"
+#include "CNTKLibrary.h"
+#include "Function.h"
+#include "Utils.h"
+#include "fileutil.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace CNTK
+{
+    static const char s_modelFileMagic[8] = { 'C', 'N', 'T', 'K', 'v', '2', 'M', 'F' };
+    static const uint32_t s_modelFileVersion = 1;
+    static const size_t s_valueAlignment = 64;
+
+    struct ModelFileHeader
+    {
+        char m_magic[8];
+        uint32_t m_version;
+        uint32_t m_reserved;
+        uint64_t m_tablesSize;   // of the Variable and Function tables following the header
+        uint64_t m_valuesOffset; // of the blob of Parameter and Constant values, from the start of the file
+        uint64_t m_valuesSize;
+    };
+
+    enum class InputReferenceKind : uint32_t
+    {
+        Variable,
+        FunctionOutput
+    };
+
+    static size_t AlignedSize(size_t size)
+    {
+        return (size + s_valueAlignment - 1) / s_valueAlignment * s_valueAlignment;
+    }
+
+    // appends the fields of the tables to a buffer
+    class ModelTableWriter
+    {
+    public:
+        template <typename T>
+        void Write(const T& value)
+        {
+            static_assert(std::is_pod<T>::value, "ModelTableWriter::Write can only write plain data");
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            m_buffer.insert(m_buffer.end(), bytes, bytes + sizeof(T));
+        }
+
+        void WriteString(const std::wstring& value)
+        {
+            std::string utf8Value = msra::strfun::utf8(value);
+            Write<uint64_t>(utf8Value.size());
+            m_buffer.insert(m_buffer.end(), utf8Value.begin(), utf8Value.end());
+        }
+
+        void WriteShape(const NDShape& shape)
+        {
+            Write<uint64_t>(shape.NumAxes());
+            for (size_t i = 0; i < shape.NumAxes(); ++i)
+                Write<uint64_t>(shape[i]);
+        }
+
+        void WriteDictionaryValue(const DictionaryValue& value)
+        {
+            Write<uint32_t>((uint32_t)value.ValueType());
+            switch (value.ValueType())
+            {
+            case DictionaryValue::Type::None:
+                break;
+            case DictionaryValue::Type::Bool:
+                Write<uint8_t>(value.GetValue<bool>() ? 1 : 0);
+                break;
+            case DictionaryValue::Type::SizeT:
+                Write<uint64_t>(value.GetValue<size_t>());
+                break;
+            case DictionaryValue::Type::Double:
+                Write<double>(value.GetValue<double>());
+                break;
+            case DictionaryValue::Type::NDShape:
+                WriteShape(value.GetValue<NDShape>());
+                break;
+            default:
+                LogicError("SaveModel: Function configuration entries of type %s cannot be saved", DictionaryValue::TypeName(value.ValueType()));
+            }
+        }
+
+        const std::vector<char>& Buffer() const
+        {
+            return m_buffer;
+        }
+
+    private:
+        std::vector<char> m_buffer;
+    };
+
+    // reads the fields of the tables from a memory range, failing on reads past its end
+    class ModelTableReader
+    {
+    public:
+        ModelTableReader(const char* begin, const char* end, const std::wstring& modelFile)
+            : m_current(begin), m_end(end), m_modelFile(modelFile)
+        {
+        }
+
+        template <typename T>
+        T Read()
+        {
+            T value;
+            memcpy(&value, Advance(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::wstring ReadString()
+        {
+            size_t size = (size_t)Read<uint64_t>();
+            const char* chars = Advance(size);
+            return msra::strfun::utf16(std::string(chars, size));
+        }
+
+        NDShape ReadShape()
+        {
+            std::vector<size_t> dimensions((size_t)Read<uint64_t>());
+            for (size_t i = 0; i < dimensions.size(); ++i)
+                dimensions[i] = (size_t)Read<uint64_t>();
+
+            return dimensions;
+        }
+
+        DictionaryValue ReadDictionaryValue()
+        {
+            auto valueType = (DictionaryValue::Type)Read<uint32_t>();
+            switch (valueType)
+            {
+            case DictionaryValue::Type::None:
+                return DictionaryValue();
+            case DictionaryValue::Type::Bool:
+                return DictionaryValue(Read<uint8_t>() != 0);
+            case DictionaryValue::Type::SizeT:
+                return DictionaryValue((size_t)Read<uint64_t>());
+            case DictionaryValue::Type::Double:
+                return DictionaryValue(Read<double>());
+            case DictionaryValue::Type::NDShape:
+                return DictionaryValue(ReadShape());
+            default:
+                RuntimeError("LoadModel: The model file '%ls' has a Function configuration entry of unknown type %u", m_modelFile.c_str(), (unsigned int)valueType);
+            }
+        }
+
+    private:
+        const char* Advance(size_t size)
+        {
+            if (size > (size_t)(m_end - m_current))
+                RuntimeError("LoadModel: The model file '%ls' is truncated or corrupt", m_modelFile.c_str());
+
+            const char* data = m_current;
+            m_current += size;
+            return data;
+        }
+
+        const char* m_current;
+        const char* m_end;
+        const std::wstring& m_modelFile;
+    };
+
+    // copy-on-write memory mapping of a model file: the loaded Parameters can be updated in place without changing the file
+    class ModelFileMapping
+    {
+    public:
+        explicit ModelFileMapping(const std::wstring& modelFile)
+            : m_data(nullptr), m_size(0)
+        {
+#ifdef _WIN32
+            m_file = CreateFileW(modelFile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (m_file == INVALID_HANDLE_VALUE)
+                RuntimeError("LoadModel: Cannot open the model file '%ls', error %x", modelFile.c_str(), (unsigned int)GetLastError());
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_file, &size))
+            {
+                CloseHandle(m_file);
+                RuntimeError("LoadModel: Cannot retrieve the size of the model file '%ls'", modelFile.c_str());
+            }
+
+            m_size = (size_t)size.QuadPart;
+            m_mapping = (m_size > 0) ? CreateFileMapping(m_file, NULL, PAGE_WRITECOPY, 0, 0, NULL) : NULL;
+            if (m_mapping != NULL)
+                m_data = (char*)MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0);
+
+            if (m_data == nullptr)
+            {
+                if (m_mapping != NULL)
+                    CloseHandle(m_mapping);
+
+                CloseHandle(m_file);
+                RuntimeError("LoadModel: Cannot memory-map the model file '%ls'", modelFile.c_str());
+            }
+#else
+            m_file = open(msra::strfun::utf8(modelFile).c_str(), O_RDONLY);
+            if (m_file == -1)
+                RuntimeError("LoadModel: Cannot open the model file '%ls'", modelFile.c_str());
+
+            struct stat info;
+            if (fstat(m_file, &info) == -1)
+            {
+                close(m_file);
+                RuntimeError("LoadModel: Cannot retrieve the size of the model file '%ls'", modelFile.c_str());
+            }
+
+            m_size = (size_t)info.st_size;
+            void* data = (m_size > 0) ? mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, m_file, 0) : MAP_FAILED;
+            if (data == MAP_FAILED)
+            {
+                close(m_file);
+                RuntimeError("LoadModel: Cannot memory-map the model file '%ls'", modelFile.c_str());
+            }
+
+            m_data = (char*)data;
+#endif
+        }
+
+        ~ModelFileMapping()
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(m_data);
+            CloseHandle(m_mapping);
+            CloseHandle(m_file);
+#else
+            munmap(m_data, m_size);
+            close(m_file);
+#endif
+        }
+
+        char* Data() const
+        {
+            return m_data;
+        }
+
+        size_t Size() const
+        {
+            return m_size;
+        }
+
+    private:
+        ModelFileMapping(const ModelFileMapping&) = delete;
+        ModelFileMapping& operator=(const ModelFileMapping&) = delete;
+
+        char* m_data;
+        size_t m_size;
+#ifdef _WIN32
+        HANDLE m_file;
+        HANDLE m_mapping;
+#else
+        int m_file;
+#endif
+    };
+
+    typedef std::shared_ptr<ModelFileMapping> ModelFileMappingPtr;
+
+    // NDArrayView::BufferDeleter of the views of a mapping; each of them holds a reference to the mapping as its context
+    static void ReleaseModelFileMapping(void* /*dataBuffer*/, void* deleterContext)
+    {
+        delete (ModelFileMappingPtr*)deleterContext;
+    }
+
+    class ModelSerializer
+    {
+    public:
+        static void Save(const FunctionPtr& rootFunction, const std::wstring& modelFile)
+        {
+            ModelSerializer serializer;
+            serializer.AddFunction(rootFunction->RootFunction());
+
+            ModelTableWriter tables;
+            size_t valuesSize = 0;
+            tables.Write<uint64_t>(serializer.m_variables.size());
+            for (auto& variable : serializer.m_variables)
+            {
+                tables.Write<uint32_t>((uint32_t)variable.Kind());
+                tables.Write<uint32_t>((uint32_t)variable.GetDataType());
+                tables.WriteShape(variable.Shape());
+                tables.WriteString(variable.Name());
+                tables.Write<uint8_t>(variable.NeedsGradient() ? 1 : 0);
+                tables.Write<uint8_t>(variable.m_dataFields->m_isSparse ? 1 : 0);
+
+                auto dynamicAxes = variable.DynamicAxes();
+                tables.Write<uint64_t>(dynamicAxes.size());
+                for (auto& axis : dynamicAxes)
+                    tables.WriteString(axis.Name());
+
+                if (variable.IsParameter() || variable.IsConstant())
+                {
+                    auto value = variable.Value();
+                    if (value->IsSparse())
+                        InvalidArgument("SaveModel: The value of '%ls' is sparse; only dense Parameter and Constant values can be saved", variable.Name().c_str());
+
+                    tables.Write<uint64_t>(valuesSize);
+                    valuesSize += AlignedSize(value->Shape().TotalSize() * ElementSize(value->GetDataType()));
+                }
+            }
+
+            tables.Write<uint64_t>(serializer.m_functions.size());
+            for (auto& function : serializer.m_functions)
+            {
+                auto primitiveFunction = dynamic_cast<PrimitiveFunction*>(function.GetPtr());
+                tables.Write<uint32_t>((uint32_t)primitiveFunction->OpType());
+                tables.WriteString(primitiveFunction->Name());
+
+                auto inputs = primitiveFunction->Inputs();
+                tables.Write<uint64_t>(inputs.size());
+                for (auto& input : inputs)
+                {
+                    if (input.Kind() == VariableKind::Output)
+                    {
+                        auto& outputLocation = serializer.m_outputLocations.at(input);
+                        tables.Write<uint32_t>((uint32_t)InputReferenceKind::FunctionOutput);
+                        tables.Write<uint64_t>(outputLocation.first);
+                        tables.Write<uint64_t>(outputLocation.second);
+                    }
+                    else
+                    {
+                        tables.Write<uint32_t>((uint32_t)InputReferenceKind::Variable);
+                        tables.Write<uint64_t>(serializer.m_variableIndices.at(input));
+                        tables.Write<uint64_t>(0);
+                    }
+                }
+
+                size_t numConfigEntries = 0;
+                primitiveFunction->FunctionConfig().ForEach([&numConfigEntries](const std::wstring&, const DictionaryValue&) { numConfigEntries++; });
+                tables.Write<uint64_t>(numConfigEntries);
+                primitiveFunction->FunctionConfig().ForEach([&tables](const std::wstring& key, const DictionaryValue& value) {
+                    tables.WriteString(key);
+                    tables.WriteDictionaryValue(value);
+                });
+            }
+
+            tables.WriteString(rootFunction->Name());
+
+            ModelFileHeader header;
+            memcpy(header.m_magic, s_modelFileMagic, sizeof(header.m_magic));
+            header.m_version = s_modelFileVersion;
+            header.m_reserved = 0;
+            header.m_tablesSize = tables.Buffer().size();
+            header.m_valuesOffset = AlignedSize(sizeof(header) + tables.Buffer().size());
+            header.m_valuesSize = valuesSize;
+
+            FILE* file = fopenOrDie(modelFile, L"wb");
+            fwriteOrDie(&header, sizeof(header), 1, file);
+            fwriteOrDie(tables.Buffer().data(), 1, tables.Buffer().size(), file);
+
+            std::vector<char> padding(s_valueAlignment, 0);
+            fwriteOrDie(padding.data(), 1, header.m_valuesOffset - sizeof(header) - tables.Buffer().size(), file);
+            for (auto& variable : serializer.m_variables)
+            {
+                if (!variable.IsParameter() && !variable.IsConstant())
+                    continue;
+
+                // Values on other devices are written from a copy on the CPU
+                auto value = variable.Value();
+                NDArrayViewPtr cpuValue = value;
+                if (value->Device() != DeviceDescriptor::CPUDevice())
+                {
+                    cpuValue = new NDArrayView(value->GetDataType(), value->Shape(), DeviceDescriptor::CPUDevice());
+                    cpuValue->CopyFrom(*value);
+                }
+
+                size_t valueSize = value->Shape().TotalSize() * ElementSize(value->GetDataType());
+                const void* valueData = (value->GetDataType() == DataType::Float) ? (const void*)cpuValue->DataBuffer<float>() : (const void*)cpuValue->DataBuffer<double>();
+                fwriteOrDie(valueData, 1, valueSize, file);
+                fwriteOrDie(padding.data(), 1, AlignedSize(valueSize) - valueSize, file);
+            }
+
+            if (fcloseOrDie(file) != 0)
+                RuntimeError("SaveModel: Failed to write the model file '%ls'", modelFile.c_str());
+        }
+
+        static FunctionPtr Load(const std::wstring& modelFile, const DeviceDescriptor& device)
+        {
+            auto mapping = std::make_shared<ModelFileMapping>(modelFile);
+
+            ModelFileHeader header;
+            if (mapping->Size() < sizeof(header))
+                RuntimeError("LoadModel: The file '%ls' is not a model file", modelFile.c_str());
+
+            memcpy(&header, mapping->Data(), sizeof(header));
+            if (memcmp(header.m_magic, s_modelFileMagic, sizeof(header.m_magic)) != 0)
+                RuntimeError("LoadModel: The file '%ls' is not a model file", modelFile.c_str());
+
+            if (header.m_version != s_modelFileVersion)
+                RuntimeError("LoadModel: The model file '%ls' has the unsupported version %u", modelFile.c_str(), (unsigned int)header.m_version);
+
+            if ((header.m_tablesSize > mapping->Size() - sizeof(header)) || (header.m_valuesOffset > mapping->Size()) || (header.m_valuesSize > mapping->Size() - header.m_valuesOffset))
+                RuntimeError("LoadModel: The model file '%ls' is truncated or corrupt", modelFile.c_str());
+
+            const char* tablesBegin = mapping->Data() + sizeof(header);
+            ModelTableReader tables(tablesBegin, tablesBegin + header.m_tablesSize, modelFile);
+            char* values = mapping->Data() + header.m_valuesOffset;
+
+            std::vector<Variable> variables((size_t)tables.Read<uint64_t>());
+            for (auto& variable : variables)
+            {
+                auto kind = (VariableKind)tables.Read<uint32_t>();
+                auto dataType = (DataType)tables.Read<uint32_t>();
+                auto shape = tables.ReadShape();
+                auto name = tables.ReadString();
+                bool needsGradient = (tables.Read<uint8_t>() != 0);
+                bool isSparse = (tables.Read<uint8_t>() != 0);
+
+                std::vector<Axis> dynamicAxes((size_t)tables.Read<uint64_t>());
+                for (auto& axis : dynamicAxes)
+                    axis = Axis(tables.ReadString());
+
+                NDArrayViewPtr value;
+                if ((kind == VariableKind::Parameter) || (kind == VariableKind::Constant))
+                {
+                    size_t valueOffset = (size_t)tables.Read<uint64_t>();
+                    size_t valueSize = shape.TotalSize() * ElementSize(dataType);
+                    if ((valueOffset > header.m_valuesSize) || (valueSize > header.m_valuesSize - valueOffset))
+                        RuntimeError("LoadModel: The model file '%ls' is truncated or corrupt", modelFile.c_str());
+
+                    bool readOnly = (kind == VariableKind::Constant);
+                    if (device == DeviceDescriptor::CPUDevice())
+                        value = new NDArrayView(dataType, shape, values + valueOffset, valueSize, device, ReleaseModelFileMapping, new ModelFileMappingPtr(mapping), readOnly);
+                    else
+                    {
+                        NDArrayView mappedValue(dataType, shape, values + valueOffset, valueSize, DeviceDescriptor::CPUDevice(), /*readOnly =*/ true);
+                        value = new NDArrayView(dataType, shape, device);
+                        value->CopyFrom(mappedValue);
+                    }
+                }
+                else if ((kind != VariableKind::Input) && (kind != VariableKind::Placeholder))
+                    RuntimeError("LoadModel: The model file '%ls' has a leaf Variable of invalid kind", modelFile.c_str());
+
+                variable = Variable(shape, kind, dataType, nullptr, value, needsGradient, dynamicAxes, isSparse, name);
+            }
+
+            std::vector<FunctionPtr> functions((size_t)tables.Read<uint64_t>());
+            for (size_t i = 0; i < functions.size(); ++i)
+            {
+                auto op = (PrimitiveOpType)tables.Read<uint32_t>();
+                if (op > PrimitiveOpType::OptimizedRNNStack)
+                    RuntimeError("LoadModel: The model file '%ls' has a Function of unknown type %u", modelFile.c_str(), (unsigned int)op);
+
+                auto name = tables.ReadString();
+
+                std::vector<Variable> inputs((size_t)tables.Read<uint64_t>());
+                for (auto& input : inputs)
+                {
+                    auto referenceKind = (InputReferenceKind)tables.Read<uint32_t>();
+                    size_t index = (size_t)tables.Read<uint64_t>();
+                    size_t outputIndex = (size_t)tables.Read<uint64_t>();
+                    if ((referenceKind == InputReferenceKind::Variable) && (index < variables.size()))
+                        input = variables[index];
+                    else if ((referenceKind == InputReferenceKind::FunctionOutput) && (index < i) && (outputIndex < functions[index]->Outputs().size()))
+                        input = functions[index]->Outputs()[outputIndex];
+                    else
+                        RuntimeError("LoadModel: The model file '%ls' has a Function input that refers to no Variable", modelFile.c_str());
+                }
+
+                Dictionary functionConfig;
+                size_t numConfigEntries = (size_t)tables.Read<uint64_t>();
+                for (size_t j = 0; j < numConfigEntries; ++j)
+                {
+                    auto key = tables.ReadString();
+                    functionConfig[key] = tables.ReadDictionaryValue();
+                }
+
+                functions[i] = new PrimitiveFunction(op, inputs, std::move(functionConfig), name);
+            }
+
+            if (functions.empty())
+                RuntimeError("LoadModel: The model file '%ls' has no Functions", modelFile.c_str());
+
+            auto name = tables.ReadString();
+            return CompositeFunction::Create(functions.back(), name);
+        }
+
+    private:
+        // adds the function after the functions and leaf variables that it depends on
+        void AddFunction(const FunctionPtr& function)
+        {
+            if (dynamic_cast<PrimitiveFunction*>(function.GetPtr()) == nullptr)
+                InvalidArgument("SaveModel: The Function '%ls' is not a built-in one; only graphs of built-in Functions can be saved", function->Name().c_str());
+
+            m_visitedFunctions.insert(function.GetPtr());
+            for (auto& input : function->Inputs())
+            {
+                if (input.Kind() == VariableKind::Output)
+                {
+                    if (m_visitedFunctions.find(input.Owner().GetPtr()) == m_visitedFunctions.end())
+                        AddFunction(input.Owner());
+                }
+                else if (m_variableIndices.find(input) == m_variableIndices.end())
+                {
+                    m_variableIndices[input] = m_variables.size();
+                    m_variables.push_back(input);
+                }
+            }
+
+            auto outputs = function->Outputs();
+            for (size_t i = 0; i < outputs.size(); ++i)
+                m_outputLocations[outputs[i]] = std::make_pair(m_functions.size(), i);
+
+            m_functions.push_back(function);
+        }
+
+        std::vector<Variable> m_variables; // leaves, in the order of the Variable table
+        std::unordered_map<Variable, size_t> m_variableIndices;
+        std::vector<FunctionPtr> m_functions; // in topological order
+        std::unordered_set<Function*> m_visitedFunctions;
+        std::unordered_map<Variable, std::pair<size_t, size_t>> m_outputLocations; // index of the function and of the output
+    };
+
+    void SaveModel(const FunctionPtr& rootFunction, const std::wstring& modelFile)
+    {
+        ModelSerializer::Save(rootFunction, modelFile);
+    }
+
+    FunctionPtr LoadModel(const std::wstring& modelFile, const DeviceDescriptor& computeDevice/* = DeviceDescriptor::DefaultDevice()*/)
+    {
+        return ModelSerializer::Load(modelFile, computeDevice);
+    }
+}
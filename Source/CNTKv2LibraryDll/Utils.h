@@ -249,6 +249,14 @@ namespace CNTK
 
         bool Contains(const wchar_t* key) const;
 
+        // Calls 'callback' with the key and the value of each entry of 'this' dictionary
+        template <typename Callback>
+        void ForEach(Callback&& callback) const
+        {
+            for (auto iter = m_dictionaryData->begin(); iter != m_dictionaryData->end(); ++iter)
+                callback(iter->first, iter->second);
+        }
+
     private:
         std::unordered_map<std::wstring, DictionaryValue>* m_dictionaryData;
     };
@@ -47,12 +47,7 @@ namespace CNTK
 
         NDMaskPtr deviceValueMask;
         if (needsMask)
-        {
-            NDShape valueMaskShape = { maxSequenceLength, numSequences };
-            deviceValueMask = NDMaskPtr(new NDMask(valueMaskShape, device), [](_Internal::_ReferenceCounter* ptr) {delete ptr; });
-            for (size_t i = 0; i < numSequences; ++i)
-                deviceValueMask->MaskSection({ sequenceLengths[i], i }, { NDShape::InferredDimension, 1 });
-        }
+            deviceValueMask = NDMaskPtr(new NDMask(sequenceLengths, maxSequenceLength, device), [](_Internal::_ReferenceCounter* ptr) {delete ptr; });
 
         return deviceValueMask;
     }
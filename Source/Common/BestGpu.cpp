@@ -47,6 +47,9 @@ int bestGPUDummy = 42; // put something into this CPP, as to avoid a linker warn
 #include <algorithm>
 
 #include <memory>
+#ifndef _WIN32
+#include <dirent.h>
+#endif
 #include "CrossProcessMutex.h"
 
 // ---------------------------------------------------------------------------
@@ -65,6 +68,8 @@ struct ProcessorData
     size_t cudaTotalMem;
     bool cntkFound;
     int deviceId; // the deviceId (cuda side) for this processor
+    char pciBusId[32]; // as "domain:bus:device.function", to find the device in NVML and sysfs
+    int numaNode;      // NUMA node the GPU is attached to, or -1 if unknown
 };
 
 enum BestGpuFlags
@@ -91,11 +96,13 @@ private:
     BestGpuFlags m_lastFlags; // flag state at last query
     int m_lastCount;          // count of devices (with filtering of allowed Devices)
     std::vector<ProcessorData*> m_procData;
+    std::vector<std::vector<int>> m_distance; // topology distance between each pair of devices, see QueryTopology()
     int m_allowedDevices; // bitfield of allowed devices
     bool m_disallowCPUDevice;
     void GetCudaProperties();
     void GetNvmlData();
     void QueryNvmlData();
+    void QueryTopology();
 
 public:
     BestGpu()
@@ -122,6 +129,10 @@ public:
     static const int AllDevices = -1;                                                         // can be used to specify all GPUs in GetDevices() call
     static const int RequeryDevices = -2;                                                     // Requery refreshing statistics and picking the same number as last query
     std::vector<int> GetDevices(int number = AllDevices, BestGpuFlags flags = bestGpuNormal); // get multiple devices
+    std::vector<int> GetDevicesByTopology();                                                  // allowed devices, closely connected ones adjacent
+    int GetDeviceForLocalRank(int localRank, int numLocalRanks, BestGpuFlags flags = bestGpuNormal); // device of one of the workers on this machine
+    int GetNumaNode(int deviceId) const;                                                      // NUMA node a device is attached to, or -1
+    static std::vector<std::string> GetNetworkDevicesOnNumaNode(int numaNode);                // InfiniBand adapters attached to a NUMA node
 private:
     bool LockDevice(int deviceId, bool trial = true);
 };
@@ -132,7 +143,81 @@ private:
 // 'cpu'  - use the CPU
 // 0      - or some other single number, use a single GPU with CUDA ID same as the number
 // This can only be called with the same parameters each time, and 'auto' is determined upon first call.
-static DEVICEID_TYPE SelectDevice(DEVICEID_TYPE deviceId, bool bLockGPU, const intargvector& excludedDevices)
+// 'gpuPlacement' decides how 'auto' picks the GPU:
+// 'score'    - the GPU with the best BestGpu score (free memory, utilization, speed, not used by other CNTK processes)
+// 'topology' - with several workers per machine, the GPUs are ordered by their PCIe/NVLink topology and assigned
+//              to the workers by their rank on the machine, so that neighboring workers are P2P peers; the CPU threads
+//              of the worker are then bound to the NUMA node of its GPU, and its CPU buffers placed there by first touch
+static bool ParseGpuPlacement(const std::wstring& gpuPlacement)
+{
+    if      (EqualCI(gpuPlacement, L"score"))    return false;
+    else if (EqualCI(gpuPlacement, L"topology")) return true;
+    else InvalidArgument("gpuPlacement: Invalid value '%ls'. Valid values are (score | topology)", gpuPlacement.c_str());
+}
+
+// determines the rank of this process among the MPI workers on this machine, from the environment set by the MPI launcher
+// This must not communicate, since the devices may be selected by a single worker, e.g. in commands run on rank 0 only.
+static bool GetLocalRank(int& localRank, int& numLocalRanks)
+{
+    static const char* const variables[][2] =
+    {
+        { "OMPI_COMM_WORLD_LOCAL_RANK", "OMPI_COMM_WORLD_LOCAL_SIZE" }, // Open MPI
+        { "MV2_COMM_WORLD_LOCAL_RANK",  "MV2_COMM_WORLD_LOCAL_SIZE" },  // MVAPICH2
+        { "MPI_LOCALRANKID",            "MPI_LOCALNRANKS" },            // MPICH (Hydra), Intel MPI
+        { "PMI_LOCAL_RANK",             "PMI_LOCAL_SIZE" },
+    };
+    for (const auto& variable : variables)
+    {
+        const char* rank = getenv(variable[0]);
+        const char* size = getenv(variable[1]);
+        if (rank && size)
+        {
+            localRank = atoi(rank);
+            numLocalRanks = atoi(size);
+            if (localRank >= 0 && localRank < numLocalRanks)
+                return true;
+        }
+    }
+    return false;
+}
+
+static DEVICEID_TYPE SelectDeviceByTopology(BestGpu& bestGpu, BestGpuFlags flags)
+{
+    int localRank, numLocalRanks;
+    if (!GetLocalRank(localRank, numLocalRanks))
+    {
+        fprintf(stderr, "SelectDevice: Topology placement needs the rank of this worker on its machine, which the MPI launcher did not provide. Selecting by score instead.\n");
+        return (DEVICEID_TYPE) bestGpu.GetDevice(flags);
+    }
+
+    int deviceId = bestGpu.GetDeviceForLocalRank(localRank, numLocalRanks, flags);
+    int numaNode = bestGpu.GetNumaNode(deviceId);
+    fprintf(stderr, "SelectDevice: Worker %d of %d on this machine uses GPU %d on NUMA node %d.\n", localRank, numLocalRanks, deviceId, numaNode);
+    if (numaNode >= 0)
+    {
+        if (CPUNumaPlacement::BindThreadsToNode(numaNode))
+        {
+            if (CPUNumaPlacement::GetPolicy() == NumaPolicy::none)
+                CPUNumaPlacement::SetPolicy(NumaPolicy::firstTouch);
+            fprintf(stderr, "SelectDevice: Bound CPU threads to NUMA node %d.\n", numaNode);
+        }
+        else
+            fprintf(stderr, "SelectDevice: Could not bind CPU threads to NUMA node %d.\n", numaNode);
+
+        // the MPI library picks its network adapters itself; tell the user which ones avoid crossing the sockets
+        auto networkDevices = BestGpu::GetNetworkDevicesOnNumaNode(numaNode);
+        if (!networkDevices.empty())
+        {
+            std::string names;
+            for (const auto& name : networkDevices)
+                names += (names.empty() ? "" : ",") + name;
+            fprintf(stderr, "SelectDevice: Network adapters on NUMA node %d: %s.\n", numaNode, names.c_str());
+        }
+    }
+    return (DEVICEID_TYPE) deviceId;
+}
+
+static DEVICEID_TYPE SelectDevice(DEVICEID_TYPE deviceId, bool bLockGPU, const intargvector& excludedDevices, bool topologyPlacement = false)
 {
     // This can only be called with the same parameter.
     static DEVICEID_TYPE selectedDeviceId = DEVICEID_NOTYETDETERMINED;
@@ -158,7 +243,11 @@ static DEVICEID_TYPE SelectDevice(DEVICEID_TYPE deviceId, bool bLockGPU, const i
                 }
             }
 
-            bestDeviceId = (DEVICEID_TYPE)g_bestGpu->GetDevice(BestGpuFlags(bLockGPU ? (bestGpuAvoidSharing | bestGpuExclusiveLock) : bestGpuAvoidSharing));
+            BestGpuFlags flags = BestGpuFlags(bLockGPU ? (bestGpuAvoidSharing | bestGpuExclusiveLock) : bestGpuAvoidSharing);
+            if (topologyPlacement)
+                bestDeviceId = SelectDeviceByTopology(*g_bestGpu, flags);
+            else
+                bestDeviceId = (DEVICEID_TYPE)g_bestGpu->GetDevice(flags);
             // TODO: Do we need to hold this pointer at all? We will only query it once. Or is it used to hold lock to a GPU?
         }
         // already chosen
@@ -174,10 +263,11 @@ DEVICEID_TYPE DeviceFromConfig(const ScriptableObjects::IConfigRecord& config)
 {
     intargvector excludedDevices = ConfigArray(config(L"excludedDevices", ""), ':', false);
     bool bLockGPU = config(L"lockGPU", true);
+    bool topologyPlacement = ParseGpuPlacement(config(L"gpuPlacement", L"score"));
     // we need to deal with the old CNTK config semantics where 'deviceId' can be either a string or an int
     auto valpp = config.Find(L"deviceId");
     if (!valpp)
-        return SelectDevice(DEVICEID_AUTO, bLockGPU, excludedDevices); // not given at all: default
+        return SelectDevice(DEVICEID_AUTO, bLockGPU, excludedDevices, topologyPlacement); // not given at all: default
     auto valp = *valpp;                               // (the type is not determined at this point)
     if (valp.Is<ScriptableObjects::String>())
     {
@@ -185,7 +275,7 @@ DEVICEID_TYPE DeviceFromConfig(const ScriptableObjects::IConfigRecord& config)
         if (val == L"cpu")
             return SelectDevice(CPUDEVICE, false, excludedDevices);
         else if (val == L"auto")
-            return SelectDevice(DEVICEID_AUTO, bLockGPU, excludedDevices);
+            return SelectDevice(DEVICEID_AUTO, bLockGPU, excludedDevices, topologyPlacement);
         else
             InvalidArgument("Invalid value '%ls' for deviceId parameter. Allowed are 'auto' and 'cpu' (case-sensitive).", val.c_str());
     }
@@ -201,9 +291,10 @@ DEVICEID_TYPE DeviceFromConfig(const ConfigParameters& config)
     intargvector excludedDevices = ConfigArray(config("excludedDevices", ""), ':', false);
     ConfigValue val = config("deviceId", "auto");
     bool bLockGPU = config(L"lockGPU", true);
+    bool topologyPlacement = ParseGpuPlacement(config(L"gpuPlacement", L"score"));
 
     if (EqualCI(val, "cpu"))  return SelectDevice(CPUDEVICE, false, excludedDevices);
-    else if (EqualCI(val, "auto")) return SelectDevice(DEVICEID_AUTO, bLockGPU, excludedDevices);
+    else if (EqualCI(val, "auto")) return SelectDevice(DEVICEID_AUTO, bLockGPU, excludedDevices, topologyPlacement);
     else                           return SelectDevice((int)val, bLockGPU, excludedDevices);
 }
 
@@ -264,6 +355,23 @@ void BestGpu::GetCudaProperties()
         pd->cores = _ConvertSMVer2Cores(pd->deviceProp.major, pd->deviceProp.minor) * pd->deviceProp.multiProcessorCount;
         pd->cudaFreeMem = free;
         pd->cudaTotalMem = total;
+        if (cudaDeviceGetPCIBusId(pd->pciBusId, (int) sizeof(pd->pciBusId), dev) != cudaSuccess)
+            pd->pciBusId[0] = 0;
+        pd->numaNode = -1;
+#ifndef _WIN32
+        if (pd->pciBusId[0])
+        {
+            std::string path = "/sys/bus/pci/devices/" + std::string(pd->pciBusId) + "/numa_node";
+            std::transform(path.begin(), path.end(), path.begin(), ::tolower); // sysfs uses lower-case hex digits
+            FILE* f = fopen(path.c_str(), "r");
+            if (f)
+            {
+                if (fscanf(f, "%d", &pd->numaNode) != 1)
+                    pd->numaNode = -1;
+                fclose(f);
+            }
+        }
+#endif
         dev++;
         cudaDeviceReset();
     }
@@ -292,6 +400,7 @@ void BestGpu::Init()
     {
         GetCudaProperties();
         GetNvmlData();
+        QueryTopology();
     }
     m_initialized = true;
 }
@@ -626,6 +735,165 @@ void BestGpu::QueryNvmlData()
     return;
 }
 
+// QueryTopology - Determine how closely each pair of GPUs is connected
+// The distance is NVML's nvmlGpuTopologyLevel_t of the closest common ancestor of the two GPUs (from the same board
+// over the same PCIe switch and the same host bridge up to across CPU sockets), and 0 for GPUs connected by NVLink.
+// Without NVML topology information (it is not available on Windows), GPUs that can access each other's memory are
+// taken to share a host bridge.
+void BestGpu::QueryTopology()
+{
+    m_distance.assign(m_deviceCount, std::vector<int>(m_deviceCount, NVML_TOPOLOGY_SYSTEM));
+
+    std::vector<nvmlDevice_t> devices(m_deviceCount);
+    std::vector<bool> haveDevice(m_deviceCount, false);
+    if (m_nvmlData)
+    {
+        for (ProcessorData* pd : m_procData)
+            haveDevice[pd->deviceId] = pd->pciBusId[0] && nvmlDeviceGetHandleByPciBusId(pd->pciBusId, &devices[pd->deviceId]) == NVML_SUCCESS;
+    }
+
+    for (int i = 0; i < m_deviceCount; i++)
+    {
+        m_distance[i][i] = 0;
+        for (int j = 0; j < m_deviceCount; j++)
+        {
+            if (i == j)
+                continue;
+            int canAccessPeer = 0;
+            if (cudaDeviceCanAccessPeer(&canAccessPeer, i, j) == cudaSuccess && canAccessPeer)
+                m_distance[i][j] = NVML_TOPOLOGY_HOSTBRIDGE;
+            if (!haveDevice[i] || !haveDevice[j])
+                continue;
+#ifndef _WIN32
+            nvmlGpuTopologyLevel_t level;
+            if (nvmlDeviceGetTopologyCommonAncestor(devices[i], devices[j], &level) == NVML_SUCCESS)
+                m_distance[i][j] = (int) level;
+#endif
+#ifdef NVML_NVLINK_MAX_LINKS
+            nvmlPciInfo_t pci;
+            if (nvmlDeviceGetPciInfo(devices[j], &pci) != NVML_SUCCESS)
+                continue;
+            for (unsigned int link = 0; link < NVML_NVLINK_MAX_LINKS; link++)
+            {
+                nvmlEnableState_t isActive;
+                nvmlPciInfo_t remote;
+                if (nvmlDeviceGetNvLinkState(devices[i], link, &isActive) == NVML_SUCCESS && isActive == NVML_FEATURE_ENABLED &&
+                    nvmlDeviceGetNvLinkRemotePciInfo(devices[i], link, &remote) == NVML_SUCCESS &&
+                    remote.domain == pci.domain && remote.bus == pci.bus && remote.device == pci.device)
+                {
+                    m_distance[i][j] = 0;
+                    break;
+                }
+            }
+#endif
+        }
+    }
+}
+
+// GetDevicesByTopology - Order the allowed devices so that closely connected ones are adjacent
+// Starting with the lowest device, this repeatedly appends the remaining device closest to the last one, preferring
+// ones on the same NUMA node. Workers with consecutive ranks, which exchange data in ring and tree collectives, thus get
+// GPUs that are P2P peers on the same switch, and crossing the sockets is left to as few pairs as possible.
+std::vector<int> BestGpu::GetDevicesByTopology()
+{
+    std::vector<int> remaining;
+    for (ProcessorData* pd : m_procData)
+    {
+        if (DeviceAllowed(pd->deviceId))
+            remaining.push_back(pd->deviceId);
+    }
+
+    std::vector<int> order;
+    while (!remaining.empty())
+    {
+        size_t next = 0;
+        if (!order.empty())
+        {
+            int last = order.back();
+            auto cost = [&](int device)
+            {
+                return std::make_pair(m_distance[last][device], m_procData[device]->numaNode != m_procData[last]->numaNode);
+            };
+            for (size_t k = 1; k < remaining.size(); k++)
+            {
+                if (cost(remaining[k]) < cost(remaining[next]))
+                    next = k;
+            }
+        }
+        order.push_back(remaining[next]);
+        remaining.erase(remaining.begin() + next);
+    }
+    return order;
+}
+
+// GetDeviceForLocalRank - Determine the device of one of the workers on this machine, by topology
+// localRank - rank of the worker among the workers on this machine
+// numLocalRanks - how many workers run on this machine
+// bestFlags - with bestGpuExclusiveLock, the device is locked for exclusive use
+// Every worker computes the same assignment, so the workers get distinct GPUs without communicating, as long as
+// there are enough GPUs. Unlike GetDevices(), this does not skip GPUs locked by other processes, since that would
+// make the workers disagree about the assignment; instead, locking a GPU that is in use fails.
+int BestGpu::GetDeviceForLocalRank(int localRank, int numLocalRanks, BestGpuFlags bestFlags)
+{
+    std::vector<int> order = GetDevicesByTopology();
+    if (order.empty())
+    {
+        if (DeviceAllowed(-1))
+            return -1;
+        RuntimeError("Device selection: No eligible device found.");
+    }
+    if (numLocalRanks > (int) order.size())
+        fprintf(stderr, "GetDeviceForLocalRank: %d workers share %d GPUs on this machine.\n", numLocalRanks, (int) order.size());
+
+    int deviceId = order[localRank % order.size()];
+    if ((bestFlags & bestGpuExclusiveLock) && numLocalRanks <= (int) order.size())
+    {
+        if (!LockDevice(deviceId, false))
+            RuntimeError("Device selection: GPU %d, which topology placement assigned to worker %d on this machine, is locked by another process.", deviceId, localRank);
+    }
+    m_lastFlags = bestFlags;
+    m_lastCount = 1;
+    return deviceId;
+}
+
+// GetNumaNode - Determine the NUMA node that a device is attached to
+// returns: the node, or -1 for the CPU device, or if it is unknown (e.g. on Windows, or on single-socket machines)
+int BestGpu::GetNumaNode(int deviceId) const
+{
+    if (deviceId < 0 || deviceId >= (int) m_procData.size())
+        return -1;
+    return m_procData[deviceId]->numaNode;
+}
+
+// GetNetworkDevicesOnNumaNode - Determine the InfiniBand adapters attached to a NUMA node (Linux only)
+std::vector<std::string> BestGpu::GetNetworkDevicesOnNumaNode(int numaNode)
+{
+    std::vector<std::string> names;
+#ifndef _WIN32
+    DIR* dir = opendir("/sys/class/infiniband");
+    if (!dir)
+        return names;
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        std::string path = std::string("/sys/class/infiniband/") + entry->d_name + "/device/numa_node";
+        FILE* f = fopen(path.c_str(), "r");
+        if (!f)
+            continue;
+        int node;
+        if (fscanf(f, "%d", &node) == 1 && node == numaNode)
+            names.push_back(entry->d_name);
+        fclose(f);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+#else
+    numaNode;
+#endif
+    return names;
+}
+
 bool BestGpu::LockDevice(int deviceId, bool trial)
 {
     if (deviceId < 0) // don't lock CPU, always return true
@@ -247,6 +247,35 @@ bool DataReader::GetHmmData(msra::asr::simplesenonehmm* hmm)
     return bRet;
 }
 
+// GetReaderStatistics - Get the counters of the reader pipeline
+// statistics - [out] those of the first reader that keeps them (they are shared by the readers of a module)
+// returns - true if a reader keeps them
+bool DataReader::GetReaderStatistics(ReaderStatistics& statistics)
+{
+    for (size_t i = 0; i < m_ioNames.size(); i++)
+    {
+        if (m_dataReaders[m_ioNames[i]]->GetReaderStatistics(statistics))
+            return true;
+    }
+    return false;
+}
+
+// GetState - Get the position of the reader in the epoch
+// state - [out] that of the reader, if there is a single one
+// returns - true if the reader can restore it
+bool DataReader::GetState(std::vector<size_t>& state)
+{
+    return m_ioNames.size() == 1 && m_dataReaders[m_ioNames[0]]->GetState(state);
+}
+
+// SetState - Continue the epoch from a state returned by GetState()
+void DataReader::SetState(const std::vector<size_t>& state)
+{
+    if (m_ioNames.size() != 1)
+        LogicError("SetState: The state of several readers cannot be restored.");
+    m_dataReaders[m_ioNames[0]]->SetState(state);
+}
+
 size_t DataReader::GetNumParallelSequencesForFixingBPTTMode()
 {
     size_t nNbr = 0;
@@ -0,0 +1,143 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "EventTracer.h"
+#include "Basics.h"
+#include "fileutil.h"
+#include <map>
+#include <string.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct TraceEvent
+{
+    const char* name;
+    const char* category;
+    int row;
+    double ts; // microseconds since the start of tracing
+    double dur;
+};
+
+struct EventTracerState
+{
+    wstring m_filePath;
+    int m_processId;
+    size_t m_maxEvents;
+    chrono::steady_clock::time_point m_startTime;
+    double m_startSystemTime; // microseconds since the epoch of the system clock, at m_startTime
+
+    mutex m_mutex;
+    vector<TraceEvent> m_events;
+    map<thread::id, int> m_rows;
+    size_t m_numDropped;
+
+    EventTracerState()
+        : m_processId(0), m_maxEvents(0), m_startSystemTime(0), m_numDropped(0)
+    {
+    }
+
+    static EventTracerState& GetInstance()
+    {
+        static EventTracerState instance;
+        return instance;
+    }
+
+    double SinceStart(chrono::steady_clock::time_point t) const
+    {
+        return chrono::duration<double, micro>(t - m_startTime).count();
+    }
+};
+
+bool EventTracer::s_enabled = false;
+
+/*static*/ void EventTracer::Start(const wstring& filePath, int processId, size_t maxEvents)
+{
+    auto& state = EventTracerState::GetInstance();
+    lock_guard<mutex> lock(state.m_mutex);
+    state.m_filePath = filePath;
+    state.m_processId = processId;
+    state.m_maxEvents = maxEvents;
+    state.m_startTime = chrono::steady_clock::now();
+    state.m_startSystemTime = chrono::duration<double, micro>(chrono::system_clock::now().time_since_epoch()).count();
+    state.m_events.clear();
+    state.m_rows.clear();
+    state.m_numDropped = 0;
+    s_enabled = !filePath.empty();
+}
+
+/*static*/ void EventTracer::StartCollecting(size_t maxEvents)
+{
+    Start(L"", 0, maxEvents);
+    s_enabled = true;
+}
+
+/*static*/ vector<double> EventTracer::GetDurations(const char* name)
+{
+    auto& state = EventTracerState::GetInstance();
+    lock_guard<mutex> lock(state.m_mutex);
+    vector<double> durations;
+    for (const auto& e : state.m_events)
+    {
+        if (strcmp(e.name, name) == 0)
+            durations.push_back(e.dur / 1e6);
+    }
+    return durations;
+}
+
+/*static*/ void EventTracer::Clear()
+{
+    auto& state = EventTracerState::GetInstance();
+    lock_guard<mutex> lock(state.m_mutex);
+    state.m_events.clear();
+    state.m_numDropped = 0;
+}
+
+/*static*/ void EventTracer::Record(const char* name, const char* category, chrono::steady_clock::time_point begin, chrono::steady_clock::time_point end)
+{
+    auto& state = EventTracerState::GetInstance();
+    lock_guard<mutex> lock(state.m_mutex);
+    if (state.m_events.size() >= state.m_maxEvents)
+    {
+        state.m_numDropped++;
+        return;
+    }
+    auto row = state.m_rows.insert(make_pair(this_thread::get_id(), (int) state.m_rows.size())).first->second;
+    state.m_events.push_back(TraceEvent{ name, category, row, state.SinceStart(begin), chrono::duration<double, micro>(end - begin).count() });
+}
+
+/*static*/ void EventTracer::Flush()
+{
+    if (!IsEnabled())
+        return;
+
+    auto& state = EventTracerState::GetInstance();
+    lock_guard<mutex> lock(state.m_mutex);
+    if (state.m_filePath.empty()) // collecting in memory only
+        return;
+
+    FILE* f = fopenOrDie(state.m_filePath, L"w");
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"worker %d\"}}", state.m_processId, state.m_processId);
+    for (const auto& row : state.m_rows)
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", state.m_processId, row.second, row.second);
+    for (const auto& e : state.m_events)
+    {
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                e.name, e.category, state.m_processId, e.row, state.m_startSystemTime + e.ts, e.dur);
+    }
+    fprintf(f, "\n]}\n");
+    fcloseOrDie(f);
+    fprintf(stderr, "EventTracer: Wrote %d trace events to %ls%s.\n", (int) state.m_events.size(), state.m_filePath.c_str(),
+            state.m_numDropped > 0 ? msra::strfun::strprintf(" (%d more were dropped)", (int) state.m_numDropped).c_str() : "");
+}
+
+}}}
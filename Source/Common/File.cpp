@@ -24,6 +24,9 @@
 #ifdef __unix__
 #include <unistd.h>
 #include <linux/limits.h> // for PATH_MAX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -77,11 +80,16 @@ template<class String>
 //template /*static*/ void File::MakeIntermediateDirs<string> (const string&  filename); // implement this if needed
 template /*static*/ void File::MakeIntermediateDirs<wstring>(const wstring& filename);
 
+// size of the user-space buffer of files opened with fileOptionsLargeBuffer
+static const size_t largeBufferSize = 4 * 1024 * 1024;
+
 // all constructors call this
 void File::Init(const wchar_t* filename, int fileOptions)
 {
     m_filename = filename;
     m_options = fileOptions;
+    m_mappedData = nullptr;
+    m_mappedSize = 0;
     if (m_filename.empty())
         RuntimeError("File: filename is empty");
     const auto outputPipe = (m_filename.front() == '|');
@@ -91,6 +99,8 @@ void File::Init(const wchar_t* filename, int fileOptions)
     const auto writing = !!(fileOptions & fileOptionsWrite);
     if (!reading && !writing)
         RuntimeError("File: either fileOptionsRead or fileOptionsWrite must be specified");
+    if ((fileOptions & fileOptionsMemoryMapped) && (writing || !(fileOptions & fileOptionsBinary)))
+        RuntimeError("File: fileOptionsMemoryMapped can only be used for reading binary files");
     // convert fileOptions to fopen()'s mode string
     wstring options = reading ? L"r" : L"";
     if (writing)
@@ -137,11 +147,57 @@ void File::Init(const wchar_t* filename, int fileOptions)
         m_pcloseNeeded = true;
     }
     else
-        attempt([=]() // regular file: use a retry loop
-                {
-                    m_file = fopenOrDie(filename, options.c_str());
-                    m_seekable = true;
-                });
+    {
+        if (fileOptions & fileOptionsMemoryMapped)
+            OpenMapped(filename);
+        if (!IsMapped())
+            attempt([=]() // regular file: use a retry loop
+                    {
+                        m_file = fopenOrDie(filename, options.c_str());
+                        m_seekable = true;
+                    });
+        // a large stdio buffer saves most of the C runtime calls of reading or writing files value by value
+        if (!IsMapped() && (fileOptions & (fileOptionsLargeBuffer | fileOptionsMemoryMapped)))
+        {
+            m_buffer.resize(largeBufferSize);
+            if (setvbuf(m_file, m_buffer.data(), _IOFBF, m_buffer.size()) != 0)
+                m_buffer.clear(); // (keep the default buffer)
+        }
+    }
+}
+
+// map the file, and open m_file as a stream reading from the mapping
+// Where this is not supported (Windows), or the file is empty, this leaves the file unmapped, to be opened regularly.
+void File::OpenMapped(const wchar_t* filename)
+{
+#ifdef __unix__
+    int fd = open(msra::strfun::utf8(filename).c_str(), O_RDONLY);
+    if (fd == -1)
+        RuntimeError("File: cannot open '%ls' for reading: %s", filename, strerror(errno));
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+        close(fd);
+        RuntimeError("File: cannot retrieve the size of '%ls': %s", filename, strerror(errno));
+    }
+    size_t size = (size_t) info.st_size;
+    void* data = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd); // (the mapping stays valid)
+    if (data == MAP_FAILED)
+        return;
+    madvise(data, size, MADV_SEQUENTIAL);
+    m_file = fmemopen(data, size, "rb");
+    if (!m_file)
+    {
+        munmap(data, size);
+        RuntimeError("File: cannot open a stream over the mapping of '%ls': %s", filename, strerror(errno));
+    }
+    m_mappedData = (const char*) data;
+    m_mappedSize = size;
+    m_seekable = true;
+#else
+    UNUSED(filename);
+#endif
 }
 
 // determine the directory for a given pathname
@@ -263,6 +319,10 @@ File::~File(void)
     else if (m_file != stdin && m_file != stdout && m_file != stderr)
     {
         int rc = fclose(m_file);
+#ifdef __unix__
+        if (IsMapped())
+            munmap((void*) m_mappedData, m_mappedSize);
+#endif
         if ((rc != 0) && !std::uncaught_exception())
             RuntimeError("File: failed to close file at %S", m_filename.c_str());
     }
@@ -598,6 +658,8 @@ size_t File::Size()
 {
     if (!CanSeek())
         RuntimeError("File: attempted to get Size() on non-seekable stream");
+    if (IsMapped())
+        return m_mappedSize;
     return filesize(m_file);
 }
 
@@ -828,6 +890,37 @@ void File::SetPosition(uint64_t pos)
     fsetpos(m_file, pos);
 }
 
+// read a contiguous block of a binary file
+void File::ReadBlock(void* data, size_t numBytes)
+{
+    const void* mappedBlock = GetMappedBlock(numBytes);
+    if (mappedBlock)
+        memcpy(data, mappedBlock, numBytes);
+    else
+        freadOrDie(data, 1, numBytes, m_file); // (large reads bypass the buffer of m_file)
+}
+
+// write a contiguous block of a binary file
+void File::WriteBlock(const void* data, size_t numBytes)
+{
+    // from an empty buffer, the C runtime writes a block that does not fit into it straight from 'data'
+    if (!m_buffer.empty() && numBytes >= m_buffer.size())
+        fflushOrDie(m_file);
+    fwriteOrDie(data, 1, numBytes, m_file);
+}
+
+// return the next 'numBytes' bytes of a mapped file in place, and skip over them
+const void* File::GetMappedBlock(size_t numBytes)
+{
+    if (!IsMapped())
+        return nullptr;
+    uint64_t pos = fgetpos(m_file);
+    if (numBytes > m_mappedSize - pos)
+        RuntimeError("File: attempted to read past the end of the file '%ls'", m_filename.c_str());
+    fsetpos(m_file, pos + numBytes);
+    return m_mappedData + pos;
+}
+
 // helper to load a matrix from a stream (file or string literal)
 // The input string is expected to contain one line per matrix row (natural printing order for humans).
 // Inputs:
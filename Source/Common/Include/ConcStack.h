@@ -8,11 +8,15 @@
 #include <stack>
 #include <functional>
 #include <mutex>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <stdint.h>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // -----------------------------------------------------------------------
-// conc_stack -- very simple version of thread-safe stack. Add other functions as needed.
+// conc_stack -- very simple version of thread-safe stack. Add other functions as needed. For pools of reusable objects on hot paths, see conc_pool below.
 // Kept in a separate header because it pulls in some large headers that are not super-commonly needed otherwise.
 // -----------------------------------------------------------------------
 
@@ -58,4 +62,161 @@ private:
     std::stack<value_type> m_stack;
     std::mutex m_locker;
 };
+
+// -----------------------------------------------------------------------
+// conc_pool -- lock-free pool of reusable objects (buffers, workspaces, open files), with the interface of conc_stack
+// This is a Treiber stack. The items are kept in nodes linked by index, and the head holds the index of the top node
+// together with a tag that every change increments, so that a pop that raced with a pop and re-push of the same node
+// (ABA) fails its compare-exchange. Nodes are not freed while the pool lives but recycled through a second stack of
+// empty nodes, so a pop can always read the link of a node that another thread took first. The nodes are allocated
+// in chunks of doubling size that never move; only allocating a chunk takes a lock.
+// Items come back most recently pushed first, which keeps the warm buffers in use.
+// -----------------------------------------------------------------------
+
+template <typename T>
+class conc_pool
+{
+public:
+    typedef T value_type;
+
+    conc_pool()
+        : m_items(0), m_free(0), m_numNodes(0)
+    {
+        for (auto& chunk : m_chunks)
+            chunk.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~conc_pool()
+    {
+        uint32_t index;
+        while ((index = Pop(m_items)) != 0)
+            GetNode(index).Item()->~value_type();
+        for (auto& chunk : m_chunks)
+            delete[] chunk.load(std::memory_order_relaxed);
+    }
+
+    template <class Factory>
+    value_type pop_or_create(Factory&& factory)
+    {
+        uint32_t index = Pop(m_items);
+        if (index == 0)
+            return factory();
+        Node& node = GetNode(index);
+        value_type item = std::move(*node.Item());
+        node.Item()->~value_type();
+        Push(m_free, index);
+        return item;
+    }
+
+    void push(const value_type& item)
+    {
+        Emplace(item);
+    }
+
+    void push(value_type&& item)
+    {
+        Emplace(std::move(item));
+    }
+
+public:
+    conc_pool(const conc_pool&) = delete;
+    conc_pool& operator=(const conc_pool&) = delete;
+    conc_pool(conc_pool&&) = delete;
+    conc_pool& operator=(conc_pool&&) = delete;
+
+private:
+    struct Node
+    {
+        std::atomic<uint32_t> m_next; // index of the node below in the stack, or 0
+        typename std::aligned_storage<sizeof(value_type), std::alignment_of<value_type>::value>::type m_storage;
+
+        value_type* Item() { return reinterpret_cast<value_type*>(&m_storage); }
+    };
+
+    // node indices start at 1 (0 is the end of a stack); chunk k holds the indices [16 << k, 16 << (k + 1)) - 15
+    static const uint64_t firstChunkSize = 16;
+    static const size_t numChunks = 27;
+
+    static uint64_t Pack(uint32_t index, uint32_t tag)
+    {
+        return ((uint64_t) tag << 32) | index;
+    }
+
+    static size_t ChunkOf(uint64_t i)
+    {
+        size_t k = 0;
+        while (i >= (firstChunkSize << (k + 1)))
+            k++;
+        return k;
+    }
+
+    Node& GetNode(uint32_t index)
+    {
+        uint64_t i = index - 1 + firstChunkSize;
+        size_t k = ChunkOf(i);
+        return m_chunks[k].load(std::memory_order_acquire)[i - (firstChunkSize << k)];
+    }
+
+    uint32_t NewNode()
+    {
+        uint32_t index = m_numNodes.fetch_add(1, std::memory_order_relaxed) + 1;
+        size_t k = ChunkOf(index - 1 + firstChunkSize);
+        if (k >= numChunks)
+            throw std::bad_alloc();
+        if (!m_chunks[k].load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(m_growMutex);
+            if (!m_chunks[k].load(std::memory_order_relaxed))
+                m_chunks[k].store(new Node[firstChunkSize << k], std::memory_order_release);
+        }
+        return index;
+    }
+
+    void Push(std::atomic<uint64_t>& head, uint32_t index)
+    {
+        Node& node = GetNode(index);
+        uint64_t old = head.load(std::memory_order_relaxed);
+        do
+            node.m_next.store((uint32_t) old, std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(old, Pack(index, (uint32_t) (old >> 32) + 1), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    uint32_t Pop(std::atomic<uint64_t>& head)
+    {
+        uint64_t old = head.load(std::memory_order_acquire);
+        for (;;)
+        {
+            uint32_t index = (uint32_t) old;
+            if (index == 0)
+                return 0;
+            uint32_t next = GetNode(index).m_next.load(std::memory_order_relaxed); // (stale if another thread took it, then the exchange fails)
+            if (head.compare_exchange_weak(old, Pack(next, (uint32_t) (old >> 32) + 1), std::memory_order_acquire, std::memory_order_acquire))
+                return index;
+        }
+    }
+
+    template <class Item>
+    void Emplace(Item&& item)
+    {
+        uint32_t index = Pop(m_free);
+        if (index == 0)
+            index = NewNode();
+        try
+        {
+            new (&GetNode(index).m_storage) value_type(std::forward<Item>(item));
+        }
+        catch (...)
+        {
+            Push(m_free, index);
+            throw;
+        }
+        Push(m_items, index);
+    }
+
+    std::atomic<uint64_t> m_items; // stack of the nodes holding items, as Pack(top, tag)
+    std::atomic<uint64_t> m_free;  // stack of the empty nodes
+    std::atomic<uint32_t> m_numNodes;
+    std::atomic<Node*> m_chunks[numChunks];
+    std::mutex m_growMutex;
+};
 } } }
@@ -125,6 +125,33 @@ public:
     void insert(std::pair<wstring, Input> pair) { inputs.insert(pair); }
 };
 
+// Cumulative counters of the stages of a reader, see IDataReader::GetReaderStatistics().
+// Times are in seconds, summed over the threads doing the work.
+struct ReaderStatistics
+{
+    double m_chunkLoadSeconds = 0;    // waiting for the chunks of the deserializers
+    double m_transformSeconds = 0;
+    double m_packSeconds = 0;
+    double m_prefetchWaitSeconds = 0; // GetMinibatch() waiting for the prefetched minibatch
+    size_t m_chunkCacheHits = 0;
+    size_t m_chunkCacheMisses = 0;
+    size_t m_bytesRead = 0;
+
+    // the increments since an earlier snapshot
+    ReaderStatistics operator-(const ReaderStatistics& other) const
+    {
+        ReaderStatistics result;
+        result.m_chunkLoadSeconds = m_chunkLoadSeconds - other.m_chunkLoadSeconds;
+        result.m_transformSeconds = m_transformSeconds - other.m_transformSeconds;
+        result.m_packSeconds = m_packSeconds - other.m_packSeconds;
+        result.m_prefetchWaitSeconds = m_prefetchWaitSeconds - other.m_prefetchWaitSeconds;
+        result.m_chunkCacheHits = m_chunkCacheHits - other.m_chunkCacheHits;
+        result.m_chunkCacheMisses = m_chunkCacheMisses - other.m_chunkCacheMisses;
+        result.m_bytesRead = m_bytesRead - other.m_bytesRead;
+        return result;
+    }
+};
+
 // Data Reader interface
 // implemented by DataReader and underlying classes
 class DATAREADER_API IDataReader
@@ -169,6 +196,27 @@ public:
         NOT_IMPLEMENTED;
     };
 
+    // Gets the counters of the reader pipeline; returns false if the reader does not keep them.
+    virtual bool GetReaderStatistics(ReaderStatistics& /*statistics*/)
+    {
+        return false;
+    }
+
+    // Gets the position of the reader after the minibatches returned so far in the epoch, in a reader-specific encoding;
+    // returns false if the reader cannot restore it. Its first element is a global sample position, from which the epoch
+    // can also be continued alone through SetState({ position }), on any number of workers. This may return again
+    // the sequences that were returned in part.
+    virtual bool GetState(std::vector<size_t>& /*state*/)
+    {
+        return false;
+    }
+
+    // Continues the epoch started last from a state returned by GetState(), with the same epoch parameters.
+    virtual void SetState(const std::vector<size_t>& /*state*/)
+    {
+        NOT_IMPLEMENTED;
+    }
+
     // TODO: Should be removed when BPTT follows proper minibatch size.
     virtual size_t GetNumParallelSequencesForFixingBPTTMode() = 0;
 
@@ -336,6 +384,9 @@ public:
     virtual bool GetMinibatch(StreamMinibatchInputs& matrices);
     virtual bool GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, vector<size_t>& extrauttmap);
     virtual bool GetHmmData(msra::asr::simplesenonehmm* hmm);
+    virtual bool GetReaderStatistics(ReaderStatistics& statistics) override;
+    virtual bool GetState(std::vector<size_t>& state) override;
+    virtual void SetState(const std::vector<size_t>& state) override;
 
     size_t GetNumParallelSequencesForFixingBPTTMode();
     //int GetSentenceEndIdFromOutputLabel();
@@ -36,6 +36,7 @@ public:
     // Load a model based on configuration. The syntax is the same as when calling the cntk executable.
     // e.g. "modelFile=model.dat deviceId=0".
     // numCPUThreads can be used to set the thread count of BLAS.
+    // numEvalThreads and cpuCores (e.g. "0:1") give the evaluator threads of its own, optionally pinned to cores.
     // 
     virtual void Init(const std::string& config) = 0;
 
@@ -325,7 +326,7 @@ public:
     // The layout and shape of the data in inputs vector must match the schema returned by GetInputLayouts.
     // Output must be preallocated and sized to avoid memory allocation / deallocation across DLL
     // boundaries.
-    // This method is not reentrant, as the forward pass keeps internal state.
+    // This method is not reentrant, as the forward pass keeps internal state; use Clone() to evaluate on several threads.
     // inputs - vector of input buffers, one for every input as given by GetInputLayouts()
     // outputs - vector of output buffers. Must be sized to fit output schema.
     //
@@ -336,6 +337,71 @@ public:
     // (e.g. when vectors are manages by .net)
     // 
     virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output) = 0;
+
+    //
+    // Clone - create another evaluator of the same network, whose ForwardPass() can be called from another thread
+    // concurrently with the one of this evaluator. The evaluators share the parameters of the network, which the
+    // forward pass does not change; the node values and minibatch layouts are their own. If StartForwardEvaluation()
+    // has been called, it is called on the clone for the same outputs.
+    // The clone must be released by its Destroy(), independently of this evaluator.
+    //
+    virtual IEvaluateModelExtended<ElemType>* Clone() const = 0;
+
+    //
+    // ForwardPassBatched - same as ForwardPass(), but can be called concurrently from many threads, each with its own
+    // request of one sequence per input. The requests are evaluated together, as the parallel sequences of one
+    // minibatch of up to 'maxBatchSize' requests (default 32); a request waits up to 'maxBatchLatencyMs' milliseconds
+    // (default 2) for more requests to be batched with it. The call returns when the outputs of its request are written.
+    // Outputs must have one value per sample of the inputs or no dynamic axis, e.g. a sequence classification.
+    // The knobs are given to Init(). Must not be called concurrently with ForwardPass().
+    //
+    virtual void ForwardPassBatched(const Values<ElemType>& inputs, Values<ElemType>& output) = 0;
+
+    //
+    // WarmUp - evaluate synthetic inputs for every combination of the given batch sizes (numbers of parallel
+    // sequences) and sequence lengths, so that the lazy work of the first calls of these sizes is done before the
+    // evaluator serves requests: the cuDNN algorithm searches, the growth of the matrices, and the creation of the
+    // cuBLAS handles and workspaces. The largest batch is evaluated first, so that the buffers get their final sizes,
+    // and the algorithms chosen for it are kept for the smaller ones. Must be called after StartForwardEvaluation(),
+    // which calls it itself if Init() was given warmUpBatchSizes (e.g. "1:8:32") and warmUpSequenceLengths.
+    //
+    virtual void WarmUp(const std::vector<size_t>& batchSizes, const std::vector<size_t>& sequenceLengths) = 0;
+
+    //
+    // BindBuffers - bind input and output buffers that are owned by the caller, for ForwardPassBound(). Only the
+    // references are kept: the vectors and the memory they refer to must stay valid until other buffers are bound or
+    // the evaluator is destroyed. The caller may change the contents and m_size of the inputs between the calls.
+    //
+    virtual void BindBuffers(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs) = 0;
+
+    //
+    // ForwardPassBound - same as ForwardPass() on the bound buffers. Dense inputs of a network on the CPU are used
+    // in place; on a GPU they are copied to the device, and the outputs are copied into the bound buffers, once per
+    // call. Once the sizes stay the same, no memory is allocated.
+    //
+    virtual void ForwardPassBound() = 0;
+
+    //
+    // AllocateHostBuffer - allocate a buffer of elements to bind, page-locked if the network is on a GPU, which
+    // speeds up the copies to and from the device. Must be released by FreeHostBuffer() of the same evaluator.
+    //
+    virtual ElemType* AllocateHostBuffer(size_t numElements) = 0;
+    virtual void FreeHostBuffer(ElemType* buffer) = 0;
+
+    //
+    // Streaming evaluation of recurrent models, e.g. of audio that arrives in chunks. A stream is begun by
+    // BeginStream() and ended by EndStream(), which releases its state. ForwardPassStreams() evaluates the next chunk
+    // of each of the given streams, as the parallel sequences of one minibatch; the past values of a stream (PastValue()
+    // nodes) are carried over from its previous chunk, so that the cost of a chunk does not depend on the length of the
+    // history. The inputs must share one dynamic axis, and the outputs must have one value per sample of the inputs or
+    // no dynamic axis. Outputs that depend on future values cannot be streamed.
+    // If the outputs of a stream do not fit, its state is not advanced, and the chunk can be evaluated again.
+    // streamIds - the streams of the chunks, each at most once
+    // inputs, outputs - the input and output buffers of each stream, as for ForwardPass()
+    //
+    virtual void BeginStream(size_t streamId) = 0;
+    virtual void ForwardPassStreams(const std::vector<size_t>& streamIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs) = 0;
+    virtual void EndStream(size_t streamId) = 0;
 };
 
 template <typename ElemType>
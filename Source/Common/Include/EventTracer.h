@@ -0,0 +1,77 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ---------------------------------------------------------------------------
+// EventTracer -- timeline of the phases of training, in the Chrome trace format (chrome://tracing, Perfetto)
+//
+// Scopes placed in the reader, the training loop, gradient aggregation and checkpointing record their wall time
+// as complete events, one row per thread and one process per worker (the MPI rank). Timestamps are microseconds
+// of the system clock, so that the traces of the workers of a multi-node job line up when loaded together.
+// When tracing is off, a Scope costs one test of a flag; when on, two clock reads and an append under a lock.
+// Names and categories must be string literals (they are kept as pointers).
+// The events can also be collected in memory only, for tools that summarize them (see GetDurations()).
+// ---------------------------------------------------------------------------
+
+class EventTracer
+{
+public:
+    // Start collecting events, to be written to filePath by Flush(); further events beyond maxEvents are dropped.
+    static void Start(const std::wstring& filePath, int processId, size_t maxEvents = 1000000);
+    static bool IsEnabled() { return s_enabled; }
+
+    // Start collecting events in memory, without a trace file.
+    static void StartCollecting(size_t maxEvents = 1000000);
+
+    // durations in seconds of the events with the given name collected so far
+    static std::vector<double> GetDurations(const char* name);
+
+    // drop the events collected so far
+    static void Clear();
+
+    // write all events collected so far (the file is rewritten each time)
+    static void Flush();
+
+    class Scope
+    {
+    public:
+        Scope(const char* name, const char* category)
+            : m_name(nullptr)
+        {
+            if (IsEnabled())
+            {
+                m_name = name;
+                m_category = category;
+                m_begin = std::chrono::steady_clock::now();
+            }
+        }
+        ~Scope()
+        {
+            if (m_name)
+                Record(m_name, m_category, m_begin, std::chrono::steady_clock::now());
+        }
+
+    private:
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        const char* m_name;
+        const char* m_category;
+        std::chrono::steady_clock::time_point m_begin;
+    };
+
+private:
+    static void Record(const char* name, const char* category, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+    static bool s_enabled;
+};
+
+}}}
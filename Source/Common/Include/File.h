@@ -34,6 +34,8 @@ enum FileOptions
     fileOptionsRead = 8,                                        // open in read mode
     fileOptionsWrite = 16,                                      // open in write mode
     fileOptionsSequential = 32,                                 // optimize for sequential reads (allocates big buffer)
+    fileOptionsLargeBuffer = 64,                                // use a large user-space buffer, for many small reads or writes
+    fileOptionsMemoryMapped = 128,                              // binary read only: read from a read-only memory mapping of the file (large buffer where not supported)
     fileOptionsReadWrite = fileOptionsRead | fileOptionsWrite,  // read/write mode
 };
 
@@ -99,7 +101,11 @@ private:
     bool m_pcloseNeeded; // was opened with popen(), use pclose() when destructing
     bool m_seekable;     // this stream is seekable
     int m_options;       // FileOptions ored togther
+    std::vector<char> m_buffer; // user-space buffer of m_file with fileOptionsLargeBuffer
+    const char* m_mappedData;   // the memory mapping that m_file reads from, with fileOptionsMemoryMapped
+    size_t m_mappedSize;
     void Init(const wchar_t* filename, int fileOptions);
+    void OpenMapped(const wchar_t* filename);
 
 public:
     File(const std::wstring& filename, int fileOptions);
@@ -116,6 +122,7 @@ public:
     void SkipToDelimiter(int delim);
 
     bool IsTextBased();
+    bool IsMapped() const { return m_mappedData != nullptr; }
 
     bool IsUnicodeBOM(bool skip = false);
     bool IsEOF();
@@ -195,6 +202,40 @@ public:
         return *this;
     }
 
+    // get and put operators for arrays of basic types
+    // In binary files, the array is read or written in one go, rather than element by element (which is what text files do).
+    template <typename T>
+    void GetArray(T* data, size_t count)
+    {
+        if (IsTextBased())
+        {
+            for (size_t i = 0; i < count; i++)
+                fgetText(m_file, data[i]);
+        }
+        else
+            ReadBlock(data, sizeof(T) * count);
+    }
+    template <typename T>
+    void PutArray(const T* data, size_t count)
+    {
+        if (IsTextBased())
+        {
+            for (size_t i = 0; i < count; i++)
+                fputText(m_file, data[i]);
+        }
+        else
+            WriteBlock(data, sizeof(T) * count);
+    }
+
+    // read or write a contiguous block of a binary file, such as the elements of a matrix
+    // Large blocks go between the file and 'data' directly, bypassing the buffer of the file; reads of a mapped file are copies from the mapping.
+    void ReadBlock(void* data, size_t numBytes);
+    void WriteBlock(const void* data, size_t numBytes);
+
+    // for a mapped file, return the next 'numBytes' in the mapping itself and skip over them, without any copy;
+    // returns nullptr for files that are not mapped, which must be read with ReadBlock() instead
+    const void* GetMappedBlock(size_t numBytes);
+
     void WriteString(const char* str, int size = 0);                   // zero terminated strings use size=0
     void ReadString(char* str, int size);                              // read up to size bytes, or a zero terminator (or space in text mode)
     void WriteString(const wchar_t* str, int size = 0);                // zero terminated strings use size=0
@@ -0,0 +1,78 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Float16.h -- host-side conversion between float and IEEE 754 half precision (binary16)
+//
+// Half-precision values are stored as unsigned short. This is what readers use to ship
+// compact features, see Matrix::SetValueFromCompact(); the GPU converts with cuda_fp16.h instead.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// round to the nearest half (ties to even); overflows become infinity, NaNs stay NaNs
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign = (f >> 16) & 0x8000;
+    uint32_t absF = f & 0x7fffffff;
+    if (absF >= 0x7f800000) // Inf or NaN
+        return (uint16_t)(sign | 0x7c00 | (absF > 0x7f800000 ? 0x200 : 0));
+    if (absF >= 0x477ff000) // rounds to beyond the largest half (65504)
+        return (uint16_t)(sign | 0x7c00);
+    if (absF < 0x38800000) // below the smallest normal half: denormal or zero
+    {
+        if (absF < 0x33000000) // rounds to zero
+            return (uint16_t)sign;
+        uint32_t exponent = absF >> 23;
+        uint32_t mantissa = (absF & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent; // 14..24
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return (uint16_t)(sign | half);
+    }
+    // normal: rebias the exponent and round the mantissa to 10 bits; a carry correctly bumps the exponent
+    uint32_t half = ((absF - 0x38000000) >> 13);
+    uint32_t rest = absF & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return (uint16_t)(sign | half);
+}
+
+inline float HalfToFloat(uint16_t value)
+{
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t f;
+    if (exponent == 0x1f) // Inf or NaN
+        f = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent != 0) // normal
+        f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0) // zero
+        f = sign;
+    else // denormal: normalize
+    {
+        exponent = 113;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float result;
+    memcpy(&result, &f, sizeof(result));
+    return result;
+}
+
+}}}
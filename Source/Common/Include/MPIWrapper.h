@@ -11,6 +11,9 @@
 #pragma warning(pop)
 #else
 #include "mpi.h"
+#if defined(OPEN_MPI) && OPEN_MPI
+#include "mpi-ext.h" // for MPIX_Query_cuda_support()
+#endif
 #endif
 #pragma comment(lib, "msmpi.lib")
 
@@ -19,6 +22,11 @@
 #include <array>
 #include <vector>
 #include <memory>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
+#include "Metrics.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -61,6 +69,72 @@ static int operator||(int rc, const MpiFail &what)
 class MPIWrapper;
 typedef std::shared_ptr<MPIWrapper> MPIWrapperPtr;
 
+// handle of a non-blocking operation started by MPIWrapper
+// The operation is complete once Test() has returned true or Wait() has returned; until then, its buffers must neither
+// be accessed nor deallocated. A request that is destructed while its operation is pending waits for it.
+class MPIRequest
+{
+    friend class MPIWrapper;
+
+    MPI_Request m_request;
+    std::vector<int> m_counts; // array argument of the operation, which MPI may read until it is complete
+
+public:
+    MPIRequest()
+        : m_request(MPI_REQUEST_NULL)
+    {
+    }
+    MPIRequest(MPIRequest&& other)
+        : m_request(other.m_request), m_counts(std::move(other.m_counts))
+    {
+        other.m_request = MPI_REQUEST_NULL;
+    }
+    MPIRequest& operator=(MPIRequest&& other)
+    {
+        if (this != &other)
+        {
+            Wait();
+            m_request = other.m_request;
+            m_counts = std::move(other.m_counts);
+            other.m_request = MPI_REQUEST_NULL;
+        }
+        return *this;
+    }
+    MPIRequest(const MPIRequest&) = delete;
+    MPIRequest& operator=(const MPIRequest&) = delete;
+    ~MPIRequest()
+    {
+        if (m_request != MPI_REQUEST_NULL)
+            MPI_Wait(&m_request, MPI_STATUS_IGNORE); // (no error handling in a destructor)
+    }
+
+    // whether the operation is complete, without waiting for it
+    bool Test()
+    {
+        if (m_request == MPI_REQUEST_NULL)
+            return true;
+        int completed;
+        MPI_Test(&m_request, &completed, MPI_STATUS_IGNORE) || MpiFail("MPIRequest: MPI_Test");
+        return !!completed;
+    }
+
+    void Wait()
+    {
+        if (m_request != MPI_REQUEST_NULL)
+            MPI_Wait(&m_request, MPI_STATUS_IGNORE) || MpiFail("MPIRequest: MPI_Wait");
+    }
+
+    static void WaitAll(std::vector<MPIRequest>& requests)
+    {
+        std::vector<MPI_Request> handles(requests.size());
+        for (size_t i = 0; i < requests.size(); i++)
+            handles[i] = requests[i].m_request;
+        MPI_Waitall((int) handles.size(), handles.data(), MPI_STATUSES_IGNORE) || MpiFail("MPIRequest: MPI_Waitall");
+        for (auto& request : requests)
+            request.m_request = MPI_REQUEST_NULL;
+    }
+};
+
 class MPIWrapper : public std::enable_shared_from_this<MPIWrapper>
 {
     int m_myRank;
@@ -70,6 +144,19 @@ class MPIWrapper : public std::enable_shared_from_this<MPIWrapper>
     // MPI communicator that reflects the current subset selection
     MPI_Comm m_currentComm;
 
+    // for hierarchical all-reduce (see SetHierarchicalAllReduce()): the workers on this machine, with the leader as rank 0,
+    // and the leaders of all machines (MPI_COMM_NULL if we are not a leader)
+    bool m_hierarchicalAllReduce;
+    MPI_Comm m_machineComm;
+    MPI_Comm m_machineLeadersComm;
+
+    // for the shared-memory variant of the hierarchical all-reduce (see SharedMemoryAllReduce()): a window in shared memory
+    // over the workers of this machine, with one slot of m_sharedSlotBytes per worker, mapped into our address space
+    bool m_sharedMemoryAllReduce;
+    MPI_Win m_sharedWindow;
+    size_t m_sharedSlotBytes;
+    std::vector<char *> m_sharedSlots;
+
     static MPIWrapperPtr s_mpi;
 
     // MPI_Init() with delay-loading the msmpi.dll (possibly causing a failure if missing; we want to catch that)
@@ -119,7 +206,8 @@ class MPIWrapper : public std::enable_shared_from_this<MPIWrapper>
 
 public:
     MPIWrapper()
-        : m_currentComm(MPI_COMM_WORLD)
+        : m_currentComm(MPI_COMM_WORLD), m_hierarchicalAllReduce(false), m_machineComm(MPI_COMM_NULL), m_machineLeadersComm(MPI_COMM_NULL),
+          m_sharedMemoryAllReduce(false), m_sharedWindow(MPI_WIN_NULL), m_sharedSlotBytes(0)
     {
         static bool initialized = false;
         if (initialized)
@@ -169,7 +257,10 @@ public:
         // Do not finalize in event of an exception since calling MPI_Finalize without
         // all pending communications being finished results in a hang
         if (!std::uncaught_exception())
+        {
+            FreeSharedWindow();
             MPI_Finalize();
+        }
     }
 
 private:
@@ -236,6 +327,145 @@ private:
         Ping("requestnodes (after change)");
     }
 
+    // split the workers by machine, which is identified by the processor name; the leader of a machine is its worker of lowest rank
+    void CreateMachineCommunicators()
+    {
+        std::vector<char> names(MPI_MAX_PROCESSOR_NAME * NumNodesInUse(), 0);
+        char* myName = &names[MPI_MAX_PROCESSOR_NAME * CurrentNodeRank()];
+        int nameLength;
+        MPI_Get_processor_name(myName, &nameLength) || MpiFail("CreateMachineCommunicators: MPI_Get_processor_name");
+        MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, names.data(), MPI_MAX_PROCESSOR_NAME, MPI_CHAR, Communicator()) || MpiFail("CreateMachineCommunicators: MPI_Allgather");
+
+        int leader = 0;
+        while (strncmp(&names[MPI_MAX_PROCESSOR_NAME * leader], myName, MPI_MAX_PROCESSOR_NAME) != 0)
+            leader++;
+        size_t numMachines = 0;
+        for (size_t rank = 0; rank < NumNodesInUse(); rank++)
+        {
+            size_t first = 0;
+            while (strncmp(&names[MPI_MAX_PROCESSOR_NAME * first], &names[MPI_MAX_PROCESSOR_NAME * rank], MPI_MAX_PROCESSOR_NAME) != 0)
+                first++;
+            if (first == rank)
+                numMachines++;
+        }
+
+        MPI_Comm_split(Communicator(), leader, m_myRank, &m_machineComm) || MpiFail("CreateMachineCommunicators: MPI_Comm_split");
+        MPI_Comm_split(Communicator(), (leader == m_myRank) ? 0 : MPI_UNDEFINED, m_myRank, &m_machineLeadersComm) || MpiFail("CreateMachineCommunicators: MPI_Comm_split");
+
+        int numOnMachine;
+        MPI_Comm_size(m_machineComm, &numOnMachine) || MpiFail("CreateMachineCommunicators: MPI_Comm_size");
+        fprintf(stderr, "mpihelper: %d machines; we (%d) are on %s with %d workers, led by worker %d\n",
+                (int) numMachines, (int) m_myRank, myName, numOnMachine, leader);
+        fflush(stderr);
+    }
+
+    // sum over a machine on its leader, all-reduce over the leaders, and broadcast back over the machine
+    template <class ElemType>
+    void HierarchicalAllReduce(ElemType *pData, size_t nData)
+    {
+        int machineRank;
+        MPI_Comm_rank(m_machineComm, &machineRank) || MpiFail("HierarchicalAllReduce: MPI_Comm_rank");
+        if (machineRank == 0)
+            MPI_Reduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, 0, m_machineComm) || MpiFail("HierarchicalAllReduce: MPI_Reduce");
+        else
+            MPI_Reduce(pData, nullptr, (int) nData, GetDataType(pData), MPI_SUM, 0, m_machineComm) || MpiFail("HierarchicalAllReduce: MPI_Reduce");
+
+        if (m_machineLeadersComm != MPI_COMM_NULL)
+            MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, m_machineLeadersComm) || MpiFail("HierarchicalAllReduce: MPI_Allreduce");
+
+        MPI_Bcast(pData, (int) nData, GetDataType(pData), 0, m_machineComm) || MpiFail("HierarchicalAllReduce: MPI_Bcast");
+    }
+
+    // The same as HierarchicalAllReduce(), but without messages within a machine: every worker copies its data into its slot
+    // of a window in shared memory, the workers sum disjoint ranges of all slots into the slot of the leader, the leaders
+    // all-reduce that slot among themselves, and every worker copies the result back out of it.
+    template <class ElemType>
+    void SharedMemoryAllReduce(ElemType *pData, size_t nData)
+    {
+        int numWorkers;
+        MPI_Comm_size(m_machineComm, &numWorkers) || MpiFail("SharedMemoryAllReduce: MPI_Comm_size");
+        if (numWorkers == 1) // nothing to share on this machine
+        {
+            MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, m_machineLeadersComm) || MpiFail("SharedMemoryAllReduce: MPI_Allreduce");
+            return;
+        }
+
+        EnsureSharedWindow(nData * sizeof(ElemType));
+        int machineRank;
+        MPI_Comm_rank(m_machineComm, &machineRank) || MpiFail("SharedMemoryAllReduce: MPI_Comm_rank");
+
+        memcpy(m_sharedSlots[machineRank], pData, nData * sizeof(ElemType));
+        SharedWindowBarrier();
+
+        // sum our range over the slots in the order of the workers, so that all machines compute the same sums
+        ElemType *sum = (ElemType *) m_sharedSlots[0];
+        const size_t begin = nData * machineRank / numWorkers;
+        const size_t end = nData * (machineRank + 1) / numWorkers;
+        for (size_t worker = 1; worker < (size_t) numWorkers; worker++)
+        {
+            const ElemType *slot = (const ElemType *) m_sharedSlots[worker];
+            for (size_t i = begin; i < end; i++)
+                sum[i] += slot[i];
+        }
+        SharedWindowBarrier();
+
+        if (m_machineLeadersComm != MPI_COMM_NULL)
+            MPI_Allreduce(MPI_IN_PLACE, sum, (int) nData, GetDataType(pData), MPI_SUM, m_machineLeadersComm) || MpiFail("SharedMemoryAllReduce: MPI_Allreduce");
+        SharedWindowBarrier();
+
+        memcpy(pData, sum, nData * sizeof(ElemType));
+        // the leader must not overwrite its slot with the data of the next all-reduce before everyone has read the result
+        SharedWindowBarrier();
+    }
+
+    // (re-)allocate the shared window if a slot is too small for nBytes; collective over the machine, which is
+    // fine since all workers all-reduce the same sizes in the same order
+    void EnsureSharedWindow(size_t nBytes)
+    {
+        if (m_sharedWindow != MPI_WIN_NULL && nBytes <= m_sharedSlotBytes)
+            return;
+
+        FreeSharedWindow();
+        const size_t alignment = 64; // keep the slots of different workers in different cache lines
+        m_sharedSlotBytes = std::max((nBytes + alignment - 1) / alignment * alignment, alignment);
+
+        char *mySlot;
+        MPI_Win_allocate_shared((MPI_Aint) m_sharedSlotBytes, 1, MPI_INFO_NULL, m_machineComm, &mySlot, &m_sharedWindow) || MpiFail("EnsureSharedWindow: MPI_Win_allocate_shared");
+
+        int numWorkers;
+        MPI_Comm_size(m_machineComm, &numWorkers) || MpiFail("EnsureSharedWindow: MPI_Comm_size");
+        m_sharedSlots.resize(numWorkers);
+        for (int worker = 0; worker < numWorkers; worker++)
+        {
+            MPI_Aint slotBytes;
+            int dispUnit;
+            MPI_Win_shared_query(m_sharedWindow, worker, &slotBytes, &dispUnit, &m_sharedSlots[worker]) || MpiFail("EnsureSharedWindow: MPI_Win_shared_query");
+        }
+
+        // a passive-target epoch over the whole lifetime of the window; the workers synchronize with SharedWindowBarrier()
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, m_sharedWindow) || MpiFail("EnsureSharedWindow: MPI_Win_lock_all");
+    }
+
+    void FreeSharedWindow()
+    {
+        if (m_sharedWindow == MPI_WIN_NULL)
+            return;
+
+        MPI_Win_unlock_all(m_sharedWindow) || MpiFail("FreeSharedWindow: MPI_Win_unlock_all");
+        MPI_Win_free(&m_sharedWindow) || MpiFail("FreeSharedWindow: MPI_Win_free");
+        m_sharedWindow = MPI_WIN_NULL;
+        m_sharedSlotBytes = 0;
+        m_sharedSlots.clear();
+    }
+
+    // make our stores to the shared window visible to the other workers of the machine, and theirs to us
+    void SharedWindowBarrier()
+    {
+        MPI_Win_sync(m_sharedWindow) || MpiFail("SharedWindowBarrier: MPI_Win_sync");
+        MPI_Barrier(m_machineComm) || MpiFail("SharedWindowBarrier: MPI_Barrier");
+        MPI_Win_sync(m_sharedWindow) || MpiFail("SharedWindowBarrier: MPI_Win_sync");
+    }
+
 public:
 
     static MPIWrapperPtr GetInstance(bool create = false)
@@ -313,6 +543,14 @@ public:
         return sizeof(size_t) == 4 ? MPI_UNSIGNED : MPI_LONG_LONG_INT;
     }
 
+    // counts the payload handed to the collectives below by this worker, whatever the algorithm sends over the wire
+    template <class ElemType>
+    static void CountBytesCommunicated(size_t nData)
+    {
+        static auto& bytes = Metrics::GetCounter("cntk_mpi_bytes_total", "Bytes of the data exchanged by this worker in MPI collectives");
+        bytes.Add(nData * sizeof(ElemType));
+    }
+
     // allreduce of a vector
     template <typename VECTORLIKEOBJECT>
     void AllReduce(VECTORLIKEOBJECT &accumulator) const
@@ -324,26 +562,185 @@ public:
         if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
         {
             MPI_Allreduce(MPI_IN_PLACE, dataptr, (int) totalnumelements, GetDataType(dataptr), MPI_SUM, Communicator()) || MpiFail("allreduce: MPI_Allreduce");
+            CountBytesCommunicated<typename std::remove_pointer<decltype(dataptr)>::type>(totalnumelements);
         }
     }
 
     // for raw pointer
+    // This is used for gradients and models, and is hierarchical if so configured.
     template <class ElemType>
     void AllReduce(ElemType *pData, size_t nData)
     {
         if ((NumNodesInUse() > 1 && (Communicator() != MPI_COMM_NULL)))
         {
-            MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, Communicator()) || MpiFail("Allreduce: MPI_Allreduce");
+            CountBytesCommunicated<ElemType>(nData);
+            if (m_hierarchicalAllReduce && m_sharedMemoryAllReduce)
+                SharedMemoryAllReduce(pData, nData);
+            else if (m_hierarchicalAllReduce)
+                HierarchicalAllReduce(pData, nData);
+            else
+                MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, Communicator()) || MpiFail("Allreduce: MPI_Allreduce");
         }
     }
 
+    // With several workers per machine, a flat all-reduce sends one copy of the data per worker over the network.
+    // A hierarchical all-reduce first sums the data of a machine on one leader worker, all-reduces only among the
+    // leaders, and broadcasts the result back within the machine. Enabling it is a collective operation.
+    // With useSharedMemory, the workers of a machine sum their data in a window in shared memory (MPI-3) instead of
+    // sending it to the leader, so that only the leaders exchange messages.
+    void SetHierarchicalAllReduce(bool enable, bool useSharedMemory = false)
+    {
+        if (enable && m_machineComm == MPI_COMM_NULL)
+            CreateMachineCommunicators();
+        m_hierarchicalAllReduce = enable;
+        m_sharedMemoryAllReduce = enable && useSharedMemory;
+    }
+    bool UsesHierarchicalAllReduce() const
+    {
+        return m_hierarchicalAllReduce;
+    }
+    bool UsesSharedMemoryAllReduce() const
+    {
+        return m_sharedMemoryAllReduce;
+    }
+
     template <class ElemType>
     void Bcast(ElemType *pData, size_t nData, size_t srcRank)
     {
         if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
         {
             MPI_Bcast(pData, (int) nData, GetDataType(pData), (int) srcRank, Communicator()) || MpiFail("Bcast: MPI_Bcast");
+            CountBytesCommunicated<ElemType>(nData);
+        }
+    }
+
+    // all-reduce with the maximum instead of the sum
+    template <class ElemType>
+    void AllReduceMax(ElemType *pData, size_t nData)
+    {
+        if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
+        {
+            MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_MAX, Communicator()) || MpiFail("AllReduceMax: MPI_Allreduce");
+        }
+    }
+
+    // concatenate the local elements of all workers in the order of their ranks; counts receives the number of elements of each worker
+    template <class ElemType>
+    void AllGather(const ElemType *pLocal, size_t nLocal, std::vector<ElemType> &all, std::vector<int> &counts)
+    {
+        if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
+        {
+            int n = (int) nLocal;
+            counts.resize(NumNodesInUse());
+            MPI_Allgather(&n, 1, MPI_INT, counts.data(), 1, MPI_INT, Communicator()) || MpiFail("AllGather: MPI_Allgather");
+            std::vector<int> displacements(counts.size(), 0);
+            for (size_t i = 1; i < counts.size(); i++)
+                displacements[i] = displacements[i - 1] + counts[i - 1];
+            all.resize(displacements.back() + counts.back());
+            auto dataType = GetDataType(const_cast<ElemType *>(pLocal));
+            MPI_Allgatherv(pLocal, n, dataType, all.data(), counts.data(), displacements.data(), dataType, Communicator()) || MpiFail("AllGather: MPI_Allgatherv");
+            CountBytesCommunicated<ElemType>(all.size());
+        }
+        else
+        {
+            all.assign(pLocal, pLocal + nLocal);
+            counts.assign(1, (int) nLocal);
+        }
+    }
+
+    // sum pAll over all workers and leave to each worker its part, where worker r receives counts[r] elements following those of the workers before it
+    template <class ElemType>
+    void ReduceScatter(const ElemType *pAll, ElemType *pLocal, const std::vector<int> &counts)
+    {
+        if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
+        {
+            MPI_Reduce_scatter(pAll, pLocal, counts.data(), GetDataType(pLocal), MPI_SUM, Communicator()) || MpiFail("ReduceScatter: MPI_Reduce_scatter");
+            CountBytesCommunicated<ElemType>(std::accumulate(counts.begin(), counts.end(), (size_t) 0));
+        }
+        else
+        {
+            std::copy(pAll, pAll + counts[0], pLocal);
+        }
+    }
+
+    // -----------------------------------------------------------------------
+    // non-blocking data exchange
+    // Each call starts the operation and returns its request right away, so that the caller can overlap its own work
+    // with the communication, without helper threads. All workers must start the collectives in the same order.
+    // Unlike AllReduce(), AllReduceAsync() always reduces over all workers directly, also with hierarchical all-reduce.
+    // With a CUDA-aware MPI (see IsCUDAAware()), the buffers may be in GPU memory; they must have been computed before the call.
+    // On Windows these calls require MS MPI v7 or higher.
+    // -----------------------------------------------------------------------
+
+    template <class ElemType>
+    MPIRequest AllReduceAsync(ElemType *pData, size_t nData)
+    {
+        MPIRequest request;
+        if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
+        {
+            MPI_Iallreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, Communicator(), &request.m_request) || MpiFail("AllReduceAsync: MPI_Iallreduce");
+            CountBytesCommunicated<ElemType>(nData);
+        }
+        return request;
+    }
+
+    template <class ElemType>
+    MPIRequest BcastAsync(ElemType *pData, size_t nData, size_t srcRank)
+    {
+        MPIRequest request;
+        if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
+        {
+            MPI_Ibcast(pData, (int) nData, GetDataType(pData), (int) srcRank, Communicator(), &request.m_request) || MpiFail("BcastAsync: MPI_Ibcast");
+            CountBytesCommunicated<ElemType>(nData);
+        }
+        return request;
+    }
+
+    // concatenate nLocal elements of each worker into pAll, in the order of their ranks
+    template <class ElemType>
+    MPIRequest AllGatherAsync(const ElemType *pLocal, size_t nLocal, ElemType *pAll)
+    {
+        MPIRequest request;
+        if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
+        {
+            auto dataType = GetDataType(pAll);
+            MPI_Iallgather(pLocal, (int) nLocal, dataType, pAll, (int) nLocal, dataType, Communicator(), &request.m_request) || MpiFail("AllGatherAsync: MPI_Iallgather");
+            CountBytesCommunicated<ElemType>(nLocal * NumNodesInUse());
+        }
+        else
+        {
+            std::copy(pLocal, pLocal + nLocal, pAll);
         }
+        return request;
+    }
+
+    // non-blocking variant of ReduceScatter()
+    template <class ElemType>
+    MPIRequest ReduceScatterAsync(const ElemType *pAll, ElemType *pLocal, const std::vector<int> &counts)
+    {
+        MPIRequest request;
+        if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
+        {
+            request.m_counts = counts;
+            MPI_Ireduce_scatter(pAll, pLocal, request.m_counts.data(), GetDataType(pLocal), MPI_SUM, Communicator(), &request.m_request) || MpiFail("ReduceScatterAsync: MPI_Ireduce_scatter");
+            CountBytesCommunicated<ElemType>(std::accumulate(counts.begin(), counts.end(), (size_t) 0));
+        }
+        else
+        {
+            std::copy(pAll, pAll + counts[0], pLocal);
+        }
+        return request;
+    }
+
+    // whether the MPI library reports that it accepts buffers in GPU memory
+    // Only Open MPI can tell; with other libraries this is false, even where they are CUDA-aware.
+    static bool IsCUDAAware()
+    {
+#if defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+        return MPIX_Query_cuda_support() == 1;
+#else
+        return false;
+#endif
     }
 
     // wait for all ranks to reach here
@@ -351,6 +748,47 @@ public:
     {
         MPI_Barrier(m_currentComm) || MpiFail("waitall: MPI_Barrier");
     }
+
+    // -----------------------------------------------------------------------
+    // one-sided communication (wrappers around MPI RMA functions)
+    // Every worker exposes a buffer in a window, which the others add to and read from without the owner taking part.
+    // Each access takes a shared lock, so that accesses from different workers proceed concurrently; they are
+    // atomic per element since reads are done by MPI_Get_accumulate instead of MPI_Get.
+    // -----------------------------------------------------------------------
+
+    // collective; pData must stay allocated until FreeWindow()
+    template <class ElemType>
+    MPI_Win CreateWindow(ElemType *pData, size_t nData)
+    {
+        MPI_Win win;
+        MPI_Win_create(pData, (MPI_Aint) (nData * sizeof(ElemType)), sizeof(ElemType), MPI_INFO_NULL, Communicator(), &win) || MpiFail("CreateWindow: MPI_Win_create");
+        return win;
+    }
+
+    // collective
+    void FreeWindow(MPI_Win &win)
+    {
+        MPI_Win_free(&win) || MpiFail("FreeWindow: MPI_Win_free");
+    }
+
+    // combine the data into the window of the target with op (MPI_SUM or MPI_REPLACE)
+    template <class ElemType>
+    void AccumulateToWindow(const ElemType *pData, size_t nData, size_t targetRank, size_t targetOffset, MPI_Op op, MPI_Win win)
+    {
+        auto dataType = GetDataType(const_cast<ElemType *>(pData));
+        MPI_Win_lock(MPI_LOCK_SHARED, (int) targetRank, 0, win) || MpiFail("AccumulateToWindow: MPI_Win_lock");
+        MPI_Accumulate(pData, (int) nData, dataType, (int) targetRank, (MPI_Aint) targetOffset, (int) nData, dataType, op, win) || MpiFail("AccumulateToWindow: MPI_Accumulate");
+        MPI_Win_unlock((int) targetRank, win) || MpiFail("AccumulateToWindow: MPI_Win_unlock");
+    }
+
+    template <class ElemType>
+    void GetFromWindow(ElemType *pData, size_t nData, size_t targetRank, size_t targetOffset, MPI_Win win)
+    {
+        auto dataType = GetDataType(pData);
+        MPI_Win_lock(MPI_LOCK_SHARED, (int) targetRank, 0, win) || MpiFail("GetFromWindow: MPI_Win_lock");
+        MPI_Get_accumulate(nullptr, 0, dataType, pData, (int) nData, dataType, (int) targetRank, (MPI_Aint) targetOffset, (int) nData, dataType, MPI_NO_OP, win) || MpiFail("GetFromWindow: MPI_Get_accumulate");
+        MPI_Win_unlock((int) targetRank, win) || MpiFail("GetFromWindow: MPI_Win_unlock");
+    }
 };
 
 }}}
@@ -0,0 +1,119 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ---------------------------------------------------------------------------
+// Metrics -- process-wide registry of runtime counters, gauges and histograms, for fleet monitoring
+//
+// The reader, SGD, MPIWrapper and EvalDll update them as they go: counters (e.g. samples, bytes communicated),
+// gauges (e.g. samples per second, GPU memory high-water) and latency histograms (e.g. of minibatches).
+// An update is a relaxed atomic operation; looking up a metric by name takes a lock, so callers keep the
+// reference, typically in a function-local static. Metrics live until the end of the process.
+// StartExport() writes them periodically to a file and/or serves them over HTTP, in the Prometheus text format.
+// Names and help texts must be string literals (they are kept as pointers).
+// ---------------------------------------------------------------------------
+
+class Metrics
+{
+public:
+    class Counter
+    {
+    public:
+        Counter() : m_value(0) { }
+        void Add(uint64_t value) { m_value.fetch_add(value, std::memory_order_relaxed); }
+        uint64_t Get() const { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> m_value;
+    };
+
+    class Gauge
+    {
+    public:
+        Gauge() : m_value(0) { }
+        void Set(double value) { m_value.store(value, std::memory_order_relaxed); }
+        // raise the value to 'value' if it is lower, for high-water marks
+        void SetMax(double value)
+        {
+            double current = m_value.load(std::memory_order_relaxed);
+            while (value > current && !m_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+                ;
+        }
+        double Get() const { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> m_value;
+    };
+
+    // counts of observations in buckets given by their upper bounds, plus their sum
+    class Histogram
+    {
+    public:
+        explicit Histogram(const std::vector<double>& upperBounds);
+        void Observe(double value);
+
+        const std::vector<double>& UpperBounds() const { return m_upperBounds; }
+        uint64_t BucketCount(size_t bucket) const { return m_counts[bucket].load(std::memory_order_relaxed); } // bucket == UpperBounds().size() is +Inf
+        uint64_t Count() const;
+        double Sum() const { return m_sum.load(std::memory_order_relaxed); }
+
+    private:
+        Histogram(const Histogram&) = delete;
+        Histogram& operator=(const Histogram&) = delete;
+
+        std::vector<double> m_upperBounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+        std::atomic<double> m_sum;
+    };
+
+    static Counter& GetCounter(const char* name, const char* help);
+    static Gauge& GetGauge(const char* name, const char* help);
+    // The default buckets suit latencies in seconds, from 100 microseconds to a minute.
+    static Histogram& GetHistogram(const char* name, const char* help, const std::vector<double>& upperBounds = LatencyBuckets());
+    static const std::vector<double>& LatencyBuckets();
+
+    // Adds the wall time of its scope in seconds to a histogram.
+    class Timer
+    {
+    public:
+        explicit Timer(Histogram& histogram)
+            : m_histogram(histogram), m_begin(std::chrono::steady_clock::now())
+        {
+        }
+        ~Timer()
+        {
+            m_histogram.Observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - m_begin).count());
+        }
+
+    private:
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        Histogram& m_histogram;
+        std::chrono::steady_clock::time_point m_begin;
+    };
+
+    // all metrics in the Prometheus text format, each sample labeled with the labels set by StartExport()
+    static std::string Format();
+
+    // Start writing the metrics every intervalSeconds to filePath (if not empty), which is replaced atomically,
+    // and serving them at http://<host>:port/metrics (if port > 0). 'labels' identify this process, e.g. rank="3".
+    // Only the first call takes effect; later ones (e.g. by a second evaluator in the process) are ignored.
+    static void StartExport(const std::wstring& filePath, int port, size_t intervalSeconds, const std::string& labels = std::string());
+
+    // write the file a last time and stop the exporting threads
+    static void StopExport();
+};
+
+}}}
@@ -9,6 +9,8 @@
 #include <functional> // for function<>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <algorithm>
 
 namespace Microsoft { namespace MSR { namespace ScriptableObjects {
 
@@ -529,7 +531,8 @@ class ConfigRecord : public Object, public IConfigRecord // all configuration ar
 {
     function<void(const std::wstring &)> failfn; // function to call in case of failure due to this value
     // change to ContextInsensitiveMap<ConfigValuePtr>
-    std::map<std::wstring, ConfigValuePtr> members;
+    // (hashed, since every identifier lookup of the evaluator searches the records of all enclosing scopes)
+    std::unordered_map<std::wstring, ConfigValuePtr> members;
     IConfigRecordPtr parentScope; // we look up the chain
     ConfigRecord()
     {
@@ -583,8 +586,10 @@ public:
     virtual std::vector<std::wstring> /*IConfigRecord::*/ GetMemberIds() const
     {
         std::vector<std::wstring> ids;
+        ids.reserve(members.size());
         for (auto &member : members)
             ids.push_back(member.first);
+        sort(ids.begin(), ids.end()); // (in a defined order, e.g. for the order of nodes constructed from a record)
         return ids;
     }
 };
@@ -122,8 +122,19 @@ struct MBLayout
     // Use this instead of actual assignment to make it super-obvious that this is not copying the pointer but actual content. The pointer is kept fixed.
     // Use "keepName" if the "identity" of the target is to be preserved, e.g. 
     // while copying from reader space to network space.
+    // If the content is the same as before (as always in frame mode and with fixed-length data), the data computed from it
+    // are kept, in particular the columns validity mask, which then lives on the device across minibatches.
     void CopyFrom(const MBLayoutPtr& other, bool keepName=false)
     {
+        if (other.get() == this)
+            return;
+        if (!m_writable && *this == *other) // (locked, so that the computed data are complete)
+        {
+            if (!keepName)
+                m_axisName = other->m_axisName;
+            return;
+        }
+
         m_numTimeSteps = other->m_numTimeSteps;
         m_numParallelSequences = other->m_numParallelSequences;
         m_sequences = other->m_sequences;
@@ -286,6 +297,23 @@ public:
         return m_sequences;
     }
 
+    // return the sequences clipped to this minibatch, gaps left out, as the sequence-level Matrix functions take them
+    std::vector<SequenceInMinibatch> GetClippedSequences() const
+    {
+        const ptrdiff_t numTimeSteps = (ptrdiff_t) GetNumTimeSteps();
+        std::vector<SequenceInMinibatch> sequences;
+        for (const auto& seq : m_sequences)
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            ptrdiff_t tBegin = max(seq.tBegin, (ptrdiff_t) 0);
+            ptrdiff_t tEnd = min((ptrdiff_t) seq.tEnd, numTimeSteps);
+            if (tBegin < tEnd)
+                sequences.push_back(SequenceInMinibatch{seq.s, (size_t) tBegin, (size_t) tEnd});
+        }
+        return sequences;
+    }
+
     // compute the number of actual samples in this layout (not counting gaps)
     // This is used by MeanNode and InvStdDevNode, and by statistics reporting.
     size_t GetActualNumSamples() const;
@@ -381,6 +381,18 @@ public:
     bool operator==(const TensorShape& other) const { return m_dims == other.m_dims; }
     bool operator!=(const TensorShape& other) const { return !operator==(other); } // duh!
 
+    // test whether this refers to a dense matrix (no strides)
+    bool IsDense() const
+    {
+        for (size_t k = 0; k < m_dims.size(); k++)
+        {
+            ptrdiff_t stride = k > 0 ? m_strides[k - 1] * (ptrdiff_t) m_dims[k - 1] : 1;
+            if (m_strides[k] != stride)
+                return false;
+        }
+        return true;
+    }
+
     // verify that this refers to a dense matrix (no strides)
     void VerifyIsDense() const
     {
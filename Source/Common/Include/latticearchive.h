@@ -62,6 +62,30 @@ enum mbrclassdefinition // used to identify definition of class in minimum bayes
     // monophonestate = 2,
     monophone = 3, // pMBR?
 };
+
+// ===========================================================================
+// memoryreader -- reads a lattice straight from memory, e.g. from a memory-mapped
+// archive, in place of a FILE*
+// ===========================================================================
+class memoryreader
+{
+    const char* p;
+    const char* end;
+
+public:
+    memoryreader(const char* data, size_t size)
+        : p(data), end(data + size)
+    {
+    }
+    void read(void* buffer, size_t size)
+    {
+        if (size > (size_t)(end - p))
+            RuntimeError("memoryreader: attempted to read beyond the end of the lattice data");
+        memcpy(buffer, p, size);
+        p += size;
+    }
+};
+
 // ===========================================================================
 // lattice -- one lattice in memory
 // ===========================================================================
@@ -942,19 +966,43 @@ public:
     {
     }
 
-    size_t freadtag(FILE* f, const char* tag)
+    // the sources lattices are read from
+    static void freadbytes(FILE* f, void* buffer, size_t size)
+    {
+        freadOrDie(buffer, 1, size, f);
+    }
+    static void freadbytes(memoryreader& r, void* buffer, size_t size)
+    {
+        r.read(buffer, size);
+    }
+
+    template <class SOURCE>
+    void fchecktag(SOURCE& f, const char* tag)
     {
-        fcheckTag(f, tag);
-        return (unsigned int) fgetint(f);
+        char readtag[5];
+        freadbytes(f, readtag, 4);
+        readtag[4] = 0;
+        fcompareTag(readtag, tag);
     }
 
-    template <class VECTOR>
-    void freadvector(FILE* f, const char* tag, VECTOR& v, size_t expectedsize = SIZE_MAX)
+    template <class SOURCE>
+    size_t freadtag(SOURCE& f, const char* tag)
+    {
+        fchecktag(f, tag);
+        int value;
+        freadbytes(f, &value, sizeof(value));
+        return (unsigned int) value;
+    }
+
+    template <class SOURCE, class VECTOR>
+    void freadvector(SOURCE& f, const char* tag, VECTOR& v, size_t expectedsize = SIZE_MAX)
     {
         const size_t sz = freadtag(f, tag);
         if (expectedsize != SIZE_MAX && sz != expectedsize)
             RuntimeError("freadvector: malformed file, number of vector elements differs from head, for tag %s", tag);
-        freadOrDie(v, sz, f);
+        v.resize(sz);
+        if (sz > 0)
+            freadbytes(f, &v[0], sizeof(v[0]) * sz);
     }
 
     // read from a stream
@@ -966,30 +1014,44 @@ public:
     // V1 lattices will be converted. 'spsenoneid' is used in that process.
     template <class IDMAP>
     void fread(FILE* f, const IDMAP& idmap, size_t spunit)
+    {
+        freadfrom(f, idmap, spunit);
+    }
+
+    // same, reading from memory (e.g. a memory-mapped archive)
+    template <class IDMAP>
+    void fread(memoryreader& r, const IDMAP& idmap, size_t spunit)
+    {
+        freadfrom(r, idmap, spunit);
+    }
+
+private:
+    template <class SOURCE, class IDMAP>
+    void freadfrom(SOURCE& f, const IDMAP& idmap, size_t spunit)
     {
         size_t version = freadtag(f, "LAT ");
         if (version == 1)
         {
-            freadOrDie(&info, sizeof(info), 1, f);
+            freadbytes(f, &info, sizeof(info));
             freadvector(f, "NODE", nodes, info.numnodes);
             if (nodes.back().t != info.numframes)
                 RuntimeError("fread: mismatch between info.numframes and last node's time");
             freadvector(f, "EDGE", edges, info.numedges);
             freadvector(f, "ALIG", align);
-            fcheckTag(f, "END ");
+            fchecktag(f, "END ");
             // map align ids to user's symmap  --the lattice gets updated in place here
             foreach_index (k, align)
                 align[k].updateunit(idmap); // updates itself
         }
         else if (version == 2)
         {
-            freadOrDie(&info, sizeof(info), 1, f);
+            freadbytes(f, &info, sizeof(info));
             freadvector(f, "NODS", nodes, info.numnodes);
             if (nodes.back().t != info.numframes)
                 RuntimeError("fread: mismatch between info.numframes and last node's time");
             freadvector(f, "EDGS", edges2, info.numedges); // uniqued edges
             freadvector(f, "ALNS", uniquededgedatatokens); // uniqued alignments
-            fcheckTag(f, "END ");
+            fchecktag(f, "END ");
 // check if we need to map
 #if 1                                                                                     // post-bugfix for incorrect inference of spunit
             if (info.impliedspunitid != SIZE_MAX && info.impliedspunitid >= idmap.size()) // we have buggy lattices like that--what do they mean??
@@ -1063,6 +1125,7 @@ public:
             RuntimeError("fread: unsupported lattice format version");
     }
 
+public:
     // parallel versions (defined in parallelforwardbackward.cpp)
     class parallelstate
     {
@@ -1098,6 +1161,10 @@ public:
         void setloglls(const Microsoft::MSR::CNTK::Matrix<double>& loglls);
         void getgamma(Microsoft::MSR::CNTK::Matrix<float>& loglls);
         void getgamma(Microsoft::MSR::CNTK::Matrix<double>& loglls);
+        // for parallelforwardbackwardbatch(): the gammas of the frames of one lattice of the minibatch
+        void getgamma(Microsoft::MSR::CNTK::Matrix<float>& loglls, size_t firstframe, size_t numframes);
+        void getgamma(Microsoft::MSR::CNTK::Matrix<double>& loglls, size_t firstframe, size_t numframes);
+        bool batchenabled() const; // true if parallelforwardbackwardbatch() is available
     };
 
     // forward-backward function
@@ -1107,6 +1174,19 @@ public:
                            const float lmf, const float wp, const float amf, const float boostingfactor, const bool sMBRmode, array_ref<size_t> uids, const_array_ref<size_t> bounds = const_array_ref<size_t>(),
                            const_array_ref<htkmlfwordsequence::word> transcript = const_array_ref<htkmlfwordsequence::word>(), const std::vector<float>& transcriptunigrams = std::vector<float>()) const;
 
+    // forwardbackward() of all lattices of a minibatch at once, on the GPU (if parallelstate.batchenabled())
+    // The LLs of all lattices, concatenated, must have been passed to parallelstate.setloglls(), and uids are their reference
+    // state ids (already aligned to the reference if desired, see alignreference()). results[k] is what forwardbackward() returns
+    // for lattices[k], and parallelstate.getgamma(.., firstframe, numframes) then gets its gammas.
+    static void parallelforwardbackwardbatch(parallelstate& parallelstate, const std::vector<const lattice*>& lattices,
+                                             const class msra::asr::simplesenonehmm& hset, const_array_ref<size_t> uids,
+                                             const float lmf, const float wp, const float amf, const float boostingfactor,
+                                             const bool sMBRmode, std::vector<double>& results);
+
+    // replace uids by a state alignment to the phone sequence given by bounds (bounds[t] = 1 + phone id where a phone starts, else 0)
+    static void alignreference(const class msra::asr::simplesenonehmm& hset, const class msra::math::ssematrixbase& logLLs,
+                               array_ref<size_t> uids, const_array_ref<size_t> bounds);
+
     std::wstring key; // (keep our own name (key) so we can identify ourselves for diagnostics messages)
     const wchar_t* getkey() const
     {
@@ -1163,41 +1243,52 @@ class archive
             const std::wstring symlistpath = archivepaths[archiveindex] + L".symlist";
             if (verbosity > 0)
                 fprintf(stderr, "getcachedidmap: reading '%S'\n", symlistpath.c_str());
-            std::vector<char> textbuffer;
-            auto lines = msra::files::fgetfilelines(symlistpath, textbuffer);
-            // establish mapping of each entry to the corresponding id in 'symmap'; this should fail if the symbol is not found
-            idmap.reserve(lines.size() + 1); // last entry is a fake entry to return the /sp/ unit
-            std::string symstring, tosymstring;
-            symstring.reserve(100);
-            tosymstring.reserve(100);
-            foreach_index (i, lines)
+            readidmap(symlistpath, symmap, idmap);
+        }
+        return idmap;
+    }
+
+public:
+    // read the .symlist file of an archive and establish the mapping of each entry to the corresponding id in 'symmap'
+    // The last entry is a fake entry to return the /sp/ unit.
+    template <class SYMMAP>
+    static void readidmap(const std::wstring& symlistpath, const SYMMAP& symmap /*[string] -> numeric id*/, std::vector<unsigned int>& idmap)
+    {
+        std::vector<char> textbuffer;
+        auto lines = msra::files::fgetfilelines(symlistpath, textbuffer);
+        // establish mapping of each entry to the corresponding id in 'symmap'; this should fail if the symbol is not found
+        idmap.reserve(lines.size() + 1); // last entry is a fake entry to return the /sp/ unit
+        std::string symstring, tosymstring;
+        symstring.reserve(100);
+        tosymstring.reserve(100);
+        foreach_index (i, lines)
+        {
+            char* line = lines[i];
+            char* sym = line;
+            // parse out a mapping  (log SPC phys)
+            char* p = strchr(sym, ' ');
+            if (p != NULL) // mapping: just verify that the supplied symmap has the same mapping
             {
-                char* line = lines[i];
-                char* sym = line;
-                // parse out a mapping  (log SPC phys)
-                char* p = strchr(sym, ' ');
-                if (p != NULL) // mapping: just verify that the supplied symmap has the same mapping
-                {
-                    *p = 0;
-                    const char* tosym = p + 1;
-                    symstring = sym; // (reusing existing object to avoid malloc)
-                    tosymstring = tosym;
-                    if (getid(symmap, symstring) != getid(symmap, tosymstring))
-                        RuntimeError("getcachedidmap: mismatching symbol id for %s vs. %s", sym, tosym);
-                }
-                else
-                {
-                    if ((size_t) i != idmap.size()) // non-mappings must come first (this is to ensure compatibility with pre-mapping files)
-                        RuntimeError("getcachedidmap: mixed up symlist file");
-                    symstring = sym; // (reusing existing object to avoid malloc)
-                    idmap.push_back((unsigned int) getid(symmap, symstring));
-                }
+                *p = 0;
+                const char* tosym = p + 1;
+                symstring = sym; // (reusing existing object to avoid malloc)
+                tosymstring = tosym;
+                if (getid(symmap, symstring) != getid(symmap, tosymstring))
+                    RuntimeError("getcachedidmap: mismatching symbol id for %s vs. %s", sym, tosym);
+            }
+            else
+            {
+                if ((size_t) i != idmap.size()) // non-mappings must come first (this is to ensure compatibility with pre-mapping files)
+                    RuntimeError("getcachedidmap: mixed up symlist file");
+                symstring = sym; // (reusing existing object to avoid malloc)
+                idmap.push_back((unsigned int) getid(symmap, symstring));
             }
-            // append a fixed-position entry: last entry means /sp/
-            idmap.push_back((unsigned int) getid(symmap, "sp"));
         }
-        return idmap;
+        // append a fixed-position entry: last entry means /sp/
+        idmap.push_back((unsigned int) getid(symmap, "sp"));
     }
+
+private:
     // all lattices read so far
     struct latticeref
     {
@@ -0,0 +1,346 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#ifdef _WIN32
+#include <winsock2.h> // (must come before Windows.h, which Basics.h includes)
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "Metrics.h"
+#include "Basics.h"
+#include "fileutil.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _WIN32
+typedef SOCKET Socket;
+static void CloseSocket(Socket s) { closesocket(s); }
+#else
+typedef int Socket;
+static const Socket INVALID_SOCKET = -1;
+static void CloseSocket(Socket s) { close(s); }
+#endif
+
+namespace {
+
+struct MetricEntry
+{
+    const char* name;
+    const char* help;
+    const char* type; // "counter", "gauge" or "histogram"
+    unique_ptr<Metrics::Counter> counter;
+    unique_ptr<Metrics::Gauge> gauge;
+    unique_ptr<Metrics::Histogram> histogram;
+};
+
+struct MetricsState
+{
+    mutex m_mutex; // for m_entries
+    vector<unique_ptr<MetricEntry>> m_entries;
+
+    // exporting
+    bool m_exporting;
+    string m_labels;
+    wstring m_filePath;
+    size_t m_intervalSeconds;
+    mutex m_exportMutex;
+    condition_variable m_exportCondition;
+    bool m_stop;
+    thread m_fileThread;
+    thread m_httpThread;
+    Socket m_listenSocket;
+
+    MetricsState()
+        : m_exporting(false), m_intervalSeconds(0), m_stop(false), m_listenSocket(INVALID_SOCKET)
+    {
+    }
+
+    // a process ending without StopExport() must not leave the threads running
+    ~MetricsState()
+    {
+        {
+            lock_guard<mutex> lock(m_exportMutex);
+            m_stop = true;
+        }
+        m_exportCondition.notify_all();
+        if (m_fileThread.joinable())
+            m_fileThread.join();
+        if (m_httpThread.joinable())
+            m_httpThread.join();
+    }
+
+    static MetricsState& GetInstance()
+    {
+        static MetricsState instance;
+        return instance;
+    }
+
+    MetricEntry& Find(const char* name, const char* help, const char* type)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        for (auto& entry : m_entries)
+        {
+            if (strcmp(entry->name, name) == 0)
+            {
+                if (strcmp(entry->type, type) != 0)
+                    LogicError("Metrics: '%s' was registered as a %s, not a %s.", name, entry->type, type);
+                return *entry;
+            }
+        }
+        m_entries.push_back(unique_ptr<MetricEntry>(new MetricEntry{ name, help, type }));
+        return *m_entries.back();
+    }
+
+    void WriteFile();
+    void ServeHttp();
+};
+
+}
+
+Metrics::Histogram::Histogram(const vector<double>& upperBounds)
+    : m_upperBounds(upperBounds), m_counts(new atomic<uint64_t>[upperBounds.size() + 1]), m_sum(0)
+{
+    if (!is_sorted(m_upperBounds.begin(), m_upperBounds.end()))
+        InvalidArgument("Metrics: The upper bounds of the buckets of a histogram must be increasing.");
+    for (size_t i = 0; i <= m_upperBounds.size(); i++)
+        m_counts[i].store(0, memory_order_relaxed);
+}
+
+void Metrics::Histogram::Observe(double value)
+{
+    size_t bucket = lower_bound(m_upperBounds.begin(), m_upperBounds.end(), value) - m_upperBounds.begin();
+    m_counts[bucket].fetch_add(1, memory_order_relaxed);
+    double sum = m_sum.load(memory_order_relaxed);
+    while (!m_sum.compare_exchange_weak(sum, sum + value, memory_order_relaxed))
+        ;
+}
+
+uint64_t Metrics::Histogram::Count() const
+{
+    uint64_t count = 0;
+    for (size_t i = 0; i <= m_upperBounds.size(); i++)
+        count += BucketCount(i);
+    return count;
+}
+
+/*static*/ Metrics::Counter& Metrics::GetCounter(const char* name, const char* help)
+{
+    auto& entry = MetricsState::GetInstance().Find(name, help, "counter");
+    if (!entry.counter)
+        entry.counter.reset(new Counter());
+    return *entry.counter;
+}
+
+/*static*/ Metrics::Gauge& Metrics::GetGauge(const char* name, const char* help)
+{
+    auto& entry = MetricsState::GetInstance().Find(name, help, "gauge");
+    if (!entry.gauge)
+        entry.gauge.reset(new Gauge());
+    return *entry.gauge;
+}
+
+/*static*/ Metrics::Histogram& Metrics::GetHistogram(const char* name, const char* help, const vector<double>& upperBounds)
+{
+    auto& entry = MetricsState::GetInstance().Find(name, help, "histogram");
+    if (!entry.histogram)
+        entry.histogram.reset(new Histogram(upperBounds));
+    return *entry.histogram;
+}
+
+/*static*/ const vector<double>& Metrics::LatencyBuckets()
+{
+    static const vector<double> buckets = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60 };
+    return buckets;
+}
+
+/*static*/ string Metrics::Format()
+{
+    auto& state = MetricsState::GetInstance();
+    const string& labels = state.m_labels;
+    auto withLabels = [&](const string& more)
+    {
+        string all = labels.empty() ? more : more.empty() ? labels : labels + "," + more;
+        return all.empty() ? string() : "{" + all + "}";
+    };
+
+    string text;
+    lock_guard<mutex> lock(state.m_mutex);
+    for (const auto& entry : state.m_entries)
+    {
+        text += msra::strfun::strprintf("# HELP %s %s\n# TYPE %s %s\n", entry->name, entry->help, entry->name, entry->type);
+        if (entry->counter)
+            text += msra::strfun::strprintf("%s%s %llu\n", entry->name, withLabels("").c_str(), (unsigned long long) entry->counter->Get());
+        else if (entry->gauge)
+            text += msra::strfun::strprintf("%s%s %.17g\n", entry->name, withLabels("").c_str(), entry->gauge->Get());
+        else if (entry->histogram)
+        {
+            const auto& histogram = *entry->histogram;
+            const auto& bounds = histogram.UpperBounds();
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i <= bounds.size(); i++)
+            {
+                cumulative += histogram.BucketCount(i);
+                string le = i < bounds.size() ? msra::strfun::strprintf("le=\"%g\"", bounds[i]) : string("le=\"+Inf\"");
+                text += msra::strfun::strprintf("%s_bucket%s %llu\n", entry->name, withLabels(le).c_str(), (unsigned long long) cumulative);
+            }
+            text += msra::strfun::strprintf("%s_sum%s %.17g\n", entry->name, withLabels("").c_str(), histogram.Sum());
+            text += msra::strfun::strprintf("%s_count%s %llu\n", entry->name, withLabels("").c_str(), (unsigned long long) cumulative);
+        }
+    }
+    return text;
+}
+
+// write to a temporary file and rename it, so that a scraper never reads a partial file
+void MetricsState::WriteFile()
+{
+    try
+    {
+        wstring tempPath = m_filePath + L".tmp";
+        string text = Metrics::Format();
+        FILE* f = fopenOrDie(tempPath, L"wb");
+        fwriteOrDie(text.data(), 1, text.size(), f);
+        fcloseOrDie(f);
+        renameOrDie(tempPath, m_filePath);
+    }
+    catch (const exception& e) // (on a background thread) a full disk must not end the training
+    {
+        fprintf(stderr, "Metrics: Could not write %ls: %s\n", m_filePath.c_str(), e.what());
+    }
+}
+
+// a minimal HTTP/1.0 server: each connection gets the metrics, whatever it requested, and is closed
+void MetricsState::ServeHttp()
+{
+    for (;;)
+    {
+        {
+            lock_guard<mutex> lock(m_exportMutex);
+            if (m_stop)
+                break;
+        }
+
+        // wait for a connection, waking up every second to check for StopExport()
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(m_listenSocket, &readable);
+        timeval timeout = { 1, 0 };
+        if (select((int) m_listenSocket + 1, &readable, nullptr, nullptr, &timeout) <= 0)
+            continue;
+        Socket connection = accept(m_listenSocket, nullptr, nullptr);
+        if (connection == INVALID_SOCKET)
+            continue;
+
+        char request[4096];
+        recv(connection, request, sizeof(request), 0); // (not parsed)
+        string body = Metrics::Format();
+        string response = msra::strfun::strprintf("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", (int) body.size()) + body;
+        for (size_t sent = 0; sent < response.size();)
+        {
+            int n = send(connection, response.data() + sent, (int) (response.size() - sent), 0);
+            if (n <= 0)
+                break;
+            sent += n;
+        }
+        CloseSocket(connection);
+    }
+    CloseSocket(m_listenSocket);
+    m_listenSocket = INVALID_SOCKET;
+}
+
+/*static*/ void Metrics::StartExport(const wstring& filePath, int port, size_t intervalSeconds, const string& labels)
+{
+    auto& state = MetricsState::GetInstance();
+    lock_guard<mutex> lock(state.m_exportMutex);
+    if (state.m_exporting || (filePath.empty() && port <= 0))
+        return;
+    if (intervalSeconds == 0)
+        InvalidArgument("Metrics: The export interval must be at least one second.");
+
+    state.m_labels = labels;
+    state.m_filePath = filePath;
+    state.m_intervalSeconds = intervalSeconds;
+    state.m_stop = false;
+
+    if (port > 0)
+    {
+#ifdef _WIN32
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+            RuntimeError("Metrics: Could not initialize Windows sockets.");
+#endif
+        Socket s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s == INVALID_SOCKET)
+            RuntimeError("Metrics: Could not create the socket for the HTTP endpoint.");
+        int reuse = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuse, sizeof(reuse));
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons((unsigned short) port);
+        if (::bind(s, (const sockaddr*) &address, sizeof(address)) != 0 || listen(s, 16) != 0)
+        {
+            CloseSocket(s);
+            RuntimeError("Metrics: Could not listen on port %d for the HTTP endpoint.", port);
+        }
+        state.m_listenSocket = s;
+        state.m_httpThread = thread([&state] { state.ServeHttp(); });
+        fprintf(stderr, "Metrics: Serving metrics at http://localhost:%d/metrics.\n", port);
+    }
+
+    if (!filePath.empty())
+    {
+        state.m_fileThread = thread([&state]
+        {
+            unique_lock<mutex> lock(state.m_exportMutex);
+            while (!state.m_stop)
+            {
+                lock.unlock();
+                state.WriteFile();
+                lock.lock();
+                state.m_exportCondition.wait_for(lock, chrono::seconds(state.m_intervalSeconds), [&state] { return state.m_stop; });
+            }
+        });
+        fprintf(stderr, "Metrics: Writing metrics to %ls every %d seconds.\n", filePath.c_str(), (int) intervalSeconds);
+    }
+    state.m_exporting = true;
+}
+
+/*static*/ void Metrics::StopExport()
+{
+    auto& state = MetricsState::GetInstance();
+    {
+        lock_guard<mutex> lock(state.m_exportMutex);
+        if (!state.m_exporting)
+            return;
+        state.m_stop = true;
+    }
+    state.m_exportCondition.notify_all();
+    if (state.m_fileThread.joinable())
+        state.m_fileThread.join();
+    if (state.m_httpThread.joinable())
+        state.m_httpThread.join();
+    if (!state.m_filePath.empty())
+        state.WriteFile(); // the final values
+    lock_guard<mutex> lock(state.m_exportMutex);
+    state.m_exporting = false;
+}
+
+}}}
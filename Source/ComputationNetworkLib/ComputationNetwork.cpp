@@ -23,7 +23,9 @@
 #include <vector>
 #include <stack>
 #include <list>
+#include <map>
 #include <set>
+#include <tuple>
 
 using namespace std;
 
@@ -34,15 +36,202 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // -----------------------------------------------------------------------
 
 template <>
-vector<shared_ptr<Matrix<float>>>& MatrixPool::GetReleasedMatrices<float>()
+vector<MatrixPool::MemRequestInfo<float>>& MatrixPool::GetMemRequestInfoVec<float>()
 {
-    return m_releasedFloatMatrices;
+    return m_memRequestInfoFloatVec;
 }
 
 template <>
-vector<shared_ptr<Matrix<double>>>& MatrixPool::GetReleasedMatrices<double>()
+vector<MatrixPool::MemRequestInfo<double>>& MatrixPool::GetMemRequestInfoVec<double>()
 {
-    return m_releasedDoubleMatrices;
+    return m_memRequestInfoDoubleVec;
+}
+
+template <class ElemType>
+void MatrixPool::OptimizedMemoryAllocation(size_t& plannedBytes, size_t& lifoBytes, size_t& unsharedBytes)
+{
+    vector<MemRequestInfo<ElemType>>& memInfoVec = GetMemRequestInfoVec<ElemType>();
+
+    // a shared matrix and the lifetimes of the requests assigned to it
+    struct SharedMatrix
+    {
+        DEVICEID_TYPE deviceId;
+        shared_ptr<Matrix<ElemType>> matrix;
+        size_t size;
+        vector<pair<int, int>> lifetimes;
+        PlannedMatrix plan;
+
+        bool IsFreeDuring(const vector<pair<int, int>>& otherLifetimes) const
+        {
+            for (const auto& lifetime : lifetimes)
+            {
+                for (const auto& otherLifetime : otherLifetimes)
+                {
+                    if (otherLifetime.first <= lifetime.second && lifetime.first <= otherLifetime.second)
+                        return false;
+                }
+            }
+            return true;
+        }
+    };
+    vector<SharedMatrix> sharedMatrices;
+
+    // with an embedded plan, each request first goes to the shared matrix of its planned group, i.e. the k-th request of a node
+    // and category to the group of the k-th such request of the plan
+    vector<size_t> plannedGroups(memInfoVec.size(), SIZE_MAX); // [request] index into m_embeddedPlan
+    map<size_t, size_t> groupMatrices;                          // [index into m_embeddedPlan] index into sharedMatrices
+    if (!m_embeddedPlan.empty())
+    {
+        typedef tuple<bool, wstring, string> PlanKey; // (from the pool, node name, category)
+        map<PlanKey, vector<size_t>> groupsOfKey;     // in the order of the plan
+        for (size_t g = 0; g < m_embeddedPlan.size(); g++)
+        {
+            const auto& planned = m_embeddedPlan[g];
+            if (planned.elementSize != sizeof(ElemType))
+                continue;
+            if (!planned.isFromPool)
+                groupsOfKey[PlanKey(false, planned.own.nodeName, planned.own.category)].push_back(g);
+            for (const auto& request : planned.requests)
+                groupsOfKey[PlanKey(true, request.nodeName, request.category)].push_back(g);
+        }
+        map<PlanKey, size_t> numSeen;
+        for (size_t i = 0; i < memInfoVec.size(); i++)
+        {
+            PlanKey key(memInfoVec[i].pMatrixPtr != nullptr, memInfoVec[i].owner.nodeName, memInfoVec[i].owner.category);
+            size_t k = numSeen[key]++;
+            auto iter = groupsOfKey.find(key);
+            if (iter != groupsOfKey.end() && k < iter->second.size())
+                plannedGroups[i] = iter->second[k];
+        }
+    }
+
+    // matrices that were not requested from the pool keep their own memory; they can take in requests after their release
+    for (size_t i = 0; i < memInfoVec.size(); i++)
+    {
+        const auto& memInfo = memInfoVec[i];
+        if (!memInfo.pMatrixPtr)
+        {
+            if (plannedGroups[i] != SIZE_MAX)
+                groupMatrices[plannedGroups[i]] = sharedMatrices.size();
+            sharedMatrices.push_back(SharedMatrix{ memInfo.deviceId, memInfo.matrix, memInfo.matrixSize, memInfo.lifetimes, PlannedMatrix{ memInfo.deviceId, sizeof(ElemType), false, memInfo.owner, {} } });
+            unsharedBytes += memInfo.matrixSize * sizeof(ElemType);
+        }
+    }
+
+    // best fit, largest first: each request goes to the smallest shared matrix that is large enough and unused during its lifetime;
+    // if none is large enough, the largest one grows (that only happens for matrices not from the pool, since the others come in decreasing size)
+    vector<size_t> order(memInfoVec.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&memInfoVec](size_t a, size_t b) { return memInfoVec[a].matrixSize > memInfoVec[b].matrixSize; });
+    for (size_t i : order)
+    {
+        auto& memInfo = memInfoVec[i];
+        if (!memInfo.pMatrixPtr)
+            continue;
+        unsharedBytes += memInfo.matrixSize * sizeof(ElemType);
+
+        // the matrix of the planned group, or a new one for the first request of a group; otherwise (or if its lifetimes conflict) the best fit
+        SharedMatrix* best = nullptr;
+        auto groupIter = groupMatrices.find(plannedGroups[i]);
+        bool newPlannedGroup = plannedGroups[i] != SIZE_MAX && groupIter == groupMatrices.end();
+        if (groupIter != groupMatrices.end() && sharedMatrices[groupIter->second].deviceId == memInfo.deviceId && sharedMatrices[groupIter->second].IsFreeDuring(memInfo.lifetimes))
+            best = &sharedMatrices[groupIter->second];
+        else if (!newPlannedGroup)
+        {
+            for (auto& sharedMatrix : sharedMatrices)
+            {
+                if (sharedMatrix.deviceId != memInfo.deviceId || !sharedMatrix.IsFreeDuring(memInfo.lifetimes))
+                    continue;
+                bool fits = sharedMatrix.size >= memInfo.matrixSize;
+                if (!best || (fits && (best->size < memInfo.matrixSize || sharedMatrix.size < best->size)) || (!fits && best->size < memInfo.matrixSize && sharedMatrix.size > best->size))
+                    best = &sharedMatrix;
+            }
+        }
+        if (!best)
+        {
+            if (newPlannedGroup)
+                groupMatrices[plannedGroups[i]] = sharedMatrices.size();
+            sharedMatrices.push_back(SharedMatrix{ memInfo.deviceId, make_shared<Matrix<ElemType>>(memInfo.deviceId), 0, {}, PlannedMatrix{ memInfo.deviceId, sizeof(ElemType), true, RequestOwner(), {} } });
+            best = &sharedMatrices.back();
+        }
+        best->size = max(best->size, memInfo.matrixSize);
+        best->lifetimes.insert(best->lifetimes.end(), memInfo.lifetimes.begin(), memInfo.lifetimes.end());
+        best->plan.requests.push_back(memInfo.owner);
+        *memInfo.pMatrixPtr = best->matrix;
+    }
+    for (const auto& sharedMatrix : sharedMatrices)
+    {
+        plannedBytes += sharedMatrix.size * sizeof(ElemType);
+        if (!sharedMatrix.plan.requests.empty())
+            m_plan.push_back(sharedMatrix.plan);
+        // a model with a plan is loaded for serving, so its matrices are allocated now rather than in the first minibatches
+        if (!m_embeddedPlan.empty() && sharedMatrix.plan.isFromPool && sharedMatrix.size > 0)
+            sharedMatrix.matrix->Resize(sharedMatrix.size, 1);
+    }
+
+    // for comparison: the memory needed when handing out the most recently released matrix, whatever its size
+    // A reacquired matrix is a new request there.
+    vector<pair<int, size_t>> events; // (step, request index); releases are marked by the index + memInfoVec.size()
+    for (size_t i = 0; i < memInfoVec.size(); i++)
+    {
+        for (const auto& lifetime : memInfoVec[i].lifetimes)
+        {
+            if (lifetime.first >= 0)
+                events.push_back(make_pair(lifetime.first, i));
+            if (lifetime.second != INT_MAX)
+                events.push_back(make_pair(lifetime.second, i + memInfoVec.size()));
+        }
+    }
+    sort(events.begin(), events.end());
+    map<DEVICEID_TYPE, vector<size_t>> released; // [deviceId] stack of indices into lifoSizes
+    vector<size_t> lifoSizes;
+    vector<size_t> lifoIndex(memInfoVec.size(), SIZE_MAX);
+    for (const auto& event : events)
+    {
+        bool isRelease = event.second >= memInfoVec.size();
+        size_t i = isRelease ? event.second - memInfoVec.size() : event.second;
+        auto& stack = released[memInfoVec[i].deviceId];
+        if (isRelease)
+        {
+            if (lifoIndex[i] == SIZE_MAX) // not from the pool
+            {
+                lifoIndex[i] = lifoSizes.size();
+                lifoSizes.push_back(memInfoVec[i].matrixSize);
+            }
+            stack.push_back(lifoIndex[i]);
+        }
+        else
+        {
+            if (stack.empty())
+            {
+                lifoIndex[i] = lifoSizes.size();
+                lifoSizes.push_back(0);
+            }
+            else
+            {
+                lifoIndex[i] = stack.back();
+                stack.pop_back();
+            }
+            lifoSizes[lifoIndex[i]] = max(lifoSizes[lifoIndex[i]], memInfoVec[i].matrixSize);
+        }
+    }
+    for (size_t size : lifoSizes)
+        lifoBytes += size * sizeof(ElemType);
+
+    memInfoVec.clear();
+}
+
+void MatrixPool::OptimizedMemoryAllocation()
+{
+    size_t plannedBytes = 0, lifoBytes = 0, unsharedBytes = 0;
+    m_plan.clear();
+    OptimizedMemoryAllocation<float>(plannedBytes, lifoBytes, unsharedBytes);
+    OptimizedMemoryAllocation<double>(plannedBytes, lifoBytes, unsharedBytes);
+    m_stepCounter = 0;
+
+    fprintf(stderr, "Memory planner: planned peak of shared matrices %.1f MB for minibatches of %d columns (%.1f MB when reusing the most recently released matrix, %.1f MB without sharing).\n",
+            plannedBytes / 1048576.0, (int) m_minibatchSizeHint, lifoBytes / 1048576.0, unsharedBytes / 1048576.0);
 }
 
 // -----------------------------------------------------------------------
@@ -100,10 +289,119 @@ void ComputationNetwork::Save(const wstring& fileName, const FileOptions fileFor
     renameOrDie(tmpFileName, fileName);
 }
 
+template <class ElemType>
+static void SnapshotParameter(const ComputationNodeBasePtr& node, ComputationNetwork::ParameterSnapshot& snapshot)
+{
+    auto parameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(node);
+    if (parameter)
+    {
+        auto value = make_shared<Matrix<ElemType>>(CPUDEVICE);
+        value->AssignValuesOf(parameter->Value());
+        snapshot[node->NodeName()] = value;
+    }
+}
+
+ComputationNetwork::ParameterSnapshot ComputationNetwork::SnapshotParameters() const
+{
+    VerifyIsCompiled("SnapshotParameters");
+    ParameterSnapshot snapshot;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        if (iter.second->OperationName() != OperationNameOf(LearnableParameter))
+            continue;
+        SnapshotParameter<float>(iter.second, snapshot);
+        SnapshotParameter<double>(iter.second, snapshot);
+    }
+    return snapshot;
+}
+
+template <class ElemType>
+static void RestoreParameter(const ComputationNodeBasePtr& node, const ComputationNetwork::ParameterSnapshot& snapshot)
+{
+    auto parameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(node);
+    if (!parameter)
+        return;
+    auto iter = snapshot.find(node->NodeName());
+    if (iter == snapshot.end())
+        LogicError("RestoreParameterSnapshot: The snapshot has no value for parameter '%ls'.", node->NodeName().c_str());
+    auto value = dynamic_pointer_cast<Matrix<ElemType>>(iter->second);
+    if (!value)
+        LogicError("RestoreParameterSnapshot: The snapshot value for parameter '%ls' has the wrong element type.", node->NodeName().c_str());
+    parameter->Value().AssignValuesOf(*value);
+}
+
+void ComputationNetwork::RestoreParameterSnapshot(const ParameterSnapshot& snapshot)
+{
+    VerifyIsCompiled("RestoreParameterSnapshot");
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        if (iter.second->OperationName() != OperationNameOf(LearnableParameter))
+            continue;
+        RestoreParameter<float>(iter.second, snapshot);
+        RestoreParameter<double>(iter.second, snapshot);
+    }
+}
+
+ComputationNetwork::NodeStateSnapshot ComputationNetwork::SnapshotNodeStates(const wstring& scratchFileName, const FileOptions fileFormat) const
+{
+    VerifyIsCompiled("SnapshotNodeStates");
+    // save the nodes one after the other, then cut the file at the positions after each of them
+    vector<pair<wstring, uint64_t>> endPositions;
+    {
+        File fstream(scratchFileName, fileFormat | FileOptions::fileOptionsWrite | FileOptions::fileOptionsLargeBuffer);
+        for (const auto& iter : m_nameToNodeMap)
+        {
+            if (iter.second->OperationName() == OperationNameOf(LearnableParameter))
+                continue;
+            iter.second->Save(fstream);
+            endPositions.push_back(make_pair(iter.first, fstream.GetPosition()));
+        }
+    }
+    NodeStateSnapshot nodeStates;
+    {
+        File fstream(scratchFileName, fileFormat | FileOptions::fileOptionsRead);
+        uint64_t beginPosition = 0;
+        for (const auto& endPosition : endPositions)
+        {
+            auto& bytes = nodeStates[endPosition.first];
+            bytes.resize((size_t) (endPosition.second - beginPosition));
+            if (!bytes.empty())
+                fstream.ReadBlock(bytes.data(), bytes.size());
+            beginPosition = endPosition.second;
+        }
+    }
+    _wunlink(scratchFileName.c_str());
+    return nodeStates;
+}
+
+void ComputationNetwork::SaveWithParameterSnapshot(const wstring& fileName, const ParameterSnapshot& snapshot, const NodeStateSnapshot& nodeStates, const FileOptions fileFormat) const
+{
+    wstring tmpFileName = fileName + L".tmp";
+    SaveToFileImpl(tmpFileName, fileFormat, &snapshot, &nodeStates);
+    renameOrDie(tmpFileName, fileName);
+}
+
+// save a parameter node with the value from the snapshot
+template <class ElemType>
+static bool TrySaveParameterFromSnapshot(const ComputationNodeBasePtr& node, const ComputationNetwork::ParameterSnapshot& snapshot, File& fstream)
+{
+    auto parameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(node);
+    if (!parameter)
+        return false;
+    auto iter = snapshot.find(node->NodeName());
+    if (iter == snapshot.end())
+        LogicError("SaveWithParameterSnapshot: The snapshot has no value for parameter '%ls'.", node->NodeName().c_str());
+    auto value = dynamic_pointer_cast<Matrix<ElemType>>(iter->second);
+    if (!value)
+        LogicError("SaveWithParameterSnapshot: The snapshot value for parameter '%ls' has the wrong element type.", node->NodeName().c_str());
+    parameter->SaveWithValue(fstream, *value);
+    return true;
+}
+
 // TODO: how does the file distinguish float vs double nodes?
-void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptions fileFormat) const
+void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptions fileFormat, const ParameterSnapshot* snapshot, const NodeStateSnapshot* nodeStates) const
 {
-    File fstream(fileName, fileFormat | FileOptions::fileOptionsWrite);
+    File fstream(fileName, fileFormat | FileOptions::fileOptionsWrite | FileOptions::fileOptionsLargeBuffer);
     fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BCN");
 
     // model version
@@ -131,8 +429,19 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
         fstream << nodePtr->OperationName();
         // name
         fstream << nodePtr->NodeName();
-        // content
-        nodePtr->Save(fstream);
+        // content, from the snapshots if given
+        if (snapshot && (TrySaveParameterFromSnapshot<float>(nodePtr, *snapshot, fstream) || TrySaveParameterFromSnapshot<double>(nodePtr, *snapshot, fstream)))
+            continue;
+        if (!nodeStates)
+        {
+            nodePtr->Save(fstream);
+            continue;
+        }
+        auto iter = nodeStates->find(nodePtr->NodeName());
+        if (iter == nodeStates->end())
+            LogicError("SaveWithParameterSnapshot: The snapshot has no contents for node '%ls'.", nodePtr->NodeName().c_str());
+        if (!iter->second.empty())
+            fstream.WriteBlock(iter->second.data(), iter->second.size());
     }
 
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ENodeList");
@@ -187,11 +496,60 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
 
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ERootNodes");
 
+    // the memory plan of a model optimized for inference, see EmbedMemoryPlan()
+    const auto& memoryPlan = m_matrixPool.GetEmbeddedPlan();
+    if (!memoryPlan.empty())
+    {
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BMemoryPlan");
+        fstream << m_matrixPool.GetMinibatchSizeHint() << memoryPlan.size();
+        for (const auto& planned : memoryPlan)
+        {
+            fstream << planned.elementSize << planned.isFromPool;
+            if (!planned.isFromPool)
+                SavePlannedRequest(fstream, planned.own);
+            fstream << planned.requests.size();
+            for (const auto& request : planned.requests)
+                SavePlannedRequest(fstream, request);
+        }
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EMemoryPlan");
+    }
+
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ECN");
 
     fstream.Flush();
 }
 
+/*static*/ void ComputationNetwork::SavePlannedRequest(File& fstream, const MatrixPool::RequestOwner& request)
+{
+    fstream << request.nodeName << string(request.category) << request.sampleSize << request.mbScale;
+}
+
+/*static*/ MatrixPool::RequestOwner ComputationNetwork::LoadPlannedRequest(File& fstream)
+{
+    MatrixPool::RequestOwner request;
+    string category;
+    fstream >> request.nodeName >> category >> request.sampleSize >> request.mbScale;
+    // the categories are string literals
+    if (category == "value")
+        request.category = "value";
+    else if (category == "gradient")
+        request.category = "gradient";
+    else if (category == "workspace")
+        request.category = "workspace";
+    else
+        RuntimeError("Read: Unexpected category '%s' in the memory plan.", category.c_str());
+    return request;
+}
+
+// keep the memory plan of the last AllocateAllMatrices(), so that it is saved with the model and followed when the model is
+// loaded (see MatrixPool::SetEmbeddedPlan()); for a model that is only used for inference, which is planned and loaded the same way
+void ComputationNetwork::EmbedMemoryPlan()
+{
+    if (!AreMatricesAllocated())
+        LogicError("EmbedMemoryPlan: The memory plan is only known after AllocateAllMatrices().");
+    m_matrixPool.SetEmbeddedPlan(m_matrixPool.GetPlan(), m_matrixPool.GetMinibatchSizeHint());
+}
+
 // load the section of nodes that contain persistable parameters
 // This is also used for reloading a model without recreating it, e.g. during training.
 // TODO: Why not just reload it? Because SGD::Train() holds pointers to the parameters directly? That should be fixed.
@@ -264,7 +622,7 @@ void ComputationNetwork::Read(const wstring& fileName)
 {
     ClearNetwork();
 
-    File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead | FileOptions::fileOptionsMemoryMapped);
 
     ReadPersistableParameters<ElemType>(fstream, true);
 
@@ -384,6 +742,28 @@ void ComputationNetwork::Read(const wstring& fileName)
     }
     fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ERootNodes");
 
+    vector<MatrixPool::PlannedMatrix> memoryPlan;
+    size_t planMinibatchSize = 1;
+    if (fstream.TryGetMarker(FileMarker::fileMarkerBeginSection, L"BMemoryPlan"))
+    {
+        size_t num;
+        fstream >> planMinibatchSize >> num;
+        memoryPlan.resize(num);
+        for (auto& planned : memoryPlan)
+        {
+            planned.deviceId = m_deviceId;
+            fstream >> planned.elementSize >> planned.isFromPool;
+            if (!planned.isFromPool)
+                planned.own = LoadPlannedRequest(fstream);
+            size_t numRequests;
+            fstream >> numRequests;
+            for (size_t i = 0; i < numRequests; i++)
+                planned.requests.push_back(LoadPlannedRequest(fstream));
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EMemoryPlan");
+    }
+    m_matrixPool.SetEmbeddedPlan(memoryPlan, memoryPlan.empty() ? m_matrixPool.GetMinibatchSizeHint() : planMinibatchSize);
+
     fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ECN");
 }
 
@@ -394,10 +774,10 @@ void ComputationNetwork::Read(const wstring& fileName)
 // non-static version needed because it accesses m_randomSeedOffset
 // Excessively used by SimpleNetworkBuilder, but always after CreateLearnableParameter(), so we should really absorb it there
 template <class ElemType>
-void ComputationNetwork::InitLearnableParameters(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const ElemType initValueScale, bool initOnCPUOnly)
+void ComputationNetwork::InitLearnableParameters(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const ElemType initValueScale, bool initOnCPUOnly, bool parallelInit)
 {
     auto learnableParameterNode = dynamic_pointer_cast<LearnableParameter<ElemType>>(node);
-    learnableParameterNode->InitRandom(uniformInit, randomSeed + GetRandomSeedOffset(), initValueScale, initOnCPUOnly);
+    learnableParameterNode->InitRandom(uniformInit, randomSeed + GetRandomSeedOffset(), initValueScale, initOnCPUOnly, parallelInit);
 }
 
 bool ComputationNetwork::IsTypicalCriterionNode(ComputationNodeBasePtr nodePtr)
@@ -409,10 +789,9 @@ bool ComputationNetwork::IsTypicalCriterionNode(ComputationNodeBasePtr nodePtr)
         nodePtr->OperationName() == OperationNameOf(SequenceWithSoftmaxNode) ||
         nodePtr->OperationName() == OperationNameOf(CrossEntropyNode) ||
         nodePtr->OperationName() == OperationNameOf(ClassBasedCrossEntropyWithSoftmaxNode) ||
+        nodePtr->OperationName() == OperationNameOf(ModelParallelCrossEntropyWithSoftmaxNode) ||
         nodePtr->OperationName() == OperationNameOf(ErrorPredictionNode) ||
-#ifdef COMING_SOON
         nodePtr->OperationName() == OperationNameOf(CRFNode) ||
-#endif
         nodePtr->OperationName() == OperationNameOf(DummyCriterionNode))
         return true;
 
@@ -490,7 +869,7 @@ void ComputationNetwork::CollectInputAndLearnableParametersRec(const Computation
 }
 
 template <class ElemType>
-/*static*/ void ComputationNetwork::SetDropoutRate(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase)
+/*static*/ void ComputationNetwork::SetDropoutRate(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase, bool counterBasedMask)
 {
     list<ComputationNodeBasePtr> dropoutNodes = net->GetNodesWithType(OperationNameOf(DropoutNode), criterionNode);
     if (dropoutRate != prevDropoutRate)
@@ -509,6 +888,7 @@ template <class ElemType>
         auto node = dynamic_pointer_cast<DropoutNode<ElemType>>(nodeIter);
         if (dropoutRate != prevDropoutRate)
             node->SetDropoutRate(dropoutRate);
+        node->SetCounterBasedMask(counterBasedMask);
         node->SetRandomSeed(randSeed);
         randSeed++;
     }
@@ -546,6 +926,33 @@ template <class ElemType>
     }
 }
 
+template <class ElemType>
+/*static*/ void ComputationNetwork::SetBatchNormalizationSynchronization(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const MPIWrapperPtr& mpi)
+{
+    // TODO: Change this to use an interface that is independent of <ElemType>.
+    for (auto& nodeIter : net->GetNodesWithType(OperationNameOf(BatchNormalizationNode), criterionNode))
+    {
+        auto node = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(nodeIter);
+        node->SynchronizeStatistics(mpi);
+    }
+}
+
+template <class ElemType>
+/*static*/ vector<ComputationNodeBasePtr> ComputationNetwork::SetModelParallelism(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const MPIWrapperPtr& mpi)
+{
+    vector<ComputationNodeBasePtr> weightShards;
+    for (auto& nodeIter : net->GetNodesWithType(OperationNameOf(ModelParallelCrossEntropyWithSoftmaxNode), criterionNode))
+    {
+        auto node = dynamic_pointer_cast<ModelParallelCrossEntropyWithSoftmaxNode<ElemType>>(nodeIter);
+        const auto& weights = node->GetInputs()[2];
+        if (weights->OperationName() != OperationNameOf(LearnableParameter))
+            InvalidArgument("SetModelParallelism: The weights of %ls %ls operation must be a LearnableParameter, not %ls.", nodeIter->NodeName().c_str(), nodeIter->OperationName().c_str(), weights->OperationName().c_str());
+        node->SetModelParallelism(mpi);
+        weightShards.push_back(weights);
+    }
+    return weightShards;
+}
+
 //set sequence training parameters, e.g. smoothing weight, frame drop threshhold
 template <class ElemType>
 void ComputationNetwork::SetSeqParam(ComputationNetworkPtr net,
@@ -604,6 +1011,39 @@ void ComputationNetwork::SetSeqParam(ComputationNetworkPtr net,
     }
 }
 
+template <class NodeType>
+static bool TryEnableInt8Inference(const ComputationNodeBasePtr& node, size_t calibrationMinibatches)
+{
+    auto typedNode = dynamic_pointer_cast<NodeType>(node);
+    if (typedNode)
+        typedNode->EnableInt8Inference(calibrationMinibatches);
+    return typedNode != nullptr;
+}
+
+/*static*/ void ComputationNetwork::SetInt8Inference(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, size_t calibrationMinibatches)
+{
+    size_t numNodes = 0;
+    for (const auto& nodeType : {OperationNameOf(TimesNode), OperationNameOf(TransposeTimesNode), OperationNameOf(ConvolutionNode)})
+    {
+        for (const auto& node : net->GetNodesWithType(nodeType, criterionNode))
+        {
+            // The weights are quantized once, so they must be model parameters.
+            if (node->GetNumInputs() == 0 || node->GetInputs()[0]->OperationName() != OperationNameOf(LearnableParameter))
+                continue;
+            if (TryEnableInt8Inference<TimesNodeBase<float, false>>(node, calibrationMinibatches) ||
+                TryEnableInt8Inference<TimesNodeBase<float, true>>(node, calibrationMinibatches) ||
+                TryEnableInt8Inference<TimesNodeBase<double, false>>(node, calibrationMinibatches) ||
+                TryEnableInt8Inference<TimesNodeBase<double, true>>(node, calibrationMinibatches) ||
+                TryEnableInt8Inference<ConvolutionNode<float>>(node, calibrationMinibatches) ||
+                TryEnableInt8Inference<ConvolutionNode<double>>(node, calibrationMinibatches))
+            {
+                numNodes++;
+            }
+        }
+    }
+    fprintf(stderr, "Enabled int8 inference for %d Times/Convolution nodes (%d calibration minibatches).\n", (int)numNodes, (int)calibrationMinibatches);
+}
+
 // -----------------------------------------------------------------------
 // unit test
 // -----------------------------------------------------------------------
@@ -1463,22 +1903,26 @@ void ComputationNetwork::SaveToDbnFile(ComputationNetworkPtr net, const std::wst
     PutTag("EDBN");
 }
 
-template void ComputationNetwork::InitLearnableParameters<float>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const float initValueScale, bool initOnCPUOnly);
+template void ComputationNetwork::InitLearnableParameters<float>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const float initValueScale, bool initOnCPUOnly, bool parallelInit);
 template void ComputationNetwork::Read<float>(const wstring& fileName);
 template void ComputationNetwork::ReadPersistableParameters<float>(File& fstream, bool create);
 template void ComputationNetwork::PerformSVDecomposition<float>(const map<wstring, float>& SVDConfig, size_t alignedsize);
-template /*static*/ void ComputationNetwork::SetDropoutRate<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase);
+template /*static*/ void ComputationNetwork::SetDropoutRate<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase, bool counterBasedMask);
 template /*static*/ void ComputationNetwork::SetBatchNormalizationTimeConstants<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double normalizationTimeConstant, double& prevNormalizationTimeConstant, double blendTimeConstant, double& prevBlendTimeConstant);
+template /*static*/ void ComputationNetwork::SetBatchNormalizationSynchronization<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const MPIWrapperPtr& mpi);
+template /*static*/ vector<ComputationNodeBasePtr> ComputationNetwork::SetModelParallelism<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const MPIWrapperPtr& mpi);
 template void ComputationNetwork::SetSeqParam<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
                                                      const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR);
 template void ComputationNetwork::SaveToDbnFile<float>(ComputationNetworkPtr net, const std::wstring& fileName) const;
 
-template void ComputationNetwork::InitLearnableParameters<double>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const double initValueScale, bool initOnCPUOnly);
+template void ComputationNetwork::InitLearnableParameters<double>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const double initValueScale, bool initOnCPUOnly, bool parallelInit);
 template void ComputationNetwork::Read<double>(const wstring& fileName);
 template void ComputationNetwork::ReadPersistableParameters<double>(File& fstream, bool create);
 template void ComputationNetwork::PerformSVDecomposition<double>(const map<wstring, float>& SVDConfig, size_t alignedsize);
-template /*static*/ void ComputationNetwork::SetDropoutRate<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase);
+template /*static*/ void ComputationNetwork::SetDropoutRate<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase, bool counterBasedMask);
 template /*static*/ void ComputationNetwork::SetBatchNormalizationTimeConstants<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double normalizationTimeConstant, double& prevNormalizationTimeConstant, double blendTimeConstant, double& prevBlendTimeConstant);
+template /*static*/ void ComputationNetwork::SetBatchNormalizationSynchronization<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const MPIWrapperPtr& mpi);
+template /*static*/ vector<ComputationNodeBasePtr> ComputationNetwork::SetModelParallelism<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const MPIWrapperPtr& mpi);
 template void ComputationNetwork::SetSeqParam<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
                                                       const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR);
 template void ComputationNetwork::SaveToDbnFile<double>(ComputationNetworkPtr net, const std::wstring& fileName) const;
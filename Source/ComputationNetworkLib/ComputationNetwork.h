@@ -29,9 +29,24 @@
 #include <chrono>
 #include <unordered_map>
 #include <set>
+#include <functional>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+class MPIWrapper;
+typedef std::shared_ptr<MPIWrapper> MPIWrapperPtr;
+
+// rough costs of running a node on the GPU or the CPU and of moving its value between them, for ComputationNetwork::OffloadToHost()
+// Small nodes are dominated by the fixed cost per kernel launch on the GPU, which the CPU does not have.
+struct HostOffloadCostModel
+{
+    double gpuSecondsPerNode = 10e-6;           // launch and synchronization latency of one node on the GPU
+    double gpuSecondsPerElement = 0.02e-9;      // per element a node reads or writes
+    double cpuSecondsPerElement = 1e-9;
+    double transferSecondsPerTransfer = 10e-6;  // latency of one host-to-GPU copy
+    double transferSecondsPerByte = 1.0 / 6e9;  // 6 GB/s
+};
+
 // ===========================================================================
 // ComputationNetwork -- computation graph and operations
 // ===========================================================================
@@ -53,7 +68,9 @@ public:
         m_isCompiled(false),
         m_areMatricesAllocated(false),
         m_pMBLayoutOfNetwork(make_shared<MBLayout>(1, 0, L"*")),
-        m_environment(make_shared<ComputationEnvironment>())
+        m_environment(make_shared<ComputationEnvironment>()),
+        m_checkpointInterval(0),
+        m_valueCompressionType(CompactElementType::float16)
     {
         //m_pMBLayoutOfNetwork->SetAxisName(L"T");
     }
@@ -105,9 +122,17 @@ public:
     {
         Read<ElemType>(fileName);
         // perform all further post-processing, caching, etc.
+        // With the compilation cache enabled, validation starts from the shapes cached next to the model file.
+        m_compilationCachePath = s_useCompilationCache ? fileName + L".compiled" : L"";
         CompileNetwork();
+        m_compilationCachePath.clear();
     }
 
+    // Let Load() keep the validated node shapes of a model in a file next to it (model path + ".compiled"), keyed by a
+    // hash of the network structure, and start validation from them when the same structure is loaded again.
+    // Validation still runs through its final pass, so a stale cache costs time but never changes the result.
+    static void SetUseCompilationCache(bool useCompilationCache) { s_useCompilationCache = useCompilationCache; }
+
     // static helper to instantiate a network from a file
     template <class ElemType>
     static ComputationNetworkPtr CreateFromFile(DEVICEID_TYPE deviceId, const std::wstring& fileName)
@@ -120,9 +145,28 @@ public:
     void Save(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary) const;
     void SaveEdited(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary);
 
+    // Copies of the values of all LearnableParameter nodes in CPU memory, by node name.
+    // SaveWithParameterSnapshot() writes the model with these instead of the current values, so that the file can be
+    // written on a background thread while training keeps updating the parameters (asynchronous checkpointing).
+    // RestoreParameterSnapshot() assigns the copies back, e.g. after the trial mini-epochs of the learning-rate search.
+    typedef std::map<std::wstring, MatrixBasePtr> ParameterSnapshot;
+    ParameterSnapshot SnapshotParameters() const;
+    void RestoreParameterSnapshot(const ParameterSnapshot& snapshot);
+
+    // The saved contents of all other nodes, by node name, for SaveWithParameterSnapshot(): some of them also change
+    // during training (e.g. the statistics of BatchNormalization) or are read from the GPU when saved (e.g. PreComputeNode),
+    // so they are serialized on the calling thread, through the scratch file 'scratchFileName', which is deleted again.
+    // With both snapshots, the background thread only writes bytes; the network must not be edited while it does.
+    typedef std::map<std::wstring, std::vector<char>> NodeStateSnapshot;
+    NodeStateSnapshot SnapshotNodeStates(const std::wstring& scratchFileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary) const;
+    void SaveWithParameterSnapshot(const std::wstring& fileName, const ParameterSnapshot& snapshot, const NodeStateSnapshot& nodeStates,
+                                   const FileOptions fileFormat = FileOptions::fileOptionsBinary) const;
+
 private:
 
-    void SaveToFileImpl(const std::wstring& fileName, const FileOptions fileFormat) const;
+    void SaveToFileImpl(const std::wstring& fileName, const FileOptions fileFormat, const ParameterSnapshot* snapshot = nullptr, const NodeStateSnapshot* nodeStates = nullptr) const;
+    static void SavePlannedRequest(File& fstream, const MatrixPool::RequestOwner& request);
+    static MatrixPool::RequestOwner LoadPlannedRequest(File& fstream);
 
 public:
 
@@ -134,7 +178,8 @@ public:
     void ForwardProp(const ComputationNodeBasePtr rootNode);
 
     // main entry point for backprop
-    void Backprop(const ComputationNodeBasePtr rootNode);
+    void Backprop(const ComputationNodeBasePtr rootNode, double rootGradient = 1.0,
+                  const std::function<void(const ComputationNodeBasePtr&)>& onParameterGradientCompleted = nullptr);
 
     template <class NODESET> // version that takes multiple nodes
     void ForwardProp(const NODESET& nodes)
@@ -172,26 +217,92 @@ public:
     void CompileNetwork(); // call this after creation, Load(), and any modification
 
 private:
-    void ValidateNetwork();
-    size_t ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFirstPass, bool isFinalValidationPass);
+    void ValidateNetwork(bool startFromCurrentShapes = false);
+    size_t ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFirstPass, bool isFinalValidationPass, bool logChanges = true);
+    uint64_t ComputeStructureHash() const;
+    bool LoadCompilationCache(const std::wstring& cachePath);
+    void SaveCompilationCache(const std::wstring& cachePath) const;
     bool ValidateNode(ComputationNodeBasePtr node, bool isFinalValidationPass) const;
     void MarkValueNonSharableNodes();
     void ChangeNodeInputs(ComputationNodeBasePtr fromNode, ComputationNodeBasePtr toNode);
+    template <class ElemType>
+    bool TryFoldBatchNormalization(const ComputationNodeBasePtr& node, bool explicitBias);
+    template <class ElemType>
+    bool TryPretransposeTimesWeights(const ComputationNodeBasePtr& node);
+    template <class ElemType>
+    bool TryFuseAffineActivation(const ComputationNodeBasePtr& node);
+    template <class ElemType>
+    bool TryFactorizeTimesWeights(const ComputationNodeBasePtr& node, double maxRelativeError, size_t alignedSize);
+    template <class ElemType>
+    bool TryPruneTimesWeights(const ComputationNodeBasePtr& node, double threshold, double maxDensity);
+    int FoldConstantSubgraphs();
+    template <class ElemType>
+    bool TryFoldConstantNode(const ComputationNodeBasePtr& node, std::set<ComputationNodeBasePtr>& evaluated);
+    int EliminateCommonSubexpressions();
+    int PruneUnusedNodes();
 
 private:
     void DetermineSetOfAllRoots();
     void CollectInputAndLearnableParameters(const ComputationNodeBasePtr& rootNode);
     void CollectInputAndLearnableParametersRec(const ComputationNodeBasePtr& node, set<ComputationNodeBasePtr>& visited, list<ComputationNodeBasePtr>& inputs, list<ComputationNodeBasePtr>& learnableParameters);
     void ResetMBLayouts();
+    void PlaceNodesOnDevices();
     bool IsCompiled() const { return m_isCompiled; }
     bool AreMatricesAllocated() const { return m_areMatricesAllocated; }
     void VerifyIsCompiled(const char* where) const;
 public:
     void AllocateAllMatrices(const std::vector<ComputationNodeBasePtr>& evalRootNodes, const std::vector<ComputationNodeBasePtr>& outValueRootNodes, ComputationNodeBasePtr trainRootNode);
+    // minibatch size that AllocateAllMatrices() plans for; it only affects how matrices are packed, not their actual sizes
+    void SetMinibatchSizeHint(size_t minibatchSize) { m_matrixPool.SetMinibatchSizeHint(minibatchSize); }
+    void ReleaseSharedMatrixBuffers();
+    // save the memory plan of AllocateAllMatrices() with the model, to be followed when it is loaded
+    void EmbedMemoryPlan();
+    bool HasEmbeddedMemoryPlan() const { return !m_matrixPool.GetEmbeddedPlan().empty(); }
+
+    // memory that the network's matrices take for minibatches of a given number of samples, see EstimateMemory()
+    struct MemoryEstimate
+    {
+        // bytes of the matrices a node requests, before sharing
+        struct NodeBytes
+        {
+            size_t value, gradient, workspace;
+            size_t GetTotal() const { return value + gradient + workspace; }
+        };
+
+        size_t minibatchSize;
+        DEVICEID_TYPE deviceId;
+        std::map<std::string, size_t> deviceBytes; // [category] on the GPU
+        std::map<std::string, size_t> hostBytes;   // [category] in host memory, which is all of it for a network on the CPU
+        std::map<std::wstring, NodeBytes> nodeBytes; // [node name]
+
+        void AddBytes(DEVICEID_TYPE matrixDeviceId, const std::string& category, size_t bytes)
+        {
+            (matrixDeviceId == CPUDEVICE ? hostBytes : deviceBytes)[category] += bytes;
+        }
+        static size_t GetTotal(const std::map<std::string, size_t>& bytes)
+        {
+            size_t total = 0;
+            for (const auto& entry : bytes)
+                total += entry.second;
+            return total;
+        }
+    };
+    // Estimate the peak memory of the matrices for minibatches of the given number of samples (columns), broken down by category and node,
+    // from the validated sample layouts and the memory plan of AllocateAllMatrices(), which must have been called. Matrices not from the pool
+    // (parameters, inputs, non-shareable values) are counted at their full size, and shared matrices at the size of their largest request.
+    // Sparse matrices are counted as dense; memory that nodes allocate outside of the pool (e.g. cuDNN workspaces) is not included.
+    // Callers add their own categories (e.g. the learner state) before printing it with PrintMemoryEstimate().
+    MemoryEstimate EstimateMemory(size_t minibatchSize) const;
+    void PrintMemoryEstimate(const MemoryEstimate& estimate) const;
 
 private:
     template <class ElemType> void PrintMemorySharingStructure(const std::vector<ComputationNodeBasePtr>& nodes);
     void ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount);
+    void MarkValuesRecomputedForBackprop(const std::list<ComputationNodeBasePtr>& forwardPropOrder,
+                                         const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                         std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp);
+    static void RecomputeValuesForBackprop(const ComputationNodeBasePtr& node, const FrameRange& fr, std::set<ComputationNodeBasePtr>& recomputed, MatrixPool* matrixPool);
+    static void RecomputeValue(const ComputationNodeBasePtr& node, const FrameRange& fr, std::set<ComputationNodeBasePtr>& recomputed, MatrixPool* matrixPool);
     void AllocateGradientMatricesForInputs(ComputationNodeBasePtr parentNode);
 
 public:
@@ -339,7 +450,8 @@ public:
                                  const bool uniformInit,
                                  const unsigned long randomSeed,
                                  const ElemType initValueScale,
-                                 bool initOnCPUOnly = false);
+                                 bool initOnCPUOnly = false,
+                                 bool parallelInit = false);
 
     template <typename N>
     static shared_ptr<N> AsNodePtr(const ComputationNodeBasePtr& inode)
@@ -366,6 +478,24 @@ public:
     void InsertNode(wstring nodeName, ComputationNodeBasePtr newNode, const std::set<std::wstring>& newNodeTags);
     void ReplaceLeafNode(wstring oldNodeName, ComputationNodeBasePtr newNode);
     void ReplaceFinalCriterionNode(wstring oldNodeName, ComputationNodeBasePtr newNode);
+    // inference only: fold BatchNormalization nodes into the weights of the Times or Convolution nodes that feed them, where possible
+    void FoldBatchNormalization(bool explicitBias = false);
+    // inference only: turn TransposeTimes nodes into Times nodes with transposed weights, where possible
+    void PretransposeTimesWeights();
+    // replace Sigmoid/Tanh/RectifiedLinear (Plus (Times (W, x), b)) chains by AffineActivation nodes, where possible
+    void FuseAffineActivation();
+    // inference only: replace the weights of Times nodes by low-rank products U * V within a relative error, where that saves parameters
+    void FactorizeTimesWeights(double maxRelativeError, size_t alignedSize);
+    // inference only: zero the small weights of Times nodes, and store them as sparse matrices where few remain
+    void PruneTimesWeights(double threshold, double maxDensity);
+    // fold constant subgraphs, merge duplicate nodes and remove nodes that no criterion, evaluation or output node depends on
+    void OptimizeNetwork();
+    // on a GPU, run the small nodes that are computed only from data inputs and constants on the CPU where that is estimated to be faster
+    int OffloadToHost(size_t minibatchSize, const HostOffloadCostModel& costModel = HostOffloadCostModel());
+    // inference only: remove Dropout nodes, freeze BatchNormalization nodes and disable all gradients
+    void PrepareForInference();
+    // turn the network into a serving-only one that can be saved: see the "optimizeForInference" action
+    void OptimizeForInference(size_t minibatchSize);
     void AddFeatureNode(ComputationNodeBasePtr featureNode);
     //ComputationNodeBasePtr RemoveFeatureNode(ComputationNodeBasePtr featureNode);
     void SetLearnableNodesBelowLearningRateMultiplier(const float learningRateMultiplier, const ComputationNodeBasePtr& rootNode = nullptr);
@@ -431,13 +561,20 @@ public:
 
     // TODO: Why are all these static, but then take a network as the first argument? --> make them class members
     template <class ElemType>
-    static void SetDropoutRate(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase);
+    static void SetDropoutRate(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase, bool counterBasedMask = false);
 
     template <class ElemType>
     static void SetBatchNormalizationTimeConstants(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, 
                                                    double normalizationTimeConstant, double& prevNormalizationTimeConstant,
                                                    double blendTimeConstant, double& prevBlendTimeConstant);
 
+    template <class ElemType>
+    static void SetBatchNormalizationSynchronization(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const MPIWrapperPtr& mpi);
+
+    // model-parallel training of the ModelParallelCrossEntropyWithSoftmax nodes over 'mpi'; returns their weight shards, which differ between the workers
+    template <class ElemType>
+    static std::vector<ComputationNodeBasePtr> SetModelParallelism(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const MPIWrapperPtr& mpi);
+
     template <class ElemType>
     static void SetSeqParam(ComputationNetworkPtr net,
                             const ComputationNodeBasePtr criterionNode,
@@ -450,6 +587,8 @@ public:
                             const double& bMMIfactor = 0.0f,
                             const bool& sMBR = false);
     static void SetMaxTempMemSizeForCNN(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const size_t maxTempMemSizeInSamples);
+    // inference only: switch Times and Convolution nodes with LearnableParameter weights to int8 products on the CPU
+    static void SetInt8Inference(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, size_t calibrationMinibatches);
 
     // -----------------------------------------------------------------------
     // node-group access
@@ -1016,6 +1155,8 @@ protected:
         {
         }
         virtual void Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) override;
+        // same, calling onParameterGradientCompleted for each learnable parameter once its gradient is complete
+        void Backprop(const FrameRange& fr, const std::function<void(const ComputationNodeBasePtr&)>& onParameterGradientCompleted);
         virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool);
         virtual void ReleaseMatricesAfterForwardProp(MatrixPool& matrixPool);
         virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool);
@@ -1027,6 +1168,120 @@ protected:
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
         PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
         // Base::m_nestedNodes contains all top-level nodes, in evaluation order
+
+    private:
+        // concurrent streams for independent branches (see SetNumConcurrentStreams())
+        void PlanConcurrentStreams(size_t numStreams);
+        void JoinConcurrentStreams();
+        void PlanConcurrentLevels();
+        void ForwardPropConcurrentLevels(const FrameRange& fr);
+
+        std::vector<std::unique_ptr<GPUStream>> m_streams;     // empty if forward prop runs on the default stream only
+        std::vector<int> m_nodeStreams;                        // [i] index into m_streams for m_nestedNodes[i], or -1 for the default stream
+        std::vector<std::vector<size_t>> m_nodeWaits;          // [i] indices of nodes on other streams that m_nestedNodes[i] depends on
+        std::vector<std::unique_ptr<GPUEvent>> m_nodeEvents;   // [i] recorded after m_nestedNodes[i] if a node on another stream depends on it
+        std::vector<std::unique_ptr<GPUEvent>> m_streamEvents; // [s] recorded on m_streams[s] when joining at the end of forward prop
+        std::vector<std::vector<size_t>> m_nodeLevels;         // CPU: [l] indices of the nodes that run concurrently after level l-1; empty if run one by one
+    };
+
+public:
+    // -----------------------------------------------------------------------
+    // concurrent streams
+    // If set to N > 0, forward prop on the GPU distributes independent branches of the network (e.g. the
+    // towers of an Inception block, or the directions of a bidirectional LSTM) over N CUDA streams, so that
+    // their kernels can overlap. Nodes are assigned greedily: a node continues the stream of its first input
+    // that has not been continued yet, otherwise it starts a new branch on the next stream. Dependencies across
+    // streams are expressed with events. Recurrent loops and backprop run on the default stream.
+    // On the CPU, forward prop instead runs the network level by level, where a level holds the nodes whose inputs
+    // are all computed by the levels before it. The nodes of a level run concurrently on the CPU thread pool, each on
+    // one thread (see CPUThreadPool), which lowers latency for networks with many small independent branches, such
+    // as several embeddings or the evaluation criteria. Recurrent loops form levels of their own.
+    // Since the streams break the sequential order that memory sharing relies on, forward-prop buffers are
+    // not shared between nodes in this mode, at the cost of memory.
+    // Must be set before the network's matrices are allocated.
+    // -----------------------------------------------------------------------
+
+    static void SetNumConcurrentStreams(size_t numStreams);
+    static size_t GetNumConcurrentStreams();
+
+public:
+    // -----------------------------------------------------------------------
+    // gradient checkpointing
+    // Trades computation for memory in training: the values of the chosen nodes are released after forward prop and
+    // recomputed from their inputs in backprop, right before the first node that needs them. Nodes are chosen by name,
+    // or if 'checkpointInterval' is k > 0, all eligible nodes except every k-th one, whose values are kept as checkpoints
+    // to recompute the others from. Eligible are nodes outside of recurrent loops whose forward prop is stateless
+    // (see ComputationNodeBase::CanRecomputeValue()). Requires memory sharing (shareNodeValueMatrices) and no
+    // concurrent streams; otherwise it is ignored. Has no effect once the network's matrices are allocated.
+    // -----------------------------------------------------------------------
+
+    void SetGradientCheckpointing(size_t checkpointInterval, const std::vector<std::wstring>& recomputedNodeNames)
+    {
+        m_checkpointInterval = checkpointInterval;
+        m_recomputedNodeNames = recomputedNodeNames;
+    }
+
+    // -----------------------------------------------------------------------
+    // value compression
+    // A lossy complement to gradient checkpointing for values that are expensive to recompute, e.g. convolutions: the values
+    // of the named nodes are released after forward prop as well, but only after a copy compressed column by column to
+    // FP16 or to 8 bits with a per-column scale (see Matrix::AssignCompressedOf()), from which they are restored right
+    // before the first node whose backprop reads them. Backprop therefore computes with an approximation of those values.
+    // Eligible are nodes outside of recurrent loops with dense values that backprop needs. Has the same requirements as
+    // gradient checkpointing; nodes chosen for both are recomputed.
+    // -----------------------------------------------------------------------
+
+    void SetValueCompression(const std::vector<std::wstring>& compressedNodeNames, CompactElementType type)
+    {
+        m_compressedNodeNames = compressedNodeNames;
+        m_valueCompressionType = type;
+    }
+
+public:
+    // -----------------------------------------------------------------------
+    // step graphs
+    // For fixed shapes, e.g. CNNs or frame-mode DNNs, the GPU work of a training step (ForwardProp(), Backprop(),
+    // the parameter update) is the same from one minibatch to the next, and at small minibatch sizes its many kernel
+    // launches dominate. StepGraph::Run() runs such a step normally the first time it sees a signature, captures its
+    // GPU work into a GPUGraph the second time, and from then on replays the graph instead of running the step.
+    // The signature consists of the MBLayouts, dimensions and buffers of the given input nodes, and of the host-side
+    // 'scalars' that the step passes into its kernels (e.g. the learning rate), which replays reuse as captured.
+    // Any change recaptures. A step that cannot be captured (e.g. it reads results back to the host, allocates device
+    // memory, or uses concurrent streams) runs normally for that signature; after several such failures, capturing
+    // is given up. Sparse inputs are not replayed, since their buffers change with their number of non-zeros.
+    // Since a replay does not run the host code of the step, its host-side state (e.g. the eval time stamps of the
+    // nodes) is that of the capture; the step must not depend on host-side state that changes between minibatches,
+    // such as random numbers (dropout) or sample counts (batch normalization).
+    // -----------------------------------------------------------------------
+
+    class StepGraph
+    {
+    public:
+        StepGraph(DEVICEID_TYPE deviceId);
+        ~StepGraph();
+
+        // returns true if the step was replayed, i.e. 'step' was not called
+        bool Run(const std::vector<ComputationNodeBasePtr>& inputNodes, const std::vector<double>& scalars, const std::function<void()>& step);
+
+        size_t GetNumReplays() const { return m_numReplays; }
+
+    private:
+        struct Signature
+        {
+            std::vector<MBLayoutPtr> m_layouts; // copies
+            std::vector<size_t> m_shapes;       // matrix type, dimensions and buffer of each input's value
+            std::vector<double> m_scalars;
+        };
+        bool GetSignature(const std::vector<ComputationNodeBasePtr>& inputNodes, const std::vector<double>& scalars, Signature& signature) const;
+        static bool IsSameSignature(const Signature& a, const Signature& b);
+
+        DEVICEID_TYPE m_deviceId;
+        bool m_hasSignature;
+        Signature m_signature;               // of the last step
+        std::unique_ptr<GPUGraph> m_graph;   // captured for m_signature
+        bool m_captureFailed;                // for m_signature
+        size_t m_numFailures;
+        size_t m_numReplays;
     };
 
 public:
@@ -1085,6 +1340,18 @@ private:
     bool m_isCompiled; // CompileNetwork has been called
     bool m_areMatricesAllocated; // AllocateAllMatrices has been called
 
+    // compilation cache used by CompileNetwork() when called from Load(); empty if none (see SetUseCompilationCache())
+    std::wstring m_compilationCachePath;
+    static bool s_useCompilationCache;
+
+    // gradient checkpointing (see SetGradientCheckpointing())
+    size_t m_checkpointInterval;
+    std::vector<std::wstring> m_recomputedNodeNames;
+
+    // value compression (see SetValueCompression())
+    std::vector<std::wstring> m_compressedNodeNames;
+    CompactElementType m_valueCompressionType;
+
     // cached network iterations
     std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_evalOrders; // [out node] flat depth-first traversal starting from out node
     std::map<const ComputationNodeBasePtr, ComputationNodeBasePtr> m_nestedNetworks;        // [out node] network rewritten as recursive traveral, potentially optimized; execution plan
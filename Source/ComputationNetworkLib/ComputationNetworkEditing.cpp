@@ -10,6 +10,10 @@
 #include "ComputationNetwork.h"
 #include "InputAndParamNodes.h"
 #include "TrainingNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "NonlinearityNodes.h"
+#include "ConvolutionalNodes.h"
+#include "SpecialPurposeNodes.h"
 #include <string>
 #include <vector>
 #include <list>
@@ -293,6 +297,987 @@ void ComputationNetwork::ReplaceFinalCriterionNode(wstring oldNodeName, Computat
     AddToNodeGroup(L"criterion", newNode);
 }
 
+// fold BatchNormalization nodes into the weights of the Times or Convolution node that feeds them
+// BN computes y = scale * (x - mean) * invStdDev + bias with the running statistics, which at inference time is
+// a per-output scaling of the preceding product's weights plus a bias; the BN node is then removed from the network.
+// Nodes whose product or weights are shared with other nodes are left alone. The bias is kept inside the product node, so the
+// folded network cannot be saved, unless explicitBias is given: then a Plus node with a new bias parameter takes the place (and
+// name) of the BN node instead.
+void ComputationNetwork::FoldBatchNormalization(bool explicitBias)
+{
+    std::vector<ComputationNodeBasePtr> bnNodes;
+    for (const auto& iter : m_nameToNodeMap)
+        if (iter.second->OperationName() == OperationNameOf(BatchNormalizationNode))
+            bnNodes.push_back(iter.second);
+
+    int numFolded = 0;
+    for (const auto& bnNode : bnNodes)
+    {
+        if (TryFoldBatchNormalization<float>(bnNode, explicitBias) || TryFoldBatchNormalization<double>(bnNode, explicitBias))
+            numFolded++;
+    }
+
+    if (numFolded > 0)
+    {
+        fprintf(stderr, "Folded %d of %d BatchNormalization nodes into the preceding Times/Convolution nodes.\n", numFolded, (int) bnNodes.size());
+        CompileNetwork();
+    }
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFoldBatchNormalization(const ComputationNodeBasePtr& node, bool explicitBias)
+{
+    if (!dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node))
+        return false;
+    wstring biasName = node->NodeName() + L".foldedBias";
+    if (explicitBias && NodeNameExists(biasName))
+        return false;
+    for (size_t i = 1; i < node->GetNumInputs(); i++)
+        if (node->Input(i)->OperationName() != OperationNameOf(LearnableParameter))
+            return false;
+
+    ComputationNodeBasePtr productNode = node->Input(0);
+    if (productNode->GetNumInputs() < 1 || productNode->Input(0)->OperationName() != OperationNameOf(LearnableParameter))
+        return false;
+
+    // the product must only feed the BN node, and its weights must only be used by the product
+    ComputationNodeBasePtr weightsNode = productNode->Input(0);
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& consumer = iter.second;
+        for (size_t i = 0; i < consumer->GetNumInputs(); i++)
+        {
+            if ((consumer->Input(i) == productNode && consumer != node) || (consumer->Input(i) == weightsNode && consumer != productNode))
+                return false;
+        }
+    }
+    for (auto group : GetAllNodeGroups())
+    {
+        // outputs keep their names (the Plus node takes the BN node's)
+        if (std::find(group->begin(), group->end(), productNode) != group->end() || (!explicitBias && std::find(group->begin(), group->end(), node) != group->end()))
+            return false;
+    }
+
+    // per output row: y = rowScale * product + rowBias
+    const auto& scale = node->Input(1)->As<ComputationNode<ElemType>>()->Value();
+    const auto& bias = node->Input(2)->As<ComputationNode<ElemType>>()->Value();
+    const auto& runMean = node->Input(3)->As<ComputationNode<ElemType>>()->Value();
+    const auto& runInvStdDev = node->Input(4)->As<ComputationNode<ElemType>>()->Value();
+    size_t numMaps = scale.GetNumElements();
+    size_t outputDim = productNode->GetSampleLayout().GetNumElements();
+    if (numMaps == 0 || outputDim % numMaps != 0 || bias.GetNumElements() != numMaps ||
+        runMean.GetNumElements() != numMaps || runInvStdDev.GetNumElements() != numMaps)
+        return false;
+
+    std::vector<ElemType> scaleData(numMaps), biasData(numMaps), meanData(numMaps), invStdDevData(numMaps);
+    scale.CopySection(numMaps, 1, scaleData.data(), numMaps);
+    bias.CopySection(numMaps, 1, biasData.data(), numMaps);
+    runMean.CopySection(numMaps, 1, meanData.data(), numMaps);
+    runInvStdDev.CopySection(numMaps, 1, invStdDevData.data(), numMaps);
+
+    size_t spatialSize = outputDim / numMaps;
+    std::vector<ElemType> rowScaleData(outputDim), rowBiasData(outputDim);
+    for (size_t r = 0; r < outputDim; r++)
+    {
+        size_t map = r / spatialSize;
+        rowScaleData[r] = scaleData[map] * invStdDevData[map];
+        rowBiasData[r] = biasData[map] - rowScaleData[r] * meanData[map];
+    }
+
+    DEVICEID_TYPE deviceId = node->GetDeviceId();
+    Matrix<ElemType> rowBias(outputDim, 1, rowBiasData.data(), deviceId, matrixFlagNormal);
+    bool folded = false;
+    if (auto timesNode = dynamic_pointer_cast<TimesNodeBase<ElemType, false>>(productNode))
+    {
+        Matrix<ElemType> rowScale(outputDim, 1, rowScaleData.data(), deviceId, matrixFlagNormal);
+        folded = timesNode->FoldOutputScaleAndBias(rowScale, explicitBias ? nullptr : &rowBias);
+    }
+    else if (auto convNode = dynamic_pointer_cast<ConvolutionNode<ElemType>>(productNode))
+    {
+        // the scale must be the same for all outputs of a kernel
+        size_t kernelCount = weightsNode->GetAsMatrixNumRows();
+        if (kernelCount == 0 || outputDim % kernelCount != 0)
+            return false;
+        size_t outputSpatialSize = outputDim / kernelCount;
+        std::vector<ElemType> mapScaleData(kernelCount);
+        for (size_t k = 0; k < kernelCount; k++)
+        {
+            mapScaleData[k] = rowScaleData[k * outputSpatialSize];
+            for (size_t i = 1; i < outputSpatialSize; i++)
+                if (rowScaleData[k * outputSpatialSize + i] != mapScaleData[k])
+                    return false;
+        }
+        Matrix<ElemType> mapScale(kernelCount, 1, mapScaleData.data(), deviceId, matrixFlagNormal);
+        folded = convNode->FoldOutputScaleAndBias(mapScale, explicitBias ? nullptr : &rowBias);
+    }
+    if (!folded)
+        return false;
+
+    InvalidateCompiledNetwork();
+    if (!explicitBias)
+    {
+        ChangeNodeInputs(node, productNode);
+        DeleteNode(node->NodeName());
+        return true;
+    }
+
+    // Plus (product, bias), with one bias per map (broadcast over the other dimensions) if the maps are the last dimension
+    auto biasDims = productNode->GetSampleLayout().GetDims();
+    bool perMap = biasDims.back() == numMaps;
+    if (perMap)
+    {
+        for (size_t k = 0; k + 1 < biasDims.size(); k++)
+            biasDims[k] = 1;
+        for (size_t map = 0; map < numMaps; map++)
+            rowBiasData[map] = rowBiasData[map * spatialSize];
+    }
+    auto biasNode = New<LearnableParameter<ElemType>>(deviceId, biasName, TensorShape(biasDims));
+    biasNode->Value().SetValue(biasNode->Value().GetNumRows(), biasNode->Value().GetNumCols(), deviceId, rowBiasData.data());
+    ComputationNodeBasePtr biasNodeBase = biasNode;
+    biasNodeBase->SetLearningRateMultiplier(node->Input(2)->GetLearningRateMultiplier());
+    auto plusNode = New<PlusNode<ElemType>>(deviceId, node->NodeName());
+    plusNode->AttachInputs({ productNode, biasNodeBase });
+    ChangeNodeInputs(node, plusNode);
+    for (auto groupIter : GetAllNodeGroups())
+        std::replace(groupIter->begin(), groupIter->end(), node, (ComputationNodeBasePtr) plusNode);
+    RemoveNodeFromNet(node);
+    node->DetachInputs();
+    AddNodeToNet(biasNodeBase);
+    AddNodeToNet(plusNode);
+    return true;
+}
+
+// fuse activation(W * x + b), i.e. Sigmoid/Tanh/RectifiedLinear (Plus (Times (W, x), b)), into a single AffineActivation node,
+// which applies the bias and the activation in one pass over the product. The fused node takes the name of the activation node.
+// Only chains whose intermediate Times and Plus nodes have no other consumers are fused.
+void ComputationNetwork::FuseAffineActivation()
+{
+    std::vector<ComputationNodeBasePtr> activationNodes;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& op = iter.second->OperationName();
+        if (op == OperationNameOf(SigmoidNode) || op == OperationNameOf(TanhNode) || op == OperationNameOf(RectifiedLinearNode))
+            activationNodes.push_back(iter.second);
+    }
+
+    int numFused = 0;
+    for (const auto& activationNode : activationNodes)
+    {
+        if (TryFuseAffineActivation<float>(activationNode) || TryFuseAffineActivation<double>(activationNode))
+            numFused++;
+    }
+
+    if (numFused > 0)
+    {
+        fprintf(stderr, "Fused %d of %d activation nodes with the preceding Times and Plus nodes into AffineActivation nodes.\n", numFused, (int) activationNodes.size());
+        CompileNetwork();
+    }
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFuseAffineActivation(const ComputationNodeBasePtr& node)
+{
+    ElementWiseOperator activation;
+    if (dynamic_pointer_cast<SigmoidNode<ElemType>>(node))
+        activation = opSigmoid;
+    else if (dynamic_pointer_cast<TanhNode<ElemType>>(node))
+        activation = opTanh;
+    else if (dynamic_pointer_cast<RectifiedLinearNode<ElemType>>(node))
+        activation = opLinearRectifier;
+    else
+        return false;
+
+    // find Plus (Times (W, x), b) or Plus (b, Times (W, x))
+    ComputationNodeBasePtr plusNode = node->Input(0);
+    if (plusNode->OperationName() != OperationNameOf(PlusNode))
+        return false;
+    size_t timesIndex = plusNode->Input(0)->OperationName() == OperationNameOf(TimesNode) ? 0 : 1;
+    ComputationNodeBasePtr timesNode = plusNode->Input(timesIndex);
+    ComputationNodeBasePtr biasNode = plusNode->Input(1 - timesIndex);
+    auto product = dynamic_pointer_cast<TimesNodeBase<ElemType, false>>(timesNode);
+    if (!product || timesNode->OperationName() != OperationNameOf(TimesNode) || product->OutputRank() != 1 || product->HasFoldedBias() ||
+        timesNode->Input(0)->OperationName() != OperationNameOf(LearnableParameter) || biasNode->OperationName() != OperationNameOf(LearnableParameter))
+        return false;
+
+    // the product must be a plain [M x K] * [K x N] matrix product of dense data (i.e. no pruned weights), with the bias broadcast over the columns
+    ComputationNodeBasePtr weightsNode = timesNode->Input(0);
+    ComputationNodeBasePtr inputNode = timesNode->Input(1);
+    size_t outputDim = timesNode->GetSampleLayout().GetNumElements();
+    if (biasNode->GetSampleLayout().GetNumElements() != outputDim || plusNode->GetSampleLayout().GetNumElements() != outputDim ||
+        weightsNode->GetSampleLayout().GetNumElements() != outputDim * inputNode->GetSampleLayout().GetNumElements() ||
+        inputNode->As<ComputationNode<ElemType>>()->Value().GetMatrixType() != DENSE ||
+        weightsNode->As<ComputationNode<ElemType>>()->Value().GetMatrixType() != DENSE)
+        return false;
+
+    // the intermediate nodes must only feed the chain, and keep their names if they are outputs
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& consumer = iter.second;
+        for (size_t i = 0; i < consumer->GetNumInputs(); i++)
+        {
+            if ((consumer->Input(i) == plusNode && consumer != node) || (consumer->Input(i) == timesNode && consumer != plusNode))
+                return false;
+        }
+    }
+    for (auto group : GetAllNodeGroups())
+    {
+        if (std::find(group->begin(), group->end(), plusNode) != group->end() || std::find(group->begin(), group->end(), timesNode) != group->end())
+            return false;
+    }
+
+    InvalidateCompiledNetwork();
+    auto fusedNode = New<AffineActivationNode<ElemType>>(node->GetDeviceId(), node->NodeName(), activation);
+    fusedNode->AttachInputs({ weightsNode, inputNode, biasNode });
+    ChangeNodeInputs(node, fusedNode);
+    for (auto groupIter : GetAllNodeGroups())
+        std::replace(groupIter->begin(), groupIter->end(), node, (ComputationNodeBasePtr) fusedNode);
+    RemoveNodeFromNet(node);
+    node->DetachInputs();
+    AddNodeToNet(fusedNode);
+    DeleteNode(plusNode->NodeName());
+    DeleteNode(timesNode->NodeName());
+    return true;
+}
+
+// replace the [M x N] weights W of Times nodes by the product of an [M x R] and an [R x N] matrix from the truncated
+// SVD of W, i.e. Times (W, x) by Times (W_U, Times (W_V, x)), with the smallest rank R (rounded up to a multiple of
+// alignedSize) whose relative error ||W - W_U * W_V|| / ||W|| (Frobenius norm) is within maxRelativeError.
+// Unlike the ParameterSVD action, which keeps a fraction of the sum of the singular values, the rank follows from an error
+// budget, and weights are only replaced where R * (M + N) < M * N. Weights used by other nodes are left alone.
+void ComputationNetwork::FactorizeTimesWeights(double maxRelativeError, size_t alignedSize)
+{
+    std::vector<ComputationNodeBasePtr> timesNodes;
+    for (const auto& iter : m_nameToNodeMap)
+        if (iter.second->OperationName() == OperationNameOf(TimesNode))
+            timesNodes.push_back(iter.second);
+
+    int numFactorized = 0;
+    for (const auto& timesNode : timesNodes)
+    {
+        if (TryFactorizeTimesWeights<float>(timesNode, maxRelativeError, alignedSize) || TryFactorizeTimesWeights<double>(timesNode, maxRelativeError, alignedSize))
+            numFactorized++;
+    }
+
+    if (numFactorized > 0)
+    {
+        fprintf(stderr, "Factorized the weights of %d of %d Times nodes into low-rank products.\n", numFactorized, (int) timesNodes.size());
+        CompileNetwork();
+    }
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFactorizeTimesWeights(const ComputationNodeBasePtr& node, double maxRelativeError, size_t alignedSize)
+{
+    auto timesNode = dynamic_pointer_cast<TimesNodeBase<ElemType, false>>(node);
+    if (!timesNode || timesNode->OutputRank() != 1 || node->Input(0)->OperationName() != OperationNameOf(LearnableParameter) ||
+        node->Input(0)->GetSampleLayout().GetRank() != 2)
+        return false;
+
+    // the weights must only be used by this node, and keep their name if they are in a node group
+    ComputationNodeBasePtr weightsNode = node->Input(0);
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& consumer = iter.second;
+        for (size_t i = 0; i < consumer->GetNumInputs(); i++)
+            if (consumer->Input(i) == weightsNode && (consumer != node || i != 0))
+                return false;
+    }
+    for (auto group : GetAllNodeGroups())
+        if (std::find(group->begin(), group->end(), weightsNode) != group->end())
+            return false;
+
+    const wstring leftName = weightsNode->NodeName() + L"_U";
+    const wstring rightName = weightsNode->NodeName() + L"_V";
+    const wstring productName = node->NodeName() + L"_V";
+    if (NodeNameExists(leftName) || NodeNameExists(rightName) || NodeNameExists(productName))
+        return false;
+
+    const auto& weights = weightsNode->As<ComputationNode<ElemType>>()->Value();
+    if (weights.GetMatrixType() != DENSE)
+        return false;
+    size_t m = weights.GetNumRows();
+    size_t n = weights.GetNumCols();
+    size_t maxRank = min(m, n);
+    if (maxRank < 2)
+        return false;
+
+    // the SVD is computed on the CPU
+    std::vector<ElemType> weightsData(m * n);
+    weights.CopySection(m, n, weightsData.data(), m);
+    Matrix<ElemType> A(m, n, weightsData.data(), CPUDEVICE, matrixFlagNormal);
+    Matrix<ElemType> S(CPUDEVICE), U(CPUDEVICE), VT(CPUDEVICE), W(CPUDEVICE);
+    Matrix<ElemType>::SVD(A, S, U, VT, W);
+
+    // S is in descending order; the squared error of rank r is the sum of the squares of the dropped singular values
+    std::vector<double> tailEnergy(maxRank + 1, 0);
+    for (size_t i = maxRank; i-- > 0;)
+        tailEnergy[i] = tailEnergy[i + 1] + (double) S(i, 0) * S(i, 0);
+    if (tailEnergy[0] == 0)
+        return false;
+    size_t rank = 1;
+    while (rank < maxRank && tailEnergy[rank] > maxRelativeError * maxRelativeError * tailEnergy[0])
+        rank++;
+    if (alignedSize > 1 && rank % alignedSize != 0)
+        rank = min(maxRank, rank - rank % alignedSize + alignedSize);
+    if (rank * (m + n) >= m * n)
+        return false;
+
+    // W_U = U[:, 0:R] * sqrt(S), W_V = sqrt(S) * VT[0:R, :]
+    std::vector<ElemType> leftData(m * rank), vtData(n * n), rightData(rank * n);
+    U.CopySection(m, rank, leftData.data(), m);
+    VT.CopySection(n, n, vtData.data(), n);
+    for (size_t k = 0; k < rank; k++)
+    {
+        ElemType sqrtSigma = (ElemType) sqrt((double) S(k, 0));
+        for (size_t i = 0; i < m; i++)
+            leftData[k * m + i] *= sqrtSigma;
+        for (size_t j = 0; j < n; j++)
+            rightData[j * rank + k] = sqrtSigma * vtData[j * n + k];
+    }
+    fprintf(stderr, "Factorizing the %d x %d weights %ls of %ls with rank %d (%.1f%% of the parameters, relative error %.4f).\n",
+            (int) m, (int) n, weightsNode->NodeName().c_str(), node->NodeName().c_str(), (int) rank,
+            100.0 * rank * (m + n) / (m * n), sqrt(tailEnergy[rank] / tailEnergy[0]));
+
+    InvalidateCompiledNetwork();
+    DEVICEID_TYPE deviceId = weightsNode->GetDeviceId();
+    auto leftNode = AddNodeToNetWithElemType(New<LearnableParameter<ElemType>>(deviceId, leftName, m, rank));
+    auto rightNode = AddNodeToNetWithElemType(New<LearnableParameter<ElemType>>(deviceId, rightName, rank, n));
+    leftNode->Value().SetValue(m, rank, deviceId, leftData.data(), matrixFlagNormal);
+    rightNode->Value().SetValue(rank, n, deviceId, rightData.data(), matrixFlagNormal);
+    for (const ComputationNodeBasePtr& factorNode : std::vector<ComputationNodeBasePtr>{ leftNode, rightNode })
+        factorNode->SetLearningRateMultiplier(weightsNode->GetLearningRateMultiplier());
+
+    auto productNode = AddNodeToNetWithElemType(New<TimesNode<ElemType>>(node->GetDeviceId(), productName));
+    productNode->AttachInputs({ rightNode, node->Input(1) });
+    node->SetInput(0, leftNode);
+    node->SetInput(1, productNode);
+    DeleteNode(weightsNode->NodeName());
+    return true;
+}
+
+// zero the weights of Times nodes whose magnitude is below threshold, and store the weights as a sparse (CSC) matrix if
+// at most the fraction maxDensity of them remains, so that the products use the sparse x dense kernels. Weights are only
+// pruned if all their consumers are Times nodes that use them as their first input, and are left dense otherwise.
+void ComputationNetwork::PruneTimesWeights(double threshold, double maxDensity)
+{
+    std::vector<ComputationNodeBasePtr> weightsNodes;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        if (node->OperationName() == OperationNameOf(TimesNode) && node->Input(0)->OperationName() == OperationNameOf(LearnableParameter) &&
+            std::find(weightsNodes.begin(), weightsNodes.end(), node->Input(0)) == weightsNodes.end())
+            weightsNodes.push_back(node->Input(0));
+    }
+
+    int numPruned = 0;
+    for (const auto& weightsNode : weightsNodes)
+    {
+        if (TryPruneTimesWeights<float>(weightsNode, threshold, maxDensity) || TryPruneTimesWeights<double>(weightsNode, threshold, maxDensity))
+            numPruned++;
+    }
+
+    if (numPruned > 0)
+    {
+        fprintf(stderr, "Pruned %d of %d weights of Times nodes into sparse matrices.\n", numPruned, (int) weightsNodes.size());
+        InvalidateCompiledNetwork();
+        CompileNetwork();
+    }
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryPruneTimesWeights(const ComputationNodeBasePtr& node, double threshold, double maxDensity)
+{
+    auto weightsNode = dynamic_pointer_cast<LearnableParameter<ElemType>>(node);
+    if (!weightsNode || node->GetSampleLayout().GetRank() != 2)
+        return false;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& consumer = iter.second;
+        for (size_t i = 0; i < consumer->GetNumInputs(); i++)
+        {
+            if (consumer->Input(i) != node)
+                continue;
+            auto product = dynamic_pointer_cast<TimesNodeBase<ElemType, false>>(consumer);
+            if (i != 0 || consumer->OperationName() != OperationNameOf(TimesNode) || !product || product->OutputRank() != 1)
+                return false;
+        }
+    }
+
+    auto& weights = weightsNode->Value();
+    if (weights.GetMatrixType() != DENSE)
+        return false;
+    size_t m = weights.GetNumRows();
+    size_t n = weights.GetNumCols();
+    std::vector<ElemType> weightsData(m * n);
+    weights.CopySection(m, n, weightsData.data(), m);
+
+    std::vector<CPUSPARSE_INDEX_TYPE> colStarts(n + 1, 0), rowIndices;
+    std::vector<ElemType> values;
+    for (size_t j = 0; j < n; j++)
+    {
+        for (size_t i = 0; i < m; i++)
+        {
+            ElemType value = weightsData[j * m + i];
+            if (fabs((double) value) >= threshold)
+            {
+                rowIndices.push_back((CPUSPARSE_INDEX_TYPE) i);
+                values.push_back(value);
+            }
+        }
+        colStarts[j + 1] = (CPUSPARSE_INDEX_TYPE) values.size();
+    }
+    if (values.size() > maxDensity * m * n)
+        return false;
+
+    fprintf(stderr, "Pruning the %d x %d weights %ls to %d nonzeros (%.1f%%).\n",
+            (int) m, (int) n, node->NodeName().c_str(), (int) values.size(), 100.0 * values.size() / (m * n));
+    weights.SwitchToMatrixType(SPARSE, matrixFormatSparseCSC, false);
+    weights.SetMatrixFromCSCFormat(colStarts.data(), rowIndices.data(), values.data(), values.size(), m, n);
+    return true;
+}
+
+// simplify the network: fold constant subgraphs, merge common subexpressions, and remove nodes that no output depends on
+// This is done upon request only, since nodes may be removed or replaced, and can then no longer be referenced by name
+// (e.g. by MEL). Nodes in node groups (tags) keep their names.
+void ComputationNetwork::OptimizeNetwork()
+{
+    VerifyIsCompiled("OptimizeNetwork");
+
+    size_t numNodes = m_nameToNodeMap.size();
+    int numFolded = FoldConstantSubgraphs();
+    int numMerged = EliminateCommonSubexpressions();
+    int numPruned = PruneUnusedNodes();
+
+    if (numFolded + numMerged + numPruned > 0)
+    {
+        fprintf(stderr, "Optimized network: folded %d constant subgraphs, merged %d duplicate nodes, removed %d unused nodes; %d of %d nodes left.\n",
+                numFolded, numMerged, numPruned, (int) m_nameToNodeMap.size(), (int) numNodes);
+        CompileNetwork();
+    }
+}
+
+// elements of a node's value for minibatches of minibatchSize columns; asDense counts sparse values (assumed one-hot) as dense
+static double NumValueElements(const ComputationNodeBasePtr& node, size_t minibatchSize, bool asDense = false)
+{
+    double numCols = node->HasMBLayout() ? (double) minibatchSize : 1.0;
+    let floatValue = dynamic_pointer_cast<Matrix<float>>(node->ValuePtr());
+    let doubleValue = dynamic_pointer_cast<Matrix<double>>(node->ValuePtr());
+    bool isSparse = (floatValue && floatValue->GetMatrixType() == SPARSE) || (doubleValue && doubleValue->GetMatrixType() == SPARSE);
+    return isSparse && !asDense ? numCols : numCols * node->GetSampleLayout().GetNumElements();
+}
+
+// Offload to the host: When the network runs on a GPU, nodes computed only from data inputs and constants, e.g. the manipulation
+// of sparse one-hot inputs or small lookups, often take less time on the CPU than the launch of a GPU kernel. Such nodes need no
+// gradient, so that moving them changes nothing but the values' device. A cost model (see HostOffloadCostModel) estimates the
+// time per minibatch of minibatchSize columns of running each of them on either device, and of the copies to the GPU of the values that
+// GPU nodes consume from the host: the data inputs (which the reader provides on the host), and the values of offloaded nodes and
+// constants. Nodes are offloaded one at a time, inputs first, as long as that lowers the estimate. The offloaded nodes and the inputs
+// they consume are placed on the host (see PlaceNodesOnDevices()), and their GPU consumers get ToDevice() nodes, which can be saved.
+// Nodes in loops, criterion and evaluation nodes, and PreCompute nodes stay where they are. Returns the number of offloaded nodes.
+// Requires a compiled network, with the dimensions of the nodes.
+int ComputationNetwork::OffloadToHost(size_t minibatchSize, const HostOffloadCostModel& costModel)
+{
+    VerifyIsCompiled("OffloadToHost");
+    if (m_deviceId == CPUDEVICE)
+        return 0;
+
+    const auto& nodes = GetEvalOrder(nullptr);
+    std::set<ComputationNodeBasePtr> pinned(m_criterionNodes.begin(), m_criterionNodes.end());
+    pinned.insert(m_evaluationNodes.begin(), m_evaluationNodes.end());
+
+    // candidates: computed nodes outside of loops that depend on data inputs (and constants) only
+    auto isDataLeaf = [](const ComputationNodeBasePtr& node)
+    {
+        return node->IsLeaf() && !node->IsParameterUpdateRequired() && !node->RequiresPreCompute();
+    };
+    std::set<ComputationNodeBasePtr> candidates;
+    std::map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>> consumers;
+    for (const auto& node : nodes)
+    {
+        for (const auto& input : node->GetInputs())
+            consumers[input].push_back(node);
+        if (node->IsLeaf() || node->IsPartOfLoop() || node->RequiresPreCompute() || dynamic_pointer_cast<IDeviceTransferNode>(node) || pinned.find(node) != pinned.end())
+            continue;
+        bool isCandidate = true;
+        for (const auto& input : node->GetInputs())
+            isCandidate &= candidates.find(input) != candidates.end() || isDataLeaf(input);
+        if (isCandidate)
+            candidates.insert(node);
+    }
+    if (candidates.empty())
+        return 0;
+
+    auto transferSeconds = [&](double numElements)
+    {
+        return costModel.transferSecondsPerTransfer + costModel.transferSecondsPerByte * numElements * sizeof(float);
+    };
+    std::map<ComputationNodeBasePtr, double> gpuSeconds, cpuSeconds;
+    for (const auto& node : candidates)
+    {
+        double numElements = NumValueElements(node, minibatchSize);
+        for (const auto& input : node->GetInputs())
+            numElements += NumValueElements(input, minibatchSize);
+        gpuSeconds[node] = costModel.gpuSecondsPerNode + costModel.gpuSecondsPerElement * numElements;
+        cpuSeconds[node] = costModel.cpuSecondsPerElement * numElements;
+    }
+
+    // estimated time per minibatch if the nodes in onHost run on the CPU and the other candidates on the GPU
+    auto estimatedSeconds = [&](const std::set<ComputationNodeBasePtr>& onHost)
+    {
+        double seconds = 0;
+        std::set<ComputationNodeBasePtr> hostValues; // values that come from the host: data inputs and those that offloaded nodes consume
+        for (const auto& node : candidates)
+        {
+            bool isOnHost = onHost.find(node) != onHost.end();
+            seconds += isOnHost ? cpuSeconds[node] : gpuSeconds[node];
+            for (const auto& input : node->GetInputs())
+                if (input->IsLeaf() && (input->HasMBLayout() || isOnHost))
+                    hostValues.insert(input);
+            if (isOnHost)
+                hostValues.insert(node);
+        }
+        for (const auto& value : hostValues)
+        {
+            bool hasHostConsumer = false, hasGpuConsumer = false;
+            for (const auto& consumer : consumers[value])
+                (onHost.find(consumer) != onHost.end() ? hasHostConsumer : hasGpuConsumer) = true;
+            if (hasGpuConsumer) // a sparse input that is also used on the host is copied as a dense matrix (see ToDeviceNode)
+                seconds += transferSeconds(NumValueElements(value, minibatchSize, /*asDense=*/hasHostConsumer || !value->IsLeaf()));
+        }
+        return seconds;
+    };
+
+    std::set<ComputationNodeBasePtr> onHost;
+    double initialSeconds = estimatedSeconds(onHost), seconds = initialSeconds;
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (const auto& node : nodes)
+        {
+            if (candidates.find(node) == candidates.end() || onHost.find(node) != onHost.end())
+                continue;
+            bool inputsOnHost = true; // offloaded nodes do not consume GPU nodes
+            for (const auto& input : node->GetInputs())
+                inputsOnHost &= input->IsLeaf() || onHost.find(input) != onHost.end();
+            if (!inputsOnHost)
+                continue;
+            onHost.insert(node);
+            double newSeconds = estimatedSeconds(onHost);
+            if (newSeconds < seconds)
+            {
+                seconds = newSeconds;
+                changed = true;
+            }
+            else
+                onHost.erase(node);
+        }
+    }
+    if (onHost.empty())
+        return 0;
+
+    // place the offloaded nodes and the leaves they consume on the host, and copy their values to their GPU consumers
+    InvalidateCompiledNetwork();
+    std::set<ComputationNodeBasePtr> hostNodes = onHost;
+    for (const auto& node : onHost)
+        for (const auto& input : node->GetInputs())
+            hostNodes.insert(input);
+    int numTransferNodes = 0;
+    for (const auto& node : hostNodes)
+    {
+        node->SetPlacedOnHost(true);
+        ComputationNodeBasePtr transferNode;
+        for (const auto& consumer : consumers[node])
+        {
+            if (hostNodes.find(consumer) != hostNodes.end() || dynamic_pointer_cast<IDeviceTransferNode>(consumer))
+                continue;
+            if (!transferNode)
+            {
+                auto name = node->NodeName() + L".toDevice";
+                for (int k = 1; NodeNameExists(name); k++)
+                    name = node->NodeName() + L".toDevice" + std::to_wstring(k);
+                if (dynamic_pointer_cast<ComputationNode<float>>(node))
+                    transferNode = New<ToDeviceNode<float>>(m_deviceId, name, m_deviceId);
+                else
+                    transferNode = New<ToDeviceNode<double>>(m_deviceId, name, m_deviceId);
+                transferNode->AttachInputs({ node });
+                AddNodeToNet(transferNode);
+                numTransferNodes++;
+            }
+            for (size_t i = 0; i < consumer->GetNumInputs(); i++)
+                if (consumer->Input(i) == node)
+                    consumer->SetInput(i, transferNode);
+        }
+    }
+    fprintf(stderr, "Offloaded %d nodes to the host, with %d ToDevice nodes for their consumers on the GPU (estimated %.1f instead of %.1f microseconds per minibatch).\n",
+            (int) onHost.size(), numTransferNodes, seconds * 1e6, initialSeconds * 1e6);
+    CompileNetwork();
+    return (int) onHost.size();
+}
+
+// Constant folding: a node computed only from constants is evaluated once and replaced by a LearnableParameter of the same name
+// with learningRateMultiplier = 0 that holds its value. Constants are LearnableParameters with learningRateMultiplier = 0, and the
+// nodes without MBLayout that can recompute their value (see CanRecomputeValue()) from constant inputs.
+// Only the constants that feed non-constant nodes or are tagged are folded, and only if their value is not larger than their
+// inputs together (e.g. not outer products). The constants left unused are removed.
+// Requires a compiled network.
+int ComputationNetwork::FoldConstantSubgraphs()
+{
+    std::vector<ComputationNodeBasePtr> allNodes;
+    for (const auto& iter : m_nameToNodeMap)
+        allNodes.push_back(iter.second);
+    auto nodes = ComputationNodeBase::EnumerateNodes(allNodes); // inputs first
+
+    std::set<ComputationNodeBasePtr> constants;
+    for (const auto& node : nodes)
+    {
+        bool isConstant;
+        if (node->IsLeaf())
+            isConstant = node->OperationName() == OperationNameOf(LearnableParameter) && node->GetLearningRateMultiplier() == 0 && !node->HasMBLayout();
+        else
+        {
+            isConstant = !node->HasMBLayout() && !node->RequiresPreCompute() && node->CanRecomputeValue();
+            for (size_t i = 0; i < node->GetNumInputs() && isConstant; i++)
+                isConstant = constants.find(node->Input(i)) != constants.end();
+        }
+        if (isConstant)
+            constants.insert(node);
+    }
+
+    std::set<ComputationNodeBasePtr> foldCandidates;
+    for (const auto& node : nodes)
+    {
+        if (constants.find(node) != constants.end())
+            continue;
+        for (const auto& input : node->GetInputs())
+            foldCandidates.insert(input);
+    }
+    for (auto group : GetAllNodeGroups())
+        foldCandidates.insert(group->begin(), group->end());
+
+    // nodes that are used before folding; those that are no longer used afterwards are removed below
+    std::set<ComputationNodeBasePtr> usedNodes = foldCandidates;
+    for (const auto& node : constants)
+        usedNodes.insert(node->GetInputs().begin(), node->GetInputs().end());
+
+    std::set<ComputationNodeBasePtr> evaluated;
+    int numFolded = 0;
+    for (const auto& node : nodes)
+    {
+        if (node->IsLeaf() || constants.find(node) == constants.end() || foldCandidates.find(node) == foldCandidates.end())
+            continue;
+        if (TryFoldConstantNode<float>(node, evaluated) || TryFoldConstantNode<double>(node, evaluated))
+            numFolded++;
+    }
+    if (numFolded == 0)
+        return 0;
+
+    // remove the constants that are no longer used, consumers first
+    std::map<ComputationNodeBasePtr, size_t> numConsumers;
+    for (const auto& iter : m_nameToNodeMap)
+        for (const auto& input : iter.second->GetInputs())
+            numConsumers[input]++;
+    for (auto group : GetAllNodeGroups())
+        for (const auto& node : *group)
+            numConsumers[node]++;
+    for (auto iter = nodes.rbegin(); iter != nodes.rend(); ++iter)
+    {
+        const auto& node = *iter;
+        if (constants.find(node) == constants.end() || usedNodes.find(node) == usedNodes.end() || numConsumers[node] > 0 ||
+            !NodeNameExists(node->NodeName()) || GetNodeFromName(node->NodeName()) != node)
+            continue;
+        for (const auto& input : node->GetInputs())
+            numConsumers[input]--;
+        RemoveNodeFromNet(node);
+        node->DetachInputs();
+    }
+    return numFolded;
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFoldConstantNode(const ComputationNodeBasePtr& node, std::set<ComputationNodeBasePtr>& evaluated)
+{
+    auto constantNode = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+    if (!constantNode)
+        return false;
+
+    size_t inputElements = 0;
+    for (const auto& input : node->GetInputs())
+        inputElements += input->GetSampleLayout().GetNumElements();
+    if (node->GetSampleLayout().GetNumElements() > inputElements)
+        return false;
+
+    // evaluate the subgraph, inputs first; matrices come from a pool of our own, since memory is not yet allocated
+    MatrixPool matrixPool;
+    for (const auto& subNode : node->EnumerateNodes())
+    {
+        if (subNode->IsLeaf() || !evaluated.insert(subNode).second)
+            continue;
+        subNode->RequestMatricesBeforeForwardProp(matrixPool);
+        subNode->BeginForwardProp();
+        subNode->ForwardProp(FrameRange(nullptr));
+        subNode->EndForwardProp();
+    }
+
+    InvalidateCompiledNetwork();
+    auto foldedNode = New<LearnableParameter<ElemType>>(node->GetDeviceId(), node->NodeName(), node->GetSampleLayout());
+    foldedNode->Value().SetValue(constantNode->Value());
+    ComputationNodeBasePtr foldedNodeBase = foldedNode;
+    foldedNodeBase->SetLearningRateMultiplier(0);
+    ChangeNodeInputs(node, foldedNodeBase);
+    for (auto groupIter : GetAllNodeGroups())
+        std::replace(groupIter->begin(), groupIter->end(), node, foldedNodeBase);
+    RemoveNodeFromNet(node);
+    AddNodeToNet(foldedNodeBase);
+    // the inputs are kept for now, since other constants may still be computed from them
+    return true;
+}
+
+// Common-subexpression elimination: of several nodes of the same operation that have the same inputs and attributes
+// (see HasSameAttributesAs()), only the first is kept, and the others' consumers use it instead. Since inputs are visited
+// first, chains of duplicates (e.g. repeated Reshape or TransposeDimensions) collapse from the bottom up. Tagged nodes are kept.
+int ComputationNetwork::EliminateCommonSubexpressions()
+{
+    std::vector<ComputationNodeBasePtr> allNodes;
+    for (const auto& iter : m_nameToNodeMap)
+        allNodes.push_back(iter.second);
+    std::set<ComputationNodeBasePtr> taggedNodes;
+    for (auto group : GetAllNodeGroups())
+        taggedNodes.insert(group->begin(), group->end());
+
+    std::map<std::pair<std::wstring, std::vector<ComputationNodeBasePtr>>, std::vector<ComputationNodeBasePtr>> nodesByOperationAndInputs;
+    int numMerged = 0;
+    for (const auto& node : ComputationNodeBase::EnumerateNodes(allNodes))
+    {
+        if (node->IsLeaf() || !node->CanRecomputeValue())
+            continue;
+        auto& sameOperationAndInputs = nodesByOperationAndInputs[make_pair(node->OperationName(), node->GetInputs())];
+        auto equivalent = std::find_if(sameOperationAndInputs.begin(), sameOperationAndInputs.end(), [&](const ComputationNodeBasePtr& other)
+        {
+            return other->HasSameAttributesAs(*node) && node->HasSameAttributesAs(*other);
+        });
+        if (equivalent == sameOperationAndInputs.end() || taggedNodes.find(node) != taggedNodes.end())
+        {
+            sameOperationAndInputs.push_back(node);
+            continue;
+        }
+
+        InvalidateCompiledNetwork();
+        ChangeNodeInputs(node, *equivalent);
+        RemoveNodeFromNet(node);
+        node->DetachInputs();
+        numMerged++;
+    }
+    return numMerged;
+}
+
+// Dead-node elimination: remove the nodes that no criterion, evaluation or output node depends on, except inputs.
+// Networks without any of these are left alone, since all their nodes without consumers are outputs.
+int ComputationNetwork::PruneUnusedNodes()
+{
+    std::vector<ComputationNodeBasePtr> outputs;
+    for (const auto& group : { &m_criterionNodes, &m_evaluationNodes, &m_outputNodes })
+        outputs.insert(outputs.end(), group->begin(), group->end());
+    if (outputs.empty())
+        return 0;
+
+    auto usedNodes = ComputationNodeBase::EnumerateNodes(outputs);
+    std::set<ComputationNodeBasePtr> keptNodes(usedNodes.begin(), usedNodes.end());
+    for (auto group : GetAllNodeGroups())
+        keptNodes.insert(group->begin(), group->end());
+
+    std::vector<ComputationNodeBasePtr> unusedNodes;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        if (keptNodes.find(node) == keptNodes.end() && !(node->IsLeaf() && node->OperationName() != OperationNameOf(LearnableParameter)))
+            unusedNodes.push_back(node);
+    }
+
+    // all consumers of an unused node are unused as well, so they can go all at once
+    if (!unusedNodes.empty())
+        InvalidateCompiledNetwork();
+    for (const auto& node : unusedNodes)
+    {
+        RemoveNodeFromNet(node);
+        node->DetachInputs();
+    }
+    return (int) unusedNodes.size();
+}
+
+// prepare a network that is only used for inference, to take as little memory as possible:
+//  - Dropout nodes, which are the identity at inference time, are removed, unless they are tagged (e.g. outputs),
+//  - BatchNormalization nodes are frozen (see BatchNormalizationNode::Freeze()), so that they always use the running
+//    statistics and keep no minibatch statistics for backprop,
+//  - all LearnableParameters get learningRateMultiplier = 0, so that no node needs a gradient.
+// Value matrices are shared among the nodes as soon as all their consumers have run if g_shareNodeValueMatrices is set,
+// which an inference-only network should do. The prepared network cannot be trained; when saved, it is loaded with its
+// BatchNormalization nodes no longer frozen (see OptimizeForInference()).
+void ComputationNetwork::PrepareForInference()
+{
+    std::set<ComputationNodeBasePtr> taggedNodes;
+    for (auto group : GetAllNodeGroups())
+        taggedNodes.insert(group->begin(), group->end());
+
+    std::vector<ComputationNodeBasePtr> dropoutNodes;
+    int numFrozen = 0;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        if (node->OperationName() == OperationNameOf(DropoutNode) && taggedNodes.find(node) == taggedNodes.end())
+            dropoutNodes.push_back(node);
+        else if (auto bnNode = dynamic_pointer_cast<BatchNormalizationNode<float>>(node))
+        {
+            bnNode->Freeze();
+            numFrozen++;
+        }
+        else if (auto bnNode = dynamic_pointer_cast<BatchNormalizationNode<double>>(node))
+        {
+            bnNode->Freeze();
+            numFrozen++;
+        }
+        else if (node->OperationName() == OperationNameOf(LearnableParameter))
+            node->SetLearningRateMultiplier(0);
+    }
+
+    for (const auto& node : dropoutNodes)
+    {
+        InvalidateCompiledNetwork();
+        ChangeNodeInputs(node, node->Input(0));
+        DeleteNode(node->NodeName());
+    }
+
+    fprintf(stderr, "Prepared network for inference: removed %d Dropout nodes, froze %d BatchNormalization nodes.\n", (int) dropoutNodes.size(), numFrozen);
+    // the gradient flags are determined when compiling
+    InvalidateCompiledNetwork();
+    CompileNetwork();
+}
+
+// turn TransposeTimes (W, x) into Times (W', x) with W' = W^T stored, for parameters W that no other node uses
+// Times is the plain [M x K] * [K x N] product that the other inference passes (BN folding, affine fusion, low-rank
+// factorization, pruning, int8) take. The new weights and product keep the names of the old ones.
+void ComputationNetwork::PretransposeTimesWeights()
+{
+    std::vector<ComputationNodeBasePtr> transposeTimesNodes;
+    for (const auto& iter : m_nameToNodeMap)
+        if (iter.second->OperationName() == OperationNameOf(TransposeTimesNode))
+            transposeTimesNodes.push_back(iter.second);
+
+    int numTransposed = 0;
+    for (const auto& node : transposeTimesNodes)
+    {
+        if (TryPretransposeTimesWeights<float>(node) || TryPretransposeTimesWeights<double>(node))
+            numTransposed++;
+    }
+
+    if (numTransposed > 0)
+    {
+        fprintf(stderr, "Pre-transposed the weights of %d of %d TransposeTimes nodes, which are now Times nodes.\n", numTransposed, (int) transposeTimesNodes.size());
+        CompileNetwork();
+    }
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryPretransposeTimesWeights(const ComputationNodeBasePtr& node)
+{
+    if (!dynamic_pointer_cast<TransposeTimesNode<ElemType>>(node))
+        return false;
+    ComputationNodeBasePtr weightsNode = node->Input(0);
+    const auto& dims = weightsNode->GetSampleLayout().GetDims();
+    if (weightsNode->OperationName() != OperationNameOf(LearnableParameter) || dims.empty() || dims.size() > 2 ||
+        weightsNode->As<ComputationNode<ElemType>>()->Value().GetMatrixType() != DENSE)
+        return false;
+
+    // the weights must only be used by the product, and keep their names if they are tagged
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& consumer = iter.second;
+        for (size_t i = 0; i < consumer->GetNumInputs(); i++)
+        {
+            if (consumer->Input(i) == weightsNode && consumer != node)
+                return false;
+        }
+    }
+    for (auto group : GetAllNodeGroups())
+    {
+        if (std::find(group->begin(), group->end(), weightsNode) != group->end())
+            return false;
+    }
+
+    // [K x M] (or a column vector [K]) becomes [M x K]
+    size_t numRows = dims[0];
+    size_t numCols = dims.size() > 1 ? dims[1] : 1;
+    InvalidateCompiledNetwork();
+    auto transposedWeights = New<LearnableParameter<ElemType>>(weightsNode->GetDeviceId(), weightsNode->NodeName(), TensorShape(numCols, numRows));
+    transposedWeights->Value().AssignTransposeOf(weightsNode->As<ComputationNode<ElemType>>()->Value());
+    ComputationNodeBasePtr transposedWeightsBase = transposedWeights;
+    transposedWeightsBase->SetLearningRateMultiplier(weightsNode->GetLearningRateMultiplier());
+    auto timesNode = New<TimesNode<ElemType>>(node->GetDeviceId(), node->NodeName());
+    timesNode->AttachInputs({ transposedWeightsBase, node->Input(1) });
+    ChangeNodeInputs(node, timesNode);
+    for (auto groupIter : GetAllNodeGroups())
+        std::replace(groupIter->begin(), groupIter->end(), node, (ComputationNodeBasePtr) timesNode);
+    RemoveNodeFromNet(node);
+    node->DetachInputs();
+    RemoveNodeFromNet(weightsNode);
+    AddNodeToNet(transposedWeightsBase);
+    AddNodeToNet(timesNode);
+    return true;
+}
+
+// turn the network into a serving-only one for its output nodes, which, unlike the other inference passes, can be saved
+// (the "optimizeForInference" action):
+//  - the criterion and evaluation nodes are dropped, and all nodes that no output depends on are removed, including inputs (e.g. labels),
+//  - Dropout nodes are removed, and all parameters become constants (see PrepareForInference()),
+//  - TransposeTimes products become Times products of pre-transposed weights (see PretransposeTimesWeights()),
+//  - BatchNormalization nodes are folded into the weights before them, with an explicit bias (see FoldBatchNormalization()),
+//  - constant subgraphs are folded and duplicate nodes merged (see OptimizeNetwork()),
+//  - the memory plan of the outputs for minibatches of minibatchSize columns is made and embedded (see EmbedMemoryPlan()).
+// The plan assumes node value sharing (g_shareNodeValueMatrices) and frozen BatchNormalization nodes, as in the eval DLL's
+// inferenceMode, which is the default there for models with a plan. The network's matrices are allocated afterwards.
+void ComputationNetwork::OptimizeForInference(size_t minibatchSize)
+{
+    VerifyIsCompiled("OptimizeForInference");
+    if (m_outputNodes.empty())
+        InvalidArgument("OptimizeForInference: The network has no output nodes.");
+
+    size_t numNodes = m_nameToNodeMap.size();
+    auto usedNodes = ComputationNodeBase::EnumerateNodes(m_outputNodes);
+    std::set<ComputationNodeBasePtr> keptNodes(usedNodes.begin(), usedNodes.end());
+    std::vector<ComputationNodeBasePtr> unusedNodes;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        if (keptNodes.find(iter.second) == keptNodes.end())
+            unusedNodes.push_back(iter.second);
+    }
+    InvalidateCompiledNetwork();
+    for (auto group : GetAllNodeGroups())
+    {
+        group->erase(std::remove_if(group->begin(), group->end(), [&keptNodes](const ComputationNodeBasePtr& node)
+        {
+            return keptNodes.find(node) == keptNodes.end();
+        }), group->end());
+    }
+    m_criterionNodes.clear();
+    m_evaluationNodes.clear();
+    for (const auto& node : unusedNodes)
+    {
+        RemoveNodeFromNet(node);
+        node->DetachInputs();
+    }
+    fprintf(stderr, "Removed %d nodes that no output depends on (criteria, evaluation and training-only nodes).\n", (int) unusedNodes.size());
+    CompileNetwork();
+
+    PrepareForInference();
+    PretransposeTimesWeights();
+    FoldBatchNormalization(/*explicitBias=*/true);
+    OptimizeNetwork();
+    fprintf(stderr, "Optimized network for inference: %d of %d nodes left.\n", (int) m_nameToNodeMap.size(), (int) numNodes);
+
+    SetMinibatchSizeHint(minibatchSize);
+    AllocateAllMatrices({}, m_outputNodes, nullptr);
+    EmbedMemoryPlan();
+}
+
 void ComputationNetwork::AddFeatureNode(ComputationNodeBasePtr featureNode)
 {
     InvalidateCompiledNetwork();
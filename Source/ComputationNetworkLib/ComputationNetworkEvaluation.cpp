@@ -10,6 +10,8 @@
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
 #include "InputAndParamNodes.h"
+#include "CPUThreadPool.h"
+#include "NodeProfiler.h"
 #include <string>
 #include <vector>
 #include <list>
@@ -43,17 +45,17 @@ void ComputationNetwork::ForwardProp(const ComputationNodeBasePtr rootNode)
     GetNestedNetwork(rootNode)->ForwardProp(FrameRange(nullptr));
 }
 
-// set the gradient matrix of a (root) node 1.0
+// set the gradient matrix of a (root) node to a scalar (normally 1.0)
 // Returns false if the node is not a ComputationNode<ElemType>; see Backprop() below for intended use.
 template <class ElemType>
-static bool SetRootGradientToScalarOne(ComputationNodeBasePtr nodep)
+static bool SetRootGradientToScalar(ComputationNodeBasePtr nodep, double value)
 {
     auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodep);
     bool hasMatchingType = (node != nullptr);
     if (hasMatchingType)
     {
-        // reset the root gradient to 1
-        node->ResetGradient(1);
+        // reset the root gradient to the value
+        node->ResetGradient((ElemType) value);
     }
     return hasMatchingType;
 }
@@ -63,20 +65,24 @@ static bool SetRootGradientToScalarOne(ComputationNodeBasePtr nodep)
 //  - ForwardProp() for eval nodes
 //  - ForwardProp() for the training criterion (which will reuse computation results from the previous step)
 //  - Backprop() for the training criterion
-void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode) // training criterion to compute the gradients for
+// A rootGradient other than 1 scales all gradients, e.g. for loss scaling in SGD.
+// If given, onParameterGradientCompleted is called for each learnable parameter as soon as backprop has completed its gradient,
+// e.g. to start aggregating it across workers while the other gradients are being computed.
+void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode, double rootGradient, // training criterion to compute the gradients for
+                                  const std::function<void(const ComputationNodeBasePtr&)>& onParameterGradientCompleted)
 {
     if (!Environment().IsTraining())
         LogicError("Backprop: Requires network is to be in training mode.");
 
-    // initialize root gradient with a scalar value of 1.0
-    if (!SetRootGradientToScalarOne<float>(rootNode) && !SetRootGradientToScalarOne<double>(rootNode))
+    // initialize root gradient with a scalar value of 1.0 (or rootGradient)
+    if (!SetRootGradientToScalar<float>(rootNode, rootGradient) && !SetRootGradientToScalar<double>(rootNode, rootGradient))
         LogicError("Backprop: Training criterion is neither ComputationNode<float> nor ComputationNode<double>.");
 
     // reset all gradients below rootNode to zero (actually, internally, this is lazy, but we don't care here)
     ZeroInputGradients(rootNode);
 
     // backpropagate through the network
-    GetNestedNetwork(rootNode)->Backprop(FrameRange(nullptr), true, true);
+    static_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode))->Backprop(FrameRange(nullptr), onParameterGradientCompleted);
 }
 
 void ComputationNetwork::FormNestedNetwork(const ComputationNodeBasePtr& rootNode)
@@ -131,35 +137,426 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
 {
-    for (auto& node : m_nestedNodes)
+    size_t numStreams = GetNumConcurrentStreams();
+    if (numStreams > 0 && m_nodeStreams.size() != m_nestedNodes.size())
+        PlanConcurrentStreams(numStreams);
+
+    if (!m_nodeLevels.empty())
+    {
+        ForwardPropConcurrentLevels(fr);
+        return;
+    }
+
+    for (size_t i = 0; i < m_nestedNodes.size(); i++)
     {
+        auto& node = m_nestedNodes[i];
 #if 0
         if (dynamic_pointer_cast<LearnableParameter<float>>(node))
             dynamic_pointer_cast<ComputationNode<float>>(node)->DebugLogMinibatch();
 #endif
+        if (!m_streams.empty())
+        {
+            // issue the node to its stream, after the nodes on other streams that it depends on
+            if (m_nodeStreams[i] >= 0)
+                m_streams[m_nodeStreams[i]]->MakeCurrent();
+            else
+                GPUStream::MakeDefaultCurrent();
+            for (size_t j : m_nodeWaits[i])
+                m_nodeEvents[j]->MakeCurrentStreamWait();
+        }
+
         if (node->IsOutOfDateWrtInputs())
         {
+            MatrixTransferScope transferScope(node->NodeName()); // attribute implicit CPU/GPU transfers to this node (recurrent loops as a whole)
+            NodeProfiler::Scope profilerScope(node, NodeProfiler::Phase::Forward);
             node->BeginForwardProp();
             node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
             node->EndForwardProp();
+            if (node->IsValueCompressedForBackprop() && node->Environment().IsTraining())
+                node->CompressValueForBackprop();
 
             node->BumpEvalTimeStamp();
         }
+
+        if (!m_streams.empty() && m_nodeEvents[i])
+            m_nodeEvents[i]->Record();
     }
+
+    if (!m_streams.empty())
+        JoinConcurrentStreams();
+}
+
+// assign each node to a stream and determine the cross-stream dependencies; see SetNumConcurrentStreams()
+void ComputationNetwork::PARTraversalFlowControlNode::PlanConcurrentStreams(size_t numStreams)
+{
+    const size_t numNodes = m_nestedNodes.size();
+    m_nodeStreams.assign(numNodes, -1);
+    m_nodeWaits.assign(numNodes, vector<size_t>());
+    m_nodeEvents.clear();
+    m_nodeEvents.resize(numNodes);
+    m_streams.clear();
+    m_streamEvents.clear();
+    m_nodeLevels.clear();
+
+    // CPU networks run in levels instead
+    if (std::all_of(m_nestedNodes.begin(), m_nestedNodes.end(), [](const ComputationNodeBasePtr& node) { return node->GetDeviceId() == CPUDEVICE; }))
+    {
+        PlanConcurrentLevels();
+        return;
+    }
+
+    // all GPU nodes must be on the same device; otherwise we stay on the default stream
+    DEVICEID_TYPE deviceId = CPUDEVICE;
+    for (const auto& node : m_nestedNodes)
+    {
+        if (node->GetDeviceId() == CPUDEVICE || (deviceId != CPUDEVICE && node->GetDeviceId() != deviceId))
+            return;
+        deviceId = node->GetDeviceId();
+    }
+    if (deviceId == CPUDEVICE)
+        return;
+
+    unordered_map<ComputationNodeBase*, size_t> indexOf;
+    for (size_t i = 0; i < numNodes; i++)
+        indexOf[m_nestedNodes[i].get()] = i;
+
+    vector<bool> continued(numNodes, false); // [i] a consumer of m_nestedNodes[i] already continues its stream
+    size_t nextStream = 0;
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        const auto& node = m_nestedNodes[i];
+        // Leaves and loops stay on the default stream. Where they have inputs, they are synchronized implicitly, since
+        // the default stream waits for all other (blocking) streams and vice versa. The same holds for inputs that are
+        // not in this list, such as the members of a loop.
+        if (node->GetNumInputs() == 0 || dynamic_pointer_cast<SEQTraversalFlowControlNode>(node))
+            continue;
+
+        int stream = -1;
+        for (const auto& input : node->GetInputs())
+        {
+            auto iter = indexOf.find(input.get());
+            if (iter != indexOf.end() && m_nodeStreams[iter->second] >= 0 && !continued[iter->second])
+            {
+                continued[iter->second] = true;
+                stream = m_nodeStreams[iter->second];
+                break;
+            }
+        }
+        if (stream < 0) // start a new branch
+            stream = (int) (nextStream++ % numStreams);
+        m_nodeStreams[i] = stream;
+
+        for (const auto& input : node->GetInputs())
+        {
+            auto iter = indexOf.find(input.get());
+            if (iter == indexOf.end() || m_nodeStreams[iter->second] < 0 || m_nodeStreams[iter->second] == stream)
+                continue;
+            auto& waits = m_nodeWaits[i];
+            if (std::find(waits.begin(), waits.end(), iter->second) == waits.end())
+                waits.push_back(iter->second);
+            if (!m_nodeEvents[iter->second])
+                m_nodeEvents[iter->second] = unique_ptr<GPUEvent>(new GPUEvent(deviceId));
+        }
+    }
+
+    for (size_t s = 0; s < min(numStreams, nextStream); s++)
+    {
+        m_streams.push_back(unique_ptr<GPUStream>(new GPUStream(deviceId)));
+        m_streamEvents.push_back(unique_ptr<GPUEvent>(new GPUEvent(deviceId)));
+    }
+}
+
+// make all streams and the default stream wait for each other, so that later work, which may run on any of them, sees all results
+void ComputationNetwork::PARTraversalFlowControlNode::JoinConcurrentStreams()
+{
+    for (size_t s = 0; s < m_streams.size(); s++)
+    {
+        m_streams[s]->MakeCurrent();
+        m_streamEvents[s]->Record();
+    }
+    for (size_t t = 0; t < m_streams.size(); t++)
+    {
+        m_streams[t]->MakeCurrent();
+        for (size_t s = 0; s < m_streams.size(); s++)
+        {
+            if (s != t)
+                m_streamEvents[s]->MakeCurrentStreamWait();
+        }
+    }
+    GPUStream::MakeDefaultCurrent();
+    for (const auto& event : m_streamEvents)
+        event->MakeCurrentStreamWait();
+}
+
+// group the nodes of a CPU network into levels of nodes that can run concurrently; see SetNumConcurrentStreams()
+void ComputationNetwork::PARTraversalFlowControlNode::PlanConcurrentLevels()
+{
+    const size_t numNodes = m_nestedNodes.size();
+    unordered_map<ComputationNodeBase*, size_t> indexOf;
+    for (size_t i = 0; i < numNodes; i++)
+        indexOf[m_nestedNodes[i].get()] = i;
+
+    vector<size_t> nodeLevels(numNodes);
+    size_t numLevels = 0;
+    size_t firstLevel = 0; // nodes after a loop come after its level, as they may depend on nodes inside of it
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        const auto& node = m_nestedNodes[i];
+        size_t level = firstLevel;
+        if (dynamic_pointer_cast<SEQTraversalFlowControlNode>(node))
+        {
+            level = numLevels;
+            firstLevel = level + 1;
+        }
+        else
+        {
+            for (const auto& input : node->GetInputs())
+            {
+                auto iter = indexOf.find(input.get());
+                if (iter != indexOf.end())
+                    level = max(level, nodeLevels[iter->second] + 1);
+            }
+        }
+        nodeLevels[i] = level;
+        numLevels = max(numLevels, level + 1);
+    }
+    if (numLevels == numNodes) // nothing to run concurrently
+        return;
+
+    m_nodeLevels.resize(numLevels);
+    for (size_t i = 0; i < numNodes; i++)
+        m_nodeLevels[nodeLevels[i]].push_back(i);
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::ForwardPropConcurrentLevels(const FrameRange& fr)
+{
+    for (const auto& level : m_nodeLevels)
+    {
+        // the column masks of MBLayouts are created upon first use, which must not happen concurrently
+        for (size_t i : level)
+        {
+            for (const auto& input : m_nestedNodes[i]->GetInputs())
+            {
+                if (level.size() > 1 && input->HasMBLayout() && input->GetMBLayout()->HasGaps())
+                    input->GetMBLayout()->GetColumnsValidityMask(input->GetDeviceId());
+            }
+        }
+
+        // Note: no MatrixTransferScope since its scope is process-wide, and nothing is transferred on the CPU anyway.
+        CPUThreadPool::ParallelFor(0, (int64_t) level.size(), CPUThreadPool::MinWorkPerChunk, [&](int64_t j)
+        {
+            auto& node = m_nestedNodes[level[j]];
+            if (node->IsOutOfDateWrtInputs())
+            {
+                NodeProfiler::Scope profilerScope(node, NodeProfiler::Phase::Forward);
+                node->BeginForwardProp();
+                node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+                node->EndForwardProp();
+
+                node->BumpEvalTimeStamp();
+            }
+        });
+    }
+}
+
+static size_t s_numConcurrentStreams = 0;
+
+/*static*/ void ComputationNetwork::SetNumConcurrentStreams(size_t numStreams)
+{
+    s_numConcurrentStreams = numStreams;
+}
+
+/*static*/ size_t ComputationNetwork::GetNumConcurrentStreams()
+{
+    return s_numConcurrentStreams;
 }
 
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop; // TODO: think through what these mean when coming from PAR mode
+    Backprop(fr, nullptr);
+}
+
+// A learnable parameter is a leaf, which comes before all nodes that use it in evaluation order. Its gradient is
+// therefore complete when the backwards iteration reaches it.
+void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, const std::function<void(const ComputationNodeBasePtr&)>& onParameterGradientCompleted)
+{
+    std::set<ComputationNodeBasePtr> recomputed; // values released after forward prop that have been recomputed (gradient checkpointing)
     // process nodes in pre-determined order
     for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
     {
         auto& node = *pnode;
 
+        MatrixTransferScope transferScope(node->NodeName());
+        NodeProfiler::Scope profilerScope(node, NodeProfiler::Phase::Backward); // (including the recomputation of released values)
+        RecomputeValuesForBackprop(node, fr, recomputed, nullptr);
         node->BeginBackprop();
         node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
         node->EndBackprop();
+
+        if (onParameterGradientCompleted && node->IsParameterUpdateRequired() && node->NeedsGradient())
+            onParameterGradientCompleted(node);
+    }
+}
+
+// -----------------------------------------------------------------------
+// gradient checkpointing (see SetGradientCheckpointing())
+// -----------------------------------------------------------------------
+
+// recompute the released values that the backprop of 'node' reads, unless they have been recomputed already
+// 'recomputed' holds the values that are currently valid. With a 'matrixPool', nothing is computed; the values are just requested
+// and released in the same order, which is how AllocateAllMatrices() plans their memory.
+/*static*/ void ComputationNetwork::RecomputeValuesForBackprop(const ComputationNodeBasePtr& node, const FrameRange& fr, set<ComputationNodeBasePtr>& recomputed, MatrixPool* matrixPool)
+{
+    if (!node->NeedsGradient()) // no backprop happens
+        return;
+    for (size_t i = 0; i < node->GetNumInputs(); i++)
+    {
+        const auto& input = node->GetInputs()[i];
+        if (input->IsValueRecomputedForBackprop() && node->InputUsedInComputingInputNodesGradients(i))
+            RecomputeValue(input, fr, recomputed, matrixPool);
+    }
+    if (node->IsValueRecomputedForBackprop() && node->OutputUsedInComputingInputNodesGradients())
+        RecomputeValue(node, fr, recomputed, matrixPool);
+}
+
+/*static*/ void ComputationNetwork::RecomputeValue(const ComputationNodeBasePtr& node, const FrameRange& fr, set<ComputationNodeBasePtr>& recomputed, MatrixPool* matrixPool)
+{
+    if (recomputed.find(node) != recomputed.end())
+        return;
+
+    // compressed values are restored from their compressed copy, without their inputs
+    if (node->IsValueCompressedForBackprop())
+    {
+        if (matrixPool)
+            node->RequestValueForRecomputation(*matrixPool); // also releases the compressed copy
+        else
+            node->DecompressValueForBackprop();
+        recomputed.insert(node);
+        return;
+    }
+
+    // released inputs are recomputed first; those that backprop does not need are released again right after
+    std::vector<ComputationNodeBasePtr> transientInputs;
+    for (const auto& input : node->GetInputs())
+    {
+        if (input->IsValueRecomputedForBackprop() && recomputed.find(input) == recomputed.end())
+        {
+            RecomputeValue(input, fr, recomputed, matrixPool);
+            if (!input->IsOutputNeededDuringBackprop())
+                transientInputs.push_back(input);
+        }
+    }
+
+    if (matrixPool)
+        node->RequestValueForRecomputation(*matrixPool);
+    else
+    {
+        node->BeginForwardProp();
+        node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+        node->EndForwardProp();
+    }
+    recomputed.insert(node);
+
+    for (const auto& input : transientInputs)
+    {
+        if (matrixPool)
+            input->ReleaseValueAfterRecomputation(*matrixPool);
+        recomputed.erase(input);
+    }
+}
+
+// decide which values are released after forward prop and recomputed in backprop, or restored from a compressed copy (see SetValueCompression())
+// The inputs of recomputed ones must stay available until then, so their values are marked as needed during backprop.
+void ComputationNetwork::MarkValuesRecomputedForBackprop(const std::list<ComputationNodeBasePtr>& forwardPropOrder,
+                                                         const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                                         std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp)
+{
+    for (const auto& node : forwardPropOrder)
+    {
+        node->SetValueRecomputedForBackprop(false);
+        node->SetValueCompressedForBackprop(false, m_valueCompressionType);
     }
+
+    if (m_checkpointInterval == 0 && m_recomputedNodeNames.empty() && m_compressedNodeNames.empty())
+        return;
+    if (!g_shareNodeValueMatrices || GetNumConcurrentStreams() > 0)
+    {
+        fprintf(stderr, "Gradient checkpointing: WARNING: Ignored since it requires shareNodeValueMatrices and no concurrent streams.\n");
+        return;
+    }
+
+    // recomputation is triggered by the backprop of the node or of its parents, which must therefore run in PAR mode
+    auto canReleaseValue = [&](const ComputationNodeBasePtr& node)
+    {
+        bool eligible = node->IsValueSharable() && !node->IsLeaf() && !node->IsPartOfLoop() && !node->RequiresPreCompute();
+        auto parents = parentsMap.find(node);
+        if (eligible && parents != parentsMap.end())
+        {
+            for (const auto& parent : parents->second)
+                eligible &= !parent->IsPartOfLoop();
+        }
+        return eligible;
+    };
+
+    std::set<std::wstring> names(m_recomputedNodeNames.begin(), m_recomputedNodeNames.end());
+    size_t numEligible = 0;
+    size_t numRecomputed = 0;
+    for (const auto& node : forwardPropOrder)
+    {
+        bool eligible = node->CanRecomputeValue() && canReleaseValue(node);
+
+        bool named = names.erase(node->NodeName()) > 0;
+        if (named && !eligible)
+            fprintf(stderr, "Gradient checkpointing: WARNING: The value of %ls %ls operation cannot be recomputed, it is kept.\n", node->NodeName().c_str(), node->OperationName().c_str());
+        if (!eligible)
+            continue;
+
+        numEligible++;
+        // every k-th eligible node is a checkpoint
+        if (named || (m_checkpointInterval > 0 && numEligible % m_checkpointInterval != 0))
+        {
+            node->SetValueRecomputedForBackprop(true);
+            numRecomputed++;
+        }
+    }
+    for (const auto& name : names)
+        fprintf(stderr, "Gradient checkpointing: WARNING: There is no node %ls to recompute.\n", name.c_str());
+
+    // a value that backprop does not read is released after forward prop anyway, so there is nothing to compress
+    std::set<std::wstring> compressedNames(m_compressedNodeNames.begin(), m_compressedNodeNames.end());
+    size_t numCompressed = 0;
+    for (const auto& node : forwardPropOrder)
+    {
+        if (compressedNames.erase(node->NodeName()) == 0 || node->IsValueRecomputedForBackprop())
+            continue;
+        if (!outputValueNeededDuringBackProp[node] || !canReleaseValue(node))
+        {
+            fprintf(stderr, "Value compression: WARNING: The value of %ls %ls operation cannot be compressed, it is kept.\n", node->NodeName().c_str(), node->OperationName().c_str());
+            continue;
+        }
+        node->SetValueRecomputedForBackprop(true);
+        node->SetValueCompressedForBackprop(true, m_valueCompressionType);
+        numCompressed++;
+    }
+    for (const auto& name : compressedNames)
+        fprintf(stderr, "Value compression: WARNING: There is no node %ls to compress.\n", name.c_str());
+
+    for (const auto& node : forwardPropOrder)
+    {
+        if (!node->IsValueRecomputedForBackprop() || node->IsValueCompressedForBackprop())
+            continue;
+        for (const auto& input : node->GetInputs())
+        {
+            if (!input->IsValueRecomputedForBackprop())
+                outputValueNeededDuringBackProp[input] = true;
+        }
+    }
+
+    if (m_checkpointInterval > 0 || !m_recomputedNodeNames.empty())
+        fprintf(stderr, "Gradient checkpointing: The values of %d of %d eligible nodes are recomputed during backprop.\n", (int) numRecomputed, (int) numEligible);
+    if (!m_compressedNodeNames.empty())
+        fprintf(stderr, "Value compression: The values of %d nodes are kept compressed to %s for backprop.\n", (int) numCompressed, m_valueCompressionType == CompactElementType::uint8 ? "8 bits" : "FP16");
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
 {
@@ -219,11 +616,12 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     for (auto t = range.begin(); t != range.end(); t++)
     {
         for (auto& node : m_nestedNodes)
-        {
             node->ForwardProp(t);
-            node->BumpEvalTimeStamp();
-        }
     }
+
+    // the time stamps only matter once the loop is done, so they are bumped once, not once per time step
+    for (auto& node : m_nestedNodes)
+        node->BumpEvalTimeStamp();
 }
 
 /*virtual*/ void ComputationNetwork::SEQTraversalFlowControlNode::EndForwardProp() /*override*/
@@ -446,11 +844,19 @@ void ComputationNetwork::CompileNetwork()
     for (auto& node : m_allRoots)
         FormNestedNetwork(node);
 
+    // STEP: Place the nodes on their devices if the network is split by ToDevice() nodes or has nodes placed on the host.
+    // Before validation, which creates device-specific state such as convolution engines.
+    PlaceNodesOnDevices();
+
     // STEP: Infer node dimensions.
-    ValidateNetwork();
+    // With a compilation cache of the same network structure, start from the cached shapes; otherwise create the cache.
+    bool startFromCachedShapes = !m_compilationCachePath.empty() && LoadCompilationCache(m_compilationCachePath);
+    ValidateNetwork(startFromCachedShapes);
+    if (!m_compilationCachePath.empty() && !startFromCachedShapes)
+        SaveCompilationCache(m_compilationCachePath);
 
     // STEP: Optimize the network.
-    // :)
+    // Not done here, since it removes and replaces nodes; see OptimizeNetwork(), which compiles the network again.
 
     // STEP: Some final details.
     ResetEvalTimeStamps(); // invalidate all m_value fields. Really belongs into StartEvaluateMinibatchLoop()
@@ -459,6 +865,113 @@ void ComputationNetwork::CompileNetwork()
     m_isCompiled = true;
 }
 
+// a host-resident parameter (onHost=true) stays in host memory
+static bool IsHostResidentParameter(const ComputationNodeBasePtr& node)
+{
+    let floatParameter = dynamic_pointer_cast<LearnableParameter<float>>(node);
+    let doubleParameter = dynamic_pointer_cast<LearnableParameter<double>>(node);
+    return (floatParameter && floatParameter->IsOnHost()) || (doubleParameter && doubleParameter->IsOnHost());
+}
+
+// place the nodes on the devices given by ToDevice() nodes, host-resident parameters and nodes placed on the host
+//  - A computed node runs on the device of its computed inputs; a ToDevice() node on its target device.
+//  - A host-resident parameter is on the CPU, and so are the nodes computed from it, e.g. the LookupTable() of a large embedding,
+//    which gathers the columns of the minibatch on the host; a ToDevice() after it moves only those to the GPU.
+//  - A node placed on the host (see OffloadToHost()) is on the CPU.
+//  - Nodes that this leaves open, e.g. parameters, inputs, and nodes computed only from those, go to the device of
+//    the nodes that consume them (other than ToDevice()); if those differ or if there are none, to the network's device.
+// All inputs of a node other than ToDevice() must end up on its device, otherwise this fails; the fix is a ToDevice().
+// Without ToDevice() nodes and host-resident parameters, all nodes stay on the network's device. If that is the CPU, so are the targets.
+void ComputationNetwork::PlaceNodesOnDevices()
+{
+    const auto& nodes = GetEvalOrder(nullptr);
+    map<ComputationNodeBasePtr, DEVICEID_TYPE> placement;
+    for (const auto& node : nodes)
+    {
+        let transferNode = dynamic_pointer_cast<IDeviceTransferNode>(node);
+        if (transferNode)
+            placement[node] = m_deviceId == CPUDEVICE ? CPUDEVICE : transferNode->GetTargetDeviceId();
+        else if (IsHostResidentParameter(node) || node->IsPlacedOnHost())
+            placement[node] = CPUDEVICE;
+    }
+    if (placement.empty())
+        return;
+
+    // forward: from the computed inputs (repeated because a delay node comes before its input in the order)
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (const auto& node : nodes)
+        {
+            if (placement.find(node) != placement.end())
+                continue;
+            for (size_t i = 0; i < node->GetNumInputs(); i++)
+            {
+                let iter = placement.find(node->Input(i));
+                if (iter != placement.end())
+                {
+                    placement[node] = iter->second;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    // backward: from the consumers, except ToDevice() nodes, which take their inputs from anywhere
+    map<ComputationNodeBasePtr, vector<ComputationNodeBasePtr>> consumers;
+    for (const auto& node : nodes)
+    {
+        if (dynamic_pointer_cast<IDeviceTransferNode>(node))
+            continue;
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+            consumers[node->Input(i)].push_back(node);
+    }
+    for (auto nodeIter = nodes.rbegin(); nodeIter != nodes.rend(); nodeIter++)
+    {
+        let& node = *nodeIter;
+        if (placement.find(node) != placement.end())
+            continue;
+        DEVICEID_TYPE deviceId = m_deviceId;
+        let& nodeConsumers = consumers[node];
+        for (size_t k = 0; k < nodeConsumers.size(); k++)
+        {
+            let iter = placement.find(nodeConsumers[k]);
+            DEVICEID_TYPE consumerDeviceId = iter != placement.end() ? iter->second : m_deviceId;
+            if (k == 0)
+                deviceId = consumerDeviceId;
+            else if (consumerDeviceId != deviceId)
+            {
+                deviceId = m_deviceId;
+                break;
+            }
+        }
+        placement[node] = deviceId;
+    }
+
+    map<DEVICEID_TYPE, size_t> numNodesPerDevice;
+    for (const auto& node : nodes)
+    {
+        let deviceId = placement[node];
+        if (!dynamic_pointer_cast<IDeviceTransferNode>(node))
+        {
+            for (size_t i = 0; i < node->GetNumInputs(); i++)
+            {
+                let& input = node->Input(i);
+                if (placement[input] != deviceId)
+                    InvalidArgument("PlaceNodesOnDevices: %ls %ls operation runs on device %d, but its input %ls %ls operation on device %d. Use ToDevice() to move the input.",
+                                    node->NodeName().c_str(), node->OperationName().c_str(), (int) deviceId,
+                                    input->NodeName().c_str(), input->OperationName().c_str(), (int) placement[input]);
+            }
+        }
+        if (node->GetDeviceId() != deviceId)
+            node->MoveToDevice(deviceId);
+        numNodesPerDevice[deviceId]++;
+    }
+    for (const auto& device : numNodesPerDevice)
+        fprintf(stderr, "PlaceNodesOnDevices: %d nodes on %s %d.\n", (int) device.second, device.first == CPUDEVICE ? "CPU" : "GPU", (int) device.first);
+}
+
 // determine the set of all root nodes
 // Roots are nodes that ForwardProp() may be called for.
 //  - training criterion, eval criteria
@@ -575,7 +1088,9 @@ void ComputationNetwork::ResetMBLayouts()
 // This calls Validate() on every node in evaluation order (allowing to propagate things forwards through the net).
 // This is called lazily but once only per node until next ClearCache().
 // MBLayout links are expected to have been set up already for inputs, and reset to nullptr for all other nodes.
-void ComputationNetwork::ValidateNetwork()
+// With startFromCurrentShapes, the shapes the nodes have (e.g. from the compilation cache) are taken as a first guess:
+// all nodes are validated from the first pass on, and the nodes are not logged (they were when the cache was created).
+void ComputationNetwork::ValidateNetwork(bool startFromCurrentShapes)
 {
     // we call all nodes' Validate() in order to validate, that is, set up MBLayout and FunctionValues dimension
     // A problem is that recurrent loops may require partial validation.
@@ -584,7 +1099,7 @@ void ComputationNetwork::ValidateNetwork()
 
     for (auto& node : nodes)
     {
-        node->m_visited = false;
+        node->m_visited = startFromCurrentShapes;
         node->m_needsGradient = node->IsParameterUpdateRequired(); // these get propagated upwards in the following
     }
 
@@ -596,14 +1111,16 @@ void ComputationNetwork::ValidateNetwork()
     //    Fail if any change during this stage.
     size_t pass = 1;
     size_t toValidate = nodes.size();
+    if (startFromCurrentShapes)
+        fprintf(stderr, "\nValidating network starting from the cached node shapes.\n");
     while (toValidate > 0)
     {
         fprintf(stderr, "\nValidating network. %d nodes to process in pass %d.\n\n", (int) toValidate, (int) pass);
-        toValidate = ValidateNodes(nodes, /*isFirstPass=*/pass == 1, false /*isFinalValidationPass*/);
+        toValidate = ValidateNodes(nodes, /*isFirstPass=*/pass == 1, false /*isFinalValidationPass*/, /*logChanges=*/!startFromCurrentShapes);
         pass++;
     }
     fprintf(stderr, "\nValidating network, final pass.\n\n");
-    toValidate = ValidateNodes(nodes, /*isFirstPass=*/pass == 1, true /*isFinalValidationPass*/);
+    toValidate = ValidateNodes(nodes, /*isFirstPass=*/pass == 1, true /*isFinalValidationPass*/, /*logChanges=*/!startFromCurrentShapes);
     if (toValidate != 0)
         LogicError("ValidateSubNetwork: ValidateNodes(true) unexpectedly returned with work left to do.");
 
@@ -678,7 +1195,7 @@ bool ComputationNetwork::ValidateNode(ComputationNodeBasePtr node, bool isFinalV
 
 // perform one pass of validation over the topologically-sorted node set
 // returns how many nodes either could not yet be validated yet or have changed and thus must be redone
-size_t ComputationNetwork::ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFirstPass, bool isFinalValidationPass)
+size_t ComputationNetwork::ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFirstPass, bool isFinalValidationPass, bool logChanges)
 {
     size_t todo = 0;
     for (auto& node : nodes)
@@ -703,22 +1220,24 @@ size_t ComputationNetwork::ValidateNodes(list<ComputationNodeBasePtr> nodes, boo
         bool valid = false;
         if (hasVisitedChild || isLeaf) // got at least one child: it makes sense to call Validate()
         {
-            string prevPrototype = node->FormatOperationPrototype("");
+            string prevPrototype = logChanges ? node->FormatOperationPrototype("") : string(); // formatting is costly on large networks
             bool unchanged;
             try
             {
                 unchanged = !ValidateNode(node, isFinalValidationPass);
-                string updatedPrototype = node->FormatOperationPrototype("");
+                string updatedPrototype = logChanges ? node->FormatOperationPrototype("") : string();
 #if 0           // print prototype in final validation pass. Problematic for tracking down validation errors in loops.
                 unchanged;
                 if (isFinalValidationPass)
 #else           // print prototype upon every change (useful for debugging)
-                if (isFirstPass || !unchanged || prevPrototype != updatedPrototype)
+                if (logChanges && (isFirstPass || !unchanged || prevPrototype != updatedPrototype))
 #endif
                     fprintf(stderr, "Validating --> %s\n", updatedPrototype.c_str());
             }
             catch (...) // if validation failed then print the prototype anyway so one can see the input args
             {
+                if (!logChanges)
+                    prevPrototype = node->FormatOperationPrototype("");
                 fprintf(stderr, "Validating --> %s FAILED\n", prevPrototype.c_str());
                 throw;
             }
@@ -739,6 +1258,120 @@ size_t ComputationNetwork::ValidateNodes(list<ComputationNodeBasePtr> nodes, boo
     return todo;
 }
 
+// -----------------------------------------------------------------------
+// compilation cache
+// -----------------------------------------------------------------------
+
+bool ComputationNetwork::s_useCompilationCache = false;
+
+static const size_t c_compilationCacheVersion = 1;
+
+// 64-bit FNV-1a, continued from 'hash'; unlike std::hash the result is the same for all builds
+static uint64_t HashString(uint64_t hash, const std::wstring& s)
+{
+    for (auto c : s)
+    {
+        hash ^= (uint64_t) c;
+        hash *= 1099511628211ull;
+    }
+    hash *= 1099511628211ull; // terminator, so that different splits of the same characters differ
+    return hash;
+}
+
+// hash of what determines the validated shapes: the nodes with their precision, operation, connections and, for
+// leaves, shapes. Configuration inside of nodes (e.g. a target shape) is not included; validation corrects for it.
+uint64_t ComputationNetwork::ComputeStructureHash() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto& iter : m_nameToNodeMap) // (sorted by name)
+    {
+        const auto& node = iter.second;
+        hash = HashString(hash, node->Is<ComputationNode<float>>() ? L"float" : L"double");
+        hash = HashString(hash, node->OperationName());
+        hash = HashString(hash, node->NodeName());
+        for (const auto& input : node->GetInputs())
+            hash = HashString(hash, input->NodeName());
+        if (node->IsLeaf())
+            hash = HashString(hash, msra::strfun::utf16(string(node->GetSampleLayout())));
+    }
+    return hash;
+}
+
+// set the node shapes from the compilation cache if it exists and matches the network structure
+bool ComputationNetwork::LoadCompilationCache(const std::wstring& cachePath)
+{
+    if (!fexists(cachePath.c_str()))
+        return false;
+    try
+    {
+        File fstream(cachePath, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BCompilationCache");
+        size_t version;
+        uint64_t hash;
+        size_t numNodes;
+        fstream >> version >> hash >> numNodes;
+        if (version != c_compilationCacheVersion || hash != ComputeStructureHash() || numNodes != m_nameToNodeMap.size())
+        {
+            fprintf(stderr, "Compilation cache %ls does not match the network, recreating it.\n", cachePath.c_str());
+            return false;
+        }
+        vector<pair<ComputationNodeBasePtr, TensorShape>> shapes;
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            wstring nodeName;
+            TensorShape shape;
+            fstream >> nodeName;
+            shape.Load(fstream);
+            auto iter = m_nameToNodeMap.find(nodeName);
+            if (iter == m_nameToNodeMap.end())
+                return false;
+            shapes.push_back(make_pair(iter->second, shape));
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ECompilationCache");
+
+        // leaves keep their own shapes, which are part of the structure hash
+        for (const auto& nodeAndShape : shapes)
+        {
+            if (!nodeAndShape.first->IsLeaf())
+                nodeAndShape.first->SetDims(nodeAndShape.second, nodeAndShape.first->HasMBLayout());
+        }
+    }
+    catch (const exception& e) // an unreadable cache is not an error, we recreate it
+    {
+        fprintf(stderr, "Compilation cache %ls could not be read (%s), recreating it.\n", cachePath.c_str(), e.what());
+        return false;
+    }
+    fprintf(stderr, "Using the compilation cache %ls.\n", cachePath.c_str());
+    return true;
+}
+
+// save the validated node shapes to the compilation cache
+// Failing to write it is not an error, e.g. the model may be in a read-only location.
+void ComputationNetwork::SaveCompilationCache(const std::wstring& cachePath) const
+{
+    try
+    {
+        // write to a temporary file first, so that processes starting concurrently never see a partial cache
+        wstring tmpCachePath = cachePath + L".tmp";
+        {
+            File fstream(tmpCachePath, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BCompilationCache");
+            fstream << c_compilationCacheVersion << ComputeStructureHash() << m_nameToNodeMap.size();
+            for (const auto& iter : m_nameToNodeMap)
+            {
+                fstream << iter.first;
+                iter.second->GetSampleLayout().Save(fstream);
+            }
+            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ECompilationCache");
+        }
+        renameOrDie(tmpCachePath, cachePath);
+    }
+    catch (const exception& e)
+    {
+        fprintf(stderr, "Warning: Compilation cache %ls could not be written (%s).\n", cachePath.c_str(), e.what());
+    }
+}
+
 // -----------------------------------------------------------------------
 // memory allocation
 // -----------------------------------------------------------------------
@@ -897,6 +1530,10 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         }
     }
 
+    // gradient checkpointing: choose the values to release after forward prop and to recompute during backprop
+    if (performingBackPropagation)
+        MarkValuesRecomputedForBackprop(GetEvalOrder(trainRootNode), parentsMap, outputValueNeededDuringBackProp);
+
     std::unordered_map<ComputationNodeBasePtr, int> parentCount;
     for (auto& keyValue : parentsMap)
     {
@@ -933,16 +1570,26 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
 
                 for (auto& nodeLoopIter : recInfo->m_nestedNodes)
                 {
-                    ReleaseMatricesAfterEvalForChildren(nodeLoopIter, parentCount);
+                    if (GetNumConcurrentStreams() == 0)
+                        ReleaseMatricesAfterEvalForChildren(nodeLoopIter, parentCount);
                 }
             }
         }
+        else if (nodeIter->CanComputeInPlace() && GetNumConcurrentStreams() == 0)
+        {
+            // in place: if this node is the last one to read its input's value, and nothing else needs it later, that value is
+            // released first, so that this node's value may be given the same matrix
+            ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount);
+            nodeIter->RequestMatricesBeforeForwardProp(m_matrixPool);
+        }
         else
         {
             nodeIter->RequestMatricesBeforeForwardProp(m_matrixPool);
             // we only release matrices for the children since the root node's information will be used and should not be shared
             // with others
-            ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount);
+            // With concurrent streams, nodes of different branches run out of order; so nothing is shared in that case.
+            if (GetNumConcurrentStreams() == 0)
+                ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount);
         }
     }
 
@@ -952,6 +1599,7 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
 
         // now, simulate the gradient computation order to determine how to allocate matrices
         set<ComputationNodeBasePtr> completedGradient;
+        set<ComputationNodeBasePtr> recomputed; // same as in PARTraversalFlowControlNode::Backprop()
 
         // we need to call it here since we always compute gradients for children and root node is not children of other node
         trainRootNode->RequestMatricesBeforeBackprop(m_matrixPool);
@@ -976,14 +1624,23 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
             else
             {
                 // PAR mode: we can allocate and immediately deallocate one by one
+                RecomputeValuesForBackprop(n, FrameRange(), recomputed, &m_matrixPool);
                 n->AllocateGradientMatricesForInputs(m_matrixPool);
                 // Root node's information will be used and should not be shared with others, also it's small (1x1)
                 if ((n != trainRootNode) && n->NeedsGradient())
+                {
+                    // a released value that no backprop has read is released here a second time, so it must be requested first
+                    if (n->IsValueRecomputedForBackprop() && n->IsOutputNeededDuringBackprop() && recomputed.insert(n).second)
+                        n->RequestValueForRecomputation(m_matrixPool);
                     n->ReleaseMatricesAfterBackprop(m_matrixPool);
+                }
             }
         }
     }
 
+    // now that all lifetimes are known, assign the shared matrices
+    m_matrixPool.OptimizedMemoryAllocation();
+
     m_areMatricesAllocated = true;
 
     //print the memory sharing structure
@@ -1009,4 +1666,230 @@ void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBase
             pNode->ReleaseMatricesAfterForwardProp(m_matrixPool);
     }
 }
+
+template <class ElemType>
+static void ReleaseSharedMatrixBuffersOf(const ComputationNodeBasePtr& node)
+{
+    auto typedNode = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+    if (!typedNode)
+        return;
+    // (leaves' values are parameters and inputs, and their gradients hold what the learners read)
+    auto value = dynamic_pointer_cast<Matrix<ElemType>>(typedNode->ValuePtr());
+    if (value && typedNode->IsValueSharable() && value->GetMatrixType() == DENSE)
+        value->Resize(0, 0, 0, /*growOnly=*/false);
+    auto gradient = dynamic_pointer_cast<Matrix<ElemType>>(typedNode->GradientPtr());
+    if (gradient && !node->IsLeaf() && gradient->GetMatrixType() == DENSE)
+        gradient->Resize(0, 0, 0, /*growOnly=*/false);
+}
+
+// free the buffers of the shared value and gradient matrices, e.g. after running out of device memory in a minibatch
+// Their contents are lost; the next forward and backward prop allocate them again for the sizes they need then.
+void ComputationNetwork::ReleaseSharedMatrixBuffers()
+{
+    for (const auto& node : GetAllNodes())
+    {
+        ReleaseSharedMatrixBuffersOf<float>(node);
+        ReleaseSharedMatrixBuffersOf<double>(node);
+    }
+}
+
+ComputationNetwork::MemoryEstimate ComputationNetwork::EstimateMemory(size_t minibatchSize) const
+{
+    if (!AreMatricesAllocated())
+        LogicError("EstimateMemory: The memory plan is only known after AllocateAllMatrices().");
+
+    MemoryEstimate estimate;
+    estimate.minibatchSize = minibatchSize;
+    estimate.deviceId = GetDeviceId();
+
+    // matrices from the pool, as packed by the planner; a shared matrix counts for the category of its largest request
+    for (const auto& plannedMatrix : m_matrixPool.GetPlan())
+    {
+        const auto& largest = plannedMatrix.GetLargestRequest(minibatchSize);
+        estimate.AddBytes(plannedMatrix.deviceId, string("shared (") + largest.category + ")", plannedMatrix.GetBytes(minibatchSize));
+        for (const auto& request : plannedMatrix.requests)
+        {
+            auto& nodeBytes = estimate.nodeBytes[request.nodeName];
+            size_t bytes = request.GetNumElements(minibatchSize) * plannedMatrix.elementSize;
+            (request.category == string("value") ? nodeBytes.value : request.category == string("gradient") ? nodeBytes.gradient : nodeBytes.workspace) += bytes;
+        }
+    }
+
+    // values not from the pool
+    for (const auto& node : GetAllNodes())
+    {
+        if (node->IsValueSharable())
+            continue;
+        size_t elementSize = node->Is<ComputationNode<float>>() ? sizeof(float) : sizeof(double);
+        size_t bytes = node->GetSampleLayout().GetNumElements() * (node->HasMBLayout() ? minibatchSize : 1) * elementSize;
+        const char* category = node->OperationName() == OperationNameOf(LearnableParameter) ? "parameters" : node->IsLeaf() ? "inputs" : "unshared values";
+        estimate.AddBytes(node->GetDeviceId(), category, bytes);
+        estimate.nodeBytes[node->NodeName()].value += bytes;
+    }
+    return estimate;
+}
+
+void ComputationNetwork::PrintMemoryEstimate(const MemoryEstimate& estimate) const
+{
+    static const size_t maxPrintedNodes = 50;
+
+    fprintf(stderr, "\nMemory estimate for minibatches of %d samples:\n", (int) estimate.minibatchSize);
+    auto printCategories = [](const char* where, const std::map<std::string, size_t>& bytes)
+    {
+        if (bytes.empty())
+            return;
+        fprintf(stderr, "  %-30s %10.1f MB\n", where, MemoryEstimate::GetTotal(bytes) / 1048576.0);
+        for (const auto& entry : bytes)
+            fprintf(stderr, "    %-28s %10.1f MB\n", entry.first.c_str(), entry.second / 1048576.0);
+    };
+    printCategories(msra::strfun::strprintf("GPU %d", (int) estimate.deviceId).c_str(), estimate.deviceBytes);
+    printCategories("host", estimate.hostBytes);
+
+    typedef pair<const wstring, MemoryEstimate::NodeBytes> Entry;
+    vector<const Entry*> entries;
+    for (const auto& entry : estimate.nodeBytes)
+        entries.push_back(&entry);
+    sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) { return a->second.GetTotal() > b->second.GetTotal(); });
+
+    fprintf(stderr, "\nMatrices requested per node, before sharing (largest first):\n");
+    fprintf(stderr, "  %-40s %-24s %10s %10s %10s  %s\n", "node", "operation", "value[MB]", "grad[MB]", "temp[MB]", "shape");
+    for (size_t i = 0; i < entries.size() && i < maxPrintedNodes; i++)
+    {
+        const auto& bytes = entries[i]->second;
+        auto iter = m_nameToNodeMap.find(entries[i]->first);
+        fprintf(stderr, "  %-40ls %-24ls %10.2f %10.2f %10.2f  %s\n", entries[i]->first.c_str(),
+                iter != m_nameToNodeMap.end() ? iter->second->OperationName().c_str() : L"",
+                bytes.value / 1048576.0, bytes.gradient / 1048576.0, bytes.workspace / 1048576.0,
+                iter != m_nameToNodeMap.end() ? string(iter->second->ShapeDescription()).c_str() : "");
+    }
+    if (entries.size() > maxPrintedNodes)
+        fprintf(stderr, "  (%d more)\n", (int) (entries.size() - maxPrintedNodes));
+    fprintf(stderr, "\n");
+}
+
+// -----------------------------------------------------------------------
+// step graphs (see StepGraph::Run())
+// -----------------------------------------------------------------------
+
+// after this many steps that could not be captured, StepGraph stops trying
+static const size_t maxStepGraphFailures = 3;
+
+ComputationNetwork::StepGraph::StepGraph(DEVICEID_TYPE deviceId)
+    : m_deviceId(deviceId), m_hasSignature(false), m_captureFailed(false), m_numFailures(0), m_numReplays(0)
+{
+}
+
+ComputationNetwork::StepGraph::~StepGraph()
+{
+}
+
+template <class ElemType>
+static bool AppendValueShape(const ComputationNodeBasePtr& node, vector<size_t>& shapes)
+{
+    auto typedNode = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+    if (!typedNode)
+        return false;
+    const auto& value = typedNode->Value();
+    if (value.GetMatrixType() != MatrixType::DENSE || value.GetDeviceId() < 0)
+        return false;
+    shapes.push_back(value.GetNumRows());
+    shapes.push_back(value.GetNumCols());
+    shapes.push_back((size_t) value.Data()); // the graph reads the input where it was at the capture
+    return true;
+}
+
+// returns false if the inputs cannot be replayed (sparse or not on the GPU)
+bool ComputationNetwork::StepGraph::GetSignature(const vector<ComputationNodeBasePtr>& inputNodes, const vector<double>& scalars, Signature& signature) const
+{
+    map<MBLayoutPtr, MBLayoutPtr> layouts; // inputs that share a layout share its copy
+    for (const auto& node : inputNodes)
+    {
+        if (!AppendValueShape<float>(node, signature.m_shapes) && !AppendValueShape<double>(node, signature.m_shapes))
+            return false;
+        if (!node->HasMBLayout())
+            continue;
+        auto& layout = layouts[node->GetMBLayout()];
+        if (!layout)
+        {
+            layout = make_shared<MBLayout>();
+            layout->CopyFrom(node->GetMBLayout());
+        }
+        signature.m_layouts.push_back(layout);
+    }
+    signature.m_scalars = scalars;
+    return true;
+}
+
+/*static*/ bool ComputationNetwork::StepGraph::IsSameSignature(const Signature& a, const Signature& b)
+{
+    if (a.m_shapes != b.m_shapes || a.m_scalars != b.m_scalars || a.m_layouts.size() != b.m_layouts.size())
+        return false;
+    for (size_t i = 0; i < a.m_layouts.size(); i++)
+    {
+        if (*a.m_layouts[i] != *b.m_layouts[i]) // (a deep comparison)
+            return false;
+    }
+    return true;
+}
+
+bool ComputationNetwork::StepGraph::Run(const vector<ComputationNodeBasePtr>& inputNodes, const vector<double>& scalars, const function<void()>& step)
+{
+    Signature signature;
+    if (m_deviceId < 0 || !GPUGraph::IsSupported() || m_numFailures >= maxStepGraphFailures || !GetSignature(inputNodes, scalars, signature))
+    {
+        step();
+        return false;
+    }
+
+    if (!m_hasSignature || !IsSameSignature(signature, m_signature))
+    {
+        // a new signature runs once normally, which also allocates the buffers the step needs
+        m_graph.reset();
+        m_signature = move(signature);
+        m_hasSignature = true;
+        m_captureFailed = false;
+        step();
+        return false;
+    }
+
+    if (!m_graph && !m_captureFailed)
+    {
+        // the second step with the same signature is captured; nothing of it runs until the graph is replayed
+        m_graph.reset(new GPUGraph(m_deviceId));
+        m_graph->BeginCapture();
+        bool isCaptured;
+        try
+        {
+            step();
+            isCaptured = m_graph->EndCapture();
+        }
+        catch (const exception&) // e.g. a CUDA call that is not allowed while capturing
+        {
+            m_graph->EndCapture();
+            isCaptured = false;
+        }
+
+        if (!isCaptured)
+        {
+            m_graph.reset();
+            m_captureFailed = true;
+            if (++m_numFailures == maxStepGraphFailures)
+                fprintf(stderr, "StepGraph: The training step could not be captured as a GPU graph %d times, giving up.\n", (int) m_numFailures);
+            // The captured step did not run, but marked its nodes as evaluated. Run it for real.
+            ComputationNetwork::BumpEvalTimeStamp(inputNodes);
+            step();
+            return false;
+        }
+    }
+
+    if (!m_graph) // (a failed signature)
+    {
+        step();
+        return false;
+    }
+
+    m_graph->Replay();
+    m_numReplays++;
+    return true;
+}
 } } }
@@ -97,6 +97,7 @@ void ComputationNetwork::ConstructFromRoots(DEVICEID_TYPE deviceId, deque<Comput
 {
     SetDeviceId(deviceId);
     assert(this->GetTotalNumberOfNodes() == 0);
+    assert(m_featureNodes.empty() && m_labelNodes.empty() && m_criterionNodes.empty() && m_evaluationNodes.empty() && m_outputNodes.empty());
 
     // replace if requested
     // This happens for model editing.
@@ -138,6 +139,9 @@ void ComputationNetwork::ConstructFromRoots(DEVICEID_TYPE deviceId, deque<Comput
         }
 
         // add it to the respective node groups based on the tags
+        // Each node gets here only once, and the network started out empty, so unlike AddToNodeGroup(), we need not search
+        // the node group for it (which would be quadratic in the size of groups tagged by array parameters, e.g. 'outputNodes').
+        set<wstring> tags;
         for (auto tag : node->GetTags())
         {
 #if 1       // we keep this for a while (we already verified that our samples no longer use this)
@@ -145,7 +149,12 @@ void ComputationNetwork::ConstructFromRoots(DEVICEID_TYPE deviceId, deque<Comput
             if      (tag == L"criteria") tag = L"criterion";
             else if (tag == L"eval"    ) tag = L"evaluation";
 #endif
-            AddToNodeGroup(tag, node); // tag may be empty, or may have been set by array parameters
+            tags.insert(tag); // tag may be empty, or may have been set by array parameters
+        }
+        for (let& tag : tags)
+        {
+            node->SetTag(tag);
+            GetNodeGroup(tag).push_back(node);
         }
 
         // traverse children: append them to the end of the work list
@@ -254,7 +254,8 @@ void ComputationNodeBase::ValidateUnaryReduce(bool isFinalValidationPass)
 // Currently only called by criterion nodes.
 // This function also infers child LearnableParameters. In case you wonder why this is needed for criterion nodes, there are edge cases, e.g. a
 // learnable parameter being regularized by a criterion node, where the learnable parameter is fed both into that criterion node and other places.
-void ComputationNodeBase::ValidateBinaryReduce(bool isFinalValidationPass)
+// With 'allowClassIndexLabels', Input(0) may also be a scalar class index per column, see HasClassIndexLabels().
+void ComputationNodeBase::ValidateBinaryReduce(bool isFinalValidationPass, bool allowClassIndexLabels)
 {
     ComputationNodeBase::Validate(isFinalValidationPass);
     m_pMBLayout = nullptr; // this node does not hold mini-batch data
@@ -262,7 +263,7 @@ void ComputationNodeBase::ValidateBinaryReduce(bool isFinalValidationPass)
 
     if (isFinalValidationPass)
     {
-        if (!(Input(0)->GetSampleLayout().IsElementwiseCompatibleWith(Input(1)->GetSampleLayout())))
+        if (!(Input(0)->GetSampleLayout().IsElementwiseCompatibleWith(Input(1)->GetSampleLayout())) && !(allowClassIndexLabels && HasClassIndexLabels()))
         {
             string s1 = Input(0)->GetSampleLayout();
             string s2 = Input(1)->GetSampleLayout();
@@ -496,7 +497,7 @@ void ComputationNode<ElemType>::WriteMinibatchWithFormatting(FILE* f, const Fram
                                                              const string& sequencePrologue, const string& sequenceEpilogue,
                                                              const string& elementSeparator, const string& sampleSeparator,
                                                              string valueFormatString,
-                                                             bool outputGradient) const
+                                                             bool outputGradient, vector<pair<size_t, size_t>>* sequenceExtents) const
 {
     // get minibatch matrix -> matData, matRows, matStride
     const Matrix<ElemType>& outputValues = outputGradient ? Gradient() : Value();
@@ -579,6 +580,7 @@ void ComputationNode<ElemType>::WriteMinibatchWithFormatting(FILE* f, const Fram
 
         if (s > 0)
             fprintfOrDie(f, "%s", sequenceSeparator.c_str());
+        size_t sequenceBegin = sequenceExtents ? (size_t) fgetpos(f) : 0;
         fprintfOrDie(f, "%s", seqProl.c_str());
 
         // output it according to our format specification
@@ -710,6 +712,8 @@ void ComputationNode<ElemType>::WriteMinibatchWithFormatting(FILE* f, const Fram
             }
         }
         fprintfOrDie(f, "%s", sequenceEpilogue.c_str());
+        if (sequenceExtents)
+            sequenceExtents->push_back(make_pair(sequenceBegin, (size_t) fgetpos(f)));
     } // end loop over sequences
     fflushOrDie(f);
 }
@@ -742,7 +746,8 @@ WriteFormattingOptions::WriteFormattingOptions(const ConfigRecordType& config) :
             if      (type == L"real")     ; // default
             else if (type == L"category") isCategoryLabel = true;
             else if (type == L"sparse")   isSparse = true;
-            else                         InvalidArgument("write: type must be 'real', 'category', or 'sparse'");
+            else if (type == L"binary")   isBinary = true;
+            else                         InvalidArgument("write: type must be 'real', 'category', 'sparse', or 'binary'");
             labelMappingFile = (wstring)formatConfig(L"labelMappingFile", L"");
         }
         transpose = formatConfig(L"transpose", transpose);
@@ -38,7 +38,9 @@
 #define CNTK_MODEL_VERSION_7 7 // ElemType tag in model file
 #define CNTK_MODEL_VERSION_8 8 // DynamicAxis for inputs
 #define CNTK_MODEL_VERSION_9 9 // Transpose flag in ConvolutionNode to support deconvolution. 
-#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_9
+#define CNTK_MODEL_VERSION_10 10 // memory plan of models optimized for inference
+#define CNTK_MODEL_VERSION_11 11 // host-resident LearnableParameters
+#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_11
 
 extern bool g_shareNodeValueMatrices;
 
@@ -104,6 +106,10 @@ struct /*interface*/ IComputationNode
     virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) = 0;
     virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) = 0; // request matrices that are needed for gradient computation
     virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) = 0;  // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
+    virtual void RequestValueForRecomputation(MatrixPool& matrixPool) = 0;  // request the value again that was released after forward prop, to recompute it for backprop (gradient checkpointing)
+    virtual void ReleaseValueAfterRecomputation(MatrixPool& matrixPool) = 0; // release a recomputed value that was only needed to recompute other values
+    virtual void CompressValueForBackprop() = 0;                             // keep a compressed copy of the value that is released after forward prop (value compression)
+    virtual void DecompressValueForBackprop() = 0;                           // restore that value from its compressed copy for backprop
 
     // --- optional overrides that describe a feature or property of the node
 
@@ -285,7 +291,8 @@ public:
     // -----------------------------------------------------------------------
 
     ComputationNodeBase(DEVICEID_TYPE deviceId, const wstring& name) :
-        m_deviceId(deviceId), m_outputNeededDuringBackprop(true), m_learningRateMultiplier(0),
+        m_deviceId(deviceId), m_outputNeededDuringBackprop(true), m_valueRecomputedForBackprop(false), m_valueCompressedForBackprop(false),
+        m_valueCompressionType(CompactElementType::float16), m_learningRateMultiplier(0),
         m_gradientInitialized(false), m_nodeName(name == L"" ? CreateUniqNodeName() : name)
     {
         // TODO: should m_learningRateMultiplier be set to 0? Or should every node have a way to add its own say on the learning rate for all its inputs?
@@ -305,6 +312,7 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             node->m_deviceId = m_deviceId;
+            node->m_placedOnHost = m_placedOnHost;
             node->m_learningRateMultiplier = m_learningRateMultiplier;
             node->m_nodeName = newName;
 
@@ -587,6 +595,11 @@ public:
     // -----------------------------------------------------------------------
 
     DEVICEID_TYPE GetDeviceId() const { return m_deviceId; }
+    // move the node and the matrices it has so far to another device; see ComputationNetwork::PlaceNodesOnDevices()
+    virtual void MoveToDevice(DEVICEID_TYPE deviceId) = 0;
+    // the node runs on the CPU even if the network runs on a GPU (set by ComputationNetwork::OffloadToHost(), not persisted)
+    void SetPlacedOnHost(bool placedOnHost) { m_placedOnHost = placedOnHost; }
+    bool IsPlacedOnHost() const { return m_placedOnHost; }
 
     // helper to access to element(0,0) without having to type-cast
     virtual double Get00Element() const = 0;
@@ -656,7 +669,12 @@ protected:
     void ValidateInferBinaryInputDims();
     void ValidateInferNaryInputDims(size_t numInputs);    
     void ValidateBinaryZip(bool isFinalValidationPass, bool allowBroadcast);
-    void ValidateBinaryReduce(bool isFinalValidationPass);    
+    void ValidateBinaryReduce(bool isFinalValidationPass, bool allowClassIndexLabels = false);
+    // Input(0) holds one class index per column instead of a one-hot [C x T] label, for criteria that gather the label (see ValidateBinaryReduce())
+    bool HasClassIndexLabels() const
+    {
+        return Input(0)->GetSampleLayout().GetNumElements() == 1 && Input(1)->GetSampleLayout().GetNumElements() > 1;
+    }
     void ValidateNaryZip(bool isFinalValidationPass, bool allowBroadcast, size_t numInputs);
     void InferMBLayoutFromInputsForStandardCase(bool isFinalValidationPass);
     virtual void ValidateInferInputDimsFrom(const TensorShape&) = 0;    // (implemented by ComputationNode<ElemType>)
@@ -739,6 +757,25 @@ public:
     void SetOutputNeededDuringBackprop(bool f) { m_outputNeededDuringBackprop = f; }
     bool IsOutputNeededDuringBackprop() const { return !g_shareNodeValueMatrices || m_outputNeededDuringBackprop; }
 
+    // Can the output value be dropped after forward prop and recomputed from the inputs during backprop (gradient checkpointing)?
+    // Only for nodes whose ForwardProp() has no side effects and no state besides the value, e.g. not Dropout or BatchNormalization.
+    virtual bool CanRecomputeValue() const { return false; }
+
+    // Does this node compute the same function of its inputs as 'other', a node of the same operation (common-subexpression elimination)?
+    // Implemented by nodes that can recompute their value, by comparing the attributes their ForwardProp() depends on.
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const { return false; }
+
+    // Can the value share the matrix of the value of Input(0), if that is released after this node's forward prop (in-place computation)?
+    // Only for element-wise maps of a single input whose BackpropTo() does not read the input value.
+    virtual bool CanComputeInPlace() const { return false; }
+
+    void SetValueRecomputedForBackprop(bool f) { m_valueRecomputedForBackprop = f; }
+    bool IsValueRecomputedForBackprop() const { return m_valueRecomputedForBackprop; }
+
+    // A compressed value is released like a recomputed one, but restored from a lossy compressed copy instead of from its inputs.
+    void SetValueCompressedForBackprop(bool f, CompactElementType type) { m_valueCompressedForBackprop = f; m_valueCompressionType = type; }
+    bool IsValueCompressedForBackprop() const { return m_valueCompressedForBackprop; }
+
     // -----------------------------------------------------------------------
     // helpers for network traversal
     // -----------------------------------------------------------------------
@@ -841,6 +878,7 @@ protected:
 
     // administrative
     DEVICEID_TYPE m_deviceId; // CPU=-1, >=0 GPU
+    bool m_placedOnHost = false; // see SetPlacedOnHost()
     std::wstring m_nodeName;
 
     // inputs
@@ -863,6 +901,9 @@ protected:
     float m_learningRateMultiplier;    // update parameters? Only used for LearnableParameters.    --TODO: Should we make this a member of LearnableParameters actually? And require a type cast? Currently it is read out for all leaves.
     bool m_gradientInitialized;        // indicates whether the gradient matrix has been resized and initialized to 0
     bool m_outputNeededDuringBackprop; // indicates whether the output value of the node is needed during backprop
+    bool m_valueRecomputedForBackprop; // indicates whether the output value is released after forward prop and recomputed during backprop
+    bool m_valueCompressedForBackprop; // indicates whether that recomputation restores a compressed copy of the value
+    CompactElementType m_valueCompressionType;
 };
 typedef ComputationNodeBase::ComputationNodeBasePtr ComputationNodeBasePtr;
 
@@ -1458,13 +1499,46 @@ public:
             RequestMatrixFromPool(m_value, matrixPool);
         else
             CreateMatrixIfNull(m_value);
+
+        // the compressed copy lives from forward prop until the value is restored in backprop
+        if (IsValueCompressedForBackprop())
+            RequestMatrixFromPool(m_compressedValue, matrixPool);
     }
 
     // release temp matrices that are only used by forward computation
     // don't release matrices that need to be used in the gradient computation
     virtual void ReleaseMatricesAfterForwardProp(MatrixPool& matrixPool) override
     {
-        if (!IsOutputNeededDuringBackprop() && (m_value->GetMatrixType() != SPARSE) && IsValueSharable())
+        if ((!IsOutputNeededDuringBackprop() || IsValueRecomputedForBackprop()) && (m_value->GetMatrixType() != SPARSE) && IsValueSharable())
+            ReleaseMatrixToPool(m_value, matrixPool);
+    }
+
+    // gradient checkpointing: the value that was released after forward prop is needed again to recompute it
+    virtual void RequestValueForRecomputation(MatrixPool& matrixPool) override
+    {
+        if (m_value->GetMatrixType() != SPARSE && IsValueSharable())
+            matrixPool.Reacquire<ElemType>(m_value);
+        if (IsValueCompressedForBackprop())
+            ReleaseMatrixToPool(m_compressedValue, matrixPool);
+    }
+
+    // value compression (see ComputationNetwork::SetValueCompression())
+    virtual void CompressValueForBackprop() override
+    {
+        if (Value().GetMatrixType() != DENSE)
+            LogicError("%ls %ls operation: Only dense values can be compressed for backprop.", NodeName().c_str(), OperationName().c_str());
+        m_compressedValueNumRows = Value().GetNumRows();
+        m_compressedValue->AssignCompressedOf(Value(), m_valueCompressionType);
+    }
+
+    virtual void DecompressValueForBackprop() override
+    {
+        Value().AssignDecompressedOf(*m_compressedValue, m_compressedValueNumRows, m_valueCompressionType);
+    }
+
+    virtual void ReleaseValueAfterRecomputation(MatrixPool& matrixPool) override
+    {
+        if (m_value->GetMatrixType() != SPARSE && IsValueSharable())
             ReleaseMatrixToPool(m_value, matrixPool);
     }
 
@@ -1508,6 +1582,15 @@ public:
         CreateMatrixIfNull(m_gradient);
     }
 
+    virtual void /*ComputationNodeBase::*/ MoveToDevice(DEVICEID_TYPE deviceId) override
+    {
+        m_deviceId = deviceId;
+        if (m_value)
+            m_value->TransferToDeviceIfNotThere(deviceId, /*isBeingMoved=*/true);
+        if (m_gradient)
+            m_gradient->TransferToDeviceIfNotThere(deviceId, /*isBeingMoved=*/true);
+    }
+
     void MarkValueNonSharable() override
     {
         m_valueSharable = false;
@@ -1527,16 +1610,27 @@ protected:
 
     void RequestMatrixFromPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool)
     {
+        // the size of the node's output is the estimate for all its matrices, including temporaries
         if (matrixPtr == nullptr)
         {
-            matrixPtr = matrixPool.Request<ElemType>(m_deviceId);
+            matrixPool.Request<ElemType>(m_deviceId, matrixPtr, GetPoolRequestOwner(matrixPtr));
         }
     }
 
     void ReleaseMatrixToPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool)
     {
         assert(matrixPtr != nullptr);
-        matrixPool.Release<ElemType>(matrixPtr);
+        matrixPool.Release<ElemType>(matrixPtr, GetPoolRequestOwner(matrixPtr));
+    }
+
+private:
+    MatrixPool::RequestOwner GetPoolRequestOwner(const shared_ptr<Matrix<ElemType>>& matrixPtr) const
+    {
+        const char* category = &matrixPtr == &m_value ? "value" : &matrixPtr == &m_gradient ? "gradient" : "workspace";
+        size_t sampleSize = GetSampleLayout().GetNumElements();
+        if (&matrixPtr == &m_compressedValue)
+            sampleSize = GetCompressedNumRows<ElemType>(sampleSize, m_valueCompressionType);
+        return MatrixPool::RequestOwner{ NodeName(), category, sampleSize, HasMBLayout() };
     }
 
 public:
@@ -1547,11 +1641,12 @@ public:
     virtual void DumpNodeInfo(const bool /*printValues*/, const bool /*printMetadata*/, File& fstream) const;
 
     // helper for SimpleOutWriter, living in here to be able to use in debugging
+    // If given, sequenceExtents receives the file positions of the begin (after the separator) and end of each sequence written.
     void WriteMinibatchWithFormatting(FILE* f, const FrameRange& fr, size_t onlyUpToRow, size_t onlyUpToT, bool transpose, bool isCategoryLabel, bool isSparse,
                                       const std::vector<std::string>& labelMapping, const std::string& sequenceSeparator, 
                                       const std::string& sequencePrologue, const std::string& sequenceEpilogue, const std::string& elementSeparator,
                                       const std::string& sampleSeparator, std::string valueFormatString,
-                                      bool outputGradient = false) const;
+                                      bool outputGradient = false, std::vector<std::pair<size_t, size_t>>* sequenceExtents = nullptr) const;
 
     // simple helper to log the content of a minibatch
     void DebugLogMinibatch(bool outputGradient = false) const
@@ -1720,6 +1815,8 @@ public:
 protected:
 
     shared_ptr<Matrix<ElemType>> m_value, m_gradient;
+    shared_ptr<Matrix<ElemType>> m_compressedValue; // value compressed for backprop, see CompressValueForBackprop()
+    size_t m_compressedValueNumRows = 0;
 
     static std::map<size_t, std::map<size_t, shared_ptr<Matrix<ElemType>>>> s_constOnes;
 };
@@ -1739,6 +1836,7 @@ struct WriteFormattingOptions
     bool isCategoryLabel = false;  // true: find max value in column and output the index instead of the entire vector
     std::wstring labelMappingFile; // optional dictionary for pretty-printing category labels
     bool isSparse = false;
+    bool isBinary = false;         // true: write the raw values with an index of the sequences (see BinaryOutputFile); only for the 'write' action, not saved with Trace nodes
     bool transpose = true;         // true: one line per sample, each sample (column vector) forms one line; false: one column per sample
     // The following strings are interspersed with the data:
     // overall
@@ -1832,6 +1930,7 @@ public:
     virtual ComputationNodeBasePtr Duplicate(const std::wstring& newName, const CopyNodeFlags flags) const override { NOT_IMPLEMENTED; }
     virtual double Get00Element() const override { NOT_IMPLEMENTED; }
     virtual MatrixBasePtr ValuePtr() const override { NOT_IMPLEMENTED; }
+    virtual void MoveToDevice(DEVICEID_TYPE deviceId) override { NOT_IMPLEMENTED; }
     virtual void UpdateFunctionMBSize() override { NOT_IMPLEMENTED; }
     virtual void AttachInputs(const std::vector<ComputationNodeBasePtr>& inputs) override { NOT_IMPLEMENTED; }
     virtual void PrintSelf(bool) const override { NOT_IMPLEMENTED; }
@@ -1842,6 +1941,10 @@ public:
     virtual void InvalidateMissingValueColumns(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
     virtual void InvalidateMissingGradientColumns(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
     virtual void NotifyFunctionValuesMBSizeModified(void) override { NOT_IMPLEMENTED; }
+    virtual void RequestValueForRecomputation(MatrixPool&) override { NOT_IMPLEMENTED; }
+    virtual void ReleaseValueAfterRecomputation(MatrixPool&) override { NOT_IMPLEMENTED; }
+    virtual void CompressValueForBackprop() override { NOT_IMPLEMENTED; }
+    virtual void DecompressValueForBackprop() override { NOT_IMPLEMENTED; }
     virtual std::wstring ToString(void) const override { NOT_IMPLEMENTED; }
     // these are meant to be called during computation, so provide dummy implementations
     virtual bool RequiresPreCompute() const override { return false; } // return true if the node's value should be computed before the normal training. e.g., mean and invStd of input features.
@@ -1891,11 +1994,20 @@ public:
 
 struct IRecurrentNode { virtual int GetRecurrenceSteppingDirection() const = 0; };
 
+// =======================================================================
+// IDeviceTransferNode -- interface implemented by ComputationNodes that move their input to another device
+// =======================================================================
+
+struct IDeviceTransferNode { virtual DEVICEID_TYPE GetTargetDeviceId() const = 0; };
+
 // =======================================================================
 // PreComputedNodeBase -- interface implemented by ComputationNodes that precompute
 // TODO: We can use this interface in more places.
 // =======================================================================
 
+class MPIWrapper;
+typedef std::shared_ptr<MPIWrapper> MPIWrapperPtr;
+
 struct IPreComputeNode
 {
     // check whether node has already undergone precomputation
@@ -1903,6 +2015,8 @@ struct IPreComputeNode
     // call this with 'false' at start and with 'true' at end
     // This is used for resetting and updating from accumulators.
     virtual void MarkComputed(const bool hasComputed) = 0;
+    // when the workers have accumulated over disjoint shares of the data: combine their accumulators (call before MarkComputed(true))
+    virtual void AggregateAcrossWorkers(const MPIWrapperPtr& mpi) = 0;
 };
 
 // =======================================================================
@@ -1992,6 +2106,7 @@ protected:
     using Base::UpdateFunctionValuesSize;                                                                                                                \
     using Base::Validate;                                                                                                                                \
     using Base::ValidateBinaryReduce;                                                                                                                    \
+    using Base::HasClassIndexLabels;                                                                                                                     \
     using Base::ValidateBinaryZip;                                                                                                                       \
     using Base::ValidateNaryZip;                                                                                                                         \
     using Base::ValidateInferBinaryInputDims;                                                                                                            \
@@ -2097,6 +2212,8 @@ public:
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
 #endif
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool CanRecomputeValue() const override { return true; }
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const override { return true; }
 
     virtual void /*IComputationNode::*/ BeginForwardProp() override // called before first iteration step of ForwardProp()
     {
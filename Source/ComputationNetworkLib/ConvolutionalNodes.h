@@ -222,6 +222,9 @@ public:
 public:
     void Save(File& fstream) const override
     {
+        // the folded bias is not part of the model format, and the kernel has been modified
+        if (m_foldedBias)
+            LogicError("%ls %ls operation: cannot save a network with folded batch normalization.", NodeName().c_str(), OperationName().c_str());
         Base::Save(fstream);
         fstream << m_convolution2D;
     }
@@ -278,7 +281,12 @@ public:
         const Matrix<ElemType>& input0 = Input(0)->ValueAsMatrix();
         Matrix<ElemType> sliceInput1Value = Input(1)->ValueFor(fr);
         if (!m_transpose)
-            m_convEng->Forward(sliceInput1Value, input0, sliceOutputValue, *m_tempMatrix);
+        {
+            if (!m_int8Kernel || !ForwardPropInt8(sliceInput1Value, input0, sliceOutputValue))
+                m_convEng->Forward(sliceInput1Value, input0, sliceOutputValue, *m_tempMatrix);
+            if (m_foldedBias)
+                Matrix<ElemType>::ScaleAndAdd(1, *m_foldedBias, sliceOutputValue);
+        }
         else
         {
             // BackwardData adds results to the output so need to zero them out first.
@@ -375,9 +383,9 @@ public:
         {
             if (m_convEng == nullptr)
             {
-                auto geometry = std::make_shared<ConvolveGeometry>(!m_transpose ? inputShape : outputShape,
-                                                                   m_kernelShape, m_mapCount, m_stride, 
-                                                                   m_sharing, m_autoPad, m_lowerPad, m_upperPad);
+                auto geometry = ConvolveGeometry::Get(!m_transpose ? inputShape : outputShape,
+                                                      m_kernelShape, m_mapCount, m_stride, 
+                                                      m_sharing, m_autoPad, m_lowerPad, m_upperPad);
                 m_convEng = ConvolutionEngine<ElemType>::Create(geometry, m_deviceId, m_imageLayout,
                                                                 m_maxTempMemSizeInSamples, m_poolKind,
                                                                 ConvolutionEngineKind::All, NodeName());
@@ -404,6 +412,9 @@ public:
         ReleaseMatrixToPool(m_tempMatrix, matrixPool);
     }
 
+    // m_tempMatrix is kept until backprop, so recomputing the value can use it
+    bool CanRecomputeValue() const override { return true; }
+
     void SetmMaxTempMemSizeInSamples(const size_t maxTempMemSizeInSamples)
     {
         m_maxTempMemSizeInSamples = maxTempMemSizeInSamples;
@@ -411,9 +422,54 @@ public:
             m_convEng->SetmMaxTempMemSizeInSamples(maxTempMemSizeInSamples);
     }
 
+    // Inference only: compute the convolution with int8 weights on the CPU (see Int8QuantizedMatrix).
+    // The weights are quantized on first use and must not change afterwards.
+    void EnableInt8Inference(size_t calibrationMinibatches)
+    {
+        m_int8Kernel = make_shared<Int8QuantizedMatrix<ElemType>>(calibrationMinibatches);
+    }
+
+    // Inference only: folds y = mapScale[c] * conv(x)[c] + rowBias for every output channel c into the kernel and a bias that is
+    // added to the output (see ComputationNetwork::FoldBatchNormalization()); rowBias is a column vector over the output sample.
+    // Without rowBias only the kernel is scaled, and the caller adds the bias.
+    // Returns false for deconvolutions and layouts other than CHW.
+    bool FoldOutputScaleAndBias(const Matrix<ElemType>& mapScale, const Matrix<ElemType>* rowBias)
+    {
+        auto& kernel = Input(0)->Value();
+        size_t kernelCount = m_convEng->Geometry()->KernelCount();
+        if (m_transpose || m_foldedBias || m_imageLayout != ImageLayoutKind::CHW || mapScale.GetNumRows() != kernelCount)
+            return false;
+        // The engines use a row-major [kernelCount x kernel size] weight matrix (cudnn layout), i.e. the weights of each kernel are contiguous.
+        auto kernelView = kernel.Reshaped(kernel.GetNumElements() / kernelCount, kernelCount);
+        kernelView.RowElementMultiplyWith(mapScale.Reshaped(1, kernelCount));
+        if (rowBias)
+            m_foldedBias = make_shared<Matrix<ElemType>>(rowBias->DeepClone(), m_deviceId);
+        return true;
+    }
+
+private:
+    // returns false if the convolution has to be computed in full precision, e.g. if the engine does not support int8 or while calibrating
+    bool ForwardPropInt8(const Matrix<ElemType>& in, const Matrix<ElemType>& kernel, Matrix<ElemType>& out)
+    {
+        if (in.GetDeviceId() >= 0 || in.GetMatrixType() != DENSE || !m_convEng->SupportsInt8Forward())
+            return false;
+        if (m_int8Kernel->IsCalibrating())
+        {
+            m_int8Kernel->Calibrate(in);
+            return false;
+        }
+        // The engines use a row-major [kernelCount x kernel size] weight matrix (cudnn layout).
+        if (!m_int8Kernel->IsQuantized())
+            m_int8Kernel->Quantize(kernel, kernel.GetNumRows(), kernel.GetNumCols(), /*transpose=*/true);
+        m_convEng->ForwardInt8(in, *m_int8Kernel, out, *m_tempMatrix);
+        return true;
+    }
+
 protected:
     // Flag that indicates whether the node is created using 2D-syntax.
     bool m_convolution2D;
+    shared_ptr<Int8QuantizedMatrix<ElemType>> m_int8Kernel; // set if int8 inference is enabled
+    shared_ptr<Matrix<ElemType>> m_foldedBias;              // set if a batch normalization has been folded into this node
 };
 
 // -----------------------------------------------------------------------
@@ -475,6 +531,8 @@ public:
         return m_poolKind == PoolKind::Max;
     }
 
+    bool CanRecomputeValue() const override { return true; }
+
     void Validate(bool isFinalValidationPass) override
     {
         auto inputShape = GetInputSampleLayout(0);
@@ -483,8 +541,8 @@ public:
         {
             if (m_convEng == nullptr)
             {
-                auto geometry = std::make_shared<ConvolveGeometry>(inputShape, m_kernelShape, m_mapCount, m_stride,
-                                                                   m_sharing, m_autoPad, m_lowerPad, m_upperPad);
+                auto geometry = ConvolveGeometry::Get(inputShape, m_kernelShape, m_mapCount, m_stride,
+                                                      m_sharing, m_autoPad, m_lowerPad, m_upperPad);
                 m_convEng = ConvolutionEngine<ElemType>::Create(geometry, m_deviceId, m_imageLayout,
                                                                 m_maxTempMemSizeInSamples, m_poolKind,
                                                                 ConvolutionEngineKind::All, NodeName());
@@ -598,8 +656,8 @@ public:
         {
             if (m_convEng == nullptr)
             {
-                auto geometry = std::make_shared<ConvolveGeometry>(outputShape, m_kernelShape, m_mapCount, m_stride,
-                                                                   m_sharing, m_autoPad, m_lowerPad, m_upperPad);
+                auto geometry = ConvolveGeometry::Get(outputShape, m_kernelShape, m_mapCount, m_stride,
+                                                      m_sharing, m_autoPad, m_lowerPad, m_upperPad);
                 // Create reference engine as it's the only engine that implements unpooling.
                 m_convEng = ConvolutionEngine<ElemType>::Create(geometry, m_deviceId, m_imageLayout,
                                                                 m_maxTempMemSizeInSamples, m_poolKind,
@@ -726,14 +784,14 @@ public:
         if (isFinalValidationPass)
         {
             // set up various engines and descriptor objects
-            m_geometry = std::make_shared<ConvolveGeometry>(inDims.AsTensorShape(m_imageLayoutKind),
-                                                            ImageDimensions(m_windowWidth, m_windowHeight, 1).AsTensorShape(m_imageLayoutKind),
-                                                            TensorShape(1),
-                                                            ImageDimensions(m_horizontalSubsample, m_verticalSubsample, 1).AsTensorShape(m_imageLayoutKind),
-                                                            ConvolveGeometry::BoolVec{true},
-                                                            ConvolveGeometry::BoolVec{false},
-                                                            TensorShape(0),
-                                                            TensorShape(0));
+            m_geometry = ConvolveGeometry::Get(inDims.AsTensorShape(m_imageLayoutKind),
+                                               ImageDimensions(m_windowWidth, m_windowHeight, 1).AsTensorShape(m_imageLayoutKind),
+                                               TensorShape(1),
+                                               ImageDimensions(m_horizontalSubsample, m_verticalSubsample, 1).AsTensorShape(m_imageLayoutKind),
+                                               ConvolveGeometry::BoolVec{true},
+                                               ConvolveGeometry::BoolVec{false},
+                                               TensorShape(0),
+                                               TensorShape(0));
         }
     }
 
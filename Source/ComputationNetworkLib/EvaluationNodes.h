@@ -21,6 +21,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // ErrorPredictionNode (label, prediction)   or ErrorPredictionNode (prediction, label)
 // Performs classification and error counting.
 // Result is an error rate, lower = better.
+// The label may also be a [1 x T] input of class indices (label first), as with CrossEntropyWithSoftmaxNode.
+// The errors are counted by Matrix::AssignNumOfTopKErrors() in a single pass over both inputs, and the count stays on the device.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -56,12 +58,17 @@ public:
 
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
-        FrameRange fr(Input(0)->GetMBLayout());
-        Input(0)->ValueFor(fr).VectorMax(*m_maxIndexes0, *m_maxValues, true);
-        Input(1)->ValueFor(fr).VectorMax(*m_maxIndexes1, *m_maxValues, true, m_topK);
-        MaskMissingColumnsToZero(*m_maxIndexes0, Input(0)->GetMBLayout(), fr);
-        MaskMissingColumnsToZero(*m_maxIndexes1, Input(1)->GetMBLayout(), fr);
-        Value().AssignNumOfDiff(*m_maxIndexes0, *m_maxIndexes1, m_topK > 1);
+        let& pMBLayout = Input(0)->GetMBLayout();
+        FrameRange fr(pMBLayout);
+        // gaps are not counted
+        shared_ptr<Matrix<char>> columnsMask;
+        if (pMBLayout && pMBLayout->HasGaps(fr))
+        {
+            const auto& maskMatrix = pMBLayout->GetColumnsValidityMask(Input(1)->Value().GetDeviceId());
+            maskMatrix.TransferToDeviceIfNotThere(Input(1)->Value().GetDeviceId(), /*ismoved=*/ false, /*emptyTransfer=*/ false, /*updatePreferredDevice=*/ false);
+            columnsMask = make_shared<Matrix<char>>(DataWithMBLayoutFor(maskMatrix, fr, pMBLayout));
+        }
+        Value().AssignNumOfTopKErrors(Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), m_topK, HasClassIndexLabels(), columnsMask.get());
 #if NANCHECK
         Value().HasNan("ErrorPrediction");
 #endif
@@ -72,7 +79,7 @@ public:
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
-        ValidateBinaryReduce(isFinalValidationPass);
+        ValidateBinaryReduce(isFinalValidationPass, /*allowClassIndexLabels=*/true);
 
         m_topK = 1;
         // TODO: Make topK a constructor parameter
@@ -84,66 +91,24 @@ public:
         }
     }
 
-    virtual void UpdateFunctionMBSize() override
-    {
-        Base::UpdateFunctionMBSize();
-
-        // resize the temporaries to their proper size
-        size_t cols = Input(0)->Value().GetNumCols();
-        m_maxIndexes0->Resize(m_topK, cols);
-        m_maxIndexes1->Resize(m_topK, cols);
-        m_maxValues->Resize(m_topK, cols);
-    }
-
-    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
-    {
-        Base::CopyTo(nodeP, newName, flags);
-        if (flags & CopyNodeFlags::copyNodeValue)
-        {
-            auto node = dynamic_pointer_cast<ErrorPredictionNode<ElemType>>(nodeP);
-            node->m_maxIndexes0->SetValue(*m_maxIndexes0);
-            node->m_maxIndexes1->SetValue(*m_maxIndexes1);
-            node->m_maxValues->SetValue(*m_maxValues);
-        }
-    }
-    // request matrices needed to do node function value evaluation
-    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool)
-    {
-        Base::RequestMatricesBeforeForwardProp(matrixPool);
-        RequestMatrixFromPool(m_maxIndexes0, matrixPool);
-        RequestMatrixFromPool(m_maxIndexes1, matrixPool);
-        RequestMatrixFromPool(m_maxValues, matrixPool);
-    }
-
-    // release temp matrices that are only used by forward computation
-    // don't release matrices that need to be used in the gradient computation
-    virtual void ReleaseMatricesAfterForwardProp(MatrixPool& matrixPool)
-    {
-        Base::ReleaseMatricesAfterForwardProp(matrixPool);
-        ReleaseMatrixToPool(m_maxIndexes0, matrixPool);
-        ReleaseMatrixToPool(m_maxIndexes1, matrixPool);
-        ReleaseMatrixToPool(m_maxValues, matrixPool);
-    }
-
 private:
-    shared_ptr<Matrix<ElemType>> m_maxIndexes0, m_maxIndexes1;
-    shared_ptr<Matrix<ElemType>> m_maxValues;
     int m_topK;
 };
 
 template class ErrorPredictionNode<float>;
 template class ErrorPredictionNode<double>;
 
-#ifdef COMING_SOON
-
 // -----------------------------------------------------------------------
 // SequenceDecoderNode (label, position_dependent_score, transition_score)
-// Decoder that matches CRF training.
-//  - label : output label vector of [0:T-1]
+// Viterbi decoder that matches CRF training.
+//  - label : pseudo label sequences; the labels of the first and last frame of each sequence constrain the search space
+//    to paths that begin and end with them, the other labels are not used
 //  - position_dependent_score : score from position dependent node,
 //    in the R-CRF case, it is the RNN output score before softmax
 //  - transition score : score from the transition node,
 //    in the R-CRF case, it is the transition probability between labels
+// The output is the one-hot best label path of each sequence, in the layout of position_dependent_score.
+// All sequences of the minibatch are decoded in one go by Matrix::CRFViterbiDecode(); gaps are zero.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -156,54 +121,16 @@ class SequenceDecoderNode : public ComputationNodeNonLooping /*ComputationNode*/
         return L"SequenceDecoderNode";
     }
 
-private:
-    // TODO: member variables go to the end
-    Matrix<ElemType> mAlpha;
-    Matrix<ElemType> mBacktrace;
-
-    int mStartLab; // the starting output label
-    int mEndLab;   // the ending output label, if avaliable
-    ElemType m_default_activity;
-
 public:
     DeclareConstructorFromConfigWithNumInputs(SequenceDecoderNode);
     SequenceDecoderNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
           mAlpha(deviceId),
-          mBacktrace(deviceId),
-          mStartLab(-1),
-          mEndLab(-1)
+          mBacktrace(deviceId)
     {
     }
 
-    static void DecideStartEndingOutputLab(const Matrix<ElemType>& lbls, int& stt, int& stp)
-    {
-        if (stt != -1 && stp != -1)
-            return; // have computed before
-
-        int iNumPos = lbls.GetNumCols();
-
-        int firstLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, 0) != 0)
-            {
-                firstLbl = ik;
-                break;
-            }
-
-        int lastLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, iNumPos - 1) != 0)
-            {
-                lastLbl = ik;
-                break;
-            }
-
-        stt = firstLbl;
-        stp = lastLbl;
-    };
-
-    virtual void BackpropToNonLooping(size_t /*inputIndex*/) override // scaled by 2*number of elements in the Matrix<ElemType>
+    virtual void BackpropToNonLooping(size_t /*inputIndex*/) override
     {
         LogicError("SequenceDecoder is used for evaluation only.");
     }
@@ -217,125 +144,49 @@ public:
         return false;
     }
 
-    // compute posterior probability of label y at position t
+    // best label path of each sequence
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
-        DecideStartEndingOutputLab(Input(0)->Value(), mStartLab, mEndLab);
-        ForwardPropS(mAlpha, mBacktrace, Value(), Input(1)->Value(),
-                     Input(2)->Value(), mStartLab, mEndLab);
+        // the start and end labels are taken from every minibatch anew, since each may hold different sequences
+        let& pMBLayout = Input(1)->GetMBLayout();
+        Matrix<ElemType>::CRFViterbiDecode(Input(0)->Value(), Input(1)->Value(), Input(2)->ValueAsMatrix(),
+                                           pMBLayout->GetNumParallelSequences(), pMBLayout->GetClippedSequences(),
+                                           mAlpha, mBacktrace, Value());
     }
 
-    // compute forward backward algorithm
-    void ForwardPropS(Matrix<ElemType>& alpha, Matrix<ElemType>& backtrace, Matrix<ElemType>& functionValues, const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores, const size_t stt, const size_t stp)
-    {
-        // to-do, each slice is for one sentence
-        // to-do, number of slices correspond to number of frames
-        // this implementation only supports one sentence per minibatch
-
-        // change to other values so can support multiple sentences in each minibatch
-        ForwardCompute(alpha, backtrace, pos_scores, pair_scores, stt);
-        BackwardCompute(functionValues, backtrace, stp);
-    };
-
-    // compute forward backward algorithm
-    static void ForwardCompute(Matrix<ElemType>& alpha,
-                               Matrix<ElemType>& backtrace,
-                               const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores,
-                               const size_t stt)
-    {
-        // to-do, shift more than 1 to support muliple sentences per minibatch
-        int iNumPos = pos_scores.GetNumCols();
-        int iNumLab = pos_scores.GetNumRows();
-        size_t iTmp = 0;
-
-        // need to have
-        alpha.Resize(iNumLab, iNumPos);
-        backtrace.Resize(iNumLab, iNumPos);
-
-        for (int t = 0; t < iNumPos; t++)
-        {
-            for (int k = 0; k < iNumLab; k++)
-            {
-                ElemType fTmp = (ElemType) LZERO;
-                if (t > 1)
-                {
-                    for (int j = 0; j < iNumLab; j++)
-                    {
-                        ElemType fAlpha = alpha(j, t - 1) + pair_scores(k, j);
-                        if (fAlpha > fTmp)
-                        {
-                            fTmp = fAlpha;
-                            iTmp = j;
-                        }
-                    }
-                    fTmp += pos_scores(k, t); // include position dependent score
-                }
-                else
-                {
-                    // with constrain that the first word is labeled as a given symbol
-                    iTmp = stt;
-                    fTmp = 0;
-                    if (t == 1)
-                    {
-                        fTmp = alpha(iTmp, t - 1);
-                        fTmp += pair_scores(k, iTmp);
-                        fTmp += pos_scores(k, t);
-                    }
-                    else
-                    {
-                        fTmp = (k == stt) ? pos_scores(k, t) : (ElemType) LZERO;
-                    }
-                }
-                alpha(k, t) = fTmp;
-                backtrace(k, t) = (ElemType) iTmp;
-            }
-        }
-    };
-
-    // compute backward algorithm
-    static void BackwardCompute(
-        Matrix<ElemType>& decodedpath,
-        const Matrix<ElemType>& backtrace, const size_t stp)
-    {
-        int iNumPos = backtrace.GetNumCols();
-        int iNumLab = backtrace.GetNumRows();
-
-        decodedpath.Resize(iNumLab, iNumPos);
-        decodedpath.SetValue(0);
-
-        size_t lastlbl = stp;
-        decodedpath(lastlbl, iNumPos - 1) = 1;
-
-        for (int t = iNumPos - 1; t > 0; t--)
-        {
-            lastlbl = (size_t) backtrace(lastlbl, t);
-            decodedpath(lastlbl, t - 1) = 1;
-        }
-    };
-
-    // need to feed in pseudo label data, which tells the decoder what is the beginning
-    // and ending output symbol. these symbols will constrain the search space
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
         InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
 
         if (isFinalValidationPass)
-            if (!(Input(1)->GetSampleMatrixNumRows() == Input(2)->GetSampleMatrixNumRows() && // position dependent and pair scores have same number of labels
+            if (!(Input(1)->GetSampleMatrixNumRows() == Input(2)->GetAsMatrixNumRows() && // position dependent and pair scores have same number of labels
                   Input(0)->GetSampleMatrixNumRows() == Input(1)->GetSampleMatrixNumRows() &&
-                  Input(0)->GetSampleMatrixNumCols() == Input(1)->GetSampleMatrixNumCols() && // position dependent and pair scores have the same observation numbers
-                  Input(2)->GetSampleMatrixNumCols() == Input(2)->GetSampleMatrixNumRows()))
+                  Input(0)->HasMBLayout() && Input(0)->GetMBLayout() == Input(1)->GetMBLayout() &&
+                  Input(2)->GetAsMatrixNumCols() == Input(2)->GetAsMatrixNumRows()))
             {
                 LogicError("The Matrix<ElemType>  dimension in the SequenceDecoderNode operation does not match.");
             }
-        // BUGBUG: No SetDims()?
-        m_sampleLayout = TensorShape();
+        SetDims(Input(1)->GetSampleLayout(), HasMBLayout());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<SequenceDecoderNode<ElemType>>(nodeP);
+            node->mAlpha.SetValue(mAlpha);
+            node->mBacktrace.SetValue(mBacktrace);
+        }
     }
+
+private:
+    Matrix<ElemType> mAlpha;     // best path scores
+    Matrix<ElemType> mBacktrace; // best previous label of each label and frame
 };
 
 template class SequenceDecoderNode<float>;
 template class SequenceDecoderNode<double>;
 
-#endif
-
 } } }
@@ -29,12 +29,21 @@ void LearnableParameter<ElemType>::InitShape(const TensorShape& shape)
 }
 
 // constructor from config
+// a parameter with onHost=true is created in host memory right away, since it may not fit onto the network's device
+static DEVICEID_TYPE ParameterDeviceIdFromConfig(const ScriptableObjects::IConfigRecordPtr& configp)
+{
+    if (configp->Exists(L"onHost") && (bool) configp->Get(L"onHost"))
+        return CPUDEVICE;
+    return (DEVICEID_TYPE) (int) configp->Get(L"deviceId");
+}
+
 template <class ElemType>
 LearnableParameter<ElemType>::LearnableParameter(const ScriptableObjects::IConfigRecordPtr configp) :
-    LearnableParameter(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"shape"))
+    LearnableParameter(ParameterDeviceIdFromConfig(configp), L"<placeholder>", configp->Get(L"shape"))
 {
     // TODO: Change dimensions to take a generic tensor instead. That will be a (minor) breaking change that will require fix-ups when converting from NDL to BrainScript.
     AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    m_onHost = configp->Exists(L"onHost") && (bool) configp->Get(L"onHost");
     // parameters[rows, [cols=1]] plus other optional parameters (learningRateMultiplier=[1|0|float], init=[uniform|gaussian|fixedvalue], initValueScale=[1|float], value=[0|float])
     if (configp->Exists(L"learningRateMultiplier"))
         SetLearningRateMultiplier(configp->Get(L"learningRateMultiplier"));
@@ -49,7 +58,8 @@ LearnableParameter<ElemType>::LearnableParameter(const ScriptableObjects::IConfi
         // TODO: add these options also to old NDL
         static unsigned long randomSeed = 1;
         int forcedRandomSeed = configp->Get(L"randomSeed"); // forcing a specific random seed is useful for testing to get repeatable initialization independent of evaluation order
-        InitRandom((initString == L"uniform"), forcedRandomSeed < 0 ? randomSeed++ : (unsigned long) forcedRandomSeed, configp->Get(L"initValueScale"), configp->Get(L"initOnCPUOnly"));
+        InitRandom((initString == L"uniform"), forcedRandomSeed < 0 ? randomSeed++ : (unsigned long) forcedRandomSeed, configp->Get(L"initValueScale"), configp->Get(L"initOnCPUOnly"),
+                   configp->Get(L"parallelInit"));
     }
     else if (initString == L"fromFile")
     {
@@ -73,15 +83,21 @@ LearnableParameter<ElemType>::LearnableParameter(const ScriptableObjects::IConfi
 
 // initialize with random numbers
 // if 'initOnCPUOnly' then always init on CPU, making initialization consistent across both (for testing)
+// if 'parallelInit' then the values are generated in place on the target device by the counter-based generator (PhiloxRNG.h),
+// multi-threaded on the CPU. This is much faster for large parameters, and consistent across devices as well,
+// but gives different values than the serial generator, which is therefore kept as the default for existing setups.
 template <class ElemType>
 void LearnableParameter<ElemType>::InitRandom(const bool uniformInit,
                                                 const unsigned long randomSeed,
                                                 const ElemType initValueScale,
-                                                bool initOnCPUOnly)
+                                                bool initOnCPUOnly,
+                                                bool parallelInit)
 {
     // fprintf(stderr, "%d x %d: %d  %ls\n", (int)GetNumRows(), (int)GetNumCols(), (int)randomSeed, NodeName().c_str());
 
     // the random seed offset is set via the "randomSeedOffset" parameter in config
+    if (parallelInit)
+        initOnCPUOnly = false; // not needed for consistency
     if (initOnCPUOnly)
         Value().TransferToDeviceIfNotThere(CPUDEVICE, true);
 #if 1   // this more complex version is needed to repro test cases generated with an older version
@@ -93,13 +109,19 @@ void LearnableParameter<ElemType>::InitRandom(const bool uniformInit,
     {
         // TODO: move these hidden extra factors out from here and into NDL, and make them visible in BS
         ElemType randRange = 0.05f * initValueScale;
-        value.SetUniformRandomValue(-randRange, randRange, randomSeed);
+        if (parallelInit)
+            value.SetCounterBasedUniformRandomValue(-randRange, randRange, randomSeed);
+        else
+            value.SetUniformRandomValue(-randRange, randRange, randomSeed);
     }
     else
     {
         size_t inputSize = value.GetNumCols();
         ElemType randInitstd = 0.2f * initValueScale / sqrt(ElemType(inputSize));
-        value.SetGaussianRandomValue(0, randInitstd, randomSeed);
+        if (parallelInit)
+            value.SetCounterBasedGaussianRandomValue(0, randInitstd, randomSeed);
+        else
+            value.SetGaussianRandomValue(0, randInitstd, randomSeed);
     }
     if (initOnCPUOnly)
         Value().TransferToDeviceIfNotThere(m_deviceId, true);
@@ -162,13 +184,31 @@ void LearnableParameter<ElemType>::InitFromArray(const std::vector<ElemType>& ar
     VerifyDataSize(Value());      // sanity check
 }
 
+template <class ElemType>
+void LearnableParameter<ElemType>::CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const /*override*/
+{
+    Base::CopyTo(nodeP, newName, flags);
+    if (flags & CopyNodeFlags::copyNodeValue)
+    {
+        auto node = dynamic_pointer_cast<LearnableParameter<ElemType>>(nodeP);
+        node->m_onHost = m_onHost;
+    }
+}
+
 template <class ElemType>
 void LearnableParameter<ElemType>::Save(File& fstream) const /*override*/
+{
+    SaveWithValue(fstream, Value());
+}
+
+template <class ElemType>
+void LearnableParameter<ElemType>::SaveWithValue(File& fstream, const Matrix<ElemType>& value) const
 {
     Base::Save(fstream);
     fstream << m_learningRateMultiplier;
     m_sampleLayout.Save(fstream);
-    fstream << Value();
+    fstream << m_onHost;
+    fstream << value;
 }
 
 template <class ElemType>
@@ -201,6 +241,11 @@ void LearnableParameter<ElemType>::Load(File& fstream, size_t modelVersion) /*ov
         }
     }
 
+    if (modelVersion >= CNTK_MODEL_VERSION_11)
+        fstream >> m_onHost;
+    if (m_onHost && m_deviceId != CPUDEVICE) // read the value directly into host memory
+        MoveToDevice(CPUDEVICE);
+
     LoadValue(fstream);
     SetDims(sampleLayout, false); // note: call this after LoadValue() since LoadValue() overwrites m_sampleLayout
     VerifyDataSize(Value());      // sanity check
@@ -50,7 +50,8 @@ public:
 
     // initialize with random numbers
     // if 'initOnCPUOnly' then always init on CPU, making initialization consistent across both (for testing)
-    void InitRandom(const bool uniformInit, const unsigned long randomSeed, const ElemType initValueScale, bool initOnCPUOnly);
+    // if 'parallelInit' then generate in parallel on the target device, with values that do not depend on the device either
+    void InitRandom(const bool uniformInit, const unsigned long randomSeed, const ElemType initValueScale, bool initOnCPUOnly, bool parallelInit = false);
 
     // initialize by reading a matrix from a text file
     void InitFromFile(const std::wstring& initFromFilePath);
@@ -89,8 +90,18 @@ public:
 #endif
     }
 
+    // use the value matrix of another parameter, e.g. of a replica of the network that is trained alongside (hogwild SGD)
+    void ShareValueWith(const LearnableParameter<ElemType>& other) { m_value = other.m_value; }
+
+    // a host-resident parameter keeps its value, gradient and learner state in host memory, whatever the network's device,
+    // e.g. an embedding table too large for the GPU; the nodes computed from it run on the CPU (see ComputationNetwork::PlaceNodesOnDevices())
+    bool IsOnHost() const { return m_onHost; }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override;
     virtual void Save(File& fstream) const override;
     virtual void Load(File& fstream, size_t modelVersion) override;
+    // same as Save() but writes the given matrix as the value, e.g. an earlier copy of it
+    void SaveWithValue(File& fstream, const Matrix<ElemType>& value) const;
 
     // computation functions don't do anything for parameter nodes
     virtual void UpdateFunctionMBSize() override;
@@ -106,6 +117,9 @@ public:
     void InferInputDimsFrom(const TensorShape& otherShape);
 
     virtual void DumpNodeInfo(const bool printValues, const bool printMetadata, File& fstream) const override;
+
+private:
+    bool m_onHost = false;
 };
 
 // -----------------------------------------------------------------------
@@ -501,6 +515,10 @@ public:
     {
         if (inputIndex == 0) // left derivative (embedding matrix)
         {
+            // With sparse input, the gradient is block-sparse: only the columns of the words in the minibatch, which is all that SGD updates.
+            if (Input(1)->Value().GetMatrixType() == SPARSE && Input(0)->Gradient().GetMatrixType() == DENSE && Gradient().GetMatrixType() == DENSE)
+                Input(0)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+
             // This is a reduction operation, hence we need to mask out gaps.
             Matrix<ElemType> sliceInput1Value = Input(1)->MaskedValueFor(t);
             Matrix<ElemType> sliceOutputGrad = MaskedGradientFor(t);
@@ -583,6 +601,18 @@ public:
         SetDims(TensorShape(Input(0)->GetAsMatrixNumRows() * wordsInEachSample), true);
     }
 
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
+    {
+        // like TimesNode: the block-sparse gradient of the embedding is allocated directly instead of from the pool
+        if (Input(0)->NeedsGradient() && Input(1)->Value().GetMatrixType() == SPARSE)
+        {
+            Input(0)->CreateGradientMatrixIfNull();
+            Input(0)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+        }
+
+        Base::AllocateGradientMatricesForInputs(matrixPool);
+    }
+
     bool UnitTest()
     {
         try
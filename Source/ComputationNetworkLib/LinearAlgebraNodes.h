@@ -8,6 +8,7 @@
 #include "ComputationNode.h"
 #include "Matrix.h"
 #include "TensorView.h"
+#include "Int8QuantizedMatrix.h"
 
 #include <unordered_set>
 #include <map>
@@ -245,6 +246,9 @@ public:
 
     void Save(File& fstream) const
     {
+        // the folded bias is not part of the model format, and the weights have been modified
+        if (m_foldedBias)
+            LogicError("%ls %ls operation: cannot save a network with folded batch normalization.", NodeName().c_str(), OperationName().c_str());
         Base::Save(fstream);
         fstream << m_outputRank;
     }
@@ -258,7 +262,64 @@ public:
             m_outputRank = 1;
     }
 
+public:
+    size_t OutputRank() const { return m_outputRank; }
+    bool HasFoldedBias() const { return !!m_foldedBias; }
+
+    // Inference only: compute the product with int8 weights on the CPU (see Int8QuantizedMatrix).
+    // The weights are quantized on first use and must not change afterwards.
+    void EnableInt8Inference(size_t calibrationMinibatches)
+    {
+        m_int8Weights = make_shared<Int8QuantizedMatrix<ElemType>>(calibrationMinibatches);
+    }
+
+    // Inference only: folds y = rowScale .* (W * x) + rowBias, with rowScale and rowBias column vectors over the output sample,
+    // into the weights and a bias that is added to the product (see ComputationNetwork::FoldBatchNormalization()).
+    // Without rowBias only the weights are scaled, and the caller adds the bias.
+    // Returns false if the output is not a plain [output dim x input dim] product of the weights.
+    bool FoldOutputScaleAndBias(const Matrix<ElemType>& rowScale, const Matrix<ElemType>* rowBias)
+    {
+        size_t outputDim = GetSampleLayout().GetNumElements();
+        auto& weights = Input(0)->Value();
+        if (m_transpose || m_foldedBias || Input(0)->HasMBLayout() || rowScale.GetNumRows() != outputDim ||
+            weights.GetNumElements() != outputDim * Input(1)->GetSampleLayout().GetNumElements())
+            return false;
+        auto weightsView = weights.Reshaped(outputDim, weights.GetNumElements() / outputDim);
+        weightsView.ColumnElementMultiplyWith(rowScale);
+        if (rowBias)
+            m_foldedBias = make_shared<Matrix<ElemType>>(rowBias->DeepClone(), m_deviceId);
+        return true;
+    }
+
 private:
+    // returns false if the product has to be computed in full precision, e.g. for sparse or GPU inputs or while calibrating
+    bool ForwardPropInt8(const FrameRange& fr)
+    {
+        auto input1 = Input(1)->ValueFor(fr);
+        auto output = ValueFor(fr);
+        if (Input(0)->HasMBLayout() || input1.GetDeviceId() >= 0 || input1.GetMatrixType() != DENSE)
+            return false;
+        if (m_int8Weights->IsCalibrating())
+        {
+            m_int8Weights->Calibrate(input1);
+            return false;
+        }
+        if (!m_int8Weights->IsQuantized())
+        {
+            // only plain [M x K] * [K x N] products are supported, e.g. no extra dimensions of the right argument
+            const auto& weights = Input(0)->Value();
+            if (output.GetNumRows() * input1.GetNumRows() != weights.GetNumElements())
+            {
+                fprintf(stderr, "%ls %ls operation: int8 inference is not supported for this shape, using full precision.\n", NodeName().c_str(), OperationName().c_str());
+                m_int8Weights.reset();
+                return false;
+            }
+            m_int8Weights->Quantize(weights, output.GetNumRows(), input1.GetNumRows(), m_transpose);
+        }
+        m_int8Weights->Multiply(input1, output);
+        return true;
+    }
+
     // if the left argument of the matrix product (A) has a time axis, it can only be applied sample by sample
     // where each sample is treated as a separate matrix object (as a consequence, it then also applies to B and the result as well)
     TensorView<ElemType> OneSampleTensorFor(int inputIndex/*-1 for output*/, bool gradient/*instead of value*/, const FrameRange& fr)
@@ -274,11 +335,42 @@ private:
         return TensorView<ElemType>(data, tensorShape);
     }
 
+    // If A is minibatch data, the per-sample products within a frame range can be computed by one batched GEMM
+    // (Matrix::BatchMatMul()) as long as all samples are dense matrices of the same shape, i.e. B has the layout of A or none.
+    bool CanUseBatchedProduct(const FrameRange& fr) const
+    {
+        if (fr.seqIndex != SIZE_MAX || Input(0)->Value().GetMatrixType() != DENSE || Input(1)->Value().GetMatrixType() != DENSE)
+            return false;
+        if (Input(1)->HasMBLayout())
+            return Input(1)->GetMBLayout() == Input(0)->GetMBLayout();
+        return Input(1)->Value().GetNumCols() == 1;
+    }
+
+    // number of rows of each sample of A when viewed as a matrix, before transposition
+    size_t SampleMatrixRowsOfA() const
+    {
+        const auto& shapeA = Input(0)->GetSampleLayout();
+        if (m_transpose)
+            return shapeA[0];
+        size_t rows = 1;
+        for (size_t k = 0; k < m_outputRank; k++)
+            rows *= shapeA[k];
+        return rows;
+    }
+
 public:
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
         // If argument A is minibatch data, then this must be performed frame-by-frame, sequence-by-sequence, one GEMM call each.
-        // This will be inefficient. We hope this will be the baseline of a future, more efficient TensorView-based implementation.
+        // Where possible, these are batched into a single call.
+        if (!fr.IsOneColumnWrt(Input(0)->GetMBLayout()) && CanUseBatchedProduct(fr))
+        {
+            size_t rowsA = SampleMatrixRowsOfA();
+            size_t innerDim = m_transpose ? rowsA : Input(0)->GetSampleLayout().GetNumElements() / rowsA;
+            auto output = ValueFor(fr);
+            Matrix<ElemType>::BatchMatMul(1, Input(0)->ValueFor(fr), rowsA, m_transpose, Input(1)->ValueFor(fr.AllowBroadcast()), innerDim, false, 0, output);
+            return;
+        }
         if (!fr.IsOneColumnWrt(Input(0)->GetMBLayout()))
         {
             // recursively call ourselves for each individual time and sequence
@@ -290,18 +382,44 @@ public:
             return;
         }
 
-        // TensorView::DoMatrixProductOf() will reduce each tensor object into a 2D tensor (or fail if it cannot)
-        // and recreate actual Matrix objects (in case of sparse, they must be identical to the original tensor storage object).
-        // Transposition is applied after flattening into 2D, but only allowed if the input sample is 2D anyway.
-        auto input0 = OneSampleTensorFor(0,  /*gradient=*/false, fr.AllowBroadcast());
-        auto input1 = OneSampleTensorFor(1,  /*gradient=*/false, fr.AllowBroadcast());
-        auto output = OneSampleTensorFor(-1, /*gradient=*/false, fr);
-        output.AssignMatrixProductOf(false/*transC*/, input0, m_transpose/*transA*/, input1, false/*transB*/);
+        if (!m_int8Weights || !ForwardPropInt8(fr))
+        {
+            // TensorView::DoMatrixProductOf() will reduce each tensor object into a 2D tensor (or fail if it cannot)
+            // and recreate actual Matrix objects (in case of sparse, they must be identical to the original tensor storage object).
+            // Transposition is applied after flattening into 2D, but only allowed if the input sample is 2D anyway.
+            auto input0 = OneSampleTensorFor(0,  /*gradient=*/false, fr.AllowBroadcast());
+            auto input1 = OneSampleTensorFor(1,  /*gradient=*/false, fr.AllowBroadcast());
+            auto output = OneSampleTensorFor(-1, /*gradient=*/false, fr);
+            output.AssignMatrixProductOf(false/*transC*/, input0, m_transpose/*transA*/, input1, false/*transB*/);
+        }
+
+        if (m_foldedBias)
+        {
+            auto output = ValueFor(fr);
+            Matrix<ElemType>::ScaleAndAdd(1, *m_foldedBias, output);
+        }
     }
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
         // special treatment if A is minibatch data; see Forward() for comment
+        // The gradient of a B without layout is a sum over all samples, which is not a batched GEMM, nor is a sparse gradient.
+        if (!fr.IsOneColumnWrt(Input(0)->GetMBLayout()) && CanUseBatchedProduct(fr) &&
+            (inputIndex == 0 || Input(1)->HasMBLayout()) && Input(inputIndex)->Gradient().GetMatrixType() == DENSE)
+        {
+            size_t rowsA = SampleMatrixRowsOfA();
+            size_t innerDim = m_transpose ? rowsA : Input(0)->GetSampleLayout().GetNumElements() / rowsA;
+            size_t outputRows = m_transpose ? Input(0)->GetSampleLayout().GetNumElements() / rowsA : rowsA;
+            auto outputGradient = GradientFor(fr);
+            auto inputGradient = Input(inputIndex)->GradientFor(fr);
+            if (inputIndex == 0 && !m_transpose) // dA_j += dC_j * B_j'
+                Matrix<ElemType>::BatchMatMul(1, outputGradient, outputRows, false, Input(1)->ValueFor(fr.AllowBroadcast()), innerDim, true, 1, inputGradient);
+            else if (inputIndex == 0)            // dA_j += B_j * dC_j'
+                Matrix<ElemType>::BatchMatMul(1, Input(1)->ValueFor(fr.AllowBroadcast()), innerDim, false, outputGradient, outputRows, true, 1, inputGradient);
+            else                                 // dB_j += op(A_j)' * dC_j
+                Matrix<ElemType>::BatchMatMul(1, Input(0)->ValueFor(fr), rowsA, !m_transpose, outputGradient, outputRows, false, 1, inputGradient);
+            return;
+        }
         if (!fr.IsOneColumnWrt(Input(0)->GetMBLayout()))
         {
             auto timeRange     = fr.GetTimeRange();
@@ -322,7 +440,7 @@ public:
         {
             // currently we only support one combination when the input is sparse
             // If input data is sparse, then gradient is block sparse.
-            // BUGBUG: This does not accumulate into the Input(0)->Gradient, which might cause problems elsewhere.
+            // BUGBUG: On the GPU, this does not accumulate into the Input(0)->Gradient, which might cause problems elsewhere.
             if (Input(1)->Value().GetMatrixType() == SPARSE && Input(0)->Gradient().GetMatrixType() == DENSE && Gradient().GetMatrixType() == DENSE)
                 Input(0)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
             auto input0Gradient = OneSampleTensorFor(0,  /*gradient=*/true,  fr.AllowBroadcast());
@@ -341,6 +459,13 @@ public:
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     // but both *inputs* are used, so we don't overload the InputUsed-() function which defaults to 'true'
+    virtual bool CanRecomputeValue() const override { return true; }
+
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& other) const override
+    {
+        auto node = dynamic_cast<const TimesNodeBase<ElemType, m_transpose>*>(&other);
+        return node && node->m_outputRank == m_outputRank && !m_foldedBias && !node->m_foldedBias && !m_int8Weights && !node->m_int8Weights;
+    }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
@@ -455,6 +580,8 @@ public:
 
 private:
     size_t m_outputRank;
+    shared_ptr<Int8QuantizedMatrix<ElemType>> m_int8Weights; // set if int8 inference is enabled
+    shared_ptr<Matrix<ElemType>> m_foldedBias;                // set if a batch normalization has been folded into this node
 };
 
 // -----------------------------------------------------------------------
@@ -522,6 +649,167 @@ public:
 template class TransposeTimesNode<float>;
 template class TransposeTimesNode<double>;
 
+// -----------------------------------------------------------------------
+// AffineActivationNode (W, x, b) -- activation(W * x + b) in a single node
+// This is what ComputationNetwork::FuseAffineActivation() replaces a chain
+// Sigmoid/Tanh/RectifiedLinear (Plus (Times (W, x), b)) with. The bias and
+// the activation are applied in one pass over the product (see
+// Matrix::AffineAndActivation()), instead of two extra passes over the
+// intermediate results, which also need not be kept for backprop.
+// W is an [M x K] matrix without layout, b has M elements.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class AffineActivationNode : public ComputationNode<ElemType>, public NumInputs<3>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"AffineActivation"; }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(AffineActivationNode);
+    AffineActivationNode(DEVICEID_TYPE deviceId, const wstring& name, ElementWiseOperator activation = opSigmoid)
+        : Base(deviceId, name), m_activation(activation)
+    {
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<AffineActivationNode<ElemType>>(nodeP);
+            node->m_activation = m_activation;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << (int) m_activation;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        int activation;
+        fstream >> activation;
+        m_activation = (ElementWiseOperator) activation;
+    }
+
+    ElementWiseOperator Activation() const { return m_activation; }
+
+private:
+    size_t OutputDim() const { return Input(2)->GetSampleLayout().GetNumElements(); }
+    size_t InputDim()  const { return Input(1)->GetSampleLayout().GetNumElements(); }
+
+    ElementWiseOperator GradientOp() const
+    {
+        switch (m_activation)
+        {
+        case opSigmoid:         return opElementwiseProductWithSigmoidDerivativeFromOutput;
+        case opTanh:            return opElementwiseProductWithTanhDerivativeFromOutput;
+        case opLinearRectifier: return opElementwiseProductWithLinearRectifierDerivativeFromOutput;
+        default: LogicError("%ls %ls operation: unsupported activation %d.", NodeName().c_str(), OperationName().c_str(), (int) m_activation);
+        }
+    }
+
+public:
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        size_t outputDim = OutputDim();
+        auto weights = Input(0)->Value().Reshaped(outputDim, InputDim());
+        auto bias = Input(2)->Value().Reshaped(outputDim, 1);
+        auto output = ValueFor(fr);
+        Matrix<ElemType>::AffineAndActivation(weights, Input(1)->ValueFor(fr), bias, m_activation, output);
+    }
+
+    // The gradient of the pre-activation, dZ = dY .* activation'(Y), is needed for all three inputs,
+    // so it is computed once here instead of in each BackpropTo() call.
+    virtual void /*ComputationNode::*/ Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) override
+    {
+        if (NeedsGradient())
+        {
+            LazyZeroGradient();
+            m_affineGradient->Resize(Gradient());
+            size_t rank = GetSampleLayout().GetRank();
+            auto affineGradient = DataTensorFor(m_affineGradient, rank, fr);
+            affineGradient.DoBinaryOpOf(0, GradientTensorFor(rank, fr), ValueTensorFor(rank, fr), 1, GradientOp(), opSum);
+            // the weight and bias gradients are sums over all columns
+            MaskMissingColumnsToZero(*m_affineGradient, GetMBLayout(), fr);
+        }
+        Base::Backprop(fr, childrenInThisLoop, childrenInOuterLoop);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        size_t outputDim = OutputDim();
+        auto affineGradient = DataFor(*m_affineGradient, fr);
+        if (inputIndex == 0) // dW += dZ * x'
+        {
+            Input(1)->MaskMissingValueColumnsToZero(fr);
+            auto weightsGradient = Input(0)->Gradient().Reshaped(outputDim, InputDim());
+            Matrix<ElemType>::MultiplyAndWeightedAdd(1, affineGradient, false, Input(1)->ValueFor(fr), true, 1, weightsGradient);
+        }
+        else if (inputIndex == 1) // dx += W' * dZ
+        {
+            auto weights = Input(0)->Value().Reshaped(outputDim, InputDim());
+            auto inputGradient = Input(1)->GradientFor(fr);
+            Matrix<ElemType>::MultiplyAndWeightedAdd(1, weights, true, affineGradient, false, 1, inputGradient);
+        }
+        else // db += sum of dZ over the columns
+        {
+            size_t rank = GetSampleLayout().GetRank();
+            auto biasGradient = Input(2)->GradientTensorFor(rank, fr.AllowBroadcast());
+            biasGradient.AddCopyOf(DataTensorFor(m_affineGradient, rank, fr));
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return true; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override { return childIndex != 2; }
+    virtual bool CanRecomputeValue() const override { return true; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+
+        if (isFinalValidationPass)
+        {
+            if (Input(0)->HasMBLayout() || Input(2)->HasMBLayout())
+                InvalidArgument("%ls %ls operation: weights and bias must not be minibatch data.", NodeName().c_str(), OperationName().c_str());
+            if (m_activation != opSigmoid && m_activation != opTanh && m_activation != opLinearRectifier)
+                InvalidArgument("%ls %ls operation: unsupported activation %d.", NodeName().c_str(), OperationName().c_str(), (int) m_activation);
+            if (Input(0)->GetSampleLayout().GetNumElements() != OutputDim() * InputDim())
+                InvalidArgument("%ls %ls operation: weights [%s] do not match input [%s] and bias [%s].", NodeName().c_str(), OperationName().c_str(),
+                                string(Input(0)->GetSampleLayout()).c_str(), string(Input(1)->GetSampleLayout()).c_str(), string(Input(2)->GetSampleLayout()).c_str());
+        }
+
+        // the output has the shape of the bias, like Plus (Times (W, x), b)
+        const auto& biasLayout = Input(2)->GetSampleLayout();
+        SetDims(biasLayout.GetRank() > 1 ? biasLayout : TensorShape(OutputDim()), HasMBLayout());
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_affineGradient, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_affineGradient, matrixPool);
+    }
+
+private:
+    ElementWiseOperator m_activation;
+    shared_ptr<Matrix<ElemType>> m_affineGradient; // dZ = gradient w.r.t. W * x + b
+};
+
+template class AffineActivationNode<float>;
+template class AffineActivationNode<double>;
+
 // -----------------------------------------------------------------------
 // DiagTimesNode (vector representing the diagonal of a square matrix, data)
 // TODO: This is redundant with ElementTimes and should be removed (with a compat stub).
@@ -783,6 +1071,13 @@ public:
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool CanRecomputeValue() const override { return true; }
+
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& other) const override
+    {
+        auto node = dynamic_cast<const TransposeDimensionsNode<ElemType>*>(&other);
+        return node && node->m_axis1 == m_axis1 && node->m_axis2 == m_axis2;
+    }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
@@ -1049,147 +1344,32 @@ public:
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
+        if (inputIndex > 1) // the shift and the number of negative samples have no gradient
+            return;
+
         Matrix<ElemType> sliceInput0Value = Input(0)->ValueFor(fr);
         Matrix<ElemType> sliceInput1Value = Input(1)->ValueFor(fr);
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
         Matrix<ElemType> sliceInputGrad = Input(inputIndex)->GradientFor(fr);
         Matrix<ElemType> sliceThisGrad = GradientFor(fr);
 
-        BackpropToS(inputIndex, *m_invNorm0, *m_invNorm1, sliceOutputValue, *m_temp, *m_rightTerm, *m_leftTerm, *m_invNormSquare, sliceInput0Value, sliceInput1Value, Input(2)->Value(), Input(3)->Value(), sliceInputGrad, sliceThisGrad);
-    }
-
-    // functionValues, invNorm0, invNorm1 - output from the EvaluateNode() method
-    // temp, rightTerm, leftTerm - temporary matrices
-    // in0, in1, in2, in3 - input functionValues from other nodes
-    // inputGradientValues(x) - gradients to update, where x matches inputIndex
-    /*TODO: merge with call site*/ void BackpropToS(const size_t inputIndex, const Matrix<ElemType>& invNorm0, const Matrix<ElemType>& invNorm1, const Matrix<ElemType>& functionValues,
-                                                    Matrix<ElemType>& temp, Matrix<ElemType>& rightTerm, Matrix<ElemType>& leftTerm, Matrix<ElemType>& invNormSquare, // the temporary variables
-                                                    const Matrix<ElemType>& in0, const Matrix<ElemType>& in1, const Matrix<ElemType>& in2, const Matrix<ElemType>& in3,
-                                                    Matrix<ElemType>& inputGradientValues, Matrix<ElemType>& thisGradientValues)
-    {
-        size_t shift = (size_t) in2.Get00Element();
-        size_t negNumber = (size_t) in3.Get00Element();
-        size_t numCols = in0.GetNumCols(); // used in computing right child's graident
-
-        if (inputIndex == 0) // left derivative
-        {
-            invNormSquare.AssignElementProductOf(invNorm0, invNorm0);
-
-            for (long m = 0; m < negNumber + 1; m++)
-            {
-                temp.GetARowByIndex(functionValues, m); // set this matrx to be the m-th row in functionValues
-                temp.ElementMultiplyWith(invNormSquare);
-
-                Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in0, rightTerm, 0, true);
-
-                if (m == 0)
-                {
-                    temp.AssignElementProductOf(invNorm0, invNorm1);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in1, leftTerm, 0, true);
-                }
-                else
-                {
-                    size_t currshift = m + shift - 1; // for current line, how much should we shift
-
-                    temp.AssignElementProductOfWithShift(invNorm0, invNorm1, currshift); // this is a row vector
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in1, leftTerm, currshift, true);
-                }
-
-                leftTerm -= rightTerm;
-
-                temp.GetARowByIndex(thisGradientValues, m);
-
-                Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, leftTerm, rightTerm, 0, true);
-
-                inputGradientValues += rightTerm;
-            }
-        }
-        else // right part
-        {
-            invNormSquare.AssignElementProductOf(invNorm1, invNorm1); // this matrix should be save and unchanged. It should not be changed
-
-            for (long m = 0; m < negNumber + 1; m++)
-            {
-                temp.GetARowByIndex(functionValues, m); // set this matrx to be the m-th row in functionValues
-
-                if (m == 0) // this is the first line. computation should be symmetric
-                {
-                    // the following is for the right part
-                    temp.ElementMultiplyWith(invNormSquare);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in1, rightTerm, 0, true);
-
-                    // the following is for the left part
-                    temp.AssignElementProductOf(invNorm0, invNorm1);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in0, leftTerm, 0, true);
-
-                    leftTerm -= rightTerm;
-
-                    temp.GetARowByIndex(thisGradientValues, m);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, leftTerm, rightTerm, 0, true);
-
-                    inputGradientValues += rightTerm;
-                }
-                else // this requires shift
-                {
-                    size_t currshift = (m + shift - 1) % numCols;
-                    size_t reverseshift = numCols - currshift;
-
-                    leftTerm.AssignElementProductOfWithShift(invNormSquare, temp, reverseshift); // use leftTerm as a temp variable here
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(leftTerm, in1, rightTerm, 0, true);
-
-                    temp.AssignElementProductOfWithShift(invNorm1, invNorm0, reverseshift);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, in0, leftTerm, reverseshift, true);
-
-                    leftTerm -= rightTerm;
-
-                    temp.GetARowByIndex(thisGradientValues, m);
-
-                    Matrix<ElemType>::ConductRowElementMultiplyWithShift(temp, leftTerm, rightTerm, reverseshift, false);
-
-                    inputGradientValues += rightTerm;
-                }
-            }
-        }
+        size_t shift = (size_t) Input(2)->Get00Element();
+        size_t negNumber = (size_t) Input(3)->Get00Element();
+        Matrix<ElemType>::CosDistanceWithNegativeSamplesGradient(inputIndex == 0, sliceInput0Value, sliceInput1Value, shift, negNumber, *m_invNorm0, *m_invNorm1,
+                                                                 sliceOutputValue, sliceThisGrad, sliceInputGrad);
     }
 
+    // The cosine similarities of each query (input 0) with its document (input 1) and with the negNumber documents that follow it,
+    // starting at the given shift, are computed in one pass without forming the shifted copies. The inverse norms are kept for BackpropTo.
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
         Matrix<ElemType> sliceInput0Value = Input(0)->ValueFor(fr);
         Matrix<ElemType> sliceInput1Value = Input(1)->ValueFor(fr);
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
 
-        ForwardPropS(*m_invNorm0, *m_invNorm1, sliceOutputValue, sliceInput0Value, sliceInput1Value, Input(2)->Value(), Input(3)->Value(), *m_leftTerm, *m_rightTerm);
-    }
-
-    /*TODO: merge with call site*/ void ForwardPropS(Matrix<ElemType>& invNorm0, Matrix<ElemType>& invNorm1, Matrix<ElemType>& functionValues, Matrix<ElemType>& in0, Matrix<ElemType>& in1, Matrix<ElemType>& in2, Matrix<ElemType>& in3, Matrix<ElemType>& leftTermTemp, Matrix<ElemType>& rightTermTemp)
-    {
-        invNorm0.AssignVectorNorm2Of(in0, true); // seems to modify input (in0)
-        invNorm0.AssignElementInverseOf(invNorm0);
-
-        invNorm1.AssignVectorNorm2Of(in1, true); // seems to modify the input (in1)
-        invNorm1.AssignElementInverseOf(invNorm1);
-
-        size_t shift = (size_t) in2.Get00Element();
-        size_t negNumber = (size_t) in3.Get00Element();
-
-        // mutiply invNorm0 and invNorm1 with shift and neg.
-        // The result is a matrix of (numberneg+1, invNorm0.Cols)
-        leftTermTemp.AssignElementProductOfWithShiftNeg(invNorm0, invNorm1, shift, negNumber);
-
-        // compute the right values
-        // Again, the output is a matrix of (negNumber+1, invNorm0.cols)
-        rightTermTemp.AssignInnerProductOfWithShiftNeg(in0, in1, true, shift, negNumber);
-
-        // compute the evaluation result matrix by multiply these two matrices, element by element
-        // we get a (negNumber+1, n) matrix
-        functionValues.AssignElementProductOf(leftTermTemp, rightTermTemp);
+        size_t shift = (size_t) Input(2)->Get00Element();
+        size_t negNumber = (size_t) Input(3)->Get00Element();
+        Matrix<ElemType>::CosDistanceWithNegativeSamples(sliceInput0Value, sliceInput1Value, shift, negNumber, *m_invNorm0, *m_invNorm1, sliceOutputValue);
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
@@ -1220,10 +1400,6 @@ public:
             auto node = dynamic_pointer_cast<CosDistanceWithNegativeSamplesNode<ElemType>>(nodeP);
             node->m_invNorm0->SetValue(*m_invNorm0);
             node->m_invNorm1->SetValue(*m_invNorm1);
-            node->m_invNormSquare->SetValue(*m_invNormSquare);
-            node->m_leftTerm->SetValue(*m_leftTerm);
-            node->m_rightTerm->SetValue(*m_rightTerm);
-            node->m_temp->SetValue(*m_temp);
         }
     }
     // request matrices needed to do node function value evaluation
@@ -1232,16 +1408,6 @@ public:
         Base::RequestMatricesBeforeForwardProp(matrixPool);
         RequestMatrixFromPool(m_invNorm0, matrixPool);
         RequestMatrixFromPool(m_invNorm1, matrixPool);
-        RequestMatrixFromPool(m_leftTerm, matrixPool);
-        RequestMatrixFromPool(m_rightTerm, matrixPool);
-    }
-
-    // request matrices that are needed for gradient computation
-    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool)
-    {
-        Base::RequestMatricesBeforeBackprop(matrixPool);
-        RequestMatrixFromPool(m_invNormSquare, matrixPool);
-        RequestMatrixFromPool(m_temp, matrixPool);
     }
 
     // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
@@ -1250,21 +1416,12 @@ public:
         Base::ReleaseMatricesAfterBackprop(matrixPool);
         ReleaseMatrixToPool(m_invNorm0, matrixPool);
         ReleaseMatrixToPool(m_invNorm1, matrixPool);
-        ReleaseMatrixToPool(m_leftTerm, matrixPool);
-        ReleaseMatrixToPool(m_rightTerm, matrixPool);
-        ReleaseMatrixToPool(m_invNormSquare, matrixPool);
-        ReleaseMatrixToPool(m_temp, matrixPool);
     }
 
 private:
     // invNorm nodes tranfer data between ForwardProp and BackpropTo
     shared_ptr<Matrix<ElemType>> m_invNorm0;
     shared_ptr<Matrix<ElemType>> m_invNorm1;
-    shared_ptr<Matrix<ElemType>> m_leftTerm;
-    shared_ptr<Matrix<ElemType>> m_rightTerm;
-    // the rest are temporaries, values don't need to be maintained
-    shared_ptr<Matrix<ElemType>> m_invNormSquare;
-    shared_ptr<Matrix<ElemType>> m_temp;
 };
 
 template class CosDistanceWithNegativeSamplesNode<float>;
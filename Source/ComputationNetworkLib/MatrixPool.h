@@ -9,6 +9,7 @@
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
+#include <limits.h>
 #include <stdlib.h>
 
 #include "Basics.h"
@@ -19,58 +20,164 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 // MatrixPool -- class to support memory sharing
 // Despite the gather general name of this class, it is specifically designed to support the memory sharing of ComputationNodes.
+// ComputationNetwork::AllocateAllMatrices() simulates one forward and backward pass, during which nodes request and release
+// their matrices. The pool does not hand out matrices right away; it records when each request is made and released (its lifetime)
+// and how large it will be; a released matrix may be requested again (see Reacquire()). OptimizedMemoryAllocation() then packs
+// the requests into as few shared matrices as possible, largest first, each into the best-fitting shared matrix that is not in use
+// during its lifetime, and assigns them.
+// The resulting plan is kept (GetPlan()), so that the memory can be estimated for other minibatch sizes without planning again.
+// A plan can also be embedded into a model (see ComputationNetwork::EmbedMemoryPlan()); when it is loaded, the requests go to the
+// shared matrices they were planned into (SetEmbeddedPlan()) as long as their lifetimes allow it, and these are allocated right away.
 // Note: see #define SUPRESS_MEMSHARING below as for how to temporarily disable memory sharing altogether, for debugging
 class MatrixPool
 {
-    vector<shared_ptr<Matrix<float>>>  m_releasedFloatMatrices;
-    vector<shared_ptr<Matrix<double>>> m_releasedDoubleMatrices;
+public:
+    // the node a matrix is requested or released by, and what for; used for the memory plan and report
+    struct RequestOwner
+    {
+        std::wstring nodeName;
+        const char* category; // "value", "gradient", or "workspace"
+        size_t sampleSize;    // number of elements per column
+        bool mbScale;         // whether the number of columns is the minibatch size, otherwise 1
+
+        size_t GetNumElements(size_t minibatchSize) const { return sampleSize * (mbScale ? minibatchSize : 1); }
+    };
+
+    // a matrix of the memory plan and the requests assigned to it
+    struct PlannedMatrix
+    {
+        DEVICEID_TYPE deviceId;
+        size_t elementSize;
+        bool isFromPool;                    // false for a matrix not from the pool that takes in requests after its release
+        RequestOwner own;                   // the matrix itself if it is not from the pool
+        std::vector<RequestOwner> requests; // requests from the pool assigned to it
+
+        // the request that decides the size of the matrix
+        const RequestOwner& GetLargestRequest(size_t minibatchSize) const
+        {
+            const RequestOwner* largest = &requests.front();
+            for (const auto& request : requests)
+            {
+                if (request.GetNumElements(minibatchSize) > largest->GetNumElements(minibatchSize))
+                    largest = &request;
+            }
+            return *largest;
+        }
+        // bytes taken by the requests, beyond the matrix's own size if it is not from the pool
+        size_t GetBytes(size_t minibatchSize) const
+        {
+            size_t numElements = GetLargestRequest(minibatchSize).GetNumElements(minibatchSize);
+            size_t ownElements = isFromPool ? 0 : own.GetNumElements(minibatchSize);
+            return numElements > ownElements ? (numElements - ownElements) * elementSize : 0;
+        }
+    };
+
+private:
+    template <class ElemType>
+    struct MemRequestInfo
+    {
+        DEVICEID_TYPE deviceId;
+        shared_ptr<Matrix<ElemType>>* pMatrixPtr; // where the assigned matrix goes (a member of the requesting node); null for matrices not from the pool
+        shared_ptr<Matrix<ElemType>> matrix;      // placeholder until assignment, or the existing matrix if it is not from the pool
+        size_t matrixSize;                        // number of elements, estimated from the node's sample layout and the minibatch size
+        vector<pair<int, int>> lifetimes;         // steps of the simulation [request, release] during which the matrix is in use; INT_MAX if not released yet
+        RequestOwner owner;
+
+        bool IsReleased() const { return lifetimes.back().second != INT_MAX; }
+    };
+
+    vector<MemRequestInfo<float>>  m_memRequestInfoFloatVec;
+    vector<MemRequestInfo<double>> m_memRequestInfoDoubleVec;
+    int m_stepCounter;
+    size_t m_minibatchSizeHint;
+    vector<PlannedMatrix> m_plan;
+    vector<PlannedMatrix> m_embeddedPlan;
+
+    template <class ElemType>
+    vector<MemRequestInfo<ElemType>>& GetMemRequestInfoVec();
+
+    template <class ElemType>
+    MemRequestInfo<ElemType>* FindMemRequestInfo(const shared_ptr<Matrix<ElemType>>& matrixPtr)
+    {
+        for (auto& memInfo : GetMemRequestInfoVec<ElemType>())
+        {
+            if (memInfo.matrix == matrixPtr)
+                return &memInfo;
+        }
+        return nullptr;
+    }
 
     template <class ElemType>
-    vector<shared_ptr<Matrix<ElemType>>>& GetReleasedMatrices();
+    void OptimizedMemoryAllocation(size_t& plannedBytes, size_t& lifoBytes, size_t& unsharedBytes);
 
 public:
+    MatrixPool()
+        : m_stepCounter(0), m_minibatchSizeHint(1)
+    {
+    }
+
+    // number of columns assumed for matrices of nodes with an MBLayout, to weigh them against the others when packing
+    void SetMinibatchSizeHint(size_t minibatchSize) { m_minibatchSizeHint = max(minibatchSize, (size_t) 1); }
+
     // release here means the matrix can be put back and shared by others
     template <class ElemType>
-    void Release(shared_ptr<Matrix<ElemType>> freeMatrix)
+    void Release(shared_ptr<Matrix<ElemType>> freeMatrix, const RequestOwner& owner)
     {
         if (freeMatrix == nullptr || freeMatrix->GetMatrixType() == SPARSE)
             LogicError("MatrixPool::Release: freeMatrix should not be null or sparse.");
 //#define SUPRESS_MEMSHARING // #define this to disable memory sharing through this structure
         // TODO: Make this a runtime option.
 #ifndef SUPRESS_MEMSHARING
-        vector<shared_ptr<Matrix<ElemType>>>& releasedMatrices = GetReleasedMatrices<ElemType>();
-#ifdef _DEBUG
-        for (int i = 0; i < releasedMatrices.size(); i++)
+        vector<MemRequestInfo<ElemType>>& memInfoVec = GetMemRequestInfoVec<ElemType>();
+        MemRequestInfo<ElemType>* memInfo = FindMemRequestInfo(freeMatrix);
+        if (memInfo)
         {
-            if (releasedMatrices[i] == freeMatrix)
+            if (memInfo->IsReleased())
                 RuntimeError("MatrixPool::Release: freeMatrix is already in the released pool.");
+            memInfo->lifetimes.back().second = m_stepCounter++;
+            return;
         }
-
-#endif
-        releasedMatrices.push_back(freeMatrix);
+        // a matrix that was not requested here (e.g. created by the node itself) can still be shared once released
+        MemRequestInfo<ElemType> newMemInfo = { freeMatrix->GetDeviceId(), nullptr, freeMatrix, freeMatrix->GetNumElements(), { make_pair(-1, m_stepCounter++) }, owner };
+        memInfoVec.push_back(newMemInfo);
 #endif
     }
 
+    // 'matrixPtr' receives a placeholder now, and the shared matrix when OptimizedMemoryAllocation() is called, so it must stay valid until then
     template <class ElemType>
-    shared_ptr<Matrix<ElemType>> Request(DEVICEID_TYPE deviceId)
+    void Request(DEVICEID_TYPE deviceId, shared_ptr<Matrix<ElemType>>& matrixPtr, const RequestOwner& owner)
     {
-        vector<shared_ptr<Matrix<ElemType>>>& releasedMatrices = GetReleasedMatrices<ElemType>();
-        shared_ptr<Matrix<ElemType>> matrixPtr;
-        if (releasedMatrices.empty())
-        {
-            matrixPtr = make_shared<Matrix<ElemType>>(deviceId);
-        }
-        else
-        {
-            matrixPtr = releasedMatrices.back();
-            releasedMatrices.pop_back();
-        }
+        matrixPtr = make_shared<Matrix<ElemType>>(deviceId);
+        MemRequestInfo<ElemType> memInfo = { deviceId, &matrixPtr, matrixPtr, owner.GetNumElements(m_minibatchSizeHint), { make_pair(m_stepCounter++, INT_MAX) }, owner };
+        GetMemRequestInfoVec<ElemType>().push_back(memInfo);
+    }
+
+    // request a released matrix again, e.g. to recompute a value during backprop; its content is not preserved while it is released
+    template <class ElemType>
+    void Reacquire(const shared_ptr<Matrix<ElemType>>& matrixPtr)
+    {
+#ifndef SUPRESS_MEMSHARING
+        MemRequestInfo<ElemType>* memInfo = FindMemRequestInfo(matrixPtr);
+        if (!memInfo || !memInfo->IsReleased())
+            LogicError("MatrixPool::Reacquire: The matrix has not been released to the pool.");
+        memInfo->lifetimes.push_back(make_pair(m_stepCounter++, INT_MAX));
+#endif
+    }
 
-        if (!matrixPtr) // this can't really happen
-            LogicError("MatrixPool::Request: failed to get a valid matrix.");
+    // assign the shared matrices to all requests made so far, and report the planned memory use
+    void OptimizedMemoryAllocation();
 
-        return matrixPtr;
+    // the shared matrices of the last OptimizedMemoryAllocation() that requests were assigned to
+    const vector<PlannedMatrix>& GetPlan() const { return m_plan; }
+
+    // a plan made before, for the same network and minibatch size, for OptimizedMemoryAllocation() to follow
+    void SetEmbeddedPlan(const vector<PlannedMatrix>& plan, size_t minibatchSize)
+    {
+        m_embeddedPlan = plan;
+        SetMinibatchSizeHint(minibatchSize);
     }
+    const vector<PlannedMatrix>& GetEmbeddedPlan() const { return m_embeddedPlan; }
+    size_t GetMinibatchSizeHint() const { return m_minibatchSizeHint; }
 };
 
 }}}
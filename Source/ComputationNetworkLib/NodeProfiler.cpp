@@ -0,0 +1,364 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "NodeProfiler.h"
+#include "fileutil.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// trace events beyond this are not collected, to bound the memory of long runs
+static const size_t MaxTraceEvents = 1000000;
+// rows of the printed table
+static const size_t MaxPrintedNodes = 50;
+
+// one ForwardProp() or Backprop() call of the current minibatch
+struct NodeProfileRecord
+{
+    wstring nodeName;
+    wstring operationName;
+    NodeProfiler::Phase phase;
+    int threadIndex;
+    double wallBegin; // microseconds since Configure()
+    double wallEnd;
+    DEVICEID_TYPE deviceId;
+    GPUEvent* beginEvent; // (from the event pool; null on the CPU)
+    GPUEvent* endEvent;
+    long long gpuBytesInUseBegin;
+    long long gpuBytesAllocated;
+    size_t matrixBytes;
+    string shape;
+};
+
+// aggregate over the profiled minibatches
+struct NodeProfileStatistics
+{
+    wstring operationName;
+    string shape; // of the last call
+    size_t numCalls;
+    double wallMs;
+    double gpuMs;
+    size_t matrixBytes;          // largest seen
+    long long gpuBytesAllocated; // sum over all calls
+
+    NodeProfileStatistics() : numCalls(0), wallMs(0), gpuMs(0), matrixBytes(0), gpuBytesAllocated(0) { }
+    double GetMs() const { return gpuMs > 0 ? gpuMs : wallMs; }
+};
+
+struct NodeProfileTraceEvent
+{
+    wstring nodeName;
+    wstring operationName;
+    NodeProfiler::Phase phase;
+    int row; // thread index, or the device for GPU time
+    double ts;
+    double dur;
+    string shape;
+};
+
+struct NodeProfilerState
+{
+    double m_samplingRate;
+    wstring m_traceFilePath;
+    chrono::steady_clock::time_point m_startTime;
+    size_t m_numMinibatchesSeen;
+    size_t m_numMinibatchesProfiled;
+
+    mutex m_mutex; // for records of nodes that run concurrently on the CPU
+    vector<NodeProfileRecord> m_records;
+    vector<pair<DEVICEID_TYPE, unique_ptr<GPUEvent>>> m_events; // timing events, reused across minibatches
+    size_t m_numEventsUsed;
+
+    map<pair<wstring, NodeProfiler::Phase>, NodeProfileStatistics> m_statistics;
+    vector<NodeProfileTraceEvent> m_traceEvents;
+    set<int> m_traceRows;
+
+    atomic<int> m_numThreads;
+
+    NodeProfilerState()
+        : m_samplingRate(0), m_startTime(chrono::steady_clock::now()), m_numMinibatchesSeen(0), m_numMinibatchesProfiled(0), m_numEventsUsed(0), m_numThreads(0)
+    {
+    }
+
+    static NodeProfilerState& GetInstance()
+    {
+        static NodeProfilerState instance;
+        return instance;
+    }
+
+    double Now() const
+    {
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - m_startTime).count();
+    }
+
+    GPUEvent* GetEvent(DEVICEID_TYPE deviceId)
+    {
+        // pooled events are normally all of the same device, as are the networks of one process
+        if (m_numEventsUsed < m_events.size() && m_events[m_numEventsUsed].first != deviceId)
+            m_events.resize(m_numEventsUsed);
+        if (m_numEventsUsed == m_events.size())
+            m_events.push_back(make_pair(deviceId, unique_ptr<GPUEvent>(new GPUEvent(deviceId, /*enableTiming=*/true))));
+        return m_events[m_numEventsUsed++].second.get();
+    }
+};
+
+/*static*/ bool NodeProfiler::s_profilingMinibatch = false;
+
+/*static*/ void NodeProfiler::Configure(double samplingRate, const wstring& traceFilePath)
+{
+    if (samplingRate < 0 || samplingRate > 1)
+        InvalidArgument("NodeProfiler: The sampling rate must be between 0 and 1, but is %f.", samplingRate);
+
+    auto& state = NodeProfilerState::GetInstance();
+    state.m_samplingRate = samplingRate;
+    state.m_traceFilePath = traceFilePath;
+    state.m_numMinibatchesSeen = 0;
+}
+
+/*static*/ bool NodeProfiler::IsEnabled()
+{
+    return NodeProfilerState::GetInstance().m_samplingRate > 0;
+}
+
+/*static*/ void NodeProfiler::BeginMinibatch()
+{
+    auto& state = NodeProfilerState::GetInstance();
+    if (state.m_samplingRate <= 0)
+        return;
+
+    // profile minibatches evenly spread at the given rate
+    size_t n = state.m_numMinibatchesSeen++;
+    s_profilingMinibatch = floor((n + 1) * state.m_samplingRate) > floor(n * state.m_samplingRate);
+    state.m_records.clear();
+    state.m_numEventsUsed = 0;
+}
+
+// device memory taken from the caching allocator and not yet returned
+static long long GetGPUBytesInUse(DEVICEID_TYPE deviceId)
+{
+    let statistics = TracingGPUMemoryAllocator::GetCacheStatistics(deviceId);
+    return (long long) statistics.allocatedBytes - (long long) statistics.cachedBytes;
+}
+
+template <class ElemType>
+static bool TryGetMatrixBytes(const ComputationNodeBasePtr& nodep, size_t& bytes)
+{
+    auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodep);
+    if (!node)
+        return false;
+    bytes = 0;
+    if (node->ValuePtr())
+        bytes += node->Value().GetNumElements() * sizeof(ElemType);
+    if (node->GradientPtr())
+        bytes += node->Gradient().GetNumElements() * sizeof(ElemType);
+    return true;
+}
+
+/*static*/ size_t NodeProfiler::BeginRecord(const ComputationNodeBasePtr& node, Phase phase)
+{
+    static thread_local int t_threadIndex = -1;
+    auto& state = NodeProfilerState::GetInstance();
+    if (t_threadIndex < 0)
+        t_threadIndex = state.m_numThreads++;
+
+    NodeProfileRecord record;
+    record.nodeName = node->NodeName();
+    record.operationName = node->OperationName();
+    record.phase = phase;
+    record.threadIndex = t_threadIndex;
+    record.deviceId = node->GetDeviceId();
+    record.beginEvent = nullptr;
+    record.endEvent = nullptr;
+    record.gpuBytesInUseBegin = 0;
+    record.gpuBytesAllocated = 0;
+    record.matrixBytes = 0;
+
+    lock_guard<mutex> lock(state.m_mutex);
+    if (record.deviceId >= 0)
+    {
+        record.beginEvent = state.GetEvent(record.deviceId);
+        record.endEvent = state.GetEvent(record.deviceId);
+        record.beginEvent->Record();
+        record.gpuBytesInUseBegin = GetGPUBytesInUse(record.deviceId);
+    }
+    record.wallBegin = state.Now();
+    state.m_records.push_back(move(record));
+    return state.m_records.size() - 1;
+}
+
+/*static*/ void NodeProfiler::EndRecord(size_t recordIndex, const ComputationNodeBasePtr& node)
+{
+    auto& state = NodeProfilerState::GetInstance();
+    double wallEnd = state.Now();
+
+    size_t matrixBytes = 0;
+    if (!TryGetMatrixBytes<float>(node, matrixBytes))
+        TryGetMatrixBytes<double>(node, matrixBytes);
+    string shape = node->ShapeDescription();
+    if (node->HasMBLayout())
+        shape += msra::strfun::strprintf(", %d columns", (int) node->GetMBLayout()->GetNumCols());
+
+    lock_guard<mutex> lock(state.m_mutex);
+    auto& record = state.m_records[recordIndex];
+    record.wallEnd = wallEnd;
+    record.matrixBytes = matrixBytes;
+    record.shape = move(shape);
+    if (record.endEvent)
+    {
+        record.endEvent->Record();
+        record.gpuBytesAllocated = GetGPUBytesInUse(record.deviceId) - record.gpuBytesInUseBegin;
+    }
+}
+
+/*static*/ void NodeProfiler::EndMinibatch()
+{
+    if (!s_profilingMinibatch)
+        return;
+    s_profilingMinibatch = false;
+
+    auto& state = NodeProfilerState::GetInstance();
+    state.m_numMinibatchesProfiled++;
+
+    // the GPU time line of the trace is aligned with the wall time of the first GPU node
+    const NodeProfileRecord* gpuReference = nullptr;
+    for (const auto& record : state.m_records)
+    {
+        double gpuMs = 0;
+        double gpuBegin = 0;
+        if (record.endEvent)
+        {
+            record.endEvent->Synchronize();
+            if (!gpuReference)
+                gpuReference = &record;
+            gpuMs = record.endEvent->ElapsedMillisecondsSince(*record.beginEvent);
+            gpuBegin = gpuReference->wallBegin + 1000.0 * record.beginEvent->ElapsedMillisecondsSince(*gpuReference->beginEvent);
+        }
+
+        auto& statistics = state.m_statistics[make_pair(record.nodeName, record.phase)];
+        statistics.operationName = record.operationName;
+        statistics.shape = record.shape;
+        statistics.numCalls++;
+        statistics.wallMs += (record.wallEnd - record.wallBegin) / 1000.0;
+        statistics.gpuMs += gpuMs;
+        statistics.matrixBytes = max(statistics.matrixBytes, record.matrixBytes);
+        statistics.gpuBytesAllocated += record.gpuBytesAllocated;
+
+        if (!state.m_traceFilePath.empty() && state.m_traceEvents.size() + 2 <= MaxTraceEvents)
+        {
+            state.m_traceEvents.push_back(NodeProfileTraceEvent{record.nodeName, record.operationName, record.phase, record.threadIndex,
+                                                                record.wallBegin, record.wallEnd - record.wallBegin, record.shape});
+            state.m_traceRows.insert(record.threadIndex);
+            if (record.endEvent)
+            {
+                int row = -1 - record.deviceId; // GPU rows are negative
+                state.m_traceEvents.push_back(NodeProfileTraceEvent{record.nodeName, record.operationName, record.phase, row,
+                                                                    gpuBegin, 1000.0 * gpuMs, record.shape});
+                state.m_traceRows.insert(row);
+            }
+        }
+    }
+    state.m_records.clear();
+    state.m_numEventsUsed = 0;
+}
+
+static const char* PhaseName(NodeProfiler::Phase phase)
+{
+    return phase == NodeProfiler::Phase::Forward ? "forward" : "backward";
+}
+
+/*static*/ void NodeProfiler::PrintStatistics(FILE* f)
+{
+    auto& state = NodeProfilerState::GetInstance();
+    if (state.m_numMinibatchesProfiled == 0)
+        return;
+
+    typedef pair<const pair<wstring, Phase>, NodeProfileStatistics> Entry;
+    vector<const Entry*> entries;
+    double totalMs = 0;
+    for (const auto& entry : state.m_statistics)
+    {
+        entries.push_back(&entry);
+        totalMs += entry.second.GetMs();
+    }
+    sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) { return a->second.GetMs() > b->second.GetMs(); });
+
+    double numMBs = (double) state.m_numMinibatchesProfiled;
+    fprintf(f, "\nNode profile of %d minibatches, %.3f ms per minibatch (times and allocations per minibatch, most expensive first):\n",
+            (int) state.m_numMinibatchesProfiled, totalMs / numMBs);
+    fprintf(f, "  %-40s %-24s %-8s %6s %10s %10s %6s %10s %10s  %s\n",
+            "node", "operation", "phase", "calls", "wall[ms]", "GPU[ms]", "share", "matrix[MB]", "alloc[MB]", "shape");
+    for (size_t i = 0; i < entries.size() && i < MaxPrintedNodes; i++)
+    {
+        const auto& s = entries[i]->second;
+        fprintf(f, "  %-40ls %-24ls %-8s %6.1f %10.3f %10.3f %5.1f%% %10.2f %10.2f  %s\n",
+                entries[i]->first.first.c_str(), s.operationName.c_str(), PhaseName(entries[i]->first.second),
+                s.numCalls / numMBs, s.wallMs / numMBs, s.gpuMs / numMBs, totalMs > 0 ? 100.0 * s.GetMs() / totalMs : 0.0,
+                s.matrixBytes / 1048576.0, s.gpuBytesAllocated / numMBs / 1048576.0, s.shape.c_str());
+    }
+    if (entries.size() > MaxPrintedNodes)
+        fprintf(f, "  (%d more)\n", (int) (entries.size() - MaxPrintedNodes));
+
+    state.m_statistics.clear();
+    state.m_numMinibatchesProfiled = 0;
+}
+
+// JSON string contents
+static string EscapeJson(const string& s)
+{
+    string res;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            res += '\\';
+        if ((unsigned char) c < 0x20)
+            res += msra::strfun::strprintf("\\u%04x", (int) c);
+        else
+            res += c;
+    }
+    return res;
+}
+
+/*static*/ void NodeProfiler::WriteTrace()
+{
+    auto& state = NodeProfilerState::GetInstance();
+    if (state.m_traceFilePath.empty())
+        return;
+
+    FILE* f = fopenOrDie(state.m_traceFilePath, L"w");
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (int row : state.m_traceRows)
+    {
+        string rowName = row >= 0 ? msra::strfun::strprintf("CPU thread %d", row) : msra::strfun::strprintf("GPU %d", -1 - row);
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", row, rowName.c_str());
+        first = false;
+    }
+    for (const auto& e : state.m_traceEvents)
+    {
+        fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"operation\":\"%s\",\"shape\":\"%s\"}}",
+                first ? "" : ",\n", EscapeJson(msra::strfun::utf8(e.nodeName)).c_str(), PhaseName(e.phase), e.row, e.ts, e.dur,
+                EscapeJson(msra::strfun::utf8(e.operationName)).c_str(), EscapeJson(e.shape).c_str());
+        first = false;
+    }
+    fprintf(f, "\n]}\n");
+    fcloseOrDie(f);
+    fprintf(stderr, "NodeProfiler: Wrote %d trace events to %ls.\n", (int) state.m_traceEvents.size(), state.m_traceFilePath.c_str());
+}
+
+}}}
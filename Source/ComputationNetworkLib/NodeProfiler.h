@@ -0,0 +1,88 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include <string>
+#include <cstdio>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// NodeProfiler -- per-node timing and memory statistics of forward and backward propagation
+//
+// Profiles a sampled fraction of the minibatches, between BeginMinibatch() and EndMinibatch(). For each node
+// run by the PAR traversal (recurrent loops as a whole, and for those only the wall time), it records
+//  - the wall time of the ForwardProp() and Backprop() calls,
+//  - on GPU, the GPU time of the work they issued, using timing GPUEvents,
+//  - the bytes of its value and gradient matrices, and the device memory newly taken by the caching allocator,
+//  - its output shape.
+// These are aggregated per node and phase into a table (PrintStatistics()), and, if a trace file is given,
+// written as Chrome trace events (chrome://tracing) with the wall times on one row per thread and the GPU times on
+// one row per device.
+// Outside of sampled minibatches, a Scope costs one test of a flag. GPU events are only waited for in EndMinibatch().
+// -----------------------------------------------------------------------
+
+class NodeProfiler
+{
+public:
+    enum class Phase
+    {
+        Forward,
+        Backward
+    };
+
+    // Profile the given fraction (0..1) of the minibatches; 0 disables profiling. With a non-empty trace file path,
+    // WriteTrace() writes the events of all profiled minibatches there (up to a limit).
+    static void Configure(double samplingRate, const std::wstring& traceFilePath);
+    static bool IsEnabled();
+
+    // decide whether the coming minibatch is profiled
+    static void BeginMinibatch();
+    // wait for the GPU work of the profiled minibatch and add its records to the statistics
+    static void EndMinibatch();
+
+    // print the aggregated table, most expensive nodes first, and clear the aggregate
+    static void PrintStatistics(FILE* f);
+    // write all trace events collected so far to the trace file
+    static void WriteTrace();
+
+    static bool IsProfilingMinibatch() { return s_profilingMinibatch; }
+
+    // measures one ForwardProp() or Backprop() call of a node
+    class Scope
+    {
+    public:
+        Scope(const ComputationNodeBasePtr& node, Phase phase)
+            : m_recordIndex(SIZE_MAX)
+        {
+            if (IsProfilingMinibatch())
+            {
+                m_node = node;
+                m_recordIndex = BeginRecord(node, phase);
+            }
+        }
+        ~Scope()
+        {
+            if (m_recordIndex != SIZE_MAX)
+                EndRecord(m_recordIndex, m_node);
+        }
+
+        DISABLE_COPY_AND_MOVE(Scope);
+
+    private:
+        ComputationNodeBasePtr m_node;
+        size_t m_recordIndex;
+    };
+
+private:
+    static size_t BeginRecord(const ComputationNodeBasePtr& node, Phase phase);
+    static void EndRecord(size_t recordIndex, const ComputationNodeBasePtr& node);
+
+    static bool s_profilingMinibatch;
+};
+
+}}}
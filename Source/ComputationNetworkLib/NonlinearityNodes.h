@@ -97,6 +97,10 @@ public:
     {
         return opType == binaryWithInputGradient;
     }
+    virtual bool CanRecomputeValue() const override { return true; }
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& /*other*/) const override { return true; }
+    // each output element only depends on the same input element, so the output can overwrite the input, unless the gradient needs the input
+    virtual bool CanComputeInPlace() const override { return opType != binaryWithInputGradient; }
 };
 
 #define UnaryElementWiseWithOpCodeNodeBaseMembers UsingComputationNodeMembersBoilerplate;
@@ -426,6 +430,101 @@ public:
 template class HardmaxNode<float>;
 template class HardmaxNode<double>;
 
+// -----------------------------------------------------------------------
+// TopNHardmax (input, n) -- one-hot codes of the n largest elements of each sample, in descending order
+// The output sample is the input sample with an additional trailing axis of dimension n, e.g. [V x D] -> [V x D x n],
+// where the planes [..., k] are the one-hot codes of the (k+1)-th largest (ties go to the lower index).
+// This is the top-N selection of beam decoding (BS.Seq2Seq.GetTopNTensor()) in one operation, instead of n rounds
+// of Hardmax() and masking. Like Hardmax, this node is not differentiable.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class TopNHardmaxNode : public ComputationNode<ElemType>, public NumInputs<1>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"TopNHardmax"; }
+
+public:
+    TopNHardmaxNode(DEVICEID_TYPE deviceId, const wstring& name, size_t n = 1)
+        : Base(deviceId, name), m_n(n)
+    {
+    }
+    TopNHardmaxNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : TopNHardmaxNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"n"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<TopNHardmaxNode<ElemType>>(nodeP);
+            node->m_n = m_n;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_n;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_n;
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        // move the target matrix to the target device, since below it is accessed as slices which cannot move
+        Input(0)->Value().TransferToDeviceIfNotThere(Value().GetDeviceId(), /*isBeingMoved=*/ false);
+
+        auto values = ValueFor(fr);
+        values.AssignTopNHardmaxOf(Input(0)->ValueFor(fr), m_n);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t /*inputIndex*/, const FrameRange& /*fr*/) override
+    {
+        // cannot back-propagate a gradient, but must not fail either, since it may run inside a decoding loop of a model
+        // being trained, like Hardmax
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& other) const override
+    {
+        auto node = dynamic_cast<const TopNHardmaxNode<ElemType>*>(&other);
+        return node && node->m_n == m_n;
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+
+        let& inputShape = Input(0)->GetSampleLayout();
+        if (m_n == 0 || (isFinalValidationPass && m_n > inputShape.GetNumElements()))
+            InvalidArgument("%ls %ls operation: n (%d) must be between 1 and the number of elements of the input sample [%s].",
+                            NodeName().c_str(), OperationName().c_str(), (int) m_n, string(inputShape).c_str());
+        auto dims = inputShape.GetDims();
+        dims.push_back(m_n);
+        SetDims(TensorShape(dims), HasMBLayout());
+    }
+
+    size_t N() const { return m_n; }
+
+private:
+    size_t m_n; // number of top elements
+};
+
+template class TopNHardmaxNode<float>;
+template class TopNHardmaxNode<double>;
+
 // -----------------------------------------------------------------------
 // If (flag, ifValue, elseValue)
 // -----------------------------------------------------------------------
@@ -8,6 +8,7 @@
 #include "ComputationNode.h"
 #include "InputAndParamNodes.h"
 #include "Matrix.h"
+#include "MPIWrapper.h"
 
 #include <map>
 #include <string>
@@ -114,6 +115,17 @@ public:
         SetDims(TensorShape(value.GetNumRows()), false);
     }
 
+    // restore a value computed earlier for the same data (SGD's preComputeCache); unlike SideLoadFromMatrix(), this keeps the sample layout
+    void SideLoadPreComputedValue(const Matrix<ElemType>& value)
+    {
+        if (value.GetNumElements() != GetSampleLayout().GetNumElements())
+            InvalidArgument("%ls %ls operation: The cached value has %d elements, but the node has %d.", NodeName().c_str(), OperationName().c_str(),
+                            (int) value.GetNumElements(), (int) GetSampleLayout().GetNumElements());
+        UpdateFunctionValuesSize();
+        Value().SetValue(Value().GetNumRows(), Value().GetNumCols(), Value().GetDeviceId(), std::unique_ptr<ElemType[]>(value.CopyToArray()).get());
+        m_hasComputed = true;
+    }
+
 public:
     bool m_hasComputed;
 };
@@ -190,6 +202,50 @@ public:
     }
 
 protected:
+    // Combine the accumulators of the workers, each of which has seen n_r samples with mean m_r and (optionally) variance v_r, normalized by n_r.
+    // With n = sum_r n_r, this is the parallel form of Welford's update (Chan et al.):
+    //   mean = sum_r n_r m_r / n
+    //   var  = sum_r n_r (v_r + (m_r - mean)^2) / n
+    // The sums are formed in double precision on the CPU; for feature statistics, these are small vectors.
+    void AggregateMeanAndVarianceAcrossWorkers(const MPIWrapperPtr& mpi, Matrix<ElemType>& mean, Matrix<ElemType>* var)
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: AggregateAcrossWorkers() called outside accumulation.", NodeName().c_str(), OperationName().c_str());
+        if (!mpi || mpi->NumNodesInUse() <= 1)
+            return;
+
+        size_t dim = mean.GetNumElements();
+        std::unique_ptr<ElemType[]> localMean(mean.CopyToArray());
+        std::vector<double> sums(dim + 1);
+        for (size_t i = 0; i < dim; i++)
+            sums[i] = (double) m_numSamples * localMean[i];
+        sums[dim] = (double) m_numSamples;
+        mpi->AllReduce(sums);
+        double totalNumSamples = sums[dim];
+        if (totalNumSamples == 0)
+            return; // MarkComputed(true) will complain
+        std::vector<ElemType> globalMean(dim);
+        for (size_t i = 0; i < dim; i++)
+            globalMean[i] = (ElemType) (sums[i] / totalNumSamples);
+
+        if (var)
+        {
+            std::unique_ptr<ElemType[]> localVar(var->CopyToArray());
+            sums.resize(dim);
+            for (size_t i = 0; i < dim; i++)
+            {
+                double delta = (double) localMean[i] - globalMean[i];
+                sums[i] = (double) m_numSamples * (localVar[i] + delta * delta);
+            }
+            mpi->AllReduce(sums);
+            for (size_t i = 0; i < dim; i++)
+                localVar[i] = (ElemType) (sums[i] / totalNumSamples);
+            var->SetValue(var->GetNumRows(), var->GetNumCols(), var->GetDeviceId(), localVar.get());
+        }
+        mean.SetValue(mean.GetNumRows(), mean.GetNumCols(), mean.GetDeviceId(), globalMean.data());
+        m_numSamples = (size_t) totalNumSamples;
+    }
+
     size_t m_numSamples; // (SIZE_MAX while outside accumulation state)
     bool IsAccumulating() const { return m_numSamples != SIZE_MAX; }
 };
@@ -198,7 +254,8 @@ protected:
     ComputationNodeBoilerplate;               \
     UsingPreComputedNodeMembers;              \
     using Base::m_numSamples;                 \
-    using Base::IsAccumulating
+    using Base::IsAccumulating;               \
+    using Base::AggregateMeanAndVarianceAcrossWorkers
 
 // -----------------------------------------------------------------------
 // MeanNode (features)
@@ -232,6 +289,11 @@ public:
         // no else branch because ForwardPropNonLooping() already leaves a valid mean in m_value
     }
 
+    virtual void /*IPreComputeNode::*/ AggregateAcrossWorkers(const MPIWrapperPtr& mpi) override
+    {
+        AggregateMeanAndVarianceAcrossWorkers(mpi, Value(), nullptr);
+    }
+
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
         FrameRange fr(Input(0)->GetMBLayout());
@@ -313,6 +375,11 @@ public:
         }
     }
 
+    virtual void /*IPreComputeNode::*/ AggregateAcrossWorkers(const MPIWrapperPtr& mpi) override
+    {
+        AggregateMeanAndVarianceAcrossWorkers(mpi, *m_mean, m_var.get());
+    }
+
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
         FrameRange fr(Input(0)->GetMBLayout());
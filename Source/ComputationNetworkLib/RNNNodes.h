@@ -0,0 +1,174 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "RNNEngine.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// OptimizedRNNStackNode (weights, input, hiddenDims, numLayers = 1, bidirectional = false, recurrentOp = 'lstm')
+//
+// A stack of numLayers LSTM or GRU layers of hiddenDims cells each, computed over the whole minibatch in one go
+// by the cuDNN RNN engine on GPU, and by a GEMM-based engine of the same math otherwise. Layer l > 0 takes the
+// output of layer l-1; if bidirectional, each layer runs both directions and outputs both hidden states stacked.
+//
+// * weights is a LearnableParameter that holds all weights and biases of the stack as one vector; its size must be
+//      given explicitly, see RNNAttributes::GetNumParameters() in RNNEngine.h for the formula and the layout.
+// * input is a sequence; the output is a sequence of the same layout, of dimension hiddenDims (times 2 if bidirectional).
+// * recurrentOp is 'lstm' or 'gru'.
+//
+// The recurrent state starts at zero for every sequence. Sequences that cross minibatch boundaries (truncated BPTT)
+// are computed as if they started and ended at the boundaries. The node cannot be part of a recurrent loop.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class OptimizedRNNStackNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<2>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"OptimizedRNNStack"; }
+
+public:
+    OptimizedRNNStackNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name), m_hiddenSize(0), m_numLayers(1), m_bidirectional(false), m_recurrentOp(L"lstm"), m_backwardDataDone(false)
+    {
+    }
+    OptimizedRNNStackNode(DEVICEID_TYPE deviceId, const wstring& name, size_t hiddenSize, size_t numLayers, bool bidirectional, const wstring& recurrentOp)
+        : Base(deviceId, name), m_hiddenSize(hiddenSize), m_numLayers(numLayers), m_bidirectional(bidirectional), m_recurrentOp(recurrentOp), m_backwardDataDone(false)
+    {
+    }
+    OptimizedRNNStackNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : OptimizedRNNStackNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"hiddenDims"), configp->Get(L"numLayers"),
+                                configp->Get(L"bidirectional"), configp->Get(L"recurrentOp"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_hiddenSize;
+        fstream << m_numLayers;
+        fstream << m_bidirectional;
+        fstream << m_recurrentOp;
+    }
+
+    void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_hiddenSize;
+        fstream >> m_numLayers;
+        fstream >> m_bidirectional;
+        fstream >> m_recurrentOp;
+    }
+
+    void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<OptimizedRNNStackNode<ElemType>>(nodeP);
+            assert(node != nullptr);
+
+            node->m_hiddenSize = m_hiddenSize;
+            node->m_numLayers = m_numLayers;
+            node->m_bidirectional = m_bidirectional;
+            node->m_recurrentOp = m_recurrentOp;
+        }
+    }
+
+    void ForwardPropNonLooping() override
+    {
+        // The engine wants the sequences clipped to the minibatch, gaps left out.
+        let& pMBLayout = GetMBLayout();
+        m_sequences = pMBLayout->GetClippedSequences();
+
+        m_rnnEngine->Forward(Input(1)->Value(), Input(0)->Value(), Value(), pMBLayout->GetNumParallelSequences(), m_sequences, *m_reserve);
+        m_backwardDataDone = false;
+    }
+
+    void BackpropToNonLooping(size_t inputIndex) override
+    {
+        // The data gradient is computed once and goes first, since the weight gradient needs its intermediate results.
+        if (!m_backwardDataDone)
+        {
+            Matrix<ElemType> noInputGrad(m_deviceId);
+            m_rnnEngine->BackwardData(Value(), Gradient(), Input(0)->Value(),
+                                      Input(1)->NeedsGradient() ? Input(1)->Gradient() : noInputGrad, *m_reserve);
+            m_backwardDataDone = true;
+        }
+
+        if (inputIndex == 0) // derivative with respect to the weights
+            m_rnnEngine->BackwardWeights(Input(1)->Value(), Value(), Input(0)->Gradient(), *m_reserve);
+        // The derivative with respect to the input was added above.
+    }
+
+    void Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+
+        RNNAttributes attributes(RNNKindFrom(m_recurrentOp), m_hiddenSize, m_numLayers, m_bidirectional);
+        SetDims(TensorShape(attributes.GetOutputDim()), HasMBLayout());
+
+        if (isFinalValidationPass)
+        {
+            if (!Input(1)->HasMBLayout())
+                InvalidArgument("%ls %ls operation requires the input to be a sequence.", NodeName().c_str(), OperationName().c_str());
+            if (Input(0)->HasMBLayout())
+                InvalidArgument("%ls %ls operation requires the weights to be a parameter, not a sequence.", NodeName().c_str(), OperationName().c_str());
+            if (m_hiddenSize == 0 || m_numLayers == 0)
+                InvalidArgument("%ls %ls operation requires hiddenDims and numLayers to be positive.", NodeName().c_str(), OperationName().c_str());
+
+            size_t inputDim = Input(1)->GetSampleLayout().GetNumElements();
+            size_t numParameters = attributes.GetNumParameters(inputDim);
+            if (Input(0)->GetSampleLayout().GetNumElements() != numParameters)
+                InvalidArgument("%ls %ls operation: the weights have %d elements, but %d are needed for %d %ls layers of %d cells on %d-dimensional input%ls.",
+                                NodeName().c_str(), OperationName().c_str(), (int)Input(0)->GetSampleLayout().GetNumElements(), (int)numParameters,
+                                (int)m_numLayers, m_recurrentOp.c_str(), (int)m_hiddenSize, (int)inputDim, m_bidirectional ? L", bidirectional" : L"");
+
+            if (m_rnnEngine == nullptr)
+                m_rnnEngine = RNNEngine<ElemType>::Create(m_deviceId, attributes, inputDim);
+        }
+    }
+
+    void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_reserve, matrixPool);
+    }
+
+    void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_reserve, matrixPool);
+    }
+
+private:
+    size_t m_hiddenSize;
+    size_t m_numLayers;
+    bool m_bidirectional;
+    // 'lstm' or 'gru'
+    wstring m_recurrentOp;
+
+    // sequences of the current minibatch, as passed to the engine
+    std::vector<RNNSequence> m_sequences;
+    // Intermediate results of the forward pass that are used in gradient computation.
+    shared_ptr<Matrix<ElemType>> m_reserve;
+    bool m_backwardDataDone;
+
+    std::unique_ptr<RNNEngine<ElemType>> m_rnnEngine;
+};
+
+template class OptimizedRNNStackNode<float>;
+template class OptimizedRNNStackNode<double>;
+
+}}}
@@ -84,7 +84,7 @@ protected:
 //  - full support/efficiency of non-recurrent use (in which case the range can be from negative to positive, e.g. a symmetric rolling window)
 //  - denoting which tensor dimension to loop over (this may not be completed, but I will plant a seed)
 //  - support for Yongqiang's sub-minibatching with truncated BPTT (export/import state)
-//  - more efficient storage of carried-over state (only store the needed frames, not a full copy of the previous MB as currently; which will on the other hand also allow windows that reach back beyond a minibatch)
+//  - windows that reach back beyond a minibatch (the carried-over state is only the needed frames, see EndForwardProp())
 // -----------------------------------------------------------------------
 
 // TODO: 'direction' is really too general. signOfTimeOffset?
@@ -191,14 +191,37 @@ public:
         inputIndex;
 
         // special case: DelayedValueNodes may be used outside of loops
-        // TODO: this should be a bulk operation; this implementation is a quick hack
-        int dir = direction; // (this avoids a 'conditional expression is constant' warning)
+        // Runs of frames that propagate as a whole (no boundary or gap, and delayed frame inside the minibatch) are one
+        // shifted addition over consecutive columns; the others frame by frame.
         if (fr.IsAllFrames())
         {
-            // recursive call to ourselves
-            FrameRangeIteration range(m_pMBLayout, -dir);
-            for (auto t = range.rbegin(); t != range.rend(); t++) // note: reverse iterator
-                BackpropTo(inputIndex, t);
+            size_t numParallelSequences = GetNumParallelSequences();
+            int timeOffset = direction * m_timeStep;
+            auto isShifted = [&](size_t t)
+            {
+                int t_delayed = (int) t + timeOffset;
+                FrameRange frT(m_pMBLayout, t);
+                return t_delayed >= 0 && t_delayed < (int) GetNumTimeSteps() && !m_pMBLayout->IsGap(frT) && !m_pMBLayout->IsBeyondStartOrEnd(frT.WithTimeOffset(timeOffset));
+            };
+            Matrix<ElemType> frm = GradientFor(fr);
+            Matrix<ElemType> to = Input(0)->GradientFor(fr);
+            size_t end;
+            for (size_t begin = 0; begin < GetNumTimeSteps(); begin = end)
+            {
+                bool shifted = isShifted(begin);
+                for (end = begin + 1; end < GetNumTimeSteps() && isShifted(end) == shifted; end++)
+                    ;
+                if (shifted)
+                {
+                    Matrix<ElemType> toRun = to.ColumnSlice((begin + timeOffset) * numParallelSequences, (end - begin) * numParallelSequences);
+                    toRun += frm.ColumnSlice(begin * numParallelSequences, (end - begin) * numParallelSequences);
+                }
+                else
+                {
+                    for (size_t t = begin; t < end; t++)
+                        BackpropTo(inputIndex, FrameRange(m_pMBLayout, t));
+                }
+            }
             return;
         }
 
@@ -216,18 +239,25 @@ public:
             //       m_pMBLayout->IsGap(fr) || m_pMBLayout->IsBeyondStartOrEnd(frDelayed));
             if (m_pMBLayout->IsGap(fr) || m_pMBLayout->IsBeyondStartOrEnd(frDelayed)) // true if at least one parallel sequence has a boundary or gap
             {
+                // The parallel sequences are adjacent columns of the time step, so runs of consecutive sequences that propagate
+                // are done in one go, instead of sequence by sequence.
+                Matrix<ElemType> frm = GradientFor(fr);
+                Matrix<ElemType> to = Input(0)->GradientFor(frDelayed);
                 size_t mNbr = m_pMBLayout->GetNumParallelSequences();
-                for (size_t id = 0; id < mNbr; id++)
+                auto propagates = [&](size_t id) // don't propagate boundary frames or gaps
+                {
+                    return !(m_pMBLayout->IsGap(fr.Sequence(id)) || m_pMBLayout->IsBeyondStartOrEnd(frDelayed.Sequence(id)));
+                };
+                size_t end;
+                for (size_t begin = 0; begin < mNbr; begin = end)
                 {
-                    // assert(m_pShiftedMBLayout->Is(id, t, SequenceStart_or_End | MinibatchPackingFlags::NoFeature) ==
-                    //       m_pMBLayout->IsGap(fr.Sequence(id)) || m_pMBLayout->IsBeyondStartOrEnd(frDelayed.Sequence(id)));
-                    if (!(m_pMBLayout->IsGap(fr.Sequence(id)) || m_pMBLayout->IsBeyondStartOrEnd(frDelayed.Sequence(id)))) // don't propagate boundary frames or gaps
+                    bool propagate = propagates(begin);
+                    for (end = begin + 1; end < mNbr && propagates(end) == propagate; end++)
+                        ;
+                    if (propagate)
                     {
-                        Matrix<ElemType> frm = GradientFor(fr.Sequence(id));
-                        // TODO: use delayed FrameRange here as well
-                        // Matrix<ElemType> to = Input(0)->GradientFor(FrameRange(m_pMBLayout, t_delayed).Sequence(id));
-                        Matrix<ElemType> to = Input(0)->GradientFor(frDelayed.Sequence(id));
-                        to += frm;
+                        Matrix<ElemType> toRun = to.ColumnSlice(begin, end - begin);
+                        toRun += frm.ColumnSlice(begin, end - begin);
                     }
                 }
             }
@@ -249,16 +279,26 @@ public:
     {
         // In truncated BPTT, we carry over left-to-right state across minibatches.
         // It is kept in m_delayedValue, m_delayedActivationMBLayout.
-        // This could be optimized as follows:
-        //  - only keep the required number of frames (m_timeStep)
-        //  - we don't need to keep anything in full-sequence mode
-        //  - we don't need to keep anything if all sequences are closed (sentence end)
-        //    This condition includes full-sequence mode.
+        // Only the frames that the next minibatch can reach are kept: the last m_timeStep ones (the first ones for FutureValue),
+        // copied into the same buffer every time. Streaming evaluation needs all frames, since its sequences end at different times.
         // TODO: Can we optimize this and only copy if there is a sequence spanning across the end of the MB? And add a check to BeginForwardProp() to make sure we got one if there is a boundary at the start?
-        m_delayedValue.SetValue(Input(0)->Value());
-        if (!m_delayedActivationMBLayout)
-            m_delayedActivationMBLayout = make_shared<MBLayout>();
-        m_delayedActivationMBLayout->CopyFrom(m_pMBLayout);
+        if (m_carryAllFrames)
+        {
+            m_delayedValue.SetValue(Input(0)->Value());
+            if (!m_delayedActivationMBLayout)
+                m_delayedActivationMBLayout = make_shared<MBLayout>();
+            m_delayedActivationMBLayout->CopyFrom(m_pMBLayout);
+        }
+        else
+        {
+            size_t numTimeSteps = GetNumTimeSteps();
+            size_t numParallelSequences = GetNumParallelSequences();
+            size_t numFrames = min((size_t) m_timeStep, numTimeSteps);
+            int dir = direction; // (this avoids a 'conditional expression is constant' warning)
+            size_t firstFrame = dir < 0 ? numTimeSteps - numFrames : 0;
+            m_delayedValue.SetValue(Input(0)->Value().ColumnSlice(firstFrame * numParallelSequences, numFrames * numParallelSequences));
+            InitDelayedActivationMBLayout(numParallelSequences, numFrames);
+        }
 
         Base::EndForwardProp();
     }
@@ -270,14 +310,36 @@ public:
         assert(m_pMBLayout);
 
         // special case: DelayedValueNodes may be used outside of loops
-        // TODO: this should be a bulk operation; this implementation is a quick hack
-        int dir = direction; // (this avoids a 'conditional expression is constant' warning)
+        // Runs of frames whose delayed frame is inside the minibatch and crosses no boundary are a shifted view of the input,
+        // copied in one go over consecutive columns (gaps are copied along, as below); the others frame by frame.
         if (fr.IsAllFrames())
         {
-            // recursive call to ourselves
-            FrameRangeIteration range(m_pMBLayout, -dir);
-            for (auto t = range.begin(); t != range.end(); t++)
-                ForwardProp(t);
+            size_t numParallelSequences = GetNumParallelSequences();
+            int timeOffset = direction * m_timeStep;
+            auto isShifted = [&](size_t t)
+            {
+                int t_delayed = (int) t + timeOffset;
+                return t_delayed >= 0 && t_delayed < (int) GetNumTimeSteps() && !m_pMBLayout->IsBeyondStartOrEnd(FrameRange(m_pMBLayout, t).WithTimeOffset(timeOffset));
+            };
+            Matrix<ElemType> out = ValueFor(fr);
+            Matrix<ElemType> in = Input(0)->ValueFor(fr);
+            size_t end;
+            for (size_t begin = 0; begin < GetNumTimeSteps(); begin = end)
+            {
+                bool shifted = isShifted(begin);
+                for (end = begin + 1; end < GetNumTimeSteps() && isShifted(end) == shifted; end++)
+                    ;
+                if (shifted)
+                {
+                    Matrix<ElemType> outRun = out.ColumnSlice(begin * numParallelSequences, (end - begin) * numParallelSequences);
+                    outRun.AssignValuesOf(in.ColumnSlice((begin + timeOffset) * numParallelSequences, (end - begin) * numParallelSequences));
+                }
+                else
+                {
+                    for (size_t t = begin; t < end; t++)
+                        ForwardProp(FrameRange(m_pMBLayout, t));
+                }
+            }
             return;
         }
 
@@ -295,33 +357,39 @@ public:
 
         Matrix<ElemType> inp((DEVICEID_TYPE)m_value->GetDeviceId());
 
-        // if any sequence at this time step has a boundary flag, then process one by one
-        // TODO: Would there be an efficiency gain from grouping consecutive sequences with identical flags?
+        // if any sequence at this time step has a boundary flag, then process the sequences separately
+        // The parallel sequences are adjacent columns of the time step, so runs of consecutive sequences with the same flags are
+        // processed in one go. Gaps, which are never read, are filled like boundaries, so that they do not break up the runs.
         // assert(m_pShiftedMBLayout->Is(t, SequenceStart_or_End) == m_pMBLayout->IsBeyondStartOrEnd(frDelayed));
         if (m_pMBLayout->IsBeyondStartOrEnd(frDelayed))
         {
-            for (size_t id = 0; id < GetNumParallelSequences(); id++)
+            Matrix<ElemType> out = ValueFor(fr);
+            size_t numParallelSequences = GetNumParallelSequences();
+            auto isBoundaryOrGap = [&](size_t id)
             {
-                if (m_pMBLayout->IsGap(fr.Sequence(id))) // if output is in a gap then don't bother filling it
-                    continue;
-
-                Matrix<ElemType> out = ValueFor(fr.Sequence(id));
-
                 // assert(m_pShiftedMBLayout->Is(id, t, SequenceStart_or_End) == m_pMBLayout->IsBeyondStartOrEnd(frDelayed.Sequence(id)));
-                if (m_pMBLayout->IsBeyondStartOrEnd(frDelayed.Sequence(id)))
-                    out.SetValue(m_initialActivationValue); // crossed a boundary
-                else                                        // not a boundary: just copy the delayed value
+                return m_pMBLayout->IsGap(fr.Sequence(id)) || m_pMBLayout->IsBeyondStartOrEnd(frDelayed.Sequence(id));
+            };
+            size_t end;
+            for (size_t begin = 0; begin < numParallelSequences; begin = end)
+            {
+                bool isBoundary = isBoundaryOrGap(begin);
+                for (end = begin + 1; end < numParallelSequences && isBoundaryOrGap(end) == isBoundary; end++)
+                    ;
+                Matrix<ElemType> outRun = out.ColumnSlice(begin, end - begin);
+                if (isBoundary)
+                    outRun.SetValue(m_initialActivationValue); // crossed a boundary
+                else                                           // not a boundary: just copy the delayed value
                 {
                     // inside the sequence: access delayed value
                     if (t_delayed < 0)
-                        inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed + T_delayedActivation).Sequence(id), m_delayedActivationMBLayout); // delay reaches in previous minibatch
+                        inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed + T_delayedActivation), m_delayedActivationMBLayout); // delay reaches in previous minibatch
                     else if (t_delayed >= T)
-                        inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed - T).Sequence(id), m_delayedActivationMBLayout); // delay reaches in previous minibatch
+                        inp = DataWithMBLayoutFor(m_delayedValue, FrameRange(m_delayedActivationMBLayout, t_delayed - T), m_delayedActivationMBLayout); // delay reaches in previous minibatch
                     else
-                        inp = Input(0)->ValueFor(frDelayed.Sequence(id));
-                    // inp = Input(0)->ValueFor(FrameRange(m_pMBLayout, t_delayed).Sequence(id));
+                        inp = Input(0)->ValueFor(frDelayed);
 
-                    out.AssignValuesOf(inp);
+                    outRun.AssignValuesOf(inp.ColumnSlice(begin, end - begin));
                 }
             }
         }
@@ -391,7 +459,7 @@ public:
     virtual NodeStatePtr /*IStatefulNode::*/ ExportState() override
     {
         NodeStatePtr pExportedState;
-        size_t nT = m_pMBLayout->GetNumTimeSteps();
+        size_t nT = m_delayedActivationMBLayout->GetNumTimeSteps(); // frames carried over, see EndForwardProp()
         size_t nU = m_pMBLayout->GetNumParallelSequences();
         int dir = direction;
         if (m_timeStep != 1)
@@ -426,7 +494,7 @@ public:
             else
             {
                 auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
-                pState->CacheState(m_delayedValue.ColumnSlice((nT - 1) * nU, nU));
+                pState->CacheState(m_delayedValue.ColumnSlice(0, nU)); // the first frame, which ImportState() restores
                 pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
                 pExportedState = pState;
             }
@@ -464,11 +532,72 @@ public:
             LogicError("Unrecognized direction in DelayedValueNodeBase");
     }
 
+    // Streaming evaluation carries the state of a parallel sequence over to a later minibatch, in which it may be
+    // another parallel sequence. The state is the last m_timeStep input frames of the sequence, one column each.
+
+    // updates the state of parallel sequence s of the last minibatch, whose frames end before time step tEnd;
+    // if the minibatch has fewer than m_timeStep of them, the latest frames of the previous state are kept in front
+    void UpdateSequenceState(size_t s, size_t tEnd, Matrix<ElemType>& state) const
+    {
+        int dir = direction; // (this avoids a 'conditional expression is constant' warning)
+        if (dir != -1)
+            LogicError("UpdateSequenceState: Only past values can be carried over to a later minibatch.");
+
+        size_t numRows = m_delayedValue.GetNumRows();
+        size_t numParallelSequences = m_delayedActivationMBLayout->GetNumParallelSequences();
+        size_t timeStep = m_timeStep;
+        if (state.GetNumRows() != numRows || state.GetNumCols() != timeStep)
+        {
+            state.Resize(numRows, timeStep);
+            state.SetValue(m_initialActivationValue);
+        }
+
+        size_t numNewFrames = min(tEnd, timeStep);
+        if (numNewFrames < timeStep)
+            state.SetColumnSlice(state.ColumnSlice(numNewFrames, timeStep - numNewFrames).DeepClone(), 0, timeStep - numNewFrames);
+        for (size_t k = 0; k < numNewFrames; k++)
+            state.SetColumnSlice(m_delayedValue.ColumnSlice((tEnd - numNewFrames + k) * numParallelSequences + s, 1), timeStep - numNewFrames + k, 1);
+    }
+
+    // sets the frames that the next minibatch continues from to the states of its parallel sequences, as given by
+    // UpdateSequenceState(), or nullptr for a sequence that starts in the minibatch
+    void SetSequenceStates(const std::vector<const Matrix<ElemType>*>& states)
+    {
+        m_carryAllFrames = true; // UpdateSequenceState() reads the frames up to the end of each sequence
+        int dir = direction; // (this avoids a 'conditional expression is constant' warning)
+        if (dir != -1)
+            LogicError("SetSequenceStates: Only past values can be carried over from an earlier minibatch.");
+
+        size_t numParallelSequences = states.size();
+        m_delayedValue.Resize(GetSampleLayout().GetNumElements(), m_timeStep * numParallelSequences);
+        m_delayedValue.SetValue(m_initialActivationValue);
+        for (size_t s = 0; s < numParallelSequences; s++)
+        {
+            if (!states[s])
+                continue;
+            for (size_t k = 0; k < (size_t)m_timeStep; k++)
+                m_delayedValue.SetColumnSlice(states[s]->ColumnSlice(k, 1), k * numParallelSequences + s, 1);
+        }
+
+        InitDelayedActivationMBLayout(numParallelSequences, m_timeStep);
+    }
+
 protected:
+    // layout of carried-over frames in m_delayedValue: one sequence per parallel sequence, spanning all of them
+    void InitDelayedActivationMBLayout(size_t numParallelSequences, size_t numTimeSteps)
+    {
+        if (!m_delayedActivationMBLayout)
+            m_delayedActivationMBLayout = make_shared<MBLayout>();
+        m_delayedActivationMBLayout->Init(numParallelSequences, numTimeSteps);
+        for (size_t s = 0; s < numParallelSequences; s++)
+            m_delayedActivationMBLayout->AddSequence(NEW_SEQUENCE_ID, s, 0, numTimeSteps);
+    }
+
     ElemType m_initialActivationValue;       // starting value for hidden activation vector at boundary
     Matrix<ElemType> m_delayedValue;         // saves the activation of the previous step that this node points to
     MBLayoutPtr m_delayedActivationMBLayout; // layout for m_delayedValue
     int m_timeStep;                          // delay in frames (typ. 1)
+    bool m_carryAllFrames = false;           // carry over all frames of the minibatch, not only those the next one can reach (streaming evaluation)
     function<void()> m_attachInputsFn;       // for late expansion of inputs (scripting)
 };
 
@@ -193,6 +193,11 @@ template <class ElemType>
     let& inMBLayout = Input(0)->GetMBLayout();
     let& input = Input(0)->Value();
     let& sequences = inMBLayout->GetAllSequences();
+    // read the condition values in one go, rather than by element access (which would move the input to the CPU)
+    auto& condition = m_conditionBuffer;
+    condition.resize(input.GetNumElements());
+    if (!condition.empty())
+        input.CopySection(1, input.GetNumCols(), condition.data(), 1);
     auto& indexSequences = m_indexSequenceBuffer;
     if (indexSequences.size() < sequences.size())
         indexSequences.resize(sequences.size());
@@ -204,11 +209,9 @@ template <class ElemType>
         auto& indexSequence = indexSequences[i];
         indexSequence.clear();
         for (size_t t = 0; t < seq.GetNumTimeSteps(); t++)
-            if (input(0, inMBLayout->GetColumnIndex(seq, t))) // this is the condition check that this node performs; the meat
+            if (condition[inMBLayout->GetColumnIndex(seq, t)]) // this is the condition check that this node performs; the meat
                 indexSequence.push_back(t);
-        // Note: The above accesses m_value directly on the CPU, putting it into BOTH state, possibly for other consumers as well.
     }
-    input.CollapseDataLocation(); // BUGBUG: Move back, since BOTH state is broken at present.
     // create a new MBLayout
     let& outMBLayout = GetMBLayout();
     outMBLayout->InitAsPackedSequences(SequenceLengthVector(sequences, indexSequences), /*temp*/m_placementBuffer, /*temp*/m_rowAllocationsBuffer);
@@ -229,9 +232,8 @@ template <class ElemType>
         assert(sequences[i].seqId == GAP_SEQUENCE_ID);
     for (size_t i = size; i < outMBLayout->GetAllSequences().size(); i++)
         assert(outMBLayout->GetAllSequences()[i].seqId == GAP_SEQUENCE_ID);
-    // the result will be kept in CPUDEVICE, since most likely we will access it again in PackedIndexNode
-    Value().TransferToDeviceIfNotThere(CPUDEVICE, /*isBeingMoved=*/ true, /*emptyTransfer=*/ true, /*updatePreferredDevice=*/ true);
-    Value().SetValue(1, outMBLayout->GetNumCols(), CPUDEVICE, buf.data(), MatrixFormat::matrixFormatColMajor);
+    // the result goes to our device, where PackedIndexNode maps it
+    Value().SetValue(1, outMBLayout->GetNumCols(), m_deviceId, buf.data(), MatrixFormat::matrixFormatColMajor);
 }
 
 template <class ElemType>
@@ -273,9 +275,23 @@ template <class ElemType>
     let& indexMBLayout  = Input(INDEXDATA)->GetMBLayout();
     let&  index  = Input(INDEXDATA)->Value(); // per-seq index values that are to be mapped
     auto& result =                   Value(); // packed index values as mapped to sourceData's layout
-    // loop over sourceSequences
     // Input matrix contains time indices for each sequence that refer to frames inside that sequence.
     // We replace every per-sequence index by the resolved column index w.r.t. the same MBLayout.
+    if (!m_sequenceMap || *m_sequenceMapSourceLayout != *sourceMBLayout || *m_sequenceMapIndexLayout != *indexMBLayout)
+        UpdateSequenceMap();
+    result.AssignPackedIndicesOf(index, *m_sequenceMap, sourceMBLayout->GetNumParallelSequences());
+}
+
+// build m_sequenceMap: for every column of indexData, where the sequence it refers to sits in sourceData
+template <class ElemType>
+void PackedIndexNode<ElemType>::UpdateSequenceMap()
+{
+    let& sourceMBLayout = Input(SOURCEDATA)->GetMBLayout();
+    let& indexMBLayout  = Input(INDEXDATA)->GetMBLayout();
+    let numParallelSequences = (ptrdiff_t)sourceMBLayout->GetNumParallelSequences();
+    let numTimeSteps         = (ptrdiff_t)sourceMBLayout->GetNumTimeSteps();
+    vector<ElemType> buf(3 * indexMBLayout->GetNumCols(), numeric_limits<ElemType>::quiet_NaN()); // gaps keep the NaN
+    // loop over sourceSequences
     let& sourceSequences = sourceMBLayout->GetAllSequences();
     for (size_t i = 0; i < sourceSequences.size(); i++)
     {
@@ -283,16 +299,27 @@ template <class ElemType>
         if (sourceSeq.seqId == GAP_SEQUENCE_ID)
             continue;
         let& indexSeq = indexMBLayout->FindSequence(sourceSeq.seqId);          // find corresponding entry in indexMBLayout
+        let base  = sourceSeq.tBegin * numParallelSequences + (ptrdiff_t)sourceSeq.s; // column of time step 0 (which may lie before the minibatch)
+        let begin = max(-sourceSeq.tBegin, (ptrdiff_t)0);                      // range of time steps inside the minibatch (this is the range check)
+        let end   = min((ptrdiff_t)sourceSeq.GetNumTimeSteps(), numTimeSteps - sourceSeq.tBegin);
         for (size_t tIndex = 0; tIndex < indexSeq.GetNumTimeSteps(); tIndex++) // map all index values in index sequence
         {
-            let jIndex  = indexMBLayout->GetColumnIndex(indexSeq, tIndex);    // map time index to actual location in the matrix storage object
-            let tSource = (size_t)index(0, jIndex);                           // the new time location (relative to source sequence)
-            let jSource = sourceMBLayout->GetColumnIndex(sourceSeq, tSource); // map new time index as well. This performs a range check.
-            result(0, jIndex) = (ElemType)jSource;
+            let jIndex = indexMBLayout->GetColumnIndex(indexSeq, tIndex);      // map time index to actual location in the matrix storage object
+            buf[3 * jIndex]     = (ElemType)base;
+            buf[3 * jIndex + 1] = (ElemType)begin;
+            buf[3 * jIndex + 2] = (ElemType)end;
         }
     }
-    // Note: maybe this is no longer needed, now that we do the same inside UpdateFunctionValueSize() for all nodes.
-    result.CollapseDataLocation(); // BUGBUG: Move back, since BOTH state is broken at present.
+    CreateMatrixIfNull(m_sequenceMap);
+    m_sequenceMap->SetValue(3, indexMBLayout->GetNumCols(), m_deviceId, buf.data(), MatrixFormat::matrixFormatColMajor);
+    // remember what it was built for
+    if (!m_sequenceMapSourceLayout)
+    {
+        m_sequenceMapSourceLayout = make_shared<MBLayout>();
+        m_sequenceMapIndexLayout  = make_shared<MBLayout>();
+    }
+    m_sequenceMapSourceLayout->CopyFrom(sourceMBLayout);
+    m_sequenceMapIndexLayout->CopyFrom(indexMBLayout);
 }
 
 template <class ElemType>
@@ -337,6 +364,14 @@ template <class ElemType>
     output.DoGatherColumnsOf(/*beta=*/0, index, source, /*alpha=*/1);
 }
 
+// true if the index values come from PackedIndex(x, Where(cond)), which never refers to a column twice
+template <class ElemType>
+static bool HasUniquePackedIndices(const ComputationNodeBasePtr& indexNode)
+{
+    let packedIndexNode = dynamic_pointer_cast<PackedIndexNode<ElemType>>(indexNode);
+    return packedIndexNode && packedIndexNode->HasUniqueIndices();
+}
+
 template <class ElemType>
 /*virtual*/ void GatherPackedNode<ElemType>::BackpropToNonLooping(size_t inputIndex) /*override*/
 {
@@ -345,7 +380,7 @@ template <class ElemType>
         let&  index          = Input(INDEXDATA)->Value();     // column indices to copy from
         auto& sourceGradient = Input(SOURCEDATA)->Gradient(); // source to propagate the gradient intpu
         auto& outputGradient =                    Gradient(); // output gradient to propagate
-        sourceGradient.DoScatterColumnsOf(/*beta=*/1, index, outputGradient, /*alpha=*/1);
+        sourceGradient.DoScatterColumnsOf(/*beta=*/1, index, outputGradient, /*alpha=*/1, HasUniquePackedIndices<ElemType>(Input(INDEXDATA)));
     }
 }
 
@@ -395,7 +430,7 @@ template <class ElemType>
     let&  index = Input(INDEXDATA)->Value();  // column indices to copy from
     let&  source = Input(SOURCEDATA)->Value(); // source data to copy
     auto& output =                    Value(); // output goes here
-    output.DoScatterColumnsOf(/*beta=*/0, index, source, /*alpha=*/1);
+    output.DoScatterColumnsOf(/*beta=*/0, index, source, /*alpha=*/1, HasUniquePackedIndices<ElemType>(Input(INDEXDATA)));
 }
 
 template <class ElemType>
@@ -432,4 +467,77 @@ template <class ElemType>
 template class ScatterPackedNode<float>;
 template class ScatterPackedNode<double>;
 
+// -----------------------------------------------------------------------
+// ContextWindowNode(input, leftContext, rightContext) -- stack neighbor frames
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+/*virtual*/ void ContextWindowNode<ElemType>::ForwardPropNonLooping() /*override*/
+{
+    if (!m_windowIndex || *m_windowIndexLayout != *Input(0)->GetMBLayout())
+        UpdateWindowIndex();
+    // The output viewed as [inputRows x (windowSize * cols)] is a plain column gather from the input.
+    let&  input  = Input(0)->Value();
+    auto  output = Value().Reshaped(input.GetNumRows(), GetWindowSize() * input.GetNumCols());
+    output.DoGatherColumnsOf(/*beta=*/0, *m_windowIndex, input, /*alpha=*/1);
+}
+
+template <class ElemType>
+/*virtual*/ void ContextWindowNode<ElemType>::BackpropToNonLooping(size_t /*inputIndex*/) /*override*/
+{
+    // each input frame is used up to windowSize times (more at the boundaries), so this is a scatter with shared targets
+    auto& inputGradient  = Input(0)->Gradient();
+    let   outputGradient = Gradient().Reshaped(inputGradient.GetNumRows(), GetWindowSize() * inputGradient.GetNumCols());
+    inputGradient.DoScatterColumnsOf(/*beta=*/1, *m_windowIndex, outputGradient, /*alpha=*/1);
+}
+
+// build m_windowIndex: for every window position of every frame, the column of the (boundary-clamped) neighbor frame
+template <class ElemType>
+void ContextWindowNode<ElemType>::UpdateWindowIndex()
+{
+    let& pMBLayout = Input(0)->GetMBLayout();
+    let numParallelSequences = (ptrdiff_t)pMBLayout->GetNumParallelSequences();
+    let numTimeSteps         = (ptrdiff_t)pMBLayout->GetNumTimeSteps();
+    let windowSize = GetWindowSize();
+    vector<ElemType> buf(windowSize * pMBLayout->GetNumCols(), (ElemType)-1); // gaps stay at -1
+    for (let& seq : pMBLayout->GetAllSequences())
+    {
+        if (seq.seqId == GAP_SEQUENCE_ID)
+            continue;
+        let begin = max(seq.tBegin, (ptrdiff_t)0); // range of time steps inside the minibatch
+        let end   = min((ptrdiff_t)seq.tEnd, numTimeSteps);
+        for (ptrdiff_t t = begin; t < end; t++)
+        {
+            let j = t * numParallelSequences + (ptrdiff_t)seq.s;
+            for (size_t k = 0; k < windowSize; k++)
+            {
+                let tNeighbor = min(max(t + (ptrdiff_t)k - (ptrdiff_t)m_leftContext, begin), end - 1);
+                buf[j * windowSize + k] = (ElemType)(tNeighbor * numParallelSequences + (ptrdiff_t)seq.s);
+            }
+        }
+    }
+    CreateMatrixIfNull(m_windowIndex);
+    m_windowIndex->SetValue(1, buf.size(), m_deviceId, buf.data(), MatrixFormat::matrixFormatColMajor);
+    if (!m_windowIndexLayout)
+        m_windowIndexLayout = make_shared<MBLayout>();
+    m_windowIndexLayout->CopyFrom(pMBLayout);
+}
+
+template <class ElemType>
+/*virtual*/ void ContextWindowNode<ElemType>::Validate(bool isFinalValidationPass) /*override*/
+{
+    Base::Validate(isFinalValidationPass);
+    InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+    if (isFinalValidationPass && !HasMBLayout())
+        InvalidArgument("%ls requires its input to be a time sequence.", NodeDescription().c_str());
+
+    // the trailing dimension gets multiplied, as the HTK readers' context expansion does it
+    SmallVector<size_t> dims = GetInputSampleLayout(0).GetDims();
+    dims.back() *= GetWindowSize();
+    SetDims(TensorShape(dims), HasMBLayout());
+}
+
+template class ContextWindowNode<float>;
+template class ContextWindowNode<double>;
+
 }}}
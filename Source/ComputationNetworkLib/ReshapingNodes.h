@@ -160,6 +160,14 @@ public:
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool CanRecomputeValue() const override { return true; }
+
+    virtual bool HasSameAttributesAs(const ComputationNodeBase& other) const override
+    {
+        auto node = dynamic_cast<const ReshapeNode<ElemType>*>(&other);
+        return node && node->m_replacementSampleLayout == m_replacementSampleLayout &&
+               node->m_beginDimParameter == m_beginDimParameter && node->m_endDimParameter == m_endDimParameter;
+    }
 
 private:
     TensorShape m_replacementSampleLayout; // user-specified dimensions to replace dimensions [beginAxis, endAxis]
@@ -288,6 +296,9 @@ template class ReconcileDynamicAxisNode<double>;
 // SliceNode (input)
 // This node extracts a slice of the first tensor dimension (row).
 // This does not support slicing the time axis. That has to be done in BrainScript using Gather.
+// Where the slice is a contiguous column range of the input's storage (input without MBLayout, sliced
+// along its outermost non-singleton axis, e.g. a block of a parameter matrix), and the input's value is
+// not shared through the matrix pool, the output value is a view into the input's value and no copy is made.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -351,10 +362,49 @@ private:
         return inputSlice;
     }
 
+    // determine whether our output can be a view into the input's value, and if so which columns it covers
+    // This requires the slice to be a column range of the input's Matrix: not the leading axis, and all axes beyond the
+    // slice axis must be 1. The input's value must furthermore persist, i.e. not be handed to other nodes by the matrix pool.
+    bool CanBeViewOfInput(size_t& firstColumn, size_t& numColumns) const
+    {
+        auto input = Input(0);
+        if (HasMBLayout() || input->HasMBLayout() || input->IsValueSharable() || input->GetDeviceId() != m_deviceId ||
+            input->Value().GetMatrixType() != DENSE || m_axis < 2)
+            return false;
+        let& inputShape = input->GetSampleLayout();
+        for (size_t k = m_axis; k < inputShape.GetRank(); k++)
+            if (inputShape[k] != 1)
+                return false;
+        size_t columnStride = 1; // number of columns per index step along the slice axis
+        for (size_t k = 1; k < m_axis - 1; k++)
+            columnStride *= inputShape[k];
+        firstColumn = BeginIndex() * columnStride;
+        numColumns = (EndIndex() - BeginIndex()) * columnStride;
+        return true;
+    }
+
+    // (re-)point our value at the input's; done anew for every MB since the input's buffer may have been reallocated
+    void UpdateValueView()
+    {
+        size_t firstColumn, numColumns;
+        if (!CanBeViewOfInput(firstColumn, numColumns))
+            LogicError("%ls %ls operation: Slice can no longer be a view of its input.", NodeName().c_str(), OperationName().c_str());
+        Value().AssignColumnSlice(Input(0)->Value(), firstColumn, numColumns);
+    }
+
 public:
 
+    virtual void /*ComputationNode::*/ BeginForwardProp() override
+    {
+        if (m_valueIsView) // must be done before the base resizes our value
+            UpdateValueView();
+        Base::BeginForwardProp();
+    }
+
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
+        if (m_valueIsView) // value already refers to the input's
+            return;
         size_t rank = DetermineElementwiseTensorRank();
         auto output =                                ValueTensorFor(           rank, fr);
         let   input = TensorView<ElemType>(Input(0)->ValuePtr(), GetInputSlice(rank, fr.AllowBroadcast()));
@@ -372,6 +422,19 @@ public:
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
 
+    // a view must not take a matrix from the pool, and must never be returned to it
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        size_t firstColumn, numColumns;
+        bool valueIsView = CanBeViewOfInput(firstColumn, numColumns);
+        if (m_valueIsView && !valueIsView)
+            m_value = nullptr; // (don't write through a stale view into the input)
+        m_valueIsView = valueIsView;
+        if (m_valueIsView)
+            MarkValueNonSharable();
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+    }
+
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
@@ -395,6 +458,7 @@ public:
 private:
     int m_beginIndex, m_endIndex; // 'int' because negative indices are allowed, to index from end Python-style
     int m_axis;                   // note: axes are 1-based
+    bool m_valueIsView = false;   // m_value is a view into Input(0)'s value (determined when matrices are allocated)
 };
 
 template class SliceNode<float>;
@@ -667,6 +731,7 @@ public:
 
 private:
     // buffers for creating the result sequences (kept as object state to avoid memory allocations)
+    std::vector<ElemType>                   m_conditionBuffer; // [j] the input values, read from the device in one go
     std::vector<std::vector<size_t>>   m_indexSequenceBuffer; // [sequenceIndex][t] for creating the result sequences
     std::vector<size_t>               m_rowAllocationsBuffer; // [row] for determining new MBLayout packing
     std::vector<std::pair<size_t, size_t>> m_placementBuffer; // [sequenceIndex] assigned location for a sequence
@@ -705,6 +770,18 @@ public:
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
     virtual void Validate(bool isFinalValidationPass) override;
+
+    // true if no two of our index values refer to the same column, as is the case for indices that come from Where(),
+    // which are strictly increasing within each sequence. Scattering with them then needs no atomic operations.
+    bool HasUniqueIndices() const { return dynamic_pointer_cast<WhereNode<ElemType>>(Input(INDEXDATA)) != nullptr; }
+
+private:
+    void UpdateSequenceMap();
+
+    // What the mapping needs from the two MBLayouts, per index column (see Matrix::AssignPackedIndicesOf()). It only changes
+    // with the layouts, so that it is rebuilt and uploaded only then, while the index values themselves never leave the device.
+    shared_ptr<Matrix<ElemType>> m_sequenceMap;
+    MBLayoutPtr m_sequenceMapSourceLayout, m_sequenceMapIndexLayout; // copies of the layouts m_sequenceMap was built for
 };
 
 // -----------------------------------------------------------------------
@@ -773,6 +850,86 @@ public:
     virtual void Validate(bool isFinalValidationPass) override;
 };
 
+// -----------------------------------------------------------------------
+// ContextWindowNode(input, leftContext, rightContext) -- stack each frame
+// with its leftContext preceding and rightContext following frames
+// The result for frame t is [x(t-leftContext); ...; x(t); ...; x(t+rightContext)],
+// where frames beyond a sequence boundary are replaced by the first or last
+// frame of that sequence. This is the same expansion that the HTK readers apply
+// with 'contextWindow', but done on the device from raw frames, so that only
+// the raw frames need to be packed and uploaded by the reader.
+// Since it needs the neighbor frames, the input must be in sequence (utterance)
+// mode, e.g. frameMode=false with truncation; frames of a sequence that lie
+// outside the current minibatch (truncated BPTT) count as beyond the boundary.
+// Like RowRepeat, this multiplies the trailing sample dimension.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class ContextWindowNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<1>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"ContextWindow"; }
+
+public:
+    ContextWindowNode(DEVICEID_TYPE deviceId, const wstring& name, size_t leftContext = 0, size_t rightContext = 0)
+        : Base(deviceId, name),
+          m_leftContext(leftContext),
+          m_rightContext(rightContext)
+    {
+    }
+    ContextWindowNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : ContextWindowNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"leftContext"), configp->Get(L"rightContext"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<ContextWindowNode<ElemType>>(nodeP);
+            node->m_leftContext  = m_leftContext;
+            node->m_rightContext = m_rightContext;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_leftContext << m_rightContext;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_leftContext >> m_rightContext;
+    }
+
+    virtual std::string FormatOperationPrototype(const std::string& extraArgs) const override
+    {
+        return Base::FormatOperationPrototype(extraArgs + msra::strfun::strprintf(", leftContext=%lu, rightContext=%lu", m_leftContext, m_rightContext));
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override;
+    virtual void /*ComputationNodeNonLooping::*/ BackpropToNonLooping(size_t /*inputIndex*/) override;
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual void Validate(bool isFinalValidationPass) override;
+
+private:
+    size_t GetWindowSize() const { return 1 + m_leftContext + m_rightContext; }
+    void UpdateWindowIndex();
+
+    size_t m_leftContext;
+    size_t m_rightContext;
+
+    // [k + j * windowSize] input column that goes to window position k of output column j, or -1 for gaps.
+    // It only depends on the MBLayout, so it is rebuilt and uploaded only when that changes.
+    shared_ptr<Matrix<ElemType>> m_windowIndex;
+    MBLayoutPtr m_windowIndexLayout; // copy of the layout m_windowIndex was built for
+};
+
 // -----------------------------------------------------------------------
 // DiagonalNode -- extract diagonal elements of a square matrix into a row vector
 // -----------------------------------------------------------------------
@@ -61,6 +61,107 @@ private:
     std::vector<std::string> m_labelMapping;
 };
 
+// -----------------------------------------------------------------------
+// ToDeviceNode (input, targetDeviceId) -- copy the input to another device
+// The nodes computed from this one run on that device as well (see ComputationNetwork::PlaceNodesOnDevices()),
+// so that a network too large for one GPU can be split into stages on several GPUs. The gradient is copied back.
+// If the network runs on the CPU, everything stays there. A sparse input must be on the CPU or on our device; the former
+// is copied as a dense matrix (e.g. one-hot data prepared on the host, see ComputationNetwork::OffloadToHost()).
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class ToDeviceNode : public ComputationNode<ElemType>, public NumInputs<1>, public IDeviceTransferNode
+{
+    typedef ComputationNode<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"ToDevice"; }
+
+public:
+    ToDeviceNode(DEVICEID_TYPE deviceId, const wstring& name, DEVICEID_TYPE targetDeviceId = CPUDEVICE)
+        : Base(deviceId, name), m_targetDeviceId(targetDeviceId)
+    {
+    }
+
+    ToDeviceNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : ToDeviceNode(configp->Get(L"deviceId"), L"<placeholder>", (DEVICEID_TYPE) (int) configp->Get(L"targetDeviceId"))
+    {
+        if (m_targetDeviceId < CPUDEVICE)
+            InvalidArgument("ToDevice: targetDeviceId must be a GPU id or -1 for the CPU.");
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<ToDeviceNode<ElemType>>(nodeP);
+            node->m_targetDeviceId = m_targetDeviceId;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << (int) m_targetDeviceId;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        int targetDeviceId;
+        fstream >> targetDeviceId;
+        m_targetDeviceId = (DEVICEID_TYPE) targetDeviceId;
+    }
+
+    virtual DEVICEID_TYPE /*IDeviceTransferNode::*/ GetTargetDeviceId() const override { return m_targetDeviceId; }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        let& input = Input(0)->Value();
+        if (input.GetMatrixType() == SPARSE && input.GetDeviceId() == CPUDEVICE && m_deviceId != CPUDEVICE)
+        {
+            // Matrix cannot assign a CPU sparse matrix to a GPU dense one; make it dense on the host first
+            if (!m_denseInputOnHost)
+                m_denseInputOnHost = make_shared<Matrix<ElemType>>(CPUDEVICE);
+            m_denseInputOnHost->AssignValuesOf(Input(0)->ValueFor(fr));
+            ValueFor(fr).AssignValuesOf(*m_denseInputOnHost);
+            return;
+        }
+        ValueFor(fr).AssignValuesOf(Input(0)->ValueFor(fr));
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        assert(inputIndex == 0); inputIndex;
+        auto inputGradient = Input(0)->GradientFor(fr);
+        if (Input(0)->GetDeviceId() == m_deviceId)
+        {
+            inputGradient += GradientFor(fr);
+            return;
+        }
+        if (!m_gradientOnInputDevice || m_gradientOnInputDevice->GetDeviceId() != Input(0)->GetDeviceId())
+            m_gradientOnInputDevice = make_shared<Matrix<ElemType>>(Input(0)->GetDeviceId());
+        m_gradientOnInputDevice->AssignValuesOf(GradientFor(fr));
+        inputGradient += *m_gradientOnInputDevice;
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        ValidateUnaryMap(isFinalValidationPass);
+    }
+
+private:
+    DEVICEID_TYPE m_targetDeviceId;
+    shared_ptr<Matrix<ElemType>> m_gradientOnInputDevice; // staging buffer to add the gradient to the input's
+    shared_ptr<Matrix<ElemType>> m_denseInputOnHost;      // staging buffer for a sparse input on the host
+};
+
+template class ToDeviceNode<float>;
+template class ToDeviceNode<double>;
+
 #ifdef COMING_SOON
 
 // -----------------------------------------------------------------------
@@ -86,6 +187,10 @@ public:
     {
     }
 
+    // Gradients in terms of the posteriors and the weights w_ct = gradient_t * posterior_ct / stddev_ct^2, with GEMMs for shared means:
+    //  - means:    sum_t w_ct (x_t - mu_c)
+    //  - features: sum_c w_ct (mu_c - x_t)
+    //  - logStdDevs: gradient_t * posterior_ct * (||x_t - mu_c||^2 / stddev_ct^2 - featureDim)
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
         // get the right slice
@@ -93,50 +198,39 @@ public:
 
         Matrix<ElemType> sliceGradientValue = DataFor(*m_gradient, fr);
         Matrix<ElemType> slicePosterior = DataFor(*m_posterior, fr);
+        Matrix<ElemType> sliceFeature = Input(3)->ValueFor(fr);
+        // the mixture parameters are either shared by all samples or given per sample
+        auto parameter = [&](size_t i) { return colsPrior == 1 ? Input(i)->Value().AsReference() : Input(i)->ValueFor(fr); };
+        auto parameterGradient = [&](size_t i) { return colsPrior == 1 ? Input(i)->Gradient().AsReference() : Input(i)->GradientFor(fr); };
 
         switch (inputIndex)
         {
         case 0:
         {
-            if (colsPrior == 1)
-                BackpropToUnnormedPrior(Input(0)->Gradient(), sliceGradientValue, *m_prior, slicePosterior, *m_temp);
-            else
-            {
-                Matrix<ElemType> sliceUnnormedPriorGradient = Input(0)->GradientFor(fr);
-                Matrix<ElemType> slicePrior = DataFor(*m_prior, fr); // TODO: use the right MBLayout, then we won't need the special case
-                BackpropToUnnormedPrior(sliceUnnormedPriorGradient, sliceGradientValue, slicePrior, slicePosterior, *m_temp);
-            }
+            Matrix<ElemType> unnormedPriorGradient = parameterGradient(0);
+            Matrix<ElemType> prior = colsPrior == 1 ? m_prior->AsReference() : DataFor(*m_prior, fr); // TODO: use the right MBLayout, then we won't need the special case
+            BackpropToUnnormedPrior(unnormedPriorGradient, sliceGradientValue, prior, slicePosterior, *m_temp);
         }
         break;
         case 1:
         {
-            Matrix<ElemType> sliceNormedDeviationVectors = DataFor(*m_normedDeviationVectors, fr);
-            if (colsPrior == 1)
-                BackpropToMean(Input(1)->Gradient(), sliceGradientValue, sliceNormedDeviationVectors, slicePosterior, *m_temp);
-            else
-            {
-                Matrix<ElemType> sliceMeanGradient = Input(1)->GradientFor(fr);
-                BackpropToMean(sliceMeanGradient, sliceGradientValue, sliceNormedDeviationVectors, slicePosterior, *m_temp);
-            }
+            Matrix<ElemType> meanGradient = parameterGradient(1);
+            ComputeWeights(*m_weights, sliceGradientValue, slicePosterior, parameter(2));
+            BackpropToMean(meanGradient, *m_weights, parameter(1), sliceFeature, *m_temp);
         }
         break;
         case 2:
         {
+            Matrix<ElemType> logStddevGradient = parameterGradient(2);
             Matrix<ElemType> sliceNormedDeviation = DataFor(*m_normedDeviation, fr);
-            if (colsPrior == 1)
-                BackpropToLogStddev(Input(2)->Gradient(), sliceGradientValue, sliceNormedDeviation, slicePosterior, *m_temp);
-            else
-            {
-                Matrix<ElemType> sliceLotStddevGradient = Input(2)->GradientFor(fr);
-                BackpropToLogStddev(sliceLotStddevGradient, sliceGradientValue, sliceNormedDeviation, slicePosterior, *m_temp);
-            }
+            BackpropToLogStddev(logStddevGradient, sliceGradientValue, sliceNormedDeviation, slicePosterior, sliceFeature.GetNumRows(), *m_temp);
         }
         break;
         case 3:
         {
-            Matrix<ElemType> sliceNormedDeviationVectors = DataFor(*m_normedDeviationVectors, fr);
             Matrix<ElemType> sliceFeatureGradient = Input(3)->GradientFor(fr);
-            BackpropToFeature(sliceFeatureGradient, sliceGradientValue, sliceNormedDeviationVectors, slicePosterior, *m_temp);
+            ComputeWeights(*m_weights, sliceGradientValue, slicePosterior, parameter(2));
+            BackpropToFeature(sliceFeatureGradient, *m_weights, parameter(1), sliceFeature, *m_temp);
         }
         break;
         default:
@@ -145,7 +239,8 @@ public:
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
-    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    // the means, stddevs and features enter the gradients through the weights and the GEMMs
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override { return childIndex != 0; }
 
     void BackpropToUnnormedPrior(Matrix<ElemType>& unnormedPriorGradientValues, const Matrix<ElemType>& gradientValues,
                                  const Matrix<ElemType>& prior, const Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
@@ -160,39 +255,61 @@ public:
             RuntimeError("GMMLogLikelihoodNode: UnnormedPrior should either have same number of columns as the features or have only one column.");
     }
 
-    void BackpropToMean(Matrix<ElemType>& meanGradientValues, const Matrix<ElemType>& gradientValues, const Matrix<ElemType>& normedDeviationVectors,
-                        Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
+    // weights <-- gradient_t * posterior_ct / stddev_ct^2
+    void ComputeWeights(Matrix<ElemType>& weights, const Matrix<ElemType>& gradientValues, const Matrix<ElemType>& posterior, const Matrix<ElemType>& logStddev)
     {
-        size_t numComponent = posterior.GetNumRows();
-        size_t numSamples = posterior.GetNumCols();
-        size_t featureSize = normedDeviationVectors.GetNumRows() / numComponent;
-
-        temp.SetValue(normedDeviationVectors); // recall normedDeviationVectors <-- (x-u_c)/(stddev^2)
-        temp.Reshape(featureSize, numSamples * numComponent);
-
-        posterior.Reshape(1, numSamples * numComponent);
-        temp.RowElementMultiplyWith(posterior); // temp <-- posterior * (x-u_c)/(stddev^2)
+        m_temp->AssignProductOf(-2, logStddev);
+        m_temp->InplaceExp();
+        weights.SetValue(posterior);
+        if (logStddev.GetNumCols() == posterior.GetNumCols())
+            weights.ElementMultiplyWith(*m_temp);
+        else
+            weights.ColumnElementMultiplyWith(*m_temp);
+        weights.RowElementMultiplyWith(gradientValues);
+    }
 
-        posterior.Reshape(numComponent, numSamples);          // reshape back
-        temp.Reshape(featureSize * numComponent, numSamples); // reshape back
+    // (x_t - mu_c) for all components of all samples, for means that differ per sample; column c + numComponents * t of the result
+    void AssignDeviationVectors(Matrix<ElemType>& temp, const Matrix<ElemType>& mean, const Matrix<ElemType>& feature, size_t numComponents)
+    {
+        temp.AssignRepeatOf(feature, numComponents, 1);
+        temp -= mean;
+        temp.Reshape(feature.GetNumRows(), feature.GetNumCols() * numComponents);
+    }
 
-        temp.RowElementMultiplyWith(gradientValues);
+    void BackpropToMean(Matrix<ElemType>& meanGradientValues, const Matrix<ElemType>& weights, const Matrix<ElemType>& mean, const Matrix<ElemType>& feature, Matrix<ElemType>& temp)
+    {
+        size_t numComponent = weights.GetNumRows();
+        size_t numSamples = weights.GetNumCols();
+        size_t featureSize = feature.GetNumRows();
 
-        if (numSamples == meanGradientValues.GetNumCols())
+        if (mean.GetNumCols() == 1) // shared means: X w' - mu .* (sum_t w_ct)
+        {
+            Matrix<ElemType> meanGradient = meanGradientValues.Reshaped(featureSize, numComponent);
+            Matrix<ElemType> meanVectors = mean.Reshaped(featureSize, numComponent);
+            Matrix<ElemType>::MultiplyAndAdd(feature, false, weights, true, meanGradient);
+            Matrix<ElemType> weightSums(weights.GetDeviceId());
+            Matrix<ElemType>::Multiply(ConstOnes(1, numSamples, weights.GetDeviceId()), false, weights, true, weightSums);
+            temp.SetValue(meanVectors);
+            temp.RowElementMultiplyWith(weightSums);
+            meanGradient -= temp;
+        }
+        else if (mean.GetNumCols() == numSamples)
+        {
+            AssignDeviationVectors(temp, mean, feature, numComponent);
+            temp.RowElementMultiplyWith(weights.Reshaped(1, numSamples * numComponent));
+            temp.Reshape(featureSize * numComponent, numSamples);
             meanGradientValues += temp;
-        else if (meanGradientValues.GetNumCols() == 1)
-            Matrix<ElemType>::MultiplyAndAdd(temp, false, ConstOnes(numSamples, 1, meanGradientValues.GetDeviceId()), false, meanGradientValues);
+        }
         else
-            RuntimeError("GMMLogLikelihoodNode: stddev should either have same number of columns as the features or have only one column.");
+            RuntimeError("GMMLogLikelihoodNode: mean should either have same number of columns as the features or have only one column.");
     }
 
     void BackpropToLogStddev(Matrix<ElemType>& logStddevGradientValues, const Matrix<ElemType>& gradientValues, const Matrix<ElemType>& normedDeviation,
-                             const Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
+                             const Matrix<ElemType>& posterior, size_t featureDim, Matrix<ElemType>& temp)
     {
-        size_t numComponent = posterior.GetNumRows();
         size_t numSamples = posterior.GetNumCols();
 
-        temp.AssignDifferenceOf(normedDeviation, (ElemType) numComponent);
+        temp.AssignDifferenceOf(normedDeviation, (ElemType) featureDim);
         temp.ElementMultiplyWith(posterior);
         temp.RowElementMultiplyWith(gradientValues);
         if (logStddevGradientValues.GetNumCols() == numSamples)
@@ -203,25 +320,30 @@ public:
             RuntimeError("GMMLogLikelihoodNode: stddev should either have same number of columns as the features or have only one column.");
     }
 
-    void BackpropToFeature(Matrix<ElemType>& featureGradientValues, const Matrix<ElemType>& gradientValues, const Matrix<ElemType>& normedDeviationVectors,
-                           Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
+    void BackpropToFeature(Matrix<ElemType>& featureGradientValues, const Matrix<ElemType>& weights, const Matrix<ElemType>& mean, const Matrix<ElemType>& feature, Matrix<ElemType>& temp)
     {
-        size_t numComponent = posterior.GetNumRows();
-        size_t numSamples = posterior.GetNumCols();
-        size_t featureSize = normedDeviationVectors.GetNumRows() / numComponent;
-
-        temp.SetValue(normedDeviationVectors);
-        temp *= -1;
-        temp.Reshape(featureSize, numSamples * numComponent);
-        posterior.Reshape(1, numSamples * numComponent);
-        temp.RowElementMultiplyWith(posterior);
+        size_t numComponent = weights.GetNumRows();
+        size_t numSamples = weights.GetNumCols();
+        size_t featureSize = feature.GetNumRows();
 
-        posterior.Reshape(numComponent, numSamples);
-        temp.Reshape(featureSize * numComponent, numSamples);
-        temp.RowElementMultiplyWith(gradientValues);
-
-        for (int i = 0; i < numComponent; i++)
-            featureGradientValues.AddWithRowSliceValuesOf(temp, i * featureSize, featureSize);
+        if (mean.GetNumCols() == 1) // shared means: mu w - x .* (sum_c w_ct)
+        {
+            Matrix<ElemType>::MultiplyAndAdd(mean.Reshaped(featureSize, numComponent), false, weights, false, featureGradientValues);
+            Matrix<ElemType> weightSums(weights.GetDeviceId());
+            Matrix<ElemType>::Multiply(ConstOnes(1, numComponent, weights.GetDeviceId()), false, weights, false, weightSums);
+            temp.SetValue(feature);
+            temp.RowElementMultiplyWith(weightSums);
+            featureGradientValues -= temp;
+        }
+        else
+        {
+            AssignDeviationVectors(temp, mean, feature, numComponent);
+            temp *= -1;
+            temp.RowElementMultiplyWith(weights.Reshaped(1, numSamples * numComponent));
+            temp.Reshape(featureSize * numComponent, numSamples);
+            for (int i = 0; i < numComponent; i++)
+                featureGradientValues.AddWithRowSliceValuesOf(temp, i * featureSize, featureSize);
+        }
     }
 
     virtual void UpdateFunctionMBSize() override
@@ -231,12 +353,9 @@ public:
         size_t numCols = Input(3)->GetSampleMatrixNumCols();
         size_t numComponents = Input(0)->GetSampleMatrixNumRows();
         size_t colsPrior = Input(0)->GetSampleMatrixNumCols(); // may be 1
-        size_t featureSize = Input(3)->GetSampleMatrixNumRows();
 
         m_prior->Resize(numComponents, colsPrior);
-        m_stddev->Resize(numComponents, colsPrior);
         m_normedDeviation->Resize(numComponents, numCols);
-        m_normedDeviationVectors->Resize(numComponents * featureSize, numCols);
         m_posterior->Resize(numComponents, numCols);
     }
 
@@ -250,102 +369,37 @@ public:
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
         Matrix<ElemType> sliceFeature = Input(3)->ValueFor(fr);
         Matrix<ElemType> sliceNormedDeviation = DataFor(*m_normedDeviation, fr);
-        Matrix<ElemType> sliceNormedDeviationVectors = DataFor(*m_normedDeviationVectors, fr);
         Matrix<ElemType> slicePosterior = DataFor(*m_posterior, fr);
 
         if (colsPrior == 1)
         {
             ForwardPropS(sliceOutputValue, Input(0)->Value(), Input(1)->Value(), Input(2)->Value(), sliceFeature,
-                         *m_prior, *m_stddev, sliceNormedDeviationVectors, sliceNormedDeviation, slicePosterior, *m_temp);
+                         *m_prior, sliceNormedDeviation, slicePosterior);
         }
         else if (colsPrior == numSamples)
         {
-            Matrix<ElemType> sliceUnnormedPrior = Input(0)->ValueFor(fr);
-            Matrix<ElemType> sliceMean = Input(1)->ValueFor(fr);
-            Matrix<ElemType> sliceLogstddev = Input(2)->ValueFor(fr);
-
             Matrix<ElemType> slicePrior = DataFor(*m_prior, fr);
-            Matrix<ElemType> sliceStddev = DataFor(*m_stddev, fr);
-
-            ForwardPropS(sliceOutputValue, sliceUnnormedPrior, sliceMean, sliceLogstddev, sliceFeature,
-                         slicePrior, sliceStddev, sliceNormedDeviationVectors, sliceNormedDeviation, slicePosterior, *m_temp);
+            ForwardPropS(sliceOutputValue, Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), Input(2)->ValueFor(fr), sliceFeature,
+                         slicePrior, sliceNormedDeviation, slicePosterior);
         }
         else // should not reach the code since validation should fail already
             RuntimeError("GMMLogLikelihoodNode: UnnormedPrior should either have same number of columns as the features or have only one column.");
     }
 
     // input0=unnormedPrior, input1=mean, input2=logstddev, input3=feature
-    // If we want to speed up we need to replace following code with a several specialized GPU functions
-    /*TODO: merge with call site*/ void ForwardPropS(Matrix<ElemType>& functionValues, const Matrix<ElemType>& unnormedPrior, const Matrix<ElemType>& mean, Matrix<ElemType>& logstddev,
-                                                     const Matrix<ElemType>& feature, Matrix<ElemType>& prior, Matrix<ElemType>& stddev, Matrix<ElemType>& normedDeviationVectors,
-                                                     Matrix<ElemType>& normedDeviation, Matrix<ElemType>& posterior, Matrix<ElemType>& temp)
+    // The log-likelihoods, posteriors and normed squared distances come from one fused Matrix operation that never forms the
+    // [features x components x frames] differences; the prior itself is only kept for its gradient.
+    /*TODO: merge with call site*/ void ForwardPropS(Matrix<ElemType>& functionValues, const Matrix<ElemType>& unnormedPrior, const Matrix<ElemType>& mean, const Matrix<ElemType>& logstddev,
+                                                     const Matrix<ElemType>& feature, Matrix<ElemType>& prior, Matrix<ElemType>& normedDeviation, Matrix<ElemType>& posterior)
     {
-        int numComponent = unnormedPrior.GetNumRows();
-        size_t numSamples = feature.GetNumCols();
-        size_t featureDim = feature.GetNumRows();
-
-        // compute prior which is softmax of unnormedPrior
-        prior.AssignLogSoftmaxOf(unnormedPrior, true); // log prior
-
+        prior.AssignLogSoftmaxOf(unnormedPrior, true);
         prior.InplaceExp();
 
-        // compute stddev
-        stddev.AssignExpOf(logstddev);
-
-#if DUMPOUTPUT
-        unnormedPrior.Print("unnormedPrior", 0, min(5, unnormedPrior.GetNumRows() - 1), 0, min(10, unnormedPrior.GetNumCols() - 1));
-        mean.Print("mean", 0, min(5, mean.GetNumRows() - 1), 0, min(10, mean.GetNumCols() - 1));
-        logstddev.Print("logstddev", 0, min(5, logstddev.GetNumRows() - 1), 0, min(10, logstddev.GetNumCols() - 1));
-
-        prior.Print("prior", 0, min(5, prior.GetNumRows() - 1), 0, min(10, prior.GetNumCols() - 1));
-        stddev.Print("stddev", 0, min(5, stddev.GetNumRows() - 1), 0, min(10, stddev.GetNumCols() - 1));
-#endif
-
-        // compute normedDeviation <-- ||x-u_c||^2/(stddev^2)
-        normedDeviationVectors.AssignRepeatOf(feature, numComponent, 1);
-        normedDeviationVectors -= mean;                                        // each column of the mean has multiple mean components
-        normedDeviationVectors.Reshape(featureDim, numSamples * numComponent); // now each column is feature-mean_i
-
-        normedDeviation.AssignVectorNorm2Of(normedDeviationVectors, true);
-        normedDeviation ^= 2;
-        temp.AssignRepeatOf(stddev, 1, numSamples / stddev.GetNumCols()); // stddev.GetNumCols() is either 1 or =numSamples
-        temp.Reshape(1, temp.GetNumElements());                           // one stddev value for each component for each sample
-        temp ^= 2;
-        normedDeviation.ElementDivideBy(temp); // normedDeviation and temp have same dim (1, numSamples* numComponent)
-
-        // compute  normedDeviationVectors <-- (x-u_c)/(stddev^2)
-        normedDeviationVectors.RowElementDivideBy(temp);                       // divide twice
-        normedDeviationVectors.Reshape(featureDim * numComponent, numSamples); // reshape back
-
-        // compute per-component likelihood
-        posterior.AssignProductOf(-0.5f, normedDeviation); // posterior  <-- -||x-u_c||^2/(stddev^2)/2 and in (1, numSamples* numComponent) dim
-        temp.InplaceLog();
-        temp *= ((ElemType) numComponent / 2.0f);                   // temp <-- stddev^c and in (1, numSamples* numComponent) dim
-        posterior -= temp;                                          // posterior  <-- exp[-||x-u_c||^2/(stddev^2)/2]/(stddev^c)
-        posterior -= (ElemType)(numComponent / 2.0f * log(TWO_PI)); // likelihood for each component and sample is now computed and stored in posterior
-        posterior.InplaceExp();                                     // posterior  <-- exp(-||x-u_c||^2/(stddev^2)/2)
-
-        normedDeviation.Reshape(numComponent, numSamples); // reshape back
-        posterior.Reshape(numComponent, numSamples);       // reshape back
-
-        // compute posterior <-- prior_i * likelihood_i
-        if (unnormedPrior.GetNumCols() == numSamples) // each sample has different prior
-            posterior.ElementMultiplyWith(prior);
-        else // all samples share the same prior
-            posterior.ColumnElementMultiplyWith(prior);
-
-        // compute GMM log-likelihood
-        Matrix<ElemType>::Multiply(ConstOnes(1, numComponent, posterior.GetDeviceId()), false, posterior, false, functionValues); // functionValues <-- total likelihood
-        posterior.RowElementDivideBy(functionValues);                                                                             // posterior <-- per-comp likelihood / total likelihood
-        functionValues.InplaceLog();                                                                                              // log likelihood
+        Matrix<ElemType>::GMMLogLikelihood(unnormedPrior, mean, logstddev, feature, functionValues, posterior, normedDeviation);
 
 #if DUMPOUTPUT
-        temp.Print("temp", 0, min(5, temp.GetNumRows() - 1), 0, min(10, temp.GetNumCols() - 1));
         normedDeviation.Print("normedDeviation", 0, min(5, normedDeviation.GetNumRows() - 1), 0, min(10, normedDeviation.GetNumCols() - 1));
-
         posterior.Print("posterior", 0, min(5, posterior.GetNumRows() - 1), 0, min(10, posterior.GetNumCols() - 1));
-        functionValues.Print("functionValues", 0, min(5, functionValues.GetNumRows() - 1), 0, min(10, functionValues.GetNumCols() - 1));
-
         functionValues.Print("GMMLogLikelihoodNode");
 #endif
     }
@@ -382,11 +436,9 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<GMMLogLikelihoodNode<ElemType>>(nodeP);
-            *node->m_prior = *m_prior;
-            *node->m_normedDeviation = *m_normedDeviation;
-            *node->m_normedDeviationVectors = *m_normedDeviationVectors;
-            *node->m_stddev = *m_stddev;
-            *node->m_posterior = *m_posterior;
+            node->m_prior->SetValue(*m_prior);
+            node->m_normedDeviation->SetValue(*m_normedDeviation);
+            node->m_posterior->SetValue(*m_posterior);
         }
     }
 
@@ -396,9 +448,14 @@ public:
         Base::RequestMatricesBeforeForwardProp(matrixPool);
         RequestMatrixFromPool(m_prior, matrixPool);
         RequestMatrixFromPool(m_normedDeviation, matrixPool);
-        RequestMatrixFromPool(m_normedDeviationVectors, matrixPool);
-        RequestMatrixFromPool(m_stddev, matrixPool);
         RequestMatrixFromPool(m_posterior, matrixPool);
+    }
+
+    // request matrices that are needed for gradient computation
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool)
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_weights, matrixPool);
         RequestMatrixFromPool(m_temp, matrixPool);
     }
 
@@ -408,18 +465,16 @@ public:
         Base::ReleaseMatricesAfterBackprop(matrixPool);
         ReleaseMatrixToPool(m_prior, matrixPool);
         ReleaseMatrixToPool(m_normedDeviation, matrixPool);
-        ReleaseMatrixToPool(m_normedDeviationVectors, matrixPool);
-        ReleaseMatrixToPool(m_stddev, matrixPool);
         ReleaseMatrixToPool(m_posterior, matrixPool);
+        ReleaseMatrixToPool(m_weights, matrixPool);
         ReleaseMatrixToPool(m_temp, matrixPool);
     }
 
 protected:
     shared_ptr<Matrix<ElemType>> m_prior;
-    shared_ptr<Matrix<ElemType>> m_normedDeviation;
-    shared_ptr<Matrix<ElemType>> m_normedDeviationVectors;
-    shared_ptr<Matrix<ElemType>> m_stddev;
+    shared_ptr<Matrix<ElemType>> m_normedDeviation; // ||x-u_c||^2/(stddev^2)
     shared_ptr<Matrix<ElemType>> m_posterior;
+    shared_ptr<Matrix<ElemType>> m_weights;         // gradient * posterior / stddev^2
     shared_ptr<Matrix<ElemType>> m_temp;
 };
 
@@ -8,6 +8,7 @@
 #include "ComputationNode.h"
 #include "BatchNormalizationEngine.h"
 #include "RNGHandle.h"
+#include "MPIWrapper.h"
 
 #include <map>
 #include <string>
@@ -103,6 +104,12 @@ template class SquareErrorNode<double>;
 // -----------------------------------------------------------------------
 // CrossEntropyWithSoftmaxNode (labels, prediction)
 // calculates: -sum(left_i * log(softmax_i(right)))
+// With dense labels, the softmax and the cross entropy are computed in one fused pass over the prediction
+// (Matrix::SoftmaxCrossEntropy()), and the gradient is computed from the per-column log-sum-exp without
+// keeping the softmax. Sparse labels use the separate log softmax and inner product.
+// The labels may also be class indices, a [1 x T] input with the row of the target class of each frame
+// (e.g. a one-dimensional label stream instead of a one-hot one); their logits are gathered, see
+// Matrix::SoftmaxCrossEntropyWithIndices(), so that no [C x T] label matrix is built or transferred.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -134,6 +141,16 @@ public:
             Input(0)->GradientFor(fr).Print("CrossEntropyWithSoftmaxNode Partial-Left-in");
 #endif
 
+            if (HasClassIndexLabels())
+                LogicError("%ls %ls operation: The gradient w.r.t. class-index labels is not defined.", NodeName().c_str(), OperationName().c_str());
+
+            // the fused forward pass does not keep the log softmax, which is only needed for this rarely used gradient
+            if (UseFusedSoftmax())
+            {
+                m_logSoftmaxOfRight->AssignLogSoftmaxOf(Input(1)->ValueFor(fr), true);
+                MaskMissingColumnsToZero(*m_logSoftmaxOfRight, Input(1)->GetMBLayout(), fr);
+            }
+
             auto gradient = Input(0)->GradientFor(fr);
             Matrix<ElemType>::Multiply1x1AndWeightedAdd(-1.0f, Gradient() /*1x1*/, *m_logSoftmaxOfRight, 1.0f, gradient);
 #if DUMPOUTPUT
@@ -151,7 +168,12 @@ public:
 #endif
 
             auto gradient = Input(1)->GradientFor(fr);
-            Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, Input(0)->ValueFor(fr), gradient);
+            if (HasClassIndexLabels())
+                Matrix<ElemType>::AddSoftmaxCrossEntropyGradientWithIndices(Gradient(), Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), *m_logSumExp, gradient);
+            else if (UseFusedSoftmax())
+                Matrix<ElemType>::AddSoftmaxCrossEntropyGradient(Gradient(), Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), *m_logSumExp, gradient);
+            else
+                Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, Input(0)->ValueFor(fr), gradient);
 #if DUMPOUTPUT
             Input(1)->GradientFor(fr).Print("CrossEntropyWithSoftmaxNode Partial-Right");
 #endif
@@ -168,6 +190,10 @@ public:
 
     virtual void UpdateFunctionMBSize() override
     {
+        m_logSumExp->Resize(1, Input(1)->Value().GetNumCols());
+        m_crossEntropyPerColumn->Resize(1, Input(1)->Value().GetNumCols());
+        if (UseFusedSoftmax())
+            return;
         m_logSoftmaxOfRight->Resize(Input(1)->Value());
         m_softmaxOfRight->Resize(*m_logSoftmaxOfRight);
     }
@@ -175,6 +201,21 @@ public:
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override // -sum(left_i * log(softmax_i(right)))
     {
         FrameRange fr(Input(0)->GetMBLayout());
+        if (UseFusedSoftmax())
+        {
+            if (HasClassIndexLabels())
+                Matrix<ElemType>::SoftmaxCrossEntropyWithIndices(Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), *m_logSumExp, *m_crossEntropyPerColumn);
+            else
+                Matrix<ElemType>::SoftmaxCrossEntropy(Input(0)->ValueFor(fr), Input(1)->ValueFor(fr), *m_logSumExp, *m_crossEntropyPerColumn);
+            // flatten all gaps to zero, such that gaps will contribute zero to the sum
+            MaskMissingColumnsToZero(*m_crossEntropyPerColumn, Input(1)->GetMBLayout(), fr);
+            Value().AssignSumOfElements(*m_crossEntropyPerColumn);
+#if NANCHECK
+            Value().HasNan("CrossEntropyWithSoftmax");
+#endif
+            return;
+        }
+
         // first compute the softmax (column-wise)
         // Note that we need both log and non-log for gradient computation.
         m_logSoftmaxOfRight->AssignLogSoftmaxOf(Input(1)->ValueFor(fr), true);
@@ -196,7 +237,7 @@ public:
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
-        ValidateBinaryReduce(isFinalValidationPass);
+        ValidateBinaryReduce(isFinalValidationPass, /*allowClassIndexLabels=*/true);
     }
 
     virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
@@ -207,6 +248,8 @@ public:
             auto node = dynamic_pointer_cast<CrossEntropyWithSoftmaxNode<ElemType>>(nodeP);
             node->m_logSoftmaxOfRight->SetValue(*m_logSoftmaxOfRight);
             node->m_softmaxOfRight->SetValue(*m_softmaxOfRight);
+            node->m_logSumExp->SetValue(*m_logSumExp);
+            node->m_crossEntropyPerColumn->SetValue(*m_crossEntropyPerColumn);
         }
     }
 
@@ -216,16 +259,378 @@ public:
         Base::RequestMatricesBeforeForwardProp(matrixPool);
         RequestMatrixFromPool(m_logSoftmaxOfRight, matrixPool);
         RequestMatrixFromPool(m_softmaxOfRight, matrixPool);
+        RequestMatrixFromPool(m_logSumExp, matrixPool);
+        RequestMatrixFromPool(m_crossEntropyPerColumn, matrixPool);
+    }
+
+private:
+    bool UseFusedSoftmax() const
+    {
+        return Input(0)->Value().GetMatrixType() == DENSE;
     }
 
 protected:
     shared_ptr<Matrix<ElemType>> m_logSoftmaxOfRight;
     shared_ptr<Matrix<ElemType>> m_softmaxOfRight;
+    shared_ptr<Matrix<ElemType>> m_logSumExp;             // [1 x N], only used with dense or class-index labels
+    shared_ptr<Matrix<ElemType>> m_crossEntropyPerColumn; // [1 x N], only used with dense or class-index labels
 };
 
 template class CrossEntropyWithSoftmaxNode<float>;
 template class CrossEntropyWithSoftmaxNode<double>;
 
+// -----------------------------------------------------------------------
+// ModelParallelCrossEntropyWithSoftmaxNode (labels, hidden, weights)
+// Cross entropy with softmax for an output layer too large to replicate, whose weights are split by class over the
+// workers of data-parallel training (ParallelTrain/modelParallelSGD):
+//  - Input(0) [C x T] labels over all C classes
+//  - Input(1) [D x T] hidden activations, the input of the output layer
+//  - Input(2) [D x S] this worker's shard of the output layer weights, for the classes rank * S ... rank * S + S - 1
+//              (the shard of the last worker may extend beyond C; those classes are excluded from the softmax)
+// Each worker receives the hidden activations and labels of the minibatches of all workers, computes the logits of its
+// classes for all of them, and combines the normalization of the softmax through all-reduces of the column maxima and sums.
+// The value is the cross entropy of the worker's own minibatch, as with data-parallel training. The weight gradient is
+// complete (it covers the minibatches of all workers) and must not be aggregated; the gradients of the hidden activations
+// are summed over the workers and returned to the worker that owns the columns.
+// All workers must run each minibatch in lockstep; a worker without data calls ForwardAndBackpropWithoutLocalData().
+// Without an MPIWrapper (see SetModelParallelism()), S must be C, and this is CrossEntropyWithSoftmax(labels, TransposeTimes(weights, hidden)).
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class ModelParallelCrossEntropyWithSoftmaxNode : public ComputationNodeNonLooping /*ComputationNode*/<ElemType>, public NumInputs<3>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"ModelParallelCrossEntropyWithSoftmax"; }
+
+    // our inputs
+    static const size_t LABELS = 0;
+    static const size_t HIDDEN = 1;
+    static const size_t WEIGHTS = 2;
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(ModelParallelCrossEntropyWithSoftmaxNode);
+    ModelParallelCrossEntropyWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name),
+          m_classIndices(deviceId),
+          m_labelIds(deviceId),
+          m_allInputs(deviceId),
+          m_targets(0, 0, deviceId, MatrixType::SPARSE, matrixFormatSparseCSC),
+          m_softmax(deviceId),
+          m_maxIndexes(deviceId),
+          m_columnMax(deviceId),
+          m_columnSum(deviceId),
+          m_validClasses(deviceId),
+          m_targetWeights(deviceId),
+          m_targetLogits(deviceId),
+          m_inputGradients(deviceId),
+          m_localInputGradient(deviceId),
+          m_hasTargets(false)
+    {
+    }
+
+    // model-parallel training over the workers of 'mpi' (nullptr: the weights are not split)
+    // This is set by SGD (ComputationNetwork::SetModelParallelism()) and not saved.
+    void SetModelParallelism(const MPIWrapperPtr& mpi)
+    {
+        if (mpi)
+        {
+            size_t numClasses = Input(LABELS)->GetSampleMatrixNumRows();
+            size_t shardSize = Input(WEIGHTS)->GetAsMatrixNumCols();
+            if (shardSize * mpi->NumNodesInUse() < numClasses || shardSize * (mpi->NumNodesInUse() - 1) >= numClasses)
+                InvalidArgument("%ls %ls operation: The weights must have ceil(%d classes / %d workers) = %d columns, but have %d.", NodeName().c_str(), OperationName().c_str(),
+                                (int) numClasses, (int) mpi->NumNodesInUse(), (int) ((numClasses + mpi->NumNodesInUse() - 1) / mpi->NumNodesInUse()), (int) shardSize);
+        }
+        m_mpi = mpi;
+    }
+
+    virtual void BackpropToNonLooping(size_t inputIndex) override
+    {
+        if (inputIndex == LABELS)
+            InvalidArgument("%ls %ls operation cannot compute the gradient of its labels.", NodeName().c_str(), OperationName().c_str());
+
+        ElemType gradient = Gradient().Get00Element();
+        if (inputIndex == WEIGHTS)
+            BackpropToWeights(gradient);
+        else
+            BackpropToHiddenOfAllWorkers(gradient, &Input(HIDDEN)->GradientFor(FrameRange(Input(HIDDEN)->GetMBLayout())));
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+
+    virtual void UpdateFunctionMBSize() override
+    {
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        FrameRange fr(Input(LABELS)->GetMBLayout());
+        size_t numClasses = Input(LABELS)->GetSampleMatrixNumRows();
+        size_t hiddenDim = Input(HIDDEN)->GetSampleMatrixNumRows();
+        if (m_classIndices.GetNumCols() != numClasses)
+        {
+            std::vector<ElemType> classIndices(numClasses);
+            for (size_t c = 0; c < numClasses; c++)
+                classIndices[c] = (ElemType) c;
+            m_classIndices.SetValue(1, numClasses, m_deviceId, classIndices.data());
+        }
+
+        // the class of each of our columns, -1 in gaps
+        const auto& labels = Input(LABELS)->ValueFor(fr);
+        size_t numCols = labels.GetNumCols();
+        m_labelIds.AssignProductOf(m_classIndices, false, labels, false);
+        MaskMissingColumnsTo(m_labelIds, Input(LABELS)->GetMBLayout(), fr, (ElemType) -1);
+        m_localLabelIds.resize(numCols);
+        m_labelIds.CopySection(1, numCols, m_localLabelIds.data(), 1);
+
+        // our hidden activations, zero in gaps (which may hold anything)
+        m_localInputs.resize(hiddenDim * numCols);
+        Input(HIDDEN)->ValueFor(fr).CopySection(hiddenDim, numCols, m_localInputs.data(), hiddenDim);
+        for (size_t j = 0; j < numCols; j++)
+        {
+            if (m_localLabelIds[j] < 0)
+                std::fill(m_localInputs.begin() + j * hiddenDim, m_localInputs.begin() + (j + 1) * hiddenDim, (ElemType) 0);
+        }
+
+        ForwardPropOfAllWorkers();
+    }
+
+    // take part in the forward and (if 'backprop') backward propagation of the other workers' minibatches, for a worker
+    // that has no data in this minibatch; the node must be the root of backprop (its gradient is 1)
+    void ForwardAndBackpropWithoutLocalData(bool backprop)
+    {
+        m_localLabelIds.clear();
+        m_localInputs.clear();
+        ForwardPropOfAllWorkers();
+        if (!backprop)
+            return;
+
+        if (Input(WEIGHTS)->NeedsGradient())
+        {
+            Input(WEIGHTS)->ResetGradient(0);
+            BackpropToWeights(1);
+        }
+        if (Input(HIDDEN)->NeedsGradient())
+            BackpropToHiddenOfAllWorkers(1, nullptr);
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        m_pMBLayout = nullptr; // this node does not hold mini-batch data
+
+        if (isFinalValidationPass)
+        {
+            if (Input(LABELS)->GetMBLayout() != Input(HIDDEN)->GetMBLayout())
+                InvalidArgument("%ls %ls operation requires that the layouts of inputs 0 (labels) and 1 (hidden activations) match.", NodeName().c_str(), OperationName().c_str());
+            if (Input(WEIGHTS)->HasMBLayout())
+                InvalidArgument("%ls %ls operation requires input 2 (weights) to be a parameter, not minibatch data.", NodeName().c_str(), OperationName().c_str());
+            if (Input(HIDDEN)->GetSampleMatrixNumRows() != Input(WEIGHTS)->GetAsMatrixNumRows())
+                LogicError("The matrix dimensions of the hidden activations and the weights in the %ls operation do not match.", OperationName().c_str());
+            if (Input(WEIGHTS)->GetAsMatrixNumCols() > Input(LABELS)->GetSampleMatrixNumRows())
+                InvalidArgument("%ls %ls operation: The weights have more columns than there are classes.", NodeName().c_str(), OperationName().c_str());
+        }
+
+        SetDims(TensorShape(1), false);
+    }
+
+private:
+    size_t NumWorkers() const { return m_mpi ? m_mpi->NumNodesInUse() : 1; }
+    size_t Rank() const { return m_mpi ? m_mpi->CurrentNodeRank() : 0; }
+
+    void AllGather(const std::vector<ElemType>& local, std::vector<ElemType>& all, std::vector<int>& counts)
+    {
+        if (m_mpi)
+            m_mpi->AllGather(local.data(), local.size(), all, counts);
+        else
+        {
+            all = local;
+            counts.assign(1, (int) local.size());
+        }
+    }
+
+    // the softmax of our classes over the columns of all workers, and the cross entropy of our own columns
+    void ForwardPropOfAllWorkers()
+    {
+        const auto& weights = Input(WEIGHTS)->ValueAsMatrix();
+        size_t numClasses = Input(LABELS)->GetSampleMatrixNumRows();
+        size_t hiddenDim = weights.GetNumRows();
+        size_t shardSize = weights.GetNumCols();
+        size_t firstClass = Rank() * shardSize;
+        size_t numValidClasses = std::min(shardSize, numClasses - firstClass);
+        if (!m_mpi && shardSize != numClasses)
+            InvalidArgument("%ls %ls operation: The weights hold %d of %d classes, which requires model-parallel training with an MPIWrapper.", NodeName().c_str(), OperationName().c_str(),
+                            (int) shardSize, (int) numClasses);
+
+        // gather the labels and hidden activations of all workers
+        AllGather(m_localLabelIds, m_allLabelIds, m_numColsOfWorker);
+        std::vector<int> numInputElementsOfWorker;
+        AllGather(m_localInputs, m_allHostValues, numInputElementsOfWorker);
+        size_t numCols = m_allLabelIds.size();
+        m_firstColOfWorker.assign(1, 0);
+        for (int n : m_numColsOfWorker)
+            m_firstColOfWorker.push_back(m_firstColOfWorker.back() + n);
+        if (numCols == 0)
+        {
+            Value().SetValue(0);
+            return;
+        }
+        m_allInputs.SetValue(hiddenDim, numCols, m_deviceId, m_allHostValues.data());
+
+        // one-hot targets for the columns whose class is ours
+        std::vector<CPUSPARSE_INDEX_TYPE> targetColStarts(1, 0), targetRows;
+        for (size_t j = 0; j < numCols; j++)
+        {
+            if (m_allLabelIds[j] >= (ElemType) firstClass && m_allLabelIds[j] < (ElemType) (firstClass + shardSize))
+                targetRows.push_back((CPUSPARSE_INDEX_TYPE) ((size_t) m_allLabelIds[j] - firstClass));
+            targetColStarts.push_back((CPUSPARSE_INDEX_TYPE) targetRows.size());
+        }
+        m_hasTargets = !targetRows.empty();
+        if (m_hasTargets)
+        {
+            std::vector<ElemType> targetValues(targetRows.size(), 1);
+            m_targets.SetMatrixFromCSCFormat(targetColStarts.data(), targetRows.data(), targetValues.data(), targetRows.size(), shardSize, numCols);
+        }
+
+        // logits of our classes, shifted by the maximum over all classes of each column
+        m_softmax.AssignProductOf(weights, true, m_allInputs, false); // [S x numCols]
+        m_softmax.VectorMax(m_maxIndexes, m_columnMax, true);
+        std::vector<ElemType> columnMax(numCols);
+        m_columnMax.CopySection(1, numCols, columnMax.data(), 1);
+        if (m_mpi)
+            m_mpi->AllReduceMax(columnMax.data(), numCols);
+        m_columnMax.SetValue(1, numCols, m_deviceId, columnMax.data());
+        Matrix<ElemType>::ScaleAndAdd(-1, m_columnMax, m_softmax);
+        m_softmax.InplaceExp();
+        if (numValidClasses < shardSize)
+        {
+            if (m_validClasses.GetNumRows() != shardSize)
+            {
+                std::vector<ElemType> validClasses(shardSize, 0);
+                std::fill(validClasses.begin(), validClasses.begin() + numValidClasses, (ElemType) 1);
+                m_validClasses.SetValue(shardSize, 1, m_deviceId, validClasses.data());
+            }
+            m_softmax.ColumnElementMultiplyWith(m_validClasses);
+        }
+
+        // normalization over all classes
+        Matrix<ElemType>::VectorSum(m_softmax, m_columnSum, true);
+        std::vector<ElemType> columnSum(numCols);
+        m_columnSum.CopySection(1, numCols, columnSum.data(), 1);
+        if (m_mpi)
+            m_mpi->AllReduce(columnSum);
+
+        // the sum of the target logits of each worker's columns, to which the worker that owns the target class contributes
+        // (the un-shifted logit of column j is the weight column of its class times its hidden activation)
+        std::vector<double> targetLogitsOfWorker(NumWorkers(), 0);
+        if (m_hasTargets)
+        {
+            m_targetWeights.AssignProductOf(weights, false, m_targets, false); // [D x numCols]
+            m_inputGradients.AssignElementProductOf(m_targetWeights, m_allInputs); // (used as a workspace here)
+            Matrix<ElemType>::VectorSum(m_inputGradients, m_targetLogits, true);
+            std::vector<ElemType> targetLogits(numCols);
+            m_targetLogits.CopySection(1, numCols, targetLogits.data(), 1);
+            for (size_t n = 0; n < NumWorkers(); n++)
+            {
+                for (size_t j = m_firstColOfWorker[n]; j < m_firstColOfWorker[n + 1]; j++)
+                    targetLogitsOfWorker[n] += targetLogits[j];
+            }
+        }
+        if (m_mpi)
+            m_mpi->AllReduce(targetLogitsOfWorker);
+
+        // cross entropy of our own columns, and the normalization of the softmax (zero in gaps)
+        double crossEntropy = -targetLogitsOfWorker[Rank()];
+        for (size_t j = 0; j < numCols; j++)
+        {
+            if (m_allLabelIds[j] < 0)
+            {
+                columnSum[j] = 0;
+                continue;
+            }
+            if (j >= m_firstColOfWorker[Rank()] && j < m_firstColOfWorker[Rank() + 1])
+                crossEntropy += log((double) columnSum[j]) + columnMax[j];
+            columnSum[j] = 1 / columnSum[j];
+        }
+        m_columnSum.SetValue(1, numCols, m_deviceId, columnSum.data());
+        m_softmax.RowElementMultiplyWith(m_columnSum);
+        Value().SetValue((ElemType) crossEntropy);
+#if NANCHECK
+        Value().HasNan("ModelParallelCrossEntropyWithSoftmax");
+#endif
+    }
+
+    // gradient of the weights over the columns of all workers: gradient * hidden * (softmax - targets)^T
+    void BackpropToWeights(ElemType gradient)
+    {
+        if (m_allLabelIds.empty())
+            return;
+        auto& weightGradient = Input(WEIGHTS)->GradientAsMatrix();
+        Matrix<ElemType>::MultiplyAndWeightedAdd(gradient, m_allInputs, false, m_softmax, true, 1, weightGradient);
+        if (m_hasTargets)
+            Matrix<ElemType>::MultiplyAndWeightedAdd(-gradient, m_allInputs, false, m_targets, true, 1, weightGradient);
+    }
+
+    // gradient of the hidden activations of all workers, gradient * weights * (softmax - targets), summed over the workers,
+    // of which our columns are added to 'hiddenGradient' (nullptr if we have none)
+    void BackpropToHiddenOfAllWorkers(ElemType gradient, Matrix<ElemType>* hiddenGradient)
+    {
+        if (m_allLabelIds.empty())
+            return;
+        const auto& weights = Input(WEIGHTS)->ValueAsMatrix();
+        size_t hiddenDim = weights.GetNumRows();
+        m_inputGradients.AssignProductOf(weights, false, m_softmax, false); // [D x numCols]
+        if (m_hasTargets)
+            m_inputGradients -= m_targetWeights;
+        m_allHostValues.resize(m_inputGradients.GetNumElements());
+        m_inputGradients.CopySection(hiddenDim, m_allLabelIds.size(), m_allHostValues.data(), hiddenDim);
+
+        size_t numLocalCols = m_numColsOfWorker[Rank()];
+        std::vector<int> numElementsOfWorker(m_numColsOfWorker.size());
+        for (size_t n = 0; n < numElementsOfWorker.size(); n++)
+            numElementsOfWorker[n] = m_numColsOfWorker[n] * (int) hiddenDim;
+        std::vector<ElemType> localGradient(numLocalCols * hiddenDim);
+        if (m_mpi)
+            m_mpi->ReduceScatter(m_allHostValues.data(), localGradient.data(), numElementsOfWorker);
+        else
+            localGradient = m_allHostValues;
+
+        if (hiddenGradient && numLocalCols > 0)
+        {
+            m_localInputGradient.SetValue(hiddenDim, numLocalCols, m_deviceId, localGradient.data());
+            Matrix<ElemType>::ScaleAndAdd(gradient, m_localInputGradient, *hiddenGradient);
+        }
+    }
+
+protected:
+    Matrix<ElemType> m_classIndices;       // [1 x C] 0 ... C-1
+    Matrix<ElemType> m_labelIds;           // [1 x T] class of each of our columns
+    Matrix<ElemType> m_allInputs;          // [D x numCols] hidden activations of all workers, zero in gaps
+    Matrix<ElemType> m_targets;            // [S x numCols] sparse one-hot targets within our classes
+    Matrix<ElemType> m_softmax;            // [S x numCols] softmax of our classes, zero in gaps
+    Matrix<ElemType> m_maxIndexes;
+    Matrix<ElemType> m_columnMax;          // [1 x numCols]
+    Matrix<ElemType> m_columnSum;          // [1 x numCols]
+    Matrix<ElemType> m_validClasses;       // [S x 1] 1 for our classes < C, for the last worker
+    Matrix<ElemType> m_targetWeights;      // [D x numCols] weights of the target class of columns whose targets are ours, else 0
+    Matrix<ElemType> m_targetLogits;       // [1 x numCols]
+    Matrix<ElemType> m_inputGradients;     // [D x numCols] our part of the gradient of the hidden activations of all workers
+    Matrix<ElemType> m_localInputGradient; // [D x T]
+    bool m_hasTargets;
+
+    // staged in CPU memory for the exchange with the other workers
+    std::vector<ElemType> m_localLabelIds;
+    std::vector<ElemType> m_localInputs;
+    std::vector<ElemType> m_allLabelIds;
+    std::vector<ElemType> m_allHostValues;
+    std::vector<int> m_numColsOfWorker;
+    std::vector<size_t> m_firstColOfWorker;
+
+    MPIWrapperPtr m_mpi;
+};
+
+template class ModelParallelCrossEntropyWithSoftmaxNode<float>;
+template class ModelParallelCrossEntropyWithSoftmaxNode<double>;
+
 // -----------------------------------------------------------------------
 /// CrossEntropyNode (labels, prediction)
 // -----------------------------------------------------------------------
@@ -609,11 +1014,14 @@ public:
         int positive = 0, negative = 0;
         if (Input(0)->GetSampleLayout().GetNumElements() == 1)
         {
-            for (int i = 0; i < Input(0)->Value().GetNumCols(); i++) // BUGBUG: Loops must be over frames, not columns. Columns may contain gaps.
+            // get the labels to CPU once, in location=BOTH state, rather than reading each element from the GPU
+            const auto& labels = Input(0)->Value();
+            labels.TransferToDeviceIfNotThere(CPUDEVICE, /*ismoved =*/ false/*means: BOTH state OK*/, /*emptyTransfer =*/ false, /*updatePreferredDevice =*/ false);
+            for (int i = 0; i < labels.GetNumCols(); i++) // BUGBUG: Loops must be over frames, not columns. Columns may contain gaps.
             {
-                if (Input(0)->Value()(0, i) > 0)
+                if (labels(0, i) > 0)
                     positive++;
-                else if (Input(0)->Value()(0, i) < 0)
+                else if (labels(0, i) < 0)
                     negative++;
             }
             assert(positive * negative == 0);
@@ -688,6 +1096,8 @@ template class NoiseContrastiveEstimationNode<double>;
 //  - Input(1) [hdsize x T] hidden layer activation to the node in. for a simple rnn, this is the hidden layer activty
 //  - Input(2) [hdsize x vocab_size] weight matrix in, for speed-up, as per word matrix can be simply obtained as column slice
 //  - Input(3) [nbr_cls x T] clsprob in dense matrix in. This input, if applied softmax on, is the posterior probabilty of class given observations
+// The frames of a minibatch are grouped by class, and each class's word softmax is computed for all of its frames at once,
+// so that the number of operations grows with the number of classes in the minibatch, not the number of frames.
 // -----------------------------------------------------------------------
 
 // calculates: -sum(left_i * log(softmax_i(right))) for class given history and for word given history
@@ -712,19 +1122,33 @@ public:
           m_softMax(deviceId),
           m_grdToSoftMaxInput(deviceId),
           m_clsLogSoftmax(deviceId),
-          m_clsSoftmax(deviceId)
+          m_clsSoftmax(deviceId),
+          m_frameColumns(deviceId),
+          m_wordTargets(deviceId),
+          m_classTargets(deviceId),
+          m_obsByClass(deviceId),
+          m_grdToObsByClass(deviceId),
+          m_classObjective(deviceId)
     {
     }
 
 private:
-    // iterate over a large workspace that contains all class-conditioned probs concatenated
-    // 'sz' is the offset into that vector. We will iterate over these vectors at a few places. Always use this same boilerplate code.
+    // the frames of one class in the current minibatch
+    struct ClassBlock
+    {
+        size_t lft_bnd;    // index of the first word in the class
+        size_t nbr_wrd;    // number of words in the class
+        size_t firstFrame; // index of the first of the class's frames in m_frameColumns
+        size_t numFrames;
+        size_t sz;         // offset of the class's [nbr_wrd x numFrames] block in the concatenated workspaces
+    };
+
+    // iterate over the label columns, skipping gaps. We will iterate over these at a few places. Always use this same boilerplate code.
     template<class F>
-    size_t ForColumnsWithClass(const F& op)
+    void ForColumnsWithClass(const F& op)
     {
         const size_t nT = Input(LABELDATA)->GetNumTimeSteps();
         const size_t nS = Input(LABELDATA)->GetNumParallelSequences();
-        size_t sz = 0; // iterate over the packed concatenated class-conditioned prob vectors
         for (size_t s = 0; s < nS; s++)
             for (size_t t = 0; t < nT; t++)
             {
@@ -740,11 +1164,66 @@ private:
                 size_t nbr_wrd = (rgt_bnd - lft_bnd); // number of words in the class
 
                 // perform the operation
-                op(s, t, fr, y_t, c_t, sz, lft_bnd, nbr_wrd);
+                op(t * nS + s, y_t, c_t, lft_bnd, nbr_wrd);
+            }
+    }
 
-                sz += nbr_wrd;
+    // Group the frames of the minibatch by class, and set up the column map and the one-hot targets that go with it.
+    void GroupFramesByClass()
+    {
+        const size_t numCols = Input(LABELDATA)->Value().GetNumCols();
+        std::vector<std::vector<std::pair<size_t, size_t>>> framesOfClass(m_nbrCls); // column and word index within the class, per frame
+        std::vector<size_t> lftBndOfClass(m_nbrCls), nbrWrdOfClass(m_nbrCls);
+        ForColumnsWithClass([&](size_t j, size_t y_t, size_t c_t, size_t lft_bnd, size_t nbr_wrd)
+        {
+            if (nbr_wrd == 0)
+                LogicError("ClassBasedCrossEntropyWithSoftmax: Encountered a class of size 0.");
+            if (y_t < lft_bnd || y_t >= lft_bnd + nbr_wrd)
+                LogicError("ClassBasedCrossEntropyWithSoftmax: Word index out of bounds of class-member index range (word not a class member).");
+            if (c_t >= m_nbrCls)
+                LogicError("ClassBasedCrossEntropyWithSoftmax: Class index %d out of bounds, there are %d classes.", (int)c_t, (int)m_nbrCls);
+            if (framesOfClass[c_t].empty())
+            {
+                lftBndOfClass[c_t] = lft_bnd;
+                nbrWrdOfClass[c_t] = nbr_wrd;
             }
-        return sz;
+            else if (lftBndOfClass[c_t] != lft_bnd || nbrWrdOfClass[c_t] != nbr_wrd)
+                LogicError("ClassBasedCrossEntropyWithSoftmax: The word index range of class %d differs between frames.", (int)c_t);
+            framesOfClass[c_t].push_back(std::make_pair(j, y_t - lft_bnd));
+        });
+
+        m_classBlocks.clear();
+        std::vector<ElemType> frameColumns;
+        std::vector<ElemType> wordTargets;
+        std::vector<ElemType> classTargets(m_nbrCls * numCols, 0);
+        for (size_t c = 0; c < m_nbrCls; c++)
+        {
+            if (framesOfClass[c].empty())
+                continue;
+            ClassBlock block{lftBndOfClass[c], nbrWrdOfClass[c], frameColumns.size(), framesOfClass[c].size(), wordTargets.size()};
+            wordTargets.resize(block.sz + block.nbr_wrd * block.numFrames, 0);
+            for (size_t f = 0; f < block.numFrames; f++)
+            {
+                const auto& frame = framesOfClass[c][f];
+                frameColumns.push_back((ElemType)frame.first);
+                wordTargets[block.sz + f * block.nbr_wrd + frame.second] = 1;
+                classTargets[frame.first * m_nbrCls + c] = 1;
+            }
+            m_classBlocks.push_back(block);
+        }
+        m_totalNbrWords = wordTargets.size();
+
+        m_frameColumns.SetValue(1, frameColumns.size(), m_deviceId, frameColumns.data());
+        m_wordTargets.SetValue(1, m_totalNbrWords, m_deviceId, wordTargets.data());
+        m_classTargets.SetValue(m_nbrCls, numCols, m_deviceId, classTargets.data());
+    }
+
+    // view of a class's [nbr_wrd x numFrames] block of one of the concatenated workspaces
+    static Matrix<ElemType> ClassBlockOf(Matrix<ElemType>& workspace, const ClassBlock& block)
+    {
+        Matrix<ElemType> view = workspace.ColumnSlice(block.sz, block.nbr_wrd * block.numFrames);
+        view.Reshape(block.nbr_wrd, block.numFrames);
+        return view;
     }
 
     // compute gradients to input observations, the weights to the observations, and the class log posterior probabilites
@@ -756,65 +1235,56 @@ private:
 
         ComputeSoftMaxPartial(); // Note: Flag m_needRecomputeGradientToSoftmaxInput guards so that this computes only once.
 
-        ForColumnsWithClass([&](size_t /*s*/, size_t /*t*/, const FrameRange& fr, size_t /*y_t*/, size_t c_t, size_t sz, size_t lft_bnd, size_t nbr_wrd)
+        switch (inputIndex)
         {
-            // compute prb - 1 and prb
-            Matrix<ElemType> weightForClass = Input(EMBEDDINGMATRIX)->ValueAsMatrix().ColumnSlice(lft_bnd, nbr_wrd);
-            Matrix<ElemType> obs = Input(INPUTDATA)->ValueFor(fr); // hidden activation vector for current word token
-            Matrix<ElemType> grd_to_soft_max_input = m_grdToSoftMaxInput.ColumnSlice(sz, nbr_wrd);
-
-            switch (inputIndex)
+            case 1:
             {
-                case 1:
-                {
-                    // gradient to input
-                    Matrix<ElemType> grd_t = Input(INPUTDATA)->GradientFor(fr);
-                    Matrix<ElemType>::MultiplyAndAdd(weightForClass, false, grd_to_soft_max_input, true, grd_t);
-                    break;
-                }
-                case 2:
+                // gradient to input, computed per class and then added to the frames' columns
+                m_grdToObsByClass.Resize(Input(INPUTDATA)->GetSampleMatrixNumRows(), m_frameColumns.GetNumCols());
+                for (const auto& block : m_classBlocks)
                 {
-                    // gradient to input weight
-                    Matrix<ElemType> grd_to_wgt_t = Input(EMBEDDINGMATRIX)->GradientAsMatrix().ColumnSlice(lft_bnd, nbr_wrd);
-                    Matrix<ElemType>::MultiplyAndAdd(obs, false, grd_to_soft_max_input, false, grd_to_wgt_t);
-                    break;
+                    Matrix<ElemType> weightForClass = Input(EMBEDDINGMATRIX)->ValueAsMatrix().ColumnSlice(block.lft_bnd, block.nbr_wrd);
+                    Matrix<ElemType> grd_t = m_grdToObsByClass.ColumnSlice(block.firstFrame, block.numFrames);
+                    grd_t.AssignProductOf(weightForClass, false, ClassBlockOf(m_grdToSoftMaxInput, block), false);
                 }
-                case 3:
+                Input(INPUTDATA)->Gradient().DoScatterColumnsOf(1, m_frameColumns, m_grdToObsByClass, 1);
+                break;
+            }
+            case 2:
+            {
+                // gradient to input weight
+                for (const auto& block : m_classBlocks)
                 {
-                    Matrix<ElemType> grd_t = Input(CLASSPROBINDATA)->GradientFor(fr);
-                    grd_t.AssignValuesOf(Input(CLASSPROBINDATA)->DataFor(m_clsSoftmax, fr));
-                    ComputeCEPartialToSoftmaxInputs(grd_t, Gradient(), c_t);
-                    break;
+                    Matrix<ElemType> obs = m_obsByClass.ColumnSlice(block.firstFrame, block.numFrames);
+                    Matrix<ElemType> grd_to_wgt_t = Input(EMBEDDINGMATRIX)->GradientAsMatrix().ColumnSlice(block.lft_bnd, block.nbr_wrd);
+                    Matrix<ElemType>::MultiplyAndAdd(obs, false, ClassBlockOf(m_grdToSoftMaxInput, block), true, grd_to_wgt_t);
                 }
+                break;
             }
-        });
+            case 3:
+            {
+                // gradient to the class softmax input, computed in place since the class posteriors are not needed after this
+                FrameRange fr(Input(CLASSPROBINDATA)->GetMBLayout());
+                m_clsSoftmax -= m_classTargets;
+                MaskMissingColumnsToZero(m_clsSoftmax, Input(CLASSPROBINDATA)->GetMBLayout(), fr);
+                Matrix<ElemType>::Scale(Gradient(), m_clsSoftmax);
+                Input(CLASSPROBINDATA)->Gradient() += m_clsSoftmax;
+                break;
+            }
+        }
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
 
 private:
-    void ComputeCEPartialToSoftmaxInputs(Matrix<ElemType>& inputGradientValues, Matrix<ElemType>& gradientValues, size_t y_t)
-    {
-        Matrix<ElemType>::MinusOneAt(inputGradientValues, y_t);
-        Matrix<ElemType>::Scale(gradientValues, inputGradientValues);
-    }
-
     // gradient of cross entropy w.r.t. to input to softmax
     void ComputeSoftMaxPartial()
     {
         if (m_needRecomputeGradientToSoftmaxInput)
         {
-            m_grdToSoftMaxInput.Resize(1, m_totalNbrWords); // buffer that contains a concatenation of class-conditional values
-
-            ForColumnsWithClass([&](size_t /*s*/, size_t /*t*/, const FrameRange& /*fr*/, size_t y_t, size_t /*c_t*/, size_t sz, size_t lft_bnd, size_t nbr_wrd)
-            {
-                Matrix<ElemType> softMax = m_softMax.ColumnSlice(sz, nbr_wrd);
-
-                size_t idx_in_class = y_t - lft_bnd;
-                ComputeCEPartialToSoftmaxInputs(softMax, Gradient(), idx_in_class);
-
-                m_grdToSoftMaxInput.ColumnSlice(sz, nbr_wrd).AssignValuesOf(softMax);
-            });
+            // buffer that contains a concatenation of class-conditional values
+            m_grdToSoftMaxInput.AssignDifferenceOf(m_softMax, m_wordTargets);
+            Matrix<ElemType>::Scale(Gradient(), m_grdToSoftMaxInput);
 
             m_needRecomputeGradientToSoftmaxInput = false;
         }
@@ -833,66 +1303,42 @@ public:
         Input(LABELDATA)->Value().TransferToDeviceIfNotThere(CPUDEVICE, /*ismoved =*/ false/*means: BOTH state OK*/, /*emptyTransfer =*/ false, /*updatePreferredDevice =*/ false);
 
         auto& functionValues = Value();
-
-        const size_t hdSize = Input(INPUTDATA)->GetSampleMatrixNumRows();
+        FrameRange fr(Input(CLASSPROBINDATA)->GetMBLayout());
         assert(m_nbrCls == Input(CLASSPROBINDATA)->GetSampleMatrixNumRows());
 
-        // compute the class posteriors
+        // compute the class posteriors; gaps must not count
         m_clsLogSoftmax.SetValue(Input(CLASSPROBINDATA)->Value());
         m_clsLogSoftmax.InplaceLogSoftmax(true);   // log
+        MaskMissingColumnsToZero(m_clsLogSoftmax, Input(CLASSPROBINDATA)->GetMBLayout(), fr);
         m_clsSoftmax.AssignExpOf(m_clsLogSoftmax); // non-log
 
-        // create a large workspace to contain all class-conditioned probs concatenated
-        m_totalNbrWords = ForColumnsWithClass([](size_t /*s*/, size_t /*t*/, const FrameRange& /*fr*/, size_t y_t, size_t /*c_t*/, size_t /*sz*/, size_t lft_bnd, size_t nbr_wrd)
-        {
-            if (nbr_wrd == 0)
-                LogicError("ClassBasedCrossEntropyWithSoftmax: Encountered a class of size 0.");
-            if (y_t < lft_bnd || y_t >= lft_bnd + nbr_wrd)
-                LogicError("ClassBasedCrossEntropyWithSoftmax: Word index out of bounds of class-member index range (word not a class member).");
-        });
-        // now m_totalNbrWords = total size of concatenated vector
+        GroupFramesByClass();
 
-        // buffer to hold the concatenated class-conditioned prob vectors
+        // buffers to hold the concatenated class-conditioned prob blocks
         m_softMax.Resize(1, m_totalNbrWords);
         m_logSoftmax.Resize(1, m_totalNbrWords);
 
-        // accumulate objective
-        functionValues.SetValue(0);
-        ForColumnsWithClass([&](size_t s, size_t t, const FrameRange& fr, size_t y_t, size_t c_t, size_t sz, size_t lft_bnd, size_t nbr_wrd)
-        {
-            // now get views of various arrays that correspond to the index range of words belonging to this class
-
-            // get hidden vectors for the words in this class
-            Matrix<ElemType> weightForClass = Input(EMBEDDINGMATRIX)->ValueAsMatrix().ColumnSlice(lft_bnd, nbr_wrd); // [hdSize x nbr_wrd]
-
-            // buffer to hold the class-conditional distribution
-            Matrix<ElemType> softMax_t = m_softMax.ColumnSlice(sz, nbr_wrd); // TODO: declare these outside of the loop to avoid the malloc
-            Matrix<ElemType> logSoftMax_t = m_logSoftmax.ColumnSlice(sz, nbr_wrd);
-
-            Matrix<ElemType> obs = Input(INPUTDATA)->ValueFor(fr); // hidden activation vector for current word token
-
-            // multiply hidden activation with weight matrix (the slice of the weight matrix for the range of class members)
-            // TODO: can we use 'true' here instead? Above transposition hack won't work with row slices. 'obs' not used elsewhere
-            obs.Reshape(1, hdSize);                                                                                // transpose it (make it a column vector)
-            logSoftMax_t.AssignProductOf(obs /*(1 x hdSize)*/, false, weightForClass /*hdSize x nbr_wrd*/, false); // -> 1 x nbr_word
-
-            // log softmax(W x_t)
-            logSoftMax_t.InplaceLogSoftmax(false);
+        // hidden activation vectors of all frames, in class order
+        m_obsByClass.DoGatherColumnsOf(0, m_frameColumns, Input(INPUTDATA)->Value(), 1);
 
-            // and non-log version
-            softMax_t.SetValue(logSoftMax_t);
-            softMax_t.InplaceExp();
-            // we now have a column vector of class-conditional probabilities over the class members
-
-            // add  the word's class-conditional log posterior
-            size_t idx_in_class = y_t - lft_bnd;
-            Matrix<ElemType>::AddElementToElement(logSoftMax_t, 0, idx_in_class, functionValues, 0, 0); // (1x1)
-
-            // add the class log posterior probability (for backprop)
-            auto clsLogSoftmax_t = Input(CLASSPROBINDATA)->DataFor(m_clsLogSoftmax, fr);
-            Matrix<ElemType>::AddElementToElement(clsLogSoftmax_t, c_t, 0, functionValues, 0, 0); // (1x1)
-        });
+        for (const auto& block : m_classBlocks)
+        {
+            // multiply the hidden activations of all frames of the class with the slice of the weight matrix for the range of class members
+            Matrix<ElemType> weightForClass = Input(EMBEDDINGMATRIX)->ValueAsMatrix().ColumnSlice(block.lft_bnd, block.nbr_wrd); // [hdSize x nbr_wrd]
+            Matrix<ElemType> obs = m_obsByClass.ColumnSlice(block.firstFrame, block.numFrames);                                   // [hdSize x numFrames]
+            Matrix<ElemType> logSoftMax_c = ClassBlockOf(m_logSoftmax, block);
+            logSoftMax_c.AssignProductOf(weightForClass, true, obs, false); // -> nbr_wrd x numFrames
+
+            // log softmax(W x_t) for each frame
+            logSoftMax_c.InplaceLogSoftmax(true);
+        }
+        // and non-log version
+        m_softMax.AssignExpOf(m_logSoftmax);
 
+        // accumulate the words' class-conditional log posteriors and their classes' log posteriors
+        functionValues.AssignInnerProductOfMatrices(m_logSoftmax, m_wordTargets);
+        m_classObjective.AssignInnerProductOfMatrices(m_clsLogSoftmax, m_classTargets);
+        functionValues += m_classObjective;
         functionValues *= (-1);
 
 #if NANCHECK
@@ -929,11 +1375,19 @@ protected:
     Matrix<ElemType> m_clsSoftmax;
 
     // gradient of cross entropy with respect to the input of softmax
-    // a 1 row by \sum_t m_nbrWordsInEachTime[t] vector
-    // one slice of size m_nbrWordsInEachTime[t] saves the input to softmax for word y_t
+    // a 1 row by \sum_t nbr_wrd(t) vector, laid out like m_softMax: one [nbr_wrd x numFrames] block per class
     Matrix<ElemType> m_grdToSoftMaxInput;
     bool m_needRecomputeGradientToSoftmaxInput;
 
+    // the frames of the current minibatch grouped by class
+    std::vector<ClassBlock> m_classBlocks;
+    Matrix<ElemType> m_frameColumns;    // [1 x #frames] column of each frame, in class order
+    Matrix<ElemType> m_wordTargets;     // one-hot word within its class, laid out like m_softMax
+    Matrix<ElemType> m_classTargets;    // [nbr_cls x T] one-hot class, zero in gaps
+    Matrix<ElemType> m_obsByClass;      // [hdsize x #frames] hidden activations in class order
+    Matrix<ElemType> m_grdToObsByClass; // gradient to those
+    Matrix<ElemType> m_classObjective;  // [1 x 1]
+
     size_t m_nbrCls;
     size_t m_totalNbrWords;
 };
@@ -941,16 +1395,16 @@ protected:
 template class ClassBasedCrossEntropyWithSoftmaxNode<float>;
 template class ClassBasedCrossEntropyWithSoftmaxNode<double>;
 
-#ifdef COMING_SOON
-
 // -----------------------------------------------------------------------
 // CRFNode (labels, position_dependent_scores, transition_scores)
-//  - labels: output label vector of [0:T-1]
-//  - position_dependent_scores [0:T-1]: score from position dependent node,
+//  - labels: one-hot label sequences
+//  - position_dependent_scores: score from position dependent node,
 //    in the R-CRF case, it is the RNN output score before softmax
-//  - transition scores: square transition matrix,  --TODO: log?
+//  - transition scores: square transition matrix, in log space,
 //    in the R-CRF case, it is the transition probability between labels
-// BUGBUG: This node cannot operate with truncated BPTT, but does not detect it. It also does not handle gaps or test boundary flags.
+// Computes the negative log likelihood of the label sequences, summed over all sequences of the minibatch.
+// Each sequence is computed separately, all of them in one go by the Matrix::CRF functions; gaps do not count.
+// Sequences that cross minibatch boundaries (truncated BPTT) are computed as if they started and ended there.
 // -----------------------------------------------------------------------
 
 /**
@@ -984,46 +1438,23 @@ public:
         : Base(deviceId, name),
           mAlpha(deviceId),
           mBeta(deviceId),
-          mPostProb(deviceId)
+          mPostProb(deviceId),
+          mSequenceScores(deviceId)
     {
     }
 
     // compute posterior probability of label y at position t
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
-        FrameRange fr(Input(0)->GetMBLayout());
-        size_t nrow = Input(0)->Value().GetNumRows();
-        size_t ncol = Input(0)->Value().GetNumCols();
-
-        mAlpha.Resize(nrow, ncol);
-        mBeta.Resize(nrow, ncol);
-        mPostProb.Resize(nrow, ncol);
-
-        Value().SetValue(0.0);
-        Matrix<ElemType> funcVal = Value(); // TODO: This just creates a 1x1 matrix set to 0.
-
-        size_t nS = Input(0)->GetNumParallelSequences();
-        if (nS != 1)
-            LogicError("CRFNode: >1 parallel sequences are curently not implemented correctly.");
-        for (size_t i = 0; i < nS; i++) // process parallel sequences one by one  --BUGBUG: We should loop over individual sequences.
-        {
-            FrameRange sequenceRange = fr.Sequence(i); // FrameRange to select one sequence
-            // BUGBUG: This ^^ is neither supported nor correct, since this code does not handle gaps or start/end flags.
-            ForwardPropS(
-                DataWithMBLayoutFor(mPostProb, sequenceRange, Input(0)->GetMBLayout()),
-                DataWithMBLayoutFor(mAlpha, sequenceRange, Input(0)->GetMBLayout()),
-                DataWithMBLayoutFor(mBeta, sequenceRange, Input(0)->GetMBLayout()),
-                funcVal,
-                Input(0)->ValueFor(sequenceRange),
-                Input(1)->ValueFor(sequenceRange),
-                Input(2)->ValueAsMatrix(), mStartLbl,
-                mEndLbl);
-
-            Value() += funcVal; // aggregate over sequences
-        }
+        let& pMBLayout = Input(0)->GetMBLayout();
+        mSequences = pMBLayout->GetClippedSequences();
+        Matrix<ElemType>::CRFForwardBackward(Input(0)->Value(), Input(1)->Value(), Input(2)->ValueAsMatrix(),
+                                             pMBLayout->GetNumParallelSequences(), mSequences,
+                                             mAlpha, mBeta, mPostProb, mSequenceScores);
+        Value().AssignSumOfElements(mSequenceScores); // aggregate over sequences
     }
 
-    virtual void BackpropToNonLooping(size_t inputIndex) override // scaled by 2*number of colmns (samples) in the Matrix<ElemType>
+    virtual void BackpropToNonLooping(size_t inputIndex) override
     {
         FrameRange fr(Input(0)->GetMBLayout());
         // this should never be called for input[0], which is controlled through learningRateMultiplier == 0
@@ -1032,27 +1463,18 @@ public:
 
         if (inputIndex == 1)
         {
+            // the posteriors are zero in gaps, so the labels must be as well
+            Input(0)->MaskMissingValueColumnsToZero(fr);
             auto gradient = Input(1)->GradientFor(fr);
             Matrix<ElemType>::AddScaledDifference(Gradient(), mPostProb, Input(0)->ValueFor(fr), gradient);
         }
         else if (inputIndex == 2)
         {
             assert(Input(inputIndex)->GradientFor(fr).GetNumElements() > 0);
-            size_t nS = Input(0)->GetNumParallelSequences();
-            for (size_t i = 0; i < nS; i++) // process all sequences one by one
-            {
-                FrameRange sequenceRange = fr.Sequence(i); // FrameRange to select one sequence
-                auto& gradient = Input(2)->GradientAsMatrix();
-                TransGrdCompute(Input(0)->ValueFor(sequenceRange),
-                                DataWithMBLayoutFor(mAlpha, sequenceRange, Input(0)->GetMBLayout()),
-                                DataWithMBLayoutFor(mBeta, sequenceRange, Input(0)->GetMBLayout()),
-                                Input(2)->ValueAsMatrix(),
-                                gradient,
-                                mStartLbl, 1);
-            }
+            Matrix<ElemType>::CRFTransitionGradient(Input(0)->Value(), Input(1)->Value(), Input(2)->ValueAsMatrix(),
+                                                    Input(0)->GetNumParallelSequences(), mSequences,
+                                                    mAlpha, mBeta, Input(2)->GradientAsMatrix());
         }
-        else
-            return;
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
@@ -1060,147 +1482,6 @@ public:
         return false;
     }
 
-    // compute forward backward algorithm
-    /*TODO: merge with call site*/ void ForwardPropS(Matrix<ElemType> postprob, Matrix<ElemType> alpha, Matrix<ElemType> beta, Matrix<ElemType>& functionValues, const Matrix<ElemType>& lbls, const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores, int& firstLbl, int& lastLbl, const int iStep = 1)
-    {
-        // to-do, each slice is for one sentence
-        // to-do, number of slices correspond to number of frames
-        // this implementation only supports one sentence per minibatch
-
-        int nObs = lbls.GetNumCols();
-
-        // change to other values so can support multiple sentences in each minibatch
-        assert(iStep == 1);
-        ForwardCompute(alpha, lbls, pos_scores, pair_scores);
-        BackwardCompute(alpha, beta, functionValues, lbls, pos_scores, pair_scores, iStep);
-        PostProbCompute(postprob, alpha, beta);
-
-        firstLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, 0) != 0)
-            {
-                firstLbl = ik;
-                break;
-            }
-
-        lastLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, nObs - 1) != 0)
-            {
-                lastLbl = ik;
-                break;
-            }
-
-        functionValues.AssignInnerProductOfMatrices(lbls, pos_scores);
-
-        Matrix<ElemType> a = alpha.ColumnSlice(nObs - 1, 1);
-        ElemType fAlpha;
-        fAlpha = a.LogSumOfElements();
-
-        // transition score
-        ElemType tscore = 0;
-        for (int t = 0; t < nObs - 1; t++)
-        {
-            int i = -1;
-            for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-                if (lbls(ik, t) != 0)
-                {
-                    i = ik;
-                    break;
-                }
-            int j = -1;
-            for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-                if (lbls(ik, t + 1) != 0)
-                {
-                    j = ik;
-                    break;
-                }
-            tscore += pair_scores(j, i);
-        }
-        tscore += functionValues.Get00Element(); // correct path score
-        tscore -= fAlpha;                        // reduced by the scores from all paths
-        functionValues.SetValue(tscore);
-
-        functionValues *= (-1);
-    }
-
-    // compute forward backward algorithm
-    static void ForwardCompute(Matrix<ElemType>& alpha,
-                               const Matrix<ElemType>& lbls,
-                               const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores)
-    {
-        // to-do, shift more than 1 to support muliple sentences per minibatch
-        int iNumPos = lbls.GetNumCols();
-        int iNumLab = lbls.GetNumRows();
-
-        int firstLbl = -1;
-        for (int ik = 0; ik < lbls.GetNumRows(); ik++)
-            if (lbls(ik, 0) != 0)
-            {
-                firstLbl = ik;
-                break;
-            }
-
-        // need to have
-        alpha.Resize(iNumLab, iNumPos);
-
-        for (int t = 0; t < iNumPos; t++)
-        {
-            for (int k = 0; k < iNumLab; k++)
-            {
-                ElemType fTmp = (ElemType) LZERO;
-                for (int j = 0; j < iNumLab; j++)
-                {
-                    ElemType fAlpha = (j == firstLbl) ? (ElemType) 0.0 : (ElemType) LZERO;
-                    if (t > 0)
-                        fAlpha = alpha(j, t - 1);
-                    fTmp = alpha.LogAdd(fTmp, fAlpha + pair_scores(k, j));
-                }
-                fTmp += pos_scores(k, t); // include position dependent score
-                alpha(k, t) = fTmp;
-            }
-        }
-    }
-
-    // compute backward algorithm
-    static void BackwardCompute(const Matrix<ElemType>& alpha, Matrix<ElemType>& beta,
-                                Matrix<ElemType>& functionValues, const Matrix<ElemType>& lbls,
-                                const Matrix<ElemType>& pos_scores, const Matrix<ElemType>& pair_scores, const int shift = 1)
-    {
-        assert(shift == 1);
-
-        alpha.RCRFBackwardCompute(alpha, beta, functionValues, lbls, pos_scores, pair_scores, shift);
-    }
-
-    static void TransGrdCompute(const Matrix<ElemType>& lbls,
-                                const Matrix<ElemType>& alpha,
-                                const Matrix<ElemType>& beta,
-                                const Matrix<ElemType>& pair_scores,
-                                Matrix<ElemType>& grd,
-                                const int startLbl,
-                                const int shift = 1)
-    {
-        assert(shift == 1);
-
-        alpha.RCRFTransGrdCompute(lbls,
-                                  alpha,
-                                  beta,
-                                  pair_scores,
-                                  grd,
-                                  startLbl, shift);
-    }
-
-    // compute forward backward algorithm
-    static void PostProbCompute(Matrix<ElemType>& postprob, const Matrix<ElemType>& alpha, const Matrix<ElemType>& beta)
-    {
-        int iNumPos = alpha.GetNumCols();
-        int iNumLab = alpha.GetNumRows();
-
-        postprob.Resize(iNumLab, iNumPos);
-        postprob.SetValue(beta);
-        postprob.InplaceExp();
-    }
-
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
@@ -1210,7 +1491,6 @@ public:
             if (!(Input(1)->GetSampleMatrixNumRows() == Input(2)->GetAsMatrixNumRows() && // position dependent and pair scores have same number of labels
                   Input(0)->GetSampleMatrixNumRows() == Input(1)->GetSampleMatrixNumRows() &&
                   Input(0)->HasMBLayout() && Input(0)->GetMBLayout() == Input(1)->GetMBLayout() &&
-                  // Input(0)->GetNumCols() == Input(1)->GetNumCols() && // position dependent and pair scores have the same observation numbers
                   Input(2)->GetAsMatrixNumCols() == Input(2)->GetAsMatrixNumRows()))
             {
                 LogicError("The Matrix dimension in the CRFNode operation does not match.");
@@ -1225,12 +1505,11 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = dynamic_pointer_cast<CRFNode<ElemType>>(nodeP);
-            node->mAlpha = mAlpha;
-            node->mBeta = mBeta;
-            node->mPostProb = mPostProb;
-
-            node->mStartLbl = mStartLbl;
-            node->mEndLbl = mEndLbl;
+            node->mAlpha.SetValue(mAlpha);
+            node->mBeta.SetValue(mBeta);
+            node->mPostProb.SetValue(mPostProb);
+            node->mSequenceScores.SetValue(mSequenceScores);
+            node->mSequences = mSequences;
         }
     }
 
@@ -1238,11 +1517,12 @@ private:
     Matrix<ElemType> mAlpha; // TODO: m_Alpha etc.
     Matrix<ElemType> mBeta;
     Matrix<ElemType> mPostProb;
-    int mStartLbl;
-    int mEndLbl;
+    Matrix<ElemType> mSequenceScores; // [1 x number of sequences] negative log likelihood of each sequence
+    std::vector<SequenceInMinibatch> mSequences;
 };
 
-#endif
+template class CRFNode<float>;
+template class CRFNode<double>;
 
 // -----------------------------------------------------------------------
 // Logistic (labels, prediction, weight)
@@ -1405,6 +1685,9 @@ template class LogisticNode<double>;
 // -----------------------------------------------------------------------
 // DropoutNode (input) -- perform drop-out
 // Output is scaled such that no post-scaling is necessary.
+// With SetCounterBasedMask(true) (SGD's counterBasedDropout), the mask comes from the counter-based generator (PhiloxRNG.h)
+// instead: it is then the same on CPU and GPU and is not kept for backprop, since BackpropTo() regenerates it from the
+// counters that were reserved for the minibatch. Otherwise the mask is drawn from the device's generator and kept, as before.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -1421,7 +1704,8 @@ public:
     DeclareConstructorFromConfigWithNumInputs(DropoutNode);
     DropoutNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
-          m_dropoutRate(0)
+          m_dropoutRate(0),
+          m_counterBasedMask(false)
     {
         m_randomSeed = (unsigned long) CreateUniqId();
     }
@@ -1431,8 +1715,11 @@ public:
         Matrix<ElemType> sliceInput0Grad = Input(0)->GradientFor(fr);
         Matrix<ElemType> sliceOutputGrad = GradientFor(fr);
 
-        if (m_dropoutRate > 0)
+        if (m_dropoutRate > 0 && !m_counterBasedMask)
             sliceInput0Grad.AddElementProductOf(sliceOutputGrad, DataFor(*m_maskOfDropout, fr));
+        else if (m_dropoutRate > 0)
+            sliceInput0Grad.AssignElementProductOfUniformRandomMask(sliceOutputGrad, (ElemType) m_dropoutRate, (ElemType) (1.0 / (1.0 - m_dropoutRate)) /*pre-scaled*/,
+                                                                    GetRNGHandle().Seed(), m_maskFirstCounter, MaskElementOffset(fr), /*beta=*/1);
         else
             sliceInput0Grad += sliceOutputGrad;
     }
@@ -1444,8 +1731,11 @@ public:
     {
         Base::UpdateFunctionMBSize();
         // resize temporaries to their proper size
-        if (m_dropoutRate > 0)
+        if (m_dropoutRate > 0 && !m_counterBasedMask)
             m_maskOfDropout->Resize(Input(0)->Value());
+        // reserve the random numbers of the drop-out mask of this minibatch, one counter value per 4 elements
+        else if (m_dropoutRate > 0 && !Environment().IsInferring())
+            m_maskFirstCounter = GetRNGHandle().ReserveCounters((Value().GetNumElements() + 3) / 4);
     }
 
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
@@ -1457,7 +1747,7 @@ public:
         {
             sliceOutputValue.SetValue(sliceInput0Value);
         }
-        else
+        else if (!m_counterBasedMask)
         {
             // determine drop-out mask for this minibatch
             auto sliceMask = DataFor(*m_maskOfDropout, fr);
@@ -1465,6 +1755,18 @@ public:
             // apply dropout mask
             sliceOutputValue.AssignElementProductOf(sliceMask, sliceInput0Value);
         }
+        else
+        {
+            // apply the drop-out mask of these frames of the minibatch
+            sliceOutputValue.AssignElementProductOfUniformRandomMask(sliceInput0Value, (ElemType) m_dropoutRate, (ElemType) (1.0 / (1.0 - m_dropoutRate)) /*pre-scaled*/,
+                                                                     GetRNGHandle().Seed(), m_maskFirstCounter, MaskElementOffset(fr));
+        }
+    }
+
+    // index of the first element of the frames 'fr' in the minibatch, which determines their random numbers
+    size_t MaskElementOffset(const FrameRange& fr) const
+    {
+        return ColumnRangeWithMBLayoutFor(Value().GetNumCols(), fr, GetMBLayout()).first * Value().GetNumRows();
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
@@ -1480,6 +1782,12 @@ public:
         m_dropoutRate = val;
     }
 
+    // whether the mask comes from the counter-based generator and is regenerated for backprop
+    void SetCounterBasedMask(bool counterBasedMask)
+    {
+        m_counterBasedMask = counterBasedMask;
+    }
+
     void SetRandomSeed(const unsigned long val)
     {
         m_randomSeed = (unsigned long) val;
@@ -1505,9 +1813,12 @@ public:
             auto node = dynamic_pointer_cast<DropoutNode<ElemType>>(nodeP);
             node->m_dropoutRate = m_dropoutRate;
             node->m_randomSeed = m_randomSeed;
+            node->m_counterBasedMask = m_counterBasedMask;
             node->m_maskOfDropout = m_maskOfDropout;
+            node->m_maskFirstCounter = m_maskFirstCounter;
         }
     }
+
     // request matrices needed to do node function value evaluation
     virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool)
     {
@@ -1526,8 +1837,10 @@ private:
     double m_dropoutRate;
     unsigned long m_randomSeed;
     std::shared_ptr<RNGHandle> m_RNGHandle;
+    bool m_counterBasedMask;
 
     shared_ptr<Matrix<ElemType>> m_maskOfDropout;
+    uint64_t m_maskFirstCounter = 0; // first counter value of the drop-out mask of the current minibatch (counter-based mask only)
 };
 
 template class DropoutNode<float>;
@@ -1570,6 +1883,11 @@ template class DropoutNode<double>;
 // * epsilon is a conditioner constant used in computing InvStdDev
 // * useCntkEngine is a boolean flag that specifies which batch normalization implementation to use : CNTK or cuDNN - based.
 // * imageLayout is the image layout.Only cudnn is supported.
+//
+// In data-parallel training, the statistics can be synchronized across the workers (SynchronizeStatistics(), set by SGD
+// with syncBatchNormalizationStatistics): mean and variance are then computed over the minibatches of all workers
+// together, and the gradient of the input accounts for that, as if the node was run once on the joint minibatch.
+// The gradients of scale and bias stay those of the local minibatch, as they are aggregated with all other gradients.
 // -----------------------------------------------------------------------
 template <class ElemType>
 class BatchNormalizationNode : public ComputationNode<ElemType>, public NumInputs<5>
@@ -1584,13 +1902,13 @@ class BatchNormalizationNode : public ComputationNode<ElemType>, public NumInput
 public:
     BatchNormalizationNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name), m_spatial(false), m_normTimeConst(0), m_blendTimeConst(0), m_epsilon(0), m_useCntkEngine(true),
-        m_mbCount(0), m_imageLayoutKind(ImageLayoutKind::CHW)
+        m_mbCount(0), m_imageLayoutKind(ImageLayoutKind::CHW), m_frozen(false)
     {
     }
     BatchNormalizationNode(DEVICEID_TYPE deviceId, const wstring& name, bool spatial, double normalizationTimeConstant, double blendTimeConstant,
                            double epsilon, bool useCntkEngine, ImageLayoutKind imageLayoutKind)
                            : Base(deviceId, name), m_spatial(spatial), m_normTimeConst(normalizationTimeConstant), m_blendTimeConst(blendTimeConstant),
-                           m_epsilon(epsilon), m_useCntkEngine(useCntkEngine), m_imageLayoutKind(imageLayoutKind), m_mbCount(0)
+                           m_epsilon(epsilon), m_useCntkEngine(useCntkEngine), m_imageLayoutKind(imageLayoutKind), m_mbCount(0), m_frozen(false)
     {
     }
     BatchNormalizationNode(const ScriptableObjects::IConfigRecordPtr configp)
@@ -1686,11 +2004,15 @@ public:
             node->m_mbCount = m_mbCount;
             node->m_epsilon = m_epsilon;
             node->m_useCntkEngine = m_useCntkEngine;
+            node->m_frozen = m_frozen;
         }
     }
 
     void BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
+        if (m_frozen)
+            LogicError("%ls %ls operation was frozen for inference and cannot be backpropagated through.", NodeName().c_str(), OperationName().c_str());
+
         if (inputIndex == 0) // derivative with respect to the input.
         {
             auto sliceOutputGrad = GradientFor(fr);
@@ -1704,6 +2026,8 @@ public:
             // Compute all derivatives in one step. Save derivatives with respect to scale and bias in temp matrices.
             m_bnEng->Backward(sliceInputValue, sliceOutputGrad, sliceInputGrad, scale,
                                               *m_saveMean, *m_saveInvStdDev, *m_dScale, *m_dBias);
+            if (m_statisticsWereSynchronized)
+                BackpropToInputSynchronized(fr, scale);
         }
         else if (inputIndex == 1) // derivative with respect to the scale
         {
@@ -1746,7 +2070,8 @@ public:
 
         double expAvgFactor;
         double blendFactor;
-        if (!Environment().IsTraining())
+        m_statisticsWereSynchronized = false;
+        if (!Environment().IsTraining() || m_frozen)
         {
             expAvgFactor = 0;
             blendFactor = 1.0;
@@ -1756,26 +2081,16 @@ public:
         }
         else
         {
-            double numSamples = (double)GetMBLayout()->GetActualNumSamples();
-            if (m_normTimeConst > 0)
-            {
-                // Convert to per-minibatch factor. Treat positivie infinity as if running mean/var parameters are "frozen"
-                // that is, do not require updates.
-                expAvgFactor = !isfinite(m_normTimeConst) ? 0 : (1.0 - exp(-numSamples / m_normTimeConst));
-            }
-            else
-            {
-                // REVIEW alexeyk: hack, m_normTimeConst < 0 is used to compute CMA.
-                expAvgFactor = (m_normTimeConst < 0) ? (1.0 / (1.0 + m_mbCount)) : 1.0;
-            }
-
-            if (!isfinite(m_blendTimeConst))
-                blendFactor = 1.0;
-            else
-                blendFactor = m_blendTimeConst > 0 ? (m_blendTimeConst / (m_blendTimeConst + numSamples)) : 0;
-
             m_saveMean->Resize(runMean);
             m_saveInvStdDev->Resize(runMean);
+
+            if (m_mpi && m_mpi->NumNodesInUse() > 1)
+            {
+                ForwardPropSynchronized(sliceInputValue, scale, bias, runMean, runInvStdDev, sliceOutputValue);
+                m_mbCount++;
+                return;
+            }
+            GetStatisticsFactors((double)GetMBLayout()->GetActualNumSamples(), expAvgFactor, blendFactor);
         }
 
         m_bnEng->Forward(sliceInputValue, scale, bias, expAvgFactor, blendFactor, runMean, runInvStdDev,
@@ -1784,6 +2099,145 @@ public:
         m_mbCount++;
     }
 
+private:
+    // factors for updating the running statistics with, and blending them into, the statistics of a minibatch of numSamples
+    void GetStatisticsFactors(double numSamples, double& expAvgFactor, double& blendFactor) const
+    {
+        if (m_normTimeConst > 0)
+        {
+            // Convert to per-minibatch factor. Treat positivie infinity as if running mean/var parameters are "frozen"
+            // that is, do not require updates.
+            expAvgFactor = !isfinite(m_normTimeConst) ? 0 : (1.0 - exp(-numSamples / m_normTimeConst));
+        }
+        else
+        {
+            // REVIEW alexeyk: hack, m_normTimeConst < 0 is used to compute CMA.
+            expAvgFactor = (m_normTimeConst < 0) ? (1.0 / (1.0 + m_mbCount)) : 1.0;
+        }
+
+        if (!isfinite(m_blendTimeConst))
+            blendFactor = 1.0;
+        else
+            blendFactor = m_blendTimeConst > 0 ? (m_blendTimeConst / (m_blendTimeConst + numSamples)) : 0;
+    }
+
+    // Forward propagation with the statistics of the minibatches of all workers. The engine first computes the mean and
+    // inverse standard deviation of the local minibatch; from these, each worker contributes its per-map count, sum, and
+    // sum of squares to one all-reduce. The running statistics are then updated and blended, identically on all workers,
+    // as the engine would, and the engine normalizes with the result.
+    void ForwardPropSynchronized(const Matrix<ElemType>& sliceInputValue, const Matrix<ElemType>& scale, const Matrix<ElemType>& bias,
+                                 Matrix<ElemType>& runMean, Matrix<ElemType>& runInvStdDev, Matrix<ElemType>& sliceOutputValue)
+    {
+        const size_t numMaps = runMean.GetNumRows();
+        CreateMatrixIfNull(m_localMean);
+        CreateMatrixIfNull(m_localInvStdDev);
+        m_localMean->Resize(runMean);
+        m_localInvStdDev->Resize(runMean);
+        m_bnEng->Forward(sliceInputValue, scale, bias, /*expAvgFactor=*/1, /*blendFactor=*/0, *m_localMean, *m_localInvStdDev,
+                         sliceOutputValue, m_epsilon, *m_saveMean, *m_saveInvStdDev);
+
+        // The variance is recovered from the inverse standard deviation; it is combined across the workers in double.
+        std::vector<ElemType> mean(numMaps), invStdDev(numMaps);
+        m_localMean->CopySection(numMaps, 1, mean.data(), numMaps);
+        m_localInvStdDev->CopySection(numMaps, 1, invStdDev.data(), numMaps);
+        m_localCount = (double)(sliceInputValue.GetNumElements() / numMaps);
+        m_syncBuffer.assign(2 + 2 * numMaps, 0);
+        m_syncBuffer[0] = m_localCount;
+        m_syncBuffer[1] = (double)GetMBLayout()->GetActualNumSamples();
+        for (size_t map = 0; map < numMaps; map++)
+        {
+            const double variance = std::max(0.0, 1 / ((double)invStdDev[map] * invStdDev[map]) - m_epsilon);
+            m_syncBuffer[2 + map] = m_localCount * mean[map];
+            m_syncBuffer[2 + numMaps + map] = m_localCount * (variance + (double)mean[map] * mean[map]);
+        }
+        m_mpi->AllReduce(m_syncBuffer);
+        m_syncCount = m_syncBuffer[0];
+
+        double expAvgFactor, blendFactor;
+        GetStatisticsFactors(m_syncBuffer[1], expAvgFactor, blendFactor);
+        std::vector<ElemType> runMeanHost(numMaps), runInvStdDevHost(numMaps);
+        runMean.CopySection(numMaps, 1, runMeanHost.data(), numMaps);
+        runInvStdDev.CopySection(numMaps, 1, runInvStdDevHost.data(), numMaps);
+        m_syncMean.resize(numMaps);
+        m_syncInvStdDev.resize(numMaps);
+        for (size_t map = 0; map < numMaps; map++)
+        {
+            const double jointMean = m_syncBuffer[2 + map] / m_syncCount;
+            const double jointVariance = std::max(0.0, m_syncBuffer[2 + numMaps + map] / m_syncCount - jointMean * jointMean);
+            const double jointInvStdDev = 1 / sqrt(jointVariance + m_epsilon);
+            runMeanHost[map] = (ElemType)(expAvgFactor * jointMean + (1 - expAvgFactor) * runMeanHost[map]);
+            runInvStdDevHost[map] = (ElemType)(expAvgFactor * jointInvStdDev + (1 - expAvgFactor) * runInvStdDevHost[map]);
+            m_syncMean[map] = (1 - blendFactor) * jointMean + blendFactor * runMeanHost[map];
+            m_syncInvStdDev[map] = (1 - blendFactor) * jointInvStdDev + blendFactor * runInvStdDevHost[map];
+            mean[map] = (ElemType)m_syncMean[map];
+            invStdDev[map] = (ElemType)m_syncInvStdDev[map];
+        }
+        runMean.SetValue(numMaps, 1, runMean.GetDeviceId(), runMeanHost.data());
+        runInvStdDev.SetValue(numMaps, 1, runInvStdDev.GetDeviceId(), runInvStdDevHost.data());
+        m_saveMean->SetValue(numMaps, 1, m_saveMean->GetDeviceId(), mean.data());
+        m_saveInvStdDev->SetValue(numMaps, 1, m_saveInvStdDev->GetDeviceId(), invStdDev.data());
+
+        // normalize with the joint statistics, passed as running statistics that are only read
+        m_bnEng->Forward(sliceInputValue, scale, bias, /*expAvgFactor=*/0, /*blendFactor=*/1, *m_saveMean, *m_saveInvStdDev,
+                         sliceOutputValue, m_epsilon, *m_localMean, *m_localInvStdDev);
+        m_statisticsWereSynchronized = true;
+    }
+
+    // The engine computes the input gradient of the local minibatch, with scale and bias gradients dScale and dBias summed
+    // over m local values per map: dx = scale * invStdDev * (dy - (xHat * dScale + dBias) / m). Over the joint minibatch,
+    // dScale and dBias are summed across the workers, and m is the joint count. The difference is linear in x per map,
+    // c1 * x + c0, which is added to the input gradient.
+    void BackpropToInputSynchronized(const FrameRange& fr, const Matrix<ElemType>& scale)
+    {
+        const size_t numMaps = scale.GetNumRows();
+        std::vector<ElemType> scaleHost(numMaps), dScale(numMaps), dBias(numMaps);
+        scale.CopySection(numMaps, 1, scaleHost.data(), numMaps);
+        m_dScale->CopySection(numMaps, 1, dScale.data(), numMaps);
+        m_dBias->CopySection(numMaps, 1, dBias.data(), numMaps);
+        m_syncBuffer.resize(2 * numMaps);
+        for (size_t map = 0; map < numMaps; map++)
+        {
+            m_syncBuffer[map] = dScale[map];
+            m_syncBuffer[numMaps + map] = dBias[map];
+        }
+        m_mpi->AllReduce(m_syncBuffer);
+
+        std::vector<ElemType> c1(numMaps), c0(numMaps);
+        for (size_t map = 0; map < numMaps; map++)
+        {
+            const double invStdDev = m_syncInvStdDev[map];
+            const double scaleInvStdDev = scaleHost[map] * invStdDev;
+            const double dScaleDiff = dScale[map] / m_localCount - m_syncBuffer[map] / m_syncCount;
+            const double dBiasDiff = dBias[map] / m_localCount - m_syncBuffer[numMaps + map] / m_syncCount;
+            c1[map] = (ElemType)(scaleInvStdDev * invStdDev * dScaleDiff);
+            c0[map] = (ElemType)(scaleInvStdDev * (dBiasDiff - m_syncMean[map] * invStdDev * dScaleDiff));
+        }
+        CreateMatrixIfNull(m_syncGradientFactor);
+        CreateMatrixIfNull(m_syncGradientOffset);
+        m_syncGradientFactor->SetValue(numMaps, 1, m_deviceId, c1.data());
+        m_syncGradientOffset->SetValue(numMaps, 1, m_deviceId, c0.data());
+
+        // the coefficients are broadcast over the spatial dimensions of a map, which are the leading ones of the sample
+        SmallVector<size_t> dims = GetSampleLayout().GetDims();
+        for (size_t k = 0, n = GetSampleLayout().GetNumElements(); k < dims.size() && n > numMaps; k++)
+        {
+            n /= dims[k];
+            dims[k] = 1;
+        }
+        TensorShape mapShape(dims);
+        if (mapShape.GetNumElements() != numMaps)
+            InvalidArgument("%ls %ls: synchronized statistics require the feature maps to be the trailing dimensions of the sample layout [%s].",
+                            NodeName().c_str(), OperationName().c_str(), string(GetSampleLayout()).c_str());
+
+        size_t rank = mapShape.GetRank();
+        auto sliceInputValue = Input(0)->ValueTensorFor(rank, fr);
+        auto sliceInputGrad = Input(0)->GradientTensorFor(rank, fr);
+        sliceInputGrad.AddElementwiseProductOf(sliceInputValue, TensorView<ElemType>(m_syncGradientFactor, mapShape));
+        sliceInputGrad.AddCopyOf(TensorView<ElemType>(m_syncGradientOffset, mapShape));
+    }
+
+public:
+
     void Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
@@ -1820,9 +2274,18 @@ public:
     void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
     {
         Base::RequestMatricesBeforeForwardProp(matrixPool);
+        // frozen, the minibatch statistics are not kept, so they need no memory of the pool, which would last until backprop
+        if (m_frozen)
+        {
+            CreateMatrixIfNull(m_saveMean);
+            CreateMatrixIfNull(m_saveInvStdDev);
+        }
+        else
+        {
             RequestMatrixFromPool(m_saveMean, matrixPool);
             RequestMatrixFromPool(m_saveInvStdDev, matrixPool);
         }
+    }
 
     void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
     {
@@ -1834,11 +2297,14 @@ public:
     void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
     {
         Base::ReleaseMatricesAfterBackprop(matrixPool);
+        if (!m_frozen)
+        {
             ReleaseMatrixToPool(m_saveMean, matrixPool);
             ReleaseMatrixToPool(m_saveInvStdDev, matrixPool);
-            ReleaseMatrixToPool(m_dScale, matrixPool);
-            ReleaseMatrixToPool(m_dBias, matrixPool);
         }
+        ReleaseMatrixToPool(m_dScale, matrixPool);
+        ReleaseMatrixToPool(m_dBias, matrixPool);
+    }
 
     void SetNormalizationTimeConstants(double normalizationTimeConstant, double prevNormalizationTimeConstant,
                                        double blendTimeConstant, double prevBlendTimeConstant)
@@ -1851,6 +2317,25 @@ public:
             m_blendTimeConst = blendTimeConstant;
     }
 
+    // inference only: always normalize with the running statistics, as when inferring, whatever the network operation mode
+    // This is set when preparing a network for inference (ComputationNetwork::PrepareForInference()) and not saved.
+    void Freeze() { m_frozen = true; }
+
+    // number of minibatches the running statistics were updated with; SGD restores it after the trial mini-epochs of the learning-rate search
+    size_t GetMBCount() const { return m_mbCount; }
+    void SetMBCount(size_t mbCount) { m_mbCount = mbCount; }
+
+    // data-parallel training: compute the statistics over the minibatches of all workers of 'mpi' (nullptr: of the local minibatch)
+    // This is set by SGD (ComputationNetwork::SetBatchNormalizationSynchronization()) and not saved. All workers must then run
+    // forward and backward propagation of every minibatch.
+    void SynchronizeStatistics(const MPIWrapperPtr& mpi)
+    {
+        if (mpi && !m_useCntkEngine)
+            InvalidArgument("%ls %ls: synchronized statistics require the CNTK batch normalization engine (useCntkEngine=true).",
+                            NodeName().c_str(), OperationName().c_str());
+        m_mpi = mpi;
+    }
+
 private:
     // Old versioning - do not use. Do not remove until we're sure there are no old models around.
     struct VersionInfo
@@ -1887,6 +2372,8 @@ private:
     ImageLayoutKind m_imageLayoutKind;
     // Minibatch count, used to compute cumulative moving average.
     size_t m_mbCount;
+    // Frozen for inference, see Freeze().
+    bool m_frozen;
 
     // Stores pre-computed on forward pass mean values that are used in gradient computation.
     shared_ptr<Matrix<ElemType>> m_saveMean;
@@ -1898,6 +2385,19 @@ private:
     shared_ptr<Matrix<ElemType>> m_dBias;
 
     std::unique_ptr<BatchNormEngine<ElemType>> m_bnEng;
+
+    // Synchronized statistics, see SynchronizeStatistics().
+    MPIWrapperPtr m_mpi;
+    bool m_statisticsWereSynchronized = false; // in the last forward propagation
+    double m_localCount = 0;                   // number of values per map in the local and the joint minibatch
+    double m_syncCount = 0;
+    std::vector<double> m_syncMean;            // statistics normalized with, as saved in m_saveMean and m_saveInvStdDev
+    std::vector<double> m_syncInvStdDev;
+    std::vector<double> m_syncBuffer;          // all-reduced
+    shared_ptr<Matrix<ElemType>> m_localMean;  // statistics of the local minibatch
+    shared_ptr<Matrix<ElemType>> m_localInvStdDev;
+    shared_ptr<Matrix<ElemType>> m_syncGradientFactor; // per-map correction of the input gradient
+    shared_ptr<Matrix<ElemType>> m_syncGradientOffset;
 };
 
 template class BatchNormalizationNode<float>;
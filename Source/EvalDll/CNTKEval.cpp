@@ -23,6 +23,11 @@
 #include "NoRandomizer.h"
 #include "HeapMemoryProvider.h"
 #include "InputAndParamNodes.h"
+#include "RecurrentNodes.h"
+#include "CUDAPageLockedMemAllocator.h"
+#include "Metrics.h"
+#include <set>
+#include <algorithm>
 
 // TODO: Temporary mechanism to enable memory sharing for
 // node output value matrices. This will go away when the
@@ -31,6 +36,13 @@ bool g_shareNodeValueMatrices = false;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// latency of the evaluation calls of all evaluator instances of the process, as seen by the callers (see Metrics.h)
+static Metrics::Histogram& EvalRequestSeconds()
+{
+    static auto& histogram = Metrics::GetHistogram("cntk_eval_request_seconds", "Wall time of a ForwardPass call, including the wait for its batch");
+    return histogram;
+}
+
 
 template <typename ElemType>
 void CNTKEvalBase<ElemType>::Init(const std::string& config)
@@ -39,6 +51,59 @@ void CNTKEvalBase<ElemType>::Init(const std::string& config)
     size_t nThreads = m_config("numCPUThreads", "1");
     CPUMatrix<ElemType>::SetNumThreads(nThreads);
     g_shareNodeValueMatrices = m_config(L"shareNodeValueMatrices", false);
+    ComputationNetwork::SetUseCompilationCache(m_config(L"compilationCache", false));
+
+    // For one evaluator instance per socket: numaNode binds the threads that evaluate this instance to the CPUs of a
+    // NUMA node, and with numaPolicy=firstTouch the model is then loaded into the memory of that node.
+    // Note that the policy is process-wide and applies to all instances.
+    CPUNumaPlacement::SetPolicy(CPUNumaPlacement::Parse(m_config(L"numaPolicy", L"none")));
+    m_numaNode = m_config(L"numaNode", "-1");
+    BindThreadsToNumaNode();
+
+    // metricsFile and/or metricsPort export the metrics of the process (see Metrics.h), as set by the first instance
+    std::wstring metricsFile = m_config(L"metricsFile", L"");
+    int metricsPort = m_config(L"metricsPort", "0");
+    size_t metricsInterval = m_config(L"metricsInterval", "10");
+    Metrics::StartExport(metricsFile, metricsPort, metricsInterval);
+
+    // For several evaluator instances with predictable latency: numEvalThreads > 0 runs the parallel loops, OpenMP and
+    // MKL of the calls of this instance (and its clones) with that many threads of a pool of its own, instead of the
+    // process-wide numCPUThreads, and cpuCores (e.g. "0:1:2:3") pins these threads, one core each, the calling thread
+    // to the first. E.g. 4 single-threaded instances on cores 0..3, or one instance on 16 cores of a socket.
+    size_t numEvalThreads = m_config(L"numEvalThreads", "0");
+    std::vector<size_t> cores;
+    if (m_config.Exists(L"cpuCores"))
+    {
+        ConfigArray coresConfig = m_config(L"cpuCores");
+        intargvector coreIds = coresConfig;
+        for (size_t i = 0; i < coreIds.size(); i++)
+        {
+            if (coreIds[i] < 0)
+                InvalidArgument("cpuCores: Core ids must not be negative.");
+            cores.push_back((size_t) coreIds[i]);
+        }
+        if (numEvalThreads == 0)
+            numEvalThreads = cores.size();
+    }
+    if (numEvalThreads > 0)
+        m_threadPool = std::make_shared<CPUPrivateThreadPool>(numEvalThreads, cores);
+    else
+        m_threadPool.reset();
+
+    // approximateMath computes exp, log, sigmoid and tanh of floats on the CPU by vectorized approximations, with a
+    // relative error of about 1e-6 (see CPUApproximateMathScope), for the calls of this instance and its clones
+    m_approximateMath = m_config(L"approximateMath", false);
+}
+
+template <typename ElemType>
+void CNTKEvalBase<ElemType>::BindThreadsToNumaNode()
+{
+    static thread_local int boundNumaNode = -1;
+    if (m_numaNode < 0 || m_numaNode == boundNumaNode)
+        return;
+    if (!CPUNumaPlacement::BindThreadsToNode(m_numaNode))
+        RuntimeError("Could not bind the CPU threads to NUMA node %d (%d nodes).", m_numaNode, (int) CPUNumaPlacement::GetNumNodes());
+    boundNumaNode = m_numaNode;
 }
 
 
@@ -49,6 +114,8 @@ void CNTKEvalBase<ElemType>::CreateNetwork(const std::string& networkDescription
 {
     ConfigParameters config;
     config.Parse(networkDescription);
+    m_networkDescription = networkDescription;
+    CPUThreadScope threadScope(m_threadPool.get());
 
     std::vector<wstring> outputNodeNames;
     m_net = GetModelFromConfig<ConfigParameters, ElemType>(config, L"outputNodeNames", outputNodeNames);
@@ -57,9 +124,95 @@ void CNTKEvalBase<ElemType>::CreateNetwork(const std::string& networkDescription
     {
         LogicError("Unable to construct network from description");
     }
+
+    // Inference-only network of minimal memory: no Dropout nodes, frozen BatchNormalization nodes, no gradients,
+    // and node values shared as soon as all their consumers have run.
+    // Note that the value sharing is process-wide and applies to all models.
+    // Models written by the "optimizeForInference" action default to it, since their embedded memory plan assumes it.
+    if (config(L"inferenceMode", m_net->HasEmbeddedMemoryPlan()))
+    {
+        g_shareNodeValueMatrices = true;
+        m_net->PrepareForInference();
+    }
+
+    // Folding of constant subgraphs, merging of duplicate nodes and removal of nodes that no output depends on.
+    if (config(L"optimizeNetwork", false))
+        m_net->OptimizeNetwork();
+
+    // On a GPU, the small nodes computed only from inputs and constants run on the CPU where that is estimated to be faster
+    // for minibatches of offloadToHostMinibatchSize samples (see ComputationNetwork::OffloadToHost()).
+    if (config(L"offloadToHost", false))
+    {
+        size_t offloadMinibatchSize = config(L"offloadToHostMinibatchSize", "1");
+        m_net->OffloadToHost(offloadMinibatchSize);
+    }
+
+    // Inference-only folding of BatchNormalization nodes into the weights of the preceding Times and Convolution nodes.
+    // Done before int8 quantization, so that the quantized weights include the BN scale.
+    if (config(L"foldBatchNormalization", false))
+        m_net->FoldBatchNormalization();
+
+    // Inference-only low-rank factorization of the weights of Times nodes, with the smallest rank (a multiple of
+    // lowRankAlignedSize) whose relative error is within lowRankMaxError. Done after BN folding, so that the factors include the BN scale.
+    double lowRankMaxError = config(L"lowRankMaxError", "0");
+    if (lowRankMaxError > 0)
+    {
+        size_t lowRankAlignedSize = config(L"lowRankAlignedSize", "8");
+        m_net->FactorizeTimesWeights(lowRankMaxError, lowRankAlignedSize);
+    }
+
+    // Inference-only pruning of the weights of Times nodes below pruneThreshold in magnitude, which are then stored as sparse
+    // matrices if at most pruneMaxDensity of them remain. Not combined with int8 inference, which needs dense weights.
+    double pruneThreshold = config(L"pruneThreshold", "0");
+    if (pruneThreshold > 0 && !config(L"int8Inference", false))
+    {
+        double pruneMaxDensity = config(L"pruneMaxDensity", "0.3");
+        m_net->PruneTimesWeights(pruneThreshold, pruneMaxDensity);
+    }
+
+    // Fusion of Sigmoid/Tanh/RectifiedLinear (Plus (Times (W, x), b)) into AffineActivation nodes.
+    // Not combined with int8 inference, which only applies to Times nodes.
+    if (config(L"fuseAffineActivation", false) && !config(L"int8Inference", false))
+        m_net->FuseAffineActivation();
+
+    // Inference-only int8 products for Times and Convolution nodes on the CPU. With int8CalibrationMinibatches > 0,
+    // the input range of each node is calibrated in full precision on the first minibatches, otherwise it is computed per sample.
+    if (config(L"int8Inference", false))
+    {
+        size_t calibrationMinibatches = config(L"int8CalibrationMinibatches", "0");
+        ComputationNetwork::SetInt8Inference(m_net, nullptr, calibrationMinibatches);
+    }
 }
 
 
+// The network is created again from its description, so that it is transformed (inference mode, folding, int8)
+// the same way, and then its parameters are replaced by those of the other network, like the replicas of the network
+// in hogwild SGD, so that the second copy of the parameters is only held while the clone is created.
+// Parameters that are missing from the other network or differ in shape keep their own values.
+template <typename ElemType>
+void CNTKEvalBase<ElemType>::CreateNetworkSharingParameters(const CNTKEvalBase<ElemType>& other)
+{
+    m_config = other.m_config;
+    m_numaNode = other.m_numaNode;
+    m_threadPool = other.m_threadPool;
+    m_approximateMath = other.m_approximateMath;
+    CreateNetwork(other.m_networkDescription);
+
+    for (const auto& node : m_net->GetNodesWithType(OperationNameOf(LearnableParameter)))
+    {
+        if (!other.m_net->NodeNameExists(node->NodeName()))
+            continue;
+        auto parameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(node);
+        auto sharedParameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(other.m_net->GetNodeFromName(node->NodeName()));
+        if (parameter && sharedParameter &&
+            parameter->Value().GetNumRows() == sharedParameter->Value().GetNumRows() &&
+            parameter->Value().GetNumCols() == sharedParameter->Value().GetNumCols())
+        {
+            parameter->ShareValueWith(*sharedParameter);
+        }
+    }
+}
+
 // Destroy - cleanup and remove this class
 // NOTE: this destroys the object, and it can't be used past this point
 template <typename ElemType>
@@ -157,6 +310,9 @@ void CNTKEval<ElemType>::StartEvaluateMinibatchLoop(const std::wstring& outputNo
 template <typename ElemType>
 void CNTKEval<ElemType>::Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs)
 {
+    this->BindThreadsToNumaNode();
+    CPUThreadScope threadScope(this->m_threadPool.get());
+    CPUApproximateMathScope approximateMathScope(this->m_approximateMath);
     size_t minibatchSize = m_config(L"minibatchSize", (size_t) 10240);
     // get the evaluation names from the output string
     vector<wstring> outNodeNames;
@@ -194,6 +350,9 @@ void CNTKEval<ElemType>::Evaluate(std::map<std::wstring, std::vector<ElemType>*>
 template <typename ElemType>
 void CNTKEval<ElemType>::Evaluate(std::map<std::wstring, std::vector<ElemType>*>& outputs)
 {
+    this->BindThreadsToNumaNode();
+    CPUThreadScope threadScope(this->m_threadPool.get());
+    CPUApproximateMathScope approximateMathScope(this->m_approximateMath);
     // get the evaluation names from the output string
     vector<wstring> outNodeNames;
 
@@ -259,6 +418,19 @@ void CNTKEvalExtended<ElemType>::StartForwardEvaluation(const std::vector<wstrin
     m_net->AllocateAllMatrices({}, m_outputNodes, nullptr);
     m_net->StartEvaluateMinibatchLoop(m_outputNodes);
     m_inputMatrices = DataReaderHelpers::RetrieveInputMatrices(m_inputNodes);
+    m_frameModeLayout = make_shared<MBLayout>();
+    m_frameModeLayout->InitAsFrameMode(1); // treat this as if we have one single sample
+    m_boundInputs = nullptr;
+    m_boundOutputs = nullptr;
+
+    std::set<ComputationNodeBasePtr> pastValueNodes;
+    for (const auto& node : m_outputNodes)
+    {
+        for (const auto& pastValueNode : m_net->GetNodesWithType(OperationNameOf(PastValueNode), node))
+            pastValueNodes.insert(pastValueNode);
+    }
+    m_pastValueNodes.assign(pastValueNodes.begin(), pastValueNodes.end());
+    m_streams.clear();
 
     for (const auto& node : m_outputNodes)
     {
@@ -268,6 +440,9 @@ void CNTKEvalExtended<ElemType>::StartForwardEvaluation(const std::vector<wstrin
     }
 
     m_started = true;
+
+    if (!m_warmUpBatchSizes.empty())
+        WarmUp(m_warmUpBatchSizes, m_warmUpSequenceLengths);
 }
 
 template<typename ElemType>
@@ -302,10 +477,39 @@ VariableSchema CNTKEvalExtended<ElemType>::GetInputSchema() const
 
 template<typename ElemType>
 template<template<typename> class ValueContainer>
-void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<ElemType, ValueContainer> >& inputs, std::vector<ValueBuffer<ElemType, ValueContainer> >& outputs)
+size_t CNTKEvalExtended<ElemType>::GetNumSamples(const ValueBuffer<ElemType, ValueContainer>& buffer, MatrixType type, size_t numRows, const ComputationNodeBasePtr& node)
+{
+    if (type == MatrixType::DENSE)
+    {
+        if (buffer.m_buffer.size() % numRows != 0)
+            RuntimeError("Input %ls: Expected input data to be a multiple of %ld, but it is %ld", 
+                         node->GetName().c_str(), numRows, buffer.m_buffer.size());
+        if (buffer.m_buffer.size() == 0)
+            RuntimeError("Input %ls: Expected at least one element.", node->GetName().c_str());
+        return buffer.m_buffer.size() / numRows;
+    }
+
+    if (buffer.m_colIndices.size() < 2)
+        RuntimeError("Input %ls: Expected at least one element.", node->GetName().c_str());
+    if (buffer.m_colIndices[0] != 0)
+        RuntimeError("Input %ls: First element of column indices must be 0", node->GetName().c_str());
+    if (buffer.m_colIndices[buffer.m_colIndices.size() - 1] != buffer.m_indices.size())
+        RuntimeError("Input %ls: Last element of column indices must be equal to the size of indices (%ld), but was %d", 
+                     node->GetName().c_str(), buffer.m_indices.size(), 
+                     buffer.m_colIndices[buffer.m_colIndices.size() - 1]);
+    return buffer.m_colIndices.size() - 1;
+}
+
+template<typename ElemType>
+template<template<typename> class ValueContainer>
+void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<ElemType, ValueContainer> >& inputs, std::vector<ValueBuffer<ElemType, ValueContainer> >& outputs, bool referenceInputs)
 {
     if (!m_started)
         RuntimeError("ForwardPass() called before StartForwardEvaluation()");
+    Metrics::Timer metricsTimer(EvalRequestSeconds());
+    this->BindThreadsToNumaNode();
+    CPUThreadScope threadScope(this->m_threadPool.get());
+    CPUApproximateMathScope approximateMathScope(this->m_approximateMath);
 
     if (inputs.size() != (size_t)std::distance(m_inputMatrices.begin(), m_inputMatrices.end()))
         RuntimeError("Expected %d inputs, but got %d.", (int)std::distance(m_inputMatrices.begin(), m_inputMatrices.end()), (int)inputs.size());
@@ -322,34 +526,20 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
         shared_ptr<Matrix<ElemType>> matrix = dynamic_pointer_cast<Matrix<ElemType>>(input.second.matrix);
         auto type = matrix->GetMatrixType();
         int numRows = input.second.sampleLayout.GetNumElements();
+        int numCols = (int)GetNumSamples(buffer, type, numRows, m_inputNodes[i]);
 
-        if (type == MatrixType::DENSE)
-        {
-            if (buffer.m_buffer.size() % numRows != 0)
-                RuntimeError("Input %ls: Expected input data to be a multiple of %ld, but it is %ld", 
-                             m_inputNodes[i]->GetName().c_str(), numRows, buffer.m_buffer.size());
-            if (buffer.m_buffer.size() == 0)
-                RuntimeError("Input %ls: Expected at least one element.", m_inputNodes[i]->GetName().c_str());
-        }
-        else if (type == MatrixType::SPARSE)
+        // The layout of the previous call is kept if it is the same, so that what was derived from it stays valid.
+        auto& pMBLayout = input.second.pMBLayout;
+        if (pMBLayout->GetNumParallelSequences() != 1 || pMBLayout->GetNumTimeSteps() != numCols || pMBLayout->GetAllSequences().size() != 1)
         {
-            if (buffer.m_colIndices.size() < 2)
-                RuntimeError("Input %ls: Expected at least one element.", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_colIndices[0] != 0)
-                RuntimeError("Input %ls: First element of column indices must be 0", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_colIndices[buffer.m_colIndices.size() - 1] != buffer.m_indices.size())
-                RuntimeError("Input %ls: Last element of column indices must be equal to the size of indices (%ld), but was %d", 
-                             m_inputNodes[i]->GetName().c_str(), buffer.m_indices.size(), 
-                             buffer.m_colIndices[buffer.m_colIndices.size() - 1]);
+            pMBLayout->Init(1, numCols);
+            pMBLayout->AddSequence(0, 0, 0, numCols);
         }
 
-        int numCols = type == MatrixType::DENSE ? buffer.m_buffer.size() / numRows : buffer.m_colIndices.size() - 1;
-        assert(numCols >= 1);
-        input.second.pMBLayout->Init(1, numCols);
-        input.second.pMBLayout->AddSequence(0, 0, 0, numCols);
-
-        if (type == MatrixType::DENSE)
-            matrix->SetValue(numRows, numCols, matrix->GetDeviceId(), buffer.m_buffer.data(), matrixFlagNormal);
+        if (type == MatrixType::DENSE && referenceInputs && matrix->GetDeviceId() == CPUDEVICE)
+            matrix->SetValue(numRows, numCols, CPUDEVICE, buffer.m_buffer.data(), matrixFlagDontOwnBuffer);
+        else if (type == MatrixType::DENSE)
+            CopyDenseInput(*matrix, numRows, numCols, buffer.m_buffer.data());
         else if (type == MatrixType::SPARSE)
         {
             // In the sparse case the m_data layout is identical to CUDA's CSC layout
@@ -370,10 +560,7 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
         shared_ptr<Matrix<ElemType>> outputMatrix = dynamic_pointer_cast<Matrix<ElemType>>(node->ValuePtr());
         auto pMBLayout = node->GetMBLayout();
         if (!pMBLayout)
-        {
-            pMBLayout = make_shared<MBLayout>();
-            pMBLayout->InitAsFrameMode(1); // treat this as if we have one single sample
-        }
+            pMBLayout = m_frameModeLayout;
 
         const auto& seq = pMBLayout->GetAllSequences();
         if (seq.size() != 1)
@@ -395,6 +582,16 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
     }
 }
 
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::CopyDenseInput(Matrix<ElemType>& matrix, size_t numRows, size_t numCols, ElemType* buffer)
+{
+    // A matrix that refers to a bound buffer can neither be resized nor written to, as the buffer is the caller's:
+    // it gets values of its own instead.
+    if (!matrix.OwnBuffer())
+        matrix = Matrix<ElemType>(matrix.GetDeviceId());
+    matrix.SetValue(numRows, numCols, matrix.GetDeviceId(), buffer, matrixFlagNormal);
+}
+
 template<typename ElemType>
 void CNTKEvalExtended<ElemType>::ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& outputs)
 {
@@ -407,6 +604,463 @@ void CNTKEvalExtended<ElemType>::ForwardPass(const ValueRefs<ElemType>& inputs,
     ForwardPassT(inputs, outputs);
 }
 
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::BindBuffers(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs)
+{
+    if (!m_started)
+        RuntimeError("BindBuffers() called before StartForwardEvaluation()");
+
+    if (inputs.size() != (size_t)std::distance(m_inputMatrices.begin(), m_inputMatrices.end()))
+        RuntimeError("Expected %d inputs, but got %d.", (int)std::distance(m_inputMatrices.begin(), m_inputMatrices.end()), (int)inputs.size());
+
+    if (outputs.size() != m_outputNodes.size())
+        RuntimeError("Expected %d outputs, but got %d.", (int)m_outputNodes.size(), (int)outputs.size());
+
+    m_boundInputs = &inputs;
+    m_boundOutputs = &outputs;
+}
+
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassBound()
+{
+    if (!m_boundInputs)
+        RuntimeError("ForwardPassBound() called before BindBuffers()");
+
+    ForwardPassT(*m_boundInputs, *m_boundOutputs, /*referenceInputs=*/true);
+}
+
+template <typename ElemType>
+ElemType* CNTKEvalExtended<ElemType>::AllocateHostBuffer(size_t numElements)
+{
+    if (!m_net)
+        RuntimeError("AllocateHostBuffer() called before CreateNetwork()");
+
+    if (m_net->GetDeviceId() == CPUDEVICE)
+        return new ElemType[numElements];
+
+    auto buffer = (ElemType*)CUDAPageLockedMemAllocator::Malloc(numElements * sizeof(ElemType), m_net->GetDeviceId());
+    if (!buffer)
+        RuntimeError("AllocateHostBuffer: Failed to allocate %d page-locked elements.", (int)numElements);
+    return buffer;
+}
+
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::FreeHostBuffer(ElemType* buffer)
+{
+    if (!m_net)
+        RuntimeError("FreeHostBuffer() called before CreateNetwork()");
+
+    if (m_net->GetDeviceId() == CPUDEVICE)
+        delete[] buffer;
+    else if (buffer)
+        CUDAPageLockedMemAllocator::Free(buffer, m_net->GetDeviceId());
+}
+
+template <typename ElemType>
+IEvaluateModelExtended<ElemType>* CNTKEvalExtended<ElemType>::Clone() const
+{
+    if (!m_net)
+        RuntimeError("Clone() called before CreateNetwork()");
+
+    auto clone = new CNTKEvalExtended<ElemType>();
+    try
+    {
+        clone->CreateNetworkSharingParameters(*this);
+        clone->m_maxBatchSize = m_maxBatchSize;
+        clone->m_maxBatchLatency = m_maxBatchLatency;
+        clone->m_warmUpBatchSizes = m_warmUpBatchSizes;
+        clone->m_warmUpSequenceLengths = m_warmUpSequenceLengths;
+        if (m_started)
+        {
+            std::vector<wstring> outputNodeNames;
+            for (const auto& node : m_outputNodes)
+                outputNodeNames.push_back(node->NodeName());
+            clone->StartForwardEvaluation(outputNodeNames);
+        }
+    }
+    catch (...)
+    {
+        clone->Destroy();
+        throw;
+    }
+    return clone;
+}
+
+// The caller whose request is in the queue while no batch is running collects the next batch: it waits until the
+// queue holds a full batch or the latency has passed, and evaluates the batch without holding the lock. The other
+// callers wait until their request is done, or lead the next batch.
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassBatched(const Values<ElemType>& inputs, Values<ElemType>& outputs)
+{
+    if (!m_started)
+        RuntimeError("ForwardPassBatched() called before StartForwardEvaluation()");
+    Metrics::Timer metricsTimer(EvalRequestSeconds());
+
+    // Check the request before batching it, so that it fails on its own.
+    std::map<MBLayoutPtr, size_t> numSamplesOfLayout;
+    CheckRequest(inputs, outputs, numSamplesOfLayout);
+
+    BatchRequest request = { &inputs, &outputs, false, nullptr, 0 };
+    std::unique_lock<std::mutex> lock(m_batchMutex);
+    m_batchQueue.push_back(&request);
+    m_batchCondition.notify_all();
+    while (!request.m_done)
+    {
+        if (m_batchRunning)
+        {
+            m_batchCondition.wait(lock);
+            continue;
+        }
+
+        m_batchRunning = true;
+        m_batchCondition.wait_for(lock, m_maxBatchLatency, [this]() { return m_batchQueue.size() >= m_maxBatchSize; });
+        size_t batchSize = std::min(m_batchQueue.size(), m_maxBatchSize);
+        std::vector<BatchRequest*> batch(m_batchQueue.begin(), m_batchQueue.begin() + batchSize);
+        m_batchQueue.erase(m_batchQueue.begin(), m_batchQueue.begin() + batchSize);
+        lock.unlock();
+
+        try
+        {
+            ForwardPassBatch(batch);
+        }
+        catch (...)
+        {
+            auto error = std::current_exception();
+            for (auto batchRequest : batch)
+                batchRequest->m_error = error;
+        }
+
+        lock.lock();
+        for (auto batchRequest : batch)
+            batchRequest->m_done = true;
+        m_batchRunning = false;
+        m_batchCondition.notify_all();
+    }
+
+    if (request.m_error)
+        std::rethrow_exception(request.m_error);
+}
+
+// All requests of a synthetic batch share the same inputs: zeros, or for sparse inputs a one in the first row of each
+// sample. The outputs are not used, so that requests whose outputs do not fit are no error.
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::WarmUp(const std::vector<size_t>& batchSizes, const std::vector<size_t>& sequenceLengths)
+{
+    if (!m_started)
+        RuntimeError("WarmUp() called before StartForwardEvaluation()");
+    if (std::find(batchSizes.begin(), batchSizes.end(), (size_t) 0) != batchSizes.end() ||
+        std::find(sequenceLengths.begin(), sequenceLengths.end(), (size_t) 0) != sequenceLengths.end())
+        InvalidArgument("WarmUp: Batch sizes and sequence lengths must be at least 1.");
+
+    std::vector<size_t> sortedBatchSizes(batchSizes), sortedSequenceLengths(sequenceLengths);
+    std::sort(sortedBatchSizes.rbegin(), sortedBatchSizes.rend());
+    std::sort(sortedSequenceLengths.rbegin(), sortedSequenceLengths.rend());
+    auto outputSchema = GetOutputSchema();
+    for (size_t sequenceLength : sortedSequenceLengths)
+    {
+        Values<ElemType> inputs(m_inputNodes.size());
+        size_t i = 0;
+        for (auto& input : m_inputMatrices)
+        {
+            size_t numRows = input.second.sampleLayout.GetNumElements();
+            auto& buffer = inputs[i++];
+            shared_ptr<Matrix<ElemType>> matrix = dynamic_pointer_cast<Matrix<ElemType>>(input.second.matrix);
+            if (matrix->GetMatrixType() == MatrixType::SPARSE)
+            {
+                buffer.m_buffer.assign(sequenceLength, 1);
+                buffer.m_indices.assign(sequenceLength, 0);
+                for (size_t t = 0; t <= sequenceLength; t++)
+                    buffer.m_colIndices.push_back((int) t);
+            }
+            else
+                buffer.m_buffer.assign(numRows * sequenceLength, 0);
+        }
+
+        for (size_t batchSize : sortedBatchSizes)
+        {
+            std::vector<Values<ElemType>> outputs(batchSize, Values<ElemType>(m_outputNodes.size()));
+            std::vector<BatchRequest> requests;
+            for (size_t s = 0; s < batchSize; s++)
+            {
+                for (size_t k = 0; k < m_outputNodes.size(); k++)
+                    outputs[s][k].m_buffer.reserve(outputSchema[k].m_numElements * sequenceLength);
+                requests.push_back(BatchRequest{ &inputs, &outputs[s], false, nullptr, 0 });
+            }
+            std::vector<BatchRequest*> batch;
+            for (auto& request : requests)
+                batch.push_back(&request);
+            ForwardPassBatch(batch);
+        }
+    }
+}
+
+template <typename ElemType>
+std::vector<size_t> CNTKEvalExtended<ElemType>::GetSizesConfig(const wchar_t* name) const
+{
+    std::vector<size_t> sizes;
+    if (!this->m_config.Exists(name))
+        return sizes;
+    ConfigArray sizesConfig = this->m_config(name);
+    intargvector values = sizesConfig;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (values[i] < 1)
+            InvalidArgument("%ls: Sizes must be at least 1.", name);
+        sizes.push_back((size_t) values[i]);
+    }
+    return sizes;
+}
+
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::CheckRequest(const Values<ElemType>& inputs, const Values<ElemType>& outputs, std::map<MBLayoutPtr, size_t>& numSamplesOfLayout) const
+{
+    size_t numInputs = (size_t)std::distance(m_inputMatrices.begin(), m_inputMatrices.end());
+    if (inputs.size() != numInputs)
+        RuntimeError("Expected %d inputs, but got %d.", (int)numInputs, (int)inputs.size());
+    if (outputs.size() != m_outputNodes.size())
+        RuntimeError("Expected %d outputs, but got %d.", (int)m_outputNodes.size(), (int)outputs.size());
+
+    size_t i = 0;
+    for (auto& input : m_inputMatrices)
+    {
+        shared_ptr<Matrix<ElemType>> matrix = dynamic_pointer_cast<Matrix<ElemType>>(input.second.matrix);
+        size_t numSamples = GetNumSamples(inputs[i], matrix->GetMatrixType(), input.second.sampleLayout.GetNumElements(), m_inputNodes[i]);
+        auto layout = numSamplesOfLayout.insert(std::make_pair(input.second.pMBLayout, numSamples)).first;
+        if (layout->second != numSamples)
+            RuntimeError("Input %ls: Expected %d samples, as for the other inputs of the same dynamic axis, but got %d.",
+                         m_inputNodes[i]->GetName().c_str(), (int)layout->second, (int)numSamples);
+        ++i;
+    }
+}
+
+// Request s of the batch is parallel sequence s of every input, followed by a gap up to the longest request. The
+// chunk of a stream continues its sequence, which began m_numPastSamples before the minibatch.
+// The outputs are read from the sequences of the requests in their layouts, or copied to all requests if they
+// have no layout.
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassBatch(const std::vector<BatchRequest*>& batch)
+{
+    this->BindThreadsToNumaNode();
+    CPUThreadScope threadScope(this->m_threadPool.get());
+    CPUApproximateMathScope approximateMathScope(this->m_approximateMath);
+
+    const size_t numSequences = batch.size();
+    std::set<MBLayoutPtr> initializedLayouts; // (inputs of the same dynamic axis share the layout)
+    std::vector<size_t> numSamples(numSequences);
+    size_t i = 0;
+    for (auto& input : m_inputMatrices)
+    {
+        shared_ptr<Matrix<ElemType>> matrix = dynamic_pointer_cast<Matrix<ElemType>>(input.second.matrix);
+        auto type = matrix->GetMatrixType();
+        size_t numRows = input.second.sampleLayout.GetNumElements();
+
+        size_t numTimeSteps = 0;
+        for (size_t s = 0; s < numSequences; ++s)
+        {
+            numSamples[s] = GetNumSamples((*batch[s]->m_inputs)[i], type, numRows, m_inputNodes[i]);
+            numTimeSteps = std::max(numTimeSteps, numSamples[s]);
+        }
+
+        if (initializedLayouts.insert(input.second.pMBLayout).second)
+        {
+            input.second.pMBLayout->Init(numSequences, numTimeSteps);
+            for (size_t s = 0; s < numSequences; ++s)
+            {
+                input.second.pMBLayout->AddSequence(s, s, -(ptrdiff_t)batch[s]->m_numPastSamples, numSamples[s]);
+                if (numSamples[s] < numTimeSteps)
+                    input.second.pMBLayout->AddGap(s, numSamples[s], numTimeSteps);
+            }
+        }
+
+        // column t * numSequences + s holds sample t of sequence s
+        size_t numCols = numTimeSteps * numSequences;
+        if (type == MatrixType::DENSE)
+        {
+            m_batchValues.assign(numRows * numCols, 0);
+            for (size_t s = 0; s < numSequences; ++s)
+            {
+                const auto& buffer = (*batch[s]->m_inputs)[i].m_buffer;
+                for (size_t t = 0; t < numSamples[s]; ++t)
+                    std::copy(buffer.begin() + t * numRows, buffer.begin() + (t + 1) * numRows, m_batchValues.begin() + (t * numSequences + s) * numRows);
+            }
+            CopyDenseInput(*matrix, numRows, numCols, m_batchValues.data());
+        }
+        else if (type == MatrixType::SPARSE)
+        {
+            m_batchValues.clear();
+            m_batchRowIndices.clear();
+            m_batchColIndices.assign(1, 0);
+            for (size_t t = 0; t < numTimeSteps; ++t)
+            {
+                for (size_t s = 0; s < numSequences; ++s)
+                {
+                    const auto& buffer = (*batch[s]->m_inputs)[i];
+                    if (t < numSamples[s])
+                    {
+                        m_batchValues.insert(m_batchValues.end(), buffer.m_buffer.begin() + buffer.m_colIndices[t], buffer.m_buffer.begin() + buffer.m_colIndices[t + 1]);
+                        m_batchRowIndices.insert(m_batchRowIndices.end(), buffer.m_indices.begin() + buffer.m_colIndices[t], buffer.m_indices.begin() + buffer.m_colIndices[t + 1]);
+                    }
+                    m_batchColIndices.push_back((int)m_batchRowIndices.size());
+                }
+            }
+            matrix->SetMatrixFromCSCFormat(m_batchColIndices.data(), m_batchRowIndices.data(), m_batchValues.data(),
+                                           m_batchValues.size(), numRows, numCols);
+        }
+
+        ++i;
+    }
+
+    ComputationNetwork::BumpEvalTimeStamp(m_inputNodes);
+
+    m_batchOutputs.resize(m_outputNodes.size());
+    for (size_t i = 0; i < m_outputNodes.size(); ++i)
+    {
+        m_net->ForwardProp(m_outputNodes[i]);
+        shared_ptr<Matrix<ElemType>> outputMatrix = dynamic_pointer_cast<Matrix<ElemType>>(m_outputNodes[i]->ValuePtr());
+        size_t numElements = outputMatrix->GetNumElements();
+        m_batchOutputs[i].resize(numElements);
+        ElemType* data = m_batchOutputs[i].data();
+        outputMatrix->CopyToArray(data, numElements);
+    }
+
+    // A request whose output buffer is too small fails on its own.
+    for (size_t s = 0; s < numSequences; ++s)
+    {
+        try
+        {
+            for (size_t i = 0; i < m_outputNodes.size(); ++i)
+            {
+                const auto& node = m_outputNodes[i];
+                const auto& output = m_batchOutputs[i];
+                auto& vec = (*batch[s]->m_outputs)[i].m_buffer;
+                const auto& pMBLayout = node->GetMBLayout();
+                if (!pMBLayout)
+                {
+                    if (vec.capacity() < output.size())
+                        RuntimeError("Not enough space in output buffer for output '%ls'.", node->GetName().c_str());
+                    vec.assign(output.begin(), output.end());
+                    continue;
+                }
+
+                const auto& sequences = pMBLayout->GetAllSequences();
+                auto sequence = std::find_if(sequences.begin(), sequences.end(), [s](const MBLayout::SequenceInfo& seq) { return seq.seqId == s; });
+                if (sequence == sequences.end())
+                    RuntimeError("Output '%ls' has no sequence of request %d of the batch.", node->GetName().c_str(), (int)s);
+
+                size_t numRows = node->GetSampleLayout().GetNumElements();
+                size_t numParallelSequences = pMBLayout->GetNumParallelSequences();
+                size_t begin = (size_t)std::max(sequence->tBegin, (ptrdiff_t)0);
+                size_t end = std::min(sequence->tEnd, pMBLayout->GetNumTimeSteps());
+                if (vec.capacity() < (end - begin) * numRows)
+                    RuntimeError("Not enough space in output buffer for output '%ls'.", node->GetName().c_str());
+
+                vec.resize(0);
+                for (size_t t = begin; t < end; ++t)
+                {
+                    auto column = output.begin() + (t * numParallelSequences + sequence->s) * numRows;
+                    vec.insert(vec.end(), column, column + numRows);
+                }
+            }
+        }
+        catch (...)
+        {
+            batch[s]->m_error = std::current_exception();
+        }
+    }
+}
+
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::BeginStream(size_t streamId)
+{
+    if (!m_started)
+        RuntimeError("BeginStream() called before StartForwardEvaluation()");
+    if (m_streams.find(streamId) != m_streams.end())
+        RuntimeError("Stream %d has already begun.", (int)streamId);
+
+    for (const auto& node : m_outputNodes)
+    {
+        if (!m_net->GetNodesWithType(OperationNameOf(FutureValueNode), node).empty())
+            RuntimeError("Output '%ls' depends on future values, and cannot be streamed.", node->GetName().c_str());
+    }
+
+    StreamState& stream = m_streams[streamId];
+    stream.m_numSamples = 0;
+    for (size_t i = 0; i < m_pastValueNodes.size(); ++i)
+        stream.m_pastValues.push_back(make_shared<Matrix<ElemType>>(m_net->GetDeviceId()));
+}
+
+// The past values of the streams are set to their states before the forward pass, which overwrites them, in the
+// parallel sequences of this call, and the states are updated from the values after it.
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassStreams(const std::vector<size_t>& streamIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs)
+{
+    if (!m_started)
+        RuntimeError("ForwardPassStreams() called before StartForwardEvaluation()");
+    Metrics::Timer metricsTimer(EvalRequestSeconds());
+    if (inputs.size() != streamIds.size() || outputs.size() != streamIds.size())
+        RuntimeError("Expected inputs and outputs for each of the %d streams, but got %d and %d.", (int)streamIds.size(), (int)inputs.size(), (int)outputs.size());
+    if (streamIds.empty())
+        return;
+
+    std::vector<StreamState*> streams;
+    std::vector<BatchRequest> requests;
+    std::vector<size_t> numSamples;
+    for (size_t s = 0; s < streamIds.size(); ++s)
+    {
+        auto stream = m_streams.find(streamIds[s]);
+        if (stream == m_streams.end())
+            RuntimeError("Stream %d has not begun.", (int)streamIds[s]);
+        if (std::find(streams.begin(), streams.end(), &stream->second) != streams.end())
+            RuntimeError("Stream %d is given more than once.", (int)streamIds[s]);
+
+        std::map<MBLayoutPtr, size_t> numSamplesOfLayout;
+        CheckRequest(inputs[s], outputs[s], numSamplesOfLayout);
+        if (numSamplesOfLayout.size() != 1)
+            RuntimeError("Streaming requires the inputs to share one dynamic axis.");
+
+        streams.push_back(&stream->second);
+        requests.push_back(BatchRequest{ &inputs[s], &outputs[s], false, nullptr, stream->second.m_numSamples });
+        numSamples.push_back(numSamplesOfLayout.begin()->second);
+    }
+
+    std::vector<const Matrix<ElemType>*> states(streams.size());
+    for (size_t i = 0; i < m_pastValueNodes.size(); ++i)
+    {
+        for (size_t s = 0; s < streams.size(); ++s)
+            states[s] = streams[s]->m_numSamples > 0 ? streams[s]->m_pastValues[i].get() : nullptr;
+        dynamic_pointer_cast<PastValueNode<ElemType>>(m_pastValueNodes[i])->SetSequenceStates(states);
+    }
+
+    std::vector<BatchRequest*> batch;
+    for (auto& request : requests)
+        batch.push_back(&request);
+    ForwardPassBatch(batch);
+
+    std::exception_ptr error;
+    for (size_t s = 0; s < streams.size(); ++s)
+    {
+        if (requests[s].m_error)
+        {
+            error = error ? error : requests[s].m_error;
+            continue;
+        }
+
+        for (size_t i = 0; i < m_pastValueNodes.size(); ++i)
+            dynamic_pointer_cast<PastValueNode<ElemType>>(m_pastValueNodes[i])->UpdateSequenceState(s, numSamples[s], *streams[s]->m_pastValues[i]);
+        streams[s]->m_numSamples += numSamples[s];
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+template <typename ElemType>
+void CNTKEvalExtended<ElemType>::EndStream(size_t streamId)
+{
+    if (m_streams.erase(streamId) == 0)
+        RuntimeError("Stream %d has not begun.", (int)streamId);
+}
+
 template <typename ElemType>
 void CNTKEvalExtended<ElemType>::Destroy()
 {
@@ -13,12 +13,19 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
 
 #include "Eval.h"
 #include "EvalReader.h"
 #include "EvalWriter.h"
 
 #include "ComputationNetwork.h"
+#include "CPUThreadPool.h"
+#include "CPUVectorizedTensorOps.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -29,9 +36,20 @@ protected:
     typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
     ConfigParameters m_config;
     ComputationNetworkPtr m_net;
+    std::string m_networkDescription; // as passed to CreateNetwork(), to create the network of a clone
+    int m_numaNode; // NUMA node whose CPUs the evaluating threads are bound to, or -1
+    std::shared_ptr<CPUPrivateThreadPool> m_threadPool; // that this evaluator and its clones evaluate on, or null for the process-wide one
+    bool m_approximateMath; // whether the calls of this evaluator compute transcendental ops approximately, see CPUApproximateMathScope
 
     // constructor
-    CNTKEvalBase() : m_net(nullptr) { }
+    CNTKEvalBase() : m_net(nullptr), m_numaNode(-1), m_approximateMath(false) { }
+
+    // binds the OpenMP threads of the calling thread to m_numaNode, if not done yet
+    void BindThreadsToNumaNode();
+
+    // creates the network of this evaluator as a clone of the one of another: from the same description, with the
+    // values of the LearnableParameter nodes shared with the other network
+    void CreateNetworkSharingParameters(const CNTKEvalBase<ElemType>& other);
 public:
 
     // CreateNetwork - create a network based on the network description
@@ -90,7 +108,7 @@ template <typename ElemType>
 class CNTKEvalExtended : public CNTKEvalBase<ElemType>, public IEvaluateModelExtended<ElemType>
 {
 public:
-    CNTKEvalExtended() : CNTKEvalBase<ElemType>(), m_started(false) {}
+    CNTKEvalExtended() : CNTKEvalBase<ElemType>(), m_started(false), m_boundInputs(nullptr), m_boundOutputs(nullptr), m_maxBatchSize(32), m_maxBatchLatency(2), m_batchRunning(false) {}
 
     virtual VariableSchema GetOutputSchema() const override;
 
@@ -102,6 +120,26 @@ public:
 
     virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output) override;
 
+    virtual IEvaluateModelExtended<ElemType>* Clone() const override;
+
+    virtual void ForwardPassBatched(const Values<ElemType>& inputs, Values<ElemType>& output) override;
+
+    virtual void WarmUp(const std::vector<size_t>& batchSizes, const std::vector<size_t>& sequenceLengths) override;
+
+    virtual void BindBuffers(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs) override;
+
+    virtual void ForwardPassBound() override;
+
+    virtual ElemType* AllocateHostBuffer(size_t numElements) override;
+
+    virtual void FreeHostBuffer(ElemType* buffer) override;
+
+    virtual void BeginStream(size_t streamId) override;
+
+    virtual void ForwardPassStreams(const std::vector<size_t>& streamIds, const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs) override;
+
+    virtual void EndStream(size_t streamId) override;
+
     virtual void Destroy() override;
 
     virtual void CreateNetwork(const std::string& networkDescription) override
@@ -112,6 +150,17 @@ public:
     virtual void Init(const std::string& config) override
     {
         CNTKEvalBase<ElemType>::Init(config);
+        m_maxBatchSize = this->m_config(L"maxBatchSize", "32");
+        size_t maxBatchLatencyMs = this->m_config(L"maxBatchLatencyMs", "2");
+        m_maxBatchLatency = std::chrono::milliseconds(maxBatchLatencyMs);
+        if (m_maxBatchSize == 0)
+            InvalidArgument("maxBatchSize must be at least 1.");
+        m_warmUpBatchSizes = GetSizesConfig(L"warmUpBatchSizes");
+        m_warmUpSequenceLengths = GetSizesConfig(L"warmUpSequenceLengths");
+        if (!m_warmUpSequenceLengths.empty() && m_warmUpBatchSizes.empty())
+            m_warmUpBatchSizes.push_back(1);
+        else if (!m_warmUpBatchSizes.empty() && m_warmUpSequenceLengths.empty())
+            m_warmUpSequenceLengths.push_back(1);
     }
 private:
     static VariableLayout ToVariableLayout(const ComputationNodeBasePtr n);
@@ -120,9 +169,68 @@ private:
     std::vector<ComputationNodeBasePtr> m_inputNodes;
     StreamMinibatchInputs m_inputMatrices;
     bool m_started;
+    MBLayoutPtr m_frameModeLayout; // of the outputs that have no layout
+
+    // the buffers bound by BindBuffers()
+    const ValueRefs<ElemType>* m_boundInputs;
+    ValueRefs<ElemType>* m_boundOutputs;
 
-    template<template<typename> class ValueContainer> 
+    // referenceInputs - whether dense inputs of a network on the CPU are used in place instead of copied
+    template<template<typename> class ValueContainer>
     void ForwardPassT(const std::vector < ValueBuffer<ElemType, ValueContainer> >& inputs,
-                      std::vector < ValueBuffer<ElemType, ValueContainer> >& outputs);
+                      std::vector < ValueBuffer<ElemType, ValueContainer> >& outputs, bool referenceInputs = false);
+
+    // sets the values of a dense input to a copy of the buffer, also if they referred to a bound buffer before
+    static void CopyDenseInput(Matrix<ElemType>& matrix, size_t numRows, size_t numCols, ElemType* buffer);
+
+    // checks the buffer of an input and returns its number of samples
+    template<template<typename> class ValueContainer>
+    static size_t GetNumSamples(const ValueBuffer<ElemType, ValueContainer>& buffer, MatrixType type, size_t numRows, const ComputationNodeBasePtr& node);
+
+    // a call of ForwardPassBatched(), until its outputs are written, or a chunk of ForwardPassStreams()
+    struct BatchRequest
+    {
+        const Values<ElemType>* m_inputs;
+        Values<ElemType>* m_outputs;
+        bool m_done;
+        std::exception_ptr m_error;
+        size_t m_numPastSamples; // of the stream of the chunk, before the chunk
+    };
+
+    // checks the buffers of a request, and returns the number of samples of the inputs of each dynamic axis
+    void CheckRequest(const Values<ElemType>& inputs, const Values<ElemType>& outputs, std::map<MBLayoutPtr, size_t>& numSamplesOfLayout) const;
+
+    // evaluates the requests of a batch as the parallel sequences of one minibatch
+    void ForwardPassBatch(const std::vector<BatchRequest*>& batch);
+
+    // a list of positive sizes, e.g. "1:8:32", or none if the config does not have it
+    std::vector<size_t> GetSizesConfig(const wchar_t* name) const;
+
+    // the sizes StartForwardEvaluation() warms up for, see WarmUp()
+    std::vector<size_t> m_warmUpBatchSizes;
+    std::vector<size_t> m_warmUpSequenceLengths;
+
+    size_t m_maxBatchSize;
+    std::chrono::milliseconds m_maxBatchLatency;
+    std::mutex m_batchMutex;
+    std::condition_variable m_batchCondition;
+    std::deque<BatchRequest*> m_batchQueue; // requests not taken into a batch yet
+    bool m_batchRunning;                    // whether one of the callers is collecting or evaluating a batch
+
+    // buffers of the batched inputs and outputs, reused across batches
+    std::vector<ElemType> m_batchValues;
+    std::vector<int> m_batchColIndices;
+    std::vector<int> m_batchRowIndices;
+    std::vector<std::vector<ElemType>> m_batchOutputs;
+
+    // a stream of ForwardPassStreams()
+    struct StreamState
+    {
+        size_t m_numSamples;                                         // evaluated so far
+        std::vector<std::shared_ptr<Matrix<ElemType>>> m_pastValues; // state of each of m_pastValueNodes after the last chunk
+    };
+
+    std::vector<ComputationNodeBasePtr> m_pastValueNodes; // that the outputs depend on
+    std::map<size_t, StreamState> m_streams;
 };
 } } }
@@ -11,6 +11,10 @@
 
 #include "CPUMatrix.h"
 #include "TensorOps.h"
+#include "CPUVectorizedTensorOps.h"
+#include "PhiloxRNG.h"
+#include "CPUThreadPool.h"
+#include "Float16.h"
 #include <assert.h>
 #include <stdexcept>
 #include <omp.h>
@@ -26,6 +30,9 @@
 #include "Windows.h"
 #else
 #include <cfloat>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 #ifdef LEAKDETECT
@@ -82,6 +89,157 @@ bool TracingGPUMemoryAllocator::IsTraceEnabled()
     return (m_traceLevel > 0);
 }
 
+bool MATH_API TracingGPUMemoryAllocator::m_cachingEnabled = true;
+
+void TracingGPUMemoryAllocator::SetCachingEnabled(bool cachingEnabled)
+{
+    m_cachingEnabled = cachingEnabled;
+}
+
+bool TracingGPUMemoryAllocator::IsCachingEnabled()
+{
+    return m_cachingEnabled;
+}
+
+bool MATH_API GPUHalfPrecision::m_halfPrecisionGEMM = false;
+
+void GPUHalfPrecision::SetHalfPrecisionGEMM(bool enabled)
+{
+    m_halfPrecisionGEMM = enabled;
+}
+
+bool GPUHalfPrecision::IsHalfPrecisionGEMM()
+{
+    return m_halfPrecisionGEMM;
+}
+
+NumaPolicy MATH_API CPUNumaPlacement::m_policy = NumaPolicy::none;
+
+NumaPolicy CPUNumaPlacement::Parse(const std::wstring& policy)
+{
+    if      (EqualCI(policy, L"") || EqualCI(policy, L"none")) return NumaPolicy::none;
+    else if (EqualCI(policy, L"firstTouch"))                   return NumaPolicy::firstTouch;
+    else if (EqualCI(policy, L"interleave"))                   return NumaPolicy::interleave;
+    else InvalidArgument("numaPolicy: Invalid value. Valid values are (none | firstTouch | interleave)");
+}
+
+void CPUNumaPlacement::SetPolicy(NumaPolicy policy)
+{
+    m_policy = policy;
+}
+
+NumaPolicy CPUNumaPlacement::GetPolicy()
+{
+    return m_policy;
+}
+
+#ifndef _WIN32
+// parses a sysfs list like "0-11,24-35"
+static std::vector<size_t> ReadSysfsList(const char* path)
+{
+    std::vector<size_t> res;
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return res;
+    char buf[4096];
+    if (fgets(buf, sizeof(buf), f))
+    {
+        char* p = buf;
+        for (;;)
+        {
+            char* end;
+            size_t first = strtoul(p, &end, 10);
+            if (end == p)
+                break;
+            size_t last = first;
+            if (*end == '-')
+                last = strtoul(end + 1, &end, 10);
+            for (size_t i = first; i <= last; i++)
+                res.push_back(i);
+            if (*end != ',')
+                break;
+            p = end + 1;
+        }
+    }
+    fclose(f);
+    return res;
+}
+
+static const std::vector<size_t>& OnlineNumaNodes()
+{
+    static const std::vector<size_t> nodes = ReadSysfsList("/sys/devices/system/node/online");
+    return nodes;
+}
+#endif
+
+size_t CPUNumaPlacement::GetNumNodes()
+{
+#ifdef _WIN32
+    ULONG highestNode;
+    return GetNumaHighestNodeNumber(&highestNode) ? highestNode + 1 : 1;
+#else
+    const auto& nodes = OnlineNumaNodes();
+    return nodes.empty() ? 1 : nodes.back() + 1;
+#endif
+}
+
+bool CPUNumaPlacement::BindThreadsToNode(size_t node)
+{
+    if (node >= GetNumNodes())
+        return false;
+#ifdef _WIN32
+    ULONGLONG mask;
+    if (!GetNumaNodeProcessorMask((UCHAR) node, &mask) || mask == 0)
+        return false;
+#else
+    char path[100];
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", (int) node);
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (auto cpu : ReadSysfsList(path))
+    {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &mask);
+    }
+    if (CPU_COUNT(&mask) == 0)
+        return false;
+#endif
+
+    // the calling thread is the master of the OpenMP team it runs parallel loops with
+    int numFailed = 0;
+#pragma omp parallel reduction(+ : numFailed)
+    {
+#ifdef _WIN32
+        numFailed += SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) mask) == 0;
+#else
+        numFailed += sched_setaffinity(0, sizeof(mask), &mask) != 0;
+#endif
+    }
+    return numFailed == 0;
+}
+
+// sets the interleave policy for the pages that lie completely within the buffer, which must not have been written to yet
+static void InterleavePages(void* p, size_t numBytes)
+{
+#ifdef _WIN32
+    p; numBytes; // no interleaving of existing allocations on Windows, so the buffer is placed by first touch
+#else
+    const auto& nodes = OnlineNumaNodes();
+    if (nodes.size() < 2 || nodes.back() >= 64)
+        return;
+    unsigned long nodeMask = 0;
+    for (auto node : nodes)
+        nodeMask |= 1UL << node;
+    const uintptr_t pageSize = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t) p + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t) p + numBytes) & ~(pageSize - 1);
+    if (end <= begin)
+        return;
+    const int mpolInterleave = 3; // MPOL_INTERLEAVE of <numaif.h>, which would require libnuma
+    syscall(SYS_mbind, (void*) begin, (unsigned long) (end - begin), mpolInterleave, &nodeMask, (unsigned long) nodes.back() + 2, 0); // if this fails, the default placement applies
+#endif
+}
+
 #pragma region Helpful Enum Definitions
 enum class MatrixOrder
 {
@@ -119,11 +277,27 @@ CPUMatrix<ElemType>::CPUMatrix()
     ZeroInit();
 }
 
+// smaller buffers are not worth initializing in parallel, and mostly share their pages with other allocations
+static const size_t MinNumaPlacedBufferBytes = 1 << 20;
+
 // helper to allocate an array of ElemType
 // Use this instead of new[] to get NaN initialization for debugging.
 template <class ElemType>
 static ElemType* NewArray(size_t n)
 {
+    NumaPolicy numaPolicy = CPUNumaPlacement::GetPolicy();
+    if (numaPolicy != NumaPolicy::none && n * sizeof(ElemType) >= MinNumaPlacedBufferBytes)
+    {
+        // pages are placed when they are first written, here with the same static schedule as the matrix loops
+        ElemType* p = new ElemType[n];
+        if (numaPolicy == NumaPolicy::interleave)
+            InterleavePages(p, n * sizeof(ElemType));
+#pragma omp parallel for schedule(static)
+        for (long i = 0; i < (long) n; i++)
+            p[i] = 0;
+        return p;
+    }
+
     ElemType* p = new ElemType[n]();
 #if 0 // _DEBUG
         ElemType nan = Matrix<ElemType>::MakeNan(__LINE__);
@@ -270,8 +444,7 @@ void CPUMatrix<ElemType>::CopyColumnsStrided(const CPUMatrix<ElemType>& fromMatr
 
     auto& us = *this;
 
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (size_t i = 0; i < (m & ~3); i += 4)
@@ -287,7 +460,7 @@ void CPUMatrix<ElemType>::CopyColumnsStrided(const CPUMatrix<ElemType>& fromMatr
         {
             us(i, j * destNumColsStride) = fromMatrix(i, j * srcNumColsStride);
         }
-    }
+    });
 }
 
 //for each column of a, we add all rows of a to this starting from startIndex
@@ -307,8 +480,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignToRowSliceValuesOf(const CPUMatr
 
     auto& us = *this;
 
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (size_t i = 0, startRow = startIndex; i < (m & ~3); i += 4, startRow += 4)
@@ -323,7 +495,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignToRowSliceValuesOf(const CPUMatr
         {
             us(startRow, j) = a(i, j);
         }
-    }
+    });
 
     return *this;
 }
@@ -340,8 +512,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignRowSliceValuesOf(const CPUMatrix
     long n = (long) a.GetNumCols(); // note: OpenMP requires loop indices to be long, not size_t
     long k = (long) a.GetNumRows();
 
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, numRows, [&](long j)
     {
         // memory copy might be faster?
         memcpy(Data() + j * numRows, a.Data() + j * k + startIndex, sizeof(ElemType) * numRows);
@@ -359,7 +530,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignRowSliceValuesOf(const CPUMatrix
         // {
         //    us(i,j) = a(startRow,j);
         // }
-    }
+    });
 
     return *this;
 }
@@ -384,8 +555,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddToRowSliceValuesOf(const CPUMatrix<
 
     auto& us = *this;
 
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0, startRow = (long) startIndex; i < (m & ~3); i += 4, startRow += 4)
@@ -400,7 +570,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddToRowSliceValuesOf(const CPUMatrix<
         {
             us(startRow, j) += a(i, j);
         }
-    }
+    });
 
     return *this;
 }
@@ -425,8 +595,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddWithRowSliceValuesOf(const CPUMatri
 
     auto& us = *this;
 
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0, startRow = (long) startIndex; i < (m & ~3); i += 4, startRow += 4)
@@ -441,7 +610,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddWithRowSliceValuesOf(const CPUMatri
         {
             us(i, j) += a(startRow, j);
         }
-    }
+    });
 
     return *this;
 }
@@ -456,11 +625,10 @@ CPUMatrix<ElemType> CPUMatrix<ElemType>::Diagonal() const
 
     auto& us = *this;
 
-#pragma omp parallel for
-    for (long i = 0; i < m_numRows; i++)
+    CPUThreadPool::ParallelFor(0, m_numRows, 1, [&](long i)
     {
         diag(0, (size_t) i) = us(i, i);
-    }
+    });
 
     return diag;
 }
@@ -487,8 +655,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignRepeatOf(const CPUMatrix<ElemTyp
     long n = (long) a.GetNumCols(), m = (long) a.GetNumRows();
     auto& us = *this;
 
-#pragma omp parallel for
-    for (long q = 0; q < numColRepeats; q++)
+    CPUThreadPool::ParallelFor(0, numColRepeats, numRowRepeats * n * m, [&](long q)
     {
         for (long p = 0; p < numRowRepeats; p++)
         {
@@ -513,7 +680,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignRepeatOf(const CPUMatrix<ElemTyp
                 }
             }
         }
-    }
+    });
 
     return *this;
 }
@@ -531,8 +698,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddToRowRepeatValuesOf(const CPUMatrix
 
     auto& us = *this;
 
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -553,7 +719,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddToRowRepeatValuesOf(const CPUMatrix
                 us(i, j) += a(k * m + i, j);
             }
         }
-    }
+    });
 
     return *this;
 }
@@ -603,8 +769,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTransposeOf(const CPUMatrix<Elem
 
     auto& us = *this;
 
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -619,7 +784,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTransposeOf(const CPUMatrix<Elem
         {
             us(j, i) = a(i, j);
         }
-    }
+    });
 
     return *this;
 }
@@ -656,24 +821,24 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::DoGatherColumnsOf(ElemType beta, const
         Resize(a.GetNumRows(), idx.GetNumCols());
 
     auto& us = *this;
-#pragma omp parallel for // TODO: Depending in circumstance, it may be more efficient to parallelize over rows.
-    foreach_column(jOut, us)
+    CPUThreadPool::ParallelFor(0, (int64_t)us.GetNumCols(), us.GetNumRows(), [&](int64_t jOut)
     {
         auto jInF = idx(0, jOut);         // this is the column we need to get
         if (std::isnan(jInF) || jInF < 0) // negative index means gap
-            continue;
+            return;
         size_t jIn = (size_t)jInF;
         if (jIn >= a.GetNumCols())
             InvalidArgument("DoGatherColumnsOf: Map out of bounds. %ld >= %ld", (long int)jIn, (long int)a.GetNumCols());
         ScaleAndAddColumn(beta, &us(0,jOut), &a(0,jIn), us.GetNumRows(), alpha);
-    }
+    });
 
     return *this;
 }
 
 // *this[:,idx[j]] = a[:,j] * alpha + *this[:,idx[j]] * beta
+// If idxIsUnique then no two columns of 'a' go to the same target column, and the columns can be processed in parallel.
 template <class ElemType>
-CPUMatrix<ElemType>& CPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha)
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha, bool idxIsUnique)
 {
     if (idx.GetNumRows() != 1) // index is 1-dimensional only
         InvalidArgument("DoScatterColumnsOf: Map must be a row vector.");
@@ -686,23 +851,76 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, cons
 
     // pre-scale with beta upfront
     // Scatter may add more than one source column to the same target, so we must pre-scale with beta, and then just keep adding.
-    Scale(beta, us); // if beta is 0, then this will be a memset()
+    if (beta != 1)
+        Scale(beta, us); // if beta is 0, then this will be a memset()
 
-#pragma omp parallel for // TODO: Depending in circumstance, it may be more efficient to parallelize over rows.
-    foreach_column(jIn, a)
+    auto getTargetColumn = [&](size_t jIn) -> ptrdiff_t
     {
         auto jOutF = idx(0, jIn);           // this is the column we copy/add into
         if (std::isnan(jOutF) || jOutF < 0) // negative index means gap
-            continue;
+            return -1;
         size_t jOut = (size_t)jOutF;
         if (jOut >= GetNumCols())
-            InvalidArgument("DoGatherColumnsOf: Map out of bounds.");
-        ScaleAndAddColumn(/*beta=*/(ElemType)1, &us(0, jOut), &a(0, jIn), us.GetNumRows(), alpha);
+            InvalidArgument("DoScatterColumnsOf: Map out of bounds.");
+        return (ptrdiff_t)jOut;
+    };
+
+    if (idxIsUnique) // each target column is written by one source column only: parallelize over columns
+    {
+        CPUThreadPool::ParallelFor(0, (int64_t)a.GetNumCols(), a.GetNumRows(), [&](int64_t jIn)
+        {
+            auto jOut = getTargetColumn(jIn);
+            if (jOut >= 0)
+                ScaleAndAddColumn(/*beta=*/(ElemType)1, &us(0, jOut), &a(0, jIn), us.GetNumRows(), alpha);
+        });
+    }
+    else // target columns may be shared: parallelize over row ranges instead, so that no two threads add into the same element
+    {
+        const size_t rowsPerRange = 64;
+        size_t numRows = us.GetNumRows();
+        CPUThreadPool::ParallelFor(0, (int64_t)((numRows + rowsPerRange - 1) / rowsPerRange), rowsPerRange * a.GetNumCols(), [&](int64_t range)
+        {
+            size_t iBegin = range * rowsPerRange;
+            size_t iEnd = min(iBegin + rowsPerRange, numRows);
+            foreach_column(jIn, a)
+            {
+                auto jOut = getTargetColumn(jIn);
+                if (jOut >= 0)
+                    ScaleAndAddColumn(/*beta=*/(ElemType)1, &us(iBegin, jOut), &a(iBegin, jIn), iEnd - iBegin, alpha);
+            }
+        });
     }
 
     return *this;
 }
 
+// *this[0,j] = sequenceMap(0,j) + index(0,j) * numParallelSequences, see Matrix::AssignPackedIndicesOf()
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignPackedIndicesOf(const CPUMatrix<ElemType>& index, const CPUMatrix<ElemType>& sequenceMap, size_t numParallelSequences)
+{
+    if (index.GetNumRows() != 1) // index is 1-dimensional only
+        InvalidArgument("AssignPackedIndicesOf: Index must be a row vector.");
+    if (sequenceMap.GetNumRows() != 3 || sequenceMap.GetNumCols() != index.GetNumCols())
+        InvalidArgument("AssignPackedIndicesOf: Sequence map must have 3 rows and the width of the index.");
+
+    RequireSize(1, index.GetNumCols());
+
+    auto& us = *this;
+    CPUThreadPool::ParallelFor(0, (int64_t)us.GetNumCols(), 1, [&](int64_t j)
+    {
+        ElemType base = sequenceMap(0, j); // packed column of time step 0 of the sequence
+        ElemType t = index(0, j);          // time step within the sequence
+        if (std::isnan(base))              // gap
+            us(0, j) = -1;
+        else if (t >= sequenceMap(1, j) && t < sequenceMap(2, j)) // (false for NaN)
+            us(0, j) = base + (ElemType)((size_t)t * numParallelSequences);
+        else
+            InvalidArgument("AssignPackedIndicesOf: Time index %d is outside of its sequence or the minibatch.", (int)t);
+    });
+
+    return *this;
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::SetValue(const ElemType v)
 {
@@ -886,7 +1104,8 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     if (matrixFlags & matrixFlagDontOwnBuffer)
     {
         // free previous array allocation if any before overwriting
-		delete[] Buffer();
+        if (OwnBuffer())
+            delete[] Buffer();
 
         m_numRows = numRows;
         m_numCols = numCols;
@@ -907,20 +1126,18 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
                 auto& us = *this;
                 if (sizeof(ElemType) == sizeof(double))
                 {
-#pragma omp parallel for
-                    foreach_column (j, us)
+                    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
                     {
 #ifdef USE_ACML
                         dcopy((int) numRows, reinterpret_cast<double*>(pArray + j), (int) numCols, reinterpret_cast<double*>(bufPtr + LocateColumn(j)), 1);
 #else
                         cblas_dcopy((int) numRows, reinterpret_cast<double*>(pArray + j), (int) numCols, reinterpret_cast<double*>(bufPtr + LocateColumn(j)), 1);
 #endif
-                    }
+                    });
                 }
                 else
                 {
-#pragma omp parallel for
-                    foreach_column (j, us)
+                    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
                     {
                         {
 #pragma warning(suppress : 4244)
@@ -930,13 +1147,38 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
                             cblas_scopy((int) numRows, reinterpret_cast<float*>(pArray + j), (int) numCols, reinterpret_cast<float*>(bufPtr + LocateColumn(j)), 1);
 #endif
                         }
-                    }
+                    });
                 }
             }
         }
     }
 }
 
+// *this = (data - offset) * scale, see Matrix::SetValueFromCompact()
+template <class ElemType>
+void CPUMatrix<ElemType>::SetValueFromCompact(const size_t numRows, const size_t numCols, const void* data, CompactElementType type, ElemType scale, const CPUMatrix<ElemType>* offset)
+{
+    if (offset && (offset->GetNumRows() != numRows || offset->GetNumCols() != 1))
+        InvalidArgument("SetValueFromCompact: The offset must be a column vector of %d elements.", (int) numRows);
+
+    RequireSize(numRows, numCols);
+    auto& us = *this;
+    const ElemType* offsets = offset ? offset->Data() : nullptr;
+    CPUThreadPool::ParallelFor(0, (int64_t) numCols, numRows, [&](int64_t j)
+    {
+        ElemType* dst = &us(0, j);
+        for (size_t i = 0; i < numRows; i++)
+        {
+            size_t k = i + j * numRows;
+            ElemType v = type == CompactElementType::uint8 ? (ElemType) reinterpret_cast<const unsigned char*>(data)[k]
+                                                            : (ElemType) HalfToFloat(reinterpret_cast<const uint16_t*>(data)[k]);
+            if (offsets)
+                v -= offsets[i];
+            dst[i] = v * scale;
+        }
+    });
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::SetDiagonalValue(const ElemType v)
 {
@@ -1150,6 +1392,109 @@ void CPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
     }
 }
 
+template <class ElemType>
+void CPUMatrix<ElemType>::SetCounterBasedUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle)
+{
+    if (IsEmpty())
+        LogicError("SetCounterBasedUniformRandomMask: Matrix is empty.");
+
+    // Element i gets the (i % 4)-th number of counter value first + i / 4, so the result does not depend on the number
+    // of threads, and it is the same as on the GPU.
+    const size_t n = GetNumElements();
+    const size_t numBlocks = (n + 3) / 4;
+    const uint64_t key = rngHandle.Seed();
+    const uint64_t firstCounter = rngHandle.ReserveCounters(numBlocks);
+    ElemType* data = Data();
+#pragma omp parallel for
+    for (int64_t block = 0; block < (int64_t) numBlocks; block++)
+    {
+        PhiloxValues r = Philox4x32(firstCounter + block, 0, key);
+        const size_t begin = block * 4;
+        const size_t end = std::min(n, begin + 4);
+        for (size_t i = begin; i < end; i++)
+            data[i] = PhiloxToUniform(r.v[i - begin]) <= maskRate ? 0 : scaleValue;
+    }
+}
+
+// The mask of SetCounterBasedUniformRandomMask() is regenerated for the elements elementOffset + i, i.e. element g of the matrix it was
+// generated for is the (g % 4)-th number of counter value firstCounter + g / 4.
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignElementProductOfUniformRandomMask(const CPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue,
+                                                                                  const uint64_t seed, const uint64_t firstCounter, const size_t elementOffset, const ElemType beta)
+{
+    if (a.IsEmpty())
+        LogicError("AssignElementProductOfUniformRandomMask: Matrix a is empty.");
+    if (beta == 0)
+        RequireSize(a.GetNumRows(), a.GetNumCols());
+    else if (GetNumRows() != a.GetNumRows() || GetNumCols() != a.GetNumCols())
+        InvalidArgument("AssignElementProductOfUniformRandomMask: The input matrix dimensions do not match.");
+
+    const size_t n = GetNumElements();
+    const size_t firstBlock = elementOffset / 4;
+    const size_t numBlocks = (elementOffset + n + 3) / 4 - firstBlock;
+    ElemType* us = Data();
+    const ElemType* pa = a.Data();
+#pragma omp parallel for
+    for (int64_t block = 0; block < (int64_t) numBlocks; block++)
+    {
+        PhiloxValues r = Philox4x32(firstCounter + firstBlock + block, 0, seed);
+        const size_t blockBegin = (firstBlock + block) * 4; // index g of the first element of the block
+        const size_t begin = std::max(blockBegin, elementOffset);
+        const size_t end = std::min(blockBegin + 4, elementOffset + n);
+        for (size_t g = begin; g < end; g++)
+        {
+            const size_t i = g - elementOffset;
+            const ElemType mask = PhiloxToUniform(r.v[g - blockBegin]) <= maskRate ? 0 : scaleValue;
+            us[i] = beta == 0 ? mask * pa[i] : beta * us[i] + mask * pa[i];
+        }
+    }
+    return *this;
+}
+
+// Element i gets the (i % 4)-th number of counter value i / 4 under the key 'seed', as on the GPU.
+template <class ElemType>
+void CPUMatrix<ElemType>::SetCounterBasedUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed)
+{
+    if (IsEmpty())
+        LogicError("SetCounterBasedUniformRandomValue: Matrix is empty.");
+
+    const size_t n = GetNumElements();
+    const size_t numBlocks = (n + 3) / 4;
+    ElemType* data = Data();
+#pragma omp parallel for
+    for (int64_t block = 0; block < (int64_t) numBlocks; block++)
+    {
+        PhiloxValues r = Philox4x32(block, 0, seed);
+        const size_t begin = block * 4;
+        const size_t end = std::min(n, begin + 4);
+        for (size_t i = begin; i < end; i++)
+            data[i] = low + (high - low) * (ElemType) PhiloxToUniform(r.v[i - begin]);
+    }
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::SetCounterBasedGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed)
+{
+    if (sigma <= 0)
+        InvalidArgument("SetCounterBasedGaussianRandomValue: sigma must be a positive value.");
+    if (IsEmpty())
+        LogicError("SetCounterBasedGaussianRandomValue: Matrix is empty.");
+
+    const size_t n = GetNumElements();
+    const size_t numBlocks = (n + 3) / 4;
+    ElemType* data = Data();
+#pragma omp parallel for
+    for (int64_t block = 0; block < (int64_t) numBlocks; block++)
+    {
+        float g[4];
+        PhiloxToGaussian(Philox4x32(block, 0, seed), g);
+        const size_t begin = block * 4;
+        const size_t end = std::min(n, begin + 4);
+        for (size_t i = begin; i < end; i++)
+            data[i] = mean + sigma * (ElemType) g[i - begin];
+    }
+}
+
 template <class ElemType>
 ElemType CPUMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
@@ -1265,6 +1610,70 @@ void CPUMatrix<ElemType>::FSAdagrad(CPUMatrix<ElemType>& gradients,
     }
 }
 
+template <class ElemType>
+/*static*/ void CPUMatrix<ElemType>::MultiTensorNormalGrad(const std::vector<CPUMatrix<ElemType>*>& smoothedGradients,
+                                                          const std::vector<CPUMatrix<ElemType>*>& gradients,
+                                                          const std::vector<CPUMatrix<ElemType>*>& functionValues,
+                                                          const std::vector<ElemType>& learnRatesPerSample,
+                                                          const ElemType momentum, const bool useNesterovMomentum,
+                                                          const ElemType clippingThreshold, const bool clipByTruncation,
+                                                          const ElemType l2RegWeight, const ElemType l1RegWeight)
+{
+    const bool clip = clippingThreshold != std::numeric_limits<ElemType>::infinity();
+    const ElemType truncationThreshold = abs(clippingThreshold);
+    for (size_t t = 0; t < gradients.size(); t++)
+    {
+        const long n = (long) gradients[t]->GetNumElements();
+        if (n == 0)
+            continue;
+        ElemType* smoothed = smoothedGradients[t]->Data();
+        ElemType* grad = gradients[t]->Data();
+        ElemType* val = functionValues[t]->Data();
+        const ElemType learnRatePerSample = learnRatesPerSample[t];
+        const ElemType l1Threshold = learnRatePerSample * l1RegWeight;
+
+        ElemType normFactor = 1;
+        if (clip && !clipByTruncation)
+        {
+            double gradientNorm = gradients[t]->FrobeniusNorm();
+            if (gradientNorm > clippingThreshold)
+                normFactor = (ElemType) (clippingThreshold / gradientNorm);
+        }
+
+#pragma omp parallel for
+        for (long i = 0; i < n; i++)
+        {
+            ElemType g = grad[i];
+            if (clip && clipByTruncation)
+            {
+                if (g > truncationThreshold)
+                    g = truncationThreshold;
+                else if (g < -truncationThreshold)
+                    g = -truncationThreshold;
+            }
+            g *= normFactor;
+            if (l2RegWeight > 0)
+                g += l2RegWeight * val[i];
+            grad[i] = g;
+
+            ElemType s = (1 - momentum) * learnRatePerSample * g + momentum * smoothed[i];
+            smoothed[i] = s;
+
+            ElemType v = useNesterovMomentum ? val[i] - momentum * s - (1 - momentum) * learnRatePerSample * g : val[i] - s;
+            if (l1RegWeight > 0)
+            {
+                if (v > l1Threshold)
+                    v -= l1Threshold;
+                else if (v < -l1Threshold)
+                    v += l1Threshold;
+                else
+                    v = 0;
+            }
+            val[i] = v;
+        }
+    }
+}
+
 template <class ElemType>
 ElemType CPUMatrix<ElemType>::RmsProp(CPUMatrix<ElemType>& gradients,
                                       ElemType RMS_GAMMA,
@@ -1457,10 +1866,13 @@ size_t CPUMatrix<ElemType>::CopyToArray(ElemType*& arrayCopyTo, size_t& currentA
 }
 
 template <typename ElemType>
-void CPUMatrix<ElemType>::CopySection(size_t /*numRows*/, size_t /*numCols*/, ElemType* /*dst*/, size_t /*colStride*/) const
+void CPUMatrix<ElemType>::CopySection(size_t numRows, size_t numCols, ElemType* dst, size_t colStride) const
 {
-    // REVIEW alexeyk: currently not used by CPU, but implement when possible.
-    RuntimeError("Not implemented.");
+    if (numRows > GetNumRows() || numCols > GetNumCols() || (numCols > 1 && colStride < numRows))
+        InvalidArgument("CopySection: The section (%d x %d) is larger than the matrix (%d x %d) or the column stride is too small.",
+                        (int) numRows, (int) numCols, (int) GetNumRows(), (int) GetNumCols());
+    for (size_t j = 0; j < numCols; j++)
+        memcpy(dst + j * colStride, Data() + LocateColumn(j), numRows * sizeof(ElemType));
 }
 
 template <class ElemType>
@@ -1506,8 +1918,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSumOf(const ElemType alpha, cons
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -1522,7 +1933,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSumOf(const ElemType alpha, cons
         {
             us(i, j) = alpha + a(i, j);
         }
-    }
+    });
 
     return *this;
 }
@@ -1606,8 +2017,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignDifferenceOf(const ElemType alph
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -1622,7 +2032,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignDifferenceOf(const ElemType alph
         {
             us(i, j) = alpha - a(i, j);
         }
-    }
+    });
 
     return *this;
 }
@@ -1635,8 +2045,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignDifferenceOf(const CPUMatrix<Ele
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -1651,7 +2060,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignDifferenceOf(const CPUMatrix<Ele
         {
             us(i, j) = a(i, j) - alpha;
         }
-    }
+    });
     return *this;
 }
 
@@ -1825,8 +2234,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignElementProductOf(const CPUMatrix
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -1841,7 +2249,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignElementProductOf(const CPUMatrix
         {
             us(i, j) = a(i, j) * b(i, j);
         }
-    }
+    });
     return *this;
 }
 
@@ -1862,8 +2270,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddElementProductOf(const CPUMatrix<El
     auto& us = *this;
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -1878,7 +2285,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddElementProductOf(const CPUMatrix<El
         {
             us(i, j) += a(i, j) * b(i, j);
         }
-    }
+    });
 
     return *this;
 }
@@ -1901,17 +2308,19 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignElementDivisionOf(const CPUMatri
 
     ElemType smallValue = EPS_IN_INVERSE;
 
-#pragma omp parallel for
-    foreach_coord (i, j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
-        ElemType v = b(i, j);
-        if (v >= 0 && v < smallValue)
-            us(i, j) = a(i, j) / smallValue;
-        else if (v < 0 && v > -smallValue)
-            us(i, j) = a(i, j) / (-smallValue);
-        else
-            us(i, j) = a(i, j) / v;
-    }
+        for (long i = 0; i < us.GetNumRows(); i++)
+        {
+            ElemType v = b(i, j);
+            if (v >= 0 && v < smallValue)
+                us(i, j) = a(i, j) / smallValue;
+            else if (v < 0 && v > -smallValue)
+                us(i, j) = a(i, j) / (-smallValue);
+            else
+                us(i, j) = a(i, j) / v;
+        }
+    });
 
     return *this;
 }
@@ -1929,8 +2338,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::ColumnElementMultiplyWith(const CPUMat
     auto& us = *this;
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -1945,7 +2353,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::ColumnElementMultiplyWith(const CPUMat
         {
             us(i, j) *= a(i, 0);
         }
-    }
+    });
 
     return *this;
 }
@@ -1963,8 +2371,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::RowElementMultiplyWith(const CPUMatrix
     auto& us = *this;
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         ElemType v = a(0, j);
         // four-way unrolling
@@ -1980,7 +2387,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::RowElementMultiplyWith(const CPUMatrix
         {
             us(i, j) *= v;
         }
-    }
+    });
 
     return *this;
 }
@@ -1998,8 +2405,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::RowElementDivideBy(const CPUMatrix<Ele
     auto& us = *this;
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         ElemType v = a(0, j);
         if (v >= 0 && v < EPS_IN_INVERSE)
@@ -2020,7 +2426,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::RowElementDivideBy(const CPUMatrix<Ele
         {
             us(i, j) /= v;
         }
-    }
+    });
 
     return *this;
 }
@@ -2039,8 +2445,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::ColumnElementDivideBy(const CPUMatrix<
     long m = (long) GetNumRows(), n = (long) GetNumCols();
 
     ElemType smallValue = EPS_IN_INVERSE;
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         for (long i = 0; i < m; i++)
         {
@@ -2052,7 +2457,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::ColumnElementDivideBy(const CPUMatrix<
             else
                 us(i, j) /= v;
         }
-    }
+    });
 
     return *this;
 }
@@ -2076,16 +2481,18 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignElementInverseOf(const CPUMatrix
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_coord (i, j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
-        if (a(i, j) < 0 && a(i, j) > -smallValue)
-            us(i, j) = 1 / (-smallValue);
-        else if (a(i, j) >= 0 && a(i, j) < smallValue)
-            us(i, j) = 1 / smallValue;
-        else
-            us(i, j) = 1 / a(i, j);
-    }
+        for (long i = 0; i < us.GetNumRows(); i++)
+        {
+            if (a(i, j) < 0 && a(i, j) > -smallValue)
+                us(i, j) = 1 / (-smallValue);
+            else if (a(i, j) >= 0 && a(i, j) < smallValue)
+                us(i, j) = 1 / smallValue;
+            else
+                us(i, j) = 1 / a(i, j);
+        }
+    });
 
     return *this;
 }
@@ -2107,40 +2514,76 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSigmoidOf(const CPUMatrix<ElemTy
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_coord (i, j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
-        if (a(i, j) >= 0)
-            us(i, j) = 1 / (1 + exp(-a(i, j)));
-        else
+        for (long i = 0; i < us.GetNumRows(); i++)
         {
-            ElemType v = exp(a(i, j));
-            us(i, j) = v / (1 + v);
+            if (a(i, j) >= 0)
+                us(i, j) = 1 / (1 + exp(-a(i, j)));
+            else
+            {
+                ElemType v = exp(a(i, j));
+                us(i, j) = v / (1 + v);
+            }
         }
-    }
+    });
 
     return *this;
 }
 
+// epilogue of Matrix::AffineAndActivation(); uses the same element functions as the TensorView ops of the activation nodes
 template <class ElemType>
-CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceLinearRectifierDerivative()
-{
-    return AssignLinearRectifierDerivativeOf(*this);
-}
-
-template <class ElemType>
-CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLinearRectifierDerivativeOf(const CPUMatrix<ElemType>& a)
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceAddColumnAndActivation(const CPUMatrix<ElemType>& bias, ElementWiseOperator activation)
 {
-    if (a.IsEmpty())
-        LogicError("AssignLinearRectifierDerivativeOf: Matrix a is empty.");
+    const size_t numRows = GetNumRows();
+    if (bias.GetNumElements() != numRows)
+        InvalidArgument("InplaceAddColumnAndActivation: The bias must have one element per row.");
 
-    auto& us = *this;
-    if (this != &a)
-        RequireSize(a.GetNumRows(), a.GetNumCols());
+    const ElemType* pBias = bias.Data();
+    CPUThreadPool::ParallelFor(0, (long) GetNumCols(), numRows, [&](long j)
+    {
+        ElemType* p = Data() + j * numRows;
+        if (activation == opSigmoid)
+        {
+            for (size_t i = 0; i < numRows; i++)
+                p[i] = Sigmoid(p[i] + pBias[i]);
+        }
+        else if (activation == opTanh)
+        {
+            for (size_t i = 0; i < numRows; i++)
+                p[i] = tanh(p[i] + pBias[i]);
+        }
+        else
+        {
+            for (size_t i = 0; i < numRows; i++)
+            {
+                ElemType v = p[i] + pBias[i];
+                p[i] = v > 0 ? v : 0;
+            }
+        }
+    });
+
+    return *this;
+}
+
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceLinearRectifierDerivative()
+{
+    return AssignLinearRectifierDerivativeOf(*this);
+}
+
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLinearRectifierDerivativeOf(const CPUMatrix<ElemType>& a)
+{
+    if (a.IsEmpty())
+        LogicError("AssignLinearRectifierDerivativeOf: Matrix a is empty.");
+
+    auto& us = *this;
+    if (this != &a)
+        RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -2155,7 +2598,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLinearRectifierDerivativeOf(cons
         {
             us(i, j) = a(i, j) > 0.0f ? 1.0f : 0.0f;
         }
-    }
+    });
 
     return *this;
 }
@@ -2177,8 +2620,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSigmoidDerivativeOf(const CPUMat
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -2201,7 +2643,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSigmoidDerivativeOf(const CPUMat
             ElemType v = a(i, j);
             us(i, j) = v * (1 - v);
         }
-    }
+    });
 
     return *this;
 }
@@ -2224,8 +2666,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTanhOf(const CPUMatrix<ElemType>
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -2240,7 +2681,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTanhOf(const CPUMatrix<ElemType>
         {
             us(i, j) = tanh(a(i, j));
         }
-    }
+    });
 
     return *this;
 }
@@ -2264,8 +2705,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogSoftmaxOf(const CPUMatrix<Ele
 
     if (isColWise)
     {
-#pragma omp parallel for
-        foreach_column (j, a)
+        CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
         {
             // we need to extract max before applying exp to avoid overflow
             ElemType maxV = a(0, j);
@@ -2278,12 +2718,11 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogSoftmaxOf(const CPUMatrix<Ele
             sum = log(sum);
             foreach_row (i, us)
                 us(i, j) -= sum;
-        }
+        });
     }
     else
     {
-#pragma omp parallel for
-        foreach_row (i, a)
+        CPUThreadPool::ParallelFor(0, a.GetNumRows(), a.GetNumCols(), [&](long i)
         {
             // we need to extract max before applying exp to avoid overflow
             ElemType maxV = a(i, 0);
@@ -2296,7 +2735,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogSoftmaxOf(const CPUMatrix<Ele
             sum = log(sum);
             foreach_column (j, us)
                 us(i, j) -= sum;
-        }
+        });
     }
 
     return *this;
@@ -2322,8 +2761,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignHardmaxOf(const CPUMatrix<ElemTy
 
     if (isColWise)
     {
-#pragma omp parallel for
-        foreach_column (j, a)
+        CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
         {
             // we need to extract max
             ElemType maxV = a(0, j);
@@ -2339,12 +2777,11 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignHardmaxOf(const CPUMatrix<ElemTy
 
             foreach_row (i, us)
                 us(i, j) = (i == maxI) ? 1.0f : 0.0f;
-        }
+        });
     }
     else
     {
-#pragma omp parallel for
-        foreach_row (i, a)
+        CPUThreadPool::ParallelFor(0, a.GetNumRows(), a.GetNumCols(), [&](long i)
         {
             // we need to extract max
             ElemType maxV = a(i, 0);
@@ -2360,12 +2797,44 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignHardmaxOf(const CPUMatrix<ElemTy
 
             foreach_column (j, us)
                 us(i, j) = (j == maxJ) ? 1.0f : 0.0f;
-        }
+        });
     }
 
     return *this;
 }
 
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTopNHardmaxOf(const CPUMatrix<ElemType>& a, const size_t n)
+{
+    if (a.IsEmpty())
+        LogicError("AssignTopNHardmaxOf: Matrix a is empty.");
+    if (this == &a)
+        LogicError("AssignTopNHardmaxOf: The operation cannot be done in place.");
+    if (n == 0 || n > a.GetNumRows())
+        InvalidArgument("AssignTopNHardmaxOf: n (%d) must be between 1 and the number of rows (%d).", (int) n, (int) a.GetNumRows());
+
+    const long m = (long) a.GetNumRows();
+    auto& us = *this;
+    RequireSize(m * n, a.GetNumCols());
+    SetValue(0);
+
+    CPUThreadPool::ParallelFor(0, a.GetNumCols(), m, [&](long j)
+    {
+        // the n largest in descending order; ties go to the lower index, like in AssignHardmaxOf()
+        std::vector<long> indices(m);
+        for (long i = 0; i < m; i++)
+            indices[i] = i;
+        std::partial_sort(indices.begin(), indices.begin() + n, indices.end(), [&](long i1, long i2)
+        {
+            return a(i1, j) > a(i2, j) || (a(i1, j) == a(i2, j) && i1 < i2);
+        });
+        for (long k = 0; k < (long) n; k++)
+            us(k * m + indices[k], j) = 1;
+    });
+
+    return *this;
+}
+
 //[this]=sqrt([this]) element wise
 template <class ElemType>
 CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceSqrt()
@@ -2386,8 +2855,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSqrtOf(const CPUMatrix<ElemType>
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -2402,7 +2870,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSqrtOf(const CPUMatrix<ElemType>
         {
             us(i, j) = sqrt(max((ElemType)0, a(i, j)));
         }
-    }
+    });
 
     return *this;
 }
@@ -2425,8 +2893,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignExpOf(const CPUMatrix<ElemType>&
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -2441,7 +2908,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignExpOf(const CPUMatrix<ElemType>&
         {
             us(i, j) = exp(a(i, j));
         }
-    }
+    });
 
     return *this;
 }
@@ -2464,8 +2931,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignAbsOf(const CPUMatrix<ElemType>&
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -2480,7 +2946,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignAbsOf(const CPUMatrix<ElemType>&
         {
             us(i, j) = abs(a(i, j));
         }
-    }
+    });
 
     return *this;
 }
@@ -2509,17 +2975,19 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogOf(const CPUMatrix<ElemType>&
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_coord (i, j, a)
+    CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
     {
-        const ElemType v = a(i, j);
-        if (v < EPS_IN_LOG)
+        for (long i = 0; i < a.GetNumRows(); i++)
         {
-            us(i, j) = LOG_OF_EPS_IN_LOG;
+            const ElemType v = a(i, j);
+            if (v < EPS_IN_LOG)
+            {
+                us(i, j) = LOG_OF_EPS_IN_LOG;
+            }
+            else
+                us(i, j) = log(v);
         }
-        else
-            us(i, j) = log(v);
-    }
+    });
 
     return *this;
 }
@@ -2534,19 +3002,21 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLog10Of(const CPUMatrix<ElemType
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_coord (i, j, a)
+    CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
     {
-        const ElemType v = a(i, j);
-        if (v <= 0)
-            LogicError("AssignLogOf: Log can only applied to numbers larger than 0.");
-        else if (v < EPS_IN_LOG)
+        for (long i = 0; i < a.GetNumRows(); i++)
         {
-            us(i, j) = LOG10_OF_EPS_IN_LOG;
+            const ElemType v = a(i, j);
+            if (v <= 0)
+                LogicError("AssignLogOf: Log can only applied to numbers larger than 0.");
+            else if (v < EPS_IN_LOG)
+            {
+                us(i, j) = LOG10_OF_EPS_IN_LOG;
+            }
+            else
+                us(i, j) = log10(v);
         }
-        else
-            us(i, j) = log10(v);
-    }
+    });
 
     return *this;
 }
@@ -2568,12 +3038,14 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignCosineOf(const CPUMatrix<ElemTyp
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_coord (i, j, a)
+    CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
     {
-        const ElemType v = a(i, j);
-        us(i, j) = cos(v);
-    }
+        for (long i = 0; i < a.GetNumRows(); i++)
+        {
+            const ElemType v = a(i, j);
+            us(i, j) = cos(v);
+        }
+    });
 
     return *this;
 }
@@ -2595,12 +3067,14 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignNegativeSineOf(const CPUMatrix<E
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_coord (i, j, a)
+    CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
     {
-        const ElemType v = a(i, j);
-        us(i, j) = -sin(v);
-    }
+        for (long i = 0; i < a.GetNumRows(); i++)
+        {
+            const ElemType v = a(i, j);
+            us(i, j) = -sin(v);
+        }
+    });
 
     return *this;
 }
@@ -2615,8 +3089,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceTruncateBottom(const ElemType t
     auto& us = *this;
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -2639,7 +3112,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceTruncateBottom(const ElemType t
             if (us(i, j) < threshold)
                 us(i, j) = threshold;
         }
-    }
+    });
 
     return *this;
 }
@@ -2655,8 +3128,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceTruncate(const ElemType thresho
     ElemType locTHresholdNeg = -locThresholdPos;
 
     long m = (long) GetNumRows(), n = (long) GetNumCols();
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, m, [&](long j)
     {
         // four-way unrolling
         for (long i = 0; i < (m & ~3); i += 4)
@@ -2689,7 +3161,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceTruncate(const ElemType thresho
             else if (us(i, j) < locTHresholdNeg)
                 us(i, j) = locTHresholdNeg;
         }
-    }
+    });
 
     return *this;
 }
@@ -2760,14 +3232,16 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTruncateBottomOf(const CPUMatrix
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_coord (i, j, a)
+    CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
     {
-        if (a(i, j) < threshold)
-            us(i, j) = threshold;
-        else
-            us(i, j) = a(i, j);
-    }
+        for (long i = 0; i < a.GetNumRows(); i++)
+        {
+            if (a(i, j) < threshold)
+                us(i, j) = threshold;
+            else
+                us(i, j) = a(i, j);
+        }
+    });
 
     return *this;
 }
@@ -2781,12 +3255,14 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceTruncateTop(const ElemType thre
 
     auto& us = *this;
 
-#pragma omp parallel for
-    foreach_coord (i, j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
-        if (us(i, j) > threshold)
-            us(i, j) = threshold;
-    }
+        for (long i = 0; i < us.GetNumRows(); i++)
+        {
+            if (us(i, j) > threshold)
+                us(i, j) = threshold;
+        }
+    });
 
     return *this;
 }
@@ -2802,14 +3278,16 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTruncateTopOf(const CPUMatrix<El
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_coord (i, j, a)
+    CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
     {
-        if (a(i, j) > threshold)
-            us(i, j) = threshold;
-        else
-            us(i, j) = a(i, j);
-    }
+        for (long i = 0; i < a.GetNumRows(); i++)
+        {
+            if (a(i, j) > threshold)
+                us(i, j) = threshold;
+            else
+                us(i, j) = a(i, j);
+        }
+    });
 
     return *this;
 }
@@ -2823,16 +3301,43 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::SetToZeroIfAbsLessThan(const ElemType
 
     auto& us = *this;
 
-#pragma omp parallel for
-    foreach_coord (i, j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
-        if (abs(us(i, j)) < threshold)
-            us(i, j) = 0;
-    }
+        for (long i = 0; i < us.GetNumRows(); i++)
+        {
+            if (abs(us(i, j)) < threshold)
+                us(i, j) = 0;
+        }
+    });
 
     return *this;
 }
 
+template <class ElemType>
+size_t CPUMatrix<ElemType>::ExtractAbsAboveThreshold(const ElemType threshold, size_t capacity, int* indices, ElemType* values)
+{
+    if (IsEmpty())
+        LogicError("ExtractAbsAboveThreshold: Matrix is empty.");
+
+    // sequential, so that the entries are extracted in index order
+    ElemType* data = Data();
+    size_t n = GetNumElements();
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (abs(data[i]) < threshold)
+            continue;
+        if (count < capacity)
+        {
+            indices[count] = (int) i;
+            values[count] = data[i];
+            data[i] = 0;
+        }
+        count++;
+    }
+    return count;
+}
+
 //sum of all abs(elements)
 template <class ElemType>
 ElemType CPUMatrix<ElemType>::SumOfAbsElements() const
@@ -2919,8 +3424,7 @@ void CPUMatrix<ElemType>::VectorSum(const CPUMatrix<ElemType>& a, CPUMatrix<Elem
     {
         c.RequireSize(1, n);
 
-#pragma omp parallel for
-        foreach_column (j, a)
+        CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long j)
         {
             ElemType v = 0;
             foreach_row (i, a)
@@ -2929,14 +3433,13 @@ void CPUMatrix<ElemType>::VectorSum(const CPUMatrix<ElemType>& a, CPUMatrix<Elem
                 v += a(i, j);
             }
             c(0, j) = v;
-        }
+        });
     }
     else
     {
         c.RequireSize(m, 1);
 
-#pragma omp parallel for
-        foreach_row (i, a)
+        CPUThreadPool::ParallelFor(0, a.GetNumRows(), a.GetNumCols(), [&](long i)
         {
             ElemType v = 0;
             foreach_column (j, a)
@@ -2945,7 +3448,7 @@ void CPUMatrix<ElemType>::VectorSum(const CPUMatrix<ElemType>& a, CPUMatrix<Elem
                 v += a(i, j);
             }
             c(i, 0) = v;
-        }
+        });
     }
 }
 
@@ -2966,8 +3469,7 @@ void CPUMatrix<ElemType>::VectorNorm1(CPUMatrix<ElemType>& c, const bool isColWi
     {
         c.RequireSize(1, n);
 
-#pragma omp parallel for
-        foreach_column (j, us)
+        CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
         {
             ElemType v = 0;
             foreach_row (i, us)
@@ -2976,14 +3478,13 @@ void CPUMatrix<ElemType>::VectorNorm1(CPUMatrix<ElemType>& c, const bool isColWi
                 v += abs(us(i, j));
             }
             c(0, j) = v;
-        }
+        });
     }
     else
     {
         c.RequireSize(m, 1);
 
-#pragma omp parallel for
-        foreach_row (i, us)
+        CPUThreadPool::ParallelFor(0, us.GetNumRows(), us.GetNumCols(), [&](long i)
         {
             ElemType v = 0;
             foreach_column (j, us)
@@ -2992,7 +3493,7 @@ void CPUMatrix<ElemType>::VectorNorm1(CPUMatrix<ElemType>& c, const bool isColWi
                 v += abs(us(i, j));
             }
             c(i, 0) = v;
-        }
+        });
     }
 }
 
@@ -3023,20 +3524,18 @@ void CPUMatrix<ElemType>::VectorNorm2(CPUMatrix<ElemType>& c, const bool isColWi
 
         if (sizeof(ElemType) == sizeof(double))
         {
-#pragma omp parallel for
-            foreach_column (j, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
             {
 #ifdef USE_ACML
                 c(0, j) = (ElemType) dnrm2(m, reinterpret_cast<double*>(bufPtr + us.LocateColumn(j)), 1);
 #else
                 c(0, j) = (ElemType) cblas_dnrm2(m, reinterpret_cast<double*>(bufPtr + us.LocateColumn(j)), 1);
 #endif
-            }
+            });
         }
         else
         {
-#pragma omp parallel for
-            foreach_column (j, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
             {
 #pragma warning(suppress : 4244)
 #ifdef USE_ACML
@@ -3044,7 +3543,7 @@ void CPUMatrix<ElemType>::VectorNorm2(CPUMatrix<ElemType>& c, const bool isColWi
 #else
                 c(0, j) = cblas_snrm2(m, reinterpret_cast<float*>(bufPtr + us.LocateColumn(j)), 1);
 #endif
-            }
+            });
         }
     }
     else
@@ -3053,20 +3552,18 @@ void CPUMatrix<ElemType>::VectorNorm2(CPUMatrix<ElemType>& c, const bool isColWi
 
         if (sizeof(ElemType) == sizeof(double))
         {
-#pragma omp parallel for
-            foreach_row (i, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumRows(), c.GetNumCols(), [&](long i)
             {
 #ifdef USE_ACML
                 c(i, 0) = dnrm2(n, reinterpret_cast<double*>(bufPtr + i), m);
 #else
                 c(i, 0) = cblas_dnrm2(n, reinterpret_cast<double*>(bufPtr + i), m);
 #endif
-            }
+            });
         }
         else
         {
-#pragma omp parallel for
-            foreach_row (i, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumRows(), c.GetNumCols(), [&](long i)
             {
 #pragma warning(suppress : 4244)
 #ifdef USE_ACML
@@ -3074,7 +3571,7 @@ void CPUMatrix<ElemType>::VectorNorm2(CPUMatrix<ElemType>& c, const bool isColWi
 #else
                 c(i, 0) = cblas_snrm2(n, reinterpret_cast<float*>(bufPtr + i), m);
 #endif
-            }
+            });
         }
     }
 }
@@ -3161,11 +3658,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignKhatriRaoProductOf(const CPUMatr
     long rowsB = (long) b.GetNumRows();
     RequireSize(rowsA * rowsB, cols);
 
-#ifdef __INTEL_COMPILER // TODO: check this
-#pragma simd statement
-#endif
-#pragma omp parallel for
-    for (long k = 0; k < cols; k++)
+    CPUThreadPool::ParallelFor(0, cols, rowsA * rowsB, [&](long k)
     {
         long jj = 0;
         for (long j = 0; j < rowsB; j++)
@@ -3175,7 +3668,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignKhatriRaoProductOf(const CPUMatr
                 (*this)(jj++, k) = a(i, k) * b(j, k);
             }
         }
-    }
+    });
 
     return *this;
 }
@@ -3217,8 +3710,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddColumnReshapeProductOf(const CPUMat
 #ifdef __INTEL_COMPILER // TODO: check this
 #pragma simd statement
 #endif
-#pragma omp parallel for
-        foreach_column (t, a)
+        CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long t)
         {
             size_t k = 0;
             for (size_t j = 0; j < ncols; j++) // row and col is transposed
@@ -3231,7 +3723,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddColumnReshapeProductOf(const CPUMat
                 }
                 us(j, t) += v;
             }
-        }
+        });
     }
     else
     {
@@ -3241,8 +3733,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddColumnReshapeProductOf(const CPUMat
 #ifdef __INTEL_COMPILER // TODO: check this
 #pragma simd statement
 #endif
-#pragma omp parallel for
-        foreach_column (t, a)
+        CPUThreadPool::ParallelFor(0, a.GetNumCols(), a.GetNumRows(), [&](long t)
         {
             size_t k = 0;
             for (size_t j = 0; j < ncols; j++)
@@ -3253,7 +3744,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddColumnReshapeProductOf(const CPUMat
                     k++;
                 }
             }
-        }
+        });
     }
 
     return *this;
@@ -3314,14 +3805,16 @@ ElemType CPUMatrix<ElemType>::MatrixNormInf() const
     auto& us = *this;
 
     ElemType v = 0;
-#pragma omp parallel for
-    foreach_coord (i, j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
-#pragma omp critical
+        for (long i = 0; i < us.GetNumRows(); i++)
         {
-            v = std::max(v, abs(us(i, j)));
+    #pragma omp critical
+            {
+                v = std::max(v, abs(us(i, j)));
+            }
         }
-    }
+    });
     return v;
 }
 
@@ -3334,17 +3827,19 @@ ElemType CPUMatrix<ElemType>::MatrixNorm0() const
     auto& us = *this;
 
     ElemType v = 0;
-#pragma omp parallel for
-    foreach_coord (i, j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
-        if (us(i, j) != 0)
+        for (long i = 0; i < us.GetNumRows(); i++)
         {
-#pragma omp critical
+            if (us(i, j) != 0)
             {
-                ++v;
+    #pragma omp critical
+                {
+                    ++v;
+                }
             }
         }
-    }
+    });
     return v;
 }
 
@@ -3375,8 +3870,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSignOf(const CPUMatrix<ElemType>
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_column (j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
         foreach_row (i, us)
         {
@@ -3386,7 +3880,70 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSignOf(const CPUMatrix<ElemType>
             else
                 us(i, j) = v;
         }
-    }
+    });
+
+    return us;
+}
+
+// column j of *this = [scale, packed compact elements of a(:, j)], see Matrix::AssignCompressedOf()
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignCompressedOf(const CPUMatrix<ElemType>& a, CompactElementType type)
+{
+    const size_t numRows = a.GetNumRows();
+    RequireSize(GetCompressedNumRows<ElemType>(numRows, type), a.GetNumCols());
+
+    auto& us = *this;
+    CPUThreadPool::ParallelFor(0, (int64_t) a.GetNumCols(), numRows, [&](int64_t j)
+    {
+        const ElemType* src = &a(0, j);
+        ElemType* dst = &us(0, j);
+        if (type == CompactElementType::uint8)
+        {
+            ElemType maxAbs = 0;
+            for (size_t i = 0; i < numRows; i++)
+                maxAbs = std::max(maxAbs, (ElemType) fabs(src[i]));
+            ElemType scale = maxAbs > 0 ? maxAbs / 127 : 1;
+            dst[0] = scale;
+            unsigned char* bytes = reinterpret_cast<unsigned char*>(dst + 1);
+            for (size_t i = 0; i < numRows; i++)
+                bytes[i] = (unsigned char) (std::min(std::max((int) floor(src[i] / scale + (ElemType) 0.5), -127), 127) + 127);
+        }
+        else
+        {
+            dst[0] = 1;
+            uint16_t* halves = reinterpret_cast<uint16_t*>(dst + 1);
+            for (size_t i = 0; i < numRows; i++)
+                halves[i] = FloatToHalf((float) src[i]);
+        }
+    });
+
+    return us;
+}
+
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignDecompressedOf(const CPUMatrix<ElemType>& compressed, size_t numRows, CompactElementType type)
+{
+    RequireSize(numRows, compressed.GetNumCols());
+
+    auto& us = *this;
+    CPUThreadPool::ParallelFor(0, (int64_t) compressed.GetNumCols(), numRows, [&](int64_t j)
+    {
+        const ElemType* src = &compressed(0, j);
+        ElemType* dst = &us(0, j);
+        ElemType scale = src[0];
+        if (type == CompactElementType::uint8)
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src + 1);
+            for (size_t i = 0; i < numRows; i++)
+                dst[i] = ((ElemType) bytes[i] - 127) * scale;
+        }
+        else
+        {
+            const uint16_t* halves = reinterpret_cast<const uint16_t*>(src + 1);
+            for (size_t i = 0; i < numRows; i++)
+                dst[i] = (ElemType) HalfToFloat(halves[i]) * scale;
+        }
+    });
 
     return us;
 }
@@ -3401,8 +3958,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddSignOf(const CPUMatrix<ElemType>& a
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
-#pragma omp parallel for
-    foreach_column (j, us)
+    CPUThreadPool::ParallelFor(0, us.GetNumCols(), us.GetNumRows(), [&](long j)
     {
         foreach_row (i, us)
         {
@@ -3412,7 +3968,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddSignOf(const CPUMatrix<ElemType>& a
             else
                 us(i, j) = v;
         }
-    }
+    });
 
     return us;
 }
@@ -3437,8 +3993,7 @@ void CPUMatrix<ElemType>::VectorMax(CPUMatrix<ElemType>& maxIndexes, CPUMatrix<E
 
         if (topK == 1)
         {
-#pragma omp parallel for
-            for (int j = 0; j < n; j++)
+            CPUThreadPool::ParallelFor(0, n, m, [&](long j)
             {
                 ElemType v = us(0, j);
                 size_t index = 0;
@@ -3452,7 +4007,7 @@ void CPUMatrix<ElemType>::VectorMax(CPUMatrix<ElemType>& maxIndexes, CPUMatrix<E
                 }
                 maxValues(0, j) = v;
                 maxIndexes(0, j) = (ElemType) index;
-            }
+            });
         }
         else
         {
@@ -3492,8 +4047,7 @@ void CPUMatrix<ElemType>::VectorMax(CPUMatrix<ElemType>& maxIndexes, CPUMatrix<E
         maxValues.RequireSize(m, 1);
         maxIndexes.RequireSize(m, 1);
 
-#pragma omp parallel for
-        for (int i = 0; i < m; i++)
+        CPUThreadPool::ParallelFor(0, m, n, [&](long i)
         {
             ElemType v = us(i, 0);
             size_t index = 0;
@@ -3507,7 +4061,7 @@ void CPUMatrix<ElemType>::VectorMax(CPUMatrix<ElemType>& maxIndexes, CPUMatrix<E
             }
             maxValues(i, 0) = v;
             maxIndexes(i, 0) = (ElemType) index;
-        }
+        });
     }
 }
 
@@ -3528,8 +4082,7 @@ void CPUMatrix<ElemType>::VectorMin(CPUMatrix<ElemType>& minIndexes, CPUMatrix<E
         minValues.RequireSize(1, n);
         minIndexes.RequireSize(1, n);
 
-#pragma omp parallel for
-        for (int j = 0; j < n; j++)
+        CPUThreadPool::ParallelFor(0, n, m, [&](long j)
         {
             ElemType v = us(0, j);
             size_t index = 0;
@@ -3543,15 +4096,14 @@ void CPUMatrix<ElemType>::VectorMin(CPUMatrix<ElemType>& minIndexes, CPUMatrix<E
             }
             minValues(0, j) = v;
             minIndexes(0, j) = (ElemType) index;
-        }
+        });
     }
     else
     {
         minValues.RequireSize(m, 1);
         minIndexes.RequireSize(m, 1);
 
-#pragma omp parallel for
-        for (int i = 0; i < m; i++)
+        CPUThreadPool::ParallelFor(0, m, n, [&](long i)
         {
             ElemType v = us(i, 0);
             size_t index = 0;
@@ -3565,7 +4117,7 @@ void CPUMatrix<ElemType>::VectorMin(CPUMatrix<ElemType>& minIndexes, CPUMatrix<E
             }
             minValues(i, 0) = v;
             minIndexes(i, 0) = (ElemType) index;
-        }
+        });
     }
 }
 
@@ -3603,6 +4155,58 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignNumOfDiff(const CPUMatrix<ElemTy
     return *this;
 }
 
+// A column counts as an error if its label is not among the 'topK' largest predictions, i.e. if 'topK' or more predictions
+// precede the label's in the stable descending order (larger values first, equal values by row).
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignNumOfTopKErrors(const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& predictions, int topK, bool classIndexLabels, const CPUMatrix<char>* columnsMask)
+{
+    if (labels.GetNumCols() != predictions.GetNumCols())
+        InvalidArgument("AssignNumOfTopKErrors: labels and predictions must have the same number of columns.");
+    if (classIndexLabels ? labels.GetNumRows() != 1 : labels.GetNumRows() != predictions.GetNumRows())
+        InvalidArgument("AssignNumOfTopKErrors: labels must have one row of class indices, or as many rows as the predictions.");
+    if (columnsMask && columnsMask->GetNumCols() != predictions.GetNumCols())
+        InvalidArgument("AssignNumOfTopKErrors: The column mask must have as many columns as the predictions.");
+    if (topK < 1)
+        InvalidArgument("AssignNumOfTopKErrors: topK (%d) must be positive.", topK);
+
+    const long m = (long) predictions.GetNumRows();
+    const long n = (long) predictions.GetNumCols();
+    long numErrors = 0;
+#pragma omp parallel for reduction(+ : numErrors)
+    for (long j = 0; j < n; j++)
+    {
+        if (columnsMask && (*columnsMask)(0, j) == 0)
+            continue;
+
+        long labelRow;
+        if (classIndexLabels)
+            labelRow = (long) labels(0, j);
+        else
+        {
+            labelRow = 0;
+            for (long i = 1; i < m; i++)
+                if (labels(i, j) > labels(labelRow, j))
+                    labelRow = i;
+        }
+        if (labelRow < 0 || labelRow >= m)
+        {
+            numErrors++;
+            continue;
+        }
+
+        const ElemType labelValue = predictions(labelRow, j);
+        long rank = 0;
+        for (long i = 0; i < m; i++)
+            rank += predictions(i, j) > labelValue || (predictions(i, j) == labelValue && i < labelRow);
+        numErrors += rank >= topK;
+    }
+
+    RequireSize(1, 1); // result should be one element
+    (*this)(0, 0) = (ElemType) numErrors;
+
+    return *this;
+}
+
 #pragma endregion Member BLAS Functions
 
 #pragma region Other helper Functions
@@ -3886,8 +4490,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignMaxPoolingResult(const CPUMatrix
 // OUT_ELEM_ROWPOS(channel, wrow, wcol) = (channel + (wrow + wcol * outputHeight) * channels)
 // OUT_ELEM_COLPOS = sample
 
-#pragma omp parallel for
-    for (long sample = 0; sample < (long) batchSize; sample++)
+    CPUThreadPool::ParallelFor(0, (long) batchSize, outputSizePerSample, [&](long sample)
     {
         for (long outputIndexWithinSample = 0; outputIndexWithinSample < outputSizePerSample; outputIndexWithinSample++)
         {
@@ -3913,7 +4516,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignMaxPoolingResult(const CPUMatrix
 
             (*this)(outputIndexWithinSample, sample) = maxVal;
         }
-    }
+    });
 
     return *this;
 }
@@ -3935,8 +4538,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddMaxPoolingGradient(const CPUMatrix<
 // OUT_ELEM_ROWPOS(channel, wrow, wcol) = (channel + (wrow + wcol * outputHeight) * channels)
 // OUT_ELEM_COLPOS = sample
 
-#pragma omp parallel for
-    for (long sample = 0; sample < batchSize; sample++)
+    CPUThreadPool::ParallelFor(0, batchSize, inputSizePerSample, [&](long sample)
     {
         for (long inputIndexWithinSample = 0; inputIndexWithinSample < inputSizePerSample; inputIndexWithinSample++)
         {
@@ -3961,7 +4563,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddMaxPoolingGradient(const CPUMatrix<
                 }
             }
         }
-    }
+    });
 
     return *this;
 }
@@ -3983,8 +4585,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignAveragePoolingResult(const CPUMa
 // OUT_ELEM_ROWPOS(channel, wrow, wcol) = (channel + (wrow + wcol * outputHeight) * channels)
 // OUT_ELEM_COLPOS = sample
 
-#pragma omp parallel for
-    for (long sample = 0; sample < batchSize; sample++)
+    CPUThreadPool::ParallelFor(0, batchSize, outputSizePerSample, [&](long sample)
     {
         for (long outputIndexWithinSample = 0; outputIndexWithinSample < outputSizePerSample; outputIndexWithinSample++)
         {
@@ -4007,7 +4608,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignAveragePoolingResult(const CPUMa
 
             (*this)(outputIndexWithinSample, sample) = sum / windowSize;
         }
-    }
+    });
 
     return *this;
 }
@@ -4030,8 +4631,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddAveragePoolingGradient(const CPUMat
 // OUT_ELEM_ROWPOS(channel, wrow, wcol) = (channel + (wrow + wcol * outputHeight) * channels)
 // OUT_ELEM_COLPOS = sample
 
-#pragma omp parallel for
-    for (long sample = 0; sample < batchSize; sample++)
+    CPUThreadPool::ParallelFor(0, batchSize, inputSizePerSample, [&](long sample)
     {
         for (long inputIndexWithinSample = 0; inputIndexWithinSample < inputSizePerSample; inputIndexWithinSample++)
         {
@@ -4054,7 +4654,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddAveragePoolingGradient(const CPUMat
                 }
             }
         }
-    }
+    });
 
     return *this;
 }
@@ -4413,56 +5013,298 @@ void CPUMatrix<ElemType>::AveragePoolingBackward(const CPUMatrix<int>& mpRowCol,
     }
 }
 
+// Per feature map sums of a and of a .* b over the minibatch, accumulated in double. Map i consists of the rows
+// [i * spatialSize, (i + 1) * spatialSize) of every column; for spatialSize == 1, every row is a map.
 template <class ElemType>
-void CPUMatrix<ElemType>::BatchNormalizationForward(const CPUMatrix<ElemType>& scale, const CPUMatrix<ElemType>& bias, double expAvgFactor, double blendFactor,
-                                                    CPUMatrix<ElemType>& runMean, CPUMatrix<ElemType>& runInvStdDev, CPUMatrix<ElemType>& out, double epsilon,
-                                                    CPUMatrix<ElemType>& saveMean, CPUMatrix<ElemType>& saveInvStdDev) const
+static void BatchNormalizationSums(const ElemType* a, const ElemType* b, size_t vectorSize, size_t spatialSize, size_t batchSize,
+                                   std::vector<double>& sumA, std::vector<double>& sumAB)
 {
-    UNUSED(epsilon); UNUSED(saveMean); UNUSED(saveInvStdDev);
-
-    assert((GetNumRows() % scale.GetNumRows()) == 0);
-
-    if (expAvgFactor != 0 || blendFactor != 1)
-        RuntimeError("Batch normalization training on CPU is not yet implemented.");
-
-    bool spatial = GetNumRows() != scale.GetNumRows();
-    if (spatial)
+    const size_t numMaps = vectorSize / spatialSize;
+    sumA.assign(numMaps, 0);
+    sumAB.assign(numMaps, 0);
+    if (spatialSize == 1)
     {
-        size_t spatialSize = GetNumRows() / scale.GetNumRows();
+        // accumulate column by column, so that the inner loop runs over contiguous rows
+        const size_t blockSize = 256;
+        const size_t numBlocks = (vectorSize + blockSize - 1) / blockSize;
 #pragma omp parallel for
-        for (long icol = 0; icol < out.GetNumCols(); icol++)
+        for (int64_t block = 0; block < (int64_t) numBlocks; block++)
         {
-            for (long irow = 0; irow < out.GetNumRows(); irow++)
+            const size_t begin = block * blockSize;
+            const size_t end = std::min(vectorSize, begin + blockSize);
+            for (size_t j = 0; j < batchSize; j++)
             {
-                size_t imap = irow / spatialSize;
-                out(irow, icol) = scale(imap, 0) * ((*this)(irow, icol) - runMean(imap, 0)) * runInvStdDev(imap, 0) + bias(imap, 0);
+                const ElemType* pa = a + j * vectorSize;
+                const ElemType* pb = b + j * vectorSize;
+                for (size_t i = begin; i < end; i++)
+                {
+                    sumA[i] += pa[i];
+                    sumAB[i] += (double) pa[i] * pb[i];
+                }
             }
         }
+        return;
     }
-    else
+
+    auto sumKernel = GetCPUVectorizedReductionKernel<ElemType>(ElementWiseOperator::opCopy, 2);
+    auto productKernel = GetCPUVectorizedReductionKernel<ElemType>(ElementWiseOperator::opElementwiseProduct, 3);
+#pragma omp parallel for
+    for (int64_t map = 0; map < (int64_t) numMaps; map++)
     {
+        double sa = 0;
+        double sab = 0;
+        for (size_t j = 0; j < batchSize; j++)
+        {
+            const size_t offset = j * vectorSize + map * spatialSize;
+            ElemType* pointers[2] = {const_cast<ElemType*>(a + offset), const_cast<ElemType*>(b + offset)};
+            if (sumKernel && productKernel)
+            {
+                sa += sumKernel(pointers, spatialSize);
+                sab += productKernel(pointers, spatialSize);
+            }
+            else
+            {
+                for (size_t i = 0; i < spatialSize; i++)
+                {
+                    sa += pointers[0][i];
+                    sab += (double) pointers[0][i] * pointers[1][i];
+                }
+            }
+        }
+        sumA[map] = sa;
+        sumAB[map] = sab;
+    }
+}
+
+// out = alpha[map] * in + beta[map] for all elements of each feature map (see BatchNormalizationSums() for the layout)
+template <class ElemType>
+static void BatchNormalizationApply(const ElemType* in, ElemType* out, size_t vectorSize, size_t spatialSize, size_t batchSize,
+                                    const std::vector<ElemType>& alpha, const std::vector<ElemType>& beta)
+{
+    const size_t numMaps = vectorSize / spatialSize;
 #pragma omp parallel for
-        for (long icol = 0; icol < out.GetNumCols(); icol++)
+    for (int64_t j = 0; j < (int64_t) batchSize; j++)
+    {
+        const ElemType* pin = in + j * vectorSize;
+        ElemType* pout = out + j * vectorSize;
+        if (spatialSize == 1)
         {
-            for (long irow = 0; irow < out.GetNumRows(); irow++)
+            for (size_t i = 0; i < vectorSize; i++)
+                pout[i] = alpha[i] * pin[i] + beta[i];
+        }
+        else
+        {
+            for (size_t map = 0; map < numMaps; map++)
             {
-                out(irow, icol) = scale(irow, 0) * ((*this)(irow, icol) - runMean(irow, 0)) * runInvStdDev(irow, 0) + bias(irow, 0);
+                const ElemType a = alpha[map];
+                const ElemType b = beta[map];
+                const size_t offset = map * spatialSize;
+                for (size_t i = offset; i < offset + spatialSize; i++)
+                    pout[i] = a * pin[i] + b;
             }
         }
     }
 }
 
+template <class ElemType>
+void CPUMatrix<ElemType>::BatchNormalizationForward(const CPUMatrix<ElemType>& scale, const CPUMatrix<ElemType>& bias, double expAvgFactor, double blendFactor,
+                                                    CPUMatrix<ElemType>& runMean, CPUMatrix<ElemType>& runInvStdDev, CPUMatrix<ElemType>& out, double epsilon,
+                                                    CPUMatrix<ElemType>& saveMean, CPUMatrix<ElemType>& saveInvStdDev) const
+{
+    assert((GetNumRows() % scale.GetNumRows()) == 0);
+
+    const size_t vectorSize = GetNumRows();
+    const size_t numMaps = scale.GetNumRows();
+    const size_t spatialSize = vectorSize / numMaps;
+    const size_t batchSize = GetNumCols();
+
+    // If expAvgFactor == 0 && blendFactor == 1 then we don't need to compute current minibatch statistics.
+    if (expAvgFactor > 0 || blendFactor < 1)
+    {
+        // The variance is computed from the sums of the values and of their squares, which are accumulated in double.
+        std::vector<double> sum, sumOfSquares;
+        BatchNormalizationSums(Data(), Data(), vectorSize, spatialSize, batchSize, sum, sumOfSquares);
+        const double n = (double) (spatialSize * batchSize);
+        for (size_t map = 0; map < numMaps; map++)
+        {
+            double mean = sum[map] / n;
+            double variance = std::max(0.0, sumOfSquares[map] / n - mean * mean);
+            saveMean(map, 0) = (ElemType) mean;
+            saveInvStdDev(map, 0) = (ElemType) (1 / sqrt(variance + epsilon));
+            if (expAvgFactor == 1)
+            {
+                runMean(map, 0) = saveMean(map, 0);
+                runInvStdDev(map, 0) = saveInvStdDev(map, 0);
+            }
+            else
+            {
+                runMean(map, 0) = (ElemType) (expAvgFactor * saveMean(map, 0) + (1.0 - expAvgFactor) * runMean(map, 0));
+                runInvStdDev(map, 0) = (ElemType) (expAvgFactor * saveInvStdDev(map, 0) + (1.0 - expAvgFactor) * runInvStdDev(map, 0));
+            }
+        }
+    }
+
+    // When:
+    //     blendFactor == 1 - use running mean/var instead of the current minibatch mean/var.
+    // 0 < blendFactor <  1 - blend running mean/var with mean/var of the current minibatch: saveMean = (1 - blendFactor) * saveMean + blendFactor * runMean
+    //     blendFactor == 0 - use mean/var of the current minibatch.
+    std::vector<ElemType> alpha(numMaps), beta(numMaps);
+    for (size_t map = 0; map < numMaps; map++)
+    {
+        ElemType mean = runMean(map, 0);
+        ElemType invStdDev = runInvStdDev(map, 0);
+        if (blendFactor < 1)
+        {
+            saveMean(map, 0) = (ElemType) ((1 - blendFactor) * saveMean(map, 0) + blendFactor * mean);
+            saveInvStdDev(map, 0) = (ElemType) ((1 - blendFactor) * saveInvStdDev(map, 0) + blendFactor * invStdDev);
+            mean = saveMean(map, 0);
+            invStdDev = saveInvStdDev(map, 0);
+        }
+        alpha[map] = scale(map, 0) * invStdDev;
+        beta[map] = bias(map, 0) - alpha[map] * mean;
+    }
+    BatchNormalizationApply(Data(), out.Data(), vectorSize, spatialSize, batchSize, alpha, beta);
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::BatchNormalizationBackward(const CPUMatrix<ElemType>& in, CPUMatrix<ElemType>& grad, const CPUMatrix<ElemType>& scale, const CPUMatrix<ElemType>& saveMean, const CPUMatrix<ElemType>& saveInvStdDev,
                                                      CPUMatrix<ElemType>& scaleGrad, CPUMatrix<ElemType>& biasGrad) const
 {
-    UNUSED(in); UNUSED(grad); UNUSED(scale); UNUSED(saveMean); UNUSED(saveInvStdDev); UNUSED(scaleGrad); UNUSED(biasGrad);
-    RuntimeError("Batch normalization training on CPU is not yet implemented.");
-}
+    assert((GetNumRows() % scale.GetNumRows()) == 0);
+
+    const size_t vectorSize = GetNumRows();
+    const size_t numMaps = scale.GetNumRows();
+    const size_t spatialSize = vectorSize / numMaps;
+    const size_t batchSize = GetNumCols();
 
+    std::vector<double> sumOfGrad, sumOfGradTimesIn;
+    BatchNormalizationSums(Data(), in.Data(), vectorSize, spatialSize, batchSize, sumOfGrad, sumOfGradTimesIn);
+
+    // From the BN paper, dL/dxi = scale * invStdDev * (dL/dyi - (xHat * dL/dScale + dL/dBias) / m),
+    // with dL/dScale = sum(dL/dy * xHat) and dL/dBias = sum(dL/dy). This is linear in dL/dyi and xi per feature map:
+    // dL/dxi = c1 * dL/dyi + c2 * xi + c0.
+    const double m = (double) (spatialSize * batchSize);
+    std::vector<ElemType> c0(numMaps), c1(numMaps), c2(numMaps);
+    for (size_t map = 0; map < numMaps; map++)
+    {
+        const double mean = saveMean(map, 0);
+        const double invStdDev = saveInvStdDev(map, 0);
+        const double dScale = invStdDev * (sumOfGradTimesIn[map] - mean * sumOfGrad[map]);
+        const double dBias = sumOfGrad[map];
+        scaleGrad(map, 0) = (ElemType) dScale;
+        biasGrad(map, 0) = (ElemType) dBias;
+
+        const double scaleInvStdDev = scale(map, 0) * invStdDev;
+        c1[map] = (ElemType) scaleInvStdDev;
+        c2[map] = (ElemType) (-scaleInvStdDev * invStdDev * dScale / m);
+        c0[map] = (ElemType) (-scaleInvStdDev * (dBias - invStdDev * dScale * mean) / m);
+    }
+
+    // the gradient is added to grad
+#pragma omp parallel for
+    for (int64_t j = 0; j < (int64_t) batchSize; j++)
+    {
+        const ElemType* pdy = Data() + j * vectorSize;
+        const ElemType* px = in.Data() + j * vectorSize;
+        ElemType* pdx = grad.Data() + j * vectorSize;
+        if (spatialSize == 1)
+        {
+            for (size_t i = 0; i < vectorSize; i++)
+                pdx[i] += c1[i] * pdy[i] + c2[i] * px[i] + c0[i];
+        }
+        else
+        {
+            for (size_t map = 0; map < numMaps; map++)
+            {
+                const ElemType a = c1[map], b = c2[map], c = c0[map];
+                const size_t offset = map * spatialSize;
+                for (size_t i = offset; i < offset + spatialSize; i++)
+                    pdx[i] += a * pdy[i] + b * px[i] + c;
+            }
+        }
+    }
+}
 
 #pragma region Static BLAS Functions
 
+// GEMM for few columns, c = alpha * op(a) * op(b) + beta * c with N <= MaxSmallGemmColumns columns of c, as in frame-by-frame
+// evaluation of recurrent models, where the overhead of the BLAS call exceeds the arithmetic. N is a template argument,
+// so that the loops over the columns are unrolled and those over the rows or the inner dimension vectorize.
+// Element (p, j) of op(b) is b[p * bInnerStride + j * bColStride].
+// Without transposeA, each block of rows of c accumulates the columns of a, scaled by the rows of op(b); with it, each element
+// of c is the dot product of a column of a with a column of op(b). Either way a is read once along its columns, without repacking.
+static const int MaxSmallGemmColumns = 8;
+
+template <class ElemType, int N>
+static void SmallGemm(int m, int k, ElemType alpha, const ElemType* a, int lda, bool transposeA,
+                      const ElemType* b, size_t bInnerStride, size_t bColStride, ElemType beta, ElemType* c, int ldc)
+{
+    const int blockRows = 64;
+    const int numBlocks = (m + blockRows - 1) / blockRows;
+    CPUThreadPool::ParallelFor(0, numBlocks, (size_t) blockRows * k, [&](int64_t block)
+    {
+        const int i0 = (int) block * blockRows;
+        const int rows = min(blockRows, m - i0);
+        ElemType sum[N][blockRows];
+        if (!transposeA)
+        {
+            for (int j = 0; j < N; j++)
+                for (int i = 0; i < rows; i++)
+                    sum[j][i] = 0;
+            for (int p = 0; p < k; p++)
+            {
+                const ElemType* ap = a + (size_t) p * lda + i0;
+                for (int j = 0; j < N; j++)
+                {
+                    const ElemType bpj = b[p * bInnerStride + j * bColStride];
+                    for (int i = 0; i < rows; i++)
+                        sum[j][i] += ap[i] * bpj;
+                }
+            }
+        }
+        else
+        {
+            for (int i = 0; i < rows; i++)
+            {
+                const ElemType* ai = a + (size_t) (i0 + i) * lda;
+                ElemType dot[N] = {};
+                for (int p = 0; p < k; p++)
+                    for (int j = 0; j < N; j++)
+                        dot[j] += ai[p] * b[p * bInnerStride + j * bColStride];
+                for (int j = 0; j < N; j++)
+                    sum[j][i] = dot[j];
+            }
+        }
+        // (with beta == 0, c is not read, as it may be uninitialized)
+        for (int j = 0; j < N; j++)
+        {
+            ElemType* cj = c + (size_t) j * ldc + i0;
+            for (int i = 0; i < rows; i++)
+                cj[i] = beta == 0 ? alpha * sum[j][i] : alpha * sum[j][i] + beta * cj[i];
+        }
+    });
+}
+
+template <class ElemType>
+static void SmallGemm(int m, int n, int k, ElemType alpha, const ElemType* a, int lda, bool transposeA,
+                      const ElemType* b, int ldb, bool transposeB, ElemType beta, ElemType* c, int ldc)
+{
+    const size_t bInnerStride = transposeB ? ldb : 1;
+    const size_t bColStride = transposeB ? 1 : ldb;
+    switch (n)
+    {
+    case 1: SmallGemm<ElemType, 1>(m, k, alpha, a, lda, transposeA, b, bInnerStride, bColStride, beta, c, ldc); break;
+    case 2: SmallGemm<ElemType, 2>(m, k, alpha, a, lda, transposeA, b, bInnerStride, bColStride, beta, c, ldc); break;
+    case 3: SmallGemm<ElemType, 3>(m, k, alpha, a, lda, transposeA, b, bInnerStride, bColStride, beta, c, ldc); break;
+    case 4: SmallGemm<ElemType, 4>(m, k, alpha, a, lda, transposeA, b, bInnerStride, bColStride, beta, c, ldc); break;
+    case 5: SmallGemm<ElemType, 5>(m, k, alpha, a, lda, transposeA, b, bInnerStride, bColStride, beta, c, ldc); break;
+    case 6: SmallGemm<ElemType, 6>(m, k, alpha, a, lda, transposeA, b, bInnerStride, bColStride, beta, c, ldc); break;
+    case 7: SmallGemm<ElemType, 7>(m, k, alpha, a, lda, transposeA, b, bInnerStride, bColStride, beta, c, ldc); break;
+    case 8: SmallGemm<ElemType, 8>(m, k, alpha, a, lda, transposeA, b, bInnerStride, bColStride, beta, c, ldc); break;
+    default: LogicError("SmallGemm: %d columns are too many.", n);
+    }
+}
+
 /// <summary>Matrix-matrix multiply with col-major matrices (a and b may be transposed): c = alpha * op(a) * op(b) + beta*c</summary>
 /// <param name="alpha">Scalar</param>
 /// <param name="a">Input matrix</param>
@@ -4545,6 +5387,12 @@ void CPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix
 
     ldc = (int) c.GetNumRows();
 
+    if (n <= MaxSmallGemmColumns)
+    {
+        SmallGemm(m, n, k, alpha, a.Data(), lda, transposeA, b.Data(), ldb, transposeB, beta, c.Data(), ldc);
+        return;
+    }
+
     if (sizeof(ElemType) == sizeof(double))
     {
 #ifdef USE_ACML
@@ -4564,6 +5412,25 @@ void CPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix
     }
 }
 
+// c_j = alpha * op(a_j) * op(b_j) + beta * c_j for each column j, see Matrix::BatchMatMul(), which validates the dimensions.
+// There is no call overhead to amortize on the CPU, so this is a loop over regular GEMM calls on views of the columns.
+template <class ElemType>
+void CPUMatrix<ElemType>::BatchMatMul(ElemType alpha, const CPUMatrix<ElemType>& a, const size_t aRows, const bool transposeA, const CPUMatrix<ElemType>& b, const size_t bRows, const bool transposeB,
+                                      ElemType beta, CPUMatrix<ElemType>& c)
+{
+    const size_t m = transposeA ? a.GetNumRows() / aRows : aRows;
+    for (size_t j = 0; j < c.GetNumCols(); j++)
+    {
+        CPUMatrix<ElemType> aj = a.ColumnSlice(a.GetNumCols() == 1 ? 0 : j, 1);
+        CPUMatrix<ElemType> bj = b.ColumnSlice(b.GetNumCols() == 1 ? 0 : j, 1);
+        CPUMatrix<ElemType> cj = c.ColumnSlice(j, 1);
+        aj.Reshape(aRows, a.GetNumRows() / aRows);
+        bj.Reshape(bRows, b.GetNumRows() / bRows);
+        cj.Reshape(m, c.GetNumRows() / m);
+        MultiplyAndWeightedAdd(alpha, aj, transposeA, bj, transposeB, beta, cj);
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b,
                                                     ElemType beta, CPUMatrix<ElemType>& c)
@@ -4572,13 +5439,17 @@ void CPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const CPUMat
 
     ElemType f = alpha * a.Get00Element();
     if (beta == 0) // don't even read the memory if beta is 0
-#pragma omp parallel for
-        foreach_coord (i, j, c)
-            c(i, j) = b(i, j) * f;
+        CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
+        {
+            for (long i = 0; i < c.GetNumRows(); i++)
+                c(i, j) = b(i, j) * f;
+        });
     else
-#pragma omp parallel for
-        foreach_coord (i, j, c)
-            c(i, j) = b(i, j) * f + c(i, j) * beta;
+        CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
+        {
+            for (long i = 0; i < c.GetNumRows(); i++)
+                c(i, j) = b(i, j) * f + c(i, j) * beta;
+        });
 }
 
 /* compute singular value decomposition as
@@ -4851,8 +5722,7 @@ void CPUMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>&
     {
         ElemType v = alpha * a(0, 0);
         long m = (long) c.GetNumRows(), n = (long) c.GetNumCols();
-#pragma omp parallel for
-        for (long j = 0; j < n; j++)
+        CPUThreadPool::ParallelFor(0, n, m, [&](long j)
         {
             // four-way unrolling
             for (long i = 0; i < (m & ~3); i += 4)
@@ -4867,7 +5737,7 @@ void CPUMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>&
             {
                 c(i, j) += v;
             }
-        }
+        });
     }
     else if (a.GetNumCols() == 1) // col vector, add it to all columns
     {
@@ -4880,20 +5750,18 @@ void CPUMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>&
         ElemType* cBufPtr = c.Data();
         if (sizeof(ElemType) == sizeof(double))
         {
-#pragma omp parallel for
-            foreach_column (j, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
             {
 #ifdef USE_ACML
                 daxpy(m, alpha, reinterpret_cast<double*>(aBufPtr), 1, reinterpret_cast<double*>(cBufPtr + c.LocateColumn(j)), 1);
 #else
                 cblas_daxpy(m, alpha, reinterpret_cast<double*>(aBufPtr), 1, reinterpret_cast<double*>(cBufPtr + c.LocateColumn(j)), 1);
 #endif
-            }
+            });
         }
         else
         {
-#pragma omp parallel for
-            foreach_column (j, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
             {
 #pragma warning(suppress : 4244)
 #ifdef USE_ACML
@@ -4901,7 +5769,7 @@ void CPUMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>&
 #else
                 cblas_saxpy(m, alpha, reinterpret_cast<float*>(aBufPtr), 1, reinterpret_cast<float*>(cBufPtr + c.LocateColumn(j)), 1);
 #endif
-            }
+            });
         }
     }
     else // row vector, add it to all rows
@@ -4916,20 +5784,18 @@ void CPUMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>&
         ElemType* cBufPtr = c.Data();
         if (sizeof(ElemType) == sizeof(double))
         {
-#pragma omp parallel for
-            foreach_row (i, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumRows(), c.GetNumCols(), [&](long i)
             {
 #ifdef USE_ACML
                 daxpy(n, alpha, reinterpret_cast<double*>(aBufPtr), 1, reinterpret_cast<double*>(cBufPtr + i), m);
 #else
                 cblas_daxpy(n, alpha, reinterpret_cast<double*>(aBufPtr), 1, reinterpret_cast<double*>(cBufPtr + i), m);
 #endif
-            }
+            });
         }
         else
         {
-#pragma omp parallel for
-            foreach_row (i, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumRows(), c.GetNumCols(), [&](long i)
             {
 #pragma warning(suppress : 4244)
 #ifdef USE_ACML
@@ -4937,7 +5803,7 @@ void CPUMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>&
 #else
                 cblas_saxpy(n, alpha, reinterpret_cast<float*>(aBufPtr), 1, reinterpret_cast<float*>(cBufPtr + i), m);
 #endif
-            }
+            });
         }
     }
 }
@@ -5093,6 +5959,137 @@ void CPUMatrix<ElemType>::AssignScaledDifference(const CPUMatrix<ElemType>& alph
 
     AssignScaledDifference(alpha(0, 0), a, b, c);
 }
+
+/// <summary>Fused column-wise log softmax and cross entropy with dense labels, see Matrix::SoftmaxCrossEntropy()</summary>
+/// The max and the sum of the exponentials are updated together (online softmax), so that the logits are read only once.
+template <class ElemType>
+void CPUMatrix<ElemType>::SoftmaxCrossEntropy(const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& crossEntropy)
+{
+    if (logits.IsEmpty())
+        LogicError("SoftmaxCrossEntropy: Input matrix logits is empty.");
+    if (labels.GetNumRows() != logits.GetNumRows() || labels.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("SoftmaxCrossEntropy: labels and logits must have same dimension.");
+
+    const size_t numRows = logits.GetNumRows();
+    const size_t numCols = logits.GetNumCols();
+    logSumExp.RequireSize(1, numCols);
+    crossEntropy.RequireSize(1, numCols);
+
+    CPUThreadPool::ParallelFor(0, (long) numCols, numRows, [&](long j)
+    {
+        const ElemType* x = logits.Data() + j * numRows;
+        const ElemType* y = labels.Data() + j * numRows;
+        ElemType maxV = x[0];
+        ElemType sum = 0, labelDot = 0, labelSum = 0;
+        for (size_t i = 0; i < numRows; i++)
+        {
+            ElemType v = x[i];
+            if (v > maxV)
+            {
+                sum = sum * exp(maxV - v) + 1;
+                maxV = v;
+            }
+            else
+                sum += exp(v - maxV);
+            labelDot += y[i] * v;
+            labelSum += y[i];
+        }
+        ElemType lse = maxV + log(sum);
+        logSumExp(0, j) = lse;
+        crossEntropy(0, j) = lse * labelSum - labelDot;
+    });
+}
+
+/// <summary>gradient += alpha * (softmax(logits) - labels), see Matrix::AddSoftmaxCrossEntropyGradient()</summary>
+template <class ElemType>
+void CPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradient(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, const CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& gradient)
+{
+    if (alpha.GetNumElements() != 1)
+        InvalidArgument("AddSoftmaxCrossEntropyGradient: alpha must be a 1X1 matrix.");
+    if (labels.GetNumRows() != logits.GetNumRows() || labels.GetNumCols() != logits.GetNumCols() ||
+        gradient.GetNumRows() != logits.GetNumRows() || gradient.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradient: labels, logits and gradient must have same dimension.");
+    if (logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradient: logSumExp must be a row vector with one element per column.");
+
+    const ElemType a = alpha(0, 0);
+    const size_t numRows = logits.GetNumRows();
+    CPUThreadPool::ParallelFor(0, (long) logits.GetNumCols(), numRows, [&](long j)
+    {
+        const ElemType* x = logits.Data() + j * numRows;
+        const ElemType* y = labels.Data() + j * numRows;
+        ElemType* g = gradient.Data() + j * numRows;
+        ElemType lse = logSumExp(0, j);
+        for (size_t i = 0; i < numRows; i++)
+            g[i] += a * (exp(x[i] - lse) - y[i]);
+    });
+}
+
+/// <summary>Fused column-wise log softmax and cross entropy with class-index labels, see Matrix::SoftmaxCrossEntropyWithIndices()</summary>
+template <class ElemType>
+void CPUMatrix<ElemType>::SoftmaxCrossEntropyWithIndices(const CPUMatrix<ElemType>& labelIndices, const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& crossEntropy)
+{
+    if (logits.IsEmpty())
+        LogicError("SoftmaxCrossEntropyWithIndices: Input matrix logits is empty.");
+    if (labelIndices.GetNumRows() != 1 || labelIndices.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("SoftmaxCrossEntropyWithIndices: labelIndices must be a row vector with one element per column of logits.");
+
+    const size_t numRows = logits.GetNumRows();
+    const size_t numCols = logits.GetNumCols();
+    logSumExp.RequireSize(1, numCols);
+    crossEntropy.RequireSize(1, numCols);
+
+    CPUThreadPool::ParallelFor(0, (long) numCols, numRows, [&](long j)
+    {
+        const ElemType* x = logits.Data() + j * numRows;
+        ElemType maxV = x[0];
+        ElemType sum = 0;
+        for (size_t i = 0; i < numRows; i++)
+        {
+            ElemType v = x[i];
+            if (v > maxV)
+            {
+                sum = sum * exp(maxV - v) + 1;
+                maxV = v;
+            }
+            else
+                sum += exp(v - maxV);
+        }
+        ElemType lse = maxV + log(sum);
+        ElemType label = labelIndices(0, j);
+        logSumExp(0, j) = lse;
+        crossEntropy(0, j) = (label >= 0 && label < numRows) ? lse - x[(size_t) label] : 0; // (false for NaN)
+    });
+}
+
+/// <summary>gradient += alpha * (softmax(logits) - onehot(labelIndices)), see Matrix::AddSoftmaxCrossEntropyGradientWithIndices()</summary>
+template <class ElemType>
+void CPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradientWithIndices(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labelIndices, const CPUMatrix<ElemType>& logits, const CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& gradient)
+{
+    if (alpha.GetNumElements() != 1)
+        InvalidArgument("AddSoftmaxCrossEntropyGradientWithIndices: alpha must be a 1X1 matrix.");
+    if (labelIndices.GetNumRows() != 1 || labelIndices.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradientWithIndices: labelIndices must be a row vector with one element per column of logits.");
+    if (gradient.GetNumRows() != logits.GetNumRows() || gradient.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradientWithIndices: logits and gradient must have same dimension.");
+    if (logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradientWithIndices: logSumExp must be a row vector with one element per column.");
+
+    const ElemType a = alpha(0, 0);
+    const size_t numRows = logits.GetNumRows();
+    CPUThreadPool::ParallelFor(0, (long) logits.GetNumCols(), numRows, [&](long j)
+    {
+        ElemType label = labelIndices(0, j);
+        if (!(label >= 0 && label < numRows))
+            return;
+        const ElemType* x = logits.Data() + j * numRows;
+        ElemType* g = gradient.Data() + j * numRows;
+        ElemType lse = logSumExp(0, j);
+        for (size_t i = 0; i < numRows; i++)
+            g[i] += a * exp(x[i] - lse);
+        g[(size_t) label] -= a;
+    });
+}
 /// <summary>Matrix-scalar multiply with col-major matrices: c = alpha * a</summary>
 /// <param name="alpha">Scalar</param>
 /// <param name="a">Input matrix</param>
@@ -5215,20 +6212,18 @@ void CPUMatrix<ElemType>::InnerProduct(const CPUMatrix<ElemType>& a, const CPUMa
 		ElemType* bBufPtr = b.Data();
         if (sizeof(ElemType) == sizeof(double))
         {
-#pragma omp parallel for
-            foreach_column (j, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
             {
 #ifdef USE_ACML
                 c(0, j) = (ElemType) ddot(m, reinterpret_cast<double*>(aBufPtr + a.LocateColumn(j)), 1, reinterpret_cast<double*>(bBufPtr + b.LocateColumn(j)), 1);
 #else
                 c(0, j) = (ElemType) cblas_ddot(m, reinterpret_cast<double*>(aBufPtr + a.LocateColumn(j)), 1, reinterpret_cast<double*>(bBufPtr + b.LocateColumn(j)), 1);
 #endif
-            }
+            });
         }
         else
         {
-#pragma omp parallel for
-            foreach_column (j, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
             {
 #pragma warning(suppress : 4244)
 #ifdef USE_ACML
@@ -5236,7 +6231,7 @@ void CPUMatrix<ElemType>::InnerProduct(const CPUMatrix<ElemType>& a, const CPUMa
 #else
                 c(0, j) = (ElemType) cblas_sdot(m, reinterpret_cast<float*>(aBufPtr + a.LocateColumn(j)), 1, reinterpret_cast<float*>(bBufPtr + b.LocateColumn(j)), 1);
 #endif
-            }
+            });
         }
     }
     else
@@ -5247,20 +6242,18 @@ void CPUMatrix<ElemType>::InnerProduct(const CPUMatrix<ElemType>& a, const CPUMa
 		ElemType* bBufPtr = b.Data();
         if (sizeof(ElemType) == sizeof(double))
         {
-#pragma omp parallel for
-            foreach_row (i, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumRows(), c.GetNumCols(), [&](long i)
             {
 #ifdef USE_ACML
                 c(i, 0) = ddot(n, reinterpret_cast<double*>(aBufPtr + i), m, reinterpret_cast<double*>(bBufPtr + i), m);
 #else
                 c(i, 0) = cblas_ddot(n, reinterpret_cast<double*>(aBufPtr + i), m, reinterpret_cast<double*>(bBufPtr + i), m);
 #endif
-            }
+            });
         }
         else
         {
-#pragma omp parallel for
-            foreach_row (i, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumRows(), c.GetNumCols(), [&](long i)
             {
 #pragma warning(suppress : 4244)
 #ifdef USE_ACML
@@ -5268,7 +6261,7 @@ void CPUMatrix<ElemType>::InnerProduct(const CPUMatrix<ElemType>& a, const CPUMa
 #else
                 c(i, 0) = cblas_sdot(n, reinterpret_cast<float*>(aBufPtr + i), m, reinterpret_cast<float*>(bBufPtr + i), m);
 #endif
-            }
+            });
         }
     }
 }
@@ -5319,27 +6312,33 @@ void CPUMatrix<ElemType>::ElementWisePower(ElemType alpha, const CPUMatrix<ElemT
 
     if (alpha == 2)
     {
-#pragma omp parallel for
-        foreach_coord (i, j, c)
+        CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
         {
-            c(i, j) = a(i, j) * a(i, j);
-        }
+            for (long i = 0; i < c.GetNumRows(); i++)
+            {
+                c(i, j) = a(i, j) * a(i, j);
+            }
+        });
     }
     else if (alpha == 3)
     {
-#pragma omp parallel for
-        foreach_coord (i, j, c)
+        CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
         {
-            c(i, j) = a(i, j) * a(i, j) * a(i, j);
-        }
+            for (long i = 0; i < c.GetNumRows(); i++)
+            {
+                c(i, j) = a(i, j) * a(i, j) * a(i, j);
+            }
+        });
     }
     else
     {
-#pragma omp parallel for
-        foreach_coord (i, j, c)
+        CPUThreadPool::ParallelFor(0, c.GetNumCols(), c.GetNumRows(), [&](long j)
         {
-            c(i, j) = pow(a(i, j), alpha);
-        }
+            for (long i = 0; i < c.GetNumRows(); i++)
+            {
+                c(i, j) = pow(a(i, j), alpha);
+            }
+        });
     }
 }
 
@@ -5584,20 +6583,18 @@ void CPUMatrix<ElemType>::InnerProductWithShiftNeg(const CPUMatrix<ElemType>& a,
         ElemType* bBufPtr = b.Data();
         if (sizeof(ElemType) == sizeof(double))
         {
-#pragma omp parallel for
-            foreach_row (i, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumRows(), c.GetNumCols(), [&](long i)
             {
 #ifdef USE_ACML
                 c(i, 0) = (ElemType) ddot(n, reinterpret_cast<double*>(aBufPtr + i), m, reinterpret_cast<double*>(bBufPtr + i), m);
 #else
                 c(i, 0) = (ElemType) cblas_ddot(n, reinterpret_cast<double*>(aBufPtr + i), m, reinterpret_cast<double*>(bBufPtr + i), m);
 #endif
-            }
+            });
         }
         else
         {
-#pragma omp parallel for
-            foreach_row (i, c)
+            CPUThreadPool::ParallelFor(0, c.GetNumRows(), c.GetNumCols(), [&](long i)
             {
 #pragma warning(suppress : 4244)
 #ifdef USE_ACML
@@ -5605,7 +6602,7 @@ void CPUMatrix<ElemType>::InnerProductWithShiftNeg(const CPUMatrix<ElemType>& a,
 #else
                 c(i, 0) = cblas_sdot(n, reinterpret_cast<float*>(aBufPtr + i), m, reinterpret_cast<float*>(bBufPtr + i), m);
 #endif
-            }
+            });
         }
     }
 }
@@ -5734,14 +6731,149 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignElementProductOfWithShift(const
 
     // long m = (long)GetNumRows(), n = (long)GetNumCols();  // a and b are of size (1,n)
     long n = (long) GetNumCols(); // a and b are of size (1,n)
-#pragma omp parallel for
-    for (long j = 0; j < n; j++)
+    CPUThreadPool::ParallelFor(0, n, 1, [&](long j)
     {
         us(0, j) = a(0, j) * b(0, (j + shift) % n);
-    }
+    });
     return *this;
 }
 
+// Cosine similarity of each query column with its own and negNumber shifted document columns, see Matrix::CosDistanceWithNegativeSamples().
+// Column j of d is scored against query (j - s) mod n in row i of c, s = 0 for i = 0 and shift + i - 1 otherwise.
+template <class ElemType>
+void CPUMatrix<ElemType>::CosDistanceWithNegativeSamples(const CPUMatrix<ElemType>& q, const CPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                         CPUMatrix<ElemType>& invNormQ, CPUMatrix<ElemType>& invNormD, CPUMatrix<ElemType>& c)
+{
+    const size_t m = q.GetNumRows();
+    const size_t n = q.GetNumCols();
+    if (d.GetNumRows() != m || d.GetNumCols() != n)
+        InvalidArgument("CosDistanceWithNegativeSamples: The query and document matrices must have the same dimensions.");
+
+    invNormQ.RequireSize(1, n);
+    invNormD.RequireSize(1, n);
+    c.RequireSize(negNumber + 1, n);
+    CPUThreadPool::ParallelFor(0, n, 2 * m, [&](long j)
+    {
+        ElemType sq = 0, sd = 0;
+        for (size_t r = 0; r < m; r++)
+        {
+            sq += q(r, j) * q(r, j);
+            sd += d(r, j) * d(r, j);
+        }
+        invNormQ(0, j) = 1 / sqrt(sq);
+        invNormD(0, j) = 1 / sqrt(sd);
+    });
+    CPUThreadPool::ParallelFor(0, n, (negNumber + 1) * m, [&](long j)
+    {
+        for (size_t i = 0; i <= negNumber; i++)
+        {
+            const size_t k = i == 0 ? j : (j + shift + i - 1) % n;
+            ElemType dot = 0;
+            for (size_t r = 0; r < m; r++)
+                dot += q(r, j) * d(r, k);
+            c(i, j) = dot * invNormQ(0, j) * invNormD(0, k);
+        }
+    });
+}
+
+// Adds the gradient of CosDistanceWithNegativeSamples() with respect to q (wrtQuery) or d to grad. Each thread owns a column of grad:
+// for q the negNumber + 1 documents it was scored against, for d the queries that were scored against it.
+template <class ElemType>
+void CPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(bool wrtQuery, const CPUMatrix<ElemType>& q, const CPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                                 const CPUMatrix<ElemType>& invNormQ, const CPUMatrix<ElemType>& invNormD,
+                                                                 const CPUMatrix<ElemType>& c, const CPUMatrix<ElemType>& cGrad, CPUMatrix<ElemType>& grad)
+{
+    const size_t m = q.GetNumRows();
+    const size_t n = q.GetNumCols();
+    if (grad.GetNumRows() != m || grad.GetNumCols() != n)
+        InvalidArgument("CosDistanceWithNegativeSamplesGradient: The gradient must have the dimensions of the inputs.");
+
+    const CPUMatrix<ElemType>& self = wrtQuery ? q : d;
+    const CPUMatrix<ElemType>& other = wrtQuery ? d : q;
+    const CPUMatrix<ElemType>& invNormSelf = wrtQuery ? invNormQ : invNormD;
+    const CPUMatrix<ElemType>& invNormOther = wrtQuery ? invNormD : invNormQ;
+    CPUThreadPool::ParallelFor(0, n, (negNumber + 1) * m, [&](long j)
+    {
+        for (size_t i = 0; i <= negNumber; i++)
+        {
+            const size_t s = i == 0 ? 0 : (shift + i - 1) % n;
+            const size_t k = wrtQuery ? (j + s) % n : (j + n - s) % n; // the other side of the pair
+            const size_t col = wrtQuery ? j : k;                      // the column of c that scores the pair
+            const ElemType g = cGrad(i, col);
+            const ElemType alpha = g * invNormSelf(0, j) * invNormOther(0, k);
+            const ElemType beta = g * c(i, col) * invNormSelf(0, j) * invNormSelf(0, j);
+            for (size_t r = 0; r < m; r++)
+                grad(r, j) += alpha * other(r, k) - beta * self(r, j);
+        }
+    });
+}
+
+// Gaussian mixture log-likelihood of each sample, see Matrix::GMMLogLikelihood(). A thread per sample does the squared distances,
+// the component log-likelihoods and the log-sum-exp over the components; the log-softmax of the prior cancels out of the posteriors.
+template <class ElemType>
+void CPUMatrix<ElemType>::GMMLogLikelihood(const CPUMatrix<ElemType>& unnormedPrior, const CPUMatrix<ElemType>& means, const CPUMatrix<ElemType>& logStdDevs, const CPUMatrix<ElemType>& features,
+                                           const CPUMatrix<ElemType>& products, const CPUMatrix<ElemType>& meanSquaredNorms,
+                                           CPUMatrix<ElemType>& logLikelihood, CPUMatrix<ElemType>& posterior, CPUMatrix<ElemType>& normedDeviation)
+{
+    const size_t numComponents = unnormedPrior.GetNumRows();
+    const size_t featureDim = features.GetNumRows();
+    const size_t numSamples = features.GetNumCols();
+    const bool sharedMeans = means.GetNumCols() == 1;
+    if (sharedMeans && (products.GetNumRows() != numComponents || products.GetNumCols() != numSamples || meanSquaredNorms.GetNumElements() != numComponents))
+        InvalidArgument("GMMLogLikelihood: The products with the shared means do not match the features.");
+
+    logLikelihood.RequireSize(1, numSamples);
+    posterior.RequireSize(numComponents, numSamples);
+    normedDeviation.RequireSize(numComponents, numSamples);
+    const ElemType logNormalizer = (ElemType) (featureDim * 0.5 * log(TWO_PI));
+    CPUThreadPool::ParallelFor(0, numSamples, numComponents * (sharedMeans ? 1 : featureDim), [&](long t)
+    {
+        const size_t priorCol = unnormedPrior.GetNumCols() == 1 ? 0 : t;
+        const size_t stdDevCol = logStdDevs.GetNumCols() == 1 ? 0 : t;
+        ElemType featureSquaredNorm = 0;
+        if (sharedMeans)
+            for (size_t r = 0; r < featureDim; r++)
+                featureSquaredNorm += features(r, t) * features(r, t);
+
+        // log of the unnormalized prior times the component likelihood
+        ElemType maxJoint = -std::numeric_limits<ElemType>::infinity();
+        ElemType maxPrior = -std::numeric_limits<ElemType>::infinity();
+        for (size_t c = 0; c < numComponents; c++)
+        {
+            ElemType dist;
+            if (sharedMeans)
+                dist = max((ElemType) 0, featureSquaredNorm - 2 * products(c, t) + meanSquaredNorms.Data()[c]); // the expansion may round below 0
+            else
+            {
+                dist = 0;
+                for (size_t r = 0; r < featureDim; r++)
+                {
+                    ElemType diff = features(r, t) - means(c * featureDim + r, t);
+                    dist += diff * diff;
+                }
+            }
+            const ElemType logStdDev = logStdDevs(c, stdDevCol);
+            const ElemType normed = dist * exp(-2 * logStdDev);
+            normedDeviation(c, t) = normed;
+            const ElemType joint = unnormedPrior(c, priorCol) - normed / 2 - featureDim * logStdDev - logNormalizer;
+            posterior(c, t) = joint;
+            maxJoint = max(maxJoint, joint);
+            maxPrior = max(maxPrior, unnormedPrior(c, priorCol));
+        }
+
+        ElemType sumJoint = 0, sumPrior = 0;
+        for (size_t c = 0; c < numComponents; c++)
+        {
+            sumJoint += exp(posterior(c, t) - maxJoint);
+            sumPrior += exp(unnormedPrior(c, priorCol) - maxPrior);
+        }
+        const ElemType logSumJoint = maxJoint + log(sumJoint);
+        for (size_t c = 0; c < numComponents; c++)
+            posterior(c, t) = exp(posterior(c, t) - logSumJoint);
+        logLikelihood(0, t) = logSumJoint - (maxPrior + log(sumPrior));
+    });
+}
+
 #pragma endregion Static BLAS Functions
 
 // 'double' version of LogAdd
@@ -5780,11 +6912,10 @@ void CPUMatrix<ElemType>::RCRFBackwardCompute(const CPUMatrix<ElemType>& alpha,
 
     for (int t = iNumPos - 1; t >= 0; t--)
     {
-#pragma omp parallel for
-        for (int k = 0; k < iNumLab; k++)
+        CPUThreadPool::ParallelFor(0, iNumLab, iNumLab, [&](long k)
         {
             _rcrfBackwardCompute(t, k, alpha, beta, pair_scores);
-        }
+        });
     }
 };
 
@@ -5851,11 +6982,10 @@ void CPUMatrix<ElemType>::RCRFTransGrdCompute(const CPUMatrix<ElemType>& lbls,
         if (tPos > 0)
             a = alpha.ColumnSlice(tPos - 1, 1);
 
-#pragma omp parallel for
-        for (int i = 0; i < iNumLab; i++)
+        CPUThreadPool::ParallelFor(0, iNumLab, iNumLab, [&](long i)
         {
             _rcrfTransGrdCompute(i, lbls, alpha, beta, pair_scores, grd, tPos);
-        }
+        });
 
         // transition score
         int i = -1;
@@ -5960,6 +7090,237 @@ void CPUMatrix<ElemType>::_rcrfTransGrdCompute(size_t i,
         }
     }
 };
+// the label of a CRF frame: the first row that is not zero, or -1 if there is none
+template <class ElemType>
+static int CRFLabelOf(const CPUMatrix<ElemType>& lbls, size_t col)
+{
+    for (size_t k = 0; k < lbls.GetNumRows(); k++)
+        if (lbls(k, col) != 0)
+            return (int) k;
+    return -1;
+}
+
+// Forward-backward of a linear-chain CRF over each sequence of a minibatch, in log space.
+// Frame t of the sequence in parallel-sequence slot s is column t * numParallelSequences + s. As in the single-sequence
+// version, the frame before the first is taken to have the first frame's label.
+//  - alpha: forward scores, alpha(k, t) = pos(k, t) + logsum_j (alpha(j, t-1) + pair(k, j))
+//  - beta: log posteriors of the labels, postProb = exp(beta); columns not covered by a sequence are zero in postProb
+//  - sequenceScores(0, q): the negative log likelihood of the labels of sequence q
+template <class ElemType>
+void CPUMatrix<ElemType>::CRFForwardBackward(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& posScores, const CPUMatrix<ElemType>& pairScores,
+                                             size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                             CPUMatrix<ElemType>& alpha, CPUMatrix<ElemType>& beta, CPUMatrix<ElemType>& postProb, CPUMatrix<ElemType>& sequenceScores)
+{
+    const size_t numLabels = posScores.GetNumRows();
+    const size_t numCols = posScores.GetNumCols();
+    if (lbls.GetNumRows() != numLabels || lbls.GetNumCols() != numCols || pairScores.GetNumRows() != numLabels || pairScores.GetNumCols() != numLabels)
+        InvalidArgument("CRFForwardBackward: The dimensions of the labels, position and pair scores do not match.");
+
+    alpha.RequireSize(numLabels, numCols);
+    beta.RequireSize(numLabels, numCols);
+    postProb.RequireSize(numLabels, numCols);
+    postProb.SetValue(0);
+    sequenceScores.RequireSize(1, sequences.size());
+
+    for (const auto& seq : sequences)
+        if (seq.s >= numParallelSequences || seq.tBegin >= seq.tEnd || seq.tEnd * numParallelSequences > numCols)
+            InvalidArgument("CRFForwardBackward: A sequence does not fit into the minibatch.");
+
+    CPUThreadPool::ParallelFor(0, sequences.size(), numLabels * numLabels * numCols / max(sequences.size(), (size_t) 1), [&](long q)
+    {
+        const auto& seq = sequences[q];
+        auto col = [&](size_t t) { return t * numParallelSequences + seq.s; };
+
+        const int firstLabel = CRFLabelOf(lbls, col(seq.tBegin));
+        for (size_t t = seq.tBegin; t < seq.tEnd; t++)
+        {
+            const size_t c = col(t);
+            for (size_t k = 0; k < numLabels; k++)
+            {
+                ElemType a;
+                if (t == seq.tBegin)
+                    a = firstLabel >= 0 ? pairScores(k, firstLabel) : (ElemType) LZERO;
+                else
+                {
+                    a = (ElemType) LZERO;
+                    for (size_t j = 0; j < numLabels; j++)
+                        a = (ElemType) LogAddD(a, alpha(j, c - numParallelSequences) + pairScores(k, j));
+                }
+                alpha(k, c) = a + posScores(k, c);
+            }
+        }
+
+        const size_t lastCol = col(seq.tEnd - 1);
+        ElemType logZ = (ElemType) LZERO;
+        for (size_t j = 0; j < numLabels; j++)
+            logZ = (ElemType) LogAddD(logZ, alpha(j, lastCol));
+
+        std::vector<ElemType> zeta(numLabels);
+        for (size_t t = seq.tEnd; t-- > seq.tBegin;)
+        {
+            const size_t c = col(t);
+            if (c == lastCol)
+            {
+                for (size_t k = 0; k < numLabels; k++)
+                    beta(k, c) = alpha(k, c) - logZ;
+            }
+            else
+            {
+                for (size_t j = 0; j < numLabels; j++)
+                {
+                    ElemType z = (ElemType) LZERO;
+                    for (size_t m = 0; m < numLabels; m++)
+                        z = (ElemType) LogAddD(z, alpha(m, c) + pairScores(j, m));
+                    zeta[j] = z;
+                }
+                for (size_t k = 0; k < numLabels; k++)
+                {
+                    ElemType b = (ElemType) LZERO;
+                    for (size_t j = 0; j < numLabels; j++)
+                        b = (ElemType) LogAddD(b, beta(j, c + numParallelSequences) + alpha(k, c) + pairScores(j, k) - zeta[j]);
+                    beta(k, c) = b;
+                }
+            }
+            for (size_t k = 0; k < numLabels; k++)
+                postProb(k, c) = exp(beta(k, c));
+        }
+
+        // score of the given label path, including the transition into the first frame like the forward recursion
+        ElemType score = 0;
+        int prevLabel = firstLabel;
+        for (size_t t = seq.tBegin; t < seq.tEnd; t++)
+        {
+            const int label = CRFLabelOf(lbls, col(t));
+            if (label >= 0)
+            {
+                score += posScores(label, col(t));
+                if (prevLabel >= 0)
+                    score += pairScores(label, prevLabel);
+            }
+            prevLabel = label;
+        }
+        sequenceScores(0, q) = logZ - score;
+    });
+}
+
+// Adds the expected label transition counts minus the observed ones of all sequences to grd(j, i), j following i. No locking,
+// since every thread owns a row of grd.
+template <class ElemType>
+void CPUMatrix<ElemType>::CRFTransitionGradient(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& posScores, const CPUMatrix<ElemType>& pairScores,
+                                                size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                                const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& beta, CPUMatrix<ElemType>& grd)
+{
+    const size_t numLabels = posScores.GetNumRows();
+    if (grd.GetNumRows() != numLabels || grd.GetNumCols() != numLabels)
+        InvalidArgument("CRFTransitionGradient: The gradient must be a square matrix of the number of labels.");
+
+    CPUThreadPool::ParallelFor(0, numLabels, numLabels * posScores.GetNumCols(), [&](long j)
+    {
+        for (const auto& seq : sequences)
+        {
+            const int firstLabel = CRFLabelOf(lbls, seq.tBegin * numParallelSequences + seq.s);
+            for (size_t t = seq.tBegin; t < seq.tEnd; t++)
+            {
+                const size_t c = t * numParallelSequences + seq.s;
+                // logsum_i (alpha(i, t-1) + pair(j, i)), as computed by the forward recursion
+                const ElemType zeta = alpha(j, c) - posScores(j, c);
+                const bool isLabel = lbls(j, c) != 0;
+                if (t == seq.tBegin)
+                {
+                    if (firstLabel >= 0)
+                        grd(j, firstLabel) += exp(pairScores(j, firstLabel) - zeta + beta(j, c)) - (isLabel ? 1 : 0);
+                }
+                else
+                {
+                    for (size_t i = 0; i < numLabels; i++)
+                    {
+                        grd(j, i) += exp(alpha(i, c - numParallelSequences) + pairScores(j, i) - zeta + beta(j, c));
+                        if (isLabel && lbls(i, c - numParallelSequences) != 0)
+                            grd(j, i) -= 1;
+                    }
+                }
+            }
+        }
+    });
+}
+
+// Viterbi decoding of each sequence of a minibatch. The labels only constrain the path: it starts with the label of the
+// first frame and ends with the label of the last, if those are given. decodedPath is one-hot over the best path, and zero
+// in columns not covered by a sequence. backtrace(k, t) is the best label at t-1 given label k at t.
+template <class ElemType>
+void CPUMatrix<ElemType>::CRFViterbiDecode(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& posScores, const CPUMatrix<ElemType>& pairScores,
+                                           size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                           CPUMatrix<ElemType>& alpha, CPUMatrix<ElemType>& backtrace, CPUMatrix<ElemType>& decodedPath)
+{
+    const size_t numLabels = posScores.GetNumRows();
+    const size_t numCols = posScores.GetNumCols();
+    if (lbls.GetNumRows() != numLabels || lbls.GetNumCols() != numCols || pairScores.GetNumRows() != numLabels || pairScores.GetNumCols() != numLabels)
+        InvalidArgument("CRFViterbiDecode: The dimensions of the labels, position and pair scores do not match.");
+
+    alpha.RequireSize(numLabels, numCols);
+    backtrace.RequireSize(numLabels, numCols);
+    decodedPath.RequireSize(numLabels, numCols);
+    decodedPath.SetValue(0);
+
+    for (const auto& seq : sequences)
+        if (seq.s >= numParallelSequences || seq.tBegin >= seq.tEnd || seq.tEnd * numParallelSequences > numCols)
+            InvalidArgument("CRFViterbiDecode: A sequence does not fit into the minibatch.");
+
+    CPUThreadPool::ParallelFor(0, sequences.size(), numLabels * numLabels * numCols / max(sequences.size(), (size_t) 1), [&](long q)
+    {
+        const auto& seq = sequences[q];
+        auto col = [&](size_t t) { return t * numParallelSequences + seq.s; };
+
+        const int startLabel = CRFLabelOf(lbls, col(seq.tBegin));
+        const int endLabel = CRFLabelOf(lbls, col(seq.tEnd - 1));
+        for (size_t t = seq.tBegin; t < seq.tEnd; t++)
+        {
+            const size_t c = col(t);
+            for (size_t k = 0; k < numLabels; k++)
+            {
+                ElemType best;
+                size_t from = 0;
+                if (t == seq.tBegin)
+                {
+                    best = (startLabel < 0 || k == (size_t) startLabel) ? 0 : (ElemType) LZERO;
+                    from = max(startLabel, 0);
+                }
+                else
+                {
+                    best = (ElemType) LZERO;
+                    for (size_t j = 0; j < numLabels; j++)
+                    {
+                        ElemType v = alpha(j, c - numParallelSequences) + pairScores(k, j);
+                        if (v > best)
+                        {
+                            best = v;
+                            from = j;
+                        }
+                    }
+                }
+                alpha(k, c) = best + posScores(k, c);
+                backtrace(k, c) = (ElemType) from;
+            }
+        }
+
+        // trace back from the end label, or from the best last label if none is given
+        const size_t lastCol = col(seq.tEnd - 1);
+        size_t label = max(endLabel, 0);
+        if (endLabel < 0)
+        {
+            for (size_t k = 1; k < numLabels; k++)
+                if (alpha(k, lastCol) > alpha(label, lastCol))
+                    label = k;
+        }
+        for (size_t t = seq.tEnd; t-- > seq.tBegin;)
+        {
+            decodedPath(label, col(t)) = 1;
+            if (t > seq.tBegin)
+                label = (size_t) backtrace(label, col(t));
+        }
+    });
+}
+
 template <class ElemType>
 CPUMatrix<ElemType>& CPUMatrix<ElemType>::DropFrame(const CPUMatrix<ElemType>& label, const CPUMatrix<ElemType>& gamma, const ElemType& threshhold)
 {
@@ -6027,6 +7388,7 @@ int CPUMatrix<ElemType>::SetNumThreads(int numThreads)
     openblas_set_num_threads(numThreads);
 #endif
 #endif
+    CPUThreadPool::SetNumThreads(numThreads);
     return numThreads;
 }
 
@@ -6119,20 +7481,22 @@ struct TensorOpIteration<ElemType, OPFN, 3, true /*vectorizable*/, -1 /*no reduc
         size_t K = regularOpDims[0];
         // special-case beta and alpha to allow the compiler to short-circuit it
         if (beta != 0)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            CPUThreadPool::ParallelFor(0, (int) K, 1, [&](long k)
+            {
                 TensorOpIteration<ElemType, OPFN, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            });
         else if (alpha != 1)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            CPUThreadPool::ParallelFor(0, (int) K, 1, [&](long k)
+            {
                 TensorOpIteration<ElemType, OPFN, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            });
         else
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            CPUThreadPool::ParallelFor(0, (int) K, 1, [&](long k)
+            {
                 TensorOpIteration<ElemType, OPFN, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, 1, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            });
         // TODO: According to Amit, the VS compiler is not able to vectorize into lambdas. Solution: change the lambda to take an N, or to implement the loop inside (with 1 element by default).
-        // TODO: The signedness of k (required for omp) causes an extra sign-extend.
-        // TODO: OMP adds LOTS of overhead. Do we need a guard, a min size when to use it?
+        // TODO: The signedness of k causes an extra sign-extend.
     }
 };
 // and unary
@@ -6148,17 +7512,20 @@ struct TensorOpIteration<ElemType, OPFN, 2, true /*vectorizable*/, -1 /*no reduc
         size_t K = regularOpDims[0];
         // special-case beta and alpha to allow the compiler to short-circuit it
         if (beta != 0)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            CPUThreadPool::ParallelFor(0, (int) K, 1, [&](long k)
+            {
                 TensorOpIteration<ElemType, OPFN, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            });
         else if (alpha != 1)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            CPUThreadPool::ParallelFor(0, (int) K, 1, [&](long k)
+            {
                 TensorOpIteration<ElemType, OPFN, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            });
         else
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            CPUThreadPool::ParallelFor(0, (int) K, 1, [&](long k)
+            {
                 TensorOpIteration<ElemType, OPFN, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 2>{pa + k, pb + k}, 1, opfn, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+            });
     }
 };
 
@@ -6244,6 +7611,184 @@ static void TensorOpWithFn(ElemType beta, array<ElemType*, N> pointers, ElemType
     }
 }
 
+// -----------------------------------------------------------------------
+// explicitly vectorized fast path (CPUVectorizedTensorOps.h)
+// -----------------------------------------------------------------------
+
+// Handles the case that all operands are contiguous (stride 1) in the innermost dimension, with
+//  - no reduction, and at most one further (regular) dimension; or
+//  - exactly one reduction dimension, which is the contiguous one, and at most one regular dimension.
+// Returns false if the op has no vectorized kernel or the layout does not match; the caller then uses the generic loops.
+template <class ElemType, size_t N>
+static bool TensorOpVectorized(ElemType beta, array<ElemType*, N> pointers, ElemType alpha, ElementWiseOperator op,
+                               const array<size_t, N>& offsets,
+                               const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides,
+                               const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    const size_t blockSize = 16384; // elements processed per parallel task, such that OpenMP overhead does not dominate small ops
+    for (size_t i = 0; i < N; i++)
+        pointers[i] += offsets[i];
+
+    if (reducingOpDims.size() == 0)
+    {
+        if (regularOpDims.size() < 1 || regularOpDims.size() > 2)
+            return false;
+        for (size_t i = 0; i < N; i++)
+            if (regularStrides[i][0] != 1)
+                return false;
+        auto kernel = GetCPUVectorizedTensorOpKernel<ElemType>(op, N);
+        if (!kernel)
+            return false;
+
+        const size_t n = regularOpDims[0];
+        const size_t numRows = regularOpDims.size() > 1 ? regularOpDims[1] : 1;
+        if (numRows == 1) // single contiguous range: split it into blocks
+        {
+            const int numBlocks = (int) ((n + blockSize - 1) / blockSize);
+#pragma omp parallel for if (numBlocks > 1)
+            for (int b = 0; b < numBlocks; b++)
+            {
+                const size_t begin = b * blockSize;
+                array<ElemType*, N> blockPointers;
+                for (size_t i = 0; i < N; i++)
+                    blockPointers[i] = pointers[i] + begin;
+                kernel(beta, blockPointers.data(), alpha, min(blockSize, n - begin));
+            }
+        }
+        else // one contiguous range per row
+        {
+#pragma omp parallel for if (n * numRows > blockSize)
+            for (int j = 0; j < (int) numRows; j++)
+            {
+                array<ElemType*, N> rowPointers;
+                for (size_t i = 0; i < N; i++)
+                    rowPointers[i] = pointers[i] + j * regularStrides[i][1];
+                kernel(beta, rowPointers.data(), alpha, n);
+            }
+        }
+        return true;
+    }
+    else if (reducingOpDims.size() == 1)
+    {
+        if (regularOpDims.size() > 1)
+            return false;
+        for (size_t i = 0; i < N - 1; i++) // (the output does not move along the reduction dimension)
+            if (reducingStrides[i][0] != 1)
+                return false;
+        auto kernel = GetCPUVectorizedReductionKernel<ElemType>(op, N);
+        if (!kernel)
+            return false;
+
+        const size_t n = reducingOpDims[0];
+        const size_t numOutputs = regularOpDims.size() > 0 ? regularOpDims[0] : 1;
+        // compute the sum for output j, then scale and combine the same way as TensorOpIteration<..., -1>
+        auto reduce = [&](size_t j, size_t begin, size_t count) -> double
+        {
+            array<ElemType*, N> rowPointers;
+            for (size_t i = 0; i < N; i++)
+                rowPointers[i] = pointers[i] + (regularOpDims.size() > 0 ? j * regularStrides[i][0] : 0) + begin;
+            return kernel(rowPointers.data(), count);
+        };
+        auto store = [&](size_t j, double sum)
+        {
+            ElemType* pout = pointers[N - 1] + (regularOpDims.size() > 0 ? j * regularStrides[N - 1][0] : 0);
+            ElemType val = (ElemType) sum;
+            val *= alpha;
+            if (beta != 0)
+                val += beta * *pout;
+            *pout = val;
+        };
+        if (numOutputs == 1) // a single large sum: partial sums per block, combined in fixed order for reproducibility
+        {
+            const int numBlocks = (int) ((n + blockSize - 1) / blockSize);
+            vector<double> partialSums(numBlocks);
+#pragma omp parallel for if (numBlocks > 1)
+            for (int b = 0; b < numBlocks; b++)
+                partialSums[b] = reduce(0, b * blockSize, min(blockSize, n - b * blockSize));
+            double sum = 0;
+            for (double partialSum : partialSums)
+                sum += partialSum;
+            store(0, sum);
+        }
+        else
+        {
+#pragma omp parallel for if (n * numOutputs > blockSize)
+            for (int j = 0; j < (int) numOutputs; j++)
+                store(j, reduce(j, 0, n));
+        }
+        return true;
+    }
+    return false;
+}
+
+// -----------------------------------------------------------------------
+// cache-blocked copy that moves the contiguous axis (e.g. TransposeDimensions)
+// -----------------------------------------------------------------------
+
+// Copies in tiles of the (outInnerDim, inInnerDim) plane (see GetTensorTransposeLayout()), so that both the strided reads
+// or writes of a tile stay in cache. Returns false if the layout does not call for it.
+template <class ElemType>
+static bool TensorCopyTransposed(ElemType beta, array<ElemType*, 2> pointers, ElemType alpha, const array<size_t, 2>& offsets,
+                                 const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, 2>& regularStrides)
+{
+    const size_t tileDim = 32; // a 32 x 32 tile of input and output fits into L1
+    size_t outInnerDim, inInnerDim;
+    if (!GetTensorTransposeLayout(regularOpDims, regularStrides[0], regularStrides[1], tileDim / 2, outInnerDim, inInnerDim))
+        return false;
+
+    const ElemType* pa = pointers[0] + offsets[0];
+    ElemType* pb = pointers[1] + offsets[1];
+
+    // the remaining dimensions
+    size_t batchDims[2] = {1, 1};
+    ptrdiff_t inBatchStrides[2] = {0, 0};
+    ptrdiff_t outBatchStrides[2] = {0, 0};
+    for (size_t k = 0, b = 0; k < regularOpDims.size(); k++)
+    {
+        if (k == outInnerDim || k == inInnerDim)
+            continue;
+        batchDims[b] = regularOpDims[k];
+        inBatchStrides[b] = regularStrides[0][k];
+        outBatchStrides[b] = regularStrides[1][k];
+        b++;
+    }
+    const size_t ni = regularOpDims[outInnerDim];
+    const size_t nj = regularOpDims[inInnerDim];
+    const ptrdiff_t inStridei = regularStrides[0][outInnerDim];
+    const ptrdiff_t outStridej = regularStrides[1][inInnerDim];
+
+    // one task per column of tiles (fixed j range) and batch entry
+    const size_t tilesj = (nj + tileDim - 1) / tileDim;
+    const int numTasks = (int) (tilesj * batchDims[0] * batchDims[1]);
+#pragma omp parallel for if (ni * nj * batchDims[0] * batchDims[1] > 16384)
+    for (int t = 0; t < numTasks; t++)
+    {
+        const size_t batch = t / tilesj;
+        const ElemType* pat = pa + (batch % batchDims[0]) * inBatchStrides[0] + (batch / batchDims[0]) * inBatchStrides[1];
+        ElemType* pbt = pb + (batch % batchDims[0]) * outBatchStrides[0] + (batch / batchDims[0]) * outBatchStrides[1];
+        const size_t jBegin = (t % tilesj) * tileDim;
+        const size_t jEnd = min(jBegin + tileDim, nj);
+        for (size_t iBegin = 0; iBegin < ni; iBegin += tileDim)
+        {
+            const size_t iEnd = min(iBegin + tileDim, ni);
+            for (size_t j = jBegin; j < jEnd; j++)
+            {
+                for (size_t i = iBegin; i < iEnd; i++)
+                {
+                    // same arithmetic as TensorOpIteration<..., -1>
+                    ElemType val = pat[i * inStridei + j];
+                    val *= alpha;
+                    ElemType* pout = pbt + i + j * outStridej;
+                    if (beta != 0)
+                        val += beta * *pout;
+                    *pout = val;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 // -----------------------------------------------------------------------
 // entry points from Matrix.cpp; also map op to a lambda
 // -----------------------------------------------------------------------
@@ -6269,6 +7814,10 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
     array<ElemType*, 2> pointers = {a.Data(), Data()};
+    if (op == ElementWiseOperator::opCopy && reducingOpDims.empty() && TensorCopyTransposed(beta, pointers, alpha, offsets, regularOpDims, regularStrides))
+        return;
+    if (TensorOpVectorized(beta, pointers, alpha, op, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides))
+        return;
     switch (op)
     {
         ForAllUnaryOps(CaseUnaryTensorOp);
@@ -6297,6 +7846,8 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
     array<ElemType*, 3> pointers = {a.Data(), b.Data(), Data()};
+    if (TensorOpVectorized(beta, pointers, alpha, op, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides))
+        return;
     switch (op)
     {
         ForAllBinaryOps(CaseBinaryTensorOp);
@@ -6325,6 +7876,8 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
     array<ElemType*, 4> pointers = {a.Data(), b.Data(), c.Data(), Data()};
+    if (TensorOpVectorized(beta, pointers, alpha, op, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides))
+        return;
     switch (op)
     {
         ForAllTernaryOps(CaseTernaryTensorOp);
@@ -6333,6 +7886,30 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
     }
 }
 
+// fused element-wise op over contiguous ranges (see FusedElementwiseProgram); arguments are validated by Matrix::FusedElementwiseOp()
+template <class ElemType>
+void CPUMatrix<ElemType>::FusedElementwiseOp(ElemType beta, const std::vector<const CPUMatrix<ElemType>*>& inputs, const std::vector<size_t>& offsets, size_t numElements,
+                                             const FusedElementwiseProgram& program, ElemType alpha)
+{
+    const ElemType* inputPointers[FusedElementwiseProgram::MaxInputs];
+    const size_t numInputs = inputs.size();
+    for (size_t k = 0; k < numInputs; k++)
+        inputPointers[k] = inputs[k]->Data() + offsets[k];
+    ElemType* out = Data() + offsets[numInputs];
+
+    const long N = (long) numElements;
+    CPUThreadPool::ParallelFor(0, N, 1, [&](long i)
+    {
+        ElemType regs[FusedElementwiseProgram::MaxRegisters];
+        for (size_t k = 0; k < numInputs; k++)
+            regs[k] = inputPointers[k][i];
+        ElemType val = alpha * EvaluateFusedElementwiseProgram(program, regs);
+        if (beta != 0)
+            val += beta * out[i];
+        out[i] = val;
+    });
+}
+
 // =======================================================================
 // explicit instantiations
 // =======================================================================
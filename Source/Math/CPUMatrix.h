@@ -92,6 +92,14 @@ public:
 
     ElemType Adagrad(CPUMatrix<ElemType>& gradients, const bool needAveMultiplier);
     void FSAdagrad(CPUMatrix<ElemType>& gradients, CPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul);
+    // see Matrix<ElemType>::MultiTensorNormalGrad()
+    static void MultiTensorNormalGrad(const std::vector<CPUMatrix<ElemType>*>& smoothedGradients,
+                                      const std::vector<CPUMatrix<ElemType>*>& gradients,
+                                      const std::vector<CPUMatrix<ElemType>*>& functionValues,
+                                      const std::vector<ElemType>& learnRatesPerSample,
+                                      const ElemType momentum, const bool useNesterovMomentum,
+                                      const ElemType clippingThreshold, const bool clipByTruncation,
+                                      const ElemType l2RegWeight, const ElemType l1RegWeight);
     ElemType RmsProp(CPUMatrix<ElemType>& gradients,
                      ElemType RMS_GAMMA,
                      ElemType RMS_WGT_INC,
@@ -136,6 +144,7 @@ public:
     //void SetValue(const CPUSparseMatrix<ElemType>& deepCopyFrom);
     //void SetValue(const GPUSparseMatrix<ElemType>& deepCopyFrom);
     void SetValue(const size_t numRows, const size_t numCols, ElemType* pArray, size_t matrixFlags = matrixFlagNormal);
+    void SetValueFromCompact(const size_t numRows, const size_t numCols, const void* data, CompactElementType type, ElemType scale, const CPUMatrix<ElemType>* offset);
 
     void MaskColumnsValue(const CPUMatrix<char>& columnsMask, ElemType val);
 
@@ -148,13 +157,20 @@ public:
     void SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed = USE_TIME_BASED_SEED);
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    void SetCounterBasedUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    CPUMatrix<ElemType>& AssignElementProductOfUniformRandomMask(const CPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue,
+                                                                 const uint64_t seed, const uint64_t firstCounter, const size_t elementOffset, const ElemType beta);
+    // counter-based (PhiloxRNG.h): element i depends only on the seed and i, so that CPU and GPU, and any number of threads, give the same values
+    void SetCounterBasedUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed);
+    void SetCounterBasedGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed);
     void AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
 
     CPUMatrix<ElemType> Transpose();
     CPUMatrix<ElemType>& AssignTransposeOf(const CPUMatrix<ElemType>& a);
 
     CPUMatrix<ElemType>& DoGatherColumnsOf (ElemType beta, const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha);
-    CPUMatrix<ElemType>& DoScatterColumnsOf(ElemType beta, const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha);
+    CPUMatrix<ElemType>& DoScatterColumnsOf(ElemType beta, const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha, bool idxIsUnique = false);
+    CPUMatrix<ElemType>& AssignPackedIndicesOf(const CPUMatrix<ElemType>& index, const CPUMatrix<ElemType>& sequenceMap, size_t numParallelSequences);
 
     CPUMatrix<ElemType>& operator+=(const ElemType alpha);
     CPUMatrix<ElemType>  operator+(const ElemType alpha) const;
@@ -206,6 +222,9 @@ public:
     CPUMatrix<ElemType>& InplaceSigmoid();
     CPUMatrix<ElemType>& AssignSigmoidOf(const CPUMatrix<ElemType>& a);
 
+    // this = activation(this + bias), bias is a column vector
+    CPUMatrix<ElemType>& InplaceAddColumnAndActivation(const CPUMatrix<ElemType>& bias, ElementWiseOperator activation);
+
     CPUMatrix<ElemType>& InplaceLinearRectifierDerivative();
     CPUMatrix<ElemType>& AssignLinearRectifierDerivativeOf(const CPUMatrix<ElemType>& a);
 
@@ -220,6 +239,7 @@ public:
 
     CPUMatrix<ElemType>& InplaceHardmax(const bool isColWise);
     CPUMatrix<ElemType>& AssignHardmaxOf(const CPUMatrix<ElemType>& a, const bool isColWise);
+    CPUMatrix<ElemType>& AssignTopNHardmaxOf(const CPUMatrix<ElemType>& a, const size_t n);
 
     // sequence training
     CPUMatrix<ElemType>& DropFrame(const CPUMatrix<ElemType>& label, const CPUMatrix<ElemType>& gamma, const ElemType& threshhold);
@@ -253,6 +273,7 @@ public:
     CPUMatrix<ElemType>& InplaceSoftThreshold(const ElemType threshold);
 
     CPUMatrix<ElemType>& SetToZeroIfAbsLessThan(const ElemType threshold);
+    size_t ExtractAbsAboveThreshold(const ElemType threshold, size_t capacity, int* indices, ElemType* values);
 
     ElemType SumOfAbsElements() const; // sum of all abs(elements)
     ElemType SumOfElements() const;    // sum of all elements
@@ -294,6 +315,8 @@ public:
     ElemType MatrixNorm1() const;
     ElemType MatrixNorm0() const; // number of non-zero elemets
     CPUMatrix<ElemType>& AssignSignOf(const CPUMatrix<ElemType>& a);
+    CPUMatrix<ElemType>& AssignCompressedOf(const CPUMatrix<ElemType>& a, CompactElementType type);
+    CPUMatrix<ElemType>& AssignDecompressedOf(const CPUMatrix<ElemType>& compressed, size_t numRows, CompactElementType type);
     CPUMatrix<ElemType>& AddSignOf(const CPUMatrix<ElemType>& a);
 
     CPUMatrix<ElemType>& AssignRowSliceValuesOf(const CPUMatrix<ElemType>& a, const size_t startIndex, const size_t numRows);
@@ -313,6 +336,7 @@ public:
     void VectorMin(CPUMatrix<ElemType>& minIndexes, CPUMatrix<ElemType>& minValues, const bool isColWise) const;
 
     CPUMatrix<ElemType>& AssignNumOfDiff(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, bool searchInCol = false);
+    CPUMatrix<ElemType>& AssignNumOfTopKErrors(const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& predictions, int topK, bool classIndexLabels, const CPUMatrix<char>* columnsMask);
 
     void Print(const char* matrixName, ptrdiff_t rowStart, ptrdiff_t rowEnd, ptrdiff_t colStart, ptrdiff_t colEnd) const;
     void Print(const char* matrixName = nullptr) const; // print whole matrix. can be expensive
@@ -389,6 +413,7 @@ public:
     static void Multiply(const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, CPUMatrix<ElemType>& c);
     static void Multiply(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
     static void Multiply1x1AndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, ElemType beta, CPUMatrix<ElemType>& c);
+    static void BatchMatMul(ElemType alpha, const CPUMatrix<ElemType>& a, const size_t aRows, const bool transposeA, const CPUMatrix<ElemType>& b, const size_t bRows, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c);
 
     static void ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>& a, CPUMatrix<ElemType>& c);
     static void AddScaledDifference(const ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
@@ -396,6 +421,11 @@ public:
     static void AddScaledDifference(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);    // alpha must be 1X1
     static void AssignScaledDifference(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c); // alpha must be 1X1
 
+    static void SoftmaxCrossEntropy(const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& crossEntropy);
+    static void AddSoftmaxCrossEntropyGradient(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labels, const CPUMatrix<ElemType>& logits, const CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& gradient);
+    static void SoftmaxCrossEntropyWithIndices(const CPUMatrix<ElemType>& labelIndices, const CPUMatrix<ElemType>& logits, CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& crossEntropy);
+    static void AddSoftmaxCrossEntropyGradientWithIndices(const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& labelIndices, const CPUMatrix<ElemType>& logits, const CPUMatrix<ElemType>& logSumExp, CPUMatrix<ElemType>& gradient);
+
     static void AddElementToElement(ElemType beta, const CPUMatrix<ElemType>& a, const size_t ai, const size_t aj, CPUMatrix<ElemType>& c, const size_t ci, const size_t cj);
 
     static void MinusOneAt(CPUMatrix<ElemType>& c, const size_t position);
@@ -424,6 +454,10 @@ public:
                   const SmallVector<size_t>& regularOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& regularStrides,
                   const SmallVector<size_t>& reducingOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& reducingStrides);
 
+    // c[offsets.back() + i] = beta * c[...] + alpha * program(inputs[k][offsets[k] + i]...) for i < numElements; all operands are contiguous ranges
+    void FusedElementwiseOp(ElemType beta, const std::vector<const CPUMatrix<ElemType>*>& inputs, const std::vector<size_t>& offsets, size_t numElements,
+                            const FusedElementwiseProgram& program, ElemType alpha);
+
     static CPUMatrix<ElemType> Ones(const size_t rows, const size_t cols);
     static CPUMatrix<ElemType> Zeros(const size_t rows, const size_t cols);
     static CPUMatrix<ElemType> Eye(const size_t rows);
@@ -440,6 +474,16 @@ public:
     CPUMatrix<ElemType>& GetARowByIndex(const CPUMatrix<ElemType>& a, const size_t index);
     static void ConductRowElementMultiplyWithShift(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c, const size_t shift, bool bFirstmatrixfixed);
     CPUMatrix<ElemType>& AssignElementProductOfWithShift(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, const size_t shift);
+    // fused cosine similarity against shifted negative samples, see Matrix::CosDistanceWithNegativeSamples()
+    static void CosDistanceWithNegativeSamples(const CPUMatrix<ElemType>& q, const CPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                               CPUMatrix<ElemType>& invNormQ, CPUMatrix<ElemType>& invNormD, CPUMatrix<ElemType>& c);
+    static void CosDistanceWithNegativeSamplesGradient(bool wrtQuery, const CPUMatrix<ElemType>& q, const CPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                       const CPUMatrix<ElemType>& invNormQ, const CPUMatrix<ElemType>& invNormD,
+                                                       const CPUMatrix<ElemType>& c, const CPUMatrix<ElemType>& cGrad, CPUMatrix<ElemType>& grad);
+    // fused Gaussian mixture scoring, see Matrix::GMMLogLikelihood(); products (K x T) are mu_c'x and meanSquaredNorms (1 x K) ||mu_c||^2 if the means are shared
+    static void GMMLogLikelihood(const CPUMatrix<ElemType>& unnormedPrior, const CPUMatrix<ElemType>& means, const CPUMatrix<ElemType>& logStdDevs, const CPUMatrix<ElemType>& features,
+                                 const CPUMatrix<ElemType>& products, const CPUMatrix<ElemType>& meanSquaredNorms,
+                                 CPUMatrix<ElemType>& logLikelihood, CPUMatrix<ElemType>& posterior, CPUMatrix<ElemType>& normedDeviation);
 
 public:
     friend File& operator>>(File& stream, CPUMatrix<ElemType>& us)
@@ -453,13 +497,12 @@ public:
         size_t numRows, numCols;
         int format;
         stream >> matrixName >> format >> numRows >> numCols;
-        ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        // read straight into our own buffer
+        us.SetFormat(matrixFormatDense);
+        us.SetComputeDeviceId(CPUDEVICE);
+        us.RequireSize(numRows, numCols);
+        stream.GetArray(us.Data(), numRows * numCols);
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
-        us.SetValue(numRows, numCols, d_array, matrixFlagNormal);
-
-        delete[] d_array;
         return stream;
     }
     friend File& operator<<(File& stream, const CPUMatrix<ElemType>& us)
@@ -472,8 +515,7 @@ public:
         stream << s << format;
 
         stream << us.m_numRows << us.m_numCols;
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << us.Buffer()[i];
+        stream.PutArray(us.Data(), us.GetNumElements());
         stream.PutMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         return stream;
     }
@@ -496,6 +538,17 @@ public:
                                     const CPUMatrix<ElemType>& pair_scores,
                                     CPUMatrix<ElemType>& grd);
 
+    // batched linear-chain CRF, see Matrix::CRFForwardBackward()
+    static void CRFForwardBackward(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& posScores, const CPUMatrix<ElemType>& pairScores,
+                                   size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                   CPUMatrix<ElemType>& alpha, CPUMatrix<ElemType>& beta, CPUMatrix<ElemType>& postProb, CPUMatrix<ElemType>& sequenceScores);
+    static void CRFTransitionGradient(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& posScores, const CPUMatrix<ElemType>& pairScores,
+                                      size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                      const CPUMatrix<ElemType>& alpha, const CPUMatrix<ElemType>& beta, CPUMatrix<ElemType>& grd);
+    static void CRFViterbiDecode(const CPUMatrix<ElemType>& lbls, const CPUMatrix<ElemType>& posScores, const CPUMatrix<ElemType>& pairScores,
+                                 size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                 CPUMatrix<ElemType>& alpha, CPUMatrix<ElemType>& backtrace, CPUMatrix<ElemType>& decodedPath);
+
     static void _rcrfTransGrdCompute(size_t i,
                                      const CPUMatrix<ElemType>& lbls,
                                      const CPUMatrix<ElemType>& alpha,
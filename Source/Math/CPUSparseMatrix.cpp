@@ -16,6 +16,7 @@
 #include "CPUSparseMatrix.h"
 #include <random>
 #include <chrono>
+#include <unordered_map>
 #include <iostream>
 #ifdef LEAKDETECT
 #include <vld.h>
@@ -741,6 +742,103 @@ void CPUSparseMatrix<ElemType>::Reset()
     SetBlockIdShift(0);
 }
 
+// -----------------------------------------------------------------------
+// dense x sparse products
+// The products below accumulate weighted sums of lhs columns into output columns. Output columns are
+// independent, so we distribute (output column, row block) pairs over the OpenMP threads. Blocking over
+// the rows keeps the slice of the output column being accumulated into in cache while we iterate over
+// its nonzeros; it also gives the threads enough work when there are only few output columns.
+// -----------------------------------------------------------------------
+
+static const size_t c_denseTimesSparseRowBlockSize = 1024;
+
+// out[:, outCols[k]] += alpha * sum_{p in [listStart[k], listStart[k+1])} lhs[:, lhsCols[p]] * weights[p] for all k < numLists
+// 'out' has lhs.GetNumRows() rows and no padding. If 'outCols' is null, list k goes to output column k.
+template <class ElemType>
+static void AddWeightedSumsOfColumns(ElemType alpha, const CPUMatrix<ElemType>& lhs,
+                                     size_t numLists, const CPUSPARSE_INDEX_TYPE* listStart, const CPUSPARSE_INDEX_TYPE* lhsCols, const ElemType* weights,
+                                     const size_t* outCols, ElemType* out)
+{
+    const size_t m = lhs.GetNumRows();
+    const ElemType* lhsData = lhs.Data();
+    const size_t numRowBlocks = (m + c_denseTimesSparseRowBlockSize - 1) / c_denseTimesSparseRowBlockSize;
+    const long numTasks = (long) (numLists * numRowBlocks);
+
+#pragma omp parallel for schedule(dynamic)
+    for (long task = 0; task < numTasks; task++)
+    {
+        const size_t k = task / numRowBlocks;
+        const size_t rowBegin = (task % numRowBlocks) * c_denseTimesSparseRowBlockSize;
+        const size_t rowEnd = min(m, rowBegin + c_denseTimesSparseRowBlockSize);
+        ElemType* outCol = out + (outCols ? outCols[k] : k) * m;
+        for (CPUSPARSE_INDEX_TYPE p = listStart[k]; p < listStart[k + 1]; p++)
+        {
+            const ElemType* lhsCol = lhsData + lhsCols[p] * m;
+            const ElemType val = weights[p];
+            for (size_t h = rowBegin; h < rowEnd; h++)
+                outCol[h] += alpha * lhsCol[h] * val;
+        }
+    }
+}
+
+// Group the nonzeros of a CSC matrix by row, i.e. a CSR view of it. Rows are enumerated in the order in which they first
+// occur when scanning the columns; rows without any nonzero are omitted. For the k-th row found, rows[k] is its index,
+// and the column indices and values of its nonzeros are cols[p] and values[p] for p in [start[k], start[k+1]).
+template <class ElemType>
+static void GroupNonzerosByRow(const CPUSparseMatrix<ElemType>& a, vector<size_t>& rows, vector<CPUSPARSE_INDEX_TYPE>& start,
+                               vector<CPUSPARSE_INDEX_TYPE>& cols, vector<ElemType>& values)
+{
+    const CPUSPARSE_INDEX_TYPE* colStart = a.SecondaryIndexLocation();
+    const CPUSPARSE_INDEX_TYPE* rowIndex = a.MajorIndexLocation();
+    const size_t numCols = a.GetNumCols();
+    const size_t nz = colStart[numCols] - colStart[0];
+
+    // assign each row a slot, and count the nonzeros of each slot
+    // A table over all rows costs O(rows) to clear, which dominates for large vocabularies with few nonzeros per minibatch, so then we hash.
+    const size_t none = SIZE_MAX;
+    const bool hashRows = a.GetNumRows() > 16 * nz;
+    vector<size_t> slotTable(hashRows ? 0 : a.GetNumRows(), none);
+    unordered_map<CPUSPARSE_INDEX_TYPE, size_t> slotMap;
+    if (hashRows)
+        slotMap.reserve(nz);
+    auto slotOfRow = [&](CPUSPARSE_INDEX_TYPE row) -> size_t&
+    {
+        return hashRows ? slotMap.emplace(row, none).first->second : slotTable[row];
+    };
+    vector<CPUSPARSE_INDEX_TYPE> counts;
+    rows.clear();
+    for (CPUSPARSE_INDEX_TYPE p = colStart[0]; p < colStart[numCols]; p++)
+    {
+        size_t& slot = slotOfRow(rowIndex[p]);
+        if (slot == none)
+        {
+            slot = rows.size();
+            rows.push_back(rowIndex[p]);
+            counts.push_back(0);
+        }
+        counts[slot]++;
+    }
+
+    start.resize(rows.size() + 1);
+    start[0] = 0;
+    for (size_t k = 0; k < rows.size(); k++)
+        start[k + 1] = start[k] + counts[k];
+
+    // scatter; within a slot, nonzeros stay ordered by column
+    cols.resize(nz);
+    values.resize(nz);
+    vector<CPUSPARSE_INDEX_TYPE> next(start.begin(), start.end() - 1);
+    for (size_t j = 0; j < numCols; j++)
+    {
+        for (CPUSPARSE_INDEX_TYPE p = colStart[j]; p < colStart[j + 1]; p++)
+        {
+            CPUSPARSE_INDEX_TYPE q = next[slotOfRow(rowIndex[p])]++;
+            cols[q] = (CPUSPARSE_INDEX_TYPE) j;
+            values[q] = a.Buffer()[p];
+        }
+    }
+}
+
 // c = alpha*op(lhs) * op(rhs) + beta*c
 // dense x sparse = dense
 template <class ElemType>
@@ -770,7 +868,7 @@ void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPU
 
     if (beta == 0)
     {
-        memset(c.Buffer(), 0, sizeof(ElemType) * c.GetNumElements());
+        memset(c.Data(), 0, sizeof(ElemType) * c.GetNumElements());
     }
     else if (beta != 1)
     {
@@ -786,39 +884,18 @@ void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPU
 
     if (!transposeA && !transposeB)
     {
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
-        {
-            size_t start = rhs.SecondaryIndexLocation()[j]; // ColLocation
-            size_t end = rhs.SecondaryIndexLocation()[j + 1];
-            for (size_t p = start; p < end; p++)
-            {
-                size_t i = rhs.MajorIndexLocation()[p]; // RowLocation
-                ElemType val = rhs.Buffer()[p];
-
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
-                {
-                    c(h, j) += alpha * lhs(h, i) * val;
-                }
-            }
-        }
+        // c(:, j) += alpha * sum_p lhs(:, rowIndex[p]) * val[p] over the nonzeros p of rhs column j
+        AddWeightedSumsOfColumns(alpha, lhs, rhs.GetNumCols(), rhs.SecondaryIndexLocation(), rhs.MajorIndexLocation(), rhs.Buffer(), (const size_t*) nullptr, c.Data());
     }
     else if (!transposeA && transposeB)
     {
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
-        {
-            size_t start = rhs.SecondaryIndexLocation()[j];
-            size_t end = rhs.SecondaryIndexLocation()[j + 1];
-
-            for (size_t p = start; p < end; p++)
-            {
-                size_t i = rhs.MajorIndexLocation()[p];
-                ElemType val = rhs.Buffer()[p];
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
-                {
-                    c(h, i) += alpha * lhs(h, j) * val;
-                }
-            }
-        }
+        // c(:, i) += alpha * sum_j lhs(:, j) * rhs(i, j): transpose rhs' index so that each output column is owned by one list
+        vector<size_t> rows;
+        vector<CPUSPARSE_INDEX_TYPE> start, cols;
+        vector<ElemType> values;
+        GroupNonzerosByRow(rhs, rows, start, cols, values);
+        if (!rows.empty())
+            AddWeightedSumsOfColumns(alpha, lhs, rows.size(), start.data(), cols.data(), values.data(), rows.data(), c.Data());
     }
     else if (transposeA && !transposeB)
     {
@@ -830,8 +907,86 @@ void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPU
     }
 }
 
+// sparse x dense = dense
+// c = alpha * op(lhs) * op(rhs) + beta * c, for a CSC lhs, e.g. weights whose small values have been pruned.
+// Threads own columns of c; lhs is traversed by its nonzeros, so the cost is proportional to their number.
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUSparseMatrix<ElemType>& lhs, const bool transposeA,
+                                                       const CPUMatrix<ElemType>& rhs, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c)
+{
+    if (lhs.IsEmpty() || rhs.IsEmpty())
+        LogicError("MultiplyAndWeightedAdd:  one of the input matrix is empty.");
+
+    if (lhs.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+
+    size_t m = transposeA ? lhs.GetNumCols() : lhs.GetNumRows();
+    size_t k = transposeA ? lhs.GetNumRows() : lhs.GetNumCols();
+    size_t l = transposeB ? rhs.GetNumCols() : rhs.GetNumRows();
+    size_t n = transposeB ? rhs.GetNumRows() : rhs.GetNumCols();
+    if (k != l)
+        InvalidArgument("CPUSparseMatrix::MultiplyAndWeightedAdd: The inner dimensions of a and b must match.");
+
+    if (beta == 0)
+        c.RequireSize(m, n);
+    else
+        c.VerifySize(m, n); // Can't resize if beta != 0
+
+    if (beta == 0)
+    {
+        memset(c.Data(), 0, sizeof(ElemType) * c.GetNumElements());
+    }
+    else if (beta != 1)
+    {
+#pragma omp parallel for
+        foreach_coord (i, j, c)
+        {
+            c(i, j) = beta * c(i, j);
+        }
+    }
+
+    const CPUSPARSE_INDEX_TYPE* colStart = lhs.SecondaryIndexLocation();
+    const CPUSPARSE_INDEX_TYPE* rowIndex = lhs.MajorIndexLocation();
+    const ElemType* values = lhs.Buffer();
+    const size_t lhsCols = lhs.GetNumCols();
+    const ElemType* rhsData = rhs.Data();
+    const size_t rhsRows = rhs.GetNumRows();
+    // column j of op(rhs) is contiguous unless rhs is transposed
+    const size_t rhsColStride = transposeB ? 1 : rhsRows;
+    const size_t rhsRowStride = transposeB ? rhsRows : 1;
+
+#pragma omp parallel for
+    for (long j = 0; j < (long) n; j++)
+    {
+        const ElemType* rhsCol = rhsData + j * rhsColStride;
+        ElemType* outCol = c.Data() + j * m;
+        for (size_t q = 0; q < lhsCols; q++)
+        {
+            if (!transposeA)
+            {
+                // c(:, j) += alpha * lhs(:, q) * op(rhs)(q, j)
+                const ElemType val = alpha * rhsCol[q * rhsRowStride];
+                if (val == 0)
+                    continue;
+                for (CPUSPARSE_INDEX_TYPE p = colStart[q]; p < colStart[q + 1]; p++)
+                    outCol[rowIndex[p]] += values[p] * val;
+            }
+            else
+            {
+                // c(q, j) += alpha * lhs(:, q)' * op(rhs)(:, j)
+                ElemType sum = 0;
+                for (CPUSPARSE_INDEX_TYPE p = colStart[q]; p < colStart[q + 1]; p++)
+                    sum += values[p] * rhsCol[rowIndex[p] * rhsRowStride];
+                outCol[q] += alpha * sum;
+            }
+        }
+    }
+}
+
 // dense x sparse = sparse
-// c = alpha * op(lhs) * op(rhs)
+// c += alpha * op(lhs) * op(rhs)
+// The result is block-sparse by columns. If c already is, e.g. holds the gradient of a parameter that is used more than once,
+// its blocks are accumulated into and blocks are added for the new columns; otherwise it is overwritten.
 template <class ElemType>
 void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<ElemType>& lhs, const bool transposeA,
                                                const CPUSparseMatrix<ElemType>& rhs, const bool transposeB, CPUSparseMatrix<ElemType>& c)
@@ -856,7 +1011,9 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
         InvalidArgument("CPUSparseMatrix::MultiplyAndAdd: The inner dimensions of a and b must match.");
     }
 
-    c.Reset();
+    bool accumulate = c.GetFormat() == matrixFormatSparseBlockCol && c.GetNumRows() == m && c.GetNumCols() == n && c.GetBlockSize() > 0;
+    if (!accumulate)
+        c.Reset();
 
     if (!transposeA && !transposeB)
     {
@@ -867,52 +1024,47 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
         if (rhs.GetFormat() != matrixFormatSparseCSC)
             NOT_IMPLEMENTED;
 
-        // allocate enough memory
-        c.SetFormat(matrixFormatSparseBlockCol);
-        c.RequireSizeAndAllocate(m, n, m * min(n, rhs.NzCount()), true, false);
-
-        map<size_t, size_t> w2Id;
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
-        { // j ranges over batches
-            size_t start = rhs.SecondaryIndexLocation()[j];
-            size_t end = rhs.SecondaryIndexLocation()[j + 1];
+        // one block per row i of rhs (i ranges over words) that has a nonzero, in order of first occurrence
+        vector<size_t> rows;
+        vector<CPUSPARSE_INDEX_TYPE> start, cols;
+        vector<ElemType> values;
+        GroupNonzerosByRow(rhs, rows, start, cols, values);
 
-            for (size_t p = start; p < end; p++)
+        // find the block of each row: an existing one of the same column of c, or a new one after them
+        size_t numOldBlocks = accumulate ? c.GetBlockSize() : 0;
+        vector<size_t> blockOfRow(rows.size());
+        {
+            unordered_map<size_t, size_t> blockOfColumn;
+            blockOfColumn.reserve(numOldBlocks + rows.size());
+            for (size_t j = 0; j < numOldBlocks; j++)
+                blockOfColumn[c.GetBlockIds()[j] - c.GetBlockIdShift()] = j;
+            size_t numBlocks = numOldBlocks;
+            for (size_t id = 0; id < rows.size(); id++)
             {
-                size_t i = rhs.MajorIndexLocation()[p]; // i ranges over words
-                ElemType val = rhs.Buffer()[p];  // 1 for(i, j)
+                auto iter = blockOfColumn.find(rows[id]);
+                blockOfRow[id] = iter != blockOfColumn.end() ? iter->second : numBlocks++;
+            }
 
-                bool first = true;
-                if (w2Id.find(i) == w2Id.end())
-                {
-                    size_t id = w2Id.size();
-                    w2Id[i] = id;
-                    c.GetBlockIds()[c.GetBlockSize()] = i;
-                    c.SetBlockSize(c.GetBlockSize() + 1);
-                }
-                else
-                {
-                    first = false;
-                }
-                size_t pos = w2Id[i] * lhs.GetNumRows();
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
-                { // h range over hidden layer
-                    if (first == true)
-                    {
-                        c.Buffer()[pos] = alpha * lhs(h, j) * val;
-                    }
-                    else
-                    {
-                        c.Buffer()[pos] += alpha * lhs(h, j) * val;
-                    }
-                    pos++;
-                }
+            // allocate enough memory
+            if (!accumulate)
+                c.SetFormat(matrixFormatSparseBlockCol);
+            c.RequireSizeAndAllocate(m, n, m * max(numBlocks, min(n, rhs.NzCount())), true, /*keepExistingValues=*/accumulate);
+            if (numBlocks * m > c.GetSizeAllocated())
+            {
+                LogicError("Sparse matrix is unexpectedly out of range.");
             }
+            for (size_t id = 0; id < rows.size(); id++)
+            {
+                if (blockOfRow[id] >= numOldBlocks)
+                    c.GetBlockIds()[blockOfRow[id]] = rows[id] + c.GetBlockIdShift();
+            }
+            memset(c.Buffer() + numOldBlocks * m, 0, sizeof(ElemType) * (numBlocks - numOldBlocks) * m);
+            c.SetBlockSize(numBlocks);
         }
-        if (c.GetBlockSize() * m > c.GetSizeAllocated())
-        {
-            LogicError("Sparse matrix is unexpectedly out of range.");
-        }
+
+        // block of row i += sum_j alpha * lhs(:, j) * rhs(i, j), j ranging over batches
+        if (!rows.empty())
+            AddWeightedSumsOfColumns(alpha, lhs, rows.size(), start.data(), cols.data(), values.data(), blockOfRow.data(), c.Buffer());
     }
     else if (transposeA && !transposeB)
     {
@@ -978,6 +1130,60 @@ void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSpars
     }
 }
 
+// sparse += dense, on the blocks of the block-sparse rhs only
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::ScaleAndAddOnBlocks(const ElemType alpha, const CPUMatrix<ElemType>& lhs, CPUSparseMatrix<ElemType>& rhs)
+{
+    if (lhs.GetNumRows() != rhs.GetNumRows() || lhs.GetNumCols() != rhs.GetNumCols())
+        InvalidArgument("CPUSparseMatrix::ScaleAndAddOnBlocks: The dimensions of a and b must match.");
+    if (rhs.GetFormat() != MatrixFormat::matrixFormatSparseBlockCol && rhs.GetFormat() != MatrixFormat::matrixFormatSparseBlockRow)
+        RuntimeError("CPUSparseMatrix::ScaleAndAddOnBlocks() only supports block sparse format");
+
+    const bool blockCol = rhs.GetFormat() == MatrixFormat::matrixFormatSparseBlockCol;
+    const size_t len = blockCol ? rhs.GetNumRows() : rhs.GetNumCols();
+#pragma omp parallel for
+    for (long j = 0; j < (long) rhs.GetBlockSize(); j++)
+    {
+        size_t i = rhs.GetBlockIds()[j] - rhs.GetBlockIdShift();
+        ElemType* block = rhs.Buffer() + j * len;
+        for (size_t p = 0; p < len; p++)
+            block[p] += alpha * (blockCol ? lhs(p, i) : lhs(i, p));
+    }
+}
+
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::GetBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& values) const
+{
+    if (GetFormat() != MatrixFormat::matrixFormatSparseBlockCol)
+        RuntimeError("CPUSparseMatrix::GetBlockColumns() only supports the BlockCol format");
+
+    size_t numBlocks = IsEmpty() ? 0 : GetBlockSize();
+    columnIds.resize(numBlocks);
+    for (size_t j = 0; j < numBlocks; j++)
+        columnIds[j] = GetBlockIds()[j] - GetBlockIdShift();
+    values.assign(Buffer(), Buffer() + numBlocks * GetNumRows());
+}
+
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::SetBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& values)
+{
+    VerifyWritable(__func__);
+    if (values.size() != numRows * columnIds.size())
+        LogicError("CPUSparseMatrix::SetBlockColumns: Expected %d values for %d columns of %d rows.", (int) (numRows * columnIds.size()), (int) columnIds.size(), (int) numRows);
+
+    RequireSizeAndAllocate(numRows, numCols, numRows * columnIds.size(), MatrixFormat::matrixFormatSparseBlockCol, /*growOnly=*/true, /*keepExistingValues=*/false);
+    SetBlockSize(columnIds.size());
+    SetBlockIdShift(0);
+    for (size_t j = 0; j < columnIds.size(); j++)
+    {
+        if (columnIds[j] >= numCols)
+            LogicError("CPUSparseMatrix::SetBlockColumns: Column id %d out of range.", (int) columnIds[j]);
+        GetBlockIds()[j] = columnIds[j];
+    }
+    if (!values.empty())
+        memcpy(Buffer(), values.data(), values.size() * sizeof(ElemType));
+}
+
 template <class ElemType>
 /*static*/ bool CPUSparseMatrix<ElemType>::AreEqual(const CPUSparseMatrix<ElemType>& a, const CPUSparseMatrix<ElemType>& b, const ElemType threshold)
 {
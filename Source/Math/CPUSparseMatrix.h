@@ -121,10 +121,15 @@ public:
     static void MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& lhs, const bool transposeA,
                                        const CPUSparseMatrix<ElemType>& rhs, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c);
 
+    static void MultiplyAndWeightedAdd(ElemType alpha, const CPUSparseMatrix<ElemType>& lhs, const bool transposeA,
+                                       const CPUMatrix<ElemType>& rhs, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c);
+
     static void MultiplyAndAdd(ElemType alpha, const CPUMatrix<ElemType>& lhs, const bool transposeA,
                                const CPUSparseMatrix<ElemType>& rhs, const bool transposeB, CPUSparseMatrix<ElemType>& c);
 
     static void ScaleAndAdd(const ElemType alpha, const CPUSparseMatrix<ElemType>& lhs, CPUMatrix<ElemType>& c);
+    // rhs += alpha * lhs on the blocks of the block-sparse rhs only
+    static void ScaleAndAddOnBlocks(const ElemType alpha, const CPUMatrix<ElemType>& lhs, CPUSparseMatrix<ElemType>& rhs);
 
     static bool AreEqual(const CPUSparseMatrix<ElemType>& a, const CPUSparseMatrix<ElemType>& b, const ElemType threshold = 1e-8);
 
@@ -260,6 +265,10 @@ public:
         return GetBlockIds();
     }
 
+    // BlockCol format: the ids of the nonzero columns and their values, see Matrix::GetSparseBlockColumns()
+    void GetBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& values) const;
+    void SetBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& values);
+
     CPUSPARSE_INDEX_TYPE* MajorIndexLocation() const
     {
         return GetUnCompIndex() + GetCompIndex()[m_sliceViewOffset];
@@ -0,0 +1,370 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUThreadPool.cpp -- process-wide pool of CPU threads for parallel loops (see CPUThreadPool.h)
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "CPUThreadPool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef USE_MKL
+#include <mkl.h>
+#endif
+#ifdef _WIN32
+#include "Windows.h"
+#else
+#include <sched.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// set while a thread runs chunks of a loop, so that loops inside of it run serially
+static thread_local bool t_inParallelLoop = false;
+
+// pins the calling thread to the given cores, and returns the cores it could run on before in 'previous', if given
+static bool SetThreadCores(const std::vector<size_t>& cores, std::vector<size_t>* previous)
+{
+#ifdef _WIN32
+    const size_t maxCores = 8 * sizeof(DWORD_PTR);
+    DWORD_PTR mask = 0;
+    for (auto core : cores)
+    {
+        if (core < maxCores)
+            mask |= (DWORD_PTR) 1 << core;
+    }
+    if (mask == 0)
+        return false;
+    DWORD_PTR previousMask = SetThreadAffinityMask(GetCurrentThread(), mask);
+    if (previousMask == 0)
+        return false;
+    if (previous)
+    {
+        previous->clear();
+        for (size_t core = 0; core < maxCores; core++)
+        {
+            if (previousMask & ((DWORD_PTR) 1 << core))
+                previous->push_back(core);
+        }
+    }
+    return true;
+#else
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (auto core : cores)
+    {
+        if (core < CPU_SETSIZE)
+            CPU_SET(core, &mask);
+    }
+    if (CPU_COUNT(&mask) == 0)
+        return false;
+    if (previous)
+    {
+        cpu_set_t previousMask;
+        CPU_ZERO(&previousMask);
+        if (sched_getaffinity(0, sizeof(previousMask), &previousMask) != 0)
+            return false;
+        previous->clear();
+        for (size_t core = 0; core < CPU_SETSIZE; core++)
+        {
+            if (CPU_ISSET(core, &previousMask))
+                previous->push_back(core);
+        }
+    }
+    return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#endif
+}
+
+namespace {
+
+// a call to ParallelFor() that has been split into chunks; lives on the stack of the caller until all chunks are done
+struct ParallelLoop
+{
+    ParallelLoop(int64_t begin, int64_t end, size_t numChunks, const std::function<void(int64_t, int64_t)>& chunkBody)
+        : m_begin(begin), m_end(end), m_numChunks(numChunks), m_chunkBody(chunkBody), m_nextChunk(0), m_numPending(numChunks)
+    {
+    }
+
+    void RunChunk(size_t chunk)
+    {
+        int64_t length = m_end - m_begin;
+        int64_t chunkBegin = m_begin + (int64_t) (length * chunk / m_numChunks);
+        int64_t chunkEnd = m_begin + (int64_t) (length * (chunk + 1) / m_numChunks);
+        try
+        {
+            m_chunkBody(chunkBegin, chunkEnd);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_exception)
+                m_exception = std::current_exception();
+        }
+        // the caller may destroy the loop as soon as it sees no pending chunks, so this must be the last access
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_numPending == 0)
+            m_done.notify_all();
+    }
+
+    void WaitUntilDone()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_numPending == 0; });
+        if (m_exception)
+            std::rethrow_exception(m_exception);
+    }
+
+    const int64_t m_begin;
+    const int64_t m_end;
+    const size_t m_numChunks;
+    const std::function<void(int64_t, int64_t)>& m_chunkBody;
+    size_t m_nextChunk; // guarded by the pool's mutex
+
+    std::mutex m_mutex; // guards the members below
+    std::condition_variable m_done;
+    size_t m_numPending;
+    std::exception_ptr m_exception;
+};
+
+class ThreadPool
+{
+public:
+    ThreadPool()
+        : m_numThreads(std::max(1u, std::thread::hardware_concurrency())), m_stop(false)
+    {
+    }
+
+    // the i-th worker (the 0-th is the calling thread) runs on cores[i % cores.size()] only, if cores are given
+    ThreadPool(size_t numThreads, const std::vector<size_t>& cores)
+        : m_numThreads(std::max((size_t) 1, numThreads)), m_cores(cores), m_stop(false)
+    {
+    }
+
+    ~ThreadPool()
+    {
+        StopWorkers();
+    }
+
+    size_t GetNumThreads() const { return m_numThreads; }
+
+    void SetNumThreads(size_t numThreads)
+    {
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (numThreads == m_numThreads)
+            return;
+        StopWorkers();
+        m_numThreads = numThreads;
+    }
+
+    void Run(ParallelLoop& loop)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // the workers are started on first use, so that processes that do not run parallel loops have none
+            while (m_workers.size() + 1 < m_numThreads)
+            {
+                size_t index = m_workers.size() + 1;
+                m_workers.push_back(std::thread([this, index] { WorkerLoop(index); }));
+            }
+            m_loops.push_back(&loop);
+        }
+        m_wakeUp.notify_all();
+
+        // the caller works on its own loop, so that it finishes even if all workers are busy with other loops
+        t_inParallelLoop = true;
+        for (;;)
+        {
+            size_t chunk;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (loop.m_nextChunk == loop.m_numChunks)
+                    break;
+                chunk = ClaimChunk(loop);
+            }
+            loop.RunChunk(chunk);
+        }
+        t_inParallelLoop = false;
+        loop.WaitUntilDone();
+    }
+
+private:
+    // must be called with m_mutex held; removes the loop from the queue once all its chunks are claimed
+    size_t ClaimChunk(ParallelLoop& loop)
+    {
+        size_t chunk = loop.m_nextChunk++;
+        if (loop.m_nextChunk == loop.m_numChunks)
+            m_loops.erase(std::find(m_loops.begin(), m_loops.end(), &loop));
+        return chunk;
+    }
+
+    void WorkerLoop(size_t index)
+    {
+        if (!m_cores.empty())
+            SetThreadCores(std::vector<size_t>{ m_cores[index % m_cores.size()] }, nullptr); // if this fails, the worker runs unpinned
+        t_inParallelLoop = true;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_wakeUp.wait(lock, [this] { return m_stop || !m_loops.empty(); });
+            if (m_stop)
+                return;
+            // loops are served in the order they were started
+            ParallelLoop& loop = *m_loops.front();
+            size_t chunk = ClaimChunk(loop);
+            lock.unlock();
+            loop.RunChunk(chunk); // the loop stays alive until this chunk is done
+            lock.lock();
+        }
+    }
+
+    void StopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeUp.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+        m_workers.clear();
+        m_stop = false;
+    }
+
+    size_t m_numThreads;
+    const std::vector<size_t> m_cores;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex; // guards the members below and ParallelLoop::m_nextChunk
+    std::condition_variable m_wakeUp;
+    std::deque<ParallelLoop*> m_loops; // loops that have chunks left to claim
+    bool m_stop;
+};
+
+// never destroyed: the workers may still be blocked when static objects are destroyed at process exit
+static ThreadPool& GetProcessThreadPool()
+{
+    static ThreadPool* pool = new ThreadPool();
+    return *pool;
+}
+
+// the private pool of the innermost CPUThreadScope of the calling thread, if any
+static thread_local ThreadPool* t_threadPool = nullptr;
+
+static ThreadPool& GetThreadPool()
+{
+    return t_threadPool ? *t_threadPool : GetProcessThreadPool();
+}
+
+}
+
+/*static*/ void CPUThreadPool::SetNumThreads(size_t numThreads)
+{
+    GetProcessThreadPool().SetNumThreads(numThreads);
+}
+
+/*static*/ size_t CPUThreadPool::GetNumThreads()
+{
+    return GetThreadPool().GetNumThreads();
+}
+
+/*static*/ size_t CPUThreadPool::GetNumChunks(int64_t begin, int64_t end, size_t workPerIteration)
+{
+    int64_t numIterations = end - begin;
+    size_t numThreads = GetNumThreads();
+    if (numIterations < 2 || numThreads < 2 || t_inParallelLoop)
+        return 1;
+    // a few chunks per thread, so that threads that finish early can take over the work of others
+    double numChunks = (double) numIterations * std::max(workPerIteration, (size_t) 1) / MinWorkPerChunk;
+    numChunks = std::min(numChunks, 4.0 * numThreads);
+    numChunks = std::min(numChunks, (double) numIterations);
+    return (size_t) numChunks;
+}
+
+/*static*/ void CPUThreadPool::Run(int64_t begin, int64_t end, size_t numChunks, const std::function<void(int64_t, int64_t)>& chunkBody)
+{
+    ParallelLoop loop(begin, end, numChunks, chunkBody);
+    GetThreadPool().Run(loop);
+}
+
+// -----------------------------------------------------------------------
+// CPUPrivateThreadPool, CPUThreadScope
+// -----------------------------------------------------------------------
+
+struct CPUPrivateThreadPool::Impl
+{
+    Impl(size_t numThreads, const std::vector<size_t>& cores) : m_pool(numThreads, cores) { }
+    ThreadPool m_pool;
+};
+
+CPUPrivateThreadPool::CPUPrivateThreadPool(size_t numThreads, const std::vector<size_t>& cores)
+    : m_cores(cores)
+{
+    if (numThreads == 0)
+        InvalidArgument("CPUPrivateThreadPool: The number of threads must be at least 1.");
+    size_t numCores = std::max(1u, std::thread::hardware_concurrency());
+    for (auto core : cores)
+    {
+        if (core >= numCores)
+            InvalidArgument("CPUPrivateThreadPool: Core %d does not exist (%d cores).", (int) core, (int) numCores);
+    }
+    m_impl.reset(new Impl(numThreads, cores));
+}
+
+CPUPrivateThreadPool::~CPUPrivateThreadPool()
+{
+}
+
+size_t CPUPrivateThreadPool::GetNumThreads() const
+{
+    return m_impl->m_pool.GetNumThreads();
+}
+
+CPUThreadScope::CPUThreadScope(CPUPrivateThreadPool* pool)
+    : m_pool(pool), m_previousPool(nullptr), m_previousNumOmpThreads(0), m_previousNumMklThreads(0)
+{
+    if (!m_pool)
+        return;
+    const auto& cores = m_pool->GetCores();
+    if (!cores.empty() && !SetThreadCores(std::vector<size_t>{ cores[0] }, &m_previousCores))
+        RuntimeError("CPUThreadScope: Could not pin the calling thread to core %d.", (int) cores[0]);
+
+    m_previousPool = t_threadPool;
+    t_threadPool = &m_pool->m_impl->m_pool;
+    int numThreads = (int) m_pool->GetNumThreads();
+#ifdef _OPENMP
+    m_previousNumOmpThreads = omp_get_max_threads();
+    omp_set_num_threads(numThreads);
+#endif
+#ifdef USE_MKL
+    m_previousNumMklThreads = mkl_set_num_threads_local(numThreads);
+#endif
+    numThreads; // (unused without OpenMP and MKL)
+}
+
+CPUThreadScope::~CPUThreadScope()
+{
+    if (!m_pool)
+        return;
+#ifdef USE_MKL
+    mkl_set_num_threads_local(m_previousNumMklThreads);
+#endif
+#ifdef _OPENMP
+    omp_set_num_threads(m_previousNumOmpThreads);
+#endif
+    t_threadPool = (ThreadPool*) m_previousPool;
+    if (!m_previousCores.empty())
+        SetThreadCores(m_previousCores, nullptr);
+}
+
+}}}
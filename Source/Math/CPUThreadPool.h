@@ -0,0 +1,107 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUThreadPool.h -- process-wide pool of CPU threads for parallel loops in Math, the readers and evaluation
+//
+// All parallel loops of the process share one set of worker threads, whose size is the global thread budget
+// (see SetNumThreads(), which CPUMatrix::SetNumThreads() calls). A loop is split into chunks that the idle
+// workers and the calling thread take from it one at a time, so that concurrent loops, e.g. of several evaluators
+// or of a reader's prefetch thread and the training thread, share the workers instead of each forking a team of
+// its own. Loops with little work in total run on the calling thread, as do loops inside other parallel loops.
+//
+// A thread can instead run its loops on a pool of its own (CPUPrivateThreadPool), e.g. of one evaluator instance, while
+// it is in a CPUThreadScope of that pool, so that instances do not compete for the threads of the process-wide pool.
+//
+
+#pragma once
+
+#include "CommonMatrix.h"
+#include <functional>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class MATH_API CPUThreadPool
+{
+public:
+    // minimum amount of work (roughly, elements touched) per chunk; loops with less than twice this run serially
+    static const size_t MinWorkPerChunk = 32768;
+
+    // number of threads that run the chunks of a loop, including the calling thread; 0 means the number of cores
+    // SetNumThreads() sets the size of the process-wide pool; GetNumThreads() returns the size of the pool that the
+    // loops of the calling thread run on.
+    static void SetNumThreads(size_t numThreads);
+    static size_t GetNumThreads();
+
+    // Runs body(i) for all i in [begin, end) in parallel. 'workPerIteration' is the approximate number of elements
+    // one iteration touches (e.g. the number of rows for a loop over columns), which determines the chunk size.
+    // Exceptions are passed on to the caller after all chunks have finished.
+    template <class FUNCTION>
+    static void ParallelFor(int64_t begin, int64_t end, size_t workPerIteration, const FUNCTION& body)
+    {
+        size_t numChunks = GetNumChunks(begin, end, workPerIteration);
+        if (numChunks <= 1)
+        {
+            for (int64_t i = begin; i < end; i++)
+                body(i);
+            return;
+        }
+        Run(begin, end, numChunks, [&body](int64_t chunkBegin, int64_t chunkEnd)
+        {
+            for (int64_t i = chunkBegin; i < chunkEnd; i++)
+                body(i);
+        });
+    }
+
+private:
+    static size_t GetNumChunks(int64_t begin, int64_t end, size_t workPerIteration);
+    static void Run(int64_t begin, int64_t end, size_t numChunks, const std::function<void(int64_t, int64_t)>& chunkBody);
+};
+
+// a pool of threads for the parallel loops of the threads that are in one of its CPUThreadScopes
+// numThreads includes the calling thread of a loop, as for the process-wide pool. With cores given, the i-th thread
+// runs on cores[i % cores.size()] only, where the 0-th is the calling thread while it is in a scope.
+class MATH_API CPUPrivateThreadPool
+{
+public:
+    CPUPrivateThreadPool(size_t numThreads, const std::vector<size_t>& cores);
+    ~CPUPrivateThreadPool();
+
+    size_t GetNumThreads() const;
+    const std::vector<size_t>& GetCores() const { return m_cores; }
+
+private:
+    CPUPrivateThreadPool(const CPUPrivateThreadPool&) = delete;
+    CPUPrivateThreadPool& operator=(const CPUPrivateThreadPool&) = delete;
+
+    friend class CPUThreadScope;
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+    std::vector<size_t> m_cores;
+};
+
+// While an object of this exists, the parallel loops of the thread that created it run on the given pool, the OpenMP
+// (and MKL) thread count of the thread is the size of the pool, and the thread is pinned to the first core of the pool,
+// if any. All is restored when it is destroyed. Scopes nest; with a null pool, a scope does nothing.
+// OpenBLAS threads are process-wide and not affected.
+class MATH_API CPUThreadScope
+{
+public:
+    explicit CPUThreadScope(CPUPrivateThreadPool* pool);
+    ~CPUThreadScope();
+
+private:
+    CPUThreadScope(const CPUThreadScope&) = delete;
+    CPUThreadScope& operator=(const CPUThreadScope&) = delete;
+
+    CPUPrivateThreadPool* m_pool;
+    void* m_previousPool;
+    int m_previousNumOmpThreads;
+    int m_previousNumMklThreads;
+    std::vector<size_t> m_previousCores; // affinity of the thread before the scope, if it was pinned
+};
+
+}}}
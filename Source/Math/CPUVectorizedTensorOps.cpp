@@ -0,0 +1,404 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorizedTensorOps.cpp -- AVX2/AVX-512 kernels for CPUMatrix::TensorOp(), selected at runtime (see CPUVectorizedTensorOps.h)
+//
+// Structure:
+//  - per instruction set and element type, a traits struct wraps the intrinsics we need (Load, Add, CmpLt, Select, ...);
+//    these are compiled for their instruction set only (GCC: '#pragma GCC target'), the detection code is not
+//  - the ops and loops are written once against the traits (CPUVectorizedTensorOpsKernels.h), and that file is included
+//    into each instruction set's namespace, inside its '#pragma GCC target' region, so no code crosses targets.
+//
+
+#include "stdafx.h"
+#include "CPUVectorizedTensorOps.h"
+#include "TensorOps.h"
+#include <limits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VECTORIZED_TENSOR_OPS
+#if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1911) // AVX-512 intrinsics need VS 2017 15.3 or GCC
+#define VECTORIZED_TENSOR_OPS_AVX512
+#endif
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef __GNUC__
+#define VECTOR_INLINE static inline __attribute__((always_inline))
+#else
+#define VECTOR_INLINE static __forceinline
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// instruction set detection
+// -----------------------------------------------------------------------
+
+static CPUVectorInstructionSet DetectCPUVectorInstructionSet()
+{
+#ifndef VECTORIZED_TENSOR_OPS
+    return CPUVectorInstructionSet::None;
+#else
+    bool haveAVX2, haveAVX512;
+#ifdef __GNUC__
+    __builtin_cpu_init(); // (this also checks that the OS saves the register state, via XGETBV)
+    haveAVX2 = __builtin_cpu_supports("avx2") != 0;
+    haveAVX512 = __builtin_cpu_supports("avx512f") != 0;
+#else
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return CPUVectorInstructionSet::None;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx)
+        return CPUVectorInstructionSet::None;
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    haveAVX2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x06) == 0x06;     // XMM and YMM state
+    haveAVX512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6; // ... plus opmask and ZMM state
+#endif
+#ifdef VECTORIZED_TENSOR_OPS_AVX512
+    if (haveAVX512)
+        return CPUVectorInstructionSet::AVX512;
+#else
+    UNUSED(haveAVX512);
+#endif
+    return haveAVX2 ? CPUVectorInstructionSet::AVX2 : CPUVectorInstructionSet::None;
+#endif
+}
+
+static CPUVectorInstructionSet s_cpuVectorInstructionSet = DetectCPUVectorInstructionSet();
+
+CPUVectorInstructionSet GetCPUVectorInstructionSet()
+{
+    return s_cpuVectorInstructionSet;
+}
+
+void LimitCPUVectorInstructionSet(CPUVectorInstructionSet maxInstructionSet)
+{
+    s_cpuVectorInstructionSet = DetectCPUVectorInstructionSet();
+    if ((int) s_cpuVectorInstructionSet > (int) maxInstructionSet)
+        s_cpuVectorInstructionSet = maxInstructionSet;
+}
+
+// -----------------------------------------------------------------------
+// approximate math (see CPUApproximateMathScope)
+// -----------------------------------------------------------------------
+
+static thread_local bool t_approximateMath = false;
+
+CPUApproximateMathScope::CPUApproximateMathScope(bool enable)
+    : m_previous(t_approximateMath)
+{
+    if (enable)
+        t_approximateMath = true;
+}
+
+CPUApproximateMathScope::~CPUApproximateMathScope()
+{
+    t_approximateMath = m_previous;
+}
+
+bool IsCPUApproximateMathEnabled()
+{
+    return t_approximateMath;
+}
+
+#ifdef VECTORIZED_TENSOR_OPS
+
+// ops that have a vectorized version (see CPUVectorizedTensorOpsKernels.h)
+#define ForAllVectorizedUnaryOps(Macro) \
+    Macro(Copy);                        \
+    Macro(Negate);                      \
+    Macro(Abs);                         \
+    Macro(Sqr);                         \
+    Macro(Sqrt);                        \
+    Macro(LinearRectifier);             \
+    Macro(Reciprocal);
+
+#define ForAllVectorizedBinaryOps(Macro)                              \
+    Macro(CopyIf);                                                    \
+    Macro(CopyIfNot);                                                 \
+    Macro(Sum);                                                       \
+    Macro(Difference);                                                \
+    Macro(ElementwiseProduct);                                        \
+    Macro(ElementwiseQuotient);                                       \
+    Macro(Max);                                                       \
+    Macro(Min);                                                       \
+    Macro(MaskNegative);                                              \
+    Macro(ElementwiseProductWithSigmoidDerivativeFromOutput);         \
+    Macro(ElementwiseProductWithTanhDerivativeFromOutput);            \
+    Macro(ElementwiseProductWithLinearRectifierDerivativeFromOutput); \
+    Macro(ElementwiseProductWithReciprocalDerivative);                \
+    Macro(ElementwiseProductWithSqrtDerivative);                      \
+    Macro(SqrOfDifference);
+
+// ops that have an approximate version, for float only (see CPUApproximateMathScope)
+#define ForAllApproximateUnaryOps(Macro) \
+    Macro(Exp);                          \
+    Macro(Log);                          \
+    Macro(Sigmoid);                      \
+    Macro(Tanh);
+
+#define ForAllVectorizedTernaryOps(Macro) \
+    Macro(Cond);                          \
+    Macro(CopyIfEqual);                   \
+    Macro(Clip);
+
+// -----------------------------------------------------------------------
+// instruction-set traits and kernels
+// Each Traits<ElemType> provides: E (element type), V (vector), M (comparison mask), D (double accumulator),
+// W (elements per vector), and the operations used by CPUVectorizedTensorOpsKernels.h, which is then
+// included (and thus compiled) once per instruction set, into the namespace of that instruction set.
+// -----------------------------------------------------------------------
+
+#ifdef __GNUC__
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace AVX2 {
+
+template <class ElemType> struct Traits;
+
+template <>
+struct Traits<float>
+{
+    typedef float E; typedef __m256 V; typedef __m256 M; typedef __m256d D;
+    static const size_t W = 8;
+    VECTOR_INLINE V Load(const E* p)            { return _mm256_loadu_ps(p); }
+    VECTOR_INLINE void Store(E* p, V v)         { _mm256_storeu_ps(p, v); }
+    VECTOR_INLINE V Set1(E x)                   { return _mm256_set1_ps(x); }
+    VECTOR_INLINE V Zero()                      { return _mm256_setzero_ps(); }
+    VECTOR_INLINE V Add(V a, V b)               { return _mm256_add_ps(a, b); }
+    VECTOR_INLINE V Sub(V a, V b)               { return _mm256_sub_ps(a, b); }
+    VECTOR_INLINE V Mul(V a, V b)               { return _mm256_mul_ps(a, b); }
+    VECTOR_INLINE V Div(V a, V b)               { return _mm256_div_ps(a, b); }
+    VECTOR_INLINE V Max(V a, V b)               { return _mm256_max_ps(a, b); } // = a > b ? a : b, also for NaN
+    VECTOR_INLINE V Min(V a, V b)               { return _mm256_min_ps(a, b); } // = a < b ? a : b, also for NaN
+    VECTOR_INLINE V Sqrt(V a)                   { return _mm256_sqrt_ps(a); }
+    VECTOR_INLINE V Neg(V a)                    { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    VECTOR_INLINE V Abs(V a)                    { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    VECTOR_INLINE M CmpEq(V a, V b)             { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    VECTOR_INLINE M CmpNeq(V a, V b)            { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+    VECTOR_INLINE M CmpLt(V a, V b)             { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    VECTOR_INLINE M CmpGt(V a, V b)             { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    VECTOR_INLINE M CmpGe(V a, V b)             { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    VECTOR_INLINE V Select(M m, V t, V f)       { return _mm256_blendv_ps(f, t, m); }
+    // for the approximations: rounding to the nearest integer, 2^n for integral n in [-126, 127], and for normalized a > 0
+    // floor(log2(a)) and the mantissa in [1, 2)
+    VECTOR_INLINE V Round(V a)                  { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    VECTOR_INLINE V Pow2(V n)                   { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)); }
+    VECTOR_INLINE V Exponent(V a)               { return _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(a), 23), _mm256_set1_epi32(127))); }
+    VECTOR_INLINE V Mantissa(V a)               { return _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(_mm256_castps_si256(a), _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000))); }
+    VECTOR_INLINE D DZero()                     { return _mm256_setzero_pd(); }
+    VECTOR_INLINE void Accumulate(D& acc0, D& acc1, V v)
+    {
+        acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+        acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    }
+    VECTOR_INLINE double HorizontalSum(D d)
+    {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(d), _mm256_extractf128_pd(d, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+};
+
+template <>
+struct Traits<double>
+{
+    typedef double E; typedef __m256d V; typedef __m256d M; typedef __m256d D;
+    static const size_t W = 4;
+    VECTOR_INLINE V Load(const E* p)            { return _mm256_loadu_pd(p); }
+    VECTOR_INLINE void Store(E* p, V v)         { _mm256_storeu_pd(p, v); }
+    VECTOR_INLINE V Set1(E x)                   { return _mm256_set1_pd(x); }
+    VECTOR_INLINE V Zero()                      { return _mm256_setzero_pd(); }
+    VECTOR_INLINE V Add(V a, V b)               { return _mm256_add_pd(a, b); }
+    VECTOR_INLINE V Sub(V a, V b)               { return _mm256_sub_pd(a, b); }
+    VECTOR_INLINE V Mul(V a, V b)               { return _mm256_mul_pd(a, b); }
+    VECTOR_INLINE V Div(V a, V b)               { return _mm256_div_pd(a, b); }
+    VECTOR_INLINE V Max(V a, V b)               { return _mm256_max_pd(a, b); }
+    VECTOR_INLINE V Min(V a, V b)               { return _mm256_min_pd(a, b); }
+    VECTOR_INLINE V Sqrt(V a)                   { return _mm256_sqrt_pd(a); }
+    VECTOR_INLINE V Neg(V a)                    { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+    VECTOR_INLINE V Abs(V a)                    { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    VECTOR_INLINE M CmpEq(V a, V b)             { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    VECTOR_INLINE M CmpNeq(V a, V b)            { return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); }
+    VECTOR_INLINE M CmpLt(V a, V b)             { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    VECTOR_INLINE M CmpGt(V a, V b)             { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    VECTOR_INLINE M CmpGe(V a, V b)             { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    VECTOR_INLINE V Select(M m, V t, V f)       { return _mm256_blendv_pd(f, t, m); }
+    VECTOR_INLINE D DZero()                     { return _mm256_setzero_pd(); }
+    VECTOR_INLINE void Accumulate(D& acc0, D& /*acc1*/, V v) { acc0 = _mm256_add_pd(acc0, v); }
+    VECTOR_INLINE double HorizontalSum(D d)
+    {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(d), _mm256_extractf128_pd(d, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+};
+
+#include "CPUVectorizedTensorOpsKernels.h"
+
+} // namespace AVX2
+
+#ifdef __GNUC__
+#pragma GCC pop_options
+#endif
+
+#ifdef VECTORIZED_TENSOR_OPS_AVX512
+
+#ifdef __GNUC__
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#pragma GCC optimize("fp-contract=off") // no FMA contraction: results must match the scalar code bit by bit
+#endif
+
+namespace AVX512 {
+
+template <class ElemType> struct Traits;
+
+// Note: only AVX-512F is assumed, hence the bitwise ops go through the integer unit.
+template <>
+struct Traits<float>
+{
+    typedef float E; typedef __m512 V; typedef __mmask16 M; typedef __m512d D;
+    static const size_t W = 16;
+    VECTOR_INLINE V Load(const E* p)            { return _mm512_loadu_ps(p); }
+    VECTOR_INLINE void Store(E* p, V v)         { _mm512_storeu_ps(p, v); }
+    VECTOR_INLINE V Set1(E x)                   { return _mm512_set1_ps(x); }
+    VECTOR_INLINE V Zero()                      { return _mm512_setzero_ps(); }
+    VECTOR_INLINE V Add(V a, V b)               { return _mm512_add_ps(a, b); }
+    VECTOR_INLINE V Sub(V a, V b)               { return _mm512_sub_ps(a, b); }
+    VECTOR_INLINE V Mul(V a, V b)               { return _mm512_mul_ps(a, b); }
+    VECTOR_INLINE V Div(V a, V b)               { return _mm512_div_ps(a, b); }
+    VECTOR_INLINE V Max(V a, V b)               { return _mm512_max_ps(a, b); }
+    VECTOR_INLINE V Min(V a, V b)               { return _mm512_min_ps(a, b); }
+    VECTOR_INLINE V Sqrt(V a)                   { return _mm512_sqrt_ps(a); }
+    VECTOR_INLINE V Neg(V a)                    { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32((int) 0x80000000))); }
+    VECTOR_INLINE V Abs(V a)                    { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff))); }
+    VECTOR_INLINE M CmpEq(V a, V b)             { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+    VECTOR_INLINE M CmpNeq(V a, V b)            { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ); }
+    VECTOR_INLINE M CmpLt(V a, V b)             { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    VECTOR_INLINE M CmpGt(V a, V b)             { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    VECTOR_INLINE M CmpGe(V a, V b)             { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+    VECTOR_INLINE V Select(M m, V t, V f)       { return _mm512_mask_blend_ps(m, f, t); }
+    VECTOR_INLINE V Round(V a)                  { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    VECTOR_INLINE V Pow2(V n)                   { return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23)); }
+    VECTOR_INLINE V Exponent(V a)               { return _mm512_getexp_ps(a); }
+    VECTOR_INLINE V Mantissa(V a)               { return _mm512_getmant_ps(a, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_src); }
+    VECTOR_INLINE D DZero()                     { return _mm512_setzero_pd(); }
+    VECTOR_INLINE void Accumulate(D& acc0, D& acc1, V v)
+    {
+        acc0 = _mm512_add_pd(acc0, _mm512_cvtps_pd(_mm512_castps512_ps256(v)));
+        acc1 = _mm512_add_pd(acc1, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1))));
+    }
+    VECTOR_INLINE double HorizontalSum(D d)
+    {
+        double lanes[8];
+        _mm512_storeu_pd(lanes, d);
+        return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    }
+};
+
+template <>
+struct Traits<double>
+{
+    typedef double E; typedef __m512d V; typedef __mmask8 M; typedef __m512d D;
+    static const size_t W = 8;
+    VECTOR_INLINE V Load(const E* p)            { return _mm512_loadu_pd(p); }
+    VECTOR_INLINE void Store(E* p, V v)         { _mm512_storeu_pd(p, v); }
+    VECTOR_INLINE V Set1(E x)                   { return _mm512_set1_pd(x); }
+    VECTOR_INLINE V Zero()                      { return _mm512_setzero_pd(); }
+    VECTOR_INLINE V Add(V a, V b)               { return _mm512_add_pd(a, b); }
+    VECTOR_INLINE V Sub(V a, V b)               { return _mm512_sub_pd(a, b); }
+    VECTOR_INLINE V Mul(V a, V b)               { return _mm512_mul_pd(a, b); }
+    VECTOR_INLINE V Div(V a, V b)               { return _mm512_div_pd(a, b); }
+    VECTOR_INLINE V Max(V a, V b)               { return _mm512_max_pd(a, b); }
+    VECTOR_INLINE V Min(V a, V b)               { return _mm512_min_pd(a, b); }
+    VECTOR_INLINE V Sqrt(V a)                   { return _mm512_sqrt_pd(a); }
+    VECTOR_INLINE V Neg(V a)                    { return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_set1_epi64((long long) 0x8000000000000000ULL))); }
+    VECTOR_INLINE V Abs(V a)                    { return _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a), _mm512_set1_epi64(0x7fffffffffffffffLL))); }
+    VECTOR_INLINE M CmpEq(V a, V b)             { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    VECTOR_INLINE M CmpNeq(V a, V b)            { return _mm512_cmp_pd_mask(a, b, _CMP_NEQ_UQ); }
+    VECTOR_INLINE M CmpLt(V a, V b)             { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    VECTOR_INLINE M CmpGt(V a, V b)             { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+    VECTOR_INLINE M CmpGe(V a, V b)             { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+    VECTOR_INLINE V Select(M m, V t, V f)       { return _mm512_mask_blend_pd(m, f, t); }
+    VECTOR_INLINE D DZero()                     { return _mm512_setzero_pd(); }
+    VECTOR_INLINE void Accumulate(D& acc0, D& /*acc1*/, V v) { acc0 = _mm512_add_pd(acc0, v); }
+    VECTOR_INLINE double HorizontalSum(D d)
+    {
+        double lanes[8];
+        _mm512_storeu_pd(lanes, d);
+        return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    }
+};
+
+#include "CPUVectorizedTensorOpsKernels.h"
+
+} // namespace AVX512
+
+#ifdef __GNUC__
+#pragma GCC pop_options
+#endif
+
+#endif // VECTORIZED_TENSOR_OPS_AVX512
+
+#endif // VECTORIZED_TENSOR_OPS
+
+template <class ElemType>
+CPUVectorizedTensorOpKernel<ElemType> GetCPUVectorizedTensorOpKernel(ElementWiseOperator op, size_t N)
+{
+    if (t_approximateMath)
+    {
+        switch (s_cpuVectorInstructionSet)
+        {
+#ifdef VECTORIZED_TENSOR_OPS_AVX512
+        case CPUVectorInstructionSet::AVX512: if (auto kernel = AVX512::GetApproximateElementwiseKernel<ElemType>(op, N)) return kernel; break;
+#endif
+#ifdef VECTORIZED_TENSOR_OPS
+        case CPUVectorInstructionSet::AVX2:   if (auto kernel = AVX2::GetApproximateElementwiseKernel<ElemType>(op, N)) return kernel; break;
+#endif
+        default:                              break;
+        }
+    }
+    switch (s_cpuVectorInstructionSet)
+    {
+#ifdef VECTORIZED_TENSOR_OPS_AVX512
+    case CPUVectorInstructionSet::AVX512: return AVX512::GetElementwiseKernel<ElemType>(op, N);
+#endif
+#ifdef VECTORIZED_TENSOR_OPS
+    case CPUVectorInstructionSet::AVX2:   return AVX2::GetElementwiseKernel<ElemType>(op, N);
+#endif
+    default:                              return nullptr;
+    }
+}
+
+template <class ElemType>
+CPUVectorizedReductionKernel<ElemType> GetCPUVectorizedReductionKernel(ElementWiseOperator op, size_t N)
+{
+    switch (s_cpuVectorInstructionSet)
+    {
+#ifdef VECTORIZED_TENSOR_OPS_AVX512
+    case CPUVectorInstructionSet::AVX512: return AVX512::GetReductionKernel<ElemType>(op, N);
+#endif
+#ifdef VECTORIZED_TENSOR_OPS
+    case CPUVectorInstructionSet::AVX2:   return AVX2::GetReductionKernel<ElemType>(op, N);
+#endif
+    default:                              return nullptr;
+    }
+}
+
+template CPUVectorizedTensorOpKernel<float> GetCPUVectorizedTensorOpKernel<float>(ElementWiseOperator, size_t);
+template CPUVectorizedTensorOpKernel<double> GetCPUVectorizedTensorOpKernel<double>(ElementWiseOperator, size_t);
+template CPUVectorizedReductionKernel<float> GetCPUVectorizedReductionKernel<float>(ElementWiseOperator, size_t);
+template CPUVectorizedReductionKernel<double> GetCPUVectorizedReductionKernel<double>(ElementWiseOperator, size_t);
+
+}}}
@@ -0,0 +1,74 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorizedTensorOps.h -- explicitly vectorized (AVX2, AVX-512) innermost loops for CPUMatrix::TensorOp()
+//
+// The kernels process n contiguous elements of each operand. The instruction set is chosen once at runtime
+// from CPUID, so the same binary runs on machines with and without AVX2/AVX-512; if neither is available,
+// no kernels are returned and CPUMatrix::TensorOp() uses its generic (scalar) loops.
+//
+// Only ops whose vectorized result is bit-identical to the scalar TensorOps.h implementation are covered,
+// i.e. arithmetic, comparison and selection ops, but not the transcendental ones (exp, log, tanh, ...).
+// Reductions accumulate in double, like the scalar code, but in a different order.
+//
+// The exception are opt-in polynomial approximations of Exp, Log, Sigmoid and Tanh for float, with a relative error
+// of about 1e-6 (for results that are normalized floats), see CPUApproximateMathScope. They are meant for inference
+// and never used by default, so training numerics are not affected.
+//
+
+#pragma once
+
+#include "CommonMatrix.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+enum class CPUVectorInstructionSet
+{
+    None,   // no supported vector instruction set: scalar code only
+    AVX2,
+    AVX512,
+};
+
+// instruction set that the kernels use on this machine
+MATH_API CPUVectorInstructionSet GetCPUVectorInstructionSet();
+
+// cap the instruction set used by the kernels below what the machine supports (e.g. None to force the scalar code path)
+MATH_API void LimitCPUVectorInstructionSet(CPUVectorInstructionSet maxInstructionSet);
+
+// While an object of this exists, the kernels returned to the thread that created it (e.g. an evaluator evaluating,
+// see CNTKEval's approximateMath) compute Exp, Log, Sigmoid and Tanh of floats by the approximations instead of
+// falling back to the exact scalar code. Scopes nest; with enable = false, a scope does nothing.
+class MATH_API CPUApproximateMathScope
+{
+public:
+    explicit CPUApproximateMathScope(bool enable);
+    ~CPUApproximateMathScope();
+
+private:
+    CPUApproximateMathScope(const CPUApproximateMathScope&) = delete;
+    CPUApproximateMathScope& operator=(const CPUApproximateMathScope&) = delete;
+
+    bool m_previous;
+};
+
+// whether the calling thread is in an enabled CPUApproximateMathScope
+MATH_API bool IsCPUApproximateMathEnabled();
+
+// elementwise kernel over n contiguous elements, N = number of operands counting the output:
+// pointers[N-1][i] = beta * pointers[N-1][i] + alpha * op(pointers[0][i], ..., pointers[N-2][i])
+template <class ElemType>
+using CPUVectorizedTensorOpKernel = void (*)(ElemType beta, ElemType* const* pointers, ElemType alpha, size_t n);
+
+// reduction kernel over n contiguous elements of the N-1 inputs: returns sum_i op(pointers[0][i], ..., pointers[N-2][i])
+template <class ElemType>
+using CPUVectorizedReductionKernel = double (*)(ElemType* const* pointers, size_t n);
+
+// get the kernel for an N-ary op, or nullptr if the op has no vectorized version or the machine has no usable instruction set
+template <class ElemType>
+CPUVectorizedTensorOpKernel<ElemType> GetCPUVectorizedTensorOpKernel(ElementWiseOperator op, size_t N);
+
+template <class ElemType>
+CPUVectorizedReductionKernel<ElemType> GetCPUVectorizedReductionKernel(ElementWiseOperator op, size_t N);
+
+}}}
@@ -0,0 +1,353 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorizedTensorOpsKernels.h -- instruction-set independent part of CPUVectorizedTensorOps.cpp
+//
+// This file is included by CPUVectorizedTensorOps.cpp once per instruction set, inside that instruction set's
+// namespace and '#pragma GCC target' region, after the definition of Traits<float> and Traits<double>.
+// Do not include it anywhere else.
+//
+
+// (no #pragma once: this is included multiple times on purpose)
+
+// -----------------------------------------------------------------------
+// vectorized ops
+// Each mirrors the definition of the same-named op in TensorOps.h exactly (including NaN and signed-zero behavior),
+// and uses the scalar version for the loop remainder.
+// -----------------------------------------------------------------------
+
+#pragma push_macro("DefVectorUnaryOp")
+#define DefVectorUnaryOp(op, expr)                                                                    \
+    struct VectorOp##op                                                                               \
+    {                                                                                                 \
+        template <class T>                                                                            \
+        VECTOR_INLINE typename T::V Vector(typename T::V a) { return expr; }                          \
+        template <class E>                                                                            \
+        VECTOR_INLINE E Scalar(E a) { return Op##op(a); }                                             \
+    }
+
+DefVectorUnaryOp(Copy, a);
+DefVectorUnaryOp(Negate, T::Neg(a));
+DefVectorUnaryOp(Abs, T::Abs(a));
+DefVectorUnaryOp(Sqr, T::Mul(a, a));
+DefVectorUnaryOp(Sqrt, T::Sqrt(T::Max(a, T::Zero())));
+DefVectorUnaryOp(LinearRectifier, T::Max(a, T::Zero()));
+DefVectorUnaryOp(Reciprocal, T::Select(T::CmpEq(a, T::Zero()), T::Zero(), T::Div(T::Set1(1), a)));
+#pragma pop_macro("DefVectorUnaryOp")
+
+#pragma push_macro("DefVectorBinaryOp")
+#define DefVectorBinaryOp(op, expr)                                                                   \
+    struct VectorOp##op                                                                               \
+    {                                                                                                 \
+        template <class T>                                                                            \
+        VECTOR_INLINE typename T::V Vector(typename T::V a, typename T::V b) { return expr; }         \
+        template <class E>                                                                            \
+        VECTOR_INLINE E Scalar(E a, E b) { return Op##op(a, b); }                                     \
+    }
+
+// ClippedQuotient(): denominators with |b| < EPS_IN_INVERSE are replaced by +-EPS_IN_INVERSE
+struct VectorOpElementwiseQuotient
+{
+    template <class T>
+    VECTOR_INLINE typename T::V Vector(typename T::V a, typename T::V b)
+    {
+        typedef typename T::E E;
+        typename T::V clippedB = T::Select(T::CmpGt(b, T::Zero()), T::Set1((E) EPS_IN_INVERSE), T::Set1(-(E) EPS_IN_INVERSE));
+        return T::Div(a, T::Select(T::CmpLt(T::Abs(b), T::Set1((E) EPS_IN_INVERSE)), clippedB, b));
+    }
+    template <class E>
+    VECTOR_INLINE E Scalar(E a, E b) { return OpElementwiseQuotient(a, b); }
+};
+
+DefVectorBinaryOp(CopyIf, T::Select(T::CmpNeq(a, T::Zero()), b, T::Zero()));
+DefVectorBinaryOp(CopyIfNot, T::Select(T::CmpEq(a, T::Zero()), b, T::Zero()));
+DefVectorBinaryOp(Sum, T::Add(a, b));
+DefVectorBinaryOp(Difference, T::Sub(a, b));
+DefVectorBinaryOp(ElementwiseProduct, T::Mul(a, b));
+DefVectorBinaryOp(Max, T::Max(a, b));
+DefVectorBinaryOp(Min, T::Min(a, b));
+DefVectorBinaryOp(MaskNegative, T::Select(T::CmpGe(b, T::Zero()), a, T::Zero()));
+DefVectorBinaryOp(ElementwiseProductWithSigmoidDerivativeFromOutput, T::Mul(a, T::Mul(b, T::Sub(T::Set1(1), b))));
+DefVectorBinaryOp(ElementwiseProductWithTanhDerivativeFromOutput, T::Mul(a, T::Sub(T::Set1(1), T::Mul(b, b))));
+DefVectorBinaryOp(ElementwiseProductWithLinearRectifierDerivativeFromOutput, T::Select(T::CmpGt(b, T::Zero()), a, T::Zero()));
+DefVectorBinaryOp(ElementwiseProductWithReciprocalDerivative, T::Mul(a, T::Neg(T::Mul(b, b))));
+DefVectorBinaryOp(ElementwiseProductWithSqrtDerivative, T::Div(a, T::Mul(T::Set1(2), b)));
+DefVectorBinaryOp(SqrOfDifference, T::Mul(T::Sub(a, b), T::Sub(a, b)));
+#pragma pop_macro("DefVectorBinaryOp")
+
+#pragma push_macro("DefVectorTernaryOp")
+#define DefVectorTernaryOp(op, expr)                                                                  \
+    struct VectorOp##op                                                                               \
+    {                                                                                                 \
+        template <class T>                                                                            \
+        VECTOR_INLINE typename T::V Vector(typename T::V a, typename T::V b, typename T::V c) { return expr; } \
+        template <class E>                                                                            \
+        VECTOR_INLINE E Scalar(E a, E b, E c) { return Op##op(a, b, c); }                             \
+    }
+
+DefVectorTernaryOp(Cond, T::Select(T::CmpNeq(a, T::Zero()), b, c));
+DefVectorTernaryOp(CopyIfEqual, T::Select(T::CmpEq(a, b), c, T::Zero()));
+DefVectorTernaryOp(Clip, T::Select(T::CmpLt(c, a), a, T::Select(T::CmpGt(c, b), b, c)));
+#pragma pop_macro("DefVectorTernaryOp")
+
+// -----------------------------------------------------------------------
+// approximate ops (float only, see CPUApproximateMathScope)
+// Polynomial and rational approximations in the style of Cephes and Eigen, with a relative error of about 1e-6 where
+// the result is a normalized float. NaNs are passed on. Unlike the ops above, the loop remainder uses the exact op.
+// -----------------------------------------------------------------------
+
+// exp(a) = 2^n exp(r), with n = round(a / ln 2) and |r| <= ln(2) / 2; 2^n is applied in two halves, as n may be 128
+template <class T>
+VECTOR_INLINE typename T::V ApproximateExp(typename T::V a)
+{
+    typedef typename T::V V;
+    const V minArg = T::Set1(-87.33654f); // (below, exp(a) is not a normalized float)
+    const V maxArg = T::Set1(88.72283f);
+    V x = T::Min(T::Max(a, minArg), maxArg);
+    V n = T::Round(T::Mul(x, T::Set1(1.44269504088896341f)));
+    V r = T::Sub(T::Sub(x, T::Mul(n, T::Set1(0.693359375f))), T::Mul(n, T::Set1(-2.12194440e-4f))); // (ln 2 in two parts)
+    V p = T::Set1(1.9875691500e-4f);
+    p = T::Add(T::Mul(p, r), T::Set1(1.3981999507e-3f));
+    p = T::Add(T::Mul(p, r), T::Set1(8.3334519073e-3f));
+    p = T::Add(T::Mul(p, r), T::Set1(4.1665795894e-2f));
+    p = T::Add(T::Mul(p, r), T::Set1(1.6666665459e-1f));
+    p = T::Add(T::Mul(p, r), T::Set1(5.0000001201e-1f));
+    V y = T::Add(T::Add(T::Mul(T::Mul(p, r), r), r), T::Set1(1.0f));
+    V n1 = T::Round(T::Mul(n, T::Set1(0.5f)));
+    y = T::Mul(T::Mul(y, T::Pow2(n1)), T::Pow2(T::Sub(n, n1)));
+    y = T::Select(T::CmpLt(a, minArg), T::Zero(), y);
+    y = T::Select(T::CmpGt(a, maxArg), T::Set1(std::numeric_limits<float>::infinity()), y);
+    return T::Select(T::CmpNeq(a, a), a, y);
+}
+
+// ClippedLog(a): log(a) = e ln 2 + log(1 + x), with a = 2^e (1 + x) and 1 + x in [sqrt(1/2), sqrt(2))
+template <class T>
+VECTOR_INLINE typename T::V ApproximateLog(typename T::V a)
+{
+    typedef typename T::V V;
+    V x = T::Max(a, T::Set1((float) EPS_IN_LOG));
+    V e = T::Exponent(x);
+    V m = T::Mantissa(x);
+    auto isLarge = T::CmpGt(m, T::Set1(1.41421356237f));
+    m = T::Select(isLarge, T::Mul(m, T::Set1(0.5f)), m);
+    e = T::Select(isLarge, T::Add(e, T::Set1(1.0f)), e);
+    x = T::Sub(m, T::Set1(1.0f));
+    V z = T::Mul(x, x);
+    V p = T::Set1(7.0376836292e-2f);
+    p = T::Add(T::Mul(p, x), T::Set1(-1.1514610310e-1f));
+    p = T::Add(T::Mul(p, x), T::Set1(1.1676998740e-1f));
+    p = T::Add(T::Mul(p, x), T::Set1(-1.2420140846e-1f));
+    p = T::Add(T::Mul(p, x), T::Set1(1.4249322787e-1f));
+    p = T::Add(T::Mul(p, x), T::Set1(-1.6668057665e-1f));
+    p = T::Add(T::Mul(p, x), T::Set1(2.0000714765e-1f));
+    p = T::Add(T::Mul(p, x), T::Set1(-2.4999993993e-1f));
+    p = T::Add(T::Mul(p, x), T::Set1(3.3333331174e-1f));
+    V y = T::Mul(T::Mul(p, x), z);
+    y = T::Add(y, T::Mul(e, T::Set1(-2.12194440e-4f)));
+    y = T::Sub(y, T::Mul(z, T::Set1(0.5f)));
+    V result = T::Add(T::Add(x, y), T::Mul(e, T::Set1(0.693359375f)));
+    result = T::Select(T::CmpLt(a, T::Set1((float) EPS_IN_LOG)), T::Set1((float) LOG_OF_EPS_IN_LOG), result);
+    result = T::Select(T::CmpEq(a, T::Set1(std::numeric_limits<float>::infinity())), a, result);
+    return T::Select(T::CmpNeq(a, a), a, result);
+}
+
+// Sigmoid(a) = 1 / (1 + exp(-a)), computed from exp(-|a|), which does not overflow
+template <class T>
+VECTOR_INLINE typename T::V ApproximateSigmoid(typename T::V a)
+{
+    typedef typename T::V V;
+    V e = ApproximateExp<T>(T::Neg(T::Abs(a)));
+    V s = T::Div(T::Set1(1.0f), T::Add(e, T::Set1(1.0f)));
+    return T::Select(T::CmpGe(a, T::Zero()), s, T::Mul(e, s));
+}
+
+// tanh(a) as a 13/6 degree rational function on [-7.9, 7.9], where it reaches +-1 in float; tanh(a) = a for tiny a
+template <class T>
+VECTOR_INLINE typename T::V ApproximateTanh(typename T::V a)
+{
+    typedef typename T::V V;
+    V x = T::Min(T::Max(a, T::Set1(-7.90531110763549805f)), T::Set1(7.90531110763549805f));
+    V x2 = T::Mul(x, x);
+    V p = T::Set1(-2.76076847742355e-16f);
+    p = T::Add(T::Mul(p, x2), T::Set1(2.00018790482477e-13f));
+    p = T::Add(T::Mul(p, x2), T::Set1(-8.60467152213735e-11f));
+    p = T::Add(T::Mul(p, x2), T::Set1(5.12229709037114e-08f));
+    p = T::Add(T::Mul(p, x2), T::Set1(1.48572235717979e-05f));
+    p = T::Add(T::Mul(p, x2), T::Set1(6.37261928875436e-04f));
+    p = T::Add(T::Mul(p, x2), T::Set1(4.89352455891786e-03f));
+    p = T::Mul(p, x);
+    V q = T::Set1(1.19825839466702e-06f);
+    q = T::Add(T::Mul(q, x2), T::Set1(1.18534705686654e-04f));
+    q = T::Add(T::Mul(q, x2), T::Set1(2.26843463243900e-03f));
+    q = T::Add(T::Mul(q, x2), T::Set1(4.89352518554385e-03f));
+    V y = T::Select(T::CmpLt(T::Abs(a), T::Set1(0.0004f)), a, T::Div(p, q));
+    return T::Select(T::CmpNeq(a, a), a, y);
+}
+
+#pragma push_macro("DefApproximateUnaryOp")
+#define DefApproximateUnaryOp(op)                                                                     \
+    struct ApproximateOp##op                                                                          \
+    {                                                                                                 \
+        template <class T>                                                                            \
+        VECTOR_INLINE typename T::V Vector(typename T::V a) { return Approximate##op<T>(a); }         \
+        template <class E>                                                                            \
+        VECTOR_INLINE E Scalar(E a) { return Op##op(a); }                                             \
+    }
+
+DefApproximateUnaryOp(Exp);
+DefApproximateUnaryOp(Log);
+DefApproximateUnaryOp(Sigmoid);
+DefApproximateUnaryOp(Tanh);
+#pragma pop_macro("DefApproximateUnaryOp")
+
+// -----------------------------------------------------------------------
+// generic loops
+// -----------------------------------------------------------------------
+
+// apply an op to the N-1 inputs at offset i, as vector or as scalar
+template <class T, class OP, size_t N> struct ApplyOp;
+template <class T, class OP>
+struct ApplyOp<T, OP, 2>
+{
+    VECTOR_INLINE typename T::V Vector(typename T::E* const* p, size_t i) { return OP::template Vector<T>(T::Load(p[0] + i)); }
+    VECTOR_INLINE typename T::E Scalar(typename T::E* const* p, size_t i) { return OP::Scalar(p[0][i]); }
+};
+template <class T, class OP>
+struct ApplyOp<T, OP, 3>
+{
+    VECTOR_INLINE typename T::V Vector(typename T::E* const* p, size_t i) { return OP::template Vector<T>(T::Load(p[0] + i), T::Load(p[1] + i)); }
+    VECTOR_INLINE typename T::E Scalar(typename T::E* const* p, size_t i) { return OP::Scalar(p[0][i], p[1][i]); }
+};
+template <class T, class OP>
+struct ApplyOp<T, OP, 4>
+{
+    VECTOR_INLINE typename T::V Vector(typename T::E* const* p, size_t i) { return OP::template Vector<T>(T::Load(p[0] + i), T::Load(p[1] + i), T::Load(p[2] + i)); }
+    VECTOR_INLINE typename T::E Scalar(typename T::E* const* p, size_t i) { return OP::Scalar(p[0][i], p[1][i], p[2][i]); }
+};
+
+// same semantics as TensorOpIteration<..., -1 /*scalar*/>::Loop(): val = op(...) * alpha; if (beta != 0) val += beta * out
+template <class T, class OP, size_t N>
+VECTOR_INLINE void ElementwiseLoop(typename T::E beta, typename T::E* const* pointers, typename T::E alpha, size_t n)
+{
+    typedef typename T::E E;
+    typedef ApplyOp<T, OP, N> Apply;
+    E* pout = pointers[N - 1];
+    const typename T::V valpha = T::Set1(alpha);
+    size_t i = 0;
+    if (beta != 0)
+    {
+        const typename T::V vbeta = T::Set1(beta);
+        for (; i + T::W <= n; i += T::W)
+            T::Store(pout + i, T::Add(T::Mul(Apply::Vector(pointers, i), valpha), T::Mul(vbeta, T::Load(pout + i))));
+    }
+    else
+    {
+        for (; i + T::W <= n; i += T::W)
+            T::Store(pout + i, T::Mul(Apply::Vector(pointers, i), valpha));
+    }
+    for (; i < n; i++)
+    {
+        E val = Apply::Scalar(pointers, i) * alpha;
+        if (beta != 0)
+            val += beta * pout[i];
+        pout[i] = val;
+    }
+}
+
+// same semantics as TensorOpReduction<..., 0>::Loop(): sum in double of op(...) computed in ElemType
+template <class T, class OP, size_t N>
+VECTOR_INLINE double ReductionLoop(typename T::E* const* pointers, size_t n)
+{
+    typedef ApplyOp<T, OP, N> Apply;
+    typename T::D acc0 = T::DZero(), acc1 = T::DZero();
+    size_t i = 0;
+    for (; i + T::W <= n; i += T::W)
+        T::Accumulate(acc0, acc1, Apply::Vector(pointers, i));
+    double sum = T::HorizontalSum(acc0) + T::HorizontalSum(acc1);
+    for (; i < n; i++)
+        sum += Apply::Scalar(pointers, i);
+    return sum;
+}
+
+// -----------------------------------------------------------------------
+// kernels and their lookup
+// -----------------------------------------------------------------------
+
+template <class ElemType, class OP, size_t N>
+static void ElementwiseKernel(ElemType beta, ElemType* const* pointers, ElemType alpha, size_t n)
+{
+    ElementwiseLoop<Traits<ElemType>, OP, N>(beta, pointers, alpha, n);
+}
+
+template <class ElemType, class OP, size_t N>
+static double ReductionKernel(ElemType* const* pointers, size_t n)
+{
+    return ReductionLoop<Traits<ElemType>, OP, N>(pointers, n);
+}
+
+#pragma push_macro("CaseVectorizedKernel")
+#pragma push_macro("SwitchVectorizedKernels")
+#define CaseVectorizedKernel(KERNEL, oper, n) \
+    case ElementWiseOperator::op##oper:       \
+        return &KERNEL<ElemType, VectorOp##oper, n>
+#define CaseVectorizedUnaryKernel(oper)   CaseVectorizedKernel(KERNEL, oper, 2)
+#define CaseVectorizedBinaryKernel(oper)  CaseVectorizedKernel(KERNEL, oper, 3)
+#define CaseVectorizedTernaryKernel(oper) CaseVectorizedKernel(KERNEL, oper, 4)
+#define SwitchVectorizedKernels(N, op)                                                                           \
+    switch (N)                                                                                                   \
+    {                                                                                                            \
+    case 2: switch (op) { ForAllVectorizedUnaryOps(CaseVectorizedUnaryKernel);     default: break; } break;     \
+    case 3: switch (op) { ForAllVectorizedBinaryOps(CaseVectorizedBinaryKernel);   default: break; } break;     \
+    case 4: switch (op) { ForAllVectorizedTernaryOps(CaseVectorizedTernaryKernel); default: break; } break;     \
+    }
+
+template <class ElemType>
+static CPUVectorizedTensorOpKernel<ElemType> GetElementwiseKernel(ElementWiseOperator op, size_t N)
+{
+#define KERNEL ElementwiseKernel
+    SwitchVectorizedKernels(N, op);
+#undef KERNEL
+    return nullptr;
+}
+
+template <class ElemType>
+static CPUVectorizedReductionKernel<ElemType> GetReductionKernel(ElementWiseOperator op, size_t N)
+{
+#define KERNEL ReductionKernel
+    SwitchVectorizedKernels(N, op);
+#undef KERNEL
+    return nullptr;
+}
+
+// the approximate kernels exist for float only
+template <class ElemType>
+static CPUVectorizedTensorOpKernel<ElemType> GetApproximateElementwiseKernel(ElementWiseOperator, size_t)
+{
+    return nullptr;
+}
+
+#define CaseApproximateKernel(oper)     \
+    case ElementWiseOperator::op##oper: \
+        return &ElementwiseKernel<float, ApproximateOp##oper, 2>
+
+template <>
+CPUVectorizedTensorOpKernel<float> GetApproximateElementwiseKernel<float>(ElementWiseOperator op, size_t N)
+{
+    if (N == 2)
+    {
+        switch (op)
+        {
+        ForAllApproximateUnaryOps(CaseApproximateKernel);
+        default: break;
+        }
+    }
+    return nullptr;
+}
+
+#undef CaseApproximateKernel
+#undef CaseVectorizedUnaryKernel
+#undef CaseVectorizedBinaryKernel
+#undef CaseVectorizedTernaryKernel
+#pragma pop_macro("SwitchVectorizedKernels")
+#pragma pop_macro("CaseVectorizedKernel")
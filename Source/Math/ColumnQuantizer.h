@@ -137,7 +137,7 @@ public:
                 // quantize
                 size_t ij = ColMIDX(i, colIdx, M);
                 ElemType val = inMat[ij] + inResidual[ij];
-                QWordVal qval = valQ.Quantize<ZeroThresholdFor1Bit>(val);
+                QWordVal qval = valQ.template Quantize<ZeroThresholdFor1Bit>(val);
 
                 // compute residual
                 ElemType uval = valQ.Unquantize(qval);
@@ -17,6 +17,7 @@
 #include <string>
 #include <stdint.h>
 #include <memory>
+#include <vector>
 
 #pragma warning( disable: 4251 )
 typedef unsigned char byte;
@@ -40,15 +41,53 @@ typedef unsigned char byte;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// -----------------------------------------------------------------------
+// GPUMemoryCacheStatistics -- counters of the caching device allocator
+// A hit is an allocation served from a cached free buffer, a miss one that had to call cudaMalloc().
+// -----------------------------------------------------------------------
+
+struct GPUMemoryCacheStatistics
+{
+    size_t numHits;
+    size_t numMisses;
+    size_t numCachedBuffers; // free buffers currently held by the cache
+    size_t cachedBytes;      // bytes held by those buffers
+    size_t allocatedBytes;   // bytes of all buffers owned by the cache, in use or free
+    size_t peakInUseBytes;   // high-water mark of allocatedBytes - cachedBytes since the last ResetPeakInUseBytes()
+
+    GPUMemoryCacheStatistics() : numHits(0), numMisses(0), numCachedBuffers(0), cachedBytes(0), allocatedBytes(0), peakInUseBytes(0) { }
+};
+
+// a failed device memory allocation; unlike other CUDA failures, the device remains usable, and callers may recover,
+// e.g. by releasing cached memory and retrying with less data at a time
+class OutOfDeviceMemoryError : public std::runtime_error
+{
+public:
+    explicit OutOfDeviceMemoryError(const std::string& msg) : std::runtime_error(msg) { }
+};
+
 class MATH_API TracingGPUMemoryAllocator
 {
 private:
     static int m_traceLevel;
+    static bool m_cachingEnabled;
 
 public:
     static void SetTraceLevel(int traceLevel);
     static bool IsTraceEnabled();
 
+    // Freed device buffers are by default kept in per-device, size-binned free lists and reused
+    // by later allocations of the same size class, avoiding cudaMalloc()/cudaFree() and their implicit device syncs.
+    // Disabling caching releases nothing by itself; call ReleaseCachedMemory() for that.
+    static void SetCachingEnabled(bool cachingEnabled);
+    static bool IsCachingEnabled();
+
+    // return all cached free buffers of the given device to the CUDA runtime (also done automatically when cudaMalloc() runs out of memory)
+    static void ReleaseCachedMemory(int deviceId);
+    static GPUMemoryCacheStatistics GetCacheStatistics(int deviceId);
+    // restart the high-water mark from the bytes currently in use
+    static void ResetPeakInUseBytes(int deviceId);
+
     template <typename AllocatedElemType>
     static AllocatedElemType* Allocate(int deviceId, size_t numRows, size_t numCols);
 
@@ -65,6 +104,206 @@ private:
     static std::pair<size_t, size_t> GetFreeAndTotalMemoryInMBs(int deviceId);
 };
 
+// -----------------------------------------------------------------------
+// GPUStream, GPUEvent -- additional CUDA streams for running independent work concurrently
+// All GPU math (GPUMatrix, GPUSparseMatrix, TensorView, cuBLAS, cuSPARSE, cuDNN) is issued to the
+// current stream, which is initially the default stream. Independent branches of a network can
+// overlap on the GPU by making a different GPUStream current for each, and expressing dependencies
+// between the branches with GPUEvents. The streams are created as blocking streams, so that anything
+// issued to the default stream (e.g. synchronous copies, or nodes that do not know about streams)
+// still waits for all of them, and vice versa.
+// In CPU-only builds, these are no-ops.
+// -----------------------------------------------------------------------
+
+class MATH_API GPUStream
+{
+public:
+    GPUStream(DEVICEID_TYPE deviceId);
+    ~GPUStream();
+
+    DEVICEID_TYPE GetDeviceId() const { return m_deviceId; }
+
+    // issue all subsequent GPU work of this thread to this stream
+    void MakeCurrent() const;
+    // issue all subsequent GPU work of this thread to the default stream again
+    static void MakeDefaultCurrent();
+
+    // block the calling thread until all work issued to this stream so far has completed
+    void Synchronize() const;
+
+    DISABLE_COPY_AND_MOVE(GPUStream);
+
+private:
+    DEVICEID_TYPE m_deviceId;
+    void* m_stream; // cudaStream_t
+};
+
+class MATH_API GPUEvent
+{
+public:
+    // Events for timing GPU work must be created with 'enableTiming'; the others are cheaper to record and wait for.
+    GPUEvent(DEVICEID_TYPE deviceId, bool enableTiming = false);
+    ~GPUEvent();
+
+    // capture all work issued so far to the current stream
+    void Record();
+    // make all work issued from now on to the current stream wait for the captured work; does not block the calling thread
+    void MakeCurrentStreamWait() const;
+    // block the calling thread until the captured work has completed
+    void Synchronize() const;
+    // GPU time between the completion of the work captured by 'start' and by this event; both must have been
+    // created with 'enableTiming' and have completed (see Synchronize()). Returns 0 in CPU-only builds.
+    float ElapsedMillisecondsSince(const GPUEvent& start) const;
+
+    DISABLE_COPY_AND_MOVE(GPUEvent);
+
+private:
+    DEVICEID_TYPE m_deviceId;
+    void* m_event; // cudaEvent_t
+};
+
+// -----------------------------------------------------------------------
+// GPUGraph -- recording of a sequence of GPU work, for replaying it with a single launch (CUDA graphs)
+// Between BeginCapture() and EndCapture(), the GPU work this thread issues is recorded on a capture stream
+// instead of executed. Replay() then runs all of it at once, with the kernel arguments as they were captured,
+// i.e. on the same buffers and with the same scalars, which saves the launch overhead of the single kernels.
+// Anything in the captured work that must run on the host at that time, e.g. a synchronous copy from the
+// device, fails the capture. The buffers that the captured work frees (temporaries) stay reserved for the
+// graph until it is destroyed, since its replays reuse them.
+// Requires CUDA 10.1 or later; otherwise, and in CPU-only builds, IsSupported() is false.
+// -----------------------------------------------------------------------
+
+class MATH_API GPUGraph
+{
+public:
+    GPUGraph(DEVICEID_TYPE deviceId);
+    ~GPUGraph();
+
+    static bool IsSupported();
+
+    // make the capture stream current and start recording
+    void BeginCapture();
+    // stop recording and make the default stream current again
+    // Returns false if the work could not be captured; nothing of it has been executed either way.
+    bool EndCapture();
+    bool IsCaptured() const { return m_graph != nullptr; }
+
+    // run the captured work, ordered with the work on the default stream; does not block the calling thread
+    void Replay() const;
+
+    DISABLE_COPY_AND_MOVE(GPUGraph);
+
+private:
+    DEVICEID_TYPE m_deviceId;
+    void* m_stream;          // cudaStream_t
+    void* m_graph;           // cudaGraphExec_t, once captured
+    void* m_heldBuffers;     // buffers freed during the capture, see GPUMemoryCache
+};
+
+// -----------------------------------------------------------------------
+// PrefetchGPUDataTransferer -- asynchronous host-to-device upload of prefetched data (e.g. reader minibatches)
+// Host data is staged through a ring of pinned buffers (CUDAPageLockedMemAllocator) and copied with
+// cudaMemcpyAsync() on a dedicated non-blocking copy stream, into one device buffer per buffer id.
+// This lets the upload of minibatch N+1 run on a prefetch thread while minibatch N is being computed:
+//   prefetch thread: BeginBatch(); CopyCPUToGPUAsync() for each input; EndBatch();
+//   compute thread:  WaitForCopyCPUToGPUAsync(); consume the device buffers; RecordBuffersConsumed();
+// The device buffers are overwritten by the next batch, which waits on the GPU (not on the host) for
+// RecordBuffersConsumed(), so the compute thread must have issued all reads of them by then.
+// The implementation lives in GPUDataTransferer.cpp; in CPU-only builds it is a no-op.
+// -----------------------------------------------------------------------
+
+class MATH_API PrefetchGPUDataTransferer
+{
+public:
+    PrefetchGPUDataTransferer(DEVICEID_TYPE deviceId, size_t numPinnedBuffers = 2);
+    ~PrefetchGPUDataTransferer();
+
+    DEVICEID_TYPE GetDeviceId() const { return m_deviceId; }
+
+    // start staging a new batch in the next pinned buffer of the ring; blocks until that buffer's previous uploads have completed
+    void BeginBatch();
+    // copy numBytes from cpuBuffer into pinned memory and start uploading them; returns the device buffer of bufferId
+    // If cpuBuffer is page-locked itself, it is uploaded from directly, and must not be modified before WaitForHostBuffersReleased().
+    const void* CopyCPUToGPUAsync(size_t bufferId, const void* cpuBuffer, size_t numBytes, bool cpuBufferIsPageLocked = false);
+    // mark the end of the batch's uploads
+    void EndBatch();
+    // block until the uploads of the last batch no longer read the callers' page-locked buffers
+    void WaitForHostBuffersReleased();
+
+    // make all work issued from now on to the default stream wait for the uploads of the last batch; does not block the calling thread
+    void WaitForCopyCPUToGPUAsync();
+    // capture all work issued so far to the default stream; the uploads of the next batch wait for it before they overwrite the device buffers
+    void RecordBuffersConsumed();
+
+    DISABLE_COPY_AND_MOVE(PrefetchGPUDataTransferer);
+
+private:
+    struct Buffer
+    {
+        char* m_data;
+        size_t m_size;
+    };
+
+    DEVICEID_TYPE m_deviceId;
+    size_t m_currentSlot;
+    std::vector<std::vector<Buffer>> m_pinnedBuffers; // [slot][bufferId]
+    std::vector<Buffer> m_deviceBuffers;              // [bufferId]
+    void* m_copyStream;                               // cudaStream_t
+    std::vector<void*> m_uploadedEvents;              // [slot] cudaEvent_t, recorded on m_copyStream after the slot's uploads
+    void* m_consumedEvent;                            // cudaEvent_t, recorded on the default stream by RecordBuffersConsumed()
+    void* m_allocatedEvent;                           // cudaEvent_t, recorded on the default stream after a device buffer was (re)allocated
+};
+
+// -----------------------------------------------------------------------
+// GPUHalfPrecision -- process-wide switch for FP16 operands in GPU matrix products
+// If enabled, float GEMMs on the GPU round both operands to FP16 and multiply them with FP32 accumulation
+// and FP32 output (cublasSgemmEx). This halves the memory traffic of the operands and uses the FP16 units of
+// Pascal/Volta GPUs, at the cost of an 11-bit mantissa for the inputs. double products are not affected,
+// and GPUs without FP16 GEMM support (compute capability < 5.0) fall back to regular SGEMM.
+// -----------------------------------------------------------------------
+
+class MATH_API GPUHalfPrecision
+{
+private:
+    static bool m_halfPrecisionGEMM;
+
+public:
+    static void SetHalfPrecisionGEMM(bool enabled);
+    static bool IsHalfPrecisionGEMM();
+};
+
+// -----------------------------------------------------------------------
+// CPUNumaPlacement -- process-wide NUMA placement of CPU matrix buffers and CPU threads
+// With 'firstTouch', new CPU matrix buffers are zeroed by the OpenMP threads with a static schedule, so that
+// each page is placed on the NUMA node of the thread that processes it in the (equally scheduled) matrix loops.
+// With 'interleave', the pages are spread round-robin over all nodes (Linux only; elsewhere this is 'firstTouch'),
+// which is preferable for buffers that all threads read, e.g. the weights in evaluation.
+// BindThreadsToNode() restricts the OpenMP threads of the calling thread (and thus MKL's) to the CPUs of one node,
+// e.g. for one evaluator instance or one training process per socket. OpenBLAS threads are not affected.
+// -----------------------------------------------------------------------
+
+enum class NumaPolicy
+{
+    none,
+    firstTouch,
+    interleave
+};
+
+class MATH_API CPUNumaPlacement
+{
+private:
+    static NumaPolicy m_policy;
+
+public:
+    static NumaPolicy Parse(const std::wstring& policy);
+    static void SetPolicy(NumaPolicy policy);
+    static NumaPolicy GetPolicy();
+
+    static size_t GetNumNodes();
+    // returns false if the node does not exist or the threads could not be bound
+    static bool BindThreadsToNode(size_t node);
+};
+
 // -----------------------------------------------------------------------
 // ElementWiseOperator -- This enum represents which function to apply.
 // This is shared between all matrix types and tensors.
@@ -159,6 +398,100 @@ enum ElementWiseOperator
     Macro(Clip);                                        \
     Macro(ElementwiseProductWithLogSumDerivative);      
 
+// -----------------------------------------------------------------------
+// FusedElementwiseProgram -- a chain of element-wise ops evaluated in a single pass over memory
+// E.g. the LSTM output sigmoid(o) .* tanh(c) is
+//   FusedElementwiseProgram p(2);
+//   p.Binary(opElementwiseProduct, p.Unary(opSigmoid, 0), p.Unary(opTanh, 1));
+// Registers [0, numInputs) hold the current element of each input; instruction j writes register numInputs + j.
+// The last instruction's register is the result. This is a plain struct, so that it can be passed to CUDA kernels by value.
+// -----------------------------------------------------------------------
+
+struct FusedElementwiseProgram
+{
+    static const size_t MaxInputs = 8;
+    static const size_t MaxInstructions = 24;
+    static const size_t MaxRegisters = MaxInputs + MaxInstructions;
+
+    struct Instruction
+    {
+        ElementWiseOperator op;
+        unsigned char arity;
+        unsigned char args[3]; // register indices
+    };
+
+    unsigned char numInputs;
+    unsigned char numInstructions;
+    Instruction instructions[MaxInstructions];
+
+    explicit FusedElementwiseProgram(size_t numInputs_ = 0)
+        : numInputs((unsigned char) numInputs_), numInstructions(0)
+    {
+        if (numInputs_ > MaxInputs)
+            LogicError("FusedElementwiseProgram: At most %d inputs are supported.", (int) MaxInputs);
+    }
+
+    // append an instruction; returns its result register
+    size_t Unary(ElementWiseOperator op, size_t a) { return Append(op, 1, a, 0, 0); }
+    size_t Binary(ElementWiseOperator op, size_t a, size_t b) { return Append(op, 2, a, b, 0); }
+    size_t Ternary(ElementWiseOperator op, size_t a, size_t b, size_t c) { return Append(op, 3, a, b, c); }
+
+    size_t NumRegisters() const { return numInputs + numInstructions; }
+
+    // number of arguments of an element-wise op, or 0 if it cannot be used in a program
+    static unsigned char Arity(ElementWiseOperator op)
+    {
+        switch (op)
+        {
+#define CaseArity(oper, n) case op##oper: return n
+#define CaseArity1(oper) CaseArity(oper, 1)
+#define CaseArity2(oper) CaseArity(oper, 2)
+#define CaseArity3(oper) CaseArity(oper, 3)
+            ForAllUnaryOps(CaseArity1);
+            ForAllBinaryOps(CaseArity2);
+            ForAllTernaryOps(CaseArity3);
+#undef CaseArity
+#undef CaseArity1
+#undef CaseArity2
+#undef CaseArity3
+        default:
+            return 0;
+        }
+    }
+
+private:
+    size_t Append(ElementWiseOperator op, unsigned char arity, size_t a, size_t b, size_t c)
+    {
+        if (numInstructions >= MaxInstructions)
+            LogicError("FusedElementwiseProgram: At most %d instructions are supported.", (int) MaxInstructions);
+        if (a >= NumRegisters() || b >= NumRegisters() || c >= NumRegisters())
+            LogicError("FusedElementwiseProgram: Instruction reads a register that has not been written yet.");
+        if (Arity(op) != arity)
+            LogicError("FusedElementwiseProgram: Op %d is not an element-wise op with %d arguments.", (int) op, (int) arity);
+        Instruction& instruction = instructions[numInstructions];
+        instruction.op = op;
+        instruction.arity = arity;
+        instruction.args[0] = (unsigned char) a;
+        instruction.args[1] = (unsigned char) b;
+        instruction.args[2] = (unsigned char) c;
+        return numInputs + numInstructions++;
+    }
+};
+
+// -----------------------------------------------------------------------
+// SequenceInMinibatch -- one sequence of a minibatch, for the operations that compute over whole sequences (RNN engine, CRF)
+// Frames tBegin...tEnd-1 in parallel sequence s, i.e. columns t * numParallelSequences + s.
+// Sequences that start before or end after the minibatch are clipped to it; the state is not carried across minibatches.
+// Columns not covered by any sequence are gaps.
+// -----------------------------------------------------------------------
+
+struct SequenceInMinibatch
+{
+    size_t s;
+    size_t tBegin;
+    size_t tEnd;
+};
+
 // -----------------------------------------------------------------------
 // various enums to describe
 // -----------------------------------------------------------------------
@@ -200,6 +533,26 @@ enum MatrixFlags
     matrixFlagSetValueOnDevice = 1 << bitPosSetValueOnDevice, // SetValue() call has a buffer that is already on the device
 };
 
+// element types of compact external data, which are converted on assignment, see Matrix::SetValueFromCompact()
+enum class CompactElementType : char
+{
+    uint8,   // unsigned char, e.g. image pixels
+    float16, // IEEE 754 half precision stored as unsigned short, see Float16.h
+};
+
+inline size_t GetCompactElementSize(CompactElementType type)
+{
+    return type == CompactElementType::uint8 ? 1 : 2;
+}
+
+// number of rows of a matrix that holds the columns of a numRows-row matrix compressed to 'type', see Matrix::AssignCompressedOf():
+// a per-column scale followed by the packed compact elements
+template <class ElemType>
+inline size_t GetCompressedNumRows(size_t numRows, CompactElementType type)
+{
+    return 1 + (numRows * GetCompactElementSize(type) + sizeof(ElemType) - 1) / sizeof(ElemType);
+}
+
 // -----------------------------------------------------------------------
 // BaseMatrixStorage -- base class for all matrix types (CPU, GPU) x (dense, sparse)
 // -----------------------------------------------------------------------
@@ -264,6 +617,8 @@ public:
 
                 delete[](byte*) m_tempHostBuffer;
                 m_tempHostBuffer = nullptr;
+
+                m_secondaryIndexHostCopy.clear();
             }
             m_elemSizeAllocated = 0;
             m_totalBufferSizeAllocated = 0;
@@ -308,6 +663,8 @@ protected:
     size_t GetTempHostBufferSize() const { return m_tempHostBufferSize; }
     void SetTempHostBufferSize(size_t bufferSize) const { m_tempHostBufferSize = bufferSize; }
 
+    std::vector<GPUSPARSE_INDEX_TYPE>& GetSecondaryIndexHostCopy() const { return m_secondaryIndexHostCopy; }
+
     int GetColIdx() const { return m_colIdx; }
     void SetColIdx(int idx) { m_colIdx = idx; }
 
@@ -343,6 +700,7 @@ protected:
         m_rowToId                  = nullptr; // the id showing the order row number is observed in the nnz values.
         m_tempHostBuffer           = nullptr; // used to copy values.
         m_tempHostBufferSize       = 0;
+        m_secondaryIndexHostCopy.clear();
         m_colIdx                   = 0; // used to SetValue()
         m_compIndexSize            = 0;
         m_nzValues                 = nullptr;
@@ -379,6 +737,10 @@ protected:
     mutable void* m_tempHostBuffer; // used to copy values.
     mutable size_t m_tempHostBufferSize;
 
+    // host copy of the compressed index in CSC/CSR format, so that NzCount() and Data() of the matrix and its column slices
+    // need no read-back from the device; empty if not known (it is only filled when the index is uploaded from the host)
+    mutable std::vector<GPUSPARSE_INDEX_TYPE> m_secondaryIndexHostCopy;
+
     // **************************
     // CPUSparseMatrix variables
     // **************************
@@ -496,6 +858,8 @@ protected:
     size_t GetTempHostBufferSize() const { return m_sob->GetTempHostBufferSize(); }
     void SetTempHostBufferSize(size_t bufferSize) const { m_sob->SetTempHostBufferSize(bufferSize); }
 
+    std::vector<GPUSPARSE_INDEX_TYPE>& GetSecondaryIndexHostCopy() const { return m_sob->GetSecondaryIndexHostCopy(); }
+
     int GetColIdx() const { return m_sob->GetColIdx(); }
     void SetColIdx(int idx) { m_sob->SetColIdx(idx); }
 
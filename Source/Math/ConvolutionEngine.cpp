@@ -6,6 +6,7 @@
 #include "stdafx.h"
 #include "ConvolutionEngine.h"
 #include "CuDnnFactories.h"
+#include <tuple>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -29,6 +30,22 @@ void ConvolutionEngine<ElemType>::Forward(const Mat& in, const Mat& kernel, Mat&
     ForwardCore(in, kernel, out, workspace);
 }
 
+template <class ElemType>
+void ConvolutionEngine<ElemType>::ForwardInt8(const Mat& in, const Int8QuantizedMatrix<ElemType>& kernel, Mat& out, Mat& workspace)
+{
+    const auto& g = *m_geometry;
+    assert(g.InputShape().GetNumElements() == in.GetNumRows());
+    assert(g.OutputShape().GetNumElements() == out.GetNumRows());
+    assert(g.KernelShape().GetNumElements() == kernel.GetNumCols() && g.KernelCount() == kernel.GetNumRows());
+#ifdef NDEBUG
+    UNUSED(g);
+#endif
+
+    EnsureCompatible();
+    EnsureConvolutionInitialized();
+    ForwardInt8Core(in, kernel, out, workspace);
+}
+
 template <class ElemType>
 void ConvolutionEngine<ElemType>::BackwardData(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& workspace)
 {
@@ -127,6 +144,33 @@ void ConvolutionEngine<ElemType>::MaxUnpooling(const Mat& out, const Mat& poolIn
     MaxUnpoolingCore(out, poolIn, in);
 }
 
+//------------------------------------------------------------------
+// Device copies of the ConvolveGeometry index tables.
+// Nodes with the same configuration share one geometry (see ConvolveGeometry::Get), so the tables are
+// uploaded once per device and shared by all engines that use them. A table is identified by its host
+// storage, which lives as long as the geometry that owns it; the cache holds weak references only, so
+// the device copy is released with the last engine that uses it.
+//------------------------------------------------------------------
+static std::shared_ptr<Matrix<int>> GetGeometryTable(const ConvolveGeometry::IntVec& table, DEVICEID_TYPE deviceId)
+{
+    using Key = std::tuple<const int*, size_t, DEVICEID_TYPE>;
+    static std::mutex s_mutex;
+    static std::map<Key, std::weak_ptr<Matrix<int>>> s_tables;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto& entry = s_tables[Key(table.data(), table.size(), deviceId)];
+    auto mat = entry.lock();
+    if (mat == nullptr)
+    {
+        for (auto it = s_tables.begin(); it != s_tables.end();)
+            it = (it->second.expired() && &it->second != &entry) ? s_tables.erase(it) : std::next(it);
+        auto flags = deviceId >= 0 ? matrixFlagNormal : matrixFlagDontOwnBuffer;
+        mat = std::make_shared<Matrix<int>>(table.size(), 1, const_cast<int*>(table.data()), deviceId, flags);
+        entry = mat;
+    }
+    return mat;
+}
+
 //------------------------------------------------------------------
 // Reference convolution engine implementation.
 // This engine supports arbitrary convolution geometry but does not provide efficient implementation.
@@ -143,7 +187,7 @@ public:
 public:
     ReferenceConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind)
         : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind), 
-        m_mpRowCol(geometry->MpRowCol().size(), 1, const_cast<int*>(geometry->MpRowCol().data()), deviceId, IsGpu(deviceId) ? matrixFlagNormal : matrixFlagDontOwnBuffer)
+        m_mpRowCol(GetGeometryTable(geometry->MpRowCol(), deviceId))
     {
     }
 
@@ -164,40 +208,33 @@ protected:
     {
         if (m_mpRowIwht == nullptr)
         {
-            auto flags = IsGpu(m_deviceId) ? matrixFlagNormal : matrixFlagDontOwnBuffer;
-            m_mpRowIwht = std::make_unique<Matrix<int>>(m_geometry->MpRowIwht().size(), 1, 
-                                                        const_cast<int*>(m_geometry->MpRowIwht().data()), m_deviceId, flags);
-            m_mpRowRun = std::make_unique<Matrix<int>>(m_geometry->MpRowRun().size(), 1,
-                                                       const_cast<int*>(m_geometry->MpRowRun().data()), m_deviceId, flags);
-            m_runs = std::make_unique<Matrix<int>>(m_geometry->Runs().size(), 1, 
-                                                   const_cast<int*>(m_geometry->Runs().data()), m_deviceId, flags);
+            m_mpRowIwht = GetGeometryTable(m_geometry->MpRowIwht(), m_deviceId);
+            m_mpRowRun = GetGeometryTable(m_geometry->MpRowRun(), m_deviceId);
+            m_runs = GetGeometryTable(m_geometry->Runs(), m_deviceId);
         }
     }
 
     void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& /*workspace*/) override
     {
-        in.ConvolutionForward(kernel, m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, out);
+        in.ConvolutionForward(kernel, *m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, out);
     }
 
     void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& /*workspace*/) override
     {
-        srcGrad.ConvolutionBackwardData(kernel, m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, grad);
+        srcGrad.ConvolutionBackwardData(kernel, *m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, grad);
     }
 
     void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool /*allowReuse*/, Mat& /*workspace*/) override
     {
-        srcGrad.ConvolutionBackwardKernel(in, m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, kernelGrad);
+        srcGrad.ConvolutionBackwardKernel(in, *m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, kernelGrad);
     }
 
     void EnsurePoolingInitialized() override
     {
         if (m_indices == nullptr)
         {
-            auto flags = IsGpu(m_deviceId) ? matrixFlagNormal : matrixFlagDontOwnBuffer;
-            m_mpRowIndices = std::make_unique<Matrix<int>>(m_geometry->MpRowIndices().size(), 1,
-                                                           const_cast<int*>(m_geometry->MpRowIndices().data()), m_deviceId, flags);
-            m_indices = std::make_unique<Matrix<int>>(m_geometry->Indices().size(), 1,
-                                                      const_cast<int*>(m_geometry->Indices().data()), m_deviceId, flags);
+            m_mpRowIndices = GetGeometryTable(m_geometry->MpRowIndices(), m_deviceId);
+            m_indices = GetGeometryTable(m_geometry->Indices(), m_deviceId);
         }
     }
 
@@ -205,11 +242,11 @@ protected:
     {
         if (m_poolKind == PoolKind::Max)
         {
-            in.MaxPoolingForward(m_mpRowCol, *m_mpRowIndices, *m_indices, out);
+            in.MaxPoolingForward(*m_mpRowCol, *m_mpRowIndices, *m_indices, out);
         }
         else if (m_poolKind == PoolKind::Average)
         {
-            in.AveragePoolingForward(m_mpRowCol, *m_mpRowIndices, *m_indices, out);
+            in.AveragePoolingForward(*m_mpRowCol, *m_mpRowIndices, *m_indices, out);
         }
         else
             InvalidArgument("Pooling type %d is not supported.", (int)m_poolKind);
@@ -220,11 +257,11 @@ protected:
     {
         if (m_poolKind == PoolKind::Max)
         {
-            srcGrad.MaxPoolingBackward(out, in, m_mpRowCol, *m_mpRowIndices, *m_indices, grad);
+            srcGrad.MaxPoolingBackward(out, in, *m_mpRowCol, *m_mpRowIndices, *m_indices, grad);
         }
         else if (m_poolKind == PoolKind::Average)
         {
-            srcGrad.AveragePoolingBackward(m_mpRowCol, *m_mpRowIndices, *m_indices, grad);
+            srcGrad.AveragePoolingBackward(*m_mpRowCol, *m_mpRowIndices, *m_indices, grad);
         }
         else
             InvalidArgument("Pooling type %d is not supported.", (int)m_poolKind);
@@ -232,7 +269,7 @@ protected:
 
     void MaxUnpoolingCore(const Mat& out, const Mat& poolIn, Mat& in) override
     {
-        out.MaxUnpooling(m_mpRowCol, *m_mpRowIndices, *m_indices, poolIn, in);
+        out.MaxUnpooling(*m_mpRowCol, *m_mpRowIndices, *m_indices, poolIn, in);
     }
 
 protected:
@@ -242,9 +279,10 @@ protected:
     }
 
 protected:
-    using IntMatPtr = std::unique_ptr<Matrix<int>>;
+    // Shared with the other engines that use the same geometry on the same device, see GetGeometryTable.
+    using IntMatPtr = std::shared_ptr<Matrix<int>>;
 
-    Matrix<int> m_mpRowCol;
+    IntMatPtr m_mpRowCol;
     // Convolution-specific maps.
     IntMatPtr m_mpRowIwht;
     IntMatPtr m_mpRowRun;
@@ -608,6 +646,29 @@ protected:
     // 3. Reshape and transpose result: [NW'H' x K] -> [N x W'H'K]^T -> [W'H'K x N]
     //    In case minibatch size == 1 this step is not required and step 2 writes results directly to output (out).
     void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) override
+    {
+        // cudnn layout uses row-major kernel weight matrix.
+        auto kern = kernel.ColumnSlice(0, kernel.GetNumCols());
+        kern.Reshape(kernel.GetNumCols(), kernel.GetNumRows());
+
+        UnrolledForward(in, out, workspace, [&kern](const Mat& unrolledInput, Mat& res)
+        {
+            Mat::Multiply(unrolledInput, true, kern, false, res);
+        });
+    }
+
+    // Same as ForwardCore with the GEMM in step 2 done in int8.
+    void ForwardInt8Core(const Mat& in, const Int8QuantizedMatrix<ElemType>& kernel, Mat& out, Mat& workspace) override
+    {
+        UnrolledForward(in, out, workspace, [&kernel](const Mat& unrolledInput, Mat& res)
+        {
+            // res is [NW'H' x K], i.e. row k of the kernel produces column k.
+            kernel.Multiply(unrolledInput.Data(), unrolledInput.GetNumRows(), unrolledInput.GetNumCols(), res.Data(), res.GetNumRows(), 1);
+        });
+    }
+
+    // Steps 1 and 3 of the forward method, 'multiply' computes [XYC x NW'H']^T * weights -> [NW'H' x K].
+    void UnrolledForward(const Mat& in, Mat& out, Mat& workspace, const std::function<void(const Mat&, Mat&)>& multiply)
     {
         size_t batchSize = in.GetNumCols();
         size_t subBatchSize = m_maxTempMemSizeInSamples == 0 ? batchSize : min(batchSize, m_maxTempMemSizeInSamples);
@@ -636,11 +697,7 @@ protected:
 
             // Unroll inputs.
             unrolledInput.SetValue(0);
-            inputSlice.UnrollConvolutionInput(unrollCols, mapOutSize, m_mpRowCol, *m_mpRowRun, *m_runs, unrolledInput);
-
-            // cudnn layout uses row-major kernel weight matrix.
-            auto kern = kernel.ColumnSlice(0, kernel.GetNumCols());
-            kern.Reshape(kernel.GetNumCols(), kernel.GetNumRows());
+            inputSlice.UnrollConvolutionInput(unrollCols, mapOutSize, *m_mpRowCol, *m_mpRowRun, *m_runs, unrolledInput);
 
             // Perform matrix multiplication of unrolled inputs with weights.
             // If there is just one sample in the sub-batch then compute result directly to the output matrix.
@@ -648,7 +705,7 @@ protected:
             {
                 auto outSlice = out.ColumnSlice(start, 1);
                 outSlice.Reshape(mapOutSize, mapCount);
-                Mat::Multiply(unrolledInput, true, kern, false, outSlice);
+                multiply(unrolledInput, outSlice);
             }
             else
             {
@@ -659,7 +716,7 @@ protected:
                     outTempSlice = outTempSlice.ColumnSlice(0, curBatchSize * mapCount);
                     outTempSlice.Reshape(mapOutSize * curBatchSize, mapCount);
                 }
-                Mat::Multiply(unrolledInput, true, kern, false, outTempSlice);
+                multiply(unrolledInput, outTempSlice);
                 outTempSlice.Reshape(curBatchSize, mapOutSize * mapCount);
                 auto outSlice = out.ColumnSlice(start, curBatchSize);
                 outSlice.AssignTransposeOf(outTempSlice);
@@ -735,7 +792,7 @@ protected:
 
             // Unroll outputs (source gradients).
             unrolledSrcGrad.SetValue(0);
-            srcGradSlice.UnrollConvolutionOutput(unrollCols, mapInCount, mapOutCount, m_mpRowCol, *m_mpRowRun, *m_runs, unrolledSrcGrad);
+            srcGradSlice.UnrollConvolutionOutput(unrollCols, mapInCount, mapOutCount, *m_mpRowCol, *m_mpRowRun, *m_runs, unrolledSrcGrad);
 
             // Perform matrix multiplication of unrolled outputs with weights.
             // If there is just one sample in the sub-batch then compute result directly to the output matrix.
@@ -829,7 +886,7 @@ protected:
             }
             unrolledInputSlice.Reshape(mapOutSize * curBatchSize, unrollRows);
             unrolledInputSlice.SetValue(0);
-            inputSlice.UnrollConvolutionInputForKernelBackprop(mapOutSize, m_mpRowCol, *m_mpRowRun, *m_runs, unrolledInputSlice);
+            inputSlice.UnrollConvolutionInputForKernelBackprop(mapOutSize, *m_mpRowCol, *m_mpRowRun, *m_runs, unrolledInputSlice);
 
             // cudnn layout uses row-major kernel weight matrix.
             auto kernGrad = kernelGrad.ColumnSlice(0, kernelGrad.GetNumCols());
@@ -840,6 +897,8 @@ protected:
 }
 
 public:
+    bool SupportsInt8Forward() const override { return true; }
+
     static bool IsSupported(DEVICEID_TYPE deviceId, ConvolveGeometryPtr geometry)
     {
         return deviceId < 0 &&
@@ -847,6 +906,454 @@ public:
     }
 };
 
+//------------------------------------------------------------------
+// Direct CPU convolution engine implementation.
+// Computes 2D convolutions and pooling by sliding the kernel directly over the input, one row of outputs at a time,
+// so the inner loops are contiguous (for unit stride) and vectorized by the compiler; (sample, map) planes are
+// processed in parallel. No workspace is needed.
+// GEMM works better when the unrolled dimension (XYC for forward, XYK for backward data) is large, so the direct
+// loops are only used when it is small (e.g. first layers that read the image), otherwise the work is delegated
+// to the GEMM engine. Geometries other than 2D CHW with full sharing are delegated as well.
+//------------------------------------------------------------------
+template <class ElemType>
+class DirectConvolutionEngine : public GemmConvolutionEngine<ElemType>
+{
+public:
+    using Base = GemmConvolutionEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    DirectConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind)
+        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind),
+        m_isConvolution2D(IsConvolution2D(*geometry)), m_isPooling2D(IsPooling2D(*geometry))
+    {
+        if (m_isConvolution2D || m_isPooling2D)
+        {
+            const auto& inT = geometry->InputShape();
+            const auto& kernT = geometry->KernelShape();
+            const auto& outT = geometry->OutputShape();
+            m_inW = (int)inT[0];
+            m_inH = (int)inT[1];
+            m_inC = inT.GetRank() > 2 ? (int)inT[2] : 1;
+            m_kW = (int)kernT[0];
+            m_kH = (int)kernT[1];
+            m_strideW = (int)geometry->GetStride(0);
+            m_strideH = (int)geometry->GetStride(1);
+            m_firstW = GetFirstInputCell(*geometry, 0);
+            m_firstH = GetFirstInputCell(*geometry, 1);
+            m_outW = (int)outT[0];
+            m_outH = (int)outT[1];
+            m_outC = outT.GetRank() > 2 ? (int)outT[2] : 1;
+        }
+    }
+
+protected:
+    using Base::m_geometry;
+    using Base::m_poolKind;
+
+    // Threshold on the unrolled dimension below which the direct loops outperform unrolling + GEMM.
+    static const int MaxDirectUnrollSize = 32;
+
+    void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) override
+    {
+        if (!m_isConvolution2D || m_inC * m_kW * m_kH > MaxDirectUnrollSize || !IsDense(in))
+            return Base::ForwardCore(in, kernel, out, workspace);
+
+        const ElemType* pin = in.Data();
+        const ElemType* pkern = kernel.Data();
+        ElemType* pout = out.Data();
+        size_t inSize = in.GetNumRows();
+        size_t outSize = out.GetNumRows();
+        int kernSize = m_kW * m_kH * m_inC;
+        int mapSize = m_outW * m_outH;
+
+        // Each (sample, output map) plane is computed independently.
+        int64_t count = (int64_t)in.GetNumCols() * m_outC;
+#pragma omp parallel for
+        for (int64_t i = 0; i < count; i++)
+        {
+            size_t sample = (size_t)(i / m_outC);
+            int k = (int)(i % m_outC);
+            const ElemType* src = pin + sample * inSize;
+            ElemType* dst = pout + sample * outSize + (size_t)k * mapSize;
+            memset(dst, 0, sizeof(ElemType) * mapSize);
+            for (int c = 0; c < m_inC; c++)
+            {
+                for (int y = 0; y < m_kH; y++)
+                {
+                    int ohBegin, ohEnd;
+                    GetValidRange(m_inH, m_strideH, m_firstH + y, m_outH, ohBegin, ohEnd);
+                    for (int x = 0; x < m_kW; x++)
+                    {
+                        int owBegin, owEnd;
+                        GetValidRange(m_inW, m_strideW, m_firstW + x, m_outW, owBegin, owEnd);
+                        ElemType w = pkern[(size_t)k * kernSize + x + m_kW * (y + m_kH * c)];
+                        for (int oh = ohBegin; oh < ohEnd; oh++)
+                        {
+                            const ElemType* srcRow = src + InputOffset(owBegin, oh, c, x, y);
+                            AddScaledRow(dst + m_outW * oh + owBegin, srcRow, m_strideW, w, owEnd - owBegin);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Transposed convolution: every input cell accumulates the output cells that it contributed to.
+    void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& workspace) override
+    {
+        if (!m_isConvolution2D || m_outC * m_kW * m_kH > MaxDirectUnrollSize || !IsDense(srcGrad))
+            return Base::BackwardDataCore(srcGrad, kernel, grad, workspace);
+
+        const ElemType* psrcGrad = srcGrad.Data();
+        const ElemType* pkern = kernel.Data();
+        ElemType* pgrad = grad.Data();
+        size_t inSize = grad.GetNumRows();
+        size_t outSize = srcGrad.GetNumRows();
+        int kernSize = m_kW * m_kH * m_inC;
+        int mapSize = m_outW * m_outH;
+
+        // Each (sample, input channel) plane of the gradient is computed independently.
+        int64_t count = (int64_t)srcGrad.GetNumCols() * m_inC;
+#pragma omp parallel for
+        for (int64_t i = 0; i < count; i++)
+        {
+            size_t sample = (size_t)(i / m_inC);
+            int c = (int)(i % m_inC);
+            const ElemType* src = psrcGrad + sample * outSize;
+            ElemType* dst = pgrad + sample * inSize;
+            for (int k = 0; k < m_outC; k++)
+            {
+                for (int y = 0; y < m_kH; y++)
+                {
+                    int ohBegin, ohEnd;
+                    GetValidRange(m_inH, m_strideH, m_firstH + y, m_outH, ohBegin, ohEnd);
+                    for (int x = 0; x < m_kW; x++)
+                    {
+                        int owBegin, owEnd;
+                        GetValidRange(m_inW, m_strideW, m_firstW + x, m_outW, owBegin, owEnd);
+                        ElemType w = pkern[(size_t)k * kernSize + x + m_kW * (y + m_kH * c)];
+                        for (int oh = ohBegin; oh < ohEnd; oh++)
+                        {
+                            ElemType* dstRow = dst + InputOffset(owBegin, oh, c, x, y);
+                            AddScaledRowStrided(dstRow, m_strideW, src + (size_t)k * mapSize + m_outW * oh + owBegin, w, owEnd - owBegin);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool allowReuse, Mat& workspace) override
+    {
+        if (!m_isConvolution2D || m_inC * m_kW * m_kH > MaxDirectUnrollSize || !IsDense(in))
+            return Base::BackwardKernelCore(srcGrad, in, kernelGrad, allowReuse, workspace);
+
+        const ElemType* psrcGrad = srcGrad.Data();
+        const ElemType* pin = in.Data();
+        ElemType* pkernGrad = kernelGrad.Data();
+        size_t batchSize = in.GetNumCols();
+        size_t inSize = in.GetNumRows();
+        size_t outSize = srcGrad.GetNumRows();
+        int kernSize = m_kW * m_kH * m_inC;
+        int mapSize = m_outW * m_outH;
+
+        // Each (output map, input channel) slice of the kernel is computed independently.
+        int64_t count = (int64_t)m_outC * m_inC;
+#pragma omp parallel for
+        for (int64_t i = 0; i < count; i++)
+        {
+            int k = (int)(i / m_inC);
+            int c = (int)(i % m_inC);
+            for (int y = 0; y < m_kH; y++)
+            {
+                int ohBegin, ohEnd;
+                GetValidRange(m_inH, m_strideH, m_firstH + y, m_outH, ohBegin, ohEnd);
+                for (int x = 0; x < m_kW; x++)
+                {
+                    int owBegin, owEnd;
+                    GetValidRange(m_inW, m_strideW, m_firstW + x, m_outW, owBegin, owEnd);
+                    ElemType sum = 0;
+                    for (size_t sample = 0; sample < batchSize; sample++)
+                    {
+                        const ElemType* src = psrcGrad + sample * outSize + (size_t)k * mapSize;
+                        const ElemType* inp = pin + sample * inSize;
+                        for (int oh = ohBegin; oh < ohEnd; oh++)
+                            sum += DotRow(src + m_outW * oh + owBegin, inp + InputOffset(owBegin, oh, c, x, y), m_strideW, owEnd - owBegin);
+                    }
+                    pkernGrad[(size_t)k * kernSize + x + m_kW * (y + m_kH * c)] += sum;
+                }
+            }
+        }
+    }
+
+    void ForwardPoolingCore(const Mat& in, Mat& out) override
+    {
+        if (!m_isPooling2D || !IsDense(in))
+            return Base::ForwardPoolingCore(in, out);
+
+        const ElemType* pin = in.Data();
+        ElemType* pout = out.Data();
+        size_t inSize = in.GetNumRows();
+        size_t outSize = out.GetNumRows();
+        int mapSize = m_outW * m_outH;
+        bool isMax = m_poolKind == PoolKind::Max;
+
+        int64_t count = (int64_t)in.GetNumCols() * m_inC;
+#pragma omp parallel for
+        for (int64_t i = 0; i < count; i++)
+        {
+            size_t sample = (size_t)(i / m_inC);
+            int c = (int)(i % m_inC);
+            const ElemType* src = pin + sample * inSize;
+            ElemType* dst = pout + sample * outSize + (size_t)c * mapSize;
+            assert(std::numeric_limits<ElemType>::has_infinity);
+            std::fill(dst, dst + mapSize, isMax ? -std::numeric_limits<ElemType>::infinity() : 0);
+            for (int y = 0; y < m_kH; y++)
+            {
+                int ohBegin, ohEnd;
+                GetValidRange(m_inH, m_strideH, m_firstH + y, m_outH, ohBegin, ohEnd);
+                for (int x = 0; x < m_kW; x++)
+                {
+                    int owBegin, owEnd;
+                    GetValidRange(m_inW, m_strideW, m_firstW + x, m_outW, owBegin, owEnd);
+                    int n = owEnd - owBegin;
+                    for (int oh = ohBegin; oh < ohEnd; oh++)
+                    {
+                        const ElemType* srcRow = src + InputOffset(owBegin, oh, c, x, y);
+                        ElemType* dstRow = dst + m_outW * oh + owBegin;
+                        if (isMax)
+                        {
+                            for (int j = 0; j < n; j++)
+                                dstRow[j] = std::max(dstRow[j], srcRow[j * m_strideW]);
+                        }
+                        else
+                        {
+                            for (int j = 0; j < n; j++)
+                                dstRow[j] += srcRow[j * m_strideW];
+                        }
+                    }
+                }
+            }
+            // Note that we divide by the number of actual elements (does not include padding), same as the reference engine.
+            if (!isMax)
+            {
+                for (int oh = 0; oh < m_outH; oh++)
+                {
+                    for (int ow = 0; ow < m_outW; ow++)
+                        dst[m_outW * oh + ow] /= (ElemType)GetPoolingWindowSize(ow, oh);
+                }
+            }
+        }
+    }
+
+    void BackwardPoolingCore(const Mat& out, const Mat& srcGrad, const Mat& in, Mat& grad) override
+    {
+        if (!m_isPooling2D || !IsDense(in))
+            return Base::BackwardPoolingCore(out, srcGrad, in, grad);
+
+        const ElemType* pout = out.Data();
+        const ElemType* psrcGrad = srcGrad.Data();
+        const ElemType* pin = in.Data();
+        ElemType* pgrad = grad.Data();
+        size_t inSize = in.GetNumRows();
+        size_t outSize = out.GetNumRows();
+        int mapSize = m_outW * m_outH;
+        bool isMax = m_poolKind == PoolKind::Max;
+
+        int64_t count = (int64_t)in.GetNumCols() * m_inC;
+#pragma omp parallel for
+        for (int64_t i = 0; i < count; i++)
+        {
+            size_t sample = (size_t)(i / m_inC);
+            int c = (int)(i % m_inC);
+            size_t outOffset = sample * outSize + (size_t)c * mapSize;
+            const ElemType* inp = pin + sample * inSize;
+            ElemType* dst = pgrad + sample * inSize;
+            // Average pooling distributes the gradients scaled by the window size.
+            std::vector<ElemType> scaledGrad;
+            if (!isMax)
+            {
+                scaledGrad.resize(mapSize);
+                for (int oh = 0; oh < m_outH; oh++)
+                {
+                    for (int ow = 0; ow < m_outW; ow++)
+                        scaledGrad[m_outW * oh + ow] = psrcGrad[outOffset + m_outW * oh + ow] / (ElemType)GetPoolingWindowSize(ow, oh);
+                }
+            }
+            for (int y = 0; y < m_kH; y++)
+            {
+                int ohBegin, ohEnd;
+                GetValidRange(m_inH, m_strideH, m_firstH + y, m_outH, ohBegin, ohEnd);
+                for (int x = 0; x < m_kW; x++)
+                {
+                    int owBegin, owEnd;
+                    GetValidRange(m_inW, m_strideW, m_firstW + x, m_outW, owBegin, owEnd);
+                    int n = owEnd - owBegin;
+                    for (int oh = ohBegin; oh < ohEnd; oh++)
+                    {
+                        size_t inOffset = InputOffset(owBegin, oh, c, x, y);
+                        size_t rowOffset = m_outW * oh + owBegin;
+                        ElemType* dstRow = dst + inOffset;
+                        if (isMax)
+                        {
+                            // Same as the reference engine: all inputs that are equal to the maximum receive the gradient.
+                            const ElemType* inRow = inp + inOffset;
+                            const ElemType* outRow = pout + outOffset + rowOffset;
+                            const ElemType* gradRow = psrcGrad + outOffset + rowOffset;
+                            for (int j = 0; j < n; j++)
+                            {
+                                if (inRow[j * m_strideW] >= outRow[j])
+                                    dstRow[j * m_strideW] += gradRow[j];
+                            }
+                        }
+                        else
+                        {
+                            const ElemType* gradRow = scaledGrad.data() + rowOffset;
+                            for (int j = 0; j < n; j++)
+                                dstRow[j * m_strideW] += gradRow[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static bool IsDense(const Mat& m)
+    {
+        return m.GetMatrixType() == MatrixType::DENSE;
+    }
+
+    // Input coordinate of the first cell of the kernel window of output 0 in dimension i.
+    static int GetFirstInputCell(const ConvolveGeometry& geometry, size_t i)
+    {
+        return geometry.Start()[i] - ((int)geometry.KernelShape()[i] - 1) / 2;
+    }
+
+    // [W x H x C] input convolved with K kernels of [X x Y x C] into [W' x H' x K] output.
+    static bool IsConvolution2D(const ConvolveGeometry& geometry)
+    {
+        const auto& inT = geometry.InputShape();
+        if (inT.GetRank() != 3 || find(begin(geometry.Sharing()), end(geometry.Sharing()), false) != end(geometry.Sharing()))
+            return false;
+        return geometry.GetMapCount(0) == 1 && geometry.GetMapCount(1) == 1 &&
+               geometry.KernelShape()[2] == inT[2] && geometry.OutputShape()[2] == geometry.GetMapCount(2) &&
+               GetFirstInputCell(geometry, 2) == 0;
+    }
+
+    // [W x H x C] input pooled with [X x Y] windows into [W' x H' x C] output.
+    static bool IsPooling2D(const ConvolveGeometry& geometry)
+    {
+        const auto& inT = geometry.InputShape();
+        size_t dimCount = inT.GetRank();
+        if (dimCount != 2 && dimCount != 3)
+            return false;
+        for (size_t i = 0; i < dimCount; i++)
+        {
+            if (geometry.GetMapCount(i) != 1 || !geometry.GetSharing(i))
+                return false;
+        }
+        return dimCount == 2 ||
+               (geometry.KernelShape()[2] == 1 && geometry.GetStride(2) == 1 && geometry.OutputShape()[2] == inT[2] && GetFirstInputCell(geometry, 2) == 0);
+    }
+
+    // Computes the range [begin, end) of outputs o for which the input cell o * stride + first lies within [0, size).
+    static void GetValidRange(int size, int stride, int first, int outSize, int& begin, int& end)
+    {
+        begin = first >= 0 ? 0 : (-first + stride - 1) / stride;
+        int last = size - 1 - first;
+        end = last < 0 ? 0 : std::min(outSize, last / stride + 1);
+        end = std::max(begin, end);
+    }
+
+    // Offset of the input cell that kernel element (x, y) of channel c reads for output (ow, oh).
+    size_t InputOffset(int ow, int oh, int c, int x, int y) const
+    {
+        int iw = ow * m_strideW + m_firstW + x;
+        int ih = oh * m_strideH + m_firstH + y;
+        assert(0 <= iw && iw < m_inW && 0 <= ih && ih < m_inH);
+        return iw + (size_t)m_inW * (ih + (size_t)m_inH * c);
+    }
+
+    // Number of input cells (not including padding) in the pooling window of output (ow, oh).
+    int GetPoolingWindowSize(int ow, int oh) const
+    {
+        int w = ow * m_strideW + m_firstW;
+        int h = oh * m_strideH + m_firstH;
+        int countW = std::min(w + m_kW, m_inW) - std::max(w, 0);
+        int countH = std::min(h + m_kH, m_inH) - std::max(h, 0);
+        assert(countW > 0 && countH > 0);
+        return countW * countH;
+    }
+
+    // dst[j] += w * src[j * srcStride]; the unit stride case is split out so that it can be vectorized.
+    static void AddScaledRow(ElemType* dst, const ElemType* src, int srcStride, ElemType w, int n)
+    {
+        if (srcStride == 1)
+        {
+            for (int j = 0; j < n; j++)
+                dst[j] += w * src[j];
+        }
+        else
+        {
+            for (int j = 0; j < n; j++)
+                dst[j] += w * src[j * srcStride];
+        }
+    }
+
+    // dst[j * dstStride] += w * src[j]
+    static void AddScaledRowStrided(ElemType* dst, int dstStride, const ElemType* src, ElemType w, int n)
+    {
+        if (dstStride == 1)
+        {
+            for (int j = 0; j < n; j++)
+                dst[j] += w * src[j];
+        }
+        else
+        {
+            for (int j = 0; j < n; j++)
+                dst[j * dstStride] += w * src[j];
+        }
+    }
+
+    // sum of a[j] * b[j * bStride]
+    static ElemType DotRow(const ElemType* a, const ElemType* b, int bStride, int n)
+    {
+        ElemType sum = 0;
+        if (bStride == 1)
+        {
+            for (int j = 0; j < n; j++)
+                sum += a[j] * b[j];
+        }
+        else
+        {
+            for (int j = 0; j < n; j++)
+                sum += a[j] * b[j * bStride];
+        }
+        return sum;
+    }
+
+private:
+    bool m_isConvolution2D;
+    bool m_isPooling2D;
+
+    int m_inW = 0, m_inH = 0, m_inC = 0;
+    int m_kW = 0, m_kH = 0;
+    int m_strideW = 1, m_strideH = 1;
+    // Input coordinate of the first kernel cell for output 0, negative if padded.
+    int m_firstW = 0, m_firstH = 0;
+    // m_outC is the number of output maps K for convolution and the number of channels C for pooling.
+    int m_outW = 0, m_outH = 0, m_outC = 0;
+
+public:
+    static bool IsSupported(DEVICEID_TYPE deviceId, ConvolveGeometryPtr geometry)
+    {
+        // Geometries without a direct implementation are handled by the GEMM engine.
+        return Base::IsSupported(deviceId, geometry);
+    }
+};
+
 template <class ElemType>
 std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId,
                                                                                  ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind,
@@ -878,6 +1385,12 @@ std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create
         return CuDnnConvolutionEngineFactory<ElemType>::Create(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind);
     }
 
+    if (isEnabled(ConvolutionEngineKind::Direct) && DirectConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
+    {
+        fprintf(stderr, "\n%lsusing direct convolution engine for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
+        return std::make_unique<DirectConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind);
+    }
+
     if (isEnabled(ConvolutionEngineKind::Gemm) && GemmConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
     {
         fprintf(stderr, "\n%lsusing GEMM convolution engine for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
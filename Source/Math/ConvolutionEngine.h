@@ -8,6 +8,7 @@
 #include "Matrix.h"
 #include "TensorShape.h" // for ImageLayoutKind
 #include "ConvolveGeometry.h"
+#include "Int8QuantizedMatrix.h"
 #include "StringUtil.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -22,8 +23,9 @@ enum class ConvolutionEngineKind
     CuDnn     = 1 << 1, // cuDNN, works only for 2D/3D convos with full sharing.
     Legacy    = 1 << 2, // Legacy, for backwards compatibility. REVIEW alexeyk: implement sparse version and remove Legacy altogether.
     Gemm      = 1 << 3, // Uses convolution unrolling+GEMM technique. Works only for convos with full sharing.
+    Direct    = 1 << 4, // CPU only, direct vectorized loops for 2D convos and pooling, uses GEMM for the rest (e.g. wide layers, 3D).
 
-    All       = Reference | CuDnn | Legacy | Gemm
+    All       = Reference | CuDnn | Legacy | Gemm | Direct
 };
 
 enum class PoolKind
@@ -57,6 +59,12 @@ public:
 
     void MaxUnpooling(const Mat& out, const Mat& poolIn, Mat& in);
 
+    // Inference-only forward with int8 weights, quantized from the kernel as a row-major [K x kernel size] matrix.
+    // Only supported by the engines for which SupportsInt8Forward() returns true.
+    void ForwardInt8(const Mat& in, const Int8QuantizedMatrix<ElemType>& kernel, Mat& out, Mat& workspace);
+
+    virtual bool SupportsInt8Forward() const { return false; }
+
     std::shared_ptr<const ConvolveGeometry> Geometry() const { return m_geometry; }
 
     static std::unique_ptr<ConvolutionEngine<ElemType>> Create(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout,
@@ -85,6 +93,11 @@ protected:
 
     virtual void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) = 0;
 
+    virtual void ForwardInt8Core(const Mat& /*in*/, const Int8QuantizedMatrix<ElemType>& /*kernel*/, Mat& /*out*/, Mat& /*workspace*/)
+    {
+        LogicError("This convolution engine does not support int8 inference.");
+    }
+
     virtual void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& workspace) = 0;
 
     virtual void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool allowReuse, Mat& workspace) = 0;
@@ -7,6 +7,8 @@
 #include "Basics.h"
 #include "TensorShape.h"
 #include <iterator>
+#include <map>
+#include <mutex>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -22,6 +24,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // wrt convolution configuration and dimensionality. For specific cases like 2D/3D convolutions and full sharing,
 // highly optimized implementations (e.g. cuDNN) are used.
 // TODO: rename to ConvolutionGeometry
+class ConvolveGeometry;
+using ConvolveGeometryPtr = std::shared_ptr<ConvolveGeometry>;
+
 class ConvolveGeometry final
 {
 public:
@@ -37,6 +42,8 @@ public:
     const BoolVec& AutoPad() const { return m_autoPad; }
     const TensorShape& LowerPad() const { return m_lowerPad; }
     const TensorShape& UpperPad() const { return m_upperPad; }
+    // Input coordinate of the "kernel-center" cell of the first output in each dimension.
+    const IntVec& Start() const { return m_start; }
 
     // Maps from a "row" (index of output cell) to its base "col" (index of input cell). For a given row,
     // the cols that contribute to it are { MpRowCol[row] + Indices[i0 + 1 + i] | 0 <= i < Indices[i0] },
@@ -557,6 +564,35 @@ public:
         return TensorShape(dimsInput);
     }
 
+    // Returns the geometry for the given configuration. Identical configurations (e.g. the layers of a ResNet stage)
+    // share one instance, so the index tables are computed once and engines can share their device copies too.
+    // The cache only holds weak references: a geometry goes away with the last node that uses it.
+    static ConvolveGeometryPtr Get(const TensorShape& inputShape, const TensorShape& kernelShape, const TensorShape& mapCount, const TensorShape& stride,
+                                   const BoolVec& sharing, const BoolVec& autoPad, const TensorShape& lowerPad, const TensorShape& upperPad)
+    {
+        std::ostringstream key;
+        key << (string)inputShape << "|" << (string)kernelShape << "|" << (string)mapCount << "|" << (string)stride << "|";
+        std::copy(begin(sharing), end(sharing), std::ostream_iterator<bool>(key));
+        key << "|";
+        std::copy(begin(autoPad), end(autoPad), std::ostream_iterator<bool>(key));
+        key << "|" << (string)lowerPad << "|" << (string)upperPad;
+
+        static std::mutex s_mutex;
+        static std::map<std::string, std::weak_ptr<ConvolveGeometry>> s_cache;
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto& entry = s_cache[key.str()];
+        auto geometry = entry.lock();
+        if (geometry == nullptr)
+        {
+            // Drop the entries of geometries that are no longer used before adding a new one.
+            for (auto it = s_cache.begin(); it != s_cache.end();)
+                it = (it->second.expired() && &it->second != &entry) ? s_cache.erase(it) : std::next(it);
+            geometry = std::make_shared<ConvolveGeometry>(inputShape, kernelShape, mapCount, stride, sharing, autoPad, lowerPad, upperPad);
+            entry = geometry;
+        }
+        return geometry;
+    }
+
     // Used in unit tests and during debugging.
     operator std::string() const
     {
@@ -612,6 +648,4 @@ private:
     size_t m_kernelCount;
 };
 
-using ConvolveGeometryPtr = std::shared_ptr<ConvolveGeometry>;
-
 } } }
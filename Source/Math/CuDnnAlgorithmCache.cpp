@@ -0,0 +1,137 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CuDnnAlgorithmCache.cpp -- persistent cache of the cuDNN autotuner's choices (see CuDnnAlgorithmCache.h)
+//
+
+#include "stdafx.h"
+#include "CuDnnAlgorithmCache.h"
+#include "fileutil.h"
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// process-wide state; engines tune from whatever thread runs the network, so all access is serialized
+struct CuDnnAlgorithmCacheState
+{
+    std::mutex m_mutex;
+    std::map<std::string, CuDnnAlgorithmCacheEntry> m_entries;
+    FILE* m_file = nullptr; // entries added by Add() are appended here, if the cache was opened as writable
+
+    static CuDnnAlgorithmCacheState& GetInstance()
+    {
+        // deliberately leaked, so that Add() stays valid during process exit
+        static CuDnnAlgorithmCacheState* instance = new CuDnnAlgorithmCacheState();
+        return *instance;
+    }
+};
+
+static std::string FormatEntry(const std::string& key, const CuDnnAlgorithmCacheEntry& entry)
+{
+    std::ostringstream res;
+    res << entry.algo << " " << entry.memory << " " << entry.noWorkspaceAlgo << " " << key << "\n";
+    return res.str();
+}
+
+// expects the state's mutex to be held; returns the number of entries read
+static size_t DeserializeLocked(CuDnnAlgorithmCacheState& state, const std::string& contents)
+{
+    std::istringstream lines(contents);
+    std::string line;
+    size_t numEntries = 0;
+    while (std::getline(lines, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        CuDnnAlgorithmCacheEntry entry;
+        std::string key;
+        if (!(fields >> entry.algo >> entry.memory >> entry.noWorkspaceAlgo) || !std::getline(fields >> std::ws, key) || key.empty())
+        {
+            fprintf(stderr, "CuDnnAlgorithmCache: ignoring malformed line '%s'\n", line.c_str());
+            continue;
+        }
+        state.m_entries[key] = entry;
+        numEntries++;
+    }
+    return numEntries;
+}
+
+/*static*/ void CuDnnAlgorithmCache::Open(const std::wstring& path, bool writable)
+{
+    auto& state = CuDnnAlgorithmCacheState::GetInstance();
+    std::lock_guard<std::mutex> lock(state.m_mutex);
+    if (state.m_file)
+    {
+        fclose(state.m_file);
+        state.m_file = nullptr;
+    }
+
+    bool exists = fexists(path);
+    if (exists)
+    {
+        FILE* f = fopenOrDie(path, L"rb");
+        std::string contents(filesize(f), '\0');
+        if (!contents.empty())
+            freadOrDie(&contents[0], 1, contents.size(), f);
+        fclose(f);
+        size_t numEntries = DeserializeLocked(state, contents);
+        fprintf(stderr, "CuDnnAlgorithmCache: loaded %d tuned convolution algorithms from '%ls'\n", (int) numEntries, path.c_str());
+    }
+
+    if (writable)
+    {
+        state.m_file = fopenOrDie(path, L"ab");
+        if (!exists)
+            fprintf(state.m_file, "# cuDNN convolution algorithm cache: <algo> <workspace bytes> <no-workspace algo> <key>\n");
+    }
+}
+
+/*static*/ std::string CuDnnAlgorithmCache::Serialize()
+{
+    auto& state = CuDnnAlgorithmCacheState::GetInstance();
+    std::lock_guard<std::mutex> lock(state.m_mutex);
+    std::string res;
+    for (const auto& iter : state.m_entries)
+        res += FormatEntry(iter.first, iter.second);
+    return res;
+}
+
+/*static*/ void CuDnnAlgorithmCache::Deserialize(const std::string& contents)
+{
+    auto& state = CuDnnAlgorithmCacheState::GetInstance();
+    std::lock_guard<std::mutex> lock(state.m_mutex);
+    DeserializeLocked(state, contents);
+}
+
+/*static*/ bool CuDnnAlgorithmCache::Find(const std::string& key, CuDnnAlgorithmCacheEntry& entry)
+{
+    auto& state = CuDnnAlgorithmCacheState::GetInstance();
+    std::lock_guard<std::mutex> lock(state.m_mutex);
+    auto iter = state.m_entries.find(key);
+    if (iter == state.m_entries.end())
+        return false;
+    entry = iter->second;
+    return true;
+}
+
+/*static*/ void CuDnnAlgorithmCache::Add(const std::string& key, const CuDnnAlgorithmCacheEntry& entry)
+{
+    if (key.find('\n') != std::string::npos)
+        InvalidArgument("CuDnnAlgorithmCache: key must not contain line breaks.");
+
+    auto& state = CuDnnAlgorithmCacheState::GetInstance();
+    std::lock_guard<std::mutex> lock(state.m_mutex);
+    state.m_entries[key] = entry;
+    if (state.m_file)
+    {
+        // flushed right away, so that the entry survives a crash or a killed job
+        fputs(FormatEntry(key, entry).c_str(), state.m_file);
+        fflushOrDie(state.m_file);
+    }
+}
+
+}}}
@@ -0,0 +1,45 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CuDnnAlgorithmCache.h -- persistent cache of the convolution algorithms chosen by the cuDNN autotuner
+//
+// The cuDNN convolution engine benchmarks all algorithms (cudnnFind*) for every new geometry and minibatch size,
+// which can take minutes at startup for networks with many convolution layers. The results are stored here under
+// a key that identifies the problem (direction, geometry, data type, minibatch size, workspace limit) as well as
+// the GPU model and cuDNN version, so they can be reused by later runs through a file and by the other ranks of a
+// parallel run through MPI (see Serialize()/Deserialize(); Math itself does not depend on MPI).
+//
+// File format: one entry per line, "<algo> <workspace bytes> <no-workspace algo> <key>"; lines starting with '#' are ignored.
+//
+
+#pragma once
+
+#include "CommonMatrix.h"
+#include <string>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct CuDnnAlgorithmCacheEntry
+{
+    int algo;            // cudnnConvolution{Fwd,BwdData,BwdFilter}Algo_t
+    size_t memory;       // workspace size in bytes required by algo
+    int noWorkspaceAlgo; // fastest algorithm that needs no workspace, used as a fallback
+};
+
+class MATH_API CuDnnAlgorithmCache
+{
+public:
+    // load the entries of the file, if it exists; if 'writable', newly tuned entries are appended to it
+    static void Open(const std::wstring& path, bool writable);
+
+    // all entries in the file format, e.g. to broadcast them from the rank that read the file to the others
+    static std::string Serialize();
+    // add the entries of a string in the file format
+    static void Deserialize(const std::string& contents);
+
+    static bool Find(const std::string& key, CuDnnAlgorithmCacheEntry& entry);
+    static void Add(const std::string& key, const CuDnnAlgorithmCacheEntry& entry);
+};
+
+}}}
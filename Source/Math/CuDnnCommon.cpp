@@ -6,6 +6,8 @@
 #include "stdafx.h"
 #include "GPUMatrix.h"
 #include "CuDnnCommon.h"
+#include <list>
+#include <mutex>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -77,6 +79,16 @@ cudnnDataType_t CuDnnTensor::GetDataType()
 template cudnnDataType_t CuDnnTensor::GetDataType<float>();
 template cudnnDataType_t CuDnnTensor::GetDataType<double>();
 
+// the cuDNN handles of the calling thread, one per GPU; they point into s_cudnnHandles, which owns them
+#ifdef _WIN32
+static __declspec(thread)
+#else
+static __thread
+#endif
+    CuDnn::ptr_t* t_cudnnHandle[MAX_GPUS];
+
+// A cuDNN handle is bound to one device and to one stream at a time, and is not meant to be used by several threads
+// at once. Hence each thread gets its own handle per GPU, created on first use. They are kept until the process ends.
 CuDnn::ptr_t CuDnn::Instance()
 {
     auto createNew = []()
@@ -88,21 +100,41 @@ CuDnn::ptr_t CuDnn::Instance()
             RuntimeError("cuDNN requires device with compute capability 3.0 or higher.");
         cudnnHandle_t* cudnn = new cudnnHandle_t;
         CUDNN_CALL(cudnnCreate(cudnn));
-        CUDNN_CALL(cudnnSetStream(*cudnn, GetStream()));
         return cudnn;
     };
 
-    static std::shared_ptr<cudnnHandle_t> m_instance = std::shared_ptr<cudnnHandle_t>(createNew(), [](cudnnHandle_t* src)
+    static std::mutex s_mutex;
+    static std::list<ptr_t> s_cudnnHandles;
+
+    int deviceId;
+    CUDA_CALL(cudaGetDevice(&deviceId));
+    if (deviceId < 0 || deviceId >= MAX_GPUS)
+        LogicError("CuDnn::Instance: Maximum GPU exceeded");
+    if (t_cudnnHandle[deviceId] == nullptr)
     {
-        assert(*src != nullptr);
-        auto err = cudnnDestroy(*src);
-        assert(err == CUDNN_STATUS_SUCCESS);
+        ptr_t cudnn = ptr_t(createNew(), [](cudnnHandle_t* src)
+        {
+            assert(*src != nullptr);
+            auto err = cudnnDestroy(*src);
+            assert(err == CUDNN_STATUS_SUCCESS);
 #ifdef NDEBUG
-        UNUSED(err);
+            UNUSED(err);
 #endif
-        delete src;
-    });
-    return m_instance;
+            delete src;
+        });
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_cudnnHandles.push_back(cudnn);
+        t_cudnnHandle[deviceId] = &s_cudnnHandles.back();
+    }
+    const ptr_t& cudnn = *t_cudnnHandle[deviceId];
+    CUDNN_CALL(cudnnSetStream(*cudnn, GetStream()));
+    return cudnn;
+}
+
+void CuDnn::UseCurrentStream(ptr_t& cudnn)
+{
+    // switch to the calling thread's handle for the current device, bound to its current stream
+    cudnn = Instance();
 }
 
 } } }
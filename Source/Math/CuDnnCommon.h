@@ -34,7 +34,10 @@ private:
 struct CuDnn final
 {
     using ptr_t = std::shared_ptr<cudnnHandle_t>;
+    // the calling thread's handle for the current device, bound to the thread's current stream (see GPUStream)
     static ptr_t Instance();
+    // switch to Instance(), so that subsequent work runs on the calling thread's handle and current stream; call before issuing cuDNN work
+    static void UseCurrentStream(ptr_t& cudnn);
 
     DISABLE_COPY_AND_MOVE(CuDnn);
 };
@@ -9,6 +9,8 @@
 #include <typeinfo>
 #include <typeindex>
 #include "CuDnnCommon.h"
+#include "CuDnnAlgorithmCache.h"
+#include <sstream>
 
 template <>
 const char* CudaErrString<cudnnStatus_t>(cudnnStatus_t x)
@@ -214,6 +216,7 @@ protected:
 
     void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) override
     {
+        CuDnn::UseCurrentStream(m_cudnn);
         size_t batchSize = in.GetNumCols();
         // Find best algo and allocate temp buffer, if needed.
         auto finder = [this](int& calgo, cudnnConvolutionFwdAlgoPerf_t algoPerf[MaxAlgoCount]) -> cudnnStatus_t
@@ -224,7 +227,7 @@ protected:
         {
             return cudnnGetConvolutionForwardAlgorithm(*m_cudnn, m_inT, *m_kernelT, *m_conv, m_outT, CUDNN_CONVOLUTION_FWD_NO_WORKSPACE, 0, &algo);
         };
-        FindBestAlgo(batchSize, m_fwdAlgo, finder, staticFinder);
+        FindBestAlgo("fwd", batchSize, m_fwdAlgo, finder, staticFinder);
         if (m_fwdAlgo.Algo.memory > 0)
             workspace.Resize((m_fwdAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
         // Perform forward convolution operation.
@@ -245,6 +248,7 @@ protected:
 
     void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& workspace) override
     {
+        CuDnn::UseCurrentStream(m_cudnn);
         size_t batchSize = srcGrad.GetNumCols();
         // Find best algo and allocate temp buffer, if needed.
         auto finder = [this](int& calgo, cudnnConvolutionBwdDataAlgoPerf_t algoPerf[MaxAlgoCount]) -> cudnnStatus_t
@@ -255,7 +259,7 @@ protected:
         {
             return cudnnGetConvolutionBackwardDataAlgorithm(*m_cudnn, *m_kernelT, m_outT, *m_conv, m_inT, CUDNN_CONVOLUTION_BWD_DATA_NO_WORKSPACE, 0, &algo);
         };
-        FindBestAlgo(batchSize, m_backDataAlgo, finder, staticFinder);
+        FindBestAlgo("bwdData", batchSize, m_backDataAlgo, finder, staticFinder);
         if (m_backDataAlgo.Algo.memory > 0)
             workspace.Resize((m_backDataAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
         // Compute gradients with respect to the output tensor (data).
@@ -265,6 +269,7 @@ protected:
 
     void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool /*allowReuse*/, Mat& workspace) override
     {
+        CuDnn::UseCurrentStream(m_cudnn);
         size_t batchSize = in.GetNumCols();
         // Find best algo and allocate temp buffer, if needed.
         auto finder = [this](int& calgo, cudnnConvolutionBwdFilterAlgoPerf_t algoPerf[MaxAlgoCount]) -> cudnnStatus_t
@@ -275,7 +280,7 @@ protected:
         {
             return cudnnGetConvolutionBackwardFilterAlgorithm(*m_cudnn, m_inT, m_outT, *m_conv, *m_kernelT, CUDNN_CONVOLUTION_BWD_FILTER_NO_WORKSPACE, 0, &algo);
         };
-        FindBestAlgo(batchSize, m_backFiltAlgo, finder, staticFinder);
+        FindBestAlgo("bwdFilter", batchSize, m_backFiltAlgo, finder, staticFinder);
         if (m_backFiltAlgo.Algo.memory > 0)
             workspace.Resize((m_backFiltAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
         // Compute gradients with respect to the output tensor (data).
@@ -291,6 +296,7 @@ protected:
 
     void ForwardPoolingCore(const Mat& in, Mat& out) override
     {
+        CuDnn::UseCurrentStream(m_cudnn);
         size_t batchSize = in.GetNumCols();
         m_inT.UpdateBatchSize(batchSize);
         m_outT.UpdateBatchSize(batchSize);
@@ -299,6 +305,7 @@ protected:
 
     void BackwardPoolingCore(const Mat& out, const Mat& srcGrad, const Mat& in, Mat& grad) override
     {
+        CuDnn::UseCurrentStream(m_cudnn);
         size_t batchSize = in.GetNumCols();
         m_inT.UpdateBatchSize(batchSize);
         m_outT.UpdateBatchSize(batchSize);
@@ -321,7 +328,7 @@ private:
     static const int MaxAlgoCount = 10;
 
     template <typename TAlgo, typename TFinder, typename TStaticFinder>
-    void FindBestAlgo(size_t batchSize, TAlgo& algo, TFinder finder, TStaticFinder staticFinder)
+    void FindBestAlgo(const char* direction, size_t batchSize, TAlgo& algo, TFinder finder, TStaticFinder staticFinder)
     {
         m_inT.UpdateBatchSize(batchSize);
         m_outT.UpdateBatchSize(batchSize);
@@ -330,6 +337,22 @@ private:
             return;
 
         using CuDnnAlgoT = decltype(TAlgo::Algo);
+        size_t inputSampleSize = m_geometry->InputShape().GetNumElements();
+        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : inputSampleSize * m_maxTempMemSizeInSamples * sizeof(ElemType);
+
+        // Results of earlier runs (or other ranks) for the same problem on the same GPU model and cuDNN version.
+        std::string cacheKey = GetAlgoCacheKey(direction, batchSize, maxMem);
+        CuDnnAlgorithmCacheEntry cached;
+        if (CuDnnAlgorithmCache::Find(cacheKey, cached))
+        {
+            algo.MaxAllowedMBSizeForCurrentAlgo = batchSize;
+            algo.Algo.algo = (decltype(CuDnnAlgoT::algo))cached.algo;
+            algo.Algo.memory = cached.memory;
+            algo.Algo.status = CUDNN_STATUS_SUCCESS;
+            algo.NoWorkspaceAlgo = (decltype(CuDnnAlgoT::algo))cached.noWorkspaceAlgo;
+            return;
+        }
+
         CuDnnAlgoT algoPerf[MaxAlgoCount];
         int calgo = 0;
         cudnnStatus_t err = finder(calgo, algoPerf);
@@ -349,8 +372,6 @@ private:
         }
         CUDNN_CALL(err);
         assert(calgo > 0);
-        size_t inputSampleSize = m_geometry->InputShape().GetNumElements();
-        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : inputSampleSize * m_maxTempMemSizeInSamples * sizeof(ElemType);
         // Find best (fastest) algorithm which satisfies workspace requirements.
         auto res = std::find_if(algoPerf, algoPerf + calgo,
             [=](const CuDnnAlgoT& cur)
@@ -374,6 +395,26 @@ private:
         }
         else
             algo.NoWorkspaceAlgo = (*res).algo;
+
+        CuDnnAlgorithmCacheEntry tuned = { (int)algo.Algo.algo, algo.Algo.memory, (int)algo.NoWorkspaceAlgo };
+        CuDnnAlgorithmCache::Add(cacheKey, tuned);
+    }
+
+    // Everything the autotuner's choice depends on. The (static) fallback chosen when autotuning runs out of memory is not cached.
+    std::string GetAlgoCacheKey(const char* direction, size_t batchSize, size_t maxMem) const
+    {
+        if (m_deviceKey.empty())
+        {
+            cudaDeviceProp props = {0};
+            CUDA_CALL(cudaGetDeviceProperties(&props, m_deviceId));
+            std::ostringstream deviceKey;
+            deviceKey << "cudnn=" << cudnnGetVersion() << " gpu=" << props.name << " sm=" << props.major << props.minor;
+            m_deviceKey = deviceKey.str();
+        }
+        std::ostringstream res;
+        res << direction << " " << m_deviceKey << " type=" << (m_dataType == CUDNN_DATA_FLOAT ? "float" : "double")
+            << " batch=" << batchSize << " maxMem=" << maxMem << " " << (std::string)*m_geometry;
+        return res.str();
     }
 
     static ElemType* ptr(Mat& src)
@@ -429,6 +470,8 @@ private:
     ConvAlgoInfo<cudnnConvolutionFwdAlgoPerf_t> m_fwdAlgo;
     ConvAlgoInfo<cudnnConvolutionBwdDataAlgoPerf_t> m_backDataAlgo;
     ConvAlgoInfo<cudnnConvolutionBwdFilterAlgoPerf_t> m_backFiltAlgo;
+    // GPU model and cuDNN version part of the algorithm cache keys, computed on first use
+    mutable std::string m_deviceKey;
 };
 
 template <class ElemType>
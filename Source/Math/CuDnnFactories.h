@@ -7,6 +7,7 @@
 
 #include "ConvolutionEngine.h"
 #include "BatchNormalizationEngine.h"
+#include "RNNEngine.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -28,6 +29,14 @@ public:
                                                              bool spatial, ImageLayoutKind imageLayout);
 };
 
+template <class ElemType>
+class CuDnnRNNEngineFactory
+{
+public:
+    static std::unique_ptr<RNNEngine<ElemType>> Create(DEVICEID_TYPE deviceId, const RNNAttributes& attributes, size_t inputDim);
+    static bool IsSupported(DEVICEID_TYPE deviceId);
+};
+
 // REVIEW alexeyk: wrong place? It is currently used only in unit tests but I can't add it there because of the build issues.
 // Timer that can be used to measure CUDA calls. 
 // Uses CUDA event and will synchronize(!) the stream when Stop is called.
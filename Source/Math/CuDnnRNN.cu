@@ -0,0 +1,474 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CuDnnFactories.h"
+#include "RNNEngine.h"
+#include "CuDnnCommon.h"
+#include "GPUMatrix.h"
+#include <algorithm>
+#include <numeric>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#if CUDNN_MAJOR >= 5
+
+class CuDnnDropout
+{
+public:
+    CuDnnDropout(const CuDnn::ptr_t& cudnn, DEVICEID_TYPE deviceId)
+        : m_dropout(nullptr), m_states(deviceId)
+    {
+        CUDNN_CALL(cudnnCreateDropoutDescriptor(&m_dropout));
+        size_t stateSize;
+        CUDNN_CALL(cudnnDropoutGetStatesSize(*cudnn, &stateSize));
+        m_states.Resize(1, (stateSize + sizeof(float) - 1) / sizeof(float));
+        // no dropout between the layers; CNTK applies dropout with its own node
+        CUDNN_CALL(cudnnSetDropoutDescriptor(m_dropout, *cudnn, 0.0f, m_states.Data(), stateSize, 0));
+    }
+
+    ~CuDnnDropout()
+    {
+        if (m_dropout != nullptr)
+        {
+            cudnnDestroyDropoutDescriptor(m_dropout);
+            m_dropout = nullptr;
+        }
+    }
+
+    operator cudnnDropoutDescriptor_t() const
+    {
+        return m_dropout;
+    }
+
+    DISABLE_COPY_AND_MOVE(CuDnnDropout);
+
+private:
+    cudnnDropoutDescriptor_t m_dropout;
+    Matrix<float> m_states;
+};
+
+class CuDnnRNN
+{
+public:
+    CuDnnRNN(const CuDnn::ptr_t& cudnn, const RNNAttributes& attributes, const CuDnnDropout& dropout, cudnnDataType_t dataType)
+        : m_rnn(nullptr)
+    {
+        CUDNN_CALL(cudnnCreateRNNDescriptor(&m_rnn));
+        cudnnDirectionMode_t direction = attributes.m_bidirectional ? CUDNN_BIDIRECTIONAL : CUDNN_UNIDIRECTIONAL;
+        cudnnRNNMode_t mode = attributes.m_kind == RNNKind::LSTM ? CUDNN_LSTM : CUDNN_GRU;
+#if CUDNN_MAJOR >= 6
+        CUDNN_CALL(cudnnSetRNNDescriptor_v5(m_rnn, (int)attributes.m_hiddenSize, (int)attributes.m_numLayers, dropout, CUDNN_LINEAR_INPUT, direction, mode, dataType));
+#else
+        CUDNN_CALL(cudnnSetRNNDescriptor(m_rnn, (int)attributes.m_hiddenSize, (int)attributes.m_numLayers, dropout, CUDNN_LINEAR_INPUT, direction, mode, dataType));
+#endif
+    }
+
+    ~CuDnnRNN()
+    {
+        if (m_rnn != nullptr)
+        {
+            cudnnDestroyRNNDescriptor(m_rnn);
+            m_rnn = nullptr;
+        }
+    }
+
+    operator cudnnRNNDescriptor_t() const
+    {
+        return m_rnn;
+    }
+
+    DISABLE_COPY_AND_MOVE(CuDnnRNN);
+
+private:
+    cudnnRNNDescriptor_t m_rnn;
+};
+
+class CuDnnFilter
+{
+public:
+    CuDnnFilter(cudnnDataType_t dataType, size_t numElements)
+        : m_filter(nullptr)
+    {
+        CUDNN_CALL(cudnnCreateFilterDescriptor(&m_filter));
+        int dims[3] = { (int)numElements, 1, 1 };
+        CUDNN_CALL(cudnnSetFilterNdDescriptor(m_filter, dataType, CUDNN_TENSOR_NCHW, 3, dims));
+    }
+
+    CuDnnFilter()
+        : m_filter(nullptr)
+    {
+        CUDNN_CALL(cudnnCreateFilterDescriptor(&m_filter));
+    }
+
+    ~CuDnnFilter()
+    {
+        if (m_filter != nullptr)
+        {
+            cudnnDestroyFilterDescriptor(m_filter);
+            m_filter = nullptr;
+        }
+    }
+
+    size_t GetNumElements() const
+    {
+        cudnnDataType_t dataType;
+        cudnnTensorFormat_t format;
+        int nbDims;
+        int dims[3];
+        CUDNN_CALL(cudnnGetFilterNdDescriptor(m_filter, 3, &dataType, &format, &nbDims, dims));
+        size_t n = 1;
+        for (int i = 0; i < nbDims; i++)
+            n *= dims[i];
+        return n;
+    }
+
+    operator cudnnFilterDescriptor_t() const
+    {
+        return m_filter;
+    }
+
+    DISABLE_COPY_AND_MOVE(CuDnnFilter);
+
+private:
+    cudnnFilterDescriptor_t m_filter;
+};
+
+// The frames of one time step of all sequences that are that long, as cuDNN takes them.
+class CuDnnSequenceTensors
+{
+public:
+    CuDnnSequenceTensors()
+    {
+    }
+
+    ~CuDnnSequenceTensors()
+    {
+        Clear();
+    }
+
+    // batchSizes[t] is the number of sequences that have a frame t; 'dim' is the frame dimension
+    void Set(const std::vector<size_t>& batchSizes, size_t dim, cudnnDataType_t dataType)
+    {
+        Clear();
+        for (size_t batchSize : batchSizes)
+        {
+            cudnnTensorDescriptor_t tensor;
+            CUDNN_CALL(cudnnCreateTensorDescriptor(&tensor));
+            m_tensors.push_back(tensor);
+            int dims[3] = { (int)batchSize, (int)dim, 1 };
+            int strides[3] = { (int)dim, 1, 1 };
+            CUDNN_CALL(cudnnSetTensorNdDescriptor(tensor, dataType, 3, dims, strides));
+        }
+    }
+
+    // the initial or final states of all layers and directions: [numStates x batchSize x dim]
+    void SetStates(size_t numStates, size_t batchSize, size_t dim, cudnnDataType_t dataType)
+    {
+        Clear();
+        cudnnTensorDescriptor_t tensor;
+        CUDNN_CALL(cudnnCreateTensorDescriptor(&tensor));
+        m_tensors.push_back(tensor);
+        int dims[3] = { (int)numStates, (int)batchSize, (int)dim };
+        int strides[3] = { (int)(batchSize * dim), (int)dim, 1 };
+        CUDNN_CALL(cudnnSetTensorNdDescriptor(tensor, dataType, 3, dims, strides));
+    }
+
+    int GetNumSteps() const { return (int)m_tensors.size(); }
+    const cudnnTensorDescriptor_t* Data() const { return m_tensors.data(); }
+
+    DISABLE_COPY_AND_MOVE(CuDnnSequenceTensors);
+
+private:
+    void Clear()
+    {
+        for (auto tensor : m_tensors)
+            cudnnDestroyTensorDescriptor(tensor);
+        m_tensors.clear();
+    }
+
+    std::vector<cudnnTensorDescriptor_t> m_tensors;
+};
+
+template <class ElemType>
+class CuDnnRNNEngine : public RNNEngine<ElemType>
+{
+public:
+    using Base = RNNEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    CuDnnRNNEngine(DEVICEID_TYPE deviceId, const RNNAttributes& attributes, size_t inputDim)
+        : Base(deviceId, attributes, inputDim),
+        m_cudnn(CuDnn::Instance()),
+        m_dataType(CuDnnTensor::GetDataType<ElemType>()),
+        m_dropout(m_cudnn, deviceId),
+        m_rnn(m_cudnn, attributes, m_dropout, m_dataType),
+        m_packedColumns(deviceId), m_packedX(deviceId), m_packedY(deviceId), m_packedDy(deviceId), m_packedDx(deviceId),
+        m_weights(deviceId), m_weightsGrad(deviceId), m_workspace(deviceId),
+        m_numPackedColumns(0)
+    {
+        InitParameterLayout();
+    }
+
+protected:
+    using Base::m_deviceId;
+    using Base::m_attributes;
+    using Base::m_inputDim;
+
+    void EnsureCompatible() override
+    {
+        if (m_deviceId < 0)
+            InvalidArgument("cuDNN RNN engine supports GPU devices only.");
+    }
+
+    void ForwardCore(const Mat& in, const Mat& weights, Mat& out, size_t numParallelSequences, const std::vector<RNNSequence>& sequences, Mat& reserve) override
+    {
+        CuDnn::UseCurrentStream(m_cudnn);
+        SetSequences(numParallelSequences, sequences);
+        if (m_numPackedColumns == 0)
+        {
+            out.SetValue(0);
+            return;
+        }
+        CopyParameters(weights, m_weights, /*toCuDnn=*/true);
+
+        m_packedX.DoGatherColumnsOf(0, m_packedColumns, in, 1);
+        m_packedY.Resize(m_attributes.GetOutputDim(), m_numPackedColumns);
+        ResizeReserve(reserve);
+        CUDNN_CALL(cudnnRNNForwardTraining(*m_cudnn, m_rnn, m_xTensors.GetNumSteps(),
+                                           m_xTensors.Data(), ptr(m_packedX), m_stateTensors.Data()[0], nullptr, m_stateTensors.Data()[0], nullptr,
+                                           *m_weightsFilter, ptr(m_weights), m_yTensors.Data(), ptr(m_packedY),
+                                           m_stateTensors.Data()[0], nullptr, m_stateTensors.Data()[0], nullptr,
+                                           ptr(m_workspace), m_workspace.GetNumElements() * sizeof(ElemType),
+                                           ptr(reserve), reserve.GetNumElements() * sizeof(ElemType)));
+        out.DoScatterColumnsOf(0, m_packedColumns, m_packedY, 1, /*idxIsUnique=*/true); // each frame is packed once
+    }
+
+    void BackwardDataCore(const Mat& /*out*/, const Mat& outGrad, const Mat& weights, Mat& inGrad, Mat& reserve) override
+    {
+        if (m_numPackedColumns == 0)
+            return;
+        UNUSED(weights); // the forward pass has converted them already
+        CuDnn::UseCurrentStream(m_cudnn);
+        m_packedDy.DoGatherColumnsOf(0, m_packedColumns, outGrad, 1);
+        // cuDNN always computes the input gradient; it is needed for the weights gradient in any case
+        m_packedDx.Resize(m_inputDim, m_numPackedColumns);
+        CUDNN_CALL(cudnnRNNBackwardData(*m_cudnn, m_rnn, m_xTensors.GetNumSteps(),
+                                        m_yTensors.Data(), ptr(m_packedY), m_yTensors.Data(), ptr(m_packedDy),
+                                        m_stateTensors.Data()[0], nullptr, m_stateTensors.Data()[0], nullptr,
+                                        *m_weightsFilter, ptr(m_weights), m_stateTensors.Data()[0], nullptr, m_stateTensors.Data()[0], nullptr,
+                                        m_xTensors.Data(), ptr(m_packedDx), m_stateTensors.Data()[0], nullptr, m_stateTensors.Data()[0], nullptr,
+                                        ptr(m_workspace), m_workspace.GetNumElements() * sizeof(ElemType),
+                                        ptr(reserve), reserve.GetNumElements() * sizeof(ElemType)));
+        if (!inGrad.IsEmpty())
+            inGrad.DoScatterColumnsOf(1, m_packedColumns, m_packedDx, 1, /*idxIsUnique=*/true);
+    }
+
+    void BackwardWeightsCore(const Mat& /*in*/, const Mat& /*out*/, Mat& weightsGrad, Mat& reserve) override
+    {
+        if (m_numPackedColumns == 0)
+            return;
+        CuDnn::UseCurrentStream(m_cudnn);
+        // cuDNN adds to the gradient, which is in its own layout
+        m_weightsGrad.Resize(m_weights);
+        m_weightsGrad.SetValue(0);
+        CUDNN_CALL(cudnnRNNBackwardWeights(*m_cudnn, m_rnn, m_xTensors.GetNumSteps(),
+                                           m_xTensors.Data(), ptr(m_packedX), m_stateTensors.Data()[0], nullptr,
+                                           m_yTensors.Data(), ptr(m_packedY),
+                                           ptr(m_workspace), m_workspace.GetNumElements() * sizeof(ElemType),
+                                           *m_weightsFilter, ptr(m_weightsGrad),
+                                           ptr(reserve), reserve.GetNumElements() * sizeof(ElemType)));
+        CopyParameters(weightsGrad, m_weightsGrad, /*toCuDnn=*/false);
+    }
+
+private:
+    // a run of parameters that is contiguous in both layouts
+    struct ParameterBlock
+    {
+        size_t offset;      // in the RNNAttributes layout
+        size_t cudnnOffset; // in the layout of cuDNN
+        size_t numElements;
+    };
+
+    // cuDNN may pad or reorder the matrices of its parameter buffer, so locate each of them
+    void InitParameterLayout()
+    {
+        size_t H = m_attributes.m_hiddenSize, G = m_attributes.GetNumGates();
+        CuDnnSequenceTensors xTensor;
+        xTensor.Set({ 1 }, m_inputDim, m_dataType);
+        size_t paramsBytes;
+        CUDNN_CALL(cudnnGetRNNParamsSize(*m_cudnn, m_rnn, xTensor.Data()[0], &paramsBytes, m_dataType));
+        size_t numCuDnnParameters = paramsBytes / sizeof(ElemType);
+        m_weightsFilter = std::make_unique<CuDnnFilter>(m_dataType, numCuDnnParameters);
+        m_weights.Resize(numCuDnnParameters, 1);
+        m_weights.SetValue(0);
+
+        m_parameterBlocks.clear();
+        const ElemType* base = m_weights.Data();
+        for (size_t l = 0; l < m_attributes.m_numLayers; l++)
+        {
+            size_t inDim = m_attributes.GetLayerInputDim(m_inputDim, l);
+            for (size_t d = 0; d < m_attributes.GetNumDirections(); d++)
+            {
+                int pseudoLayer = (int)(l * m_attributes.GetNumDirections() + d);
+                size_t offset = m_attributes.GetLayerParametersOffset(m_inputDim, l, d);
+                // linear layers 0...G-1 apply to the input, G...2G-1 to the recurrent state
+                for (int linLayer = 0; linLayer < (int)(2 * G); linLayer++)
+                {
+                    bool recurrent = linLayer >= (int)G;
+                    size_t g = linLayer % G;
+                    CuDnnFilter matrixFilter, biasFilter;
+                    ElemType* matrix;
+                    ElemType* bias;
+                    CUDNN_CALL(cudnnGetRNNLinLayerMatrixParams(*m_cudnn, m_rnn, pseudoLayer, xTensor.Data()[0], *m_weightsFilter, ptr(m_weights),
+                                                               linLayer, matrixFilter, (void**)&matrix));
+                    CUDNN_CALL(cudnnGetRNNLinLayerBiasParams(*m_cudnn, m_rnn, pseudoLayer, xTensor.Data()[0], *m_weightsFilter, ptr(m_weights),
+                                                             linLayer, biasFilter, (void**)&bias));
+                    size_t matrixOffset = recurrent ? G * H * inDim + g * H * H : g * H * inDim;
+                    size_t biasOffset = G * H * (inDim + H) + (recurrent ? G * H : 0) + g * H;
+                    AddParameterBlock(offset + matrixOffset, matrix - base, matrixFilter.GetNumElements());
+                    AddParameterBlock(offset + biasOffset, bias - base, biasFilter.GetNumElements());
+                }
+            }
+        }
+    }
+
+    void AddParameterBlock(size_t offset, size_t cudnnOffset, size_t numElements)
+    {
+        if (!m_parameterBlocks.empty())
+        {
+            auto& last = m_parameterBlocks.back();
+            if (last.offset + last.numElements == offset && last.cudnnOffset + last.numElements == cudnnOffset)
+            {
+                last.numElements += numElements;
+                return;
+            }
+        }
+        m_parameterBlocks.push_back(ParameterBlock{ offset, cudnnOffset, numElements });
+    }
+
+    // copies the parameters into the cuDNN layout, or adds gradients in the cuDNN layout to 'params'
+    void CopyParameters(const Mat& params, Mat& cudnnParams, bool toCuDnn)
+    {
+        Mat paramsRow = params.Reshaped(1, params.GetNumElements());
+        Mat cudnnParamsRow = cudnnParams.Reshaped(1, cudnnParams.GetNumElements());
+        for (const auto& block : m_parameterBlocks)
+        {
+            Mat ours = paramsRow.ColumnSlice(block.offset, block.numElements);
+            Mat theirs = cudnnParamsRow.ColumnSlice(block.cudnnOffset, block.numElements);
+            if (toCuDnn)
+                theirs.AssignValuesOf(ours);
+            else
+                Mat::ScaleAndAdd(1, theirs, ours);
+        }
+    }
+
+    // cuDNN takes the sequences sorted by length, one time step after another
+    void SetSequences(size_t numParallelSequences, const std::vector<RNNSequence>& sequences)
+    {
+        std::vector<size_t> order(sequences.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&sequences](size_t a, size_t b)
+        {
+            return sequences[a].tEnd - sequences[a].tBegin > sequences[b].tEnd - sequences[b].tBegin;
+        });
+
+        std::vector<ElemType> columns;
+        std::vector<size_t> batchSizes;
+        for (size_t t = 0; !order.empty() && t < sequences[order[0]].tEnd - sequences[order[0]].tBegin; t++)
+        {
+            size_t batchSize = 0;
+            for (size_t i : order)
+            {
+                const auto& seq = sequences[i];
+                if (t >= seq.tEnd - seq.tBegin)
+                    break;
+                columns.push_back((ElemType)((seq.tBegin + t) * numParallelSequences + seq.s));
+                batchSize++;
+            }
+            batchSizes.push_back(batchSize);
+        }
+
+        m_numPackedColumns = columns.size();
+        if (m_numPackedColumns == 0)
+            return;
+        m_packedColumns.SetValue(1, m_numPackedColumns, m_deviceId, columns.data());
+        m_xTensors.Set(batchSizes, m_inputDim, m_dataType);
+        m_yTensors.Set(batchSizes, m_attributes.GetOutputDim(), m_dataType);
+        m_stateTensors.SetStates(m_attributes.m_numLayers * m_attributes.GetNumDirections(), batchSizes[0], m_attributes.m_hiddenSize, m_dataType);
+
+        size_t workspaceBytes;
+        CUDNN_CALL(cudnnGetRNNWorkspaceSize(*m_cudnn, m_rnn, m_xTensors.GetNumSteps(), m_xTensors.Data(), &workspaceBytes));
+        m_workspace.Resize((workspaceBytes + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
+    }
+
+    void ResizeReserve(Mat& reserve)
+    {
+        size_t reserveBytes;
+        CUDNN_CALL(cudnnGetRNNTrainingReserveSize(*m_cudnn, m_rnn, m_xTensors.GetNumSteps(), m_xTensors.Data(), &reserveBytes));
+        reserve.Resize((reserveBytes + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
+    }
+
+    static ElemType* ptr(Mat& src)
+    {
+        return src.Data();
+    }
+    static const ElemType* ptr(const Mat& src)
+    {
+        return src.Data();
+    }
+
+private:
+    CuDnn::ptr_t m_cudnn;
+    cudnnDataType_t m_dataType;
+    CuDnnDropout m_dropout;
+    CuDnnRNN m_rnn;
+    CuDnnSequenceTensors m_xTensors;
+    CuDnnSequenceTensors m_yTensors;
+    CuDnnSequenceTensors m_stateTensors; // for the initial and final states, which are not passed (zero)
+    std::unique_ptr<CuDnnFilter> m_weightsFilter;
+    std::vector<ParameterBlock> m_parameterBlocks;
+
+    Mat m_packedColumns; // for each packed frame, its column in the minibatch
+    Mat m_packedX, m_packedY, m_packedDy, m_packedDx;
+    Mat m_weights, m_weightsGrad; // in the layout of cuDNN
+    Mat m_workspace;
+    size_t m_numPackedColumns;
+};
+
+template class CuDnnRNNEngine<float>;
+template class CuDnnRNNEngine<double>;
+
+#endif
+
+template <typename ElemType>
+std::unique_ptr<RNNEngine<ElemType>> CuDnnRNNEngineFactory<ElemType>::Create(DEVICEID_TYPE deviceId, const RNNAttributes& attributes, size_t inputDim)
+{
+#if CUDNN_MAJOR >= 5
+    return std::make_unique<CuDnnRNNEngine<ElemType>>(deviceId, attributes, inputDim);
+#else
+    UNUSED(deviceId); UNUSED(attributes); UNUSED(inputDim);
+    RuntimeError("The cuDNN RNN engine requires cuDNN 5 or later.");
+#endif
+}
+
+template <typename ElemType>
+bool CuDnnRNNEngineFactory<ElemType>::IsSupported(DEVICEID_TYPE deviceId)
+{
+#if CUDNN_MAJOR >= 5
+    cudaDeviceProp props = {0};
+    // Note that cudaGetDeviceProperties also sets CUDA last error so need to check/clear both.
+    return deviceId >= 0 && (cudaGetDeviceProperties(&props, deviceId) | cudaGetLastError()) == cudaSuccess && props.major >= 3;
+#else
+    UNUSED(deviceId);
+    return false;
+#endif
+}
+
+template class CuDnnRNNEngineFactory<float>;
+template class CuDnnRNNEngineFactory<double>;
+
+} } }
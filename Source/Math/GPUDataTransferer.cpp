@@ -2,6 +2,7 @@
 #include "Basics.h"
 #include "GPUDataTransferer.h"
 #include "GPUMatrix.h"
+#include "CUDAPageLockedMemAllocator.h"
 
 #pragma comment(lib, "cudart.lib")
 
@@ -137,6 +138,163 @@ void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUAsync()
     SyncEvent(m_assignCompleteEvent);
 }
 
+// -----------------------------------------------------------------------
+// PrefetchGPUDataTransferer -- see CommonMatrix.h
+// -----------------------------------------------------------------------
+
+// same as SyncEvent() above, for the non-templated class
+static void SyncUploadEvent(cudaEvent_t ev)
+{
+    auto rc = cudaEventQuery(ev);
+    if (rc != cudaErrorNotReady)
+    {
+        rc || "cudaEventQuery failed";
+        return;
+    }
+    cudaEventSynchronize(ev) || "cudaEventSynchronize failed";
+}
+
+// buffers grow with some slack, since minibatch sizes vary from batch to batch (e.g. with sequence lengths)
+static size_t GetGrownBufferSize(size_t numBytes)
+{
+    return numBytes + numBytes / 4;
+}
+
+PrefetchGPUDataTransferer::PrefetchGPUDataTransferer(DEVICEID_TYPE deviceId, size_t numPinnedBuffers)
+    : m_deviceId(deviceId), m_currentSlot(0), m_pinnedBuffers(numPinnedBuffers), m_copyStream(nullptr), m_uploadedEvents(numPinnedBuffers, nullptr), m_consumedEvent(nullptr), m_allocatedEvent(nullptr)
+{
+    if (numPinnedBuffers == 0)
+        InvalidArgument("PrefetchGPUDataTransferer: numPinnedBuffers must be at least 1.");
+
+    PrepareDevice(m_deviceId);
+
+    cudaStream_t stream;
+    cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking) || "cudaStreamCreateWithFlags failed";
+    m_copyStream = stream;
+
+    // Note: Do NOT use cudaEventBlockingSync, see GPUDataTransferer above.
+    cudaEvent_t ev;
+    for (auto& uploadedEvent : m_uploadedEvents)
+    {
+        cudaEventCreateWithFlags(&ev, cudaEventDisableTiming) || "cudaEventCreateWithFlags failed";
+        uploadedEvent = ev;
+    }
+    cudaEventCreateWithFlags(&ev, cudaEventDisableTiming) || "cudaEventCreateWithFlags failed";
+    m_consumedEvent = ev;
+    cudaEventCreateWithFlags(&ev, cudaEventDisableTiming) || "cudaEventCreateWithFlags failed";
+    m_allocatedEvent = ev;
+}
+
+PrefetchGPUDataTransferer::~PrefetchGPUDataTransferer()
+{
+    // TODO: Check for error code and throw if !std::uncaught_exception()
+    PrepareDevice(m_deviceId);
+    cudaStreamSynchronize((cudaStream_t) m_copyStream);
+
+    for (auto& slot : m_pinnedBuffers)
+        for (auto& buffer : slot)
+            if (buffer.m_data)
+                CUDAPageLockedMemAllocator::Free(buffer.m_data, m_deviceId);
+    for (auto& buffer : m_deviceBuffers)
+        if (buffer.m_data)
+            TracingGPUMemoryAllocator::Free<char>(m_deviceId, buffer.m_data, true);
+
+    for (auto uploadedEvent : m_uploadedEvents)
+        cudaEventDestroy((cudaEvent_t) uploadedEvent);
+    cudaEventDestroy((cudaEvent_t) m_consumedEvent);
+    cudaEventDestroy((cudaEvent_t) m_allocatedEvent);
+    cudaStreamDestroy((cudaStream_t) m_copyStream);
+}
+
+void PrefetchGPUDataTransferer::BeginBatch()
+{
+    PrepareDevice(m_deviceId);
+
+    m_currentSlot = (m_currentSlot + 1) % m_pinnedBuffers.size();
+    // the pinned memory of this slot may still be read by the uploads of an earlier batch
+    SyncUploadEvent((cudaEvent_t) m_uploadedEvents[m_currentSlot]);
+    // and the device buffers by the consumer of the previous batch
+    cudaStreamWaitEvent((cudaStream_t) m_copyStream, (cudaEvent_t) m_consumedEvent, 0) || "cudaStreamWaitEvent failed";
+}
+
+const void* PrefetchGPUDataTransferer::CopyCPUToGPUAsync(size_t bufferId, const void* cpuBuffer, size_t numBytes, bool cpuBufferIsPageLocked)
+{
+    PrepareDevice(m_deviceId);
+
+    auto& slot = m_pinnedBuffers[m_currentSlot];
+    if (slot.size() <= bufferId)
+        slot.resize(bufferId + 1, Buffer{nullptr, 0});
+    if (m_deviceBuffers.size() <= bufferId)
+        m_deviceBuffers.resize(bufferId + 1, Buffer{nullptr, 0});
+
+    auto& pinnedBuffer = slot[bufferId];
+    if (!cpuBufferIsPageLocked && pinnedBuffer.m_size < numBytes)
+    {
+        // BeginBatch() has waited for the slot already, so its old buffer is no longer in use
+        if (pinnedBuffer.m_data)
+            CUDAPageLockedMemAllocator::Free(pinnedBuffer.m_data, m_deviceId);
+        pinnedBuffer.m_size = GetGrownBufferSize(numBytes);
+        pinnedBuffer.m_data = (char*) CUDAPageLockedMemAllocator::Malloc(pinnedBuffer.m_size, m_deviceId);
+    }
+
+    auto& deviceBuffer = m_deviceBuffers[bufferId];
+    if (deviceBuffer.m_size < numBytes)
+    {
+        // the old buffer may still be the target of an upload of this stream
+        cudaStreamSynchronize((cudaStream_t) m_copyStream) || "cudaStreamSynchronize failed";
+        if (deviceBuffer.m_data)
+            TracingGPUMemoryAllocator::Free<char>(m_deviceId, deviceBuffer.m_data);
+        deviceBuffer.m_size = GetGrownBufferSize(numBytes);
+        deviceBuffer.m_data = TracingGPUMemoryAllocator::Allocate<char>(m_deviceId, deviceBuffer.m_size);
+        // a recycled buffer of the memory cache may still be in use by work on the default stream, which our stream does not wait for
+        cudaEventRecord((cudaEvent_t) m_allocatedEvent, cudaStreamDefault) || "cudaEventRecord failed";
+        cudaStreamWaitEvent((cudaStream_t) m_copyStream, (cudaEvent_t) m_allocatedEvent, 0) || "cudaStreamWaitEvent failed";
+    }
+
+    if (numBytes > 0)
+    {
+        // a page-locked source is read by the DMA engine directly, otherwise it is staged through the slot's pinned buffer
+        const void* source = cpuBuffer;
+        if (!cpuBufferIsPageLocked)
+        {
+            memcpy(pinnedBuffer.m_data, cpuBuffer, numBytes);
+            source = pinnedBuffer.m_data;
+        }
+        cudaMemcpyAsync(deviceBuffer.m_data, source, numBytes, cudaMemcpyHostToDevice, (cudaStream_t) m_copyStream) || "cudaMemcpyAsync failed";
+    }
+    return deviceBuffer.m_data;
+}
+
+void PrefetchGPUDataTransferer::EndBatch()
+{
+    PrepareDevice(m_deviceId);
+
+    cudaEventRecord((cudaEvent_t) m_uploadedEvents[m_currentSlot], (cudaStream_t) m_copyStream) || "cudaEventRecord failed";
+}
+
+void PrefetchGPUDataTransferer::WaitForHostBuffersReleased()
+{
+    PrepareDevice(m_deviceId);
+
+    SyncUploadEvent((cudaEvent_t) m_uploadedEvents[m_currentSlot]);
+}
+
+void PrefetchGPUDataTransferer::WaitForCopyCPUToGPUAsync()
+{
+    PrepareDevice(m_deviceId);
+
+    // The consumers copy out of the device buffers with cudaMemcpy() on the default stream, which also orders
+    // them before any later work on the (blocking) compute streams.
+    cudaStreamWaitEvent(cudaStreamDefault, (cudaEvent_t) m_uploadedEvents[m_currentSlot], 0) || "cudaStreamWaitEvent failed";
+}
+
+void PrefetchGPUDataTransferer::RecordBuffersConsumed()
+{
+    PrepareDevice(m_deviceId);
+
+    cudaEventRecord((cudaEvent_t) m_consumedEvent, cudaStreamDefault) || "cudaEventRecord failed";
+}
+
 //explicit
 template class GPUDataTransferer<float>;
 template class GPUDataTransferer<double>;
@@ -22,8 +22,11 @@
 #include <curand.h>
 #include <curand_kernel.h>
 #include "cublas_v2.h"
+#include <cuda_fp16.h>
 #include <assert.h>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "CntkBatchNormalization.cuh"
 #include "Convolution.cuh"
 
@@ -43,9 +46,19 @@
 #ifdef _WIN32
 // thread local storage to access the current stream, initalize to default stream
 __declspec(thread)
+#else
+__thread
 #endif
     cudaStream_t t_stream = cudaStreamDefault;
 
+// the cublas handles of the calling thread, one per GPU (see GetCublasHandle())
+#ifdef _WIN32
+static __declspec(thread)
+#else
+static __thread
+#endif
+    cublasHandle_t t_cublasHandle[MAX_GPUS];
+
 #define DEFAULT_THREAD_PER_DIM 16
 
 extern int _ConvertSMVer2Cores(int major, int minor); // forward declaration
@@ -116,6 +129,414 @@ const char* CudaErrString<curandStatus>(curandStatus)
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// buffers freed by the work of a GPUGraph while it is captured; they are kept out of the free lists of the cache
+struct GPUGraphBuffers
+{
+    int m_deviceId;
+    std::vector<std::pair<size_t, void*>> m_buffers; // size class, buffer
+};
+
+// the buffers of the GPUGraph that the calling thread is capturing, if any
+#ifdef _WIN32
+static __declspec(thread)
+#else
+static __thread
+#endif
+    GPUGraphBuffers* t_captureBuffers = nullptr;
+
+// -----------------------------------------------------------------------
+// GPUMemoryCache -- size-binned cache of device buffers behind TracingGPUMemoryAllocator
+// Requests are rounded up to a size class (4 classes per power of two, i.e. at most 25% slack),
+// and freed buffers go onto per-device free lists of their class rather than back to cudaFree().
+// Buffers are reused in host-issue order, which is safe for work issued to the same stream.
+// A buffer freed while a non-default stream is current remembers an event of that stream, and a
+// later allocation from a different stream waits for that event before it uses the buffer.
+// (Work on the default stream needs no event, since the non-default streams are blocking streams.)
+// While a GPUGraph is captured, the buffers its work frees go to the graph instead (t_captureBuffers), and
+// further allocations of the capture reuse those first. A capture cannot wait for events of other streams,
+// so it only takes buffers from the free lists that need no waiting.
+// -----------------------------------------------------------------------
+
+class GPUMemoryCache
+{
+    struct CachedBuffer
+    {
+        void* m_buffer;
+        cudaStream_t m_stream; // stream that was current when the buffer was freed
+        cudaEvent_t m_event;   // recorded on m_stream at that time, or null for the default stream
+    };
+    struct DeviceCache
+    {
+        std::map<size_t, std::vector<CachedBuffer>> m_freeLists; // [size class] -> free buffers of that class
+        std::unordered_map<void*, size_t> m_bufferSizes;   // all buffers owned by the cache, in use or free -> size class
+        GPUMemoryCacheStatistics m_statistics;
+    };
+
+public:
+    static GPUMemoryCache& GetInstance()
+    {
+        // deliberately leaked, so that we never call cudaFree() from a static destructor during process exit
+        static GPUMemoryCache* instance = new GPUMemoryCache();
+        return *instance;
+    }
+
+    static size_t GetSizeClass(size_t numBytes)
+    {
+        const size_t minClass = 512; // cudaMalloc() aligns to at least this anyway
+        if (numBytes <= minClass)
+            return minClass;
+        size_t octave = minClass;
+        while (octave <= numBytes / 2)
+            octave *= 2;               // octave = largest power of two <= numBytes
+        size_t step = octave / 4;
+        return (numBytes + step - 1) / step * step;
+    }
+
+    // caller must have selected the device already (PrepareDevice())
+    void* Allocate(int deviceId, size_t numBytes)
+    {
+        size_t sizeClass = GetSizeClass(numBytes);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bool isCapturing = t_captureBuffers && t_captureBuffers->m_deviceId == deviceId;
+        if (isCapturing)
+        {
+            auto& held = t_captureBuffers->m_buffers;
+            for (auto candidate = held.rbegin(); candidate != held.rend(); ++candidate)
+            {
+                if (candidate->first == sizeClass)
+                {
+                    void* p = candidate->second;
+                    held.erase(candidate.base() - 1);
+                    return p;
+                }
+            }
+        }
+        auto& cache = m_devices[deviceId];
+        auto& freeList = cache.m_freeLists[sizeClass];
+        if (!freeList.empty() && !(isCapturing && freeList.back().m_event && freeList.back().m_stream != t_stream))
+        {
+            // prefer the most recently freed buffer of the current stream, which needs no synchronization
+            auto iter = freeList.end() - 1;
+            for (auto candidate = freeList.rbegin(); candidate != freeList.rend(); ++candidate)
+            {
+                if (candidate->m_stream == t_stream)
+                {
+                    iter = candidate.base() - 1;
+                    break;
+                }
+            }
+            CachedBuffer buffer = *iter;
+            freeList.erase(iter);
+            if (buffer.m_event)
+            {
+                if (buffer.m_stream != t_stream)
+                    CUDA_CALL(cudaStreamWaitEvent(t_stream, buffer.m_event, 0));
+                cudaEventDestroy(buffer.m_event);
+            }
+            void* p = buffer.m_buffer;
+            cache.m_statistics.numHits++;
+            cache.m_statistics.numCachedBuffers--;
+            cache.m_statistics.cachedBytes -= sizeClass;
+            UpdatePeakLocked(cache);
+            return p;
+        }
+
+        cache.m_statistics.numMisses++;
+        void* p = nullptr;
+        cudaError_t err = cudaMalloc(&p, sizeClass);
+        if (err == cudaErrorMemoryAllocation && cache.m_statistics.numCachedBuffers > 0)
+        {
+            // out of memory: give everything we hold back to the runtime and try once more
+            cudaGetLastError(); // clear the sticky error
+            ReleaseLocked(cache);
+            err = cudaMalloc(&p, sizeClass);
+        }
+        CUDA_CALL(err);
+        cache.m_bufferSizes[p] = sizeClass;
+        cache.m_statistics.allocatedBytes += sizeClass;
+        UpdatePeakLocked(cache);
+        return p;
+    }
+
+    // returns false if the buffer was not allocated through the cache, in which case the caller must cudaFree() it
+    bool Free(int deviceId, void* p)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = m_devices.find(deviceId);
+        if (iter == m_devices.end())
+            return false;
+        auto& cache = iter->second;
+        auto sizeIter = cache.m_bufferSizes.find(p);
+        if (sizeIter == cache.m_bufferSizes.end())
+            return false;
+        if (t_captureBuffers && t_captureBuffers->m_deviceId == deviceId)
+        {
+            t_captureBuffers->m_buffers.push_back(std::make_pair(sizeIter->second, p));
+            return true;
+        }
+        CachedBuffer buffer = { p, t_stream, nullptr };
+        if (t_stream != cudaStreamDefault && cudaEventCreateWithFlags(&buffer.m_event, cudaEventDisableTiming) == cudaSuccess)
+            cudaEventRecord(buffer.m_event, t_stream);
+        cache.m_freeLists[sizeIter->second].push_back(buffer);
+        cache.m_statistics.numCachedBuffers++;
+        cache.m_statistics.cachedBytes += sizeIter->second;
+        return true;
+    }
+
+    // puts the buffers a GPUGraph held onto the free lists, once the graph is destroyed
+    void ReturnHeldBuffers(const GPUGraphBuffers& held)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& cache = m_devices[held.m_deviceId];
+        for (const auto& buffer : held.m_buffers)
+        {
+            cache.m_freeLists[buffer.first].push_back(CachedBuffer{ buffer.second, cudaStreamDefault, nullptr });
+            cache.m_statistics.numCachedBuffers++;
+            cache.m_statistics.cachedBytes += buffer.first;
+        }
+    }
+
+    // caller must have selected the device already (PrepareDevice())
+    void Release(int deviceId)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = m_devices.find(deviceId);
+        if (iter != m_devices.end())
+            ReleaseLocked(iter->second);
+    }
+
+    GPUMemoryCacheStatistics GetStatistics(int deviceId)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = m_devices.find(deviceId);
+        return iter != m_devices.end() ? iter->second.m_statistics : GPUMemoryCacheStatistics();
+    }
+
+    void ResetPeak(int deviceId)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& cache = m_devices[deviceId];
+        cache.m_statistics.peakInUseBytes = 0;
+        UpdatePeakLocked(cache);
+    }
+
+private:
+    GPUMemoryCache() { }
+
+    static void UpdatePeakLocked(DeviceCache& cache)
+    {
+        size_t inUseBytes = cache.m_statistics.allocatedBytes - cache.m_statistics.cachedBytes;
+        if (inUseBytes > cache.m_statistics.peakInUseBytes)
+            cache.m_statistics.peakInUseBytes = inUseBytes;
+    }
+
+    void ReleaseLocked(DeviceCache& cache)
+    {
+        for (auto& freeList : cache.m_freeLists)
+        {
+            for (const auto& buffer : freeList.second)
+            {
+                if (buffer.m_event)
+                    cudaEventDestroy(buffer.m_event);
+                cudaFree(buffer.m_buffer); // (synchronizes with all pending work)
+                cache.m_bufferSizes.erase(buffer.m_buffer);
+                cache.m_statistics.allocatedBytes -= freeList.first;
+            }
+            freeList.second.clear();
+        }
+        cache.m_statistics.numCachedBuffers = 0;
+        cache.m_statistics.cachedBytes = 0;
+    }
+
+    std::mutex m_mutex;
+    std::map<int, DeviceCache> m_devices;
+};
+
+void TracingGPUMemoryAllocator::ReleaseCachedMemory(int deviceId)
+{
+    PrepareDevice(deviceId);
+    GPUMemoryCache::GetInstance().Release(deviceId);
+
+    if (IsTraceEnabled())
+    {
+        auto freeAndTotalMemory = GetFreeAndTotalMemoryInMBs(deviceId);
+        fprintf(stderr, "Released cached buffers on DeviceId = %d; GPU Memory Free = %d MB of %d MB\n", (int) deviceId, (int) freeAndTotalMemory.first, (int) freeAndTotalMemory.second);
+    }
+}
+
+GPUMemoryCacheStatistics TracingGPUMemoryAllocator::GetCacheStatistics(int deviceId)
+{
+    return GPUMemoryCache::GetInstance().GetStatistics(deviceId);
+}
+
+void TracingGPUMemoryAllocator::ResetPeakInUseBytes(int deviceId)
+{
+    GPUMemoryCache::GetInstance().ResetPeak(deviceId);
+}
+
+// -----------------------------------------------------------------------
+// GPUStream, GPUEvent
+// -----------------------------------------------------------------------
+
+GPUStream::GPUStream(DEVICEID_TYPE deviceId)
+    : m_deviceId(deviceId), m_stream(nullptr)
+{
+    PrepareDevice(deviceId);
+    cudaStream_t stream;
+    CUDA_CALL(cudaStreamCreate(&stream)); // (a blocking stream, i.e. it synchronizes with the default stream)
+    m_stream = stream;
+}
+
+GPUStream::~GPUStream()
+{
+    if (t_stream == (cudaStream_t) m_stream)
+        t_stream = cudaStreamDefault;
+    cudaStreamDestroy((cudaStream_t) m_stream); // (pending work still completes)
+}
+
+void GPUStream::MakeCurrent() const
+{
+    PrepareDevice(m_deviceId);
+    SetStream((cudaStream_t) m_stream);
+}
+
+/*static*/ void GPUStream::MakeDefaultCurrent()
+{
+    SetStream(cudaStreamDefault);
+}
+
+void GPUStream::Synchronize() const
+{
+    CUDA_CALL(cudaStreamSynchronize((cudaStream_t) m_stream));
+}
+
+GPUEvent::GPUEvent(DEVICEID_TYPE deviceId, bool enableTiming)
+    : m_deviceId(deviceId), m_event(nullptr)
+{
+    PrepareDevice(deviceId);
+    cudaEvent_t event;
+    CUDA_CALL(cudaEventCreateWithFlags(&event, enableTiming ? cudaEventDefault : cudaEventDisableTiming));
+    m_event = event;
+}
+
+GPUEvent::~GPUEvent()
+{
+    cudaEventDestroy((cudaEvent_t) m_event);
+}
+
+void GPUEvent::Record()
+{
+    CUDA_CALL(cudaEventRecord((cudaEvent_t) m_event, t_stream));
+}
+
+void GPUEvent::MakeCurrentStreamWait() const
+{
+    CUDA_CALL(cudaStreamWaitEvent(t_stream, (cudaEvent_t) m_event, 0));
+}
+
+void GPUEvent::Synchronize() const
+{
+    CUDA_CALL(cudaEventSynchronize((cudaEvent_t) m_event));
+}
+
+float GPUEvent::ElapsedMillisecondsSince(const GPUEvent& start) const
+{
+    float ms;
+    CUDA_CALL(cudaEventElapsedTime(&ms, (cudaEvent_t) start.m_event, (cudaEvent_t) m_event));
+    return ms;
+}
+
+// stream capture with per-thread prohibition of unsafe calls needs CUDA 10.1
+#if CUDA_VERSION >= 10010
+#define CUDA_GRAPHS_SUPPORTED
+#endif
+
+GPUGraph::GPUGraph(DEVICEID_TYPE deviceId)
+    : m_deviceId(deviceId), m_stream(nullptr), m_graph(nullptr), m_heldBuffers(new GPUGraphBuffers{ deviceId, {} })
+{
+    PrepareDevice(deviceId);
+    cudaStream_t stream;
+    CUDA_CALL(cudaStreamCreate(&stream)); // (a blocking stream, so that replays are ordered with the default stream)
+    m_stream = stream;
+}
+
+GPUGraph::~GPUGraph()
+{
+    auto heldBuffers = (GPUGraphBuffers*) m_heldBuffers;
+    if (t_captureBuffers == heldBuffers)
+        EndCapture();
+#ifdef CUDA_GRAPHS_SUPPORTED
+    if (m_graph)
+        cudaGraphExecDestroy((cudaGraphExec_t) m_graph);
+#endif
+    if (t_stream == (cudaStream_t) m_stream)
+        t_stream = cudaStreamDefault;
+    cudaStreamDestroy((cudaStream_t) m_stream); // (pending replays still complete)
+    // work issued to the default stream from now on is ordered after the replays, so it may reuse these
+    GPUMemoryCache::GetInstance().ReturnHeldBuffers(*heldBuffers);
+    delete heldBuffers;
+}
+
+/*static*/ bool GPUGraph::IsSupported()
+{
+#ifdef CUDA_GRAPHS_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GPUGraph::BeginCapture()
+{
+#ifdef CUDA_GRAPHS_SUPPORTED
+    if (t_captureBuffers)
+        LogicError("GPUGraph: Captures cannot be nested.");
+    if (m_graph)
+        LogicError("GPUGraph: The graph has been captured already.");
+    PrepareDevice(m_deviceId);
+    SetStream((cudaStream_t) m_stream);
+    CUDA_CALL(cudaStreamBeginCapture((cudaStream_t) m_stream, cudaStreamCaptureModeThreadLocal));
+    t_captureBuffers = (GPUGraphBuffers*) m_heldBuffers;
+#else
+    RuntimeError("GPUGraph: Capturing GPU work requires CUDA 10.1 or later.");
+#endif
+}
+
+bool GPUGraph::EndCapture()
+{
+#ifdef CUDA_GRAPHS_SUPPORTED
+    t_captureBuffers = nullptr;
+    SetStream(cudaStreamDefault);
+    cudaGraph_t graph = nullptr;
+    cudaError_t err = cudaStreamEndCapture((cudaStream_t) m_stream, &graph);
+    if (err == cudaSuccess)
+    {
+        cudaGraphExec_t graphExec;
+        err = cudaGraphInstantiate(&graphExec, graph, nullptr, nullptr, 0);
+        if (err == cudaSuccess)
+            m_graph = graphExec;
+    }
+    if (graph)
+        cudaGraphDestroy(graph);
+    if (err != cudaSuccess) // e.g. an unsafe call in the captured work
+        cudaGetLastError();  // clear the error, it is reported through the return value
+    return err == cudaSuccess;
+#else
+    return false;
+#endif
+}
+
+void GPUGraph::Replay() const
+{
+#ifdef CUDA_GRAPHS_SUPPORTED
+    if (!m_graph)
+        LogicError("GPUGraph::Replay: Nothing has been captured.");
+    CUDA_CALL(cudaGraphLaunch((cudaGraphExec_t) m_graph, (cudaStream_t) m_stream));
+#else
+    LogicError("GPUGraph::Replay: Nothing has been captured.");
+#endif
+}
+
 template <typename AllocatedElemType>
 AllocatedElemType* TracingGPUMemoryAllocator::Allocate(int deviceId, size_t numRows, size_t numCols)
 {
@@ -160,10 +581,14 @@ template <typename AllocatedElemType>
 void TracingGPUMemoryAllocator::Free(int deviceId, AllocatedElemType* bufferPtr, bool ignoreCUDARetCode /*= false*/)
 {
     PrepareDevice(deviceId);
-    if (ignoreCUDARetCode)
-        cudaFree((void*) bufferPtr);
-    else
-        CUDA_CALL(cudaFree((void*) bufferPtr));
+    // buffers owned by the cache go back onto its free list; anything else is returned to CUDA right away
+    if (bufferPtr == nullptr || !GPUMemoryCache::GetInstance().Free(deviceId, (void*) bufferPtr))
+    {
+        if (ignoreCUDARetCode)
+            cudaFree((void*) bufferPtr);
+        else
+            CUDA_CALL(cudaFree((void*) bufferPtr));
+    }
 
     if (IsTraceEnabled())
     {
@@ -179,7 +604,10 @@ AllocatedElemType* TracingGPUMemoryAllocator::AllocateNoTrace(int deviceId, size
     AllocatedElemType* deviceBufferPtr;
 
     PrepareDevice(deviceId);
-    CUDA_CALL(cudaMalloc((void**) &deviceBufferPtr, sizeof(AllocatedElemType) * numElements));
+    if (IsCachingEnabled() && numElements > 0)
+        deviceBufferPtr = (AllocatedElemType*) GPUMemoryCache::GetInstance().Allocate(deviceId, sizeof(AllocatedElemType) * numElements);
+    else
+        CUDA_CALL(cudaMalloc((void**) &deviceBufferPtr, sizeof(AllocatedElemType) * numElements));
 
     return deviceBufferPtr;
 }
@@ -324,6 +752,28 @@ void GPUMatrix<ElemType>::CopySection(size_t numRows, size_t numCols, ElemType*
     CUBLAS_CALL(cublasGetMatrix((int) numRows, (int) numCols, sizeof(ElemType),
                                 Data(), (int) GetNumRows(), dst, (int) colStride));
 }
+template <class ElemType>
+void GPUMatrix<ElemType>::SetElements(size_t firstElement, size_t numElements, const ElemType* src)
+{
+    if (firstElement + numElements > GetNumElements())
+        InvalidArgument("SetElements: The elements [%d, %d) are out of range of the matrix (%d).", (int) firstElement, (int) (firstElement + numElements), (int) GetNumElements());
+    if (numElements == 0)
+        return;
+    PrepareDevice();
+    CUDA_CALL(cudaMemcpy(Data() + firstElement, src, sizeof(ElemType) * numElements, cudaMemcpyHostToDevice));
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SetValueFromOtherDevice(const GPUMatrix<ElemType>& src)
+{
+    RequireSize(src.GetNumRows(), src.GetNumCols());
+    if (IsEmpty())
+        return;
+    // cudaMemcpyPeer() goes through the host if the devices cannot access each other; it does not block the host either way
+    PrepareDevice();
+    CUDA_CALL(cudaMemcpyPeer(Data(), GetComputeDeviceId(), src.Data(), src.GetComputeDeviceId(), sizeof(ElemType) * GetNumElements()));
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::ChangeDeviceTo(DEVICEID_TYPE to_id)
 {
@@ -514,7 +964,7 @@ std::unique_ptr<GPUMatrix<ElemType>> GPUMatrix<ElemType>::GetOrCreateWorkspace()
 {
     // REVIEW alexeyk: not thread-safe, fine for now.
     if (m_workspace == nullptr)
-        m_workspace = std::make_unique<conc_stack<std::unique_ptr<GPUMatrix<ElemType>>>>();
+        m_workspace = std::make_unique<conc_pool<std::unique_ptr<GPUMatrix<ElemType>>>>();
     assert(m_workspace != nullptr);
     auto deviceId = GetComputeDeviceId();
     return m_workspace->pop_or_create([deviceId]()
@@ -816,10 +1266,13 @@ GPUMatrix<ElemType> GPUMatrix<ElemType>::Transpose() const
     return c;
 }
 
-// GetCublasHandle - get a cublas handle for the given GPU, should only need one per GPU
+// GetCublasHandle - get the calling thread's cublas handle for the given GPU, bound to the thread's current stream
 // computeDevice - The compute device for which the cublas handle is desired
 // returns: cublas handle
-// NOTE: we currently don't bother to ever free the CUBLAS handle, it will be freed automatically by CUDA when the process ends
+// A cublas handle holds the stream it is bound to and its own workspace, so a handle shared between threads that
+// run on different streams would race between cublasSetStream() and the call using it; hence each thread that
+// issues GPU math gets its own handle per GPU. The handles are shared between float and double.
+// NOTE: we currently don't bother to ever free the CUBLAS handles, they will be freed automatically by CUDA when the process ends
 template <class ElemType>
 cublasHandle_t GPUMatrix<ElemType>::GetCublasHandle(int computeDevice /*=-1*/)
 {
@@ -829,10 +1282,10 @@ cublasHandle_t GPUMatrix<ElemType>::GetCublasHandle(int computeDevice /*=-1*/)
 
     if (computeDevice < 0 || computeDevice >= MaxGpus)
         LogicError("GetCublasHandle: Maximum GPU exceeded");
-    cublasHandle_t cuHandle = s_cuHandle[computeDevice];
+    cublasHandle_t cuHandle = t_cublasHandle[computeDevice];
     if (cuHandle == NULL)
     {
-        s_cuHandle[computeDevice] = cuHandle = _initCUBLAS<ElemType>(computeDevice);
+        t_cublasHandle[computeDevice] = cuHandle = _initCUBLAS<ElemType>(computeDevice);
     }
     CUBLAS_CALL(cublasSetStream(cuHandle, t_stream));
 
@@ -872,32 +1325,42 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignTransposeOf(const GPUMatrix<Elem
     return *this;
 }
 
-template <class ElemType>
-__global__ void _doGatherColumnsOf(ElemType* us, size_t usStride, const ElemType beta, const ElemType* idx, size_t idxStride, const ElemType* a, size_t aStride, size_t aCols, const ElemType alpha, CUDA_LONG numElements)
+// launch configuration for the column gather/scatter kernels
+// Each block copies a range of rows of one column at a time, so that the threads of a warp access consecutive
+// elements of both matrices (coalesced), and each thread reads its column index once rather than per element.
+// blockIdx.y strides over the columns, blockIdx.x over the rows of a column.
+static void GetColumnsOfLaunchConfig(size_t numRows, size_t numCols, dim3& blocksPerGrid, dim3& threadsPerBlock)
 {
-    CUDA_LONG id = GridDim::GetLinearThreadId();
-    if (id >= numElements) // note: there are no __syncthread() calls inside
-        return;
-
-    // id = i + jOut * usStride;
-    // Each thread processes one element of the output matrix.
-    CUDA_LONG i    = id % usStride; // row index into 'us' and 'a'
-    CUDA_LONG jOut = id / usStride; // col index into 'us' and 'idx'
-
-    auto jInF = idx[jOut * idxStride]; // this is the column we need to get
-    if (::isnan(jInF) || jInF < 0)     // negative index means gap
-        return;
-    size_t jIn = (size_t)jInF;
-    //if (jIn >= aCols)
-    //    return; // actually a failure
-
-    const ElemType&  ra = a[    i + jIn  *  aStride  ];
-    ElemType&       rus = us[id/*i + jOut * usStride*/];
+    const size_t warpSize = 32;
+    size_t numThreads = min((size_t)GridDim::maxThreadsPerBlock, (numRows + warpSize - 1) / warpSize * warpSize);
+    threadsPerBlock = dim3((unsigned int)numThreads);
+    blocksPerGrid = dim3((unsigned int)min((numRows + numThreads - 1) / numThreads, (size_t)4),  // a thread loops over the rows beyond these
+                         (unsigned int)min(numCols, (size_t)65535));                              // a block loops over the columns beyond these
+}
 
-    ElemType res = ra * alpha;
-    if (beta != 0)
-        res += rus * beta;
-    rus = res;
+template <class ElemType>
+__global__ void _doGatherColumnsOf(ElemType* us, size_t usStride, const ElemType beta, const ElemType* idx, size_t idxStride, const ElemType* a, size_t aStride, size_t aCols, const ElemType alpha, CUDA_LONG numRows, CUDA_LONG numCols)
+{
+    // Each block processes one column of the output matrix at a time.
+    for (CUDA_LONG jOut = blockIdx.y; jOut < numCols; jOut += gridDim.y)
+    {
+        auto jInF = idx[jOut * idxStride]; // this is the column we need to get
+        if (::isnan(jInF) || jInF < 0)     // negative index means gap
+            continue;
+        size_t jIn = (size_t)jInF;
+        //if (jIn >= aCols)
+        //    continue; // actually a failure
+
+        const ElemType* pa  = a  + jIn  * aStride;
+        ElemType*       pus = us + jOut * usStride;
+        for (CUDA_LONG i = blockIdx.x * blockDim.x + threadIdx.x; i < numRows; i += blockDim.x * gridDim.x)
+        {
+            ElemType res = pa[i] * alpha;
+            if (beta != 0)
+                res += pus[i] * beta;
+            pus[i] = res;
+        }
+    }
 }
 
 // *this[:,j] = a[:,idx[j]] * alpha + *this[:,j] * beta
@@ -916,14 +1379,14 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoGatherColumnsOf(ElemType beta, const
         InvalidArgument("All matrices must be on the same GPU");
     a.PrepareDevice();
 
+    if (IsEmpty())
+        return *this;
+
     // launch the kernel
-    CUDA_LONG NN = (CUDA_LONG)GetNumElements(); // linear space identifying each individual input element
+    dim3 blocksPerGrid, threadsPerBlock;
+    GetColumnsOfLaunchConfig(GetNumRows(), GetNumCols(), blocksPerGrid, threadsPerBlock);
     SyncGuard syncGuard;
-    GridDim grid(NN);
-    _doGatherColumnsOf<ElemType><<<grid.m_blocksPerGrid, grid.m_threadsPerBlock, 0, t_stream>>>(Data(), GetNumRows(), beta, idx.Data(), idx.GetNumRows(), a.Data(), a.GetNumRows(), a.GetNumCols(), alpha, grid.m_N);
-
-    // Note: The following fails silently (no error, immediate or delayed) for numcols = 10000 under CUDA 7.0.
-    //_doGatherColumnsOf<ElemType><<<GetNumCols(), GetNumRows(), 0, t_stream>>>(Data(), GetNumRows(), beta, idx.Data(), idx.GetNumRows(), a.Data(), a.GetNumRows(), a.GetNumCols(), alpha);
+    _doGatherColumnsOf<ElemType><<<blocksPerGrid, threadsPerBlock, 0, t_stream>>>(Data(), GetNumRows(), beta, idx.Data(), idx.GetNumRows(), a.Data(), a.GetNumRows(), a.GetNumCols(), alpha, (CUDA_LONG)GetNumRows(), (CUDA_LONG)GetNumCols());
 
     return *this;
 }
@@ -941,43 +1404,38 @@ static void Peek(const GPUMatrix<ElemType>& m, const char* which)
     //CUDA_CALL(cudaMemcpy(const_cast<ElemType*>(m.Data()), buf, sizeof(ElemType) * n, cudaMemcpyHostToDevice));
 }
 
-#define ALLOW_ATOMIC_SCATTER // allow to disable this, until we know atomicAdd() works properly here
-
-template <class ElemType>
-__global__ void _doScatterColumnsOf(ElemType* us, size_t usStride, size_t usCols, const ElemType* idx, size_t idxStride, const ElemType* a, size_t aStride, const ElemType alpha, CUDA_LONG numElements)
+// useAtomics: target columns may be shared by several source columns. If not, a plain read-modify-write suffices.
+template <class ElemType, bool useAtomics>
+__global__ void _doScatterColumnsOf(ElemType* us, size_t usStride, size_t usCols, const ElemType* idx, size_t idxStride, const ElemType* a, size_t aStride, const ElemType alpha, CUDA_LONG numRows, CUDA_LONG numCols)
 {
-    CUDA_LONG id = GridDim::GetLinearThreadId();
-    if (id >= numElements) // note: there are no __syncthread() calls inside
-        return;
-
-    // id = i + jIn  *  aStride
-    // Each thread processes one element of a
-    CUDA_LONG i   = id % aStride; // row index into 'a' and 'us'
-    CUDA_LONG jIn = id / aStride; // col index into 'a' and 'idx'
-
-    auto jOutF = idx[jIn * idxStride];  // this is the column we copy/add into
-    if (::isnan(jOutF) || jOutF < 0)    // negative index means gap
-        return;
-    size_t jOut = (size_t)jOutF;
-    //if (jOut >= usCols)
-    //    return; // actually a failure  --TODO: This should not be necessary. Why is it?
-
-    const ElemType&  ra =  a[id/*i + jIn  *  aStride*/];
-    ElemType&       rus = us[    i + jOut * usStride  ];
-
-    ElemType res = ra * alpha;
-    if (res != 0)             // avoid memory conflict if e.g. an entire column has no gradient
-#ifdef ALLOW_ATOMIC_SCATTER
-        atomicAdd(&rus, res); // rus += res;
-#else
-        rus += res;
-#endif
-    // Note: atomicAdd() is supposed to be fast in case of no conflict (the simple case of Scatter())
+    // Each block processes one column of a at a time.
+    for (CUDA_LONG jIn = blockIdx.y; jIn < numCols; jIn += gridDim.y)
+    {
+        auto jOutF = idx[jIn * idxStride];  // this is the column we copy/add into
+        if (::isnan(jOutF) || jOutF < 0)    // negative index means gap
+            continue;
+        size_t jOut = (size_t)jOutF;
+        //if (jOut >= usCols)
+        //    continue; // actually a failure  --TODO: This should not be necessary. Why is it?
+
+        const ElemType* pa  = a  + jIn  * aStride;
+        ElemType*       pus = us + jOut * usStride;
+        for (CUDA_LONG i = blockIdx.x * blockDim.x + threadIdx.x; i < numRows; i += blockDim.x * gridDim.x)
+        {
+            ElemType res = pa[i] * alpha;
+            if (!useAtomics)
+                pus[i] += res;
+            else if (res != 0)         // avoid memory conflict if e.g. an entire column has no gradient
+                atomicAdd(&pus[i], res); // pus[i] += res;
+            // Note: atomicAdd() is supposed to be fast in case of no conflict (the simple case of Scatter())
+        }
+    }
 }
 
 // *this[:,idx[j]] = a[:,j] * alpha + *this[:,idx[j]] * beta
+// If idxIsUnique then no two columns of 'a' go to the same target column, and no atomic operations are needed.
 template <class ElemType>
-GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha)
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha, bool idxIsUnique)
 {
     if (idx.GetNumRows() != 1) // index is 1-dimensional only
         InvalidArgument("DoScatterColumnsOf: Map must be a row vector.");
@@ -991,40 +1449,64 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, cons
     a.PrepareDevice();
 
     auto& us = *this;
-
-#ifndef ALLOW_ATOMIC_SCATTER // verify that atomicAdd is not needed  --this is not efficient
-    {
-        vector<ElemType> buf(idx.GetNumRows() * idx.GetNumCols()); // idx(,)are the column(s) we copy/add into
-        CUDA_CALL(cudaMemcpy(buf.data(), idx.Data(), sizeof(ElemType) * buf.size(), cudaMemcpyDeviceToHost));
-        vector<bool> writtenTo(GetNumCols(), false); // remember whether an output column is in fact a target
-        for (size_t i = 0; i < buf.size(); i++)
-        {
-            auto colF = buf[i];
-            if (std::isnan(colF) || colF < 0)
-                continue;
-            size_t col = (size_t)colF;
-            if (col >= GetNumCols())
-                LogicError("DoScatterColumnsOf: Index value out of bounds.");
-            if (writtenTo[col])
-                LogicError("DoScatterColumnsOf: #ifndef ALLOW_ATOMIC_SCATTER then columns must be unique. Column idx(%d,%d)=%d is used twice.", (int)(i % idx.GetNumCols()), (int)(i / idx.GetNumCols()), (int)col);
-            else
-                writtenTo[col] = true;
-        }
-    }
-#endif
+    if (us.IsEmpty())
+        return *this;
 
     // pre-scale with beta upfront
     // Scatter may add more than one source column to the same target, so we must pre-scale with beta, and then just keep adding.
-    Scale(beta, us); // if beta is 0, then this will be a memset()
+    if (beta != 1)
+        Scale(beta, us); // if beta is 0, then this will be a memset()
+
+    if (a.IsEmpty())
+        return *this;
 
     // launch the kernel
-    CUDA_LONG NN = (CUDA_LONG)(a.GetNumElements()); // linear space identifying each individual input element
+    dim3 blocksPerGrid, threadsPerBlock;
+    GetColumnsOfLaunchConfig(a.GetNumRows(), a.GetNumCols(), blocksPerGrid, threadsPerBlock);
     SyncGuard syncGuard;
-    GridDim grid(NN);
-    _doScatterColumnsOf<ElemType><<<grid.m_blocksPerGrid, grid.m_threadsPerBlock, 0, t_stream>>>(Data(), GetNumRows(), GetNumCols(), idx.Data(), idx.GetNumRows(), a.Data(), a.GetNumRows(), alpha, NN);
+    if (idxIsUnique)
+        _doScatterColumnsOf<ElemType, false><<<blocksPerGrid, threadsPerBlock, 0, t_stream>>>(Data(), GetNumRows(), GetNumCols(), idx.Data(), idx.GetNumRows(), a.Data(), a.GetNumRows(), alpha, (CUDA_LONG)a.GetNumRows(), (CUDA_LONG)a.GetNumCols());
+    else
+        _doScatterColumnsOf<ElemType, true><<<blocksPerGrid, threadsPerBlock, 0, t_stream>>>(Data(), GetNumRows(), GetNumCols(), idx.Data(), idx.GetNumRows(), a.Data(), a.GetNumRows(), alpha, (CUDA_LONG)a.GetNumRows(), (CUDA_LONG)a.GetNumCols());
 
-    //SyncGuard syncGuard;
-    //_doScatterColumnsOf<ElemType><<<a.GetNumCols(), a.GetNumRows(), 0, t_stream>>>(Data(), GetNumRows(), GetNumCols(), idx.Data(), idx.GetNumRows(), a.Data(), a.GetNumRows(), alpha, NN);
+    return *this;
+}
+
+template <class ElemType>
+__global__ void _assignPackedIndicesOf(ElemType* us, const ElemType* index, const ElemType* sequenceMap, size_t numParallelSequences, CUDA_LONG numCols)
+{
+    CUDA_LONG j = GridDim::GetLinearThreadId();
+    if (j >= numCols)
+        return;
+
+    ElemType base = sequenceMap[3 * j];   // packed column of time step 0 of the sequence, NaN for gaps
+    ElemType t    = index[j];             // time step within the sequence
+    if (::isnan(base) || !(t >= sequenceMap[3 * j + 1] && t < sequenceMap[3 * j + 2]))
+        us[j] = -1;                       // out-of-range time steps become gaps, as kernels cannot fail
+    else
+        us[j] = base + (ElemType)((size_t)t * numParallelSequences);
+}
+
+// *this[0,j] = sequenceMap(0,j) + index(0,j) * numParallelSequences, see Matrix::AssignPackedIndicesOf()
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPackedIndicesOf(const GPUMatrix<ElemType>& index, const GPUMatrix<ElemType>& sequenceMap, size_t numParallelSequences)
+{
+    if (index.GetNumRows() != 1) // index is 1-dimensional only
+        InvalidArgument("AssignPackedIndicesOf: Index must be a row vector.");
+    if (sequenceMap.GetNumRows() != 3 || sequenceMap.GetNumCols() != index.GetNumCols())
+        InvalidArgument("AssignPackedIndicesOf: Sequence map must have 3 rows and the width of the index.");
+    if (index.GetComputeDeviceId() != sequenceMap.GetComputeDeviceId() || GetComputeDeviceId() != index.GetComputeDeviceId())
+        InvalidArgument("All matrices must be on the same GPU");
+
+    RequireSize(1, index.GetNumCols());
+    if (IsEmpty())
+        return *this;
+
+    index.PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG)GetNumCols();
+    SyncGuard syncGuard;
+    GridDim grid(N);
+    _assignPackedIndicesOf<ElemType><<<grid.m_blocksPerGrid, grid.m_threadsPerBlock, 0, t_stream>>>(Data(), index.Data(), sequenceMap.Data(), numParallelSequences, N);
 
     return *this;
 }
@@ -1193,6 +1675,44 @@ void GPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, i
     SetFormat(matrixFormatDense);
 }
 
+// *this = (data - offset) * scale, see Matrix::SetValueFromCompact()
+// Host data are uploaded as they are, so that the link carries the compact bytes, and converted by the kernel.
+template <class ElemType>
+void GPUMatrix<ElemType>::SetValueFromCompact(const size_t numRows, const size_t numCols, const void* data, CompactElementType type, ElemType scale, const GPUMatrix<ElemType>* offset, size_t matrixFlags)
+{
+    if (offset && (offset->GetNumRows() != numRows || offset->GetNumCols() != 1))
+        InvalidArgument("SetValueFromCompact: The offset must be a column vector of %d elements.", (int) numRows);
+
+    RequireSize(numRows, numCols);
+    if (IsEmpty())
+        return;
+    PrepareDevice();
+
+    size_t numBytes = GetNumElements() * GetCompactElementSize(type);
+    const void* deviceData = data;
+    char* uploaded = nullptr;
+    if (!(matrixFlags & matrixFlagSetValueOnDevice))
+    {
+        uploaded = TracingGPUMemoryAllocator::Allocate<char>(GetComputeDeviceId(), numBytes);
+        CUDA_CALL(cudaMemcpy(uploaded, data, numBytes, cudaMemcpyHostToDevice));
+        deviceData = uploaded;
+    }
+
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    const ElemType* offsets = offset ? offset->Data() : nullptr;
+    {
+        SyncGuard syncGuard;
+        if (type == CompactElementType::uint8)
+            _assignFromCompact<ElemType, unsigned char><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), reinterpret_cast<const unsigned char*>(deviceData), offsets, scale, (CUDA_LONG) numRows, N);
+        else
+            _assignFromCompact<ElemType, half><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), reinterpret_cast<const half*>(deviceData), offsets, scale, (CUDA_LONG) numRows, N);
+    }
+
+    if (uploaded)
+        TracingGPUMemoryAllocator::Free<char>(GetComputeDeviceId(), uploaded); // cudaFree() waits for the kernel
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::SetDiagonalValue(const ElemType v)
 {
@@ -1294,6 +1814,62 @@ void GPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
     _setMaskAndScale<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), N, maskRate, scaleValue);
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SetCounterBasedUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle)
+{
+    PrepareDevice();
+
+    // counter-based, so the mask is generated in a single kernel and matches the CPU (see CPUMatrix::SetCounterBasedUniformRandomMask())
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    CUDA_LONG numBlocks = (N + 3) / 4;
+    uint64_t firstCounter = rngHandle.ReserveCounters(numBlocks);
+    int blocksPerGrid = (int) ceil(numBlocks / (double) GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _setUniformRandomMask<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), N, maskRate, scaleValue, firstCounter, rngHandle.Seed());
+}
+
+// see CPUMatrix::AssignElementProductOfUniformRandomMask()
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignElementProductOfUniformRandomMask(const GPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue,
+                                                                                  const uint64_t seed, const uint64_t firstCounter, const size_t elementOffset, const ElemType beta)
+{
+    if (a.IsEmpty())
+        LogicError("AssignElementProductOfUniformRandomMask: Matrix a is empty.");
+    if (beta == 0)
+        RequireSize(a.GetNumRows(), a.GetNumCols());
+    else if (GetNumRows() != a.GetNumRows() || GetNumCols() != a.GetNumCols())
+        InvalidArgument("AssignElementProductOfUniformRandomMask: The input matrix dimensions do not match.");
+
+    PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil(N / (double) GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _assignElementProductOfUniformRandomMask<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), a.Data(), N, maskRate, scaleValue, firstCounter, seed, elementOffset, beta);
+    return *this;
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SetCounterBasedUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed)
+{
+    PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil((N + 3) / 4 / (double) GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _setCounterBasedRandomValue<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), N, /*gaussian=*/false, low, high - low, seed);
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SetCounterBasedGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed)
+{
+    if (sigma <= 0)
+        InvalidArgument("SetCounterBasedGaussianRandomValue: sigma must be a positive value.");
+    PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil((N + 3) / 4 / (double) GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _setCounterBasedRandomValue<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), N, /*gaussian=*/true, mean, sigma, seed);
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
@@ -1360,6 +1936,89 @@ void GPUMatrix<ElemType>::FSAdagrad(GPUMatrix<ElemType>& gradients,
                                                                          learnRatePerSample, momentum, adaWeight, adaMul);
 }
 
+// Calls launch(params, numBlocks) for consecutive batches of the chunks of the given tensors, each as many as fit into one launch.
+// A tensor with more chunks than fit is continued in the next batch.
+template <class ElemType, class LaunchFunction>
+static void ForEachMultiTensorLaunch(const std::vector<GPUMatrix<ElemType>*>& smoothedGradients,
+                                     const std::vector<GPUMatrix<ElemType>*>& gradients,
+                                     const std::vector<GPUMatrix<ElemType>*>& functionValues,
+                                     const std::vector<ElemType>& learnRatesPerSample,
+                                     const LaunchFunction& launch)
+{
+    typedef MultiTensorLaunchParams<ElemType> Params;
+    Params params;
+    int numTensors = 0;
+    int numBlocks = 0;
+    for (size_t t = 0; t < gradients.size(); t++)
+    {
+        const CUDA_LONG n = (CUDA_LONG) gradients[t]->GetNumElements();
+        const CUDA_LONG numChunks = (n + Params::chunkSize - 1) / Params::chunkSize;
+        int tensor = -1; // of this one in the current batch
+        for (CUDA_LONG chunk = 0; chunk < numChunks; chunk++)
+        {
+            if (tensor < 0)
+            {
+                tensor = numTensors++;
+                params.smoothedGradients[tensor] = smoothedGradients[t]->Data();
+                params.gradients[tensor] = gradients[t]->Data();
+                params.functionValues[tensor] = functionValues[t]->Data();
+                params.learnRatesPerSample[tensor] = learnRatesPerSample[t];
+                params.numElements[tensor] = n;
+                params.tensorIndices[tensor] = (int) t;
+            }
+            params.blockTensors[numBlocks] = (unsigned char) tensor;
+            params.blockChunks[numBlocks] = chunk;
+            numBlocks++;
+
+            if (numBlocks == Params::maxBlocks || (numTensors == Params::maxTensors && chunk == numChunks - 1))
+            {
+                launch(params, numBlocks);
+                numTensors = 0;
+                numBlocks = 0;
+                tensor = -1;
+            }
+        }
+    }
+    if (numBlocks > 0)
+        launch(params, numBlocks);
+}
+
+template <class ElemType>
+/*static*/ void GPUMatrix<ElemType>::MultiTensorNormalGrad(const std::vector<GPUMatrix<ElemType>*>& smoothedGradients,
+                                                          const std::vector<GPUMatrix<ElemType>*>& gradients,
+                                                          const std::vector<GPUMatrix<ElemType>*>& functionValues,
+                                                          const std::vector<ElemType>& learnRatesPerSample,
+                                                          const ElemType momentum, const bool useNesterovMomentum,
+                                                          const ElemType clippingThreshold, const bool clipByTruncation,
+                                                          const ElemType l2RegWeight, const ElemType l1RegWeight)
+{
+    typedef MultiTensorLaunchParams<ElemType> Params;
+    if (gradients.empty())
+        return;
+    gradients[0]->PrepareDevice();
+
+    const bool clip = clippingThreshold != std::numeric_limits<ElemType>::infinity();
+
+    // clipping by norm: first the sums of squares of all gradients, which the update kernel then reads on the device
+    GPUMatrix<ElemType> sumsOfSquares(gradients[0]->GetComputeDeviceId());
+    if (clip && !clipByTruncation)
+    {
+        sumsOfSquares.RequireSize(1, gradients.size());
+        sumsOfSquares.SetValue(0);
+        ForEachMultiTensorLaunch(smoothedGradients, gradients, functionValues, learnRatesPerSample, [&](const Params& params, int numBlocks)
+        {
+            _multiTensorSumOfSquares<ElemType><<<numBlocks, Params::threadsPerBlock, 0, t_stream>>>(params, sumsOfSquares.Data());
+        });
+    }
+
+    const ElemType* sumsOfSquaresData = (clip && !clipByTruncation) ? sumsOfSquares.Data() : nullptr;
+    ForEachMultiTensorLaunch(smoothedGradients, gradients, functionValues, learnRatesPerSample, [&](const Params& params, int numBlocks)
+    {
+        _multiTensorNormalGrad<ElemType><<<numBlocks, Params::threadsPerBlock, 0, t_stream>>>(params, sumsOfSquaresData, clip && clipByTruncation, clippingThreshold,
+                                                                                              l2RegWeight, l1RegWeight, momentum, useNesterovMomentum);
+    });
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::RmsProp(GPUMatrix<ElemType>& gradients,
                                       ElemType RMS_GAMMA,
@@ -1890,6 +2549,23 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignSigmoidOf(const GPUMatrix<ElemTy
 DEF_ELEMWISE_INPLACE_FUNC(SigmoidDerivative)
 DEF_ELEMWISE_ASSIGN_FUNC(SigmoidDerivative)
 
+// epilogue of Matrix::AffineAndActivation()
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::InplaceAddColumnAndActivation(const GPUMatrix<ElemType>& bias, ElementWiseOperator activation)
+{
+    if (bias.GetNumElements() != GetNumRows())
+        InvalidArgument("InplaceAddColumnAndActivation: The bias must have one element per row.");
+    if (IsEmpty())
+        return *this;
+
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    PrepareDevice();
+    SyncGuard syncGuard;
+    _addColumnAndActivation<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), bias.Data(), (CUDA_LONG) GetNumRows(), N, activation);
+    return *this;
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::AssignNoiseContrastiveEstimation(const GPUMatrix<ElemType>& a,
                                                            const GPUMatrix<ElemType>& b, const GPUMatrix<ElemType>& bias, size_t sampleCount, GPUMatrix<ElemType>& tmp, GPUMatrix<ElemType>& c)
@@ -2082,6 +2758,27 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignHardmaxOf(const GPUMatrix<ElemTy
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignTopNHardmaxOf(const GPUMatrix<ElemType>& a, const size_t n)
+{
+    if (a.IsEmpty())
+        LogicError("AssignTopNHardmaxOf: Matrix a is empty.");
+    if (this == &a)
+        LogicError("AssignTopNHardmaxOf: The operation cannot be done in place.");
+    if (n == 0 || n > a.GetNumRows())
+        InvalidArgument("AssignTopNHardmaxOf: n (%d) must be between 1 and the number of rows (%d).", (int) n, (int) a.GetNumRows());
+
+    RequireSize(a.GetNumRows() * n, a.GetNumCols());
+    SetValue(0);
+    PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG) a.GetNumCols();
+    CUDA_LONG M = (CUDA_LONG) a.GetNumRows();
+    SyncGuard syncGuard;
+    _assignColumnwiseTopNHardmaxOf<<<N, 512, 0, t_stream>>>(a.Data(), Data(), N, M, (CUDA_LONG) n);
+
+    return *this;
+}
+
 DEF_ELEMWISE_INPLACE_FUNC(Sqrt)
 DEF_ELEMWISE_ASSIGN_FUNC(Sqrt)
 
@@ -2193,6 +2890,40 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::SetToZeroIfAbsLessThan(const ElemType
     return *this;
 }
 
+// The order of the extracted entries is not deterministic, and if there are more than 'capacity' it is not
+// deterministic which of them are extracted.
+template <class ElemType>
+size_t GPUMatrix<ElemType>::ExtractAbsAboveThreshold(const ElemType threshold, size_t capacity, int* indices, ElemType* values)
+{
+    if (IsEmpty())
+        LogicError("ExtractAbsAboveThreshold: Matrix is empty.");
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil(N * 1.0 / GridDim::maxThreadsPerBlock);
+    PrepareDevice();
+
+    int* d_count = TracingGPUMemoryAllocator::Allocate<int>(GetComputeDeviceId(), 1);
+    int* d_indices = capacity > 0 ? TracingGPUMemoryAllocator::Allocate<int>(GetComputeDeviceId(), capacity) : nullptr;
+    ElemType* d_values = capacity > 0 ? TracingGPUMemoryAllocator::Allocate<ElemType>(GetComputeDeviceId(), capacity) : nullptr;
+    CUDA_CALL(cudaMemsetAsync(d_count, 0, sizeof(int), t_stream));
+    _extractAbsAboveThreshold<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), threshold, N, d_count, (int) capacity, d_indices, d_values);
+
+    int h_count = 0;
+    CUDA_CALL(cudaMemcpy(&h_count, d_count, sizeof(int), cudaMemcpyDeviceToHost));
+    size_t numExtracted = min((size_t) h_count, capacity);
+    if (numExtracted > 0)
+    {
+        CUDA_CALL(cudaMemcpy(indices, d_indices, numExtracted * sizeof(int), cudaMemcpyDeviceToHost));
+        CUDA_CALL(cudaMemcpy(values, d_values, numExtracted * sizeof(ElemType), cudaMemcpyDeviceToHost));
+    }
+    TracingGPUMemoryAllocator::Free<int>(GetComputeDeviceId(), d_count);
+    if (capacity > 0)
+    {
+        TracingGPUMemoryAllocator::Free<int>(GetComputeDeviceId(), d_indices);
+        TracingGPUMemoryAllocator::Free<ElemType>(GetComputeDeviceId(), d_values);
+    }
+    return h_count;
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::SumOfAbsElements() const
 {
@@ -2632,6 +3363,43 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignSignOf(const GPUMatrix<ElemType>
     return *this;
 }
 
+// column j of *this = [scale, packed compact elements of a(:, j)], see Matrix::AssignCompressedOf()
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignCompressedOf(const GPUMatrix<ElemType>& a, CompactElementType type)
+{
+    const size_t numRows = a.GetNumRows();
+    const size_t compressedNumRows = GetCompressedNumRows<ElemType>(numRows, type);
+    RequireSize(compressedNumRows, a.GetNumCols());
+    if (IsEmpty())
+        return *this;
+
+    PrepareDevice();
+    SyncGuard syncGuard;
+    if (type == CompactElementType::uint8)
+        _assignCompressedOf<ElemType, unsigned char><<<(int) GetNumCols(), GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), a.Data(), (CUDA_LONG) numRows, (CUDA_LONG) compressedNumRows);
+    else
+        _assignCompressedOf<ElemType, half><<<(int) GetNumCols(), GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), a.Data(), (CUDA_LONG) numRows, (CUDA_LONG) compressedNumRows);
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignDecompressedOf(const GPUMatrix<ElemType>& compressed, size_t numRows, CompactElementType type)
+{
+    RequireSize(numRows, compressed.GetNumCols());
+    if (IsEmpty())
+        return *this;
+
+    PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    if (type == CompactElementType::uint8)
+        _assignDecompressedOf<ElemType, unsigned char><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), compressed.Data(), (CUDA_LONG) numRows, (CUDA_LONG) compressed.GetNumRows(), N);
+    else
+        _assignDecompressedOf<ElemType, half><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), compressed.Data(), (CUDA_LONG) numRows, (CUDA_LONG) compressed.GetNumRows(), N);
+    return *this;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddSignOf(const GPUMatrix<ElemType>& a)
 {
@@ -2835,6 +3603,33 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignNumOfDiff(const GPUMatrix<ElemTy
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignNumOfTopKErrors(const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& predictions, int topK, bool classIndexLabels, const GPUMatrix<char>* columnsMask)
+{
+    if (labels.GetNumCols() != predictions.GetNumCols())
+        InvalidArgument("AssignNumOfTopKErrors: labels and predictions must have the same number of columns.");
+    if (classIndexLabels ? labels.GetNumRows() != 1 : labels.GetNumRows() != predictions.GetNumRows())
+        InvalidArgument("AssignNumOfTopKErrors: labels must have one row of class indices, or as many rows as the predictions.");
+    if (columnsMask && columnsMask->GetNumCols() != predictions.GetNumCols())
+        InvalidArgument("AssignNumOfTopKErrors: The column mask must have as many columns as the predictions.");
+    if (topK < 1)
+        InvalidArgument("AssignNumOfTopKErrors: topK (%d) must be positive.", topK);
+
+    RequireSize(1, 1); // result should be one element
+    SetValue(0);       // (the columns add their errors atomically; nothing is copied to the host)
+
+    const CUDA_LONG n = (CUDA_LONG) predictions.GetNumCols();
+    if (n == 0)
+        return *this;
+
+    PrepareDevice();
+    SyncGuard syncGuard;
+    const int blockSize = 256;
+    _assignNumOfTopKErrors<blockSize><<<n, blockSize, 0, t_stream>>>(labels.Data(), predictions.Data(), columnsMask ? columnsMask->Data() : nullptr, Data(),
+                                                                     (CUDA_LONG) predictions.GetNumRows(), (CUDA_LONG) topK, classIndexLabels);
+    return *this;
+}
+
 #pragma endregion Member BLAS Functions
 
 #pragma region Other helper functions
@@ -3206,6 +4001,54 @@ static cublasStatus_t cublas_gemm(cublasHandle_t handle, cublasOperation_t trans
 {
     return cublasDgemm(handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
 }
+// GEMM with FP16 operands and FP32 accumulation and output (see GPUHalfPrecision).
+// The operands are rounded into temporary FP16 buffers, which the caching allocator recycles between calls.
+#if CUDA_VERSION >= 8000
+#define CUBLAS_GEMM_DATA_HALF CUDA_R_16F
+#define CUBLAS_GEMM_DATA_FLOAT CUDA_R_32F
+#else
+#define CUBLAS_GEMM_DATA_HALF CUBLAS_DATA_HALF
+#define CUBLAS_GEMM_DATA_FLOAT CUBLAS_DATA_FLOAT
+#endif
+static cublasStatus_t cublas_gemm_halfOperands(cublasHandle_t handle, int deviceId, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+                                               const float* alpha, const float* A, int lda, size_t numElementsA, const float* B, int ldb, size_t numElementsB,
+                                               const float* beta, float* C, int ldc)
+{
+    half* halfA = TracingGPUMemoryAllocator::Allocate<half>(deviceId, numElementsA);
+    half* halfB = TracingGPUMemoryAllocator::Allocate<half>(deviceId, numElementsB);
+    {
+        SyncGuard syncGuard;
+        _convertToHalf<float><<<(int) ceil(1.0 * numElementsA / GridDim::maxThreadsPerBlock), GridDim::maxThreadsPerBlock, 0, t_stream>>>(A, halfA, (CUDA_LONG) numElementsA);
+        _convertToHalf<float><<<(int) ceil(1.0 * numElementsB / GridDim::maxThreadsPerBlock), GridDim::maxThreadsPerBlock, 0, t_stream>>>(B, halfB, (CUDA_LONG) numElementsB);
+    }
+    cublasStatus_t status = cublasSgemmEx(handle, transa, transb, m, n, k, alpha, halfA, CUBLAS_GEMM_DATA_HALF, lda, halfB, CUBLAS_GEMM_DATA_HALF, ldb,
+                                          beta, C, CUBLAS_GEMM_DATA_FLOAT, ldc);
+    // GPUs before Maxwell have no FP16 GEMM; compute in full precision instead
+    if (status == CUBLAS_STATUS_ARCH_MISMATCH || status == CUBLAS_STATUS_NOT_SUPPORTED)
+        status = cublasSgemm(handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+    TracingGPUMemoryAllocator::Free<half>(deviceId, halfA);
+    TracingGPUMemoryAllocator::Free<half>(deviceId, halfB);
+    return status;
+}
+static cublasStatus_t cublas_gemm_halfOperands(cublasHandle_t handle, int /*deviceId*/, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k,
+                                               const double* alpha, const double* A, int lda, size_t /*numElementsA*/, const double* B, int ldb, size_t /*numElementsB*/,
+                                               const double* beta, double* C, int ldc)
+{
+    return cublasDgemm(handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc); // only float products use FP16 operands
+}
+#if CUDA_VERSION >= 8000
+// float/double overloads of cublasSgemmStridedBatched()/cublasDgemmStridedBatched()
+static cublasStatus_t cublas_gemmStridedBatched(cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k, const float* alpha,
+                                                const float* A, int lda, long long strideA, const float* B, int ldb, long long strideB, const float* beta, float* C, int ldc, long long strideC, int batchCount)
+{
+    return cublasSgemmStridedBatched(handle, transa, transb, m, n, k, alpha, A, lda, strideA, B, ldb, strideB, beta, C, ldc, strideC, batchCount);
+}
+static cublasStatus_t cublas_gemmStridedBatched(cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k, const double* alpha,
+                                                const double* A, int lda, long long strideA, const double* B, int ldb, long long strideB, const double* beta, double* C, int ldc, long long strideC, int batchCount)
+{
+    return cublasDgemmStridedBatched(handle, transa, transb, m, n, k, alpha, A, lda, strideA, B, ldb, strideB, beta, C, ldc, strideC, batchCount);
+}
+#endif
 static cublasStatus_t cublas_axpy(cublasHandle_t handle, int n, const float* alpha, const float* x, int incx, float* y, int incy)
 {
     return cublasSaxpy(handle, n, alpha, x, incx, y, incy);
@@ -3237,11 +4080,48 @@ void GPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix
         RuntimeError("!(m>0 && k>0 && l>0 && n>0)"); // converting from size_t to int may cause overflow
     if (k != l)
         RuntimeError("matrix dim mismatch in MultiplyAndWeightedAdd");
-    CUBLAS_CALL(cublas_gemm(cuHandle, transA, transB, m, n, k, &alpha, a.Data(), (int) a.m_numRows, b.Data(), (int) b.m_numRows, &beta, c.Data(), (int) c.m_numRows));
+    if (GPUHalfPrecision::IsHalfPrecisionGEMM())
+        CUBLAS_CALL(cublas_gemm_halfOperands(cuHandle, b.GetComputeDeviceId(), transA, transB, m, n, k, &alpha, a.Data(), (int) a.m_numRows, a.GetNumElements(),
+                                             b.Data(), (int) b.m_numRows, b.GetNumElements(), &beta, c.Data(), (int) c.m_numRows));
+    else
+        CUBLAS_CALL(cublas_gemm(cuHandle, transA, transB, m, n, k, &alpha, a.Data(), (int) a.m_numRows, b.Data(), (int) b.m_numRows, &beta, c.Data(), (int) c.m_numRows));
     c.m_numRows = m;
     c.m_numCols = n;
 }
 
+// c_j = alpha * op(a_j) * op(b_j) + beta * c_j for each column j, see Matrix::BatchMatMul(), which validates the dimensions.
+// The columns are consecutive in memory, so all products are computed by a single strided batched GEMM; a or b with a single column get stride 0.
+template <class ElemType>
+void GPUMatrix<ElemType>::BatchMatMul(ElemType alpha, const GPUMatrix<ElemType>& a, const size_t aRows, const bool transposeA, const GPUMatrix<ElemType>& b, const size_t bRows, const bool transposeB,
+                                      ElemType beta, GPUMatrix<ElemType>& c)
+{
+    a.PrepareDevice();
+    if ((a.GetComputeDeviceId() != b.GetComputeDeviceId()) || (b.GetComputeDeviceId() != c.GetComputeDeviceId())) // different GPUs
+        InvalidArgument("All matrices must be on the same GPU");
+
+    int m = (int) (transposeA ? a.m_numRows / aRows : aRows);
+    int k = (int) (transposeA ? aRows : a.m_numRows / aRows);
+    int n = (int) (transposeB ? bRows : b.m_numRows / bRows);
+#if CUDA_VERSION >= 8000
+    cublasHandle_t cuHandle = GetCublasHandle(b.GetComputeDeviceId());
+    long long strideA = a.m_numCols == 1 ? 0 : (long long) a.m_numRows;
+    long long strideB = b.m_numCols == 1 ? 0 : (long long) b.m_numRows;
+    CUBLAS_CALL(cublas_gemmStridedBatched(cuHandle, transposeA ? CUBLAS_OP_T : CUBLAS_OP_N, transposeB ? CUBLAS_OP_T : CUBLAS_OP_N, m, n, k,
+                                          &alpha, a.Data(), (int) aRows, strideA, b.Data(), (int) bRows, strideB, &beta, c.Data(), m, (long long) c.m_numRows, (int) c.m_numCols));
+#else
+    for (size_t j = 0; j < c.GetNumCols(); j++)
+    {
+        GPUMatrix<ElemType> aj = a.ColumnSlice(a.GetNumCols() == 1 ? 0 : j, 1);
+        GPUMatrix<ElemType> bj = b.ColumnSlice(b.GetNumCols() == 1 ? 0 : j, 1);
+        GPUMatrix<ElemType> cj = c.ColumnSlice(j, 1);
+        aj.Reshape(aRows, a.GetNumRows() / aRows);
+        bj.Reshape(bRows, b.GetNumRows() / bRows);
+        cj.Reshape(m, n);
+        MultiplyAndWeightedAdd(alpha, aj, transposeA, bj, transposeB, beta, cj);
+    }
+#endif
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, ElemType beta, GPUMatrix<ElemType>& c)
 {
@@ -3611,6 +4491,83 @@ void GPUMatrix<ElemType>::AssignScaledDifference(const GPUMatrix<ElemType>& alph
     }
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SoftmaxCrossEntropy(const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& crossEntropy)
+{
+    if (logits.IsEmpty())
+        LogicError("SoftmaxCrossEntropy: Input matrix logits is empty.");
+    if (labels.GetNumRows() != logits.GetNumRows() || labels.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("SoftmaxCrossEntropy: labels and logits must have same dimension.");
+    if (labels.GetComputeDeviceId() != logits.GetComputeDeviceId())
+        InvalidArgument("All matrices must be on the same GPU");
+
+    logSumExp.RequireSize(1, logits.GetNumCols());
+    crossEntropy.RequireSize(1, logits.GetNumCols());
+
+    logits.PrepareDevice();
+    SyncGuard syncGuard;
+    _softmaxCrossEntropy<ElemType><<<(CUDA_LONG) logits.GetNumCols(), 512, 0, t_stream>>>(labels.Data(), logits.Data(), logSumExp.Data(), crossEntropy.Data(), (CUDA_LONG) logits.GetNumRows());
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradient(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& gradient)
+{
+    if (alpha.GetNumElements() != 1)
+        InvalidArgument("AddSoftmaxCrossEntropyGradient: alpha must be a 1X1 matrix.");
+    if (labels.GetNumRows() != logits.GetNumRows() || labels.GetNumCols() != logits.GetNumCols() ||
+        gradient.GetNumRows() != logits.GetNumRows() || gradient.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradient: labels, logits and gradient must have same dimension.");
+    if (logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradient: logSumExp must be a row vector with one element per column.");
+    if (logits.IsEmpty())
+        return;
+
+    logits.PrepareDevice();
+    CUDA_LONG n = (CUDA_LONG) logits.GetNumElements();
+    int blocksPerGrid = (int) ceil(1.0 * n / GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _addSoftmaxCrossEntropyGradient<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(alpha.Data(), labels.Data(), logits.Data(), logSumExp.Data(), gradient.Data(), (CUDA_LONG) logits.GetNumRows(), n);
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SoftmaxCrossEntropyWithIndices(const GPUMatrix<ElemType>& labelIndices, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& crossEntropy)
+{
+    if (logits.IsEmpty())
+        LogicError("SoftmaxCrossEntropyWithIndices: Input matrix logits is empty.");
+    if (labelIndices.GetNumRows() != 1 || labelIndices.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("SoftmaxCrossEntropyWithIndices: labelIndices must be a row vector with one element per column of logits.");
+    if (labelIndices.GetComputeDeviceId() != logits.GetComputeDeviceId())
+        InvalidArgument("All matrices must be on the same GPU");
+
+    logSumExp.RequireSize(1, logits.GetNumCols());
+    crossEntropy.RequireSize(1, logits.GetNumCols());
+
+    logits.PrepareDevice();
+    SyncGuard syncGuard;
+    _softmaxCrossEntropyWithIndices<ElemType><<<(CUDA_LONG) logits.GetNumCols(), 512, 0, t_stream>>>(labelIndices.Data(), logits.Data(), logSumExp.Data(), crossEntropy.Data(), (CUDA_LONG) logits.GetNumRows());
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradientWithIndices(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labelIndices, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& gradient)
+{
+    if (alpha.GetNumElements() != 1)
+        InvalidArgument("AddSoftmaxCrossEntropyGradientWithIndices: alpha must be a 1X1 matrix.");
+    if (labelIndices.GetNumRows() != 1 || labelIndices.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradientWithIndices: labelIndices must be a row vector with one element per column of logits.");
+    if (gradient.GetNumRows() != logits.GetNumRows() || gradient.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradientWithIndices: logits and gradient must have same dimension.");
+    if (logSumExp.GetNumRows() != 1 || logSumExp.GetNumCols() != logits.GetNumCols())
+        InvalidArgument("AddSoftmaxCrossEntropyGradientWithIndices: logSumExp must be a row vector with one element per column.");
+    if (logits.IsEmpty())
+        return;
+
+    logits.PrepareDevice();
+    CUDA_LONG n = (CUDA_LONG) logits.GetNumElements();
+    int blocksPerGrid = (int) ceil(1.0 * n / GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _addSoftmaxCrossEntropyGradientWithIndices<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(alpha.Data(), labelIndices.Data(), logits.Data(), logSumExp.Data(), gradient.Data(), (CUDA_LONG) logits.GetNumRows(), n);
+}
+
 //c[ci,cj] += a[ai,aj]
 template <class ElemType>
 void GPUMatrix<ElemType>::AddElementToElement(ElemType beta, const GPUMatrix<ElemType>& a, const size_t ai, const size_t aj, GPUMatrix<ElemType>& c, const size_t ci, const size_t cj)
@@ -4138,6 +5095,72 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignElementProductOfWithShift(const
     return *this;
 }
 
+// fused cosine similarity against shifted negative samples, see CPUMatrix::CosDistanceWithNegativeSamples(); a block per query column
+template <class ElemType>
+void GPUMatrix<ElemType>::CosDistanceWithNegativeSamples(const GPUMatrix<ElemType>& q, const GPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                         GPUMatrix<ElemType>& invNormQ, GPUMatrix<ElemType>& invNormD, GPUMatrix<ElemType>& c)
+{
+    const CUDA_LONG m = (CUDA_LONG) q.GetNumRows();
+    const CUDA_LONG n = (CUDA_LONG) q.GetNumCols();
+    if (d.GetNumRows() != m || d.GetNumCols() != n)
+        InvalidArgument("CosDistanceWithNegativeSamples: The query and document matrices must have the same dimensions.");
+
+    q.PrepareDevice();
+    invNormQ.RequireSize(1, n);
+    invNormD.RequireSize(1, n);
+    c.RequireSize(negNumber + 1, n);
+    const int blocksPerGrid = (n + GridDim::maxThreadsPerBlock - 1) / GridDim::maxThreadsPerBlock;
+    SyncGuard syncGuard;
+    _cosDistanceInverseNorms<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(q.Data(), d.Data(), invNormQ.Data(), invNormD.Data(), m, n);
+    _cosDistanceWithNegativeSamples<ElemType, 128><<<n, 128, 0, t_stream>>>(q.Data(), d.Data(), invNormQ.Data(), invNormD.Data(), c.Data(),
+                                                                              m, n, (CUDA_LONG) shift, (CUDA_LONG) negNumber);
+}
+
+// a block per column of grad, see CPUMatrix::CosDistanceWithNegativeSamplesGradient()
+template <class ElemType>
+void GPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(bool wrtQuery, const GPUMatrix<ElemType>& q, const GPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                                 const GPUMatrix<ElemType>& invNormQ, const GPUMatrix<ElemType>& invNormD,
+                                                                 const GPUMatrix<ElemType>& c, const GPUMatrix<ElemType>& cGrad, GPUMatrix<ElemType>& grad)
+{
+    const CUDA_LONG m = (CUDA_LONG) q.GetNumRows();
+    const CUDA_LONG n = (CUDA_LONG) q.GetNumCols();
+    if (grad.GetNumRows() != m || grad.GetNumCols() != n)
+        InvalidArgument("CosDistanceWithNegativeSamplesGradient: The gradient must have the dimensions of the inputs.");
+
+    grad.PrepareDevice();
+    const int threadsPerBlock = (int) min((CUDA_LONG) GridDim::maxThreadsPerBlock, (m + 31) / 32 * 32);
+    SyncGuard syncGuard;
+    _cosDistanceWithNegativeSamplesGradient<ElemType><<<n, threadsPerBlock, 0, t_stream>>>(wrtQuery, wrtQuery ? q.Data() : d.Data(), wrtQuery ? d.Data() : q.Data(),
+                                                                                           wrtQuery ? invNormQ.Data() : invNormD.Data(), wrtQuery ? invNormD.Data() : invNormQ.Data(),
+                                                                                           c.Data(), cGrad.Data(), grad.Data(), m, n, (CUDA_LONG) shift, (CUDA_LONG) negNumber);
+}
+
+// fused Gaussian mixture scoring, see CPUMatrix::GMMLogLikelihood(); a block per sample
+template <class ElemType>
+void GPUMatrix<ElemType>::GMMLogLikelihood(const GPUMatrix<ElemType>& unnormedPrior, const GPUMatrix<ElemType>& means, const GPUMatrix<ElemType>& logStdDevs, const GPUMatrix<ElemType>& features,
+                                           const GPUMatrix<ElemType>& products, const GPUMatrix<ElemType>& meanSquaredNorms,
+                                           GPUMatrix<ElemType>& logLikelihood, GPUMatrix<ElemType>& posterior, GPUMatrix<ElemType>& normedDeviation)
+{
+    const size_t numComponents = unnormedPrior.GetNumRows();
+    const size_t featureDim = features.GetNumRows();
+    const size_t numSamples = features.GetNumCols();
+    const bool sharedMeans = means.GetNumCols() == 1;
+    if (sharedMeans && (products.GetNumRows() != numComponents || products.GetNumCols() != numSamples || meanSquaredNorms.GetNumElements() != numComponents))
+        InvalidArgument("GMMLogLikelihood: The products with the shared means do not match the features.");
+
+    features.PrepareDevice();
+    logLikelihood.RequireSize(1, numSamples);
+    posterior.RequireSize(numComponents, numSamples);
+    normedDeviation.RequireSize(numComponents, numSamples);
+    const ElemType logNormalizer = (ElemType) (featureDim * 0.5 * log(TWO_PI));
+    SyncGuard syncGuard;
+    _gmmLogLikelihood<ElemType, 128><<<(int) numSamples, 128, 0, t_stream>>>(unnormedPrior.Data(), unnormedPrior.GetNumCols() == 1, means.Data(), sharedMeans,
+                                                                            logStdDevs.Data(), logStdDevs.GetNumCols() == 1, features.Data(),
+                                                                            sharedMeans ? products.Data() : nullptr, sharedMeans ? meanSquaredNorms.Data() : nullptr,
+                                                                            logLikelihood.Data(), posterior.Data(), normedDeviation.Data(),
+                                                                            (CUDA_LONG) numComponents, (CUDA_LONG) featureDim, logNormalizer);
+}
+
 //sequence training
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::DropFrame(const GPUMatrix<ElemType>& label, const GPUMatrix<ElemType>& gamma, const ElemType& threshhold)
@@ -4269,6 +5292,109 @@ void GPUMatrix<ElemType>::RCRFTransGrdCompute(const GPUMatrix<ElemType>& lbls,
     TracingGPUMemoryAllocator::Free<ElemType>(alpha.GetComputeDeviceId(), d_zeta);
 };
 
+// copies the sequences to the device as (s, tBegin, tEnd) triples, after checking that they fit into the minibatch;
+// the caller frees the memory
+static size_t* CRFSequencesToDevice(DEVICEID_TYPE deviceId, const std::vector<SequenceInMinibatch>& sequences, size_t numParallelSequences, size_t numCols, const char* function)
+{
+    std::vector<size_t> buf;
+    buf.reserve(3 * sequences.size());
+    for (const auto& seq : sequences)
+    {
+        if (seq.s >= numParallelSequences || seq.tBegin >= seq.tEnd || seq.tEnd * numParallelSequences > numCols)
+            InvalidArgument("%s: A sequence does not fit into the minibatch.", function);
+        buf.push_back(seq.s);
+        buf.push_back(seq.tBegin);
+        buf.push_back(seq.tEnd);
+    }
+    size_t* d_sequences = TracingGPUMemoryAllocator::Allocate<size_t>(deviceId, buf.size());
+    CUDA_CALL(cudaMemcpy(d_sequences, buf.data(), sizeof(size_t) * buf.size(), cudaMemcpyHostToDevice));
+    return d_sequences;
+}
+
+// threads of a block that runs over the labels of one sequence
+static int CRFThreadsPerSequence(size_t numLabels)
+{
+    return (int) min((size_t) GridDim::maxThreadsPerBlock, (numLabels + 31) / 32 * 32);
+}
+
+// batched linear-chain CRF, see CPUMatrix::CRFForwardBackward(); a block per sequence
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFForwardBackward(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                             size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                             GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& beta, GPUMatrix<ElemType>& postProb, GPUMatrix<ElemType>& sequenceScores)
+{
+    const size_t numLabels = posScores.GetNumRows();
+    const size_t numCols = posScores.GetNumCols();
+    if (lbls.GetNumRows() != numLabels || lbls.GetNumCols() != numCols || pairScores.GetNumRows() != numLabels || pairScores.GetNumCols() != numLabels)
+        InvalidArgument("CRFForwardBackward: The dimensions of the labels, position and pair scores do not match.");
+
+    posScores.PrepareDevice();
+    alpha.RequireSize(numLabels, numCols);
+    beta.RequireSize(numLabels, numCols);
+    postProb.RequireSize(numLabels, numCols);
+    postProb.SetValue(0);
+    sequenceScores.RequireSize(1, sequences.size());
+    if (sequences.empty())
+        return;
+
+    size_t* d_sequences = CRFSequencesToDevice(posScores.GetComputeDeviceId(), sequences, numParallelSequences, numCols, "CRFForwardBackward");
+    SyncGuard syncGuard;
+    _crfForwardBackward<ElemType><<<(int) sequences.size(), CRFThreadsPerSequence(numLabels), sizeof(ElemType) * numLabels, t_stream>>>(
+        lbls.Data(), posScores.Data(), pairScores.Data(), d_sequences, numParallelSequences, numLabels,
+        alpha.Data(), beta.Data(), postProb.Data(), sequenceScores.Data());
+    TracingGPUMemoryAllocator::Free<size_t>(posScores.GetComputeDeviceId(), d_sequences);
+}
+
+// batched CRF transition gradient, see CPUMatrix::CRFTransitionGradient(); a thread per element of grd
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFTransitionGradient(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                                size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                                const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& beta, GPUMatrix<ElemType>& grd)
+{
+    const size_t numLabels = posScores.GetNumRows();
+    if (grd.GetNumRows() != numLabels || grd.GetNumCols() != numLabels)
+        InvalidArgument("CRFTransitionGradient: The gradient must be a square matrix of the number of labels.");
+    if (sequences.empty())
+        return;
+
+    grd.PrepareDevice();
+    size_t* d_sequences = CRFSequencesToDevice(grd.GetComputeDeviceId(), sequences, numParallelSequences, posScores.GetNumCols(), "CRFTransitionGradient");
+    CUDA_LONG N = (CUDA_LONG) (numLabels * numLabels);
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _crfTransitionGradient<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
+        lbls.Data(), posScores.Data(), pairScores.Data(), d_sequences, sequences.size(), numParallelSequences, numLabels,
+        alpha.Data(), beta.Data(), grd.Data());
+    TracingGPUMemoryAllocator::Free<size_t>(grd.GetComputeDeviceId(), d_sequences);
+}
+
+// batched Viterbi decoding, see CPUMatrix::CRFViterbiDecode(); a block per sequence
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFViterbiDecode(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                           size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                           GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& backtrace, GPUMatrix<ElemType>& decodedPath)
+{
+    const size_t numLabels = posScores.GetNumRows();
+    const size_t numCols = posScores.GetNumCols();
+    if (lbls.GetNumRows() != numLabels || lbls.GetNumCols() != numCols || pairScores.GetNumRows() != numLabels || pairScores.GetNumCols() != numLabels)
+        InvalidArgument("CRFViterbiDecode: The dimensions of the labels, position and pair scores do not match.");
+
+    posScores.PrepareDevice();
+    alpha.RequireSize(numLabels, numCols);
+    backtrace.RequireSize(numLabels, numCols);
+    decodedPath.RequireSize(numLabels, numCols);
+    decodedPath.SetValue(0);
+    if (sequences.empty())
+        return;
+
+    size_t* d_sequences = CRFSequencesToDevice(posScores.GetComputeDeviceId(), sequences, numParallelSequences, numCols, "CRFViterbiDecode");
+    SyncGuard syncGuard;
+    _crfViterbiDecode<ElemType><<<(int) sequences.size(), CRFThreadsPerSequence(numLabels), 0, t_stream>>>(
+        lbls.Data(), posScores.Data(), pairScores.Data(), d_sequences, numParallelSequences, numLabels,
+        alpha.Data(), backtrace.Data(), decodedPath.Data());
+    TracingGPUMemoryAllocator::Free<size_t>(posScores.GetComputeDeviceId(), d_sequences);
+}
+
 // -----------------------------------------------------------------------
 // TensorView entry points from Matrix.cpp
 // -----------------------------------------------------------------------
@@ -4384,6 +5510,25 @@ void GPUMatrix<ElemType>::TensorOp(ElemType beta, const GPUMatrix<ElemType>& a,
     return TensorOpN<ElemType, 4>(beta, array<ElemType*, 4>{a.Data(), b.Data(), c.Data(), Data()}, alpha, op, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
 }
 
+// fused element-wise op over contiguous ranges (see FusedElementwiseProgram); arguments are validated by Matrix::FusedElementwiseOp()
+template <class ElemType>
+void GPUMatrix<ElemType>::FusedElementwiseOp(ElemType beta, const std::vector<const GPUMatrix<ElemType>*>& inputs, const std::vector<size_t>& offsets, size_t numElements,
+                                             const FusedElementwiseProgram& program, ElemType alpha)
+{
+    PrepareDevice();
+    FusedElementwiseInputs<ElemType> inputPointers;
+    for (size_t k = 0; k < inputs.size(); k++)
+    {
+        if (inputs[k]->GetComputeDeviceId() != GetComputeDeviceId())
+            InvalidArgument("All matrices must be on the same GPU");
+        inputPointers.p[k] = inputs[k]->Data() + offsets[k];
+    }
+    CUDA_LONG N = (CUDA_LONG) numElements;
+    GridDim grid(N);
+    SyncGuard syncGuard;
+    _fusedElementwiseOp<ElemType><<<grid.m_blocksPerGrid, grid.m_threadsPerBlock, 0, t_stream>>>(beta, inputPointers, program, alpha, Data() + offsets[inputs.size()], N);
+}
+
 // =======================================================================
 // explicit instantiations business
 // =======================================================================
@@ -4393,8 +5538,6 @@ template class GPUMatrix<double>;
 template class DeviceBoundNumber<float>;
 template class DeviceBoundNumber<double>;
 
-template <class ElemType>
-cublasHandle_t GPUMatrix<ElemType>::s_cuHandle[GPUMatrix<ElemType>::MaxGpus] = {0};
 
 template <class ElemType>
 void* GPUMatrix<ElemType>::s_curandGenerator = NULL;
@@ -4407,6 +5550,7 @@ template GPUMatrix<char>::GPUMatrix(const GPUMatrix<char>&);
 template GPUMatrix<char>::GPUMatrix(GPUMatrix<char>&&);
 template char* GPUMatrix<char>::CopyToArray() const;
 template void GPUMatrix<char>::ChangeDeviceTo(int);
+template void GPUMatrix<char>::SetValueFromOtherDevice(const GPUMatrix<char>&);
 template void GPUMatrix<char>::Resize(size_t, size_t, bool);
 template void GPUMatrix<char>::RequireSize(size_t, size_t, bool);
 
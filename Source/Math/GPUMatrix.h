@@ -14,6 +14,7 @@
 #include "GPURNGHandle.h"
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <array>
 #include <ctime>
 #include <iostream> // for cout/cerr
@@ -137,7 +138,6 @@ public:
     static const int MaxGpus = MAX_GPUS;
 
 private:
-    static cublasHandle_t s_cuHandle[MaxGpus];
     static void* s_curandGenerator;
 
 // Have to use disable the warning to avoid issues with __declspec(dllexport) on Windows (C4251).
@@ -145,7 +145,7 @@ private:
 // The only workaround is to use naked pointer.
 #pragma warning(push)
 #pragma warning(disable : 4251)
-    mutable std::unique_ptr<conc_stack<std::unique_ptr<GPUMatrix<ElemType>>>> m_workspace;
+    mutable std::unique_ptr<conc_pool<std::unique_ptr<GPUMatrix<ElemType>>>> m_workspace;
 #pragma warning(pop)
 
 private:
@@ -176,8 +176,12 @@ public:
     ElemType* CopyToArray() const;                                              // allocated by the callee but need to be deleted by the caller
     size_t CopyToArray(ElemType*& arrayCopyTo, size_t& currentArraySize) const; // allocated by the callee but need to be deleted by the caller
     void CopySection(size_t numRows, size_t numCols, ElemType* dst, size_t colStride) const;
+    // copy numElements elements from host memory into our elements from firstElement on (in column-major order), without resizing
+    void SetElements(size_t firstElement, size_t numElements, const ElemType* src);
 
     void ChangeDeviceTo(DEVICEID_TYPE to_id);
+    // copy the values of a matrix on another GPU into ours, which stay on our device (unlike SetValue(), which moves us to src's device)
+    void SetValueFromOtherDevice(const GPUMatrix<ElemType>& src);
 
 public:
     GPUMatrix<ElemType> ColumnSlice(size_t startColumn, size_t numCols) const;
@@ -199,6 +203,14 @@ public:
 
     ElemType Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier);
     void FSAdagrad(GPUMatrix<ElemType>& gradients, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul);
+    // see Matrix<ElemType>::MultiTensorNormalGrad()
+    static void MultiTensorNormalGrad(const std::vector<GPUMatrix<ElemType>*>& smoothedGradients,
+                                      const std::vector<GPUMatrix<ElemType>*>& gradients,
+                                      const std::vector<GPUMatrix<ElemType>*>& functionValues,
+                                      const std::vector<ElemType>& learnRatesPerSample,
+                                      const ElemType momentum, const bool useNesterovMomentum,
+                                      const ElemType clippingThreshold, const bool clipByTruncation,
+                                      const ElemType l2RegWeight, const ElemType l1RegWeight);
     ElemType RmsProp(GPUMatrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
 
     void Reshape(const size_t numRows, const size_t numCols);
@@ -233,18 +245,26 @@ public:
     //void SetValue(const CPUSparseMatrix<ElemType>& deepCopyFrom);
     //void SetValue(const GPUSparseMatrix<ElemType>& deepCopyFrom);
     void SetValue(const size_t numRows, const size_t numCols, int deviceId, ElemType* pArray, size_t matrixFlags = matrixFlagNormal);
+    void SetValueFromCompact(const size_t numRows, const size_t numCols, const void* data, CompactElementType type, ElemType scale, const GPUMatrix<ElemType>* offset, size_t matrixFlags = matrixFlagNormal);
 
     void SetDiagonalValue(const ElemType v);
     void SetDiagonalValue(const GPUMatrix<ElemType>& vector);
     void SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed = USE_TIME_BASED_SEED);
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    void SetCounterBasedUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    GPUMatrix<ElemType>& AssignElementProductOfUniformRandomMask(const GPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue,
+                                                                 const uint64_t seed, const uint64_t firstCounter, const size_t elementOffset, const ElemType beta);
+    // counter-based (PhiloxRNG.h): element i depends only on the seed and i, so that CPU and GPU, and any number of threads, give the same values
+    void SetCounterBasedUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed);
+    void SetCounterBasedGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed);
 
     GPUMatrix<ElemType> Transpose() const;
     GPUMatrix<ElemType>& AssignTransposeOf(const GPUMatrix<ElemType>& a);
 
     GPUMatrix<ElemType>& DoGatherColumnsOf (ElemType beta, const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha);
-    GPUMatrix<ElemType>& DoScatterColumnsOf(ElemType beta, const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha);
+    GPUMatrix<ElemType>& DoScatterColumnsOf(ElemType beta, const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha, bool idxIsUnique = false);
+    GPUMatrix<ElemType>& AssignPackedIndicesOf(const GPUMatrix<ElemType>& index, const GPUMatrix<ElemType>& sequenceMap, size_t numParallelSequences);
 
     GPUMatrix<ElemType>& operator+=(const ElemType alpha);
     GPUMatrix<ElemType> operator+(const ElemType alpha) const;
@@ -302,6 +322,9 @@ public:
     GPUMatrix<ElemType>& InplaceSigmoid();
     GPUMatrix<ElemType>& AssignSigmoidOf(const GPUMatrix<ElemType>& a);
 
+    // this = activation(this + bias), bias is a column vector
+    GPUMatrix<ElemType>& InplaceAddColumnAndActivation(const GPUMatrix<ElemType>& bias, ElementWiseOperator activation);
+
     GPUMatrix<ElemType>& InplaceTanh();
     GPUMatrix<ElemType>& AssignTanhOf(const GPUMatrix<ElemType>& a);
 
@@ -310,6 +333,7 @@ public:
 
     GPUMatrix<ElemType>& InplaceHardmax(const bool isColWise);
     GPUMatrix<ElemType>& AssignHardmaxOf(const GPUMatrix<ElemType>& a, const bool isColWise);
+    GPUMatrix<ElemType>& AssignTopNHardmaxOf(const GPUMatrix<ElemType>& a, const size_t n);
 
     // sequence training
     GPUMatrix<ElemType>& DropFrame(const GPUMatrix<ElemType>& label, const GPUMatrix<ElemType>& gamma, const ElemType& threshhold);
@@ -341,6 +365,7 @@ public:
     GPUMatrix<ElemType>& InplaceSoftThreshold(const ElemType threshold);
 
     GPUMatrix<ElemType>& SetToZeroIfAbsLessThan(const ElemType threshold);
+    size_t ExtractAbsAboveThreshold(const ElemType threshold, size_t capacity, int* indices, ElemType* values); // indices and values are CPU buffers
 
     DeviceBoundNumber<ElemType> Sum_AsDeviceBoundNum() const;
     ElemType SumOfAbsElements() const; // sum of all abs(elements)
@@ -374,6 +399,8 @@ public:
     ElemType MatrixNorm1() const;
     ElemType MatrixNorm0() const; // number of non-zero elemets
     GPUMatrix<ElemType>& AssignSignOf(const GPUMatrix<ElemType>& a);
+    GPUMatrix<ElemType>& AssignCompressedOf(const GPUMatrix<ElemType>& a, CompactElementType type);
+    GPUMatrix<ElemType>& AssignDecompressedOf(const GPUMatrix<ElemType>& compressed, size_t numRows, CompactElementType type);
     GPUMatrix<ElemType>& AddSignOf(const GPUMatrix<ElemType>& a);
 
     GPUMatrix<ElemType>& AssignToRowSliceValuesOf(const GPUMatrix<ElemType>& a, const size_t startIndex, const size_t numRows);
@@ -393,6 +420,7 @@ public:
     void VectorMin(GPUMatrix<ElemType>& minIndexes, GPUMatrix<ElemType>& minValues, const bool isColWise) const;
 
     GPUMatrix<ElemType>& AssignNumOfDiff(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, bool searchInCol = false);
+    GPUMatrix<ElemType>& AssignNumOfTopKErrors(const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& predictions, int topK, bool classIndexLabels, const GPUMatrix<char>* columnsMask);
 
     GPUMatrix<ElemType>& AssignInnerProductOfMatrices(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b);
 
@@ -463,6 +491,7 @@ public:
     static void Multiply(const GPUMatrix<ElemType>& a, const bool transposeA, const GPUMatrix<ElemType>& b, const bool transposeB, GPUMatrix<ElemType>& c);
     static void Multiply(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c);
     static void Multiply1x1AndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, ElemType beta, GPUMatrix<ElemType>& c);
+    static void BatchMatMul(ElemType alpha, const GPUMatrix<ElemType>& a, const size_t aRows, const bool transposeA, const GPUMatrix<ElemType>& b, const size_t bRows, const bool transposeB, ElemType beta, GPUMatrix<ElemType>& c);
 
     static void ScaleAndAdd(ElemType alpha, const GPUMatrix<ElemType>& a, GPUMatrix<ElemType>& c);
     static void ScaleAndAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c);
@@ -471,6 +500,11 @@ public:
     static void AddScaledDifference(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c);
     static void AssignScaledDifference(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c);
 
+    static void SoftmaxCrossEntropy(const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& crossEntropy);
+    static void AddSoftmaxCrossEntropyGradient(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labels, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& gradient);
+    static void SoftmaxCrossEntropyWithIndices(const GPUMatrix<ElemType>& labelIndices, const GPUMatrix<ElemType>& logits, GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& crossEntropy);
+    static void AddSoftmaxCrossEntropyGradientWithIndices(const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& labelIndices, const GPUMatrix<ElemType>& logits, const GPUMatrix<ElemType>& logSumExp, GPUMatrix<ElemType>& gradient);
+
     static void AddElementToElement(ElemType beta, const GPUMatrix<ElemType>& a, const size_t ai, const size_t aj, GPUMatrix<ElemType>& c, const size_t ci, const size_t cj);
 
     // minus one at a specific position
@@ -500,6 +534,10 @@ public:
                   const SmallVector<size_t>& regularOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& regularStrides,
                   const SmallVector<size_t>& reducingOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& reducingStrides);
 
+    // c[offsets.back() + i] = beta * c[...] + alpha * program(inputs[k][offsets[k] + i]...) for i < numElements; all operands are contiguous ranges
+    void FusedElementwiseOp(ElemType beta, const std::vector<const GPUMatrix<ElemType>*>& inputs, const std::vector<size_t>& offsets, size_t numElements,
+                            const FusedElementwiseProgram& program, ElemType alpha);
+
     static void CreateCurandObject(unsigned long seed, const char* caller);
     static void ResetCurandObject(unsigned long seed, const char* caller);
     static GPUMatrix<ElemType> Ones(const size_t rows, const size_t cols, int deviceId);
@@ -521,6 +559,16 @@ public:
     static void ConductRowElementMultiplyWithShift(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c, const size_t shift, const bool isafixed);
 
     GPUMatrix<ElemType>& AssignElementProductOfWithShift(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, const size_t shift);
+    // fused cosine similarity against shifted negative samples, see Matrix::CosDistanceWithNegativeSamples()
+    static void CosDistanceWithNegativeSamples(const GPUMatrix<ElemType>& q, const GPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                               GPUMatrix<ElemType>& invNormQ, GPUMatrix<ElemType>& invNormD, GPUMatrix<ElemType>& c);
+    static void CosDistanceWithNegativeSamplesGradient(bool wrtQuery, const GPUMatrix<ElemType>& q, const GPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                       const GPUMatrix<ElemType>& invNormQ, const GPUMatrix<ElemType>& invNormD,
+                                                       const GPUMatrix<ElemType>& c, const GPUMatrix<ElemType>& cGrad, GPUMatrix<ElemType>& grad);
+    // fused Gaussian mixture scoring, a block per sample, see Matrix::GMMLogLikelihood(); products (K x T) are mu_c'x and meanSquaredNorms (1 x K) ||mu_c||^2 if the means are shared
+    static void GMMLogLikelihood(const GPUMatrix<ElemType>& unnormedPrior, const GPUMatrix<ElemType>& means, const GPUMatrix<ElemType>& logStdDevs, const GPUMatrix<ElemType>& features,
+                                 const GPUMatrix<ElemType>& products, const GPUMatrix<ElemType>& meanSquaredNorms,
+                                 GPUMatrix<ElemType>& logLikelihood, GPUMatrix<ElemType>& posterior, GPUMatrix<ElemType>& normedDeviation);
 
 public:
     static void RCRFBackwardCompute(
@@ -535,6 +583,17 @@ public:
                                     const int startLbl, // the time 0 start symbol in the output layer
                                     const int shift);
 
+    // batched linear-chain CRF, see Matrix::CRFForwardBackward(); one thread block per sequence
+    static void CRFForwardBackward(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                   size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                   GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& beta, GPUMatrix<ElemType>& postProb, GPUMatrix<ElemType>& sequenceScores);
+    static void CRFTransitionGradient(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                      size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                      const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& beta, GPUMatrix<ElemType>& grd);
+    static void CRFViterbiDecode(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                 size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                 GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& backtrace, GPUMatrix<ElemType>& decodedPath);
+
 public:
     friend File& operator>>(File& stream, GPUMatrix<ElemType>& us)
     {
@@ -547,12 +606,24 @@ public:
         size_t numRows, numCols;
         int format;
         stream >> matrixNameDummy >> format >> numRows >> numCols;
-        ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        // Read through a host buffer of bounded size, so that a large matrix does not need a host copy of its full size.
+        // From a mapped file, the elements are copied to the device straight from the mapping instead.
+        us.SetValue(numRows, numCols, us.GetComputeDeviceId(), nullptr, matrixFlagNormal | format);
+        const size_t numElements = numRows * numCols;
+        if (stream.IsMapped())
+        {
+            us.SetElements(0, numElements, (const ElemType*) stream.GetMappedBlock(numElements * sizeof(ElemType)));
+            stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
+            return stream;
+        }
+        std::vector<ElemType> buffer(std::min(numElements, (size_t) 16 * 1024 * 1024 / sizeof(ElemType)));
+        for (size_t firstElement = 0; firstElement < numElements; firstElement += buffer.size())
+        {
+            size_t numChunkElements = std::min(buffer.size(), numElements - firstElement);
+            stream.GetArray(buffer.data(), numChunkElements);
+            us.SetElements(firstElement, numChunkElements, buffer.data());
+        }
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
-        us.SetValue(numRows, numCols, us.GetComputeDeviceId(), d_array, matrixFlagNormal | format);
-        delete[] d_array;
         return stream;
     }
     friend File& operator<<(File& stream, const GPUMatrix<ElemType>& us)
@@ -567,9 +638,7 @@ public:
 
         stream << us.m_numRows << us.m_numCols;
         ElemType* pArray = us.CopyToArray();
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << pArray[i];
-        
+        stream.PutArray(pArray, us.GetNumElements());
         delete[] pArray;
 
         stream.PutMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
@@ -591,6 +660,10 @@ typedef GPUMatrix<float> GPUSingleMatrix;
 
 template <typename ERRTYPE>
 const char* CudaErrString(ERRTYPE x); // actual error function is defined inside .cu files
+// whether a failure is for lack of device memory, which is reported as an OutOfDeviceMemoryError
+template <typename ERRTYPE>
+static bool IsCudaOutOfMemory(ERRTYPE) { return false; }
+static inline bool IsCudaOutOfMemory(cudaError_t x) { return x == cudaErrorMemoryAllocation; }
 template <typename ERRTYPE>
 static void CudaCall(ERRTYPE retCode, const char* exprString, const char* libName, ERRTYPE successCode)
 {
@@ -607,6 +680,11 @@ static void CudaCall(ERRTYPE retCode, const char* exprString, const char* libNam
 #endif
             int currentCudaDevice;
             cudaGetDevice(&currentCudaDevice);
+            if (IsCudaOutOfMemory(retCode))
+            {
+                cudaGetLastError(); // clear the error, so that later calls do not fail on it if the caller recovers
+                Microsoft::MSR::CNTK::ThrowFormatted<Microsoft::MSR::CNTK::OutOfDeviceMemoryError>("%s failure %d: %s ; GPU=%d ; hostname=%s ; expr=%s", libName, (int)retCode, CudaErrString(retCode), currentCudaDevice, hostname ? hostname : "?", exprString);
+            }
             Microsoft::MSR::CNTK::RuntimeError("%s failure %d: %s ; GPU=%d ; hostname=%s ; expr=%s", libName, (int)retCode, CudaErrString(retCode), currentCudaDevice, hostname ? hostname : "?", exprString);
         }
         catch (const std::exception& e) // catch, log, and rethrow since CUDA code sometimes hangs in destruction, so we'd never get to see the error
@@ -14,8 +14,10 @@
 #include "CommonMatrix.h"
 #include "GPUMatrix.h"
 #include "TensorOps.h" // for exp_() etc.
+#include "PhiloxRNG.h"
 #include "device_functions.h"
 #include <cuda_runtime.h>
+#include <cuda_fp16.h>
 #include <assert.h>
 #include <float.h>
 #pragma pop_macro("TENSOR_OPS_DECL")
@@ -228,6 +230,71 @@ __global__ void _elementWisePowerOnCuda(
     }
 };
 
+// round to FP16 (nearest even), for half-precision GEMM operands (see GPUHalfPrecision)
+template <class ElemType>
+__global__ void _convertToHalf(
+    const ElemType* a,
+    half* res,
+    const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    res[id] = __float2half((float) a[id]);
+};
+
+// compact input element to float, see _assignFromCompact()
+__device__ __forceinline__ float _compactToFloat(unsigned char v)
+{
+    return (float) v;
+}
+__device__ __forceinline__ float _compactToFloat(half v)
+{
+    return __half2float(v);
+}
+
+// us[id] = (data[id] - offset[id % numRows]) * scale, converting compact (uint8 or FP16) input data (see Matrix::SetValueFromCompact())
+template <class ElemType, class CompactType>
+__global__ void _assignFromCompact(
+    ElemType* us,
+    const CompactType* data,
+    const ElemType* offset, // null for none
+    const ElemType scale,
+    const CUDA_LONG numRows,
+    const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    ElemType v = (ElemType) _compactToFloat(data[id]);
+    if (offset)
+        v -= offset[id % numRows];
+    us[id] = v * scale;
+};
+
+// input pointers of a fused element-wise op, passed by value as a kernel argument
+template <class ElemType>
+struct FusedElementwiseInputs
+{
+    const ElemType* p[FusedElementwiseProgram::MaxInputs];
+};
+
+// res[id] = beta * res[id] + alpha * program(inputs.p[0][id], ..., inputs.p[numInputs-1][id])
+template <class ElemType>
+__global__ void _fusedElementwiseOp(
+    ElemType beta,
+    const FusedElementwiseInputs<ElemType> inputs,
+    const FusedElementwiseProgram program,
+    ElemType alpha,
+    ElemType* res,
+    const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    ElemType regs[FusedElementwiseProgram::MaxRegisters];
+    for (size_t k = 0; k < program.numInputs; k++)
+        regs[k] = inputs.p[k][id];
+    ElemType val = alpha * EvaluateFusedElementwiseProgram(program, regs);
+    if (beta != 0)
+        val += beta * res[id];
+    res[id] = val;
+};
+
 // Note that this code is inefficient on CUDA due to diverging code paths.
 // Use Sigmoid() in TensorOps.h instead, which solves this problem.
 template <class ElemType>
@@ -1014,6 +1081,255 @@ __global__ void _logSoftMaxRowWise(
 }
 
 // each block processes one column. There must be 512 threads in a block
+// c = activation(c + bias), with bias a column vector; the activation is the same for all threads, so the switch does not diverge
+template <class ElemType>
+__global__ void _addColumnAndActivation(
+    ElemType* c,
+    const ElemType* bias,
+    const CUDA_LONG numRows,
+    const CUDA_LONG N,
+    const ElementWiseOperator activation)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    ElemType v = c[id] + bias[id % numRows];
+    switch (activation)
+    {
+    case ElementWiseOperator::opSigmoid:
+        c[id] = Microsoft::MSR::CNTK::Sigmoid(v);
+        break;
+    case ElementWiseOperator::opTanh:
+        c[id] = tanh_(v);
+        break;
+    default:
+        c[id] = v > 0 ? v : 0;
+        break;
+    }
+}
+
+// Fused log softmax and cross entropy, one block of 512 threads per column.
+// Each thread keeps a running max and the sum of exp(x - max) (online softmax), so that the logits are read only once;
+// the partial results of the threads are then combined in shared memory.
+template <class ElemType>
+__global__ void _softmaxCrossEntropy(
+    const ElemType* labels,
+    const ElemType* logits,
+    ElemType* logSumExp,
+    ElemType* crossEntropy,
+    const CUDA_LONG numRows)
+{
+    __shared__ ElemType partialMax[512];
+    __shared__ ElemType partialSum[512];
+    __shared__ ElemType partialDot[512];
+    __shared__ ElemType partialLabelSum[512];
+
+    const ElemType* x = logits + IDX2C(0, blockIdx.x, numRows);
+    const ElemType* y = labels + IDX2C(0, blockIdx.x, numRows);
+    ElemType maxV = x[0];
+    ElemType sum = 0, labelDot = 0, labelSum = 0;
+    for (CUDA_LONG i = threadIdx.x; i < numRows; i += 512)
+    {
+        ElemType v = x[i];
+        if (v > maxV)
+        {
+            sum = sum * exp_(maxV - v) + 1;
+            maxV = v;
+        }
+        else
+            sum += exp_(v - maxV);
+        labelDot += y[i] * v;
+        labelSum += y[i];
+    }
+    partialMax[threadIdx.x] = maxV;
+    partialSum[threadIdx.x] = sum;
+    partialDot[threadIdx.x] = labelDot;
+    partialLabelSum[threadIdx.x] = labelSum;
+    __syncthreads();
+
+    for (int stride = 256; stride > 0; stride /= 2)
+    {
+        if (threadIdx.x < stride)
+        {
+            ElemType m1 = partialMax[threadIdx.x], m2 = partialMax[threadIdx.x + stride];
+            ElemType s2 = partialSum[threadIdx.x + stride];
+            if (m2 > m1)
+            {
+                partialSum[threadIdx.x] = partialSum[threadIdx.x] * exp_(m1 - m2) + s2;
+                partialMax[threadIdx.x] = m2;
+            }
+            else if (s2 > 0)
+                partialSum[threadIdx.x] += s2 * exp_(m2 - m1);
+            partialDot[threadIdx.x] += partialDot[threadIdx.x + stride];
+            partialLabelSum[threadIdx.x] += partialLabelSum[threadIdx.x + stride];
+        }
+        __syncthreads();
+    }
+
+    if (threadIdx.x == 0)
+    {
+        ElemType lse = partialMax[0] + log_(partialSum[0]);
+        logSumExp[blockIdx.x] = lse;
+        crossEntropy[blockIdx.x] = lse * partialLabelSum[0] - partialDot[0];
+    }
+}
+
+// gradient += alpha * (exp(logits - logSumExp) - labels), with alpha on the device
+template <class ElemType>
+__global__ void _addSoftmaxCrossEntropyGradient(
+    const ElemType* alpha,
+    const ElemType* labels,
+    const ElemType* logits,
+    const ElemType* logSumExp,
+    ElemType* gradient,
+    const CUDA_LONG numRows,
+    const CUDA_LONG N)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    gradient[id] += alpha[0] * (exp_(logits[id] - logSumExp[id / numRows]) - labels[id]);
+}
+
+// _softmaxCrossEntropy() with class-index labels: each block reduces the log-sum-exp of its column and thread 0 gathers
+// the logit of the target class; columns with an index outside [0, numRows) (gaps) get zero
+template <class ElemType>
+__global__ void _softmaxCrossEntropyWithIndices(
+    const ElemType* labelIndices,
+    const ElemType* logits,
+    ElemType* logSumExp,
+    ElemType* crossEntropy,
+    const CUDA_LONG numRows)
+{
+    __shared__ ElemType partialMax[512];
+    __shared__ ElemType partialSum[512];
+
+    const ElemType* x = logits + IDX2C(0, blockIdx.x, numRows);
+    ElemType maxV = x[0];
+    ElemType sum = 0;
+    for (CUDA_LONG i = threadIdx.x; i < numRows; i += 512)
+    {
+        ElemType v = x[i];
+        if (v > maxV)
+        {
+            sum = sum * exp_(maxV - v) + 1;
+            maxV = v;
+        }
+        else
+            sum += exp_(v - maxV);
+    }
+    partialMax[threadIdx.x] = maxV;
+    partialSum[threadIdx.x] = sum;
+    __syncthreads();
+
+    for (int stride = 256; stride > 0; stride /= 2)
+    {
+        if (threadIdx.x < stride)
+        {
+            ElemType m1 = partialMax[threadIdx.x], m2 = partialMax[threadIdx.x + stride];
+            ElemType s2 = partialSum[threadIdx.x + stride];
+            if (m2 > m1)
+            {
+                partialSum[threadIdx.x] = partialSum[threadIdx.x] * exp_(m1 - m2) + s2;
+                partialMax[threadIdx.x] = m2;
+            }
+            else if (s2 > 0)
+                partialSum[threadIdx.x] += s2 * exp_(m2 - m1);
+        }
+        __syncthreads();
+    }
+
+    if (threadIdx.x == 0)
+    {
+        ElemType lse = partialMax[0] + log_(partialSum[0]);
+        ElemType label = labelIndices[blockIdx.x];
+        logSumExp[blockIdx.x] = lse;
+        crossEntropy[blockIdx.x] = (label >= 0 && label < numRows) ? lse - x[(CUDA_LONG) label] : 0;
+    }
+}
+
+// gradient += alpha * (exp(logits - logSumExp) - onehot(labelIndices)), with alpha on the device; columns with an invalid index are skipped
+template <class ElemType>
+__global__ void _addSoftmaxCrossEntropyGradientWithIndices(
+    const ElemType* alpha,
+    const ElemType* labelIndices,
+    const ElemType* logits,
+    const ElemType* logSumExp,
+    ElemType* gradient,
+    const CUDA_LONG numRows,
+    const CUDA_LONG N)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    CUDA_LONG col = id / numRows;
+    ElemType label = labelIndices[col];
+    if (!(label >= 0 && label < numRows))
+        return;
+    ElemType target = ((CUDA_LONG) label == id - col * numRows) ? 1 : 0;
+    gradient[id] += alpha[0] * (exp_(logits[id] - logSumExp[col]) - target);
+}
+
+// one block of 512 threads per column: n rounds of a block-wide arg max over the rows not chosen in the earlier rounds
+// 'us' must be zero-initialized; round k sets the one in rows k * m_numRows ... (k + 1) * m_numRows - 1
+// The rounds pick in descending (value, -row) order, so the rows still available are those ordered after the previous pick.
+template <class ElemType>
+__global__ void _assignColumnwiseTopNHardmaxOf(
+    const ElemType* a,
+    ElemType* us,
+    const CUDA_LONG m_numCols,
+    const CUDA_LONG m_numRows,
+    const CUDA_LONG n)
+{
+    __shared__ ElemType partials[512];
+    __shared__ int partialsI[512];
+    const CUDA_LONG usRows = m_numRows * n;
+    ElemType prevV = 0;
+    int prevI = -1;
+    for (CUDA_LONG k = 0; k < n; k++)
+    {
+        // best of this thread's rows (the lowest index among equal values, since rows are visited in increasing order)
+        ElemType bestV = 0;
+        int bestI = -1;
+        for (CUDA_LONG i = threadIdx.x; i < m_numRows; i += blockDim.x)
+        {
+            const ElemType v = a[IDX2C(i, blockIdx.x, m_numRows)];
+            const bool chosen = prevI >= 0 && !(v < prevV || (v == prevV && i > prevI));
+            if (!chosen && (bestI < 0 || bestV < v))
+            {
+                bestV = v;
+                bestI = i;
+            }
+        }
+        partials[threadIdx.x] = bestV;
+        partialsI[threadIdx.x] = bestI;
+        __syncthreads();
+
+        // reduce over the threads
+        for (int s = blockDim.x / 2; s > 0; s >>= 1)
+        {
+            if (threadIdx.x < s)
+            {
+                int other = threadIdx.x + s;
+                int otherI = partialsI[other];
+                int thisI = partialsI[threadIdx.x];
+                if (otherI >= 0 && (thisI < 0 || partials[threadIdx.x] < partials[other] || (partials[threadIdx.x] == partials[other] && otherI < thisI)))
+                {
+                    partials[threadIdx.x] = partials[other];
+                    partialsI[threadIdx.x] = otherI;
+                }
+            }
+            __syncthreads();
+        }
+
+        prevV = partials[0];
+        prevI = partialsI[0];
+        if (prevI < 0) // (only NaNs are left)
+            return;
+        if (threadIdx.x == 0)
+            us[IDX2C(k * m_numRows + prevI, blockIdx.x, usRows)] = 1;
+        __syncthreads(); // (partials[] is overwritten in the next round)
+    }
+}
+
 template <class ElemType>
 __global__ void _assignColumnwiseHardmaxOf(
     const ElemType* a,
@@ -1199,6 +1515,33 @@ __global__ void _setToZeroIfAbsLessThan(
     }
 }
 
+// Moves the entries with |a[id]| >= threshold to (indices, values), in the order in which they claim a slot, as long as
+// there is room; 'count' receives the total number of such entries.
+template <class ElemType>
+__global__ void _extractAbsAboveThreshold(
+    ElemType* a,
+    const ElemType threshold,
+    const CUDA_LONG N,
+    int* count,
+    const int capacity,
+    int* indices,
+    ElemType* values)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    ElemType v = a[id];
+    if (fabs_(v) < threshold)
+        return;
+    int pos = atomicAdd(count, 1);
+    if (pos < capacity)
+    {
+        indices[pos] = id;
+        values[pos] = v;
+        a[id] = 0;
+    }
+}
+
 template <class ElemType>
 __global__ void _areEqual(
     const ElemType* a,
@@ -1542,6 +1885,75 @@ __global__ void _setMaskAndScale(
     a[id] = a[id] <= maskRate ? 0 : scaleValue;
 }
 
+// each thread sets 4 elements, from the 4 random numbers of one Philox counter value
+template <class ElemType>
+__global__ void _setUniformRandomMask(
+    ElemType* a,
+    const CUDA_LONG N,
+    const ElemType maskRate,
+    const ElemType scaleValue,
+    const uint64_t firstCounter,
+    const uint64_t key)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    CUDA_LONG begin = id * 4;
+    if (begin >= N)
+        return;
+    PhiloxValues r = Philox4x32(firstCounter + id, 0, key);
+    for (CUDA_LONG i = 0; i < 4 && begin + i < N; i++)
+        a[begin + i] = PhiloxToUniform(r.v[i]) <= maskRate ? 0 : scaleValue;
+}
+
+// us = beta * us + a .* mask, with the mask of _setUniformRandomMask() regenerated for the elements elementOffset + id
+// (one thread per element; see CPUMatrix::AssignElementProductOfUniformRandomMask())
+template <class ElemType>
+__global__ void _assignElementProductOfUniformRandomMask(
+    ElemType* us,
+    const ElemType* a,
+    const CUDA_LONG N,
+    const ElemType maskRate,
+    const ElemType scaleValue,
+    const uint64_t firstCounter,
+    const uint64_t key,
+    const uint64_t elementOffset,
+    const ElemType beta)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+    uint64_t g = elementOffset + id;
+    PhiloxValues r = Philox4x32(firstCounter + g / 4, 0, key);
+    ElemType mask = PhiloxToUniform(r.v[g % 4]) <= maskRate ? 0 : scaleValue;
+    us[id] = beta == 0 ? mask * a[id] : beta * us[id] + mask * a[id];
+}
+
+// likewise for parameter initialization, see CPUMatrix::SetCounterBasedUniformRandomValue()
+template <class ElemType>
+__global__ void _setCounterBasedRandomValue(
+    ElemType* a,
+    const CUDA_LONG N,
+    const bool gaussian,
+    const ElemType offset, // low, or the mean
+    const ElemType scale,  // high - low, or sigma
+    const uint64_t key)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    CUDA_LONG begin = id * 4;
+    if (begin >= N)
+        return;
+    PhiloxValues r = Philox4x32(id, 0, key);
+    float values[4];
+    if (gaussian)
+        PhiloxToGaussian(r, values);
+    else
+    {
+        for (int i = 0; i < 4; i++)
+            values[i] = PhiloxToUniform(r.v[i]);
+    }
+    for (CUDA_LONG i = 0; i < 4 && begin + i < N; i++)
+        a[begin + i] = offset + scale * (ElemType) values[i];
+}
+
 template <class ElemType>
 __global__ void _vectorSum(
     ElemType* c,       // output
@@ -2183,6 +2595,71 @@ __global__ void _assignSignOf(
     a[id] = (v == (ElemType) 0 ? (ElemType) 0 : (v > 0 ? (ElemType) 1 : (ElemType)(-1)));
 }
 
+// compact element from float, see _assignCompressedOf()
+__device__ __forceinline__ void _floatToCompact(float v, unsigned char& res)
+{
+    res = (unsigned char) (fminf(fmaxf(rintf(v), -127.0f), 127.0f) + 127.0f);
+}
+__device__ __forceinline__ void _floatToCompact(float v, half& res)
+{
+    res = __float2half(v);
+}
+
+// column j of us = [scale, packed compact elements of a(:, j)], one block per column (see Matrix::AssignCompressedOf())
+// For uint8, the block first reduces max |a(:, j)| to the scale; FP16 stores the values as they are.
+template <class ElemType, class CompactType>
+__global__ void _assignCompressedOf(
+    ElemType* us,
+    const ElemType* a,
+    const CUDA_LONG numRows,
+    const CUDA_LONG compressedNumRows)
+{
+    __shared__ float partials[GridDim::maxThreadsPerBlock];
+    const ElemType* src = a + (size_t) blockIdx.x * numRows;
+    ElemType* dst = us + (size_t) blockIdx.x * compressedNumRows;
+    CompactType* compact = reinterpret_cast<CompactType*>(dst + 1);
+
+    float scale = 1;
+    if (sizeof(CompactType) == 1)
+    {
+        float maxAbs = 0;
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+            maxAbs = fmaxf(maxAbs, fabsf((float) src[i]));
+        partials[threadIdx.x] = maxAbs;
+        __syncthreads();
+        for (int n = blockDim.x / 2; n > 0; n /= 2)
+        {
+            if (threadIdx.x < n)
+                partials[threadIdx.x] = fmaxf(partials[threadIdx.x], partials[threadIdx.x + n]);
+            __syncthreads();
+        }
+        if (partials[0] > 0)
+            scale = partials[0] / 127;
+    }
+    if (threadIdx.x == 0)
+        dst[0] = (ElemType) scale;
+    for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+        _floatToCompact((float) src[i] / scale, compact[i]);
+}
+
+// us(:, j) = compact elements of column j (less 127 for uint8) * scale, inverse of _assignCompressedOf()
+template <class ElemType, class CompactType>
+__global__ void _assignDecompressedOf(
+    ElemType* us,
+    const ElemType* compressed,
+    const CUDA_LONG numRows,
+    const CUDA_LONG compressedNumRows,
+    const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+    CUDA_LONG j = id / numRows;
+    const ElemType* src = compressed + (size_t) j * compressedNumRows;
+    float v = _compactToFloat(reinterpret_cast<const CompactType*>(src + 1)[id - j * numRows]);
+    if (sizeof(CompactType) == 1)
+        v -= 127;
+    us[id] = (ElemType) v * src[0];
+}
+
 template <class ElemType>
 __global__ void _addSignOf(
     ElemType* a,
@@ -2823,6 +3300,50 @@ __global__ void _shiftColCSCIndexFromSliceViewToAbsolute(
         colCSCIndex[cols] = nz;
 }
 
+// c = alpha * op(a) * b + beta * c, where b (k x n) is given by its CSC arrays
+// One thread per element of c, rows fastest, so that the threads of a column of c share the (few) nonzeros of b,
+// e.g. of one-hot input, and read the columns of a at consecutive addresses. The nonzero values are indexed absolutely, i.e. through
+// Buffer(), and thus the column offsets of a column slice are used as is.
+template <class ElemType>
+__global__ void _denseMultSparseCSCAndWeightedAddToDense(
+    const int m, // rows of op(a) and c
+    const int k, // columns of op(a), rows of b
+    const int n, // columns of b and c
+    const ElemType alpha,
+    const ElemType* a, // dense
+    const bool transposeA,
+    const ElemType* bnzValues, // sparse nz values
+    const GPUSPARSE_INDEX_TYPE* rowIndex,
+    const GPUSPARSE_INDEX_TYPE* colCSCIndex,
+    const ElemType beta,
+    ElemType* c // dense target
+    )
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= m * n)
+        return;
+
+    int colInC = id / m;
+    int rowInC = id % m;
+
+    int start = colCSCIndex[colInC];
+    int end = colCSCIndex[colInC + 1];
+
+    ElemType s = 0;
+    if (!transposeA)
+    {
+        for (int j = start; j < end; j++)
+            s += a[IDX2C(rowInC, rowIndex[j], m)] * bnzValues[j];
+    }
+    else
+    {
+        for (int j = start; j < end; j++)
+            s += a[IDX2C(rowIndex[j], rowInC, k)] * bnzValues[j];
+    }
+
+    c[id] = alpha * s + (beta == 0 ? 0 : beta * c[id]); // If beta is zero then don't lookup c
+}
+
 //c = alpha * op(a) * op(b) + beta*c
 // TODO: This function can be further improved by loading the kernel in shared memory
 template <class ElemType>
@@ -3022,9 +3543,10 @@ __global__ void _findColsWithValues(
 //what's the mapping from the column id in the resulted SparseBlockCol format to the column id in the dense format
 //input: rowIndexes: the row indexes of the CSC sparse matrix to be multiplied with
 //blockId2Col: the blockID to colum id mapping in the resulting matrix;
-//col2BlockId: the col2BlockId to blockID mapping in the resulting matrix;
+//col2BlockId: the col2BlockId to blockID mapping in the resulting matrix, on input the flags of _findColsWithValues;
 //numCols: number of columns in the resulting matrix or the size of blockIDs
 //blockSize: return the blockSize with values, *blockSize must be zero before passed in.
+//The flags must not be in blockId2Col: a thread of another thread block may assign a block id there before they are read.
 template <class ElemType>
 __global__ void _determineBlockIds(
     GPUSPARSE_INDEX_TYPE* blockId2Col, GPUSPARSE_INDEX_TYPE* col2BlockId, const size_t numCols, size_t* blockSize)
@@ -3033,17 +3555,12 @@ __global__ void _determineBlockIds(
     if (index >= numCols)
         return;
 
-    size_t blockIndex = numCols;
-    if (blockId2Col[index] > 0)
+    if (col2BlockId[index] > 0)
     {
-        blockIndex = atomicAdd((unsigned int*) blockSize, (unsigned int) 1);
+        size_t blockIndex = atomicAdd((unsigned int*) blockSize, (unsigned int) 1);
         col2BlockId[index] = blockIndex;
-    }
-
-    __syncthreads();
-
-    if (blockIndex < numCols)
         blockId2Col[blockIndex] = index;
+    }
 }
 
 // backward pass from hidden layer to feature weight
@@ -3157,6 +3674,39 @@ __global__ void _scaleSparseBlockAndAddToDense(
     rhs[IDX2C(row, col, numRows)] += alpha * lhsValues[index];
 }
 
+// the reverse of _scaleSparseBlockAndAddToDense: rhsValues += alpha * lhs at the positions of the blocks
+template <class ElemType>
+__global__ void _scaleDenseAndAddToSparseBlock(
+    const ElemType alpha,
+    const bool blockCol, // true if blockRow
+    const size_t numRows,
+    const size_t numCols,
+    const size_t numBlocks,
+    const ElemType* lhs,
+    const GPUSPARSE_INDEX_TYPE* blockIds,
+    ElemType* rhsValues) // rhs is blockCol or blockRow
+{
+    const CUDA_LONG index = blockIdx.x * blockDim.x + threadIdx.x;
+    CUDA_LONG row, col;
+    if (blockCol)
+    {
+        const CUDA_LONG blockId = index / numRows;
+        if (blockId >= numBlocks)
+            return;
+        row = index - numRows * blockId;
+        col = blockIds[blockId];
+    }
+    else
+    {
+        const CUDA_LONG blockId = index / numCols;
+        if (blockId >= numBlocks)
+            return;
+        col = index - numCols * blockId;
+        row = blockIds[blockId];
+    }
+    rhsValues[index] += alpha * lhs[IDX2C(row, col, numRows)];
+}
+
 #if 0
 // compute predictions in cross entropy node
 template <class ElemType>
@@ -3827,6 +4377,115 @@ __global__ void _inplaceSoftThreshold(
         a[id] = 0;
 }
 
+// Kernel parameters of a launch of the multi-tensor kernels below (see GPUMatrix<ElemType>::MultiTensorNormalGrad()).
+// Each block processes one chunk of one of up to maxTensors tensors. It is passed by value, so it must stay within
+// the 4 KB limit of kernel parameters.
+template <class ElemType>
+struct MultiTensorLaunchParams
+{
+    static const int maxTensors = 32;
+    static const int maxBlocks = 256;
+    static const int threadsPerBlock = 256;
+    static const CUDA_LONG chunkSize = 8192;
+
+    ElemType* smoothedGradients[maxTensors];
+    ElemType* gradients[maxTensors];
+    ElemType* functionValues[maxTensors];
+    ElemType learnRatesPerSample[maxTensors];
+    CUDA_LONG numElements[maxTensors];
+    int tensorIndices[maxTensors];   // index of the tensor in the whole list, for the sums of squares
+    unsigned char blockTensors[maxBlocks]; // the tensor (0..maxTensors-1) of each block
+    CUDA_LONG blockChunks[maxBlocks];      // the chunk within that tensor
+};
+
+// adds the sum of squares of each chunk of the gradients to sumsOfSquares[tensor index]
+template <class ElemType>
+__global__ void _multiTensorSumOfSquares(const MultiTensorLaunchParams<ElemType> params, ElemType* sumsOfSquares)
+{
+    typedef MultiTensorLaunchParams<ElemType> Params;
+    __shared__ ElemType partialSums[Params::threadsPerBlock];
+
+    const int tensor = params.blockTensors[blockIdx.x];
+    const CUDA_LONG begin = params.blockChunks[blockIdx.x] * Params::chunkSize;
+    const CUDA_LONG end = min(begin + Params::chunkSize, params.numElements[tensor]);
+    const ElemType* grad = params.gradients[tensor];
+
+    ElemType sum = 0;
+    for (CUDA_LONG i = begin + threadIdx.x; i < end; i += Params::threadsPerBlock)
+        sum += grad[i] * grad[i];
+    partialSums[threadIdx.x] = sum;
+    __syncthreads();
+
+    for (int stride = Params::threadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (threadIdx.x < stride)
+            partialSums[threadIdx.x] += partialSums[threadIdx.x + stride];
+        __syncthreads();
+    }
+    if (threadIdx.x == 0)
+        atomicAdd(&sumsOfSquares[params.tensorIndices[tensor]], partialSums[0]);
+}
+
+// clipping, L2 regularization, momentum SGD and L1 regularization of each chunk, see Matrix<ElemType>::MultiTensorNormalGrad()
+// sumsOfSquares is null unless clipping by norm.
+template <class ElemType>
+__global__ void _multiTensorNormalGrad(const MultiTensorLaunchParams<ElemType> params, const ElemType* sumsOfSquares,
+                                       const bool clipByTruncation, const ElemType clippingThreshold,
+                                       const ElemType l2RegWeight, const ElemType l1RegWeight,
+                                       const ElemType momentum, const bool useNesterovMomentum)
+{
+    typedef MultiTensorLaunchParams<ElemType> Params;
+
+    const int tensor = params.blockTensors[blockIdx.x];
+    const CUDA_LONG begin = params.blockChunks[blockIdx.x] * Params::chunkSize;
+    const CUDA_LONG end = min(begin + Params::chunkSize, params.numElements[tensor]);
+    ElemType* smoothed = params.smoothedGradients[tensor];
+    ElemType* grad = params.gradients[tensor];
+    ElemType* val = params.functionValues[tensor];
+    const ElemType learnRatePerSample = params.learnRatesPerSample[tensor];
+    const ElemType l1Threshold = learnRatePerSample * l1RegWeight;
+    const ElemType truncationThreshold = fabs(clippingThreshold);
+
+    ElemType normFactor = 1;
+    if (sumsOfSquares)
+    {
+        const ElemType gradientNorm = sqrt(sumsOfSquares[params.tensorIndices[tensor]]);
+        if (gradientNorm > clippingThreshold)
+            normFactor = clippingThreshold / gradientNorm;
+    }
+
+    for (CUDA_LONG i = begin + threadIdx.x; i < end; i += Params::threadsPerBlock)
+    {
+        ElemType g = grad[i];
+        if (clipByTruncation)
+        {
+            if (g > truncationThreshold)
+                g = truncationThreshold;
+            else if (g < -truncationThreshold)
+                g = -truncationThreshold;
+        }
+        g *= normFactor;
+        if (l2RegWeight > 0)
+            g += l2RegWeight * val[i];
+        grad[i] = g;
+
+        const ElemType s = (1 - momentum) * learnRatePerSample * g + momentum * smoothed[i];
+        smoothed[i] = s;
+
+        ElemType v = useNesterovMomentum ? val[i] - momentum * s - (1 - momentum) * learnRatePerSample * g : val[i] - s;
+        if (l1RegWeight > 0)
+        {
+            if (v > l1Threshold)
+                v -= l1Threshold;
+            else if (v < -l1Threshold)
+                v += l1Threshold;
+            else
+                v = 0;
+        }
+        val[i] = v;
+    }
+}
+
 template <class ElemType>
 __global__ void _normalGradForSparseBlock(
     const ElemType momentum,
@@ -4558,6 +5217,187 @@ __global__ void _assignElementProductOfWithShift(
     us[id] = a[id] * b[tmpidb];
 }
 
+// Inverse column norms of the queries q and the documents d (m x n) for CosDistanceWithNegativeSamples; a thread per column.
+template <class ElemType>
+__global__ void _cosDistanceInverseNorms(
+    const ElemType* q,
+    const ElemType* d,
+    ElemType* invNormQ,
+    ElemType* invNormD,
+    const CUDA_LONG m,
+    const CUDA_LONG n)
+{
+    CUDA_LONG j = blockDim.x * blockIdx.x + threadIdx.x;
+    if (j >= n)
+        return;
+
+    ElemType sq = 0, sd = 0;
+    for (CUDA_LONG r = 0; r < m; r++)
+    {
+        sq += q[IDX2C(r, j, m)] * q[IDX2C(r, j, m)];
+        sd += d[IDX2C(r, j, m)] * d[IDX2C(r, j, m)];
+    }
+    invNormQ[j] = 1 / sqrt_(sq);
+    invNormD[j] = 1 / sqrt_(sd);
+}
+
+// Cosine similarity of query j against its document and the negNumber shifted ones, see CPUMatrix::CosDistanceWithNegativeSamples().
+// A block per query; the threads split the rows of each dot product, which are then reduced in shared memory.
+template <class ElemType, int BlockSize>
+__global__ void _cosDistanceWithNegativeSamples(
+    const ElemType* q,
+    const ElemType* d,
+    const ElemType* invNormQ,
+    const ElemType* invNormD,
+    ElemType* c,
+    const CUDA_LONG m,
+    const CUDA_LONG n,
+    const CUDA_LONG shift,
+    const CUDA_LONG negNumber)
+{
+    __shared__ ElemType partials[BlockSize];
+    const CUDA_LONG j = blockIdx.x;
+    for (CUDA_LONG i = 0; i <= negNumber; i++)
+    {
+        const CUDA_LONG k = i == 0 ? j : (j + shift + i - 1) % n;
+        ElemType dot = 0;
+        for (CUDA_LONG r = threadIdx.x; r < m; r += BlockSize)
+            dot += q[IDX2C(r, j, m)] * d[IDX2C(r, k, m)];
+        partials[threadIdx.x] = dot;
+        __syncthreads();
+        for (int stride = BlockSize / 2; stride > 0; stride /= 2)
+        {
+            if (threadIdx.x < stride)
+                partials[threadIdx.x] += partials[threadIdx.x + stride];
+            __syncthreads();
+        }
+        if (threadIdx.x == 0)
+            c[IDX2C(i, j, negNumber + 1)] = partials[0] * invNormQ[j] * invNormD[k];
+        __syncthreads();
+    }
+}
+
+// Gradient of CosDistanceWithNegativeSamples with respect to q (wrtQuery) or d, see CPUMatrix::CosDistanceWithNegativeSamplesGradient().
+// A block per column of grad and a thread per row, so that no two threads update the same element.
+template <class ElemType>
+__global__ void _cosDistanceWithNegativeSamplesGradient(
+    const bool wrtQuery,
+    const ElemType* self,
+    const ElemType* other,
+    const ElemType* invNormSelf,
+    const ElemType* invNormOther,
+    const ElemType* c,
+    const ElemType* cGrad,
+    ElemType* grad,
+    const CUDA_LONG m,
+    const CUDA_LONG n,
+    const CUDA_LONG shift,
+    const CUDA_LONG negNumber)
+{
+    const CUDA_LONG j = blockIdx.x;
+    for (CUDA_LONG r = threadIdx.x; r < m; r += blockDim.x)
+    {
+        ElemType sum = 0;
+        for (CUDA_LONG i = 0; i <= negNumber; i++)
+        {
+            const CUDA_LONG s = i == 0 ? 0 : (shift + i - 1) % n;
+            const CUDA_LONG k = wrtQuery ? (j + s) % n : (j + n - s) % n;
+            const CUDA_LONG col = wrtQuery ? j : k;
+            const ElemType g = cGrad[IDX2C(i, col, negNumber + 1)];
+            sum += g * invNormSelf[j] * (invNormOther[k] * other[IDX2C(r, k, m)] - c[IDX2C(i, col, negNumber + 1)] * invNormSelf[j] * self[IDX2C(r, j, m)]);
+        }
+        grad[IDX2C(r, j, m)] += sum;
+    }
+}
+
+// max or sum of v over the threads of a block, returned to all of them
+template <class ElemType, int BlockSize>
+__device__ ElemType _gmmBlockReduce(ElemType* partials, ElemType v, bool takeMax)
+{
+    partials[threadIdx.x] = v;
+    __syncthreads();
+    for (int stride = BlockSize / 2; stride > 0; stride /= 2)
+    {
+        if (threadIdx.x < stride)
+            partials[threadIdx.x] = takeMax ? max(partials[threadIdx.x], partials[threadIdx.x + stride]) : partials[threadIdx.x] + partials[threadIdx.x + stride];
+        __syncthreads();
+    }
+    ElemType result = partials[0];
+    __syncthreads();
+    return result;
+}
+
+// Gaussian mixture log-likelihood, see CPUMatrix::GMMLogLikelihood(). A block per sample and the components spread over its threads,
+// with the max and the sums of the log-sum-exp reduced in shared memory.
+template <class ElemType, int BlockSize>
+__global__ void _gmmLogLikelihood(
+    const ElemType* unnormedPrior,
+    const bool sharedPrior,
+    const ElemType* means,
+    const bool sharedMeans,
+    const ElemType* logStdDevs,
+    const bool sharedStdDevs,
+    const ElemType* features,
+    const ElemType* products,         // mu_c'x (numComponents x #samples) if sharedMeans
+    const ElemType* meanSquaredNorms, // ||mu_c||^2 if sharedMeans
+    ElemType* logLikelihood,
+    ElemType* posterior,
+    ElemType* normedDeviation,
+    const CUDA_LONG numComponents,
+    const CUDA_LONG featureDim,
+    const ElemType logNormalizer)
+{
+    __shared__ ElemType partials[BlockSize];
+    const CUDA_LONG t = blockIdx.x;
+    const ElemType* u = unnormedPrior + (sharedPrior ? 0 : t * numComponents);
+    const ElemType* s = logStdDevs + (sharedStdDevs ? 0 : t * numComponents);
+    const ElemType* x = features + t * featureDim;
+    ElemType* p = posterior + t * numComponents;
+
+    ElemType featureSquaredNorm = 0;
+    if (sharedMeans)
+    {
+        for (CUDA_LONG r = threadIdx.x; r < featureDim; r += BlockSize)
+            featureSquaredNorm += x[r] * x[r];
+        featureSquaredNorm = _gmmBlockReduce<ElemType, BlockSize>(partials, featureSquaredNorm, false);
+    }
+
+    // log of the unnormalized prior times the component likelihood
+    ElemType maxJoint = -FLT_MAX, maxPrior = -FLT_MAX;
+    for (CUDA_LONG c = threadIdx.x; c < numComponents; c += BlockSize)
+    {
+        ElemType dist = 0;
+        if (sharedMeans)
+            dist = max((ElemType) 0, featureSquaredNorm - 2 * products[IDX2C(c, t, numComponents)] + meanSquaredNorms[c]);
+        else
+        {
+            const ElemType* mu = means + t * numComponents * featureDim + c * featureDim;
+            for (CUDA_LONG r = 0; r < featureDim; r++)
+                dist += (x[r] - mu[r]) * (x[r] - mu[r]);
+        }
+        const ElemType normed = dist * exp_(-2 * s[c]);
+        normedDeviation[IDX2C(c, t, numComponents)] = normed;
+        p[c] = u[c] - normed / 2 - featureDim * s[c] - logNormalizer;
+        maxJoint = max(maxJoint, p[c]);
+        maxPrior = max(maxPrior, u[c]);
+    }
+    maxJoint = _gmmBlockReduce<ElemType, BlockSize>(partials, maxJoint, true);
+    maxPrior = _gmmBlockReduce<ElemType, BlockSize>(partials, maxPrior, true);
+
+    ElemType sumJoint = 0, sumPrior = 0;
+    for (CUDA_LONG c = threadIdx.x; c < numComponents; c += BlockSize)
+    {
+        sumJoint += exp_(p[c] - maxJoint);
+        sumPrior += exp_(u[c] - maxPrior);
+    }
+    const ElemType logSumJoint = maxJoint + log_(_gmmBlockReduce<ElemType, BlockSize>(partials, sumJoint, false));
+    const ElemType logSumPrior = maxPrior + log_(_gmmBlockReduce<ElemType, BlockSize>(partials, sumPrior, false));
+    for (CUDA_LONG c = threadIdx.x; c < numComponents; c += BlockSize)
+        p[c] = exp_(p[c] - logSumJoint);
+    if (threadIdx.x == 0)
+        logLikelihood[t] = logSumJoint - logSumPrior;
+}
+
 // minus 1 at a specific position
 template <class ElemType>
 __global__ void _minusOneAt(
@@ -4860,6 +5700,234 @@ __global__ void _rcrfTransGrdCompute(
     }
 };
 
+// the label of a CRF frame: the first row that is not zero, or -1 if there is none
+template <class ElemType>
+__device__ int _crfLabelOf(const ElemType* lbls, const size_t col, const size_t numLabels)
+{
+    for (size_t k = 0; k < numLabels; k++)
+        if (lbls[IDX2C(k, col, numLabels)] != 0)
+            return (int) k;
+    return -1;
+}
+
+// Batched CRF forward-backward, see CPUMatrix::CRFForwardBackward(). One block per sequence and the labels spread over
+// its threads; sequences holds (s, tBegin, tEnd) per sequence. Needs numLabels elements of shared memory for zeta.
+template <class ElemType>
+__global__ void _crfForwardBackward(
+    const ElemType* lbls,
+    const ElemType* pos_scores,
+    const ElemType* pair_scores,
+    const size_t* sequences,
+    const size_t numParallelSequences,
+    const size_t numLabels,
+    ElemType* alpha,
+    ElemType* beta,
+    ElemType* postProb,
+    ElemType* sequenceScores)
+{
+    extern __shared__ double sh_crfZeta[];
+    ElemType* zeta = (ElemType*) sh_crfZeta;
+
+    const size_t s = sequences[3 * blockIdx.x];
+    const size_t tBegin = sequences[3 * blockIdx.x + 1];
+    const size_t tEnd = sequences[3 * blockIdx.x + 2];
+
+    const int firstLabel = _crfLabelOf(lbls, tBegin * numParallelSequences + s, numLabels);
+    for (size_t t = tBegin; t < tEnd; t++)
+    {
+        const size_t c = t * numParallelSequences + s;
+        for (size_t k = threadIdx.x; k < numLabels; k += blockDim.x)
+        {
+            ElemType a;
+            if (t == tBegin)
+                a = firstLabel >= 0 ? pair_scores[IDX2C(k, firstLabel, numLabels)] : (ElemType) LZERO;
+            else
+            {
+                a = LZERO;
+                for (size_t j = 0; j < numLabels; j++)
+                    a = logaddk(a, alpha[IDX2C(j, c - numParallelSequences, numLabels)] + pair_scores[IDX2C(k, j, numLabels)]);
+            }
+            alpha[IDX2C(k, c, numLabels)] = a + pos_scores[IDX2C(k, c, numLabels)];
+        }
+        __syncthreads();
+    }
+
+    const size_t lastCol = (tEnd - 1) * numParallelSequences + s;
+    ElemType logZ = LZERO;
+    for (size_t j = 0; j < numLabels; j++)
+        logZ = logaddk(logZ, alpha[IDX2C(j, lastCol, numLabels)]);
+
+    for (size_t t = tEnd; t-- > tBegin;)
+    {
+        const size_t c = t * numParallelSequences + s;
+        if (c == lastCol)
+        {
+            for (size_t k = threadIdx.x; k < numLabels; k += blockDim.x)
+                beta[IDX2C(k, c, numLabels)] = alpha[IDX2C(k, c, numLabels)] - logZ;
+        }
+        else
+        {
+            for (size_t j = threadIdx.x; j < numLabels; j += blockDim.x)
+            {
+                ElemType z = LZERO;
+                for (size_t m = 0; m < numLabels; m++)
+                    z = logaddk(z, alpha[IDX2C(m, c, numLabels)] + pair_scores[IDX2C(j, m, numLabels)]);
+                zeta[j] = z;
+            }
+            __syncthreads();
+            for (size_t k = threadIdx.x; k < numLabels; k += blockDim.x)
+            {
+                ElemType b = LZERO;
+                for (size_t j = 0; j < numLabels; j++)
+                    b = logaddk(b, beta[IDX2C(j, c + numParallelSequences, numLabels)] + alpha[IDX2C(k, c, numLabels)] + pair_scores[IDX2C(j, k, numLabels)] - zeta[j]);
+                beta[IDX2C(k, c, numLabels)] = b;
+            }
+        }
+        for (size_t k = threadIdx.x; k < numLabels; k += blockDim.x)
+            postProb[IDX2C(k, c, numLabels)] = exp(beta[IDX2C(k, c, numLabels)]);
+        __syncthreads();
+    }
+
+    // score of the given label path, including the transition into the first frame like the forward recursion
+    if (threadIdx.x == 0)
+    {
+        ElemType score = 0;
+        int prevLabel = firstLabel;
+        for (size_t t = tBegin; t < tEnd; t++)
+        {
+            const size_t c = t * numParallelSequences + s;
+            const int label = _crfLabelOf(lbls, c, numLabels);
+            if (label >= 0)
+            {
+                score += pos_scores[IDX2C(label, c, numLabels)];
+                if (prevLabel >= 0)
+                    score += pair_scores[IDX2C(label, prevLabel, numLabels)];
+            }
+            prevLabel = label;
+        }
+        sequenceScores[blockIdx.x] = logZ - score;
+    }
+}
+
+// Batched CRF transition gradient, see CPUMatrix::CRFTransitionGradient(). A thread per element grd(j, i).
+template <class ElemType>
+__global__ void _crfTransitionGradient(
+    const ElemType* lbls,
+    const ElemType* pos_scores,
+    const ElemType* pair_scores,
+    const size_t* sequences,
+    const size_t numSequences,
+    const size_t numParallelSequences,
+    const size_t numLabels,
+    const ElemType* alpha,
+    const ElemType* beta,
+    ElemType* grd)
+{
+    const CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= numLabels * numLabels)
+        return;
+    const size_t j = id % numLabels;
+    const size_t i = id / numLabels;
+
+    ElemType g = 0;
+    for (size_t q = 0; q < numSequences; q++)
+    {
+        const size_t s = sequences[3 * q];
+        const size_t tBegin = sequences[3 * q + 1];
+        const size_t tEnd = sequences[3 * q + 2];
+        const int firstLabel = _crfLabelOf(lbls, tBegin * numParallelSequences + s, numLabels);
+        for (size_t t = tBegin; t < tEnd; t++)
+        {
+            const size_t c = t * numParallelSequences + s;
+            const ElemType zeta = alpha[IDX2C(j, c, numLabels)] - pos_scores[IDX2C(j, c, numLabels)];
+            const bool isLabel = lbls[IDX2C(j, c, numLabels)] != 0;
+            if (t == tBegin)
+            {
+                if ((int) i == firstLabel)
+                    g += exp(pair_scores[id] - zeta + beta[IDX2C(j, c, numLabels)]) - (isLabel ? 1 : 0);
+            }
+            else
+            {
+                g += exp(alpha[IDX2C(i, c - numParallelSequences, numLabels)] + pair_scores[id] - zeta + beta[IDX2C(j, c, numLabels)]);
+                if (isLabel && lbls[IDX2C(i, c - numParallelSequences, numLabels)] != 0)
+                    g -= 1;
+            }
+        }
+    }
+    grd[id] += g;
+}
+
+// Batched Viterbi decoding, see CPUMatrix::CRFViterbiDecode(). One block per sequence and the labels spread over its threads.
+template <class ElemType>
+__global__ void _crfViterbiDecode(
+    const ElemType* lbls,
+    const ElemType* pos_scores,
+    const ElemType* pair_scores,
+    const size_t* sequences,
+    const size_t numParallelSequences,
+    const size_t numLabels,
+    ElemType* alpha,
+    ElemType* backtrace,
+    ElemType* decodedPath)
+{
+    const size_t s = sequences[3 * blockIdx.x];
+    const size_t tBegin = sequences[3 * blockIdx.x + 1];
+    const size_t tEnd = sequences[3 * blockIdx.x + 2];
+
+    const int startLabel = _crfLabelOf(lbls, tBegin * numParallelSequences + s, numLabels);
+    for (size_t t = tBegin; t < tEnd; t++)
+    {
+        const size_t c = t * numParallelSequences + s;
+        for (size_t k = threadIdx.x; k < numLabels; k += blockDim.x)
+        {
+            ElemType best;
+            size_t from = 0;
+            if (t == tBegin)
+            {
+                best = (startLabel < 0 || k == (size_t) startLabel) ? 0 : (ElemType) LZERO;
+                from = startLabel < 0 ? 0 : startLabel;
+            }
+            else
+            {
+                best = LZERO;
+                for (size_t j = 0; j < numLabels; j++)
+                {
+                    ElemType v = alpha[IDX2C(j, c - numParallelSequences, numLabels)] + pair_scores[IDX2C(k, j, numLabels)];
+                    if (v > best)
+                    {
+                        best = v;
+                        from = j;
+                    }
+                }
+            }
+            alpha[IDX2C(k, c, numLabels)] = best + pos_scores[IDX2C(k, c, numLabels)];
+            backtrace[IDX2C(k, c, numLabels)] = (ElemType) from;
+        }
+        __syncthreads();
+    }
+
+    // trace back from the end label, or from the best last label if none is given
+    if (threadIdx.x == 0)
+    {
+        const size_t lastCol = (tEnd - 1) * numParallelSequences + s;
+        const int endLabel = _crfLabelOf(lbls, lastCol, numLabels);
+        size_t label = endLabel < 0 ? 0 : endLabel;
+        if (endLabel < 0)
+        {
+            for (size_t k = 1; k < numLabels; k++)
+                if (alpha[IDX2C(k, lastCol, numLabels)] > alpha[IDX2C(label, lastCol, numLabels)])
+                    label = k;
+        }
+        for (size_t t = tEnd; t-- > tBegin;)
+        {
+            const size_t c = t * numParallelSequences + s;
+            decodedPath[IDX2C(label, c, numLabels)] = 1;
+            if (t > tBegin)
+                label = (size_t) backtrace[IDX2C(label, c, numLabels)];
+        }
+    }
+}
+
 template <class ElemType>
 __global__ void _reductionLogAddSum(
     const ElemType* data,
@@ -4992,6 +6060,65 @@ __global__ void _assignNumOfDiffCol(const ElemType* a, const ElemType* b, ElemTy
         *c = res;
 }
 
+// One block per column: the label row is found (first maximum of a one-hot column, or the class index), then the predictions
+// preceding the label's in the stable descending order are counted, and the column adds 1 to 'numErrors' if there are 'topK' or more.
+// 'numErrors' must be zeroed beforehand. Columns where 'columnsMask' is 0 are skipped.
+template <int BlockSize, class ElemType>
+__global__ void _assignNumOfTopKErrors(const ElemType* labels, const ElemType* predictions, const char* columnsMask, ElemType* numErrors,
+                                       CUDA_LONG numRows, CUDA_LONG topK, bool classIndexLabels)
+{
+    const CUDA_LONG col = blockIdx.x;
+    if (columnsMask && columnsMask[col] == 0)
+        return; // (uniform across the block)
+
+    __shared__ CUDA_LONG labelRow;
+    if (classIndexLabels)
+    {
+        if (threadIdx.x == 0)
+            labelRow = (CUDA_LONG) labels[col];
+    }
+    else
+    {
+        using ArgMaxT = cub::KeyValuePair<int, ElemType>;
+        using BlockArgMaxT = cub::BlockReduce<ArgMaxT, BlockSize>;
+        __shared__ typename BlockArgMaxT::TempStorage argMaxTmp;
+
+        // cub::ArgMax() keeps the lower key among equal values, so threads without a row carry an out-of-range key and the lowest value
+        ArgMaxT best(numRows, (ElemType) -FLT_MAX);
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += BlockSize)
+        {
+            const ElemType v = labels[IDX2C(i, col, numRows)];
+            if (best.key == numRows || best.value < v)
+                best = ArgMaxT(i, v);
+        }
+        best = BlockArgMaxT(argMaxTmp).Reduce(best, cub::ArgMax());
+        if (threadIdx.x == 0)
+            labelRow = best.key;
+    }
+    __syncthreads();
+
+    if (labelRow < 0 || labelRow >= numRows)
+    {
+        if (threadIdx.x == 0)
+            atomicAdd(numErrors, (ElemType) 1);
+        return;
+    }
+
+    const ElemType labelValue = predictions[IDX2C(labelRow, col, numRows)];
+    int rank = 0;
+    for (CUDA_LONG i = threadIdx.x; i < numRows; i += BlockSize)
+    {
+        const ElemType v = predictions[IDX2C(i, col, numRows)];
+        rank += v > labelValue || (v == labelValue && i < labelRow);
+    }
+
+    using BlockSumT = cub::BlockReduce<int, BlockSize>;
+    __shared__ typename BlockSumT::TempStorage sumTmp;
+    rank = BlockSumT(sumTmp).Sum(rank);
+    if (threadIdx.x == 0 && rank >= topK)
+        atomicAdd(numErrors, (ElemType) 1);
+}
+
 template <class ElemType>
 __global__ void _maskColumnsValue(ElemType* a, const char* columnsMask, CUDA_LONG numCols, CUDA_LONG numRows, ElemType val)
 {
@@ -11,7 +11,7 @@
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 GPURNGHandle::GPURNGHandle(int deviceId, unsigned long seed)
-    : RNGHandle(deviceId)
+    : RNGHandle(deviceId, seed)
 {
     unsigned long long cudaSeed = seed;
     fprintf(stderr, "(GPU): creating curand object with seed %llu\n", cudaSeed);
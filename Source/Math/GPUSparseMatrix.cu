@@ -28,9 +28,9 @@ typedef unsigned char byte;
 // thread local storage to access the current stream, initalize to default stream
 extern __declspec(thread)
 #else
-static
+extern __thread
 #endif
-    cudaStream_t t_stream;
+    cudaStream_t t_stream; // defined in GPUMatrix.cu
 
 template <>
 const char* CudaErrString<cusparseStatus_t>(cusparseStatus_t)
@@ -41,12 +41,42 @@ const char* CudaErrString<cusparseStatus_t>(cusparseStatus_t)
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// GetCusparseHandle - get the calling thread's cusparse handle for the given GPU, bound to the thread's current stream;
+// like the cublas handles in GPUMatrix, one per thread and GPU is created on first use and never freed
+static cusparseHandle_t GetCusparseHandle(int computeDevice = -1)
+{
+#ifdef _WIN32
+    static __declspec(thread)
+#else
+    static __thread
+#endif
+        cusparseHandle_t s_cusparseHandle[MAX_GPUS];
+
+    if (computeDevice < 0)
+        cudaGetDevice(&computeDevice);
+    if (computeDevice < 0 || computeDevice >= MAX_GPUS)
+        LogicError("GetCusparseHandle: Maximum GPU exceeded");
+    cusparseHandle_t cusparseHandle = s_cusparseHandle[computeDevice];
+    if (cusparseHandle == NULL)
+    {
+        PrepareDevice((DEVICEID_TYPE) computeDevice);
+        CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+        s_cusparseHandle[computeDevice] = cusparseHandle;
+    }
+    CUSPARSE_CALL(cusparseSetStream(cusparseHandle, t_stream));
+    return cusparseHandle;
+}
+
 #pragma region Constructors and Destructor
 
 template <class ElemType>
 GPUSPARSE_INDEX_TYPE GPUSparseMatrix<ElemType>::SecondaryIndexValueAt(size_t idx) const
 {
     if (idx + m_sliceViewOffset == 0) return 0;
+    // if the index was uploaded from the host, read it from the host copy instead of blocking on a copy from the device
+    const auto& hostCopy = GetSecondaryIndexHostCopy();
+    if (idx + m_sliceViewOffset < hostCopy.size())
+        return hostCopy[idx + m_sliceViewOffset];
     GPUSPARSE_INDEX_TYPE value;
     CUDA_CALL(cudaMemcpy(&value, SecondaryIndexLocation() + idx, sizeof(GPUSPARSE_INDEX_TYPE), cudaMemcpyDeviceToHost));
 
@@ -133,6 +163,17 @@ template <class ElemType>
             GetNumNZElements());
     }
 
+    // carry the host copy of the index along, shifted like the device copy
+    const auto& sourceHostCopy = deepCopy.GetSecondaryIndexHostCopy();
+    if ((GetFormat() == matrixFormatSparseCSC || GetFormat() == matrixFormatSparseCSR) && deepCopy.m_sliceViewOffset + SecondaryIndexCount() <= sourceHostCopy.size())
+    {
+        auto& hostCopy = GetSecondaryIndexHostCopy();
+        hostCopy.assign(sourceHostCopy.begin() + deepCopy.m_sliceViewOffset, sourceHostCopy.begin() + deepCopy.m_sliceViewOffset + SecondaryIndexCount());
+        const GPUSPARSE_INDEX_TYPE firstIndex = hostCopy[0];
+        for (auto& index : hostCopy)
+            index -= firstIndex;
+    }
+
     // TODO: to copy other variables used only for class based LM
 }
 
@@ -161,9 +202,28 @@ void GPUSparseMatrix<ElemType>::SetValue(const CPUSparseMatrix<ElemType>& deepCo
     {
         SetMatrixFromCSRFormat(deepCopy.RowLocation(), deepCopy.ColLocation(), deepCopy.Data(), deepCopy.GetNumElemAllocated(), deepCopy.GetNumRows(), deepCopy.GetNumCols());
     }
-    else if (deepCopy.GetFormat() == matrixFormatSparseCSC)
+    else if (deepCopy.GetFormat() == matrixFormatSparseBlockCol)
     {
-        SetMatrixFromCSCFormat(deepCopy.ColLocation(), deepCopy.RowLocation(), deepCopy.Data(), deepCopy.GetNumElemAllocated(), deepCopy.GetNumRows(), deepCopy.GetNumCols());
+        // the inverse of the BlockCol case of CopyToCPUSparseMatrix(); columns without a block map to -1
+        std::vector<size_t> columnIds;
+        std::vector<ElemType> values;
+        deepCopy.GetBlockColumns(columnIds, values);
+
+        RequireSizeAndAllocate(deepCopy.GetNumRows(), deepCopy.GetNumCols(), values.size(), true, false);
+        PrepareDevice();
+        std::vector<GPUSPARSE_INDEX_TYPE> blockId2Col(columnIds.size());
+        std::vector<GPUSPARSE_INDEX_TYPE> col2BlockId(GetNumCols(), -1);
+        for (size_t i = 0; i < columnIds.size(); ++i)
+        {
+            blockId2Col[i] = (GPUSPARSE_INDEX_TYPE) columnIds[i];
+            col2BlockId[columnIds[i]] = (GPUSPARSE_INDEX_TYPE) i;
+        }
+        SetBlockSize(columnIds.size());
+        if (!columnIds.empty())
+            CUDA_CALL(cudaMemcpy(BlockId2ColOrRow(), blockId2Col.data(), blockId2Col.size() * sizeof(GPUSPARSE_INDEX_TYPE), cudaMemcpyHostToDevice));
+        CUDA_CALL(cudaMemcpy(ColOrRow2BlockId(), col2BlockId.data(), col2BlockId.size() * sizeof(GPUSPARSE_INDEX_TYPE), cudaMemcpyHostToDevice));
+        if (!values.empty())
+            CUDA_CALL(cudaMemcpy(Data(), values.data(), NzSize(), cudaMemcpyHostToDevice));
     }
     else
         NOT_IMPLEMENTED;
@@ -258,8 +318,7 @@ void GPUSparseMatrix<ElemType>::CopyToDenseMatrix(GPUMatrix<ElemType>& denseMatr
     }
 
     PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle();
     cusparseMatDescr_t descr = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descr));
     cusparseSetMatType(descr, CUSPARSE_MATRIX_TYPE_GENERAL);
@@ -268,7 +327,6 @@ void GPUSparseMatrix<ElemType>::CopyToDenseMatrix(GPUMatrix<ElemType>& denseMatr
     denseMatrix.RequireSize(GetNumRows(), GetNumCols());
 
     SyncGuard syncGuard;
-    CUSPARSE_CALL(cusparseSetStream(cusparseHandle, t_stream));
     if (GetFormat() == MatrixFormat::matrixFormatSparseCSR)
     {
         if (sizeof(ElemType) == sizeof(float))
@@ -295,7 +353,6 @@ void GPUSparseMatrix<ElemType>::CopyToDenseMatrix(GPUMatrix<ElemType>& denseMatr
     {
         NOT_IMPLEMENTED;
     }
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
 
 }
 
@@ -318,11 +375,9 @@ void GPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat, GP
     }
 
     PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle();
 
     SyncGuard syncGuard;
-    CUSPARSE_CALL(cusparseSetStream(cusparseHandle, t_stream));
 
     outMatrix.ChangeDeviceTo(GetComputeDeviceId());
     outMatrix.RequireSizeAndAllocate(GetNumRows(), GetNumCols(), NzCount(), newFormat, true, false);
@@ -347,7 +402,6 @@ void GPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat, GP
         NOT_IMPLEMENTED;
     }
 
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
 }
 
 template <class ElemType>
@@ -454,8 +508,7 @@ void GPUSparseMatrix<ElemType>::SetValue(const GPUMatrix<ElemType>& denseMatrix,
     }
 
     PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle();
     cusparseMatDescr_t descr = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descr));
     cusparseSetMatType(descr, CUSPARSE_MATRIX_TYPE_GENERAL);
@@ -608,6 +661,10 @@ void GPUSparseMatrix<ElemType>::ResizeAsAndCopyIndexFrom(const GPUSparseMatrix<E
 
     CUDA_CALL(cudaMemcpy(MajorIndexLocation(), a.MajorIndexLocation(), MajorIndexSize(), cudaMemcpyDeviceToDevice));
     CUDA_CALL(cudaMemcpy(SecondaryIndexLocation(), a.SecondaryIndexLocation(), SecondaryIndexSize(), cudaMemcpyDeviceToDevice));
+
+    const auto& sourceHostCopy = a.GetSecondaryIndexHostCopy();
+    if ((GetFormat() == matrixFormatSparseCSC || GetFormat() == matrixFormatSparseCSR) && a.m_sliceViewOffset + SecondaryIndexCount() <= sourceHostCopy.size())
+        GetSecondaryIndexHostCopy().assign(sourceHostCopy.begin() + a.m_sliceViewOffset, sourceHostCopy.begin() + a.m_sliceViewOffset + SecondaryIndexCount());
 }
 
 //-------------------------------------------------------------------------
@@ -628,6 +685,8 @@ void GPUSparseMatrix<ElemType>::Reshape(const size_t numRows, const size_t numCo
     if (GetNumRows() * GetNumCols() != numRows * numCols)
         LogicError("GPUSparseMatrix::Reshape: new matrix size does not match current size, can't be reshaped. Did you mean to resize?");
 
+    GetSecondaryIndexHostCopy().clear(); // the index is recomputed on the device
+
     size_t bufferSizeNeeded = BufferSizeNeeded(numRows, numCols, GetSizeAllocated(), GetFormat());
 
     ElemType* pArray = reinterpret_cast<ElemType*>(TracingGPUMemoryAllocator::Allocate<char>(GetComputeDeviceId(), bufferSizeNeeded));
@@ -674,6 +733,8 @@ void GPUSparseMatrix<ElemType>::Allocate(const size_t numRows, const size_t numC
     if (GetNumRows() != numRows || GetNumCols() != numCols)
         LogicError("Error, calling allocate with dimensions (%d, %d), but the matrix has dimension (%d, %d).", (int)numRows, (int)numCols, (int)GetNumRows(), (int)GetNumCols());
 
+    GetSecondaryIndexHostCopy().clear();
+
     size_t bufferSizeNeeded = BufferSizeNeeded(numRows, numCols, numNZElemToReserve, GetFormat());
     bool reallocate = (BufferSizeAllocated() < bufferSizeNeeded || (!growOnly && BufferSizeAllocated() > bufferSizeNeeded));
 
@@ -730,6 +791,9 @@ void GPUSparseMatrix<ElemType>::RequireSizeAndAllocate(const size_t numRows, con
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::RequireSizeAndAllocate(const size_t numRows, const size_t numCols, const size_t numNZElemToReserve, const MatrixFormat matrixFormat, const bool growOnly /*= true*/, bool keepExistingValues /*= true*/)
 {
+    // the caller is about to write the index on the device, so the host copy no longer applies
+    GetSecondaryIndexHostCopy().clear();
+
 	RequireSize(numRows, numCols, matrixFormat, growOnly);
     
     size_t bufferSizeNeeded = BufferSizeNeeded(numRows, numCols, numNZElemToReserve, matrixFormat);
@@ -764,6 +828,7 @@ void GPUSparseMatrix<ElemType>::Resize(const size_t numRows, const size_t numCol
 {
     VerifyResizable(__func__);
 
+    GetSecondaryIndexHostCopy().clear();
     m_sliceViewOffset = 0;
     SetNumRows(numRows);
     SetNumCols(numCols);
@@ -805,6 +870,7 @@ void GPUSparseMatrix<ElemType>::ClearNzCount()
     // These requirements can be deduced by the NzCount method.
     CUDA_CALL(cudaMemset(Buffer(), 0, BufferSizeAllocated()));
     SetBlockSize(0);
+    GetSecondaryIndexHostCopy().clear();
 }
 
 
@@ -846,6 +912,9 @@ void GPUSparseMatrix<ElemType>::SetMatrixFromCSRFormat(const GPUSPARSE_INDEX_TYP
         CUDA_CALL(cudaMemcpy(RowLocation(), pRow, RowSize(), kind));
         CUDA_CALL(cudaMemcpy(ColLocation(), pCol, nz * sizeof(GPUSPARSE_INDEX_TYPE), kind));
     }
+
+    if (!IsOnDevice)
+        GetSecondaryIndexHostCopy().assign(h_CSRRow, h_CSRRow + numRows + 1);
 }
 
 // this function will allocate memory while the caller needs to release it
@@ -926,6 +995,9 @@ void GPUSparseMatrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYP
         CUDA_CALL(cudaMemcpy(RowLocation(), pRow, sizeof(GPUSPARSE_INDEX_TYPE) * nz, kind));
         CUDA_CALL(cudaMemcpy(ColLocation(), pCol, sizeof(GPUSPARSE_INDEX_TYPE) * (numCols+1), kind));
     }
+
+    if (!IsOnDevice)
+        GetSecondaryIndexHostCopy().assign(h_CSCCol, h_CSCCol + numCols + 1);
 }
 
 // this function will allocate memory while the caller needs to release it
@@ -1002,23 +1074,48 @@ void GPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPU
     else
         c.VerifySize(m, n); // Can't resize if beta != 0
 
+    if (rhs.GetFormat() != matrixFormatSparseCSC && rhs.GetFormat() != matrixFormatSparseCSR)
+        NOT_IMPLEMENTED;
+
     c.PrepareDevice();
-    if (rhs.GetFormat() == MatrixFormat::matrixFormatSparseCSC)
-    {
-        ConvolveAndWeightedAdd(alpha, lhs, transposeA, rhs, transposeB, beta, c, 1, 1, false, false);
-    }
-    else if (rhs.GetFormat() == matrixFormatSparseCSR)
+    // The kernel needs op(rhs) in CSC form. A CSC rhs is that as is, and so are the arrays of a CSR rhs that is
+    // transposed, read as the CSC of its transpose. This covers the forward (CSC input) and the backward (input
+    // gradient through a CSR input) of a product with sparse input without any conversion or host synchronization.
+    // Otherwise the transpose in the same format provides the arrays.
+    if ((rhs.GetFormat() == matrixFormatSparseCSC) != transposeB)
     {
-        GPUSparseMatrix<ElemType> tempMatrix(rhs.GetComputeDeviceId(), matrixFormatSparseCSC);
-        rhs.ConvertToSparseFormat(matrixFormatSparseCSC, tempMatrix);
-        MultiplyAndWeightedAdd(alpha, lhs, transposeA, tempMatrix, transposeB, beta, c);
+        DenseMultSparseCSCAndWeightedAddToDense(alpha, lhs, transposeA, rhs, beta, c);
     }
     else
     {
-        NOT_IMPLEMENTED;
+        GPUSparseMatrix<ElemType> rhsT = rhs.Transpose();
+        DenseMultSparseCSCAndWeightedAddToDense(alpha, lhs, transposeA, rhsT, beta, c);
     }
 }
 
+// c = alpha * op(lhs) * b + beta * c, where b is the matrix whose CSC arrays are the major and secondary index arrays
+// of the compressed rhs: rhs itself if it is CSC, its transpose if it is CSR
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::DenseMultSparseCSCAndWeightedAddToDense(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA,
+                                                                        const GPUSparseMatrix<ElemType>& rhs, ElemType beta, GPUMatrix<ElemType>& c)
+{
+    int m = (int) c.GetNumRows();
+    int k = transposeA ? (int) lhs.GetNumRows() : (int) lhs.GetNumCols();
+    int n = (int) c.GetNumCols();
+    int blocksPerGrid = (int) ceil(1.0 * m * n / GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _denseMultSparseCSCAndWeightedAddToDense<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
+        m, k, n, alpha,
+        reinterpret_cast<const ElemType*>(lhs.Data()), // dense
+        transposeA,
+        reinterpret_cast<const ElemType*>(rhs.Buffer()), // sparse nz values. Note that because of the offsets we use the array
+        rhs.MajorIndexLocation(),
+        rhs.SecondaryIndexLocation(),
+        beta,
+        reinterpret_cast<ElemType*>(c.Data()) // dense target
+        );
+}
+
 // dense X sparse = dense
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::ConvolveAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA,
@@ -1209,11 +1306,11 @@ void GPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const GPUMatrix<E
             size_t* blockSize = TracingGPUMemoryAllocator::Allocate<size_t>(lhs.GetComputeDeviceId(), 1);
             CUDA_CALL(cudaMemset(blockSize, 0, sizeof(size_t)));
 
-            CUDA_CALL(cudaMemset(c.BlockId2ColOrRow(), 0, sizeof(GPUSPARSE_INDEX_TYPE) * (n)));
+            CUDA_CALL(cudaMemset(c.ColOrRow2BlockId(), 0, sizeof(GPUSPARSE_INDEX_TYPE) * (n)));
 
             blocksPerGrid = (int) ceil(((double) rhs_nz) / GridDim::maxThreadsPerBlock);
             _findColsWithValues<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
-                rhs.RowLocation(), c.BlockId2ColOrRow(), rhs_nz);
+                rhs.RowLocation(), c.ColOrRow2BlockId(), rhs_nz);
                 
             blocksPerGrid = (int) ceil(((double) n) / GridDim::maxThreadsPerBlock);
             _determineBlockIds<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
@@ -1337,6 +1434,34 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const GPUSpars
     }
 }
 
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::ScaleAndAddOnBlocks(const ElemType alpha, const GPUMatrix<ElemType>& lhs, GPUSparseMatrix<ElemType>& rhs)
+{
+    rhs.VerifyWritable(__func__);
+
+    if (lhs.GetNumRows() != rhs.GetNumRows() || lhs.GetNumCols() != rhs.GetNumCols())
+        LogicError("ScaleAndAddOnBlocks: dimension mismatch");
+    if (lhs.GetComputeDeviceId() != rhs.GetComputeDeviceId())
+        RuntimeError("GPUSparseMatrix::ScaleAndAddOnBlocks: All matrices must be on the same GPU");
+    if (rhs.GetFormat() != matrixFormatSparseBlockCol && rhs.GetFormat() != matrixFormatSparseBlockRow)
+        NOT_IMPLEMENTED;
+
+    LONG64 N = (LONG64) rhs.GetNumNZElements();
+    if (N == 0)
+        return;
+    SyncGuard syncGuard;
+    int blocksPerGrid = (int) ceil(((double) N) / GridDim::maxThreadsPerBlock);
+    _scaleDenseAndAddToSparseBlock<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
+        alpha,
+        rhs.GetFormat() == matrixFormatSparseBlockCol,
+        rhs.GetNumRows(),
+        rhs.GetNumCols(),
+        rhs.GetBlockSize(),
+        lhs.Data(),
+        rhs.BlockId2ColOrRow(),
+        rhs.Data());
+}
+
 template <class ElemType>
 GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::InplaceTruncate(const ElemType threshold)
 {
@@ -1474,8 +1599,7 @@ void GPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPU
         RuntimeError("MultiplyAndWeightedAdd: All matrices must be on the same GPU");
 
     a.PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle();
     cusparseMatDescr_t descr = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descr));
     cusparseSetMatType(descr, CUSPARSE_MATRIX_TYPE_GENERAL);
@@ -1504,7 +1628,6 @@ void GPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPU
                                      aRowLocation, aColLocation, reinterpret_cast<double*>(b.Data()),
                                      (int) b.GetNumRows(), reinterpret_cast<double*>(&beta), reinterpret_cast<double*>(c.Data()), (int) c.GetNumRows()));
     }
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
 }
 
 template <class ElemType>
@@ -1623,8 +1746,7 @@ void GPUSparseMatrix<ElemType>::Multiply(const GPUSparseMatrix<ElemType>& S1, bo
         RuntimeError("Sparse matrix multiply: both matrices must be on the same device");
 
     S1.PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle();
     cusparseMatDescr_t descrA = 0, descrB = 0, descrC = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descrA));
     CUSPARSE_CALL(cusparseCreateMatDescr(&descrB));
@@ -1672,7 +1794,6 @@ void GPUSparseMatrix<ElemType>::Multiply(const GPUSparseMatrix<ElemType>& S1, bo
                                        descrB, nnzB, (const double*) S2.Buffer(), S2.RowLocation(), S2.ColLocation(),
                                        descrC, (double*) c.Data(), c.RowLocation(), c.ColLocation()));
     }
-    cusparseDestroy(cusparseHandle);
 }
 
 template <class ElemType>
@@ -1705,8 +1826,7 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const GPUSparseMatri
     int nnzB = (int) b.GetNumNZElements();
 
     a.PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle();
     cusparseMatDescr_t descrA = 0, descrB = 0, descrC = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descrA));
     CUSPARSE_CALL(cusparseCreateMatDescr(&descrB));
@@ -1740,7 +1860,6 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const GPUSparseMatri
         CUSPARSE_CALL(cusparseDcsrgeam(cusparseHandle, m, n, reinterpret_cast<const double*>(&alpha), descrA, nnzA, reinterpret_cast<const double*>(a.Data()), a.RowLocation(), a.ColLocation(),
                                        reinterpret_cast<const double*>(&beta), descrB, nnzB, reinterpret_cast<const double*>(b.Data()), b.RowLocation(), b.ColLocation(), descrC, reinterpret_cast<double*>(c.Data()), c.RowLocation(), c.ColLocation()));
     }
-    cusparseDestroy(cusparseHandle);
 }
 
 template <class ElemType>
@@ -1838,7 +1957,7 @@ ElemType GPUSparseMatrix<ElemType>::InnerProductOfMatrices(const GPUSparseMatrix
         cscRowIndA = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), nnz);
         cscColPtrA = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), (n + 1));
 
-        CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+        cusparseHandle = GetCusparseHandle(a.GetComputeDeviceId());
         SyncGuard syncGuard;
         if (sizeof(ElemType) == sizeof(float))
         {
@@ -1888,7 +2007,6 @@ ElemType GPUSparseMatrix<ElemType>::InnerProductOfMatrices(const GPUSparseMatrix
     }
     TracingGPUMemoryAllocator::Free<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), vectArray);
     TracingGPUMemoryAllocator::Free<ElemType>(a.GetComputeDeviceId(), cscValA);
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
     return res;
 }
 
@@ -2099,8 +2217,7 @@ GPUSparseMatrix<ElemType> GPUSparseMatrix<ElemType>::Transpose() const
     GPUSparseMatrix c(GetComputeDeviceId(), GetFormat());
     c.RequireSizeAndAllocate(n, m, nnz, GetFormat(), true, false);
 
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle();
 
     SyncGuard syncGuard;
     if (GetFormat() == MatrixFormat::matrixFormatSparseCSR)
@@ -2147,7 +2264,6 @@ GPUSparseMatrix<ElemType> GPUSparseMatrix<ElemType>::Transpose() const
     {
         NOT_IMPLEMENTED;
     }
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
     return c;
 }
 
@@ -2209,15 +2325,13 @@ void GPUSparseMatrix<ElemType>::AssignColumnSliceToDense(GPUMatrix<ElemType>& sl
         NOT_IMPLEMENTED;
 
     PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle();
     cusparseMatDescr_t descr = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descr));
     cusparseSetMatType(descr, CUSPARSE_MATRIX_TYPE_GENERAL);
     cusparseSetMatIndexBase(descr, CUSPARSE_INDEX_BASE_ZERO);
 
     SyncGuard syncGuard;
-    CUSPARSE_CALL(cusparseSetStream(cusparseHandle, t_stream));
     if (sizeof(ElemType) == sizeof(float))
     {
         CUSPARSE_CALL(cusparseScsc2dense(cusparseHandle, m, numCols, descr, (float*) Buffer(), RowLocation(), ColLocation() + startColumn, (float*) slice.Data(), m));
@@ -2227,7 +2341,6 @@ void GPUSparseMatrix<ElemType>::AssignColumnSliceToDense(GPUMatrix<ElemType>& sl
         CUSPARSE_CALL(cusparseDcsc2dense(cusparseHandle, m, numCols, descr, (double*) Buffer(), RowLocation(), ColLocation() + startColumn, (double*) slice.Data(), m));
     }
 
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
 
 }
 template <class ElemType>
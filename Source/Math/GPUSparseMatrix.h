@@ -404,6 +404,8 @@ public:
     static void MultiplyAndAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA, const GPUSparseMatrix<ElemType>& rhs,
                                const bool transposeB, GPUSparseMatrix<ElemType>& c);
     static void ScaleAndAdd(const ElemType alpha, const GPUSparseMatrix<ElemType>& lhs, GPUMatrix<ElemType>& c);
+    // rhs += alpha * lhs on the blocks of the block-sparse rhs only
+    static void ScaleAndAddOnBlocks(const ElemType alpha, const GPUMatrix<ElemType>& lhs, GPUSparseMatrix<ElemType>& rhs);
     static void ConvolveAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA, const GPUSparseMatrix<ElemType>& rhs,
                                        const bool transposeB, ElemType beta, GPUMatrix<ElemType>& c, size_t numChannels, size_t horizontalSubsample, bool padding, bool channelwise);
     static void TensorShuffleScaleAndAdd(ElemType keepWeight, const GPUSparseMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const GPUSparseMatrix<ElemType>& b, GPUSparseMatrix<ElemType>& c);
@@ -456,6 +458,8 @@ private:
     DEVICEID_TYPE PrepareDevice(const DEVICEID_TYPE deviceId = -1) const;
     size_t IdentifyRowsWithValues() const;
 
+    static void DenseMultSparseCSCAndWeightedAddToDense(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA,
+                                                        const GPUSparseMatrix<ElemType>& rhs, ElemType beta, GPUMatrix<ElemType>& c);
 };
 
 }}}
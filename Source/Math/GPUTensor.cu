@@ -19,6 +19,8 @@
 #include <cuda_runtime.h>
 #include "cublas_v2.h"
 #include <assert.h>
+#include <map>
+#include <mutex>
 
 #ifndef let
 #define let const auto
@@ -34,8 +36,10 @@
 #ifdef _WIN32
 // thread local storage to access the current stream, initalize to default stream
 __declspec(thread)
-#endif
 extern cudaStream_t t_stream;
+#else
+extern __thread cudaStream_t t_stream;
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -417,6 +421,20 @@ struct TensorOpElement<ElemType, N, M, K, /*parallelReduce=*/false, /*k=*/-1>
 
 #undef ALLOW_ATOMIC_REDUCTION // undefine to disable use of atomicAdd() below, for testing it
 
+static const CUDA_LONG c_warpSize = 32; // on all GPUs we support (Kepler and newer)
+
+// sum over the threads of a warp by shuffles; the result is valid in lane 0 (the other lanes hold partial sums)
+template <class ElemType>
+static __device__ __forceinline__ ElemType WarpReduceSum(ElemType sum)
+{
+#ifdef __CUDA_ARCH__
+    const int lane = threadIdx.x % c_warpSize;
+    for (int offset = c_warpSize / 2; offset > 0; offset /= 2)
+        sum += cub::ShuffleIndex(sum, lane + offset); // lanes >= offset read garbage, which lane 0 never picks up
+#endif
+    return sum;
+}
+
 // specialization for k = -1 terminates the template recursion, and computes reductions in parallel
 template <class ElemType, C_size_t N, C_int M, C_int K>
 struct TensorOpElement<ElemType, N, M, K, /*parallelReduce=*/true, /*k=*/-1>
@@ -449,24 +467,24 @@ struct TensorOpElement<ElemType, N, M, K, /*parallelReduce=*/true, /*k=*/-1>
             sum += val;
         }
 
-        // reduce    --cf https://docs.nvidia.com/cuda/samples/6_Advanced/reduction/doc/reduction.pdf
-        __shared__ ReduceElemType volatile accumulators[GridDim::maxThreadsPerBlock /*tids*/];
-        accumulators[tid] = sum;
+        // reduce    --within each warp by shuffles, then the sums of the warps by the first warp
+        // The launch makes tids a multiple of the warp size, so that all lanes of all warps take part in the shuffles.
+        static_assert(GridDim::maxThreadsPerBlock <= c_warpSize * c_warpSize, "GridDim::maxThreadsPerBlock too large for a two-level warp reduction");
+        __shared__ ReduceElemType warpSums[GridDim::maxThreadsPerBlock / c_warpSize];
+        sum = WarpReduceSum(sum);
+        if (tid % c_warpSize == 0)
+            warpSums[tid / c_warpSize] = sum;
         __syncthreads();
-        static_assert(GridDim::maxThreadsPerBlock <= 512, "GridDim::maxThreadsPerBlock too large, need to add manually unrolled steps");
-        for (CUDA_LONG i = 256; i; i >>= 1)
+        if (tid < c_warpSize)
         {
-            if (tid < i && tid + i < tids)
-                accumulators[tid] += accumulators[tid + i];
-            if (0 + i < tids)
-                __syncthreads(); // sync if condition true for at least one thread
-            // TODO: use volatile* and then we can skip the __syncthreads() for the last 32 values. See Amit's allreduce() function implementation in MatrixQuantizer_kernel.cu.
+            sum = tid < tids / c_warpSize ? warpSums[tid] : 0;
+            sum = WarpReduceSum(sum);
         }
 
         // now set final value to output coordinate
         if (tid == 0)
         {
-            ElemType val = (ElemType) accumulators[0];
+            ElemType val = (ElemType) sum;
             // scale
             val *= alpha;
             // combine with previous value in target matrix, then write it out
@@ -561,23 +579,25 @@ static shared_ptr<ElemType> AllocateReductionBuffer(size_t N)
 template <class ElemType>
 static shared_ptr<ElemType> GetReductionBuffer(size_t N)
 {
-    bool dontCache = false;         // (for debugging only)
-    if (t_stream != 0 || dontCache) // we cache for the NULL stream but don't bother for others, since we only ever use the NULL stream currently
+    bool dontCache = false; // (for debugging only)
+    if (dontCache)
         return AllocateReductionBuffer<ElemType>(N);
 
-    static shared_ptr<ElemType> reductionBuffersCache[32]; // cache of objects    --TODO: Do we have a #define the the max somewhere? Then also use it in CPUMatrix.cu GetOnesTensor()
-    static size_t reductionBuffersCacheSize[_countof(reductionBuffersCache)] = { 0 };
+    // one buffer per device and stream, since kernels on different streams may run concurrently
+    // (cudaMalloc() and cudaFree() would also synchronize the device, defeating the purpose of the streams)
+    static std::map<std::pair<int, cudaStream_t>, std::pair<shared_ptr<ElemType>, size_t>> reductionBuffersCache; // [(device, stream)] -> (buffer, size)
+    static std::mutex reductionBuffersCacheMutex;
     let deviceId = GridDim::GetCurrentDeviceId();
-    if (deviceId >= _countof(reductionBuffersCache)) // index check w.r.t. our hard-coded dimensions
-        return AllocateReductionBuffer<ElemType>(N); // out of bounds: don't cache
-    if (!reductionBuffersCache[deviceId])
+    std::lock_guard<std::mutex> lock(reductionBuffersCacheMutex);
+    auto& entry = reductionBuffersCache[std::make_pair(deviceId, t_stream)];
+    if (!entry.first)
     {
-        reductionBuffersCache[deviceId] = AllocateReductionBuffer<ElemType>(N);
-        reductionBuffersCacheSize[deviceId] = N;
+        entry.first = AllocateReductionBuffer<ElemType>(N);
+        entry.second = N;
     }
-    if (N > reductionBuffersCacheSize[deviceId]) // buffer size check
+    if (N > entry.second) // buffer size check
         LogicError("GetReductionBuffer: Must be called with the number of multiprocs, which may not change.");
-    return reductionBuffersCache[deviceId];
+    return entry.first;
 }
 
 // All dimensions (N-ariness, number of input dimensions K and number of reduction dimensions M) are bound to template parameters now.
@@ -621,13 +641,17 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
         reductionDim *= (C_size_t) reducingOpDimVector[k];
     GridDim grid(NN);
     let& props = GridDim::GetDeviceProps();
+    // Reductions to few outputs are split over this many blocks per multiproc, to have enough warps in flight to hide the
+    // memory latency. The partial sums need a buffer of this many values per multiproc.
+    let reductionBlocksPerMultiproc = 4;
+    let reductionBufferSize = props.multiProcessorCount * reductionBlocksPerMultiproc;
     // === simple case: NN large, one thread per output element
     bool disableParallelReduction = false;                       // (for debugging)
     if (reductionDim == 1 ||                                     // no reduction
         grid.m_blocksPerGrid >= props.multiProcessorCount ||     // enough output elements to fill all multiprocs
         reductionDim * numElements <= 2 * props.warpSize ||      // trivial operation not worth the trouble (2* because the more complex one also needs 2 kernel launches)
         disableParallelReduction ||                              // (for debugging)
-        reductionDim * numElements <= props.multiProcessorCount) // recursive call from reduction below
+        reductionDim * numElements <= reductionBufferSize)       // recursive call from reduction below
     {
         // we got enough elements to generate: do one element per thread, and reduction inside
         _launchTensorOp<ElemType, N, M, K><<<grid.m_blocksPerGrid, grid.m_threadsPerBlock, 0, t_stream>>>(
@@ -662,8 +686,9 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
         //          and K * NN = on the order of NN, but generally a bit larger due to rounding.
 
         // By how much do we underutilize?
-        // We increase #blocks by that factor by breaking reduction into that many chunks.
-        let numReductionChunks = max(props.multiProcessorCount / NN, 1); // only >1 for NN < multiProcessorCount
+        // We increase #blocks by that factor by breaking reduction into that many chunks, but keep at least two elements
+        // per thread in each chunk, as a chunk costs a partial sum and a share of the second pass.
+        let numReductionChunks = max(min(reductionBufferSize / NN, CeilDiv(reductionDim, 2 * GridDim::maxThreadsPerBlock)), 1); // only >1 for NN < reductionBufferSize
 
         // distribute NN over block X and Y
         let blockXOverBy = CeilDiv(NN, props.maxGridSize[0]);
@@ -675,15 +700,15 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
         //  - X, Y: such that X*Y covers NN
         //  - Z: reduction chunks
 
-        // reduction goes into thread dim X
+        // reduction goes into thread dim X, in whole warps for the shuffles
         let reductionChunkSize = CeilDiv(reductionDim, numReductionChunks);
-        let numThreadsX = min(reductionChunkSize, GridDim::maxThreadsPerBlock); // any that's over will be done by looping inside the kernel
+        let numThreadsX = min(CeilDiv(reductionChunkSize, c_warpSize) * c_warpSize, GridDim::maxThreadsPerBlock); // any that's over will be done by looping inside the kernel
 
         // --- cases (a1) and (a2)
         // This involves no reduction across blocks.
         if (numReductionChunks == 1)
         {
-            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(
+            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, 0, t_stream>>>(
                 beta, pointers, alpha, op,
                 regularOpStrides, regularStrides, NN,
                 reducingOpDims, reducingStrides, 0, reductionChunkSize);
@@ -693,16 +718,15 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
 #ifndef ALLOW_ATOMIC_REDUCTION // temporarily disabled to ensure it is not causing the non-reproducability
         else
         {
-            // we get here if NN <= #multiprocs
-            assert(NN <= props.multiProcessorCount && numBlocksX == NN && numBlocksY == 1);
+            // we get here if NN < reductionBufferSize
+            assert(NN < reductionBufferSize && numBlocksX == NN && numBlocksY == 1);
             // dims are:
             //  - numBlocksZ = numReductionChunks = how many multiprocs work together to produce one output element
             //  - numBlocksX = NN = number of output elements
             //  - numThreadsX = reductionChunkSize clipped to 512; reductionChunkSize > 512 is handled by an inner for loop inside of the kernel
 
             // we need memory for block outputs of dimension [numBlocksX x numBlocksZ]
-            //  - total elements = NN * Floor(#multiprocs / NN) = <= #multiprocs
-            let reductionBufferSize = props.multiProcessorCount;
+            //  - total elements <= NN * Floor(reductionBufferSize / NN) <= reductionBufferSize
             assert(reductionBufferSize >= NN * numBlocksZ);
             shared_ptr<ElemType> reductionBuffer = GetReductionBuffer<ElemType>(reductionBufferSize);
 
@@ -720,7 +744,7 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
             FixedMatrix<C_int, N, K> regularStrides1(regularStrideVectors1);
             ElemType beta1  = 0;
             ElemType alpha1 = 1;
-            _launchTensorOpWithReduction<ElemType, N, M, K> << <dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream >> >(
+            _launchTensorOpWithReduction<ElemType, N, M, K> << <dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, 0, t_stream >> >(
                 beta1, pointers1, alpha1, op,
                 regularOpStrides, regularStrides1, NN,
                 reducingOpDims, reducingStrides, /*reductionBegin*/0, reductionChunkSize);
@@ -850,6 +874,92 @@ void LaunchUnaryTensorOp(ElemType beta, const ElemType* pa, ElemType* pb, ElemTy
     }
 }
 
+// -----------------------------------------------------------------------
+// kernel and launch  --tiled copy that moves the contiguous axis
+// -----------------------------------------------------------------------
+
+static const CUDA_LONG c_transposeTileDim = 32; // tile of c_transposeTileDim x c_transposeTileDim elements per block
+static const CUDA_LONG c_transposeTileRows = 8; // each thread moves c_transposeTileDim / c_transposeTileRows elements
+
+// copy one tile of the (i, j) plane, where the output is contiguous along i and the input along j
+// Reads and writes are both coalesced; the tile is transposed in shared memory (padded by one column against bank conflicts).
+// blockIdx.z enumerates the (up to two) remaining dimensions.
+template <class ElemType>
+__global__ void _launchTransposeTensorOp(ElemType beta, const ElemType* pa, ElemType* pb, ElemType alpha,
+                                         CUDA_LONG ni, CUDA_LONG nj, CUDA_LONG inStridei, CUDA_LONG outStridej,
+                                         CUDA_LONG batchDim1, CUDA_LONG inBatchStride1, CUDA_LONG inBatchStride2, CUDA_LONG outBatchStride1, CUDA_LONG outBatchStride2)
+{
+    __shared__ ElemType tile[c_transposeTileDim][c_transposeTileDim + 1];
+
+    CUDA_LONG batch1 = blockIdx.z % batchDim1;
+    CUDA_LONG batch2 = blockIdx.z / batchDim1;
+    pa += batch1 * inBatchStride1 + batch2 * inBatchStride2;
+    pb += batch1 * outBatchStride1 + batch2 * outBatchStride2;
+
+    CUDA_LONG i0 = blockIdx.x * c_transposeTileDim;
+    CUDA_LONG j0 = blockIdx.y * c_transposeTileDim;
+
+    // read along j
+    CUDA_LONG j = j0 + threadIdx.x;
+    for (CUDA_LONG k = threadIdx.y; k < c_transposeTileDim; k += c_transposeTileRows)
+    {
+        CUDA_LONG i = i0 + k;
+        if (i < ni && j < nj)
+            tile[k][threadIdx.x] = pa[i * inStridei + j];
+    }
+    __syncthreads();
+
+    // write along i
+    CUDA_LONG i = i0 + threadIdx.x;
+    for (CUDA_LONG k = threadIdx.y; k < c_transposeTileDim; k += c_transposeTileRows)
+    {
+        j = j0 + k;
+        if (i < ni && j < nj)
+        {
+            ElemType* pout = pb + i + j * outStridej;
+            ElemType val = alpha * tile[threadIdx.x][k];
+            if (beta != 0)
+                val += beta * *pout;
+            *pout = val;
+        }
+    }
+}
+
+// copy in tiles if the layout calls for it (see GetTensorTransposeLayout()); returns false otherwise
+template <class ElemType, C_size_t N>
+static bool LaunchTransposeTensorOp(ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha,
+                                    const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides)
+{
+    size_t outInnerDim, inInnerDim;
+    if (N != 2 || !GetTensorTransposeLayout(regularOpDims, regularStrides[0], regularStrides[N - 1], c_transposeTileDim / 2, outInnerDim, inInnerDim))
+        return false;
+
+    // the remaining dimensions are enumerated by blockIdx.z
+    CUDA_LONG batchDims[2] = {1, 1};
+    CUDA_LONG inBatchStrides[2] = {0, 0};
+    CUDA_LONG outBatchStrides[2] = {0, 0};
+    for (size_t k = 0, b = 0; k < regularOpDims.size(); k++)
+    {
+        if (k == outInnerDim || k == inInnerDim)
+            continue;
+        batchDims[b] = (CUDA_LONG) regularOpDims[k];
+        inBatchStrides[b] = (CUDA_LONG) regularStrides[0][k];
+        outBatchStrides[b] = (CUDA_LONG) regularStrides[N - 1][k];
+        b++;
+    }
+    CUDA_LONG ni = (CUDA_LONG) regularOpDims[outInnerDim];
+    CUDA_LONG nj = (CUDA_LONG) regularOpDims[inInnerDim];
+    dim3 blocksPerGrid((ni + c_transposeTileDim - 1) / c_transposeTileDim, (nj + c_transposeTileDim - 1) / c_transposeTileDim, batchDims[0] * batchDims[1]);
+    if (blocksPerGrid.y > 65535 || blocksPerGrid.z > 65535) // grid limits; leave these to the generic kernel
+        return false;
+
+    SyncGuard syncGuard;
+    _launchTransposeTensorOp<ElemType><<<blocksPerGrid, dim3(c_transposeTileDim, c_transposeTileRows), 0, t_stream>>>(
+        beta, pointers[0], pointers[N - 1], alpha, ni, nj, (CUDA_LONG) regularStrides[0][outInnerDim], (CUDA_LONG) regularStrides[N - 1][inInnerDim],
+        batchDims[0], inBatchStrides[0], inBatchStrides[1], outBatchStrides[0], outBatchStrides[1]);
+    return true;
+}
+
 // -----------------------------------------------------------------------
 // map runtime parameters N to template parameters
 // -----------------------------------------------------------------------
@@ -884,6 +994,9 @@ void TensorOpN(ElemType beta, array<ElemType*, N> pointers, ElemType alpha, Elem
 {
     for (C_size_t i = 0; i < N; i++) // N = a small constant, this will be unrolled
         pointers[i] += offsets[i];
+    // copies that move the contiguous axis (e.g. TransposeDimensions) go through shared-memory tiles
+    if (op == ElementWiseOperator::opCopy && reducingOpDims.empty() && LaunchTransposeTensorOp(beta, pointers, alpha, regularOpDims, regularStrides))
+        return;
     size_t dims = regularOpDims.size();
     switch (dims)
     {
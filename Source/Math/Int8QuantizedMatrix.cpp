@@ -0,0 +1,157 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Int8QuantizedMatrix.cpp -- int8 weights for inference-only matrix products on the CPU (see Int8QuantizedMatrix.h)
+//
+
+#include "stdafx.h"
+#include "Int8QuantizedMatrix.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// products are accumulated in int32, which limits the length of the dot products
+static const size_t MaxInt8DotProductLength = INT_MAX / (127 * 127);
+
+// tile of the output that is computed by one thread, so that the rows of A and the columns of B it reads stay in cache
+static const size_t TileRows = 16;
+static const size_t TileCols = 64;
+
+template <class ElemType>
+static void VerifyCPUDense(const char* name, const Matrix<ElemType>& m)
+{
+    if (m.GetDeviceId() >= 0 || m.GetMatrixType() != MatrixType::DENSE)
+        LogicError("Int8QuantizedMatrix: %s must be a dense CPU matrix.", name);
+}
+
+// the loop is written so that the compiler vectorizes it (widening multiply-add)
+static inline int DotProduct(const signed char* a, const signed char* b, size_t n)
+{
+    int sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += (int)a[i] * (int)b[i];
+    return sum;
+}
+
+template <class ElemType>
+Int8QuantizedMatrix<ElemType>::Int8QuantizedMatrix(size_t calibrationMinibatches)
+    : m_rows(0), m_cols(0), m_calibrationMinibatches(calibrationMinibatches), m_range(0)
+{
+}
+
+// quantizes n values x[i * stride] with the given range, or with their own range if 0
+template <class ElemType>
+/*static*/ void Int8QuantizedMatrix<ElemType>::QuantizeVector(const ElemType* x, size_t n, size_t stride, ElemType range, signed char* res, float& scale)
+{
+    if (range <= 0)
+    {
+        for (size_t i = 0; i < n; i++)
+            range = std::max(range, (ElemType)fabs(x[i * stride]));
+    }
+    scale = (float)range / 127;
+    float invScale = scale > 0 ? 1 / scale : 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        float v = std::round((float)x[i * stride] * invScale);
+        res[i] = (signed char)std::max(-127.0f, std::min(127.0f, v));
+    }
+}
+
+template <class ElemType>
+void Int8QuantizedMatrix<ElemType>::Quantize(const Matrix<ElemType>& a, size_t rows, size_t cols, bool transpose)
+{
+    VerifyCPUDense("weight matrix", a);
+    if (a.GetNumElements() != rows * cols)
+        InvalidArgument("Int8QuantizedMatrix: weight matrix has %d elements, expected %d x %d.", (int)a.GetNumElements(), (int)rows, (int)cols);
+    if (!transpose)
+        Quantize(a.Data(), rows, cols, 1, rows);
+    else
+        Quantize(a.Data(), rows, cols, cols, 1);
+}
+
+template <class ElemType>
+void Int8QuantizedMatrix<ElemType>::Quantize(const ElemType* a, size_t rows, size_t cols, size_t rowStride, size_t colStride)
+{
+    if (cols > MaxInt8DotProductLength)
+        InvalidArgument("Int8QuantizedMatrix: inner dimension %d is too large for int32 accumulation.", (int)cols);
+
+    m_rows = rows;
+    m_cols = cols;
+    m_data.resize(rows * cols);
+    m_scales.resize(rows);
+#pragma omp parallel for
+    for (int64_t r = 0; r < (int64_t)rows; r++)
+        QuantizeVector(a + r * rowStride, cols, colStride, 0, m_data.data() + r * cols, m_scales[r]);
+}
+
+template <class ElemType>
+void Int8QuantizedMatrix<ElemType>::Calibrate(const Matrix<ElemType>& b)
+{
+    VerifyCPUDense("input", b);
+    Calibrate(b.Data(), b.GetNumElements());
+}
+
+template <class ElemType>
+void Int8QuantizedMatrix<ElemType>::Calibrate(const ElemType* b, size_t numElements)
+{
+    if (!IsCalibrating())
+        LogicError("Int8QuantizedMatrix: Calibrate() called after calibration has finished.");
+    for (size_t i = 0; i < numElements; i++)
+        m_range = std::max(m_range, (ElemType)fabs(b[i]));
+    m_calibrationMinibatches--;
+}
+
+template <class ElemType>
+void Int8QuantizedMatrix<ElemType>::Multiply(const Matrix<ElemType>& b, Matrix<ElemType>& c) const
+{
+    VerifyCPUDense("input", b);
+    VerifyCPUDense("output", c);
+    if (b.GetNumRows() != m_cols || c.GetNumRows() != m_rows || c.GetNumCols() != b.GetNumCols())
+        InvalidArgument("Int8QuantizedMatrix: cannot multiply [%d x %d] weights with [%d x %d] input into [%d x %d] output.",
+                        (int)m_rows, (int)m_cols, (int)b.GetNumRows(), (int)b.GetNumCols(), (int)c.GetNumRows(), (int)c.GetNumCols());
+    Multiply(b.Data(), b.GetNumRows(), b.GetNumCols(), c.Data(), 1, c.GetNumRows());
+}
+
+template <class ElemType>
+void Int8QuantizedMatrix<ElemType>::Multiply(const ElemType* b, size_t ldb, size_t numCols, ElemType* c, size_t cRowStride, size_t cColStride) const
+{
+    if (!IsQuantized())
+        LogicError("Int8QuantizedMatrix: Multiply() called before Quantize().");
+    if (IsCalibrating())
+        LogicError("Int8QuantizedMatrix: Multiply() called during calibration.");
+
+    // Quantize the columns of B.
+    std::vector<signed char> bq(m_cols * numCols);
+    std::vector<float> bScales(numCols);
+#pragma omp parallel for
+    for (int64_t n = 0; n < (int64_t)numCols; n++)
+        QuantizeVector(b + n * ldb, m_cols, 1, m_range, bq.data() + n * m_cols, bScales[n]);
+
+    size_t rowTiles = (m_rows + TileRows - 1) / TileRows;
+    size_t colTiles = (numCols + TileCols - 1) / TileCols;
+#pragma omp parallel for
+    for (int64_t tile = 0; tile < (int64_t)(rowTiles * colTiles); tile++)
+    {
+        size_t rowBegin = (tile % rowTiles) * TileRows;
+        size_t rowEnd = std::min(m_rows, rowBegin + TileRows);
+        size_t colBegin = (tile / rowTiles) * TileCols;
+        size_t colEnd = std::min(numCols, colBegin + TileCols);
+        for (size_t n = colBegin; n < colEnd; n++)
+        {
+            const signed char* bCol = bq.data() + n * m_cols;
+            for (size_t r = rowBegin; r < rowEnd; r++)
+            {
+                int sum = DotProduct(m_data.data() + r * m_cols, bCol, m_cols);
+                c[r * cRowStride + n * cColStride] = (ElemType)(sum * m_scales[r] * bScales[n]);
+            }
+        }
+    }
+}
+
+template class Int8QuantizedMatrix<float>;
+template class Int8QuantizedMatrix<double>;
+
+}}}
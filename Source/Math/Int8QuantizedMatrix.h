@@ -0,0 +1,66 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Int8QuantizedMatrix.h -- int8 weights for inference-only matrix products on the CPU
+//
+// The weight matrix A [rows x cols] is quantized once, symmetrically per row (i.e. per output channel):
+//     A(r, k) ~= scale[r] * Aq(r, k),  scale[r] = max_k |A(r, k)| / 127.
+// The right operand B is quantized on the fly per column, either with the column's own range or with a fixed
+// range determined by calibration (values outside of it are clipped). Products are accumulated in int32.
+// Weights are not tracked after Quantize(), so this is only valid as long as they do not change (i.e. not during training).
+//
+
+#pragma once
+
+#include "Matrix.h"
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#pragma warning(push)
+#pragma warning(disable : 4251) // std::vector members of an exported class
+
+template <class ElemType>
+class MATH_API Int8QuantizedMatrix
+{
+public:
+    // The range of B is taken as the maximum over the first 'calibrationMinibatches' minibatches passed to Calibrate().
+    // If 0, every column of B is quantized with its own range.
+    Int8QuantizedMatrix(size_t calibrationMinibatches = 0);
+
+    // Quantizes the [rows x cols] matrix stored column-major in 'a' (any shape with rows * cols elements), or its transpose.
+    void Quantize(const Matrix<ElemType>& a, size_t rows, size_t cols, bool transpose);
+    // Same for raw data: element (r, k) is at a[r * rowStride + k * colStride].
+    void Quantize(const ElemType* a, size_t rows, size_t cols, size_t rowStride, size_t colStride);
+
+    bool IsQuantized() const { return !m_scales.empty(); }
+    size_t GetNumRows() const { return m_rows; }
+    size_t GetNumCols() const { return m_cols; }
+
+    bool IsCalibrating() const { return m_calibrationMinibatches > 0; }
+    // Observes the range of a minibatch of B, computed in full precision by the caller while calibrating.
+    void Calibrate(const Matrix<ElemType>& b);
+    void Calibrate(const ElemType* b, size_t numElements);
+
+    // c = A * b, where b is [cols x N] and c is [rows x N]; all on the CPU.
+    void Multiply(const Matrix<ElemType>& b, Matrix<ElemType>& c) const;
+    // Same for raw data: b(k, n) is at b[k + n * ldb], c(r, n) is written to c[r * cRowStride + n * cColStride].
+    void Multiply(const ElemType* b, size_t ldb, size_t numCols, ElemType* c, size_t cRowStride, size_t cColStride) const;
+
+private:
+    static void QuantizeVector(const ElemType* x, size_t n, size_t stride, ElemType range, signed char* res, float& scale);
+
+private:
+    size_t m_rows;
+    size_t m_cols;
+    std::vector<signed char> m_data; // row-major, so that each output is a dot product of two contiguous vectors
+    std::vector<float> m_scales;     // per row
+
+    size_t m_calibrationMinibatches; // remaining minibatches to observe
+    ElemType m_range;                // calibrated range of B, 0 if not calibrated
+};
+
+#pragma warning(pop)
+
+}}}
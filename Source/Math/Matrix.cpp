@@ -147,6 +147,97 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 MatrixBase::~MatrixBase() { }
 
+#pragma region MatrixTransferStatistics
+
+struct MatrixTransferStatisticsState
+{
+    MatrixTransferCounts m_total;
+    std::map<std::wstring, MatrixTransferCounts> m_perScope;
+    MatrixTransferCheck m_check = MatrixTransferCheck::none;
+    size_t m_numWarnings = 0;
+    std::wstring m_scope;
+
+    static MatrixTransferStatisticsState& GetInstance()
+    {
+        static MatrixTransferStatisticsState instance;
+        return instance;
+    }
+};
+
+// stop reporting ping-pong transfers after this many, the counters show the rest
+static const size_t MaxNumTransferWarnings = 100;
+
+/*static*/ void MatrixTransferStatistics::Reset()
+{
+    auto& state = MatrixTransferStatisticsState::GetInstance();
+    state.m_total = MatrixTransferCounts();
+    state.m_perScope.clear();
+    state.m_numWarnings = 0;
+}
+
+/*static*/ MatrixTransferCounts MatrixTransferStatistics::GetTotal()
+{
+    return MatrixTransferStatisticsState::GetInstance().m_total;
+}
+
+/*static*/ std::map<std::wstring, MatrixTransferCounts> MatrixTransferStatistics::GetPerScope()
+{
+    return MatrixTransferStatisticsState::GetInstance().m_perScope;
+}
+
+/*static*/ void MatrixTransferStatistics::Print(FILE* f)
+{
+    auto& state = MatrixTransferStatisticsState::GetInstance();
+    fprintf(f, "Implicit CPU/GPU matrix transfers: %d, %.3f MB\n", (int) state.m_total.numTransfers, state.m_total.numBytes / 1e6);
+    for (const auto& iter : state.m_perScope)
+        fprintf(f, "\t%ls: %d, %.3f MB\n", iter.first.empty() ? L"(outside of nodes)" : iter.first.c_str(), (int) iter.second.numTransfers, iter.second.numBytes / 1e6);
+}
+
+/*static*/ void MatrixTransferStatistics::SetCheck(MatrixTransferCheck check)
+{
+    MatrixTransferStatisticsState::GetInstance().m_check = check;
+}
+
+/*static*/ MatrixTransferCheck MatrixTransferStatistics::GetCheck()
+{
+    return MatrixTransferStatisticsState::GetInstance().m_check;
+}
+
+/*static*/ const std::wstring& MatrixTransferStatistics::GetScope()
+{
+    return MatrixTransferStatisticsState::GetInstance().m_scope;
+}
+
+/*static*/ void MatrixTransferStatistics::SetScope(const std::wstring& scope)
+{
+    MatrixTransferStatisticsState::GetInstance().m_scope = scope;
+}
+
+/*static*/ void MatrixTransferStatistics::Record(size_t numBytes, bool isPingPong, size_t numRows, size_t numCols, int fromDeviceId, int toDeviceId)
+{
+    auto& state = MatrixTransferStatisticsState::GetInstance();
+    state.m_total.numTransfers++;
+    state.m_total.numBytes += numBytes;
+    auto& counts = state.m_perScope[state.m_scope];
+    counts.numTransfers++;
+    counts.numBytes += numBytes;
+
+    if (!isPingPong || state.m_check == MatrixTransferCheck::none)
+        return;
+    if (state.m_check == MatrixTransferCheck::fail)
+        RuntimeError("Matrix with dim [%lu, %lu] was implicitly transferred from device %d back to device %d in %ls.",
+                     (unsigned long) numRows, (unsigned long) numCols, fromDeviceId, toDeviceId, state.m_scope.empty() ? L"(outside of nodes)" : state.m_scope.c_str());
+    if (state.m_numWarnings < MaxNumTransferWarnings)
+    {
+        fprintf(stderr, "WARNING: Matrix with dim [%lu, %lu] was implicitly transferred from device %d back to device %d in %ls.\n",
+                (unsigned long) numRows, (unsigned long) numCols, fromDeviceId, toDeviceId, state.m_scope.empty() ? L"(outside of nodes)" : state.m_scope.c_str());
+        if (++state.m_numWarnings == MaxNumTransferWarnings)
+            fprintf(stderr, "WARNING: Further implicit matrix transfers will not be reported.\n");
+    }
+}
+
+#pragma endregion MatrixTransferStatistics
+
 #pragma region Constructors, destructors and other static matrix builders
 
 
@@ -177,6 +268,9 @@ void Matrix<ElemType>::Init(DEVICEID_TYPE deviceId)
     m_numTimesDeviceChanged = 0;
     m_numTimesMatrixTypeChanged = 0;
     m_devicesTransferedTo[1]    = m_devicesTransferedTo[0] = CPUDEVICE - 1; // (some value that is different from any valid value)
+    m_numImplicitTransfers = 0;
+    m_numImplicitTransferBytes = 0;
+    m_lastImplicitTransferFromDeviceId = CPUDEVICE - 1;
 }
 
 // shallow-copy all members
@@ -197,6 +291,9 @@ void Matrix<ElemType>::ShallowCopyFrom(const Matrix<ElemType>& other)
     m_numTimesMatrixTypeChanged = other.m_numTimesMatrixTypeChanged;
     m_devicesTransferedTo[0]    = other.m_devicesTransferedTo[0]; // TODO: spelling
     m_devicesTransferedTo[1]    = other.m_devicesTransferedTo[1];
+    m_numImplicitTransfers             = other.m_numImplicitTransfers;
+    m_numImplicitTransferBytes         = other.m_numImplicitTransferBytes;
+    m_lastImplicitTransferFromDeviceId = other.m_lastImplicitTransferFromDeviceId;
 }
 
 // Call this function after an update operation has created/set/updated the respective pointers.
@@ -1073,20 +1170,40 @@ Matrix<ElemType>& Matrix<ElemType>::DoGatherColumnsOf(ElemType beta, const Matri
 // idx has width of 'a' and contains values w.r.t. 'this'
 // Unlike gather, for scatter, 'this' must have been sized already.
 // Invalid entries (gap columns) are denoted by idx(0,j) == -1.
+// Pass idxIsUnique if no target column appears twice in idx, which allows to add into the targets without atomic operations.
 template <class ElemType>
-Matrix<ElemType>& Matrix<ElemType>::DoScatterColumnsOf(ElemType beta, const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha)
+Matrix<ElemType>& Matrix<ElemType>::DoScatterColumnsOf(ElemType beta, const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha, bool idxIsUnique)
 {
     DecideAndMoveToRightDevice(*this, idx, a); // TODO: only move target if beta != 0
 
     DISPATCH_MATRIX_ON_FLAG(&a, this,
-        { m_CPUMatrix->DoScatterColumnsOf(beta, *idx.m_CPUMatrix, *a.m_CPUMatrix, alpha); },
-        { m_GPUMatrix->DoScatterColumnsOf(beta, *idx.m_GPUMatrix, *a.m_GPUMatrix, alpha); },
+        { m_CPUMatrix->DoScatterColumnsOf(beta, *idx.m_CPUMatrix, *a.m_CPUMatrix, alpha, idxIsUnique); },
+        { m_GPUMatrix->DoScatterColumnsOf(beta, *idx.m_GPUMatrix, *a.m_GPUMatrix, alpha, idxIsUnique); },
         { NOT_IMPLEMENTED; },
         { NOT_IMPLEMENTED; });
 
     return *this;
 }
 
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignPackedIndicesOf(const Matrix<ElemType>& index, const Matrix<ElemType>& sequenceMap, size_t numParallelSequences)
+{
+    DecideAndMoveToRightDevice(index, sequenceMap, *this);
+    if (index.GetMatrixType() != DENSE || sequenceMap.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    SwitchToMatrixType(DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&index,
+                            this,
+                            m_CPUMatrix->AssignPackedIndicesOf(*index.m_CPUMatrix, *sequenceMap.m_CPUMatrix, numParallelSequences),
+                            m_GPUMatrix->AssignPackedIndicesOf(*index.m_GPUMatrix, *sequenceMap.m_GPUMatrix, numParallelSequences),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
 // set all elements of a matrix to a scalar value
 // For sparse matrices, the only allowed value is 0.
 template <class ElemType>
@@ -1233,7 +1350,7 @@ void Matrix<ElemType>::AssignValuesOf(const Matrix<ElemType>& deepCopyFrom)
             // Set GPUMatrix from:
             DISPATCH_MATRIX_ON_FLAG(&deepCopyFrom, nullptr,
                 { m_GPUMatrix->SetValue(deepCopyFrom.GetNumRows(), deepCopyFrom.GetNumCols(), this->GetDeviceId(), deepCopyFrom.m_CPUMatrix->Data()); },
-                { m_GPUMatrix->SetValue(*deepCopyFrom.m_GPUMatrix); },
+                { if (deepCopyFrom.GetDeviceId() == this->GetDeviceId()) m_GPUMatrix->SetValue(*deepCopyFrom.m_GPUMatrix); else m_GPUMatrix->SetValueFromOtherDevice(*deepCopyFrom.m_GPUMatrix); },
                 { LogicError("AssignValuesOf: Assigning a CPUSparseMatrix to a GPUMatrix is not yet implemented."); },//{ m_GPUMatrix->SetValue(*deepCopyFrom.m_CPUSparseMatrix); },
                 { LogicError("AssignValuesOf: Assigning a GPUSparseMatrix to a GPUMatrix is not yet implemented."); });//{ m_GPUMatrix->SetValue(*deepCopyFrom.m_GPUSparseMatrix); });
         },
@@ -1270,6 +1387,28 @@ void Matrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, int
                             NOT_IMPLEMENTED);
 }
 
+template <class ElemType>
+void Matrix<ElemType>::SetValueFromCompact(const size_t numRows, const size_t numCols, const void* data, CompactElementType type, ElemType scale, const Matrix<ElemType>* offset, const size_t matrixFlags)
+{
+    if (((numRows * numCols) > 0) && (data == nullptr))
+        InvalidArgument("Invalid data.");
+    if (offset)
+    {
+        offset->_transferToDevice(GetDeviceId(), /*isBeingMoved=*/false);
+        if (offset->GetMatrixType() != DENSE)
+            NOT_IMPLEMENTED;
+    }
+
+    SwitchToMatrixType(DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->SetValueFromCompact(numRows, numCols, data, type, scale, offset ? offset->m_CPUMatrix.get() : nullptr),
+                            m_GPUMatrix->SetValueFromCompact(numRows, numCols, data, type, scale, offset ? offset->m_GPUMatrix.get() : nullptr, matrixFlags),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 template <class ElemType>
 void Matrix<ElemType>::SetValue(const size_t rIdx, const size_t cIdx, ElemType val)
 {
@@ -1303,6 +1442,41 @@ void Matrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYPE* h_CSCC
         { m_GPUSparseMatrix->SetMatrixFromCSCFormat(h_CSCCol, h_Row, h_Val, nz, numRows, numCols); });
 }
 
+template <class ElemType>
+void Matrix<ElemType>::GetSparseBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& values) const
+{
+    if (GetMatrixType() != MatrixType::SPARSE || GetFormat() != matrixFormatSparseBlockCol)
+        LogicError("GetSparseBlockColumns: Requires a block-sparse (BlockCol) matrix.");
+
+    DISPATCH_MATRIX_ON_FLAG(this, nullptr,
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        { m_CPUSparseMatrix->GetBlockColumns(columnIds, values); },
+        {
+            CPUSparseMatrix<ElemType> cpuCopy(matrixFormatSparseBlockCol);
+            m_GPUSparseMatrix->CopyToCPUSparseMatrix(cpuCopy);
+            cpuCopy.GetBlockColumns(columnIds, values);
+        });
+}
+
+template <class ElemType>
+void Matrix<ElemType>::SetSparseBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& values)
+{
+    if (GetMatrixType() != MatrixType::SPARSE || GetFormat() != matrixFormatSparseBlockCol)
+        LogicError("SetSparseBlockColumns: Requires a block-sparse (BlockCol) matrix.");
+
+    // on the GPU, the blocks are assembled on the CPU and then copied
+    DISPATCH_MATRIX_ON_FLAG(this, this,
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        { m_CPUSparseMatrix->SetBlockColumns(numRows, numCols, columnIds, values); },
+        {
+            CPUSparseMatrix<ElemType> cpuCopy(matrixFormatSparseBlockCol);
+            cpuCopy.SetBlockColumns(numRows, numCols, columnIds, values);
+            m_GPUSparseMatrix->SetValue(cpuCopy);
+        });
+}
+
 template <class ElemType>
 void Matrix<ElemType>::SetDiagonalValue(const ElemType v)
 {
@@ -1394,6 +1568,37 @@ void Matrix<ElemType>::SetGaussianRandomValue(const ElemType mean, const ElemTyp
                             NOT_IMPLEMENTED);
 }
 
+template <class ElemType>
+void Matrix<ElemType>::SetCounterBasedUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed)
+{
+    if (IsEmpty())
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->SetCounterBasedUniformRandomValue(low, high, seed),
+                            m_GPUMatrix->SetCounterBasedUniformRandomValue(low, high, seed),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::SetCounterBasedGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed)
+{
+    if (sigma <= 0)
+        InvalidArgument("SetCounterBasedGaussianRandomValue: sigma must be a positive value.");
+
+    if (IsEmpty())
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->SetCounterBasedGaussianRandomValue(mean, sigma, seed),
+                            m_GPUMatrix->SetCounterBasedGaussianRandomValue(mean, sigma, seed),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 template <class ElemType>
 void Matrix<ElemType>::AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed)
 {
@@ -1427,6 +1632,41 @@ void Matrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const ElemT
                             NOT_IMPLEMENTED);
 }
 
+template <class ElemType>
+void Matrix<ElemType>::SetCounterBasedUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle)
+{
+    if (IsEmpty())
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->SetCounterBasedUniformRandomMask(maskRate, scaleValue, rngHandle),
+                            m_GPUMatrix->SetCounterBasedUniformRandomMask(maskRate, scaleValue, rngHandle),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignElementProductOfUniformRandomMask(const Matrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue,
+                                                                            const uint64_t seed, const uint64_t firstCounter, const size_t elementOffset, const ElemType beta)
+{
+    if (a.IsEmpty())
+        LogicError("AssignElementProductOfUniformRandomMask: Matrix a is empty.");
+
+    DecideAndMoveToRightDevice(a, *this);
+    if (beta == 0)
+        SwitchToMatrixType(a.GetMatrixType(), a.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->AssignElementProductOfUniformRandomMask(*a.m_CPUMatrix, maskRate, scaleValue, seed, firstCounter, elementOffset, beta),
+                            m_GPUMatrix->AssignElementProductOfUniformRandomMask(*a.m_GPUMatrix, maskRate, scaleValue, seed, firstCounter, elementOffset, beta),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
 template <class ElemType>
 void Matrix<ElemType>::NormalGrad(Matrix<ElemType>& gradients,
                                   Matrix<ElemType>& functionValues,
@@ -1528,6 +1768,68 @@ void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Mat
     // Note: Since both 'this' and gradients are changed, we must call SetDataLocation() on 'this' as well.
 }
 
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::MultiTensorNormalGrad(const std::vector<Matrix<ElemType>*>& smoothedGradients,
+                                                       const std::vector<Matrix<ElemType>*>& gradients,
+                                                       const std::vector<Matrix<ElemType>*>& functionValues,
+                                                       const std::vector<ElemType>& learnRatesPerSample,
+                                                       const ElemType momentum, const bool useNesterovMomentum,
+                                                       const ElemType clippingThreshold, const bool clipByTruncation,
+                                                       const ElemType l2RegWeight, const ElemType l1RegWeight)
+{
+    const size_t numTensors = gradients.size();
+    if (smoothedGradients.size() != numTensors || functionValues.size() != numTensors || learnRatesPerSample.size() != numTensors)
+        InvalidArgument("MultiTensorNormalGrad: The lists of matrices and learning rates must have the same length.");
+    if (numTensors == 0)
+        return;
+
+    int deviceId = gradients[0]->GetDeviceId();
+    for (size_t i = 0; i < numTensors; i++)
+    {
+        DecideAndMoveToRightDevice(*gradients[0], *gradients[i], *smoothedGradients[i], *functionValues[i]);
+        for (const Matrix<ElemType>* matrix : { smoothedGradients[i], gradients[i], functionValues[i] })
+        {
+            if (matrix->GetMatrixType() != MatrixType::DENSE)
+                InvalidArgument("MultiTensorNormalGrad: All matrices must be dense.");
+            if (matrix->GetNumRows() != gradients[i]->GetNumRows() || matrix->GetNumCols() != gradients[i]->GetNumCols())
+                InvalidArgument("MultiTensorNormalGrad: The smoothed gradient, gradient and value of a parameter must have the same dimensions.");
+        }
+    }
+    deviceId = gradients[0]->GetDeviceId();
+
+    if (deviceId == CPUDEVICE)
+    {
+        std::vector<CPUMatrix<ElemType>*> s, g, v;
+        for (size_t i = 0; i < numTensors; i++)
+        {
+            s.push_back(smoothedGradients[i]->m_CPUMatrix.get());
+            g.push_back(gradients[i]->m_CPUMatrix.get());
+            v.push_back(functionValues[i]->m_CPUMatrix.get());
+        }
+        CPUMatrix<ElemType>::MultiTensorNormalGrad(s, g, v, learnRatesPerSample, momentum, useNesterovMomentum, clippingThreshold, clipByTruncation, l2RegWeight, l1RegWeight);
+    }
+    else
+    {
+        std::vector<GPUMatrix<ElemType>*> s, g, v;
+        for (size_t i = 0; i < numTensors; i++)
+        {
+            s.push_back(smoothedGradients[i]->m_GPUMatrix.get());
+            g.push_back(gradients[i]->m_GPUMatrix.get());
+            v.push_back(functionValues[i]->m_GPUMatrix.get());
+        }
+        GPUMatrix<ElemType>::MultiTensorNormalGrad(s, g, v, learnRatesPerSample, momentum, useNesterovMomentum, clippingThreshold, clipByTruncation, l2RegWeight, l1RegWeight);
+    }
+
+    // all three are changed
+    const CurrentDataLocation location = deviceId == CPUDEVICE ? CurrentDataLocation::CPU : CurrentDataLocation::GPU;
+    for (size_t i = 0; i < numTensors; i++)
+    {
+        smoothedGradients[i]->SetDataLocation(location, MatrixType::DENSE);
+        gradients[i]->SetDataLocation(location, MatrixType::DENSE);
+        functionValues[i]->SetDataLocation(location, MatrixType::DENSE);
+    }
+}
+
 template <class ElemType>
 ElemType Matrix<ElemType>::RmsProp(Matrix<ElemType>& gradients,
                                    ElemType RMS_GAMMA,
@@ -2493,6 +2795,27 @@ Matrix<ElemType>& Matrix<ElemType>::AssignNumOfDiff(const Matrix<ElemType>& a, c
 
     return *this;
 }
+
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignNumOfTopKErrors(const Matrix<ElemType>& labels, const Matrix<ElemType>& predictions, int topK, bool classIndexLabels, const Matrix<char>* columnsMask)
+{
+    DecideAndMoveToRightDevice(labels, predictions, *this);
+    if (labels.GetMatrixType() != DENSE || predictions.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+    if (columnsMask && columnsMask->GetDeviceId() != predictions.GetDeviceId() && columnsMask->GetCurrentMatrixLocation() != BOTH)
+        RuntimeError("AssignNumOfTopKErrors: The predictions and the column mask must be on the same device.");
+
+    SwitchToMatrixType(DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->AssignNumOfTopKErrors(*labels.m_CPUMatrix, *predictions.m_CPUMatrix, topK, classIndexLabels, columnsMask ? columnsMask->m_CPUMatrix.get() : nullptr),
+                            m_GPUMatrix->AssignNumOfTopKErrors(*labels.m_GPUMatrix, *predictions.m_GPUMatrix, topK, classIndexLabels, columnsMask ? columnsMask->m_GPUMatrix.get() : nullptr),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
 //[this]=tanh([this]) element wise
 template <class ElemType>
 Matrix<ElemType>& Matrix<ElemType>::InplaceTanh()
@@ -2569,6 +2892,24 @@ Matrix<ElemType>& Matrix<ElemType>::InplaceHardmax(const bool isColWise)
     return *this;
 }
 
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignTopNHardmaxOf(const Matrix<ElemType>& a, const size_t n)
+{
+    if (a.IsEmpty())
+        LogicError("AssignTopNHardmaxOf: Matrix a is empty.");
+    DecideAndMoveToRightDevice(a, *this);
+    SwitchToMatrixType(a.GetMatrixType(), a.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(&a,
+                            this,
+                            m_CPUMatrix->AssignTopNHardmaxOf(*a.m_CPUMatrix, n),
+                            m_GPUMatrix->AssignTopNHardmaxOf(*a.m_GPUMatrix, n),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
 template <class ElemType>
 Matrix<ElemType>& Matrix<ElemType>::AssignHardmaxOf(const Matrix<ElemType>& a, const bool isColWise)
 {
@@ -3024,6 +3365,22 @@ Matrix<ElemType>& Matrix<ElemType>::SetToZeroIfAbsLessThan(const ElemType thresh
     return *this;
 }
 
+template <class ElemType>
+size_t Matrix<ElemType>::ExtractAbsAboveThreshold(const ElemType threshold, size_t capacity, int* indices, ElemType* values)
+{
+    if (IsEmpty())
+        LogicError("ExtractAbsAboveThreshold: Matrix is empty.");
+    if (GetNumElements() > INT_MAX)
+        LogicError("ExtractAbsAboveThreshold: Matrix has too many elements for int indices.");
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            return m_CPUMatrix->ExtractAbsAboveThreshold(threshold, capacity, indices, values),
+                            return m_GPUMatrix->ExtractAbsAboveThreshold(threshold, capacity, indices, values),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 //sum of all elements
 template <class ElemType>
 ElemType Matrix<ElemType>::SumOfElements() const
@@ -3387,6 +3744,51 @@ Matrix<ElemType>& Matrix<ElemType>::AssignSignOf(const Matrix<ElemType>& a)
     return *this;
 }
 
+// compresses the columns of 'a' into *this, see Matrix.h
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignCompressedOf(const Matrix<ElemType>& a, CompactElementType type)
+{
+    if (a.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+    if (this == &a)
+        LogicError("AssignCompressedOf: The compressed matrix cannot be the source matrix.");
+
+    DecideAndMoveToRightDevice(a, *this);
+    SwitchToMatrixType(DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&a,
+                            this,
+                            m_CPUMatrix->AssignCompressedOf(*a.m_CPUMatrix, type),
+                            m_GPUMatrix->AssignCompressedOf(*a.m_GPUMatrix, type),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignDecompressedOf(const Matrix<ElemType>& compressed, size_t numRows, CompactElementType type)
+{
+    if (compressed.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+    if (this == &compressed)
+        LogicError("AssignDecompressedOf: The decompressed matrix cannot be the compressed matrix.");
+    if (compressed.GetNumRows() != GetCompressedNumRows<ElemType>(numRows, type))
+        InvalidArgument("AssignDecompressedOf: A matrix of %d rows cannot be restored from compressed columns of %d rows.", (int) numRows, (int) compressed.GetNumRows());
+
+    DecideAndMoveToRightDevice(compressed, *this);
+    SwitchToMatrixType(DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&compressed,
+                            this,
+                            m_CPUMatrix->AssignDecompressedOf(*compressed.m_CPUMatrix, numRows, type),
+                            m_GPUMatrix->AssignDecompressedOf(*compressed.m_GPUMatrix, numRows, type),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
 template <class ElemType>
 Matrix<ElemType>& Matrix<ElemType>::AddSignOf(const Matrix<ElemType>& a)
 {
@@ -3578,9 +3980,20 @@ void Matrix<ElemType>::_transferToDevice(int to_id, bool isBeingMoved /*= true*/
         RuntimeError("Cannot move externally owned matrices to the preferred device.");
 }
 
+template <class ElemType>
+void Matrix<ElemType>::RecordImplicitTransfer(int from_id, int to_id) const
+{
+    size_t numBytes = m_matrixType == MatrixType::SPARSE ? BufferSize() : GetNumElements() * sizeof(ElemType);
+    bool isPingPong = (to_id == m_lastImplicitTransferFromDeviceId);
+    m_numImplicitTransfers++;
+    m_numImplicitTransferBytes += numBytes;
+    m_lastImplicitTransferFromDeviceId = from_id;
+    MatrixTransferStatistics::Record(numBytes, isPingPong, GetNumRows(), GetNumCols(), from_id, to_id);
+}
+
 // this function performs data transfer and updates data location, but not the device that is stored with it
 template <class ElemType>
-void Matrix<ElemType>::_transferFromDeviceToDevice(int from_id, int to_id, bool isBeingMoved /*= true*/, bool emptyTransfer /* = false*/) const
+void Matrix<ElemType>::_transferFromDeviceToDevice(int from_id, int to_id, bool isBeingMoved /*= true*/, bool emptyTransfer /* = false*/, bool isImplicit /*= true*/) const
 {
     if (from_id < 0)
         from_id = CPUDEVICE;
@@ -3595,6 +4008,23 @@ void Matrix<ElemType>::_transferFromDeviceToDevice(int from_id, int to_id, bool
         return;
     }
 
+    // If the data is current on both the GPU and the CPU, going to the CPU needs no copy. It only drops the GPU copy if the matrix is being moved.
+    if (m_currentDataLocation == CurrentDataLocation::BOTH && to_id == CPUDEVICE && !emptyTransfer &&
+        ((m_matrixType == MatrixType::DENSE && m_CPUMatrix && m_GPUMatrix && m_CPUMatrix->GetNumElements() == m_GPUMatrix->GetNumElements()) ||
+         (m_matrixType == MatrixType::SPARSE && m_CPUSparseMatrix && m_GPUSparseMatrix)))
+    {
+        if (isBeingMoved)
+        {
+            SetDataLocation(CPU, m_matrixType);
+            m_GPUMatrix = nullptr;
+            m_GPUSparseMatrix = nullptr;
+        }
+        return;
+    }
+
+    if (isImplicit && !emptyTransfer)
+        RecordImplicitTransfer(from_id, to_id);
+
     // warn about device change
 #define NUM_DEVICE_CHANGED_WARN 20
     if (m_numTimesDeviceChanged <= NUM_DEVICE_CHANGED_WARN &&
@@ -3747,7 +4177,7 @@ void Matrix<ElemType>::_transferFromDeviceToDevice(int from_id, int to_id, bool
 template <class ElemType>
 void Matrix<ElemType>::TransferFromDeviceToDevice(int from_id, int to_id, bool isBeingMoved, bool emptyTransfer/* = false*/, bool updatePreferredDevice/* = true*/) const
 {
-    _transferFromDeviceToDevice(from_id, to_id, isBeingMoved, emptyTransfer);
+    _transferFromDeviceToDevice(from_id, to_id, isBeingMoved, emptyTransfer, false /*isImplicit*/);
     if (updatePreferredDevice)
         m_preferredDeviceId = GetDeviceId();
 }
@@ -4356,8 +4786,15 @@ void Matrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemT
     if (c.GetDeviceId() < 0) // CPU
     {
         if (a.GetMatrixType() == MatrixType::SPARSE)
-            NOT_IMPLEMENTED;
-        if (b.GetMatrixType() == MatrixType::SPARSE)
+        {
+            // sparse x dense, e.g. pruned weights
+            if (b.GetMatrixType() == MatrixType::SPARSE)
+                NOT_IMPLEMENTED;
+            c.SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+            CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(alpha, *a.m_CPUSparseMatrix, transposeA, *b.m_CPUMatrix, transposeB, beta, *c.m_CPUMatrix);
+            c.SetDataLocation(CPU, DENSE);
+        }
+        else if (b.GetMatrixType() == MatrixType::SPARSE)
         {
             if (c.GetMatrixType() == MatrixType::DENSE)
             {
@@ -4366,6 +4803,9 @@ void Matrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemT
             }
             else if (c.GetMatrixType() == MatrixType::SPARSE)
             {
+                // block-sparse result, e.g. the gradient of an embedding; accumulates into the blocks c has unless beta == 0
+                if (beta == 0)
+                    c.m_CPUSparseMatrix->Reset();
                 CPUSparseMatrix<ElemType>::MultiplyAndAdd(alpha, *a.m_CPUMatrix, transposeA, *b.m_CPUSparseMatrix, transposeB, *c.m_CPUSparseMatrix);
                 c.SetDataLocation(CPU, SPARSE);
             }
@@ -4470,6 +4910,83 @@ template <class ElemType>
                             NOT_IMPLEMENTED);
 }
 
+/// <summary>Fused affine layer with activation: c = activation(a * b + bias)</summary>
+/// Compared to a product followed by a bias addition and an activation, this saves two passes over c and their temporaries.
+/// <param name="a">Input matrix, usually the weights</param>
+/// <param name="b">Input matrix</param>
+/// <param name="bias">Column vector that is added to each column of the product</param>
+/// <param name="activation">opSigmoid, opTanh, or opLinearRectifier</param>
+/// <param name="c">Resulting matrix</param>
+template <class ElemType>
+void Matrix<ElemType>::AffineAndActivation(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& bias, ElementWiseOperator activation, Matrix<ElemType>& c)
+{
+    if (activation != opSigmoid && activation != opTanh && activation != opLinearRectifier)
+        InvalidArgument("AffineAndActivation: Unsupported activation function.");
+    if (bias.GetNumElements() != a.GetNumRows())
+        InvalidArgument("AffineAndActivation: The bias must be a column vector with one element per row of the product.");
+
+    Multiply(a, b, c);
+    DecideAndMoveToRightDevice(c, bias);
+    if (bias.GetMatrixType() != DENSE || c.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DISPATCH_MATRIX_ON_FLAG(&c,
+                            &c,
+                            c.m_CPUMatrix->InplaceAddColumnAndActivation(*bias.m_CPUMatrix, activation),
+                            c.m_GPUMatrix->InplaceAddColumnAndActivation(*bias.m_GPUMatrix, activation),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+/// <summary>Batched matrix-matrix multiply, one product per column: c_j = alpha * op(a_j) * op(b_j) + beta * c_j</summary>
+/// This replaces a loop of small MultiplyAndWeightedAdd() calls by a single batched GEMM call on the GPU.
+/// <param name="alpha">Scalar</param>
+/// <param name="a">Input matrix, each column (or its only column) holds one [aRows x ?] matrix</param>
+/// <param name="aRows">Number of rows of each matrix in a, before transposition</param>
+/// <param name="transposeA">Whether the matrices a_j are transposed</param>
+/// <param name="b">Input matrix, each column (or its only column) holds one [bRows x ?] matrix</param>
+/// <param name="bRows">Number of rows of each matrix in b, before transposition</param>
+/// <param name="transposeB">Whether the matrices b_j are transposed</param>
+/// <param name="beta">Scalar</param>
+/// <param name="c">Resulting matrix, each column holds one result; resized if beta is 0</param>
+template <class ElemType>
+void Matrix<ElemType>::BatchMatMul(ElemType alpha, const Matrix<ElemType>& a, const size_t aRows, const bool transposeA, const Matrix<ElemType>& b, const size_t bRows, const bool transposeB,
+                                   ElemType beta, Matrix<ElemType>& c)
+{
+    DecideAndMoveToRightDevice(a, b, c);
+
+    if (a.GetMatrixType() != DENSE || b.GetMatrixType() != DENSE || c.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+    if (aRows == 0 || bRows == 0 || a.GetNumRows() % aRows != 0 || b.GetNumRows() % bRows != 0)
+        InvalidArgument("BatchMatMul: The number of rows of a [%d] and b [%d] must be multiples of aRows (%d) and bRows (%d).", (int) a.GetNumRows(), (int) b.GetNumRows(), (int) aRows, (int) bRows);
+
+    size_t batchSize = std::max(a.GetNumCols(), b.GetNumCols());
+    if ((a.GetNumCols() != batchSize && a.GetNumCols() != 1) || (b.GetNumCols() != batchSize && b.GetNumCols() != 1))
+        InvalidArgument("BatchMatMul: a and b must have the same number of columns, or one.");
+    size_t aCols = a.GetNumRows() / aRows;
+    size_t bCols = b.GetNumRows() / bRows;
+    size_t m = transposeA ? aCols : aRows;
+    size_t k = transposeA ? aRows : aCols;
+    size_t l = transposeB ? bCols : bRows;
+    size_t n = transposeB ? bRows : bCols;
+    if (k != l)
+        InvalidArgument("BatchMatMul: The inner dimensions of a [%d x %d] and b [%d x %d] must match.", (int) m, (int) k, (int) l, (int) n);
+
+    if (beta == 0)
+        c.Resize(m * n, batchSize);
+    else
+        c.VerifySize(m * n, batchSize);
+    if (batchSize == 0)
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(&c,
+                            nullptr,
+                            CPUMatrix<ElemType>::BatchMatMul(alpha, *a.m_CPUMatrix, aRows, transposeA, *b.m_CPUMatrix, bRows, transposeB, beta, *c.m_CPUMatrix),
+                            GPUMatrix<ElemType>::BatchMatMul(alpha, *a.m_GPUMatrix, aRows, transposeA, *b.m_GPUMatrix, bRows, transposeB, beta, *c.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 /// <summary>Matrix-matrix multiply with col-major matrices (a and b may be transposed): c =  op(a) * op(b) + c</summary>
 /// <param name="a">Input matrix</param>
 /// <param name="transposeA">Whether matrix a is transposed</param>
@@ -4576,6 +5093,23 @@ template <class ElemType>
     }
 }
 
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::ScaleAndAddOnSparseBlocks(ElemType alpha, const Matrix<ElemType>& a, Matrix<ElemType>& c)
+{
+    if (a.GetMatrixType() != MatrixType::DENSE || c.GetMatrixType() != MatrixType::SPARSE)
+        LogicError("ScaleAndAddOnSparseBlocks: Requires a dense a and a sparse c.");
+    if (a.IsEmpty() || c.IsEmpty())
+        LogicError("ScaleAndAddOnSparseBlocks:  one of the input matrices is empty.");
+
+    DecideAndMoveToRightDevice(c, a);
+
+    DISPATCH_MATRIX_ON_FLAG(&c, &c,
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        { CPUSparseMatrix<ElemType>::ScaleAndAddOnBlocks(alpha, *a.m_CPUMatrix, *c.m_CPUSparseMatrix); },
+        { GPUSparseMatrix<ElemType>::ScaleAndAddOnBlocks(alpha, *a.m_GPUMatrix, *c.m_GPUSparseMatrix); });
+}
+
 /// <summary>Matrix-scalar multiply with col-major matrices: c = alpha * a + beta * c</summary>
 /// if a is a column vector, add to all columns of c
 /// if a is a row vector, add to all rows of c
@@ -4730,6 +5264,105 @@ void Matrix<ElemType>::AssignScaledDifference(const Matrix<ElemType>& alpha, con
                             NOT_IMPLEMENTED);
 }
 
+/// <summary>Fused column-wise log softmax and cross entropy with dense labels</summary>
+/// <param name="labels">Input label matrix, same dimensions as logits</param>
+/// <param name="logits">Input matrix of unnormalized log probabilities</param>
+/// <param name="logSumExp">Resulting [1 x N] matrix, log sum_i exp(logits(i, j))</param>
+/// <param name="crossEntropy">Resulting [1 x N] matrix, the cross entropy of each column</param>
+template <class ElemType>
+void Matrix<ElemType>::SoftmaxCrossEntropy(const Matrix<ElemType>& labels, const Matrix<ElemType>& logits, Matrix<ElemType>& logSumExp, Matrix<ElemType>& crossEntropy)
+{
+    DecideAndMoveToRightDevice(logits, labels);
+    logSumExp._transferToDevice(logits.GetDeviceId());
+    crossEntropy._transferToDevice(logits.GetDeviceId());
+
+    if (labels.GetMatrixType() != DENSE || logits.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    logSumExp.SwitchToMatrixType(logits.GetMatrixType(), logits.GetFormat(), false);
+    crossEntropy.SwitchToMatrixType(logits.GetMatrixType(), logits.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(&logSumExp,
+                            &crossEntropy,
+                            CPUMatrix<ElemType>::SoftmaxCrossEntropy(*labels.m_CPUMatrix, *logits.m_CPUMatrix, *logSumExp.m_CPUMatrix, *crossEntropy.m_CPUMatrix),
+                            GPUMatrix<ElemType>::SoftmaxCrossEntropy(*labels.m_GPUMatrix, *logits.m_GPUMatrix, *logSumExp.m_GPUMatrix, *crossEntropy.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+/// <summary>Gradient of SoftmaxCrossEntropy() w.r.t. the logits: gradient += alpha * (softmax(logits) - labels)</summary>
+/// <param name="alpha">1X1 matrix, usually the gradient of the criterion</param>
+/// <param name="labels">Input label matrix, same dimensions as logits</param>
+/// <param name="logits">Input matrix of unnormalized log probabilities</param>
+/// <param name="logSumExp">[1 x N] matrix computed by SoftmaxCrossEntropy()</param>
+/// <param name="gradient">Resulting matrix, same dimensions as logits</param>
+template <class ElemType>
+void Matrix<ElemType>::AddSoftmaxCrossEntropyGradient(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labels, const Matrix<ElemType>& logits, const Matrix<ElemType>& logSumExp, Matrix<ElemType>& gradient)
+{
+    DecideAndMoveToRightDevice(logits, labels, logSumExp, alpha);
+    gradient._transferToDevice(logits.GetDeviceId());
+
+    if (labels.GetMatrixType() != DENSE || logits.GetMatrixType() != DENSE || gradient.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DISPATCH_MATRIX_ON_FLAG(&gradient,
+                            &gradient,
+                            CPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradient(*alpha.m_CPUMatrix, *labels.m_CPUMatrix, *logits.m_CPUMatrix, *logSumExp.m_CPUMatrix, *gradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradient(*alpha.m_GPUMatrix, *labels.m_GPUMatrix, *logits.m_GPUMatrix, *logSumExp.m_GPUMatrix, *gradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+/// <summary>SoftmaxCrossEntropy() with class-index labels: crossEntropy(0, j) = logSumExp(0, j) - logits(labelIndices(0, j), j)</summary>
+/// The label of each column is gathered from the logits, so that no one-hot label matrix needs to be built or transferred.
+/// <param name="labelIndices">[1 x N] matrix of the target row of each column; columns with an index outside [0, numRows) get zero</param>
+/// <param name="logits">Input [M x N] matrix of unnormalized log probabilities</param>
+/// <param name="logSumExp">Resulting [1 x N] matrix, log sum_i exp(logits(i, j))</param>
+/// <param name="crossEntropy">Resulting [1 x N] matrix, the cross entropy of each column</param>
+template <class ElemType>
+void Matrix<ElemType>::SoftmaxCrossEntropyWithIndices(const Matrix<ElemType>& labelIndices, const Matrix<ElemType>& logits, Matrix<ElemType>& logSumExp, Matrix<ElemType>& crossEntropy)
+{
+    DecideAndMoveToRightDevice(logits, labelIndices);
+    logSumExp._transferToDevice(logits.GetDeviceId());
+    crossEntropy._transferToDevice(logits.GetDeviceId());
+
+    if (labelIndices.GetMatrixType() != DENSE || logits.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    logSumExp.SwitchToMatrixType(logits.GetMatrixType(), logits.GetFormat(), false);
+    crossEntropy.SwitchToMatrixType(logits.GetMatrixType(), logits.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(&logSumExp,
+                            &crossEntropy,
+                            CPUMatrix<ElemType>::SoftmaxCrossEntropyWithIndices(*labelIndices.m_CPUMatrix, *logits.m_CPUMatrix, *logSumExp.m_CPUMatrix, *crossEntropy.m_CPUMatrix),
+                            GPUMatrix<ElemType>::SoftmaxCrossEntropyWithIndices(*labelIndices.m_GPUMatrix, *logits.m_GPUMatrix, *logSumExp.m_GPUMatrix, *crossEntropy.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+/// <summary>Gradient of SoftmaxCrossEntropyWithIndices() w.r.t. the logits: gradient += alpha * (softmax(logits) - onehot(labelIndices))</summary>
+/// <param name="alpha">1X1 matrix, usually the gradient of the criterion</param>
+/// <param name="labelIndices">[1 x N] matrix of the target row of each column</param>
+/// <param name="logits">Input matrix of unnormalized log probabilities</param>
+/// <param name="logSumExp">[1 x N] matrix computed by SoftmaxCrossEntropyWithIndices()</param>
+/// <param name="gradient">Resulting matrix, same dimensions as logits; columns with an invalid index are left unchanged</param>
+template <class ElemType>
+void Matrix<ElemType>::AddSoftmaxCrossEntropyGradientWithIndices(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labelIndices, const Matrix<ElemType>& logits, const Matrix<ElemType>& logSumExp, Matrix<ElemType>& gradient)
+{
+    DecideAndMoveToRightDevice(logits, labelIndices, logSumExp, alpha);
+    gradient._transferToDevice(logits.GetDeviceId());
+
+    if (labelIndices.GetMatrixType() != DENSE || logits.GetMatrixType() != DENSE || gradient.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DISPATCH_MATRIX_ON_FLAG(&gradient,
+                            &gradient,
+                            CPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradientWithIndices(*alpha.m_CPUMatrix, *labelIndices.m_CPUMatrix, *logits.m_CPUMatrix, *logSumExp.m_CPUMatrix, *gradient.m_CPUMatrix),
+                            GPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradientWithIndices(*alpha.m_GPUMatrix, *labelIndices.m_GPUMatrix, *logits.m_GPUMatrix, *logSumExp.m_GPUMatrix, *gradient.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 //c[ci,cj] += a[ai,aj]
 template <class ElemType>
 void Matrix<ElemType>::AddElementToElement(const Matrix<ElemType>& a, const size_t ai, const size_t aj, Matrix<ElemType>& c, const size_t ci, const size_t cj)
@@ -5234,6 +5867,102 @@ Matrix<ElemType>& Matrix<ElemType>::AssignElementProductOfWithShift(const Matrix
     return *this;
 }
 
+template <class ElemType>
+void Matrix<ElemType>::CosDistanceWithNegativeSamples(const Matrix<ElemType>& q, const Matrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                      Matrix<ElemType>& invNormQ, Matrix<ElemType>& invNormD, Matrix<ElemType>& c)
+{
+    if (q.IsEmpty() || d.IsEmpty())
+        LogicError("CosDistanceWithNegativeSamples: Matrix is empty.");
+
+    DecideAndMoveToRightDevice(q, d);
+    if (q.GetMatrixType() != DENSE || d.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+    for (auto* out : { &invNormQ, &invNormD, &c })
+    {
+        out->_transferToDevice(q.GetDeviceId(), true, /*emptyTransfer=*/true);
+        out->SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    }
+
+    DISPATCH_MATRIX_ON_FLAG(&q,
+                            &c,
+                            { CPUMatrix<ElemType>::CosDistanceWithNegativeSamples(*q.m_CPUMatrix, *d.m_CPUMatrix, shift, negNumber, *invNormQ.m_CPUMatrix, *invNormD.m_CPUMatrix, *c.m_CPUMatrix);
+                              invNormQ.SetDataLocation(CPU, DENSE); invNormD.SetDataLocation(CPU, DENSE); },
+                            { GPUMatrix<ElemType>::CosDistanceWithNegativeSamples(*q.m_GPUMatrix, *d.m_GPUMatrix, shift, negNumber, *invNormQ.m_GPUMatrix, *invNormD.m_GPUMatrix, *c.m_GPUMatrix);
+                              invNormQ.SetDataLocation(GPU, DENSE); invNormD.SetDataLocation(GPU, DENSE); },
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::CosDistanceWithNegativeSamplesGradient(bool wrtQuery, const Matrix<ElemType>& q, const Matrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                              const Matrix<ElemType>& invNormQ, const Matrix<ElemType>& invNormD,
+                                                              const Matrix<ElemType>& c, const Matrix<ElemType>& cGrad, Matrix<ElemType>& grad)
+{
+    DecideAndMoveToRightDevice(q, d, grad);
+    DecideAndMoveToRightDevice(q, invNormQ, invNormD);
+    DecideAndMoveToRightDevice(q, c, cGrad);
+    if (q.GetMatrixType() != DENSE || d.GetMatrixType() != DENSE || grad.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DISPATCH_MATRIX_ON_FLAG(&q,
+                            &grad,
+                            CPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(wrtQuery, *q.m_CPUMatrix, *d.m_CPUMatrix, shift, negNumber, *invNormQ.m_CPUMatrix, *invNormD.m_CPUMatrix,
+                                                                                        *c.m_CPUMatrix, *cGrad.m_CPUMatrix, *grad.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(wrtQuery, *q.m_GPUMatrix, *d.m_GPUMatrix, shift, negNumber, *invNormQ.m_GPUMatrix, *invNormD.m_GPUMatrix,
+                                                                                        *c.m_GPUMatrix, *cGrad.m_GPUMatrix, *grad.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::GMMLogLikelihood(const Matrix<ElemType>& unnormedPrior, const Matrix<ElemType>& means, const Matrix<ElemType>& logStdDevs, const Matrix<ElemType>& features,
+                                        Matrix<ElemType>& logLikelihood, Matrix<ElemType>& posterior, Matrix<ElemType>& normedDeviation)
+{
+    const size_t numComponents = unnormedPrior.GetNumRows();
+    const size_t featureDim = features.GetNumRows();
+    const size_t numSamples = features.GetNumCols();
+    if (features.IsEmpty() || numComponents == 0)
+        LogicError("GMMLogLikelihood: Matrix is empty.");
+    if (logStdDevs.GetNumRows() != numComponents || means.GetNumRows() != numComponents * featureDim)
+        InvalidArgument("GMMLogLikelihood: The prior, means and stddevs must have one, featureDim and one rows per component.");
+    for (auto* param : { &unnormedPrior, &means, &logStdDevs })
+        if (param->GetNumCols() != 1 && param->GetNumCols() != numSamples)
+            InvalidArgument("GMMLogLikelihood: The mixture parameters must have either one column or one per sample.");
+
+    DecideAndMoveToRightDevice(features, unnormedPrior, means, logStdDevs);
+    if (features.GetMatrixType() != DENSE || means.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    // shared means: the cross terms of the squared distances, one GEMM for all components and samples
+    Matrix<ElemType> products(features.GetDeviceId());
+    Matrix<ElemType> meanSquaredNorms(features.GetDeviceId());
+    if (means.GetNumCols() == 1)
+    {
+        Matrix<ElemType> meanVectors = means.Reshaped(featureDim, numComponents);
+        Multiply(meanVectors, true, features, false, products);
+        meanSquaredNorms.AssignVectorNorm2Of(meanVectors, true);
+        meanSquaredNorms ^= 2;
+    }
+    for (auto* out : { &logLikelihood, &posterior, &normedDeviation })
+    {
+        out->_transferToDevice(features.GetDeviceId(), true, /*emptyTransfer=*/true);
+        out->SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    }
+
+    DISPATCH_MATRIX_ON_FLAG(&features,
+                            &logLikelihood,
+                            { CPUMatrix<ElemType>::GMMLogLikelihood(*unnormedPrior.m_CPUMatrix, *means.m_CPUMatrix, *logStdDevs.m_CPUMatrix, *features.m_CPUMatrix,
+                                                                    *products.m_CPUMatrix, *meanSquaredNorms.m_CPUMatrix,
+                                                                    *logLikelihood.m_CPUMatrix, *posterior.m_CPUMatrix, *normedDeviation.m_CPUMatrix);
+                              posterior.SetDataLocation(CPU, DENSE); normedDeviation.SetDataLocation(CPU, DENSE); },
+                            { GPUMatrix<ElemType>::GMMLogLikelihood(*unnormedPrior.m_GPUMatrix, *means.m_GPUMatrix, *logStdDevs.m_GPUMatrix, *features.m_GPUMatrix,
+                                                                    *products.m_GPUMatrix, *meanSquaredNorms.m_GPUMatrix,
+                                                                    *logLikelihood.m_GPUMatrix, *posterior.m_GPUMatrix, *normedDeviation.m_GPUMatrix);
+                              posterior.SetDataLocation(GPU, DENSE); normedDeviation.SetDataLocation(GPU, DENSE); },
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 template <class ElemType>
 void Matrix<ElemType>::RCRFBackwardCompute(const Matrix<ElemType>& alpha, Matrix<ElemType>& beta,
                                            Matrix<ElemType>& functionValues, const Matrix<ElemType>& lbls,
@@ -5292,6 +6021,89 @@ void Matrix<ElemType>::RCRFTransGrdCompute(const Matrix<ElemType>& lbls,
                             NOT_IMPLEMENTED);
 }
 
+// The CRF functions read the labels element by element, so sparse labels (the usual input) are made dense first.
+template <class ElemType>
+static const Matrix<ElemType>& DenseCRFLabels(const Matrix<ElemType>& lbls, Matrix<ElemType>& denseCopy)
+{
+    if (lbls.GetMatrixType() != SPARSE)
+        return lbls;
+    denseCopy = lbls.DeepClone();
+    denseCopy.SwitchToMatrixType(DENSE, matrixFormatDense, true);
+    return denseCopy;
+}
+
+template <class ElemType>
+void Matrix<ElemType>::CRFForwardBackward(const Matrix<ElemType>& lbls, const Matrix<ElemType>& posScores, const Matrix<ElemType>& pairScores,
+                                          size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                          Matrix<ElemType>& alpha, Matrix<ElemType>& beta, Matrix<ElemType>& postProb, Matrix<ElemType>& sequenceScores)
+{
+    DecideAndMoveToRightDevice(posScores, pairScores, lbls);
+    Matrix<ElemType> denseLbls(posScores.GetDeviceId());
+    const Matrix<ElemType>& l = DenseCRFLabels(lbls, denseLbls);
+    for (auto* out : { &alpha, &beta, &postProb, &sequenceScores })
+    {
+        out->_transferToDevice(posScores.GetDeviceId(), true, /*emptyTransfer=*/true);
+        out->SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    }
+
+    DISPATCH_MATRIX_ON_FLAG(&posScores,
+                            &alpha,
+                            { CPUMatrix<ElemType>::CRFForwardBackward(*l.m_CPUMatrix, *posScores.m_CPUMatrix, *pairScores.m_CPUMatrix, numParallelSequences, sequences,
+                                                                      *alpha.m_CPUMatrix, *beta.m_CPUMatrix, *postProb.m_CPUMatrix, *sequenceScores.m_CPUMatrix);
+                              beta.SetDataLocation(CPU, DENSE); postProb.SetDataLocation(CPU, DENSE); sequenceScores.SetDataLocation(CPU, DENSE); },
+                            { GPUMatrix<ElemType>::CRFForwardBackward(*l.m_GPUMatrix, *posScores.m_GPUMatrix, *pairScores.m_GPUMatrix, numParallelSequences, sequences,
+                                                                      *alpha.m_GPUMatrix, *beta.m_GPUMatrix, *postProb.m_GPUMatrix, *sequenceScores.m_GPUMatrix);
+                              beta.SetDataLocation(GPU, DENSE); postProb.SetDataLocation(GPU, DENSE); sequenceScores.SetDataLocation(GPU, DENSE); },
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::CRFTransitionGradient(const Matrix<ElemType>& lbls, const Matrix<ElemType>& posScores, const Matrix<ElemType>& pairScores,
+                                             size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                             const Matrix<ElemType>& alpha, const Matrix<ElemType>& beta, Matrix<ElemType>& grd)
+{
+    DecideAndMoveToRightDevice(posScores, pairScores, lbls);
+    DecideAndMoveToRightDevice(posScores, alpha, beta, grd);
+    Matrix<ElemType> denseLbls(posScores.GetDeviceId());
+    const Matrix<ElemType>& l = DenseCRFLabels(lbls, denseLbls);
+
+    DISPATCH_MATRIX_ON_FLAG(&grd,
+                            &grd,
+                            CPUMatrix<ElemType>::CRFTransitionGradient(*l.m_CPUMatrix, *posScores.m_CPUMatrix, *pairScores.m_CPUMatrix, numParallelSequences, sequences,
+                                                                       *alpha.m_CPUMatrix, *beta.m_CPUMatrix, *grd.m_CPUMatrix),
+                            GPUMatrix<ElemType>::CRFTransitionGradient(*l.m_GPUMatrix, *posScores.m_GPUMatrix, *pairScores.m_GPUMatrix, numParallelSequences, sequences,
+                                                                       *alpha.m_GPUMatrix, *beta.m_GPUMatrix, *grd.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::CRFViterbiDecode(const Matrix<ElemType>& lbls, const Matrix<ElemType>& posScores, const Matrix<ElemType>& pairScores,
+                                        size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                        Matrix<ElemType>& alpha, Matrix<ElemType>& backtrace, Matrix<ElemType>& decodedPath)
+{
+    DecideAndMoveToRightDevice(posScores, pairScores, lbls);
+    Matrix<ElemType> denseLbls(posScores.GetDeviceId());
+    const Matrix<ElemType>& l = DenseCRFLabels(lbls, denseLbls);
+    for (auto* out : { &alpha, &backtrace, &decodedPath })
+    {
+        out->_transferToDevice(posScores.GetDeviceId(), true, /*emptyTransfer=*/true);
+        out->SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    }
+
+    DISPATCH_MATRIX_ON_FLAG(&posScores,
+                            &alpha,
+                            { CPUMatrix<ElemType>::CRFViterbiDecode(*l.m_CPUMatrix, *posScores.m_CPUMatrix, *pairScores.m_CPUMatrix, numParallelSequences, sequences,
+                                                                    *alpha.m_CPUMatrix, *backtrace.m_CPUMatrix, *decodedPath.m_CPUMatrix);
+                              backtrace.SetDataLocation(CPU, DENSE); decodedPath.SetDataLocation(CPU, DENSE); },
+                            { GPUMatrix<ElemType>::CRFViterbiDecode(*l.m_GPUMatrix, *posScores.m_GPUMatrix, *pairScores.m_GPUMatrix, numParallelSequences, sequences,
+                                                                    *alpha.m_GPUMatrix, *backtrace.m_GPUMatrix, *decodedPath.m_GPUMatrix);
+                              backtrace.SetDataLocation(GPU, DENSE); decodedPath.SetDataLocation(GPU, DENSE); },
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 template <class ElemType>
 Matrix<ElemType>& Matrix<ElemType>::DropFrame(const Matrix<ElemType>& label, const Matrix<ElemType>& gamma, const ElemType& threshhold)
 {
@@ -5401,6 +6213,46 @@ void Matrix<ElemType>::TensorOp(ElemType beta, const Matrix<ElemType>& a, const
                             NOT_IMPLEMENTED);
 }
 
+// c = beta * c + alpha * program(inputs) over numElements contiguous elements of each operand, starting at the given offsets (output last)
+// This evaluates a whole chain of element-wise ops reading each input and writing the output only once.
+template <class ElemType>
+void Matrix<ElemType>::FusedElementwiseOp(ElemType beta, const std::vector<const Matrix<ElemType>*>& inputs, const std::vector<size_t>& offsets, size_t numElements,
+                                          const FusedElementwiseProgram& program, ElemType alpha)
+{
+    if (inputs.size() != program.numInputs)
+        InvalidArgument("FusedElementwiseOp: The program expects %d inputs, but %d were passed.", (int) program.numInputs, (int) inputs.size());
+    if (offsets.size() != inputs.size() + 1)
+        InvalidArgument("FusedElementwiseOp: Expected one offset per input plus one for the output.");
+    if (program.numInstructions == 0)
+        InvalidArgument("FusedElementwiseOp: The program is empty.");
+    VerifyIsDense(*this);
+    for (size_t k = 0; k <= inputs.size(); k++)
+    {
+        const Matrix<ElemType>& m = k < inputs.size() ? *inputs[k] : *this;
+        VerifyIsDense(m);
+        if (offsets[k] + numElements > m.GetNumElements())
+            InvalidArgument("FusedElementwiseOp: Operand %d is too small for %d elements at offset %d.", (int) k, (int) numElements, (int) offsets[k]);
+        if (m.GetDeviceId() != GetDeviceId())
+            m._transferToDevice(GetDeviceId());
+    }
+    if (numElements == 0)
+        return;
+
+    std::vector<const CPUMatrix<ElemType>*> cpuInputs;
+    std::vector<const GPUMatrix<ElemType>*> gpuInputs;
+    for (auto input : inputs)
+    {
+        cpuInputs.push_back(input->m_CPUMatrix.get());
+        gpuInputs.push_back(input->m_GPUMatrix.get());
+    }
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->FusedElementwiseOp(beta, cpuInputs, offsets, numElements, program, alpha),
+                            m_GPUMatrix->FusedElementwiseOp(beta, gpuInputs, offsets, numElements, program, alpha),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 template class Matrix<float>;
 template class Matrix<double>;
 
@@ -18,6 +18,8 @@
 #include <memory> // for shared_ptr
 #include <array>
 #include <initializer_list>
+#include <map>
+#include <string>
 
 // This class is exported from the Math.dll
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -53,6 +55,63 @@ struct /*interface*/ MATH_API MatrixBase
 };
 typedef std::shared_ptr<MatrixBase> MatrixBasePtr;
 
+// -----------------------------------------------------------------------
+// MatrixTransferStatistics -- counters of implicit data transfers between CPU and GPU
+// Implicit transfers are those that Matrix does on its own, e.g. when the operands of an operation live on
+// different devices, or on element access; explicit calls to TransferFromDeviceToDevice() are not counted.
+// Transfers are attributed to the current scope (e.g. the node being evaluated, see MatrixTransferScope).
+// A matrix that is implicitly moved back to a device that it was implicitly moved away from is "ping-ponging";
+// depending on the check mode, this is reported or raises an error. Like Matrix, this is not thread-safe.
+// -----------------------------------------------------------------------
+
+enum class MatrixTransferCheck
+{
+    none,
+    warn, // report each ping-pong transfer (up to a limit)
+    fail  // RuntimeError on the first ping-pong transfer
+};
+
+struct MatrixTransferCounts
+{
+    size_t numTransfers;
+    size_t numBytes;
+    MatrixTransferCounts() : numTransfers(0), numBytes(0) { }
+};
+
+class MATH_API MatrixTransferStatistics
+{
+public:
+    static void Reset();
+    static MatrixTransferCounts GetTotal();
+    static std::map<std::wstring, MatrixTransferCounts> GetPerScope();
+    static void Print(FILE* f);
+
+    static void SetCheck(MatrixTransferCheck check);
+    static MatrixTransferCheck GetCheck();
+
+    static const std::wstring& GetScope();
+    static void SetScope(const std::wstring& scope);
+
+    // called by Matrix for every implicit transfer
+    static void Record(size_t numBytes, bool isPingPong, size_t numRows, size_t numCols, int fromDeviceId, int toDeviceId);
+};
+
+// sets the scope that implicit transfers are attributed to, for the lifetime of this object
+class MatrixTransferScope
+{
+    std::wstring m_previousScope;
+
+public:
+    MatrixTransferScope(const std::wstring& scope) : m_previousScope(MatrixTransferStatistics::GetScope())
+    {
+        MatrixTransferStatistics::SetScope(scope);
+    }
+    ~MatrixTransferScope()
+    {
+        MatrixTransferStatistics::SetScope(m_previousScope);
+    }
+};
+
 // Note: To comply with BLAS libraries, matrices are stored in ColMajor. However, by default C/C++/C# use RowMajor convertion.
 // !!!WARNING!!! This class is NOT THREAD SAFE. Test and add necessary modifications if using in multi-threaded environment
 template <class ElemType>
@@ -74,8 +133,14 @@ private:
     mutable size_t m_numTimesMatrixTypeChanged;
     mutable int m_devicesTransferedTo[2]; // TODO: what is this for? Seems only diagnostics
 
+    // implicit transfers of this matrix (see MatrixTransferStatistics)
+    mutable size_t m_numImplicitTransfers;
+    mutable size_t m_numImplicitTransferBytes;
+    mutable int m_lastImplicitTransferFromDeviceId; // device that the data was last implicitly moved away from
+
     // Moves matrix from device id_from to device with id_to. This method doesn't change preferred device Id
-    void _transferFromDeviceToDevice(int id_from, int id_to, bool isBeingMoved = true, bool emptyTransfer = false) const;
+    void _transferFromDeviceToDevice(int id_from, int id_to, bool isBeingMoved = true, bool emptyTransfer = false, bool isImplicit = true) const;
+    void RecordImplicitTransfer(int id_from, int id_to) const;
     // Moves matrix from current device to device with id_to. This method doesn't change preferred device Id
     void _transferToDevice(int id_to, bool isBeingMoved = true, bool emptyTransfer = false) const;
     template <class ElemType2>
@@ -158,6 +223,8 @@ public:
     // Same as TransferFromDeviceToDevice() but moves only if it is currently not on the target device
     void TransferToDeviceIfNotThere(int id_to, bool isBeingMoved = false, bool emptyTransfer = false, bool updatePreferredDevice = true) const;
     CurrentDataLocation GetCurrentMatrixLocation() const { return m_currentDataLocation; };
+    size_t GetNumImplicitTransfers() const { return m_numImplicitTransfers; }
+    size_t GetNumImplicitTransferBytes() const { return m_numImplicitTransferBytes; }
     void SwitchToMatrixType(MatrixType newMatrixType, MatrixFormat newMatrixFormat, bool keepValues); // sets matrix type between dense and sparse
     size_t GetNumRows() const;
     size_t GetNumCols() const;
@@ -195,6 +262,21 @@ public:
     void FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum);
     ElemType RmsProp(Matrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
 
+    // Momentum SGD step for a list of dense parameters, with gradient clipping and regularization folded in.
+    // For each i, the same as, in this order:
+    //  - clipping gradients[i] at clippingThreshold (infinity for none), by truncating its elements or, if !clipByTruncation, by scaling it down to that Frobenius norm,
+    //  - ScaleAndAdd(l2RegWeight, *functionValues[i], *gradients[i]) if l2RegWeight > 0,
+    //  - smoothedGradients[i]->NormalGrad(*gradients[i], *functionValues[i], learnRatesPerSample[i], momentum, useNesterovMomentum),
+    //  - functionValues[i]->InplaceSoftThreshold(learnRatesPerSample[i] * l1RegWeight) if l1RegWeight > 0.
+    // On the GPU, the whole list takes a few kernel launches (one more for the norms when clipping by norm) instead of several per parameter.
+    static void MultiTensorNormalGrad(const std::vector<Matrix<ElemType>*>& smoothedGradients,
+                                      const std::vector<Matrix<ElemType>*>& gradients,
+                                      const std::vector<Matrix<ElemType>*>& functionValues,
+                                      const std::vector<ElemType>& learnRatesPerSample,
+                                      const ElemType momentum, const bool useNesterovMomentum,
+                                      const ElemType clippingThreshold, const bool clipByTruncation,
+                                      const ElemType l2RegWeight, const ElemType l1RegWeight);
+
     void Resize(const size_t numRows, const size_t numCols, const size_t numNZElemToReserve = 10000, bool growOnly = true); // by default we only reallocate if need to grow
     void Resize(const Matrix<ElemType>& other) // TODO: Should this carry over numNZElemToReserve for sparse matrices?
     {
@@ -243,6 +325,11 @@ public:
     // AssignValuesOf respects the target matrix's information. It copies the values from the target into the memory of the source.
     void AssignValuesOf(const Matrix<ElemType>& deepCopyFrom);
     void SetValue(const size_t numRows, const size_t numCols, int deviceId, ElemType* pArray, const size_t matrixFlags = matrixFlagNormal);
+    // Sets the matrix to numRows x numCols column-major values of a compact type (e.g. uint8 pixels or FP16 features from a reader),
+    // converted on the way as (data[i,j] - offset[i]) * scale. 'offset' is an optional column vector of numRows.
+    // 'data' is on the host, or on this matrix's device if matrixFlagSetValueOnDevice is given. On the GPU, only the compact
+    // data are uploaded, and conversion and normalization are a single kernel.
+    void SetValueFromCompact(const size_t numRows, const size_t numCols, const void* data, CompactElementType type, ElemType scale = 1, const Matrix<ElemType>* offset = nullptr, const size_t matrixFlags = matrixFlagNormal);
     void SetValue(const size_t rIdx, const size_t cIdx, ElemType val); // set matrix sparsely
     void SetValue(const size_t numRows, const size_t numCols, std::initializer_list<ElemType> l) // SetValue(2,3, {1,2,3,  4,5,6});
     {
@@ -257,6 +344,10 @@ public:
     }
     void SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYPE* h_CSCCol, const CPUSPARSE_INDEX_TYPE* h_Row, const ElemType* h_Val,
                                 const size_t nz, const size_t numRows, const size_t numCols);
+    // block-sparse (BlockCol) matrices, e.g. the gradients of embeddings: the ids of the nonzero columns and their values
+    // (numRows x columnIds.size(), column-major), copied from and to the device
+    void GetSparseBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& values) const;
+    void SetSparseBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& values);
 
     void MaskColumnsValue(const Matrix<char>& columnsMask, ElemType val);
 
@@ -269,6 +360,15 @@ public:
     void SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed = USE_TIME_BASED_SEED);
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    // same, but from the counter-based generator (PhiloxRNG.h) of the handle: the same mask on CPU and GPU, and for any number of threads
+    void SetCounterBasedUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    // this = beta * this + a .* mask, with the mask that SetCounterBasedUniformRandomMask() generated from counter 'firstCounter' of the generator 'seed'
+    // for a matrix whose element 'elementOffset' is element 0 of this one; so that a dropout mask need not be kept for backprop, but is regenerated
+    Matrix<ElemType>& AssignElementProductOfUniformRandomMask(const Matrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue,
+                                                              const uint64_t seed, const uint64_t firstCounter, const size_t elementOffset, const ElemType beta = 0);
+    // counter-based (PhiloxRNG.h): element i depends only on the seed and i, so that CPU and GPU, and any number of threads, give the same values
+    void SetCounterBasedUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed);
+    void SetCounterBasedGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed);
     void AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     Matrix<ElemType>& AssignNoiseContrastiveEstimation(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& c, const Matrix<ElemType>& bias, Matrix<ElemType>& tmp);
 
@@ -280,7 +380,12 @@ public:
     Matrix<ElemType>& AssignTransposeOf(const Matrix<ElemType>& a);
 
     Matrix<ElemType>& DoGatherColumnsOf (ElemType beta, const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha);
-    Matrix<ElemType>& DoScatterColumnsOf(ElemType beta, const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha);
+    Matrix<ElemType>& DoScatterColumnsOf(ElemType beta, const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha, bool idxIsUnique = false);
+    // this[0,j] = sequenceMap(0,j) + index(0,j) * numParallelSequences, i.e. the packed column of time step index(0,j) of the sequence that
+    // column j refers to (see PackedIndexNode). Per column, sequenceMap (3 x n) holds the packed column of that sequence's time step 0 (NaN
+    // for gaps) and the range [begin, end) of its time steps inside the minibatch. Gaps give -1, as do time steps out of range on the GPU
+    // (they are an error on the CPU).
+    Matrix<ElemType>& AssignPackedIndicesOf(const Matrix<ElemType>& index, const Matrix<ElemType>& sequenceMap, size_t numParallelSequences);
 
     Matrix<ElemType>& operator+=(const ElemType alpha);
     Matrix<ElemType>  operator+(const ElemType alpha) const;
@@ -350,6 +455,9 @@ public:
 
     Matrix<ElemType>& InplaceHardmax(const bool isColWise);
     Matrix<ElemType>& AssignHardmaxOf(const Matrix<ElemType>& a, const bool isColWise);
+    // column-wise one-hot codes of the n largest elements of each column of a, in descending order: [(rows of a) * n x (cols of a)],
+    // where rows k * (rows of a) ... (k + 1) * (rows of a) - 1 hold the one-hot code of the (k+1)-th largest; ties go to the lower index
+    Matrix<ElemType>& AssignTopNHardmaxOf(const Matrix<ElemType>& a, const size_t n);
 
     // sequence training
     Matrix<ElemType>& DropFrame(const Matrix<ElemType>& label, const Matrix<ElemType>& gamma, const ElemType& threshhold);
@@ -386,6 +494,10 @@ public:
     void InplaceTranspose();
 
     Matrix<ElemType>& SetToZeroIfAbsLessThan(const ElemType threshold);
+    // Moves up to 'capacity' entries with |x| >= threshold into the CPU buffers (indices, values), setting them to 0 here.
+    // Returns the number of entries with |x| >= threshold, which may exceed 'capacity' (use capacity 0 to just count them).
+    // Indices are linear (column-major). Used for sparse gradient exchange, see SparseDistGradAggregator.
+    size_t ExtractAbsAboveThreshold(const ElemType threshold, size_t capacity, int* indices, ElemType* values);
 
     DeviceBoundNumber<ElemType> Sum_AsDeviceBoundNum() const;
     ElemType SumOfAbsElements() const; // sum of all abs(elements)
@@ -433,12 +545,21 @@ public:
     ElemType MatrixNorm1() const;
     ElemType MatrixNorm0() const; // number of non-zero elemets
     Matrix<ElemType>& AssignSignOf(const Matrix<ElemType>& a);
+    // Lossy compression of the columns of a dense matrix, e.g. for activations that are needed again only by the backward pass.
+    // Each column of the result (GetCompressedNumRows() x a.GetNumCols()) holds a scale followed by the packed compact elements:
+    // uint8 stores round(v / scale) + 127 with scale = max |v| / 127 of the column, float16 stores v with scale 1.
+    Matrix<ElemType>& AssignCompressedOf(const Matrix<ElemType>& a, CompactElementType type);
+    // inverse of AssignCompressedOf(); numRows is that of the original matrix
+    Matrix<ElemType>& AssignDecompressedOf(const Matrix<ElemType>& compressed, size_t numRows, CompactElementType type);
     Matrix<ElemType>& AddSignOf(const Matrix<ElemType>& a);
     void VectorMax(Matrix<ElemType>& maxIndexes, Matrix<ElemType>& maxValues, const bool isColWise) const;
     void VectorMax(Matrix<ElemType>& maxIndexes, Matrix<ElemType>& maxValues, const bool isColWise, int topK) const;
     void VectorMin(Matrix<ElemType>& minIndexes, Matrix<ElemType>& minValues, const bool isColWise) const;
 
     Matrix<ElemType>& AssignNumOfDiff(const Matrix<ElemType>& a, const Matrix<ElemType>& b, bool searchInCol = false);
+    // number of columns whose label is not among the 'topK' largest predictions, in a single pass over both (this method will resize(1,1) first)
+    // 'labels' are one-hot columns, or a row of class indices if 'classIndexLabels'; columns where 'columnsMask' is 0 are not counted
+    Matrix<ElemType>& AssignNumOfTopKErrors(const Matrix<ElemType>& labels, const Matrix<ElemType>& predictions, int topK, bool classIndexLabels, const Matrix<char>* columnsMask = nullptr);
 
     Matrix<ElemType>& AssignInnerProductOfMatrices(const Matrix<ElemType>& a, const Matrix<ElemType>& b); // this method will resize(1,1) first
 
@@ -523,15 +644,36 @@ public:
     static void Multiply(const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, Matrix<ElemType>& c);
     static void Multiply(const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
     static void Multiply1x1AndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, ElemType beta, Matrix<ElemType>& c);
+    // Batched GEMM: each column of a, b and c holds one column-major matrix, e.g. one per sample of a minibatch:
+    //     c_j = alpha * op(a_j) * op(b_j) + beta * c_j,  where a_j is column j of a viewed as an [aRows x a.GetNumRows() / aRows] matrix, b_j likewise.
+    // If a or b has a single column, it is used for all columns of c.
+    static void BatchMatMul(ElemType alpha, const Matrix<ElemType>& a, const size_t aRows, const bool transposeA, const Matrix<ElemType>& b, const size_t bRows, const bool transposeB, ElemType beta, Matrix<ElemType>& c);
+    // Fused affine layer: c = activation(a * b + bias), with bias a column vector; the bias and the activation are applied in a single pass after the GEMM.
+    // activation is opSigmoid, opTanh, or opLinearRectifier.
+    static void AffineAndActivation(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& bias, ElementWiseOperator activation, Matrix<ElemType>& c);
     static void ConvolveAndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, ElemType beta, Matrix<ElemType>& c, size_t numChannels, size_t horizontalSubsample, bool padding, bool channelwise);
 
     static void ScaleAndAdd(ElemType alpha, const Matrix<ElemType>& a, Matrix<ElemType>& c);
     static void ScaleAndAdd(ElemType alpha, const Matrix<ElemType>& a, ElemType beta, Matrix<ElemType>& c);
+    // c += alpha * a on the nonzero blocks of the block-sparse c only, e.g. weight decay of the rows of an embedding that are in the minibatch
+    static void ScaleAndAddOnSparseBlocks(ElemType alpha, const Matrix<ElemType>& a, Matrix<ElemType>& c);
     static void AddScaledDifference(const ElemType alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
     static void AssignScaledDifference(const ElemType alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
     static void AddScaledDifference(const Matrix<ElemType>& alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c); // c += alpha * (a - b)
     static void AssignScaledDifference(const Matrix<ElemType>& alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
 
+    // Fused column-wise softmax and cross entropy for dense labels, in a single pass over the logits. For each column j:
+    //     logSumExp(0, j) = log(sum_i exp(logits(i, j))),  crossEntropy(0, j) = -sum_i labels(i, j) * (logits(i, j) - logSumExp(0, j))
+    static void SoftmaxCrossEntropy(const Matrix<ElemType>& labels, const Matrix<ElemType>& logits, Matrix<ElemType>& logSumExp, Matrix<ElemType>& crossEntropy);
+    // gradient += alpha * (softmax(logits) - labels), with the softmax recomputed from the logSumExp of SoftmaxCrossEntropy(); alpha is 1x1
+    static void AddSoftmaxCrossEntropyGradient(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labels, const Matrix<ElemType>& logits, const Matrix<ElemType>& logSumExp, Matrix<ElemType>& gradient);
+    // The same with class-index labels instead of one-hot columns: labelIndices is [1 x N] and holds the row of the target class
+    // of each column, so crossEntropy(0, j) = logSumExp(0, j) - logits(labelIndices(0, j), j). Columns whose index is outside
+    // [0, numRows), such as -1 or NaN in gaps, get a cross entropy of zero and no gradient.
+    static void SoftmaxCrossEntropyWithIndices(const Matrix<ElemType>& labelIndices, const Matrix<ElemType>& logits, Matrix<ElemType>& logSumExp, Matrix<ElemType>& crossEntropy);
+    // gradient += alpha * (softmax(logits) - onehot(labelIndices))
+    static void AddSoftmaxCrossEntropyGradientWithIndices(const Matrix<ElemType>& alpha, const Matrix<ElemType>& labelIndices, const Matrix<ElemType>& logits, const Matrix<ElemType>& logSumExp, Matrix<ElemType>& gradient);
+
     static void AddElementToElement(const Matrix<ElemType>& a, const size_t ai, const size_t aj, Matrix<ElemType>& c, const size_t ci, const size_t cj);
     // static void AddLogElementToElement(const Matrix<ElemType>& a, const size_t ai, const size_t aj, Matrix<ElemType>& c, const size_t ci, const size_t cj);
     static void AssignElementToElement(const Matrix<ElemType>& a, const size_t ai, const size_t aj, Matrix<ElemType>& c, const size_t ci, const size_t cj);
@@ -562,6 +704,10 @@ public:
                   const SmallVector<size_t>& regularOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& regularStrides,
                   const SmallVector<size_t>& reducingOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& reducingStrides);
 
+    // c[offsets.back() + i] = beta * c[...] + alpha * program(inputs[k][offsets[k] + i]...) for i < numElements; all operands are contiguous ranges
+    void FusedElementwiseOp(ElemType beta, const std::vector<const Matrix<ElemType>*>& inputs, const std::vector<size_t>& offsets, size_t numElements,
+                            const FusedElementwiseProgram& program, ElemType alpha);
+
 public:
     void Read(File& stream);
     void Write(File& stream) const;
@@ -575,6 +721,24 @@ public:
     static void ConductRowElementMultiplyWithShift(const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c, size_t shift, bool bFirstmatrixfixed);
     Matrix<ElemType>& AssignElementProductOfWithShift(const Matrix<ElemType>& a, const Matrix<ElemType>& b, size_t shift);
 
+    // Cosine similarity of each column j of q with column j of d (row 0 of c) and with column (j + shift + i - 1) % n of d (row i,
+    // 1 <= i <= negNumber), in one pass that does not form the shifted copies (see CosDistanceWithNegativeSamplesNode).
+    // invNormQ and invNormD get the inverse column norms (1 x n) for the gradient.
+    static void CosDistanceWithNegativeSamples(const Matrix<ElemType>& q, const Matrix<ElemType>& d, size_t shift, size_t negNumber,
+                                               Matrix<ElemType>& invNormQ, Matrix<ElemType>& invNormD, Matrix<ElemType>& c);
+    // add the gradient of CosDistanceWithNegativeSamples()'s c, given cGrad, with respect to q (wrtQuery) or d to grad
+    static void CosDistanceWithNegativeSamplesGradient(bool wrtQuery, const Matrix<ElemType>& q, const Matrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                       const Matrix<ElemType>& invNormQ, const Matrix<ElemType>& invNormD,
+                                                       const Matrix<ElemType>& c, const Matrix<ElemType>& cGrad, Matrix<ElemType>& grad);
+
+    // Log-likelihood (1 x T) of each column of features (d x T) under a Gaussian mixture of K components with one stddev per component
+    // (see GMMLogLikelihoodNode). unnormedPrior (K), means (d*K, the component means concatenated) and logStdDevs (K) have either one
+    // column or one per sample. For shared means the squared distances come from a GEMM, ||x - mu_c||^2 = ||x||^2 - 2 mu_c'x + ||mu_c||^2,
+    // and the log-softmax of the prior, the component log-likelihoods and the log-sum-exp over the components are fused into one pass
+    // per sample, so that nothing of size d x K x T is formed. Also returns the posteriors and ||x - mu_c||^2 / stddev_c^2 (K x T).
+    static void GMMLogLikelihood(const Matrix<ElemType>& unnormedPrior, const Matrix<ElemType>& means, const Matrix<ElemType>& logStdDevs, const Matrix<ElemType>& features,
+                                 Matrix<ElemType>& logLikelihood, Matrix<ElemType>& posterior, Matrix<ElemType>& normedDeviation);
+
 public:
     static void RCRFBackwardCompute(const Matrix<ElemType>& alpha, Matrix<ElemType>& beta,
                                     Matrix<ElemType>& functionValues, const Matrix<ElemType>& lbls,
@@ -588,6 +752,23 @@ public:
                                     const int startLbl, // the time 0 start symbol in the output layer
                                     const int shift);
 
+    // Linear-chain CRF over all sequences of a minibatch at once (see CRFNode). All matrices but pairScores have one column per frame,
+    // in the minibatch's column order; the label of a frame is the first nonzero row of lbls, and pairScores(j, i) scores label i
+    // followed by label j. Computes alpha (log forward scores), beta (log posteriors), postProb (posteriors, zero in gaps) and the
+    // negative log-likelihood of the labels of each sequence into sequenceScores (1 x #sequences).
+    static void CRFForwardBackward(const Matrix<ElemType>& lbls, const Matrix<ElemType>& posScores, const Matrix<ElemType>& pairScores,
+                                   size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                   Matrix<ElemType>& alpha, Matrix<ElemType>& beta, Matrix<ElemType>& postProb, Matrix<ElemType>& sequenceScores);
+    // add the gradient of the sum of CRFForwardBackward()'s sequenceScores with respect to pairScores to grd
+    static void CRFTransitionGradient(const Matrix<ElemType>& lbls, const Matrix<ElemType>& posScores, const Matrix<ElemType>& pairScores,
+                                      size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                      const Matrix<ElemType>& alpha, const Matrix<ElemType>& beta, Matrix<ElemType>& grd);
+    // Viterbi decoding of all sequences of a minibatch that matches CRFForwardBackward(); the labels of the first and the last frame
+    // of a sequence in lbls, if there is one, are fixed. decodedPath gets the one-hot best labels, zero in gaps.
+    static void CRFViterbiDecode(const Matrix<ElemType>& lbls, const Matrix<ElemType>& posScores, const Matrix<ElemType>& pairScores,
+                                 size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                 Matrix<ElemType>& alpha, Matrix<ElemType>& backtrace, Matrix<ElemType>& decodedPath);
+
     template <typename T>
     friend class MatrixQuantizer;
 
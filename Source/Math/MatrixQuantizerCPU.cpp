@@ -1,8 +1,221 @@
 #include "stdafx.h"
 #include "MatrixQuantizerCPU.h"
+#include <algorithm>
+#include <cstring>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// ---------------------------------------------------------------------------
+// CPU kernels for the column-wise quantization
+//
+// They produce exactly the results and the QWord layout of ColumnQuantizer: the k-th value packed into QWord w of a column
+// is row w + k * numQWordsPerCol (an interleaving chosen for collated memory access on the GPU). ColumnQuantizer walks the
+// column QWord by QWord, i.e. with a stride of numQWordsPerCol through the matrix, which defeats the caches and SIMD on the CPU.
+// Here the column is walked in k-major order instead: for a fixed k, the rows k * numQWordsPerCol + w for consecutive w are
+// consecutive in the matrix, in the residual, and in the QWord array, so the inner loops are contiguous and branch-free and
+// can be vectorized by the compiler.
+// Columns are processed in parallel with OpenMP.
+// ---------------------------------------------------------------------------
+
+static const size_t c_minElementsForParallelQuantization = 16384; // below that, the threads cost more than they save
+
+// sum over a column of f(inMat[i] + inResidual[i])
+// The sums are accumulated in row order like in ColumnQuantizer, since a different rounding of the range can move values
+// that lie on a quantization boundary into the neighboring bin.
+template <class ElemType, class AccType, class F>
+static AccType SumOverColumn(const ElemType* inMat, const ElemType* inResidual, size_t M, const F& f)
+{
+    AccType sum = 0;
+    for (size_t i = 0; i < M; i++)
+        sum += f(inMat[i] + inResidual[i]);
+    return sum;
+}
+
+// same as ColumnQuantizer::ComputeRangeStatColj()
+template <class ElemType>
+static void ComputeRangeStatColumn(const ElemType* inMat, const ElemType* inResidual, size_t M, size_t bits, bool zeroThresholdFor1Bit, ElemType& lower, ElemType& upper)
+{
+    ElemType mean = 0.0f;
+    if (!zeroThresholdFor1Bit || (bits != 1))
+        mean = SumOverColumn<ElemType, ElemType>(inMat, inResidual, M, [](ElemType val) { return val; }) / M;
+
+    if (bits == 1)
+    {
+        // the two level means, see ColumnQuantizer
+        // (the level of each value selects by arithmetic rather than by a branch, which is unpredictable for gradients)
+        ElemType meanacc0 = 0.0f, meanacc1 = 0.0f;
+        unsigned int num0 = 0;
+        for (size_t i = 0; i < M; i++)
+        {
+            ElemType val = inMat[i] + inResidual[i];
+            unsigned int isLow = val < mean;
+            ElemType toLow = meanacc0 + val, toHigh = meanacc1 + val;
+            meanacc0 = isLow ? toLow : meanacc0;
+            meanacc1 = isLow ? meanacc1 : toHigh;
+            num0 += isLow;
+        }
+        unsigned int num1 = (unsigned int) M - num0;
+
+        ElemType radius;
+        ElemType newmean;
+        if (!zeroThresholdFor1Bit)
+        {
+            ElemType devacc0 = (num0 * mean) - meanacc0;
+            ElemType devacc1 = meanacc1 - (num1 * mean);
+            ElemType dev = (devacc0 + devacc1) / M;
+            radius = 2.0f * dev;
+            newmean = mean;
+        }
+        else
+        {
+            if (num0 == 0)
+                num0 = 1;
+            if (num1 == 0)
+                num1 = 1;
+            ElemType mean0 = meanacc0 / num0;
+            ElemType mean1 = meanacc1 / num1;
+            newmean = 0.5f * (mean0 + mean1);
+            radius = 2.0f * (mean1 - newmean);
+        }
+        lower = newmean - radius;
+        upper = newmean + radius;
+    }
+    else
+    {
+        ElemType stddevs = 5.0f;
+        ElemType varacc = SumOverColumn<ElemType, ElemType>(inMat, inResidual, M, [mean](ElemType val) { return (val - mean) * (val - mean); });
+        ElemType stddev = sqrt(varacc / M);
+        lower = mean - (stddevs * stddev);
+        upper = mean + (stddevs * stddev);
+    }
+}
+
+// the parameters of ValueQuantizer, for use in the inner loops
+template <class ElemType>
+struct QuantizationParams
+{
+    typedef typename ValueQuantizer<ElemType>::QWordVal QWordVal;
+    typedef typename ValueQuantizer<ElemType>::QWordValSigned QWordValSigned;
+
+    QuantizationParams(size_t nBits, ElemType lower, ElemType upper)
+        : quantimin(lower), quantimax(upper)
+    {
+        // (as in the constructor of ValueQuantizer; not used for nBits = QWordNumBits)
+        rangeend = ((QWordVal) 1) << nBits;
+        if ((quantimax - quantimin) < 1e-36f)
+            qfactor = ufactor = (ElemType) 0.0;
+        else
+        {
+            qfactor = rangeend / (quantimax - quantimin);
+            ufactor = (quantimax - quantimin) / rangeend;
+        }
+        quantimid = 0.5f * (quantimax + quantimin);
+    }
+
+    QWordVal Quantize(ElemType u) const
+    {
+        return u <= quantimin ? 0 : u >= quantimax ? rangeend - 1 : (QWordVal)((QWordValSigned)((u - quantimin) * qfactor));
+    }
+    ElemType Unquantize(QWordVal u) const
+    {
+        return ((u + (ElemType) 0.5) * ufactor) + quantimin;
+    }
+
+    ElemType quantimin, quantimax, quantimid, qfactor, ufactor;
+    QWordVal rangeend;
+};
+
+template <class ElemType>
+static void QuantizeColumn(const ElemType* inMat, const ElemType* inResidual, size_t M, size_t nBits, bool zeroThresholdFor1Bit,
+                           ElemType lower, ElemType upper, typename ValueQuantizer<ElemType>::QWord* qColBits, ElemType* outResidual)
+{
+    typedef typename ValueQuantizer<ElemType>::QWord QWord;
+    const size_t QWordNumBits = ValueQuantizer<ElemType>::QWordNumBits;
+    const size_t numQWordsPerCol = ColumnQuantizer<ElemType>::QWordsPerCol(M, nBits);
+
+    if (nBits == QWordNumBits) // no quantization: pass the bit patterns through
+    {
+        for (size_t i = 0; i < M; i++)
+        {
+            ElemType val = inMat[i] + inResidual[i];
+            memcpy(&qColBits[i], &val, sizeof(val));
+            outResidual[i] = 0;
+        }
+        return;
+    }
+
+    const QuantizationParams<ElemType> params(nBits, lower, upper);
+    const ElemType threshold = zeroThresholdFor1Bit ? (ElemType) 0.0 : params.quantimid;
+    const ElemType val0 = params.Unquantize(0); // the two levels of 1-bit quantization
+    const ElemType val1 = params.Unquantize(1);
+    std::fill(qColBits, qColBits + numQWordsPerCol, (QWord) 0);
+    for (size_t rowBegin = 0, shift = 0; rowBegin < M; rowBegin += numQWordsPerCol, shift += nBits)
+    {
+        const size_t n = std::min(numQWordsPerCol, M - rowBegin);
+        const ElemType* in = inMat + rowBegin;
+        const ElemType* res = inResidual + rowBegin;
+        ElemType* outRes = outResidual + rowBegin;
+        if (nBits == 1)
+        {
+            const ElemType levels[2] = { val0, val1 };
+            for (size_t w = 0; w < n; w++)
+            {
+                ElemType val = in[w] + res[w];
+                QWord qval = val >= threshold;
+                qColBits[w] |= qval << shift;
+                outRes[w] = val - levels[qval];
+            }
+        }
+        else
+        {
+            for (size_t w = 0; w < n; w++)
+            {
+                ElemType val = in[w] + res[w];
+                QWord qval = params.Quantize(val);
+                qColBits[w] |= qval << shift;
+                outRes[w] = val - params.Unquantize(qval);
+            }
+        }
+    }
+}
+
+template <class ElemType>
+static void UnquantizeColumn(const typename ValueQuantizer<ElemType>::QWord* qColBits, size_t M, size_t nBits, ElemType lower, ElemType upper, ElemType* outMat, bool add)
+{
+    typedef typename ValueQuantizer<ElemType>::QWord QWord;
+    const size_t QWordNumBits = ValueQuantizer<ElemType>::QWordNumBits;
+    const size_t numQWordsPerCol = ColumnQuantizer<ElemType>::QWordsPerCol(M, nBits);
+
+    if (nBits == QWordNumBits)
+    {
+        for (size_t i = 0; i < M; i++)
+        {
+            ElemType val;
+            memcpy(&val, &qColBits[i], sizeof(val));
+            outMat[i] = add ? outMat[i] + val : val;
+        }
+        return;
+    }
+
+    const QuantizationParams<ElemType> params(nBits, lower, upper);
+    const QWord bitmask = params.rangeend - 1;
+    for (size_t rowBegin = 0, shift = 0; rowBegin < M; rowBegin += numQWordsPerCol, shift += nBits)
+    {
+        const size_t n = std::min(numQWordsPerCol, M - rowBegin);
+        ElemType* out = outMat + rowBegin;
+        if (add)
+        {
+            for (size_t w = 0; w < n; w++)
+                out[w] += params.Unquantize((qColBits[w] >> shift) & bitmask);
+        }
+        else
+        {
+            for (size_t w = 0; w < n; w++)
+                out[w] = params.Unquantize((qColBits[w] >> shift) & bitmask);
+        }
+    }
+}
+
 template <class ElemType>
 MatrixQuantizerCPU<ElemType>::MatrixQuantizerCPU()
     : MatrixQuantizerImpl<ElemType>(CPUDEVICE)
@@ -26,40 +239,18 @@ void MatrixQuantizerCPU<ElemType>::QuantizeAsync(const Matrix<ElemType>& inMatri
     assert((inResidual.GetNumRows() == nRow) && (inResidual.GetNumCols() == nCol));
     assert((outResidual.GetNumRows() == nRow) && (outResidual.GetNumCols() == nCol));
 
-    const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
-#ifdef QUANTUSEPPL
-    Concurrency::parallel_for((size_t) 0, us.cols(), [&](size_t j)
-#else
-    for (size_t j = 0; j < nCol; j++)
-#endif
-                              {
-                                  auto& qcol = *(outQMatrix.GetQuantizedColumn(j));
-                                  if (zeroThresholdFor1Bit)
-                                  {
-                                      // Explicit use of 'template' keyword is needed to compile with GCC
-                                      ColumnQuantizer<ElemType>::template ComputeRangeStatColj<true>(inMatrix.Data(), inResidual.Data(), (long) nRow, j, nBits, qcol.lower, qcol.upper);
-                                  }
-                                  else
-                                  {
-                                      // Explicit use of 'template' keyword is needed to compile with GCC
-                                      ColumnQuantizer<ElemType>::template ComputeRangeStatColj<false>(inMatrix.Data(), inResidual.Data(), (long) nRow, j, nBits, qcol.lower, qcol.upper);
-                                  }
-
-                                  ColumnQuantizer<ElemType> q(ldNbits, qcol.lower, qcol.upper);
-                                  if (zeroThresholdFor1Bit)
-                                  {
-                                      // Explicit use of 'template' keyword is needed to compile with GCC
-                                      q.template Quantize<true>(inMatrix.Data(), inResidual.Data(), (long) nRow, j, qcol.bits, outResidual.Data());
-                                  }
-                                  else
-                                  {
-                                      // Explicit use of 'template' keyword is needed to compile with GCC
-                                      q.template Quantize<false>(inMatrix.Data(), inResidual.Data(), (long) nRow, j, qcol.bits, outResidual.Data());
-                                  }
-                              }
-#ifdef QUANTUSEPPL
-                              );
-#endif
+    ValueQuantizer<ElemType>::ld(nBits); // (validates nBits)
+    const ElemType* inData = inMatrix.Data();
+    const ElemType* inResidualData = inResidual.Data();
+    ElemType* outResidualData = outResidual.Data();
+#pragma omp parallel for schedule(static) if (nRow * nCol >= c_minElementsForParallelQuantization)
+    for (long j = 0; j < (long) nCol; j++)
+    {
+        auto& qcol = *(outQMatrix.GetQuantizedColumn(j));
+        size_t offset = j * nRow;
+        ComputeRangeStatColumn(inData + offset, inResidualData + offset, nRow, nBits, zeroThresholdFor1Bit, qcol.lower, qcol.upper);
+        QuantizeColumn(inData + offset, inResidualData + offset, nRow, nBits, zeroThresholdFor1Bit, qcol.lower, qcol.upper, qcol.bits, outResidualData + offset);
+    }
 }
 
 template <class ElemType>
@@ -68,7 +259,7 @@ void MatrixQuantizerCPU<ElemType>::WaitQuantizeAsyncDone()
     // TODO: Currently this is a no-op since the actual quantization is synchronous
 }
 
-// unquantize an entire matrix, calling unquantize() for each column
+// unquantize an entire matrix, column by column
 template <class ElemType>
 void MatrixQuantizerCPU<ElemType>::UnquantizeAsync(QuantizedMatrix<ElemType>& inQMatrix, Matrix<ElemType>& outMatrix, bool add /*= false*/)
 {
@@ -83,20 +274,14 @@ void MatrixQuantizerCPU<ElemType>::UnquantizeAsync(QuantizedMatrix<ElemType>& in
     // Verify that the different matrix parameters have matching dimensions
     assert((outMatrix.GetNumRows() == nRow) && (outMatrix.GetNumCols() == nCol));
 
-    const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
-#ifdef QUANTUSEPPL
-    Concurrency::parallel_for((size_t) 0, us.cols(), [&](size_t j)
-#else
-    for (size_t j = 0; j < nCol; j++)
-#endif
-                              {
-                                  const auto& qcol = *(inQMatrix.GetQuantizedColumn(j));
-                                  ColumnQuantizer<ElemType> q(ldNbits, qcol.lower, qcol.upper);
-                                  q.Unquantize(outMatrix.Data(), (long) nRow, j, qcol.bits, add);
-                              }
-#ifdef QUANTUSEPPL
-                              );
-#endif
+    ValueQuantizer<ElemType>::ld(nBits); // (validates nBits)
+    ElemType* outData = outMatrix.Data();
+#pragma omp parallel for schedule(static) if (nRow * nCol >= c_minElementsForParallelQuantization)
+    for (long j = 0; j < (long) nCol; j++)
+    {
+        const auto& qcol = *(inQMatrix.GetQuantizedColumn(j));
+        UnquantizeColumn(qcol.bits, nRow, nBits, qcol.lower, qcol.upper, outData + j * nRow, add);
+    }
 }
 
 template <class ElemType>
@@ -0,0 +1,81 @@
+#include "stdafx.h"
+#include "NcclComm.h"
+#include "BestGpu.h" // for CPUONLY
+#if !defined(CPUONLY) && defined(USE_NCCL)
+#include "GPUMatrix.h" // for GetStream()
+#include <cuda_runtime_api.h>
+#include <nccl.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#if !defined(CPUONLY) && defined(USE_NCCL)
+
+static void NcclCheck(ncclResult_t rc, const char* what)
+{
+    if (rc != ncclSuccess)
+        RuntimeError("NcclComm: %s failed: %s", what, ncclGetErrorString(rc));
+}
+
+template <class ElemType> static ncclDataType_t NcclDataType();
+template <> ncclDataType_t NcclDataType<float>()  { return ncclFloat; }
+template <> ncclDataType_t NcclDataType<double>() { return ncclDouble; }
+
+NcclComm::NcclComm(int deviceId, size_t rank, size_t numRanks, const std::function<void(void* data, size_t size)>& broadcastFromRank0)
+    : m_ncclComm(nullptr), m_deviceId(deviceId)
+{
+    ncclUniqueId ncclId;
+    if (rank == 0)
+        NcclCheck(ncclGetUniqueId(&ncclId), "ncclGetUniqueId");
+    broadcastFromRank0(&ncclId, sizeof(ncclId));
+
+    cudaSetDevice(m_deviceId);
+    NcclCheck(ncclCommInitRank(&m_ncclComm, (int) numRanks, ncclId, (int) rank), "ncclCommInitRank");
+}
+
+NcclComm::~NcclComm()
+{
+    if (m_ncclComm != nullptr)
+        ncclCommDestroy(m_ncclComm);
+}
+
+/*static*/ bool NcclComm::IsAvailable()
+{
+    return true;
+}
+
+template <class ElemType>
+void NcclComm::AllReduce(ElemType* gpuBuffer, size_t numElements)
+{
+    cudaSetDevice(m_deviceId);
+    NcclCheck(ncclAllReduce(gpuBuffer, gpuBuffer, numElements, NcclDataType<ElemType>(), ncclSum, m_ncclComm, GetStream()), "ncclAllReduce");
+}
+
+#else
+// Dummy definitions when compiling without NCCL
+NcclComm::NcclComm(int, size_t, size_t, const std::function<void(void* data, size_t size)>&)
+    : m_ncclComm(nullptr), m_deviceId(-1)
+{
+    RuntimeError("NcclComm: This build of CNTK does not support NCCL.");
+}
+
+NcclComm::~NcclComm()
+{
+}
+
+/*static*/ bool NcclComm::IsAvailable()
+{
+    return false;
+}
+
+template <class ElemType>
+void NcclComm::AllReduce(ElemType*, size_t)
+{
+    LogicError("NcclComm: This build of CNTK does not support NCCL.");
+}
+#endif
+
+template MATH_API void NcclComm::AllReduce<float>(float*, size_t);
+template MATH_API void NcclComm::AllReduce<double>(double*, size_t);
+
+}}}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Basics.h"
+#include <functional>
+
+struct ncclComm; // (from nccl.h, which users of this header do not need)
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+// -----------------------------------------------------------------------
+// NcclComm -- sum of GPU buffers over all workers with NVIDIA NCCL
+//
+// The buffers are reduced in GPU memory, over NVLink or P2P within a node, instead of being staged in host memory.
+// Each worker uses one GPU. The reductions are issued on the compute stream, so they follow the computation of the
+// buffers and precede their use without any wait on the host. Only available if built with NCCL (USE_NCCL).
+// -----------------------------------------------------------------------
+
+class MATH_API NcclComm
+{
+public:
+    // The communicator is identified by an id that worker 0 creates; broadcastFromRank0(data, size) must send it to the
+    // others, e.g. with MPIWrapper::Bcast().
+    NcclComm(int deviceId, size_t rank, size_t numRanks, const std::function<void(void* data, size_t size)>& broadcastFromRank0);
+    ~NcclComm();
+
+    DISABLE_COPY_AND_MOVE(NcclComm);
+
+    // whether this build supports NCCL
+    static bool IsAvailable();
+
+    // in-place sum of gpuBuffer over all workers, queued on the compute stream
+    template <class ElemType>
+    void AllReduce(ElemType* gpuBuffer, size_t numElements);
+
+private:
+    ncclComm* m_ncclComm;
+    int m_deviceId;
+};
+
+}}}
@@ -232,6 +232,11 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const GPUSpars
 {
 }
 
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::ScaleAndAddOnBlocks(const ElemType alpha, const GPUMatrix<ElemType>& lhs, GPUSparseMatrix<ElemType>& rhs)
+{
+}
+
 template <class ElemType>
 GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::InplaceTruncate(const ElemType threshold)
 {
@@ -782,6 +787,16 @@ void GPUMatrix<ElemType>::CopySection(size_t numRows, size_t numCols, ElemType*
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SetElements(size_t firstElement, size_t numElements, const ElemType* src)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SetValueFromOtherDevice(const GPUMatrix<ElemType>& src)
+{
+}
+
 //memory will be allocated by the callee if not enough but need to be deleted by the caller after it's done
 //return number of elements copied
 template <class ElemType>
@@ -958,7 +973,13 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoGatherColumnsOf(ElemType beta, const
 }
 
 template <class ElemType>
-GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, const GPUMatrix<ElemType>& m, const GPUMatrix<ElemType>& a, ElemType alpha)
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, const GPUMatrix<ElemType>& m, const GPUMatrix<ElemType>& a, ElemType alpha, bool idxIsUnique)
+{
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPackedIndicesOf(const GPUMatrix<ElemType>& index, const GPUMatrix<ElemType>& sequenceMap, size_t numParallelSequences)
 {
     return *this;
 }
@@ -1017,6 +1038,11 @@ void GPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, i
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SetValueFromCompact(const size_t numRows, const size_t numCols, const void* data, CompactElementType type, ElemType scale, const GPUMatrix<ElemType>* offset, size_t matrixFlags)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::SetDiagonalValue(const ElemType v)
 {
@@ -1044,11 +1070,44 @@ void GPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SetCounterBasedUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& seed)
+{
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignElementProductOfUniformRandomMask(const GPUMatrix<ElemType>& /*a*/, const ElemType maskRate, const ElemType scaleValue,
+                                                                                  const uint64_t seed, const uint64_t firstCounter, const size_t elementOffset, const ElemType beta)
+{
+    return *this;
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SetCounterBasedUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SetCounterBasedGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed)
+{
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
     return 0;
 }
+template <class ElemType>
+/*static*/ void GPUMatrix<ElemType>::MultiTensorNormalGrad(const std::vector<GPUMatrix<ElemType>*>& smoothedGradients,
+                                                          const std::vector<GPUMatrix<ElemType>*>& gradients,
+                                                          const std::vector<GPUMatrix<ElemType>*>& functionValues,
+                                                          const std::vector<ElemType>& learnRatesPerSample,
+                                                          const ElemType momentum, const bool useNesterovMomentum,
+                                                          const ElemType clippingThreshold, const bool clipByTruncation,
+                                                          const ElemType l2RegWeight, const ElemType l1RegWeight)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::FSAdagrad(GPUMatrix<ElemType>& gradients, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul)
 {
@@ -1292,6 +1351,12 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::InplaceSigmoid()
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::InplaceAddColumnAndActivation(const GPUMatrix<ElemType>& /*bias*/, ElementWiseOperator /*activation*/)
+{
+    return *this;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignSigmoidOf(const GPUMatrix<ElemType>& /*a*/)
 {
@@ -1346,6 +1411,12 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignHardmaxOf(const GPUMatrix<ElemTy
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignTopNHardmaxOf(const GPUMatrix<ElemType>& /*a*/, const size_t /*n*/)
+{
+    return *this;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::DropFrame(const GPUMatrix<ElemType>& label, const GPUMatrix<ElemType>& gamma, const ElemType& threshhold)
 {
@@ -1470,6 +1541,12 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::SetToZeroIfAbsLessThan(const ElemType
     return *this;
 }
 
+template <class ElemType>
+size_t GPUMatrix<ElemType>::ExtractAbsAboveThreshold(const ElemType threshold, size_t capacity, int* indices, ElemType* values)
+{
+    return 0;
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::SumOfAbsElements() const
 {
@@ -1537,6 +1614,26 @@ void GPUMatrix<ElemType>::ConductRowElementMultiplyWithShift(const GPUMatrix<Ele
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::CosDistanceWithNegativeSamples(const GPUMatrix<ElemType>& q, const GPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                         GPUMatrix<ElemType>& invNormQ, GPUMatrix<ElemType>& invNormD, GPUMatrix<ElemType>& c)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CosDistanceWithNegativeSamplesGradient(bool wrtQuery, const GPUMatrix<ElemType>& q, const GPUMatrix<ElemType>& d, size_t shift, size_t negNumber,
+                                                                 const GPUMatrix<ElemType>& invNormQ, const GPUMatrix<ElemType>& invNormD,
+                                                                 const GPUMatrix<ElemType>& c, const GPUMatrix<ElemType>& cGrad, GPUMatrix<ElemType>& grad)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::GMMLogLikelihood(const GPUMatrix<ElemType>& unnormedPrior, const GPUMatrix<ElemType>& means, const GPUMatrix<ElemType>& logStdDevs, const GPUMatrix<ElemType>& features,
+                                           const GPUMatrix<ElemType>& products, const GPUMatrix<ElemType>& meanSquaredNorms,
+                                           GPUMatrix<ElemType>& logLikelihood, GPUMatrix<ElemType>& posterior, GPUMatrix<ElemType>& normedDeviation)
+{
+}
+
 template <class ElemType>
 DeviceBoundNumber<ElemType> GPUMatrix<ElemType>::Sum_AsDeviceBoundNum() const
 {
@@ -1679,6 +1776,18 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignSignOf(const GPUMatrix<ElemType>
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignCompressedOf(const GPUMatrix<ElemType>& /*a*/, CompactElementType /*type*/)
+{
+    return *this;
+}
+
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignDecompressedOf(const GPUMatrix<ElemType>& /*compressed*/, size_t /*numRows*/, CompactElementType /*type*/)
+{
+    return *this;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddSignOf(const GPUMatrix<ElemType>& /*a*/)
 {
@@ -1706,6 +1815,12 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignNumOfDiff(const GPUMatrix<ElemTy
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignNumOfTopKErrors(const GPUMatrix<ElemType>& /*labels*/, const GPUMatrix<ElemType>& /*predictions*/, int /*topK*/, bool /*classIndexLabels*/, const GPUMatrix<char>* /*columnsMask*/)
+{
+    return *this;
+}
+
 #pragma endregion Member BLAS Functions
 
 #pragma region Other helper functions
@@ -1851,6 +1966,12 @@ void GPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const GPUMat
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::BatchMatMul(ElemType alpha, const GPUMatrix<ElemType>& /*a*/, const size_t aRows, const bool transposeA, const GPUMatrix<ElemType>& /*b*/, const size_t bRows, const bool transposeB,
+                                      ElemType beta, GPUMatrix<ElemType>& c)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::MultiplyAndAdd(const GPUMatrix<ElemType>& /*a*/, const bool transposeA, const GPUMatrix<ElemType>& /*b*/, const bool transposeB, GPUMatrix<ElemType>& c)
 {
@@ -1935,6 +2056,26 @@ void GPUMatrix<ElemType>::AssignScaledDifference(const GPUMatrix<ElemType>& /*al
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::SoftmaxCrossEntropy(const GPUMatrix<ElemType>& /*labels*/, const GPUMatrix<ElemType>& /*logits*/, GPUMatrix<ElemType>& /*logSumExp*/, GPUMatrix<ElemType>& /*crossEntropy*/)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradient(const GPUMatrix<ElemType>& /*alpha*/, const GPUMatrix<ElemType>& /*labels*/, const GPUMatrix<ElemType>& /*logits*/, const GPUMatrix<ElemType>& /*logSumExp*/, GPUMatrix<ElemType>& /*gradient*/)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::SoftmaxCrossEntropyWithIndices(const GPUMatrix<ElemType>& /*labelIndices*/, const GPUMatrix<ElemType>& /*logits*/, GPUMatrix<ElemType>& /*logSumExp*/, GPUMatrix<ElemType>& /*crossEntropy*/)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AddSoftmaxCrossEntropyGradientWithIndices(const GPUMatrix<ElemType>& /*alpha*/, const GPUMatrix<ElemType>& /*labelIndices*/, const GPUMatrix<ElemType>& /*logits*/, const GPUMatrix<ElemType>& /*logSumExp*/, GPUMatrix<ElemType>& /*gradient*/)
+{
+}
+
 //c[ci,cj] += a[ai,aj]
 template <class ElemType>
 void GPUMatrix<ElemType>::AddElementToElement(ElemType beta, const GPUMatrix<ElemType>& /*a*/, const size_t ai, const size_t aj, GPUMatrix<ElemType>& c, const size_t ci, const size_t cj)
@@ -2017,6 +2158,12 @@ void GPUMatrix<ElemType>::TensorOp(ElemType beta, const GPUMatrix<ElemType>& a,
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::FusedElementwiseOp(ElemType beta, const std::vector<const GPUMatrix<ElemType>*>& inputs, const std::vector<size_t>& offsets, size_t numElements,
+                                             const FusedElementwiseProgram& program, ElemType alpha)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::CreateCurandObject(unsigned long seed, const char* caller)
 {
@@ -2093,6 +2240,27 @@ void GPUMatrix<ElemType>::RCRFTransGrdCompute(const GPUMatrix<ElemType>& lbls,
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFForwardBackward(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                             size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                             GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& beta, GPUMatrix<ElemType>& postProb, GPUMatrix<ElemType>& sequenceScores)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFTransitionGradient(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                                size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                                const GPUMatrix<ElemType>& alpha, const GPUMatrix<ElemType>& beta, GPUMatrix<ElemType>& grd)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CRFViterbiDecode(const GPUMatrix<ElemType>& lbls, const GPUMatrix<ElemType>& posScores, const GPUMatrix<ElemType>& pairScores,
+                                           size_t numParallelSequences, const std::vector<SequenceInMinibatch>& sequences,
+                                           GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& backtrace, GPUMatrix<ElemType>& decodedPath)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::AssignNoiseContrastiveEstimation(const GPUMatrix<ElemType>& a,
                                                            const GPUMatrix<ElemType>& b, const GPUMatrix<ElemType>& bias, size_t sampleCount, GPUMatrix<ElemType>& tmp, GPUMatrix<ElemType>& c)
@@ -2206,7 +2374,7 @@ void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUAsync()
 #pragma region GPURNGHandle functions
 
 GPURNGHandle::GPURNGHandle(int deviceId, unsigned long seed)
-    : RNGHandle(deviceId)
+    : RNGHandle(deviceId, seed)
 {
 }
 
@@ -2230,9 +2398,6 @@ template void MatrixQuantizerGPU<double>::QuantizeAsync(const Matrix<double>&, c
 template class GPUDataTransferer<float>;
 template class GPUDataTransferer<double>;
 
-template <class ElemType>
-cublasHandle_t GPUMatrix<ElemType>::s_cuHandle[GPUMatrix<ElemType>::MaxGpus] = {0};
-
 template <class ElemType>
 void* GPUMatrix<ElemType>::s_curandGenerator = NULL;
 
@@ -2262,6 +2427,21 @@ std::unique_ptr<BatchNormEngine<ElemType>> CuDnnBatchNormEngineFactory<ElemType>
 template class CuDnnBatchNormEngineFactory<float>;
 template class CuDnnBatchNormEngineFactory<double>;
 
+template <class ElemType>
+std::unique_ptr<RNNEngine<ElemType>> CuDnnRNNEngineFactory<ElemType>::Create(DEVICEID_TYPE, const RNNAttributes&, size_t)
+{
+    RuntimeError("The code is compiled with CPUONLY macro.");
+}
+
+template <class ElemType>
+bool CuDnnRNNEngineFactory<ElemType>::IsSupported(DEVICEID_TYPE)
+{
+    return false;
+}
+
+template class CuDnnRNNEngineFactory<float>;
+template class CuDnnRNNEngineFactory<double>;
+
 CudaTimer::~CudaTimer()
 {
 }
@@ -2276,6 +2456,106 @@ float CudaTimer::Elapsed()
     return 0;
 }
 
+void TracingGPUMemoryAllocator::ReleaseCachedMemory(int deviceId)
+{
+}
+
+GPUMemoryCacheStatistics TracingGPUMemoryAllocator::GetCacheStatistics(int deviceId)
+{
+    return GPUMemoryCacheStatistics();
+}
+
+void TracingGPUMemoryAllocator::ResetPeakInUseBytes(int deviceId)
+{
+}
+
+GPUStream::GPUStream(DEVICEID_TYPE deviceId)
+    : m_deviceId(deviceId), m_stream(nullptr)
+{
+}
+GPUStream::~GPUStream()
+{
+}
+void GPUStream::MakeCurrent() const
+{
+}
+/*static*/ void GPUStream::MakeDefaultCurrent()
+{
+}
+void GPUStream::Synchronize() const
+{
+}
+
+GPUEvent::GPUEvent(DEVICEID_TYPE deviceId, bool enableTiming)
+    : m_deviceId(deviceId), m_event(nullptr)
+{
+}
+GPUEvent::~GPUEvent()
+{
+}
+void GPUEvent::Record()
+{
+}
+void GPUEvent::MakeCurrentStreamWait() const
+{
+}
+void GPUEvent::Synchronize() const
+{
+}
+float GPUEvent::ElapsedMillisecondsSince(const GPUEvent& start) const
+{
+    return 0;
+}
+
+GPUGraph::GPUGraph(DEVICEID_TYPE deviceId)
+    : m_deviceId(deviceId), m_stream(nullptr), m_graph(nullptr), m_heldBuffers(nullptr)
+{
+}
+GPUGraph::~GPUGraph()
+{
+}
+/*static*/ bool GPUGraph::IsSupported()
+{
+    return false;
+}
+void GPUGraph::BeginCapture()
+{
+}
+bool GPUGraph::EndCapture()
+{
+    return false;
+}
+void GPUGraph::Replay() const
+{
+}
+
+PrefetchGPUDataTransferer::PrefetchGPUDataTransferer(DEVICEID_TYPE deviceId, size_t numPinnedBuffers)
+    : m_deviceId(deviceId), m_currentSlot(0), m_copyStream(nullptr), m_consumedEvent(nullptr), m_allocatedEvent(nullptr)
+{
+}
+PrefetchGPUDataTransferer::~PrefetchGPUDataTransferer()
+{
+}
+void PrefetchGPUDataTransferer::BeginBatch()
+{
+}
+const void* PrefetchGPUDataTransferer::CopyCPUToGPUAsync(size_t, const void*, size_t, bool)
+{
+    return nullptr;
+}
+void PrefetchGPUDataTransferer::EndBatch()
+{
+}
+void PrefetchGPUDataTransferer::WaitForHostBuffersReleased()
+{
+}
+void PrefetchGPUDataTransferer::WaitForCopyCPUToGPUAsync()
+{
+}
+void PrefetchGPUDataTransferer::RecordBuffersConsumed()
+{
+}
+
 } } }
 
 // define a dummy GPUWatcher class too
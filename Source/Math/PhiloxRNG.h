@@ -0,0 +1,86 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PhiloxRNG.h -- counter-based random number generator Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC 2011)
+//
+// Each 128-bit counter value is mapped to four independent 32-bit random numbers by a keyed bijection, so the
+// i-th random number of a stream can be computed directly, without generating the ones before it. This makes the
+// results independent of how the work is split across CPU threads or CUDA threads. Shared by the CPU and the GPU code.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#pragma push_macro("PHILOX_DECL")
+#ifdef __CUDACC__
+#define PHILOX_DECL __host__ __device__ inline
+#else
+#define PHILOX_DECL static inline
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct PhiloxValues
+{
+    uint32_t v[4];
+};
+
+PHILOX_DECL void PhiloxMulHiLo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+{
+    uint64_t product = (uint64_t) a * b;
+    hi = (uint32_t) (product >> 32);
+    lo = (uint32_t) product;
+}
+
+// returns the four random numbers for the given counter and key
+PHILOX_DECL PhiloxValues Philox4x32(uint64_t counterLow, uint64_t counterHigh, uint64_t key)
+{
+    const uint32_t multiplier0 = 0xD2511F53, multiplier1 = 0xCD9E8D57;
+    const uint32_t weyl0 = 0x9E3779B9, weyl1 = 0xBB67AE85;
+
+    uint32_t c0 = (uint32_t) counterLow, c1 = (uint32_t) (counterLow >> 32);
+    uint32_t c2 = (uint32_t) counterHigh, c3 = (uint32_t) (counterHigh >> 32);
+    uint32_t k0 = (uint32_t) key, k1 = (uint32_t) (key >> 32);
+    for (int round = 0; round < 10; round++)
+    {
+        uint32_t hi0, lo0, hi1, lo1;
+        PhiloxMulHiLo(multiplier0, c0, hi0, lo0);
+        PhiloxMulHiLo(multiplier1, c2, hi1, lo1);
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += weyl0;
+        k1 += weyl1;
+    }
+    PhiloxValues res = {{c0, c1, c2, c3}};
+    return res;
+}
+
+// maps a 32-bit random number to [0, 1) with 24 bits of precision, so that the result is exact in float
+PHILOX_DECL float PhiloxToUniform(uint32_t x)
+{
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// maps the four random numbers to four standard normal ones, by two Box-Muller transforms
+// (CPU and GPU agree up to the rounding of their log/sin/cos)
+PHILOX_DECL void PhiloxToGaussian(const PhiloxValues& r, float g[4])
+{
+    for (int k = 0; k < 4; k += 2)
+    {
+        float u1 = 1.0f - PhiloxToUniform(r.v[k]); // (0, 1], so that the log is finite
+        float u2 = PhiloxToUniform(r.v[k + 1]);
+        float radius = sqrtf(-2.0f * logf(u1));
+        float angle = 6.283185307f * u2;
+        g[k] = radius * cosf(angle);
+        g[k + 1] = radius * sinf(angle);
+    }
+}
+
+}}}
+
+#pragma pop_macro("PHILOX_DECL")
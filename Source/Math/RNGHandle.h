@@ -9,6 +9,7 @@
 
 #include "CommonMatrix.h"
 #include <memory>
+#include <stdint.h>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -24,14 +25,31 @@ public:
         return m_deviceId;
     }
 
+    // State of the counter-based generator (see PhiloxRNG.h), which is used for random masks on both CPU and GPU:
+    // the seed is the key, and every call consumes a contiguous range of counter values.
+    uint64_t Seed() const
+    {
+        return m_seed;
+    }
+
+    // reserves the next 'count' counter values and returns the first one
+    uint64_t ReserveCounters(uint64_t count)
+    {
+        uint64_t first = m_counter;
+        m_counter += count;
+        return first;
+    }
+
 protected:
-    RNGHandle(DEVICEID_TYPE deviceId)
-        : m_deviceId(deviceId)
+    RNGHandle(DEVICEID_TYPE deviceId, unsigned long seed)
+        : m_deviceId(deviceId), m_seed(seed), m_counter(0)
     {}
 
 private:
 
     DEVICEID_TYPE m_deviceId;
+    uint64_t m_seed;
+    uint64_t m_counter;
 };
 
 }}}
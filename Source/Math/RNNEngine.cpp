@@ -0,0 +1,490 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "RNNEngine.h"
+#include "CuDnnFactories.h"
+#include <algorithm>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+void RNNEngine<ElemType>::Forward(const Mat& in, const Mat& weights, Mat& out, size_t numParallelSequences, const std::vector<RNNSequence>& sequences, Mat& reserve)
+{
+    assert(in.GetNumRows() == m_inputDim);
+    assert(out.GetNumRows() == m_attributes.GetOutputDim());
+    assert(in.GetNumCols() == out.GetNumCols());
+    assert(numParallelSequences > 0 && in.GetNumCols() % numParallelSequences == 0);
+    if (weights.GetNumElements() != m_attributes.GetNumParameters(m_inputDim))
+        InvalidArgument("RNNEngine: The weights have %d elements, but %d are needed.", (int) weights.GetNumElements(), (int) m_attributes.GetNumParameters(m_inputDim));
+
+    EnsureCompatible();
+    ForwardCore(in, weights, out, numParallelSequences, sequences, reserve);
+}
+
+template <class ElemType>
+void RNNEngine<ElemType>::BackwardData(const Mat& out, const Mat& outGrad, const Mat& weights, Mat& inGrad, Mat& reserve)
+{
+    assert(out.GetNumRows() == outGrad.GetNumRows() && out.GetNumCols() == outGrad.GetNumCols());
+    assert(inGrad.IsEmpty() || (inGrad.GetNumRows() == m_inputDim && inGrad.GetNumCols() == out.GetNumCols()));
+
+    EnsureCompatible();
+    BackwardDataCore(out, outGrad, weights, inGrad, reserve);
+}
+
+template <class ElemType>
+void RNNEngine<ElemType>::BackwardWeights(const Mat& in, const Mat& out, Mat& weightsGrad, Mat& reserve)
+{
+    assert(in.GetNumCols() == out.GetNumCols());
+    assert(weightsGrad.GetNumElements() == m_attributes.GetNumParameters(m_inputDim));
+
+    EnsureCompatible();
+    BackwardWeightsCore(in, out, weightsGrad, reserve);
+}
+
+//-------------------------------------------------------------
+// Engine that runs on any device with matrix operations: the input contribution of all frames is one GEMM
+// per gate; the recurrence is a loop over time steps, each processing all parallel sequences at once.
+//-------------------------------------------------------------
+template <class ElemType>
+class GemmRNNEngine : public RNNEngine<ElemType>
+{
+public:
+    using Base = RNNEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    GemmRNNEngine(DEVICEID_TYPE deviceId, const RNNAttributes& attributes, size_t inputDim)
+        : Base(deviceId, attributes, inputDim),
+        m_numParallelSequences(0), m_numTimeSteps(0), m_hasGaps(false),
+        m_validMask(deviceId), m_continueMasks{ Matrix<char>(deviceId), Matrix<char>(deviceId) },
+        m_hPrev(deviceId), m_cPrev(deviceId), m_dh(deviceId), m_dc(deviceId), m_dhNext(deviceId), m_dcNext(deviceId),
+        m_tmp(deviceId), m_tmp2(deviceId), m_dY(deviceId), m_dX(deviceId), m_dH(deviceId), m_x(deviceId), m_hPrevAll(deviceId), m_ones(deviceId)
+    {
+    }
+
+protected:
+    using Base::m_deviceId;
+    using Base::m_attributes;
+    using Base::m_inputDim;
+
+    void EnsureCompatible() override
+    {
+    }
+
+    void ForwardCore(const Mat& in, const Mat& weights, Mat& out, size_t numParallelSequences, const std::vector<RNNSequence>& sequences, Mat& reserve) override
+    {
+        size_t H = m_attributes.m_hiddenSize;
+        m_numParallelSequences = numParallelSequences;
+        m_numTimeSteps = in.GetNumCols() / numParallelSequences;
+        PrepareSequenceMasks(sequences);
+        reserve.Resize(H, GetNumReserveColumns());
+
+        for (size_t l = 0; l < m_attributes.m_numLayers; l++)
+        {
+            Mat x = l == 0 ? in.AsReference() : LayerOutput(reserve, l - 1);
+            for (size_t d = 0; d < m_attributes.GetNumDirections(); d++)
+                ForwardDirection(x, weights, l, d, reserve);
+
+            Mat y = l + 1 < m_attributes.m_numLayers ? LayerOutput(reserve, l) : out.AsReference();
+            for (size_t d = 0; d < m_attributes.GetNumDirections(); d++)
+                y.AssignToRowSliceValuesOf(Hidden(reserve, l, d), d * H, H);
+        }
+        if (m_hasGaps)
+            out.MaskColumnsValue(m_validMask, 0);
+    }
+
+    void BackwardDataCore(const Mat& /*out*/, const Mat& outGrad, const Mat& weights, Mat& inGrad, Mat& reserve) override
+    {
+        size_t H = m_attributes.m_hiddenSize;
+        m_dY.SetValue(outGrad);
+        if (m_hasGaps)
+            m_dY.MaskColumnsValue(m_validMask, 0);
+
+        for (size_t l = m_attributes.m_numLayers; l-- > 0;)
+        {
+            for (size_t d = 0; d < m_attributes.GetNumDirections(); d++)
+            {
+                m_dH.AssignRowSliceValuesOf(m_dY, d * H, H);
+                BackwardDirection(m_dH, weights, l, d, reserve);
+            }
+            if (l == 0 && inGrad.IsEmpty())
+                break;
+
+            // the gradient of the layer input, which is the output of the layer below
+            if (l > 0)
+            {
+                m_dX.Resize(m_attributes.GetOutputDim(), GetNumColumns());
+                m_dX.SetValue(0);
+            }
+            Mat& dx = l > 0 ? m_dX : inGrad;
+            for (size_t d = 0; d < m_attributes.GetNumDirections(); d++)
+            {
+                for (size_t g = 0; g < m_attributes.GetNumGates(); g++)
+                    Mat::MultiplyAndAdd(InputWeights(weights, l, d, g), false, GatesGrad(reserve, l, d, g), false, dx);
+            }
+            if (l > 0)
+                m_dY.SetValue(m_dX);
+        }
+    }
+
+    void BackwardWeightsCore(const Mat& in, const Mat& /*out*/, Mat& weightsGrad, Mat& reserve) override
+    {
+        bool lstm = m_attributes.m_kind == RNNKind::LSTM;
+        m_ones.Resize(GetNumColumns(), 1);
+        m_ones.SetValue(1);
+
+        for (size_t l = 0; l < m_attributes.m_numLayers; l++)
+        {
+            // gaps of the input may hold anything, even NaNs, which the zero gradients of the gaps would not cancel
+            Mat layerInput = l == 0 ? in.AsReference() : LayerOutput(reserve, l - 1);
+            if (l == 0 && m_hasGaps)
+            {
+                m_x.SetValue(in);
+                m_x.MaskColumnsValue(m_validMask, 0);
+            }
+            const Mat& x = (l == 0 && m_hasGaps) ? m_x : layerInput;
+
+            for (size_t d = 0; d < m_attributes.GetNumDirections(); d++)
+            {
+                GetAllPreviousStates(Hidden(reserve, l, d), d, m_hPrevAll);
+                for (size_t g = 0; g < m_attributes.GetNumGates(); g++)
+                {
+                    Mat dGate = GatesGrad(reserve, l, d, g);
+                    // the recurrent part of the GRU hidden gate has a gradient of its own, as it is applied after the reset gate
+                    Mat dRecurrent = (!lstm && g == 2) ? CellsGrad(reserve, l, d) : dGate.AsReference();
+
+                    Mat dW = InputWeights(weightsGrad, l, d, g);
+                    Mat dR = RecurrentWeights(weightsGrad, l, d, g);
+                    Mat dbW = InputBias(weightsGrad, l, d, g);
+                    Mat dbR = RecurrentBias(weightsGrad, l, d, g);
+                    Mat::MultiplyAndAdd(x, false, dGate, true, dW);
+                    Mat::MultiplyAndAdd(m_hPrevAll, false, dRecurrent, true, dR);
+                    Mat::MultiplyAndAdd(dGate, false, m_ones, false, dbW);
+                    Mat::MultiplyAndAdd(dRecurrent, false, m_ones, false, dbR);
+                }
+            }
+        }
+    }
+
+private:
+    // input contribution of all frames, then the steps of one direction of a layer
+    void ForwardDirection(const Mat& x, const Mat& weights, size_t l, size_t d, Mat& reserve)
+    {
+        bool lstm = m_attributes.m_kind == RNNKind::LSTM;
+        for (size_t g = 0; g < m_attributes.GetNumGates(); g++)
+        {
+            Mat gate = Gates(reserve, l, d, g);
+            Mat::Multiply(InputWeights(weights, l, d, g), true, x, false, gate);
+            Mat::ScaleAndAdd(1, InputBias(weights, l, d, g), gate);
+            if (lstm || g != 2) // the recurrent bias of the GRU hidden gate is applied after the reset gate
+                Mat::ScaleAndAdd(1, RecurrentBias(weights, l, d, g), gate);
+            if (m_hasGaps)
+                gate.MaskColumnsValue(m_validMask, 0);
+        }
+
+        Mat cells = Cells(reserve, l, d);
+        Mat hidden = Hidden(reserve, l, d);
+        for (size_t k = 0; k < m_numTimeSteps; k++)
+        {
+            size_t t = d == 0 ? k : m_numTimeSteps - 1 - k;
+            GetPreviousState(hidden, d, k, t, m_hPrev);
+            Mat h = Step(hidden, t);
+            if (lstm)
+            {
+                GetPreviousState(cells, d, k, t, m_cPrev);
+                Mat in = GateStep(reserve, l, d, 0, t), forget = GateStep(reserve, l, d, 1, t);
+                Mat cell = GateStep(reserve, l, d, 2, t), output = GateStep(reserve, l, d, 3, t);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 0), true, m_hPrev, false, in);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 1), true, m_hPrev, false, forget);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 2), true, m_hPrev, false, cell);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 3), true, m_hPrev, false, output);
+                in.InplaceSigmoid();
+                forget.InplaceSigmoid();
+                cell.InplaceTanh();
+                output.InplaceSigmoid();
+
+                Mat c = Step(cells, t);
+                c.AssignElementProductOf(forget, m_cPrev);
+                c.AddElementProductOf(in, cell);
+                m_tmp.AssignTanhOf(c);
+                h.AssignElementProductOf(output, m_tmp);
+            }
+            else
+            {
+                Mat reset = GateStep(reserve, l, d, 0, t), update = GateStep(reserve, l, d, 1, t), candidate = GateStep(reserve, l, d, 2, t);
+                // R_n' h_{t-1} + bR_n, kept for the gradient of the reset gate
+                Mat recurrent = Step(cells, t);
+                Mat::Multiply(RecurrentWeights(weights, l, d, 2), true, m_hPrev, false, recurrent);
+                Mat::ScaleAndAdd(1, RecurrentBias(weights, l, d, 2), recurrent);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 0), true, m_hPrev, false, reset);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 1), true, m_hPrev, false, update);
+                reset.InplaceSigmoid();
+                update.InplaceSigmoid();
+                candidate.AddElementProductOf(reset, recurrent);
+                candidate.InplaceTanh();
+
+                // h_t = n_t + z_t * (h_{t-1} - n_t)
+                m_tmp.AssignDifferenceOf(m_hPrev, candidate);
+                m_tmp.ElementMultiplyWith(update);
+                h.AssignSumOf(candidate, m_tmp);
+            }
+        }
+    }
+
+    // back-propagation through time of one direction of a layer, into the gradients of the gates (before their nonlinearities)
+    void BackwardDirection(const Mat& dH, const Mat& weights, size_t l, size_t d, Mat& reserve)
+    {
+        bool lstm = m_attributes.m_kind == RNNKind::LSTM;
+        size_t H = m_attributes.m_hiddenSize;
+        Mat cells = Cells(reserve, l, d);
+        Mat hidden = Hidden(reserve, l, d);
+        Mat cellsGrad = CellsGrad(reserve, l, d);
+
+        // gradients that flow into the state from the step processed after it
+        m_dhNext.Resize(H, m_numParallelSequences);
+        m_dhNext.SetValue(0);
+        m_dcNext.Resize(H, m_numParallelSequences);
+        m_dcNext.SetValue(0);
+        for (size_t k = m_numTimeSteps; k-- > 0;)
+        {
+            size_t t = d == 0 ? k : m_numTimeSteps - 1 - k;
+            m_dh.AssignSumOf(Step(dH, t), m_dhNext);
+            GetPreviousState(hidden, d, k, t, m_hPrev);
+            if (lstm)
+            {
+                GetPreviousState(cells, d, k, t, m_cPrev);
+                Mat in = GateStep(reserve, l, d, 0, t), forget = GateStep(reserve, l, d, 1, t);
+                Mat cell = GateStep(reserve, l, d, 2, t), output = GateStep(reserve, l, d, 3, t);
+                Mat dIn = GateGradStep(reserve, l, d, 0, t), dForget = GateGradStep(reserve, l, d, 1, t);
+                Mat dCell = GateGradStep(reserve, l, d, 2, t), dOutput = GateGradStep(reserve, l, d, 3, t);
+
+                m_tmp.AssignTanhOf(Step(cells, t));
+                dOutput.AssignElementProductOf(m_dh, m_tmp);
+                dOutput.ElementMultiplyWith(m_tmp2.AssignSigmoidDerivativeOf(output));
+
+                // the cell state gets its gradient through h_t and from the next step
+                AssignTanhDerivativeOf(m_tmp2, m_tmp);
+                m_tmp2.ElementMultiplyWith(output);
+                m_tmp2.ElementMultiplyWith(m_dh);
+                m_dc.AssignSumOf(m_tmp2, m_dcNext);
+
+                dIn.AssignElementProductOf(m_dc, cell);
+                dIn.ElementMultiplyWith(m_tmp2.AssignSigmoidDerivativeOf(in));
+                AssignTanhDerivativeOf(dCell, cell);
+                dCell.ElementMultiplyWith(in);
+                dCell.ElementMultiplyWith(m_dc);
+                dForget.AssignElementProductOf(m_dc, m_cPrev);
+                dForget.ElementMultiplyWith(m_tmp2.AssignSigmoidDerivativeOf(forget));
+
+                m_dcNext.AssignElementProductOf(m_dc, forget);
+                Mat::Multiply(RecurrentWeights(weights, l, d, 0), false, dIn, false, m_dhNext);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 1), false, dForget, false, m_dhNext);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 2), false, dCell, false, m_dhNext);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 3), false, dOutput, false, m_dhNext);
+            }
+            else
+            {
+                Mat reset = GateStep(reserve, l, d, 0, t), update = GateStep(reserve, l, d, 1, t), candidate = GateStep(reserve, l, d, 2, t);
+                Mat dReset = GateGradStep(reserve, l, d, 0, t), dUpdate = GateGradStep(reserve, l, d, 1, t), dCandidate = GateGradStep(reserve, l, d, 2, t);
+                Mat recurrent = Step(cells, t);
+                Mat dRecurrent = Step(cellsGrad, t);
+
+                dUpdate.AssignDifferenceOf(m_hPrev, candidate);
+                dUpdate.ElementMultiplyWith(m_dh);
+                dUpdate.ElementMultiplyWith(m_tmp.AssignSigmoidDerivativeOf(update));
+
+                AssignTanhDerivativeOf(dCandidate, candidate);
+                dCandidate.ElementMultiplyWith(m_tmp.AssignDifferenceOf(1, update));
+                dCandidate.ElementMultiplyWith(m_dh);
+
+                dRecurrent.AssignElementProductOf(dCandidate, reset);
+                dReset.AssignElementProductOf(dCandidate, recurrent);
+                dReset.ElementMultiplyWith(m_tmp.AssignSigmoidDerivativeOf(reset));
+
+                m_dhNext.AssignElementProductOf(m_dh, update);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 0), false, dReset, false, m_dhNext);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 1), false, dUpdate, false, m_dhNext);
+                Mat::MultiplyAndAdd(RecurrentWeights(weights, l, d, 2), false, dRecurrent, false, m_dhNext);
+            }
+            // nothing flows into the state before the beginning of a sequence
+            m_dhNext.MaskColumnsValue(ContinueMaskStep(d, t), 0);
+            if (lstm)
+                m_dcNext.MaskColumnsValue(ContinueMaskStep(d, t), 0);
+        }
+
+        if (m_hasGaps)
+        {
+            for (size_t g = 0; g < m_attributes.GetNumGates(); g++)
+                GatesGrad(reserve, l, d, g).MaskColumnsValue(m_validMask, 0);
+            if (!lstm)
+                cellsGrad.MaskColumnsValue(m_validMask, 0);
+        }
+    }
+
+    // the state that flows into step t, the k-th step of direction d: zero at the first step and where a sequence begins
+    void GetPreviousState(const Mat& states, size_t d, size_t k, size_t t, Mat& prev)
+    {
+        if (k == 0)
+        {
+            prev.Resize(m_attributes.m_hiddenSize, m_numParallelSequences);
+            prev.SetValue(0);
+            return;
+        }
+        prev.SetValue(Step(states, d == 0 ? t - 1 : t + 1));
+        prev.MaskColumnsValue(ContinueMaskStep(d, t), 0);
+    }
+
+    // GetPreviousState() for all steps at once
+    void GetAllPreviousStates(const Mat& states, size_t d, Mat& prev)
+    {
+        size_t S = m_numParallelSequences, N = GetNumColumns();
+        prev.Resize(m_attributes.m_hiddenSize, N);
+        if (N > S)
+        {
+            if (d == 0)
+                prev.ColumnSlice(S, N - S).AssignValuesOf(states.ColumnSlice(0, N - S));
+            else
+                prev.ColumnSlice(0, N - S).AssignValuesOf(states.ColumnSlice(S, N - S));
+        }
+        // this also clears the first step, as no sequence continues into it
+        prev.MaskColumnsValue(m_continueMasks[d], 0);
+    }
+
+    void PrepareSequenceMasks(const std::vector<RNNSequence>& sequences)
+    {
+        size_t S = m_numParallelSequences, N = GetNumColumns();
+        std::vector<char> valid(N, 0);
+        std::vector<char> continues[2] = { std::vector<char>(N, 0), std::vector<char>(N, 0) };
+        for (const auto& seq : sequences)
+        {
+            assert(seq.s < S && seq.tBegin < seq.tEnd && seq.tEnd <= m_numTimeSteps);
+            for (size_t t = seq.tBegin; t < seq.tEnd; t++)
+            {
+                valid[t * S + seq.s] = 1;
+                continues[0][t * S + seq.s] = t > seq.tBegin;
+                continues[1][t * S + seq.s] = t + 1 < seq.tEnd;
+            }
+        }
+        m_hasGaps = std::find(valid.begin(), valid.end(), 0) != valid.end();
+        m_validMask.SetValue(1, N, m_deviceId, valid.data());
+        for (size_t d = 0; d < 2; d++)
+            m_continueMasks[d].SetValue(1, N, m_deviceId, continues[d].data());
+    }
+
+    static void AssignTanhDerivativeOf(Mat& c, const Mat& tanhValue)
+    {
+        c.AssignElementProductOf(tanhValue, tanhValue);
+        c.AssignDifferenceOf(1, c);
+    }
+
+    // views of the parameters of one direction of a layer (see RNNAttributes)
+    Mat ParameterBlock(const Mat& weights, size_t l, size_t d, size_t offset, size_t rows, size_t cols) const
+    {
+        offset += m_attributes.GetLayerParametersOffset(m_inputDim, l, d);
+        return weights.Reshaped(1, weights.GetNumElements()).ColumnSlice(offset, rows * cols).Reshaped(rows, cols);
+    }
+    Mat InputWeights(const Mat& weights, size_t l, size_t d, size_t g) const
+    {
+        size_t H = m_attributes.m_hiddenSize, inDim = m_attributes.GetLayerInputDim(m_inputDim, l);
+        return ParameterBlock(weights, l, d, g * inDim * H, inDim, H);
+    }
+    Mat RecurrentWeights(const Mat& weights, size_t l, size_t d, size_t g) const
+    {
+        size_t H = m_attributes.m_hiddenSize, G = m_attributes.GetNumGates(), inDim = m_attributes.GetLayerInputDim(m_inputDim, l);
+        return ParameterBlock(weights, l, d, G * H * inDim + g * H * H, H, H);
+    }
+    Mat InputBias(const Mat& weights, size_t l, size_t d, size_t g) const
+    {
+        size_t H = m_attributes.m_hiddenSize, G = m_attributes.GetNumGates(), inDim = m_attributes.GetLayerInputDim(m_inputDim, l);
+        return ParameterBlock(weights, l, d, G * H * (inDim + H) + g * H, H, 1);
+    }
+    Mat RecurrentBias(const Mat& weights, size_t l, size_t d, size_t g) const
+    {
+        size_t H = m_attributes.m_hiddenSize, G = m_attributes.GetNumGates(), inDim = m_attributes.GetLayerInputDim(m_inputDim, l);
+        return ParameterBlock(weights, l, d, G * H * (inDim + H + 1) + g * H, H, 1);
+    }
+
+    // The reserve has hiddenSize rows. For each layer and direction it holds the gates after their nonlinearities
+    // (numGates blocks of one column per frame), the cell state (GRU: R_n' h_{t-1} + bR_n), the hidden state, the
+    // gradients of the gates and the gradient of the second block; then the outputs of all but the top layer.
+    size_t GetNumColumns() const { return m_numTimeSteps * m_numParallelSequences; }
+    size_t GetNumBlocksPerDirection() const { return 2 * m_attributes.GetNumGates() + 3; }
+    size_t GetNumReserveColumns() const
+    {
+        size_t D = m_attributes.GetNumDirections(), L = m_attributes.m_numLayers;
+        return (L * D * GetNumBlocksPerDirection() + (L - 1) * D) * GetNumColumns();
+    }
+    Mat ReserveBlocks(const Mat& reserve, size_t l, size_t d, size_t firstBlock, size_t numBlocks) const
+    {
+        size_t first = (l * m_attributes.GetNumDirections() + d) * GetNumBlocksPerDirection() + firstBlock;
+        return reserve.ColumnSlice(first * GetNumColumns(), numBlocks * GetNumColumns());
+    }
+    Mat Gates(const Mat& reserve, size_t l, size_t d, size_t g) const { return ReserveBlocks(reserve, l, d, g, 1); }
+    Mat Cells(const Mat& reserve, size_t l, size_t d) const { return ReserveBlocks(reserve, l, d, m_attributes.GetNumGates(), 1); }
+    Mat Hidden(const Mat& reserve, size_t l, size_t d) const { return ReserveBlocks(reserve, l, d, m_attributes.GetNumGates() + 1, 1); }
+    Mat GatesGrad(const Mat& reserve, size_t l, size_t d, size_t g) const { return ReserveBlocks(reserve, l, d, m_attributes.GetNumGates() + 2 + g, 1); }
+    Mat CellsGrad(const Mat& reserve, size_t l, size_t d) const { return ReserveBlocks(reserve, l, d, 2 * m_attributes.GetNumGates() + 2, 1); }
+    Mat LayerOutput(const Mat& reserve, size_t l) const
+    {
+        size_t D = m_attributes.GetNumDirections();
+        size_t first = m_attributes.m_numLayers * D * GetNumBlocksPerDirection() + l * D;
+        return reserve.ColumnSlice(first * GetNumColumns(), D * GetNumColumns()).Reshaped(m_attributes.GetOutputDim(), GetNumColumns());
+    }
+
+    // the columns of time step t
+    Mat Step(const Mat& m, size_t t) const { return m.ColumnSlice(t * m_numParallelSequences, m_numParallelSequences); }
+    Mat GateStep(const Mat& reserve, size_t l, size_t d, size_t g, size_t t) const { return Step(Gates(reserve, l, d, g), t); }
+    Mat GateGradStep(const Mat& reserve, size_t l, size_t d, size_t g, size_t t) const { return Step(GatesGrad(reserve, l, d, g), t); }
+    Matrix<char> ContinueMaskStep(size_t d, size_t t) const { return m_continueMasks[d].ColumnSlice(t * m_numParallelSequences, m_numParallelSequences); }
+
+private:
+    size_t m_numParallelSequences;
+    size_t m_numTimeSteps;
+    bool m_hasGaps;
+    Matrix<char> m_validMask;        // 0 for gaps
+    Matrix<char> m_continueMasks[2]; // per direction, 0 where the state does not continue from the previous step
+
+    // temporaries
+    Mat m_hPrev, m_cPrev, m_dh, m_dc, m_dhNext, m_dcNext, m_tmp, m_tmp2;
+    Mat m_dY, m_dX, m_dH, m_x, m_hPrevAll, m_ones;
+};
+
+template class GemmRNNEngine<float>;
+template class GemmRNNEngine<double>;
+
+template <typename T>
+bool HasFlag(T src, T testFlag)
+{
+    return ((int)src & (int)testFlag) != 0;
+}
+
+template <class ElemType>
+std::unique_ptr<RNNEngine<ElemType>> RNNEngine<ElemType>::Create(DEVICEID_TYPE deviceId, const RNNAttributes& attributes, size_t inputDim,
+                                                                 RNNEngineKind enabledEngines)
+{
+    if (attributes.m_hiddenSize == 0 || attributes.m_numLayers == 0 || inputDim == 0)
+        InvalidArgument("RNNEngine: The hidden size, the number of layers and the input dimension must be positive.");
+
+    // Use cuDNN on the GPU where it is available.
+    if (HasFlag(enabledEngines, RNNEngineKind::CuDnn) && CuDnnRNNEngineFactory<ElemType>::IsSupported(deviceId))
+    {
+        fprintf(stderr, "\nUsing cuDNN RNN engine.\n");
+        return CuDnnRNNEngineFactory<ElemType>::Create(deviceId, attributes, inputDim);
+    }
+
+    if (HasFlag(enabledEngines, RNNEngineKind::Gemm))
+    {
+        fprintf(stderr, "\nUsing GEMM RNN engine.\n");
+        return std::make_unique<GemmRNNEngine<ElemType>>(deviceId, attributes, inputDim);
+    }
+
+    RuntimeError("Could not find appropriate RNN engine.");
+}
+
+template class RNNEngine<float>;
+template class RNNEngine<double>;
+
+} } }
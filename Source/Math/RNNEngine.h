@@ -0,0 +1,148 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "Matrix.h"
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+//-------------------------------------------------------------
+// Fused recurrent network (stack of LSTM or GRU layers) engine interface.
+//-------------------------------------------------------------
+enum class RNNEngineKind
+{
+    None  = 0,
+    Gemm  = 1,
+    CuDnn = 1 << 1,
+
+    All  = Gemm  | CuDnn
+};
+
+enum class RNNKind
+{
+    LSTM,
+    GRU
+};
+
+static inline RNNKind RNNKindFrom(const std::wstring& s)
+{
+    if (s == L"lstm")
+        return RNNKind::LSTM;
+    else if (s == L"gru")
+        return RNNKind::GRU;
+    else
+        InvalidArgument("RNNKindFrom: Unknown recurrent operation '%ls', must be 'lstm' or 'gru'.", s.c_str());
+}
+
+static inline std::wstring ToString(RNNKind kind)
+{
+    return kind == RNNKind::LSTM ? L"lstm" : L"gru";
+}
+
+// Shape of the stack. Layer l > 0 takes the output of layer l-1, which is the hidden state of all directions stacked (forward first).
+//
+// All parameters are kept in one vector. For each layer and direction (forward first), in this order:
+//  - W: the input weights as an [inputDim x numGates * hiddenSize] matrix; the columns of gate g are g * hiddenSize...
+//  - R: the recurrent weights as a [hiddenSize x numGates * hiddenSize] matrix, in the same order
+//  - bW, bR: the input and recurrent biases, numGates * hiddenSize each
+// The gates are (in this order) input, forget, cell and output for LSTM, and reset, update and hidden for GRU, with
+//  LSTM:  c_t = f_t * c_{t-1} + i_t * g_t, h_t = o_t * tanh(c_t), where g_t is tanh and the other gates are sigmoids of W' x_t + R' h_{t-1} + bW + bR
+//  GRU:   h_t = (1 - z_t) * n_t + z_t * h_{t-1}, with n_t = tanh(W_n' x_t + bW_n + r_t * (R_n' h_{t-1} + bR_n))
+// so that each gate's matrix is laid out as cuDNN expects it.
+struct RNNAttributes
+{
+    RNNAttributes(RNNKind kind, size_t hiddenSize, size_t numLayers, bool bidirectional)
+        : m_kind(kind), m_hiddenSize(hiddenSize), m_numLayers(numLayers), m_bidirectional(bidirectional)
+    {
+    }
+
+    size_t GetNumGates() const { return m_kind == RNNKind::LSTM ? 4 : 3; }
+    size_t GetNumDirections() const { return m_bidirectional ? 2 : 1; }
+    size_t GetOutputDim() const { return GetNumDirections() * m_hiddenSize; }
+    size_t GetLayerInputDim(size_t inputDim, size_t layer) const { return layer == 0 ? inputDim : GetOutputDim(); }
+
+    // number of parameters of one direction of a layer
+    size_t GetNumLayerParameters(size_t layerInputDim) const { return GetNumGates() * m_hiddenSize * (layerInputDim + m_hiddenSize + 2); }
+
+    // size of the parameter vector for the given input dimension
+    size_t GetNumParameters(size_t inputDim) const
+    {
+        size_t n = 0;
+        for (size_t l = 0; l < m_numLayers; l++)
+            n += GetNumDirections() * GetNumLayerParameters(GetLayerInputDim(inputDim, l));
+        return n;
+    }
+
+    // offset of the parameters of one direction of a layer in the parameter vector
+    size_t GetLayerParametersOffset(size_t inputDim, size_t layer, size_t direction) const
+    {
+        size_t n = 0;
+        for (size_t l = 0; l < layer; l++)
+            n += GetNumDirections() * GetNumLayerParameters(GetLayerInputDim(inputDim, l));
+        return n + direction * GetNumLayerParameters(GetLayerInputDim(inputDim, layer));
+    }
+
+    RNNKind m_kind;
+    size_t m_hiddenSize;
+    size_t m_numLayers;
+    bool m_bidirectional;
+};
+
+// One sequence of the minibatch, see SequenceInMinibatch. Gaps have zero output and input gradient.
+typedef SequenceInMinibatch RNNSequence;
+
+#pragma warning(push)
+#pragma warning(disable : 4251)
+
+template <class ElemType>
+class MATH_API RNNEngine
+{
+public:
+    using Mat = Matrix<ElemType>;
+
+public:
+    virtual ~RNNEngine() = default;
+
+    // The input has one column per frame. 'reserve' is resized as needed and must be passed unchanged to the backward
+    // functions of the same minibatch; the engine keeps the sequence layout until the next Forward().
+    void Forward(const Mat& in, const Mat& weights, Mat& out, size_t numParallelSequences, const std::vector<RNNSequence>& sequences, Mat& reserve);
+
+    // Adds the gradient with respect to the input to 'inGrad', if it is not empty. Must be called before BackwardWeights().
+    void BackwardData(const Mat& out, const Mat& outGrad, const Mat& weights, Mat& inGrad, Mat& reserve);
+
+    // Adds the gradient with respect to the weights to 'weightsGrad'.
+    void BackwardWeights(const Mat& in, const Mat& out, Mat& weightsGrad, Mat& reserve);
+
+    static std::unique_ptr<RNNEngine<ElemType>> Create(DEVICEID_TYPE deviceId, const RNNAttributes& attributes, size_t inputDim,
+                                                       RNNEngineKind enabledEngines = RNNEngineKind::All);
+
+    DISABLE_COPY_AND_MOVE(RNNEngine);
+
+protected:
+    RNNEngine(DEVICEID_TYPE deviceId, const RNNAttributes& attributes, size_t inputDim)
+        : m_deviceId(deviceId), m_attributes(attributes), m_inputDim(inputDim)
+    {
+    }
+
+    virtual void EnsureCompatible() = 0;
+
+    virtual void ForwardCore(const Mat& in, const Mat& weights, Mat& out, size_t numParallelSequences, const std::vector<RNNSequence>& sequences, Mat& reserve) = 0;
+
+    virtual void BackwardDataCore(const Mat& out, const Mat& outGrad, const Mat& weights, Mat& inGrad, Mat& reserve) = 0;
+
+    virtual void BackwardWeightsCore(const Mat& in, const Mat& out, Mat& weightsGrad, Mat& reserve) = 0;
+
+protected:
+    DEVICEID_TYPE m_deviceId;
+    RNNAttributes m_attributes;
+    size_t m_inputDim;
+};
+
+#pragma warning(pop)
+
+} } }
@@ -263,6 +263,75 @@ DefTernaryOp(Clip, c < a ? a : (c > b ? b : c)); // Clip(min,max)(data) => a=min
 DefTernaryOp(ElementwiseProductWithLogSumDerivative, a * Sigmoid(c - b));
 
 #pragma pop_macro("DefTernaryOp")
+
+// -----------------------------------------------------------------------
+// evaluation of a FusedElementwiseProgram (see CommonMatrix.h) for one element
+// regs[0..numInputs) must hold the input values; the remaining registers are used as scratch.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+DECL ElemType EvaluateFusedElementwiseProgram(const FusedElementwiseProgram& program, ElemType* regs)
+{
+    for (size_t j = 0; j < program.numInstructions; j++)
+    {
+        const auto& instruction = program.instructions[j];
+        const ElemType a = regs[instruction.args[0]];
+        const ElemType b = regs[instruction.args[1]];
+        const ElemType c = regs[instruction.args[2]];
+        ElemType r;
+        switch (instruction.op)
+        {
+#define CaseFusedUnaryOp(oper)       \
+    case ElementWiseOperator::op##oper: \
+        r = Op##oper(a);             \
+        break
+#define CaseFusedBinaryOp(oper)      \
+    case ElementWiseOperator::op##oper: \
+        r = Op##oper(a, b);          \
+        break
+#define CaseFusedTernaryOp(oper)     \
+    case ElementWiseOperator::op##oper: \
+        r = Op##oper(a, b, c);       \
+        break
+            ForAllUnaryOps(CaseFusedUnaryOp);
+            ForAllBinaryOps(CaseFusedBinaryOp);
+            ForAllTernaryOps(CaseFusedTernaryOp);
+#undef CaseFusedUnaryOp
+#undef CaseFusedBinaryOp
+#undef CaseFusedTernaryOp
+        default:
+            r = 0; // cannot happen: FusedElementwiseProgram only accepts the ops above
+        }
+        regs[program.numInputs + j] = r;
+    }
+    return regs[program.numInputs + program.numInstructions - 1];
+}
+
+// -----------------------------------------------------------------------
+// layout of tensor copies that move the contiguous axis (e.g. TransposeDimensions)
+// -----------------------------------------------------------------------
+
+// Returns true if a copy without reduction writes contiguously along one regular dimension 'outInnerDim' but reads contiguously
+// along another one 'inInnerDim'. Element-by-element, such a copy reads or writes with a large stride; CPU and GPU instead
+// move it in tiles of the (outInnerDim, inInnerDim) plane. Both dimensions must be at least minTileDim; the remaining
+// (at most two, since regular dimensions are flattened to at most four) dimensions are looped over.
+template <class DimVector, class StrideVector>
+static inline bool GetTensorTransposeLayout(const DimVector& regularOpDims, const StrideVector& inStrides, const StrideVector& outStrides, size_t minTileDim,
+                                            /*out*/ size_t& outInnerDim, /*out*/ size_t& inInnerDim)
+{
+    if (regularOpDims.size() < 2 || regularOpDims.size() > 4)
+        return false;
+    outInnerDim = inInnerDim = SIZE_MAX;
+    for (size_t k = 0; k < regularOpDims.size(); k++)
+    {
+        if (outStrides[k] == 1 && outInnerDim == SIZE_MAX)
+            outInnerDim = k;
+        if (inStrides[k] == 1 && inInnerDim == SIZE_MAX)
+            inInnerDim = k;
+    }
+    return outInnerDim != SIZE_MAX && inInnerDim != SIZE_MAX && outInnerDim != inInnerDim &&
+           regularOpDims[outInnerDim] >= minTileDim && regularOpDims[inInnerDim] >= minTileDim;
+}
 }}}
 #pragma pop_macro("DECL")
 #pragma pop_macro("TENSOR_OPS_DECL")
@@ -285,6 +285,79 @@ void TensorView<ElemType>::DoTernaryOpOf(ElemType beta, const TensorView& a, con
     GetSOB().TensorOp(beta, a.GetSOB(), b.GetSOB(), c.GetSOB(), alpha, op, reductionOp, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
 }
 
+// -------------------------------------------------------------------
+// fused elementwise operation
+// -------------------------------------------------------------------
+
+template <class ElemType>
+void TensorView<ElemType>::DoFusedElementwiseOf(ElemType beta, const std::vector<TensorView>& inputs, const FusedElementwiseProgram& program, ElemType alpha)
+{
+    if (inputs.size() != program.numInputs)
+        InvalidArgument("DoFusedElementwiseOf: The program expects %d inputs, but %d were passed.", (int) program.numInputs, (int) inputs.size());
+    if (program.numInstructions == 0)
+        InvalidArgument("DoFusedElementwiseOf: The program is empty.");
+
+    // inputs must be broadcastable to the output; intermediate values have the output's shape, so we cannot reduce
+    const auto& outDims = GetShape().GetDims();
+    bool sameShapes = GetShape().IsDense();
+    for (const auto& input : inputs)
+    {
+        const auto& inDims = input.GetShape().GetDims();
+        if (inDims.size() > outDims.size())
+            InvalidArgument("DoFusedElementwiseOf: Input [%s] has a higher rank than the output [%s].", string(input.GetShape()).c_str(), string(GetShape()).c_str());
+        for (size_t k = 0; k < inDims.size(); k++)
+        {
+            if (inDims[k] != 1 && inDims[k] != outDims[k])
+                InvalidArgument("DoFusedElementwiseOf: Input [%s] cannot be broadcast to the output [%s].", string(input.GetShape()).c_str(), string(GetShape()).c_str());
+        }
+        sameShapes &= input.GetShape() == GetShape() && input.GetShape().IsDense();
+    }
+
+    // fast path: all operands are dense and have the same shape --one kernel over contiguous ranges
+    if (sameShapes)
+    {
+        vector<const Matrix<ElemType>*> sobs;
+        vector<size_t> offsets;
+        for (const auto& input : inputs)
+        {
+            sobs.push_back(&input.GetSOB());
+            offsets.push_back(input.GetShape().GetOffset());
+        }
+        offsets.push_back(GetShape().GetOffset());
+        GetSOB().FusedElementwiseOp(beta, sobs, offsets, GetShape().GetNumElements(), program, alpha);
+        return;
+    }
+
+    // general case: run the program op by op; intermediate results go to dense temporaries of the output's dimensions,
+    // and the last instruction writes directly into 'this'
+    vector<TensorView> regs(inputs.begin(), inputs.end());
+    regs.reserve(program.numInputs + program.numInstructions);
+    const TensorShape tempShape(outDims);
+    for (size_t i = 0; i < program.numInstructions; i++)
+    {
+        const auto& instruction = program.instructions[i];
+        const bool isLast = i + 1 == program.numInstructions;
+        TensorView result = isLast ? *this : TensorView(make_shared<Matrix<ElemType>>(tempShape.GetNumElements(), 1, GetSOB().GetDeviceId()), tempShape);
+        ElemType resultBeta = isLast ? beta : 0;
+        ElemType resultAlpha = isLast ? alpha : 1;
+        switch (instruction.arity)
+        {
+        case 1:
+            result.DoUnaryOpOf(resultBeta, regs[instruction.args[0]], resultAlpha, instruction.op, ElementWiseOperator::opSum);
+            break;
+        case 2:
+            result.DoBinaryOpOf(resultBeta, regs[instruction.args[0]], regs[instruction.args[1]], resultAlpha, instruction.op, ElementWiseOperator::opSum);
+            break;
+        case 3:
+            result.DoTernaryOpOf(resultBeta, regs[instruction.args[0]], regs[instruction.args[1]], regs[instruction.args[2]], resultAlpha, instruction.op, ElementWiseOperator::opSum);
+            break;
+        default:
+            LogicError("DoFusedElementwiseOf: Invalid instruction arity %d.", (int) instruction.arity);
+        }
+        regs.push_back(result);
+    }
+}
+
 // -------------------------------------------------------------------
 // matrix product -- GEMM for flattened tensors
 // -------------------------------------------------------------------
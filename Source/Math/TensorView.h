@@ -125,6 +125,18 @@ public:
     void DoBinaryOpOf (ElemType beta, const TensorView& a, const TensorView& b,                      ElemType alpha, ElementWiseOperator op, ElementWiseOperator reductionOp);
     void DoTernaryOpOf(ElemType beta, const TensorView& a, const TensorView& b, const TensorView& c, ElemType alpha, ElementWiseOperator op, ElementWiseOperator reductionOp);
 
+    // -------------------------------------------------------------------
+    // fused elementwise operation
+    // Evaluates a chain of element-wise ops (see FusedElementwiseProgram) in one pass:
+    // this := beta * this + alpha * program(inputs[0], ..., inputs[N-1]).
+    // If all operands are dense and have the same shape, this launches a single kernel
+    // that reads each input and writes the output once. Otherwise (broadcasting or strided
+    // operands), the program is executed op by op through temporaries.
+    // Inputs may broadcast, but not reduce, i.e. no input may be larger than the output.
+    // -------------------------------------------------------------------
+
+    void DoFusedElementwiseOf(ElemType beta, const std::vector<TensorView>& inputs, const FusedElementwiseProgram& program, ElemType alpha);
+
     // -------------------------------------------------------------------
     // matrix product -- GEMM for flattened tensors
     // Result goes into 'this', and can optionally be added to the existing value.
@@ -58,11 +58,11 @@ public:
     {
         return cuda_ptr(p - index);
     }
-    cuda_ptr(T* pp)
+    cudasharedcode cuda_ptr(T* pp)
         : p(pp)
     {
     }
-    T* get() const
+    cudasharedcode T* get() const
     {
         return p;
     }
@@ -88,7 +88,7 @@ public:
     {
         return p[i];
     }
-    cuda_ptr<T> get() const throw()
+    cudasharedcode cuda_ptr<T> get() const throw()
     {
         return p;
     }
@@ -98,7 +98,7 @@ public:
         n = nn;
         return pp;
     }
-    vectorref(cuda_ptr<T> pp, size_t nn)
+    cudasharedcode vectorref(cuda_ptr<T> pp, size_t nn)
         : p(pp), n(nn)
     {
     }
@@ -127,11 +127,11 @@ protected:
     }
 
 public:
-    matrixref(T* p, size_t numRows, size_t numCols, size_t colStride)
+    cudasharedcode matrixref(T* p, size_t numRows, size_t numCols, size_t colStride)
         : p(p), numrows(numRows), numcols(numCols), colstride(colStride)
     {
     }
-    cuda_ptr<T> get() const throw()
+    cudasharedcode cuda_ptr<T> get() const throw()
     {
         return p;
     }
@@ -16,6 +16,7 @@
 #include <memory> // for auto_ptr
 #include <assert.h>
 #include <float.h>
+#include <algorithm>
 
 namespace msra { namespace cuda {
 
@@ -71,6 +72,26 @@ public:
         if (synchronize)
             join();
     }
+    void append(const elemtype *p, size_t nelem, bool synchronize)
+    {
+        const size_t oldsize = size();
+        ondevice no(deviceid); // switch to desired CUDA card
+        if (oldsize + nelem > capacity) // need to grow: allocate with headroom and move the current elements over
+        {
+            const size_t newcapacity = std::max(oldsize + nelem, 2 * capacity);
+            cuda_ptr<elemtype> pnew = malloc<elemtype>(newcapacity);
+            if (oldsize > 0)
+                memcpy(pnew, 0, this->get(), 0, oldsize);
+            capacity = newcapacity;
+            free(this->reset(pnew, oldsize + nelem));
+        }
+        else
+            this->reset(this->get(), oldsize + nelem);
+        if (nelem > 0)
+            memcpy(this->get(), oldsize, p, nelem);
+        if (synchronize)
+            join();
+    }
     void fetch(elemtype *p, size_t nelem, bool synchronize) const
     {
         if (nelem != size()) // fetch() cannot resize the target; caller must do that
@@ -212,6 +233,107 @@ private:
                                              dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(logqs),
                                              logaccMatrixRef);
     }
+
+    void edgealignmentbatch(const latticebatchinfovector &lattices, const lrhmmdefvector &hmms, const lr3transPvector &transPs,
+                            const size_t spalignunitid, const size_t silalignunitid, const Microsoft::MSR::CNTK::Matrix<float> &logLLs,
+                            const nodeinfovector &nodes, const edgeinfowithscoresvector &edges, const aligninfovector &aligns,
+                            const uintvector &alignoffsets, ushortvector &backptrstorage, const sizetvector &backptroffsets,
+                            ushortvector &alignresult, floatvector &edgeacscores) // output
+    {
+        ondevice no(deviceid);
+
+        matrixref<float> logLLsMatrixRef = tomatrixref(logLLs);
+        latticefunctionsops::edgealignmentbatch(dynamic_cast<const vectorbaseimpl<latticebatchinfovector, vectorref<latticebatchinfo>> &>(lattices),
+                                                dynamic_cast<const vectorbaseimpl<lrhmmdefvector, vectorref<lrhmmdef>> &>(hmms),
+                                                dynamic_cast<const vectorbaseimpl<lr3transPvector, vectorref<lr3transP>> &>(transPs),
+                                                spalignunitid, silalignunitid, logLLsMatrixRef,
+                                                dynamic_cast<const vectorbaseimpl<nodeinfovector, vectorref<msra::lattices::nodeinfo>> &>(nodes),
+                                                dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
+                                                dynamic_cast<const vectorbaseimpl<aligninfovector, vectorref<msra::lattices::aligninfo>> &>(aligns),
+                                                dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(alignoffsets),
+                                                dynamic_cast<vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(backptrstorage),
+                                                dynamic_cast<const vectorbaseimpl<sizetvector, vectorref<size_t>> &>(backptroffsets),
+                                                dynamic_cast<vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(alignresult),
+                                                dynamic_cast<vectorbaseimpl<floatvector, vectorref<float>> &>(edgeacscores));
+    }
+
+    void forwardbackwardlatticebatch(const latticebatchinfovector &lattices,
+                                     const size_t *batchsizeforward, const size_t *batchsizebackward,
+                                     const size_t numlaunchforward, const size_t numlaunchbackward,
+                                     const uintvector &forwardorder, const uintvector &backwardorder,
+                                     const size_t spalignunitid, const size_t silalignunitid,
+                                     const floatvector &edgeacscores, const edgeinfowithscoresvector &edges,
+                                     const nodeinfovector &nodes, const aligninfovector &aligns,
+                                     const ushortvector &alignments, const uintvector &alignoffsets,
+                                     doublevector &logpps, doublevector &logalphas, doublevector &logbetas,
+                                     const float lmf, const float wp, const float amf, const float boostingfactor, const bool returnEframescorrect,
+                                     const ushortvector &uids, const ushortvector &senone2classmap, doublevector &logaccalphas,
+                                     doublevector &logaccbetas, doublevector &logframescorrectedge,
+                                     doublevector &logEframescorrect, const size_t alphabetanoderatio, doublevector &totals)
+    {
+        ondevice no(deviceid);
+        latticefunctionsops::forwardbackwardlatticebatch(dynamic_cast<const vectorbaseimpl<latticebatchinfovector, vectorref<latticebatchinfo>> &>(lattices),
+                                                         batchsizeforward, batchsizebackward, numlaunchforward, numlaunchbackward,
+                                                         dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(forwardorder),
+                                                         dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(backwardorder),
+                                                         spalignunitid, silalignunitid,
+                                                         dynamic_cast<const vectorbaseimpl<floatvector, vectorref<float>> &>(edgeacscores),
+                                                         dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
+                                                         dynamic_cast<const vectorbaseimpl<nodeinfovector, vectorref<msra::lattices::nodeinfo>> &>(nodes),
+                                                         dynamic_cast<const vectorbaseimpl<aligninfovector, vectorref<msra::lattices::aligninfo>> &>(aligns),
+                                                         dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(alignments),
+                                                         dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(alignoffsets),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logpps),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logalphas),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logbetas),
+                                                         lmf, wp, amf, boostingfactor, returnEframescorrect,
+                                                         dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(uids),
+                                                         dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(senone2classmap),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logaccalphas),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logaccbetas),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logframescorrectedge),
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(logEframescorrect),
+                                                         alphabetanoderatio,
+                                                         dynamic_cast<vectorbaseimpl<doublevector, vectorref<double>> &>(totals));
+    }
+
+    void sMBRerrorsignalbatch(const latticebatchinfovector &lattices, const ushortvector &alignstateids, const uintvector &alignoffsets,
+                              const edgeinfowithscoresvector &edges, const nodeinfovector &nodes,
+                              const doublevector &logpps, const float amf, const doublevector &logEframescorrect,
+                              const doublevector &totals, Microsoft::MSR::CNTK::Matrix<float> &dengammas, Microsoft::MSR::CNTK::Matrix<float> &dengammasbuf)
+    {
+        ondevice no(deviceid);
+
+        matrixref<float> dengammasMatrixRef = tomatrixref(dengammas);
+        matrixref<float> dengammasbufMatrixRef = tomatrixref(dengammasbuf);
+        latticefunctionsops::sMBRerrorsignalbatch(dynamic_cast<const vectorbaseimpl<latticebatchinfovector, vectorref<latticebatchinfo>> &>(lattices),
+                                                  dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(alignstateids),
+                                                  dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(alignoffsets),
+                                                  dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
+                                                  dynamic_cast<const vectorbaseimpl<nodeinfovector, vectorref<msra::lattices::nodeinfo>> &>(nodes),
+                                                  dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(logpps),
+                                                  amf,
+                                                  dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(logEframescorrect),
+                                                  dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(totals),
+                                                  dengammasMatrixRef, dengammasbufMatrixRef);
+    }
+
+    void mmierrorsignalbatch(const latticebatchinfovector &lattices, const ushortvector &alignstateids, const uintvector &alignoffsets,
+                             const edgeinfowithscoresvector &edges, const nodeinfovector &nodes,
+                             const doublevector &logpps, const doublevector &totals, Microsoft::MSR::CNTK::Matrix<float> &dengammas)
+    {
+        ondevice no(deviceid);
+
+        matrixref<float> dengammasMatrixRef = tomatrixref(dengammas);
+        latticefunctionsops::mmierrorsignalbatch(dynamic_cast<const vectorbaseimpl<latticebatchinfovector, vectorref<latticebatchinfo>> &>(lattices),
+                                                 dynamic_cast<const vectorbaseimpl<ushortvector, vectorref<unsigned short>> &>(alignstateids),
+                                                 dynamic_cast<const vectorbaseimpl<uintvector, vectorref<unsigned int>> &>(alignoffsets),
+                                                 dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
+                                                 dynamic_cast<const vectorbaseimpl<nodeinfovector, vectorref<msra::lattices::nodeinfo>> &>(nodes),
+                                                 dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(logpps),
+                                                 dynamic_cast<const vectorbaseimpl<doublevector, vectorref<double>> &>(totals),
+                                                 dengammasMatrixRef);
+    }
 };
 
 latticefunctions *newlatticefunctions(size_t deviceid)
@@ -261,5 +383,9 @@ aligninfovector *newaligninfovector(size_t deviceid)
 {
     return new vectorbaseimpl<aligninfovector, vectorref<aligninfo>>(deviceid);
 }
+latticebatchinfovector *newlatticebatchinfovector(size_t deviceid)
+{
+    return new vectorbaseimpl<latticebatchinfovector, vectorref<latticebatchinfo>>(deviceid);
+}
 };
 };
@@ -47,6 +47,14 @@ struct /*interface*/ vectorbase
         if (!v.empty())
             assign(&v[0], v.size(), synchronize);
     }
+    // grow by n elements copied from p, keeping the current ones (the allocation grows geometrically)
+    virtual void append(const ELEMTYPE* p, size_t n, bool synchronize) = 0;
+    template <class VECTOR>
+    void append(const VECTOR& v, bool synchronize)
+    {
+        if (!v.empty())
+            append(&v[0], v.size(), synchronize);
+    }
     virtual void fetch(ELEMTYPE* p, size_t n, bool synchronize) const = 0;
     template <class VECTOR>
     void fetch(VECTOR& v, bool synchronize) const
@@ -79,6 +87,7 @@ typedef vectorbase<msra::lattices::lr3transP> lr3transPvector;
 typedef vectorbase<msra::lattices::nodeinfo> nodeinfovector;
 typedef vectorbase<msra::lattices::edgeinfowithscores> edgeinfowithscoresvector;
 typedef vectorbase<msra::lattices::aligninfo> aligninfovector;
+typedef vectorbase<msra::lattices::latticebatchinfo> latticebatchinfovector;
 
 struct latticefunctions : public vectorbase<msra::lattices::empty>
 {
@@ -109,6 +118,38 @@ struct latticefunctions : public vectorbase<msra::lattices::empty>
     virtual void stateposteriors(const ushortvector& alignstateids, const uintvector& alignoffsets,
                                  const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
                                  const doublevector& logqs, Microsoft::MSR::CNTK::Matrix<float>& logacc) = 0;
+
+    // batched versions: all lattices of a minibatch with one set of launches, see latticebatchinfo
+    // The lattice data are the resident buffers, all other vectors and matrices span the whole minibatch.
+    // Launch i of the forward pass processes the next batchsizeforward[i] edges listed in forwardorder (batch edge indices, from all lattices); same for backward.
+    // totals[4*k..4*k+3] receive fw score, fw acc, bw score and bw acc (= logEframescorrecttotal) of lattice k;
+    // the error signals of lattices without a path (LOGZERO fw score) are left at zero.
+    virtual void edgealignmentbatch(const latticebatchinfovector& lattices, const lrhmmdefvector& hmms, const lr3transPvector& transPs,
+                                    const size_t spalignunitid, const size_t silalignunitid, const Microsoft::MSR::CNTK::Matrix<float>& logLLs,
+                                    const nodeinfovector& nodes, const edgeinfowithscoresvector& edges, const aligninfovector& aligns,
+                                    const uintvector& alignoffsets, ushortvector& backptrstorage, const sizetvector& backptroffsets,
+                                    ushortvector& alignresult, floatvector& edgeacscores) = 0; // output
+    virtual void forwardbackwardlatticebatch(const latticebatchinfovector& lattices,
+                                             const size_t* batchsizeforward, const size_t* batchsizebackward,
+                                             const size_t numlaunchforward, const size_t numlaunchbackward,
+                                             const uintvector& forwardorder, const uintvector& backwardorder,
+                                             const size_t spalignunitid, const size_t silalignunitid,
+                                             const floatvector& edgeacscores, const edgeinfowithscoresvector& edges,
+                                             const nodeinfovector& nodes, const aligninfovector& aligns,
+                                             const ushortvector& alignoutput, const uintvector& alignoffsets,
+                                             doublevector& logpps, doublevector& logalphas, doublevector& logbetas,
+                                             const float lmf, const float wp, const float amf, const float boostingfactor, const bool returnEframescorrect,
+                                             const ushortvector& uids, const ushortvector& senone2classmap,
+                                             doublevector& logaccalphas, doublevector& logaccbetas,
+                                             doublevector& logframescorrectedge, doublevector& logEframescorrect,
+                                             const size_t alphabetanoderatio, doublevector& totals) = 0;
+    virtual void sMBRerrorsignalbatch(const latticebatchinfovector& lattices, const ushortvector& alignstateids, const uintvector& alignoffsets,
+                                      const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
+                                      const doublevector& logpps, const float amf, const doublevector& logEframescorrect,
+                                      const doublevector& totals, Microsoft::MSR::CNTK::Matrix<float>& dengammas, Microsoft::MSR::CNTK::Matrix<float>& dengammasbuf) = 0;
+    virtual void mmierrorsignalbatch(const latticebatchinfovector& lattices, const ushortvector& alignstateids, const uintvector& alignoffsets,
+                                     const edgeinfowithscoresvector& edges, const nodeinfovector& nodes,
+                                     const doublevector& logpps, const doublevector& totals, Microsoft::MSR::CNTK::Matrix<float>& dengammas) = 0;
 };
 
 // ---------------------------------------------------------------------------
@@ -127,5 +168,6 @@ lr3transPvector* newlr3transPvector(size_t deviceid);
 nodeinfovector* newnodeinfovector(size_t deviceid);
 edgeinfowithscoresvector* newedgeinfovector(size_t deviceid);
 aligninfovector* newaligninfovector(size_t deviceid);
+latticebatchinfovector* newlatticebatchinfovector(size_t deviceid);
 };
 };
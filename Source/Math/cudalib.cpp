@@ -84,5 +84,10 @@ void memcpyd2h(void *dst, const void *src, size_t byteoffset, size_t nbytes)
 {
     cudaMemcpy(dst, byteoffset + (const char *) src, nbytes, cudaMemcpyDeviceToHost) || "cudaMemcpy failed";
 }
+
+void memcpyd2d(void *dst, size_t dstbyteoffset, const void *src, size_t srcbyteoffset, size_t nbytes)
+{
+    cudaMemcpy(dstbyteoffset + (char *) dst, srcbyteoffset + (const char *) src, nbytes, cudaMemcpyDeviceToDevice) || "cudaMemcpy failed";
+}
 };
 };
@@ -31,6 +31,7 @@ void free(cuda_ptr<T> p)
 
 void memcpyh2d(void *dst, size_t byteoffset, const void *src, size_t nbytes);
 void memcpyd2h(void *dst, const void *src, size_t byteoffset, size_t nbytes);
+void memcpyd2d(void *dst, size_t dstbyteoffset, const void *src, size_t srcbyteoffset, size_t nbytes);
 template <typename T>
 void memcpy(cuda_ptr<T> dst, size_t dstoffset, const T *src, size_t nelem)
 {
@@ -41,6 +42,11 @@ void memcpy(T *dst, const cuda_ptr<T> src, size_t srcoffset, size_t nelem)
 {
     memcpyd2h((void *) dst, (const void *) src.get(), srcoffset * sizeof(T), nelem * sizeof(T));
 }
+template <typename T>
+void memcpy(cuda_ptr<T> dst, size_t dstoffset, const cuda_ptr<T> src, size_t srcoffset, size_t nelem)
+{
+    memcpyd2d((void *) dst.get(), dstoffset * sizeof(T), (const void *) src.get(), srcoffset * sizeof(T), nelem * sizeof(T));
+}
 // [v-hansu] for debug use, change false to true to activate
 template <typename T>
 void peek(vectorref<T> v)
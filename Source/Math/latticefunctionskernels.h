@@ -179,6 +179,32 @@ public:
     }
 };
 
+// where the data of one lattice of a minibatch is, for processing all lattices of the minibatch with one set of kernel launches
+// The lattice itself lives in device buffers that are kept across minibatches (the 'resident' offsets);
+// the per-minibatch buffers concatenate the lattices in minibatch order (the 'batch' offsets).
+// Kernels find the lattice of a batch edge j by edgeoffset, then run the per-lattice kernel on views of the lattice's data.
+struct latticebatchinfo
+{
+    // resident lattice data
+    size_t edgesoffset;          // first edge in edges
+    size_t nodesoffset;          // first node in nodes
+    size_t alignsoffset;         // first unit in aligns
+    size_t alignoffsetsoffset;   // first entry in alignoffsets (numedges + 1 entries)
+    size_t backptroffsetsoffset; // first entry in backptroffsets (numedges + 1 entries)
+    size_t numedges;
+    size_t numnodes;
+    size_t numaligns;
+    // per-minibatch data
+    size_t edgeoffset;      // first edge in the per-edge buffers (edgeacscores, logpps, logframescorrectedge, logEframescorrect)
+    size_t alphabetaoffset; // first entry in logalphas, logbetas, logaccalphas, logaccbetas (alphabetanoderatio * numnodes entries)
+    size_t alignbufoffset;  // first entry of the edge alignments
+    size_t alignbufsize;
+    size_t backptrbufoffset; // first entry of the /sil/ traceback buffer
+    size_t backptrbufsize;
+    size_t frameoffset; // first column in logLLs, uids and the error signals
+    size_t numframes;
+};
+
 // this class contains all-static methods that are inner pieces of thread kernels for use with CUDA
 struct latticefunctionskernels
 {
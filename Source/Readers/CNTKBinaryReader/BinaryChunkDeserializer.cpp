@@ -0,0 +1,376 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <string.h>
+#include <algorithm>
+#include "BinaryChunkDeserializer.h"
+#include "Basics.h"
+#include "CPUThreadPool.h"
+#include "Lz4Codec.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+static size_t AlignTo8(size_t size)
+{
+    return (size + 7) / 8 * 8;
+}
+
+static size_t GetElementSize(ElementType type)
+{
+    return type == ElementType::tdouble ? sizeof(double) : sizeof(float);
+}
+
+static void ConvertValues(const char* source, ElementType sourceType, char* target, ElementType targetType, size_t count)
+{
+    if (sourceType == ElementType::tfloat && targetType == ElementType::tdouble)
+    {
+        for (size_t i = 0; i < count; i++)
+            ((double*) target)[i] = ((const float*) source)[i];
+    }
+    else if (sourceType == ElementType::tdouble && targetType == ElementType::tfloat)
+    {
+        for (size_t i = 0; i < count; i++)
+            ((float*) target)[i] = (float) ((const double*) source)[i];
+    }
+    else
+        LogicError("ConvertValues: Unsupported element types.");
+}
+
+// sequence data that own their values, used when the values have to be converted to the precision of the reader
+struct ConvertedDenseSequenceData : DenseSequenceData
+{
+    std::vector<char> m_values;
+};
+
+struct ConvertedSparseSequenceData : SparseSequenceData
+{
+    std::vector<char> m_values;
+};
+
+// -----------------------------------------------------------------------
+// BinaryDataChunk -- a chunk of the file, with its sequences in place in the mapping or in its buffer
+// -----------------------------------------------------------------------
+
+class BinaryChunkDeserializer::BinaryDataChunk : public Chunk, public std::enable_shared_from_this<Chunk>
+{
+public:
+    BinaryDataChunk(const BinaryChunkDeserializer* deserializer, const BinaryChunkHeader& header)
+        : m_deserializer(deserializer), m_source(deserializer->m_source), m_header(header)
+    {
+        if (deserializer->m_compression == BinaryCompression::none)
+        {
+            m_data = deserializer->GetData(header.m_offset, header.m_byteSize, m_buffer);
+            return;
+        }
+
+        std::vector<char> compressed;
+        const char* chunk = deserializer->GetData(header.m_offset, header.m_byteSize, compressed);
+        m_data = deserializer->DecompressChunk(chunk, m_header, m_buffer);
+    }
+
+    // sequenceId is the index of the sequence in the sequence table of the chunk
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        if (sequenceId >= m_header.m_numberOfSequences)
+            LogicError("BinaryDataChunk: Invalid sequence id %" PRIu64 ".", sequenceId);
+
+        const auto& sequence = ((const BinarySequenceHeader*) m_data)[sequenceId];
+        const auto& streams = m_deserializer->m_streams;
+        const auto& fileStreams = m_deserializer->m_fileStreams;
+        size_t firstResult = result.size();
+        result.resize(firstResult + streams.size());
+
+        size_t offset = (size_t) sequence.m_dataOffset;
+        for (size_t j = 0; j < fileStreams.size(); j++)
+        {
+            const FileStream& fileStream = fileStreams[j];
+            const auto& record = *(const BinaryStreamRecord*) GetData(offset, sizeof(BinaryStreamRecord));
+            size_t recordOffset = offset + sizeof(BinaryStreamRecord);
+            size_t numValues = fileStream.m_storageType == StorageType::dense ? record.m_numberOfSamples * fileStream.m_sampleDimension : record.m_totalNnzCount;
+            size_t valuesOffset = recordOffset;
+            if (fileStream.m_storageType == StorageType::sparse_csc)
+                valuesOffset += AlignTo8(sizeof(IndexType) * (record.m_numberOfSamples + record.m_totalNnzCount));
+            offset = AlignTo8(valuesOffset + numValues * fileStream.m_elementSize);
+            const char* values = GetData(valuesOffset, numValues * fileStream.m_elementSize);
+
+            // is this stream read?
+            auto exposed = std::find(m_deserializer->m_fileStreamOfStream.begin(), m_deserializer->m_fileStreamOfStream.end(), j);
+            if (exposed == m_deserializer->m_fileStreamOfStream.end())
+                continue;
+            size_t streamIndex = exposed - m_deserializer->m_fileStreamOfStream.begin();
+            const StreamDescription& stream = *streams[streamIndex];
+            bool convert = stream.m_elementType != fileStream.m_elementType;
+
+            SequenceDataPtr data;
+            std::vector<char>* convertedValues = nullptr;
+            if (fileStream.m_storageType == StorageType::dense)
+            {
+                DenseSequenceDataPtr denseData;
+                if (convert)
+                {
+                    auto converted = std::make_shared<ConvertedDenseSequenceData>();
+                    convertedValues = &converted->m_values;
+                    denseData = converted;
+                }
+                else
+                    denseData = std::make_shared<DenseSequenceData>();
+                denseData->m_sampleLayout = stream.m_sampleLayout;
+                data = denseData;
+            }
+            else
+            {
+                SparseSequenceDataPtr sparseData;
+                if (convert)
+                {
+                    auto converted = std::make_shared<ConvertedSparseSequenceData>();
+                    convertedValues = &converted->m_values;
+                    sparseData = converted;
+                }
+                else
+                    sparseData = std::make_shared<SparseSequenceData>();
+                const IndexType* nnzCounts = (const IndexType*) GetData(recordOffset, sizeof(IndexType) * (record.m_numberOfSamples + record.m_totalNnzCount));
+                sparseData->m_nnzCounts.assign(nnzCounts, nnzCounts + record.m_numberOfSamples);
+                sparseData->m_indices = const_cast<IndexType*>(nnzCounts + record.m_numberOfSamples);
+                sparseData->m_totalNnzCount = record.m_totalNnzCount;
+                data = sparseData;
+            }
+
+            if (convert)
+            {
+                convertedValues->resize(numValues * GetElementSize(stream.m_elementType));
+                ConvertValues(values, fileStream.m_elementType, convertedValues->data(), stream.m_elementType, numValues);
+                data->m_data = convertedValues->data();
+            }
+            else
+                data->m_data = const_cast<char*>(values);
+            data->m_numberOfSamples = record.m_numberOfSamples;
+            data->m_chunk = shared_from_this();
+            data->m_id = sequenceId;
+            result[firstResult + streamIndex] = data;
+        }
+    }
+
+private:
+    const char* GetData(size_t offset, size_t size) const
+    {
+        if (offset + size > m_header.m_byteSize)
+            RuntimeError("Malformed input file (%ls): a sequence exceeds its chunk.", m_deserializer->m_filename.c_str());
+        return m_data + offset;
+    }
+
+    const BinaryChunkDeserializer* m_deserializer;
+    ByteSourcePtr m_source;     // keeps the mapping alive
+    std::vector<char> m_buffer; // the data of the chunk if the file is not mapped or the chunk is compressed
+    const char* m_data;
+    BinaryChunkHeader m_header;
+};
+
+// -----------------------------------------------------------------------
+// BinaryChunkDeserializer
+// -----------------------------------------------------------------------
+
+BinaryChunkDeserializer::BinaryChunkDeserializer(CorpusDescriptorPtr corpus, const BinaryConfigHelper& helper)
+    : m_filename(helper.GetFilePath()), m_traceLevel(helper.GetTraceLevel())
+{
+    m_source = OpenByteSource(m_filename, helper.GetCacheDirectory());
+
+    std::vector<char> buffer;
+    const BinaryFileHeader header = *(const BinaryFileHeader*) GetData(0, sizeof(BinaryFileHeader), buffer);
+    if (memcmp(header.m_magic, s_binaryFormatMagic, sizeof(s_binaryFormatMagic)) != 0)
+        RuntimeError("The input file (%ls) is not in the CNTK binary format.", m_filename.c_str());
+    if (header.m_version < 1 || header.m_version > s_binaryFormatVersion)
+        RuntimeError("The input file (%ls) has an unsupported version (%u) of the CNTK binary format.", m_filename.c_str(), (unsigned int) header.m_version);
+    m_compression = header.m_version >= 2 ? header.m_compression : BinaryCompression::none;
+    if (m_compression != BinaryCompression::none && m_compression != BinaryCompression::lz4)
+        RuntimeError("The input file (%ls) has an unsupported compression (%u).", m_filename.c_str(), (unsigned int) m_compression);
+
+    ReadStreams(header, helper);
+    ReadChunks(header, corpus);
+
+    if (m_traceLevel >= 2)
+    {
+        fprintf(stderr, "INFO: Opened the input file (%ls): %" PRIu64 " streams, %" PRIu64 " chunks, %" PRIu64 " sequences%s.\n",
+                m_filename.c_str(), m_fileStreams.size(), m_chunks.size(), m_keyToSequenceInChunk.Size(),
+                m_compression == BinaryCompression::lz4 ? ", LZ4-compressed" : "");
+    }
+}
+
+const char* BinaryChunkDeserializer::GetData(uint64_t offset, uint64_t size, std::vector<char>& buffer) const
+{
+    if (offset > m_source->Size() || size > m_source->Size() - offset)
+        RuntimeError("Malformed input file (%ls): it ends prematurely.", m_filename.c_str());
+    if (m_source->Data() != nullptr)
+        return m_source->Data() + offset;
+
+    buffer.resize((size_t) size);
+    m_source->Read(offset, (size_t) size, buffer.data());
+    return buffer.data();
+}
+
+const char* BinaryChunkDeserializer::DecompressChunk(const char* chunk, BinaryChunkHeader& header, std::vector<char>& buffer) const
+{
+    size_t tableSize = (size_t) header.m_numberOfSequences * sizeof(BinarySequenceHeader);
+    if (header.m_byteSize - tableSize < sizeof(BinaryCompressedData))
+        RuntimeError("Malformed input file (%ls): a compressed chunk lacks its header.", m_filename.c_str());
+    BinaryCompressedData compressed;
+    memcpy(&compressed, chunk + tableSize, sizeof(compressed));
+    if (compressed.m_compressedSize > header.m_byteSize - tableSize - sizeof(BinaryCompressedData))
+        RuntimeError("Malformed input file (%ls): the compressed data exceed their chunk.", m_filename.c_str());
+
+    buffer.resize(tableSize + (size_t) compressed.m_decompressedSize);
+    memcpy(buffer.data(), chunk, tableSize);
+    Lz4Decompress(chunk + tableSize + sizeof(BinaryCompressedData), (size_t) compressed.m_compressedSize,
+                  buffer.data() + tableSize, (size_t) compressed.m_decompressedSize);
+    header.m_byteSize = buffer.size();
+    return buffer.data();
+}
+
+void BinaryChunkDeserializer::ReadStreams(const BinaryFileHeader& header, const BinaryConfigHelper& helper)
+{
+    uint64_t offset = header.m_streamTableOffset;
+    std::vector<char> headerBuffer, nameBuffer;
+    for (uint32_t i = 0; i < header.m_numStreams; i++)
+    {
+        const auto& streamHeader = *(const BinaryStreamHeader*) GetData(offset, sizeof(BinaryStreamHeader), headerBuffer);
+        const char* name = GetData(offset + sizeof(BinaryStreamHeader), streamHeader.m_nameLength, nameBuffer);
+        offset += AlignTo8(sizeof(BinaryStreamHeader) + streamHeader.m_nameLength);
+
+        FileStream stream;
+        stream.m_name.assign(name, (size_t) streamHeader.m_nameLength);
+        if (streamHeader.m_storageType == BinaryStorageType::dense)
+            stream.m_storageType = StorageType::dense;
+        else if (streamHeader.m_storageType == BinaryStorageType::sparse_csc)
+            stream.m_storageType = StorageType::sparse_csc;
+        else
+            RuntimeError("Malformed input file (%ls): unknown storage type of stream '%s'.", m_filename.c_str(), stream.m_name.c_str());
+        if (streamHeader.m_elementType == BinaryElementType::tfloat)
+            stream.m_elementType = ElementType::tfloat;
+        else if (streamHeader.m_elementType == BinaryElementType::tdouble)
+            stream.m_elementType = ElementType::tdouble;
+        else
+            RuntimeError("Malformed input file (%ls): unknown element type of stream '%s'.", m_filename.c_str(), stream.m_name.c_str());
+        stream.m_elementSize = GetElementSize(stream.m_elementType);
+        stream.m_sampleDimension = (size_t) streamHeader.m_sampleDimension;
+        m_fileStreams.push_back(stream);
+    }
+
+    std::vector<BinaryInputDescriptor> inputs = helper.GetInputs();
+    if (inputs.empty()) // all streams, by their names in the file
+    {
+        for (const auto& fileStream : m_fileStreams)
+            inputs.push_back(BinaryInputDescriptor{ msra::strfun::utf16(fileStream.m_name), fileStream.m_name });
+    }
+
+    for (const auto& input : inputs)
+    {
+        auto fileStream = std::find_if(m_fileStreams.begin(), m_fileStreams.end(), [&input](const FileStream& s) { return s.m_name == input.m_fileStreamName; });
+        if (fileStream == m_fileStreams.end())
+            RuntimeError("The input file (%ls) has no stream '%s' (for input '%ls').", m_filename.c_str(), input.m_fileStreamName.c_str(), input.m_name.c_str());
+
+        auto stream = std::make_shared<StreamDescription>();
+        stream->m_id = m_streams.size();
+        stream->m_name = input.m_name;
+        stream->m_storageType = fileStream->m_storageType;
+        stream->m_elementType = helper.GetElementType();
+        stream->m_sampleLayout = std::make_shared<TensorShape>(fileStream->m_sampleDimension);
+        m_streams.push_back(stream);
+        m_fileStreamOfStream.push_back(fileStream - m_fileStreams.begin());
+    }
+}
+
+void BinaryChunkDeserializer::ReadChunks(const BinaryFileHeader& header, CorpusDescriptorPtr corpus)
+{
+    std::vector<char> chunkTable;
+    const auto* chunkHeaders = (const BinaryChunkHeader*) GetData(header.m_chunkTableOffset, header.m_numChunks * sizeof(BinaryChunkHeader), chunkTable);
+    for (uint64_t i = 0; i < header.m_numChunks; i++)
+    {
+        const BinaryChunkHeader& chunkHeader = chunkHeaders[i];
+        if (chunkHeader.m_offset > m_source->Size() || chunkHeader.m_byteSize > m_source->Size() - chunkHeader.m_offset)
+            RuntimeError("Malformed input file (%ls): it ends prematurely.", m_filename.c_str());
+        if (chunkHeader.m_numberOfSequences * sizeof(BinarySequenceHeader) > chunkHeader.m_byteSize)
+            RuntimeError("Malformed input file (%ls): the sequence table of chunk %" PRIu64 " exceeds the chunk.", m_filename.c_str(), i);
+    }
+
+    // The sequence tables of a remote file are read concurrently, being a request each.
+    std::vector<std::vector<char>> sequenceTables((size_t) header.m_numChunks);
+    std::vector<const BinarySequenceHeader*> sequenceHeadersOfChunk((size_t) header.m_numChunks);
+    CPUThreadPool::ParallelFor(0, (size_t) header.m_numChunks, m_source->Data() ? 1 : CPUThreadPool::MinWorkPerChunk, [&](size_t i)
+    {
+        sequenceHeadersOfChunk[i] = (const BinarySequenceHeader*) GetData(chunkHeaders[i].m_offset, chunkHeaders[i].m_numberOfSequences * sizeof(BinarySequenceHeader), sequenceTables[i]);
+    });
+
+    auto& stringRegistry = corpus->GetStringRegistry();
+    for (uint64_t i = 0; i < header.m_numChunks; i++)
+    {
+        const BinaryChunkHeader& chunkHeader = chunkHeaders[i];
+        const auto* sequenceHeaders = sequenceHeadersOfChunk[(size_t) i];
+
+        // only the sequences the corpus includes; chunks without any are left out
+        ChunkInfo chunk;
+        chunk.m_header = chunkHeader;
+        chunk.m_numberOfSamples = 0;
+        ChunkIdType chunkId = (ChunkIdType) m_chunks.size();
+        for (size_t k = 0; k < chunkHeader.m_numberOfSequences; k++)
+        {
+            auto key = std::to_string(sequenceHeaders[k].m_key);
+            if (!corpus->IsIncluded(key))
+                continue;
+
+            SequenceDescription sequence;
+            sequence.m_id = k;
+            sequence.m_numberOfSamples = sequenceHeaders[k].m_numberOfSamples;
+            sequence.m_chunkId = chunkId;
+            sequence.m_key.m_sequence = stringRegistry[key];
+            sequence.m_key.m_sample = 0;
+            m_keyToSequenceInChunk.Add(sequence.m_key.m_sequence, chunkId, chunk.m_sequences.size());
+            chunk.m_numberOfSamples += sequence.m_numberOfSamples;
+            chunk.m_sequences.push_back(sequence);
+        }
+        if (!chunk.m_sequences.empty())
+            m_chunks.push_back(std::move(chunk));
+        std::vector<char>().swap(sequenceTables[(size_t) i]);
+    }
+}
+
+ChunkDescriptions BinaryChunkDeserializer::GetChunkDescriptions()
+{
+    ChunkDescriptions result;
+    result.reserve(m_chunks.size());
+    for (ChunkIdType i = 0; i < m_chunks.size(); i++)
+    {
+        result.push_back(std::shared_ptr<ChunkDescription>(
+            new ChunkDescription{ i, m_chunks[i].m_numberOfSamples, m_chunks[i].m_sequences.size() }));
+    }
+    return result;
+}
+
+void BinaryChunkDeserializer::GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& result)
+{
+    const auto& sequences = m_chunks[chunkId].m_sequences;
+    result.insert(result.end(), sequences.begin(), sequences.end());
+}
+
+bool BinaryChunkDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
+{
+    ChunkIdType chunkId;
+    size_t index;
+    if (!m_keyToSequenceInChunk.TryGet(key.m_sequence, chunkId, index))
+        return false;
+
+    result = m_chunks[chunkId].m_sequences[index];
+    return true;
+}
+
+ChunkPtr BinaryChunkDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    const BinaryChunkHeader& header = m_chunks[chunkId].m_header;
+    m_source->Prefetch(header.m_offset, (size_t) header.m_byteSize);
+    return std::make_shared<BinaryDataChunk>(this, header);
+}
+
+}}}
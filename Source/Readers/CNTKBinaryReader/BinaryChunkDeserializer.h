@@ -0,0 +1,82 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <map>
+#include "DataDeserializerBase.h"
+#include "CorpusDescriptor.h"
+#include "SequenceKeyLocations.h"
+#include "BinaryConfigHelper.h"
+#include "BinaryDataFormat.h"
+#include "ByteSource.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer of the CNTK binary chunked format (see BinaryDataFormat.h).
+// A local file is memory-mapped, and the chunks hand out pointers into the mapping (sparse nnz counts
+// and, if the precision of the file and of the reader differ, the values are the only copies made),
+// so loading a chunk costs no parsing, only the page faults of touching its data.
+// A remote file (see ByteSource) is read with one range read per chunk into a buffer of the chunk.
+// Compressed chunks are decompressed into a buffer of the chunk as they are loaded.
+class BinaryChunkDeserializer : public DataDeserializerBase
+{
+public:
+    BinaryChunkDeserializer(CorpusDescriptorPtr corpus, const BinaryConfigHelper& helper);
+
+    // Retrieves a chunk of data.
+    ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+    // Get information about chunks.
+    ChunkDescriptions GetChunkDescriptions() override;
+
+    // Get information about particular chunk.
+    void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& result) override;
+
+    bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result) override;
+
+private:
+    class BinaryDataChunk;
+
+    // A stream as stored in the file.
+    struct FileStream
+    {
+        std::string m_name;
+        StorageType m_storageType;
+        size_t m_elementSize;
+        ElementType m_elementType;
+        size_t m_sampleDimension;
+    };
+
+    // A chunk with the sequences the corpus includes (m_id is the index in the sequence table of the file chunk).
+    struct ChunkInfo
+    {
+        BinaryChunkHeader m_header;
+        size_t m_numberOfSamples;
+        std::vector<SequenceDescription> m_sequences;
+    };
+
+    void ReadStreams(const BinaryFileHeader& header, const BinaryConfigHelper& helper);
+    void ReadChunks(const BinaryFileHeader& header, CorpusDescriptorPtr corpus);
+
+    // checked access to the file: points into the mapping of a local file, or reads into buffer
+    const char* GetData(uint64_t offset, uint64_t size, std::vector<char>& buffer) const;
+
+    // decompresses a chunk into buffer (see BinaryDataFormat.h); header.m_byteSize becomes the decompressed size
+    const char* DecompressChunk(const char* chunk, BinaryChunkHeader& header, std::vector<char>& buffer) const;
+
+    std::wstring m_filename;
+    ByteSourcePtr m_source;
+    BinaryCompression m_compression;
+    std::vector<FileStream> m_fileStreams;
+    std::vector<size_t> m_fileStreamOfStream; // index into m_fileStreams of each exposed stream (m_streams)
+    std::vector<ChunkInfo> m_chunks;
+    SequenceKeyLocations m_keyToSequenceInChunk; // sequence key -> location in m_chunks
+    unsigned int m_traceLevel;
+
+    DISABLE_COPY_AND_MOVE(BinaryChunkDeserializer);
+};
+
+}}}
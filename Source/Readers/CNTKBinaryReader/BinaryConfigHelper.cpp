@@ -0,0 +1,87 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "BinaryConfigHelper.h"
+#include "ByteSource.h"
+#include "DataReader.h"
+#include "StringUtil.h"
+
+using std::string;
+using std::wstring;
+using std::pair;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+BinaryConfigHelper::BinaryConfigHelper(const ConfigParameters& config)
+{
+    string precision = config.Find("precision", "float");
+    if (AreEqualIgnoreCase(precision, "double"))
+    {
+        m_elementType = ElementType::tdouble;
+    }
+    else if (AreEqualIgnoreCase(precision, "float"))
+    {
+        m_elementType = ElementType::tfloat;
+    }
+    else
+    {
+        RuntimeError("Not supported precision '%s'. Expected 'double' or 'float'.", precision.c_str());
+    }
+
+    // The input section is optional: each entry exposes the stream 'alias' of the file (default: the same name) as the input.
+    if (config.ExistsCurrent(L"input"))
+    {
+        const ConfigParameters& input = config(L"input");
+        for (const pair<string, ConfigParameters>& section : input)
+        {
+            ConfigParameters stream = section.second;
+            BinaryInputDescriptor descriptor;
+            descriptor.m_name = msra::strfun::utf16(section.first);
+            descriptor.m_fileStreamName = stream.ExistsCurrent(L"alias") ? (string) stream(L"alias") : section.first;
+            if (descriptor.m_fileStreamName.empty())
+            {
+                RuntimeError("Alias value for input '%ls' is empty.", descriptor.m_name.c_str());
+            }
+            m_inputs.push_back(descriptor);
+        }
+    }
+
+    m_filepath = msra::strfun::utf16(config(L"file"));
+
+    wstring randomizeString = config(L"randomize", wstring());
+    if (!_wcsicmp(randomizeString.c_str(), L"none")) // (for DoWriteOutput(), see TextConfigHelper)
+    {
+        m_randomizationWindow = randomizeNone;
+    }
+    else
+    {
+        bool randomize = config(L"randomize", true);
+
+        if (!randomize)
+        {
+            m_randomizationWindow = randomizeNone;
+        }
+        else if (config.Exists(L"randomizationWindow"))
+        {
+            m_randomizationWindow = config(L"randomizationWindow");
+        }
+        else
+        {
+            m_randomizationWindow = randomizeAuto;
+        }
+    }
+
+    m_cacheDirectory = config(L"cacheDirectory", wstring());
+
+    // Chunks can be loaded concurrently, so reading ahead is safe here. Remote files read ahead by default,
+    // so that the range requests of the next chunks overlap the training on the current ones.
+    m_numPrefetchChunks = config(L"prefetchChunks", IsRemotePath(m_filepath) ? (size_t) 4 : (size_t) 0);
+    m_partitionChunks = config(L"partitionChunks", false);
+    m_traceLevel = config(L"traceLevel", 1);
+    m_frameMode = config(L"frameMode", false);
+}
+
+}}}
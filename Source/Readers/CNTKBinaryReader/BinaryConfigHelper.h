@@ -0,0 +1,67 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Config.h"
+#include "Reader.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// An input stream as selected in the configuration: the name under which it is exposed,
+// and the name of the stream in the binary file.
+struct BinaryInputDescriptor
+{
+    std::wstring m_name;
+    std::string m_fileStreamName;
+};
+
+// A helper class for binary reader specific parameters.
+// A simple wrapper around CNTK ConfigParameters.
+class BinaryConfigHelper
+{
+public:
+    explicit BinaryConfigHelper(const ConfigParameters& config);
+
+    // The streams to read; empty means all streams of the file, under their names in the file.
+    const std::vector<BinaryInputDescriptor>& GetInputs() const { return m_inputs; }
+
+    // Get full path to the input file.
+    const std::wstring& GetFilePath() const { return m_filepath; }
+
+    // Local directory that keeps the chunks read from a remote input file (see ByteSource), empty for none.
+    const std::wstring& GetCacheDirectory() const { return m_cacheDirectory; }
+
+    size_t GetRandomizationWindow() const { return m_randomizationWindow; }
+
+    // Number of chunks to load ahead of the randomization window (see BlockRandomizer).
+    size_t GetNumPrefetchChunks() const { return m_numPrefetchChunks; }
+
+    // In distributed reading, each worker owns a fixed set of chunks (see BlockRandomizer::DecimationMode::partition).
+    bool ShouldPartitionChunks() const { return m_partitionChunks; }
+
+    unsigned int GetTraceLevel() const { return m_traceLevel; }
+
+    bool IsInFrameMode() const { return m_frameMode; }
+
+    ElementType GetElementType() const { return m_elementType; }
+
+    DISABLE_COPY_AND_MOVE(BinaryConfigHelper);
+
+private:
+    std::wstring m_filepath;
+    std::wstring m_cacheDirectory;
+    std::vector<BinaryInputDescriptor> m_inputs;
+    size_t m_randomizationWindow;
+    size_t m_numPrefetchChunks;
+    bool m_partitionChunks;
+    ElementType m_elementType;
+    unsigned int m_traceLevel;
+    bool m_frameMode; // if true, the maximum expected sequence length in the dataset is one sample.
+};
+
+}}}
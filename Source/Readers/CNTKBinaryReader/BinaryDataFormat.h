@@ -0,0 +1,118 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// CNTK binary chunked data format, as read by the BinaryChunkDeserializer and written by
+// cntk_binary_format_converter.py. All integers are little-endian.
+//
+//   header:       BinaryFileHeader at offset 0
+//   stream table: at m_streamTableOffset, m_numStreams entries: BinaryStreamHeader, followed by the UTF-8 stream name
+//                 of m_nameLength bytes, padded to a multiple of 8
+//   chunks:       each at an 8-byte aligned offset, see below
+//   chunk table:  at m_chunkTableOffset, m_numChunks BinaryChunkHeader entries
+//
+// A chunk starts with its sequence table (m_numSequences BinarySequenceHeader entries), followed by the data of
+// its sequences. The data of a sequence are, per stream in the order of the stream table, a BinaryStreamRecord
+// followed by
+//   dense:  m_numberOfSamples * sampleDimension values
+//   sparse: int32 nnzCounts[m_numberOfSamples], int32 indices[m_totalNnzCount], padding to 8, values[m_totalNnzCount]
+// and padding to a multiple of 8 bytes. Everything is thus aligned such that the data can be used in place
+// from a memory mapping of the file.
+//
+// Version 2 adds compression (m_compression != none): the data of the sequences of each chunk are then
+// compressed as a whole. Such a chunk consists of its sequence table, a BinaryCompressedData header and
+// the compressed block; the m_dataOffset of the sequences refer to the decompressed chunk, which is the
+// sequence table directly followed by the decompressed data. Compressed chunks are decompressed as they
+// are loaded, i.e. on the threads that prefetch chunks.
+// -----------------------------------------------------------------------
+
+static const char s_binaryFormatMagic[8] = { 'C', 'N', 'T', 'K', 'B', 'C', 'F', '1' };
+
+enum class BinaryStorageType : uint32_t
+{
+    dense = 0,
+    sparse_csc = 1,
+};
+
+enum class BinaryElementType : uint32_t
+{
+    tfloat = 0,
+    tdouble = 1,
+};
+
+enum class BinaryCompression : uint32_t
+{
+    none = 0,
+    lz4 = 1, // LZ4 block format, see Lz4Codec.h
+};
+
+struct BinaryFileHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_numStreams;
+    uint64_t m_numChunks;
+    uint64_t m_numSequences;
+    uint64_t m_streamTableOffset;
+    uint64_t m_chunkTableOffset;
+    BinaryCompression m_compression; // (version 2) of the chunks
+    uint32_t m_reserved0;
+    uint64_t m_reserved;
+};
+
+struct BinaryStreamHeader
+{
+    BinaryStorageType m_storageType;
+    BinaryElementType m_elementType;
+    uint64_t m_sampleDimension;
+    uint64_t m_nameLength;
+};
+
+struct BinaryChunkHeader
+{
+    uint64_t m_offset;   // of the chunk in the file
+    uint64_t m_byteSize;
+    uint64_t m_numberOfSequences;
+    uint64_t m_numberOfSamples;
+};
+
+struct BinarySequenceHeader
+{
+    uint64_t m_key;             // sequence id, used to match the sequences of different deserializers
+    uint32_t m_numberOfSamples; // the largest number of samples among the streams
+    uint32_t m_reserved;
+    uint64_t m_dataOffset;      // of the sequence data, from the start of the chunk
+};
+
+// (version 2) follows the sequence table of a compressed chunk
+struct BinaryCompressedData
+{
+    uint64_t m_decompressedSize; // of the sequence data
+    uint64_t m_compressedSize;
+};
+
+struct BinaryStreamRecord
+{
+    uint32_t m_numberOfSamples;
+    uint32_t m_totalNnzCount; // (sparse only)
+};
+
+// files without compression are written as version 1, which readers of both versions read
+static const uint32_t s_binaryFormatVersion = 2;
+
+static_assert(sizeof(BinaryFileHeader) == 64, "BinaryFileHeader must match the file layout");
+static_assert(sizeof(BinaryStreamHeader) == 24, "BinaryStreamHeader must match the file layout");
+static_assert(sizeof(BinaryChunkHeader) == 32, "BinaryChunkHeader must match the file layout");
+static_assert(sizeof(BinarySequenceHeader) == 24, "BinarySequenceHeader must match the file layout");
+static_assert(sizeof(BinaryCompressedData) == 16, "BinaryCompressedData must match the file layout");
+static_assert(sizeof(BinaryStreamRecord) == 8, "BinaryStreamRecord must match the file layout");
+
+}}}
@@ -0,0 +1,100 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CNTKBinaryReader.h"
+#include "Config.h"
+#include "BinaryConfigHelper.h"
+#include "BinaryChunkDeserializer.h"
+#include "BlockRandomizer.h"
+#include "NoRandomizer.h"
+#include "SequencePacker.h"
+#include "FramePacker.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Same composition as the CNTKTextFormatReader, for configs that use the binary format directly
+// (the generic way is the CompositeDataReader with a CNTKBinaryFormatDeserializer).
+CNTKBinaryReader::CNTKBinaryReader(MemoryProviderPtr provider,
+    const ConfigParameters& config) :
+    m_provider(provider)
+{
+    BinaryConfigHelper configHelper(config);
+
+    try
+    {
+        m_deserializer = std::make_shared<BinaryChunkDeserializer>(std::make_shared<CorpusDescriptor>(), configHelper);
+
+        size_t window = configHelper.GetRandomizationWindow();
+        if (window > 0)
+        {
+            // Verbosity is a general config parameter, not specific to the binary reader.
+            int verbosity = config(L"verbosity", 0);
+            auto decimationMode = configHelper.ShouldPartitionChunks() ? BlockRandomizer::DecimationMode::partition : BlockRandomizer::DecimationMode::chunk;
+            m_randomizer = std::make_shared<BlockRandomizer>(verbosity, window, m_deserializer,
+                decimationMode, false /* useLegacyRandomization */, false /* multithreadedGetNextSequences */,
+                configHelper.GetNumPrefetchChunks());
+        }
+        else
+        {
+            m_randomizer = std::make_shared<NoRandomizer>(m_deserializer);
+        }
+
+        if (configHelper.IsInFrameMode())
+        {
+            m_packer = std::make_shared<FramePacker>(
+                m_provider,
+                m_randomizer,
+                GetStreamDescriptions());
+        }
+        else
+        {
+            m_packer = std::make_shared<SequencePacker>(
+                m_provider,
+                m_randomizer,
+                GetStreamDescriptions());
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        RuntimeError("CNTKBinaryReader: While reading '%ls': %s", configHelper.GetFilePath().c_str(), e.what());
+    }
+}
+
+std::vector<StreamDescriptionPtr> CNTKBinaryReader::GetStreamDescriptions()
+{
+    return m_deserializer->GetStreamDescriptions();
+}
+
+void CNTKBinaryReader::StartEpoch(const EpochConfiguration& config)
+{
+    if (config.m_totalEpochSizeInSamples == 0)
+    {
+        RuntimeError("Epoch size cannot be 0.");
+    }
+
+    m_randomizer->StartEpoch(config);
+    m_packer->StartEpoch(config);
+}
+
+Minibatch CNTKBinaryReader::ReadMinibatch()
+{
+    assert(m_packer != nullptr);
+    return m_packer->ReadMinibatch();
+}
+
+bool CNTKBinaryReader::GetState(ReaderState& state)
+{
+    assert(m_packer != nullptr);
+    return m_packer->GetState(state);
+}
+
+void CNTKBinaryReader::SetState(const ReaderState& state)
+{
+    assert(m_packer != nullptr);
+    m_packer->SetState(state);
+}
+
+}}}
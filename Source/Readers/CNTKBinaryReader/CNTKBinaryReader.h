@@ -0,0 +1,50 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "Reader.h"
+#include "Packer.h"
+#include "SequenceEnumerator.h"
+#include "DataDeserializer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Implementation of the binary reader.
+// Effectively the class represents a factory for connecting the packer,
+// randomizer and the deserializer together.
+class CNTKBinaryReader : public Reader
+{
+public:
+    CNTKBinaryReader(MemoryProviderPtr provider,
+        const ConfigParameters& parameters);
+
+    // Description of streams that this reader provides.
+    std::vector<StreamDescriptionPtr> GetStreamDescriptions() override;
+
+    // Starts a new epoch with the provided configuration.
+    void StartEpoch(const EpochConfiguration& config) override;
+
+    // Reads a single minibatch.
+    Minibatch ReadMinibatch() override;
+
+    // Gets and restores the position in the epoch.
+    bool GetState(ReaderState& state) override;
+    void SetState(const ReaderState& state) override;
+
+private:
+    IDataDeserializerPtr m_deserializer;
+
+    // Randomizer.
+    SequenceEnumeratorPtr m_randomizer;
+
+    // Packer.
+    PackerPtr m_packer;
+
+    // Memory provider (TODO: this will possibly change in the near future.)
+    MemoryProviderPtr m_provider;
+};
+
+}}}
@@ -0,0 +1,46 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Exports.cpp : Defines the exported functions for the DLL application.
+//
+
+#include "stdafx.h"
+#define DATAREADER_EXPORTS
+#include "DataReader.h"
+#include "ReaderShim.h"
+#include "CNTKBinaryReader.h"
+#include "BinaryChunkDeserializer.h"
+#include "StringUtil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+auto factory = [](const ConfigParameters& parameters, MemoryProviderPtr memoryProvider) -> ReaderPtr
+{
+    return std::make_shared<CNTKBinaryReader>(memoryProvider, parameters);
+};
+
+extern "C" DATAREADER_API void GetReaderF(IDataReader** preader)
+{
+    *preader = new ReaderShim<float>(factory);
+}
+
+extern "C" DATAREADER_API void GetReaderD(IDataReader** preader)
+{
+    *preader = new ReaderShim<double>(factory);
+}
+
+// TODO: Not safe from the ABI perspective. Will be uglified to make the interface ABI.
+// A factory method for creating binary deserializers.
+extern "C" DATAREADER_API bool CreateDeserializer(IDataDeserializer** deserializer, const std::wstring& type, const ConfigParameters& deserializerConfig, CorpusDescriptorPtr corpus, bool)
+{
+    if (type == L"CNTKBinaryFormatDeserializer")
+        *deserializer = new BinaryChunkDeserializer(corpus, BinaryConfigHelper(deserializerConfig));
+    else
+        InvalidArgument("Unknown deserializer type '%ls'", type.c_str());
+
+    // Deserializer created.
+    return true;
+}
+
+}}}
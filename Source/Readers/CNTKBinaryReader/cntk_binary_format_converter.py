@@ -0,0 +1,261 @@
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+#
+# Converts CNTK text format (CTF), UCI and LibSVM files into the CNTK binary
+# chunked format read by the CNTKBinaryReader (see BinaryDataFormat.h).
+
+import argparse
+import struct
+
+MAGIC = b'CNTKBCF1'
+VERSION = 1
+VERSION_COMPRESSED = 2
+DENSE, SPARSE = 0, 1
+FLOAT, DOUBLE = 0, 1
+NO_COMPRESSION, LZ4 = 0, 1
+
+HEADER = struct.Struct('<8sIIQQQQIIQ')     # BinaryFileHeader
+STREAM_HEADER = struct.Struct('<IIQQ')     # BinaryStreamHeader
+CHUNK_HEADER = struct.Struct('<QQQQ')      # BinaryChunkHeader
+SEQUENCE_HEADER = struct.Struct('<QIIQ')   # BinarySequenceHeader
+STREAM_RECORD = struct.Struct('<II')       # BinaryStreamRecord
+COMPRESSED_DATA = struct.Struct('<QQ')     # BinaryCompressedData
+
+
+def pad8(data):
+    return data + b'\0' * (-len(data) % 8)
+
+
+class Stream(object):
+    def __init__(self, name, storage, dim, alias=None):
+        self.name = name
+        self.storage = storage
+        self.dim = dim
+        self.alias = alias if alias is not None else name
+
+
+class BinaryWriter(object):
+    '''Writes sequences into chunks of about chunk_size bytes.
+    A sequence is a list with one entry per stream: a list of samples, each a list
+    of values (dense) or a list of (index, value) pairs (sparse).'''
+
+    def __init__(self, file_out, streams, precision='float', chunk_size=32 * 1024 * 1024, compression='none'):
+        self.streams = streams
+        self.compression = LZ4 if compression == 'lz4' else NO_COMPRESSION
+        if self.compression == LZ4:
+            import lz4.block  # the 'lz4' package
+            self.compress = lambda data: lz4.block.compress(data, store_size=False)
+        self.value_format = 'd' if precision == 'double' else 'f'
+        self.element_type = DOUBLE if precision == 'double' else FLOAT
+        self.chunk_size = chunk_size
+        self.output = open(file_out, 'wb')
+        self.output.write(b'\0' * HEADER.size)  # written in close()
+        self.stream_table_offset = self.output.tell()
+        for s in streams:
+            name = s.name.encode('utf-8')
+            self.output.write(pad8(STREAM_HEADER.pack(s.storage, self.element_type, s.dim, len(name)) + name))
+        self.chunks = []
+        self.num_sequences = 0
+        self._start_chunk()
+
+    def _start_chunk(self):
+        self.sequences = []  # (key, number of samples, data)
+        self.chunk_bytes = 0
+
+    def _encode_stream(self, stream, samples):
+        if stream.storage == DENSE:
+            values = []
+            for sample in samples:
+                if len(sample) > stream.dim:
+                    raise RuntimeError("Dense sample of input '{}' has {} values, expected {}"
+                                       .format(stream.name, len(sample), stream.dim))
+                values.extend(sample)
+                values.extend([0.0] * (stream.dim - len(sample)))  # a sparse suffix
+            return pad8(STREAM_RECORD.pack(len(samples), 0) +
+                        struct.pack('<%d%s' % (len(values), self.value_format), *values))
+        nnz_counts, indices, values = [], [], []
+        for sample in samples:
+            nnz_counts.append(len(sample))
+            for index, value in sample:
+                if index >= stream.dim:
+                    raise RuntimeError("Sparse index {} of input '{}' exceeds the dimension {}"
+                                       .format(index, stream.name, stream.dim))
+                indices.append(index)
+                values.append(value)
+        data = pad8(STREAM_RECORD.pack(len(samples), len(values)) +
+                    struct.pack('<%di' % len(nnz_counts), *nnz_counts) +
+                    struct.pack('<%di' % len(indices), *indices))
+        return pad8(data + struct.pack('<%d%s' % (len(values), self.value_format), *values))
+
+    def add_sequence(self, key, sequence):
+        data = b''.join(self._encode_stream(s, samples) for s, samples in zip(self.streams, sequence))
+        num_samples = max(len(samples) for samples in sequence)
+        if self.sequences and self.chunk_bytes + len(data) > self.chunk_size:
+            self._write_chunk()
+        self.sequences.append((key, num_samples, data))
+        self.chunk_bytes += len(data)
+        self.num_sequences += 1
+
+    def _write_chunk(self):
+        if not self.sequences:
+            return
+        offset = self.output.tell()
+        data_offset = SEQUENCE_HEADER.size * len(self.sequences)
+        table = []
+        for key, num_samples, data in self.sequences:
+            table.append(SEQUENCE_HEADER.pack(key, num_samples, 0, data_offset))
+            data_offset += len(data)
+        self.output.write(b''.join(table))
+        if self.compression == LZ4:
+            data = b''.join(data for _, _, data in self.sequences)
+            block = self.compress(data)
+            self.output.write(pad8(COMPRESSED_DATA.pack(len(data), len(block)) + block))
+        else:
+            for _, _, data in self.sequences:
+                self.output.write(data)
+        self.chunks.append(CHUNK_HEADER.pack(offset, self.output.tell() - offset, len(self.sequences),
+                                             sum(n for _, n, _ in self.sequences)))
+        self._start_chunk()
+
+    def close(self):
+        self._write_chunk()
+        chunk_table_offset = self.output.tell()
+        self.output.write(b''.join(self.chunks))
+        self.output.seek(0)
+        version = VERSION_COMPRESSED if self.compression != NO_COMPRESSION else VERSION
+        self.output.write(HEADER.pack(MAGIC, version, len(self.streams), len(self.chunks), self.num_sequences,
+                                      self.stream_table_offset, chunk_table_offset, self.compression, 0, 0))
+        self.output.close()
+
+
+def read_ctf(file_in, streams):
+    '''Yields (key, sequence) from a CNTK text format file. Rows with the same leading
+    sequence id form a sequence; without ids, each row is a sequence keyed by its line number.'''
+    alias_to_index = {s.alias: i for i, s in enumerate(streams)}
+    key, sequence = None, None
+    with open(file_in, 'r') as f:
+        for line_number, line in enumerate(f):
+            line = line.rstrip('\r\n')
+            if not line.strip():
+                continue
+            prefix, _, rest = line.partition('|')
+            prefix = prefix.strip()
+            row_key = int(prefix) if prefix else line_number
+            if sequence is not None and row_key != key:
+                yield key, sequence
+                sequence = None
+            if sequence is None:
+                key, sequence = row_key, [[] for _ in streams]
+            for field in rest.split('|'):
+                if not field or field.startswith('#'):
+                    continue  # a comment
+                parts = field.split(None, 1)
+                alias, values = parts[0], parts[1] if len(parts) > 1 else ''
+                if alias not in alias_to_index:
+                    raise RuntimeError("Unknown input '{}' in line {}".format(alias, line_number + 1))
+                i = alias_to_index[alias]
+                if streams[i].storage == DENSE:
+                    sequence[i].append([float(v) for v in values.split()])
+                else:
+                    sequence[i].append([(int(iv.split(':')[0]), float(iv.split(':')[1])) for iv in values.split()])
+    if sequence is not None:
+        yield key, sequence
+
+
+def label_vector(label, label_map, num_labels):
+    if label not in label_map:
+        raise RuntimeError("Illegal label value: '{}'".format(label))
+    one_hot = [0.0] * num_labels
+    one_hot[label_map[label]] = 1.0
+    return one_hot
+
+
+def read_uci(file_in, features_start, features_dim, labels_start, num_labels, label_map):
+    '''Yields (key, sequence) from a UCI file, one sample per line, as 'features' and one-hot 'labels'.'''
+    with open(file_in, 'r') as f:
+        for line_number, line in enumerate(f):
+            values = line.split()
+            if not values:
+                continue
+            if len(values) < max(features_start + features_dim, labels_start + 1):
+                raise RuntimeError("Too few input columns in line {}".format(line_number + 1))
+            features = [float(v) for v in values[features_start:features_start + features_dim]]
+            yield line_number, [[features], [label_vector(values[labels_start], label_map, num_labels)]]
+
+
+def read_libsvm(file_in, features_dim, num_labels, label_map, zero_based):
+    '''Yields (key, sequence) from a LibSVM file, one sample per line, as sparse 'features'
+    and one-hot 'labels' (or the label value itself if num_labels is 0).'''
+    offset = 0 if zero_based else 1
+    with open(file_in, 'r') as f:
+        for line_number, line in enumerate(f):
+            values = line.split('#')[0].split()
+            if not values:
+                continue
+            features = [(int(iv.split(':')[0]) - offset, float(iv.split(':')[1])) for iv in values[1:]]
+            label = label_vector(values[0], label_map, num_labels) if num_labels > 0 else [float(values[0])]
+            yield line_number, [[features], [label]]
+
+
+def make_label_map(num_labels, mapping_file):
+    label_map = {str(x): x for x in range(num_labels)}
+    if mapping_file is not None:
+        label_map = {}
+        with open(mapping_file, 'r') as f:
+            for line in f.read().splitlines():
+                label_map[line] = len(label_map)
+    return label_map, max(num_labels, len(label_map))
+
+
+def parse_stream(spec):
+    # name:dense|sparse:dim[:alias]
+    parts = spec.split(':')
+    if len(parts) not in (3, 4) or parts[1] not in ('dense', 'sparse'):
+        raise argparse.ArgumentTypeError("Expected name:dense|sparse:dim[:alias], got '{}'".format(spec))
+    return Stream(parts[0], DENSE if parts[1] == 'dense' else SPARSE, int(parts[2]),
+                  parts[3] if len(parts) == 4 else None)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="CTF, UCI and LibSVM to CNTK binary format converter")
+    parser.add_argument('-in', '--input_file', required=True, help='input file path')
+    parser.add_argument('-out', '--output_file', required=True, help='output file path')
+    parser.add_argument('-f', '--format', choices=['ctf', 'uci', 'libsvm'], default='ctf', help='input format')
+    parser.add_argument('-s', '--stream', type=parse_stream, action='append', default=[],
+                        help='(ctf) an input, as name:dense|sparse:dim[:alias]; may be repeated')
+    parser.add_argument('-fs', '--features_start', type=int, default=0, help='(uci) index of the first feature column')
+    parser.add_argument('-fd', '--features_dim', type=int, help='(uci, libsvm) feature dimension')
+    parser.add_argument('-ls', '--labels_start', type=int, default=0, help='(uci) index of the label column')
+    parser.add_argument('-nl', '--num_labels', type=int, default=0, help='(uci, libsvm) number of label classes')
+    parser.add_argument('-lm', '--label_mapping_file', help='(uci, libsvm) label values, one per line')
+    parser.add_argument('-zb', '--zero_based', action='store_true', help='(libsvm) feature indices start at 0')
+    parser.add_argument('-p', '--precision', choices=['float', 'double'], default='float')
+    parser.add_argument('-c', '--chunk_size', type=int, default=32 * 1024 * 1024, help='chunk size in bytes')
+    parser.add_argument('-z', '--compression', choices=['none', 'lz4'], default='none',
+                        help='compression of the chunks (lz4 requires the lz4 package)')
+    args = parser.parse_args()
+
+    if args.format == 'ctf':
+        if not args.stream:
+            parser.error('ctf input requires at least one --stream')
+        streams = args.stream
+        sequences = read_ctf(args.input_file, streams)
+    else:
+        if args.features_dim is None:
+            parser.error('{} input requires --features_dim'.format(args.format))
+        label_map, num_labels = make_label_map(args.num_labels, args.label_mapping_file)
+        if args.format == 'uci':
+            if num_labels == 0:
+                parser.error('uci input requires --num_labels or --label_mapping_file')
+            streams = [Stream('features', DENSE, args.features_dim), Stream('labels', DENSE, num_labels)]
+            sequences = read_uci(args.input_file, args.features_start, args.features_dim,
+                                 args.labels_start, num_labels, label_map)
+        else:
+            streams = [Stream('features', SPARSE, args.features_dim), Stream('labels', DENSE, max(num_labels, 1))]
+            sequences = read_libsvm(args.input_file, args.features_dim, num_labels, label_map, args.zero_based)
+
+    writer = BinaryWriter(args.output_file, streams, args.precision, args.chunk_size, args.compression)
+    for key, sequence in sequences:
+        writer.add_sequence(key, sequence)
+    writer.close()
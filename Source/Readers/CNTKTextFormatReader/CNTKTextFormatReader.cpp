@@ -10,6 +10,7 @@
 #include "ChunkCache.h"
 #include "BlockRandomizer.h"
 #include "NoRandomizer.h"
+#include "ShuffleBufferRandomizer.h"
 #include "TextParser.h"
 #include "SequencePacker.h"
 #include "FramePacker.h"
@@ -36,17 +37,23 @@ CNTKTextFormatReader::CNTKTextFormatReader(MemoryProviderPtr provider,
             m_deserializer = shared_ptr<IDataDeserializer>(new TextParser<double>(configHelper));
         }
 
-        if (configHelper.ShouldKeepDataInMemory()) 
+        if (configHelper.ShouldKeepDataInMemory() || configHelper.GetChunkCacheBudget() > 0)
         {
-            m_deserializer = shared_ptr<IDataDeserializer>(new ChunkCache(m_deserializer));
+            m_deserializer = shared_ptr<IDataDeserializer>(
+                new ChunkCache(m_deserializer, configHelper.GetChunkCacheBudget(), configHelper.GetTraceLevel(), configHelper.ShouldCompressChunkCache()));
         }
 
         size_t window = configHelper.GetRandomizationWindow();
-        if (window > 0)
+        if (window > 0 && configHelper.GetShuffleBufferSize() > 0)
+        {
+            m_randomizer = make_shared<ShuffleBufferRandomizer>(m_deserializer, configHelper.GetShuffleBufferSize());
+        }
+        else if (window > 0)
         {
             // Verbosity is a general config parameter, not specific to the text format reader.
             int verbosity = config(L"verbosity", 0);
-            m_randomizer = make_shared<BlockRandomizer>(verbosity, window, m_deserializer);
+            auto decimationMode = configHelper.ShouldPartitionChunks() ? BlockRandomizer::DecimationMode::partition : BlockRandomizer::DecimationMode::chunk;
+            m_randomizer = make_shared<BlockRandomizer>(verbosity, window, m_deserializer, decimationMode);
         }
         else
         {
@@ -95,4 +102,16 @@ Minibatch CNTKTextFormatReader::ReadMinibatch()
     assert(m_packer != nullptr);
     return m_packer->ReadMinibatch();
 }
+
+bool CNTKTextFormatReader::GetState(ReaderState& state)
+{
+    assert(m_packer != nullptr);
+    return m_packer->GetState(state);
+}
+
+void CNTKTextFormatReader::SetState(const ReaderState& state)
+{
+    assert(m_packer != nullptr);
+    m_packer->SetState(state);
+}
 } } }
@@ -30,6 +30,10 @@ public:
     // Reads a single minibatch.
     Minibatch ReadMinibatch() override;
 
+    // Gets and restores the position in the epoch.
+    bool GetState(ReaderState& state) override;
+    void SetState(const ReaderState& state) override;
+
 private:
     IDataDeserializerPtr m_deserializer;
 
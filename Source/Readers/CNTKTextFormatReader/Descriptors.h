@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <vector>
 #include "DataDeserializer.h"
+#include "SequenceKeyLocations.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -61,7 +62,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     struct Index
     {
         std::vector<ChunkDescriptor> m_chunks;                                  // chunks
-        std::map<size_t, std::pair<size_t, size_t>> m_keyToSequenceInChunk;     // sequence key -> sequence location in chunk
+        SequenceKeyLocations m_keyToSequenceInChunk;                            // sequence key -> sequence location in chunk
         const size_t m_maxChunkSize;                                            // maximum chunk size in bytes
 
         explicit Index(size_t chunkSize) : m_maxChunkSize(chunkSize)
@@ -92,9 +93,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             chunk->m_numberOfSamples += sd.m_numberOfSamples;
             sd.m_chunkId = chunk->m_id;
             sd.m_id = chunk->m_sequences.size();
-            auto location = std::make_pair(chunk->m_id, sd.m_id);
-            auto sequenceId = sd.m_key.m_sequence;
-            m_keyToSequenceInChunk.insert(std::make_pair(sequenceId, location));
+            m_keyToSequenceInChunk.Add(sd.m_key.m_sequence, chunk->m_id, sd.m_id);
             chunk->m_sequences.push_back(sd);
         }
 
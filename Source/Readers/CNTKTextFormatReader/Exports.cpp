@@ -10,16 +10,13 @@
 #include "DataReader.h"
 #include "ReaderShim.h"
 #include "CNTKTextFormatReader.h"
-#include "HeapMemoryProvider.h"
 #include "StringUtil.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-// TODO: Memory provider should be injected by SGD.
-
-auto factory = [](const ConfigParameters& parameters) -> ReaderPtr
+auto factory = [](const ConfigParameters& parameters, MemoryProviderPtr memoryProvider) -> ReaderPtr
 {
-    return std::make_shared<CNTKTextFormatReader>(std::make_shared<HeapMemoryProvider>(), parameters);
+    return std::make_shared<CNTKTextFormatReader>(memoryProvider, parameters);
 };
 
 extern "C" DATAREADER_API void GetReaderF(IDataReader** preader)
@@ -6,6 +6,11 @@
 #include "stdafx.h"
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <chrono>
+#include <thread>
 #include "Indexer.h"
 #include "TextReaderConstants.h"
 
@@ -13,6 +18,58 @@ using std::string;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// Layout of the index cache file: the header, the input path (UTF-8), then one entry per sequence of the input.
+// The magic is written last, so a file whose writing was interrupted is not valid.
+struct IndexCacheHeader
+{
+    char m_magic[8];
+    uint64_t m_fileSize;           // of the input, at the time of indexing
+    int64_t m_fileTime;            // likewise the modification time
+    uint64_t m_numSequences;
+    uint32_t m_skipSequenceIds;    // as passed to the Indexer
+    uint32_t m_hasSequenceIds;     // the result of indexing
+    uint64_t m_pathLength;
+};
+
+struct IndexCacheEntry
+{
+    uint64_t m_key;                // sequence id, or line number
+    uint64_t m_numberOfSamples;
+    int64_t m_fileOffsetBytes;
+    uint64_t m_byteSize;
+};
+
+static const char s_indexCacheMagic[8] = { 'C', 'T', 'F', 'I', 'D', 'X', '0', '1' };
+
+// if the writer of an index cache does not make progress for this long, it is assumed to have died
+static const auto s_indexCacheWriterTimeout = std::chrono::seconds(60);
+
+static bool GetFileSizeAndTime(const std::wstring& path, uint64_t& size, int64_t& time)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_wstat64(path.c_str(), &info) != 0)
+        return false;
+#else
+    struct stat info;
+    if (stat(wtocharpath(path).c_str(), &info) != 0)
+        return false;
+#endif
+    size = (uint64_t) info.st_size;
+    time = (int64_t) info.st_mtime;
+    return true;
+}
+
+// returns nullptr if the file exists already (errno = EEXIST) or cannot be created
+static FILE* CreateFileExclusively(const std::wstring& path)
+{
+#ifdef _WIN32
+    return _wfopen(path.c_str(), L"wbx");
+#else
+    return fopen(wtocharpath(path).c_str(), "wbx");
+#endif
+}
+
 Indexer::Indexer(FILE* file, bool skipSequenceIds, size_t chunkSize) :
     m_file(file),
     m_fileOffsetStart(0),
@@ -23,7 +80,10 @@ Indexer::Indexer(FILE* file, bool skipSequenceIds, size_t chunkSize) :
     m_pos(nullptr),
     m_done(false),
     m_hasSequenceIds(!skipSequenceIds),
-    m_index(chunkSize)
+    m_skipSequenceIds(skipSequenceIds),
+    m_index(chunkSize),
+    m_cacheFile(nullptr),
+    m_numCachedSequences(0)
 {
     if (m_file == nullptr)
     {
@@ -31,6 +91,145 @@ Indexer::Indexer(FILE* file, bool skipSequenceIds, size_t chunkSize) :
     }
 }
 
+void Indexer::EnableIndexCache(const std::wstring& inputFilePath)
+{
+    m_inputFilePath = inputFilePath;
+    m_cacheFilePath = inputFilePath + L".ctfindex";
+}
+
+bool Indexer::TryReadIndexCache(CorpusDescriptorPtr corpus)
+{
+    uint64_t fileSize;
+    int64_t fileTime;
+    if (!GetFileSizeAndTime(m_inputFilePath, fileSize, fileTime))
+        return false;
+    FILE* f = _wfopen(m_cacheFilePath.c_str(), L"rb");
+    if (f == nullptr)
+        return false;
+
+    IndexCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, f) == 1 &&
+                 memcmp(header.m_magic, s_indexCacheMagic, sizeof(s_indexCacheMagic)) == 0 &&
+                 header.m_fileSize == fileSize && header.m_fileTime == fileTime &&
+                 header.m_skipSequenceIds == (uint32_t) m_skipSequenceIds;
+    if (valid)
+    {
+        string path(header.m_pathLength, '\0');
+        valid = (path.empty() || fread(&path[0], 1, path.size(), f) == path.size()) && path == msra::strfun::utf8(m_inputFilePath);
+    }
+    if (!valid)
+    {
+        fclose(f);
+        return false;
+    }
+
+    m_index.Reserve(fileSize);
+    m_hasSequenceIds = header.m_hasSequenceIds != 0;
+    std::vector<IndexCacheEntry> entries(64 * 1024);
+    for (uint64_t i = 0; i < header.m_numSequences; i += entries.size())
+    {
+        size_t n = (size_t) std::min<uint64_t>(entries.size(), header.m_numSequences - i);
+        if (fread(entries.data(), sizeof(IndexCacheEntry), n, f) != n)
+        {
+            fclose(f);
+            RuntimeError("Index cache file %ls is truncated.", m_cacheFilePath.c_str());
+        }
+        for (size_t k = 0; k < n; k++)
+        {
+            SequenceDescriptor sd = {};
+            sd.m_numberOfSamples = (size_t) entries[k].m_numberOfSamples;
+            sd.m_fileOffsetBytes = entries[k].m_fileOffsetBytes;
+            sd.m_byteSize = (size_t) entries[k].m_byteSize;
+            AddSequenceIfIncluded(corpus, (size_t) entries[k].m_key, sd);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+bool Indexer::TryLoadIndexCache(CorpusDescriptorPtr corpus)
+{
+    const std::wstring tempFilePath = m_cacheFilePath + L".tmp";
+    uint64_t lastTempSize = 0;
+    auto lastProgress = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        if (TryReadIndexCache(corpus))
+            return true;
+
+        // no valid cache: write it, unless another process already does
+        m_cacheFile = CreateFileExclusively(tempFilePath);
+        if (m_cacheFile != nullptr)
+        {
+            IndexCacheHeader header = {}; // no magic yet, see FinishIndexCache()
+            string path = msra::strfun::utf8(m_inputFilePath);
+            header.m_pathLength = path.size();
+            if (fwrite(&header, sizeof(header), 1, m_cacheFile) != 1 || fwrite(path.data(), 1, path.size(), m_cacheFile) != path.size())
+                AbandonIndexCache();
+            return false;
+        }
+        if (errno != EEXIST)
+        {
+            fprintf(stderr, "WARNING: Cannot create the index cache file %ls, indexing without it.\n", tempFilePath.c_str());
+            return false;
+        }
+
+        // wait for the other process, as long as it makes progress
+        uint64_t tempSize;
+        int64_t tempTime;
+        if (GetFileSizeAndTime(tempFilePath, tempSize, tempTime)) // (else it has just finished)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (tempSize != lastTempSize)
+            {
+                lastTempSize = tempSize;
+                lastProgress = now;
+            }
+            else if (now - lastProgress > s_indexCacheWriterTimeout)
+            {
+                fprintf(stderr, "WARNING: The index cache file %ls has not grown for %d seconds; assuming that its writer has died.\n",
+                        tempFilePath.c_str(), (int) std::chrono::duration_cast<std::chrono::seconds>(s_indexCacheWriterTimeout).count());
+                _wunlink(tempFilePath.c_str());
+                lastProgress = now;
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+}
+
+void Indexer::FinishIndexCache()
+{
+    if (m_cacheFile == nullptr)
+        return;
+
+    IndexCacheHeader header = {};
+    memcpy(header.m_magic, s_indexCacheMagic, sizeof(s_indexCacheMagic));
+    if (!GetFileSizeAndTime(m_inputFilePath, header.m_fileSize, header.m_fileTime))
+        return AbandonIndexCache();
+    header.m_numSequences = m_numCachedSequences;
+    header.m_skipSequenceIds = m_skipSequenceIds;
+    header.m_hasSequenceIds = m_hasSequenceIds;
+    header.m_pathLength = msra::strfun::utf8(m_inputFilePath).size();
+    if (fseek(m_cacheFile, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, m_cacheFile) != 1 || fclose(m_cacheFile) != 0)
+    {
+        m_cacheFile = nullptr; // (closed or not, we cannot use it anymore)
+        return AbandonIndexCache();
+    }
+    m_cacheFile = nullptr;
+    renameOrDie(m_cacheFilePath + L".tmp", m_cacheFilePath);
+}
+
+// stop writing the cache (e.g. the disk is full), indexing continues without it
+void Indexer::AbandonIndexCache()
+{
+    fprintf(stderr, "WARNING: Failed to write the index cache file %ls.tmp, indexing without it.\n", m_cacheFilePath.c_str());
+    if (m_cacheFile != nullptr)
+        fclose(m_cacheFile);
+    m_cacheFile = nullptr;
+    _wunlink((m_cacheFilePath + L".tmp").c_str());
+}
+
 void Indexer::RefillBuffer()
 {
     if (!m_done)
@@ -98,6 +297,33 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
         return;
     }
 
+    if (m_cacheFilePath.empty())
+    {
+        BuildFromFile(corpus);
+        return;
+    }
+
+    if (TryLoadIndexCache(corpus))
+        return;
+    try
+    {
+        BuildFromFile(corpus);
+    }
+    catch (...)
+    {
+        if (m_cacheFile != nullptr) // do not leave a lock behind
+        {
+            fclose(m_cacheFile);
+            m_cacheFile = nullptr;
+            _wunlink((m_cacheFilePath + L".tmp").c_str());
+        }
+        throw;
+    }
+    FinishIndexCache();
+}
+
+void Indexer::BuildFromFile(CorpusDescriptorPtr corpus)
+{
     m_index.Reserve(filesize(m_file));
 
     RefillBuffer(); // read the first block of data
@@ -160,6 +386,15 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
 
 void Indexer::AddSequenceIfIncluded(CorpusDescriptorPtr corpus, size_t sequenceKey, SequenceDescriptor& sd)
 {
+    if (m_cacheFile != nullptr)
+    {
+        IndexCacheEntry entry = { sequenceKey, sd.m_numberOfSamples, sd.m_fileOffsetBytes, sd.m_byteSize };
+        if (fwrite(&entry, sizeof(entry), 1, m_cacheFile) == 1)
+            m_numCachedSequences++;
+        else
+            AbandonIndexCache();
+    }
+
     auto& stringRegistry = corpus->GetStringRegistry();
     auto key = std::to_string(sequenceKey);
     if (corpus->IsIncluded(key))
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <string>
 #include <vector>
 #include "Descriptors.h"
 #include "CorpusDescriptor.h"
@@ -22,6 +23,12 @@ class Indexer
 public:
     Indexer(FILE* file, bool skipSequenceIds = false, size_t chunkSize = 32 * 1024 * 1024);
 
+    // Keep the sequence boundaries found by Build() in a sidecar file next to the input
+    // (inputFilePath + ".ctfindex"), and reuse them as long as the input has the same path, size and
+    // modification time. If several processes (e.g. MPI ranks) index the same input at once, one of them
+    // scans it, and the others wait for its result.
+    void EnableIndexCache(const std::wstring& inputFilePath);
+
     // Reads the input file, building and index of chunks and corresponding
     // sequences.
     void Build(CorpusDescriptorPtr corpus);
@@ -49,13 +56,31 @@ private:
 
     bool m_hasSequenceIds; // true, when input contains one sequence per line 
                            // or when sequence id column was ignored during indexing.
+    bool m_skipSequenceIds;
 
     // a collection of chunk descriptors and sequence keys.
     Index m_index;
 
+    // index cache (see EnableIndexCache()), empty if not used
+    std::wstring m_inputFilePath;
+    std::wstring m_cacheFilePath;
+    FILE* m_cacheFile;          // while writing the cache (under a temporary name, which other processes take as a lock)
+    uint64_t m_numCachedSequences;
+
+    // Loads the index from the cache, waiting while another process writes it.
+    // Returns false if there is no valid cache; then m_cacheFile is open if this process is to write it.
+    bool TryLoadIndexCache(CorpusDescriptorPtr corpus);
+    bool TryReadIndexCache(CorpusDescriptorPtr corpus);
+    void FinishIndexCache();
+    void AbandonIndexCache();
+
     // Same function as above but with check that the sequence is included in the corpus descriptor.
+    // While writing the index cache, also records the sequence there (included or not, since the cache does not depend on the corpus).
     void AddSequenceIfIncluded(CorpusDescriptorPtr corpus, size_t sequenceKey, SequenceDescriptor& sd);
 
+    // Scans the input file to build the index.
+    void BuildFromFile(CorpusDescriptorPtr corpus);
+
     // fills up the buffer with data from file, all previously buffered data
     // will be overwritten.
     void RefillBuffer();
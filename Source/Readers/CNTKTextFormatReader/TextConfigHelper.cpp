@@ -144,10 +144,16 @@ TextConfigHelper::TextConfigHelper(const ConfigParameters& config)
     }
 
     m_skipSequenceIds = config(L"skipSequenceIds", false);
+    m_cacheIndex = config(L"cacheIndex", false);
     m_maxErrors = config(L"maxErrors", 0);
     m_traceLevel = config(L"traceLevel", 1);
     m_chunkSizeBytes = config(L"chunkSizeInBytes", 32 * 1024 * 1024); // 32 MB by default
+    m_numParsingThreads = config(L"numParsingThreads", 1);
     m_keepDataInMemory = config(L"keepDataInMemory", false);
+    m_chunkCacheBudgetBytes = config(L"chunkCacheBudgetInMB", (size_t)0) * 1024 * 1024; // 0 = unlimited
+    m_compressChunkCache = config(L"compressChunkCache", false);
+    m_partitionChunks = config(L"partitionChunks", false);
+    m_shuffleBufferSize = config(L"shuffleBufferInSamples", (size_t)0);
     m_frameMode = config(L"frameMode", false);
 }
 
@@ -29,14 +29,32 @@ public:
 
     bool ShouldSkipSequenceIds() const { return m_skipSequenceIds; }
 
+    // keep the index of the input in a sidecar file (input path + ".ctfindex"), for later runs and the other workers
+    bool ShouldCacheIndex() const { return m_cacheIndex; }
+
     unsigned int GetMaxAllowedErrors() const { return m_maxErrors; }
 
     unsigned int GetTraceLevel() const { return m_traceLevel; }
 
     size_t GetChunkSize() const { return m_chunkSizeBytes; }
 
+    // number of threads that parse the sequences of a chunk (0 = one per hardware thread)
+    unsigned int GetNumParsingThreads() const { return m_numParsingThreads; }
+
     bool ShouldKeepDataInMemory() const { return m_keepDataInMemory; }
 
+    // memory for the chunks kept in memory, the least recently used ones are dropped beyond it (0 = unlimited)
+    size_t GetChunkCacheBudget() const { return m_chunkCacheBudgetBytes; }
+
+    // keep the chunks in memory compressed (see ChunkCache)
+    bool ShouldCompressChunkCache() const { return m_compressChunkCache; }
+
+    // in distributed reading, each worker owns a fixed set of chunks (see BlockRandomizer::DecimationMode::partition)
+    bool ShouldPartitionChunks() const { return m_partitionChunks; }
+
+    // if non-zero, the input is read sequentially and randomized in a shuffle buffer of this size (see ShuffleBufferRandomizer)
+    size_t GetShuffleBufferSize() const { return m_shuffleBufferSize; }
+
     bool IsInFrameMode() const { return m_frameMode; }
 
     ElementType GetElementType() const { return m_elementType; }
@@ -49,10 +67,16 @@ private:
     size_t m_randomizationWindow;
     ElementType m_elementType;
     bool m_skipSequenceIds;
+    bool m_cacheIndex;
     unsigned int m_maxErrors;
     unsigned int m_traceLevel;
     size_t m_chunkSizeBytes; // chunks size in bytes
+    unsigned int m_numParsingThreads;
     bool m_keepDataInMemory; // if true the whole dataset is kept in memory
+    size_t m_chunkCacheBudgetBytes; // if non-zero, chunks are kept in memory up to this size
+    bool m_compressChunkCache;
+    bool m_partitionChunks;
+    size_t m_shuffleBufferSize;
     bool m_frameMode; // if true, the maximum expected sequence length in the dataset is one sample.
 };
 
@@ -7,9 +7,14 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <cfloat>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <thread>
 #include "Indexer.h"
 #include "TextParser.h"
 #include "TextReaderConstants.h"
+#include "ReaderCounters.h"
 
 #define isSign(c) ((c == '-' || c == '+'))
 #define isE(c) ((c == 'e' || c == 'E'))
@@ -45,6 +50,15 @@ public:
 
     // a non-owned pointer to the parser that created this chunk
     TextParser* m_parser;
+
+    // Arenas of the sparse inputs, one set for each parser that loaded sequences of the chunk.
+    std::vector<std::unique_ptr<SparseArenas>> m_sparseArenas;
+
+    SparseArenas* AddSparseArenas()
+    {
+        m_sparseArenas.push_back(std::unique_ptr<SparseArenas>(new SparseArenas(m_parser->m_streamInfos.size())));
+        return m_sparseArenas.back().get();
+    }
 };
 
 
@@ -67,6 +81,8 @@ TextParser(corpus, helper.GetFilePath(), helper.GetStreams())
     SetMaxAllowedErrors(helper.GetMaxAllowedErrors());
     SetChunkSize(helper.GetChunkSize());
     SetSkipSequenceIds(helper.ShouldSkipSequenceIds());
+    SetCacheIndex(helper.ShouldCacheIndex());
+    SetNumParsingThreads(helper.GetNumParsingThreads());
 
     Initialize();
 }
@@ -84,11 +100,16 @@ TextParser<ElemType>::TextParser(CorpusDescriptorPtr corpus, const std::wstring&
     m_bufferStart(nullptr),
     m_bufferEnd(nullptr),
     m_pos(nullptr),
+    m_sparseArenas(nullptr),
+    m_numParsingThreads(1),
+    m_numBytesParsed(0),
+    m_parsingSeconds(0),
     m_chunkSizeBytes(0),
     m_traceLevel(TraceLevel::Error),
     m_hadWarnings(false),
     m_numAllowedErrors(0),
     m_skipSequenceIds(false),
+    m_cacheIndex(false),
     m_numRetries(5),
     m_corpus(corpus)
 {
@@ -118,9 +139,47 @@ TextParser<ElemType>::TextParser(CorpusDescriptorPtr corpus, const std::wstring&
     m_scratch = unique_ptr<char[]>(new char[m_maxAliasLength + 1]);
 }
 
+template <class ElemType>
+TextParser<ElemType>::TextParser(const TextParser* parent) :
+    m_filename(parent->m_filename),
+    m_file(nullptr), // parses the parent's m_chunkData, see TryRefillBuffer()
+    m_streamInfos(parent->m_streamInfos),
+    m_maxAliasLength(parent->m_maxAliasLength),
+    m_aliasToIdMap(parent->m_aliasToIdMap),
+    m_indexer(nullptr),
+    m_fileOffsetStart(0),
+    m_fileOffsetEnd(0),
+    m_bufferStart(nullptr),
+    m_bufferEnd(nullptr),
+    m_pos(nullptr),
+    m_scratch(new char[parent->m_maxAliasLength + 1]),
+    m_sparseArenas(nullptr),
+    m_numParsingThreads(1),
+    m_numBytesParsed(0),
+    m_parsingSeconds(0),
+    m_chunkSizeBytes(parent->m_chunkSizeBytes),
+    m_traceLevel(parent->m_traceLevel),
+    m_hadWarnings(false),
+    m_numAllowedErrors(0),
+    m_skipSequenceIds(parent->m_skipSequenceIds),
+    m_cacheIndex(false),
+    m_numRetries(0),
+    m_corpus(parent->m_corpus)
+{
+    m_streams = parent->m_streams;
+}
+
 template <class ElemType>
 TextParser<ElemType>::~TextParser()
 {
+    if (m_numBytesParsed > 0 && m_traceLevel >= Warning)
+    {
+        fprintf(stderr,
+            "INFO: Parsed %.1f MB of the input file (%ls) in %.3f seconds (%.1f MB/s) using %u thread(s).\n",
+            m_numBytesParsed / 1e6, m_filename.c_str(), m_parsingSeconds,
+            m_parsingSeconds > 0 ? m_numBytesParsed / 1e6 / m_parsingSeconds : 0.0, m_numParsingThreads);
+    }
+
     if (m_file)
     {
         fclose(m_file);
@@ -167,6 +226,8 @@ void TextParser<ElemType>::Initialize()
         }
 
         m_indexer = make_unique<Indexer>(m_file, m_skipSequenceIds, m_chunkSizeBytes);
+        if (m_cacheIndex)
+            m_indexer->EnableIndexCache(m_filename);
 
         m_indexer->Build(m_corpus);
     });
@@ -247,22 +308,22 @@ void TextParser<ElemType>::TextDataChunk::GetSequence(size_t sequenceId, std::ve
         {
             auto denseData = make_shared<DenseSequenceData>();
             denseData->m_sampleLayout = m_parser->m_streams[j]->m_sampleLayout;
+            denseData->m_data = input->m_buffer.data();
             data = denseData;
         }
         else
         {
             auto sparseData = make_shared<SparseSequenceData>();
             SparseInputStreamBuffer* sparseInput = static_cast<SparseInputStreamBuffer*>(input);
-            sparseData->m_indices = sparseInput->m_indices.data();
-            sparseData->m_nnzCounts.reserve(sparseInput->m_nnzCounts.size());
-            copy(sparseInput->m_nnzCounts.begin(), sparseInput->m_nnzCounts.end(),
-                back_inserter(sparseData->m_nnzCounts));
+            SparseArena& arena = *sparseInput->m_arena;
+            sparseData->m_indices = arena.m_indices.data() + sparseInput->m_valueOffset;
+            auto nnzCounts = arena.m_nnzCounts.begin() + sparseInput->m_nnzCountOffset;
+            sparseData->m_nnzCounts.assign(nnzCounts, nnzCounts + input->m_numberOfSamples);
             sparseData->m_totalNnzCount = sparseInput->m_totalNnzCount;
-            assert(input->m_numberOfSamples == sparseInput->m_nnzCounts.size());
+            sparseData->m_data = arena.m_values.data() + sparseInput->m_valueOffset;
             data = sparseData;
         }
 
-        data->m_data = input->m_buffer.data();
         data->m_numberOfSamples = input->m_numberOfSamples;
         data->m_chunk = shared_from_this();
         data->m_id = sequenceId;
@@ -292,12 +353,163 @@ ChunkPtr TextParser<ElemType>::GetChunk(ChunkIdType chunkId)
 template <class ElemType>
 void TextParser<ElemType>::LoadChunk(TextChunkPtr& chunk, const ChunkDescriptor& descriptor)
 {
-    for (const auto& sequenceDescriptor : descriptor.m_sequences)
+    auto start = std::chrono::steady_clock::now();
+
+    if (!TryLoadChunkInParallel(chunk, descriptor))
     {
-        chunk->m_sequenceMap.insert(make_pair(
-            sequenceDescriptor.m_id,
-            LoadSequence(sequenceDescriptor)));
+        m_sparseArenas = chunk->AddSparseArenas();
+        for (const auto& sequenceDescriptor : descriptor.m_sequences)
+        {
+            chunk->m_sequenceMap.insert(make_pair(
+                sequenceDescriptor.m_id,
+                LoadSequence(sequenceDescriptor)));
+        }
+        m_sparseArenas = nullptr;
     }
+
+    m_numBytesParsed += descriptor.m_byteSize;
+    m_parsingSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <class ElemType>
+bool TextParser<ElemType>::TryLoadChunkInParallel(TextChunkPtr& chunk, const ChunkDescriptor& descriptor)
+{
+    const auto& sequences = descriptor.m_sequences;
+    size_t numThreads = min<size_t>(m_numParsingThreads, sequences.size());
+    if (numThreads <= 1)
+    {
+        return false;
+    }
+
+    // The sequences of a chunk are in file order, with gaps where the corpus excludes sequences.
+    // Don't read the chunk at once if the gaps make up most of it.
+    for (size_t i = 1; i < sequences.size(); ++i)
+    {
+        if (sequences[i].m_fileOffsetBytes < sequences[i - 1].m_fileOffsetBytes)
+        {
+            return false;
+        }
+    }
+    int64_t begin = sequences.front().m_fileOffsetBytes;
+    int64_t end = sequences.back().m_fileOffsetBytes + sequences.back().m_byteSize;
+    size_t size = (size_t)(end - begin);
+    if (end <= begin || size > 2 * descriptor.m_byteSize + BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    // this moves the file position, so the next LoadSequence() has to seek
+    m_fileOffsetStart = -1;
+    m_fileOffsetEnd = -1;
+    m_chunkData.resize(size);
+    if (_fseeki64(m_file, begin, SEEK_SET) != 0)
+    {
+        PrintWarningNotification();
+        RuntimeError("Error seeking to position %" PRId64 " in the input file (%ls).",
+            begin, m_filename.c_str());
+    }
+    if (fread(m_chunkData.data(), 1, size, m_file) != size)
+    {
+        PrintWarningNotification();
+        RuntimeError("Could not read %" PRIu64 " bytes at position %" PRId64 " from the input file (%ls).",
+            size, begin, m_filename.c_str());
+    }
+    ReaderCounters::Add(ReaderCounters::bytesRead, size);
+
+    // split the sequences into contiguous ranges of about the same number of bytes, one per worker
+    vector<size_t> firstSequence(numThreads + 1, sequences.size());
+    firstSequence[0] = 0;
+    for (size_t i = 0, w = 1; i < sequences.size(); ++i)
+    {
+        while (w < numThreads && (size_t)(sequences[i].m_fileOffsetBytes - begin) >= size * w / numThreads)
+        {
+            firstSequence[w++] = i;
+        }
+    }
+
+    // Each worker gets the whole remaining error budget; what they used together is charged below.
+    while (m_workers.size() < numThreads)
+    {
+        m_workers.push_back(unique_ptr<TextParser>(new TextParser(this)));
+    }
+    for (size_t w = 0; w < numThreads; ++w)
+    {
+        TextParser& worker = *m_workers[w];
+        worker.m_fileOffsetStart = begin;
+        worker.m_fileOffsetEnd = end;
+        worker.m_bufferStart = m_chunkData.data();
+        worker.m_bufferEnd = worker.m_bufferStart + size;
+        worker.m_pos = worker.m_bufferStart;
+        worker.m_numAllowedErrors = m_numAllowedErrors;
+        worker.m_hadWarnings = false;
+        worker.m_sparseArenas = chunk->AddSparseArenas();
+    }
+
+    vector<vector<pair<size_t, SequenceBuffer>>> results(numThreads);
+    auto parse = [this, &sequences, &firstSequence, &results](size_t w)
+    {
+        for (size_t i = firstSequence[w]; i < firstSequence[w + 1]; ++i)
+        {
+            results[w].push_back(make_pair(sequences[i].m_id, m_workers[w]->LoadSequence(sequences[i])));
+        }
+    };
+
+    vector<std::future<void>> tasks;
+    for (size_t w = 1; w < numThreads; ++w)
+    {
+        tasks.push_back(std::async(std::launch::async, parse, w));
+    }
+    std::exception_ptr error;
+    try
+    {
+        parse(0);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    for (auto& task : tasks) // (all workers must be done with m_chunkData before leaving)
+    {
+        try
+        {
+            task.get();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    unsigned int numErrors = 0;
+    for (size_t w = 0; w < numThreads; ++w)
+    {
+        m_workers[w]->m_sparseArenas = nullptr;
+        numErrors += m_numAllowedErrors - m_workers[w]->m_numAllowedErrors;
+        m_hadWarnings |= m_workers[w]->m_hadWarnings;
+    }
+    if (error)
+    {
+        m_numAllowedErrors -= min(numErrors, m_numAllowedErrors);
+        std::rethrow_exception(error);
+    }
+    if (numErrors > m_numAllowedErrors)
+    {
+        m_numAllowedErrors = 0;
+        IncrementNumberOfErrorsOrDie(); // throws
+    }
+    m_numAllowedErrors -= numErrors;
+
+    for (auto& result : results)
+    {
+        for (auto& sequence : result)
+        {
+            chunk->m_sequenceMap.insert(std::move(sequence));
+        }
+    }
+    return true;
 }
 
 template <class ElemType>
@@ -316,6 +528,12 @@ void TextParser<ElemType>::IncrementNumberOfErrorsOrDie()
 template <class ElemType>
 bool TextParser<ElemType>::TryRefillBuffer()
 {
+    if (m_file == nullptr)
+    {
+        // a worker, which parses from memory (the chunk is all there is)
+        return false;
+    }
+
     size_t bytesRead = fread(m_buffer.get(), 1, BUFFER_SIZE, m_file);
 
     if (bytesRead == (size_t)-1)
@@ -324,6 +542,8 @@ bool TextParser<ElemType>::TryRefillBuffer()
         RuntimeError("Could not read from the input file (%ls).", m_filename.c_str());
     }
 
+    ReaderCounters::Add(ReaderCounters::bytesRead, bytesRead);
+
     if (!bytesRead)
     {
         return false;
@@ -371,8 +591,9 @@ typename TextParser<ElemType>::SequenceBuffer TextParser<ElemType>::LoadSequence
     SequenceBuffer sequence;
 
     // TODO: reuse loaded sequences instead of creating new ones!
-    for (auto const & stream : m_streamInfos)
+    for (size_t j = 0; j < m_streamInfos.size(); ++j)
     {
+        const StreamInfo& stream = m_streamInfos[j];
         if (stream.m_type == StorageType::dense)
         {
             sequence.push_back(make_unique<DenseInputStreamBuffer>(
@@ -380,7 +601,8 @@ typename TextParser<ElemType>::SequenceBuffer TextParser<ElemType>::LoadSequence
         }
         else
         {
-            sequence.push_back(make_unique<SparseInputStreamBuffer>());
+            sequence.push_back(make_unique<SparseInputStreamBuffer>(
+                m_sparseArenas ? &(*m_sparseArenas)[j] : nullptr));
         }
     }
 
@@ -615,8 +837,8 @@ bool TextParser<ElemType>::TryReadSample(SequenceBuffer& sequence, size_t& bytes
     else
     {
         SparseInputStreamBuffer* data = reinterpret_cast<SparseInputStreamBuffer*>(sequence[id].get());
-        vector<ElemType>& values = data->m_buffer;
-        vector<IndexType>& indices = data->m_indices;
+        vector<ElemType>& values = data->m_arena->m_values;
+        vector<IndexType>& indices = data->m_arena->m_indices;
         assert(values.size() == indices.size());
         size_t size = values.size();
         if (!TryReadSparseSample(values, indices, stream.m_sampleDimension, bytesToRead))
@@ -639,7 +861,7 @@ bool TextParser<ElemType>::TryReadSample(SequenceBuffer& sequence, size_t& bytes
         assert(values.size() == indices.size());
         ++data->m_numberOfSamples;
         IndexType count = static_cast<IndexType>(values.size() - size);
-        data->m_nnzCounts.push_back(count);
+        data->m_arena->m_nnzCounts.push_back(count);
         data->m_totalNnzCount += count;
     }
 
@@ -913,6 +1135,21 @@ void TextParser<ElemType>::SkipToNextInput(size_t& bytesToRead)
 template <class ElemType>
 bool TextParser<ElemType>::TryReadUint64(size_t& value, size_t& bytesToRead)
 {
+    // fast path: the digits (at most 19, which cannot overflow) and the character that follows are in the buffer
+    const char* end = GetContiguousEnd(bytesToRead);
+    const char* p = m_pos;
+    value = 0;
+    for (; p != end && isdigit(*p) && p - m_pos < 19; ++p)
+    {
+        value = value * 10 + (*p - '0');
+    }
+    if (p != m_pos && p != end && !isdigit(*p))
+    {
+        bytesToRead -= p - m_pos;
+        m_pos = p;
+        return true;
+    }
+
     value = 0;
     bool found = false;
     while (bytesToRead && CanRead())
@@ -965,6 +1202,11 @@ bool TextParser<ElemType>::TryReadUint64(size_t& value, size_t& bytesToRead)
 template <class ElemType>
 bool TextParser<ElemType>::TryReadRealNumber(ElemType& value, size_t& bytesToRead)
 {
+    if (TryReadRealNumberInBuffer(value, bytesToRead))
+    {
+        return true;
+    }
+
     State state = State::Init;
     double coefficient = .0, number = .0, divider = .0;
     bool negative = false;
@@ -1154,6 +1396,102 @@ bool TextParser<ElemType>::TryReadRealNumber(ElemType& value, size_t& bytesToRea
     return false;
 }
 
+// Accumulates all digits into one integer and scales it once by a power of ten, which is exact
+// (correctly rounded) for up to 15 significant digits and exponents up to 22, i.e., almost always.
+// Accepts the same syntax as the state machine in TryReadRealNumber.
+template <class ElemType>
+bool TextParser<ElemType>::TryReadRealNumberInBuffer(ElemType& value, size_t& bytesToRead)
+{
+    static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* end = GetContiguousEnd(bytesToRead);
+    const char* p = m_pos;
+
+    bool negative = false;
+    if (p != end && isSign(*p))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+    if (p == end || !isdigit(*p))
+    {
+        return false;
+    }
+
+    uint64_t mantissa = 0;
+    int numDigits = 0, exponent = 0;
+    for (; p != end && isdigit(*p); ++p, ++numDigits)
+    {
+        mantissa = mantissa * 10 + (*p - '0');
+    }
+
+    // a period that is not followed by a digit ends the number
+    bool endsWithPeriod = false;
+    if (p != end && *p == '.')
+    {
+        ++p;
+        endsWithPeriod = true;
+        for (; p != end && isdigit(*p); ++p, ++numDigits, --exponent)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            endsWithPeriod = false;
+        }
+    }
+
+    if (!endsWithPeriod && p != end && isE(*p))
+    {
+        ++p;
+        bool negativeExponent = false;
+        if (p != end && isSign(*p))
+        {
+            negativeExponent = (*p == '-');
+            ++p;
+        }
+        if (p == end || !isdigit(*p))
+        {
+            return false;
+        }
+        int explicitExponent = 0;
+        for (; p != end && isdigit(*p); ++p)
+        {
+            if (explicitExponent < 100000) // (beyond any floating point range)
+            {
+                explicitExponent = explicitExponent * 10 + (*p - '0');
+            }
+        }
+        exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    }
+
+    // The number must be followed by a character in the buffer (else it may continue after a refill),
+    // and the mantissa must fit into 64 bits.
+    if (p == end || numDigits > 19)
+    {
+        return false;
+    }
+
+    double number = static_cast<double>(mantissa);
+    if (exponent < 0 && exponent >= -22)
+    {
+        number /= powersOf10[-exponent];
+    }
+    else if (exponent >= 0 && exponent <= 22)
+    {
+        number *= powersOf10[exponent];
+    }
+    else
+    {
+        number *= pow(10.0, exponent);
+    }
+
+    value = static_cast<ElemType>(negative ? -number : number);
+    bytesToRead -= p - m_pos;
+    m_pos = p;
+    return true;
+}
+
 template <class ElemType>
 void TextParser<ElemType>::SetTraceLevel(unsigned int traceLevel)
 {
@@ -1172,6 +1510,12 @@ void TextParser<ElemType>::SetSkipSequenceIds(bool skip)
     m_skipSequenceIds = skip;
 }
 
+template <class ElemType>
+void TextParser<ElemType>::SetCacheIndex(bool cacheIndex)
+{
+    m_cacheIndex = cacheIndex;
+}
+
 template <class ElemType>
 void TextParser<ElemType>::SetChunkSize(size_t size)
 {
@@ -1184,6 +1528,12 @@ void TextParser<ElemType>::SetNumRetries(unsigned int numRetries)
     m_numRetries = numRetries;
 }
 
+template <class ElemType>
+void TextParser<ElemType>::SetNumParsingThreads(unsigned int numThreads)
+{
+    m_numParsingThreads = numThreads > 0 ? numThreads : max(std::thread::hardware_concurrency(), 1u);
+}
+
 template <class ElemType>
 std::wstring TextParser<ElemType>::GetFileInfo()
 {
@@ -1195,19 +1545,19 @@ std::wstring TextParser<ElemType>::GetFileInfo()
 template <class ElemType>
 bool TextParser<ElemType>::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
 {
-    const auto& keys = m_indexer->GetIndex().m_keyToSequenceInChunk;
-    auto sequenceLocation = keys.find(key.m_sequence);
-    if (sequenceLocation == keys.end())
+    ChunkIdType chunkId;
+    size_t index;
+    if (!m_indexer->GetIndex().m_keyToSequenceInChunk.TryGet(key.m_sequence, chunkId, index))
     {
         return false;
     }
 
-    result = m_indexer->GetIndex().m_chunks[sequenceLocation->second.first].m_sequences[sequenceLocation->second.second];
+    result = m_indexer->GetIndex().m_chunks[chunkId].m_sequences[index];
     return true;
 }
 
 template <class ElemType>
-const string& TextParser<ElemType>::GetSequenceKey(const SequenceDescriptor& s) const
+string TextParser<ElemType>::GetSequenceKey(const SequenceDescriptor& s) const
 {
     return m_corpus->GetStringRegistry()[s.m_key.m_sequence];
 }
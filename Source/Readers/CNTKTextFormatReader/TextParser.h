@@ -61,16 +61,39 @@ private:
         }
     };
 
-    // In case of sparse input, we also need a vector of
-    // indices (one index for each input value) and a vector
-    // of NNZ counts (one for each sample).
-    struct SparseInputStreamBuffer : InputStreamBuffer
+    // The values, indices (one index for each input value) and NNZ counts (one for each sample)
+    // of the sparse samples of a chunk for one input stream. The sequences of the chunk are parsed into it
+    // one after another, so that a chunk needs a few allocations per sparse stream instead of three for
+    // every sequence, and the sequence data point into it.
+    struct SparseArena
     {
-        IndexType m_totalNnzCount = 0;
+        std::vector<ElemType> m_values;
         std::vector<IndexType> m_indices;
         std::vector<IndexType> m_nnzCounts;
     };
 
+    // In case of sparse input, the buffer is the range of its sequence in the arena of the stream.
+    struct SparseInputStreamBuffer : InputStreamBuffer
+    {
+        // uses an arena of its own if none is given
+        explicit SparseInputStreamBuffer(SparseArena* arena)
+            : m_ownArena(arena ? nullptr : new SparseArena()),
+              m_arena(arena ? arena : m_ownArena.get()),
+              m_valueOffset(m_arena->m_values.size()),
+              m_nnzCountOffset(m_arena->m_nnzCounts.size())
+        {
+        }
+
+        std::unique_ptr<SparseArena> m_ownArena;
+        SparseArena* m_arena;
+        size_t m_valueOffset;    // of the first value (and index) of the sequence in the arena
+        size_t m_nnzCountOffset; // of the NNZ count of the first sample
+        IndexType m_totalNnzCount = 0;
+    };
+
+    // Arenas of all streams (indexed by stream id, only those of sparse streams are used).
+    typedef std::vector<SparseArena> SparseArenas;
+
     // A sequence buffer is a vector that contains an input buffer for each input stream.
     typedef std::vector<std::unique_ptr<InputStreamBuffer>> SequenceBuffer;
 
@@ -110,11 +133,25 @@ private:
 
     unique_ptr<char[]> m_scratch; // local buffer for string parsing
 
+    // the arenas LoadSequence() parses sparse inputs into, owned by the chunk being loaded
+    SparseArenas* m_sparseArenas;
+
+    // Parallel chunk parsing: the byte range of a chunk is read into m_chunkData at once,
+    // and its sequences are split among the workers, each parsing from memory.
+    unsigned int m_numParsingThreads;
+    std::vector<char> m_chunkData;
+    std::vector<std::unique_ptr<TextParser>> m_workers;
+
+    // parsing throughput, reported when the parser is destroyed
+    size_t m_numBytesParsed;
+    double m_parsingSeconds;
+
     size_t m_chunkSizeBytes;
     unsigned int m_traceLevel;
     bool m_hadWarnings;
     unsigned int m_numAllowedErrors;
     bool m_skipSequenceIds;
+    bool m_cacheIndex; // keep the index in a sidecar file, see Indexer::EnableIndexCache()
     unsigned int m_numRetries; // specifies the number of times an unsuccessful
     // file operation should be repeated (default value is 5).
 
@@ -136,6 +173,12 @@ private:
 
     bool TryRefillBuffer();
 
+    // Returns the end of the input that can be parsed without refilling the buffer.
+    const char* GetContiguousEnd(size_t bytesToRead) const
+    {
+        return (size_t)(m_bufferEnd - m_pos) < bytesToRead ? m_bufferEnd : m_pos + bytesToRead;
+    }
+
     int64_t GetFileOffset() const { return m_fileOffsetStart + (m_pos - m_bufferStart); }
 
     // Returns a string containing input file information (current offset, file name, etc.),
@@ -147,6 +190,10 @@ private:
 
     bool TryReadRealNumber(ElemType& value, size_t& bytesToRead);
 
+    // Fast path of TryReadRealNumber for a well-formed number that lies entirely in the buffer.
+    // Returns false (without consuming anything) in all other cases, which are left to the state machine.
+    bool TryReadRealNumberInBuffer(ElemType& value, size_t& bytesToRead);
+
     bool TryReadUint64(size_t& value, size_t& bytesToRead);
 
     // Reads dense sample values into the provided vector.
@@ -174,6 +221,13 @@ private:
     // Given a descriptor, retrieves the data for the corresponding chunk from the file.
     void LoadChunk(TextChunkPtr& chunk, const ChunkDescriptor& descriptor);
 
+    // Same as above, with the sequences of the chunk parsed by m_numParsingThreads threads.
+    // Returns false if the chunk is not worth it (or not suitable), without loading anything.
+    bool TryLoadChunkInParallel(TextChunkPtr& chunk, const ChunkDescriptor& descriptor);
+
+    // A worker of the given parser, see TryLoadChunkInParallel().
+    explicit TextParser(const TextParser* parent);
+
     TextParser(CorpusDescriptorPtr corpus, const std::wstring& filename, const vector<StreamDescriptor>& streams);
 
     void SetTraceLevel(unsigned int traceLevel);
@@ -182,13 +236,17 @@ private:
 
     void SetSkipSequenceIds(bool skip);
 
+    void SetCacheIndex(bool cacheIndex);
+
     void SetChunkSize(size_t size);
 
     void SetNumRetries(unsigned int numRetries);
 
+    void SetNumParsingThreads(unsigned int numThreads);
+
     friend class CNTKTextFormatReaderTestRunner<ElemType>;
 
-    const std::string& GetSequenceKey(const SequenceDescriptor& s) const;
+    std::string GetSequenceKey(const SequenceDescriptor& s) const;
 
     DISABLE_COPY_AND_MOVE(TextParser);
 };
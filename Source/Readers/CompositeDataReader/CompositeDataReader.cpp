@@ -15,8 +15,10 @@
 #include "Bundler.h"
 #include "BlockRandomizer.h"
 #include "NoRandomizer.h"
+#include "ShuffleBufferRandomizer.h"
 #include "FramePacker.h"
 #include "SequencePacker.h"
+#include "SequenceLengthBucketer.h"
 #include "TruncatedBpttPacker.h"
 #include "CorpusDescriptor.h"
 #include "ConfigUtil.h"
@@ -85,13 +87,25 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config, MemoryP
     // It makes sense to put it to true for cases when deserialization is CPU intensive,
     // i.e. decompression of images.
     bool multiThreadedDeserialization = config(L"multiThreadedDeserialization", false);
-    if (randomize)
+    // Inputs that are too large or too slow to index can be randomized in a shuffle buffer while they are read sequentially.
+    size_t shuffleBufferInSamples = config(L"shuffleBufferInSamples", (size_t) 0);
+    if (randomize && shuffleBufferInSamples > 0)
+    {
+        m_sequenceEnumerator = std::make_shared<ShuffleBufferRandomizer>(deserializer, shuffleBufferInSamples, multiThreadedDeserialization);
+    }
+    else if (randomize)
     {
         // By default randomizing the whole data set.
         size_t randomizationWindow = config(L"randomizationWindow", requestDataSize);
         // By default using STL random number generator.
         bool useLegacyRandomization = config(L"useLegacyRandomization", false);
-        m_sequenceEnumerator = std::make_shared<BlockRandomizer>(verbosity, randomizationWindow, deserializer, BlockRandomizer::DecimationMode::chunk, useLegacyRandomization, multiThreadedDeserialization);
+        // By default chunks are loaded when the randomization window reaches them. Loading ahead requires
+        // deserializers whose chunks can be loaded concurrently.
+        size_t prefetchChunks = config(L"prefetchChunks", (size_t) 0);
+        // In distributed reading, each worker can own a fixed set of chunks, so that it only randomizes and loads those.
+        bool partitionChunks = config(L"partitionChunks", false);
+        auto decimationMode = partitionChunks ? BlockRandomizer::DecimationMode::partition : BlockRandomizer::DecimationMode::chunk;
+        m_sequenceEnumerator = std::make_shared<BlockRandomizer>(verbosity, randomizationWindow, deserializer, decimationMode, useLegacyRandomization, multiThreadedDeserialization, prefetchChunks);
     }
     else
     {
@@ -99,9 +113,26 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config, MemoryP
     }
 
     // In case when there are transforms, applying them to the data.
+    // The transformed data depend on the number of transformer chains, which by default is the number of CPU threads.
+    size_t numTransformThreads = config(L"numTransformThreads", (size_t)0);
     m_sequenceEnumerator = m_transforms.empty()
         ? m_sequenceEnumerator 
-        : std::make_shared<TransformController>(m_transforms, m_sequenceEnumerator);
+        : std::make_shared<TransformController>(m_transforms, m_sequenceEnumerator, numTransformThreads);
+
+    // Optionally, grouping sequences of similar length into the same minibatch to reduce padding in the layout.
+    m_bucketByLength = config(L"bucketByLength", false);
+    if (m_bucketByLength)
+    {
+        if (m_packingMode != PackingMode::sequence)
+        {
+            InvalidArgument("bucketByLength is only supported when packing full sequences, not with frameMode or truncated.");
+        }
+
+        size_t bucketingWindow = config(L"bucketingWindow", (size_t)16); // in minibatches
+        bool limitPaddedSamples = config(L"limitPaddedSamples", false); // caps sequences x longest length
+        m_sequenceEnumerator = std::make_shared<SequenceLengthBucketer>(m_sequenceEnumerator, bucketingWindow, limitPaddedSamples);
+    }
+    m_reportPadding = m_bucketByLength || verbosity > 0;
 
     // Create output stream descriptions - where to get those? from config? what if it is not the same as network expects?
     // TODO: Currently only dense output streams.
@@ -125,6 +156,16 @@ Minibatch CompositeDataReader::ReadMinibatch()
     return m_packer->ReadMinibatch();
 }
 
+bool CompositeDataReader::GetState(ReaderState& state)
+{
+    return m_packer->GetState(state);
+}
+
+void CompositeDataReader::SetState(const ReaderState& state)
+{
+    m_packer->SetState(state);
+}
+
 // Create deserializers based on the specified configuration. 
 // deserializers = [
 //        [ type = "ImageDataDeserializer" module = "ImageReader" ...]
@@ -260,7 +301,8 @@ void CompositeDataReader::StartEpoch(const EpochConfiguration& cfg)
         m_packer = std::make_shared<SequencePacker>(
             m_provider,
             m_sequenceEnumerator,
-            m_streams);
+            m_streams,
+            m_reportPadding);
         break;
     case PackingMode::truncated:
     {
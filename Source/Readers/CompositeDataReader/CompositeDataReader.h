@@ -66,6 +66,10 @@ public:
     // Reads a minibatch that contains data across all streams.
     Minibatch ReadMinibatch() override;
 
+    // Gets and restores the position in the epoch.
+    bool GetState(ReaderState& state) override;
+    void SetState(const ReaderState& state) override;
+
 private:
     void CreateDeserializers(const ConfigParameters& readerConfig);
     void CreateTransforms(const ConfigParameters& deserializerConfig);
@@ -127,6 +131,10 @@ private:
 
     // Truncation length for BPTT mode.
     size_t m_truncationLength;
+
+    // Whether sequences are grouped by length, and whether the sequence packer reports the padding.
+    bool m_bucketByLength;
+    bool m_reportPadding;
 };
 
 }}}
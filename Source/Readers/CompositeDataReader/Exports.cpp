@@ -12,7 +12,6 @@
 #include "DataReader.h"
 #include "CompositeDataReader.h"
 #include "ReaderShim.h"
-#include "HeapMemoryProvider.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -30,9 +29,9 @@ public:
     }
 };
 
-auto factory = [](const ConfigParameters& parameters) -> ReaderPtr
+auto factory = [](const ConfigParameters& parameters, MemoryProviderPtr memoryProvider) -> ReaderPtr
 {
-    return std::make_shared<CompositeDataReader>(parameters, std::make_shared<HeapMemoryProvider>());
+    return std::make_shared<CompositeDataReader>(parameters, memoryProvider);
 };
 
 extern "C" DATAREADER_API void GetReaderF(IDataReader** preader)
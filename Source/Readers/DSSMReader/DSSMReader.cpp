@@ -234,6 +234,14 @@ void DSSMReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig)
 template <class ElemType>
 DSSMReader<ElemType>::~DSSMReader()
 {
+    // the read ahead uses the buffers of the inputs
+    try
+    {
+        WaitForReadAhead();
+    }
+    catch (...)
+    {
+    }
     ReleaseMemory();
 }
 
@@ -289,6 +297,7 @@ void DSSMReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_
     fprintf(stderr, "starting epoch %lld at record count %lld, and file position %lld\n", m_epoch, mbStartSample, fileRecord);
 
     // reset the next read sample
+    WaitForReadAhead();
     m_readNextSample = 0;
     m_epochStartSample = m_mbStartSample = mbStartSample;
     m_mbSize = mbSize;
@@ -305,6 +314,37 @@ void DSSMReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_
     }
     m_epoch = epoch;
     m_mbStartSample = epoch * m_epochSize;
+
+    m_currentBuffer = 0;
+    ReadAhead();
+}
+
+template <class ElemType>
+void DSSMReader<ElemType>::ReadAhead()
+{
+    if (m_readNextSample >= m_totalSamples)
+    {
+        return;
+    }
+
+    size_t buffer = m_currentBuffer;
+    size_t cur = m_readNextSample;
+    m_pendingMBSize = (m_readNextSample + m_mbSize > m_totalSamples) ? m_totalSamples - m_readNextSample : m_mbSize;
+    size_t numToRead = m_pendingMBSize;
+    m_pendingRead = std::async(std::launch::async, [this, buffer, cur, numToRead]()
+    {
+        dssm_queryInput.Read_Batch(buffer, cur, numToRead, read_order);
+        dssm_docInput.Read_Batch(buffer, cur, numToRead, read_order);
+    });
+}
+
+template <class ElemType>
+void DSSMReader<ElemType>::WaitForReadAhead()
+{
+    if (m_pendingRead.valid())
+    {
+        m_pendingRead.get();
+    }
 }
 
 // function to store the LabelType in an ElemType
@@ -333,7 +373,13 @@ bool DSSMReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
     Matrix<ElemType>& featuresD = matrices.GetInputMatrix<ElemType>(m_featuresNameDoc);
     Matrix<ElemType>& labels    = matrices.GetInputMatrix<ElemType>(m_labelsName); // will change this part later.  TODO: How?
 
-    size_t actualMBSize = (m_readNextSample + m_mbSize > m_totalSamples) ? m_totalSamples - m_readNextSample : m_mbSize;
+    // the minibatch has been read ahead, read the next one into the other buffers while this one is set
+    WaitForReadAhead();
+    size_t actualMBSize = m_pendingMBSize;
+    size_t buffer = m_currentBuffer;
+    m_readNextSample += actualMBSize;
+    m_currentBuffer = 1 - m_currentBuffer;
+    ReadAhead();
 
     featuresQ.SwitchToMatrixType(MatrixType::SPARSE, MatrixFormat::matrixFormatSparseCSC, false);
     featuresD.SwitchToMatrixType(MatrixType::SPARSE, MatrixFormat::matrixFormatSparseCSC, false);
@@ -344,11 +390,10 @@ bool DSSMReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
     */
 
     // fprintf(stderr, "featuresQ\n");
-    dssm_queryInput.Next_Batch(featuresQ, m_readNextSample, actualMBSize, read_order);
+    dssm_queryInput.Fill_Batch(featuresQ, buffer, actualMBSize);
     // fprintf(stderr, "\n\n\nfeaturesD\n");
-    dssm_docInput.Next_Batch(featuresD, m_readNextSample, actualMBSize, read_order);
+    dssm_docInput.Fill_Batch(featuresD, buffer, actualMBSize);
     // fprintf(stderr, "\n\n\n\n\n");
-    m_readNextSample += actualMBSize;
     /*
                 featuresQ.Print("featuresQ");
                 fprintf(stderr, "\n");
@@ -450,7 +495,15 @@ bool DSSMReader<ElemType>::DataEnd() { return true; }
 
 template <class ElemType>
 DSSM_BinaryInput<ElemType>::DSSM_BinaryInput()
+    : offsets_orig(NULL), data_orig(NULL), mbSize(0), offsets(NULL)
 {
+    for (size_t buffer = 0; buffer < 2; buffer++)
+    {
+        values[buffer] = NULL;
+        colIndices[buffer] = NULL;
+        rowIndices[buffer] = NULL;
+        nnz[buffer] = 0;
+    }
 }
 template <class ElemType>
 DSSM_BinaryInput<ElemType>::~DSSM_BinaryInput()
@@ -532,18 +585,21 @@ void DSSM_BinaryInput<ElemType>::Init(wstring fileName, size_t dim)
 template <class ElemType>
 bool DSSM_BinaryInput<ElemType>::SetupEpoch(size_t minibatchSize)
 {
-    if (values == NULL || mbSize < minibatchSize)
+    if (values[0] == NULL || mbSize < minibatchSize)
     {
-        if (values != NULL)
+        for (size_t buffer = 0; buffer < 2; buffer++)
         {
-            free(values);
-            free(colIndices);
-            free(rowIndices);
-        }
+            if (values[buffer] != NULL)
+            {
+                free(values[buffer]);
+                free(colIndices[buffer]);
+                free(rowIndices[buffer]);
+            }
 
-        values = (ElemType*) malloc(sizeof(ElemType) * MAX_BUFFER * minibatchSize);
-        colIndices = (int32_t*) malloc(sizeof(int32_t) * (minibatchSize + 1));
-        rowIndices = (int32_t*) malloc(sizeof(int32_t) * MAX_BUFFER * minibatchSize);
+            values[buffer] = (ElemType*) malloc(sizeof(ElemType) * MAX_BUFFER * minibatchSize);
+            colIndices[buffer] = (int32_t*) malloc(sizeof(int32_t) * (minibatchSize + 1));
+            rowIndices[buffer] = (int32_t*) malloc(sizeof(int32_t) * MAX_BUFFER * minibatchSize);
+        }
         // fprintf(stderr, "values  size: %d",sizeof(ElemType)*MAX_BUFFER*minibatchSize);
         // fprintf(stderr, "colindi size: %d",sizeof(int32_t)*MAX_BUFFER*(1+minibatchSize));
         // fprintf(stderr, "rowindi size: %d",sizeof(int32_t)*MAX_BUFFER*minibatchSize);
@@ -556,8 +612,12 @@ bool DSSM_BinaryInput<ElemType>::SetupEpoch(size_t minibatchSize)
     return true;
 }
 template <class ElemType>
-bool DSSM_BinaryInput<ElemType>::Next_Batch(Matrix<ElemType>& matrices, size_t cur, size_t numToRead, int* /*ordering*/)
+void DSSM_BinaryInput<ElemType>::Read_Batch(size_t buffer, size_t cur, size_t numToRead, int* /*ordering*/)
 {
+    ElemType* values = this->values[buffer];
+    int32_t* colIndices = this->colIndices[buffer];
+    int32_t* rowIndices = this->rowIndices[buffer];
+
     /*
     int devId = matrices.GetDeviceId();
     matrices.TransferFromDeviceToDevice(devId, -1);
@@ -573,6 +633,10 @@ bool DSSM_BinaryInput<ElemType>::Next_Batch(Matrix<ElemType>& matrices, size_t c
         // int32_t nnz;
         colIndices[c] = cur_index;
         int32_t nnz = *(int32_t*) ((char*) data_buffer + cur_offset);
+        if (cur_index + nnz > MAX_BUFFER * mbSize)
+        {
+            RuntimeError("Input data is too dense - not enough memory allocated");
+        }
         // memcpy(&nnz, (char*)data_buffer + cur_offset, sizeof(int32_t));
         memcpy(values + cur_index, (char*) data_buffer + cur_offset + sizeof(int32_t), sizeof(ElemType) * nnz);
         memcpy(rowIndices + cur_index, (char*) data_buffer + cur_offset + sizeof(int32_t) + sizeof(ElemType) * nnz, sizeof(int32_t) * nnz);
@@ -589,6 +653,7 @@ bool DSSM_BinaryInput<ElemType>::Next_Batch(Matrix<ElemType>& matrices, size_t c
         cur_index += nnz;
     }
     colIndices[numToRead] = cur_index;
+    this->nnz[buffer] = cur_index;
     /*
     int col = 0;
     for (int c = 0; c < cur_index; c++)
@@ -612,8 +677,12 @@ bool DSSM_BinaryInput<ElemType>::Next_Batch(Matrix<ElemType>& matrices, size_t c
         colIndices = (int32_t*)malloc(sizeof(int32_t)*MAX_BUFFER*(minibatchSize+1));
         rowIndices = (int32_t*)malloc(sizeof(int32_t)*MAX_BUFFER*minibatchSize);
         */
+}
 
-    matrices.SetMatrixFromCSCFormat(colIndices, rowIndices, values, cur_index, m_dim, numToRead);
+template <class ElemType>
+void DSSM_BinaryInput<ElemType>::Fill_Batch(Matrix<ElemType>& matrices, size_t buffer, size_t numToRead)
+{
+    matrices.SetMatrixFromCSCFormat(colIndices[buffer], rowIndices[buffer], values[buffer], nnz[buffer], m_dim, numToRead);
     // matrices.Print("actual values");
     // exit(1);
     /*
@@ -622,7 +691,6 @@ bool DSSM_BinaryInput<ElemType>::Next_Batch(Matrix<ElemType>& matrices, size_t c
     exit(1);
     matrices.TransferFromDeviceToDevice(-1,devId);
     */
-    return true;
 }
 
 template <class ElemType>
@@ -641,17 +709,23 @@ void DSSM_BinaryInput<ElemType>::Dispose()
     {
         free(offsets); // = (ElemType*)malloc(sizeof(float)* 230 * 1024);
     }
-    if (values != NULL)
-    {
-        free(values); // = (ElemType*)malloc(sizeof(float)* 230 * 1024);
-    }
-    if (rowIndices != NULL)
+    for (size_t buffer = 0; buffer < 2; buffer++)
     {
-        free(rowIndices); // = (int*)malloc(sizeof(float)* 230 * 1024);
-    }
-    if (colIndices != NULL)
-    {
-        free(colIndices); // = (int*)malloc(sizeof(float)* 230 * 1024);
+        if (values[buffer] != NULL)
+        {
+            free(values[buffer]); // = (ElemType*)malloc(sizeof(float)* 230 * 1024);
+        }
+        if (rowIndices[buffer] != NULL)
+        {
+            free(rowIndices[buffer]); // = (int*)malloc(sizeof(float)* 230 * 1024);
+        }
+        if (colIndices[buffer] != NULL)
+        {
+            free(colIndices[buffer]); // = (int*)malloc(sizeof(float)* 230 * 1024);
+        }
+        values[buffer] = NULL;
+        rowIndices[buffer] = NULL;
+        colIndices[buffer] = NULL;
     }
 }
 
@@ -12,6 +12,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <future>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -45,10 +46,13 @@ private:
     size_t mbSize;
     size_t MAX_BUFFER = 300;
 
-    ElemType* values;    // = (ElemType*)malloc(sizeof(float)* 230 * 1024);
-    int64_t* offsets;    // = (int*)malloc(sizeof(int)* 230 * 1024);
-    int32_t* colIndices; // = (int*)malloc(sizeof(int)* (batchsize + 1));
-    int32_t* rowIndices; // = (int*)malloc(sizeof(int)* MAX_BUFFER * batchsize);
+    // The minibatches are double buffered: one is read ahead by Read_Batch while the other is set to the matrix
+    // by Fill_Batch.
+    ElemType* values[2];    // = (ElemType*)malloc(sizeof(float)* 230 * 1024);
+    int64_t* offsets;       // = (int*)malloc(sizeof(int)* 230 * 1024);
+    int32_t* colIndices[2]; // = (int*)malloc(sizeof(int)* (batchsize + 1));
+    int32_t* rowIndices[2]; // = (int*)malloc(sizeof(int)* MAX_BUFFER * batchsize);
+    int32_t nnz[2];
 
 public:
     int64_t numRows;
@@ -59,7 +63,10 @@ public:
     ~DSSM_BinaryInput();
     void Init(std::wstring fileName, size_t dim);
     bool SetupEpoch(size_t minibatchSize);
-    bool Next_Batch(Matrix<ElemType>& matrices, size_t cur, size_t numToRead, int* ordering);
+    // Gathers the records [cur, cur + numToRead) into the buffer; can run on a background thread.
+    void Read_Batch(size_t buffer, size_t cur, size_t numToRead, int* ordering);
+    // Sets the matrix to the records read into the buffer.
+    void Fill_Batch(Matrix<ElemType>& matrices, size_t buffer, size_t numToRead);
     void Dispose();
 };
 
@@ -89,6 +96,9 @@ private:
     size_t m_randomizeRange;         // randomization range
     size_t m_featureCount;           // feature count
     size_t m_readNextSample;         // next sample to read
+    size_t m_currentBuffer;          // the buffer of the inputs being read ahead
+    size_t m_pendingMBSize;          // the number of samples being read ahead
+    std::future<void> m_pendingRead; // the read ahead of the next minibatch
     bool m_labelFirst;               // the label is the first element in a line
     bool m_partialMinibatch;         // a partial minibatch is allowed
     LabelKind m_labelType;           // labels are categories, create mapping table
@@ -134,6 +144,9 @@ private:
     size_t RecordsToRead(size_t mbStartSample, bool tail = false);
     void ReleaseMemory();
     void WriteLabelFile();
+    // Starts reading the minibatch at m_readNextSample into the current buffers in the background.
+    void ReadAhead();
+    void WaitForReadAhead();
 
     virtual bool ReadRecord(size_t readSample);
 
@@ -153,6 +166,8 @@ public:
         : m_pMBLayout(make_shared<MBLayout>())
     {
         m_pMBLayout->SetUniqueAxisName(L"DSSMReader");
+        m_currentBuffer = 0;
+        m_pendingMBSize = 0;
         m_qfeaturesBuffer = NULL;
         m_dfeaturesBuffer = NULL;
         m_labelsBuffer = NULL;
@@ -73,6 +73,21 @@ void ConfigHelper::CheckLabelType()
     }
 }
 
+bool ConfigHelper::IsClassIndexLabelFormat() const
+{
+    string format = m_config.Find("labelFormat", "oneHot");
+    if (AreEqualIgnoreCase(format, "classIndex"))
+    {
+        return true;
+    }
+
+    if (!AreEqualIgnoreCase(format, "oneHot"))
+    {
+        RuntimeError("Not supported label format '%s'. Expected 'oneHot' or 'classIndex'.", format.c_str());
+    }
+    return false;
+}
+
 // GetFileConfigNames - determine the names of the features and labels sections in the config file
 // features - [in,out] a vector of feature name strings
 // labels - [in,out] a vector of label name strings
@@ -123,6 +138,22 @@ ElementType ConfigHelper::GetElementType() const
     RuntimeError("Not supported precision '%s'. Expected 'double' or 'float'.", precision.c_str());
 }
 
+ElementType ConfigHelper::GetStorageElementType() const
+{
+    string precision = m_config.Find("storagePrecision", "");
+    if (precision.empty())
+    {
+        return GetElementType();
+    }
+
+    if (AreEqualIgnoreCase(precision, "float16"))
+    {
+        return ElementType::tfloat16;
+    }
+
+    RuntimeError("Not supported storage precision '%s'. Expected 'float16'.", precision.c_str());
+}
+
 size_t ConfigHelper::GetFeatureDimension()
 {
     if (m_config.Exists(L"dim"))
@@ -217,6 +248,17 @@ wstring ConfigHelper::GetRandomizer()
     return randomizer;
 }
 
+size_t ConfigHelper::GetMaxOpenFiles() const
+{
+    size_t maxOpenFiles = m_config(L"maxOpenFiles", (size_t)16);
+    if (maxOpenFiles == 0)
+    {
+        InvalidArgument("'maxOpenFiles' must be positive.");
+    }
+
+    return maxOpenFiles;
+}
+
 vector<wstring> ConfigHelper::GetSequencePaths()
 {
     wstring scriptPath = m_config(L"scpFile");
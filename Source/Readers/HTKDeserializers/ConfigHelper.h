@@ -33,12 +33,20 @@ public:
     // Currently both features and labels should be of the same type.
     ElementType GetElementType() const;
 
+    // Gets the element type the features are shipped in, 'storagePrecision'; by default the one above.
+    // With "float16" they stay half precision up to the device, where they are converted (see ElementType::tfloat16).
+    ElementType GetStorageElementType() const;
+
     // Checks feature type in the configuration.
     void CheckFeatureType();
 
     // Checks lables type in the configuration.
     void CheckLabelType();
 
+    // Whether labels are provided as one class index per frame, 'labelFormat="classIndex"', instead of one-hot columns.
+    // Criteria that accept class-index labels (e.g. CrossEntropyWithSoftmax) then gather them without a [C x T] label matrix.
+    bool IsClassIndexLabelFormat() const;
+
     // Gets names of feature, label, hmm and lattice files from the configuration.
     void GetDataNamesFromConfig(
         std::vector<std::wstring>& features,
@@ -58,6 +66,9 @@ public:
     // Gets randomizer type - "auto" or "block"
     std::wstring GetRandomizer();
 
+    // Gets the maximum number of feature files that are kept open across chunk loads.
+    size_t GetMaxOpenFiles() const;
+
     // Gets number of utterances per minibatch for epochs as an array.
     intargvector GetNumberOfUtterancesPerMinibatchForAllEppochs();
 
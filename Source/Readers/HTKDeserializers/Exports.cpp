@@ -13,18 +13,18 @@
 #include "Config.h"
 #include "ReaderShim.h"
 #include "HTKMLFReader.h"
-#include "HeapMemoryProvider.h"
 #include "HTKDataDeserializer.h"
 #include "MLFDataDeserializer.h"
+#include "KaldiFeatureDeserializer.h"
 #include "StringUtil.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // Factory methods for the reader.
 // TODO: Must be removed when SGD is moved to an untyped matrix.
-auto factory = [](const ConfigParameters& parameters) -> ReaderPtr
+auto factory = [](const ConfigParameters& parameters, MemoryProviderPtr memoryProvider) -> ReaderPtr
 {
-    return std::make_shared<HTKMLFReader>(std::make_shared<HeapMemoryProvider>(), parameters);
+    return std::make_shared<HTKMLFReader>(memoryProvider, parameters);
 };
 
 extern "C" DATAREADER_API void GetReaderF(IDataReader** preader)
@@ -48,6 +48,10 @@ extern "C" DATAREADER_API bool CreateDeserializer(IDataDeserializer** deserializ
     {
         *deserializer = new MLFDataDeserializer(corpus, deserializerConfig, primary);
     }
+    else if (type == L"KaldiFeatureDeserializer")
+    {
+        *deserializer = new KaldiFeatureDeserializer(corpus, deserializerConfig, primary);
+    }
     else
     {
         // Unknown type.
@@ -11,6 +11,8 @@
 #include "../HTKMLFReader/htkfeatio.h"
 #include "UtteranceDescription.h"
 #include "ssematrix.h"
+#include "CPUThreadPool.h"
+#include "HTKFeatureReaderPool.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -112,7 +114,9 @@ public:
     // Pages-in the data for this chunk.
     // this function supports retrying since we read from the unreliable network, i.e. do not return in a broken state
     // We pass in the feature info variables to check that that data being read has expected properties.
-    void RequireData(const string& featureKind, size_t featureDimension, unsigned int samplePeriod, int verbosity = 0) const
+    // Utterances that are adjacent in an archive are read at once, and different files are read in parallel,
+    // each with a reader from the pool that keeps the files open across chunks.
+    void RequireData(const string& featureKind, size_t featureDimension, unsigned int samplePeriod, HTKFeatureReaderPool& readers, int verbosity = 0) const
     {
         if (GetNumberOfUtterances() == 0)
         {
@@ -126,26 +130,62 @@ public:
 
         try
         {
-            // feature reader (we reinstantiate it for each block, i.e. we reopen the file actually)
-            // if this is the first feature read ever, we explicitly open the first file to get the information such as feature dimension
-            msra::asr::htkfeatreader reader;
+            // Split the utterances into runs of utterances that are adjacent in the same archive,
+            // and group the runs by the file they come from.
+            std::vector<std::wstring> files;
+            std::vector<std::vector<std::pair<size_t, size_t>>> runsPerFile; // [file] -> (first utterance, number of utterances)
+            for (size_t i = 0; i < m_utterances.size();)
+            {
+                size_t end = i + 1;
+                while (end < m_utterances.size() && m_utterances[end].GetPath().Follows(m_utterances[end - 1].GetPath()))
+                    end++;
+
+                auto file = m_utterances[i].GetPath().physicallocation();
+                auto f = std::find(files.begin(), files.end(), file);
+                if (f == files.end())
+                {
+                    files.push_back(file);
+                    runsPerFile.push_back({});
+                    f = files.end() - 1;
+                }
+                runsPerFile[f - files.begin()].push_back(std::make_pair(i, end - i));
+                i = end;
+            }
 
-            // read all utterances; if they are in the same archive, htkfeatreader will be efficient in not closing the file
             m_frames.resize(featureDimension, m_totalFrames);
-            foreach_index(i, m_utterances)
+            CPUThreadPool::ParallelFor(0, files.size(), CPUThreadPool::MinWorkPerChunk, [&](int64_t j)
             {
-                // read features for this file
-                auto framesWrapper = GetUtteranceFrames(i);
-                reader.read(m_utterances[i].GetPath(), featureKind, samplePeriod, framesWrapper);
-            }
+                auto reader = readers.Get(files[j]);
+                for (const auto& run : runsPerFile[j])
+                {
+                    const auto& path = m_utterances[run.first].GetPath();
+                    if (path.IsArchive())
+                    {
+                        size_t numFrames = m_firstFrames[run.first + run.second - 1] + m_utterances[run.first + run.second - 1].GetNumberOfFrames() - m_firstFrames[run.first];
+                        reader->readrange(path, numFrames, featureKind, samplePeriod, m_frames, m_firstFrames[run.first]);
+                    }
+                    else
+                    {
+                        auto framesWrapper = GetUtteranceFrames(run.first);
+                        reader->read(path, featureKind, samplePeriod, framesWrapper);
+                    }
+                }
+                readers.Return(files[j], std::move(reader));
+            });
 
             if (verbosity)
             {
-                fprintf(stderr, "HTKChunkDescription::RequireData: read physical chunk %u (%" PRIu64 " utterances, %" PRIu64 " frames, %" PRIu64 " bytes)\n",
+                size_t numRuns = 0;
+                for (const auto& runs : runsPerFile)
+                    numRuns += runs.size();
+
+                fprintf(stderr, "HTKChunkDescription::RequireData: read physical chunk %u (%" PRIu64 " utterances, %" PRIu64 " frames, %" PRIu64 " bytes) in %" PRIu64 " reads from %" PRIu64 " files\n",
                         m_chunkId,
                         m_utterances.size(),
                         m_totalFrames,
-                        sizeof(float) * m_frames.rows() * m_frames.cols());
+                        sizeof(float) * m_frames.rows() * m_frames.cols(),
+                        numRuns,
+                        files.size());
             }
         }
         catch (...)
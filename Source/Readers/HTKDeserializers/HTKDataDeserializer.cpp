@@ -9,6 +9,7 @@
 #include "HTKDataDeserializer.h"
 #include "ConfigHelper.h"
 #include "Basics.h"
+#include "Float16.h"
 #include <numeric>
 
 // TODO: This will be removed when dependency on old code is eliminated.
@@ -51,9 +52,10 @@ HTKDataDeserializer::HTKDataDeserializer(
     ConfigHelper config(streamConfig);
     auto context = config.GetContextWindow();
 
-    m_elementType = config.GetElementType();
+    m_elementType = config.GetStorageElementType();
     m_dimension = config.GetFeatureDimension();
     m_dimension = m_dimension * (1 + context.first + context.second);
+    m_readers.SetMaxOpenFiles(config.GetMaxOpenFiles());
 
     InitializeChunkDescriptions(config);
     InitializeStreams(inputName);
@@ -80,10 +82,11 @@ HTKDataDeserializer::HTKDataDeserializer(
     m_verbosity = feature(L"verbosity", 0);
 
     auto context = config.GetContextWindow();
-    m_elementType = config.GetElementType();
+    m_elementType = config.GetStorageElementType();
 
     m_dimension = config.GetFeatureDimension();
     m_dimension = m_dimension * (1 + context.first + context.second);
+    m_readers.SetMaxOpenFiles(config.GetMaxOpenFiles());
 
     InitializeChunkDescriptions(config);
     InitializeStreams(featureName);
@@ -166,7 +169,7 @@ void HTKDataDeserializer::InitializeChunkDescriptions(ConfigHelper& config)
         if (!m_primary)
         {
             // Have to store key <-> utterance mapping for non primary deserializers.
-            m_keyToChunkLocation[utterances[i].GetId()] = make_pair(currentChunk.GetChunkId(), currentChunk.GetNumberOfUtterances());
+            m_keyToChunkLocation.Add(utterances[i].GetId(), (ChunkIdType)currentChunk.GetChunkId(), currentChunk.GetNumberOfUtterances());
         }
 
         currentChunk.Add(move(utterances[i]));
@@ -308,7 +311,10 @@ private:
 
 // Represents a chunk data in memory. Given up to the randomizer.
 // It is up to the randomizer to decide when to release a particular chunk.
-class HTKDataDeserializer::HTKChunk : public Chunk
+// In frame mode with float features and no context window, the frames are handed out as
+// they are in the chunk: each has a sequence header, created once with the chunk, that points
+// into the chunk's frame array and shares the ownership of the chunk. So no frame allocates.
+class HTKDataDeserializer::HTKChunk : public Chunk, public std::enable_shared_from_this<HTKDataDeserializer::HTKChunk>
 {
 public:
     HTKChunk(HTKDataDeserializer* parent, ChunkIdType chunkId) : m_parent(parent), m_chunkId(chunkId)
@@ -319,13 +325,37 @@ public:
         // making several attempts
         msra::util::attempt(5, [&]()
         {
-            chunkDescription.RequireData(m_parent->m_featureKind, m_parent->m_ioFeatureDimension, m_parent->m_samplePeriod, m_parent->m_verbosity);
+            chunkDescription.RequireData(m_parent->m_featureKind, m_parent->m_ioFeatureDimension, m_parent->m_samplePeriod, m_parent->m_readers, m_parent->m_verbosity);
         });
+
+        if (m_parent->m_frameMode && m_parent->m_elementType == ElementType::tfloat &&
+            m_parent->m_augmentationWindow.first == 0 && m_parent->m_augmentationWindow.second == 0)
+        {
+            m_frames.resize(chunkDescription.GetTotalFrames());
+            for (size_t i = 0; i < chunkDescription.GetNumberOfUtterances(); ++i)
+            {
+                auto utteranceFrames = chunkDescription.GetUtteranceFrames(i);
+                size_t firstFrame = chunkDescription.GetStartFrameIndexInsideChunk(i);
+                for (size_t j = 0; j < utteranceFrames.cols(); ++j)
+                {
+                    auto& frame = m_frames[firstFrame + j];
+                    frame.m_id = firstFrame + j;
+                    frame.m_numberOfSamples = 1;
+                    frame.m_data = &utteranceFrames(0, j);
+                }
+            }
+        }
     }
 
     // Gets data for the sequence.
     virtual void GetSequence(size_t sequenceId, vector<SequenceDataPtr>& result) override
     {
+        if (!m_frames.empty())
+        {
+            assert(sequenceId < m_frames.size());
+            result.push_back(SequenceDataPtr(shared_from_this(), &m_frames[sequenceId]));
+            return;
+        }
         m_parent->GetSequenceById(m_chunkId, sequenceId, result);
     }
 
@@ -340,6 +370,7 @@ private:
     DISABLE_COPY_AND_MOVE(HTKChunk);
     HTKDataDeserializer* m_parent;
     ChunkIdType m_chunkId;
+    std::vector<DenseSequenceData> m_frames; // [frame index in chunk] (in frame mode without copies, see above)
 };
 
 // Gets a data chunk with the specified chunk id.
@@ -426,6 +457,28 @@ private:
     std::vector<double> m_buffer;
 };
 
+// This class stores sequence data for HTK as half precision, see ConfigHelper::GetStorageElementType().
+struct HTKHalfSequenceData : DenseSequenceData
+{
+    HTKHalfSequenceData(FeatureMatrix& data) : m_buffer(data.GetTotalSize())
+    {
+        m_numberOfSamples = (uint32_t)data.GetNumberOfColumns();
+        if (m_numberOfSamples != data.GetNumberOfColumns())
+        {
+            RuntimeError("Maximum number of samples per sequence exceeded.");
+        }
+        const float* features = data.GetData();
+        for (size_t i = 0; i < m_buffer.size(); ++i)
+        {
+            m_buffer[i] = FloatToHalf(features[i]);
+        }
+        m_data = m_buffer.data();
+    }
+
+private:
+    std::vector<uint16_t> m_buffer;
+};
+
 // Get a sequence by its chunk id and sequence id.
 // Sequence ids are guaranteed to be unique inside a chunk.
 void HTKDataDeserializer::GetSequenceById(ChunkIdType chunkId, size_t id, vector<SequenceDataPtr>& r)
@@ -464,9 +517,13 @@ void HTKDataDeserializer::GetSequenceById(ChunkIdType chunkId, size_t id, vector
     {
         result = make_shared<HTKFloatSequenceData>(std::move(features));
     }
+    else if (m_elementType == ElementType::tfloat16)
+    {
+        result = make_shared<HTKHalfSequenceData>(features);
+    }
     else
     {
-        LogicError("Currently, HTK Deserializer supports only double and float types.");
+        LogicError("Currently, HTK Deserializer supports only double, float and float16 types.");
     }
 
     r.push_back(result);
@@ -476,14 +533,13 @@ void HTKDataDeserializer::GetSequenceById(ChunkIdType chunkId, size_t id, vector
 bool HTKDataDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& d)
 {
     assert(!m_primary);
-    auto iter = m_keyToChunkLocation.find(key.m_sequence);
-    if (iter == m_keyToChunkLocation.end())
+    ChunkIdType chunkId;
+    size_t utteranceIndexInsideChunk;
+    if (!m_keyToChunkLocation.TryGet(key.m_sequence, chunkId, utteranceIndexInsideChunk))
     {
         return false;
     }
 
-    auto chunkId = iter->second.first;
-    auto utteranceIndexInsideChunk = iter->second.second;
     const auto& chunk = m_chunks[chunkId];
     const auto& sequence = chunk.GetUtterance(utteranceIndexInsideChunk);
     d.m_chunkId = (ChunkIdType)chunkId;
@@ -11,6 +11,7 @@
 #include "UtteranceDescription.h"
 #include "HTKChunkDescription.h"
 #include "ConfigHelper.h"
+#include "SequenceKeyLocations.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -78,12 +79,15 @@ private:
 
     // Used to correlate a sequence key with the sequence inside the chunk when deserializer is running not in primary mode.
     // Key -> <chunkid, offset inside chunk>
-    std::map<size_t, std::pair<size_t, size_t>> m_keyToChunkLocation;
+    SequenceKeyLocations m_keyToChunkLocation;
 
     // Auxiliary data for checking against the data in the feature file.
     unsigned int m_samplePeriod = 0;
     size_t m_ioFeatureDimension = 0;
     std::string m_featureKind;
+
+    // Feature readers that keep the archives open across chunk loads.
+    HTKFeatureReaderPool m_readers;
 };
 
 typedef std::shared_ptr<HTKDataDeserializer> HTKDataDeserializerPtr;
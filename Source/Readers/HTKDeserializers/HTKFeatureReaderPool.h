@@ -0,0 +1,75 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include "../HTKMLFReader/htkfeatio.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Keeps feature readers, and with them their archive files and read buffers, open across chunk loads,
+// so that chunks of the same archive do not reopen it each time.
+// A reader is handed out to one thread at a time, as htkfeatreader is not thread-safe.
+// It is only used internally by the HTK deserializer.
+class HTKFeatureReaderPool
+{
+public:
+    typedef std::unique_ptr<msra::asr::htkfeatreader> ReaderPtr;
+
+    // maxOpenFiles bounds the number of readers (i.e. open files) kept in the pool.
+    explicit HTKFeatureReaderPool(size_t maxOpenFiles = 16) : m_maxOpenFiles(maxOpenFiles)
+    {
+    }
+
+    void SetMaxOpenFiles(size_t maxOpenFiles)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_maxOpenFiles = maxOpenFiles;
+        Trim();
+    }
+
+    // Gets a reader, preferably one that has the given physical file open already.
+    ReaderPtr Get(const std::wstring& physicalPath)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto i = m_readers.begin(); i != m_readers.end(); ++i)
+        {
+            if (i->first == physicalPath)
+            {
+                ReaderPtr reader = std::move(i->second);
+                m_readers.erase(i);
+                return reader;
+            }
+        }
+        return ReaderPtr(new msra::asr::htkfeatreader());
+    }
+
+    // Returns a reader to the pool. The readers used least recently are closed if there are too many.
+    void Return(const std::wstring& physicalPath, ReaderPtr&& reader)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_readers.emplace_front(physicalPath, std::move(reader));
+        Trim();
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(HTKFeatureReaderPool);
+
+    void Trim()
+    {
+        while (m_readers.size() > m_maxOpenFiles)
+            m_readers.pop_back();
+    }
+
+    // Pooled readers with the physical file they have open, the most recently returned first.
+    std::list<std::pair<std::wstring, ReaderPtr>> m_readers;
+    size_t m_maxOpenFiles;
+    std::mutex m_lock;
+};
+
+}}}
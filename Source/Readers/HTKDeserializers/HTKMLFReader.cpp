@@ -8,25 +8,106 @@
 #include "Config.h"
 #include "HTKDataDeserializer.h"
 #include "MLFDataDeserializer.h"
+#include "LatticeDeserializer.h"
 #include "ConfigHelper.h"
 #include "Bundler.h"
 #include "StringUtil.h"
 #include "FramePacker.h"
 #include "SequencePacker.h"
+#include "SequenceLengthBucketer.h"
 #include "TruncatedBpttPacker.h"
 #include "BlockRandomizer.h"
 #include "NoRandomizer.h"
+#include "Sequences.h"
+#include "latticesource.h"
+#include "simplesenonehmm.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-std::vector<IDataDeserializerPtr> CreateDeserializers(const ConfigParameters& readerConfig)
+// Removes the lattice stream from the sequences on their way to the packer, which only packs matrices,
+// and keeps the lattices and labels of the sequences last returned, from which the reader assembles
+// the lattices of the minibatch.
+class LatticeStreamSplitter : public SequenceEnumerator
+{
+public:
+    LatticeStreamSplitter(SequenceEnumeratorPtr sequenceProvider, size_t latticeStreamId, size_t labelStreamId)
+        : m_sequenceProvider(sequenceProvider), m_latticeStreamId(latticeStreamId), m_labelStreamId(labelStreamId)
+    {
+        for (const auto& stream : m_sequenceProvider->GetStreamDescriptions())
+        {
+            if (stream->m_id == m_latticeStreamId)
+                continue;
+
+            auto copy = std::make_shared<StreamDescription>(*stream);
+            copy->m_id = m_streams.size();
+            m_streams.push_back(copy);
+        }
+    }
+
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_streams;
+    }
+
+    virtual void StartEpoch(const EpochConfiguration& config) override
+    {
+        m_lattices.clear();
+        m_labels.clear();
+        m_sequenceProvider->StartEpoch(config);
+    }
+
+    virtual size_t GetCurrentSamplePosition() override
+    {
+        return m_sequenceProvider->GetCurrentSamplePosition();
+    }
+
+    virtual void SetCurrentSamplePosition(size_t samplePosition) override
+    {
+        m_lattices.clear();
+        m_labels.clear();
+        m_sequenceProvider->SetCurrentSamplePosition(samplePosition);
+    }
+
+    virtual Sequences GetNextSequences(size_t sampleCount) override
+    {
+        Sequences sequences = m_sequenceProvider->GetNextSequences(sampleCount);
+        if (sequences.m_data.empty())
+        {
+            m_lattices.clear();
+            m_labels.clear();
+            return sequences;
+        }
+
+        m_lattices = std::move(sequences.m_data[m_latticeStreamId]);
+        m_labels = sequences.m_data[m_labelStreamId];
+        sequences.m_data.erase(sequences.m_data.begin() + m_latticeStreamId);
+        return sequences;
+    }
+
+    // Lattices and labels of the sequences last returned, in the order of the sequences.
+    const std::vector<SequenceDataPtr>& GetLattices() const { return m_lattices; }
+    const std::vector<SequenceDataPtr>& GetLabels() const { return m_labels; }
+
+private:
+    SequenceEnumeratorPtr m_sequenceProvider;
+    size_t m_latticeStreamId;
+    size_t m_labelStreamId;
+    std::vector<StreamDescriptionPtr> m_streams;
+    std::vector<SequenceDataPtr> m_lattices;
+    std::vector<SequenceDataPtr> m_labels;
+};
+
+// Creates the deserializers of features, labels and lattices, in this order.
+// If an HMM is configured, it is loaded into hset; lattices require it.
+std::vector<IDataDeserializerPtr> CreateDeserializers(const ConfigParameters& readerConfig, msra::asr::simplesenonehmm& hset)
 {
     std::vector<std::wstring> featureNames;
     std::vector<std::wstring> labelNames;
-    std::vector<std::wstring> notused;
+    std::vector<std::wstring> hmmNames;
+    std::vector<std::wstring> latticeNames;
     ConfigHelper config(readerConfig);
 
-    config.GetDataNamesFromConfig(featureNames, labelNames, notused, notused);
+    config.GetDataNamesFromConfig(featureNames, labelNames, hmmNames, latticeNames);
     if (featureNames.size() < 1)
     {
         InvalidArgument("Network needs at least 1 feature specified.");
@@ -58,12 +139,37 @@ std::vector<IDataDeserializerPtr> CreateDeserializers(const ConfigParameters& re
     deserializers.insert(deserializers.end(), featureDeserializers.begin(), featureDeserializers.end());
     deserializers.insert(deserializers.end(), labelDeserializers.begin(), labelDeserializers.end());
 
+    // As in the old reader, only a single HMM and a single set of lattices are supported;
+    // the state list of the HMM is the one of the first labels.
+    if (!hmmNames.empty())
+    {
+        if (labelNames.empty())
+        {
+            InvalidArgument("The HMM requires labels with a labelMappingFile.");
+        }
+
+        const ConfigParameters& hmmConfig = readerConfig(hmmNames.front());
+        const ConfigParameters& labelConfig = readerConfig(labelNames.front());
+        hset.loadfromfile(hmmConfig(L"phoneFile"), labelConfig(L"labelMappingFile"), hmmConfig(L"transPFile", L""));
+    }
+
+    if (!latticeNames.empty())
+    {
+        if (hmmNames.empty())
+        {
+            InvalidArgument("Lattices require an HMM to be specified (phoneFile).");
+        }
+
+        auto deserializer = std::make_shared<LatticeDeserializer>(corpus, readerConfig(latticeNames.front()), latticeNames.front(), hset.getsymmap());
+        deserializers.push_back(deserializer);
+    }
+
     return deserializers;
 }
 
 HTKMLFReader::HTKMLFReader(MemoryProviderPtr provider,
     const ConfigParameters& readerConfig)
-    : m_seed(0), m_provider(provider)
+    : m_seed(0), m_provider(provider), m_hset(new msra::asr::simplesenonehmm())
 {
     // TODO: deserializers and transformers will be dynamically loaded
     // from external libraries based on the configuration/brain script.
@@ -99,13 +205,15 @@ HTKMLFReader::HTKMLFReader(MemoryProviderPtr provider,
 
     ConfigHelper config(readerConfig);
     size_t window = config.GetRandomizationWindow();
-    auto deserializers = CreateDeserializers(readerConfig);
+    auto deserializers = CreateDeserializers(readerConfig, *m_hset);
     if (deserializers.empty())
     {
         LogicError("Please specify at least a single input stream.");
     }
 
-    bool cleanse = readerConfig(L"checkData", false);
+    // Utterances without lattices are skipped, as in the old reader.
+    bool hasLattices = std::dynamic_pointer_cast<LatticeDeserializer>(deserializers.back()) != nullptr;
+    bool cleanse = readerConfig(L"checkData", false) || hasLattices;
     auto bundler = std::make_shared<Bundler>(readerConfig, deserializers[0], deserializers, cleanse);
     int verbosity = readerConfig(L"verbosity", 0);
     std::wstring readMethod = config.GetRandomizer();
@@ -113,7 +221,10 @@ HTKMLFReader::HTKMLFReader(MemoryProviderPtr provider,
     // TODO: this should be bool. Change when config per deserializer is allowed.
     if (AreEqualIgnoreCase(readMethod, std::wstring(L"blockRandomize")))
     {
-        m_randomizer = std::make_shared<BlockRandomizer>(verbosity, window, bundler, BlockRandomizer::DecimationMode::chunk, true /* useLegacyRandomization */);
+        // In distributed reading, each worker can own a fixed set of chunks, so that it only randomizes and loads those.
+        bool partitionChunks = readerConfig(L"partitionChunks", false);
+        auto decimationMode = partitionChunks ? BlockRandomizer::DecimationMode::partition : BlockRandomizer::DecimationMode::chunk;
+        m_randomizer = std::make_shared<BlockRandomizer>(verbosity, window, bundler, decimationMode, true /* useLegacyRandomization */);
     }
     else if (AreEqualIgnoreCase(readMethod, std::wstring(L"none")))
     {
@@ -124,16 +235,50 @@ HTKMLFReader::HTKMLFReader(MemoryProviderPtr provider,
         RuntimeError("readMethod must be 'blockRandomize' or 'none'.");
     }
 
-    // Create output stream descriptions (all dense)
-    for (auto d : deserializers)
+    // Optionally, grouping utterances of similar length into the same minibatch to reduce padding in the layout.
+    bool bucketByLength = readerConfig(L"bucketByLength", false);
+    if (bucketByLength)
+    {
+        if (m_packingMode != PackingMode::sequence)
+        {
+            InvalidArgument("bucketByLength is only supported when packing full sequences, not with frameMode or truncated.");
+        }
+
+        size_t bucketingWindow = readerConfig(L"bucketingWindow", (size_t)16); // in minibatches
+        bool limitPaddedSamples = readerConfig(L"limitPaddedSamples", false); // caps sequences x longest length
+        m_randomizer = std::make_shared<SequenceLengthBucketer>(m_randomizer, bucketingWindow, limitPaddedSamples);
+    }
+
+    // The lattices, if any, are the last stream; they are assembled per minibatch next to the packer.
+    if (hasLattices)
     {
-        for (auto i : d->GetStreamDescriptions())
+        if (m_packingMode != PackingMode::sequence)
+        {
+            InvalidArgument("Lattices are only supported when packing full sequences, not with frameMode or truncated.");
+        }
+
+        size_t numberOfStreams = bundler->GetStreamDescriptions().size();
+        size_t firstLabelStream = 0;
+        for (size_t i = 0; i + 1 < deserializers.size() && !std::dynamic_pointer_cast<MLFDataDeserializer>(deserializers[i]); ++i)
         {
-            StreamDescriptionPtr stream = std::make_shared<StreamDescription>(*i);
-            stream->m_storageType = StorageType::dense;
-            stream->m_id = m_streams.size();
-            m_streams.push_back(stream);
+            firstLabelStream += deserializers[i]->GetStreamDescriptions().size();
         }
+        if (firstLabelStream >= numberOfStreams - 1)
+        {
+            InvalidArgument("Lattices require labels to be specified.");
+        }
+
+        m_latticeSplitter = std::make_shared<LatticeStreamSplitter>(m_randomizer, numberOfStreams - 1, firstLabelStream);
+        m_randomizer = m_latticeSplitter;
+    }
+
+    // Create output stream descriptions (all dense)
+    for (auto i : m_randomizer->GetStreamDescriptions())
+    {
+        StreamDescriptionPtr stream = std::make_shared<StreamDescription>(*i);
+        stream->m_storageType = StorageType::dense;
+        stream->m_id = m_streams.size();
+        m_streams.push_back(stream);
     }
 
     // TODO: should we unify sample and sequence mode packers into a single one.
@@ -150,7 +295,7 @@ HTKMLFReader::HTKMLFReader(MemoryProviderPtr provider,
         m_packer = std::make_shared<FramePacker>(m_provider, m_randomizer, m_streams);
         break;
     case PackingMode::sequence:
-        m_packer = std::make_shared<SequencePacker>(m_provider, m_randomizer, m_streams);
+        m_packer = std::make_shared<SequencePacker>(m_provider, m_randomizer, m_streams, bucketByLength || verbosity > 0);
         break;
     case PackingMode::truncated:
         m_packer = std::make_shared<TruncatedBPTTPacker>(m_provider, m_randomizer, m_streams);
@@ -211,7 +356,79 @@ void HTKMLFReader::StartEpoch(const EpochConfiguration& config)
 Minibatch HTKMLFReader::ReadMinibatch()
 {
     assert(m_packer != nullptr);
-    return m_packer->ReadMinibatch();
+    Minibatch minibatch = m_packer->ReadMinibatch();
+    if (m_latticeSplitter && !minibatch.m_data.empty())
+    {
+        minibatch.m_lattices = ReadLattices(minibatch.m_data.front()->m_layout);
+    }
+    return minibatch;
+}
+
+bool HTKMLFReader::GetState(ReaderState& state)
+{
+    assert(m_packer != nullptr);
+    return m_packer->GetState(state);
+}
+
+void HTKMLFReader::SetState(const ReaderState& state)
+{
+    assert(m_packer != nullptr);
+    m_packer->SetState(state);
+}
+
+// Decodes the lattices of the sequences of the minibatch, ordered by parallel sequence and time as sequence training expects.
+LatticeMinibatchPtr HTKMLFReader::ReadLattices(const MBLayoutPtr& layout)
+{
+    const auto& lattices = m_latticeSplitter->GetLattices();
+    const auto& labels = m_latticeSplitter->GetLabels();
+
+    std::vector<MBLayout::SequenceInfo> sequences;
+    for (const auto& sequence : layout->GetAllSequences())
+    {
+        if (sequence.seqId != GAP_SEQUENCE_ID)
+        {
+            sequences.push_back(sequence);
+        }
+    }
+    std::sort(sequences.begin(), sequences.end(), [](const MBLayout::SequenceInfo& a, const MBLayout::SequenceInfo& b)
+    {
+        return a.s < b.s || (a.s == b.s && a.tBegin < b.tBegin);
+    });
+
+    auto result = std::make_shared<LatticeMinibatch>();
+    for (const auto& sequence : sequences)
+    {
+        // The sequence packer numbers the sequences by their index in the batch.
+        size_t numberOfFrames = sequence.GetNumTimeSteps();
+        const auto& lattice = std::static_pointer_cast<LatticeSequenceData>(lattices[sequence.seqId]);
+        const auto& label = std::static_pointer_cast<SparseSequenceData>(labels[sequence.seqId]);
+        if (label->m_numberOfSamples != numberOfFrames)
+        {
+            RuntimeError("Number of frames mismatch between the labels (%d) and the features (%d) of utterance '%s'.",
+                (int)label->m_numberOfSamples, (int)numberOfFrames, lattice->m_key.c_str());
+        }
+
+        auto pair = std::make_shared<msra::dbn::latticepair>();
+        lattice->Decode(pair->second, numberOfFrames);
+        result->m_lattices.push_back(pair);
+        result->m_uids.insert(result->m_uids.end(), label->m_indices, label->m_indices + numberOfFrames);
+        result->m_parallelSequences.push_back(sequence.s);
+    }
+
+    // Reference alignments are not supported, there are no phone boundaries.
+    result->m_boundaries.resize(result->m_uids.size(), 0);
+    return result;
+}
+
+bool HTKMLFReader::GetHmmData(msra::asr::simplesenonehmm* hmm)
+{
+    if (!m_latticeSplitter)
+    {
+        return false;
+    }
+
+    *hmm = *m_hset;
+    return true;
 }
 
 }}}
@@ -12,6 +12,8 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+class LatticeStreamSplitter;
+
 // The class represents a factory for connecting the packer,
 // transformers and HTK and MLF deserializers together.
 // TODO: The Packer and Randomizer will be moved to the network,
@@ -29,9 +31,16 @@ public:
     // Starts a new epoch with the provided configuration.
     void StartEpoch(const EpochConfiguration& config) override;
 
-    // Reads a single minibatch.
+    // Reads a single minibatch, with its lattices if these are configured.
     Minibatch ReadMinibatch() override;
 
+    // Gets and restores the position in the epoch.
+    bool GetState(ReaderState& state) override;
+    void SetState(const ReaderState& state) override;
+
+    // Gets the HMM for sequence training, if lattices are configured.
+    bool GetHmmData(msra::asr::simplesenonehmm* hmm) override;
+
 private:
     enum class PackingMode
     {
@@ -40,6 +49,8 @@ private:
         truncated
     };
 
+    LatticeMinibatchPtr ReadLattices(const MBLayoutPtr& layout);
+
     // All streams this reader provides.
     std::vector<StreamDescriptionPtr> m_streams;
 
@@ -62,6 +73,10 @@ private:
 
     // Parallel sequences, used for legacy configs.
     intargvector m_numParallelSequencesForAllEpochs;
+
+    // Sequence training: the HMM, and the enumerator that takes the lattices out of the sequences if lattices are configured.
+    std::shared_ptr<msra::asr::simplesenonehmm> m_hset;
+    std::shared_ptr<LatticeStreamSplitter> m_latticeSplitter;
 };
 
 }}}
@@ -0,0 +1,426 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "KaldiFeatureDeserializer.h"
+#include "ConfigHelper.h"
+#include "Basics.h"
+#include <unordered_map>
+#include <algorithm>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+KaldiFeatureDeserializer::KaldiFeatureDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& cfg, bool primary)
+    : m_corpus(corpus),
+      m_primary(primary),
+      m_verbosity(0)
+{
+    m_frameMode = (ConfigValue)cfg("frameMode", "true");
+    m_verbosity = cfg(L"verbosity", 0);
+
+    argvector<ConfigValue> inputs = cfg("input");
+    if (inputs.size() != 1)
+    {
+        InvalidArgument("KaldiFeatureDeserializer supports a single input stream only.");
+    }
+
+    ConfigParameters input = inputs.front();
+    auto inputName = input.GetMemberIds().front();
+
+    ConfigParameters streamConfig = input(inputName);
+    ConfigHelper config(streamConfig);
+    m_elementType = config.GetElementType();
+    m_dimension = config.GetFeatureDimension();
+
+    wstring scpPath = streamConfig(L"scpFile");
+    wstring prefixPath = streamConfig(L"prefixPathInSCP", L"");
+    ReadScp(scpPath, prefixPath);
+    CreateChunks();
+
+    StreamDescriptionPtr stream = make_shared<StreamDescription>();
+    stream->m_id = 0;
+    stream->m_name = inputName;
+    stream->m_sampleLayout = make_shared<TensorShape>(m_dimension);
+    stream->m_elementType = m_elementType;
+    stream->m_storageType = StorageType::dense;
+    m_streams.push_back(stream);
+}
+
+void KaldiFeatureDeserializer::ReadScp(const wstring& scpPath, const wstring& prefixPath)
+{
+    ifstream scp(msra::strfun::utf8(scpPath).c_str());
+    if (!scp)
+    {
+        RuntimeError("KaldiFeatureDeserializer: Failed to open the scp file %ls.", scpPath.c_str());
+    }
+
+    unordered_map<wstring, uint32_t> archiveIds;
+    auto& stringRegistry = m_corpus->GetStringRegistry();
+    size_t allUtterances = 0;
+    string line;
+    while (getline(scp, line))
+    {
+        // 'key rxspecifier', the offset of the rxspecifier is after the last colon (Windows paths have colons)
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == string::npos)
+        {
+            continue;
+        }
+
+        size_t keyEnd = line.find_first_of(" \t", begin);
+        size_t pathBegin = keyEnd == string::npos ? string::npos : line.find_first_not_of(" \t", keyEnd);
+        size_t pathEnd = line.find_last_not_of(" \t\r");
+        if (pathBegin == string::npos)
+        {
+            RuntimeError("KaldiFeatureDeserializer: Invalid line '%s' in the scp file %ls, expected 'key path.ark:offset'.", line.c_str(), scpPath.c_str());
+        }
+
+        string key = line.substr(begin, keyEnd - begin);
+        string specifier = line.substr(pathBegin, pathEnd + 1 - pathBegin);
+        if (specifier.back() == '|' || specifier.back() == ']')
+        {
+            RuntimeError("KaldiFeatureDeserializer: Pipes and ranges are not supported, in '%s' of the scp file %ls.", specifier.c_str(), scpPath.c_str());
+        }
+
+        allUtterances++;
+        if (!m_corpus->IsIncluded(key))
+        {
+            continue;
+        }
+
+        size_t offset = 0;
+        string path = specifier;
+        size_t colon = specifier.find_last_of(':');
+        if (colon != string::npos && colon + 1 < specifier.size() &&
+            specifier.find_first_not_of("0123456789", colon + 1) == string::npos)
+        {
+            path = specifier.substr(0, colon);
+            offset = (size_t)strtoull(specifier.c_str() + colon + 1, nullptr, 10);
+        }
+
+        wstring archivePath = msra::strfun::utf16(path);
+        if (!prefixPath.empty() && archivePath.front() != L'/' && archivePath.find(L':') == wstring::npos)
+        {
+            archivePath = prefixPath + L"/" + archivePath;
+        }
+
+        auto archive = archiveIds.find(archivePath);
+        if (archive == archiveIds.end())
+        {
+            archive = archiveIds.insert(make_pair(archivePath, (uint32_t)m_archives.size())).first;
+            m_archives.push_back(make_shared<MappedFile>(archivePath));
+            m_archivePaths.push_back(archivePath);
+        }
+
+        Utterance utterance;
+        utterance.m_id = stringRegistry[key];
+        utterance.m_archive = archive->second;
+        utterance.m_firstFrame = 0;
+        ParseMatrixHeader(archivePath, offset, utterance);
+        m_utterances.push_back(utterance);
+    }
+
+    if (scp.bad())
+    {
+        RuntimeError("KaldiFeatureDeserializer: An error occurred while reading the scp file %ls.", scpPath.c_str());
+    }
+
+    if (m_verbosity > 0)
+    {
+        fprintf(stderr, "KaldiFeatureDeserializer: %" PRIu64 " of %" PRIu64 " utterances of %ls are selected, in %" PRIu64 " archives.\n",
+            (uint64_t)m_utterances.size(), (uint64_t)allUtterances, scpPath.c_str(), (uint64_t)m_archives.size());
+    }
+
+    if (m_utterances.empty())
+    {
+        RuntimeError("KaldiFeatureDeserializer: No utterances to process.");
+    }
+}
+
+// A binary Kaldi matrix: "\0B", the token "FM " or "DM ", the number of rows and the number of columns as
+// one byte of size (4) followed by an int32, then the rows.
+void KaldiFeatureDeserializer::ParseMatrixHeader(const wstring& archivePath, size_t offset, Utterance& utterance)
+{
+    const auto& archive = *m_archives[utterance.m_archive];
+    const char* data = archive.Data();
+    const size_t headerSize = 2 + 3 + 2 * (1 + sizeof(int32_t));
+    if (offset + headerSize > archive.Size())
+    {
+        RuntimeError("KaldiFeatureDeserializer: The offset %" PRIu64 " is beyond the end of the archive %ls.", (uint64_t)offset, archivePath.c_str());
+    }
+
+    const char* header = data + offset;
+    if (header[0] != '\0' || header[1] != 'B')
+    {
+        RuntimeError("KaldiFeatureDeserializer: Only binary archives are supported, the matrix at the offset %" PRIu64 " of %ls is not binary.", (uint64_t)offset, archivePath.c_str());
+    }
+
+    if (memcmp(header + 2, "FM ", 3) == 0)
+    {
+        utterance.m_isDouble = false;
+    }
+    else if (memcmp(header + 2, "DM ", 3) == 0)
+    {
+        utterance.m_isDouble = true;
+    }
+    else
+    {
+        RuntimeError("KaldiFeatureDeserializer: Only float (FM) and double (DM) matrices are supported, the matrix at the offset %" PRIu64 " of %ls is not one.", (uint64_t)offset, archivePath.c_str());
+    }
+
+    int32_t rows, columns;
+    if (header[5] != sizeof(int32_t) || header[10] != sizeof(int32_t))
+    {
+        RuntimeError("KaldiFeatureDeserializer: Invalid size of the matrix at the offset %" PRIu64 " of %ls.", (uint64_t)offset, archivePath.c_str());
+    }
+    memcpy(&rows, header + 6, sizeof(int32_t));
+    memcpy(&columns, header + 11, sizeof(int32_t));
+
+    if (columns != (int32_t)m_dimension)
+    {
+        RuntimeError("KaldiFeatureDeserializer: The matrix at the offset %" PRIu64 " of %ls has %d columns, the dimension of the features is %" PRIu64 ".",
+            (uint64_t)offset, archivePath.c_str(), (int)columns, (uint64_t)m_dimension);
+    }
+
+    size_t elementSize = utterance.m_isDouble ? sizeof(double) : sizeof(float);
+    utterance.m_offset = offset + headerSize;
+    if (rows < 0 || utterance.m_offset + (size_t)rows * m_dimension * elementSize > archive.Size())
+    {
+        RuntimeError("KaldiFeatureDeserializer: The matrix at the offset %" PRIu64 " of %ls is beyond the end of the archive.", (uint64_t)offset, archivePath.c_str());
+    }
+
+    utterance.m_numberOfFrames = (uint32_t)rows;
+}
+
+void KaldiFeatureDeserializer::CreateChunks()
+{
+    // Consecutive utterances of a chunk are consecutive in the archives, so that a chunk is read sequentially.
+    sort(m_utterances.begin(), m_utterances.end(), [](const Utterance& a, const Utterance& b)
+    {
+        return a.m_archive < b.m_archive || (a.m_archive == b.m_archive && a.m_offset < b.m_offset);
+    });
+
+    // As in the HTK deserializer, a chunk constitutes of 15 minutes of 100 frames a second.
+    const size_t ChunkFrames = 15 * 60 * 100;
+
+    size_t totalFrames = 0;
+    for (size_t i = 0; i < m_utterances.size(); ++i)
+    {
+        auto& utterance = m_utterances[i];
+        if (m_chunks.empty() || m_chunks.back().m_numberOfFrames > ChunkFrames)
+        {
+            if (m_chunks.size() >= CHUNKID_MAX)
+            {
+                RuntimeError("KaldiFeatureDeserializer: The number of chunks exceeds %" PRIu64 ".", (uint64_t)CHUNKID_MAX);
+            }
+            m_chunks.push_back(ChunkInfo{ i, 0, 0 });
+        }
+
+        auto& chunk = m_chunks.back();
+        if (!m_primary)
+        {
+            m_keyToChunkLocation.Add(utterance.m_id, (ChunkIdType)(m_chunks.size() - 1), chunk.m_numberOfUtterances);
+        }
+
+        utterance.m_firstFrame = chunk.m_numberOfFrames;
+        chunk.m_numberOfFrames += utterance.m_numberOfFrames;
+        chunk.m_numberOfUtterances++;
+        totalFrames += utterance.m_numberOfFrames;
+    }
+    m_keyToChunkLocation.ShrinkToFit();
+
+    fprintf(stderr,
+        "KaldiFeatureDeserializer::KaldiFeatureDeserializer: "
+        "selected %" PRIu64 " utterances grouped into %" PRIu64 " chunks, "
+        "average chunk size: %.1f utterances, %.1f frames\n",
+        (uint64_t)m_utterances.size(),
+        (uint64_t)m_chunks.size(),
+        m_utterances.size() / (double)m_chunks.size(),
+        totalFrames / (double)m_chunks.size());
+}
+
+ChunkDescriptions KaldiFeatureDeserializer::GetChunkDescriptions()
+{
+    ChunkDescriptions chunks;
+    chunks.reserve(m_chunks.size());
+
+    for (ChunkIdType i = 0; i < m_chunks.size(); ++i)
+    {
+        auto cd = make_shared<ChunkDescription>();
+        cd->m_id = i;
+        cd->m_numberOfSamples = m_chunks[i].m_numberOfFrames;
+        // In frame mode, each frame is represented as sequence.
+        cd->m_numberOfSequences = m_frameMode ? m_chunks[i].m_numberOfFrames : m_chunks[i].m_numberOfUtterances;
+        chunks.push_back(cd);
+    }
+    return chunks;
+}
+
+void KaldiFeatureDeserializer::GetSequencesForChunk(ChunkIdType chunkId, vector<SequenceDescription>& result)
+{
+    const auto& chunk = m_chunks[chunkId];
+    result.reserve(m_frameMode ? chunk.m_numberOfFrames : chunk.m_numberOfUtterances);
+    size_t offsetInChunk = 0;
+    for (size_t i = chunk.m_firstUtterance; i < chunk.m_firstUtterance + chunk.m_numberOfUtterances; ++i)
+    {
+        const auto& utterance = m_utterances[i];
+        if (m_frameMode)
+        {
+            for (size_t k = 0; k < utterance.m_numberOfFrames; ++k)
+            {
+                SequenceDescription f;
+                f.m_chunkId = chunkId;
+                f.m_key.m_sequence = utterance.m_id;
+                f.m_key.m_sample = k;
+                f.m_id = offsetInChunk++;
+                f.m_numberOfSamples = 1;
+                result.push_back(f);
+            }
+        }
+        else
+        {
+            SequenceDescription f;
+            f.m_chunkId = chunkId;
+            f.m_key.m_sequence = utterance.m_id;
+            f.m_key.m_sample = 0;
+            f.m_id = offsetInChunk++;
+            if (SEQUENCELEN_MAX < utterance.m_numberOfFrames)
+            {
+                RuntimeError("Maximum number of samples per sequence exceeded");
+            }
+
+            f.m_numberOfSamples = utterance.m_numberOfFrames;
+            result.push_back(f);
+        }
+    }
+}
+
+size_t KaldiFeatureDeserializer::GetUtteranceForChunkFrameIndex(const ChunkInfo& chunk, size_t frameIndex) const
+{
+    auto begin = m_utterances.begin() + chunk.m_firstUtterance;
+    auto end = begin + chunk.m_numberOfUtterances;
+    auto found = upper_bound(begin, end, frameIndex, [](size_t frame, const Utterance& u)
+    {
+        return frame < u.m_firstFrame;
+    });
+    return (found - begin) - 1;
+}
+
+// Sequence data that points into the mapped archive, or converts the frames to the element type of the stream.
+struct KaldiFeatureSequenceData : DenseSequenceData
+{
+    std::vector<char> m_buffer;
+};
+
+template <class TTo, class TFrom>
+static void ConvertFrames(const char* from, size_t count, std::vector<char>& buffer)
+{
+    buffer.resize(count * sizeof(TTo));
+    TTo* to = reinterpret_cast<TTo*>(buffer.data());
+    for (size_t i = 0; i < count; ++i)
+    {
+        TFrom value;
+        memcpy(&value, from + i * sizeof(TFrom), sizeof(TFrom));
+        to[i] = (TTo)value;
+    }
+}
+
+// Represents a chunk of the mapped archives. Loading the chunk reads its pages, so that the I/O is done by the
+// prefetch of the reader and not when the sequences are packed.
+class KaldiFeatureDeserializer::KaldiChunk : public Chunk, public std::enable_shared_from_this<KaldiChunk>
+{
+public:
+    KaldiChunk(const KaldiFeatureDeserializer& parent, ChunkIdType chunkId)
+        : m_parent(parent), m_chunk(parent.m_chunks[chunkId])
+    {
+        const size_t pageSize = 4096;
+        volatile char touched = 0;
+        for (size_t i = m_chunk.m_firstUtterance; i < m_chunk.m_firstUtterance + m_chunk.m_numberOfUtterances; ++i)
+        {
+            const auto& utterance = m_parent.m_utterances[i];
+            const auto& archive = *m_parent.m_archives[utterance.m_archive];
+            size_t size = Size(utterance, utterance.m_numberOfFrames);
+            archive.Prefetch(utterance.m_offset, size);
+            for (size_t offset = 0; offset < size; offset += pageSize)
+            {
+                touched ^= archive.Data()[utterance.m_offset + offset];
+            }
+        }
+    }
+
+    virtual void GetSequence(size_t sequenceId, vector<SequenceDataPtr>& result) override
+    {
+        size_t utteranceIndex = m_parent.m_frameMode ? m_parent.GetUtteranceForChunkFrameIndex(m_chunk, sequenceId) : sequenceId;
+        if (utteranceIndex >= m_chunk.m_numberOfUtterances)
+        {
+            LogicError("KaldiFeatureDeserializer: Sequence %" PRIu64 " is not in the chunk.", (uint64_t)sequenceId);
+        }
+
+        const auto& utterance = m_parent.m_utterances[m_chunk.m_firstUtterance + utteranceIndex];
+        size_t firstFrame = m_parent.m_frameMode ? sequenceId - utterance.m_firstFrame : 0;
+        uint32_t numberOfFrames = m_parent.m_frameMode ? 1 : utterance.m_numberOfFrames;
+        const char* frames = m_parent.m_archives[utterance.m_archive]->Data() + utterance.m_offset + Size(utterance, firstFrame);
+
+        auto data = make_shared<KaldiFeatureSequenceData>();
+        data->m_id = sequenceId;
+        data->m_numberOfSamples = numberOfFrames;
+        data->m_chunk = shared_from_this();
+        size_t count = numberOfFrames * m_parent.m_dimension;
+        bool isDoubleStream = m_parent.m_elementType == ElementType::tdouble;
+        if (utterance.m_isDouble == isDoubleStream)
+        {
+            data->m_data = const_cast<char*>(frames);
+        }
+        else
+        {
+            if (isDoubleStream)
+                ConvertFrames<double, float>(frames, count, data->m_buffer);
+            else
+                ConvertFrames<float, double>(frames, count, data->m_buffer);
+            data->m_data = data->m_buffer.data();
+        }
+        result.push_back(data);
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(KaldiChunk);
+
+    // Size in bytes of the frames of the utterance.
+    size_t Size(const Utterance& utterance, size_t numberOfFrames) const
+    {
+        return numberOfFrames * m_parent.m_dimension * (utterance.m_isDouble ? sizeof(double) : sizeof(float));
+    }
+
+    const KaldiFeatureDeserializer& m_parent;
+    const ChunkInfo& m_chunk;
+};
+
+ChunkPtr KaldiFeatureDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    return make_shared<KaldiChunk>(*this, chunkId);
+}
+
+bool KaldiFeatureDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& d)
+{
+    assert(!m_primary);
+    ChunkIdType chunkId;
+    size_t utteranceIndexInsideChunk;
+    if (!m_keyToChunkLocation.TryGet(key.m_sequence, chunkId, utteranceIndexInsideChunk))
+    {
+        return false;
+    }
+
+    const auto& utterance = m_utterances[m_chunks[chunkId].m_firstUtterance + utteranceIndexInsideChunk];
+    d.m_chunkId = chunkId;
+    d.m_id = m_frameMode ? utterance.m_firstFrame + key.m_sample : utteranceIndexInsideChunk;
+    d.m_numberOfSamples = m_frameMode ? 1 : utterance.m_numberOfFrames;
+    return true;
+}
+
+}}}
@@ -0,0 +1,100 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "CorpusDescriptor.h"
+#include "MappedFile.h"
+#include "SequenceKeyLocations.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Class represents a deserializer of Kaldi features, given by an scp file of 'key path.ark:offset' entries that
+// point to binary float (FM) or double (DM) matrices in Kaldi ark files, one row per frame.
+// The ark files are memory-mapped and the matrix headers are read when the scp file is indexed. The utterances are
+// sorted by their archive and offset and grouped into chunks of consecutive ranges of the archives, so that loading
+// a chunk (which is done by the prefetch of the reader) reads the archives sequentially. The sequences of float
+// matrices read as float point into the mapping and are not copied.
+// Compressed matrices (CM), text archives, pipes and ranges in the scp file are not supported.
+class KaldiFeatureDeserializer : public DataDeserializerBase
+{
+public:
+    KaldiFeatureDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, bool primary);
+
+    // Get information about chunks.
+    virtual ChunkDescriptions GetChunkDescriptions() override;
+
+    // Get information about particular chunk.
+    virtual void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& result) override;
+
+    // Retrieves data for a chunk.
+    virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+    // Gets sequence description by its key.
+    virtual bool GetSequenceDescriptionByKey(const KeyType&, SequenceDescription&) override;
+
+private:
+    class KaldiChunk;
+    DISABLE_COPY_AND_MOVE(KaldiFeatureDeserializer);
+
+    struct Utterance
+    {
+        size_t m_id;              // key id in the string registry of the corpus
+        size_t m_offset;          // of the first frame in the archive
+        uint32_t m_archive;       // index of the archive
+        uint32_t m_numberOfFrames;
+        bool m_isDouble;          // DM, otherwise FM
+        size_t m_firstFrame;      // index of the first frame inside the chunk
+    };
+
+    struct ChunkInfo
+    {
+        size_t m_firstUtterance;
+        size_t m_numberOfUtterances;
+        size_t m_numberOfFrames;
+    };
+
+    // Reads the scp file and the headers of the matrices it refers to.
+    void ReadScp(const std::wstring& scpPath, const std::wstring& prefixPath);
+
+    // Parses the header of the binary matrix at the offset of the archive into the utterance.
+    void ParseMatrixHeader(const std::wstring& archivePath, size_t offset, Utterance& utterance);
+
+    // Groups the sorted utterances into chunks.
+    void CreateChunks();
+
+    // Finds the utterance of a frame inside the chunk.
+    size_t GetUtteranceForChunkFrameIndex(const ChunkInfo& chunk, size_t frameIndex) const;
+
+    // Dimension of features.
+    size_t m_dimension;
+
+    // Type of the features.
+    ElementType m_elementType;
+
+    CorpusDescriptorPtr m_corpus;
+
+    // Flag that indicates whether a single speech frames should be exposed as a sequence.
+    bool m_frameMode;
+
+    // Indicates, whether the deserializers is the "primary" one, the one that drives chunking.
+    bool m_primary;
+
+    // Memory-mapped archives and their paths, the index of an archive is kept in the utterances.
+    std::vector<MappedFilePtr> m_archives;
+    std::vector<std::wstring> m_archivePaths;
+
+    std::vector<Utterance> m_utterances;
+    std::vector<ChunkInfo> m_chunks;
+
+    // Key -> <chunkid, utterance index inside chunk>, when the deserializer is not primary.
+    SequenceKeyLocations m_keyToChunkLocation;
+
+    int m_verbosity;
+};
+
+}}}
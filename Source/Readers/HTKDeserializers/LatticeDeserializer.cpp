@@ -0,0 +1,220 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "LatticeDeserializer.h"
+#include "ConfigHelper.h"
+#include "../HTKMLFReader/htkfeatio.h"
+#include "latticearchive.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+void LatticeSequenceData::Decode(msra::lattices::lattice& lattice, size_t expectedFrames) const
+{
+    const char* begin = static_cast<const char*>(m_data);
+    msra::lattices::memoryreader reader(begin, m_archiveEnd - begin);
+    lattice.fread(reader, *m_idmap, m_idmap->back());
+    lattice.key = msra::strfun::utf16(m_key);
+    if (lattice.getnumframes() != expectedFrames)
+    {
+        RuntimeError("Number of frames mismatch between the lattice (%d) and the features (%d) of utterance '%s'.",
+            (int)lattice.getnumframes(), (int)expectedFrames, m_key.c_str());
+    }
+}
+
+// All lattices are in a single chunk, the archives are mapped as a whole.
+class LatticeDeserializer::LatticeChunk : public Chunk
+{
+    LatticeDeserializer* m_parent;
+public:
+    LatticeChunk(LatticeDeserializer* parent) : m_parent(parent)
+    {}
+
+    virtual void GetSequence(size_t sequenceId, vector<SequenceDataPtr>& result) override
+    {
+        m_parent->GetSequenceById(sequenceId, result);
+    }
+};
+
+LatticeDeserializer::LatticeDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& latticeConfig, const wstring& name,
+                                         const unordered_map<string, size_t>& symbolMap)
+    : m_corpus(corpus)
+{
+    // Lattices are whole utterances.
+    // As for the MLF deserializer, the frame mode is specified on a higher level in the configuration.
+    bool frameMode = latticeConfig.Find("frameMode", "true");
+    if (frameMode)
+    {
+        InvalidArgument("Lattices are only supported with frameMode=false.");
+    }
+
+    if (latticeConfig.Exists(L"numLatTocFile"))
+    {
+        fprintf(stderr, "LatticeDeserializer: numerator lattices are not used, ignoring numLatTocFile.\n");
+    }
+
+    vector<wstring> tocPaths;
+    expand_wildcards(latticeConfig(L"denLatTocFile"), tocPaths);
+    wstring prefixPath = latticeConfig(L"prefixPathInToc", L"");
+
+    for (const auto& tocPath : tocPaths)
+    {
+        ReadToc(tocPath, prefixPath, symbolMap);
+    }
+
+    fprintf(stderr, "LatticeDeserializer: %d lattices of the corpus referenced in %d TOC and %d archive files\n",
+        (int)m_numberOfSequences, (int)tocPaths.size(), (int)m_archives.size());
+
+    StreamDescriptionPtr stream = make_shared<StreamDescription>();
+    stream->m_id = 0;
+    stream->m_name = name;
+    stream->m_sampleLayout = make_shared<TensorShape>(1);
+    stream->m_storageType = StorageType::dense;
+    stream->m_elementType = ElementType::tatom;
+    m_streams.push_back(stream);
+}
+
+void LatticeDeserializer::ReadToc(const wstring& tocPath, const wstring& prefixPath, const unordered_map<string, size_t>& symbolMap)
+{
+    const auto& stringRegistry = m_corpus->GetStringRegistry();
+
+    MappedFile toc(tocPath);
+    const char* p = toc.Data();
+    const char* end = p + toc.Size();
+    uint32_t archiveIndex = UINT32_MAX;
+    while (p < end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (lineEnd == nullptr)
+            lineEnd = end;
+        const char* line = p;
+        const char* last = lineEnd;
+        p = lineEnd + 1;
+        if (last > line && last[-1] == '\r')
+            last--;
+        if (last == line)
+            continue;
+
+        // key=archive[offset]
+        const char* equal = static_cast<const char*>(memchr(line, '=', last - line));
+        const char* bracket = equal ? static_cast<const char*>(memchr(equal, '[', last - equal)) : nullptr;
+        if (bracket == nullptr || last[-1] != ']' || last - bracket < 3)
+            RuntimeError("Invalid line in lattice TOC file '%ls': %s", tocPath.c_str(), string(line, last).c_str());
+
+        if (bracket != equal + 1)
+        {
+            wstring archivePath = msra::strfun::utf16(string(equal + 1, bracket));
+            if (!prefixPath.empty())
+                archivePath = prefixPath + L"/" + archivePath;
+
+            auto archive = m_archiveIndex.find(archivePath);
+            if (archive != m_archiveIndex.end())
+            {
+                archiveIndex = archive->second;
+            }
+            else
+            {
+                archiveIndex = (uint32_t)m_archives.size();
+                m_archiveIndex[archivePath] = archiveIndex;
+                m_archives.push_back(Archive{ archivePath, nullptr, vector<unsigned int>() });
+            }
+        }
+        if (archiveIndex == UINT32_MAX)
+            RuntimeError("Invalid line in lattice TOC file '%ls' (empty archive path): %s", tocPath.c_str(), string(line, last).c_str());
+
+        uint64_t offset = 0;
+        for (const char* digit = bracket + 1; digit < last - 1; digit++)
+        {
+            if (*digit < '0' || *digit > '9')
+                RuntimeError("Invalid line in lattice TOC file '%ls' (bad offset): %s", tocPath.c_str(), string(line, last).c_str());
+            offset = offset * 10 + (*digit - '0');
+        }
+
+        // Currently the string registry contains only utterances described in scp.
+        // So here we skip all others.
+        size_t id = 0;
+        if (!stringRegistry.TryGet(string(line, equal), id))
+            continue;
+
+        if (id >= m_locations.size())
+            m_locations.resize(id + 1, LatticeLocation{ UINT32_MAX, 0 });
+        if (m_locations[id].m_archive != UINT32_MAX)
+            RuntimeError("Duplicate lattice for utterance '%s' in TOC file '%ls'.", string(line, equal).c_str(), tocPath.c_str());
+        m_locations[id] = LatticeLocation{ archiveIndex, offset };
+        m_numberOfSequences++;
+    }
+
+    // Mapping the archives that are referenced for the first time, and reading their symbol lists.
+    for (auto& archive : m_archives)
+    {
+        if (archive.m_file)
+            continue;
+
+        archive.m_file = make_shared<MappedFile>(archive.m_path);
+        msra::lattices::archive::readidmap(archive.m_path + L".symlist", symbolMap, archive.m_idmap);
+    }
+}
+
+// Currently lattices have a single chunk.
+ChunkDescriptions LatticeDeserializer::GetChunkDescriptions()
+{
+    auto cd = make_shared<ChunkDescription>();
+    cd->m_id = 0;
+    cd->m_numberOfSequences = m_numberOfSequences;
+    cd->m_numberOfSamples = m_numberOfSequences;
+    return ChunkDescriptions{cd};
+}
+
+void LatticeDeserializer::GetSequencesForChunk(ChunkIdType, vector<SequenceDescription>& result)
+{
+    UNUSED(result);
+    LogicError("Lattice deserializer does not support primary mode - it cannot control chunking.");
+}
+
+ChunkPtr LatticeDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    UNUSED(chunkId);
+    assert(chunkId == 0);
+    return make_shared<LatticeChunk>(this);
+}
+
+void LatticeDeserializer::GetSequenceById(size_t sequenceId, vector<SequenceDataPtr>& result)
+{
+    const auto& location = m_locations[sequenceId];
+    const auto& archive = m_archives[location.m_archive];
+    if (location.m_offset >= archive.m_file->Size())
+    {
+        RuntimeError("Lattice offset of utterance '%s' is beyond the end of the archive '%ls'.",
+            m_corpus->GetStringRegistry()[sequenceId].c_str(), archive.m_path.c_str());
+    }
+
+    auto s = make_shared<LatticeSequenceData>();
+    s->m_id = sequenceId;
+    s->m_numberOfSamples = 1;
+    s->m_data = const_cast<char*>(archive.m_file->Data() + location.m_offset);
+    s->m_archiveEnd = archive.m_file->Data() + archive.m_file->Size();
+    s->m_idmap = &archive.m_idmap;
+    s->m_key = m_corpus->GetStringRegistry()[sequenceId];
+    result.push_back(s);
+}
+
+bool LatticeDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
+{
+    if (key.m_sequence >= m_locations.size() || m_locations[key.m_sequence].m_archive == UINT32_MAX)
+    {
+        return false;
+    }
+
+    assert(key.m_sample == 0);
+    result.m_chunkId = 0;
+    result.m_key = key;
+    result.m_id = key.m_sequence;
+    result.m_numberOfSamples = 1;
+    return true;
+}
+
+}}}
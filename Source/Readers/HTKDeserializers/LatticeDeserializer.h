@@ -0,0 +1,88 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <unordered_map>
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "CorpusDescriptor.h"
+#include "MappedFile.h"
+
+namespace msra { namespace lattices { class lattice; } }
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Lattice of an utterance, as returned by the lattice deserializer.
+// m_data points to the lattice in the memory-mapped archive, no lattice is copied until it is decoded.
+struct LatticeSequenceData : SequenceDataBase
+{
+    const char* m_archiveEnd;                // end of the mapped archive, bounds the reads of the decoding
+    const std::vector<unsigned int>* m_idmap; // mapping of the symbols of the archive to the ids of the model, /sp/ last
+    std::string m_key;                        // key of the utterance, for diagnostics
+
+    // Decodes the (denominator) lattice. expectedFrames is checked against the number of frames of the lattice.
+    void Decode(msra::lattices::lattice& lattice, size_t expectedFrames) const;
+};
+typedef std::shared_ptr<LatticeSequenceData> LatticeSequenceDataPtr;
+
+// Class represents a lattice deserializer, for sequence training.
+// It provides the denominator lattices of the utterances of the corpus as a single stream of type atom.
+// The TOC files and lattice archives are memory-mapped; TOC entries of utterances outside of the corpus are not kept.
+// Like the MLF deserializer, it cannot control chunking.
+class LatticeDeserializer : public DataDeserializerBase
+{
+public:
+    // symbolMap maps the phone units of the model (see simplesenonehmm::getsymmap()) to their ids.
+    // TODO: Should be removed, when all readers go away, expects configuration in a legacy mode.
+    LatticeDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, const std::wstring& streamName,
+                        const std::unordered_map<std::string, size_t>& symbolMap);
+
+    // Retrieves sequence description by its key. The lattice of an utterance is a single sample.
+    bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& s) override;
+
+    // Gets description of all chunks.
+    virtual ChunkDescriptions GetChunkDescriptions() override;
+
+    // Get sequence descriptions of a particular chunk.
+    virtual void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& s) override;
+
+    // Retrieves a chunk with data. All archives are mapped, so there is a single chunk only.
+    virtual ChunkPtr GetChunk(ChunkIdType) override;
+
+private:
+    class LatticeChunk;
+    DISABLE_COPY_AND_MOVE(LatticeDeserializer);
+
+    // Parses a TOC file of lines 'key=archive[offset]', where an empty archive means the one of the previous line.
+    void ReadToc(const std::wstring& tocPath, const std::wstring& prefixPath, const std::unordered_map<std::string, size_t>& symbolMap);
+
+    void GetSequenceById(size_t sequenceId, std::vector<SequenceDataPtr>& result);
+
+    struct LatticeLocation
+    {
+        uint32_t m_archive; // index into m_archives
+        uint64_t m_offset;  // byte offset of the lattice in the archive
+    };
+
+    // Lattice locations, indexed by the corpus id of the utterance (m_archive is UINT32_MAX if there is no lattice).
+    std::vector<LatticeLocation> m_locations;
+
+    // Number of utterances with lattices.
+    size_t m_numberOfSequences = 0;
+
+    struct Archive
+    {
+        std::wstring m_path;
+        MappedFilePtr m_file;
+        std::vector<unsigned int> m_idmap; // see archive::readidmap()
+    };
+    std::vector<Archive> m_archives;
+    std::map<std::wstring, uint32_t> m_archiveIndex; // [path] -> index into m_archives
+
+    CorpusDescriptorPtr m_corpus;
+};
+
+}}}
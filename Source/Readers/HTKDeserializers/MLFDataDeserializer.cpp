@@ -7,6 +7,7 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <limits>
+#include <sys/stat.h>
 #include "MLFDataDeserializer.h"
 #include "ConfigHelper.h"
 #include "../HTKMLFReader/htkfeatio.h"
@@ -37,12 +38,57 @@ public:
     }
 };
 
-// Inner class for an utterance.
-struct MLFUtterance : SequenceDescription
+// Binary cache of the parsed MLF files, with the labels of all their utterances:
+//   MLFCacheHeader
+//   signature: stamps of the MLF and state list files the cache was built from, padded to 8 bytes
+//   MLFCacheUtterance[m_numberOfUtterances]
+//   keys: utf-8 keys of the utterances, padded to 8 bytes
+//   CLASSIDTYPE[m_numberOfFrames]: class ids of all frames, utterance by utterance
+static const char s_labelCacheMagic[8] = { 'C', 'N', 'T', 'K', 'M', 'L', 'C', '1' };
+static const uint32_t s_labelCacheVersion = 1;
+
+struct MLFCacheHeader
 {
-    size_t m_sequenceStart;
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_classIdSize;
+    uint64_t m_signatureSize;
+    uint64_t m_numberOfUtterances;
+    uint64_t m_numberOfFrames;
+    uint64_t m_numberOfClasses;
+    uint64_t m_keysSize;
 };
 
+struct MLFCacheUtterance
+{
+    uint64_t m_keyOffset; // in the keys
+    uint32_t m_keyLength;
+    uint32_t m_numberOfFrames;
+};
+
+static_assert(sizeof(MLFCacheHeader) == 56 && sizeof(MLFCacheUtterance) == 16, "Unexpected layout of the label cache structures.");
+
+static size_t PadTo8(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+// Size and modification time of a file the label cache is built from.
+static string GetFileStamp(const wstring& path)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_wstat64(path.c_str(), &info) != 0)
+#else
+    struct stat info;
+    if (stat(msra::strfun::utf8(path).c_str(), &info) != 0)
+#endif
+    {
+        RuntimeError("Cannot access the file '%ls'.", path.c_str());
+    }
+    return msra::strfun::strprintf("%s %" PRIu64 " %" PRId64 "\n", msra::strfun::utf8(path).c_str(), (uint64_t)info.st_size, (int64_t)info.st_mtime);
+}
+
 MLFDataDeserializer::MLFDataDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& cfg, bool primary)
 {
     // TODO: This should be read in one place, potentially given by SGD.
@@ -69,7 +115,8 @@ MLFDataDeserializer::MLFDataDeserializer(CorpusDescriptorPtr corpus, const Confi
     size_t dimension = config.GetLabelDimension();
 
     wstring labelMappingFile = streamConfig(L"labelMappingFile", L"");
-    InitializeChunkDescriptions(corpus, config, labelMappingFile, dimension);
+    wstring labelCacheFile = streamConfig(L"labelCacheFile", L"");
+    InitializeChunkDescriptions(corpus, config, labelMappingFile, dimension, labelCacheFile);
     InitializeStream(inputName, dimension);
 }
 
@@ -92,104 +139,112 @@ MLFDataDeserializer::MLFDataDeserializer(CorpusDescriptorPtr corpus, const Confi
     }
 
     wstring labelMappingFile = labelConfig(L"labelMappingFile", L"");
-    InitializeChunkDescriptions(corpus, config, labelMappingFile, dimension);
+    wstring labelCacheFile = labelConfig(L"labelCacheFile", L"");
+    InitializeChunkDescriptions(corpus, config, labelMappingFile, dimension, labelCacheFile);
     InitializeStream(name, dimension);
 }
 
 // Currently we create a single chunk only.
-void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus, const ConfigHelper& config, const wstring& stateListPath, size_t dimension)
+void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus, const ConfigHelper& config, const wstring& stateListPath, size_t dimension, const wstring& cachePath)
 {
-    // TODO: Similarly to the old reader, currently we assume all Mlfs will have same root name (key)
-    // restrict MLF reader to these files--will make stuff much faster without having to use shortened input files
-
-    // TODO: currently we do not use symbol and word tables.
-    const msra::lm::CSymbolSet* wordTable = nullptr;
-    unordered_map<const char*, int>* symbolTable = nullptr;
-    vector<wstring> mlfPaths = config.GetMlfPaths();
-
-    // TODO: Currently we still use the old IO module. This will be refactored later.
-    const double htkTimeToFrame = 100000.0; // default is 10ms
-    msra::asr::htkmlfreader<msra::asr::htkmlfentry, msra::lattices::lattice::htkmlfwordsequence> labels(mlfPaths, set<wstring>(), stateListPath, wordTable, symbolTable, htkTimeToFrame);
-
-    // Make sure 'msra::asr::htkmlfreader' type has a move constructor
-    static_assert(
-        is_move_constructible<
-        msra::asr::htkmlfreader<msra::asr::htkmlfentry,
-        msra::lattices::lattice::htkmlfwordsequence >> ::value,
-        "Type 'msra::asr::htkmlfreader' should be move constructible!");
-
     m_elementType = config.GetElementType();
+    m_classIndexLabels = config.IsClassIndexLabelFormat();
+    m_classIndexLayout = make_shared<TensorShape>(1);
 
-    MLFUtterance description;
+    vector<wstring> mlfPaths = config.GetMlfPaths();
     size_t numClasses = 0;
-    size_t totalFrames = 0;
 
-    const auto& stringRegistry = corpus->GetStringRegistry();
-
-    // TODO resize m_keyToSequence with number of IDs from string registry
+    // The cache is invalidated by any change of the MLF and state list files.
+    string signature;
+    if (!cachePath.empty())
+    {
+        for (const auto& path : mlfPaths)
+            signature += GetFileStamp(path);
+        if (!stateListPath.empty())
+            signature += GetFileStamp(stateListPath);
+    }
 
-    for (const auto& l : labels)
+    if (!cachePath.empty() && LoadLabelCache(corpus, cachePath, signature, dimension, numClasses))
     {
-        // Currently the string registry contains only utterances described in scp.
-        // So here we skip all others.
-        size_t id = 0;
-        if (!stringRegistry.TryGet(msra::strfun::utf8(l.first), id))
-            continue;
+        fprintf(stderr, "MLFDataDeserializer::MLFDataDeserializer: read labels from cache '%ls'\n", cachePath.c_str());
+    }
+    else
+    {
+        // TODO: Similarly to the old reader, currently we assume all Mlfs will have same root name (key)
+        // restrict MLF reader to these files--will make stuff much faster without having to use shortened input files
 
-        description.m_key.m_sequence = id;
+        // TODO: currently we do not use symbol and word tables.
+        const msra::lm::CSymbolSet* wordTable = nullptr;
+        unordered_map<const char*, int>* symbolTable = nullptr;
 
-        const auto& utterance = l.second;
-        description.m_sequenceStart = m_classIds.size();
-        uint32_t numberOfFrames = 0;
+        // TODO: Currently we still use the old IO module. This will be refactored later.
+        const double htkTimeToFrame = 100000.0; // default is 10ms
+        msra::asr::htkmlfreader<msra::asr::htkmlfentry, msra::lattices::lattice::htkmlfwordsequence> labels(mlfPaths, set<wstring>(), stateListPath, wordTable, symbolTable, htkTimeToFrame);
 
-        foreach_index(i, utterance)
-        {
-            const auto& timespan = utterance[i];
-            if ((i == 0 && timespan.firstframe != 0) ||
-                (i > 0 && utterance[i - 1].firstframe + utterance[i - 1].numframes != timespan.firstframe))
-            {
-                RuntimeError("Labels are not in the consecutive order MLF in label set: %ls", l.first.c_str());
-            }
+        // Make sure 'msra::asr::htkmlfreader' type has a move constructor
+        static_assert(
+            is_move_constructible<
+            msra::asr::htkmlfreader<msra::asr::htkmlfentry,
+            msra::lattices::lattice::htkmlfwordsequence >> ::value,
+            "Type 'msra::asr::htkmlfreader' should be move constructible!");
 
-            if (timespan.classid >= dimension)
-            {
-                RuntimeError("Class id %d exceeds the model output dimension %d.", (int)timespan.classid, (int)dimension);
-            }
+        const auto& stringRegistry = corpus->GetStringRegistry();
 
-            if (timespan.classid != static_cast<msra::dbn::CLASSIDTYPE>(timespan.classid))
-            {
-                RuntimeError("CLASSIDTYPE has too few bits");
-            }
+        // TODO resize m_keyToSequence with number of IDs from string registry
 
-            if (SEQUENCELEN_MAX < timespan.firstframe + timespan.numframes)
-            {
-                RuntimeError("Maximum number of sample per sequence exceeded.");
-            }
+        for (const auto& l : labels)
+        {
+            // Currently the string registry contains only utterances described in scp.
+            // So here we skip all others.
+            size_t id = 0;
+            if (!stringRegistry.TryGet(msra::strfun::utf8(l.first), id))
+                continue;
 
-            numClasses = max(numClasses, (size_t)(1u + timespan.classid));
+            const auto& utterance = l.second;
+            size_t sequenceStart = m_classIds.size();
+            uint32_t numberOfFrames = 0;
 
-            for (size_t t = timespan.firstframe; t < timespan.firstframe + timespan.numframes; t++)
+            foreach_index(i, utterance)
             {
-                m_classIds.push_back(timespan.classid);
-                numberOfFrames++;
+                const auto& timespan = utterance[i];
+                if ((i == 0 && timespan.firstframe != 0) ||
+                    (i > 0 && utterance[i - 1].firstframe + utterance[i - 1].numframes != timespan.firstframe))
+                {
+                    RuntimeError("Labels are not in the consecutive order MLF in label set: %ls", l.first.c_str());
+                }
+
+                if (timespan.classid >= dimension)
+                {
+                    RuntimeError("Class id %d exceeds the model output dimension %d.", (int)timespan.classid, (int)dimension);
+                }
+
+                if (timespan.classid != static_cast<msra::dbn::CLASSIDTYPE>(timespan.classid))
+                {
+                    RuntimeError("CLASSIDTYPE has too few bits");
+                }
+
+                if (SEQUENCELEN_MAX < timespan.firstframe + timespan.numframes)
+                {
+                    RuntimeError("Maximum number of sample per sequence exceeded.");
+                }
+
+                numClasses = max(numClasses, (size_t)(1u + timespan.classid));
+
+                for (size_t t = timespan.firstframe; t < timespan.firstframe + timespan.numframes; t++)
+                {
+                    m_classIds.push_back(timespan.classid);
+                    numberOfFrames++;
+                }
             }
-        }
 
-        description.m_numberOfSamples = numberOfFrames;
-        m_utteranceIndex.push_back(totalFrames);
-        totalFrames += numberOfFrames;
+            AddUtterance(id, sequenceStart, numberOfFrames);
+        }
 
-        if (m_keyToSequence.size() <= description.m_key.m_sequence)
+        if (!cachePath.empty())
         {
-            m_keyToSequence.resize(description.m_key.m_sequence + 1, SIZE_MAX);
+            WriteLabelCache(labels, cachePath, signature);
         }
-        assert(m_keyToSequence[description.m_key.m_sequence] == SIZE_MAX);
-        m_keyToSequence[description.m_key.m_sequence] = m_utteranceIndex.size() - 1;
-        m_numberOfSequences++;
     }
-    m_utteranceIndex.push_back(totalFrames);
-
-    m_totalNumberOfFrames = totalFrames;
 
     fprintf(stderr, "MLFDataDeserializer::MLFDataDeserializer: %" PRIu64 " utterances with %" PRIu64 " frames in %" PRIu64 " classes\n",
             m_numberOfSequences,
@@ -198,6 +253,16 @@ void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus
 
     // Initializing array of labels.
     m_categories.reserve(dimension);
+    if (m_classIndexLabels)
+    {
+        for (size_t i = 0; i < dimension; ++i)
+        {
+            m_categories.push_back(CreateClassIndexSequence(1));
+            SetClassIndex(m_categories.back(), 0, i);
+        }
+        return;
+    }
+
     m_categoryIndices.reserve(dimension);
     for (size_t i = 0; i < dimension; ++i)
     {
@@ -221,14 +286,195 @@ void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus
     }
 }
 
+void MLFDataDeserializer::AddUtterance(size_t id, size_t classIdsStart, uint32_t numberOfFrames)
+{
+    m_utteranceIndex.push_back(classIdsStart);
+    m_utteranceLength.push_back(numberOfFrames);
+    m_totalNumberOfFrames += numberOfFrames;
+
+    if (m_keyToSequence.size() <= id)
+    {
+        m_keyToSequence.resize(id + 1, SIZE_MAX);
+    }
+    assert(m_keyToSequence[id] == SIZE_MAX);
+    m_keyToSequence[id] = m_utteranceIndex.size() - 1;
+    m_numberOfSequences++;
+}
+
+bool MLFDataDeserializer::LoadLabelCache(CorpusDescriptorPtr corpus, const wstring& path, const string& signature, size_t dimension, size_t& numClasses)
+{
+    if (!fexists(path))
+    {
+        return false;
+    }
+
+    auto cache = make_shared<MappedFile>(path);
+    const char* data = cache->Data();
+    const auto* header = reinterpret_cast<const MLFCacheHeader*>(data);
+    if (cache->Size() < sizeof(MLFCacheHeader) ||
+        memcmp(header->m_magic, s_labelCacheMagic, sizeof(s_labelCacheMagic)) != 0 ||
+        header->m_version != s_labelCacheVersion ||
+        header->m_classIdSize != sizeof(msra::dbn::CLASSIDTYPE))
+    {
+        fprintf(stderr, "WARNING: '%ls' is not a label cache of this version, rebuilding it.\n", path.c_str());
+        return false;
+    }
+
+    const size_t signatureOffset = sizeof(MLFCacheHeader);
+    const size_t utterancesOffset = signatureOffset + PadTo8(header->m_signatureSize);
+    const size_t keysOffset = utterancesOffset + header->m_numberOfUtterances * sizeof(MLFCacheUtterance);
+    const size_t classIdsOffset = keysOffset + PadTo8(header->m_keysSize);
+    if (classIdsOffset + header->m_numberOfFrames * sizeof(msra::dbn::CLASSIDTYPE) != cache->Size())
+    {
+        fprintf(stderr, "WARNING: label cache '%ls' is truncated, rebuilding it.\n", path.c_str());
+        return false;
+    }
+
+    if (string(data + signatureOffset, header->m_signatureSize) != signature)
+    {
+        fprintf(stderr, "MLFDataDeserializer::MLFDataDeserializer: label cache '%ls' is out of date, rebuilding it\n", path.c_str());
+        return false;
+    }
+
+    const auto* utterances = reinterpret_cast<const MLFCacheUtterance*>(data + utterancesOffset);
+    size_t totalFrames = 0;
+    for (size_t i = 0; i < header->m_numberOfUtterances; ++i)
+    {
+        if (utterances[i].m_keyOffset + utterances[i].m_keyLength > header->m_keysSize)
+        {
+            fprintf(stderr, "WARNING: label cache '%ls' is corrupt, rebuilding it.\n", path.c_str());
+            return false;
+        }
+        totalFrames += utterances[i].m_numberOfFrames;
+    }
+
+    if (totalFrames != header->m_numberOfFrames)
+    {
+        fprintf(stderr, "WARNING: label cache '%ls' is corrupt, rebuilding it.\n", path.c_str());
+        return false;
+    }
+
+    // Unlike parsing, which only checks the utterances of the corpus, this checks the labels of all utterances in the cache.
+    if (header->m_numberOfClasses > dimension)
+    {
+        RuntimeError("Class id %d exceeds the model output dimension %d.", (int)header->m_numberOfClasses - 1, (int)dimension);
+    }
+
+    // Currently the string registry contains only utterances described in scp.
+    // So here we skip all others, their labels just stay unused in the cache.
+    const auto& stringRegistry = corpus->GetStringRegistry();
+    const char* keys = data + keysOffset;
+    size_t classIdsStart = 0;
+    for (size_t i = 0; i < header->m_numberOfUtterances; ++i)
+    {
+        size_t id = 0;
+        if (stringRegistry.TryGet(string(keys + utterances[i].m_keyOffset, utterances[i].m_keyLength), id))
+        {
+            AddUtterance(id, classIdsStart, utterances[i].m_numberOfFrames);
+        }
+        classIdsStart += utterances[i].m_numberOfFrames;
+    }
+
+    numClasses = header->m_numberOfClasses;
+    m_cachedClassIds = reinterpret_cast<const msra::dbn::CLASSIDTYPE*>(data + classIdsOffset);
+    m_labelCache = cache;
+    return true;
+}
+
+void MLFDataDeserializer::WriteLabelCache(const map<wstring, vector<msra::asr::htkmlfentry>>& labels, const wstring& path, const string& signature)
+{
+    MLFCacheHeader header;
+    memcpy(header.m_magic, s_labelCacheMagic, sizeof(s_labelCacheMagic));
+    header.m_version = s_labelCacheVersion;
+    header.m_classIdSize = sizeof(msra::dbn::CLASSIDTYPE);
+    header.m_signatureSize = signature.size();
+    header.m_numberOfUtterances = labels.size();
+    header.m_numberOfFrames = 0;
+    header.m_numberOfClasses = 0;
+
+    vector<MLFCacheUtterance> utterances;
+    utterances.reserve(labels.size());
+    string keys;
+    for (const auto& l : labels)
+    {
+        const auto& utterance = l.second;
+        MLFCacheUtterance u;
+        string key = msra::strfun::utf8(l.first);
+        u.m_keyOffset = keys.size();
+        u.m_keyLength = (uint32_t)key.size();
+        keys += key;
+
+        // Labels of all utterances are cached, also of the ones the corpus does not use; they have to be consecutive as well.
+        size_t numberOfFrames = 0;
+        foreach_index(i, utterance)
+        {
+            if (utterance[i].firstframe != numberOfFrames)
+            {
+                fprintf(stderr, "WARNING: labels are not in the consecutive order MLF in label set: %ls, not writing the label cache.\n", l.first.c_str());
+                return;
+            }
+            numberOfFrames += utterance[i].numframes;
+            header.m_numberOfClasses = max(header.m_numberOfClasses, (uint64_t)utterance[i].classid + 1);
+        }
+        if (SEQUENCELEN_MAX < numberOfFrames)
+        {
+            fprintf(stderr, "WARNING: label set %ls exceeds the maximum number of samples per sequence, not writing the label cache.\n", l.first.c_str());
+            return;
+        }
+        u.m_numberOfFrames = (uint32_t)numberOfFrames;
+        header.m_numberOfFrames += numberOfFrames;
+        utterances.push_back(u);
+    }
+    header.m_keysSize = keys.size();
+
+    // Several processes may build the cache at the same time, each writes its own temporary file.
+    wstring tmpPath = path + msra::strfun::wstrprintf(L".%d.tmp", (int)GetCurrentProcessId());
+    try
+    {
+        const char padding[8] = {};
+        vector<msra::dbn::CLASSIDTYPE> classIds;
+        {
+            auto_file_ptr f(fopenOrDie(tmpPath, L"wb"));
+            fwriteOrDie(&header, sizeof(header), 1, f);
+            fwriteOrDie(signature.data(), 1, signature.size(), f);
+            fwriteOrDie(padding, 1, PadTo8(signature.size()) - signature.size(), f);
+            fwriteOrDie(utterances.data(), sizeof(MLFCacheUtterance), utterances.size(), f);
+            fwriteOrDie(keys.data(), 1, keys.size(), f);
+            fwriteOrDie(padding, 1, PadTo8(keys.size()) - keys.size(), f);
+            for (const auto& l : labels)
+            {
+                classIds.clear();
+                for (const auto& timespan : l.second)
+                    classIds.insert(classIds.end(), timespan.numframes, timespan.classid);
+                fwriteOrDie(classIds.data(), sizeof(msra::dbn::CLASSIDTYPE), classIds.size(), f);
+            }
+            fflushOrDie(f);
+        }
+        if (fexists(path))
+        {
+            unlinkOrDie(path);
+        }
+        renameOrDie(tmpPath, path);
+        fprintf(stderr, "MLFDataDeserializer::MLFDataDeserializer: wrote label cache '%ls'\n", path.c_str());
+    }
+    catch (const exception& e)
+    {
+        fprintf(stderr, "WARNING: could not write the label cache '%ls': %s\n", path.c_str(), e.what());
+        if (fexists(tmpPath))
+        {
+            unlinkOrDie(tmpPath);
+        }
+    }
+}
+
 void MLFDataDeserializer::InitializeStream(const wstring& name, size_t dimension)
 {
     // Initializing stream description - a single stream of MLF data.
     StreamDescriptionPtr stream = make_shared<StreamDescription>();
     stream->m_id = 0;
     stream->m_name = name;
-    stream->m_sampleLayout = make_shared<TensorShape>(dimension);
-    stream->m_storageType = StorageType::sparse_csc;
+    stream->m_sampleLayout = m_classIndexLabels ? m_classIndexLayout : make_shared<TensorShape>(dimension);
+    stream->m_storageType = m_classIndexLabels ? StorageType::dense : StorageType::sparse_csc;
     stream->m_elementType = m_elementType;
     m_streams.push_back(stream);
 }
@@ -287,19 +533,68 @@ struct MLFSequenceData : SparseSequenceData
     }
 };
 
+// Class-index labels for an utterance, one value per frame.
+template <class ElemType>
+struct MLFClassIndexSequenceData : DenseSequenceData
+{
+    vector<ElemType> m_values;
+
+    MLFClassIndexSequenceData(size_t numberOfSamples, const TensorShapePtr& sampleLayout) :
+        m_values(numberOfSamples)
+    {
+        m_numberOfSamples = (uint32_t) numberOfSamples;
+        m_sampleLayout = sampleLayout;
+        m_data = m_values.data();
+    }
+};
+
+SequenceDataPtr MLFDataDeserializer::CreateClassIndexSequence(size_t numberOfSamples) const
+{
+    if (m_elementType == ElementType::tfloat)
+    {
+        return make_shared<MLFClassIndexSequenceData<float>>(numberOfSamples, m_classIndexLayout);
+    }
+
+    assert(m_elementType == ElementType::tdouble);
+    return make_shared<MLFClassIndexSequenceData<double>>(numberOfSamples, m_classIndexLayout);
+}
+
+void MLFDataDeserializer::SetClassIndex(const SequenceDataPtr& sequence, size_t sample, size_t label) const
+{
+    if (m_elementType == ElementType::tfloat)
+    {
+        static_cast<float*>(sequence->m_data)[sample] = static_cast<float>(label);
+    }
+    else
+    {
+        static_cast<double*>(sequence->m_data)[sample] = static_cast<double>(label);
+    }
+}
+
 void MLFDataDeserializer::GetSequenceById(size_t sequenceId, vector<SequenceDataPtr>& result)
 {
     if (m_frameMode)
     {
-        size_t label = m_classIds[sequenceId];
+        size_t label = GetClassId(sequenceId);
         assert(label < m_categories.size());
         result.push_back(m_categories[label]);
     }
+    else if (m_classIndexLabels)
+    {
+        size_t startFrameIndex = m_utteranceIndex[sequenceId];
+        size_t numberOfSamples = m_utteranceLength[sequenceId];
+        SequenceDataPtr s = CreateClassIndexSequence(numberOfSamples);
+        for (size_t i = 0; i < numberOfSamples; i++)
+        {
+            SetClassIndex(s, i, GetClassId(startFrameIndex + i));
+        }
+        result.push_back(s);
+    }
     else
     {
         // Packing labels for the utterance into sparse sequence.
         size_t startFrameIndex = m_utteranceIndex[sequenceId];
-        size_t numberOfSamples = m_utteranceIndex[sequenceId + 1] - startFrameIndex;
+        size_t numberOfSamples = m_utteranceLength[sequenceId];
         SparseSequenceDataPtr s;
         if (m_elementType == ElementType::tfloat)
         {
@@ -314,7 +609,7 @@ void MLFDataDeserializer::GetSequenceById(size_t sequenceId, vector<SequenceData
         for (size_t i = 0; i < numberOfSamples; i++)
         {
             size_t frameIndex = startFrameIndex + i;
-            size_t label = m_classIds[frameIndex];
+            size_t label = GetClassId(frameIndex);
             s->m_indices[i] = static_cast<IndexType>(label);
         }
         result.push_back(s);
@@ -344,7 +639,7 @@ bool MLFDataDeserializer::GetSequenceDescriptionByKey(const KeyType& key, Sequen
     {
         assert(result.m_key.m_sample == 0);
         result.m_id = sequenceId;
-        result.m_numberOfSamples = (uint32_t) (m_utteranceIndex[sequenceId + 1] - m_utteranceIndex[sequenceId]);
+        result.m_numberOfSamples = m_utteranceLength[sequenceId];
     }
     return true;
 }
@@ -9,6 +9,7 @@
 #include "HTKDataDeserializer.h"
 #include "../HTKMLFReader/biggrowablevectors.h"
 #include "CorpusDescriptor.h"
+#include "MappedFile.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -41,9 +42,26 @@ private:
     class MLFChunk;
     DISABLE_COPY_AND_MOVE(MLFDataDeserializer);
 
-    void InitializeChunkDescriptions(CorpusDescriptorPtr corpus, const ConfigHelper& config, const std::wstring& stateListPath, size_t dimension);
+    void InitializeChunkDescriptions(CorpusDescriptorPtr corpus, const ConfigHelper& config, const std::wstring& stateListPath, size_t dimension, const std::wstring& cachePath);
     void InitializeStream(const std::wstring& name, size_t dimension);
 
+    // Dense sequence of class-index labels, see m_classIndexLabels.
+    SequenceDataPtr CreateClassIndexSequence(size_t numberOfSamples) const;
+    void SetClassIndex(const SequenceDataPtr& sequence, size_t sample, size_t label) const;
+
+    // Registers an utterance of the corpus, whose labels start at classIdsStart.
+    void AddUtterance(size_t id, size_t classIdsStart, uint32_t numberOfFrames);
+
+    // Binary cache of the parsed MLF files (see 'labelCacheFile').
+    // Loading fails if the cache does not exist or was built from other versions of the MLF and state list files.
+    bool LoadLabelCache(CorpusDescriptorPtr corpus, const std::wstring& path, const std::string& signature, size_t dimension, size_t& numClasses);
+    static void WriteLabelCache(const std::map<std::wstring, std::vector<msra::asr::htkmlfentry>>& labels, const std::wstring& path, const std::string& signature);
+
+    msra::dbn::CLASSIDTYPE GetClassId(size_t frameIndex) const
+    {
+        return m_cachedClassIds ? m_cachedClassIds[frameIndex] : m_classIds[frameIndex];
+    }
+
     void GetSequenceById(size_t sequenceId, std::vector<SequenceDataPtr>& result);
 
     // Vector that maps KeyType.m_sequence into an utterance ID (or SIZE_MAX if the key is not assigned).
@@ -57,18 +75,24 @@ private:
     // Array of all labels.
     msra::dbn::biggrowablevector<msra::dbn::CLASSIDTYPE> m_classIds;
 
-    // Index of utterances in the m_classIds.
+    // Index of utterances in the m_classIds (or m_cachedClassIds), and their number of frames.
     msra::dbn::biggrowablevector<size_t> m_utteranceIndex;
+    msra::dbn::biggrowablevector<uint32_t> m_utteranceLength;
+
+    // If the labels were loaded from the cache, all labels of the MLFs, in the memory-mapped cache file.
+    MappedFilePtr m_labelCache;
+    const msra::dbn::CLASSIDTYPE* m_cachedClassIds = nullptr;
 
     // Type of the data this serializer provides.
     ElementType m_elementType;
 
     // Total number of frames.
-    size_t m_totalNumberOfFrames;
+    size_t m_totalNumberOfFrames = 0;
 
     // Array of available categories.
     // We do no allocate data for all input sequences, only returning a pointer to existing category.
-    std::vector<SparseSequenceDataPtr> m_categories;
+    // These are one-hot sparse samples, or dense scalar samples with the class index (see m_classIndexLabels).
+    std::vector<SequenceDataPtr> m_categories;
 
     // A list of category indices
     // (a list of numbers from 0 to N, where N = (number of categories -1))
@@ -76,6 +100,10 @@ private:
 
     // Flag that indicates whether a single speech frames should be exposed as a sequence.
     bool m_frameMode;
+
+    // Labels are exposed as a dense stream of dimension 1 holding the class index of each frame ('labelFormat="classIndex"').
+    bool m_classIndexLabels = false;
+    TensorShapePtr m_classIndexLayout;
 };
 
 }}}
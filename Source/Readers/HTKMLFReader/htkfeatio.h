@@ -331,6 +331,7 @@ class htkfeatreader : protected htkfeatio
     vector<float> a, b;                  // for decompression
     vector<short> tmp;                   // for decompression
     vector<unsigned char> tmpByteVector; // for decompression of idx files
+    vector<float> tmpframes;             // for reading frame ranges at once (readrange())
     size_t curframe;                     // current # samples read so far
     size_t numframes;                    // number of samples for current logical file
     size_t energyElements;               // how many energy elements to add if addEnergy is true
@@ -450,6 +451,19 @@ public:
             return logicalpath.substr(0, logicalpath.find_last_of("."));
         }
 
+        // Checks whether this is a frame range of an archive.
+        bool IsArchive() const
+        {
+            return isarchive;
+        }
+
+        // Checks whether the frames of this range directly follow the ones of 'previous' in the same archive,
+        // so that both can be read at once.
+        bool Follows(const parsedpath& previous) const
+        {
+            return isarchive && previous.isarchive && archivePathIdx == previous.archivePathIdx && s == previous.e + 1;
+        }
+
         // Clears logical path after parsing, in order not to duplicate it 
         // with the one stored in the corpus descriptor.
         void ClearLogicalPath()
@@ -758,6 +772,44 @@ public:
             throw;
         }
     }
+    // read 'numframes' consecutive frames of an archive, starting with the first frame of 'ppath', into the columns [ts, ts + numframes) of feat
+    // This is used to read adjacent utterances of an archive at once. Uncompressed float features are read with a single fread().
+    template <class MATRIX>
+    void readrange(const parsedpath& ppath, size_t numframes, const string& kindstr, const unsigned int period, MATRIX& feat, size_t ts)
+    {
+        open(ppath);
+        if (!ppath.isarchive)
+            LogicError("readrange: '%ls' is not an archive", ((wstring)ppath).c_str());
+        if (ppath.s + numframes > physicalframes)
+            RuntimeError("readrange: end frame exceeds archive's total number of frames %d in '%ls'", (int)physicalframes, ((wstring)ppath).c_str());
+        if (ts + numframes > feat.cols() || feat.rows() != featdim + energyElements)
+            LogicError("readrange: range read called with wrong dimensions");
+        if (kindstr != featkind || period != featperiod)
+            LogicError("readrange: attempting to mixing different feature kinds");
+
+        this->numframes = numframes;
+        try
+        {
+            if (compressed || isidxformat || addEnergy)
+            {
+                read(feat, ts, ts + numframes);
+                return;
+            }
+
+            tmpframes.resize(featdim * numframes);
+            freadOrDie(tmpframes, tmpframes.size(), f);
+            if (needbyteswapping)
+                msra::util::byteswap(tmpframes);
+            for (size_t t = 0; t < numframes; t++)
+                memcpy(&feat(0, ts + t), &tmpframes[t * featdim], featdim * sizeof(float));
+            curframe = numframes;
+        }
+        catch (...)
+        {
+            close();
+            throw;
+        }
+    }
     // read an entire utterance into a virgen, allocatable matrix
     // Matrix type needs to have operator(i,j) and resize(n,m)
     template <class MATRIX>
@@ -6,11 +6,12 @@
 #pragma once
 #include <opencv2/core/mat.hpp>
 #include "Config.h"
+#include "ConcStack.h"
 #ifdef USE_ZIP
 #include <zip.h>
 #include <unordered_map>
 #include <memory>
-#include "ConcStack.h"
+#include "MappedFile.h"
 #endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -22,35 +23,65 @@ public:
     virtual ~ByteReader() = default;
 
     virtual void Register(size_t seqId, const std::string& path) = 0;
-    virtual cv::Mat Read(size_t seqId, const std::string& path, bool grayscale) = 0;
+
+    // Reads and decodes an image. If minSize is not 0, a JPEG image may be decoded at a reduced size
+    // whose shorter side still has at least minSize pixels (see Decode()).
+    virtual cv::Mat Read(size_t seqId, const std::string& path, bool grayscale, size_t minSize) = 0;
 
     DISABLE_COPY_AND_MOVE(ByteReader);
+
+    // Decodes an encoded image. A JPEG image whose shorter side has at least twice minSize pixels is scaled
+    // by 1/2, 1/4 or 1/8 by the DCT of libjpeg while it is decoded, which is a fraction of the work of decoding
+    // it at full size and scaling it down afterwards.
+    static cv::Mat Decode(const unsigned char* data, size_t size, bool grayscale, size_t minSize);
 };
 
 class FileByteReader : public ByteReader
 {
 public:
     void Register(size_t, const std::string&) override {}
-    cv::Mat Read(size_t seqId, const std::string& path, bool grayscale) override;
+    cv::Mat Read(size_t seqId, const std::string& path, bool grayscale, size_t minSize) override;
+
+private:
+    // buffers for the file contents, reused across images
+    conc_pool<std::vector<unsigned char>> m_workspace;
 };
 
 #ifdef USE_ZIP
+// Reads images from a zip file. The archive is memory-mapped and its central directory parsed once, so that images
+// stored without compression (the usual case, as images are compressed already) are decoded right from the mapping,
+// without copies or locks. Compressed entries are read through a pool of libzip handles.
 class ZipByteReader : public ByteReader
 {
 public:
     ZipByteReader(const std::string& zipPath);
 
     void Register(size_t seqId, const std::string& path) override;
-    cv::Mat Read(size_t seqId, const std::string& path, bool grayscale) override;
+    cv::Mat Read(size_t seqId, const std::string& path, bool grayscale, size_t minSize) override;
 
 private:
     using ZipPtr = std::unique_ptr<zip_t, void(*)(zip_t*)>;
     ZipPtr OpenZip();
 
+    struct ZipEntry
+    {
+        zip_uint64_t m_index; // in the central directory, as used by libzip
+        zip_uint64_t m_size; // uncompressed
+        size_t m_dataOffset; // in the file, if the entry is stored uncompressed; SIZE_MAX otherwise
+    };
+
+    // Fills m_localHeaderOffsets from the central directory of the mapped file; false if it does not hold the
+    // expected number of entries or cannot be parsed.
+    bool ReadCentralDirectory(zip_uint64_t expectedNumEntries);
+    // Offset of the data of an entry in the file, from its local header; SIZE_MAX if the header does not match.
+    size_t GetDataOffset(zip_uint64_t index, zip_uint64_t size, const std::string& path) const;
+
     std::string m_zipPath;
-    conc_stack<ZipPtr> m_zips;
-    std::unordered_map<size_t, std::pair<zip_uint64_t, zip_uint64_t>> m_seqIdToIndex;
-    conc_stack<std::vector<unsigned char>> m_workspace;
+    MappedFilePtr m_file;
+    std::vector<size_t> m_localHeaderOffsets; // [index] offset of the local header of an entry in the file
+    conc_pool<ZipPtr> m_zips;
+    std::unordered_map<size_t, ZipEntry> m_seqIdToEntry; // not changed after Register(), so that Read() needs no locks
+    conc_pool<std::vector<unsigned char>> m_workspace;
 };
 #endif
 
@@ -10,18 +10,15 @@
 #include "DataReader.h"
 #include "ReaderShim.h"
 #include "ImageReader.h"
-#include "HeapMemoryProvider.h"
 #include "ImageDataDeserializer.h"
 #include "ImageTransformers.h"
 #include "CorpusDescriptor.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-// TODO: Memory provider should be injected by SGD.
-
-auto factory = [](const ConfigParameters& parameters) -> ReaderPtr
+auto factory = [](const ConfigParameters& parameters, MemoryProviderPtr memoryProvider) -> ReaderPtr
 {
-    return std::make_shared<ImageReader>(std::make_shared<HeapMemoryProvider>(), parameters);
+    return std::make_shared<ImageReader>(memoryProvider, parameters);
 };
 
 extern "C" DATAREADER_API void GetReaderF(IDataReader** preader)
@@ -4,6 +4,8 @@
 //
 
 #include "stdafx.h"
+#include <algorithm>
+#include <cmath>
 #include "ImageConfigHelper.h"
 #include "StringUtil.h"
 #include "ConfigUtil.h"
@@ -11,7 +13,7 @@
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 ImageConfigHelper::ImageConfigHelper(const ConfigParameters& config)
-    : m_dataFormat(CHW)
+    : m_dataFormat(CHW), m_minDecodedSize(0)
 {
     std::vector<std::string> featureNames = GetSectionsWithParameter("ImageReader", config, "width");
     std::vector<std::string> labelNames = GetSectionsWithParameter("ImageReader", config, "labelDim");
@@ -92,9 +94,35 @@ ImageConfigHelper::ImageConfigHelper(const ConfigParameters& config)
         RuntimeError("Not supported precision '%s'. Expected 'double' or 'float'.", precision.c_str());
     }
 
+    // With storagePrecision = "uint8" the pixels are shipped as they are decoded, and converted on the device, see ElementType::tuint8.
+    std::string storagePrecision = featureSection("storagePrecision", "");
+    if (AreEqualIgnoreCase(storagePrecision, "uint8"))
+    {
+        features->m_elementType = ElementType::tuint8;
+    }
+    else if (!storagePrecision.empty())
+    {
+        RuntimeError("Not supported storage precision '%s'. Expected 'uint8'.", storagePrecision.c_str());
+    }
+
     m_cpuThreadCount = config(L"numCPUThreads", 0);
 
     m_cropType = ParseCropType(featureSection(L"cropType", ""));
+
+    m_convertAfterScale = featureSection(L"convertAfterScale", false);
+
+    // The crop of the shorter side by the smallest ratio must still cover the scaled image.
+    // The aspect ratio jitter of the crop is not accounted for, it may get scaled up slightly.
+    if (featureSection(L"reducedSizeDecoding", false))
+    {
+        floatargvector cropRatio = featureSection(L"cropRatio", "1.0");
+        double minCropRatio = std::min(cropRatio[0], cropRatio[1]);
+        if (minCropRatio <= 0)
+        {
+            RuntimeError("Invalid cropRatio value, must be > 0 and <= 1.");
+        }
+        m_minDecodedSize = (size_t)std::ceil(std::max(w, h) / minCropRatio);
+    }
 }
 
 std::vector<StreamDescriptionPtr> ImageConfigHelper::GetStreams() const
@@ -68,6 +68,20 @@ public:
         return m_cropType == CropType::MultiView10;
     }
 
+    // Minimum size of the shorter side of a decoded image that the crop and scale of the feature stream
+    // need, if reducedSizeDecoding is enabled; 0 otherwise.
+    size_t GetMinDecodedSize() const
+    {
+        return m_minDecodedSize;
+    }
+
+    // Whether the images are cropped and scaled as decoded (8 bit per channel) and converted to the element type
+    // only at their scaled size, which is less work than converting them at full size and scaling them as float.
+    bool ShouldConvertAfterScale() const
+    {
+        return m_convertAfterScale;
+    }
+
     static CropType ParseCropType(const std::string &src);
 
 private:
@@ -81,6 +95,8 @@ private:
     bool m_randomize;
     bool m_grayscale;
     CropType m_cropType;
+    size_t m_minDecodedSize;
+    bool m_convertAfterScale;
 };
 
 typedef std::shared_ptr<ImageConfigHelper> ImageConfigHelperPtr;
@@ -8,9 +8,15 @@
 #include <inttypes.h>
 #include <opencv2/opencv.hpp>
 #include <numeric>
+#include <algorithm>
+#include <cstdio>
+#include <string.h>
 #include <limits>
 #include "ImageDataDeserializer.h"
 #include "ImageConfigHelper.h"
+#include "ImageTransformers.h"
+#include "ImagePackFormat.h"
+#include "fileutil.h"
 #include "StringUtil.h"
 #include "ConfigUtil.h"
 
@@ -56,10 +62,32 @@ private:
     vector<IndexType> m_indices;
 };
 
-// Used to keep track of the image. Accessed only using DenseSequenceData interface.
-struct DeserializedImage : DenseSequenceData
+// Used to keep track of the image. Accessed only using DenseSequenceData interface
+// and by the image transformers.
+struct DeserializedImage : ImageSequenceData
 {
-    cv::Mat m_image;
+    // buffers larger than this (that of a 1448x1448 RGB float image) are not returned to the pool,
+    // so that a few large images do not make all pooled buffers grow to their size
+    static const size_t MaxPooledBufferSize = 24 * 1024 * 1024;
+
+    explicit DeserializedImage(conc_pool<std::vector<unsigned char>>& bufferPool)
+        : m_buffer(bufferPool.pop_or_create([]() { return std::vector<unsigned char>(); })), m_bufferPool(bufferPool)
+    {
+    }
+
+    ~DeserializedImage()
+    {
+        if (m_buffer.capacity() <= MaxPooledBufferSize)
+        {
+            m_bufferPool.push(std::move(m_buffer));
+        }
+    }
+
+    // the data of m_image, unless the decoded image could be used as is
+    std::vector<unsigned char> m_buffer;
+
+private:
+    conc_pool<std::vector<unsigned char>>& m_bufferPool;
 };
 
 // For image, chunks correspond to a single image.
@@ -79,44 +107,84 @@ public:
         assert(sequenceId == m_description.m_id);
         const auto& imageSequence = m_description;
 
-        auto image = std::make_shared<DeserializedImage>();
-        image->m_image = std::move(m_parent.ReadImage(m_description.m_id, imageSequence.m_path, m_parent.m_grayscale));
-        auto& cvImage = image->m_image;
-
-        if (!cvImage.data)
+        cv::Mat decoded = m_parent.ReadImage(m_description.m_id, imageSequence.m_path, m_parent.m_grayscale);
+        if (!decoded.data)
         {
             RuntimeError("Cannot open file '%s'", imageSequence.m_path.c_str());
         }
 
-        // Convert element type.
-        int dataType = m_parent.m_featureElementType == ElementType::tfloat ? CV_32F : CV_64F;
-        if (cvImage.type() != CV_MAKETYPE(dataType, cvImage.channels()))
-        {
-            cvImage.convertTo(cvImage, dataType);
-        }
+        m_parent.CreateSequences(decoded, imageSequence, shared_from_this(), result);
+    }
+};
+
+// A chunk of a pack, read into memory as a whole; its images are decoded on request.
+class ImageDataDeserializer::ImagePackChunk : public Chunk, public std::enable_shared_from_this<ImagePackChunk>
+{
+    ImageDataDeserializer& m_parent;
+    const PackChunkInfo& m_info;
+    std::vector<unsigned char> m_data;
 
-        if (!cvImage.isContinuous())
+public:
+    ImagePackChunk(const PackChunkInfo& info, ImageDataDeserializer& parent)
+        : m_parent(parent), m_info(info)
+    {
+        m_data.resize((size_t)m_info.m_byteSize);
+        m_parent.m_packs[m_info.m_pack]->Read(m_info.m_offset, m_data.size(), reinterpret_cast<char*>(m_data.data()));
+    }
+
+    virtual void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        assert(m_info.m_firstSequence <= sequenceId && sequenceId < m_info.m_firstSequence + m_info.m_numSequences);
+        const auto& imageSequence = m_parent.m_imageSequences[sequenceId];
+
+        cv::Mat decoded = ByteReader::Decode(m_data.data() + imageSequence.m_dataOffset, imageSequence.m_dataSize,
+                                             m_parent.m_grayscale, m_parent.m_minDecodedSize);
+        if (!decoded.data)
         {
-            cvImage = cvImage.clone();
+            RuntimeError("Cannot decode image '%s'", imageSequence.m_path.c_str());
         }
-        assert(cvImage.isContinuous());
-
-        image->m_data = image->m_image.data;
-        ImageDimensions dimensions(cvImage.cols, cvImage.rows, cvImage.channels());
-        image->m_sampleLayout = std::make_shared<TensorShape>(dimensions.AsTensorShape(HWC));
-        image->m_id = sequenceId;
-        image->m_numberOfSamples = 1;
-        image->m_chunk = shared_from_this();
-        result.push_back(image);
-
-        SparseSequenceDataPtr label = std::make_shared<SparseSequenceData>();
-        label->m_chunk = shared_from_this();
-        m_parent.m_labelGenerator->CreateLabelFor(imageSequence.m_classId, *label);
-        label->m_numberOfSamples = 1;
-        result.push_back(label);
+
+        m_parent.CreateSequences(decoded, imageSequence, shared_from_this(), result);
     }
 };
 
+void ImageDataDeserializer::CreateSequences(const cv::Mat& decoded, const ImageSequenceDescription& description, const ChunkPtr& chunk, std::vector<SequenceDataPtr>& result)
+{
+    auto image = std::make_shared<DeserializedImage>(m_imageBuffers);
+    auto& cvImage = image->m_image;
+
+    // Convert element type, into a pooled buffer instead of a new allocation per image.
+    int dataType = m_featureElementType == ElementType::tuint8 ? CV_8U : m_featureElementType == ElementType::tfloat ? CV_32F : CV_64F;
+    int imageType = CV_MAKETYPE(dataType, decoded.channels());
+    if ((decoded.type() == imageType || m_convertAfterScale) && decoded.isContinuous())
+    {
+        cvImage = decoded;
+    }
+    else
+    {
+        image->m_buffer.resize(decoded.total() * CV_ELEM_SIZE(imageType));
+        cvImage = cv::Mat(decoded.rows, decoded.cols, imageType, image->m_buffer.data());
+        // writes into the buffer, as cvImage already has the size and type of the result
+        decoded.convertTo(cvImage, dataType);
+    }
+    assert(cvImage.isContinuous());
+    assert(cvImage.data == image->m_buffer.data() || cvImage.data == decoded.data);
+
+    image->m_data = image->m_image.data;
+    ImageDimensions dimensions(cvImage.cols, cvImage.rows, cvImage.channels());
+    image->m_sampleLayout = std::make_shared<TensorShape>(dimensions.AsTensorShape(HWC));
+    image->m_id = description.m_id;
+    image->m_numberOfSamples = 1;
+    image->m_chunk = chunk;
+    result.push_back(image);
+
+    SparseSequenceDataPtr label = std::make_shared<SparseSequenceData>();
+    label->m_chunk = chunk;
+    m_labelGenerator->CreateLabelFor(description.m_classId, *label);
+    label->m_numberOfSamples = 1;
+    result.push_back(label);
+}
+
 // A new constructor to support new compositional configuration,
 // that allows composition of deserializers and transforms on inputs.
 ImageDataDeserializer::ImageDataDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config)
@@ -143,6 +211,17 @@ ImageDataDeserializer::ImageDataDeserializer(CorpusDescriptorPtr corpus, const C
     features->m_name = msra::strfun::utf16(featureSection.ConfigName());
     features->m_storageType = StorageType::dense;
     features->m_elementType = AreEqualIgnoreCase(precision, "float") ? ElementType::tfloat : ElementType::tdouble;
+    // With storagePrecision = "uint8" the pixels are shipped as they are decoded, and converted on the device, see ElementType::tuint8.
+    string storagePrecision = featureSection("storagePrecision", "");
+    if (AreEqualIgnoreCase(storagePrecision, "uint8"))
+    {
+        features->m_elementType = ElementType::tuint8;
+    }
+    else if (!storagePrecision.empty())
+    {
+        RuntimeError("Not supported storage precision '%s'. Expected 'uint8'.", storagePrecision.c_str());
+    }
+    m_featureElementType = features->m_elementType;
     m_streams.push_back(features);
 
     // Label stream.
@@ -162,9 +241,14 @@ ImageDataDeserializer::ImageDataDeserializer(CorpusDescriptorPtr corpus, const C
 
     m_grayscale = config(L"grayscale", false);
 
+    // the shorter side of an image that the transforms of the feature stream need at least, 0 to decode images at full size
+    m_minDecodedSize = featureSection(L"minDecodedSize", (size_t)0);
+    m_convertAfterScale = false;
+
     // TODO: multiview should be done on the level of randomizer/transformers - it is responsiblity of the
     // TODO: randomizer to collect how many copies each transform needs and request same sequence several times.
     bool multiViewCrop = config(L"multiViewCrop", false);
+    m_cacheDirectory = config(L"cacheDirectory", L"");
     CreateSequenceDescriptions(corpus, config(L"file"), labelDimension, multiViewCrop);
 }
 
@@ -176,6 +260,8 @@ ImageDataDeserializer::ImageDataDeserializer(const ConfigParameters& config)
     m_streams = configHelper.GetStreams();
     assert(m_streams.size() == 2);
     m_grayscale = configHelper.UseGrayscale();
+    m_minDecodedSize = configHelper.GetMinDecodedSize();
+    m_convertAfterScale = configHelper.ShouldConvertAfterScale();
     const auto& label = m_streams[configHelper.GetLabelStreamId()];
     const auto& feature = m_streams[configHelper.GetFeatureStreamId()];
 
@@ -202,6 +288,7 @@ ImageDataDeserializer::ImageDataDeserializer(const ConfigParameters& config)
         RuntimeError("Unsupported label element type '%d'.", (int)label->m_elementType);
     }
 
+    m_cacheDirectory = config(L"cacheDirectory", L"");
     CreateSequenceDescriptions(std::make_shared<CorpusDescriptor>(), configHelper.GetMapPath(), labelDimension, configHelper.IsMultiViewCrop());
 }
 
@@ -209,6 +296,20 @@ ImageDataDeserializer::ImageDataDeserializer(const ConfigParameters& config)
 ChunkDescriptions ImageDataDeserializer::GetChunkDescriptions()
 {
     ChunkDescriptions result;
+    if (!m_packChunks.empty())
+    {
+        result.reserve(m_packChunks.size());
+        for (ChunkIdType i = 0; i < m_packChunks.size(); i++)
+        {
+            auto chunk = std::make_shared<ChunkDescription>();
+            chunk->m_id = i;
+            chunk->m_numberOfSamples = m_packChunks[i].m_numSequences;
+            chunk->m_numberOfSequences = m_packChunks[i].m_numSequences;
+            result.push_back(chunk);
+        }
+        return result;
+    }
+
     result.reserve(m_imageSequences.size());
     for (auto const& s : m_imageSequences)
     {
@@ -224,12 +325,178 @@ ChunkDescriptions ImageDataDeserializer::GetChunkDescriptions()
 
 void ImageDataDeserializer::GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& result)
 {
-    // Currently a single sequence per chunk.
+    if (!m_packChunks.empty())
+    {
+        const auto& chunk = m_packChunks[chunkId];
+        result.insert(result.end(), m_imageSequences.begin() + chunk.m_firstSequence,
+                      m_imageSequences.begin() + chunk.m_firstSequence + chunk.m_numSequences);
+        return;
+    }
+
+    // Otherwise a single sequence per chunk.
     result.push_back(m_imageSequences[chunkId]);
 }
 
+static bool IsImagePack(const std::string& path)
+{
+    char magic[sizeof(s_imagePackMagic)];
+    std::wstring widePath = msra::strfun::utf16(path);
+    if (IsRemotePath(widePath))
+    {
+        // remote inputs can only be packs, the images of map files are read from local files
+        auto source = OpenByteSource(widePath);
+        if (source->Size() < sizeof(magic))
+        {
+            return false;
+        }
+        source->Read(0, sizeof(magic), magic);
+        return memcmp(magic, s_imagePackMagic, sizeof(magic)) == 0;
+    }
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool isPack = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, s_imagePackMagic, sizeof(magic)) == 0;
+    fclose(file);
+    return isPack;
+}
+
+// The packs that 'path' names, either itself or as a list of packs, one per line; none if it is a map file.
+static std::vector<std::string> GetImagePacks(const std::string& path)
+{
+    if (IsImagePack(path))
+    {
+        return std::vector<std::string>{ path };
+    }
+
+    std::vector<std::string> packs;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+        if (!IsImagePack(line))
+        {
+            // a map file, unless the lines before named packs
+            if (!packs.empty())
+            {
+                RuntimeError("'%s' in the list of image packs %s is not an image pack.", line.c_str(), path.c_str());
+            }
+            break;
+        }
+        packs.push_back(line);
+    }
+    return packs;
+}
+
+void ImageDataDeserializer::AddImagePack(CorpusDescriptorPtr corpus, const std::string& packPath, size_t labelDimension, bool isMultiCrop)
+{
+    auto pack = OpenByteSource(msra::strfun::utf16(packPath), m_cacheDirectory);
+    ImagePackHeader header;
+    if (pack->Size() < sizeof(header))
+    {
+        RuntimeError("Malformed image pack %s: the file is too short.", packPath.c_str());
+    }
+    pack->Read(0, sizeof(header), reinterpret_cast<char*>(&header));
+    if (header.m_version != s_imagePackVersion)
+    {
+        RuntimeError("Image pack %s has version %u, expected %u.", packPath.c_str(), header.m_version, s_imagePackVersion);
+    }
+
+    std::vector<ImagePackChunkHeader> chunks((size_t)header.m_numChunks);
+    std::vector<ImagePackRecord> records((size_t)header.m_numRecords);
+    std::vector<char> keys((size_t)header.m_keyTableSize);
+    pack->Read(header.m_chunkTableOffset, chunks.size() * sizeof(ImagePackChunkHeader), reinterpret_cast<char*>(chunks.data()));
+    pack->Read(header.m_recordTableOffset, records.size() * sizeof(ImagePackRecord), reinterpret_cast<char*>(records.data()));
+    pack->Read(header.m_keyTableOffset, keys.size(), keys.data());
+
+    size_t itemsPerRecord = isMultiCrop ? 10 : 1;
+    size_t packIndex = m_packs.size();
+    m_packs.push_back(pack);
+
+    auto& stringRegistry = corpus->GetStringRegistry();
+    ImageSequenceDescription description;
+    description.m_numberOfSamples = 1;
+    for (const auto& chunk : chunks)
+    {
+        PackChunkInfo info = { packIndex, chunk.m_offset, chunk.m_byteSize, m_imageSequences.size(), 0 };
+        if (chunk.m_firstRecord + chunk.m_numRecords > records.size())
+        {
+            RuntimeError("Malformed image pack %s: a chunk exceeds the record table.", packPath.c_str());
+        }
+
+        for (size_t i = chunk.m_firstRecord; i < chunk.m_firstRecord + chunk.m_numRecords; i++)
+        {
+            const auto& record = records[i];
+            if (record.m_keyOffset + record.m_keyLength > keys.size() || record.m_dataOffset + record.m_dataSize > chunk.m_byteSize)
+            {
+                RuntimeError("Malformed image pack %s: record %" PRIu64 " exceeds its chunk or the key table.", packPath.c_str(), (uint64_t)i);
+            }
+
+            std::string sequenceKey(keys.data() + record.m_keyOffset, record.m_keyLength);
+            if (!corpus->IsIncluded(sequenceKey))
+            {
+                continue;
+            }
+
+            if (record.m_classId >= labelDimension)
+            {
+                RuntimeError(
+                    "Image '%s' has invalid class id '%u'. Expected label dimension is '%" PRIu64 "'. Image pack %s.",
+                    sequenceKey.c_str(), record.m_classId, labelDimension, packPath.c_str());
+            }
+
+            if (CHUNKID_MAX < m_packChunks.size() + 1)
+            {
+                RuntimeError("Maximum number of chunks exceeded.");
+            }
+
+            for (size_t k = 0; k < itemsPerRecord; k++)
+            {
+                description.m_id = m_imageSequences.size();
+                description.m_chunkId = (ChunkIdType)m_packChunks.size();
+                description.m_path = sequenceKey; // for error messages
+                description.m_classId = record.m_classId;
+                description.m_dataOffset = record.m_dataOffset;
+                description.m_dataSize = record.m_dataSize;
+                description.m_key.m_sequence = stringRegistry[sequenceKey];
+                description.m_key.m_sample = 0;
+
+                m_keyToSequence.Add(description.m_key.m_sequence, description.m_chunkId, m_imageSequences.size());
+                m_imageSequences.push_back(description);
+                info.m_numSequences++;
+            }
+        }
+
+        // chunks without any included images are left out
+        if (info.m_numSequences > 0)
+        {
+            m_packChunks.push_back(info);
+        }
+    }
+}
+
 void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath, size_t labelDimension, bool isMultiCrop)
 {
+    auto packs = GetImagePacks(mapPath);
+    if (!packs.empty())
+    {
+        for (const auto& pack : packs)
+        {
+            AddImagePack(corpus, pack, labelDimension, isMultiCrop);
+        }
+        return;
+    }
+
     std::ifstream mapFile(mapPath);
     if (!mapFile)
     {
@@ -287,6 +554,8 @@ void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpu
 
         for (size_t start = curId; curId < start + itemsPerLine; curId++)
         {
+            description.m_dataOffset = 0;
+            description.m_dataSize = 0;
             description.m_id = curId;
             description.m_chunkId = (ChunkIdType)curId;
             description.m_path = imagePath;
@@ -294,7 +563,7 @@ void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpu
             description.m_key.m_sequence = stringRegistry[sequenceKey];
             description.m_key.m_sample = 0;
 
-            m_keyToSequence[description.m_key.m_sequence] = m_imageSequences.size();
+            m_keyToSequence.Add(description.m_key.m_sequence, description.m_chunkId, m_imageSequences.size());
             m_imageSequences.push_back(description);
             RegisterByteReader(description.m_id, description.m_path, knownReaders);
         }
@@ -303,6 +572,11 @@ void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpu
 
 ChunkPtr ImageDataDeserializer::GetChunk(ChunkIdType chunkId)
 {
+    if (!m_packChunks.empty())
+    {
+        return std::make_shared<ImagePackChunk>(m_packChunks[chunkId], *this);
+    }
+
     auto sequenceDescription = m_imageSequences[chunkId];
     return std::make_shared<ImageChunk>(sequenceDescription, *this);
 }
@@ -350,27 +624,124 @@ cv::Mat ImageDataDeserializer::ReadImage(size_t seqId, const std::string& path,
 
     ImageDataDeserializer::SeqReaderMap::const_iterator r;
     if (m_readers.empty() || (r = m_readers.find(seqId)) == m_readers.end())
-        return m_defaultReader.Read(seqId, path, grayscale);
-    return (*r).second->Read(seqId, path, grayscale);
+        return m_defaultReader.Read(seqId, path, grayscale, m_minDecodedSize);
+    return (*r).second->Read(seqId, path, grayscale, m_minDecodedSize);
 }
 
-cv::Mat FileByteReader::Read(size_t, const std::string& path, bool grayscale)
+cv::Mat FileByteReader::Read(size_t, const std::string& path, bool grayscale, size_t minSize)
 {
     assert(!path.empty());
 
-    return cv::imread(path, grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return cv::Mat(); // reported by the caller
+    }
+
+    auto contents = m_workspace.pop_or_create([]() { return std::vector<unsigned char>(); });
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > 0)
+    {
+        contents.resize(size);
+        size = (long)fread(contents.data(), 1, size, file);
+    }
+    fclose(file);
+
+    cv::Mat image;
+    if (size > 0)
+    {
+        image = Decode(contents.data(), size, grayscale, minSize);
+    }
+    m_workspace.push(std::move(contents));
+    return image;
+}
+
+// Reads the dimensions from the frame header of a JPEG image. Returns false if the data is not a JPEG image.
+static bool GetJpegDimensions(const unsigned char* data, size_t size, int& width, int& height)
+{
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xFF)
+    {
+        unsigned char marker = data[pos + 1];
+        if (marker == 0xFF) // fill byte
+        {
+            pos++;
+            continue;
+        }
+
+        // The markers C0-CF start the frame header, which holds the precision, height and width,
+        // except for C4 and CC, which define coding tables, and the reserved C8.
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        {
+            if (pos + 9 > size)
+            {
+                return false;
+            }
+            height = (data[pos + 5] << 8) | data[pos + 6];
+            width = (data[pos + 7] << 8) | data[pos + 8];
+            return width > 0 && height > 0;
+        }
+
+        // the scan data starts or the image ends without a frame header
+        if (marker == 0xDA || marker == 0xD9)
+        {
+            return false;
+        }
+
+        pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+    }
+    return false;
+}
+
+/*static*/ cv::Mat ByteReader::Decode(const unsigned char* data, size_t size, bool grayscale, size_t minSize)
+{
+    int flags = grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+
+    // The reduced decoding modes are available since OpenCV 3.1.
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 1)
+    int width, height;
+    if (minSize > 0 && GetJpegDimensions(data, size, width, height))
+    {
+        // libjpeg rounds the scaled size up, so the shorter side keeps at least minSize pixels
+        size_t shorterSide = (size_t)std::min(width, height);
+        if (shorterSide >= 8 * minSize)
+        {
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+        }
+        else if (shorterSide >= 4 * minSize)
+        {
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+        }
+        else if (shorterSide >= 2 * minSize)
+        {
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+        }
+    }
+#else
+    UNUSED(minSize);
+#endif
+
+    return cv::imdecode(cv::Mat(1, (int)size, CV_8UC1, const_cast<unsigned char*>(data)), flags);
 }
 
 bool ImageDataDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
 {
-    auto index = m_keyToSequence.find(key.m_sequence);
+    ChunkIdType chunkId;
+    size_t index;
     // Checks whether it is a known sequence for us.
-    if (key.m_sample != 0 || index == m_keyToSequence.end())
+    if (key.m_sample != 0 || !m_keyToSequence.TryGet(key.m_sequence, chunkId, index))
     {
         return false;
     }
 
-    result = m_imageSequences[index->second];
+    result = m_imageSequences[index];
     return true;
 }
 
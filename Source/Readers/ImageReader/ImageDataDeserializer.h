@@ -10,6 +10,8 @@
 #include "ByteReader.h"
 #include <unordered_map>
 #include "CorpusDescriptor.h"
+#include "SequenceKeyLocations.h"
+#include "ByteSource.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -18,6 +20,10 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // All sequences consist only of a single sample (image/label).
 // For features it uses dense storage format with different layout (dimensions) per sequence.
 // For labels it uses the csc sparse storage format.
+// The images are read from the files listed in a map file, one image per chunk, or from packs of images
+// (see ImagePackFormat.h), several images per chunk. The 'file' parameter names either the map file, a pack,
+// or a text file that lists packs, one per line. Packs can also be read from remote storage ('http://' URLs,
+// see ByteSource.h); the optional 'cacheDirectory' parameter keeps their chunks on the local disk once read.
 class ImageDataDeserializer : public DataDeserializerBase
 {
 public:
@@ -44,14 +50,36 @@ private:
     // Creates a set of sequence descriptions.
     void CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath, size_t labelDimension, bool isMultiCrop);
 
+    // Creates the sequence descriptions and chunks of the images of a pack.
+    void AddImagePack(CorpusDescriptorPtr corpus, const std::string& packPath, size_t labelDimension, bool isMultiCrop);
+
     // Image sequence descriptions. Currently, a sequence contains a single sample only.
     struct ImageSequenceDescription : public SequenceDescription
     {
         std::string m_path;
         size_t m_classId;
+        uint64_t m_dataOffset; // (packs only) of the encoded image in the chunk
+        uint32_t m_dataSize;   // (packs only)
     };
 
+    // Creates the feature and label sequences of a decoded image.
+    void CreateSequences(const cv::Mat& decoded, const ImageSequenceDescription& description, const ChunkPtr& chunk, std::vector<SequenceDataPtr>& result);
+
     class ImageChunk;
+    class ImagePackChunk;
+
+    // A chunk of a pack, holding the sequences [m_firstSequence, m_firstSequence + m_numSequences).
+    struct PackChunkInfo
+    {
+        size_t m_pack; // index into m_packs
+        uint64_t m_offset;
+        uint64_t m_byteSize;
+        size_t m_firstSequence;
+        size_t m_numSequences;
+    };
+    std::vector<ByteSourcePtr> m_packs; // local or remote (see ByteSource.h)
+    std::wstring m_cacheDirectory;      // where the chunks of remote packs are kept, if not empty
+    std::vector<PackChunkInfo> m_packChunks; // empty if the images are read from files
 
     // A helper class for generation of type specific labels (currently float/double only).
     class LabelGenerator;
@@ -61,8 +89,8 @@ private:
     // Sequence descriptions for all input data.
     std::vector<ImageSequenceDescription> m_imageSequences;
 
-    // Mapping of logical sequence key into sequence description.
-    std::map<size_t, size_t> m_keyToSequence;
+    // Mapping of logical sequence key into sequence description (chunk id, index into m_imageSequences).
+    SequenceKeyLocations m_keyToSequence;
 
     // Element type of the feature/label stream (currently float/double only).
     ElementType m_featureElementType;
@@ -70,6 +98,15 @@ private:
     // whether images shall be loaded in grayscale 
     bool m_grayscale;
 
+    // minimum size of the shorter side of a decoded image, 0 if images are always decoded at full size
+    size_t m_minDecodedSize;
+
+    // whether decoded images are passed on in their type, to be converted by the ScaleTransformer
+    bool m_convertAfterScale;
+
+    // buffers of the images converted to the feature element type, reused across images
+    conc_pool<std::vector<unsigned char>> m_imageBuffers;
+
     // Not using nocase_compare here as it's not correct on Linux.
     using PathReaderMap = std::unordered_map<std::string, std::shared_ptr<ByteReader>>;
     void RegisterByteReader(size_t seqId, const std::string& path, PathReaderMap& knownReaders);
@@ -0,0 +1,65 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// Packed image format, as read by the ImageDataDeserializer and written by cntk_image_pack_builder.py.
+// All integers are little-endian.
+//
+//   header:       ImagePackHeader at offset 0
+//   chunks:       the encoded images (as in their files, e.g. JPEG) of the records of a chunk, back to back
+//   chunk table:  at m_chunkTableOffset, m_numChunks ImagePackChunkHeader entries
+//   record table: at m_recordTableOffset, m_numRecords ImagePackRecord entries, in the order of the chunks
+//   key table:    at m_keyTableOffset, the UTF-8 sequence keys of the records, back to back
+//
+// A chunk is read with a single sequential read, and the records of a chunk are randomized together,
+// so the images should be shuffled when they are packed.
+// -----------------------------------------------------------------------
+
+static const char s_imagePackMagic[8] = { 'C', 'N', 'T', 'K', 'I', 'M', 'P', '1' };
+
+struct ImagePackHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_reserved;
+    uint64_t m_numChunks;
+    uint64_t m_numRecords;
+    uint64_t m_chunkTableOffset;
+    uint64_t m_recordTableOffset;
+    uint64_t m_keyTableOffset;
+    uint64_t m_keyTableSize;
+};
+
+struct ImagePackChunkHeader
+{
+    uint64_t m_offset; // of the chunk in the file
+    uint64_t m_byteSize;
+    uint64_t m_firstRecord;
+    uint64_t m_numRecords;
+};
+
+struct ImagePackRecord
+{
+    uint64_t m_dataOffset; // of the encoded image, from the start of its chunk
+    uint32_t m_dataSize;
+    uint32_t m_classId;
+    uint64_t m_keyOffset; // in the key table
+    uint32_t m_keyLength;
+    uint32_t m_reserved;
+};
+
+static const uint32_t s_imagePackVersion = 1;
+
+static_assert(sizeof(ImagePackHeader) == 64, "ImagePackHeader must match the file layout");
+static_assert(sizeof(ImagePackChunkHeader) == 32, "ImagePackChunkHeader must match the file layout");
+static_assert(sizeof(ImagePackRecord) == 32, "ImagePackRecord must match the file layout");
+
+}}}
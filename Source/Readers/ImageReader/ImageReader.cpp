@@ -13,6 +13,7 @@
 #include "ImageDataDeserializer.h"
 #include "FramePacker.h"
 #include <omp.h>
+#include "CPUThreadPool.h"
 #include "TransformController.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -37,6 +38,8 @@ ImageReader::ImageReader(MemoryProviderPtr provider,
     if (threadCount > 0)
     {
         omp_set_num_threads(threadCount);
+        // the randomizer decodes and the transform controller transforms the images on the CPU thread pool
+        CPUThreadPool::SetNumThreads(threadCount);
     }
 
     auto deserializer = std::make_shared<ImageDataDeserializer>(config);
@@ -48,7 +51,9 @@ ImageReader::ImageReader(MemoryProviderPtr provider,
     {
         // We do not use legacy randomization.
         bool useLegacyRandomization = false;
-        randomizer = std::make_shared<BlockRandomizer>(0, 1, deserializer, BlockRandomizer::DecimationMode::sequence, useLegacyRandomization, multithreadedGetNextSequences);
+        // Packs on remote storage are read a chunk at a time, the next chunks are loaded ahead in the background.
+        size_t prefetchChunks = config(L"prefetchChunks", IsRemotePath(msra::strfun::utf16(configHelper.GetMapPath())) ? (size_t)4 : (size_t)0);
+        randomizer = std::make_shared<BlockRandomizer>(0, 1, deserializer, BlockRandomizer::DecimationMode::sequence, useLegacyRandomization, multithreadedGetNextSequences, prefetchChunks);
     }
     else
     {
@@ -71,7 +76,17 @@ ImageReader::ImageReader(MemoryProviderPtr provider,
         transformations.push_back(Transformation{ std::make_shared<TransposeTransformer>(featureStream), featureName });
     }
 
-    m_sequenceEnumerator = std::make_shared<TransformController>(transformations, randomizer);
+    // The transformed data depend on the number of transformer chains, which by default is the number of CPU threads.
+    size_t numTransformThreads = config(L"numTransformThreads", (size_t)0);
+    m_sequenceEnumerator = std::make_shared<TransformController>(transformations, randomizer, numTransformThreads);
+
+    // The transforms may leave the normalization of compact (uint8) pixels to the device, see MeanTransformer.
+    auto transformedStreams = m_sequenceEnumerator->GetStreamDescriptions();
+    for (auto& stream : m_streams)
+    {
+        stream->m_storageScale = transformedStreams[stream->m_id]->m_storageScale;
+        stream->m_storageOffset = transformedStreams[stream->m_id]->m_storageOffset;
+    }
 
     m_packer = std::make_shared<FramePacker>(
         m_provider,
@@ -101,4 +116,16 @@ Minibatch ImageReader::ReadMinibatch()
     assert(m_packer != nullptr);
     return m_packer->ReadMinibatch();
 }
+
+bool ImageReader::GetState(ReaderState& state)
+{
+    assert(m_packer != nullptr);
+    return m_packer->GetState(state);
+}
+
+void ImageReader::SetState(const ReaderState& state)
+{
+    assert(m_packer != nullptr);
+    m_packer->SetState(state);
+}
 } } }
@@ -29,6 +29,10 @@ public:
     // Reads a single minibatch.
     Minibatch ReadMinibatch() override;
 
+    // Gets and restores the position in the epoch.
+    bool GetState(ReaderState& state) override;
+    void SetState(const ReaderState& state) override;
+
 private:
     // All streams this reader provides.
     std::vector<StreamDescriptionPtr> m_streams;
@@ -16,16 +16,10 @@
 namespace Microsoft { namespace MSR { namespace CNTK 
 {
 
-struct ImageSequenceData : DenseSequenceData
-{
-    cv::Mat m_image;
-    // In case we do not copy data - we have to preserve the original sequence.
-    SequenceDataPtr m_original;
-};
-
 ImageTransformerBase::ImageTransformerBase(const ConfigParameters& readerConfig) : m_imageElementType(0)
 {
     m_seed = readerConfig(L"seed", 0u);
+    m_rng.seed(m_seed);
 }
 
 // The method describes how input stream is transformed to the output stream. Called once per applied stream.
@@ -48,6 +42,11 @@ StreamDescription ImageTransformerBase::Transform(const StreamDescription& input
     {
         m_imageElementType = CV_32F;
     }
+    else if (m_inputStream.m_elementType == ElementType::tuint8)
+    {
+        // the pixels stay uint8, only geometric transforms apply, and the mean is subtracted on the device
+        m_imageElementType = CV_8U;
+    }
     else
     {
         RuntimeError("Unsupported type");
@@ -68,6 +67,11 @@ SequenceDataPtr ImageTransformerBase::Transform(SequenceDataPtr sequence)
 
     auto result = std::make_shared<ImageSequenceData>();
     int type = CV_MAKETYPE(m_imageElementType, channels);
+    auto image = dynamic_cast<const ImageSequenceData*>(sequence.get());
+    if (image != nullptr && !image->m_image.empty())
+    {
+        type = image->m_image.type();
+    }
     cv::Mat buffer = cv::Mat(rows, columns, type, inputSequence.m_data);
     Apply(sequence->m_id, buffer);
     if (!buffer.isContinuous())
@@ -129,9 +133,6 @@ void CropTransformer::StartEpoch(const EpochConfiguration &config)
 
 void CropTransformer::Apply(size_t id, cv::Mat &mat)
 {
-    auto seed = GetSeed();
-    auto rng = m_rngs.pop_or_create([seed]() { return std::make_unique<std::mt19937>(seed); });
-
     double ratio = 1;
     switch (m_jitterType)
     {
@@ -145,7 +146,7 @@ void CropTransformer::Apply(size_t id, cv::Mat &mat)
         }
         else
         {
-            ratio = UniRealT(m_cropRatioMin, m_cropRatioMax)(*rng);
+            ratio = UniRealT(m_cropRatioMin, m_cropRatioMax)(m_rng);
             assert(m_cropRatioMin <= ratio && ratio < m_cropRatioMax);
         }
         break;
@@ -155,14 +156,12 @@ void CropTransformer::Apply(size_t id, cv::Mat &mat)
 
     int viewIndex = m_cropType == CropType::MultiView10 ? (int)(id % 10) : 0;
 
-    mat = mat(GetCropRect(m_cropType, viewIndex, mat.rows, mat.cols, ratio, *rng));
-    if ((m_hFlip && std::bernoulli_distribution()(*rng)) ||
+    mat = mat(GetCropRect(m_cropType, viewIndex, mat.rows, mat.cols, ratio, m_rng));
+    if ((m_hFlip && std::bernoulli_distribution()(m_rng)) ||
         viewIndex >= 5)
     {
         cv::flip(mat, mat, 1);
     }
-
-    m_rngs.push(std::move(rng));
 }
 
 CropTransformer::RatioJitterType
@@ -327,21 +326,16 @@ void ScaleTransformer::Apply(size_t id, cv::Mat &mat)
 {
     UNUSED(id);
 
-    // If matrix has not been converted to the right type, do it now as rescaling
-    // requires floating point type.
+    auto index = UniIntT(0, static_cast<int>(m_interp.size()) - 1)(m_rng);
+    assert(m_interp.size() > 0);
+    cv::resize(mat, mat, cv::Size((int)m_imgWidth, (int)m_imgHeight), 0, 0, m_interp[index]);
+
+    // If matrix has not been converted to the right type, do it now, at the scaled size,
+    // as the transformations that follow require floating point type.
     if (mat.type() != CV_MAKETYPE(m_imageElementType, m_imgChannels))
     {
         mat.convertTo(mat, m_imageElementType);
     }
-
-    auto seed = GetSeed();
-    auto rng = m_rngs.pop_or_create([seed]() { return std::make_unique<std::mt19937>(seed); });
-
-    auto index = UniIntT(0, static_cast<int>(m_interp.size()) - 1)(*rng);
-    assert(m_interp.size() > 0);
-    cv::resize(mat, mat, cv::Size((int)m_imgWidth, (int)m_imgHeight), 0, 0, m_interp[index]);
-
-    m_rngs.push(std::move(rng));
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -374,9 +368,38 @@ MeanTransformer::MeanTransformer(const ConfigParameters& config) : ImageTransfor
     }
 }
 
+// For uint8 storage, the mean cannot be subtracted from the pixels. It is passed on as the offset
+// that is subtracted on the device, together with the conversion to the network's precision.
+StreamDescription MeanTransformer::Transform(const StreamDescription& inputStream)
+{
+    ImageTransformerBase::Transform(inputStream);
+    if (m_inputStream.m_elementType == ElementType::tuint8 && !m_meanImg.empty())
+    {
+        if (m_inputStream.m_storageOffset)
+        {
+            RuntimeError("MeanTransformer: the stream '%ls' already has a storage offset.", m_inputStream.m_name.c_str());
+        }
+        if (!m_inputStream.m_sampleLayout || m_meanImg.total() * m_meanImg.channels() != m_inputStream.m_sampleLayout->GetNumElements())
+        {
+            RuntimeError("MeanTransformer: the mean image does not match the size of the images of stream '%ls'.", m_inputStream.m_name.c_str());
+        }
+        cv::Mat mean;
+        m_meanImg.convertTo(mean, CV_32F);
+        mean = mean.isContinuous() ? mean : mean.clone();
+        const float* values = mean.ptr<float>();
+        m_outputStream.m_storageOffset = std::make_shared<std::vector<float>>(values, values + m_inputStream.m_sampleLayout->GetNumElements()); // HWC like the pixels
+    }
+    return m_outputStream;
+}
+
 void MeanTransformer::Apply(size_t id, cv::Mat &mat)
 {
     UNUSED(id);
+    if (m_imageElementType == CV_8U)
+    {
+        return; // applied on the device, see Transform()
+    }
+
     assert(m_meanImg.size() == cv::Size(0, 0) ||
            (m_meanImg.size() == mat.size() &&
            m_meanImg.channels() == mat.channels()));
@@ -402,6 +425,23 @@ StreamDescription TransposeTransformer::Transform(const StreamDescription& input
     ImageDimensions dimensions(*m_inputStream.m_sampleLayout, HWC);
     m_outputStream = m_inputStream;
     m_outputStream.m_sampleLayout = std::make_shared<TensorShape>(dimensions.AsTensorShape(CHW));
+
+    // the offset subtracted on the device (uint8 storage, see MeanTransformer) must be transposed as well
+    if (m_inputStream.m_storageOffset)
+    {
+        const auto& src = *m_inputStream.m_storageOffset;
+        auto dst = std::make_shared<std::vector<float>>(src.size());
+        size_t rowCount = dimensions.m_height * dimensions.m_width;
+        size_t channelCount = dimensions.m_numChannels;
+        for (size_t irow = 0; irow < rowCount; irow++)
+        {
+            for (size_t icol = 0; icol < channelCount; icol++)
+            {
+                (*dst)[icol * rowCount + irow] = src[irow * channelCount + icol];
+            }
+        }
+        m_outputStream.m_storageOffset = dst;
+    }
     return m_outputStream;
 }
 
@@ -418,6 +458,11 @@ SequenceDataPtr TransposeTransformer::Transform(SequenceDataPtr sequence)
         return TypedTransform<float>(sequence);
     }
 
+    if (m_inputStream.m_elementType == ElementType::tuint8)
+    {
+        return TypedTransform<unsigned char>(sequence);
+    }
+
     RuntimeError("Unsupported type");
 }
 
@@ -512,17 +557,13 @@ void IntensityTransformer::Apply(size_t id, cv::Mat &mat)
 template <typename ElemType>
 void IntensityTransformer::Apply(cv::Mat &mat)
 {
-    auto seed = GetSeed();
-    auto rng = m_rngs.pop_or_create([seed]() { return std::make_unique<std::mt19937>(seed); } );
-
     // Using single precision as EigVal and EigVec matrices are single precision.
     std::normal_distribution<float> d(0, (float)m_curStdDev);
     cv::Mat alphas(1, 3, CV_32FC1);
     assert(m_eigVal.rows == 1 && m_eigVec.cols == 3);
-    alphas.at<float>(0) = d(*rng) * m_eigVal.at<float>(0);
-    alphas.at<float>(1) = d(*rng) * m_eigVal.at<float>(1);
-    alphas.at<float>(2) = d(*rng) * m_eigVal.at<float>(2);
-    m_rngs.push(std::move(rng));
+    alphas.at<float>(0) = d(m_rng) * m_eigVal.at<float>(0);
+    alphas.at<float>(1) = d(m_rng) * m_eigVal.at<float>(1);
+    alphas.at<float>(2) = d(m_rng) * m_eigVal.at<float>(2);
 
     assert(m_eigVec.rows == 3 && m_eigVec.cols == 3);
 
@@ -586,9 +627,6 @@ void ColorTransformer::Apply(size_t id, cv::Mat &mat)
 template <typename ElemType>
 void ColorTransformer::Apply(cv::Mat &mat)
 {
-    auto seed = GetSeed();
-    auto rng = m_rngs.pop_or_create([seed]() { return std::make_unique<std::mt19937>(seed); });
-
     if (m_curBrightnessRadius > 0 || m_curContrastRadius > 0)
     {
         // To change brightness and/or contrast the following standard transformation is used:
@@ -601,14 +639,14 @@ void ColorTransformer::Apply(cv::Mat &mat)
             // Compute mean value of the image.
             cv::Scalar imgMean = cv::sum(cv::sum(mat));
             // Compute beta as a fraction of the mean.
-            beta = (ElemType)(d(*rng) * imgMean[0] / (mat.rows * mat.cols * mat.channels()));
+            beta = (ElemType)(d(m_rng) * imgMean[0] / (mat.rows * mat.cols * mat.channels()));
         }
 
         ElemType alpha = 1;
         if (m_curContrastRadius > 0)
         {
             UniRealT d(-m_curContrastRadius, m_curContrastRadius);
-            alpha = (ElemType)(1 + d(*rng));
+            alpha = (ElemType)(1 + d(m_rng));
         }
 
         // Could potentially use mat.convertTo(mat, -1, alpha, beta) 
@@ -624,28 +662,22 @@ void ColorTransformer::Apply(cv::Mat &mat)
     if (m_curSaturationRadius > 0 && mat.channels() == 3)
     {
         UniRealT d(-m_curSaturationRadius, m_curSaturationRadius);
-        double ratio = 1.0 + d(*rng);
+        double ratio = 1.0 + d(m_rng);
         assert(0 <= ratio && ratio <= 2);
 
-        auto hsv = m_hsvTemp.pop_or_create([]() { return std::make_unique<cv::Mat>(); });
-
         // To change saturation, we need to convert the image to HSV format first,
         // the change S channgel and convert the image back to BGR format.
-        cv::cvtColor(mat, *hsv, CV_BGR2HSV);
-        assert(hsv->rows == mat.rows && hsv->cols == mat.cols);
-        size_t count = hsv->rows * hsv->cols * mat.channels();
-        ElemType* phsvBase = reinterpret_cast<ElemType*>(hsv->data);
+        cv::cvtColor(mat, m_hsvTemp, CV_BGR2HSV);
+        assert(m_hsvTemp.rows == mat.rows && m_hsvTemp.cols == mat.cols);
+        size_t count = m_hsvTemp.rows * m_hsvTemp.cols * mat.channels();
+        ElemType* phsvBase = reinterpret_cast<ElemType*>(m_hsvTemp.data);
         for (ElemType* phsv = phsvBase; phsv < phsvBase + count; phsv += 3)
         {
             const int HsvIndex = 1;
             phsv[HsvIndex] = std::min((ElemType)(phsv[HsvIndex] * ratio), (ElemType)1);
         }
-        cv::cvtColor(*hsv, mat, CV_HSV2BGR);
-
-        m_hsvTemp.push(std::move(hsv));
+        cv::cvtColor(m_hsvTemp, mat, CV_HSV2BGR);
     }
-
-    m_rngs.push(std::move(rng));
 }
 
 }}}
@@ -18,6 +18,15 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 class ConfigParameters;
 
+// An image sequence as OpenCV matrix. Until the ScaleTransformer, the matrix may still be of the type the image
+// was decoded to (see ImageConfigHelper::ShouldConvertAfterScale()), otherwise it is of the stream element type.
+struct ImageSequenceData : DenseSequenceData
+{
+    cv::Mat m_image;
+    // In case we do not copy data - we have to preserve the original sequence.
+    SequenceDataPtr m_original;
+};
+
 // Base class for image transformations based on OpenCV
 // that helps to wrap the sequences into OpenCV::Mat class.
 class ImageTransformerBase : public Transformer
@@ -47,12 +56,23 @@ protected:
     // The only function that should be redefined by the inherited classes.
     virtual void Apply(size_t id, cv::Mat &from) = 0;
 
+    // A copy of the transformer of type T, with the seed offset by seedOffset (see Transformer::Clone()).
+    template <class T>
+    std::shared_ptr<T> CloneAs(unsigned int seedOffset) const
+    {
+        auto clone = std::make_shared<T>(static_cast<const T&>(*this));
+        clone->m_seed = m_seed + seedOffset;
+        clone->m_rng.seed(clone->m_seed);
+        return clone;
+    }
+
 protected:
     StreamDescription m_inputStream;
     StreamDescription m_outputStream;
     unsigned int m_seed;
     int m_imageElementType;
-    conc_stack<std::unique_ptr<std::mt19937>> m_rngs;
+    // The TransformController gives each thread a copy of its own, see Transformer::Clone().
+    std::mt19937 m_rng;
 };
 
 // Crop transformation of the image.
@@ -62,6 +82,11 @@ class CropTransformer : public ImageTransformerBase
 public:
     explicit CropTransformer(const ConfigParameters& config);
 
+    TransformerPtr Clone(unsigned int seedOffset) const override
+    {
+        return CloneAs<CropTransformer>(seedOffset);
+    }
+
 private:
     void Apply(size_t id, cv::Mat &mat) override;
 
@@ -79,7 +104,6 @@ private:
     RatioJitterType ParseJitterType(const std::string &src);
     cv::Rect GetCropRect(CropType type, int viewIndex, int crow, int ccol, double cropRatio, std::mt19937 &rng);
 
-    conc_stack<std::unique_ptr<std::mt19937>> m_rngs;
     CropType m_cropType;
     double m_cropRatioMin;
     double m_cropRatioMax;
@@ -98,6 +122,11 @@ public:
 
     StreamDescription Transform(const StreamDescription& inputStream) override;
 
+    TransformerPtr Clone(unsigned int seedOffset) const override
+    {
+        return CloneAs<ScaleTransformer>(seedOffset);
+    }
+
 private:
     void Apply(size_t id, cv::Mat &mat) override;
 
@@ -105,7 +134,6 @@ private:
     StrToIntMapT m_interpMap;
     std::vector<int> m_interp;
 
-    conc_stack<std::unique_ptr<std::mt19937>> m_rngs;
     size_t m_imgWidth;
     size_t m_imgHeight;
     size_t m_imgChannels;
@@ -117,6 +145,8 @@ class MeanTransformer : public ImageTransformerBase
 public:
     explicit MeanTransformer(const ConfigParameters& config);
 
+    StreamDescription Transform(const StreamDescription& inputStream) override;
+
 private:
     void Apply(size_t id, cv::Mat &mat) override;
 
@@ -155,6 +185,11 @@ class IntensityTransformer : public ImageTransformerBase
 public:
     explicit IntensityTransformer(const ConfigParameters& config);
 
+    TransformerPtr Clone(unsigned int seedOffset) const override
+    {
+        return CloneAs<IntensityTransformer>(seedOffset);
+    }
+
 private:
     void StartEpoch(const EpochConfiguration &config) override;
 
@@ -168,7 +203,6 @@ private:
     cv::Mat m_eigVal;
     cv::Mat m_eigVec;
 
-    conc_stack<std::unique_ptr<std::mt19937>> m_rngs;
 };
 
 // Color jittering transform based on the paper: http://arxiv.org/abs/1312.5402
@@ -178,6 +212,13 @@ class ColorTransformer : public ImageTransformerBase
 public:
     explicit ColorTransformer(const ConfigParameters& config);
 
+    TransformerPtr Clone(unsigned int seedOffset) const override
+    {
+        auto clone = CloneAs<ColorTransformer>(seedOffset);
+        clone->m_hsvTemp = cv::Mat(); // (a copy would share the buffer)
+        return clone;
+    }
+
 private:
     void StartEpoch(const EpochConfiguration &config) override;
 
@@ -192,8 +233,7 @@ private:
     doubleargvector m_saturationRadius;
     double m_curSaturationRadius;
 
-    conc_stack<std::unique_ptr<std::mt19937>> m_rngs;
-    conc_stack<std::unique_ptr<cv::Mat>> m_hsvTemp;
+    cv::Mat m_hsvTemp;
 };
 
 }}}
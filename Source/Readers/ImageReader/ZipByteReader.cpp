@@ -5,6 +5,7 @@
 
 #include "stdafx.h"
 #include <opencv2/opencv.hpp>
+#include <string.h>
 #include "ByteReader.h"
 
 #ifdef USE_ZIP
@@ -20,10 +21,132 @@ std::string GetZipError(int err)
     return errS;
 }
 
+// little-endian fields of the zip records
+static uint16_t ReadUInt16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t ReadUInt32(const unsigned char* p)
+{
+    return (uint32_t)ReadUInt16(p) | ((uint32_t)ReadUInt16(p + 2) << 16);
+}
+
+static uint64_t ReadUInt64(const unsigned char* p)
+{
+    return (uint64_t)ReadUInt32(p) | ((uint64_t)ReadUInt32(p + 4) << 32);
+}
+
 ZipByteReader::ZipByteReader(const std::string& zipPath)
     : m_zipPath(zipPath)
 {
     assert(!m_zipPath.empty());
+
+    auto zipFile = OpenZip();
+    if (!ReadCentralDirectory((zip_uint64_t)zip_get_num_entries(zipFile.get(), 0)))
+    {
+        fprintf(stderr, "WARNING: Cannot index the zip file %s, its entries are read through libzip.\n", m_zipPath.c_str());
+        m_localHeaderOffsets.clear();
+        m_file.reset();
+    }
+    m_zips.push(std::move(zipFile));
+}
+
+bool ZipByteReader::ReadCentralDirectory(zip_uint64_t expectedNumEntries)
+{
+    m_file = std::make_shared<MappedFile>(msra::strfun::utf16(m_zipPath));
+    auto data = reinterpret_cast<const unsigned char*>(m_file->Data());
+    size_t size = m_file->Size();
+
+    // The end of central directory record is followed only by the archive comment of up to 64 KB.
+    const size_t EndRecordSize = 22;
+    if (size < EndRecordSize)
+        return false;
+    size_t end = size - EndRecordSize;
+    size_t searchBegin = end > 0xFFFF ? end - 0xFFFF : 0;
+    while (ReadUInt32(data + end) != 0x06054b50)
+    {
+        if (end == searchBegin)
+            return false;
+        end--;
+    }
+    uint64_t numEntries = ReadUInt16(data + end + 10);
+    uint64_t directoryOffset = ReadUInt32(data + end + 16);
+
+    // Zip64 archives keep the values that do not fit into the end record in a record of their own,
+    // which a locator right before the end record points to.
+    if ((numEntries == 0xFFFF || directoryOffset == 0xFFFFFFFF) && end >= 20 && ReadUInt32(data + end - 20) == 0x07064b50)
+    {
+        uint64_t recordOffset = ReadUInt64(data + end - 20 + 8);
+        if (recordOffset + 56 > size || ReadUInt32(data + recordOffset) != 0x06064b50)
+            return false;
+        numEntries = ReadUInt64(data + recordOffset + 32);
+        directoryOffset = ReadUInt64(data + recordOffset + 48);
+    }
+
+    // The entries are indexed in the order of the central directory, as by libzip.
+    if (numEntries != expectedNumEntries)
+        return false;
+    m_localHeaderOffsets.reserve(numEntries);
+    const size_t HeaderSize = 46;
+    size_t pos = directoryOffset;
+    for (uint64_t i = 0; i < numEntries; i++)
+    {
+        if (pos + HeaderSize > size || ReadUInt32(data + pos) != 0x02014b50)
+            return false;
+        uint64_t compressedSize = ReadUInt32(data + pos + 20);
+        uint64_t uncompressedSize = ReadUInt32(data + pos + 24);
+        size_t nameLength = ReadUInt16(data + pos + 28);
+        size_t extraLength = ReadUInt16(data + pos + 30);
+        size_t commentLength = ReadUInt16(data + pos + 32);
+        uint64_t localHeaderOffset = ReadUInt32(data + pos + 42);
+        if (pos + HeaderSize + nameLength + extraLength > size)
+            return false;
+
+        // A zip64 offset is in the zip64 extra field, after the sizes that do not fit into their 32 bit fields.
+        if (localHeaderOffset == 0xFFFFFFFF)
+        {
+            size_t extra = pos + HeaderSize + nameLength;
+            size_t extraEnd = extra + extraLength;
+            while (extra + 4 <= extraEnd)
+            {
+                size_t fieldLength = ReadUInt16(data + extra + 2);
+                if (ReadUInt16(data + extra) == 0x0001)
+                {
+                    size_t field = extra + 4 + (uncompressedSize == 0xFFFFFFFF ? 8 : 0) + (compressedSize == 0xFFFFFFFF ? 8 : 0);
+                    if (field + 8 > extra + 4 + fieldLength || field + 8 > extraEnd)
+                        return false;
+                    localHeaderOffset = ReadUInt64(data + field);
+                    break;
+                }
+                extra += 4 + fieldLength;
+            }
+        }
+
+        m_localHeaderOffsets.push_back((size_t)localHeaderOffset);
+        pos += HeaderSize + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
+size_t ZipByteReader::GetDataOffset(zip_uint64_t index, zip_uint64_t size, const std::string& path) const
+{
+    if (index >= m_localHeaderOffsets.size())
+        return SIZE_MAX;
+
+    auto data = reinterpret_cast<const unsigned char*>(m_file->Data());
+    size_t fileSize = m_file->Size();
+    size_t header = m_localHeaderOffsets[index];
+    const size_t HeaderSize = 30;
+    if (header + HeaderSize > fileSize || ReadUInt32(data + header) != 0x04034b50)
+        return SIZE_MAX;
+
+    // The name is checked as well, to be sure that the index of libzip and ours agree.
+    size_t nameLength = ReadUInt16(data + header + 26);
+    size_t dataOffset = header + HeaderSize + nameLength + ReadUInt16(data + header + 28);
+    if (dataOffset + size > fileSize || nameLength != path.size() || memcmp(data + header + HeaderSize, path.data(), nameLength) != 0)
+        return SIZE_MAX;
+    return dataOffset;
 }
 
 ZipByteReader::ZipPtr ZipByteReader::OpenZip()
@@ -52,19 +175,33 @@ void ZipByteReader::Register(size_t seqId, const std::string& path)
     int err = zip_stat(zipFile.get(), path.c_str(), 0, &stat);
     if (ZIP_ER_OK != err)
         RuntimeError("Failed to get file info of %s, zip library error: %s", path.c_str(), GetZipError(err).c_str());
-    m_seqIdToIndex[seqId] = std::make_pair(stat.index, stat.size);
+
+    // Images are usually stored uncompressed, as they are compressed already; these are read from the mapping.
+    ZipEntry entry = { stat.index, stat.size, SIZE_MAX };
+    if ((stat.valid & ZIP_STAT_COMP_METHOD) && stat.comp_method == ZIP_CM_STORE &&
+        (stat.valid & ZIP_STAT_ENCRYPTION_METHOD) && stat.encryption_method == ZIP_EM_NONE)
+    {
+        entry.m_dataOffset = GetDataOffset(stat.index, stat.size, path);
+    }
+    m_seqIdToEntry[seqId] = entry;
     m_zips.push(std::move(zipFile));
 }
 
-cv::Mat ZipByteReader::Read(size_t seqId, const std::string& path, bool grayscale)
+cv::Mat ZipByteReader::Read(size_t seqId, const std::string& path, bool grayscale, size_t minSize)
 {
     // Find index of the file in .zip file.
-    auto r = m_seqIdToIndex.find(seqId);
-    if (r == m_seqIdToIndex.end())
+    auto r = m_seqIdToEntry.find(seqId);
+    if (r == m_seqIdToEntry.end())
         RuntimeError("Could not find file %s in the zip file, sequence id = %lu", path.c_str(), (long)seqId);
 
-    zip_uint64_t index = std::get<0>((*r).second);
-    zip_uint64_t size = std::get<1>((*r).second);
+    const ZipEntry& entry = r->second;
+    if (entry.m_dataOffset != SIZE_MAX)
+    {
+        return Decode(reinterpret_cast<const unsigned char*>(m_file->Data()) + entry.m_dataOffset, entry.m_size, grayscale, minSize);
+    }
+
+    zip_uint64_t index = entry.m_index;
+    zip_uint64_t size = entry.m_size;
 
     auto contents = m_workspace.pop_or_create([size]() { return vector<unsigned char>(size); });
     if (contents.size() < size)
@@ -99,8 +236,7 @@ cv::Mat ZipByteReader::Read(size_t seqId, const std::string& path, bool grayscal
     }
     m_zips.push(std::move(zipFile));
 
-    cv::Mat img; 
-    img = cv::imdecode(cv::Mat(1, (int)size, CV_8UC1, contents.data()), grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+    cv::Mat img = Decode(contents.data(), size, grayscale, minSize);
     assert(nullptr != img.data);
     m_workspace.push(std::move(contents));
     return img;
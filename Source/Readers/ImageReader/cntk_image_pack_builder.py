@@ -0,0 +1,119 @@
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+#
+# Packs the images listed in an ImageReader map file into image packs (see ImagePackFormat.h),
+# which the ImageReader reads chunk by chunk with large sequential reads instead of one file per image.
+
+import argparse
+import random
+import struct
+
+MAGIC = b'CNTKIMP1'
+VERSION = 1
+
+HEADER = struct.Struct('<8sIIQQQQQQ')  # ImagePackHeader
+CHUNK_HEADER = struct.Struct('<QQQQ')  # ImagePackChunkHeader
+RECORD = struct.Struct('<QIIQII')      # ImagePackRecord
+
+
+def read_map_file(map_file):
+    '''Yields (key, image path, class id) as the ImageDataDeserializer parses a map file:
+    'key<TAB>path<TAB>label' or 'path<TAB>label', keyed by the line number.'''
+    with open(map_file, 'r') as f:
+        for line_number, line in enumerate(f):
+            line = line.rstrip('\r\n')
+            columns = line.split('\t')
+            if len(columns) >= 3:
+                key, path, label = columns[0], columns[1], columns[2]
+            elif len(columns) == 2 and columns[0] and columns[1]:
+                key, path, label = str(line_number), columns[0], columns[1]
+            else:
+                raise RuntimeError("Invalid map file format, must contain 2 or 3 tab-delimited columns, line {}".format(line_number))
+            yield key, path, int(label)
+
+
+class PackWriter(object):
+    '''Writes records into chunks of about chunk_size bytes.'''
+
+    def __init__(self, file_out, chunk_size):
+        self.chunk_size = chunk_size
+        self.output = open(file_out, 'wb')
+        self.output.write(b'\0' * HEADER.size)  # written in close()
+        self.chunks = []
+        self.records = []
+        self.keys = []
+        self.key_table_size = 0
+        self.bytes_written = 0
+        self._start_chunk()
+
+    def _start_chunk(self):
+        self.chunk_offset = self.output.tell()
+        self.chunk_first_record = len(self.records)
+        self.chunk_bytes = 0
+
+    def _end_chunk(self):
+        if len(self.records) > self.chunk_first_record:
+            self.chunks.append(CHUNK_HEADER.pack(self.chunk_offset, self.chunk_bytes, self.chunk_first_record,
+                                                 len(self.records) - self.chunk_first_record))
+        self._start_chunk()
+
+    def add(self, key, data, class_id):
+        if self.chunk_bytes > 0 and self.chunk_bytes + len(data) > self.chunk_size:
+            self._end_chunk()
+        key = key.encode('utf-8')
+        self.records.append(RECORD.pack(self.chunk_bytes, len(data), class_id, self.key_table_size, len(key), 0))
+        self.keys.append(key)
+        self.key_table_size += len(key)
+        self.output.write(data)
+        self.chunk_bytes += len(data)
+        self.bytes_written += len(data)
+
+    def close(self):
+        self._end_chunk()
+        chunk_table_offset = self.output.tell()
+        self.output.write(b''.join(self.chunks))
+        record_table_offset = self.output.tell()
+        self.output.write(b''.join(self.records))
+        key_table_offset = self.output.tell()
+        self.output.write(b''.join(self.keys))
+        self.output.seek(0)
+        self.output.write(HEADER.pack(MAGIC, VERSION, 0, len(self.chunks), len(self.records), chunk_table_offset,
+                                      record_table_offset, key_table_offset, self.key_table_size))
+        self.output.close()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Packs the images of an ImageReader map file into image packs")
+    parser.add_argument('-map', '--map_file', required=True, help='map file of the images')
+    parser.add_argument('-out', '--output_file', required=True,
+                        help='output pack; with --shard_size, the list of the shards, which are written to <output>.<n>')
+    parser.add_argument('-c', '--chunk_size', type=int, default=64 * 1024 * 1024,
+                        help='chunk size in bytes, a chunk is read at once and randomized as a whole')
+    parser.add_argument('-s', '--shard_size', type=int, default=0, help='shard size in bytes (0 = a single pack)')
+    parser.add_argument('--no_shuffle', action='store_true',
+                        help='keep the order of the map file (by default, images are shuffled so that chunks mix classes)')
+    parser.add_argument('--seed', type=int, default=0, help='seed of the shuffle')
+    args = parser.parse_args()
+
+    images = list(read_map_file(args.map_file))
+    if not args.no_shuffle:
+        random.Random(args.seed).shuffle(images)
+
+    shards = []
+    writer = None
+    for key, path, class_id in images:
+        if writer is None or (args.shard_size > 0 and writer.bytes_written >= args.shard_size):
+            if writer is not None:
+                writer.close()
+            shard = args.output_file if args.shard_size == 0 else '{}.{}'.format(args.output_file, len(shards))
+            shards.append(shard)
+            writer = PackWriter(shard, args.chunk_size)
+        with open(path, 'rb') as f:
+            writer.add(key, f.read(), class_id)
+    if writer is not None:
+        writer.close()
+
+    if args.shard_size > 0:
+        with open(args.output_file, 'w') as f:
+            f.write(''.join(shard + '\n' for shard in shards))
@@ -146,6 +146,7 @@ void HTKMLFReader<ElemType>::PrepareForSequenceTraining(const ConfigRecordType&
     ElemType acousticScale;
     ElemType lmScale;
     bool oneSilenceClass;
+    size_t numDerivativeThreads;
 
     // Makes sure that "denlats" and "alignments" sections exist.
     if (!readerConfig.Exists(L"denlats"))
@@ -174,6 +175,8 @@ void HTKMLFReader<ElemType>::PrepareForSequenceTraining(const ConfigRecordType&
     acousticScale = denlatConfig(L"acousticScale", 0.2);
     lmScale = denlatConfig(L"lmScale", 1.0);
     oneSilenceClass = denlatConfig(L"oneSilenceClass", true);
+    // derivatives are computed on this many threads, overlapped with the forward pass of the next minibatch (0: synchronously)
+    numDerivativeThreads = denlatConfig(L"numDerivativeThreads", (size_t) std::max(1u, std::thread::hardware_concurrency()));
 
     // Processes "alignments" section.
     const ConfigRecordType& aliConfig = readerConfig(L"alignments");
@@ -227,7 +230,7 @@ void HTKMLFReader<ElemType>::PrepareForSequenceTraining(const ConfigRecordType&
                    "buffering?\n");
     }
     m_uttDerivBuffer = new UtteranceDerivativeBuffer<ElemType>(
-        m_numberOfuttsPerMinibatch, m_seqTrainDeriv);
+        m_numberOfuttsPerMinibatch, m_seqTrainDeriv, numDerivativeThreads);
 }
 
 // Loads input and output data for training and testing. Below we list the
@@ -676,8 +679,8 @@ HTKMLFReader<ElemType>::~HTKMLFReader()
     delete m_mbiter;
     delete m_frameSource;
     delete m_lattices;
+    delete m_uttDerivBuffer; // (first, it waits for the derivatives computed with m_seqTrainDeriv)
     delete m_seqTrainDeriv;
-    delete m_uttDerivBuffer;
 
     foreach_index(i, m_featuresBufferMultiIO)
         delete[] m_featuresBufferMultiIO[i];
@@ -63,27 +63,31 @@ bool KaldiSequenceTrainingDerivative<ElemType>::ComputeDerivative(
                      (int) m_transModel.NumPdfs());
     }
 
-    // Reads alignment.
-    if (!m_aliReader->HasKey(uttIDStr))
+    // Reads alignment and denominator lattice. Only this takes the lock, the
+    // lattice computation below runs concurrently for different utterances.
+    std::vector<int32> ali;
+    kaldi::CompactLattice clat;
     {
-        RuntimeError("Alignment not found for utterance %s\n",
-                     uttIDStr.c_str());
+        std::lock_guard<std::mutex> lock(m_readerMutex);
+        if (!m_aliReader->HasKey(uttIDStr))
+        {
+            RuntimeError("Alignment not found for utterance %s\n",
+                         uttIDStr.c_str());
+        }
+        ali = m_aliReader->Value(uttIDStr);
+        if (!m_denlatReader->HasKey(uttIDStr))
+        {
+            RuntimeError("Denominator lattice not found for utterance %S\n",
+                         uttID.c_str());
+        }
+        clat = m_denlatReader->Value(uttIDStr);
     }
-    const std::vector<int32> ali = m_aliReader->Value(uttIDStr);
     if (ali.size() != logLikelihood.GetNumCols())
     {
         RuntimeError("Number of frames in logLikelihood does not match that"
                      " in the alignment for utterance %S: %d v.s. %d\n",
                      uttID.c_str(), (int) logLikelihood.GetNumCols(), (int) ali.size());
     }
-
-    // Reads denominator lattice.
-    if (!m_denlatReader->HasKey(uttIDStr))
-    {
-        RuntimeError("Denominator lattice not found for utterance %S\n",
-                     uttID.c_str());
-    }
-    kaldi::CompactLattice clat = m_denlatReader->Value(uttIDStr);
     fst::CreateSuperFinal(&clat); /* One final state with weight One() */
     kaldi::Lattice lat;
     fst::ConvertLattice(clat, &lat);
@@ -233,6 +237,7 @@ bool KaldiSequenceTrainingDerivative<ElemType>::HasResourceForDerivative(
     }
 
     std::string uttIDStr = msra::asr::toStr(uttID);
+    std::lock_guard<std::mutex> lock(m_readerMutex);
     if (!m_aliReader->HasKey(uttIDStr) || !m_denlatReader->HasKey(uttIDStr))
     {
         return false;
@@ -22,6 +22,9 @@ private:
     kaldi::TransitionModel m_transModel;
     kaldi::RandomAccessCompactLatticeReader* m_denlatReader;
     kaldi::RandomAccessInt32VectorReader* m_aliReader;
+    // The readers are not thread-safe; ComputeDerivative() may run on several
+    // threads at once, see UtteranceDerivativeBuffer.
+    mutable std::mutex m_readerMutex;
 
     // Rescores the lattice with the lastest posteriors from the neural network.
     void LatticeAcousticRescore(const wstring& uttID,
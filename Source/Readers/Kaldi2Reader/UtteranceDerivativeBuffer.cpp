@@ -1,6 +1,7 @@
 #include "basetypes.h"
 #include "htkfeatio_utils.h"
 #include "UtteranceDerivativeBuffer.h"
+#include <atomic>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -8,7 +9,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 template <class ElemType>
 UtteranceDerivativeBuffer<ElemType>::UtteranceDerivativeBuffer(
     size_t numberOfuttsPerMinibatch,
-    UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface)
+    UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface,
+    size_t numDerivativeThreads)
 {
     assert(derivativeInterface != NULL);
     m_derivativeInterface = derivativeInterface;
@@ -18,6 +20,73 @@ UtteranceDerivativeBuffer<ElemType>::UtteranceDerivativeBuffer(
     m_uttReady.assign(m_numUttsPerMinibatch, false);
     m_epochEnd = false;
     m_dimension = 0;
+    m_numDerivativeThreads = numDerivativeThreads;
+}
+
+template <class ElemType>
+void UtteranceDerivativeBuffer<ElemType>::ComputeDerivatives(
+    const std::vector<shared_ptr<UtteranceDerivativeUnit>>& units,
+    const std::vector<wstring>& uttIDs)
+{
+    assert(units.size() == uttIDs.size());
+    if (units.empty())
+    {
+        return;
+    }
+    if (m_numDerivativeThreads == 0)
+    {
+        for (size_t i = 0; i < units.size(); ++i)
+        {
+            m_derivativeInterface->ComputeDerivative(
+                uttIDs[i], units[i]->logLikelihood,
+                &units[i]->derivative, &units[i]->objective);
+        }
+        return;
+    }
+
+    // One task for the batch, which spreads the utterances over the worker
+    // threads. The caller does not wait for it until GetDerivative().
+    size_t numThreads = std::min(m_numDerivativeThreads, units.size());
+    UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface = m_derivativeInterface;
+    std::shared_future<void> done = std::async(std::launch::async, [units, uttIDs, numThreads, derivativeInterface]()
+    {
+        std::atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < units.size(); i = next++)
+            {
+                derivativeInterface->ComputeDerivative(
+                    uttIDs[i], units[i]->logLikelihood,
+                    &units[i]->derivative, &units[i]->objective);
+            }
+        };
+        std::vector<std::future<void>> workers;
+        for (size_t i = 1; i < numThreads; ++i)
+        {
+            workers.push_back(std::async(std::launch::async, worker));
+        }
+        worker();
+        for (auto& w : workers)
+        {
+            w.get(); // (rethrows errors of the worker)
+        }
+    }).share();
+    for (auto& unit : units)
+    {
+        unit->derivativeDone = done;
+    }
+}
+
+template <class ElemType>
+void UtteranceDerivativeBuffer<ElemType>::WaitForDerivatives()
+{
+    for (auto& iter : m_uttPool)
+    {
+        if (iter.second->derivativeDone.valid())
+        {
+            iter.second->derivativeDone.wait();
+        }
+    }
 }
 
 template <class ElemType>
@@ -98,7 +167,9 @@ bool UtteranceDerivativeBuffer<ElemType>::SetLikelihood(
             logLikelihood.GetDeviceId(), CPUDEVICE, true, false, false);
     }
 
-    size_t currentMBSize = pMBLayout->GetNumTimeSteps();
+    // The utterances this minibatch completes.
+    std::vector<shared_ptr<UtteranceDerivativeUnit>> completedUnits;
+    std::vector<wstring> completedUttIDs;
     for (size_t i = 0; i < uttInfo.size(); ++i)
     {
         assert(uttInfo[i].size() == uttInfoInMinibatch[i].size());
@@ -107,50 +178,49 @@ bool UtteranceDerivativeBuffer<ElemType>::SetLikelihood(
             wstring uttID = uttInfo[i][j].first;
             if (m_uttPool.find(uttID) == m_uttPool.end())
             {
-                UtteranceDerivativeUnit tmpUttUnit;
-                tmpUttUnit.hasDerivative = false;
-                tmpUttUnit.uttLength = uttInfo[i][j].second;
-                tmpUttUnit.progress = 0;
-                tmpUttUnit.streamID = i;
-                tmpUttUnit.logLikelihood.Resize(logLikelihood.GetNumRows(),
-                                                tmpUttUnit.uttLength);
-                m_uttPool[uttID] = std::move(tmpUttUnit);
+                auto tmpUttUnit = make_shared<UtteranceDerivativeUnit>();
+                tmpUttUnit->hasDerivative = false;
+                tmpUttUnit->uttLength = uttInfo[i][j].second;
+                tmpUttUnit->progress = 0;
+                tmpUttUnit->streamID = i;
+                tmpUttUnit->logLikelihood.Resize(logLikelihood.GetNumRows(),
+                                                 tmpUttUnit->uttLength);
+                m_uttPool[uttID] = tmpUttUnit;
             }
 
             // Sets the likelihood and computes derivatives.
             assert(m_uttPool.find(uttID) != m_uttPool.end());
-            if (m_uttPool[uttID].hasDerivative == false)
+            if (m_uttPool[uttID]->hasDerivative == false)
             {
                 assert(uttID == uttInfoInMinibatch[i][j].first);
                 size_t startFrame = uttInfoInMinibatch[i][j].second.first;
                 size_t numFrames = uttInfoInMinibatch[i][j].second.second;
-                assert(m_uttPool[uttID].progress + numFrames <= m_uttPool[uttID].uttLength);
+                assert(m_uttPool[uttID]->progress + numFrames <= m_uttPool[uttID]->uttLength);
 
                 // Sets the likelihood.
                 for (size_t k = 0; k < numFrames; ++k)
                 {
-                    m_uttPool[uttID].logLikelihood.SetColumn(
+                    m_uttPool[uttID]->logLikelihood.SetColumn(
                         logLikelihood.ColumnSlice(
                             (startFrame + k) * m_numUttsPerMinibatch + i, 1),
-                        m_uttPool[uttID].progress + k);
+                        m_uttPool[uttID]->progress + k);
                 }
 
-                m_uttPool[uttID].progress += numFrames;
-                if (m_uttPool[uttID].progress == m_uttPool[uttID].uttLength)
+                m_uttPool[uttID]->progress += numFrames;
+                if (m_uttPool[uttID]->progress == m_uttPool[uttID]->uttLength)
                 {
-                    m_derivativeInterface->ComputeDerivative(
-                        uttID,
-                        m_uttPool[uttID].logLikelihood,
-                        &m_uttPool[uttID].derivative,
-                        &m_uttPool[uttID].objective);
-                    m_uttPool[uttID].hasDerivative = true;
-                    m_uttPool[uttID].progress = 0;
-                    m_uttReady[m_uttPool[uttID].streamID] = true;
+                    completedUnits.push_back(m_uttPool[uttID]);
+                    completedUttIDs.push_back(uttID);
+                    m_uttPool[uttID]->hasDerivative = true;
+                    m_uttPool[uttID]->progress = 0;
+                    m_uttReady[m_uttPool[uttID]->streamID] = true;
                 }
             }
         }
     }
 
+    ComputeDerivatives(completedUnits, completedUttIDs);
+
     // Checks if we are ready to provide derivatives.
     m_needLikelihood = false;
     for (size_t i = 0; i < m_uttReady.size(); ++i)
@@ -191,29 +261,35 @@ bool UtteranceDerivativeBuffer<ElemType>::GetDerivative(
             wstring uttID = uttInfo[i][j].first;
 
             // Checks if we have derivatives.
-            if (m_uttPool.find(uttID) == m_uttPool.end() || (m_uttPool.find(uttID) != m_uttPool.end() && m_uttPool[uttID].hasDerivative == false))
+            if (m_uttPool.find(uttID) == m_uttPool.end() || (m_uttPool.find(uttID) != m_uttPool.end() && m_uttPool[uttID]->hasDerivative == false))
             {
                 RuntimeError("Derivatives are not ready for utterance:"
                              " %S\n",
                              uttID.c_str());
             }
 
+            // Waits for the derivatives if they are computed on a worker thread.
+            if (m_uttPool[uttID]->derivativeDone.valid())
+            {
+                m_uttPool[uttID]->derivativeDone.get();
+            }
+
             // Assign the derivatives.
             assert(uttID == uttInfoInMinibatch[i][j].first);
             size_t startFrame = uttInfoInMinibatch[i][j].second.first;
-            size_t startFrameInUtt = m_uttPool[uttID].progress;
+            size_t startFrameInUtt = m_uttPool[uttID]->progress;
             size_t numFrames = uttInfoInMinibatch[i][j].second.second;
             for (size_t k = 0; k < numFrames; ++k)
             {
                 derivatives.SetColumn(
-                    m_uttPool[uttID].derivative.ColumnSlice(
+                    m_uttPool[uttID]->derivative.ColumnSlice(
                         startFrameInUtt + k, 1),
                     (startFrame + k) * m_numUttsPerMinibatch + i);
             }
-            m_currentObj += m_uttPool[uttID].objective * numFrames / m_uttPool[uttID].uttLength;
-            m_uttPool[uttID].progress += numFrames;
-            assert(m_uttPool[uttID].progress <= m_uttPool[uttID].uttLength);
-            if (m_uttPool[uttID].progress == m_uttPool[uttID].uttLength)
+            m_currentObj += m_uttPool[uttID]->objective * numFrames / m_uttPool[uttID]->uttLength;
+            m_uttPool[uttID]->progress += numFrames;
+            assert(m_uttPool[uttID]->progress <= m_uttPool[uttID]->uttLength);
+            if (m_uttPool[uttID]->progress == m_uttPool[uttID]->uttLength)
             {
                 m_uttPool.erase(uttID);
             }
@@ -312,6 +388,7 @@ void UtteranceDerivativeBuffer<ElemType>::ResetEpoch()
     m_needLikelihood = true;
     m_currentObj = 0;
     m_epochEnd = false;
+    WaitForDerivatives();
     m_uttPool.clear();
     m_currentUttInfo.clear();
     m_uttReady.assign(m_numUttsPerMinibatch, false);
@@ -4,12 +4,18 @@
 #include "basetypes.h"
 #include "Sequences.h"
 #include "UtteranceDerivativeComputationInterface.h"
+#include <future>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // This class "gules" together the log-likelihood from different minibatches,
 // and then calls <UtteranceDerivativeComputationInterface> class to compute
 // the derivative for given utterance.
+//
+// With <numDerivativeThreads> > 0, the derivatives of the utterances that a
+// minibatch completes are computed on that many worker threads, while the
+// caller goes on with the forward pass of the next minibatch. GetDerivative()
+// waits for the derivatives it hands out.
 template <class ElemType>
 class UtteranceDerivativeBuffer
 {
@@ -23,6 +29,7 @@ private:
         Matrix<ElemType> logLikelihood;
         Matrix<ElemType> derivative;
         ElemType objective;
+        std::shared_future<void> derivativeDone; // (only valid while computed on a worker thread)
 
         UtteranceDerivativeUnit()
             : logLikelihood(CPUDEVICE), derivative(CPUDEVICE)
@@ -42,8 +49,17 @@ private:
     ElemType m_currentObj;
     std::vector<bool> m_uttReady;
     std::vector<std::vector<std::pair<wstring, size_t>>> m_currentUttInfo;
-    unordered_map<wstring, UtteranceDerivativeUnit> m_uttPool;
+    // (units are held by pointer, since the worker threads write into them while the pool rehashes)
+    unordered_map<wstring, shared_ptr<UtteranceDerivativeUnit>> m_uttPool;
     UtteranceDerivativeComputationInterface<ElemType>* m_derivativeInterface;
+    size_t m_numDerivativeThreads;
+
+    // Computes the derivatives of <units>, on worker threads if enabled.
+    void ComputeDerivatives(const std::vector<shared_ptr<UtteranceDerivativeUnit>>& units,
+                            const std::vector<wstring>& uttIDs);
+
+    // Waits for all derivatives that are being computed.
+    void WaitForDerivatives();
 
     // <uttInfoInMinibatch> is a vector of vector of the following:
     //     uttID startFrameIndexInMinibatch numFrames
@@ -59,14 +75,17 @@ private:
 
 public:
     // Constructor.
-    // Does not take ownership of <derivativeInterface>.
+    // Does not take ownership of <derivativeInterface>, which must be
+    // thread-safe if <numDerivativeThreads> > 0.
     UtteranceDerivativeBuffer(
         size_t numberOfuttsPerMinibatch,
-        UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface);
+        UtteranceDerivativeComputationInterface<ElemType>* derivativeInterface,
+        size_t numDerivativeThreads = 0);
 
     // Destructor.
     ~UtteranceDerivativeBuffer()
     {
+        WaitForDerivatives();
     }
 
     bool NeedLikelihoodToComputeDerivative() const
@@ -10,6 +10,7 @@
 #define DATAWRITER_EXPORTS
 #include "SequenceReader.h"
 #include "SequenceWriter.h"
+#include "WordSequenceDeserializer.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -31,4 +32,18 @@ extern "C" DATAWRITER_API void GetWriterD(IDataWriter** pwriter)
     *pwriter = new LMSequenceWriter<double>();
 }
 
+// A factory method for creating the deserializer of the text format of this reader (a sentence per line),
+// for use with the composite reader.
+extern "C" DATAREADER_API bool CreateDeserializer(IDataDeserializer** deserializer, const std::wstring& type, const ConfigParameters& deserializerConfig, CorpusDescriptorPtr corpus, bool)
+{
+    if (type == L"LMSequenceDeserializer")
+        *deserializer = new WordSequenceDeserializer(corpus, deserializerConfig, WordSequenceDeserializer::Format::sentencePerLine);
+    else
+        // Unknown type.
+        return false;
+
+    // Deserializer created.
+    return true;
+}
+
 }}}
@@ -10,6 +10,7 @@
 #define DATAWRITER_EXPORTS
 #include "LUSequenceReader.h"
 #include "LUSequenceWriter.h"
+#include "WordSequenceDeserializer.h"
 
 #ifdef _MSC_VER
 #include <codecvt>
@@ -57,4 +58,18 @@ extern "C" DATAWRITER_API void GetWriterD(IDataWriter** pwriter)
     *pwriter = new LUSequenceWriter<double>();
 }
 
+// A factory method for creating the deserializer of the text format of this reader (a word and its label per line),
+// for use with the composite reader.
+extern "C" DATAREADER_API bool CreateDeserializer(IDataDeserializer** deserializer, const std::wstring& type, const ConfigParameters& deserializerConfig, CorpusDescriptorPtr corpus, bool)
+{
+    if (type == L"LUSequenceDeserializer")
+        *deserializer = new WordSequenceDeserializer(corpus, deserializerConfig, WordSequenceDeserializer::Format::wordPerLine);
+    else
+        // Unknown type.
+        return false;
+
+    // Deserializer created.
+    return true;
+}
+
 }}}
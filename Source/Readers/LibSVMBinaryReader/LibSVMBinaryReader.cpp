@@ -49,6 +49,7 @@ template <class ElemType>
 void DenseBinaryMatrix<ElemType>::Clear()
 {
     this->m_numRows = 0;
+    this->m_viewValues = nullptr;
 }
 
 template <class ElemType>
@@ -65,7 +66,8 @@ void DenseBinaryMatrix<ElemType>::Dispose()
 template <class ElemType>
 void DenseBinaryMatrix<ElemType>::Fill(Matrix<ElemType>* matrix)
 {
-    matrix->SetValue(this->m_maxNumCols, this->m_numRows, matrix->GetDeviceId(), this->m_values, matrixFlagNormal);
+    ElemType* values = this->m_viewValues != nullptr ? this->m_viewValues : this->m_values;
+    matrix->SetValue(this->m_maxNumCols, this->m_numRows, matrix->GetDeviceId(), values, matrixFlagNormal);
 #if DEBUG
     matrix->Print("testname");
 #endif
@@ -99,9 +101,17 @@ void DenseBinaryMatrix<ElemType>::AddValues(void* values, size_t numRows)
     this->m_numRows += numRows;
 }
 
+template <class ElemType>
+void DenseBinaryMatrix<ElemType>::SetView(void* values, void* /*rowIndices*/, void* /*colIndices*/, size_t /*nnz*/, size_t numRows)
+{
+    assert(this->m_numRows == 0);
+    this->m_viewValues = (ElemType*) values;
+    this->m_numRows = numRows;
+}
+
 template <class ElemType>
 SparseBinaryMatrix<ElemType>::SparseBinaryMatrix(wstring name, int deviceId, size_t numRows, size_t numCols)
-    : BinaryMatrix<ElemType>(name, deviceId, numRows, numCols), m_rowIndices(nullptr), m_colIndices(nullptr), m_nnz(0), m_maxNNz(0)
+    : BinaryMatrix<ElemType>(name, deviceId, numRows, numCols), m_rowIndices(nullptr), m_colIndices(nullptr), m_viewRowIndices(nullptr), m_viewColIndices(nullptr), m_nnz(0), m_maxNNz(0)
 {
     // m_colIndices = (int32_t*)malloc(sizeof(int32_t)*(numRows + 1));
     m_colIndices = (int32_t*) CUDAPageLockedMemAllocator::Malloc(sizeof(int32_t) * (numRows + 1), deviceId);
@@ -191,6 +201,9 @@ void SparseBinaryMatrix<ElemType>::Clear()
 {
     m_numRows = 0;
     m_nnz = 0;
+    m_viewRowIndices = nullptr;
+    m_viewColIndices = nullptr;
+    this->m_viewValues = nullptr;
 }
 
 template <class ElemType>
@@ -215,10 +228,25 @@ void SparseBinaryMatrix<ElemType>::AddRowIndices(void* rowIndices, size_t nnz)
     memcpy(m_rowIndices + this->m_nnz, rowIndices, sizeof(int32_t) * nnz);
 }
 
+template <class ElemType>
+void SparseBinaryMatrix<ElemType>::SetView(void* values, void* rowIndices, void* colIndices, size_t nnz, size_t numRows)
+{
+    assert(m_numRows == 0 && m_nnz == 0);
+    // the column indices of a microbatch start at 0, so they are used as they are
+    this->m_viewValues = (ElemType*) values;
+    m_viewRowIndices = (int32_t*) rowIndices;
+    m_viewColIndices = (int32_t*) colIndices;
+    m_nnz = nnz;
+    m_numRows = numRows;
+}
+
 template <class ElemType>
 void SparseBinaryMatrix<ElemType>::Fill(Matrix<ElemType>* matrix)
 {
-    matrix->SetMatrixFromCSCFormat(m_colIndices, m_rowIndices, this->m_values, this->m_nnz, this->m_maxNumCols, this->m_numRows);
+    if (this->m_viewValues != nullptr)
+        matrix->SetMatrixFromCSCFormat(m_viewColIndices, m_viewRowIndices, this->m_viewValues, this->m_nnz, this->m_maxNumCols, this->m_numRows);
+    else
+        matrix->SetMatrixFromCSCFormat(m_colIndices, m_rowIndices, this->m_values, this->m_nnz, this->m_maxNumCols, this->m_numRows);
 #if DEBUG
     matrix->Print("testname");
 #endif
@@ -228,8 +256,8 @@ template <class ElemType>
 SparseBinaryInput<ElemType>::SparseBinaryInput(std::wstring fileName)
     : m_fileName(fileName), m_readOrder(nullptr), m_readOrderLength(0), m_randomize(false), m_tempValues(nullptr), m_tempValuesSize(0), m_offsets(nullptr), m_offsetsStart(0), m_startMB(0), m_endMB(0)
 {
-    std::string name = msra::strfun::utf8(m_fileName);
-    m_inFile.open(name, ifstream::binary | ifstream::in);
+    m_file = make_shared<MappedFile>(m_fileName);
+    m_fileSize = m_file->Size();
 }
 
 template <class ElemType>
@@ -242,20 +270,15 @@ void SparseBinaryInput<ElemType>::Init(std::map<std::wstring, std::wstring> rena
 {
 
     size_t base_offset = 0;
-    m_inFile.seekg(0, ifstream::beg);
-    m_inFile.read((char*) &m_numRows, sizeof(int64_t));
-    base_offset += sizeof(int64_t);
+    ReadValue(base_offset, &m_numRows, sizeof(int64_t));
 
-    m_inFile.read((char*) &m_numBatches, sizeof(int64_t));
-    base_offset += sizeof(int64_t);
+    ReadValue(base_offset, &m_numBatches, sizeof(int64_t));
 
     int32_t numFeatures;
     int32_t numLabels;
-    m_inFile.read((char*) &numFeatures, sizeof(int32_t));
-    base_offset += sizeof(int32_t);
+    ReadValue(base_offset, &numFeatures, sizeof(int32_t));
 
-    m_inFile.read((char*) &numLabels, sizeof(int32_t));
-    base_offset += sizeof(int32_t);
+    ReadValue(base_offset, &numLabels, sizeof(int32_t));
 
     int32_t len;
     int32_t numCols;
@@ -263,16 +286,15 @@ void SparseBinaryInput<ElemType>::Init(std::map<std::wstring, std::wstring> rena
     char* tempName = (char*) malloc(maxLen);
     for (int32_t c = 0; c < numFeatures; c++)
     {
-        m_inFile.read((char*) &len, sizeof(int32_t));
+        ReadValue(base_offset, &len, sizeof(int32_t));
         if (len + 1 > maxLen)
         {
             maxLen = len + 1;
             free(tempName);
             tempName = (char*) malloc(maxLen);
         }
-        base_offset += sizeof(int32_t);
 
-        m_inFile.read((char*) tempName, len);
+        ReadValue(base_offset, tempName, len);
         tempName[len] = '\0';
         // std::string name((char*)header_buffer + base_offset, len);
         std::wstring wname = msra::strfun::utf16(tempName);
@@ -284,27 +306,24 @@ void SparseBinaryInput<ElemType>::Init(std::map<std::wstring, std::wstring> rena
         {
             m_features.emplace_back(rename[wname]);
         }
-        base_offset += sizeof(int8_t) * len;
 
-        m_inFile.read((char*) &numCols, sizeof(numCols));
+        ReadValue(base_offset, &numCols, sizeof(numCols));
         // numCols = *(int32_t*)((char*)header_buffer + base_offset);
-        base_offset += sizeof(int32_t);
 
         m_mappedNumCols[m_features.back()] = numCols;
     }
     for (int32_t c = 0; c < numLabels; c++)
     {
-        m_inFile.read((char*) &len, sizeof(int32_t));
+        ReadValue(base_offset, &len, sizeof(int32_t));
         if (len + 1 > maxLen)
         {
             maxLen = len + 1;
             free(tempName);
             tempName = (char*) malloc(maxLen);
         }
-        base_offset += sizeof(int32_t);
 
         // std::string name((char*)header_buffer + base_offset, len);
-        m_inFile.read((char*) tempName, len);
+        ReadValue(base_offset, tempName, len);
         tempName[len] = '\0';
         std::wstring wname = msra::strfun::utf16(tempName);
         if (rename.find(wname) == rename.end())
@@ -316,11 +335,9 @@ void SparseBinaryInput<ElemType>::Init(std::map<std::wstring, std::wstring> rena
             // m_features.emplace_back(rename[wname]);
             m_labels.emplace_back(rename[wname]);
         }
-        base_offset += sizeof(int8_t) * len;
 
         // numCols = *(int32_t*)((char*)header_buffer + base_offset);
-        m_inFile.read((char*) &numCols, sizeof(numCols));
-        base_offset += sizeof(int32_t);
+        ReadValue(base_offset, &numCols, sizeof(numCols));
         m_mappedNumCols[m_labels.back()] = numCols;
     }
     free(tempName);
@@ -329,14 +346,20 @@ void SparseBinaryInput<ElemType>::Init(std::map<std::wstring, std::wstring> rena
     m_dataStart = m_offsetsStart + m_numBatches * sizeof(int64_t);
 
     /*Read in the microbatch size here*/
-    m_inFile.seekg(m_dataStart, ios::beg);
-    m_inFile.read((char*) &m_microBatchSize, sizeof(int32_t));
+    size_t offset = m_dataStart;
+    ReadValue(offset, &m_microBatchSize, sizeof(int32_t));
     m_mbSize = (size_t) m_microBatchSize;
+}
 
-    m_inFile.seekg(0, ios::end);
-    m_fileSize = (size_t) m_inFile.tellg();
-    
-    m_maxMBSize = 0;
+template <class ElemType>
+void SparseBinaryInput<ElemType>::ReadValue(size_t& offset, void* value, size_t size)
+{
+    if (offset + size > m_fileSize)
+    {
+        RuntimeError("LibSVMBinaryReader: Unexpected end of the file %ls.", m_fileName.c_str());
+    }
+    memcpy(value, m_file->Data() + offset, size);
+    offset += size;
 }
 
 template <class ElemType>
@@ -378,15 +401,15 @@ void SparseBinaryInput<ElemType>::ReadOffsets(size_t startMB, size_t numMBs)
         free(m_offsets);
     }
     m_offsets = (int64_t*) malloc(sizeof(int64_t) * (numMBs + 1));
-    m_inFile.seekg(m_offsetsStart + startMB * sizeof(int64_t), ios::beg);
-    m_inFile.read((char*) &(m_offsets[0]), sizeof(int64_t) * numMBs);
+    size_t offset = m_offsetsStart + startMB * sizeof(int64_t);
+    ReadValue(offset, &(m_offsets[0]), sizeof(int64_t) * numMBs);
     if (startMB + numMBs < m_numBatches)
     {
-        m_inFile.read((char*) &(m_offsets[numMBs]), sizeof(int64_t));
+        ReadValue(offset, &(m_offsets[numMBs]), sizeof(int64_t));
     }
     else
     {
-        m_offsets[numMBs] = m_fileSize;
+        m_offsets[numMBs] = m_fileSize - m_dataStart;
     }
     m_startMB = startMB;
     m_endMB = startMB + numMBs;
@@ -438,36 +461,13 @@ void SparseBinaryInput<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, s
 
     ReadOffsets(startMB, m_windowSize);
 
-    size_t maxMBSize = 0;
-    for (size_t c = 0; c < m_windowSize; c++)
+    // the data of the first microbatch, the later ones are prefetched while the current one is filled
+    if (m_windowSize > 0)
     {
-        maxMBSize = max(maxMBSize, (size_t)(m_offsets[c + 1] - m_offsets[c]));
-        // fprintf(stderr, "m_offsets[%lu] = %lu\n", c, m_offsets[c]);
+        m_file->Prefetch(m_dataStart + m_offsets[m_readOrder[0]], (size_t)(m_offsets[m_readOrder[0] + 1] - m_offsets[m_readOrder[0]]));
     }
-    if (maxMBSize > m_maxMBSize)
-    {
-        m_maxMBSize = maxMBSize;
-        while (m_dataToProduce.size() > 0)
-        {
-            free(m_dataToProduce.pop());
-        }
-        // fprintf(stderr, "max mb size: %ld\n", m_maxMBSize);
-
-        size_t maxMem = 1024 * 1024 * 1024; // 1GB
-        size_t maxPointers = maxMem / m_maxMBSize;
-        for (size_t c = 0; c < maxPointers; c++)
-        {
-            void* dataBuffer = malloc(m_maxMBSize);
-            m_dataToProduce.push(dataBuffer);
-        }
-    }
-
-    std::thread readData([this]
-                         {
-                             this->ReadMinibatches(m_readOrder, m_readOrderLength);
-                         });
-    readData.detach();
 }
+
 template <class ElemType>
 void* SparseBinaryInput<ElemType>::GetTempDataPointer(size_t numBytes)
 {
@@ -503,55 +503,7 @@ shared_ptr<BinaryMatrix<ElemType>> SparseBinaryInput<ElemType>::CreateMatrix(std
 }
 
 template <class ElemType>
-void SparseBinaryInput<ElemType>::ReadMinibatches(size_t* read_order, size_t numToRead)
-{
-#if DEBUG
-    marker_series series(L"Read Minibatches");
-    // diagnostic::span span(series, L"Reading Data");
-    span* read_span;
-#endif
-    for (size_t c = 0; c < numToRead; c++)
-    {
-#if DEBUG
-        read_span = new span(series, 1, L"Getting Buffer %ld\n", c);
-#endif
-        // fprintf(stderr, "start reading data %ld\n", c);
-        size_t readSize = m_offsets[read_order[c] + 1] - m_offsets[read_order[c]];
-//void* data_buffer = GetTempDataPointer(readSize);
-#if DEBUG
-        series.write_flag(_T("Getting buffer."));
-#endif
-        void* data_buffer = m_dataToProduce.pop();
-#if DEBUG
-        delete read_span;
-        series.write_flag(_T("Got buffer."));
-        read_span = new span(series, 2, L"Reading Data %ld\n", c);
-#endif
-
-        m_inFile.clear();
-#if DEBUG
-        series.write_flag(_T("seeking."));
-#endif
-        m_inFile.seekg(m_dataStart + m_offsets[c], ios::beg);
-#if DEBUG
-        series.write_flag(_T("reading."));
-#endif
-        m_inFile.read((char*) data_buffer, readSize);
-        m_dataToConsume.push(data_buffer);
-//fprintf(stderr, "done reading data %ld\n", c);
-#if DEBUG
-        series.write_flag(_T("Done read, pushed buffer."));
-        delete read_span;
-#endif
-    }
-//m_dataToConsume.push(nullptr);
-#if DEBUG
-    series.write_flag(_T("Done reading."));
-#endif
-}
-
-template <class ElemType>
-size_t SparseBinaryInput<ElemType>::ReadMinibatch(void* data_buffer, std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices)
+size_t SparseBinaryInput<ElemType>::ReadMinibatch(void* data_buffer, std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices, bool asView)
 {
 
     // fprintf(stderr, "start read minibatch.\n");
@@ -593,11 +545,18 @@ size_t SparseBinaryInput<ElemType>::ReadMinibatch(void* data_buffer, std::map<st
         if (findMat != matrices.end())
         {
             auto mat = findMat->second;
-            mat->ResizeArrays(nnz);
-            mat->AddValues(vals, nnz);
-            mat->AddRowIndices(rowIndices, nnz);
-            mat->AddColIndices(colIndices, curMBSize + 1);
-            mat->UpdateNNz(nnz);
+            if (asView)
+            {
+                mat->SetView(vals, rowIndices, colIndices, nnz, curMBSize);
+            }
+            else
+            {
+                mat->ResizeArrays(nnz);
+                mat->AddValues(vals, nnz);
+                mat->AddRowIndices(rowIndices, nnz);
+                mat->AddColIndices(colIndices, curMBSize + 1);
+                mat->UpdateNNz(nnz);
+            }
 #ifdef DEBUG
             mat->Print("features");
 #endif
@@ -616,7 +575,10 @@ size_t SparseBinaryInput<ElemType>::ReadMinibatch(void* data_buffer, std::map<st
         if (findMat != matrices.end())
         {
             auto mat = findMat->second;
-            mat->AddValues(vals, curMBSize);
+            if (asView)
+                mat->SetView(vals, nullptr, nullptr, 0, curMBSize);
+            else
+                mat->AddValues(vals, curMBSize);
 #ifdef DEBUG
             mat->Print("labels");
 #endif
@@ -636,22 +598,28 @@ size_t SparseBinaryInput<ElemType>::FillMatrices(std::map<std::wstring, shared_p
         mat.second->SetMaxRows(m_mbSize);
         mat.second->Clear();
     }
-    void* data_buffer;
     // fprintf(stderr, "start while\n");
-    // clock_t start_w = clock();
-    // while (curSize + m_microBatchSize <= m_mbSize && (data_buffer = m_dataToConsume.pop()) != nullptr) {
     while (curSize + m_microBatchSize <= m_mbSize && m_nextMB < m_epochSize)
     {
-        data_buffer = m_dataToConsume.pop();
-        // clock_t in_w = clock();
-        // start_w = in_w - start_w;
-        // fprintf(stderr, "start read mb\tIt took me %d clicks (%f seconds).\n", start_w, ((float)start_w) / CLOCKS_PER_SEC);
-        // start_w = in_w;
-        // fprintf(stderr, "start read mb\n");
-        curSize += ReadMinibatch(data_buffer, matrices);
-        // fprintf(stderr, "end read mb\n");
+        size_t mb = m_readOrder[m_nextMB];
+        size_t begin = m_dataStart + m_offsets[mb];
+        size_t end = m_dataStart + m_offsets[mb + 1];
+        if (end > m_fileSize || begin > end)
+        {
+            RuntimeError("LibSVMBinaryReader: The microbatch %d is outside of the file %ls.", (int) (m_startMB + mb), m_fileName.c_str());
+        }
+        if (m_nextMB + 1 < m_epochSize)
+        {
+            size_t next = m_readOrder[m_nextMB + 1];
+            m_file->Prefetch(m_dataStart + m_offsets[next], (size_t) (m_offsets[next + 1] - m_offsets[next]));
+        }
+
+        // a minibatch of a single microbatch (the usual case, the minibatch size of the config must match the file)
+        // refers to the mapped file, otherwise the microbatches are gathered in the buffers of the matrices
+        bool asView = curSize == 0 && 2 * (size_t) m_microBatchSize > m_mbSize;
+        void* data_buffer = (void*) (m_file->Data() + begin);
+        curSize += ReadMinibatch(data_buffer, matrices, asView);
         m_nextMB++;
-        m_dataToProduce.push(data_buffer);
     }
     // fprintf(stderr, "end fill matrices\n");
     return curSize;
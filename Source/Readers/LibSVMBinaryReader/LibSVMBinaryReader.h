@@ -9,6 +9,7 @@
 #include "DataReader.h"
 #include "DataWriter.h"
 #include "RandomOrdering.h"
+#include "MappedFile.h"
 #include <string>
 #include <map>
 #include <vector>
@@ -25,51 +26,12 @@ using namespace Concurrency::diagnostic;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-template <typename T>
-class BlockingQueue
-{
-private:
-    std::mutex d_mutex;
-    std::condition_variable d_condition;
-    std::deque<T> d_queue;
-
-public:
-    void release()
-    {
-        while (!d_queue.empty())
-            free(d_queue.pop_front());
-    }
-    size_t size()
-    {
-        return d_queue.size();
-    }
-    void push(T const& value)
-    {
-        {
-            std::unique_lock<std::mutex> lock(this->d_mutex);
-            d_queue.push_front(value);
-        }
-        this->d_condition.notify_one();
-    }
-    T pop()
-    {
-        std::unique_lock<std::mutex> lock(this->d_mutex);
-        this->d_condition.wait(lock, [=]
-                               {
-                                   return !this->d_queue.empty();
-                               });
-        T rc(std::move(this->d_queue.back()));
-        this->d_queue.pop_back();
-        return rc;
-    }
-};
-
 template <class ElemType>
 class BinaryMatrix
 {
 public:
     BinaryMatrix(wstring name, int deviceID, size_t numRows, size_t numCols)
-        : m_matrixName(name), m_deviceID(deviceID), m_maxNumRows(numRows), m_numRows(0), m_maxNumCols(numCols), m_values(nullptr){};
+        : m_matrixName(name), m_deviceID(deviceID), m_maxNumRows(numRows), m_numRows(0), m_maxNumCols(numCols), m_values(nullptr), m_viewValues(nullptr){};
     // BinaryMatrix(wstring name, size_t numRows, size_t numCols) : m_matrixName(name), m_maxNumRows(numRows), m_numRows(0), m_maxNumCols(numCols), m_values(nullptr) {};
     virtual void Clear() = 0;
     virtual void Dispose() = 0;
@@ -77,6 +39,9 @@ public:
     virtual void AddValues(void*, size_t) = 0;
     virtual void AddColIndices(void*, size_t) = 0;
     virtual void AddRowIndices(void*, size_t) = 0;
+    // Refers to a microbatch of the mapped file instead of copying it; the matrix then holds just that microbatch
+    // until it is cleared. The dense matrices use the values only.
+    virtual void SetView(void* values, void* rowIndices, void* colIndices, size_t nnz, size_t numRows) = 0;
     virtual void UpdateNNz(size_t) = 0;
     virtual void UpdateCurMB(size_t mb)
     {
@@ -89,6 +54,7 @@ protected:
     wstring m_matrixName;
     int m_deviceID;
     ElemType* m_values;
+    ElemType* m_viewValues; // in the mapped file, or nullptr if the values are copied to m_values
     size_t m_maxNumRows;
     size_t m_maxNumCols;
 
@@ -105,6 +71,7 @@ public:
     virtual void Dispose();
     virtual void Fill(Matrix<ElemType>* matrix) override;
     virtual void AddValues(void* values, size_t numRows) override;
+    virtual void SetView(void* values, void* /*rowIndices*/, void* /*colIndices*/, size_t /*nnz*/, size_t numRows) override;
     virtual void AddColIndices(void* /*colIndices*/, size_t /*numCols*/) override
     {
         NOT_IMPLEMENTED
@@ -140,6 +107,7 @@ public:
     virtual void AddValues(void* values, size_t nnz) override;
     virtual void AddColIndices(void* colIndices, size_t numCols) override;
     virtual void AddRowIndices(void* rowIndices, size_t nnz) override;
+    virtual void SetView(void* values, void* rowIndices, void* colIndices, size_t nnz, size_t numRows) override;
     virtual void UpdateNNz(size_t nnz) override
     {
         m_nnz += nnz;
@@ -150,6 +118,8 @@ public:
 protected:
     int32_t* m_rowIndices;
     int32_t* m_colIndices;
+    int32_t* m_viewRowIndices; // in the mapped file, if the matrix is a view
+    int32_t* m_viewColIndices;
     size_t m_nnz;
     size_t m_maxNNz;
 };
@@ -162,8 +132,7 @@ public:
     ~SparseBinaryInput();
     void Init(std::map<std::wstring, std::wstring> rename);
     void StartDistributedMinibatchLoop(size_t mbSize, size_t subsetNum, size_t numSubsets);
-    void ReadMinibatches(size_t* read_order, size_t numToRead);
-    size_t ReadMinibatch(void* data_buffer, std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices);
+    size_t ReadMinibatch(void* data_buffer, std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices, bool asView);
     size_t FillMatrices(std::map<std::wstring, shared_ptr<BinaryMatrix<ElemType>>>& matrices);
     size_t GetMBSize()
     {
@@ -179,12 +148,16 @@ public:
     virtual bool DataEnd();
 
 private:
+    // Copies the header value at the offset of the mapped file and advances the offset.
+    void ReadValue(size_t& offset, void* value, size_t size);
     void ReadOffsets(size_t startMB, size_t numMBs);
     void FillReadOrder(size_t windowSize);
     void* GetTempDataPointer(size_t numVals);
     bool Randomize();
 
-    ifstream m_inFile;
+    // The whole file is mapped, the microbatches are parsed in place and handed out as views where possible,
+    // so that they are not copied to reader buffers before the upload to the matrices.
+    MappedFilePtr m_file;
     std::wstring m_fileName;
     size_t m_fileSize;
 
@@ -214,7 +187,6 @@ private:
     bool m_randomize;
     size_t* m_readOrder; // array to shuffle to reorder the dataset
     size_t m_readOrderLength;
-    size_t m_maxMBSize;
 
     std::vector<std::wstring> m_features;
     std::vector<std::wstring> m_labels;
@@ -225,13 +197,6 @@ private:
 
     RandomOrdering m_randomordering; // randomizing class
     std::mt19937_64 m_randomEngine;
-#ifdef _WIN32
-    DWORD sysGran;
-#else
-    int32_t sysGran;
-#endif
-    BlockingQueue<void*> m_dataToProduce;
-    BlockingQueue<void*> m_dataToConsume;
 };
 
 template <class ElemType>
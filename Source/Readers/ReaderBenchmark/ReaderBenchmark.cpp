@@ -0,0 +1,206 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ReaderBenchmark.cpp -- drives a reader configuration through the reader plugins with no network attached
+//
+// Tells whether a job is bound by the reader: it reads the configured epochs as fast as the reader delivers them and
+// reports the throughput, the latencies of the reader stages and the time spent waiting for chunks, for each combination
+// of CPU thread count and prefetch depths. Takes the same command line as cntk, e.g.
+//
+//   readerbenchmark configFile=train.cntk readerSection=train:reader inputs=features:labels numCPUThreads=1:4:8 prefetchQueueSize=1:4
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "Config.h"
+#include "DataReader.h"
+#include "EventTracer.h"
+#include "Matrix.h"
+#include "CPUMatrix.h"
+#include "Sequences.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Microsoft::MSR::CNTK;
+
+// the stages recorded by the reader (see the EventTracer scopes in ReaderLib), and the time the consumer waits
+static const char* s_stages[] = { "GetMinibatch", "Deserialize", "ChunkLoad", "ChunkPrefetch", "Transform", "Pack", "PrefetchQueueWait" };
+
+struct BenchmarkResult
+{
+    size_t m_numMinibatches = 0;
+    size_t m_numSamples = 0;
+    size_t m_numBytes = 0;
+    double m_seconds = 0;
+};
+
+static void PrintStage(const char* name, vector<double> durations)
+{
+    if (durations.empty())
+        return;
+
+    sort(durations.begin(), durations.end());
+    auto percentile = [&](double p) { return durations[min(durations.size() - 1, (size_t) (p * durations.size()))] * 1000; };
+    double total = 0;
+    for (auto d : durations)
+        total += d;
+    fprintf(stderr, "  %-18s %10d %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+            name, (int) durations.size(), total, percentile(0.5), percentile(0.9), percentile(0.99), durations.back() * 1000);
+}
+
+// reads the epochs with one reader configuration
+static BenchmarkResult RunBenchmark(const ConfigParameters& readerConfig, const vector<wstring>& inputs, const set<wstring>& sparseInputs,
+                                    size_t minibatchSize, size_t epochSize, size_t epochs, size_t maxMinibatches)
+{
+    // the layouts are shared as in a network without explicit dynamic axes
+    StreamMinibatchInputs matrices;
+    auto layout = make_shared<MBLayout>(1, 0, L"X");
+    for (const auto& name : inputs)
+    {
+        auto matrix = make_shared<Matrix<float>>(CPUDEVICE);
+        if (sparseInputs.find(name) != sparseInputs.end())
+            matrix->SwitchToMatrixType(MatrixType::SPARSE, MatrixFormat::matrixFormatSparseCSC, false);
+        matrices.insert(make_pair(name, StreamMinibatchInputs::Input(matrix, layout, TensorShape())));
+    }
+
+    DataReader reader(readerConfig);
+    EventTracer::Clear(); // not counting the indexing by the constructor
+
+    BenchmarkResult result;
+    auto start = chrono::steady_clock::now();
+    for (size_t epoch = 0; epoch < epochs; epoch++)
+    {
+        reader.StartMinibatchLoop(minibatchSize, epoch, epochSize);
+        for (;;)
+        {
+            bool gotMinibatch;
+            {
+                EventTracer::Scope scope("GetMinibatch", "reader");
+                gotMinibatch = reader.GetMinibatch(matrices);
+            }
+            if (!gotMinibatch)
+                break;
+
+            result.m_numMinibatches++;
+            result.m_numSamples += layout->GetActualNumSamples();
+            for (const auto& name : inputs)
+            {
+                const auto& matrix = matrices.GetInputMatrix<float>(name);
+                result.m_numBytes += matrix.GetMatrixType() == MatrixType::SPARSE ? matrix.BufferSize() : matrix.GetNumElements() * sizeof(float);
+            }
+
+            if (maxMinibatches > 0 && result.m_numMinibatches >= maxMinibatches)
+                break;
+        }
+
+        if (maxMinibatches > 0 && result.m_numMinibatches >= maxMinibatches)
+            break;
+    }
+    result.m_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// values of a parameter that is swept ('1:4:8'), or a single empty value if it is not set
+static vector<string> GetSweep(const ConfigParameters& config, const wchar_t* name)
+{
+    vector<string> values;
+    if (config.Exists(name))
+    {
+        ConfigArray array = config(name);
+        for (const auto& v : array)
+            values.push_back(v);
+    }
+    if (values.empty())
+        values.push_back("");
+    return values;
+}
+
+int wmain1(int argc, wchar_t* argv[])
+{
+    try
+    {
+        ConfigParameters config;
+        string rawConfigString = ConfigParameters::ParseCommandLine(argc, argv, config);
+        config.ResolveVariables(rawConfigString);
+
+        // the reader section, a path of nested sections such as 'train:reader'
+        ConfigArray readerSection = config(L"readerSection", "reader");
+        ConfigParameters baseReaderConfig = config;
+        for (const auto& section : readerSection)
+            baseReaderConfig = baseReaderConfig(msra::strfun::utf16(section));
+
+        vector<wstring> inputs;
+        for (const auto& name : ConfigArray(config(L"inputs", "features:labels")))
+            inputs.push_back(msra::strfun::utf16(name));
+        set<wstring> sparseInputs;
+        for (const auto& name : ConfigArray(config(L"sparseInputs", "")))
+            sparseInputs.insert(msra::strfun::utf16(name));
+
+        size_t minibatchSize = config(L"minibatchSize", (size_t) 256);
+        size_t epochSize = config(L"epochSize", (size_t) 0);
+        if (epochSize == 0)
+            epochSize = requestDataSize;
+        size_t epochs = config(L"epochs", (size_t) 1);
+        size_t maxMinibatches = config(L"maxMinibatches", (size_t) 0);
+
+        EventTracer::StartCollecting(config(L"maxEvents", (size_t) 10000000));
+        for (const auto& numThreads : GetSweep(config, L"numCPUThreads"))
+        {
+            int threads = CPUMatrix<float>::SetNumThreads(numThreads.empty() ? 0 : stoi(numThreads));
+            for (const auto& queueSize : GetSweep(config, L"prefetchQueueSize"))
+            {
+                for (const auto& prefetchChunks : GetSweep(config, L"prefetchChunks"))
+                {
+                    ConfigParameters readerConfig = baseReaderConfig;
+                    if (!queueSize.empty())
+                        readerConfig.Insert("prefetchQueueSize", queueSize);
+                    if (!prefetchChunks.empty())
+                        readerConfig.Insert("prefetchChunks", prefetchChunks);
+
+                    auto result = RunBenchmark(readerConfig, inputs, sparseInputs, minibatchSize, epochSize, epochs, maxMinibatches);
+                    fprintf(stderr, "\nReaderBenchmark: numCPUThreads=%d prefetchQueueSize=%s prefetchChunks=%s: %d minibatches, %d samples in %.3f s: %.1f samples/s, %.2f MB/s\n",
+                            threads, queueSize.empty() ? "default" : queueSize.c_str(), prefetchChunks.empty() ? "default" : prefetchChunks.c_str(),
+                            (int) result.m_numMinibatches, (int) result.m_numSamples, result.m_seconds,
+                            result.m_numSamples / result.m_seconds, result.m_numBytes / result.m_seconds / (1024 * 1024));
+                    fprintf(stderr, "  %-18s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "total s", "p50 ms", "p90 ms", "p99 ms", "max ms");
+                    for (auto stage : s_stages)
+                        PrintStage(stage, EventTracer::GetDurations(stage));
+                    fflush(stderr);
+                }
+            }
+        }
+    }
+    catch (const exception& e)
+    {
+        fprintf(stderr, "ReaderBenchmark: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+#ifdef __UNIX__
+/// UNIX main function converts arguments in UTF-8 encoding and passes to Visual-Studio style wmain() which takes wchar_t strings.
+int main(int argc, char* argv[])
+{
+    vector<wstring> args;
+    vector<wchar_t*> wargs;
+    for (int i = 0; i < argc; ++i)
+        args.push_back(msra::strfun::utf16(argv[i]));
+    for (auto& arg : args)
+        wargs.push_back(&arg[0]);
+    return wmain1(argc, wargs.data());
+}
+#else
+int wmain(int argc, wchar_t* argv[])
+{
+    return wmain1(argc, argv);
+}
+#endif
@@ -13,6 +13,9 @@
 #include <deque>
 
 #include "DataReader.h"
+#include "CPUThreadPool.h"
+#include "EventTracer.h"
+#include "ReaderCounters.h"
 #include <random>
 #include <set>
 
@@ -24,7 +27,8 @@ BlockRandomizer::BlockRandomizer(
     IDataDeserializerPtr deserializer,
     DecimationMode decimationMode,
     bool useLegacyRandomization,
-    bool multithreadedGetNextSequence)
+    bool multithreadedGetNextSequence,
+    size_t numPrefetchChunks)
     : m_verbosity(verbosity),
       m_deserializer(deserializer),
       m_decimationMode(decimationMode),
@@ -35,7 +39,12 @@ BlockRandomizer::BlockRandomizer(
       m_sweepTotalNumberOfSamples(0),
       m_lastSeenChunkId(CHUNKID_MAX),
       m_chunkRandomizer(std::make_shared<ChunkRandomizer>(deserializer, randomizationRangeInSamples, useLegacyRandomization)),
-      m_multithreadedGetNextSequences(multithreadedGetNextSequence)
+      m_multithreadedGetNextSequences(multithreadedGetNextSequence),
+      m_numPrefetchChunks(numPrefetchChunks),
+      m_randomizationRangeInSamples(randomizationRangeInSamples),
+      m_useLegacyRandomization(useLegacyRandomization),
+      m_partitionRank(0),
+      m_partitionWorkers(0)
 {
     assert(deserializer != nullptr);
 
@@ -48,6 +57,57 @@ BlockRandomizer::BlockRandomizer(
     {
         m_sweepTotalNumberOfSamples += chunk->m_numberOfSamples;
     }
+    m_totalNumberOfSamples = m_sweepTotalNumberOfSamples;
+}
+
+// Restricts the randomization to the chunks of the worker: a new chunk and sequence randomizer over them only.
+void BlockRandomizer::PartitionChunks(size_t workerRank, size_t numberOfWorkers)
+{
+    CancelPrefetch();
+    m_chunks.clear();
+    m_lastSeenChunkId = CHUNKID_MAX;
+
+    ChunkDescriptions chunks;
+    size_t numberOfSamples = 0;
+    for (const auto& chunk : m_deserializer->GetChunkDescriptions())
+    {
+        if (chunk->m_id % numberOfWorkers == workerRank)
+        {
+            chunks.push_back(chunk);
+            numberOfSamples += chunk->m_numberOfSamples;
+        }
+    }
+
+    if (numberOfSamples == 0)
+    {
+        RuntimeError("BlockRandomizer: worker %d of %d has no data; partitioning the input requires at least as many chunks as workers.",
+                     (int) workerRank, (int) numberOfWorkers);
+    }
+
+    m_partitionRank = workerRank;
+    m_partitionWorkers = numberOfWorkers;
+    m_sweepTotalNumberOfSamples = numberOfSamples;
+
+    // The window holds about as many samples of the worker as a worker used to hold of the decimated window.
+    size_t randomizationRange = m_randomizationRangeInSamples >= m_totalNumberOfSamples ?
+        m_randomizationRangeInSamples :
+        std::max<size_t>(1, GetPartitionShare(m_randomizationRangeInSamples));
+
+    m_sequenceRandomizer.reset();
+    m_chunkRandomizer = std::make_shared<ChunkRandomizer>(chunks, randomizationRange, m_useLegacyRandomization);
+    m_sequenceRandomizer = std::make_shared<SequenceRandomizer>(m_verbosity, m_deserializer, m_chunkRandomizer);
+    m_sweep = SIZE_MAX; // randomized on the next PrepareNewSweepIfNeeded()
+
+    if (m_verbosity >= Notification)
+        fprintf(stderr, "BlockRandomizer::PartitionChunks: worker %" PRIu64 " of %" PRIu64 " reads %" PRIu64 " chunks with %" PRIu64 " of %" PRIu64 " samples\n",
+                workerRank, numberOfWorkers, chunks.size(), numberOfSamples, m_totalNumberOfSamples);
+}
+
+size_t BlockRandomizer::GetPartitionShare(size_t numberOfSamples) const
+{
+    if (m_sweepTotalNumberOfSamples == m_totalNumberOfSamples || numberOfSamples == SIZE_MAX)
+        return numberOfSamples;
+    return (size_t) ((double) numberOfSamples * m_sweepTotalNumberOfSamples / m_totalNumberOfSamples + 0.5);
 }
 
 // Start a new epoch.
@@ -56,24 +116,29 @@ void BlockRandomizer::StartEpoch(const EpochConfiguration& config)
     m_lastSeenChunkId = CHUNKID_MAX;
 
     m_config = config;
+    if (m_decimationMode == DecimationMode::partition &&
+        (config.m_workerRank != m_partitionRank || config.m_numberOfWorkers != m_partitionWorkers))
+    {
+        PartitionChunks(config.m_workerRank, config.m_numberOfWorkers);
+    }
+
     if (config.m_totalEpochSizeInSamples == requestDataSize)
     {
         m_epochSize = m_sweepTotalNumberOfSamples;
     }
+    else if (m_decimationMode == DecimationMode::partition)
+    {
+        m_epochSize = std::max<size_t>(1, GetPartitionShare(config.m_totalEpochSizeInSamples));
+    }
     else
     {
         m_epochSize = config.m_totalEpochSizeInSamples;
     }
 
     // Calculates starts of the epoch, prepares a new sweep if needed.
-    m_epochStartPosition = m_epochSize * config.m_epochIndex;
-    PrepareNewSweepIfNeeded(m_epochStartPosition);
-
-    // Sets sequence cursor to the sequence that corresponds to the epoch start position.
     // If last epoch ended in the middle of a sequence, the cursor is moved to the next sequence in the sweep.
-    size_t offsetInSweep = m_epochStartPosition % m_sweepTotalNumberOfSamples;
-    size_t newOffset = m_sequenceRandomizer->Seek(offsetInSweep, m_sweep);
-    m_globalSamplePosition = m_sweep * m_sweepTotalNumberOfSamples + newOffset;
+    m_epochStartPosition = m_epochSize * config.m_epochIndex;
+    SetCurrentSamplePosition(m_epochStartPosition);
 
     size_t epochStartFrame = config.m_epochIndex * m_epochSize;
     fprintf(stderr, "BlockRandomizer::StartEpoch: epoch %" PRIu64 ": frames [%" PRIu64 "..%" PRIu64 "] (first sequence at sample %" PRIu64 "), data subset %" PRIu64 " of %" PRIu64 "\n",
@@ -85,6 +150,19 @@ void BlockRandomizer::StartEpoch(const EpochConfiguration& config)
             config.m_numberOfWorkers);
 }
 
+// Sets sequence cursor to the sequence that corresponds to the sample position, or the next one in the sweep.
+void BlockRandomizer::SetCurrentSamplePosition(size_t samplePosition)
+{
+    PrepareNewSweepIfNeeded(samplePosition);
+
+    size_t offsetInSweep = samplePosition % m_sweepTotalNumberOfSamples;
+    size_t newOffset = m_sequenceRandomizer->Seek(offsetInSweep, m_sweep);
+    m_globalSamplePosition = m_sweep * m_sweepTotalNumberOfSamples + newOffset;
+
+    // the chunk window may have been rebuilt
+    m_lastSeenChunkId = CHUNKID_MAX;
+}
+
 // Prepares a new sweep if needed.
 void BlockRandomizer::PrepareNewSweepIfNeeded(size_t samplePosition)
 {
@@ -105,6 +183,7 @@ void BlockRandomizer::PrepareNewSweepIfNeeded(size_t samplePosition)
         m_sequenceRandomizer->Reset(m_sweep + 1);
 
         // Unloading all chunk data from memory.
+        CancelPrefetch();
         m_chunks.clear();
         m_lastSeenChunkId = CHUNKID_MAX;
     }
@@ -113,9 +192,15 @@ void BlockRandomizer::PrepareNewSweepIfNeeded(size_t samplePosition)
 // Gets next sequences not exceeding sampleCount.
 Sequences BlockRandomizer::GetNextSequences(size_t sampleCount)
 {
+    EventTracer::Scope scope("Deserialize", "reader");
     // Get next sequence descriptions.
     Sequences result;
     std::vector<RandomizedSequenceDescription> sequences;
+    if (m_decimationMode == DecimationMode::partition)
+    {
+        // the timeline holds the samples of this worker only
+        sampleCount = std::max<size_t>(1, GetPartitionShare(sampleCount));
+    }
     result.m_endOfEpoch = GetNextSequenceDescriptions(sampleCount, sequences);
     if (sequences.size() == 0)
     {
@@ -143,7 +228,7 @@ Sequences BlockRandomizer::GetNextSequences(size_t sampleCount)
     auto process = [&](int i) -> void {
         const auto& description = decimated[i];
         std::vector<SequenceDataPtr> sequence;
-        auto it = m_chunks.find(description.m_chunk->m_chunkId);
+        auto it = m_chunks.find(description.m_chunkId);
         if (it == m_chunks.end())
         {
             LogicError("Invalid chunk requested.");
@@ -159,9 +244,8 @@ Sequences BlockRandomizer::GetNextSequences(size_t sampleCount)
     // TODO: This will be changed, when we move transformers under the randomizer, should not deal with multithreading here.
     if (m_multithreadedGetNextSequences)
     {
-#pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < decimated.size(); ++i)
-            process(i);
+        // each sequence is a chunk's worth of work, so that the sequences are spread over the threads one by one
+        CPUThreadPool::ParallelFor(0, decimated.size(), CPUThreadPool::MinWorkPerChunk, process);
     }
     else
     {
@@ -217,7 +301,7 @@ void BlockRandomizer::Decimate(const std::vector<RandomizedSequenceDescription>&
     {
         for (const auto& sequence : all)
         {
-            if (sequence.m_chunk->m_chunkId % m_config.m_numberOfWorkers == m_config.m_workerRank)
+            if (sequence.m_chunkId % m_config.m_numberOfWorkers == m_config.m_workerRank)
             {
                 decimated.push_back(sequence);
             }
@@ -229,6 +313,11 @@ void BlockRandomizer::Decimate(const std::vector<RandomizedSequenceDescription>&
         size_t strideEnd = all.size() * (m_config.m_workerRank + 1) / m_config.m_numberOfWorkers;
         decimated.assign(all.begin() + strideBegin, all.begin() + strideEnd);
     }
+    else if (m_decimationMode == DecimationMode::partition)
+    {
+        // all sequences of the window are of chunks of this worker
+        decimated = all;
+    }
     else
     {
         LogicError("Not supported mode.");
@@ -268,12 +357,28 @@ void BlockRandomizer::RetrieveDataChunks()
         }
         else
         {
-            chunks[chunk.m_chunkId] = m_deserializer->GetChunk(chunk.m_original->m_id);
+            auto prefetched = m_prefetchedChunks.find(chunk.m_original->m_id);
+            bool wasPrefetched = prefetched != m_prefetchedChunks.end();
+            {
+                // the reader waits for the chunk, unless it was prefetched early enough
+                EventTracer::Scope chunkScope("ChunkLoad", "reader");
+                ReaderCounters::Timer timer(ReaderCounters::chunkLoadMicroseconds);
+                if (wasPrefetched)
+                {
+                    chunks[chunk.m_chunkId] = prefetched->second.get(); // rethrows an exception of the background load
+                    m_prefetchedChunks.erase(prefetched);
+                }
+                else
+                {
+                    chunks[chunk.m_chunkId] = m_deserializer->GetChunk(chunk.m_original->m_id);
+                }
+            }
 
             if (m_verbosity >= Information)
-                fprintf(stderr, "BlockRandomizer::RetrieveDataChunks: paged in randomized chunk %u (original chunk: %u), now %" PRIu64 " chunks in memory\n",
+                fprintf(stderr, "BlockRandomizer::RetrieveDataChunks: paged in randomized chunk %u (original chunk: %u)%s, now %" PRIu64 " chunks in memory\n",
                         chunk.m_chunkId,
                         chunk.m_original->m_id,
+                        wasPrefetched ? " from prefetch" : "",
                         ++numLoadedChunks);
         }
     }
@@ -287,6 +392,60 @@ void BlockRandomizer::RetrieveDataChunks()
                 m_chunks.size(),
                 window.front().m_chunkId,
                 window.back().m_chunkId);
+
+    if (m_numPrefetchChunks > 0)
+        PrefetchChunks(m_lastSeenChunkId + 1);
+}
+
+// Starts background loads of the next m_numPrefetchChunks chunks of this worker in the randomized order of the sweep,
+// beginning with the randomized chunk nextChunkIndex. Loads that are already running are kept; those of chunks that
+// are no longer ahead (e.g. after StartEpoch() moved the position or changed the decimation) are waited for and dropped.
+void BlockRandomizer::PrefetchChunks(ChunkIdType nextChunkIndex)
+{
+    const auto& randomizedChunks = m_chunkRandomizer->GetRandomizedChunks();
+    std::map<ChunkIdType, std::future<ChunkPtr>> prefetchedChunks;
+    for (size_t i = nextChunkIndex; i < randomizedChunks.size() && prefetchedChunks.size() < m_numPrefetchChunks; ++i)
+    {
+        const auto& chunk = randomizedChunks[i];
+        if (m_decimationMode == DecimationMode::chunk && chunk.m_chunkId % m_config.m_numberOfWorkers != m_config.m_workerRank)
+            continue;
+        if (m_chunks.find(chunk.m_chunkId) != m_chunks.end())
+            continue; // already in the window
+
+        ChunkIdType originalChunkId = chunk.m_original->m_id;
+        auto it = m_prefetchedChunks.find(originalChunkId);
+        if (it != m_prefetchedChunks.end())
+        {
+            prefetchedChunks[originalChunkId] = std::move(it->second);
+            continue;
+        }
+
+        IDataDeserializerPtr deserializer = m_deserializer;
+        prefetchedChunks[originalChunkId] = std::async(std::launch::async, [deserializer, originalChunkId]()
+        {
+            EventTracer::Scope scope("ChunkPrefetch", "reader");
+            return deserializer->GetChunk(originalChunkId);
+        });
+
+        if (m_verbosity >= Debug)
+            fprintf(stderr, "BlockRandomizer::PrefetchChunks: prefetching randomized chunk %u (original chunk: %u)\n",
+                    chunk.m_chunkId,
+                    originalChunkId);
+    }
+
+    CancelPrefetch(); // the remaining ones are no longer ahead
+    m_prefetchedChunks.swap(prefetchedChunks);
+}
+
+// Waits for and discards all outstanding prefetches.
+void BlockRandomizer::CancelPrefetch()
+{
+    for (auto& prefetched : m_prefetchedChunks)
+    {
+        if (prefetched.second.valid())
+            prefetched.second.wait(); // an exception of a load that is no longer needed is dropped with it
+    }
+    m_prefetchedChunks.clear();
 }
 
 }}}
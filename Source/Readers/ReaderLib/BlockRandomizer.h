@@ -6,6 +6,8 @@
 #pragma once
 
 #include <vector>
+#include <map>
+#include <future>
 
 #include "SequenceEnumerator.h"
 #include "DataDeserializer.h"
@@ -30,15 +32,25 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 //
 // This class is responsible for decimation and loading the data chunks in to memory.
 // Actual randomization happens in ChunkRandomizer and SequenceRandomizer.
+// With numPrefetchChunks > 0, the next chunks in the randomized order past the window are loaded ahead of time,
+// concurrently on background tasks, so that entering a new chunk does not stall on I/O. At most numPrefetchChunks
+// chunks are held in addition to the window. This requires a deserializer whose GetChunk() can be called concurrently
+// with itself and with its other methods.
+// In the partition decimation mode, a worker owns a fixed set of chunks (original chunk id modulo the number of workers)
+// and randomizes only those, on a timeline of its own: the windows, sequence descriptions and prefetches of a worker
+// cover only its chunks, so they do not grow with the number of workers, and a worker reads the same chunks in every
+// sweep, which keeps caches below the randomizer (e.g. ChunkCache) warm. The epoch size, the randomization range and
+// the requested sample counts are scaled to the share of the samples of the worker.
 // TODO: The behavior can be simplified by only randomizing sequences forward.
 class BlockRandomizer : public SequenceEnumerator
 {
 public:
-    // Currently, decimation based on sequences or chunks is supported.
+    // Currently, decimation based on sequences or chunks, or partitioning of the chunks between the workers is supported.
     enum class DecimationMode
     {
         chunk,
-        sequence
+        sequence,
+        partition
     };
 
     BlockRandomizer(
@@ -47,7 +59,8 @@ public:
         IDataDeserializerPtr deserializer,
         DecimationMode decimationMode = DecimationMode::chunk,
         bool useLegacyRandomization = false,
-        bool multithreadedGetNextSequences = false);
+        bool multithreadedGetNextSequences = false,
+        size_t numPrefetchChunks = 0);
 
     // Starts a new epoch.
     virtual void StartEpoch(const EpochConfiguration& config) override;
@@ -55,6 +68,14 @@ public:
     // Gets next sequences.
     virtual Sequences GetNextSequences(size_t sampleCount) override;
 
+    // The randomization of a sweep is determined by its index, hence the position on the timeline is the whole state.
+    virtual size_t GetCurrentSamplePosition() override
+    {
+        return m_globalSamplePosition;
+    }
+
+    virtual void SetCurrentSamplePosition(size_t samplePosition) override;
+
     // Gets stream descriptions.
     virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
     {
@@ -65,6 +86,12 @@ private:
     // Retrieve data for chunks.
     void RetrieveDataChunks();
 
+    // Starts loading the chunks that follow the randomized part of the window, drops prefetches that are no longer ahead.
+    void PrefetchChunks(ChunkIdType nextChunkIndex);
+
+    // Waits for and discards all outstanding prefetches.
+    void CancelPrefetch();
+
     // Get next sequence descriptions that do not exceed sample count.
     // Returns true if epoch end is reached.
     bool GetNextSequenceDescriptions(size_t sampleCount, std::vector<RandomizedSequenceDescription>& result);
@@ -75,6 +102,12 @@ private:
     // Prepares a new sweep if needed.
     void PrepareNewSweepIfNeeded(size_t samplePosition);
 
+    // Restricts the randomization to the chunks of the worker (partition mode).
+    void PartitionChunks(size_t workerRank, size_t numberOfWorkers);
+
+    // The share of the worker of a number of samples of the whole input (partition mode).
+    size_t GetPartitionShare(size_t numberOfSamples) const;
+
     // Global sample position on the timeline.
     size_t m_globalSamplePosition;
 
@@ -93,9 +126,20 @@ private:
     // Global position of the current sweep in samples.
     size_t m_sweepStartInSamples;
 
-    // Total number of samples in a sweep.
+    // Total number of samples in a sweep (of the chunks of the worker, in partition mode).
     size_t m_sweepTotalNumberOfSamples;
 
+    // Total number of samples of the input.
+    size_t m_totalNumberOfSamples;
+
+    // Parameters of the chunk randomization, kept to randomize the chunks of a partition.
+    size_t m_randomizationRangeInSamples;
+    bool m_useLegacyRandomization;
+
+    // Worker rank and number of workers of the current partition (partition mode), 0 workers before the first epoch.
+    size_t m_partitionRank;
+    size_t m_partitionWorkers;
+
     IDataDeserializerPtr m_deserializer;
 
     // Chunk randomizer.
@@ -110,6 +154,12 @@ private:
     // A map of data chunks.
     std::map<size_t, ChunkPtr> m_chunks;
 
+    // Number of chunks to load ahead of the randomization window.
+    size_t m_numPrefetchChunks;
+
+    // Chunks being loaded ahead of time, by original chunk id.
+    std::map<ChunkIdType, std::future<ChunkPtr>> m_prefetchedChunks;
+
     // Last seen data chunk id.
     ChunkIdType m_lastSeenChunkId;
 
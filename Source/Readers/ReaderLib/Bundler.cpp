@@ -8,6 +8,7 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <set>
+#include <future>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -28,6 +29,8 @@ Bundler::Bundler(
     : m_deserializers(deserializers), m_driver(driver)
 {
     m_verbosity = readerConfig(L"verbosity", 0);
+    // By default the chunks of different deserializers are loaded concurrently.
+    m_loadChunksInParallel = readerConfig(L"loadChunksInParallel", true);
 
     // Combines streams of underlying deserializers.
     for (auto d : deserializers)
@@ -234,9 +237,15 @@ public:
 
         // Creating chunk mapping.
         m_parent->m_driver->GetSequencesForChunk(original->m_id, sequences);
-        ChunkPtr drivingChunk = m_parent->m_driver->GetChunk(original->m_id);
         m_sequenceToSequence.resize(deserializers.size() * sequences.size());
         m_innerChunks.resize(deserializers.size() * sequences.size());
+
+        // Creating sequence mapping and collecting the underlying chunks each deserializer has to load.
+        // The driving deserializer is the first one, its only chunk is the original chunk.
+        std::vector<std::map<ChunkIdType, ChunkPtr>> innerChunks(deserializers.size());
+        std::vector<ChunkIdType> innerChunkIds(m_innerChunks.size());
+        innerChunks[0][original->m_id] = nullptr;
+        SequenceDescription s;
         for (size_t sequenceIndex = 0; sequenceIndex < sequences.size(); ++sequenceIndex)
         {
             if (chunk->m_invalid.find(sequenceIndex) != chunk->m_invalid.end())
@@ -246,39 +255,84 @@ public:
 
             size_t currentIndex = sequenceIndex * deserializers.size();
             m_sequenceToSequence[currentIndex] = sequences[sequenceIndex].m_id;
-            m_innerChunks[currentIndex] = drivingChunk;
+            for (size_t deserializerIndex = 1; deserializerIndex < deserializers.size(); ++deserializerIndex)
+            {
+                deserializers[deserializerIndex]->GetSequenceDescriptionByKey(sequences[sequenceIndex].m_key, s);
+                m_sequenceToSequence[currentIndex + deserializerIndex] = s.m_id;
+                innerChunkIds[currentIndex + deserializerIndex] = s.m_chunkId;
+                innerChunks[deserializerIndex][s.m_chunkId] = nullptr;
+            }
         }
 
-        // Creating sequence mapping and requiring underlying chunks.
-        SequenceDescription s;
-        for (size_t deserializerIndex = 1; deserializerIndex < m_parent->m_deserializers.size(); ++deserializerIndex)
+        // Requiring underlying chunks. The deserializers usually read different files, so each of them loads
+        // its chunks on its own task, and the chunk is complete when all have finished. The chunks of a single
+        // deserializer are loaded one after another, so deserializers do not need to support concurrent loads.
+        auto load = [&deserializers, &innerChunks](size_t deserializerIndex)
         {
-            std::map<size_t, ChunkPtr> secondaryChunks;
+            for (auto& c : innerChunks[deserializerIndex])
+            {
+                c.second = deserializers[deserializerIndex]->GetChunk(c.first);
+            }
+        };
 
-            for (size_t sequenceIndex = 0; sequenceIndex < sequences.size(); ++sequenceIndex)
+        if (m_parent->m_loadChunksInParallel)
+        {
+            std::vector<std::future<void>> loads;
+            for (size_t deserializerIndex = 1; deserializerIndex < deserializers.size(); ++deserializerIndex)
             {
-                if (chunk->m_invalid.find(sequenceIndex) != chunk->m_invalid.end())
-                {
-                    continue;
-                }
+                loads.push_back(std::async(std::launch::async, load, deserializerIndex));
+            }
 
-                size_t currentIndex = sequenceIndex * deserializers.size() + deserializerIndex;
-                deserializers[deserializerIndex]->GetSequenceDescriptionByKey(sequences[sequenceIndex].m_key, s);
-                m_sequenceToSequence[currentIndex] = s.m_id;
+            // Waiting for all loads before rethrowing a failure of any of them, they reference the local state.
+            std::exception_ptr failure;
+            try
+            {
+                load(0);
+            }
+            catch (...)
+            {
+                failure = std::current_exception();
+            }
 
-                ChunkPtr secondaryChunk;
-                auto it = secondaryChunks.find(s.m_chunkId);
-                if (it == secondaryChunks.end())
+            for (auto& l : loads)
+            {
+                try
                 {
-                    secondaryChunk = deserializers[deserializerIndex]->GetChunk(s.m_chunkId);
-                    secondaryChunks.insert(make_pair(s.m_chunkId, secondaryChunk));
+                    l.get();
                 }
-                else
+                catch (...)
                 {
-                    secondaryChunk = it->second;
+                    if (!failure)
+                        failure = std::current_exception();
                 }
+            }
+
+            if (failure)
+            {
+                std::rethrow_exception(failure);
+            }
+        }
+        else
+        {
+            for (size_t deserializerIndex = 0; deserializerIndex < deserializers.size(); ++deserializerIndex)
+            {
+                load(deserializerIndex);
+            }
+        }
 
-                m_innerChunks[currentIndex] = secondaryChunk;
+        ChunkPtr drivingChunk = innerChunks[0][original->m_id];
+        for (size_t sequenceIndex = 0; sequenceIndex < sequences.size(); ++sequenceIndex)
+        {
+            if (chunk->m_invalid.find(sequenceIndex) != chunk->m_invalid.end())
+            {
+                continue;
+            }
+
+            size_t currentIndex = sequenceIndex * deserializers.size();
+            m_innerChunks[currentIndex] = drivingChunk;
+            for (size_t deserializerIndex = 1; deserializerIndex < deserializers.size(); ++deserializerIndex)
+            {
+                m_innerChunks[currentIndex + deserializerIndex] = innerChunks[deserializerIndex][innerChunkIds[currentIndex + deserializerIndex]];
             }
         }
     }
@@ -59,6 +59,9 @@ private:
     // (i.e. often in speech)
     bool m_takePrimarySequenceLength;
 
+    // Whether the chunks of the underlying deserializers are loaded concurrently, one task per deserializer.
+    bool m_loadChunksInParallel;
+
     // General configuration
     int m_verbosity;
 };
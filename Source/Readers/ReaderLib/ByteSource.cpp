@@ -0,0 +1,408 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "ByteSource.h"
+#include "MappedFile.h"
+#include "ReaderCounters.h"
+#include "fileutil.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // (Windows has no SIGPIPE)
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+void ByteSource::CheckRange(uint64_t offset, size_t size) const
+{
+    if (offset > Size() || size > Size() - offset)
+    {
+        RuntimeError("Attempted to read %" PRIu64 " bytes at offset %" PRIu64 " beyond the end of '%ls' (%" PRIu64 " bytes).",
+                     (uint64_t) size, offset, m_name.c_str(), Size());
+    }
+}
+
+static const wchar_t s_httpScheme[] = L"http://";
+static const wchar_t s_httpsScheme[] = L"https://";
+
+static bool StartsWith(const std::wstring& s, const wchar_t* prefix)
+{
+    return s.compare(0, wcslen(prefix), prefix) == 0;
+}
+
+bool IsRemotePath(const std::wstring& path)
+{
+    return StartsWith(path, s_httpScheme) || StartsWith(path, s_httpsScheme);
+}
+
+// -----------------------------------------------------------------------
+// MappedByteSource -- a local file, memory-mapped
+// -----------------------------------------------------------------------
+
+class MappedByteSource : public ByteSource
+{
+public:
+    explicit MappedByteSource(const std::wstring& path)
+        : ByteSource(path), m_file(std::make_shared<MappedFile>(path))
+    {
+    }
+
+    uint64_t Size() const override
+    {
+        return m_file->Size();
+    }
+
+    void Read(uint64_t offset, size_t size, char* buffer) const override
+    {
+        CheckRange(offset, size);
+        memcpy(buffer, m_file->Data() + offset, size);
+        ReaderCounters::Add(ReaderCounters::bytesRead, size);
+    }
+
+    const char* Data() const override
+    {
+        return m_file->Data();
+    }
+
+    void Prefetch(uint64_t offset, size_t size) const override
+    {
+        m_file->Prefetch((size_t) offset, size);
+    }
+
+private:
+    MappedFilePtr m_file;
+};
+
+// -----------------------------------------------------------------------
+// HttpByteSource -- a remote file, read with HTTP/1.1 range requests
+// -----------------------------------------------------------------------
+
+// A connection is made per request, so that concurrent reads (the chunks loaded ahead by the randomizer)
+// are independent requests. Failed requests are retried, as transient errors are common with object storage.
+class HttpByteSource : public ByteSource
+{
+public:
+    explicit HttpByteSource(const std::wstring& url)
+        : ByteSource(url), m_size(0)
+    {
+        if (StartsWith(url, s_httpsScheme))
+            RuntimeError("Reading from '%ls': https is not supported, please use an http URL.", url.c_str());
+
+        // http://host[:port]/path
+        std::string address = msra::strfun::utf8(url.substr(wcslen(s_httpScheme)));
+        size_t slash = address.find('/');
+        std::string hostAndPort = address.substr(0, slash);
+        m_path = slash == std::string::npos ? "/" : address.substr(slash);
+        size_t colon = hostAndPort.find(':');
+        m_host = hostAndPort.substr(0, colon);
+        m_port = colon == std::string::npos ? "80" : hostAndPort.substr(colon + 1);
+        if (m_host.empty())
+            RuntimeError("Invalid URL '%ls'.", url.c_str());
+
+        // The total size comes with the response to any range request.
+        char first;
+        m_size = Request(0, 1, &first);
+    }
+
+    uint64_t Size() const override
+    {
+        return m_size;
+    }
+
+    void Read(uint64_t offset, size_t size, char* buffer) const override
+    {
+        CheckRange(offset, size);
+        if (size > 0)
+            Request(offset, size, buffer);
+        ReaderCounters::Add(ReaderCounters::bytesRead, size);
+    }
+
+private:
+    static const int s_maxAttempts = 4;
+
+    // Reads the range into buffer, retrying on failures; returns the total size of the remote file.
+    uint64_t Request(uint64_t offset, size_t size, char* buffer) const
+    {
+        for (int attempt = 1;; attempt++)
+        {
+            std::string error;
+            uint64_t totalSize = TryRequest(offset, size, buffer, error);
+            if (error.empty())
+                return totalSize;
+            if (attempt == s_maxAttempts)
+                RuntimeError("Reading %" PRIu64 " bytes at offset %" PRIu64 " of '%ls' failed: %s", (uint64_t) size, offset, GetName().c_str(), error.c_str());
+
+            fprintf(stderr, "WARNING: Reading from '%ls' failed (%s), retrying.\n", GetName().c_str(), error.c_str());
+            std::this_thread::sleep_for(std::chrono::milliseconds(500 * attempt));
+        }
+    }
+
+#ifdef _WIN32
+    typedef SOCKET Socket;
+    static void CloseSocket(Socket s) { closesocket(s); }
+    static bool IsValid(Socket s) { return s != INVALID_SOCKET; }
+#else
+    typedef int Socket;
+    static void CloseSocket(Socket s) { close(s); }
+    static bool IsValid(Socket s) { return s >= 0; }
+#endif
+
+    // closes the socket when leaving the scope
+    struct SocketGuard
+    {
+        Socket m_socket;
+        ~SocketGuard()
+        {
+            if (IsValid(m_socket))
+                CloseSocket(m_socket);
+        }
+    };
+
+    Socket Connect(std::string& error) const
+    {
+#ifdef _WIN32
+        static std::once_flag initialized;
+        std::call_once(initialized, []
+        {
+            WSADATA data;
+            if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+                RuntimeError("Cannot initialize Windows sockets.");
+        });
+#endif
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(m_host.c_str(), m_port.c_str(), &hints, &addresses) != 0)
+        {
+            error = "cannot resolve host " + m_host;
+            return (Socket) -1;
+        }
+
+        Socket s = (Socket) -1;
+        for (addrinfo* a = addresses; a != nullptr; a = a->ai_next)
+        {
+            s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (!IsValid(s))
+                continue;
+            if (connect(s, a->ai_addr, (int) a->ai_addrlen) == 0)
+                break;
+            CloseSocket(s);
+            s = (Socket) -1;
+        }
+        freeaddrinfo(addresses);
+        if (!IsValid(s))
+            error = "cannot connect to " + m_host + ":" + m_port;
+        return s;
+    }
+
+    // Reads the range into buffer; on failure sets error and returns 0.
+    uint64_t TryRequest(uint64_t offset, size_t size, char* buffer, std::string& error) const
+    {
+        SocketGuard connection = { Connect(error) };
+        if (!error.empty())
+            return 0;
+
+        std::ostringstream request;
+        request << "GET " << m_path << " HTTP/1.1\r\n"
+                << "Host: " << m_host << "\r\n"
+                << "Range: bytes=" << offset << "-" << offset + size - 1 << "\r\n"
+                << "Connection: close\r\n\r\n";
+        const std::string text = request.str();
+        for (size_t sent = 0; sent < text.size();)
+        {
+            int n = send(connection.m_socket, text.data() + sent, (int) (text.size() - sent), MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                error = "cannot send the request";
+                return 0;
+            }
+            sent += n;
+        }
+
+        // Receiving the headers; whatever follows them is the beginning of the body.
+        std::string headers;
+        size_t headersEnd;
+        char receiveBuffer[4096];
+        while ((headersEnd = headers.find("\r\n\r\n")) == std::string::npos)
+        {
+            int n = recv(connection.m_socket, receiveBuffer, sizeof(receiveBuffer), 0);
+            if (n <= 0)
+            {
+                error = "connection closed before the response headers";
+                return 0;
+            }
+            headers.append(receiveBuffer, n);
+        }
+        std::string body = headers.substr(headersEnd + 4);
+        headers.resize(headersEnd + 2);
+
+        int status = 0;
+        if (sscanf(headers.c_str(), "HTTP/%*d.%*d %d", &status) != 1)
+        {
+            error = "invalid response";
+            return 0;
+        }
+        if (status != 206)
+        {
+            // Client errors (e.g. an expired signature or a missing blob) are not retried.
+            if (status >= 400 && status < 500)
+                RuntimeError("Reading from '%ls' failed with HTTP status %d; range requests are required.", GetName().c_str(), status);
+            error = "HTTP status " + std::to_string(status);
+            return 0;
+        }
+
+        // Content-Range: bytes first-last/total
+        uint64_t first = 0, last = 0, totalSize = 0;
+        const char* contentRange = FindHeader(headers, "content-range:");
+        if (contentRange == nullptr ||
+            sscanf(contentRange, " bytes %" SCNu64 "-%" SCNu64 "/%" SCNu64, &first, &last, &totalSize) != 3 ||
+            first != offset || last != offset + size - 1)
+        {
+            error = "unexpected Content-Range in the response";
+            return 0;
+        }
+
+        // Receiving the body straight into the buffer.
+        size_t received = std::min(body.size(), size);
+        memcpy(buffer, body.data(), received);
+        while (received < size)
+        {
+            int n = recv(connection.m_socket, buffer + received, (int) std::min<size_t>(size - received, 1 << 30), 0);
+            if (n <= 0)
+            {
+                error = "connection closed after " + std::to_string(received) + " bytes of the response";
+                return 0;
+            }
+            received += n;
+        }
+        return totalSize;
+    }
+
+    // value of a header, by its lower-case name with the colon
+    static const char* FindHeader(const std::string& headers, const char* name)
+    {
+        const size_t length = strlen(name);
+        for (size_t line = headers.find("\r\n"); line != std::string::npos; line = headers.find("\r\n", line + 2))
+        {
+            size_t begin = line + 2;
+            if (begin + length <= headers.size() && _strnicmp(headers.c_str() + begin, name, length) == 0)
+                return headers.c_str() + begin + length;
+        }
+        return nullptr;
+    }
+
+    std::string m_host;
+    std::string m_port;
+    std::string m_path;
+    uint64_t m_size;
+};
+
+// -----------------------------------------------------------------------
+// CachedByteSource -- keeps the ranges read from a remote source on the local disk
+// -----------------------------------------------------------------------
+
+// Each range is a file, named after the source, its size and the range; as deserializers read the same
+// ranges (chunks) in every epoch, these are hit from the second read on. Files are written under a temporary
+// name and renamed, so that concurrent jobs sharing the directory never see partial files.
+class CachedByteSource : public ByteSource
+{
+public:
+    CachedByteSource(ByteSourcePtr source, const std::wstring& cacheDirectory)
+        : ByteSource(source->GetName()), m_source(source)
+    {
+        // FNV-1a of the name and the size, so that a changed remote file does not hit stale ranges
+        uint64_t hash = 14695981039346656037ULL;
+        std::string key = msra::strfun::utf8(GetName()) + "/" + std::to_string(m_source->Size());
+        for (char c : key)
+            hash = (hash ^ (unsigned char) c) * 1099511628211ULL;
+        m_prefix = cacheDirectory + L"/" + msra::strfun::utf16(msra::strfun::strprintf("%016" PRIx64, hash));
+        msra::files::make_intermediate_dirs(m_prefix);
+    }
+
+    uint64_t Size() const override
+    {
+        return m_source->Size();
+    }
+
+    void Read(uint64_t offset, size_t size, char* buffer) const override
+    {
+        CheckRange(offset, size);
+        const std::wstring path = m_prefix + msra::strfun::utf16(msra::strfun::strprintf("_%" PRIu64 "_%" PRIu64, offset, (uint64_t) size));
+
+        FILE* f = _wfopen(path.c_str(), L"rb");
+        if (f != nullptr)
+        {
+            bool complete = fread(buffer, 1, size, f) == size;
+            fclose(f);
+            if (complete)
+            {
+                ReaderCounters::Add(ReaderCounters::bytesRead, size);
+                return;
+            }
+        }
+
+        m_source->Read(offset, size, buffer);
+
+        std::ostringstream temporary;
+        temporary << std::this_thread::get_id();
+        const std::wstring temporaryPath = path + L"." + msra::strfun::utf16(temporary.str()) + L".tmp";
+        f = _wfopen(temporaryPath.c_str(), L"wb");
+        if (f == nullptr)
+            return; // the cache is only an optimization
+        bool written = fwrite(buffer, 1, size, f) == size;
+        written = fclose(f) == 0 && written;
+        if (!written || !RenameCacheFile(temporaryPath, path))
+            _wunlink(temporaryPath.c_str());
+    }
+
+private:
+    static bool RenameCacheFile(const std::wstring& from, const std::wstring& to)
+    {
+#ifdef _WIN32
+        return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return rename(msra::strfun::utf8(from).c_str(), msra::strfun::utf8(to).c_str()) == 0;
+#endif
+    }
+
+    ByteSourcePtr m_source;
+    std::wstring m_prefix;
+};
+
+ByteSourcePtr OpenByteSource(const std::wstring& path, const std::wstring& cacheDirectory)
+{
+    if (!IsRemotePath(path))
+        return std::make_shared<MappedByteSource>(path);
+
+    ByteSourcePtr source = std::make_shared<HttpByteSource>(path);
+    if (!cacheDirectory.empty())
+        source = std::make_shared<CachedByteSource>(source, cacheDirectory);
+    return source;
+}
+
+}}}
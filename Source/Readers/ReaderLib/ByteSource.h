@@ -0,0 +1,76 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <stdint.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// ByteSource -- random access to the bytes of an input file, local or remote
+// -----------------------------------------------------------------------
+
+// Deserializers that read their input in ranges (a header, tables, whole chunks) read through this
+// instead of opening the file themselves, so that the input can also live on remote storage.
+// Local files are memory-mapped and expose their data directly (see Data()); remote sources are read
+// with one range request per Read(). The read-ahead of upcoming chunks is that of the randomizer,
+// which loads the next chunks in randomized order on background tasks (see BlockRandomizer), so
+// Read() has to be thread-safe.
+class ByteSource
+{
+public:
+    virtual ~ByteSource() {}
+
+    // Total number of bytes.
+    virtual uint64_t Size() const = 0;
+
+    // Reads size bytes at offset; fails if the range exceeds the source.
+    virtual void Read(uint64_t offset, size_t size, char* buffer) const = 0;
+
+    // The whole source in memory, if it is a local file, so that no copies have to be made; nullptr otherwise.
+    virtual const char* Data() const
+    {
+        return nullptr;
+    }
+
+    // hint that a range is going to be read
+    virtual void Prefetch(uint64_t /*offset*/, size_t /*size*/) const
+    {
+    }
+
+    // The path or URL, for messages.
+    const std::wstring& GetName() const
+    {
+        return m_name;
+    }
+
+protected:
+    explicit ByteSource(const std::wstring& name) : m_name(name)
+    {
+    }
+
+    // checks that a read stays within the source
+    void CheckRange(uint64_t offset, size_t size) const;
+
+private:
+    std::wstring m_name;
+};
+
+typedef std::shared_ptr<ByteSource> ByteSourcePtr;
+
+// Whether a path refers to remote storage rather than to a local file.
+bool IsRemotePath(const std::wstring& path);
+
+// Opens a local file (memory-mapped) or a remote source. Remote sources are addressed by 'http://' URLs
+// and read with HTTP range requests, e.g. from blob storage through a URL with a shared access signature.
+// If cacheDirectory is not empty, the ranges read from remote sources are kept in files in that directory,
+// and read from there from then on: as the deserializers read each chunk as a whole, from the second epoch
+// (or the second job on the machine) on, the data of remote sources is read from the local disk.
+ByteSourcePtr OpenByteSource(const std::wstring& path, const std::wstring& cacheDirectory = L"");
+
+}}}
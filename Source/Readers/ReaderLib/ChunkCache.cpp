@@ -5,22 +5,285 @@
 
 #define _CRT_SECURE_NO_WARNINGS
 
+#include <unordered_map>
+#include <string.h>
 #include "ChunkCache.h"
+#include "ElementTypeUtils.h"
+#include "Lz4Codec.h"
+#include "ReaderCounters.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+static size_t AlignTo8(size_t size)
+{
+    return (size + 7) / 8 * 8;
+}
+
+// The sequences of a chunk with their data in a single compressed block.
+// In the decompressed block, the data of a sequence stream are at m_offset, aligned to 8 bytes:
+//   dense:  the values
+//   sparse: the nnz counts and the indices, padding to 8, the values
+class ChunkCache::CompressedChunk
+{
+public:
+    struct SequenceStream
+    {
+        StorageType m_storageType;
+        uint32_t m_numberOfSamples;
+        TensorShapePtr m_sampleLayout; // (dense)
+        size_t m_numNnzCounts;         // (sparse)
+        IndexType m_totalNnzCount;     // (sparse)
+        size_t m_offset;
+    };
+
+    std::unordered_map<size_t, size_t> m_firstStreamOfSequence; // sequence id -> index into m_sequenceStreams
+    std::vector<SequenceStream> m_sequenceStreams;              // the streams of each sequence, in the order of the streams
+    size_t m_numStreams;
+    std::vector<char> m_block;
+    size_t m_decompressedSize;
+};
+
+// A chunk decompressed from the cache, it owns the data of its sequences.
+class ChunkCache::DecompressedChunk : public Chunk, public std::enable_shared_from_this<DecompressedChunk>
+{
+public:
+    explicit DecompressedChunk(const CompressedChunkPtr& compressed)
+        : m_compressed(compressed), m_data(compressed->m_decompressedSize)
+    {
+        Lz4Decompress(compressed->m_block.data(), compressed->m_block.size(), m_data.data(), m_data.size());
+    }
+
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        auto first = m_compressed->m_firstStreamOfSequence.find(sequenceId);
+        if (first == m_compressed->m_firstStreamOfSequence.end())
+            LogicError("ChunkCache: Sequence %d is not in the chunk.", (int) sequenceId);
+
+        for (size_t i = 0; i < m_compressed->m_numStreams; i++)
+        {
+            const auto& stream = m_compressed->m_sequenceStreams[first->second + i];
+            char* data = m_data.data() + stream.m_offset;
+            SequenceDataPtr sequence;
+            if (stream.m_storageType == StorageType::dense)
+            {
+                auto dense = std::make_shared<DenseSequenceData>();
+                dense->m_sampleLayout = stream.m_sampleLayout;
+                dense->m_data = data;
+                sequence = dense;
+            }
+            else
+            {
+                auto sparse = std::make_shared<SparseSequenceData>();
+                const IndexType* nnzCounts = reinterpret_cast<const IndexType*>(data);
+                sparse->m_nnzCounts.assign(nnzCounts, nnzCounts + stream.m_numNnzCounts);
+                sparse->m_indices = reinterpret_cast<IndexType*>(data) + stream.m_numNnzCounts;
+                sparse->m_totalNnzCount = stream.m_totalNnzCount;
+                sparse->m_data = data + AlignTo8(sizeof(IndexType) * (stream.m_numNnzCounts + stream.m_totalNnzCount));
+                sequence = sparse;
+            }
+            sequence->m_id = sequenceId;
+            sequence->m_numberOfSamples = stream.m_numberOfSamples;
+            sequence->m_chunk = shared_from_this();
+            result.push_back(sequence);
+        }
+    }
+
+private:
+    CompressedChunkPtr m_compressed;
+    std::vector<char> m_data;
+};
+
+ChunkCache::ChunkCache(IDataDeserializerPtr deserializer, size_t budgetInBytes, int traceLevel, bool compress)
+    : m_deserializer(deserializer), m_budgetInBytes(budgetInBytes), m_traceLevel(traceLevel), m_compress(compress), m_statistics()
+{
+    m_streams = m_deserializer->GetStreamDescriptions();
+}
+
+ChunkCache::~ChunkCache()
+{
+    size_t numRequests = m_statistics.m_hits + m_statistics.m_misses;
+    if (m_traceLevel > 0 && numRequests > 0)
+    {
+        fprintf(stderr, "ChunkCache: %.1f%% of %d chunk requests were hits, %d chunks were evicted, %d chunks are cached",
+                100.0 * m_statistics.m_hits / numRequests, (int) numRequests, (int) m_statistics.m_evictions, (int) m_statistics.m_cachedChunks);
+        if (m_budgetInBytes > 0)
+            fprintf(stderr, " (%.1f of %.1f MB)", m_statistics.m_cachedBytes / 1e6, m_budgetInBytes / 1e6);
+        if (m_compress)
+            fprintf(stderr, ", compressed from %.1f to %.1f MB", m_statistics.m_uncompressedBytes / 1e6, m_statistics.m_cachedBytes / 1e6);
+        fprintf(stderr, ".\n");
+    }
+}
+
 ChunkPtr ChunkCache::GetChunk(ChunkIdType chunkId)
 {
-    auto it = m_chunkMap.find(chunkId);
-    if (it != m_chunkMap.end())
+    CompressedChunkPtr compressed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_chunkMap.find(chunkId);
+        if (it != m_chunkMap.end())
+        {
+            m_statistics.m_hits++;
+            ReaderCounters::Add(ReaderCounters::chunkCacheHits, 1);
+            m_lru.splice(m_lru.begin(), m_lru, it->second.m_lruPosition);
+            if (!it->second.m_compressed)
+            {
+                return it->second.m_chunk;
+            }
+            compressed = it->second.m_compressed;
+        }
+        else
+        {
+            m_statistics.m_misses++;
+            ReaderCounters::Add(ReaderCounters::chunkCacheMisses, 1);
+        }
+    }
+
+    // decompressed without holding the lock
+    if (compressed)
     {
-        return it->second;
+        return std::make_shared<DecompressedChunk>(compressed);
     }
- 
+
+    // loaded without holding the lock; if another thread loads the same chunk meanwhile, the first one is kept
     ChunkPtr chunk = m_deserializer->GetChunk(chunkId);
-    m_chunkMap[chunkId] = chunk;
- 
+    size_t sizeInBytes = 0;
+    if (m_compress)
+    {
+        compressed = Compress(chunkId, chunk);
+        sizeInBytes = compressed->m_block.size();
+    }
+    else if (m_budgetInBytes > 0)
+    {
+        sizeInBytes = GetChunkSizeInBytes(chunkId, chunk);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto inserted = m_chunkMap.insert(std::make_pair((size_t) chunkId, CachedChunk{ compressed ? nullptr : chunk, compressed, sizeInBytes, m_lru.end() }));
+    if (!inserted.second)
+    {
+        return compressed ? chunk : inserted.first->second.m_chunk;
+    }
+
+    m_lru.push_front(chunkId);
+    inserted.first->second.m_lruPosition = m_lru.begin();
+    m_statistics.m_cachedChunks++;
+    m_statistics.m_cachedBytes += sizeInBytes;
+    if (compressed)
+    {
+        m_statistics.m_uncompressedBytes += compressed->m_decompressedSize;
+    }
+
+    // Evict the least recently used chunks, but never the one just loaded.
+    while (m_budgetInBytes > 0 && m_statistics.m_cachedBytes > m_budgetInBytes && m_lru.size() > 1)
+    {
+        auto evicted = m_chunkMap.find(m_lru.back());
+        m_statistics.m_cachedBytes -= evicted->second.m_sizeInBytes;
+        if (evicted->second.m_compressed)
+        {
+            m_statistics.m_uncompressedBytes -= evicted->second.m_compressed->m_decompressedSize;
+        }
+        m_statistics.m_cachedChunks--;
+        m_statistics.m_evictions++;
+        m_chunkMap.erase(evicted);
+        m_lru.pop_back();
+    }
+
     return chunk;
 }
 
+ChunkCache::Statistics ChunkCache::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+size_t ChunkCache::GetChunkSizeInBytes(ChunkIdType chunkId, const ChunkPtr& chunk)
+{
+    std::vector<SequenceDescription> sequences;
+    m_deserializer->GetSequencesForChunk(chunkId, sequences);
+
+    size_t sizeInBytes = 0;
+    std::vector<SequenceDataPtr> data;
+    for (const auto& sequence : sequences)
+    {
+        data.clear();
+        chunk->GetSequence(sequence.m_id, data);
+        for (size_t i = 0; i < data.size() && i < m_streams.size(); i++)
+        {
+            size_t elementSize = GetSizeByType(m_streams[i]->m_elementType);
+            if (m_streams[i]->m_storageType == StorageType::dense)
+            {
+                const auto& dense = static_cast<const DenseSequenceData&>(*data[i]);
+                const auto& sampleLayout = dense.m_sampleLayout ? dense.m_sampleLayout : m_streams[i]->m_sampleLayout;
+                sizeInBytes += dense.m_numberOfSamples * sampleLayout->GetNumElements() * elementSize;
+            }
+            else
+            {
+                const auto& sparse = static_cast<const SparseSequenceData&>(*data[i]);
+                sizeInBytes += sparse.m_totalNnzCount * (elementSize + sizeof(IndexType)) + sparse.m_nnzCounts.size() * sizeof(IndexType);
+            }
+        }
+    }
+    return sizeInBytes;
+}
+
+ChunkCache::CompressedChunkPtr ChunkCache::Compress(ChunkIdType chunkId, const ChunkPtr& chunk)
+{
+    std::vector<SequenceDescription> sequences;
+    m_deserializer->GetSequencesForChunk(chunkId, sequences);
+
+    auto compressed = std::make_shared<CompressedChunk>();
+    compressed->m_numStreams = m_streams.size();
+    compressed->m_sequenceStreams.reserve(sequences.size() * m_streams.size());
+
+    std::vector<char> buffer;
+    std::vector<SequenceDataPtr> data;
+    for (const auto& sequence : sequences)
+    {
+        data.clear();
+        chunk->GetSequence(sequence.m_id, data);
+        if (data.size() != m_streams.size())
+            LogicError("ChunkCache: Sequence %d has %d streams, expected %d.", (int) sequence.m_id, (int) data.size(), (int) m_streams.size());
+
+        compressed->m_firstStreamOfSequence[sequence.m_id] = compressed->m_sequenceStreams.size();
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            size_t elementSize = GetSizeByType(m_streams[i]->m_elementType);
+            CompressedChunk::SequenceStream stream = {};
+            stream.m_storageType = m_streams[i]->m_storageType;
+            stream.m_numberOfSamples = data[i]->m_numberOfSamples;
+            stream.m_offset = buffer.size();
+            if (stream.m_storageType == StorageType::dense)
+            {
+                const auto& dense = static_cast<const DenseSequenceData&>(*data[i]);
+                stream.m_sampleLayout = dense.m_sampleLayout;
+                const auto& sampleLayout = dense.m_sampleLayout ? dense.m_sampleLayout : m_streams[i]->m_sampleLayout;
+                size_t valuesSize = dense.m_numberOfSamples * sampleLayout->GetNumElements() * elementSize;
+                buffer.resize(AlignTo8(stream.m_offset + valuesSize));
+                memcpy(buffer.data() + stream.m_offset, dense.m_data, valuesSize);
+            }
+            else
+            {
+                const auto& sparse = static_cast<const SparseSequenceData&>(*data[i]);
+                stream.m_numNnzCounts = sparse.m_nnzCounts.size();
+                stream.m_totalNnzCount = sparse.m_totalNnzCount;
+                size_t nnzCountsSize = sizeof(IndexType) * stream.m_numNnzCounts;
+                size_t indicesSize = sizeof(IndexType) * stream.m_totalNnzCount;
+                size_t valuesOffset = AlignTo8(stream.m_offset + nnzCountsSize + indicesSize);
+                size_t valuesSize = stream.m_totalNnzCount * elementSize;
+                buffer.resize(AlignTo8(valuesOffset + valuesSize));
+                memcpy(buffer.data() + stream.m_offset, sparse.m_nnzCounts.data(), nnzCountsSize);
+                memcpy(buffer.data() + stream.m_offset + nnzCountsSize, sparse.m_indices, indicesSize);
+                memcpy(buffer.data() + valuesOffset, sparse.m_data, valuesSize);
+            }
+            compressed->m_sequenceStreams.push_back(stream);
+        }
+    }
+
+    compressed->m_decompressedSize = buffer.size();
+    Lz4Compress(buffer.data(), buffer.size(), compressed->m_block);
+    compressed->m_block.shrink_to_fit();
+    return compressed;
+}
+
 } } }
@@ -6,21 +6,32 @@
 #pragma once
 
 #include <map>
+#include <list>
+#include <mutex>
 #include "DataDeserializer.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-// A cache to store the complete dataset (all chunks) in memory. The caching can
-// be switched on/off by a boolean flag in the reader config section, independent 
-// of the randomization and chunking parameters. The caching should only be enabled 
-// when the whole dataset fits in memory.
+// A cache to store chunks in memory. The caching can be switched on/off by a boolean 
+// flag in the reader config section, independent of the randomization and chunking parameters.
 // Implemented as a wrapping proxy around a deserializer that stores pointers to
-// all chunks it sees in an internal map.
+// the chunks it sees in an internal map.
+// Without a budget, all chunks are kept, which should only be enabled when the whole dataset fits in memory.
+// With a budget (in bytes of sequence data), the least recently used chunks are dropped when it is exceeded,
+// so that the hot part of a dataset larger than memory is not reread every sweep. A dropped chunk is only freed
+// once the randomizer has released it as well; the budget should exceed the data of a randomization window,
+// otherwise every window reloads its chunks.
+// With compression, the cache keeps the sequence data of each chunk as a single LZ4 block (see Lz4Codec.h),
+// decompressed into a new chunk on every hit, on the thread that requests the chunk (the prefetching tasks
+// of the randomizer). The budget then counts the compressed bytes, so several times more of a sparse or
+// text-like dataset fits into it.
 class ChunkCache : public IDataDeserializer
 {
 public:
 
-    ChunkCache(IDataDeserializerPtr deserializer) : m_deserializer(deserializer) { }
+    ChunkCache(IDataDeserializerPtr deserializer, size_t budgetInBytes = 0 /* unlimited */, int traceLevel = 0, bool compress = false);
+
+    ~ChunkCache();
 
     virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
     {
@@ -45,10 +56,49 @@ public:
     // Gets chunk data given its id.
     virtual ChunkPtr GetChunk(ChunkIdType chunkId);
 
+    struct Statistics
+    {
+        size_t m_hits;
+        size_t m_misses;
+        size_t m_evictions;
+        size_t m_cachedChunks;
+        size_t m_cachedBytes; // only counted with a budget or compression
+        size_t m_uncompressedBytes; // of the cached chunks, only counted with compression
+    };
+
+    Statistics GetStatistics() const;
+
 private:
+    // Bytes of sequence data of a chunk, as returned by its sequences.
+    size_t GetChunkSizeInBytes(ChunkIdType chunkId, const ChunkPtr& chunk);
+
+    class CompressedChunk;
+    class DecompressedChunk;
+    typedef std::shared_ptr<CompressedChunk> CompressedChunkPtr;
+
+    // Compresses the sequences of a chunk.
+    CompressedChunkPtr Compress(ChunkIdType chunkId, const ChunkPtr& chunk);
+
+    struct CachedChunk
+    {
+        ChunkPtr m_chunk;                // without compression
+        CompressedChunkPtr m_compressed; // with compression
+        size_t m_sizeInBytes;
+        std::list<ChunkIdType>::iterator m_lruPosition;
+    };
+
     // A map of currently loaded chunks
-    std::map<size_t, ChunkPtr> m_chunkMap;
+    std::map<size_t, CachedChunk> m_chunkMap;
+    // Chunk ids in the order of their last use, the most recent first.
+    std::list<ChunkIdType> m_lru;
     IDataDeserializerPtr m_deserializer;
+    std::vector<StreamDescriptionPtr> m_streams;
+
+    size_t m_budgetInBytes;
+    int m_traceLevel;
+    bool m_compress;
+    Statistics m_statistics;
+    mutable std::mutex m_mutex;
 
     DISABLE_COPY_AND_MOVE(ChunkCache);
 };
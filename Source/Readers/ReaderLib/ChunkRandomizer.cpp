@@ -38,9 +38,13 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     }
 
     ChunkRandomizer::ChunkRandomizer(IDataDeserializerPtr deserializer, size_t randomizationRangeInSamples, bool legacy) :
-        m_deserializer(deserializer), m_legacy(legacy), m_randomizationRangeInSamples(randomizationRangeInSamples)
+        ChunkRandomizer(deserializer->GetChunkDescriptions(), randomizationRangeInSamples, legacy)
+    {
+    }
+
+    ChunkRandomizer::ChunkRandomizer(const ChunkDescriptions& chunks, size_t randomizationRangeInSamples, bool legacy) :
+        m_originalChunks(chunks), m_legacy(legacy), m_randomizationRangeInSamples(randomizationRangeInSamples)
     {
-        m_originalChunks = m_deserializer->GetChunkDescriptions();
         assert(m_originalChunks.size() < CHUNKID_MAX);
     }
 
@@ -52,6 +52,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     public:
         ChunkRandomizer(IDataDeserializerPtr deserializer, size_t randomizationRangeInSamples, bool legacy = false);
 
+        // Randomizes a subset of the chunks of a deserializer, e.g. those of a worker.
+        ChunkRandomizer(const ChunkDescriptions& chunks, size_t randomizationRangeInSamples, bool legacy = false);
+
         // Gets randomized chunks.
         const std::vector<RandomizedChunk>& GetRandomizedChunks() const;
 
@@ -59,7 +62,6 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         void Randomize(unsigned int seed);
 
     private:
-        IDataDeserializerPtr m_deserializer;
         // Randomized chunks.
         std::vector<RandomizedChunk> m_randomizedChunks;
         // Original chunks.
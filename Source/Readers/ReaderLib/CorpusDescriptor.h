@@ -6,7 +6,7 @@
 #pragma once
 
 #include "StringToIdMap.h"
-#include <set>
+#include <vector>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -16,7 +16,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 class CorpusDescriptor
 {
     bool m_includeAll;
-    std::set<size_t> m_sequenceIds;
+    std::vector<bool> m_isIncluded; // by the id of the key in the string registry, ids added later are not included
 
 public:
     CorpusDescriptor(const std::wstring& file) : m_includeAll(false)
@@ -24,7 +24,12 @@ public:
         // Add all sequence ids.
         for (msra::files::textreader r(file); r;)
         {
-            m_sequenceIds.insert(m_stringRegistry[r.getline()]);
+            size_t id = m_stringRegistry[r.getline()];
+            if (id >= m_isIncluded.size())
+            {
+                m_isIncluded.resize(id + 1, false);
+            }
+            m_isIncluded[id] = true;
         }
     }
 
@@ -46,7 +51,7 @@ public:
             return false;
         }
 
-        return m_sequenceIds.find(id) != m_sequenceIds.end();
+        return id < m_isIncluded.size() && m_isIncluded[id];
     }
 
     // Gets the string registry
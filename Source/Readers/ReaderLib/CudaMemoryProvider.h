@@ -5,29 +5,54 @@
 
 #pragma once
 
-#include <memory>
+#include <map>
+#include <mutex>
 #include <CUDAPageLockedMemAllocator.h>
 
 #include "MemoryProvider.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-/// TODO: Memory provider should reside on the matrix. It is responsibility of the network
-/// to decide what memory to use per stream. This class will be moved in the near future.
+// Allocates the packers' buffers in page-locked (pinned) host memory, so that PrefetchGPUDataTransferer can upload
+// them to the GPU by DMA, without first copying them into a pinned staging buffer.
+// ReaderShim only learns the device from the first minibatch it fills, so the provider allocates from the heap
+// until SetDeviceId() is called; buffers allocated before are replaced by the packers at the start of the next epoch.
+// Alloc() and Free() are called on the prefetch thread, SetDeviceId() and IsPageLocked() on the main thread.
+// TODO: Memory provider should reside on the matrix. It is responsibility of the network
+// to decide what memory to use per stream.
 class CudaMemoryProvider : public MemoryProvider
 {
-    std::unique_ptr<CUDAPageLockedMemAllocator> m_allocator;
+    mutable std::mutex m_mutex;
+    int m_deviceId;                      // < 0 while allocating from the heap
+    std::map<const void*, int> m_pinned; // page-locked allocations and the device they were made for
 
 public:
-    CudaMemoryProvider(int deviceId)
+    explicit CudaMemoryProvider(int deviceId = -1)
+        : m_deviceId(deviceId)
     {
-        m_allocator = std::make_unique<CUDAPageLockedMemAllocator>(deviceId);
+    }
+
+    void SetDeviceId(int deviceId)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_deviceId = deviceId;
     }
 
     virtual void* Alloc(size_t elementSize, size_t numberOfElements) override
     {
         size_t totalSize = elementSize * numberOfElements;
-        return m_allocator->Malloc(totalSize);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_deviceId >= 0 && totalSize > 0)
+        {
+            // returns nullptr in CPU-only builds
+            void* p = CUDAPageLockedMemAllocator::Malloc(totalSize, m_deviceId);
+            if (p)
+            {
+                m_pinned[p] = m_deviceId;
+                return p;
+            }
+        }
+        return ::operator new(totalSize);
     }
 
     virtual void Free(void* p) override
@@ -37,7 +62,27 @@ public:
             return;
         }
 
-        m_allocator->Free(reinterpret_cast<char*>(p));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto pinned = m_pinned.find(p);
+        if (pinned == m_pinned.end())
+        {
+            ::operator delete(p);
+            return;
+        }
+        CUDAPageLockedMemAllocator::Free(p, pinned->second);
+        m_pinned.erase(pinned);
+    }
+
+    virtual bool IsPageLocked(const void* p) const override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pinned.find(p) != m_pinned.end();
+    }
+
+    virtual bool AllocatesPageLocked() const override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_deviceId >= 0;
     }
 };
 } } }
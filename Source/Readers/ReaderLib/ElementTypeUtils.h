@@ -22,8 +22,18 @@ inline size_t GetSizeByType(ElementType type)
         return sizeof(double);
     case ElementType::tatom:
         return sizeof(char);
+    case ElementType::tuint8:
+        return sizeof(unsigned char);
+    case ElementType::tfloat16:
+        return sizeof(unsigned short);
     default:
         RuntimeError("Unsupported type '%d'", type);
     }
 }
+
+// Whether the stream data are stored compactly, and converted to the network's precision on the device.
+inline bool IsCompactElementType(ElementType type)
+{
+    return type == ElementType::tuint8 || type == ElementType::tfloat16;
+}
 } } }
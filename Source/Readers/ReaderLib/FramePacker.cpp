@@ -20,9 +20,40 @@ MBLayoutPtr FramePacker::CreateMBLayout(const StreamBatch& batch)
         RuntimeError("Detected a non-frame sequence of size %d in frame mode.", 
             (int)(*violation)->m_numberOfSamples);
     }
-    // Creating the minibatch layout.
-    MBLayoutPtr pMBLayout = make_shared<MBLayout>();
-    pMBLayout->InitAsFrameMode(batch.size());
+    // Creating the minibatch layout (the same as before unless the number of frames changed).
+    return GetLayout(batch, [&batch](MBLayout& layout) { layout.InitAsFrameMode(batch.size()); });
+}
+
+MBLayoutPtr FramePacker::PackDenseStream(const StreamBatch& batch, size_t streamIndex)
+{
+    const auto& stream = m_inputStreamDescriptions[streamIndex];
+    if (stream->m_storageType != StorageType::dense) // (sparse input packed as dense)
+    {
+        return SequencePacker::PackDenseStream(batch, streamIndex);
+    }
+
+    auto pMBLayout = CreateMBLayout(batch);
+    size_t sampleSize = GetSampleSize(stream);
+    auto& buffer = m_streamBuffers[streamIndex];
+    size_t requiredSize = batch.size() * sampleSize;
+    if (buffer.m_size < requiredSize)
+    {
+        buffer.Resize(requiredSize);
+    }
+
+    // Without randomization, frames come in the order of their chunk.
+    char* destination = buffer.m_data.get();
+    for (size_t i = 0; i < batch.size();)
+    {
+        const char* source = reinterpret_cast<const char*>(batch[i]->m_data);
+        size_t end = i + 1;
+        while (end < batch.size() && batch[end]->m_data == source + (end - i) * sampleSize)
+        {
+            end++;
+        }
+        memcpy(destination + i * sampleSize, source, (end - i) * sampleSize);
+        i = end;
+    }
     return pMBLayout;
 }
 
@@ -23,6 +23,9 @@ public:
 private:
 
     MBLayoutPtr CreateMBLayout(const StreamBatch& batch) override;
+
+    // Frame i goes to column i, frames that are adjacent in memory are copied at once.
+    MBLayoutPtr PackDenseStream(const StreamBatch& batch, size_t streamIndex) override;
 };
 
 typedef std::shared_ptr<FramePacker> FramePackerPtr;
@@ -0,0 +1,184 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdint.h>
+#include <string.h>
+#include "Lz4Codec.h"
+#include "Basics.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// constants of the block format
+static const size_t s_minMatch = 4;
+static const size_t s_lastLiterals = 5; // the last bytes are always literals
+static const size_t s_matchSearchLimit = 12; // no match starts within the last bytes
+static const size_t s_maxOffset = 65535;
+static const int s_hashBits = 16;
+
+static uint32_t Read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static size_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - s_hashBits);
+}
+
+// the length of a literal run or match beyond what fits into the token, in bytes of 255 and a remainder
+static unsigned char* WriteLength(unsigned char* op, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char) length;
+    return op;
+}
+
+static unsigned char* WriteSequence(unsigned char* op, const unsigned char* literals, size_t numLiterals, size_t offset, size_t matchLength)
+{
+    unsigned char* token = op++;
+    *token = (unsigned char) ((numLiterals >= 15 ? 15 : numLiterals) << 4);
+    if (numLiterals >= 15)
+        op = WriteLength(op, numLiterals - 15);
+    memcpy(op, literals, numLiterals);
+    op += numLiterals;
+    if (matchLength == 0) // the last sequence has literals only
+        return op;
+
+    *op++ = (unsigned char) (offset & 0xff);
+    *op++ = (unsigned char) (offset >> 8);
+    size_t length = matchLength - s_minMatch;
+    *token |= (unsigned char) (length >= 15 ? 15 : length);
+    if (length >= 15)
+        op = WriteLength(op, length - 15);
+    return op;
+}
+
+size_t Lz4CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+void Lz4Compress(const char* source, size_t size, std::vector<char>& target)
+{
+    target.resize(Lz4CompressBound(size));
+    const unsigned char* begin = reinterpret_cast<const unsigned char*>(source);
+    const unsigned char* end = begin + size;
+    const unsigned char* anchor = begin;
+    unsigned char* op = reinterpret_cast<unsigned char*>(target.data());
+
+    if (size > s_matchSearchLimit)
+    {
+        // positions of the last occurrences of 4-byte sequences
+        std::vector<size_t> table((size_t) 1 << s_hashBits, SIZE_MAX);
+        const unsigned char* matchLimit = end - s_lastLiterals;
+        const unsigned char* searchLimit = end - s_matchSearchLimit;
+        const unsigned char* ip = begin;
+        size_t misses = 0;
+        while (ip < searchLimit)
+        {
+            uint32_t sequence = Read32(ip);
+            size_t& entry = table[Hash(sequence)];
+            const unsigned char* match = entry == SIZE_MAX ? nullptr : begin + entry;
+            entry = ip - begin;
+            if (match == nullptr || (size_t) (ip - match) > s_maxOffset || Read32(match) != sequence)
+            {
+                // skip faster through data that does not compress
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            // extend the match backwards into the pending literals, and forwards
+            while (ip > anchor && match > begin && ip[-1] == match[-1])
+            {
+                ip--;
+                match--;
+            }
+            size_t length = s_minMatch;
+            while (ip + length < matchLimit && ip[length] == match[length])
+                length++;
+
+            op = WriteSequence(op, anchor, ip - anchor, ip - match, length);
+            ip += length;
+            anchor = ip;
+            if (ip < searchLimit)
+                table[Hash(Read32(ip - 2))] = ip - 2 - begin;
+        }
+    }
+
+    op = WriteSequence(op, anchor, end - anchor, 0, 0);
+    target.resize(op - reinterpret_cast<unsigned char*>(target.data()));
+}
+
+void Lz4Decompress(const char* source, size_t size, char* target, size_t targetSize)
+{
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(source);
+    const unsigned char* iend = ip + size;
+    unsigned char* op = reinterpret_cast<unsigned char*>(target);
+    unsigned char* oend = op + targetSize;
+
+    auto readLength = [&](size_t length) -> size_t
+    {
+        if (length != 15)
+            return length;
+        unsigned char b;
+        do
+        {
+            if (ip >= iend)
+                RuntimeError("Lz4Decompress: The compressed data are truncated.");
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return length;
+    };
+
+    for (;;)
+    {
+        if (ip >= iend)
+            RuntimeError("Lz4Decompress: The compressed data are truncated.");
+        unsigned char token = *ip++;
+
+        size_t numLiterals = readLength(token >> 4);
+        if (numLiterals > (size_t) (iend - ip) || numLiterals > (size_t) (oend - op))
+            RuntimeError("Lz4Decompress: Malformed compressed data (literals exceed the block).");
+        memcpy(op, ip, numLiterals);
+        ip += numLiterals;
+        op += numLiterals;
+        if (ip == iend) // the last sequence
+            break;
+
+        if (iend - ip < 2)
+            RuntimeError("Lz4Decompress: The compressed data are truncated.");
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t) (op - reinterpret_cast<unsigned char*>(target)))
+            RuntimeError("Lz4Decompress: Malformed compressed data (invalid match offset).");
+
+        size_t length = readLength(token & 15) + s_minMatch;
+        if (length > (size_t) (oend - op))
+            RuntimeError("Lz4Decompress: Malformed compressed data (a match exceeds the decompressed size).");
+        const unsigned char* match = op - offset;
+        if (offset >= length)
+        {
+            memcpy(op, match, length);
+            op += length;
+        }
+        else // overlapping, repeats the last offset bytes
+        {
+            for (size_t i = 0; i < length; i++)
+                *op++ = *match++;
+        }
+    }
+
+    if (op != oend)
+        RuntimeError("Lz4Decompress: The decompressed size (%d) differs from the expected one (%d).", (int) (op - reinterpret_cast<unsigned char*>(target)), (int) targetSize);
+}
+
+}}}
@@ -0,0 +1,32 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// LZ4 block compression of chunk data
+// -----------------------------------------------------------------------
+
+// A self-contained implementation of the LZ4 block format (as produced by LZ4_compress_default() and
+// lz4.block.compress(data, store_size=False) in Python), used for compressed chunks in the binary
+// format and in the ChunkCache. It favors speed over ratio: decompression runs at memory speed, so
+// reading compressed chunks costs much less than the I/O they save on sparse and text-like data.
+// The block does not store its decompressed size, the caller has to keep it.
+
+// Upper bound of the compressed size of size bytes.
+size_t Lz4CompressBound(size_t size);
+
+// Compresses size bytes into target, which is resized to the compressed size.
+void Lz4Compress(const char* source, size_t size, std::vector<char>& target);
+
+// Decompresses a block into exactly targetSize bytes; fails on malformed or truncated input.
+void Lz4Decompress(const char* source, size_t size, char* target, size_t targetSize);
+
+}}}
@@ -0,0 +1,115 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include "Basics.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// MappedFile -- a read-only memory mapping of a whole file
+// -----------------------------------------------------------------------
+
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::wstring& path)
+        : m_data(nullptr), m_size(0)
+    {
+#ifdef _WIN32
+        m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            RuntimeError("Cannot open the input file (%ls), error %x.", path.c_str(), (unsigned int) GetLastError());
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size))
+        {
+            CloseHandle(m_file);
+            RuntimeError("Cannot retrieve the size of the input file (%ls).", path.c_str());
+        }
+        m_size = (size_t) size.QuadPart;
+        m_mapping = m_size > 0 ? CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        if (m_mapping != NULL)
+            m_data = (const char*) MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (m_data == nullptr)
+        {
+            if (m_mapping != NULL)
+                CloseHandle(m_mapping);
+            CloseHandle(m_file);
+            RuntimeError("Cannot memory-map the input file (%ls).", path.c_str());
+        }
+#else
+        m_file = open(msra::strfun::utf8(path).c_str(), O_RDONLY);
+        if (m_file == -1)
+            RuntimeError("Cannot open the input file (%ls).", path.c_str());
+        struct stat info;
+        if (fstat(m_file, &info) == -1)
+        {
+            close(m_file);
+            RuntimeError("Cannot retrieve the size of the input file (%ls).", path.c_str());
+        }
+        m_size = (size_t) info.st_size;
+        void* data = m_size > 0 ? mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_file, 0) : MAP_FAILED;
+        if (data == MAP_FAILED)
+        {
+            close(m_file);
+            RuntimeError("Cannot memory-map the input file (%ls).", path.c_str());
+        }
+        m_data = (const char*) data;
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+#else
+        munmap((void*) m_data, m_size);
+        close(m_file);
+#endif
+    }
+
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+    // hint that a range is going to be read
+    void Prefetch(size_t offset, size_t size) const
+    {
+#ifndef _WIN32
+        size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+        size_t begin = offset / pageSize * pageSize;
+        madvise((void*) (m_data + begin), offset + size - begin, MADV_WILLNEED);
+#else
+        UNUSED(offset);
+        UNUSED(size);
+#endif
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(MappedFile);
+
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_file;
+#endif
+};
+
+typedef std::shared_ptr<MappedFile> MappedFilePtr;
+
+}}}
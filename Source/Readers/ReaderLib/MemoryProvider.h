@@ -22,6 +22,13 @@ public:
     // Frees contiguous storage.
     virtual void Free(void* ptr) = 0;
 
+    // Whether ptr was allocated in page-locked host memory, which can be uploaded to the GPU without staging.
+    virtual bool IsPageLocked(const void* /*ptr*/) const { return false; }
+
+    // Whether storage allocated from now on is page-locked. Buffers allocated before that are
+    // replaced at the next opportunity (see PackerBase::StartEpoch()).
+    virtual bool AllocatesPageLocked() const { return false; }
+
     // TODO: add Resize function.
 
     virtual ~MemoryProvider() { }
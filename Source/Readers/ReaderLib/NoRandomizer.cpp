@@ -8,6 +8,9 @@
 
 #include "NoRandomizer.h"
 #include "DataReader.h"
+#include "CPUThreadPool.h"
+#include "EventTracer.h"
+#include "ReaderCounters.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -57,8 +60,14 @@ void NoRandomizer::StartEpoch(const EpochConfiguration& config)
         m_config.m_totalEpochSizeInSamples = m_totalNumberOfSamples;
     }
 
-    m_samplePositionInEpoch = 0;
-    m_globalSamplePosition = m_config.m_totalEpochSizeInSamples * config.m_epochIndex;
+    SetCurrentSamplePosition(m_config.m_totalEpochSizeInSamples * config.m_epochIndex);
+};
+
+// Moves the cursor to the sequence that contains the sample position.
+void NoRandomizer::SetCurrentSamplePosition(size_t samplePosition)
+{
+    m_globalSamplePosition = samplePosition;
+    m_samplePositionInEpoch = samplePosition - m_config.m_totalEpochSizeInSamples * m_config.m_epochIndex;
     size_t sweepSamplePosition = m_globalSamplePosition % m_totalNumberOfSamples;
 
     ChunkIdType chunkIndex = GetChunkIndexOf(sweepSamplePosition);
@@ -80,7 +89,7 @@ void NoRandomizer::StartEpoch(const EpochConfiguration& config)
     size_t numberOfSamples = 0;
     size_t sequenceId = 0;
 
-    // Currently linear, happens only at the border of epochs.
+    // Currently linear, happens only at the border of epochs and on restoring a reader state.
     for (size_t i = 0; i < m_sequenceWindow.size(); ++i)
     {
         size_t sequenceSize = m_sequenceWindow[i].m_numberOfSamples;
@@ -96,7 +105,7 @@ void NoRandomizer::StartEpoch(const EpochConfiguration& config)
 
     m_currentSequencePositionInChunk = sequenceId;
     assert(m_chunkDescriptions[m_currentChunkPosition]->m_numberOfSequences > m_currentSequencePositionInChunk);
-};
+}
 
 // Moving the cursor to the next sequence. Possibly updating the chunk information if needed.
 void NoRandomizer::MoveToNextSequence()
@@ -144,6 +153,7 @@ std::vector<SequenceDescription> NoRandomizer::GetNextSequenceDescriptions(size_
 
 Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
 {
+    EventTracer::Scope scope("Deserialize", "reader");
     Sequences result;
     if (m_config.m_totalEpochSizeInSamples <= m_samplePositionInEpoch)
     {
@@ -184,6 +194,8 @@ Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
         auto it = chunks.find(sequenceDescription.m_chunkId);
         if (it == chunks.end())
         {
+            EventTracer::Scope chunkScope("ChunkLoad", "reader");
+            ReaderCounters::Timer timer(ReaderCounters::chunkLoadMicroseconds);
             chunks[sequenceDescription.m_chunkId] = m_deserializer->GetChunk(sequenceDescription.m_chunkId);
         }
     }
@@ -208,9 +220,7 @@ Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
     // TODO: This will be changed, when we move transformers under the (no-) randomizer, should not deal with multithreading here.
     if (m_multithreadedGetNextSequences)
     {
-#pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < subsetSize; ++i)
-            process(i);
+        CPUThreadPool::ParallelFor(0, subsetSize, CPUThreadPool::MinWorkPerChunk, process);
     }
     else
     {
@@ -27,6 +27,13 @@ public:
         return m_deserializer->GetStreamDescriptions();
     }
 
+    virtual size_t GetCurrentSamplePosition() override
+    {
+        return m_globalSamplePosition;
+    }
+
+    virtual void SetCurrentSamplePosition(size_t samplePosition) override;
+
 private:
     // Gets next sequence descriptions with total size less than sampleCount.
     std::vector<SequenceDescription> GetNextSequenceDescriptions(size_t sampleCount);
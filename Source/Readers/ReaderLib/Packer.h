@@ -19,6 +19,18 @@ public:
     virtual void StartEpoch(const EpochConfiguration& config) = 0;
 
     virtual Minibatch ReadMinibatch() = 0;
+
+    // Gets and restores the position in the epoch, see Reader::GetState().
+    virtual bool GetState(ReaderState& /*state*/)
+    {
+        return false;
+    }
+
+    virtual void SetState(const ReaderState& /*state*/)
+    {
+        LogicError("SetState: The packer does not support restoring its state.");
+    }
+
     virtual ~Packer() {}
 };
 
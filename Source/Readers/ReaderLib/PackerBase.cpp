@@ -31,6 +31,77 @@ void PackerBase::StartEpoch(const EpochConfiguration& config)
     {
         LogicError("Minibatch size cannot be zero.");
     }
+
+    // If the memory provider has switched to page-locked memory, drop the buffers allocated before,
+    // so that the next minibatch is packed into page-locked memory.
+    for (auto& buffer : m_streamBuffers)
+    {
+        if (buffer.m_data && buffer.m_memoryProvider->AllocatesPageLocked() && !buffer.m_memoryProvider->IsPageLocked(buffer.m_data.get()))
+        {
+            buffer.m_data.reset();
+            buffer.m_size = 0;
+        }
+    }
+}
+
+bool PackerBase::GetState(ReaderState& state)
+{
+    state.m_samplePosition = m_sequenceEnumerator->GetCurrentSamplePosition();
+    state.m_slotSequencePositions.clear();
+    state.m_slotSampleCursors.clear();
+    return state.m_samplePosition != SIZE_MAX;
+}
+
+void PackerBase::SetState(const ReaderState& state)
+{
+    if (!state.m_slotSequencePositions.empty())
+    {
+        RuntimeError("SetState: The reader state holds sequences of a truncated BPTT packer.");
+    }
+
+    m_sequenceEnumerator->SetCurrentSamplePosition(state.m_samplePosition);
+}
+
+MBLayoutPtr PackerBase::GetLayout(const StreamBatch& batch, const function<void(MBLayout&)>& initLayout)
+{
+    auto isSameAs = [&batch](const CachedLayout& cached)
+    {
+        if (cached.m_sequenceLengths.size() != batch.size())
+            return false;
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            if (cached.m_sequenceLengths[i] != batch[i]->m_numberOfSamples)
+                return false;
+        }
+        return true;
+    };
+    for (const auto& cached : m_layoutCache)
+    {
+        if (isSameAs(cached))
+            return cached.m_layout;
+    }
+
+    // take over the oldest slot; its layout can be refilled in place if no minibatch holds it anymore
+    size_t slotIndex;
+    if (m_layoutCache.size() < max<size_t>(m_outputStreamDescriptions.size(), 1))
+    {
+        slotIndex = m_layoutCache.size();
+        m_layoutCache.push_back(CachedLayout());
+    }
+    else
+    {
+        slotIndex = m_nextLayoutCacheSlot;
+        m_nextLayoutCacheSlot = (m_nextLayoutCacheSlot + 1) % m_layoutCache.size();
+    }
+    auto& slot = m_layoutCache[slotIndex];
+    if (!slot.m_layout || slot.m_layout.use_count() > 1)
+        slot.m_layout = make_shared<MBLayout>();
+    initLayout(*slot.m_layout);
+
+    slot.m_sequenceLengths.resize(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i)
+        slot.m_sequenceLengths[i] = batch[i]->m_numberOfSamples;
+    return slot.m_layout;
 }
 
 PackerBase::PackerBase(MemoryProviderPtr memoryProvider,
@@ -38,7 +109,8 @@ PackerBase::PackerBase(MemoryProviderPtr memoryProvider,
     const std::vector<StreamDescriptionPtr>& streams) :
     m_sequenceEnumerator(sequenceEnumerator),
     m_minibatchSize(0),
-    m_outputStreamDescriptions(streams)
+    m_outputStreamDescriptions(streams),
+    m_nextLayoutCacheSlot(0)
 {
     m_inputStreamDescriptions = sequenceEnumerator->GetStreamDescriptions();
     assert(m_inputStreamDescriptions.size() != 0);
@@ -53,7 +125,7 @@ PackerBase::PackerBase(MemoryProviderPtr memoryProvider,
         UNUSED(stream);
 
         // Input and output should match in everything except for sparse/dense storage type.
-        assert(stream->m_elementType == ElementType::tfloat || stream->m_elementType == ElementType::tdouble);
+        assert(stream->m_elementType == ElementType::tfloat || stream->m_elementType == ElementType::tdouble || IsCompactElementType(stream->m_elementType));
         assert(stream->m_name == m_inputStreamDescriptions[i]->m_name);
         assert(stream->m_id == m_inputStreamDescriptions[i]->m_id);
         assert(GetSampleSize(m_inputStreamDescriptions[i]) == GetSampleSize(stream));
@@ -65,6 +137,14 @@ PackerBase::PackerBase(MemoryProviderPtr memoryProvider,
                 stream->m_name.c_str());
         }
 
+        // compact element types are converted by the ReaderShim, which only does it for dense data
+        if (IsCompactElementType(stream->m_elementType) &&
+            (stream->m_storageType != StorageType::dense || m_inputStreamDescriptions[i]->m_storageType != StorageType::dense))
+        {
+            RuntimeError("Stream '%ls' has a compact element type, which is only supported for dense data.",
+                stream->m_name.c_str());
+        }
+
         m_streamBuffers.push_back(StreamBuffer(memoryProvider));
     }
 }
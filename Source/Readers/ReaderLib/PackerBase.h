@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <functional>
 #include "Reader.h"
 #include "MemoryProvider.h"
 #include "SequenceEnumerator.h"
@@ -47,14 +48,14 @@ protected:
     // at the offset equal to value index * elementSize. sampleOffset specifies the offset of the
     // first value from the given sample in the sequence data/indices array (sampleOffset is equal
     // to the sum of non-zero value counts of all preceding samples).
-    void PackSparseSampleAsDense(char* destination, SparseSequenceDataPtr sequence,
+    void PackSparseSampleAsDense(char* destination, const SparseSequenceDataPtr& sequence,
         size_t sampleIndex, size_t sampleOffset, size_t sampleSize, size_t elementSize);
 
     // Packs a dense sample as dense. Copies sampleSize bytes staring at the sampleOffset from 
     // the data portion of the source sequence to the destination block of memory. sampleOffset 
     // specifies the offset of the first value from the given sample in the sequence data/ array 
     // (sampleOffset is equal to the sum of sample sizes of all preceding samples).
-    void PackDenseSample(char* destination, SequenceDataPtr sequence, size_t sampleOffset, size_t sampleSize);
+    void PackDenseSample(char* destination, const SequenceDataPtr& sequence, size_t sampleOffset, size_t sampleSize);
 
     SequenceEnumeratorPtr m_sequenceEnumerator;
 
@@ -70,12 +71,32 @@ protected:
     // Minibatch size in samples.
     size_t m_minibatchSize;
 
+    // Returns the layout for a batch. Batches with the same sequence lengths as a recent one (always so in frame mode
+    // and with fixed-length data) get that same layout, which is read-only once packed. Otherwise initLayout() fills
+    // a layout, reusing the storage of a recent one that nobody holds anymore.
+    MBLayoutPtr GetLayout(const StreamBatch& batch, const std::function<void(MBLayout&)>& initLayout);
+
+private:
+    struct CachedLayout
+    {
+        std::vector<size_t> m_sequenceLengths;
+        MBLayoutPtr m_layout;
+    };
+
+    // Layouts of the recent batches, one for each stream at most
+    std::vector<CachedLayout> m_layoutCache;
+    size_t m_nextLayoutCacheSlot;
+
 public:
     // Sets current epoch configuration.
     virtual void StartEpoch(const EpochConfiguration& config) override;
+
+    // A packer that does not hold sequences over to the next minibatch is positioned by the sequence enumerator alone.
+    virtual bool GetState(ReaderState& state) override;
+    virtual void SetState(const ReaderState& state) override;
 };
 
-inline void PackerBase::PackSparseSampleAsDense(char* destination, SparseSequenceDataPtr sequence,
+inline void PackerBase::PackSparseSampleAsDense(char* destination, const SparseSequenceDataPtr& sequence,
     size_t sampleIndex, size_t sampleOffset, size_t sampleSize, size_t elementSize)
 {
     //The sample is sparse, first, need to zero out the buffer.
@@ -97,7 +118,7 @@ inline void PackerBase::PackSparseSampleAsDense(char* destination, SparseSequenc
     }
 }
 
-inline void PackerBase::PackDenseSample(char* destination, SequenceDataPtr sequence, size_t sampleOffset, size_t sampleSize)
+inline void PackerBase::PackDenseSample(char* destination, const SequenceDataPtr& sequence, size_t sampleOffset, size_t sampleSize)
 {
     // Because the sample is dense - simply copying it to the output.
     memcpy(destination, (const char*)(sequence->m_data) + sampleOffset, sampleSize);
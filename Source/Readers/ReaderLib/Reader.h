@@ -10,6 +10,9 @@
 #include "Sequences.h"
 #include "TensorShape.h"
 
+namespace msra { namespace dbn { class latticepair; } }
+namespace msra { namespace asr { class simplesenonehmm; } }
+
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 typedef GPUSPARSE_INDEX_TYPE IndexType;
@@ -37,7 +40,10 @@ enum class ElementType
 {
     tfloat,  // single precision
     tdouble, // double precision
-    tatom    // sizeof(atom) == 1 constitute of blobs -> sequences of atoms (i.e. used for lattices, hmmm, etc.)
+    tatom,   // sizeof(atom) == 1 constitute of blobs -> sequences of atoms (i.e. used for lattices, hmmm, etc.)
+    // compact storage of dense streams, converted to the network's precision after upload (see StreamDescription):
+    tuint8,  // unsigned char, e.g. image pixels
+    tfloat16 // IEEE half precision stored as unsigned short, see Float16.h
 };
 
 // Supported storage types, will be extended in the future.
@@ -58,6 +64,21 @@ struct StreamDescription
     ElementType m_elementType;     // Element type of the stream
     TensorShapePtr m_sampleLayout; // Layout of the sample for the stream
                                    // If not specified - can be specified per sequence
+
+    // For the compact element types only: the network sees (value - m_storageOffset[i]) * m_storageScale
+    // for element i of a sample, so that a normalization the reader would do on the host is done on the device instead.
+    double m_storageScale;
+    std::shared_ptr<const std::vector<float>> m_storageOffset; // [element of sample], or null for none
+
+    StreamDescription()
+        : m_id(0), m_storageType(StorageType::dense), m_elementType(ElementType::tfloat), m_storageScale(1)
+    {
+    }
+
+    StreamDescription(const std::wstring& name, StreamId id, StorageType storageType, ElementType elementType, const TensorShapePtr& sampleLayout)
+        : m_name(name), m_id(id), m_storageType(storageType), m_elementType(elementType), m_sampleLayout(sampleLayout), m_storageScale(1)
+    {
+    }
 };
 typedef std::shared_ptr<StreamDescription> StreamDescriptionPtr;
 
@@ -72,6 +93,16 @@ struct StreamMinibatch
 };
 typedef std::shared_ptr<StreamMinibatch> StreamMinibatchPtr;
 
+// Lattices of the utterances of a minibatch, for sequence training (see IDataReader::GetMinibatch4SE()).
+struct LatticeMinibatch
+{
+    std::vector<std::shared_ptr<const msra::dbn::latticepair>> m_lattices; // utterance by utterance, ordered by parallel sequence and time
+    std::vector<size_t> m_uids;                                            // state ids of all frames of the utterances, concatenated
+    std::vector<size_t> m_boundaries;                                      // phone boundaries of all frames, concatenated
+    std::vector<size_t> m_parallelSequences;                               // [utterance] parallel sequence of the utterance in the layout
+};
+typedef std::shared_ptr<LatticeMinibatch> LatticeMinibatchPtr;
+
 // Represents a single minibatch, that contains information about all streams.
 struct Minibatch
 {
@@ -83,6 +114,9 @@ struct Minibatch
     // Minibatch data
     std::vector<StreamMinibatchPtr> m_data;
 
+    // Lattices of the minibatch if the reader provides them, otherwise null.
+    LatticeMinibatchPtr m_lattices;
+
     Minibatch() : m_endOfEpoch(false)
     {
     }
@@ -92,6 +126,22 @@ struct Minibatch
     }
 };
 
+// The position of a reader inside an epoch, from which it continues with the minibatch that follows the ones read so far.
+struct ReaderState
+{
+    // Position of the next sequence on the global sample timeline of the sequence enumerator.
+    size_t m_samplePosition;
+
+    // Sequences a packer holds over to the next minibatch (truncated BPTT), for each slot the
+    // positions of its sequences on the timeline and the number of samples of the front one already returned.
+    std::vector<std::vector<size_t>> m_slotSequencePositions;
+    std::vector<size_t> m_slotSampleCursors;
+
+    ReaderState() : m_samplePosition(0)
+    {
+    }
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // Main Reader interface. The border interface between the CNTK and reader libraries.
 // TODO: Expect to change in a little bit: stream matrices provided by the network as input.
@@ -108,6 +158,24 @@ public:
     // Reads a minibatch that contains data across all streams.
     virtual Minibatch ReadMinibatch() = 0;
 
+    // Gets the HMM for sequence training; returns false if the reader does not provide one.
+    virtual bool GetHmmData(msra::asr::simplesenonehmm* /*hmm*/)
+    {
+        return false;
+    }
+
+    // Gets the state after the minibatches read so far in the epoch; returns false if the reader cannot restore it.
+    virtual bool GetState(ReaderState& /*state*/)
+    {
+        return false;
+    }
+
+    // Continues the current epoch from a state returned by GetState(), after StartEpoch() with the same configuration.
+    virtual void SetState(const ReaderState& /*state*/)
+    {
+        LogicError("SetState: The reader does not support restoring its state.");
+    }
+
     virtual ~Reader() {};
 };
 
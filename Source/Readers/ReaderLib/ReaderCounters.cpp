@@ -0,0 +1,28 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "ReaderCounters.h"
+#include "DataReader.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+std::atomic<uint64_t> ReaderCounters::s_counters[ReaderCounters::numCounters];
+
+ReaderStatistics ReaderCounters::Get()
+{
+    auto get = [](Counter counter) { return s_counters[counter].load(std::memory_order_relaxed); };
+
+    ReaderStatistics statistics;
+    statistics.m_chunkLoadSeconds = get(chunkLoadMicroseconds) * 1e-6;
+    statistics.m_transformSeconds = get(transformMicroseconds) * 1e-6;
+    statistics.m_packSeconds = get(packMicroseconds) * 1e-6;
+    statistics.m_prefetchWaitSeconds = get(prefetchWaitMicroseconds) * 1e-6;
+    statistics.m_chunkCacheHits = (size_t) get(chunkCacheHits);
+    statistics.m_chunkCacheMisses = (size_t) get(chunkCacheMisses);
+    statistics.m_bytesRead = (size_t) get(bytesRead);
+    return statistics;
+}
+
+}}}
@@ -0,0 +1,69 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct ReaderStatistics;
+
+// Process-wide counters of the stages of the reader pipeline, surfaced through IDataReader::GetReaderStatistics()
+// and logged by SGD with the training progress, so that an input-bound job can be told apart without a profiler.
+// The stages add to them as they go, a relaxed atomic addition per chunk, batch or minibatch. Times are the wall
+// times of the threads doing the work (concurrent chunk loads add up). ReaderLib is linked into each reader
+// module, so the counters are those of the module that composes the reader.
+class ReaderCounters
+{
+public:
+    enum Counter
+    {
+        chunkLoadMicroseconds,    // the reader waiting for the chunks of the deserializers
+        transformMicroseconds,
+        packMicroseconds,
+        prefetchWaitMicroseconds, // GetMinibatch() waiting for the prefetched minibatch
+        chunkCacheHits,
+        chunkCacheMisses,
+        bytesRead,                // from the input files
+        numCounters
+    };
+
+    static void Add(Counter counter, uint64_t value)
+    {
+        s_counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // The values accumulated since the start of the process.
+    static ReaderStatistics Get();
+
+    // Adds the wall time of its scope to a time counter.
+    class Timer
+    {
+    public:
+        explicit Timer(Counter counter)
+            : m_counter(counter), m_begin(std::chrono::steady_clock::now())
+        {
+        }
+        ~Timer()
+        {
+            Add(m_counter, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_begin).count());
+        }
+
+    private:
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        Counter m_counter;
+        std::chrono::steady_clock::time_point m_begin;
+    };
+
+private:
+    static std::atomic<uint64_t> s_counters[numCounters];
+};
+
+}}}
@@ -12,17 +12,26 @@
 #endif
 
 #include <sstream>
+#include <numeric>
+#include <random>
 #include "Basics.h"
 
 #define DATAREADER_EXPORTS // creating the exports here
 #include "DataReader.h"
 #include "ReaderShim.h"
+#include "ElementTypeUtils.h"
+#include "EventTracer.h"
+#include "ReaderCounters.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 template <class ElemType>
 ReaderShim<ElemType>::ReaderShim(ReaderFactory factory)
-    : m_factory(factory)
+    : m_factory(factory), m_prefetchToDevice(false), m_memoryProvider(std::make_shared<CudaMemoryProvider>()), m_prefetchQueueSize(1), m_stopPrefetchQueue(false),
+      m_numQueueReads(0), m_numQueueStalls(0), m_sumQueueOccupancy(0),
+      m_cacheOnDevice(false), m_deviceCacheMaxBytes(0), m_deviceCacheState(DeviceCacheState::disabled), m_servingFromDeviceCache(false), m_deviceCacheBytes(0),
+      m_deviceCacheMBSize(0), m_deviceCacheSubset(0), m_deviceCacheNumSubsets(1), m_deviceCachePosition(0), m_deviceCacheServedMBSize(0),
+      m_hasState(false), m_hasPrefetchedState(false)
 {
 }
 
@@ -36,10 +45,21 @@ void ReaderShim<ElemType>::Init(const ConfigParameters& config)
     // if prefetch - launching asynchronously,
     // otherwise deferring - synchronous execution during .get() call
     m_launchType = prefetch ? launch::async : launch::deferred;
+    // number of minibatches that are read ahead; more than one are kept in a queue, see StartPrefetchQueueTask()
+    m_prefetchQueueSize = prefetch ? config(L"prefetchQueueSize", (size_t) 1) : 1;
+    if (m_prefetchQueueSize == 0)
+        InvalidArgument("ReaderShim: prefetchQueueSize must be at least 1.");
+    // uploading in the prefetch task only helps if the task actually runs ahead,
+    // and there is a single set of device buffers, so it is not done for queued minibatches
+    m_prefetchToDevice = prefetch && m_prefetchQueueSize == 1 && config(L"prefetchToDevice", true);
 
     m_numParallelSequences = numberOfuttsPerMinibatchForAllEpochs[0];
 
-    m_reader = m_factory(config);
+    // keep the dataset on the device after its first sweep, see DeviceCacheState
+    m_cacheOnDevice = config(L"cacheOnDevice", false);
+    m_deviceCacheMaxBytes = (size_t) config(L"deviceCacheMaxMB", (size_t) 2048) * 1024 * 1024;
+
+    m_reader = m_factory(config, m_memoryProvider);
     m_streams = m_reader->GetStreamDescriptions();
     for (auto i : m_streams)
     {
@@ -66,6 +86,14 @@ void ReaderShim<ElemType>::StartDistributedMinibatchLoop(
     {
         m_prefetchTask.wait();
     }
+    StopPrefetchQueueTask();
+
+    m_endOfEpoch = false;
+    m_hasState = false;
+    if (StartEpochFromDeviceCache(requestedMBSize, epoch, subsetNum, numSubsets, requestedEpochSamples))
+    {
+        return;
+    }
 
     EpochConfiguration config;
     config.m_workerRank = subsetNum;
@@ -75,17 +103,203 @@ void ReaderShim<ElemType>::StartDistributedMinibatchLoop(
     config.m_epochIndex = epoch;
 
     m_reader->StartEpoch(config);
-    m_endOfEpoch = false;
+    m_hasState = m_reader->GetState(m_state);
+
+    if (m_prefetchQueueSize > 1)
+    {
+        StartPrefetchQueueTask();
+    }
+    else
+    {
+        StartPrefetchTask();
+    }
+}
+
+template <class ElemType>
+void ReaderShim<ElemType>::StartPrefetchTask()
+{
+    // The next upload reuses the device buffers, so it must wait for everything issued so far that reads them.
+    if (m_dataTransferer)
+    {
+        m_dataTransferer->RecordBuffersConsumed();
+    }
 
     // Starting the prefetch task. There is always a single async read in flight.
     // When the network requests a new minibatch, we wait for the current async to finish,
     // return the result and kick off a new one.
     m_prefetchTask = std::async(m_launchType, [this]()
     {
-        return m_reader->ReadMinibatch();
+        EventTracer::Scope scope("Prefetch", "reader");
+        // the packer overwrites its buffers, which the previous upload may still be reading from
+        if (m_dataTransferer)
+        {
+            m_dataTransferer->WaitForHostBuffersReleased();
+        }
+        Minibatch minibatch = m_reader->ReadMinibatch();
+        m_hasPrefetchedState = m_reader->GetState(m_prefetchedState);
+        m_deviceData.clear();
+        if (m_dataTransferer)
+        {
+            UploadMinibatch(minibatch);
+        }
+        return minibatch;
     });
 }
 
+// Runs in the prefetch task: starts the host-to-device copy of all dense streams.
+// Sparse streams are still copied by GetMinibatch() through SetMatrixFromCSCFormat().
+template <class ElemType>
+void ReaderShim<ElemType>::UploadMinibatch(const Minibatch& minibatch)
+{
+    m_deviceData.assign(m_streams.size(), nullptr);
+    m_dataTransferer->BeginBatch();
+    for (size_t streamId = 0; streamId < minibatch.m_data.size(); streamId++)
+    {
+        if (m_streams[streamId]->m_storageType != StorageType::dense)
+        {
+            continue;
+        }
+
+        const auto& stream = minibatch.m_data[streamId];
+        size_t numBytes = m_streams[streamId]->m_sampleLayout->GetNumElements() * stream->m_layout->GetNumCols() * GetElementSize(streamId);
+        bool isPageLocked = m_memoryProvider->IsPageLocked(stream->m_data);
+        m_deviceData[streamId] = m_dataTransferer->CopyCPUToGPUAsync(streamId, stream->m_data, numBytes, isPageLocked);
+    }
+    m_dataTransferer->EndBatch();
+}
+
+// Starts the task that reads the minibatches of the epoch into m_prefetchQueue, waiting whenever it is full.
+// The task ends after the last minibatch of the epoch, or when asked to by StopPrefetchQueueTask().
+template <class ElemType>
+void ReaderShim<ElemType>::StartPrefetchQueueTask()
+{
+    m_numQueueReads = m_numQueueStalls = m_sumQueueOccupancy = 0;
+    m_prefetchQueueTask = std::async(launch::async, [this]()
+    {
+        try
+        {
+            bool endOfEpoch = false;
+            while (!endOfEpoch)
+            {
+                {
+                    unique_lock<mutex> lock(m_prefetchQueueMutex);
+                    m_prefetchQueueChanged.wait(lock, [this]() { return m_stopPrefetchQueue || m_prefetchQueue.size() < m_prefetchQueueSize; });
+                    if (m_stopPrefetchQueue)
+                        return;
+                }
+
+                QueuedMinibatch queued;
+                {
+                    EventTracer::Scope scope("Prefetch", "reader");
+                    queued = CopyMinibatch(m_reader->ReadMinibatch());
+                    queued.m_hasState = m_reader->GetState(queued.m_state);
+                }
+                endOfEpoch = queued.m_minibatch.m_endOfEpoch;
+
+                lock_guard<mutex> lock(m_prefetchQueueMutex);
+                m_prefetchQueue.push_back(std::move(queued));
+                m_prefetchQueueChanged.notify_all();
+            }
+        }
+        catch (...)
+        {
+            // passed on to the reading thread by PopPrefetchedMinibatch()
+            lock_guard<mutex> lock(m_prefetchQueueMutex);
+            m_prefetchQueueError = current_exception();
+            m_prefetchQueueChanged.notify_all();
+        }
+    });
+}
+
+// Lets the task finish the minibatch it is reading and discards the queue.
+template <class ElemType>
+void ReaderShim<ElemType>::StopPrefetchQueueTask()
+{
+    if (!m_prefetchQueueTask.valid())
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_prefetchQueueMutex);
+        m_stopPrefetchQueue = true;
+        m_prefetchQueueChanged.notify_all();
+    }
+    m_prefetchQueueTask.wait();
+    m_prefetchQueueTask = std::future<void>();
+
+    m_prefetchQueue.clear();
+    m_prefetchQueueError = nullptr;
+    m_stopPrefetchQueue = false;
+}
+
+template <class ElemType>
+typename ReaderShim<ElemType>::QueuedMinibatch ReaderShim<ElemType>::PopPrefetchedMinibatch()
+{
+    unique_lock<mutex> lock(m_prefetchQueueMutex);
+    m_numQueueReads++;
+    m_sumQueueOccupancy += m_prefetchQueue.size();
+    if (m_prefetchQueue.empty())
+    {
+        m_numQueueStalls++;
+        EventTracer::Scope scope("PrefetchQueueWait", "reader");
+        ReaderCounters::Timer timer(ReaderCounters::prefetchWaitMicroseconds);
+        m_prefetchQueueChanged.wait(lock, [this]() { return !m_prefetchQueue.empty() || m_prefetchQueueError; });
+    }
+    if (m_prefetchQueue.empty())
+    {
+        rethrow_exception(m_prefetchQueueError);
+    }
+
+    QueuedMinibatch queued = std::move(m_prefetchQueue.front());
+    m_prefetchQueue.pop_front();
+    m_prefetchQueueChanged.notify_all();
+    return queued;
+}
+
+// Copies the data and the layouts of a minibatch out of the packer's buffers.
+template <class ElemType>
+typename ReaderShim<ElemType>::QueuedMinibatch ReaderShim<ElemType>::CopyMinibatch(const Minibatch& minibatch) const
+{
+    QueuedMinibatch result;
+    result.m_minibatch.m_endOfEpoch = minibatch.m_endOfEpoch;
+    result.m_minibatch.m_lattices = minibatch.m_lattices; // the reader creates these per minibatch, they are not reused
+    result.m_buffers.resize(minibatch.m_data.size());
+    map<MBLayoutPtr, MBLayoutPtr> layouts; // streams that share a layout share its copy
+    for (size_t streamId = 0; streamId < minibatch.m_data.size(); streamId++)
+    {
+        const auto& stream = minibatch.m_data[streamId];
+        size_t numCols = stream->m_layout->GetNumCols();
+        size_t numBytes;
+        if (m_streams[streamId]->m_storageType == StorageType::dense)
+        {
+            numBytes = m_streams[streamId]->m_sampleLayout->GetNumElements() * numCols * GetElementSize(streamId);
+        }
+        else
+        {
+            // nnzCount, values, row indices, column offsets, see FillMatrixFromStream()
+            size_t nnzCount = *reinterpret_cast<const size_t*>(stream->m_data);
+            numBytes = sizeof(size_t) + nnzCount * (sizeof(ElemType) + sizeof(IndexType)) + (numCols + 1) * sizeof(IndexType);
+        }
+        auto& buffer = result.m_buffers[streamId];
+        const char* data = reinterpret_cast<const char*>(stream->m_data);
+        buffer.assign(data, data + numBytes);
+
+        auto& layout = layouts[stream->m_layout];
+        if (!layout)
+        {
+            layout = make_shared<MBLayout>();
+            layout->CopyFrom(stream->m_layout);
+        }
+
+        auto copy = make_shared<StreamMinibatch>();
+        copy->m_data = buffer.data();
+        copy->m_layout = layout;
+        result.m_minibatch.m_data.push_back(copy);
+    }
+    return result;
+}
+
 string EnumerateInputs(const map<wstring, size_t> &nameToStreamId)
 {
     // TODO use boost::algorithm::join, boost::adapters::transformed, make this a generic function
@@ -115,24 +329,60 @@ bool ReaderShim<ElemType>::GetMinibatch(StreamMinibatchInputs& matrices)
         return false;
     }
 
-    // Check that all matrices have the same device id.
-    // If not we should inject the IMemoryProvider per stream.
+    if (m_servingFromDeviceCache)
+    {
+        return GetMinibatchFromDeviceCache(matrices);
+    }
+
+    // The data are prefetched to the device of the first matrix. The inputs of a network that is placed on several
+    // devices (ToDevice()) may be elsewhere; those are filled from the host copy, see FillMatrixFromStream().
     int deviceId = matrices.begin()->second.matrix->GetDeviceId();
-    for (auto mx : matrices)
-        assert(mx.second.matrix->GetDeviceId() == deviceId), UNUSED(deviceId);
 
-    assert(m_prefetchTask.valid());
+    Minibatch minibatch;
+    QueuedMinibatch queued; // owns the data of minibatch if it comes from the queue
+    if (m_prefetchQueueSize > 1)
+    {
+        queued = PopPrefetchedMinibatch();
+        minibatch = queued.m_minibatch;
+        m_hasState = queued.m_hasState;
+        m_state = std::move(queued.m_state);
+    }
+    else
+    {
+        assert(m_prefetchTask.valid());
+
+        {
+            ReaderCounters::Timer timer(ReaderCounters::prefetchWaitMicroseconds);
+            minibatch = m_prefetchTask.get();
+        }
+        m_hasState = m_hasPrefetchedState;
+        m_state = m_prefetchedState;
+        if (!m_deviceData.empty())
+        {
+            m_dataTransferer->WaitForCopyCPUToGPUAsync();
+        }
+    }
 
-    Minibatch minibatch = m_prefetchTask.get();
     if (minibatch.m_endOfEpoch)
     {
         m_endOfEpoch = true;
+        if (m_prefetchQueueSize > 1 && m_numQueueReads > 0)
+        {
+            fprintf(stderr, "ReaderShim: Prefetch queue of %d minibatches held %.1f on average, %d of %d minibatches had to be waited for.\n",
+                    (int) m_prefetchQueueSize, (double) m_sumQueueOccupancy / m_numQueueReads, (int) m_numQueueStalls, (int) m_numQueueReads);
+        }
         if (minibatch.m_data.empty())
         {
+            if (m_deviceCacheState == DeviceCacheState::filling)
+            {
+                FinishDeviceCache();
+            }
             return false;
         }
     }
 
+    m_lattices = minibatch.m_lattices;
+
     // Reset stale mb layouts.
     // BUGBUG: This seems incorrect. (1) layouts should all be updated below, and (2) some of these layouts are the same, we are resetting them twice.
     for (const auto& iter : matrices)
@@ -183,30 +433,422 @@ bool ReaderShim<ElemType>::GetMinibatch(StreamMinibatchInputs& matrices)
 
             size_t sampleSize = m_streams[streamId]->m_sampleLayout->GetNumElements();
             auto& matrix = matrices.GetInputMatrix<ElemType>(mx.first);
-            FillMatrixFromStream(m_streams[streamId]->m_storageType, &matrix, sampleSize, stream);
+            const void* deviceData = m_deviceData.empty() ? nullptr : m_deviceData[streamId];
+            FillMatrixFromStream(streamId, &matrix, sampleSize, stream, deviceData);
+        }
+
+        if (m_deviceCacheState == DeviceCacheState::filling)
+        {
+            AddToDeviceCache(matrices);
         }
     }
 
-    if (!m_endOfEpoch)
+    if (m_endOfEpoch && m_deviceCacheState == DeviceCacheState::filling)
     {
-        // Starting the prefetch task. There is always a single async read in flight.
-        // When the network requests a new minibatch, we wait for the current async to finish,
-        // return the result and kick off a new one.
-        m_prefetchTask = std::async(m_launchType, [this]()
-        {
-            return m_reader->ReadMinibatch();
-        });
+        FinishDeviceCache();
+    }
+
+    // The transferer is created on first use, when we know the device the network runs on.
+    // From the next epoch on, the packers pack into page-locked memory, which it uploads from directly.
+    if (m_prefetchToDevice && !m_dataTransferer && deviceId >= 0)
+    {
+        m_dataTransferer.reset(new PrefetchGPUDataTransferer(deviceId));
+        m_memoryProvider->SetDeviceId(deviceId);
+    }
+
+    if (!m_endOfEpoch && m_prefetchQueueSize == 1)
+    {
+        StartPrefetchTask();
     }
 
     return !minibatch.m_data.empty();
 }
 
+// Decides at the start of an epoch whether it is formed from the device cache, and if so, shuffles the cache for it.
+// Otherwise the epoch is read through the reader, and fills the cache if it is a full sweep.
+template <class ElemType>
+bool ReaderShim<ElemType>::StartEpochFromDeviceCache(size_t requestedMBSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples)
+{
+    m_servingFromDeviceCache = false;
+    if (!m_cacheOnDevice)
+    {
+        return false;
+    }
+
+    // the cache holds one sweep over this worker's part of the data
+    bool isSweep = requestedEpochSamples == requestDataSize;
+    bool matchesCache = isSweep && subsetNum == m_deviceCacheSubset && numSubsets == m_deviceCacheNumSubsets &&
+                        (!m_cachedFrames.empty() || requestedMBSize == m_deviceCacheMBSize);
+    if (m_deviceCacheState == DeviceCacheState::complete && matchesCache)
+    {
+        std::mt19937_64 rng(epoch);
+        m_deviceCachePosition = 0;
+        if (!m_cachedFrames.empty())
+        {
+            const auto& frames = *m_cachedFrames.begin()->second;
+            vector<ElemType> order(frames.GetNumCols());
+            iota(order.begin(), order.end(), (ElemType) 0);
+            shuffle(order.begin(), order.end(), rng);
+            m_cachedFrameOrder = make_shared<Matrix<ElemType>>(1, order.size(), order.data(), frames.GetDeviceId(), matrixFlagNormal);
+            // the worker's share of the minibatch, as the randomizer would return it
+            m_deviceCacheServedMBSize = max<size_t>(1, (requestedMBSize + numSubsets - 1) / numSubsets);
+        }
+        else
+        {
+            m_cachedMinibatchOrder.resize(m_cachedMinibatches.size());
+            iota(m_cachedMinibatchOrder.begin(), m_cachedMinibatchOrder.end(), (size_t) 0);
+            shuffle(m_cachedMinibatchOrder.begin(), m_cachedMinibatchOrder.end(), rng);
+        }
+        m_servingFromDeviceCache = true;
+        return true;
+    }
+
+    // A sweep that the cache cannot serve refills it; a partial epoch keeps a complete cache for the next sweep.
+    if (isSweep)
+    {
+        ClearDeviceCache();
+        m_deviceCacheState = DeviceCacheState::filling;
+        m_deviceCacheMBSize = requestedMBSize;
+        m_deviceCacheSubset = subsetNum;
+        m_deviceCacheNumSubsets = numSubsets;
+    }
+    else if (m_deviceCacheState == DeviceCacheState::filling)
+    {
+        ClearDeviceCache();
+    }
+    return false;
+}
+
+// Keeps a copy of the input matrices just filled from the reader, on their devices.
 template <class ElemType>
-void ReaderShim<ElemType>::FillMatrixFromStream(StorageType type, Matrix<ElemType>* matrix, size_t numRows, const StreamMinibatchPtr& stream)
+void ReaderShim<ElemType>::AddToDeviceCache(const StreamMinibatchInputs& matrices)
 {
+    if (m_lattices)
+    {
+        fprintf(stderr, "ReaderShim: Minibatches with lattices are not cached on the device.\n");
+        ClearDeviceCache();
+        m_cacheOnDevice = false;
+        return;
+    }
+
+    CachedMinibatch cached;
+    map<MBLayoutPtr, MBLayoutPtr> layouts; // inputs that share a layout share its copy
+    for (const auto& mx : matrices)
+    {
+        auto copy = make_shared<Matrix<ElemType>>(matrices.GetInputMatrix<ElemType>(mx.first).DeepClone());
+        m_deviceCacheBytes += copy->BufferSize();
+        cached.m_matrices[mx.first] = copy;
+
+        auto& layout = layouts[mx.second.pMBLayout];
+        if (!layout)
+        {
+            layout = make_shared<MBLayout>();
+            layout->CopyFrom(mx.second.pMBLayout, /*keepName*/ true);
+        }
+        cached.m_layouts[mx.first] = layout;
+    }
+
+    if (m_deviceCacheBytes > m_deviceCacheMaxBytes)
+    {
+        fprintf(stderr, "ReaderShim: The dataset does not fit into deviceCacheMaxMB = %d, it is read through the reader in every epoch.\n", (int) (m_deviceCacheMaxBytes >> 20));
+        ClearDeviceCache();
+        m_cacheOnDevice = false;
+        return;
+    }
+    m_cachedMinibatches.push_back(std::move(cached));
+}
+
+// Completes the cache at the end of the sweep that filled it. In frame mode, the frames of all minibatches are joined.
+template <class ElemType>
+void ReaderShim<ElemType>::FinishDeviceCache()
+{
+    if (m_cachedMinibatches.empty())
+    {
+        ClearDeviceCache();
+        return;
+    }
+
+    // frame indices are gathered as ElemType, which limits their number to the integers it represents exactly
+    bool frameMode = true;
+    size_t numFrames = 0;
+    for (const auto& cached : m_cachedMinibatches)
+    {
+        size_t numCols = cached.m_matrices.begin()->second->GetNumCols();
+        for (const auto& layout : cached.m_layouts)
+        {
+            frameMode &= layout.second->GetNumTimeSteps() == 1 && !layout.second->HasGaps();
+        }
+        for (const auto& matrix : cached.m_matrices)
+        {
+            frameMode &= matrix.second->GetMatrixType() == DENSE && matrix.second->GetNumCols() == numCols;
+        }
+        numFrames += numCols;
+    }
+    frameMode &= numFrames <= ((size_t) 1 << numeric_limits<ElemType>::digits);
+
+    if (frameMode)
+    {
+        for (const auto& input : m_cachedMinibatches.front().m_matrices)
+        {
+            const auto& name = input.first;
+            auto frames = make_shared<Matrix<ElemType>>(input.second->GetNumRows(), numFrames, input.second->GetDeviceId());
+            size_t startColumn = 0;
+            for (auto& cached : m_cachedMinibatches)
+            {
+                auto& matrix = cached.m_matrices[name];
+                frames->SetColumnSlice(*matrix, startColumn, matrix->GetNumCols());
+                startColumn += matrix->GetNumCols();
+                matrix.reset(); // at most one input is held twice
+            }
+            m_cachedFrames[name] = frames;
+        }
+        m_cachedMinibatches.clear();
+    }
+
+    m_deviceCacheState = DeviceCacheState::complete;
+    fprintf(stderr, "ReaderShim: Cached %d MB of %s on the device, further sweeps are formed from the cache.\n",
+            (int) (m_deviceCacheBytes >> 20), frameMode ? "frames" : "minibatches");
+}
+
+template <class ElemType>
+void ReaderShim<ElemType>::ClearDeviceCache()
+{
+    m_deviceCacheState = DeviceCacheState::disabled;
+    m_deviceCacheBytes = 0;
+    m_cachedMinibatches.clear();
+    m_cachedFrames.clear();
+    m_cachedFrameOrder.reset();
+    m_cachedMinibatchOrder.clear();
+}
+
+// Forms the next minibatch of the epoch from the device cache.
+template <class ElemType>
+bool ReaderShim<ElemType>::GetMinibatchFromDeviceCache(StreamMinibatchInputs& matrices)
+{
+    m_lattices = nullptr;
+    if (!m_cachedFrames.empty())
+    {
+        size_t numFrames = m_cachedFrameOrder->GetNumCols();
+        size_t numCols = min(m_deviceCacheServedMBSize, numFrames - m_deviceCachePosition);
+        auto order = m_cachedFrameOrder->ColumnSlice(m_deviceCachePosition, numCols);
+        for (const auto& mx : matrices)
+        {
+            auto frames = m_cachedFrames.find(mx.first);
+            if (frames == m_cachedFrames.end())
+            {
+                RuntimeError("ReaderShim: Input '%ls' was not requested when the device cache was filled.", mx.first.c_str());
+            }
+            matrices.GetInputMatrix<ElemType>(mx.first).DoGatherColumnsOf(0, order, *frames->second, 1);
+            mx.second.pMBLayout->InitAsFrameMode(numCols);
+        }
+        m_numParallelSequences = numCols;
+        m_deviceCachePosition += numCols;
+        m_endOfEpoch = m_deviceCachePosition == numFrames;
+    }
+    else
+    {
+        const auto& cached = m_cachedMinibatches[m_cachedMinibatchOrder[m_deviceCachePosition++]];
+        for (const auto& mx : matrices)
+        {
+            auto matrix = cached.m_matrices.find(mx.first);
+            if (matrix == cached.m_matrices.end())
+            {
+                RuntimeError("ReaderShim: Input '%ls' was not requested when the device cache was filled.", mx.first.c_str());
+            }
+            matrices.GetInputMatrix<ElemType>(mx.first).SetValue(*matrix->second);
+            const auto& layout = cached.m_layouts.at(mx.first);
+            mx.second.pMBLayout->CopyFrom(layout, /*keepName*/ true);
+            m_numParallelSequences = layout->GetNumParallelSequences();
+        }
+        m_endOfEpoch = m_deviceCachePosition == m_cachedMinibatchOrder.size();
+    }
+    return true;
+}
+
+template <class ElemType>
+bool ReaderShim<ElemType>::GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, vector<size_t>& extrauttmap)
+{
+    if (!m_lattices)
+    {
+        RuntimeError("GetMinibatch4SE: the reader does not provide lattices, please specify the lattices and the HMM in the reader configuration.");
+    }
+
+    latticeinput = m_lattices->m_lattices;
+    uids = m_lattices->m_uids;
+    boundaries = m_lattices->m_boundaries;
+    extrauttmap = m_lattices->m_parallelSequences;
+    return true;
+}
+
+template <class ElemType>
+bool ReaderShim<ElemType>::GetReaderStatistics(ReaderStatistics& statistics)
+{
+    statistics = ReaderCounters::Get();
+    return true;
+}
+
+// The state is encoded as the sample position, the number of slots, and for each slot its sample cursor,
+// the number of its sequences and their positions.
+template <class ElemType>
+bool ReaderShim<ElemType>::GetState(std::vector<size_t>& state)
+{
+    if (!m_hasState)
+    {
+        return false;
+    }
+
+    // the position to continue from without the parallel sequences: the start of the earliest one that is still pending
+    size_t restartPosition = m_state.m_samplePosition;
+    for (const auto& positions : m_state.m_slotSequencePositions)
+    {
+        for (size_t position : positions)
+        {
+            restartPosition = std::min(restartPosition, position);
+        }
+    }
+
+    state.clear();
+    state.push_back(restartPosition);
+    state.push_back(m_state.m_samplePosition);
+    state.push_back(m_state.m_slotSequencePositions.size());
+    for (size_t i = 0; i < m_state.m_slotSequencePositions.size(); ++i)
+    {
+        const auto& positions = m_state.m_slotSequencePositions[i];
+        state.push_back(m_state.m_slotSampleCursors[i]);
+        state.push_back(positions.size());
+        state.insert(state.end(), positions.begin(), positions.end());
+    }
+    return true;
+}
+
+template <class ElemType>
+void ReaderShim<ElemType>::SetState(const std::vector<size_t>& state)
+{
+    if (m_servingFromDeviceCache)
+    {
+        LogicError("SetState: The epoch is formed from the device cache.");
+    }
+
+    ReaderState readerState;
+    size_t k = 0;
+    auto next = [&]() -> size_t
+    {
+        if (k >= state.size())
+        {
+            RuntimeError("SetState: The reader state is truncated.");
+        }
+        return state[k++];
+    };
+    size_t restartPosition = next();
+    size_t numSlots = 0;
+    if (state.size() == 1) // continuing from the position alone, with empty parallel sequences
+    {
+        readerState.m_samplePosition = restartPosition;
+    }
+    else
+    {
+        readerState.m_samplePosition = next();
+        numSlots = next();
+    }
+    for (size_t i = 0; i < numSlots; ++i)
+    {
+        readerState.m_slotSampleCursors.push_back(next());
+        readerState.m_slotSequencePositions.push_back(std::vector<size_t>(next()));
+        for (auto& position : readerState.m_slotSequencePositions.back())
+        {
+            position = next();
+        }
+    }
+
+    // Drop what has been read ahead from the old position.
+    if (m_prefetchTask.valid())
+    {
+        m_prefetchTask.get();
+        if (!m_deviceData.empty())
+        {
+            m_dataTransferer->WaitForCopyCPUToGPUAsync();
+        }
+    }
+    StopPrefetchQueueTask();
+
+    m_reader->SetState(readerState);
+    m_state = readerState;
+    m_hasState = true;
+    m_endOfEpoch = false;
+
+    // the device cache holds full sweeps only
+    if (m_deviceCacheState == DeviceCacheState::filling)
+    {
+        ClearDeviceCache();
+    }
+
+    if (m_prefetchQueueSize > 1)
+    {
+        StartPrefetchQueueTask();
+    }
+    else
+    {
+        StartPrefetchTask();
+    }
+}
+
+template <class ElemType>
+bool ReaderShim<ElemType>::GetHmmData(msra::asr::simplesenonehmm* hmm)
+{
+    if (!m_reader->GetHmmData(hmm))
+    {
+        RuntimeError("GetHmmData: the reader does not provide an HMM, please specify the HMM in the reader configuration.");
+    }
+    return true;
+}
+
+// Size of the elements of a dense stream as packed; all but the compact types are in the precision of the network.
+template <class ElemType>
+size_t ReaderShim<ElemType>::GetElementSize(size_t streamId) const
+{
+    ElementType type = m_streams[streamId]->m_elementType;
+    return IsCompactElementType(type) ? GetSizeByType(type) : sizeof(ElemType);
+}
+
+template <class ElemType>
+void ReaderShim<ElemType>::FillMatrixFromStream(size_t streamId, Matrix<ElemType>* matrix, size_t numRows, const StreamMinibatchPtr& stream, const void* deviceData)
+{
+    const auto& description = *m_streams[streamId];
+    StorageType type = description.m_storageType;
     size_t numCols = stream->m_layout->GetNumCols();
+    bool isOnTransferDevice = deviceData && matrix->GetDeviceId() == m_dataTransferer->GetDeviceId();
 
-    if (type == StorageType::dense)
+    if (type == StorageType::dense && IsCompactElementType(description.m_elementType))
+    {
+        // convert, together with the normalization the reader left to us, directly into the matrix
+        Matrix<ElemType>* offset = nullptr;
+        if (description.m_storageOffset)
+        {
+            m_storageOffsets.resize(m_streams.size());
+            auto& storageOffset = m_storageOffsets[streamId];
+            if (!storageOffset)
+            {
+                const auto& values = *description.m_storageOffset;
+                if (values.size() != numRows)
+                {
+                    LogicError("Stream '%ls' has a storage offset of %d elements for samples of %d.", description.m_name.c_str(), (int)values.size(), (int)numRows);
+                }
+                vector<ElemType> buffer(values.begin(), values.end());
+                storageOffset = make_shared<Matrix<ElemType>>(numRows, 1, buffer.data(), matrix->GetDeviceId(), matrixFlagNormal);
+            }
+            offset = storageOffset.get();
+        }
+        CompactElementType compactType = description.m_elementType == ElementType::tuint8 ? CompactElementType::uint8 : CompactElementType::float16;
+        matrix->SetValueFromCompact(numRows, numCols, isOnTransferDevice ? deviceData : stream->m_data, compactType, (ElemType)description.m_storageScale, offset,
+                                    isOnTransferDevice ? matrixFlagSetValueOnDevice : matrixFlagNormal);
+    }
+    else if (type == StorageType::dense && isOnTransferDevice)
+    {
+        // already uploaded by the prefetch task, just a device-to-device copy
+        auto data = reinterpret_cast<const ElemType*>(deviceData);
+        matrix->SetValue(numRows, numCols, matrix->GetDeviceId(), const_cast<ElemType*>(data), matrixFlagSetValueOnDevice);
+    }
+    else if (type == StorageType::dense)
     {
         auto data = reinterpret_cast<const ElemType*>(stream->m_data);
         matrix->SetValue(numRows, numCols, matrix->GetDeviceId(), const_cast<ElemType*>(data), matrixFlagNormal);
@@ -10,13 +10,18 @@
 
 #include <map>
 #include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 #include "DataReader.h"
 #include <future>
 #include "Reader.h"
+#include "CudaMemoryProvider.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-typedef ReaderPtr (*ReaderFactory)(const ConfigParameters& parameters);
+// Creates the reader; its packer allocates the minibatch buffers from memoryProvider.
+typedef ReaderPtr (*ReaderFactory)(const ConfigParameters& parameters, MemoryProviderPtr memoryProvider);
 
 template <class ElemType>
 class ReaderShim : public IDataReader
@@ -39,6 +44,7 @@ public:
             // If there are some, give them time to finish.
             m_prefetchTask.wait_for(std::chrono::seconds(5));
         }
+        StopPrefetchQueueTask();
 
         delete this;
     }
@@ -59,6 +65,18 @@ public:
 
     virtual size_t GetNumParallelSequencesForFixingBPTTMode() override;
 
+    // Sequence training: the lattices of the minibatch last returned by GetMinibatch(), and the HMM.
+    virtual bool GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, vector<size_t>& extrauttmap) override;
+    virtual bool GetHmmData(msra::asr::simplesenonehmm* hmm) override;
+
+    // The counters of the reader pipeline, see ReaderCounters.
+    virtual bool GetReaderStatistics(ReaderStatistics& statistics) override;
+
+    // The state of the reader after the minibatch last returned by GetMinibatch(), see Reader::GetState().
+    // Not available for an epoch formed from the device cache.
+    virtual bool GetState(std::vector<size_t>& state) override;
+    virtual void SetState(const std::vector<size_t>& state) override;
+
 private:
     std::future<Minibatch> m_prefetchTask;
     ReaderPtr m_reader;
@@ -66,12 +84,95 @@ private:
     bool m_endOfEpoch;
 
     size_t m_numParallelSequences;
+    LatticeMinibatchPtr m_lattices; // of the current minibatch, if the reader provides them
 
     std::map<std::wstring, size_t> m_nameToStreamId;
     std::vector<StreamDescriptionPtr> m_streams;
     launch m_launchType;
 
-    void FillMatrixFromStream(StorageType type, Matrix<ElemType>* matrix, size_t numRows, const StreamMinibatchPtr& stream);
+    // If enabled, the prefetch task also uploads the dense inputs to the GPU (see PrefetchGPUDataTransferer),
+    // so that the host-to-device copy of the next minibatch overlaps the computation on the current one.
+    bool m_prefetchToDevice;
+    std::unique_ptr<PrefetchGPUDataTransferer> m_dataTransferer;
+    std::vector<const void*> m_deviceData; // [streamId] device copy of the minibatch read by m_prefetchTask, or nullptr if not uploaded
+    // The packers allocate from this; once the device is known, from page-locked memory,
+    // which m_dataTransferer uploads from directly instead of copying it into its own pinned buffers first.
+    std::shared_ptr<CudaMemoryProvider> m_memoryProvider;
+
+    // The reader state after the minibatch last returned, and after the one read by m_prefetchTask.
+    ReaderState m_state, m_prefetchedState;
+    bool m_hasState, m_hasPrefetchedState;
+
+    void StartPrefetchTask();
+    void UploadMinibatch(const Minibatch& minibatch);
+
+    // With prefetchQueueSize > 1, a background task reads ahead up to that many minibatches into a queue instead,
+    // which absorbs the variance of the time it takes to read single minibatches. The queued minibatches are copies,
+    // as the packers reuse their buffers from one minibatch to the next.
+    struct QueuedMinibatch
+    {
+        Minibatch m_minibatch;
+        std::vector<std::vector<char>> m_buffers; // [streamId] the data m_minibatch points into
+        ReaderState m_state;                      // of the reader after m_minibatch
+        bool m_hasState;
+    };
+    size_t m_prefetchQueueSize;
+    std::deque<QueuedMinibatch> m_prefetchQueue;
+    std::mutex m_prefetchQueueMutex;
+    std::condition_variable m_prefetchQueueChanged;
+    std::future<void> m_prefetchQueueTask;
+    bool m_stopPrefetchQueue;
+    std::exception_ptr m_prefetchQueueError;
+
+    // occupancy of the queue in the current epoch, reported at its end
+    size_t m_numQueueReads;
+    size_t m_numQueueStalls; // reads that found the queue empty
+    size_t m_sumQueueOccupancy;
+
+    void StartPrefetchQueueTask();
+    void StopPrefetchQueueTask();
+    QueuedMinibatch PopPrefetchedMinibatch();
+    QueuedMinibatch CopyMinibatch(const Minibatch& minibatch) const;
+
+    void FillMatrixFromStream(size_t streamId, Matrix<ElemType>* matrix, size_t numRows, const StreamMinibatchPtr& stream, const void* deviceData);
+
+    // Streams of a compact element type (uint8, FP16) stay compact up to the device and are converted there.
+    size_t GetElementSize(size_t streamId) const;
+    std::vector<std::shared_ptr<Matrix<ElemType>>> m_storageOffsets; // [streamId] the stream's m_storageOffset as a column vector, created on first use
+
+    // With cacheOnDevice, a dataset that fits into device memory is read through the reader only once: the input matrices
+    // of the first full sweep are kept on their devices, and the later epochs are formed from them without deserialization,
+    // randomization, packing or upload.
+    //  - If all inputs are dense and in frame mode, the frames of all minibatches are kept as one matrix per input, and each
+    //    epoch gathers its minibatches from them on the device in a new random order (DoGatherColumnsOf()).
+    //  - Otherwise the minibatches are kept as they are, with their MBLayouts, and each epoch returns them in a new random order;
+    //    this requires the minibatch size of the first sweep. Another size refills the cache through the reader.
+    // The cache is abandoned if it grows beyond deviceCacheMaxMB, or if the sweep had lattices.
+    enum class DeviceCacheState { disabled, filling, complete };
+    struct CachedMinibatch
+    {
+        std::map<std::wstring, std::shared_ptr<Matrix<ElemType>>> m_matrices; // [input name]
+        std::map<std::wstring, MBLayoutPtr> m_layouts;                       // [input name], shared between inputs as in the network
+    };
+    bool m_cacheOnDevice;
+    size_t m_deviceCacheMaxBytes;
+    DeviceCacheState m_deviceCacheState;
+    bool m_servingFromDeviceCache;     // the current epoch is formed from the cache
+    size_t m_deviceCacheBytes;
+    size_t m_deviceCacheMBSize;        // minibatch size of the sweep that filled the cache
+    size_t m_deviceCacheSubset, m_deviceCacheNumSubsets;
+    std::vector<CachedMinibatch> m_cachedMinibatches;
+    std::map<std::wstring, std::shared_ptr<Matrix<ElemType>>> m_cachedFrames; // [input name] all frames, if in frame mode
+    std::shared_ptr<Matrix<ElemType>> m_cachedFrameOrder;                     // [1 x numFrames] this epoch's permutation of the frames
+    std::vector<size_t> m_cachedMinibatchOrder;                               // this epoch's permutation of m_cachedMinibatches
+    size_t m_deviceCachePosition;      // next frame or minibatch of the epoch
+    size_t m_deviceCacheServedMBSize;  // the epoch's minibatch size per worker, in frame mode
+
+    bool StartEpochFromDeviceCache(size_t requestedMBSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples);
+    bool GetMinibatchFromDeviceCache(StreamMinibatchInputs& matrices);
+    void AddToDeviceCache(const StreamMinibatchInputs& matrices);
+    void FinishDeviceCache();
+    void ClearDeviceCache();
 };
 
 }}}
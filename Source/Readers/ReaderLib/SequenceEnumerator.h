@@ -44,6 +44,19 @@ public:
     // Gets next sequences up to a maximum count of samples.
     virtual Sequences GetNextSequences(size_t sampleCount) = 0;
 
+    // Gets the position of the next sequence on the global sample timeline, to restore it with SetCurrentSamplePosition().
+    // Returns SIZE_MAX if the enumerator cannot be repositioned (e.g. it buffers sequences it has read ahead).
+    virtual size_t GetCurrentSamplePosition()
+    {
+        return SIZE_MAX;
+    }
+
+    // Moves to a position returned by GetCurrentSamplePosition() in the current epoch.
+    virtual void SetCurrentSamplePosition(size_t /*samplePosition*/)
+    {
+        LogicError("SetCurrentSamplePosition: The sequence enumerator cannot be repositioned.");
+    }
+
     virtual ~SequenceEnumerator()
     {
     }
@@ -0,0 +1,78 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <inttypes.h>
+#include "DataDeserializer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// The locations (chunk and index) of the sequences of a deserializer by their key, used to look up the sequences
+// of the other deserializers when bundling. The keys are the ids of the string registry of the corpus, which are
+// dense, so the locations are kept in a vector indexed by the key (8 bytes per key of the corpus) instead of a tree.
+class SequenceKeyLocations
+{
+public:
+    SequenceKeyLocations() : m_size(0)
+    {}
+
+    void Add(size_t key, ChunkIdType chunkId, size_t index)
+    {
+        if (index >= UINT32_MAX)
+        {
+            RuntimeError("SequenceKeyLocations: The index (%" PRIu64 ") of a sequence is too large.", index);
+        }
+
+        if (key >= m_locations.size())
+        {
+            m_locations.resize(std::max(key + 1, 2 * m_locations.size()), Location{ CHUNKID_MAX, 0 });
+        }
+
+        if (m_locations[key].m_chunkId == CHUNKID_MAX)
+        {
+            m_size++;
+        }
+        m_locations[key] = Location{ chunkId, (uint32_t)index };
+    }
+
+    bool TryGet(size_t key, ChunkIdType& chunkId, size_t& index) const
+    {
+        if (key >= m_locations.size() || m_locations[key].m_chunkId == CHUNKID_MAX)
+        {
+            return false;
+        }
+
+        chunkId = m_locations[key].m_chunkId;
+        index = m_locations[key].m_index;
+        return true;
+    }
+
+    // Number of sequences with a location.
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    // Releases the slack of the vector, once all locations have been added.
+    void ShrinkToFit()
+    {
+        m_locations.shrink_to_fit();
+    }
+
+private:
+    struct Location
+    {
+        ChunkIdType m_chunkId;
+        uint32_t m_index;
+    };
+
+    std::vector<Location> m_locations;
+    size_t m_size;
+};
+
+}}}
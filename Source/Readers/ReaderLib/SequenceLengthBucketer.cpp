@@ -0,0 +1,133 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+
+#include "SequenceLengthBucketer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+SequenceLengthBucketer::SequenceLengthBucketer(SequenceEnumeratorPtr sequenceProvider, size_t windowSizeInMinibatches, bool limitPaddedSamples)
+    : m_sequenceProvider(sequenceProvider),
+      m_windowSizeInMinibatches(windowSizeInMinibatches),
+      m_limitPaddedSamples(limitPaddedSamples),
+      m_providerEndOfEpoch(false)
+{
+    assert(m_sequenceProvider != nullptr);
+    if (m_windowSizeInMinibatches == 0)
+    {
+        InvalidArgument("SequenceLengthBucketer: the bucketing window must contain at least one minibatch.");
+    }
+
+    m_numberOfStreams = m_sequenceProvider->GetStreamDescriptions().size();
+}
+
+void SequenceLengthBucketer::StartEpoch(const EpochConfiguration& config)
+{
+    m_sequenceProvider->StartEpoch(config);
+    m_minibatches.clear();
+    m_providerEndOfEpoch = false;
+    m_rng.seed(static_cast<unsigned int>(config.m_epochIndex));
+}
+
+Sequences SequenceLengthBucketer::GetNextSequences(size_t sampleCount)
+{
+    if (m_minibatches.empty() && !m_providerEndOfEpoch)
+    {
+        FillNextWindow(sampleCount);
+    }
+
+    Sequences result;
+    if (m_minibatches.empty())
+    {
+        result.m_endOfEpoch = true;
+        return result;
+    }
+
+    const auto& minibatch = m_minibatches.front();
+    result.m_data.resize(m_numberOfStreams);
+    for (size_t streamIndex = 0; streamIndex < m_numberOfStreams; ++streamIndex)
+    {
+        result.m_data[streamIndex].reserve(minibatch.size());
+        for (const auto& sequence : minibatch)
+        {
+            result.m_data[streamIndex].push_back(sequence.m_data[streamIndex]);
+        }
+    }
+
+    m_minibatches.pop_front();
+    result.m_endOfEpoch = m_minibatches.empty() && m_providerEndOfEpoch;
+    return result;
+}
+
+void SequenceLengthBucketer::FillNextWindow(size_t sampleCount)
+{
+    // Pool the sequences of the next window.
+    std::vector<PooledSequence> pool;
+    size_t pooledSamples = 0;
+    while (pooledSamples < m_windowSizeInMinibatches * sampleCount && !m_providerEndOfEpoch)
+    {
+        Sequences sequences = m_sequenceProvider->GetNextSequences(sampleCount);
+        m_providerEndOfEpoch = sequences.m_endOfEpoch;
+        if (sequences.m_data.empty() || sequences.m_data.front().empty())
+        {
+            if (!m_providerEndOfEpoch)
+            {
+                LogicError("SequenceLengthBucketer: the sequence provider returned no sequences before the end of the epoch.");
+            }
+            break;
+        }
+
+        assert(sequences.m_data.size() == m_numberOfStreams);
+        for (size_t i = 0; i < sequences.m_data.front().size(); ++i)
+        {
+            PooledSequence sequence;
+            sequence.m_length = 0;
+            sequence.m_data.reserve(m_numberOfStreams);
+            for (size_t streamIndex = 0; streamIndex < m_numberOfStreams; ++streamIndex)
+            {
+                const auto& data = sequences.m_data[streamIndex][i];
+                sequence.m_length = std::max(sequence.m_length, (size_t)data->m_numberOfSamples);
+                sequence.m_data.push_back(data);
+            }
+
+            pooledSamples += sequence.m_length;
+            pool.push_back(std::move(sequence));
+        }
+    }
+
+    // Sequences of equal length keep the (random) order of the provider.
+    std::stable_sort(pool.begin(), pool.end(),
+        [](const PooledSequence& a, const PooledSequence& b) { return a.m_length < b.m_length; });
+
+    // Cut the sorted pool into minibatches of up to sampleCount samples, each with at least one sequence.
+    // As the lengths increase, the padded size of a minibatch is its number of sequences times the last length.
+    std::vector<std::vector<PooledSequence>> minibatches;
+    size_t minibatchSamples = 0;
+    for (auto& sequence : pool)
+    {
+        size_t samplesWithSequence = m_limitPaddedSamples && !minibatches.empty()
+            ? (minibatches.back().size() + 1) * sequence.m_length
+            : minibatchSamples + sequence.m_length;
+        if (minibatches.empty() || samplesWithSequence > sampleCount)
+        {
+            minibatches.push_back(std::vector<PooledSequence>());
+            minibatchSamples = 0;
+        }
+
+        minibatchSamples += sequence.m_length;
+        minibatches.back().push_back(std::move(sequence));
+    }
+
+    // Return the minibatches of the window in random order, so that training does not see increasing lengths.
+    std::shuffle(minibatches.begin(), minibatches.end(), m_rng);
+    for (auto& minibatch : minibatches)
+    {
+        m_minibatches.push_back(std::move(minibatch));
+    }
+}
+
+}}}
@@ -0,0 +1,63 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <random>
+#include "SequenceEnumerator.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A sequence enumerator that groups sequences of similar length into the same minibatch, so that the parallel
+// sequences of the MBLayout built by the sequence packer contain fewer gaps.
+// It pools the sequences of a window of several minibatches from the wrapped enumerator (usually a randomizer),
+// sorts the pool by length, cuts it into minibatches of up to the requested number of samples and returns these
+// in random order. The order of sequences of equal length within the pool and the composition of the windows
+// stay those of the wrapped enumerator, so that data outside of a window is not reordered.
+// With limitPaddedSamples the requested number of samples caps the padded size of a minibatch, i.e. the number of
+// its sequences times the length of the longest one, rather than the sum of their lengths, so that the memory of
+// the layout stays the same for minibatches of long and of short sequences.
+class SequenceLengthBucketer : public SequenceEnumerator
+{
+public:
+    // windowSizeInMinibatches: number of minibatches whose sequences are pooled and sorted together.
+    // limitPaddedSamples: whether the minibatch size caps the padded samples instead of the samples.
+    SequenceLengthBucketer(SequenceEnumeratorPtr sequenceProvider, size_t windowSizeInMinibatches, bool limitPaddedSamples = false);
+
+    virtual void StartEpoch(const EpochConfiguration& config) override;
+    virtual Sequences GetNextSequences(size_t sampleCount) override;
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_sequenceProvider->GetStreamDescriptions();
+    }
+
+private:
+    // A sequence with its data for all streams.
+    struct PooledSequence
+    {
+        size_t m_length; // number of time steps in the layout, the maximum over the streams
+        std::vector<SequenceDataPtr> m_data;
+    };
+
+    // Pulls the next window of sequences from the provider and cuts it into minibatches of up to sampleCount (padded) samples.
+    void FillNextWindow(size_t sampleCount);
+
+    SequenceEnumeratorPtr m_sequenceProvider;
+    size_t m_windowSizeInMinibatches;
+    bool m_limitPaddedSamples;
+    size_t m_numberOfStreams;
+
+    // Minibatches of the current window that have not been returned yet.
+    std::deque<std::vector<PooledSequence>> m_minibatches;
+
+    // Whether the provider has reached the end of the epoch.
+    bool m_providerEndOfEpoch;
+
+    std::mt19937 m_rng;
+};
+
+}}}
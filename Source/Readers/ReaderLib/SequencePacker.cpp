@@ -11,29 +11,31 @@
 #include <inttypes.h>
 #include "SequencePacker.h"
 #include "ElementTypeUtils.h"
+#include "EventTracer.h"
+#include "ReaderCounters.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 MBLayoutPtr SequencePacker::CreateMBLayout(const StreamBatch& batch)
 {
-    vector<MBLayout::SequenceInfo> infos;
-    for (size_t index = 0; index < batch.size(); ++index)
+    // Creating the minibatch layout (the same as before unless the sequence lengths changed).
+    return GetLayout(batch, [&batch](MBLayout& layout)
     {
-        MBLayout::SequenceInfo info;
-
-        info.seqId = index;
-        info.tBegin = 0;
-        info.tEnd = batch[index]->m_numberOfSamples;
-        infos.push_back(info);
-    }
+        vector<MBLayout::SequenceInfo> infos;
+        for (size_t index = 0; index < batch.size(); ++index)
+        {
+            MBLayout::SequenceInfo info;
 
-    vector<pair<size_t, size_t>> placement;
-    vector<size_t> rowAllocations;
+            info.seqId = index;
+            info.tBegin = 0;
+            info.tEnd = batch[index]->m_numberOfSamples;
+            infos.push_back(info);
+        }
 
-    // Creating the minibatch layout.
-    MBLayoutPtr pMBLayout = make_shared<MBLayout>();
-    pMBLayout->InitAsPackedSequences(infos, placement, rowAllocations);
-    return pMBLayout;
+        vector<pair<size_t, size_t>> placement;
+        vector<size_t> rowAllocations;
+        layout.InitAsPackedSequences(infos, placement, rowAllocations);
+    });
 }
 
 Minibatch SequencePacker::ReadMinibatch()
@@ -44,11 +46,17 @@ Minibatch SequencePacker::ReadMinibatch()
     Minibatch minibatch(sequences.m_endOfEpoch);
     if (batch.empty())
     {
+        if (minibatch.m_endOfEpoch)
+        {
+            ReportPadding();
+        }
         return minibatch;
     }
 
     assert(m_outputStreamDescriptions.size() == batch.size());
 
+    EventTracer::Scope scope("Pack", "reader");
+    ReaderCounters::Timer timer(ReaderCounters::packMicroseconds);
     for (int streamIndex = 0; streamIndex < batch.size(); ++streamIndex)
     {
         const auto& streamBatch = batch[streamIndex];
@@ -62,11 +70,31 @@ Minibatch SequencePacker::ReadMinibatch()
         streamMinibatch->m_data = buffer.m_data.get();
         streamMinibatch->m_layout = pMBLayout;
         minibatch.m_data.push_back(streamMinibatch);
+
+        m_numPackedFrames += pMBLayout->GetNumCols();
+        m_numPackedGapFrames += pMBLayout->GetNumCols() - pMBLayout->GetActualNumSamples();
+    }
+
+    if (minibatch.m_endOfEpoch)
+    {
+        ReportPadding();
     }
 
     return minibatch;
 }
 
+void SequencePacker::ReportPadding()
+{
+    if (m_reportPadding && m_numPackedFrames > 0)
+    {
+        fprintf(stderr, "SequencePacker: %" PRIu64 " of %" PRIu64 " minibatch frames (%.2f%%) were gaps in this epoch.\n",
+                m_numPackedGapFrames, m_numPackedFrames, 100.0 * m_numPackedGapFrames / m_numPackedFrames);
+    }
+
+    m_numPackedFrames = 0;
+    m_numPackedGapFrames = 0;
+}
+
 MBLayoutPtr SequencePacker::PackDenseStream(const StreamBatch& batch, size_t streamIndex)
 {
     assert(m_outputStreamDescriptions[streamIndex]->m_storageType == StorageType::dense);
@@ -185,10 +213,12 @@ MBLayoutPtr SequencePacker::PackSparseStream(const StreamBatch& batch, size_t st
     // one for data portion and anther -- for indices.
     auto* dataDst = destination + sizeof(nnzCount);
     auto* indicesDst = dataDst + elementSize* nnzCount;
+    // the column indices (one for each sample in the resulting (packed) matrix, plus the end)
+    // follow the row indices and are written in place.
+    auto* columnsDst = indicesDst + indexSize * nnzCount;
+    auto* columnsBegin = columnsDst;
     // column index for the current sample (= number of nnz value packed so far).
     IndexType columnOffset = 0;
-    // a vector to store column index for each sample in the resulting (packed) matrix.
-    vector<IndexType> sparseColumnIndices;
     // a vector to keep track of the offsets into each input sequence,
     // there an offset is the number of nnz values packed so far. Current sample
     // values/indices start of the offset position in the sequence data/index array
@@ -215,7 +245,8 @@ MBLayoutPtr SequencePacker::PackSparseStream(const StreamBatch& batch, size_t st
             }
 
             // store the offset of the current column )...
-            sparseColumnIndices.push_back(columnOffset);
+            memcpy(columnsDst, &columnOffset, indexSize);
+            columnsDst += indexSize;
 
             auto seqId = sequenceInfo.seqId;
             if (seqId == GAP_SEQUENCE_ID)
@@ -260,15 +291,15 @@ MBLayoutPtr SequencePacker::PackSparseStream(const StreamBatch& batch, size_t st
     assert(indicesDst == dataDst + nnzCount * indexSize);
     // after we packed all samples, the column offset must be equal to the total nnz count.
     assert(columnOffset == nnzCount);
-    sparseColumnIndices.push_back(columnOffset);
+    // the row indices end where the column indices begin.
+    assert(indicesDst == columnsBegin);
+    memcpy(columnsDst, &columnOffset, indexSize);
+    columnsDst += indexSize;
     // check that the number of column indices == N + 1 (where N is the number of
     // column in the packed matrix)
-    assert((pMBLayout->GetNumCols() + 1) == sparseColumnIndices.size());
-
-    // verify that there's enough space in the buffer for the array of column indices.
-    assert(indicesDst + sparseColumnIndices.size()*indexSize <= destination + requiredSize);
-    // copy column indices into the buffer.
-    memcpy(indicesDst, sparseColumnIndices.data(), sparseColumnIndices.size() * indexSize);
+    assert((pMBLayout->GetNumCols() + 1) * indexSize == (size_t)(columnsDst - columnsBegin));
+    // verify that the column indices fit into the buffer.
+    assert(columnsDst <= destination + requiredSize);
 
     return pMBLayout;
 }
@@ -14,11 +14,16 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 class SequencePacker : public PackerBase
 {
 public:
+    // With reportPadding, the share of gap frames in the minibatch layouts is printed at the end of the epoch.
     SequencePacker(
         MemoryProviderPtr memoryProvider,
         SequenceEnumeratorPtr sequenceEnumerator,
-        const std::vector<StreamDescriptionPtr>& streams) :
-        PackerBase(memoryProvider, sequenceEnumerator, streams)
+        const std::vector<StreamDescriptionPtr>& streams,
+        bool reportPadding = false) :
+        PackerBase(memoryProvider, sequenceEnumerator, streams),
+        m_reportPadding(reportPadding),
+        m_numPackedFrames(0),
+        m_numPackedGapFrames(0)
     {
 
     }
@@ -33,6 +38,16 @@ protected:
     // Given a number of sequences, creates an MB layout that is used to guide
     // the actual packing.
     virtual MBLayoutPtr CreateMBLayout(const StreamBatch& batch);
+
+private:
+    // Prints the share of gap frames of the epoch if requested, and restarts counting.
+    void ReportPadding();
+
+    bool m_reportPadding;
+
+    // Frames (columns) of the layouts packed so far in the epoch over all streams, and the gaps among them.
+    size_t m_numPackedFrames;
+    size_t m_numPackedGapFrames;
 };
 
 typedef std::shared_ptr<SequencePacker> SequencePackerPtr;
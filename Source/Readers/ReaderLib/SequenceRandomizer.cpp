@@ -186,11 +186,14 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             m_randomizationCursor == 0 ? 0 : m_randomizedChunks[m_randomizationCursor - 1].SequenceEndPosition();
 
         size_t endSequencePosToRandomize = m_randomizedChunks[nextRandomizationCursor - 1].SequenceEndPosition();
+        ChunkIdType currentChunkIdx = (ChunkIdType)m_randomizationCursor;
         for (size_t t = firstSequencePositionToRandomize; t < endSequencePosToRandomize; ++t)
         {
             // Get valid randomization range, expressed in chunks
-            // TODO: This can be done more efficiently, we know the range of chunks already.
-            const ChunkIdType currentChunkIdx = GetChunkIndexForSequencePosition(t);
+            // (positions are visited in order, so the chunk of position t only ever moves forward)
+            while (t >= m_randomizedChunks[currentChunkIdx].SequenceEndPosition())
+                currentChunkIdx++;
+            assert(currentChunkIdx == GetChunkIndexForSequencePosition(t));
 
             size_t chunkWindowBegin = m_randomizedChunks[currentChunkIdx].m_randomizationWindow.m_begin;
             size_t chunkWindowEnd = m_randomizedChunks[currentChunkIdx].m_randomizationWindow.m_end;
@@ -317,7 +320,22 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                 m_currentSampleCursor,
                 sweepSampleOffset);
 
-        // TODO perhaps optimize this
+        // Skip the chunks that end before the offset as a whole; they are randomized as the cursor enters them, exactly as
+        // if their sequences had been read.
+        while (m_currentChunkCursor < m_randomizedChunks.size())
+        {
+            const auto& info = m_randomizedChunkInfo[m_currentChunkCursor - m_chunkWindowBegin];
+            if (info.start + info.numberOfSamples > sweepSampleOffset)
+            {
+                break;
+            }
+
+            m_currentSampleCursor = info.start + info.numberOfSamples;
+            m_currentSequenceCursor = m_randomizedChunks[m_currentChunkCursor].SequenceEndPosition();
+            MoveChunkCursor();
+            ReleaseChunks();
+        }
+
         while (m_currentSampleCursor < sweepSampleOffset)
         {
             GetNextSequenceDescriptions(1);
@@ -334,18 +352,22 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     bool SequenceRandomizer::IsValidForPosition(size_t targetPosition, const RandomizedSequenceDescription& seqDesc) const
     {
         const auto& chunk = m_randomizedChunks[GetChunkIndexForSequencePosition(targetPosition)];
-        return chunk.m_randomizationWindow.m_begin <= seqDesc.m_chunk->m_chunkId && seqDesc.m_chunk->m_chunkId < chunk.m_randomizationWindow.m_end;
+        return chunk.m_randomizationWindow.m_begin <= seqDesc.m_chunkId && seqDesc.m_chunkId < chunk.m_randomizationWindow.m_end;
     }
 
     // Gets randomized chunk index using a sequence position in the sweep.
+    // All positions asked for are of loaded chunks, so only the chunk window is searched, not all chunks of the sweep.
     ChunkIdType SequenceRandomizer::GetChunkIndexForSequencePosition(size_t sequencePosition) const
     {
+        assert(!m_chunkWindow.empty() &&
+               m_chunkWindow.front().m_sequencePositionStart <= sequencePosition &&
+               sequencePosition < m_chunkWindow.back().SequenceEndPosition());
         auto result = std::upper_bound(
-            m_randomizedChunks.begin(),
-            m_randomizedChunks.end(),
+            m_chunkWindow.begin(),
+            m_chunkWindow.end(),
             sequencePosition,
             [](size_t sp, const RandomizedChunk& c) { return sp < c.m_sequencePositionStart; });
-        return (ChunkIdType)(result - 1 - m_randomizedChunks.begin());
+        return (ChunkIdType)(m_chunkWindowBegin + (result - 1 - m_chunkWindow.begin()));
     }
 
     // Add randomizes sequences for the chunk with a given index.
@@ -364,7 +386,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             RandomizedSequenceDescription s;
             s.m_id = m_bufferOriginalSequences[k].m_id;
             s.m_numberOfSamples = m_bufferOriginalSequences[k].m_numberOfSamples;
-            s.m_chunk = &chunk;
+            s.m_chunkId = chunk.m_chunkId;
             chunkSequences.push_back(s);
         }
 
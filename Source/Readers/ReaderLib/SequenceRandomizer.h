@@ -15,16 +15,19 @@
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // Randomized sequence description.
+// One is kept for every sequence of the chunk window, so it is packed into 16 bytes.
 struct RandomizedSequenceDescription
 {
     // Sequence id.
     size_t m_id;
     // Number of samples in sequence.
     uint32_t m_numberOfSamples;
-    // Randomized chunk this sequence belongs to.
-    const RandomizedChunk* m_chunk;
+    // Randomized chunk this sequence belongs to (index into the randomized chunks).
+    ChunkIdType m_chunkId;
 };
 
+static_assert(sizeof(RandomizedSequenceDescription) == 16, "RandomizedSequenceDescription is expected to be packed.");
+
 // Class that given randomized chunks, randomizes sequence descriptions in a window of chunks.
 // TODO: This code is still based on the old behavior, so that all current tests pass.
 // TODO: Can be simplified if we only randomized sequences forward.
@@ -67,7 +70,7 @@ private:
     // Checks if the randomized sequence is valid for a target position using its chunk randomization window.
     bool IsValidForPosition(size_t targetPosition, const RandomizedSequenceDescription& seqDesc) const;
 
-    // Gets randomized chunk index using a sequence position in the sweep.
+    // Gets randomized chunk index using a sequence position in the sweep; the position must be in the chunk window.
     ChunkIdType GetChunkIndexForSequencePosition(size_t sequencePosition) const;
 
     // Gets randomized sequence by the sequence id.
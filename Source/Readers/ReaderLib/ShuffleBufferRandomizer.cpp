@@ -0,0 +1,255 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+
+#include "ShuffleBufferRandomizer.h"
+#include "DataReader.h"
+#include "CPUThreadPool.h"
+#include "EventTracer.h"
+#include "ReaderCounters.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+ShuffleBufferRandomizer::ShuffleBufferRandomizer(IDataDeserializerPtr deserializer, size_t bufferSizeInSamples, bool multithreadedGetNextSequences)
+    : m_deserializer(deserializer),
+      m_bufferSizeInSamples(bufferSizeInSamples),
+      m_multithreadedGetNextSequences(multithreadedGetNextSequences),
+      m_epochSize(0),
+      m_samplePositionInEpoch(0),
+      m_nextEpochIndex(SIZE_MAX),
+      m_nextChunk(0),
+      m_wrapAround(false),
+      m_bufferedSamples(0),
+      m_hasDrawnSequence(false),
+      m_loadChunks(true)
+{
+    assert(deserializer != nullptr);
+    if (bufferSizeInSamples == 0)
+    {
+        InvalidArgument("ShuffleBufferRandomizer: The size of the shuffle buffer has to be positive.");
+    }
+
+    m_streams = m_deserializer->GetStreamDescriptions();
+    m_chunkDescriptions = m_deserializer->GetChunkDescriptions();
+    if (m_chunkDescriptions.empty())
+    {
+        RuntimeError("ShuffleBufferRandomizer: Expected input to contain samples, but the number of successfully read chunks was 0.");
+    }
+}
+
+void ShuffleBufferRandomizer::Reset(unsigned int seed)
+{
+    m_rng.seed(seed);
+    m_nextChunk = m_config.m_workerRank;
+    m_buffer.clear();
+    m_bufferedSamples = 0;
+    m_hasDrawnSequence = false;
+    m_chunks.clear();
+    FillBuffer();
+}
+
+void ShuffleBufferRandomizer::StartEpoch(const EpochConfiguration& config)
+{
+    bool workersChanged = config.m_workerRank != m_config.m_workerRank || config.m_numberOfWorkers != m_config.m_numberOfWorkers;
+    m_config = config;
+    if (m_config.m_workerRank >= m_chunkDescriptions.size())
+    {
+        RuntimeError("ShuffleBufferRandomizer: Worker %d has no data, the input has only %d chunks for %d workers.",
+            (int) m_config.m_workerRank, (int) m_chunkDescriptions.size(), (int) m_config.m_numberOfWorkers);
+    }
+
+    m_samplePositionInEpoch = 0;
+    if (m_config.m_totalEpochSizeInSamples == requestDataSize)
+    {
+        // Each epoch is a pass over the chunks of this worker, randomized on its own.
+        m_epochSize = SIZE_MAX;
+        m_wrapAround = false;
+        Reset((unsigned int) m_config.m_epochIndex);
+        return;
+    }
+
+    // This worker's share of the epoch, the shares add up to the epoch size.
+    m_epochSize = (m_config.m_totalEpochSizeInSamples + m_config.m_numberOfWorkers - 1 - m_config.m_workerRank) / m_config.m_numberOfWorkers;
+    m_wrapAround = true;
+    if (workersChanged || m_config.m_epochIndex != m_nextEpochIndex)
+    {
+        Reset(0);
+        Replay(m_config.m_epochIndex);
+    }
+
+    m_nextEpochIndex = m_config.m_epochIndex + 1;
+}
+
+void ShuffleBufferRandomizer::Replay(size_t epochIndex)
+{
+    m_loadChunks = false;
+    std::vector<SequenceDescription> skipped;
+    for (size_t i = 0; i < epochIndex; ++i)
+    {
+        for (size_t position = 0; position < m_epochSize && PeekSequence();)
+        {
+            position += m_drawnSequence.m_numberOfSamples;
+            skipped.clear();
+            TakeSequence(skipped, nullptr);
+        }
+    }
+    m_loadChunks = true;
+}
+
+void ShuffleBufferRandomizer::FillBuffer()
+{
+    while (m_bufferedSamples < m_bufferSizeInSamples)
+    {
+        if (m_nextChunk >= m_chunkDescriptions.size())
+        {
+            if (!m_wrapAround)
+            {
+                return;
+            }
+
+            m_nextChunk = m_config.m_workerRank;
+        }
+
+        const auto& chunk = m_chunkDescriptions[m_nextChunk];
+        size_t bufferSize = m_buffer.size();
+        m_deserializer->GetSequencesForChunk(chunk->m_id, m_buffer);
+        for (size_t i = bufferSize; i < m_buffer.size(); ++i)
+        {
+            m_bufferedSamples += m_buffer[i].m_numberOfSamples;
+        }
+
+        if (m_buffer.size() > bufferSize)
+        {
+            auto& entry = m_chunks[chunk->m_id];
+            entry.second += m_buffer.size() - bufferSize;
+            if (m_loadChunks && entry.first == nullptr)
+            {
+                EventTracer::Scope chunkScope("ChunkLoad", "reader");
+                ReaderCounters::Timer timer(ReaderCounters::chunkLoadMicroseconds);
+                entry.first = m_deserializer->GetChunk(chunk->m_id);
+            }
+        }
+
+        m_nextChunk += m_config.m_numberOfWorkers;
+    }
+}
+
+bool ShuffleBufferRandomizer::PeekSequence()
+{
+    if (m_hasDrawnSequence)
+    {
+        return true;
+    }
+
+    if (m_buffer.empty())
+    {
+        return false;
+    }
+
+    size_t index = std::uniform_int_distribution<size_t>(0, m_buffer.size() - 1)(m_rng);
+    std::swap(m_buffer[index], m_buffer.back());
+    m_drawnSequence = m_buffer.back();
+    m_buffer.pop_back();
+    m_bufferedSamples -= m_drawnSequence.m_numberOfSamples;
+    m_hasDrawnSequence = true;
+
+    FillBuffer();
+    return true;
+}
+
+void ShuffleBufferRandomizer::TakeSequence(std::vector<SequenceDescription>& result, std::map<ChunkIdType, ChunkPtr>* chunks)
+{
+    assert(m_hasDrawnSequence);
+    m_hasDrawnSequence = false;
+    result.push_back(m_drawnSequence);
+
+    auto it = m_chunks.find(m_drawnSequence.m_chunkId);
+    if (it == m_chunks.end())
+    {
+        LogicError("ShuffleBufferRandomizer: The chunk of a buffered sequence is not known.");
+    }
+
+    if (chunks != nullptr)
+    {
+        if (it->second.first == nullptr)
+        {
+            EventTracer::Scope chunkScope("ChunkLoad", "reader");
+            ReaderCounters::Timer timer(ReaderCounters::chunkLoadMicroseconds);
+            it->second.first = m_deserializer->GetChunk(m_drawnSequence.m_chunkId);
+        }
+
+        (*chunks)[m_drawnSequence.m_chunkId] = it->second.first;
+    }
+
+    // Release the chunk with its last buffered sequence.
+    if (--it->second.second == 0)
+    {
+        m_chunks.erase(it);
+    }
+}
+
+Sequences ShuffleBufferRandomizer::GetNextSequences(size_t sampleCount)
+{
+    EventTracer::Scope scope("Deserialize", "reader");
+    Sequences result;
+    if (m_samplePositionInEpoch >= m_epochSize || !PeekSequence())
+    {
+        result.m_endOfEpoch = true;
+        return result;
+    }
+
+    // This worker's share of the requested samples.
+    sampleCount = std::max<size_t>(1, (sampleCount + m_config.m_numberOfWorkers - 1 - m_config.m_workerRank) / m_config.m_numberOfWorkers);
+
+    std::vector<SequenceDescription> descriptions;
+    std::map<ChunkIdType, ChunkPtr> chunks;
+    size_t samples = 0;
+    do
+    {
+        samples += m_drawnSequence.m_numberOfSamples;
+        TakeSequence(descriptions, &chunks);
+    }
+    // Check whether the next sequence fits into the sample count, if not, exit.
+    while (m_samplePositionInEpoch + samples < m_epochSize &&
+           PeekSequence() &&
+           samples + m_drawnSequence.m_numberOfSamples <= sampleCount);
+
+    m_samplePositionInEpoch += samples;
+
+    result.m_data.resize(m_streams.size(), std::vector<SequenceDataPtr>(descriptions.size()));
+    auto process = [&](int i) -> void {
+        std::vector<SequenceDataPtr> sequence;
+        const auto& sequenceDescription = descriptions[i];
+
+        auto it = chunks.find(sequenceDescription.m_chunkId);
+        if (it == chunks.end())
+        {
+            LogicError("Invalid chunk requested.");
+        }
+
+        it->second->GetSequence(sequenceDescription.m_id, sequence);
+        for (int j = 0; j < m_streams.size(); ++j)
+        {
+            result.m_data[j][i] = sequence[j];
+        }
+    };
+
+    // TODO: This will be changed, when we move transformers under the (no-) randomizer, should not deal with multithreading here.
+    if (m_multithreadedGetNextSequences)
+    {
+        CPUThreadPool::ParallelFor(0, descriptions.size(), CPUThreadPool::MinWorkPerChunk, process);
+    }
+    else
+    {
+        for (int i = 0; i < descriptions.size(); ++i)
+            process(i);
+    }
+
+    return result;
+}
+
+}}}
@@ -0,0 +1,99 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <random>
+#include "SequenceEnumerator.h"
+#include "DataDeserializer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A randomizer for inputs that cannot be indexed up front, or only at a high cost: it reads the chunks of the
+// deserializer sequentially, in their original order, and randomizes the sequences inside a bounded shuffle buffer.
+// The buffer is filled with the sequences of the next chunks until it holds bufferSizeInSamples samples, and each
+// returned sequence is drawn uniformly from the buffer. Unlike the BlockRandomizer, it needs neither the sample
+// counts of all chunks nor the sequence descriptions of a window of chunks; only the chunks of the buffered sequences
+// are kept in memory, and they are loaded in stream order.
+// In distributed reading, the stream of chunks is striped over the workers (chunk i belongs to worker i modulo
+// the number of workers), each worker reads only its chunks and returns its share of the requested samples.
+// An epoch of requestDataSize is one pass over the chunks of the worker; other epochs continue the stream where the
+// last one ended. An epoch that does not follow the previous one (e.g. after restarting from a checkpoint) is reached
+// by replaying the randomization from the start, which reads the sequence descriptions but no chunk data.
+class ShuffleBufferRandomizer : public SequenceEnumerator
+{
+public:
+    ShuffleBufferRandomizer(IDataDeserializerPtr deserializer, size_t bufferSizeInSamples, bool multithreadedGetNextSequences = false);
+
+    virtual void StartEpoch(const EpochConfiguration& config) override;
+    virtual Sequences GetNextSequences(size_t sampleCount) override;
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_deserializer->GetStreamDescriptions();
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(ShuffleBufferRandomizer);
+
+    // Starts the stream of this worker over, with the given seed.
+    void Reset(unsigned int seed);
+
+    // Replays the epochs before the given one without loading chunk data.
+    void Replay(size_t epochIndex);
+
+    // Adds the sequences of the next chunks of this worker until the buffer is full or the pass ends.
+    void FillBuffer();
+
+    // Draws the next sequence from the buffer, unless it has already been drawn; returns false at the end of the pass.
+    // The draws do not depend on the requested sample counts, so that replaying the stream gives the same sequences.
+    bool PeekSequence();
+
+    // Takes the drawn sequence, adding its chunk to chunks if not null.
+    void TakeSequence(std::vector<SequenceDescription>& result, std::map<ChunkIdType, ChunkPtr>* chunks);
+
+    IDataDeserializerPtr m_deserializer;
+    std::vector<StreamDescriptionPtr> m_streams;
+    ChunkDescriptions m_chunkDescriptions;
+
+    size_t m_bufferSizeInSamples;
+
+    // Whether to get sequences using multiple thread.
+    // TODO temporary; should go away when transformers are moved closer to the deserializer
+    bool m_multithreadedGetNextSequences;
+
+    EpochConfiguration m_config;
+
+    // Epoch size of this worker in samples, SIZE_MAX for a pass over its chunks.
+    size_t m_epochSize;
+    size_t m_samplePositionInEpoch;
+
+    // Index of the epoch that continues the stream without replaying it.
+    size_t m_nextEpochIndex;
+
+    // The next chunk to read (an index into m_chunkDescriptions, the chunks of this worker are
+    // m_workerRank + k * m_numberOfWorkers), and whether to wrap around at the end of the chunks.
+    size_t m_nextChunk;
+    bool m_wrapAround;
+
+    // Buffered sequences and their total number of samples.
+    std::vector<SequenceDescription> m_buffer;
+    size_t m_bufferedSamples;
+
+    // The drawn sequence, returned by the next TakeSequence().
+    SequenceDescription m_drawnSequence;
+    bool m_hasDrawnSequence;
+
+    // The chunks of the buffered sequences with the number of their sequences in the buffer.
+    // A chunk is loaded as soon as it is read from the stream, but not while replaying, then it is null
+    // until the first of its sequences is taken.
+    std::map<ChunkIdType, std::pair<ChunkPtr, size_t>> m_chunks;
+    bool m_loadChunks;
+
+    std::mt19937 m_rng;
+};
+
+}}}
@@ -8,83 +8,165 @@
 #include <string>
 #include <memory>
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <string.h>
 #include "Basics.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // This class represents a string registry pattern to share strings between different deserializers if needed.
 // It associates a unique key for a given string.
-// Currently it is implemented in-memory, but can be unloaded to external disk if needed.
+// The ids are assigned in the order the strings are added (0, 1, ...), so that the deserializers can keep their
+// sequence locations in vectors indexed by the id. The strings are kept one after another in a single character
+// arena and found through an open-addressing hash table of ids. All of it is a few flat arrays, which take a fraction
+// of the memory of a tree of string nodes (corpora have tens of millions of keys) and can be dumped to or mapped
+// from a file as a whole.
 // TODO: Move this class to Basics.h when it is required by more than one reader.
 template<class TString>
 class TStringToIdMap
 {
+    typedef typename TString::value_type TChar;
+
 public:
-    TStringToIdMap()
-    {}
+    TStringToIdMap() : m_numValues(0)
+    {
+        m_offsets.push_back(0);
+    }
 
-    // Adds string value to the registry.
+    // Adds string value to the registry, returns its id (the existing one if it has been added before).
     size_t AddValue(const TString& value)
     {
-        auto iter = m_values.insert(std::make_pair(value, m_indexedValues.size()));
-        m_indexedValues.push_back(&((iter.first)->first));
-        return m_indexedValues.size() - 1;
+        size_t slot = FindSlot(value.data(), value.size());
+        if (m_table.empty() || m_table[slot] == s_empty)
+        {
+            return Insert(value);
+        }
+        return m_table[slot];
     }
 
     // Tries to get a value by id.
     bool TryGet(const TString& value, size_t& id) const
     {
-        const auto& it = m_values.find(value);
-        if (it == m_values.end())
-        {
-            return false;
-        }
-        else
-        {
-            id = it->second;
-            return true;
-        }
+        id = Find(value);
+        return id != SIZE_MAX;
     }
 
     // Get integer id for the string value, adding if not exists.
     size_t operator[](const TString& value)
     {
-        const auto& it = m_values.find(value);
-        if (it == m_values.end())
-        {
-            return AddValue(value);
-        }
-        return it->second;
+        return AddValue(value);
     }
 
     // Get integer id for the string value.
     size_t operator[](const TString& value) const
     {
-        const auto& it = m_values.find(value);
-        assert(it != m_values.end());
-        return it->second;
+        size_t id = Find(value);
+        assert(id != SIZE_MAX);
+        return id;
     }
 
     // Get string value by its integer id.
-    const TString& operator[](size_t id) const
+    TString operator[](size_t id) const
     {
-        assert(id < m_indexedValues.size());
-        return *m_indexedValues[id];
+        assert(id < m_numValues);
+        return TString(m_arena.data() + m_offsets[id], m_offsets[id + 1] - m_offsets[id]);
     }
 
     // Checks whether the value exists.
     bool Contains(const TString& value) const
     {
-        return m_values.find(value) != m_values.end();
+        return Find(value) != SIZE_MAX;
+    }
+
+    // Number of strings in the registry, one more than the largest id.
+    size_t Size() const
+    {
+        return m_numValues;
     }
 
 private:
     // TODO: Move NonCopyable as a separate class to Basics.h
     DISABLE_COPY_AND_MOVE(TStringToIdMap);
 
-    std::map<TString, size_t> m_values;
-    std::vector<const TString*> m_indexedValues;
+    static const uint32_t s_empty = UINT32_MAX;
+
+    // FNV-1a over the characters
+    static size_t Hash(const TChar* value, size_t length)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash = (hash ^ (uint64_t)value[i]) * 1099511628211ull;
+        }
+        return (size_t)(hash ^ (hash >> 32));
+    }
+
+    // The slot of the table that holds the id of the value, or the empty slot where it would be inserted.
+    size_t FindSlot(const TChar* value, size_t length) const
+    {
+        if (m_table.empty())
+        {
+            return 0;
+        }
+
+        size_t mask = m_table.size() - 1;
+        for (size_t slot = Hash(value, length) & mask;; slot = (slot + 1) & mask)
+        {
+            uint32_t id = m_table[slot];
+            if (id == s_empty ||
+                (m_offsets[id + 1] - m_offsets[id] == length &&
+                 memcmp(m_arena.data() + m_offsets[id], value, length * sizeof(TChar)) == 0))
+            {
+                return slot;
+            }
+        }
+    }
+
+    size_t Find(const TString& value) const
+    {
+        if (m_table.empty())
+        {
+            return SIZE_MAX;
+        }
+
+        uint32_t id = m_table[FindSlot(value.data(), value.size())];
+        return id == s_empty ? SIZE_MAX : id;
+    }
+
+    size_t Insert(const TString& value)
+    {
+        if (m_numValues >= s_empty - 1)
+        {
+            RuntimeError("StringToIdMap: The maximum number of strings (%u) is exceeded.", (unsigned int)(s_empty - 1));
+        }
+
+        // at most half of the slots are used
+        if (2 * (m_numValues + 1) > m_table.size())
+        {
+            Rehash(std::max<size_t>(2 * m_table.size(), 1024));
+        }
+
+        size_t id = m_numValues++;
+        m_arena.insert(m_arena.end(), value.begin(), value.end());
+        m_offsets.push_back(m_arena.size());
+        m_table[FindSlot(value.data(), value.size())] = (uint32_t)id;
+        return id;
+    }
+
+    void Rehash(size_t tableSize)
+    {
+        m_table.assign(tableSize, (uint32_t)s_empty);
+        for (size_t id = 0; id < m_numValues; ++id)
+        {
+            size_t slot = FindSlot(m_arena.data() + m_offsets[id], m_offsets[id + 1] - m_offsets[id]);
+            m_table[slot] = (uint32_t)id;
+        }
+    }
+
+    std::vector<TChar> m_arena;     // the characters of all strings, in the order of their ids
+    std::vector<size_t> m_offsets;  // string id -> its beginning in the arena, followed by the end of the last string
+    std::vector<uint32_t> m_table;  // open-addressing hash table (linear probing) of string ids, the size is a power of 2
+    size_t m_numValues;
 };
 
 typedef TStringToIdMap<std::wstring> WStringToIdMap;
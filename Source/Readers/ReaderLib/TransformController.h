@@ -6,9 +6,13 @@
 #pragma once
 
 #include <set>
+#include <algorithm>
 
 #include "Transformer.h"
 #include "SequenceEnumerator.h"
+#include "CPUThreadPool.h"
+#include "EventTracer.h"
+#include "ReaderCounters.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -22,10 +26,15 @@ struct Transformation
 // A class responsible for applying a list of transformers to sequences and stream descriptions.
 // Delegates retrieving of sequences to another sequence provider(such as randomizer) and applies transformations after retrieving.
 // Usually used by the packer to get next set of sequences.
+// The sequences are transformed in parallel by a number of transformer chains, each a copy of the transformers
+// with its own state and seed (see Transformer::Clone()), which run on the threads of the CPUThreadPool.
+// The sequence j of the sequences retrieved at once goes to the chain j modulo the number of chains, and each chain
+// transforms its sequences in order, so the results depend on the number of chains, but not on the threads.
 class TransformController : public SequenceEnumerator
 {
 public:
-    TransformController(const std::vector<Transformation>& transformations, SequenceEnumeratorPtr sequenceProvider)
+    // 'numChains' is the number of transformer chains, 0 means the number of threads of the CPUThreadPool.
+    TransformController(const std::vector<Transformation>& transformations, SequenceEnumeratorPtr sequenceProvider, size_t numChains = 0)
         : m_sequenceProvider(sequenceProvider)
     {
         // Applying transformations to stream descriptions,
@@ -38,6 +47,26 @@ public:
             transformedStreams[streamId] = std::make_shared<StreamDescription>(t.m_transformer->Transform(*transformedStreams[streamId]));
         }
         m_outputStreams = transformedStreams;
+
+        if (numChains == 0)
+        {
+            numChains = CPUThreadPool::GetNumThreads();
+        }
+
+        // The first chain consists of the given transformers, the others of their copies.
+        m_chains.resize(std::max<size_t>(numChains, 1));
+        for (const auto& t : m_transformations)
+        {
+            m_chains[0].push_back(t.first.m_transformer);
+        }
+        for (size_t i = 1; i < m_chains.size(); ++i)
+        {
+            for (const auto& transformer : m_chains[0])
+            {
+                TransformerPtr clone = transformer->Clone(static_cast<unsigned int>(i));
+                m_chains[i].push_back(clone ? clone : transformer);
+            }
+        }
     }
 
     // Sets configuration for the current epoch.
@@ -45,14 +74,33 @@ public:
     virtual void StartEpoch(const EpochConfiguration &config) override
     {
         assert(m_sequenceProvider != nullptr);
-        for (auto& t : m_transformations)
+        for (auto& chain : m_chains)
         {
-            t.first.m_transformer->StartEpoch(config);
+            for (size_t i = 0; i < chain.size(); ++i)
+            {
+                // (a shared transformer only once)
+                if (&chain != &m_chains.front() && chain[i] == m_chains.front()[i])
+                {
+                    continue;
+                }
+
+                chain[i]->StartEpoch(config);
+            }
         }
 
         m_sequenceProvider->StartEpoch(config);
     }
 
+    virtual size_t GetCurrentSamplePosition() override
+    {
+        return m_sequenceProvider->GetCurrentSamplePosition();
+    }
+
+    virtual void SetCurrentSamplePosition(size_t samplePosition) override
+    {
+        m_sequenceProvider->SetCurrentSamplePosition(samplePosition);
+    }
+
     // Description of streams that the transformer provides.
     virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
     {
@@ -65,19 +113,29 @@ public:
     {
         assert(m_sequenceProvider != nullptr);
         Sequences sequences = m_sequenceProvider->GetNextSequences(sampleCount);
-        if (sequences.m_data.empty())
+        if (sequences.m_data.empty() || sequences.m_data.front().empty())
         {
             return sequences;
         }
 
-#pragma omp parallel for schedule(dynamic)
-        for (int j = 0; j < sequences.m_data.front().size(); ++j)
+        EventTracer::Scope scope("Transform", "reader");
+        ReaderCounters::Timer timer(ReaderCounters::transformMicroseconds);
+        size_t numSequences = sequences.m_data.front().size();
+        size_t numChains = m_chains.size();
+        size_t numActiveChains = std::min(numChains, numSequences);
+        size_t sequencesPerChain = (numSequences + numActiveChains - 1) / numActiveChains;
+        CPUThreadPool::ParallelFor(0, numActiveChains, CPUThreadPool::MinWorkPerChunk * sequencesPerChain, [&](int64_t c)
         {
-            for (auto& t : m_transformations)
+            const auto& chain = m_chains[c];
+            for (size_t j = c; j < numSequences; j += numChains)
             {
-                sequences.m_data[t.second][j] = t.first.m_transformer->Transform(sequences.m_data[t.second][j]);
+                for (size_t i = 0; i < chain.size(); ++i)
+                {
+                    auto& sequence = sequences.m_data[m_transformations[i].second][j];
+                    sequence = chain[i]->Transform(sequence);
+                }
             }
-        }
+        });
 
         return sequences;
     }
@@ -100,6 +158,9 @@ private:
     SequenceEnumeratorPtr m_sequenceProvider;
     std::vector<StreamDescriptionPtr> m_outputStreams;
     std::vector<std::pair<Transformation, size_t>> m_transformations;
+
+    // The transformer chains, each with a transformer for every transformation.
+    std::vector<std::vector<TransformerPtr>> m_chains;
 };
 
 }}}
@@ -29,6 +29,15 @@ public:
     // This method should describe how input sequences is transformed to the output sequence.
     virtual SequenceDataPtr Transform(SequenceDataPtr inputSequence) = 0;
 
+    // Creates a copy of the transformer (after its stream has been transformed) for another thread of the
+    // TransformController. The copy has state of its own, so that it is not shared between the threads, and draws
+    // its random numbers with the seed of the transformer plus the given offset.
+    // Transformers that keep no state between sequences return nullptr, they are shared by all threads.
+    virtual TransformerPtr Clone(unsigned int /*seedOffset*/) const
+    {
+        return nullptr;
+    }
+
     virtual ~Transformer()
     {
     }
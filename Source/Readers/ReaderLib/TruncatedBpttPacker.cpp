@@ -6,9 +6,12 @@
 #define _CRT_SECURE_NO_WARNINGS
 #define _SCL_SECURE_NO_WARNINGS
 
-#include <deque>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <numeric>
 #include "TruncatedBpttPacker.h"
 #include "ElementTypeUtils.h"
+#include "ReaderCounters.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -19,44 +22,77 @@ using namespace std;
 class Slot
 {
 public:
-    Slot() : m_length(0), m_sampleCursor(0), m_sampleOffset(0)
+    Slot() : m_length(0), m_sampleCursor(0), m_sampleOffset(0), m_front(0)
     {}
 
     // Checks if slot is empty.
     bool IsEmpty() const
     {
-        return m_sequences.empty();
+        return m_front == m_sequences.size();
     }
 
     // Gets the number of available samples in the slot.
     size_t AvailableNumberOfSamples() const
     {
         assert(m_length >= m_sampleCursor);
-        assert(m_sequences.empty() ? m_sampleCursor == 0 : FrontSequence()->m_numberOfSamples >= m_sampleCursor);
+        assert(IsEmpty() ? m_sampleCursor == 0 : FrontSequence()->m_numberOfSamples >= m_sampleCursor);
         return m_length - m_sampleCursor;
     }
 
-    // Adds a new sequence to the end of the slot.
-    void PushSequence(SequenceDataPtr s)
+    // Adds a new sequence to the end of the slot, with its position on the timeline of the sequence enumerator.
+    void PushSequence(const SequenceDataPtr& s, size_t samplePosition)
     {
         m_sequences.push_back(s);
+        m_samplePositions.push_back(samplePosition);
         m_length += s->m_numberOfSamples;
     }
 
-    SequenceDataPtr FrontSequence() const
+    // Positions of the sequences in the slot, the front one first.
+    vector<size_t> SequencePositions() const
     {
-        assert(!m_sequences.empty());
-        return m_sequences.front();
+        return vector<size_t>(m_samplePositions.begin() + m_front, m_samplePositions.end());
+    }
+
+    // Drops all sequences.
+    void Clear()
+    {
+        m_sequences.clear();
+        m_samplePositions.clear();
+        m_front = 0;
+        m_length = 0;
+        m_sampleCursor = 0;
+        m_sampleOffset = 0;
+    }
+
+    const SequenceDataPtr& FrontSequence() const
+    {
+        assert(!IsEmpty());
+        return m_sequences[m_front];
     }
 
     // Pops the front sequence at the beginning of the slot.
     void PopSequence()
     {
-        assert(!m_sequences.empty());
+        assert(!IsEmpty());
         m_sampleCursor = 0;
         m_sampleOffset = 0;
-        m_length -= m_sequences.front()->m_numberOfSamples;
-        m_sequences.pop_front();
+        m_length -= m_sequences[m_front]->m_numberOfSamples;
+        m_sequences[m_front++].reset();
+
+        // A slot holds a couple of sequences at a time, so it is drained often and its storage is reused
+        // instead of the blocks of a deque being allocated and freed as the sequences pass through.
+        if (IsEmpty())
+        {
+            m_sequences.clear();
+            m_samplePositions.clear();
+            m_front = 0;
+        }
+        else if (m_front >= 16 && 2 * m_front >= m_sequences.size())
+        {
+            m_sequences.erase(m_sequences.begin(), m_sequences.begin() + m_front);
+            m_samplePositions.erase(m_samplePositions.begin(), m_samplePositions.begin() + m_front);
+            m_front = 0;
+        }
     }
 
     // Contains the current sample cursor in the first sequence(m_sequences.front()) of the slot.
@@ -69,8 +105,10 @@ public:
     size_t m_sampleOffset; 
 
 private:
-    // Prepared sequences.
-    deque<SequenceDataPtr> m_sequences;
+    // Prepared sequences, the ones before m_front have been popped.
+    vector<SequenceDataPtr> m_sequences;
+    vector<size_t> m_samplePositions;
+    size_t m_front;
 
     // Contains the size of the slot in samples (accumulated over all m_sequences).
     size_t m_length;
@@ -188,6 +226,8 @@ Minibatch TruncatedBPTTPacker::ReadMinibatch()
         return result;
     }
 
+    ReaderCounters::Timer timer(ReaderCounters::packMicroseconds);
+
     // Iterating over the streams/slots and packing them into the minibatch.
     for (size_t streamIndex = 0; streamIndex < m_outputStreamDescriptions.size(); ++streamIndex)
     {
@@ -241,8 +281,11 @@ void TruncatedBPTTPacker::PackSlot(size_t streamIndex, size_t slotIndex, size_t&
         -(int)slot.m_sampleCursor,
         slot.FrontSequence()->m_numberOfSamples - slot.m_sampleCursor);
 
-    // Ok, now fill in the buffer with data.
-    for (size_t currentTimestep = 0; currentTimestep < numberOfSamples; ++currentTimestep)
+    // Ok, now fill in the buffer with data, a run of samples of the front sequence at a time.
+    auto& buffer = m_streamBuffers[streamIndex];
+    char* slotDestination = buffer.m_data.get() + slotIndex * sampleSize;
+    size_t currentTimestep = 0;
+    while (currentTimestep < numberOfSamples)
     {
         // Check if reach the end of the front sequence.
         if (slot.m_sampleCursor >= slot.FrontSequence()->m_numberOfSamples)
@@ -259,33 +302,50 @@ void TruncatedBPTTPacker::PackSlot(size_t streamIndex, size_t slotIndex, size_t&
         }
 
         // Fill in the data from the first sequence in the slot.
-        auto data = slot.FrontSequence();
-        // Get buffer destination for the current sample.
-        auto& buffer = m_streamBuffers[streamIndex];
-        auto offset = strideSize * currentTimestep + slotIndex * sampleSize;
-        assert(offset >= 0 && offset < buffer.m_size);
-        char* destination = buffer.m_data.get() + offset;
-
-        // Pack the sample.
+        const auto& data = slot.FrontSequence();
+        size_t runLength = min(numberOfSamples - currentTimestep, data->m_numberOfSamples - slot.m_sampleCursor);
+
+        // Get buffer destination for the first sample of the run, the next ones are a stride apart.
+        char* destination = slotDestination + strideSize * currentTimestep;
+        assert(strideSize * (currentTimestep + runLength - 1) + slotIndex * sampleSize < buffer.m_size);
+
+        // Pack the samples.
         if (storageType == StorageType::dense)
         {
             assert(slot.m_sampleOffset == slot.m_sampleCursor * sampleSize);
-            PackDenseSample(destination, data, slot.m_sampleOffset, sampleSize);
-            slot.m_sampleOffset += sampleSize;
+            const char* source = (const char*)data->m_data + slot.m_sampleOffset;
+            if (strideSize == sampleSize)
+            {
+                // A single slot, the samples are contiguous in the minibatch as well.
+                memcpy(destination, source, runLength * sampleSize);
+            }
+            else
+            {
+                for (size_t i = 0; i < runLength; ++i)
+                {
+                    memcpy(destination + i * strideSize, source + i * sampleSize, sampleSize);
+                }
+            }
+            slot.m_sampleOffset += runLength * sampleSize;
         }
         else
         {
             assert(storageType == StorageType::sparse_csc);
             // TODO: make type casts members of the SparseSequenceData
             SparseSequenceDataPtr sparseSequence = static_pointer_cast<SparseSequenceData>(data);
-            assert(slot.m_sampleCursor < sparseSequence->m_nnzCounts.size());
-            PackSparseSampleAsDense(destination, sparseSequence, slot.m_sampleCursor, 
-                slot.m_sampleOffset, sampleSize, elementSize);
-            slot.m_sampleOffset += sparseSequence->m_nnzCounts[slot.m_sampleCursor];
-            assert(slot.m_sampleOffset <= sparseSequence->m_totalNnzCount);
+            for (size_t i = 0; i < runLength; ++i)
+            {
+                size_t sampleIndex = slot.m_sampleCursor + i;
+                assert(sampleIndex < sparseSequence->m_nnzCounts.size());
+                PackSparseSampleAsDense(destination + i * strideSize, sparseSequence, sampleIndex,
+                    slot.m_sampleOffset, sampleSize, elementSize);
+                slot.m_sampleOffset += sparseSequence->m_nnzCounts[sampleIndex];
+                assert(slot.m_sampleOffset <= sparseSequence->m_totalNnzCount);
+            }
         }
 
-        slot.m_sampleCursor++;
+        slot.m_sampleCursor += runLength;
+        currentTimestep += runLength;
     }
 
     // Cleaning up the last sequence we have just read if needed.
@@ -312,6 +372,7 @@ void TruncatedBPTTPacker::ReadSequencesToSlot(size_t slotIndex)
     {
         // We need a single sequence, potentially we can request (m_truncationSize - slot.AvailableNumberOfSamples())
         // to be more efficient. In reality the truncation size usually is less the sequence size.
+        size_t samplePosition = m_sequenceEnumerator->GetCurrentSamplePosition();
         auto s = m_sequenceEnumerator->GetNextSequences(1);
         if (s.m_endOfEpoch)
         {
@@ -329,9 +390,107 @@ void TruncatedBPTTPacker::ReadSequencesToSlot(size_t slotIndex)
                 RuntimeError("For BPTT sequences between different input stream should have the same length.");
             }
 
-            m_sequenceBufferPerStream[i]->m_slots[slotIndex].PushSequence(s.m_data[i].front());
+            m_sequenceBufferPerStream[i]->m_slots[slotIndex].PushSequence(s.m_data[i].front(), samplePosition);
+        }
+    }
+}
+
+bool TruncatedBPTTPacker::GetState(ReaderState& state)
+{
+    state.m_samplePosition = m_sequenceEnumerator->GetCurrentSamplePosition();
+    state.m_slotSequencePositions.clear();
+    state.m_slotSampleCursors.clear();
+    if (state.m_samplePosition == SIZE_MAX)
+    {
+        return false;
+    }
+
+    // the slots of all streams hold the same sequences
+    for (const auto& slot : m_sequenceBufferPerStream.front()->m_slots)
+    {
+        state.m_slotSequencePositions.push_back(slot.SequencePositions());
+        state.m_slotSampleCursors.push_back(slot.m_sampleCursor);
+    }
+    return true;
+}
+
+// Reads the sequences held over in the slots again, in the order of the timeline, then moves on to the next position.
+void TruncatedBPTTPacker::SetState(const ReaderState& state)
+{
+    // (no parallel sequences at all: they are started anew from the sample position)
+    if ((!state.m_slotSequencePositions.empty() || !state.m_slotSampleCursors.empty()) &&
+        (state.m_slotSequencePositions.size() != m_numParallelSequences || state.m_slotSampleCursors.size() != m_numParallelSequences))
+    {
+        RuntimeError("SetState: The reader state has %d parallel sequences, but the packer is configured for %d.",
+                     (int)state.m_slotSequencePositions.size(), (int)m_numParallelSequences);
+    }
+
+    vector<pair<size_t, size_t>> sequences; // (position, slot)
+    for (size_t slotIndex = 0; slotIndex < state.m_slotSequencePositions.size(); ++slotIndex)
+    {
+        for (size_t position : state.m_slotSequencePositions[slotIndex])
+        {
+            sequences.push_back(make_pair(position, slotIndex));
+        }
+    }
+    stable_sort(sequences.begin(), sequences.end());
+
+    for (auto& buffer : m_sequenceBufferPerStream)
+    {
+        for (auto& slot : buffer->m_slots)
+        {
+            slot.Clear();
+        }
+    }
+
+    for (const auto& sequence : sequences)
+    {
+        m_sequenceEnumerator->SetCurrentSamplePosition(sequence.first);
+        auto s = m_sequenceEnumerator->GetNextSequences(1);
+        if (s.m_data.empty() || s.m_data.front().size() != 1)
+        {
+            RuntimeError("SetState: The sequence at sample position %" PRIu64 " of the reader state cannot be read.", sequence.first);
+        }
+
+        for (size_t i = 0; i < s.m_data.size(); ++i)
+        {
+            m_sequenceBufferPerStream[i]->m_slots[sequence.second].PushSequence(s.m_data[i].front(), sequence.first);
+        }
+    }
+
+    // Restore the cursors into the front sequences.
+    for (size_t streamIndex = 0; streamIndex < m_outputStreamDescriptions.size(); ++streamIndex)
+    {
+        size_t sampleSize = GetSampleSize(m_inputStreamDescriptions[streamIndex]);
+        bool isSparse = m_inputStreamDescriptions[streamIndex]->m_storageType == StorageType::sparse_csc;
+        for (size_t slotIndex = 0; slotIndex < state.m_slotSampleCursors.size(); ++slotIndex)
+        {
+            auto& slot = m_sequenceBufferPerStream[streamIndex]->m_slots[slotIndex];
+            size_t sampleCursor = state.m_slotSampleCursors[slotIndex];
+            if (sampleCursor == 0)
+            {
+                continue;
+            }
+
+            if (slot.IsEmpty() || sampleCursor >= slot.FrontSequence()->m_numberOfSamples)
+            {
+                RuntimeError("SetState: The sample cursor of slot %d of the reader state is out of range.", (int)slotIndex);
+            }
+
+            slot.m_sampleCursor = sampleCursor;
+            if (isSparse)
+            {
+                const auto& nnzCounts = static_pointer_cast<SparseSequenceData>(slot.FrontSequence())->m_nnzCounts;
+                slot.m_sampleOffset = accumulate(nnzCounts.begin(), nnzCounts.begin() + sampleCursor, (size_t)0);
+            }
+            else
+            {
+                slot.m_sampleOffset = sampleCursor * sampleSize;
+            }
         }
     }
+
+    m_sequenceEnumerator->SetCurrentSamplePosition(state.m_samplePosition);
 }
 
 }}}
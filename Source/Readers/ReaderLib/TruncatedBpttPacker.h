@@ -29,6 +29,10 @@ public:
 
     virtual void StartEpoch(const EpochConfiguration& config) override;
 
+    // The state includes the sequences held over in the slots, which are read again on restoring it.
+    virtual bool GetState(ReaderState& state) override;
+    virtual void SetState(const ReaderState& state) override;
+
 private:
     // Reads sequences to slot with the specified index.
     // Number of slots = m_parallelNumberOfSequences
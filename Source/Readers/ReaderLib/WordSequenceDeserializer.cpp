@@ -0,0 +1,388 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include "WordSequenceDeserializer.h"
+#include "ElementTypeUtils.h"
+#include "StringUtil.h"
+#include "fileutil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// The sequences of a chunk point into the ids of the deserializer, which outlives the chunks.
+class WordSequenceDeserializer::WordChunk : public Chunk, public std::enable_shared_from_this<WordChunk>
+{
+public:
+    WordChunk(const WordSequenceDeserializer& parent, ChunkIdType chunkId)
+        : m_parent(parent), m_info(parent.m_chunks[chunkId])
+    {
+    }
+
+    virtual void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        if (sequenceId < m_info.m_firstSequence || sequenceId >= m_info.m_firstSequence + m_info.m_numberOfSequences)
+        {
+            LogicError("WordSequenceDeserializer: Sequence %" PRIu64 " is not in the chunk.", (uint64_t)sequenceId);
+        }
+
+        const auto& sequence = m_parent.m_sequences[sequenceId];
+        const IndexType* words = m_parent.m_wordIds.data() + m_parent.m_offsets[sequenceId];
+        const IndexType* labels = m_parent.m_format == Format::sentencePerLine ?
+            words + 1 :
+            m_parent.m_labelIds.data() + m_parent.m_offsets[sequenceId];
+
+        result.push_back(CreateSequence(sequence, words));
+        result.push_back(CreateSequence(sequence, labels));
+    }
+
+private:
+    SequenceDataPtr CreateSequence(const SequenceDescription& sequence, const IndexType* ids)
+    {
+        auto data = std::make_shared<SparseSequenceData>();
+        data->m_id = sequence.m_id;
+        data->m_numberOfSamples = sequence.m_numberOfSamples;
+        data->m_chunk = shared_from_this();
+        data->m_data = const_cast<char*>(m_parent.m_ones.data());
+        data->m_indices = const_cast<IndexType*>(ids);
+        data->m_nnzCounts.assign(sequence.m_numberOfSamples, 1);
+        data->m_totalNnzCount = (IndexType)sequence.m_numberOfSamples;
+        return data;
+    }
+
+    const WordSequenceDeserializer& m_parent;
+    const ChunkInfo& m_info;
+};
+
+WordSequenceDeserializer::WordSequenceDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, Format format)
+    : m_format(format),
+      m_fixedWords(false),
+      m_fixedLabels(false),
+      m_unkWordId(-1),
+      m_unkLabelId(-1),
+      m_bytesInChunk(0),
+      m_numSkipped(0)
+{
+    std::wstring path = config(L"file");
+    std::string precision = (ConfigValue)config(L"precision", "float");
+    m_elementType = AreEqualIgnoreCase(precision, "float") ? ElementType::tfloat : ElementType::tdouble;
+
+    std::string unk = (ConfigValue)config(L"unk", "<unk>");
+    m_beginSequence = (ConfigValue)config(L"beginSequence", "");
+    m_endSequence = (ConfigValue)config(L"endSequence", format == Format::wordPerLine ? "</s>" : "");
+
+    size_t id;
+    std::wstring vocabulary = config(L"vocabulary", L"");
+    if (!vocabulary.empty())
+    {
+        LoadVocabulary(vocabulary, m_words);
+        m_fixedWords = true;
+        if (m_words.TryGet(unk, id))
+        {
+            m_unkWordId = (IndexType)id;
+        }
+    }
+
+    // the labels of the sentencePerLine format are words
+    std::wstring labelVocabulary = config(L"labelVocabulary", L"");
+    if (format == Format::wordPerLine && !labelVocabulary.empty())
+    {
+        LoadVocabulary(labelVocabulary, m_labels);
+        m_fixedLabels = true;
+        if (m_labels.TryGet(unk, id))
+        {
+            m_unkLabelId = (IndexType)id;
+        }
+    }
+
+    size_t chunkSizeInBytes = config(L"chunkSizeInBytes", (size_t)32 * 1024 * 1024);
+    Index(corpus, path, chunkSizeInBytes);
+
+    size_t wordDimension = std::max<size_t>(config(L"dim", (size_t)0), m_words.Size());
+    size_t labelDimension = std::max<size_t>(config(L"labelDim", (size_t)0), format == Format::sentencePerLine ? m_words.Size() : m_labels.Size());
+
+    auto features = std::make_shared<StreamDescription>();
+    features->m_id = 0;
+    features->m_name = (std::wstring)config(L"featureStreamName", L"features");
+    features->m_sampleLayout = std::make_shared<TensorShape>(wordDimension);
+    features->m_storageType = StorageType::sparse_csc;
+    features->m_elementType = m_elementType;
+    m_streams.push_back(features);
+
+    auto labels = std::make_shared<StreamDescription>();
+    labels->m_id = 1;
+    labels->m_name = (std::wstring)config(L"labelStreamName", L"labels");
+    labels->m_sampleLayout = std::make_shared<TensorShape>(labelDimension);
+    labels->m_storageType = StorageType::sparse_csc;
+    labels->m_elementType = m_elementType;
+    m_streams.push_back(labels);
+
+    // the one-hot values of the longest sequence
+    size_t maxLength = 0;
+    for (const auto& sequence : m_sequences)
+    {
+        maxLength = std::max<size_t>(maxLength, sequence.m_numberOfSamples);
+    }
+    m_ones.resize(maxLength * GetSizeByType(m_elementType));
+    if (m_elementType == ElementType::tfloat)
+    {
+        std::fill_n(reinterpret_cast<float*>(m_ones.data()), maxLength, 1.0f);
+    }
+    else
+    {
+        std::fill_n(reinterpret_cast<double*>(m_ones.data()), maxLength, 1.0);
+    }
+
+    int traceLevel = config(L"traceLevel", 0);
+    if (traceLevel > 0)
+    {
+        fprintf(stderr, "WordSequenceDeserializer: %" PRIu64 " sequences with %" PRIu64 " samples in %" PRIu64 " chunks, %" PRIu64 " words, %" PRIu64 " labels from '%ls'.\n",
+                (uint64_t)m_sequences.size(), (uint64_t)(format == Format::sentencePerLine ? m_wordIds.size() - m_sequences.size() : m_wordIds.size()),
+                (uint64_t)m_chunks.size(), (uint64_t)wordDimension, (uint64_t)labelDimension, path.c_str());
+    }
+}
+
+void WordSequenceDeserializer::LoadVocabulary(const std::wstring& path, StringToIdMap& vocabulary)
+{
+    for (msra::files::textreader r(path); r;)
+    {
+        std::string word = r.getline();
+        if (vocabulary.Contains(word))
+        {
+            RuntimeError("WordSequenceDeserializer: The word '%s' is listed twice in the vocabulary '%ls'.", word.c_str(), path.c_str());
+        }
+        vocabulary.AddValue(word);
+    }
+}
+
+IndexType WordSequenceDeserializer::GetId(StringToIdMap& vocabulary, bool isFixed, IndexType unkId, const std::string& word)
+{
+    if (!isFixed)
+    {
+        return (IndexType)vocabulary.AddValue(word);
+    }
+
+    size_t id;
+    if (vocabulary.TryGet(word, id))
+    {
+        return (IndexType)id;
+    }
+    if (unkId < 0)
+    {
+        RuntimeError("WordSequenceDeserializer: The word '%s' is not in the vocabulary, which has no unk word.", word.c_str());
+    }
+    return unkId;
+}
+
+void WordSequenceDeserializer::Index(CorpusDescriptorPtr corpus, const std::wstring& path, size_t chunkSizeInBytes)
+{
+    auto_file_ptr f(path.c_str(), "rb");
+
+    std::vector<std::string> tokens;
+    size_t begin = 0;          // of the ids of the sequence being read
+    size_t sequenceBytes = 0;  // of the text of the sequence being read
+    auto parseLine = [&](const char* line, size_t length)
+    {
+        tokens.clear();
+        for (size_t i = 0; i < length;)
+        {
+            while (i < length && isspace((unsigned char)line[i]))
+                i++;
+            size_t start = i;
+            while (i < length && !isspace((unsigned char)line[i]))
+                i++;
+            if (i > start)
+                tokens.push_back(std::string(line + start, i - start));
+        }
+        sequenceBytes += length + 1;
+
+        if (m_format == Format::sentencePerLine)
+        {
+            if (tokens.empty())
+            {
+                sequenceBytes = 0;
+                return;
+            }
+
+            if (!m_beginSequence.empty() && tokens.front() != m_beginSequence)
+                m_wordIds.push_back(GetId(m_words, m_fixedWords, m_unkWordId, m_beginSequence));
+            for (const auto& token : tokens)
+                m_wordIds.push_back(GetId(m_words, m_fixedWords, m_unkWordId, token));
+            if (!m_endSequence.empty() && tokens.back() != m_endSequence)
+                m_wordIds.push_back(GetId(m_words, m_fixedWords, m_unkWordId, m_endSequence));
+
+            // n words are n - 1 samples (each word with the next one as its label)
+            size_t numberOfSamples = m_wordIds.size() - begin;
+            if (numberOfSamples < 2 || !AddSequence(corpus, begin, numberOfSamples - 1, sequenceBytes, chunkSizeInBytes))
+                m_wordIds.resize(begin);
+            begin = m_wordIds.size();
+            sequenceBytes = 0;
+            return;
+        }
+
+        // wordPerLine: the word and its label, lines with fewer columns end the sentence if they are empty
+        if (tokens.size() >= 2)
+        {
+            m_wordIds.push_back(GetId(m_words, m_fixedWords, m_unkWordId, tokens.front()));
+            m_labelIds.push_back(GetId(m_labels, m_fixedLabels, m_unkLabelId, tokens.back()));
+        }
+        if (tokens.empty() || (tokens.size() >= 2 && tokens.front() == m_endSequence))
+        {
+            if (!AddSequence(corpus, begin, m_wordIds.size() - begin, sequenceBytes, chunkSizeInBytes))
+            {
+                m_wordIds.resize(begin);
+                m_labelIds.resize(begin);
+            }
+            begin = m_wordIds.size();
+            sequenceBytes = 0;
+        }
+    };
+
+    std::vector<char> buffer(1 << 20);
+    std::string line; // the part of a line at the end of the buffer
+    for (;;)
+    {
+        size_t bytesRead = fread(buffer.data(), 1, buffer.size(), f);
+        if (ferror(f))
+        {
+            RuntimeError("WordSequenceDeserializer: Could not read from the input file '%ls'.", path.c_str());
+        }
+        if (bytesRead == 0)
+        {
+            break;
+        }
+
+        const char* position = buffer.data();
+        const char* end = position + bytesRead;
+        for (;;)
+        {
+            const char* newLine = (const char*)memchr(position, '\n', end - position);
+            if (newLine == nullptr)
+            {
+                line.append(position, end);
+                break;
+            }
+
+            if (line.empty())
+            {
+                parseLine(position, newLine - position);
+            }
+            else
+            {
+                line.append(position, newLine);
+                parseLine(line.data(), line.size());
+                line.clear();
+            }
+            position = newLine + 1;
+        }
+    }
+
+    // the last line or sentence
+    if (!line.empty())
+    {
+        parseLine(line.data(), line.size());
+    }
+    if (m_format == Format::wordPerLine && begin < m_wordIds.size())
+    {
+        parseLine("", 0);
+    }
+
+    m_keyToSequence.ShrinkToFit();
+    m_wordIds.shrink_to_fit();
+    m_labelIds.shrink_to_fit();
+
+    if (m_sequences.empty())
+    {
+        RuntimeError("WordSequenceDeserializer: The input file '%ls' has no sequences.", path.c_str());
+    }
+}
+
+bool WordSequenceDeserializer::AddSequence(CorpusDescriptorPtr corpus, size_t wordBegin, size_t numberOfSamples, size_t numberOfBytes, size_t chunkSizeInBytes)
+{
+    // the key is the index of the sentence in the file
+    std::string key = std::to_string(m_offsets.size() + m_numSkipped);
+    if (numberOfSamples == 0 || !corpus->IsIncluded(key))
+    {
+        m_numSkipped++;
+        return false;
+    }
+
+    if (m_chunks.empty() || m_bytesInChunk >= chunkSizeInBytes)
+    {
+        if (m_chunks.size() >= CHUNKID_MAX)
+        {
+            RuntimeError("WordSequenceDeserializer: Maximum number of chunks exceeded.");
+        }
+        m_chunks.push_back(ChunkInfo{ m_sequences.size(), 0, 0 });
+        m_bytesInChunk = 0;
+    }
+
+    if (numberOfSamples > SEQUENCELEN_MAX)
+    {
+        RuntimeError("WordSequenceDeserializer: Sequence %s is too long.", key.c_str());
+    }
+
+    SequenceDescription description;
+    description.m_id = m_sequences.size();
+    description.m_numberOfSamples = (uint32_t)numberOfSamples;
+    description.m_chunkId = (ChunkIdType)(m_chunks.size() - 1);
+    description.m_key.m_sequence = corpus->GetStringRegistry()[key];
+    description.m_key.m_sample = 0;
+
+    m_keyToSequence.Add(description.m_key.m_sequence, description.m_chunkId, m_sequences.size());
+    m_sequences.push_back(description);
+    m_offsets.push_back(wordBegin);
+
+    auto& chunk = m_chunks.back();
+    chunk.m_numberOfSequences++;
+    chunk.m_numberOfSamples += numberOfSamples;
+    m_bytesInChunk += numberOfBytes;
+    return true;
+}
+
+ChunkDescriptions WordSequenceDeserializer::GetChunkDescriptions()
+{
+    ChunkDescriptions result;
+    result.reserve(m_chunks.size());
+    for (ChunkIdType i = 0; i < m_chunks.size(); ++i)
+    {
+        result.push_back(std::make_shared<ChunkDescription>(ChunkDescription{ i, m_chunks[i].m_numberOfSamples, m_chunks[i].m_numberOfSequences }));
+    }
+    return result;
+}
+
+void WordSequenceDeserializer::GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& result)
+{
+    const auto& chunk = m_chunks[chunkId];
+    result.insert(result.end(), m_sequences.begin() + chunk.m_firstSequence, m_sequences.begin() + chunk.m_firstSequence + chunk.m_numberOfSequences);
+}
+
+bool WordSequenceDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
+{
+    ChunkIdType chunkId;
+    size_t index;
+    if (key.m_sample != 0 || !m_keyToSequence.TryGet(key.m_sequence, chunkId, index))
+    {
+        return false;
+    }
+
+    result = m_sequences[index];
+    return true;
+}
+
+ChunkPtr WordSequenceDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    if (chunkId >= m_chunks.size())
+    {
+        LogicError("WordSequenceDeserializer: Chunk %u does not exist.", chunkId);
+    }
+    return std::make_shared<WordChunk>(*this, chunkId);
+}
+
+}}}
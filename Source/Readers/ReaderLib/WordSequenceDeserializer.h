@@ -0,0 +1,99 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "CorpusDescriptor.h"
+#include "SequenceKeyLocations.h"
+#include "StringToIdMap.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer of the word sequences of the text formats of LMSequenceReader and LUSequenceReader, so that
+// language modeling and understanding jobs can use the composite reader (prefetch, chunk randomization, distributed
+// reading) instead of the legacy readers, which parse the text on the training thread.
+//
+//   sentencePerLine (LMSequenceDeserializer): a sentence per line, its words separated by white space; the label of
+//       a word is the next word (labelType 'nextWord' of LMSequenceReader).
+//   wordPerLine (LUSequenceDeserializer): a word and its label per line (the first and the last column), sentences
+//       separated by empty lines or ended by the end of sentence word.
+//
+// The words are mapped to ids once, when the file is indexed, and only the ids are kept in memory (4 bytes per word
+// and label), so that loading a chunk takes no I/O. The ids come from the 'vocabulary' (and 'labelVocabulary')
+// files, one word per line, or are assigned in the order of appearance if no file is given. Words missing from
+// a vocabulary file are mapped to the 'unk' word. Both streams are sparse, with one non-zero value per sample.
+// The sequences are grouped into chunks of about 'chunkSizeInBytes' of text; the key of a sequence is its index.
+class WordSequenceDeserializer : public DataDeserializerBase
+{
+public:
+    enum class Format
+    {
+        sentencePerLine,
+        wordPerLine
+    };
+
+    WordSequenceDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, Format format);
+
+    virtual ChunkDescriptions GetChunkDescriptions() override;
+
+    virtual void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& result) override;
+
+    virtual bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result) override;
+
+    virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+private:
+    class WordChunk;
+
+    struct ChunkInfo
+    {
+        size_t m_firstSequence;
+        size_t m_numberOfSequences;
+        size_t m_numberOfSamples;
+    };
+
+    // Reads a vocabulary file; the id of a word is its line number.
+    static void LoadVocabulary(const std::wstring& path, StringToIdMap& vocabulary);
+
+    // Maps a word to its id, adding it if the vocabulary is built from the corpus.
+    IndexType GetId(StringToIdMap& vocabulary, bool isFixed, IndexType unkId, const std::string& word);
+
+    // Reads the file, mapping the words to ids, and groups the sequences into chunks.
+    void Index(CorpusDescriptorPtr corpus, const std::wstring& path, size_t chunkSizeInBytes);
+
+    // Adds the sequence whose ids begin at wordBegin; returns false if it is empty or not in the corpus.
+    bool AddSequence(CorpusDescriptorPtr corpus, size_t wordBegin, size_t numberOfSamples, size_t numberOfBytes, size_t chunkSizeInBytes);
+
+    Format m_format;
+    std::string m_beginSequence; // added to sentences that do not start with it (sentencePerLine)
+    std::string m_endSequence;   // added to sentences that do not end with it (sentencePerLine), ends a sentence (wordPerLine)
+
+    StringToIdMap m_words;
+    StringToIdMap m_labels;
+    bool m_fixedWords;           // read from a vocabulary file
+    bool m_fixedLabels;
+    IndexType m_unkWordId;       // or -1 if the vocabulary has no unk word
+    IndexType m_unkLabelId;
+
+    // The word ids of all sequences, one after another. In the sentencePerLine format a sentence of n words takes
+    // n ids, its inputs are the first n - 1 and its labels the last n - 1; otherwise the labels are in m_labelIds.
+    std::vector<IndexType> m_wordIds;
+    std::vector<IndexType> m_labelIds;
+    std::vector<size_t> m_offsets; // of the first word and label of each sequence
+
+    std::vector<SequenceDescription> m_sequences;
+    std::vector<ChunkInfo> m_chunks;
+    SequenceKeyLocations m_keyToSequence;
+    size_t m_bytesInChunk;       // of the chunk being indexed
+    size_t m_numSkipped;         // sentences not added (empty or not in the corpus), for the keys of the others
+
+    // The values of the one-hot samples (all ones), enough for the longest sequence.
+    std::vector<char> m_ones;
+    ElementType m_elementType;
+};
+
+}}}
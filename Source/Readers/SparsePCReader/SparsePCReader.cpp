@@ -33,6 +33,18 @@ DWORD LODWORD(size_t size)
 template <class ElemType>
 SparsePCReader<ElemType>::~SparsePCReader()
 {
+    // the read in the background uses the mapping and the buffers
+    if (m_pendingRead.valid())
+    {
+        try
+        {
+            m_pendingRead.get();
+        }
+        catch (...)
+        {
+        }
+    }
+
 #ifdef SPARSE_PCREADER_USE_WINDOWS_API
     if (m_filemap != NULL)
     {
@@ -49,27 +61,42 @@ SparsePCReader<ElemType>::~SparsePCReader()
     munmap(m_dataBuffer, m_filePositionMax); 
     close(m_hndl);
 #endif
-    for (int i = 0; i < m_featureCount; i++)
+    FreeBuffers();
+}
+
+template <class ElemType>
+void SparsePCReader<ElemType>::AllocateBuffers()
+{
+    for (auto& buffer : m_buffers)
     {
-        if (m_values[i] != NULL)
+        for (int i = 0; i < m_featureCount; i++)
         {
-            free(m_values[i]);
+            buffer.m_values[i] = (ElemType*) malloc(sizeof(ElemType) * m_dims[i] * m_miniBatchSize / m_sparsenessFactor);
+            buffer.m_rowIndices[i] = (int32_t*) malloc(sizeof(int32_t) * m_dims[i] * m_miniBatchSize / m_sparsenessFactor);
+            buffer.m_colIndices[i] = (int32_t*) malloc(sizeof(int32_t) * (m_miniBatchSize + 1));
         }
+        buffer.m_labelsBuffer = (ElemType*) malloc(sizeof(ElemType) * m_miniBatchSize);
+        buffer.m_numSamples = 0;
+    }
+}
 
-        if (m_rowIndices[i] != NULL)
+template <class ElemType>
+void SparsePCReader<ElemType>::FreeBuffers()
+{
+    for (auto& buffer : m_buffers)
+    {
+        for (int i = 0; i < buffer.m_values.size(); i++)
         {
-            free(m_rowIndices[i]);
+            free(buffer.m_values[i]);
+            free(buffer.m_rowIndices[i]);
+            free(buffer.m_colIndices[i]);
+            buffer.m_values[i] = NULL;
+            buffer.m_rowIndices[i] = NULL;
+            buffer.m_colIndices[i] = NULL;
         }
 
-        if (m_colIndices[i] != NULL)
-        {
-            free(m_colIndices[i]);
-        }
-    }
-
-    if (m_labelsBuffer != NULL)
-    {
-        free(m_labelsBuffer);
+        free(buffer.m_labelsBuffer);
+        buffer.m_labelsBuffer = NULL;
     }
 }
 
@@ -119,9 +146,15 @@ void SparsePCReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConf
 
     m_featureNames = std::vector<std::wstring>(m_featureCount);
     m_dims = std::vector<size_t>(m_featureCount);
-    m_values = std::vector<ElemType*>(m_featureCount);
-    m_rowIndices = std::vector<int32_t*>(m_featureCount);
-    m_colIndices = std::vector<int32_t*>(m_featureCount);
+    for (auto& buffer : m_buffers)
+    {
+        buffer.m_values = std::vector<ElemType*>(m_featureCount);
+        buffer.m_rowIndices = std::vector<int32_t*>(m_featureCount);
+        buffer.m_colIndices = std::vector<int32_t*>(m_featureCount);
+        buffer.m_nnz = std::vector<int32_t>(m_featureCount);
+        buffer.m_labelsBuffer = NULL;
+        buffer.m_numSamples = 0;
+    }
 
     for (int i = 0; i < m_featureCount; i++)
     {
@@ -166,6 +199,8 @@ void SparsePCReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConf
         m_dataBuffer = nullptr;
         RuntimeError("Could not memory map file %ls", m_file.c_str());
     }
+    // the file is read front to back, so the pages can be read ahead aggressively and dropped once read
+    madvise(m_dataBuffer, m_filePositionMax, MADV_SEQUENTIAL);
 
 #endif
 }
@@ -177,61 +212,47 @@ void SparsePCReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConf
 template <class ElemType>
 void SparsePCReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t /*epoch*/, size_t /*requestedEpochSamples*/)
 {
-    if (m_values[0] == NULL || m_miniBatchSize != mbSize)
+    // wait for the read ahead of the previous loop, it uses the buffers
+    if (m_pendingRead.valid())
     {
-        m_miniBatchSize = mbSize;
-
-        for (int i = 0; i < m_featureCount; i++)
-        {
-            if (m_values[i] != NULL)
-            {
-                free(m_values[i]);
-                free(m_colIndices[i]);
-                free(m_rowIndices[i]);
-                free(m_labelsBuffer);
-            }
+        m_pendingRead.get();
+    }
 
-            m_values[i] = (ElemType*) malloc(sizeof(ElemType) * m_dims[i] * m_miniBatchSize / m_sparsenessFactor);
-            m_rowIndices[i] = (int32_t*) malloc(sizeof(int32_t) * m_dims[i] * m_miniBatchSize / m_sparsenessFactor);
-            m_colIndices[i] = (int32_t*) malloc(sizeof(int32_t) * (m_miniBatchSize + 1));
-            m_labelsBuffer = (ElemType*) malloc(sizeof(ElemType) * m_miniBatchSize);
-        }
+    if (m_buffers[0].m_labelsBuffer == NULL || m_miniBatchSize != mbSize)
+    {
+        FreeBuffers();
+        m_miniBatchSize = mbSize;
+        AllocateBuffers();
     }
 
     // reset the next read sample
     m_currOffset = 0;
+    m_currentBuffer = 0;
+    ReadAhead();
 }
 
-// GetMinibatch - Get the next minibatch (features and labels)
-// matrices - [in] a map with named matrix types (i.e. 'features', 'labels') mapped to the corresponding matrix,
-//             [out] each matrix resized if necessary containing data.
-// returns - true if there are more minibatches, false if no more minibatchs remain
 template <class ElemType>
-bool SparsePCReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
+void SparsePCReader<ElemType>::ReadAhead()
 {
-    // get out if they didn't call StartMinibatchLoop() first
-    if (m_miniBatchSize == 0)
-        return false;
+    MinibatchBuffer& buffer = m_buffers[m_currentBuffer];
+    m_pendingRead = std::async(std::launch::async, [this, &buffer]()
+    {
+        ReadMinibatch(buffer);
+    });
+}
+
+template <class ElemType>
+void SparsePCReader<ElemType>::ReadMinibatch(MinibatchBuffer& buffer)
+{
+    buffer.m_numSamples = 0;
 
     // Return early (for debugging purposes)
     if (m_maxReadData > 0 && m_currOffset >= m_maxReadData)
-        return false;
-
-    if (m_currOffset >= m_filePositionMax)
-        return false;
-
-    Matrix<ElemType>* labels = nullptr; // labels to return, or NULL if no labels in matrix set
-    if (matrices.HasInput(m_labelName))
-    {
-        labels = &matrices.GetInputMatrix<ElemType>(m_labelName);
-        if (labels->GetNumRows() != 1)
-            RuntimeError("SparsePCReader only supports single label value per column but the network expected %d.", (int) labels->GetNumRows());
-    }
+        return;
 
-    std::vector<int32_t> currIndex = std::vector<int32_t>(m_featureCount);
     for (int i = 0; i < m_featureCount; i++)
     {
-        currIndex[i] = 0;
+        buffer.m_nnz[i] = 0;
     }
 
     size_t j = 0;
@@ -240,7 +261,8 @@ bool SparsePCReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
     {
         for (int i = 0; i < m_featureCount; i++)
         {
-            m_colIndices[i][j] = currIndex[i];
+            int32_t& currIndex = buffer.m_nnz[i];
+            buffer.m_colIndices[i][j] = currIndex;
 
             int32_t nnz = *(int32_t*) ((char*) m_dataBuffer + m_currOffset);
             m_currOffset += sizeof(int32_t);
@@ -250,17 +272,17 @@ bool SparsePCReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
                 RuntimeError("Input data is too dense - not enough memory allocated");
             }
 
-            memcpy(m_values[i] + currIndex[i], (char*) m_dataBuffer + m_currOffset, sizeof(ElemType) * nnz);
+            memcpy(buffer.m_values[i] + currIndex, (char*) m_dataBuffer + m_currOffset, sizeof(ElemType) * nnz);
             m_currOffset += (sizeof(ElemType) * nnz);
 
-            memcpy(m_rowIndices[i] + currIndex[i], (char*) m_dataBuffer + m_currOffset, sizeof(int32_t) * nnz);
+            memcpy(buffer.m_rowIndices[i] + currIndex, (char*) m_dataBuffer + m_currOffset, sizeof(int32_t) * nnz);
             m_currOffset += (sizeof(int32_t) * nnz);
 
-            currIndex[i] += nnz;
+            currIndex += nnz;
         }
 
         ElemType label = *(ElemType*) ((char*) m_dataBuffer + m_currOffset);
-        m_labelsBuffer[j] = label;
+        buffer.m_labelsBuffer[j] = label;
         m_currOffset += sizeof(ElemType);
 
         if (m_verificationCode != 0)
@@ -270,7 +292,6 @@ bool SparsePCReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
             if (verifCode != m_verificationCode)
             {
                 RuntimeError("Verification code did not match (expected %d) - error in reading data", m_verificationCode);
-                return false;
             }
 
             m_currOffset += sizeof(int32_t);
@@ -279,13 +300,48 @@ bool SparsePCReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
 
     for (int i = 0; i < m_featureCount; i++)
     {
-        m_colIndices[i][j] = currIndex[i];
+        buffer.m_colIndices[i][j] = buffer.m_nnz[i];
+    }
+    buffer.m_numSamples = j;
+}
+
+// GetMinibatch - Get the next minibatch (features and labels)
+// matrices - [in] a map with named matrix types (i.e. 'features', 'labels') mapped to the corresponding matrix,
+//             [out] each matrix resized if necessary containing data.
+// returns - true if there are more minibatches, false if no more minibatchs remain
+template <class ElemType>
+bool SparsePCReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
+{
+    // get out if they didn't call StartMinibatchLoop() first
+    if (m_miniBatchSize == 0 || !m_pendingRead.valid())
+        return false;
+
+    Matrix<ElemType>* labels = nullptr; // labels to return, or NULL if no labels in matrix set
+    if (matrices.HasInput(m_labelName))
+    {
+        labels = &matrices.GetInputMatrix<ElemType>(m_labelName);
+        if (labels->GetNumRows() != 1)
+            RuntimeError("SparsePCReader only supports single label value per column but the network expected %d.", (int) labels->GetNumRows());
+    }
+
+    m_pendingRead.get();
+    MinibatchBuffer& buffer = m_buffers[m_currentBuffer];
+    size_t j = buffer.m_numSamples;
+    if (j == 0)
+        return false;
+
+    // the next minibatch is read into the other buffer while this one is set to the matrices
+    m_currentBuffer = 1 - m_currentBuffer;
+    ReadAhead();
+
+    for (int i = 0; i < m_featureCount; i++)
+    {
         Matrix<ElemType>& features = matrices.GetInputMatrix<ElemType>(m_featureNames[i]);
 
         if (features.GetFormat() != MatrixFormat::matrixFormatSparseCSC)
             features.SwitchToMatrixType(MatrixType::SPARSE, MatrixFormat::matrixFormatSparseCSC, false);
 
-        features.SetMatrixFromCSCFormat(m_colIndices[i], m_rowIndices[i], m_values[i], currIndex[i], m_dims[i], j);
+        features.SetMatrixFromCSCFormat(buffer.m_colIndices[i], buffer.m_rowIndices[i], buffer.m_values[i], buffer.m_nnz[i], m_dims[i], j);
     }
 
     if (m_returnDense || m_doGradientCheck)
@@ -298,7 +354,7 @@ bool SparsePCReader<ElemType>::TryGetMinibatch(StreamMinibatchInputs& matrices)
     {
         labels->Resize(1, j);
         labels->SetValue((ElemType) 0);
-        labels->SetValue(1, j, labels->GetDeviceId(), m_labelsBuffer, 0);
+        labels->SetValue(1, j, labels->GetDeviceId(), buffer.m_labelsBuffer, 0);
     }
 
     // create the MBLayout
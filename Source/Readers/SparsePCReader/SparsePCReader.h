@@ -12,6 +12,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <future>
 
 // Windows or Posix? Originally the reader was done only for Windows. Keep it this way for now when running on Windows.
 #ifdef __WINDOWS__
@@ -36,12 +37,25 @@ class SparsePCReader : public DataReaderBase
     bool m_returnDense;
     size_t m_sparsenessFactor;
     int32_t m_verificationCode;
-    std::vector<ElemType*> m_values;
-    std::vector<int32_t*> m_rowIndices;
-    std::vector<int32_t*> m_colIndices;
-    ElemType* m_labelsBuffer;
     MBLayoutPtr m_pMBLayout;
 
+    // A minibatch gathered from the mapped file, in the CSC format of the features.
+    struct MinibatchBuffer
+    {
+        std::vector<ElemType*> m_values;
+        std::vector<int32_t*> m_rowIndices;
+        std::vector<int32_t*> m_colIndices;
+        std::vector<int32_t> m_nnz;
+        ElemType* m_labelsBuffer;
+        size_t m_numSamples;
+    };
+
+    // The minibatches are double buffered: while the matrices are set from one buffer, the next minibatch is read
+    // into the other one in the background, so that the reading overlaps with the computation of the minibatch.
+    MinibatchBuffer m_buffers[2];
+    size_t m_currentBuffer;      // the buffer being read in the background
+    std::future<void> m_pendingRead;
+
 #ifdef SPARSE_PCREADER_USE_WINDOWS_API
     HANDLE m_hndl;
     HANDLE m_filemap;
@@ -57,10 +71,22 @@ class SparsePCReader : public DataReaderBase
     std::map<LabelIdType, LabelType> m_mapIdToLabel;
     std::map<LabelType, LabelIdType> m_mapLabelToId;
 
+    void AllocateBuffers();
+    void FreeBuffers();
+    // Reads the next minibatch from the file into the buffer (on the background thread).
+    void ReadMinibatch(MinibatchBuffer& buffer);
+    // Starts reading the next minibatch into the current buffer, after the previous read has completed.
+    void ReadAhead();
+
 public:
     SparsePCReader()
-        : m_pMBLayout(make_shared<MBLayout>())
+        : m_pMBLayout(make_shared<MBLayout>()), m_currentBuffer(0)
     {
+        for (auto& buffer : m_buffers)
+        {
+            buffer.m_labelsBuffer = NULL;
+            buffer.m_numSamples = 0;
+        }
         m_pMBLayout->SetUniqueAxisName(L"SparsePCReader");
     };
     virtual ~SparsePCReader();
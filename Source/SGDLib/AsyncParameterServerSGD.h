@@ -0,0 +1,241 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "MASGD.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <chrono>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// AsyncParameterServerSGD -- asynchronous SGD with parameter servers sharded over the workers
+//
+// The learnable parameters, flattened into one vector, are cut into one contiguous shard per worker, and each
+// worker holds the global value of its shard in an MPI window. Every blockSizePerWorker samples, a worker
+//  - pushes the change of its local model since its last pull into all shards (MPI_Accumulate with MPI_SUM),
+//  - advances its clock, and waits until no worker is more than maxStaleness clocks behind it,
+//  - pulls all shards into its local model.
+// There is no barrier between the workers within an epoch, so that a worker only waits for stragglers that are
+// more than maxStaleness syncs behind (maxStaleness = 0 waits for all, like a barrier would).
+// At the end of an epoch all changes are pushed and pulled, so that all workers leave it with the same model.
+// The momentum (smoothed gradient) of each worker stays local.
+// -----------------------------------------------------------------------
+
+template <typename ElemType>
+class AsyncParameterServerSGD : public IMASGD<ElemType>
+{
+    typedef IMASGD<ElemType> Base;
+    using Base::m_pMPI;
+    using Base::m_numWorkers;
+    using Base::m_myRank;
+    using Base::m_numSyncPerformed;
+    using Base::m_perfReporter;
+    using Base::DownCast;
+
+public:
+    AsyncParameterServerSGD(const MPIWrapperPtr& pMPI, size_t reportFreq, DEVICEID_TYPE devID, size_t maxStaleness)
+        : Base(pMPI, reportFreq, devID), m_maxStaleness(maxStaleness), m_clock(0), m_clocks(pMPI->NumNodesInUse(), 0),
+          m_globalClocks(pMPI->IsMainNode() ? pMPI->NumNodesInUse() : 0, 0),
+          m_parameterWindow(MPI_WIN_NULL), m_clockWindow(MPI_WIN_NULL)
+    {
+        fprintf(stderr, "Parallel training (%d workers) using asynchronous parameter servers with a staleness of up to %d syncs\n",
+                (int) m_pMPI->NumNodesInUse(), (int) m_maxStaleness);
+    }
+
+    ~AsyncParameterServerSGD()
+    {
+        // (all workers destroy their SGD object at the end of training, so that the collective calls match)
+        if (m_parameterWindow != MPI_WIN_NULL)
+        {
+            m_pMPI->FreeWindow(m_parameterWindow);
+            m_pMPI->FreeWindow(m_clockWindow);
+        }
+    }
+
+    void OnEpochStart(const std::list<ComputationNodeBasePtr>& learnableNodes) override
+    {
+        if (m_parameterWindow == MPI_WIN_NULL)
+            CreateParameterServers(learnableNodes);
+
+        // all workers have passed the end of the previous epoch, so the clocks can restart
+        m_clock = 0;
+        m_pMPI->AccumulateToWindow(&m_clock, 1, m_pMPI->MainNodeRank(), m_myRank, MPI_REPLACE, m_clockWindow);
+        m_pMPI->WaitAll();
+        m_perfReporter.OnEpochStart();
+    }
+
+    void OnEpochEnd(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                    std::list<Matrix<ElemType>>& /*smoothedGradient*/,
+                    size_t samplesSinceLastSync) override
+    {
+        Timer commTimer;
+        commTimer.Start();
+        Push(learnableNodes);
+        // nobody must wait for a worker that has finished the epoch
+        int finished = std::numeric_limits<int>::max();
+        m_pMPI->AccumulateToWindow(&finished, 1, m_pMPI->MainNodeRank(), m_myRank, MPI_REPLACE, m_clockWindow);
+        m_pMPI->WaitAll(); // all pushes have completed
+        Pull(learnableNodes);
+        m_pMPI->WaitAll(); // no push of the next epoch can reach a worker that is still pulling
+        commTimer.Stop();
+
+        m_numSyncPerformed++;
+        m_perfReporter.OnMAPerformed(samplesSinceLastSync, samplesSinceLastSync * m_numWorkers, (float) commTimer.ElapsedSeconds());
+        m_perfReporter.OnEpochEnd();
+    }
+
+    // always syncs, so that the caller restarts counting the samples
+    bool OnArrivingAtSyncPoint(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                               std::list<Matrix<ElemType>>& smoothedGradient,
+                               size_t samplesSinceLastSync) override
+    {
+        size_t totalSamplesProcessed = 0;
+        float secondsOnCommunication = 0.0f;
+        m_numSyncPerformed++;
+        ModelAggregationProcessing(samplesSinceLastSync, learnableNodes, smoothedGradient, totalSamplesProcessed, secondsOnCommunication);
+        m_perfReporter.OnMAPerformed(samplesSinceLastSync, totalSamplesProcessed, secondsOnCommunication);
+        return true;
+    }
+
+    void ModelAggregationProcessing(size_t samplesSinceLastSync,                         /* in */
+                                    const std::list<ComputationNodeBasePtr>& learnableNodes, /* in/out */
+                                    std::list<Matrix<ElemType>>& /*smoothedGradient*/,   /* in/out */
+                                    size_t& totalSamplesProcessed,                       /* out */
+                                    float& secondsOnCommunication                        /* out */) override
+    {
+        Timer commTimer;
+        commTimer.Start();
+        Push(learnableNodes);
+        m_clock++;
+        m_pMPI->AccumulateToWindow(&m_clock, 1, m_pMPI->MainNodeRank(), m_myRank, MPI_REPLACE, m_clockWindow);
+        commTimer.Stop();
+        secondsOnCommunication = (float) commTimer.ElapsedSeconds();
+
+        Timer waitTimer;
+        waitTimer.Start();
+        bool waited = false;
+        while (m_clock - MinimumClock() > (int) m_maxStaleness)
+        {
+            waited = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        waitTimer.Stop();
+        m_perfReporter.OnArriveAtSyncPoint(waitTimer.ElapsedSeconds(), waited);
+
+        commTimer.Restart();
+        Pull(learnableNodes);
+        commTimer.Stop();
+        secondsOnCommunication += (float) commTimer.ElapsedSeconds();
+
+        // the other workers' share is an estimate, since they sync at their own pace
+        totalSamplesProcessed = samplesSinceLastSync * m_numWorkers;
+    }
+
+private:
+    // the shards are cut by element count; the rank of the worker that holds element i is the r with ShardBegin(r) <= i < ShardBegin(r + 1)
+    size_t ShardBegin(size_t rank) const
+    {
+        return m_localModel.size() * rank / m_numWorkers;
+    }
+
+    // collective; each worker seeds its shard with its own model, which is pulled by all, so that they start from the same model
+    void CreateParameterServers(const std::list<ComputationNodeBasePtr>& learnableNodes)
+    {
+        size_t numElements = 0;
+        for (auto& pBaseNode : learnableNodes)
+        {
+            if (pBaseNode->IsParameterUpdateRequired())
+                numElements += DownCast(pBaseNode)->Value().GetNumElements();
+        }
+        m_localModel.resize(numElements);
+        m_lastPulledModel.resize(numElements);
+        GetLocalModel(learnableNodes);
+
+        m_shard.assign(m_localModel.begin() + ShardBegin(m_myRank), m_localModel.begin() + ShardBegin(m_myRank + 1));
+        m_parameterWindow = m_pMPI->CreateWindow(m_shard.data(), m_shard.size());
+        m_clockWindow = m_pMPI->CreateWindow(m_globalClocks.data(), m_globalClocks.size());
+        m_pMPI->WaitAll();
+        Pull(learnableNodes);
+    }
+
+    void GetLocalModel(const std::list<ComputationNodeBasePtr>& learnableNodes)
+    {
+        size_t offset = 0;
+        for (auto& pBaseNode : learnableNodes)
+        {
+            if (!pBaseNode->IsParameterUpdateRequired())
+                continue;
+            const auto& value = DownCast(pBaseNode)->Value();
+            value.CopySection(value.GetNumRows(), value.GetNumCols(), m_localModel.data() + offset, value.GetNumRows());
+            offset += value.GetNumElements();
+        }
+    }
+
+    void SetLocalModel(const std::list<ComputationNodeBasePtr>& learnableNodes)
+    {
+        size_t offset = 0;
+        for (auto& pBaseNode : learnableNodes)
+        {
+            if (!pBaseNode->IsParameterUpdateRequired())
+                continue;
+            auto& value = DownCast(pBaseNode)->Value();
+            value.SetValue(value.GetNumRows(), value.GetNumCols(), value.GetDeviceId(), m_localModel.data() + offset);
+            offset += value.GetNumElements();
+        }
+    }
+
+    // add the local change since the last pull to the global model; starts with the own shard so that the
+    // workers do not all lock the same one at the same time
+    void Push(const std::list<ComputationNodeBasePtr>& learnableNodes)
+    {
+        GetLocalModel(learnableNodes);
+        for (size_t i = 0; i < m_localModel.size(); i++)
+            m_localModel[i] -= m_lastPulledModel[i];
+        for (size_t k = 0; k < m_numWorkers; k++)
+        {
+            size_t rank = (m_myRank + k) % m_numWorkers;
+            size_t begin = ShardBegin(rank);
+            size_t end = ShardBegin(rank + 1);
+            if (end > begin)
+                m_pMPI->AccumulateToWindow(m_localModel.data() + begin, end - begin, rank, 0, MPI_SUM, m_parameterWindow);
+        }
+    }
+
+    void Pull(const std::list<ComputationNodeBasePtr>& learnableNodes)
+    {
+        for (size_t k = 0; k < m_numWorkers; k++)
+        {
+            size_t rank = (m_myRank + k) % m_numWorkers;
+            size_t begin = ShardBegin(rank);
+            size_t end = ShardBegin(rank + 1);
+            if (end > begin)
+                m_pMPI->GetFromWindow(m_lastPulledModel.data() + begin, end - begin, rank, 0, m_parameterWindow);
+        }
+        m_localModel = m_lastPulledModel;
+        SetLocalModel(learnableNodes);
+    }
+
+    int MinimumClock()
+    {
+        m_pMPI->GetFromWindow(m_clocks.data(), m_clocks.size(), m_pMPI->MainNodeRank(), 0, m_clockWindow);
+        return *std::min_element(m_clocks.begin(), m_clocks.end());
+    }
+
+    size_t m_maxStaleness;
+    int m_clock;                           // number of syncs of this worker in the current epoch
+    std::vector<int> m_clocks;             // the clocks of all workers as last read
+    std::vector<int> m_globalClocks;       // the clocks of all workers, held by the main node
+    std::vector<ElemType> m_localModel;    // flattened local model, and the change to push
+    std::vector<ElemType> m_lastPulledModel;
+    std::vector<ElemType> m_shard;         // the global model of the shard held by this worker
+    MPI_Win m_parameterWindow;
+    MPI_Win m_clockWindow;
+};
+
+}}}
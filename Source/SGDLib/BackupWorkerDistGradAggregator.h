@@ -0,0 +1,282 @@
+#pragma once
+
+#include "IDistGradAggregator.h"
+#include "TimerUtility.h"
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Synchronous gradient aggregation that tolerates stragglers by not waiting for the last numBackupWorkers workers.
+// Every worker sends its header and gradients to the main node, which sums those of the first N - numBackupWorkers
+// workers to arrive (always including its own), and sends the sum back to all workers, late ones included, so that
+// all workers apply the same update. A late gradient arrives while the main node is already at a later minibatch;
+// it is then either discarded, or added to that minibatch's sum with its samples (deferLateGradients).
+// The aggregated header only counts the samples of the gradients in the sum.
+// Collectives cannot leave out a worker, so this uses point-to-point messages; the main node posts one receive per
+// worker ahead of time and takes whichever complete first (MPI_Waitany). The main node itself is never skipped.
+template <class ElemType>
+class BackupWorkerDistGradAggregator : public IDistGradAggregator<ElemType>
+{
+    UsingIDistGradAggregatorMembers;
+
+    // number of minibatches a worker may fall behind; beyond that, the main node waits for it. This bounds the
+    // staleness of deferred gradients and the number of sums the main node is still sending to late workers.
+    static const size_t MaxLag = 4;
+    // minibatches are told apart by the message tag, which only needs to be unique within the lag bounded above
+    static const int TagRange = 32768;
+
+public:
+    BackupWorkerDistGradAggregator(const MPIWrapperPtr& mpi, size_t numBackupWorkers, bool deferLateGradients, int syncStatsTrace)
+        : IDistGradAggregator<ElemType>(mpi), m_numBackupWorkers(numBackupWorkers), m_deferLateGradients(deferLateGradients),
+          m_syncStatsTrace(syncStatsTrace), m_iterationCount(0), m_numElements(0), m_headerElements(0), m_numLateGradients(0)
+    {
+        if (numBackupWorkers >= NumProc())
+            InvalidArgument("BackupWorkerDistGradAggregator: numBackupWorkers must be less than the number of workers.");
+    }
+
+    ~BackupWorkerDistGradAggregator()
+    {
+        if (!m_mpi->IsMainNode() || m_recvRequests.empty())
+            return;
+
+        // every worker has sent one gradient per minibatch; receive those still underway, then cancel the receives posted for the next
+        for (size_t j = 0; j < NumProc(); j++)
+        {
+            while (m_recvRequests[j] != MPI_REQUEST_NULL)
+            {
+                if (m_numReceived[j] < m_iterationCount)
+                {
+                    MPI_Wait(&m_recvRequests[j], MPI_STATUS_IGNORE) || MpiFail("MPI_Wait");
+                    m_numReceived[j]++;
+                    if (m_numReceived[j] < m_iterationCount)
+                        PostReceive(j);
+                }
+                else
+                {
+                    MPI_Cancel(&m_recvRequests[j]) || MpiFail("MPI_Cancel");
+                    MPI_Wait(&m_recvRequests[j], MPI_STATUS_IGNORE) || MpiFail("MPI_Wait");
+                }
+            }
+        }
+        while (!m_resultsInFlight.empty())
+            CompleteOldestResult();
+    }
+
+    // Aggregate the gradient matrices across the first workers to arrive
+    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int /*epochNumber*/) override
+    {
+        Initialize(gradients, headerCPU);
+        bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        int tag = (int) (m_iterationCount % TagRange);
+
+        Timer aggregationTimer;
+        if (showSyncPerfStats)
+            aggregationTimer.Start();
+
+        size_t numGradMatrices = gradients.size();
+        if (headerCPU->numSamples == 0)
+        {
+            headerCPU->criterion = 0.0;
+            for (int i = 0; i < headerCPU->numEvalNode; ++i)
+                headerCPU->evalErrors[i] = { 0.0, 0 };
+
+            // If the current node did not process any samples, the gradients should be zero'd
+            for (size_t i = 0; i < numGradMatrices; ++i)
+                gradients[i]->SetValue(0);
+        }
+
+        // pack the header and the gradients into one message
+        memcpy(m_buffer.data(), headerCPU, headerCPU->Size());
+        for (size_t i = 0; i < numGradMatrices; ++i)
+            gradients[i]->CopySection(gradients[i]->GetNumRows(), gradients[i]->GetNumCols(), m_buffer.data() + m_headerElements + m_offsets[i], gradients[i]->GetNumRows());
+
+        const std::vector<ElemType>* result = &m_buffer;
+        size_t numOnTime = 1;
+        size_t numLate = 0;
+        if (m_mpi->IsMainNode())
+        {
+            // sum up in m_buffer what arrived since the last minibatch, then wait for the rest of the first N - numBackupWorkers
+            while (ReceiveGradient(tag, /*wait=*/false, numOnTime, numLate))
+                ;
+            while (numOnTime + m_numBackupWorkers < NumProc())
+                ReceiveGradient(tag, /*wait=*/true, numOnTime, numLate);
+            for (size_t j = 0; j < NumProc(); j++)
+            {
+                while (j != MyRank() && m_numReceived[j] + MaxLag < m_iterationCount)
+                    ReceiveGradient(tag, /*wait=*/true, numOnTime, numLate, j);
+            }
+
+            if (m_resultsInFlight.size() > MaxLag)
+                CompleteOldestResult();
+            std::unique_ptr<ResultInFlight> sent(new ResultInFlight());
+            if (!m_freeResultBuffers.empty())
+            {
+                sent->m_buffer.swap(m_freeResultBuffers.back());
+                m_freeResultBuffers.pop_back();
+            }
+            sent->m_buffer = m_buffer;
+            sent->m_requests.resize(NumProc(), MPI_REQUEST_NULL);
+            for (size_t j = 0; j < NumProc(); j++)
+            {
+                if (j != MyRank())
+                    MPI_Isend(sent->m_buffer.data(), (int) sent->m_buffer.size(), MPIWrapper::GetDataType(sent->m_buffer.data()), (int) j, tag, m_mpi->Communicator(), &sent->m_requests[j]) || MpiFail("MPI_Isend");
+            }
+            result = &sent->m_buffer;
+            m_resultsInFlight.push_back(std::move(sent));
+        }
+        else
+        {
+            MPI_Send(m_buffer.data(), (int) m_buffer.size(), MPIWrapper::GetDataType(m_buffer.data()), (int) m_mpi->MainNodeRank(), tag, m_mpi->Communicator()) || MpiFail("MPI_Send");
+            MPI_Recv(m_buffer.data(), (int) m_buffer.size(), MPIWrapper::GetDataType(m_buffer.data()), (int) m_mpi->MainNodeRank(), tag, m_mpi->Communicator(), MPI_STATUS_IGNORE) || MpiFail("MPI_Recv");
+        }
+        m_iterationCount++;
+
+        // unpack
+        headerCPU->Aggregate((DistGradHeader*) result->data());
+        for (size_t i = 0; i < numGradMatrices; ++i)
+            gradients[i]->SetValue(gradients[i]->GetNumRows(), gradients[i]->GetNumCols(), gradients[i]->GetDeviceId(), const_cast<ElemType*>(result->data()) + m_headerElements + m_offsets[i]);
+
+        if (showSyncPerfStats)
+        {
+            aggregationTimer.Stop();
+            double epochTime = aggregationTimer.ElapsedSeconds();
+            if (m_mpi->IsMainNode())
+                fprintf(stderr, "Actual gradient aggregation time: %.6g, %d of %d workers on time, %d late gradients %s (%d in total)\n",
+                        epochTime, (int) numOnTime, (int) NumProc(), (int) numLate, m_deferLateGradients ? "deferred" : "discarded", (int) m_numLateGradients);
+            else
+                fprintf(stderr, "Actual gradient aggregation time: %.6g\n", epochTime);
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+private:
+    // the sum sent by the main node for one minibatch, kept until all workers have received it
+    struct ResultInFlight
+    {
+        std::vector<ElemType> m_buffer;
+        std::vector<MPI_Request> m_requests;
+    };
+
+    void Initialize(const std::vector<Matrix<ElemType>*>& gradients, const DistGradHeader* headerCPU)
+    {
+        if (!m_buffer.empty())
+            return;
+
+        for (size_t i = 0; i < gradients.size(); i++)
+        {
+            // Make sure none of the gradient matrixes are sparse - we currently do not support aggregation of sparse gradient matrices
+            if (gradients[i]->GetMatrixType() != DENSE)
+                RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
+            m_offsets.push_back(m_numElements);
+            m_numElements += gradients[i]->GetNumElements();
+        }
+        m_headerElements = (headerCPU->Size() + sizeof(ElemType) - 1) / sizeof(ElemType);
+        if (m_headerElements + m_numElements > INT_MAX)
+            RuntimeError("BackupWorkerDistGradAggregator: the model has too many parameters for a single message.");
+        m_buffer.resize(m_headerElements + m_numElements);
+
+        if (m_mpi->IsMainNode())
+        {
+            m_recvBuffers.resize(NumProc());
+            m_recvRequests.resize(NumProc(), MPI_REQUEST_NULL);
+            m_numReceived.resize(NumProc(), 0);
+            for (size_t j = 0; j < NumProc(); j++)
+            {
+                if (j == MyRank())
+                    continue;
+                m_recvBuffers[j].resize(m_buffer.size());
+                PostReceive(j);
+            }
+        }
+    }
+
+    void PostReceive(size_t rank)
+    {
+        MPI_Irecv(m_recvBuffers[rank].data(), (int) m_recvBuffers[rank].size(), MPIWrapper::GetDataType(m_recvBuffers[rank].data()), (int) rank, MPI_ANY_TAG, m_mpi->Communicator(), &m_recvRequests[rank]) || MpiFail("MPI_Irecv");
+    }
+
+    // Takes a gradient that has arrived at the main node (from the given worker, or any if rank is SIZE_MAX), adds it to
+    // m_buffer if it is on time or deferred, and posts the next receive for its worker.
+    // Returns false if none has arrived and wait is false.
+    bool ReceiveGradient(int tag, bool wait, size_t& numOnTime, size_t& numLate, size_t rank = SIZE_MAX)
+    {
+        int index = (int) rank;
+        MPI_Status status;
+        if (rank != SIZE_MAX)
+        {
+            MPI_Wait(&m_recvRequests[rank], &status) || MpiFail("MPI_Wait");
+        }
+        else if (wait)
+        {
+            MPI_Waitany((int) m_recvRequests.size(), m_recvRequests.data(), &index, &status) || MpiFail("MPI_Waitany");
+        }
+        else
+        {
+            int flag;
+            MPI_Testany((int) m_recvRequests.size(), m_recvRequests.data(), &index, &flag, &status) || MpiFail("MPI_Testany");
+            if (!flag)
+                return false;
+        }
+        if (index == MPI_UNDEFINED)
+            LogicError("BackupWorkerDistGradAggregator: no receive is posted.");
+
+        m_numReceived[index]++;
+        bool onTime = (status.MPI_TAG == tag);
+        if (!onTime)
+        {
+            numLate++;
+            m_numLateGradients++;
+        }
+        if (onTime || m_deferLateGradients)
+        {
+            const std::vector<ElemType>& received = m_recvBuffers[index];
+            ((DistGradHeader*) m_buffer.data())->Aggregate((DistGradHeader*) received.data(), true);
+            ElemType* sum = m_buffer.data() + m_headerElements;
+            const ElemType* gradient = received.data() + m_headerElements;
+#pragma omp parallel for
+            for (long long k = 0; k < (long long) m_numElements; k++)
+                sum[k] += gradient[k];
+            if (onTime)
+                numOnTime++;
+        }
+        PostReceive(index);
+        return true;
+    }
+
+    void CompleteOldestResult()
+    {
+        auto& oldest = m_resultsInFlight.front();
+        MPI_Waitall((int) oldest->m_requests.size(), oldest->m_requests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
+        m_freeResultBuffers.push_back(std::move(oldest->m_buffer));
+        m_resultsInFlight.pop_front();
+    }
+
+private:
+    size_t m_numBackupWorkers;
+    bool m_deferLateGradients;
+    int m_syncStatsTrace;
+
+    // number of minibatches aggregated so far, which all workers agree on
+    size_t m_iterationCount;
+
+    // a message is the header, padded to whole elements, followed by all gradients
+    size_t m_numElements;
+    size_t m_headerElements;
+    std::vector<size_t> m_offsets;
+    std::vector<ElemType> m_buffer;
+
+    // main node only: one posted receive per worker, and the sums sent for the last minibatches
+    std::vector<std::vector<ElemType>> m_recvBuffers;
+    std::vector<MPI_Request> m_recvRequests;
+    std::vector<size_t> m_numReceived;
+    std::deque<std::unique_ptr<ResultInFlight>> m_resultsInFlight;
+    std::vector<std::vector<ElemType>> m_freeResultBuffers;
+    size_t m_numLateGradients;
+};
+} } }
@@ -0,0 +1,134 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "Basics.h"
+#include "fileutil.h"
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <future>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// BinaryOutputFile -- binary output of a node's values, as written by the 'write' action with format = [ type = "binary" ]
+//
+// File layout (all integers little-endian uint64 unless noted):
+//   header:  char magic[8] = "CNTKBIN1"; uint32 elementSize; uint32 reserved; sampleDim; numSequences; indexOffset
+//   data:    the sequences one after the other, each as numFrames frames of sampleDim elements
+//   index:   at indexOffset, numSequences entries { sequenceId; dataOffset; numFrames }, dataOffset in bytes from the file start
+// Everything is 8-byte aligned, so that a reader can memory-map the file and use the index and the data in place.
+// indexOffset stays 0 until Close(), which identifies a file whose writing was interrupted.
+// A sequence that is split across minibatches (truncated BPTT) has one index entry per piece, with the same sequenceId.
+//
+// The data are collected in chunks, and each full chunk is written by a background task while the next one is filled.
+// -----------------------------------------------------------------------
+
+class BinaryOutputFile
+{
+public:
+    BinaryOutputFile(const std::wstring& path, size_t elementSize, size_t sampleDim, size_t chunkSize = 16 * 1024 * 1024)
+        : m_path(path), m_elementSize(elementSize), m_sampleDim(sampleDim), m_chunkSize(chunkSize), m_offset(HeaderSize)
+    {
+        m_file = fopenOrDie(path, L"wb");
+        WriteHeader(/*numSequences=*/0, /*indexOffset=*/0);
+        m_chunk.reserve(m_chunkSize);
+    }
+
+    ~BinaryOutputFile()
+    {
+        if (m_file)
+        {
+            // not closed due to an exception; leave an unfinished file behind (indexOffset = 0)
+            if (m_pendingWrite.valid())
+                m_pendingWrite.wait();
+            fclose(m_file);
+        }
+    }
+
+    // append a sequence of numFrames frames, which are columns of frameStride elements apart in memory
+    void AppendSequence(uint64_t sequenceId, const char* firstFrame, size_t numFrames, size_t frameStride)
+    {
+        size_t frameBytes = m_sampleDim * m_elementSize;
+        m_index.push_back(IndexEntry{ sequenceId, m_offset + m_chunk.size(), (uint64_t) numFrames });
+        for (size_t t = 0; t < numFrames; t++)
+        {
+            const char* frame = firstFrame + t * frameStride * m_elementSize;
+            m_chunk.insert(m_chunk.end(), frame, frame + frameBytes);
+        }
+        m_chunk.resize((m_chunk.size() + 7) / 8 * 8); // keep the next sequence aligned
+        if (m_chunk.size() >= m_chunkSize)
+            WriteChunkInBackground();
+    }
+
+    size_t GetNumSequences() const { return m_index.size(); }
+
+    // write the remaining data and the index
+    void Close()
+    {
+        WriteChunkInBackground();
+        m_pendingWrite.get(); // rethrows an exception of the background write
+        uint64_t indexOffset = m_offset;
+        if (!m_index.empty())
+            fwriteOrDie(m_index.data(), sizeof(IndexEntry), m_index.size(), m_file);
+        fseekOrDie(m_file, 0);
+        WriteHeader(m_index.size(), indexOffset);
+        fflushOrDie(m_file);
+        fcloseOrDie(m_file);
+        m_file = nullptr;
+    }
+
+private:
+    struct IndexEntry
+    {
+        uint64_t sequenceId;
+        uint64_t dataOffset;
+        uint64_t numFrames;
+    };
+    static const size_t HeaderSize = 40;
+
+    void WriteHeader(uint64_t numSequences, uint64_t indexOffset)
+    {
+        uint32_t elementSize = (uint32_t) m_elementSize, reserved = 0;
+        uint64_t sampleDim = m_sampleDim;
+        fwriteOrDie("CNTKBIN1", 1, 8, m_file);
+        fwriteOrDie(&elementSize, sizeof(elementSize), 1, m_file);
+        fwriteOrDie(&reserved, sizeof(reserved), 1, m_file);
+        fwriteOrDie(&sampleDim, sizeof(sampleDim), 1, m_file);
+        fwriteOrDie(&numSequences, sizeof(numSequences), 1, m_file);
+        fwriteOrDie(&indexOffset, sizeof(indexOffset), 1, m_file);
+    }
+
+    // double buffering: wait for the write of the previous chunk, then hand the current one to a background task
+    void WriteChunkInBackground()
+    {
+        if (m_pendingWrite.valid())
+            m_pendingWrite.get();
+        m_writtenChunk.swap(m_chunk);
+        m_chunk.clear();
+        m_offset += m_writtenChunk.size();
+        FILE* f = m_file;
+        const std::vector<char>& chunk = m_writtenChunk;
+        m_pendingWrite = std::async(std::launch::async, [f, &chunk]()
+        {
+            if (!chunk.empty())
+                fwriteOrDie(chunk.data(), 1, chunk.size(), f);
+        });
+    }
+
+    std::wstring m_path;
+    size_t m_elementSize;
+    size_t m_sampleDim;
+    size_t m_chunkSize;
+    FILE* m_file;
+    uint64_t m_offset; // file offset of the start of m_chunk
+    std::vector<char> m_chunk;        // being filled
+    std::vector<char> m_writtenChunk; // being written by m_pendingWrite
+    std::future<void> m_pendingWrite;
+    std::vector<IndexEntry> m_index;
+};
+
+}}}
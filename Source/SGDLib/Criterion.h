@@ -130,6 +130,14 @@ private:
         if (numSamples > 0) // (if MB is empty, matrix may not have the correct row dmension)
         {
             auto criterionValue = node->As<ComputationNode<ElemType>>()->ValueTensorFor(SIZE_MAX, fr);
+            // a node on another device than ours (see ToDevice()) is copied over first, since an operation across devices would move its matrix
+            if (node->GetDeviceId() != m_aggregateCriterionValues->GetDeviceId())
+            {
+                if (!m_stagedCriterionValues)
+                    m_stagedCriterionValues = make_shared<Matrix<ElemType>>(m_aggregateCriterionValues->GetDeviceId());
+                m_stagedCriterionValues->AssignValuesOf(node->As<ComputationNode<ElemType>>()->Value());
+                criterionValue = TensorView<ElemType>(m_stagedCriterionValues, criterionValue.GetShape());
+            }
             // accumulate
             // Note: If criterion is > [1 x 1] then inverse broadcasting will kick in and aggregate.
             // If count is zero, we lazily consider the numerator as zero as well.
@@ -151,6 +159,7 @@ public:
 
 private:
     shared_ptr<Matrix<ElemType>> m_aggregateCriterionValues; // [1 x N]
+    shared_ptr<Matrix<ElemType>> m_stagedCriterionValues;    // copy of the value of a node on another device
     vector<size_t> m_aggregateSampleCounts;                  // [N]
 };
 
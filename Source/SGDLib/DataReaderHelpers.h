@@ -6,6 +6,7 @@
 #include "DataReader.h"
 #include "ComputationNetwork.h"
 #include "MPIWrapper.h"
+#include "EventTracer.h"
 #include "SpecialPurposeNodes.h"        // for SequenceWithSoftmaxNode
 #include <string>
 #include <map>
@@ -48,6 +49,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                                         size_t& actualMBSize, 
                                         const MPIWrapperPtr& mpi)
     {
+        EventTracer::Scope scope("GetMinibatchIntoNetwork", "reader");
         // Reading consists of a sequence of Reader API calls:
         //  - GetMinibatch() --fills the inputMatrices and copies the MBLayout from Reader into inputMatrices
         //  - SetActualMiniBatchSizeFromFeatures()  --tells Network to resize the nodes' buffers
@@ -117,6 +119,17 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     // -------------------------------------------------------------------
     // DecimateMinibatch - decimate minibatch for parallelization
     // -------------------------------------------------------------------
+    // the rank that DecimateMinibatch() assigns parallel sequence s of numParallelSequences to
+    static size_t DecimationRank(size_t s, size_t numParallelSequences, size_t numProcs)
+    {
+        for (size_t rank = 0; rank + 1 < numProcs; rank++)
+        {
+            if (s < numParallelSequences * (rank + 1) / numProcs)
+                return rank;
+        }
+        return numProcs - 1;
+    }
+
     // non-inplace decimation , to be used in subminibatch implementation
     // returns a subset of parallel sequences
     template <class ElemType>
@@ -282,7 +295,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         ExtrauttMap m_extrauttmapCache;
         Boundaries m_BoundariesCache;
         shared_ptr<Matrix<ElemType>> m_netCriterionAccumulator;
-        shared_ptr<Matrix<ElemType>> m_netEvaluationAccumulator;
+        vector<shared_ptr<Matrix<ElemType>>> m_netEvaluationAccumulators; // [i] on the device of evaluation node i
         std::map<wstring, vector<shared_ptr<INodeState>>> m_netStates; // m_netStatefulNodes[node][i] caches the state of i-th subminibatch of node
         bool m_hasLattices;
 
@@ -343,8 +356,11 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                   const std::vector<ComputationNodeBasePtr>& evaluationNodes)
         {
             m_MBLayoutCache = make_shared<MBLayout>();
-            m_netCriterionAccumulator = make_shared<Matrix<ElemType>>(1, 1, net->GetDeviceId());
-            m_netEvaluationAccumulator = make_shared<Matrix<ElemType>>(1, evaluationNodes.size(), net->GetDeviceId());
+            // the accumulators live with the nodes, which need not be on the network's device (see ToDevice())
+            m_netCriterionAccumulator = make_shared<Matrix<ElemType>>(1, 1, criterionNodes.empty() ? net->GetDeviceId() : criterionNodes[0]->GetDeviceId());
+            m_netEvaluationAccumulators.clear();
+            for (auto& x : evaluationNodes)
+                m_netEvaluationAccumulators.push_back(make_shared<Matrix<ElemType>>(1, 1, x->GetDeviceId()));
             // remember ptrs to learnable nodes
             for (auto x : learnableNodes)
             {
@@ -361,7 +377,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                 m_netEvaluationNodes.push_back(dynamic_pointer_cast<ComputationNode<ElemType>>(x));
             }
             m_netCriterionAccumulator->SetValue((ElemType) 0);
-            m_netEvaluationAccumulator->SetValue((ElemType) 0);
+            for (auto& accumulator : m_netEvaluationAccumulators)
+                accumulator->SetValue((ElemType) 0);
 
             // emulate all the nodes, find nodes that have state
             m_netStatefulNodes = EnumerateStatefulNode(*net, criterionNodes, evaluationNodes);
@@ -392,6 +409,12 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             }
         }
 
+        // the state of stateful nodes is kept per sub-minibatch, so their number must not change within an epoch
+        bool HasStatefulNodes() const
+        {
+            return !m_netStatefulNodes.empty();
+        }
+
         size_t GetMinibatchIntoCache(IDataReader& trainSetDataReader,
                                      ComputationNetwork& net,
                                      StreamMinibatchInputs& inputMatrices,
@@ -571,7 +594,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             for (size_t i = 0; i < m_netEvaluationNodes.size(); i++)
             {
                 Matrix<ElemType>::AddElementToElement(m_netEvaluationNodes[i]->Value(), 0, 0,
-                                                      *m_netEvaluationAccumulator, 0, i);
+                                                      *m_netEvaluationAccumulators[i], 0, 0);
                 m_netEvaluationNodes[i]->Value().SetValue(0);
             }
 
@@ -609,10 +632,36 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             for (size_t i = 0; i < m_netEvaluationNodes.size(); i++)
             {
                 // m_netEvaluationNodes[i]->Value().SetValue((ElemType)0);
-                Matrix<ElemType>::AddElementToElement(*m_netEvaluationAccumulator, 0, i,
+                Matrix<ElemType>::AddElementToElement(*m_netEvaluationAccumulators[i], 0, 0,
                                                       m_netEvaluationNodes[i]->Value(), 0, 0);
+                m_netEvaluationAccumulators[i]->SetValue(0);
+            }
+        }
+
+        // undo a minibatch whose sub-minibatches did not all complete, e.g. for lack of device memory, so that it can be split anew:
+        // the net gets the full minibatch back, and what the completed sub-minibatches accumulated is dropped
+        // Not for stateful nodes, whose states would be of the wrong sub-minibatches.
+        void AbandonCurrentMinibatch()
+        {
+            for (auto& x : m_inputMatricesCache)
+            {
+                const wstring& name = x.first;
+                m_netInputMatrixPtr.GetInputMatrix<ElemType>(name).SetValue(m_inputMatricesCache.GetInputMatrix<ElemType>(name));
             }
-            m_netEvaluationAccumulator->SetValue(0);
+            m_netMBLayoutPtr->CopyFrom(m_MBLayoutCache);
+            if (m_hasLattices)
+            {
+                *m_netLatticePtr = m_LatticeCache;
+                *m_netUidPtr = m_uidCache;
+                *m_netExtrauttMapPtr = m_extrauttmapCache;
+                *m_netBoundariesPtr = m_BoundariesCache;
+            }
+
+            for (auto& x : m_cachedGradient)
+                m_cachedGradient.GetInputMatrix<ElemType>(x.first).SetValue(0);
+            m_netCriterionAccumulator->SetValue(0);
+            for (auto& accumulator : m_netEvaluationAccumulators)
+                accumulator->SetValue(0);
         }
     };
 };
@@ -5,6 +5,14 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// how the gradients on GPU devices are exchanged between the workers
+enum class GradientCommunicationBackend
+{
+    mpi,          // staged in page-locked host buffers and reduced with MPI
+    cudaAwareMPI, // device buffers are passed to a CUDA-aware MPI directly
+    nccl          // reduced in GPU memory with NVIDIA NCCL on the compute stream (see NcclComm)
+};
+
 template <class ElemType>
 class IDistGradAggregator
 {
@@ -21,6 +29,18 @@ public:
     // Returns a boolean indicating if any samples were processed
     virtual bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int epochNumber) = 0;
 
+    // Called during backprop for each gradient matrix passed to AggregateGradients() once it is complete for the current
+    // minibatch. Aggregators that overlap communication with backprop start aggregating it here; the others ignore it.
+    virtual void OnGradientCompleted(Matrix<ElemType>* /*gradient*/)
+    {
+    }
+
+    // whether OnGradientCompleted() is used
+    virtual bool OverlapsAggregationWithBackprop() const
+    {
+        return false;
+    }
+
     size_t NumProc()
     {
         return m_mpi->NumNodesInUse();
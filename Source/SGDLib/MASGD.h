@@ -404,4 +404,179 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         }
     };
 
+    // Model averaging with the communication of a block overlapped with the computation of the next block.
+    // At the sync point after block k, each worker starts a non-blocking all-reduce of its model change during block k
+    // (weighted by its samples), and continues block k + 1 at once, from the global model up to block k - 1 plus its own
+    // change during block k. The averaged change of block k is waited for and applied at the next sync point, so that the
+    // all-reduce is hidden behind a whole block of computation. At the end of an epoch the pipeline is drained with a
+    // blocking all-reduce, so that all workers leave it with the same model.
+    // The all-reduce only progresses while the computation runs if the MPI library progresses it asynchronously.
+    template<typename ElemType>
+    class PipelinedModelAveragingSGD : public IMASGD<ElemType>
+    {
+        typedef IMASGD<ElemType> Base; 
+        using Base::m_pMPI;
+        using Base::DownCast;
+
+    public:
+        PipelinedModelAveragingSGD(const MPIWrapperPtr& pMPI, size_t reportFreq, DEVICEID_TYPE devID)
+            : Base(pMPI, reportFreq, devID), m_reducing(false), m_draining(false), m_localSamples(0), m_totalSamples(0)
+        {
+            fprintf(stderr, "Parallel training (%d workers) using pipelined ModelAveraging\n",(int)m_pMPI->NumNodesInUse());
+        }
+
+        ~PipelinedModelAveragingSGD()
+        {
+            WaitForReduction();
+        }
+
+        void OnEpochStart(const std::list<ComputationNodeBasePtr>& learnableNodes) override
+        {
+            // all workers start the epoch from the same model
+            GetLocalModel(learnableNodes, m_globalModel);
+            m_reference = m_globalModel;
+            Base::OnEpochStart(learnableNodes);
+        }
+
+        void OnEpochEnd(const std::list<ComputationNodeBasePtr>&    learnableNodes,
+                        std::list<Matrix<ElemType>>&                smoothedGradient, 
+                        size_t                                      samplesSinceLastSync) override
+        {
+            m_draining = true;
+            Base::OnEpochEnd(learnableNodes, smoothedGradient, samplesSinceLastSync);
+            m_draining = false;
+        }
+
+        void ModelAggregationProcessing(
+            size_t samplesSinceLastSync,                                       /* in */
+            const std::list<ComputationNodeBasePtr>&  learnableNodes,          /* in/out */
+            std::list<Matrix<ElemType>>&              /*smoothedGradient*/,    /* in/out */
+            size_t&                                   totalSamplesProcessed,   /* out */
+            float&                                    secondsOnCommunication   /* out */) override
+        {
+            Timer commTimer; 
+            secondsOnCommunication = 0.0f;
+
+            //----------------------------------------
+            // 1. apply the averaged change of the previous block, which was reduced during this block
+            //----------------------------------------
+            commTimer.Start();
+            bool hadPreviousBlock = m_reducing;
+            WaitForReduction();
+            commTimer.Stop();
+            secondsOnCommunication += (float)commTimer.ElapsedSeconds();
+            if (hadPreviousBlock)
+                AddAveragedChange();
+
+            //----------------------------------------
+            // 2. the change of this block
+            //----------------------------------------
+            GetLocalModel(learnableNodes, m_localChange);
+            for (size_t i = 0; i < m_localChange.size(); i++)
+                m_localChange[i] -= m_reference[i];
+            m_reduceBuffer.resize(m_localChange.size());
+            for (size_t i = 0; i < m_localChange.size(); i++)
+                m_reduceBuffer[i] = m_localChange[i] * (ElemType)samplesSinceLastSync;
+            m_localSamples = (int)samplesSinceLastSync;
+
+            if (m_draining)
+            {
+                // the last block of the epoch: average it right away, and all workers end up with the global model
+                commTimer.Restart();
+                m_totalSamples = m_localSamples;
+                m_pMPI->AllReduce(&m_totalSamples, 1);
+                m_pMPI->AllReduce(m_reduceBuffer.data(), m_reduceBuffer.size());
+                commTimer.Stop();
+                secondsOnCommunication += (float)commTimer.ElapsedSeconds();
+                AddAveragedChange();
+                m_reference = m_globalModel;
+            }
+            else
+            {
+                // continue from the global model up to the previous block plus the own change of this block,
+                // while the change of this block is averaged
+                m_reference.resize(m_globalModel.size());
+                for (size_t i = 0; i < m_reference.size(); i++)
+                    m_reference[i] = m_globalModel[i] + m_localChange[i];
+                StartReduction();
+            }
+            SetLocalModel(learnableNodes, m_reference);
+
+            // the sample count of the latest completed reduction (an estimate for the block just started)
+            totalSamplesProcessed = m_totalSamples > 0 ? m_totalSamples : samplesSinceLastSync * m_pMPI->NumNodesInUse();
+        }
+
+    private:
+        void StartReduction()
+        {
+            m_samplesRequest = m_pMPI->AllReduceAsync(&m_localSamples, 1);
+            m_reduceRequest = m_pMPI->AllReduceAsync(m_reduceBuffer.data(), m_reduceBuffer.size());
+            m_reducing = true;
+        }
+
+        void WaitForReduction()
+        {
+            if (!m_reducing)
+                return;
+            m_samplesRequest.Wait();
+            m_reduceRequest.Wait();
+            m_totalSamples = m_localSamples;
+            m_reducing = false;
+        }
+
+        // adds the sample-weighted average of the changes in m_reduceBuffer to the global model
+        void AddAveragedChange()
+        {
+            if (m_totalSamples <= 0)
+                return; // no worker processed any samples
+            ElemType factor = (ElemType)1 / m_totalSamples;
+            for (size_t i = 0; i < m_globalModel.size(); i++)
+                m_globalModel[i] += m_reduceBuffer[i] * factor;
+        }
+
+        void GetLocalModel(const std::list<ComputationNodeBasePtr>& learnableNodes, std::vector<ElemType>& model)
+        {
+            size_t numElements = 0;
+            for (auto& pBaseNode : learnableNodes)
+            {
+                if (pBaseNode->IsParameterUpdateRequired())
+                    numElements += DownCast(pBaseNode)->Value().GetNumElements();
+            }
+            model.resize(numElements);
+            size_t offset = 0;
+            for (auto& pBaseNode : learnableNodes)
+            {
+                if (!pBaseNode->IsParameterUpdateRequired())
+                    continue;
+                const auto& value = DownCast(pBaseNode)->Value();
+                value.CopySection(value.GetNumRows(), value.GetNumCols(), model.data() + offset, value.GetNumRows());
+                offset += value.GetNumElements();
+            }
+        }
+
+        void SetLocalModel(const std::list<ComputationNodeBasePtr>& learnableNodes, std::vector<ElemType>& model)
+        {
+            size_t offset = 0;
+            for (auto& pBaseNode : learnableNodes)
+            {
+                if (!pBaseNode->IsParameterUpdateRequired())
+                    continue;
+                auto& value = DownCast(pBaseNode)->Value();
+                value.SetValue(value.GetNumRows(), value.GetNumCols(), value.GetDeviceId(), model.data() + offset);
+                offset += value.GetNumElements();
+            }
+        }
+
+        bool m_reducing;                       // an all-reduce of m_reduceBuffer and m_localSamples is in flight
+        bool m_draining;                       // inside OnEpochEnd()
+        int  m_localSamples;                   // the samples of the block being reduced; their sum once reduced
+        int  m_totalSamples;                   // the total samples of the latest reduced block
+        std::vector<ElemType> m_globalModel;   // the average model up to the latest reduced block
+        std::vector<ElemType> m_reference;     // the local model at the start of the current block
+        std::vector<ElemType> m_localChange;
+        std::vector<ElemType> m_reduceBuffer;  // the sample-weighted change of the block being reduced
+        MPIRequest m_reduceRequest;
+        MPIRequest m_samplesRequest;
+    };
+
 } } }
@@ -17,10 +17,30 @@
 #endif
 
 #include "SimpleDistGradAggregator.h"
+#include "AsyncParameterServerSGD.h"
+#include "SparseDistGradAggregator.h"
+#include "BackupWorkerDistGradAggregator.h"
 #include "ProgressTracing.h"
+#include "NodeProfiler.h"
+#include "EventTracer.h"
+#include "Metrics.h"
+#include "GPUWatcher.h"
+#include "InputAndParamNodes.h"
+#include "CPUMatrix.h"                  // for SetNumThreads()
+#include "CPUThreadPool.h"
+#include "TrainingNodes.h"              // for ModelParallelCrossEntropyWithSoftmaxNode
+#include "PreComputeNodes.h"            // for PreComputedNodeBase
 
 #include <map>
 #include <set>
+#include <numeric>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -71,8 +91,7 @@ void SGD<ElemType>::Train(function<ComputationNetworkPtr(DEVICEID_TYPE)> createN
     else
         fprintf(stderr, " on GPU %d.\n", (int) net->GetDeviceId());
 
-    // TODO: BUGBUG: if not starting from checkpoint, need to synchronize initial model
-    // strategy should be to run the initializer above on mpiRank==0, and then broadcast parameters.
+    // (with several workers, they are made to start from the same model in TrainOrAdaptModel(), see SynchronizeInitialModel())
 
     startEpoch = max(startEpoch, 0);
     m_needAdaptRegularization = false;
@@ -119,14 +138,26 @@ void SGD<ElemType>::Adapt(wstring origModelFileName, wstring refNodeName,
 
     ComputationNetworkPtr refNet;
     m_needAdaptRegularization = m_adaptationRegType != AdaptationRegType::None && m_adaptationRegWeight > 0;
-    if (m_needAdaptRegularization)
+    bool refOutputFromInput = m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && !m_adaptationRegRefInput.empty();
+    if (m_needAdaptRegularization && !refOutputFromInput)
     {
         LOGPRINTF(stderr, "Load reference Network From the original model file %ls.\n", origModelFileName.c_str());
         refNet = ComputationNetwork::CreateFromFile<ElemType>(deviceId, origModelFileName);
     }
 
     ComputationNodeBasePtr refNode;
-    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL)
+    if (refOutputFromInput)
+    {
+        // the reference output was computed beforehand and is read like the features; refNode is that input, and there is no refNet
+        LOGPRINTF(stderr, "Reading the reference output from input %ls.\n", m_adaptationRegRefInput.c_str());
+        refNode = net->GetNodeFromName(m_adaptationRegRefInput);
+        let& featureNodes = net->FeatureNodes();
+        if (!refNode->Is<InputValueBase<ElemType>>() || find(featureNodes.begin(), featureNodes.end(), refNode) == featureNodes.end())
+            InvalidArgument("adaptationRegRefInput: %ls is not a feature input of the model.", m_adaptationRegRefInput.c_str());
+        if (net->LabelNodes().empty() || refNode->GetSampleLayout() != net->LabelNodes()[0]->GetSampleLayout())
+            InvalidArgument("adaptationRegRefInput: The dimensions [%s] of %ls must match those of the labels.", string(refNode->GetSampleLayout()).c_str(), m_adaptationRegRefInput.c_str());
+    }
+    else if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL)
     {
         LOGPRINTF(stderr, "Checking refNodeName %ls.\n", origModelFileName.c_str());
         if (refNodeName == L"")
@@ -137,11 +168,199 @@ void SGD<ElemType>::Adapt(wstring origModelFileName, wstring refNodeName,
     TrainOrAdaptModel(startEpoch, net, networkLoadedFromCheckpoint, refNet, refNode, trainSetDataReader, validationSetDataReader);
 }
 
+// -----------------------------------------------------------------------
+// Benchmark() -- time training steps on inputs that do not come from a reader
+// Each phase is followed by a wait for the device, so that its wall time includes its GPU work; this gives up
+// the overlap of consecutive phases (and of aggregation with backprop), which training has.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+void SGD<ElemType>::Benchmark(ComputationNetworkPtr net,
+                              const function<size_t(const std::vector<ComputationNodeBasePtr>& inputNodes)>& fillInputs,
+                              size_t numSteps, size_t numWarmupSteps)
+{
+    if (numSteps == 0)
+        InvalidArgument("Benchmark: numSteps must be positive.");
+
+    if (m_optimizeNetwork)
+        net->OptimizeNetwork();
+    if (m_offloadToHost)
+        net->OffloadToHost(m_mbSize[0]);
+    if (m_fuseAffineActivation)
+        net->FuseAffineActivation();
+
+    let& criterionNodes = GetTrainCriterionNodes(net);
+    if (criterionNodes.empty())
+        InvalidArgument("Benchmark: No criterion node was specified.");
+    std::vector<ComputationNodeBasePtr> evaluationNodes;
+    for (const auto& node : GetEvalCriterionNodes(net))
+        if (find(criterionNodes.begin(), criterionNodes.end(), node) == criterionNodes.end())
+            evaluationNodes.push_back(node);
+
+    net->SetMinibatchSizeHint(m_mbSize[0]);
+    net->AllocateAllMatrices(evaluationNodes, {}, criterionNodes[0]);
+
+    let& inputNodeList = net->InputNodes(criterionNodes[0]);
+    std::vector<ComputationNodeBasePtr> inputNodes(inputNodeList.begin(), inputNodeList.end());
+    auto& learnableNodes = net->LearnableParameterNodes(criterionNodes[0]);
+    std::list<Matrix<ElemType>> smoothedGradients;
+    for (const auto& learnableNode : learnableNodes)
+    {
+        ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(learnableNode);
+        smoothedGradients.push_back(Matrix<ElemType>(node->Value().GetNumRows(), node->Value().GetNumCols(), node->GetDeviceId()));
+    }
+
+    bool useGradientAggregation = UsingGradientAggregation(0) && m_mpi != nullptr;
+    if (useGradientAggregation)
+        InitDistGradAgg(evaluationNodes.size(), m_traceLevel);
+    else if (UsingModelAggregation(0))
+        LOGPRINTF(stderr, "Benchmark: The periodic model aggregation of the parallelization method is not included in the timings.\n");
+    std::vector<Matrix<ElemType>*> learnParamsGradients;
+
+    enum Phase { generate, forward, backward, aggregate, update, numPhases };
+    static const char* phaseNames[numPhases] = { "input generation", "forward", "backward", "aggregation", "update" };
+    std::vector<double> phaseSeconds(numPhases, 0);
+    size_t totalSamples = 0;
+    double totalSeconds = 0;
+
+    std::unique_ptr<GPUEvent> deviceDone(net->GetDeviceId() != CPUDEVICE ? new GPUEvent(net->GetDeviceId()) : nullptr);
+    auto waitForDevice = [&]()
+    {
+        if (deviceDone)
+        {
+            deviceDone->Record();
+            deviceDone->Synchronize();
+        }
+    };
+
+    ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
+    net->StartEvaluateMinibatchLoop(evaluationNodes);
+    net->StartEvaluateMinibatchLoop(criterionNodes);
+    CriterionAccumulator<ElemType> localCriterion(1, net->GetDeviceId());
+    CriterionAccumulator<ElemType> localEvalErrors(evaluationNodes.size(), net->GetDeviceId());
+
+    fprintf(stderr, "\n");
+    LOGPRINTF(stderr, "Benchmark: %d warm-up and %d timed steps, minibatch size hint %d.\n", (int) numWarmupSteps, (int) numSteps, (int) m_mbSize[0]);
+    for (size_t step = 0; step < numWarmupSteps + numSteps; step++)
+    {
+        std::vector<double> stepSeconds(numPhases, 0);
+        auto phaseBegin = std::chrono::steady_clock::now();
+        auto endPhase = [&](Phase phase)
+        {
+            waitForDevice();
+            auto now = std::chrono::steady_clock::now();
+            stepSeconds[phase] += std::chrono::duration<double>(now - phaseBegin).count();
+            phaseBegin = now;
+        };
+
+        size_t actualMBSize = fillInputs(inputNodes);
+        ComputationNetwork::BumpEvalTimeStamp(inputNodes);
+        MarkDropoutNodesEvalTimeStampAsOutdated(net, criterionNodes[0]);
+        endPhase(generate);
+
+        net->ForwardProp(evaluationNodes);
+        net->ForwardProp(criterionNodes[0]);
+        endPhase(forward);
+
+        net->Backprop(criterionNodes[0]);
+        endPhase(backward);
+
+        size_t numSamplesWithLabelOfNetwork = net->GetNumSamplesWithLabelOfNetwork(actualMBSize);
+        size_t numSamplesInMinibatch = criterionNodes[0]->HasMBLayout() ? CriterionAccumulator<ElemType>::GetNumSamples(criterionNodes[0], numSamplesWithLabelOfNetwork) : actualMBSize;
+        size_t aggregateNumSamples = actualMBSize;
+        if (useGradientAggregation)
+        {
+            if (learnParamsGradients.empty())
+            {
+                for (const auto& learnableNode : learnableNodes)
+                {
+                    ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(learnableNode);
+                    if (node->IsParameterUpdateRequired())
+                        learnParamsGradients.push_back(&node->Gradient());
+                }
+            }
+            m_gradHeader->numEvalNode = evaluationNodes.size();
+            m_gradHeader->numSamples = actualMBSize;
+            localCriterion.Assign(criterionNodes, 0, numSamplesWithLabelOfNetwork);
+            for (size_t i = 0; i < evaluationNodes.size(); i++)
+                localEvalErrors.Assign(evaluationNodes, i, numSamplesWithLabelOfNetwork);
+            m_gradHeader->numSamplesWithLabel = localCriterion.GetCriterion(0).second;
+            m_gradHeader->criterion = localCriterion.GetCriterion(0).first;
+            for (size_t i = 0; i < evaluationNodes.size(); i++)
+                m_gradHeader->evalErrors[i] = localEvalErrors.GetCriterion(i);
+            m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader.get(), /*epochNumber=*/0);
+            aggregateNumSamples = m_gradHeader->numSamples;
+            if (criterionNodes[0]->HasMBLayout())
+                numSamplesInMinibatch = m_gradHeader->numSamplesWithLabel;
+            else
+                numSamplesInMinibatch = aggregateNumSamples;
+            endPhase(aggregate);
+        }
+
+        size_t numParallelSequences = net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences();
+        double learnRatePerSample = GetLearningRatePerSample(0, numParallelSequences);
+        double momentumPerSample = GetMomentumPerSample(0, numParallelSequences);
+        if (aggregateNumSamples > 0)
+        {
+            if (m_fusedParameterUpdate && GradUpdateType() == GradientsUpdateType::None && GradientUpdateNoiseStd() == 0)
+                UpdateWeightsMultiTensor(learnableNodes, smoothedGradients, learnRatePerSample, momentumPerSample, numSamplesInMinibatch);
+            else
+            {
+                auto smoothedGradientIter = smoothedGradients.begin();
+                for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+                {
+                    if ((*nodeIter)->IsParameterUpdateRequired())
+                        UpdateWeights(*nodeIter, *smoothedGradientIter, learnRatePerSample, momentumPerSample, numSamplesInMinibatch,
+                                      m_L2RegWeight, m_L1RegWeight, m_needAveMultiplier, m_useNesterovMomentum);
+                }
+            }
+        }
+        endPhase(update);
+
+        if (step < numWarmupSteps)
+            continue;
+        for (size_t phase = 0; phase < numPhases; phase++)
+            phaseSeconds[phase] += stepSeconds[phase];
+        totalSamples += actualMBSize;
+        totalSeconds += std::accumulate(stepSeconds.begin() + forward, stepSeconds.end(), 0.0);
+    }
+
+    // the input generation stands in for the reader and is not part of the throughput
+    LOGPRINTF(stderr, "Benchmark: %d samples in %.3f seconds of compute: %.1f samples/s on this worker.\n",
+              (int) totalSamples, totalSeconds, totalSeconds > 0 ? totalSamples / totalSeconds : 0.0);
+    for (size_t phase = 0; phase < numPhases; phase++)
+    {
+        if (phase == aggregate && !useGradientAggregation)
+            continue;
+        LOGPRINTF(stderr, "\t%-16s %9.3f ms per step\n", phaseNames[phase], 1000 * phaseSeconds[phase] / numSteps);
+    }
+    if (m_mpi != nullptr && m_mpi->NumNodesInUse() > 1)
+    {
+        double samplesPerSecond[2] = { totalSeconds > 0 ? totalSamples / totalSeconds : 0.0, (double) totalSamples };
+        m_mpi->AllReduce(samplesPerSecond, 2);
+        LOGPRINTF(stderr, "Benchmark: %d samples over %d workers: %.1f samples/s in total.\n",
+                  (int) samplesPerSecond[1], (int) m_mpi->NumNodesInUse(), samplesPerSecond[0]);
+    }
+}
+
 // -----------------------------------------------------------------------
 // TrainOrAdaptModel() -- main training end-to-end, given a start model
 // -----------------------------------------------------------------------
 
 static double MomentumPerMB(double momentumPerSample, size_t minibatchSize);
+static CompactElementType ParseValueCompressionType(const wstring& s);
+
+// updates the process-wide metrics (see Metrics.h) after each minibatch
+static void UpdateMinibatchMetrics(DEVICEID_TYPE deviceId, size_t numSamples, double seconds)
+{
+    static auto& samples = Metrics::GetCounter("cntk_train_samples_total", "Training samples processed by this worker");
+    static auto& minibatchSeconds = Metrics::GetHistogram("cntk_minibatch_seconds", "Wall time of a training minibatch, from reading it to updating the model");
+    static auto& gpuMemoryPeak = Metrics::GetGauge("cntk_gpu_memory_peak_bytes", "High-water mark of the GPU memory in use by the matrices of this worker");
+    samples.Add(numSamples);
+    minibatchSeconds.Observe(seconds);
+    if (deviceId >= 0 && TracingGPUMemoryAllocator::IsCachingEnabled()) // (the cache keeps the statistics)
+        gpuMemoryPeak.SetMax((double) TracingGPUMemoryAllocator::GetCacheStatistics(deviceId).peakInUseBytes);
+}
 
 template <class ElemType>
 void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
@@ -151,6 +370,22 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                                       IDataReader* trainSetDataReader,
                                       IDataReader* validationSetDataReader)
 {
+    // Note: the checkpoints then contain the optimized network (folded constants, merged duplicates), the ToDevice() nodes of offloaded nodes, and AffineActivation nodes instead of the original chains.
+    if (m_optimizeNetwork)
+        net->OptimizeNetwork();
+    if (m_offloadToHost)
+        net->OffloadToHost(m_mbSize[0]);
+    NodeProfiler::Configure(m_nodeProfilingRate, m_nodeProfilingTraceFile);
+    if (!m_traceTimelineFile.empty())
+    {
+        // one file per worker, each worker being one process of the timeline
+        bool multipleWorkers = m_mpi != nullptr && m_mpi->NumNodesInUse() > 1;
+        EventTracer::Start(multipleWorkers ? m_traceTimelineFile + msra::strfun::wstrprintf(L".rank%d", (int) m_mpi->CurrentNodeRank()) : m_traceTimelineFile,
+                           m_mpi ? (int) m_mpi->CurrentNodeRank() : 0);
+    }
+    if (m_fuseAffineActivation)
+        net->FuseAffineActivation();
+
     let& criterionNodes = GetTrainCriterionNodes(net);
 
     fprintf(stderr, "\n");
@@ -197,6 +432,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     additionalNodesToEvaluate.insert(additionalNodesToEvaluate.end(), preComputeNodesList.cbegin(), preComputeNodesList.cend());
 
     // allocate memory for forward and backward computation
+    net->SetMinibatchSizeHint(m_mbSize[startEpoch]);
+    net->SetGradientCheckpointing(m_gradientCheckpointInterval, m_recomputeNodeNames);
+    net->SetValueCompression(m_compressedNodeNames, ParseValueCompressionType(m_valueCompression));
     net->AllocateAllMatrices(evaluationNodes, additionalNodesToEvaluate, criterionNodes[0]);
 
     // get feature and label nodes into an array of matrices that will be passed to GetMinibatch()
@@ -213,6 +451,39 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             inputMatrices->AddInput(node->NodeName(), node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
     }
 
+    // estimate the memory before anything is computed, so that a configuration that does not fit is known before the first epoch
+    if (m_memoryReport || m_dryRun || m_autoMaxSamplesInRAM || m_autoSubminibatches)
+    {
+        let& learnableNodes = net->LearnableParameterNodes(criterionNodes[0]);
+        std::vector<ComputationNodeBasePtr> inputNodes(featureNodes.begin(), featureNodes.end());
+        inputNodes.insert(inputNodes.end(), labelNodes.begin(), labelNodes.end());
+        size_t maxMBSize = 0;
+        for (int i = startEpoch; i < (int) m_maxEpochs; i++)
+            maxMBSize = max(maxMBSize, (size_t) m_mbSize[i]);
+        if (m_autoMaxSamplesInRAM)
+            FitMaxSamplesInRAMToGPUMemory(net, learnableNodes, inputNodes, maxMBSize);
+        if (m_autoSubminibatches && (net->GetDeviceId() == CPUDEVICE || !TracingGPUMemoryAllocator::IsCachingEnabled()))
+        {
+            LOGPRINTF(stderr, "autoSubminibatches: ignored, since it measures the memory of the caching GPU allocator.\n");
+            m_autoSubminibatches = false;
+        }
+        if (m_autoSubminibatches)
+        {
+            m_peakMemoryProbe.fixedBytes = (double) ComputationNetwork::MemoryEstimate::GetTotal(EstimateMemory(net, learnableNodes, inputNodes, 0).deviceBytes);
+            m_peakMemoryProbe.plannedBytesPerSample = ComputationNetwork::MemoryEstimate::GetTotal(EstimateMemory(net, learnableNodes, inputNodes, 1).deviceBytes) - m_peakMemoryProbe.fixedBytes;
+            m_peakMemoryProbe.largestSamplesInRAM = 0;
+            TracingGPUMemoryAllocator::ResetPeakInUseBytes(net->GetDeviceId());
+        }
+        if (m_memoryReport || m_dryRun)
+            net->PrintMemoryEstimate(EstimateMemory(net, learnableNodes, inputNodes, min(maxMBSize, m_maxSamplesInRAM)));
+        if (m_dryRun)
+        {
+            LOGPRINTF(stderr, "Dry run: stopping before training.\n");
+            delete inputMatrices;
+            return;
+        }
+    }
+
     // get hmm file for sequence training
     bool isSequenceTrainingCriterion = (criterionNodes[0]->OperationName() == L"SequenceWithSoftmax");
     if (isSequenceTrainingCriterion)
@@ -229,7 +500,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     // TODO: Redo this leveraging that we now have shared_ptrs. It is probably even OK if both networks share feature nodes.
     // TODO: Then we can also share the MBLayout; which currently is copied by value.
     std::vector<ComputationNodeBasePtr> refFeatureNodes; // we keep the original network's features here
-    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode != nullptr)
+    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode != nullptr && refNet)
     {
         refNet->InvalidateCompiledNetwork(); // prepare to re-compile
         // replace input nodes in ref network by input nodes of the main network
@@ -258,9 +529,15 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
         smoothedGradients.push_back(Matrix<ElemType>(node->Value().GetNumRows(),
                                                      node->Value().GetNumCols(),
-                                                     net->GetDeviceId()));
+                                                     node->GetDeviceId()));
     }
 
+    // a network split over several devices by ToDevice() keeps each parameter and its learner state on the device of its stage,
+    // which the aggregation of gradients and models across workers does not know about
+    bool isOnSeveralDevices = any_of(learnableNodes.begin(), learnableNodes.end(), [&net](const ComputationNodeBasePtr& node) { return node->GetDeviceId() != net->GetDeviceId(); });
+    if (isOnSeveralDevices && (GetParallelizationMethod() != ParallelizationMethod::none || m_hogwildThreads > 1))
+        InvalidArgument("A network placed on several devices with ToDevice() cannot be trained with parallel training or hogwildThreads.");
+
     double avgCriterion, lrControlCriterion;
     lrControlCriterion = avgCriterion = numeric_limits<double>::infinity();
     size_t epochsNotCountedInAvgCriterion = startEpoch % m_learnRateAdjustInterval;
@@ -279,16 +556,41 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         prevLearnRates[i] = -1.0;
     }
 
+    // (all workers get here, as creating the communicators is a collective operation)
+    if (m_hierarchicalAllReduce && GetParallelizationMethod() != ParallelizationMethod::none)
+        m_mpi->SetHierarchicalAllReduce(true, m_sharedMemoryAllReduce);
+
     if (GetParallelizationMethod() == ParallelizationMethod::dataParallelSGD)
     {
         InitDistGradAgg(evaluationNodes.size(), m_traceLevel);
     }
     else if (GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD || 
-             GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD)
+             GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD ||
+             GetParallelizationMethod() == ParallelizationMethod::asyncParameterServerSGD)
     {
         InitModelAggregationHandler(m_syncStatsTrace, net->GetDeviceId());
     }
-    
+
+    // with a model-parallel output layer, each worker trains its own shard of the output weights, which is not aggregated
+    if (UsingModelParallelism())
+    {
+        m_modelParallelWeights = ComputationNetwork::SetModelParallelism<ElemType>(net, criterionNodes[0], m_mpi);
+        if (m_modelParallelWeights.size() != 1 || criterionNodes[0]->OperationName() != OperationNameOf(ModelParallelCrossEntropyWithSoftmaxNode))
+            InvalidArgument("modelParallelSGD requires the training criterion to be a ModelParallelCrossEntropyWithSoftmax operation, with no other one below it.");
+        // (these would let the workers run different sequences of collectives, or reload the model without the shards)
+        if (m_bufferedAsyncGradientAggregation || m_gradientBucketSizeInBytes > 0 || m_numBackupWorkers > 0 || m_parallelizationStartEpochNum > 0 ||
+            m_dynamicLossScaling || UsesShardedCheckPoints() || m_hogwildThreads > 1 || m_autoAdjustMinibatch ||
+            m_autoLearnRateSearchType == LearningRateSearchAlgorithm::SearchBeforeEpoch)
+        {
+            InvalidArgument("modelParallelSGD cannot be combined with useBufferedAsyncGradientAggregation, overlapGradientAggregation, numBackupWorkers, parallelizationStartEpoch, "
+                            "dynamicLossScaling, shardedCheckpoints, hogwildThreads, autoAdjustMinibatch or autoAdjustLR=searchBeforeEpoch!");
+        }
+        if (!networkLoadedFromCheckpoint)
+            DecorrelateModelParallelWeights();
+    }
+    else
+        SynchronizeInitialModel(net, net->LearnableParameterNodes(criterionNodes[0]));
+
     // precompute mean and invStdDev nodes and save initial model
     // When no precompute, only save if we did not load the model from a 
     // checkpoint but instead built it from a network description
@@ -305,6 +607,8 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // the parallel training nodes from colliding to write the same file
         if ((m_mpi == nullptr) || m_mpi->IsMainNode())
             net->Save(GetModelNameForEpoch(int(startEpoch) - 1));
+        if (!networkLoadedFromCheckpoint)
+            SaveModelParallelShard(GetModelNameForEpoch(int(startEpoch) - 1), learnableNodes, smoothedGradients);
     }
 
     size_t totalTrainingSamplesSeen = 0; // aggregated over all epochs, for logging purposes only
@@ -321,8 +625,14 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                                                      /*out*/ m_prevChosenMinibatchSize);
         if (learnRateInitialized)
             prevLearnRates[startEpoch % m_numPrevLearnRates] = learnRatePerSample;
+        if (networkLoadedFromCheckpoint)
+            LoadModelParallelShard(GetModelNameForEpoch(int(startEpoch) - 1), learnableNodes, smoothedGradients);
     }
 
+    // continue the start epoch where its last mid-epoch checkpoint left off
+    if (m_numMBsToCheckpoint > 0)
+        TryLoadMidEpochCheckPoint(startEpoch, net, smoothedGradients);
+
     if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::AdjustAfterEpoch &&
         !learnRateInitialized && m_learningRatesParam.size() <= startEpoch)
     {
@@ -339,7 +649,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
 
     // pass user config on memory allocation for convolution operations to the Network
     ComputationNetwork::SetMaxTempMemSizeForCNN(net, criterionNodes[0], m_maxTempMemSizeInSamplesForCNN);
-    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode)
+    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode && refNet)
     {
         ComputationNetwork::SetMaxTempMemSizeForCNN(refNet, refNode, m_maxTempMemSizeInSamplesForCNN);
     }
@@ -368,13 +678,28 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // We use the same seed across workers until parallel training kicks in to ensure that the workers have identical models
         size_t parallelWorkerIdx = ((m_mpi == nullptr) || !UsingParallelTrain(i)) ? 0 : m_mpi->CurrentNodeRank();
         size_t dropoutRandSeedBase = (parallelWorkerIdx * m_maxEpochs) + i;
-        ComputationNetwork::SetDropoutRate<ElemType>(net, criterionNodes[0], m_dropoutRates[i], prevDropoutRate, dropoutRandSeedBase);
+        // changing these edits nodes that a checkpoint written in the background reads
+        if (m_dropoutRates[i] != prevDropoutRate ||
+            m_batchNormalizationTimeConstant[i] != prevNormalizationTimeConstant ||
+            m_batchNormalizationBlendTimeConstant[i] != prevNormalizationBlendTimeConstant)
+        {
+            WaitForCheckPointWrite(/*synchronizeWorkers=*/false);
+        }
+        ComputationNetwork::SetDropoutRate<ElemType>(net, criterionNodes[0], m_dropoutRates[i], prevDropoutRate, dropoutRandSeedBase, m_counterBasedDropout);
         ComputationNetwork::SetBatchNormalizationTimeConstants<ElemType>(net, criterionNodes[0], 
                                                                          m_batchNormalizationTimeConstant[i], prevNormalizationTimeConstant,
                                                                          m_batchNormalizationBlendTimeConstant[i], prevNormalizationBlendTimeConstant);
         
+        // an epoch continued from a mid-epoch checkpoint keeps the learning rate and minibatch size it was started with
+        bool resumingEpoch = m_midEpochCheckPoint && m_midEpochCheckPoint->epoch == i;
+
         // learning rate adjustment
-        if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::None || i < m_learningRatesParam.size())
+        if (resumingEpoch)
+        {
+            learnRatePerSample = m_midEpochCheckPoint->learnRatePerSample;
+            prevLearnRates[i % m_numPrevLearnRates] = learnRatePerSample;
+        }
+        else if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::None || i < m_learningRatesParam.size())
         {
             // BUGBUG: GetNumParallelSequences() returns 1 under certain situations; it seems when restarting from checkpoint
             learnRatePerSample = GetLearningRatePerSample(i /*BUGBUG workaround:*/, trainSetDataReader->GetNumParallelSequencesForFixingBPTTMode());
@@ -387,6 +712,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 largestPrevLearnRatePerSample = max(largestPrevLearnRatePerSample, prevLearnRates[j]);
             }
 
+            // the search reloads the model of the previous epoch, which may still be written in the background
+            WaitForCheckPointWrite(/*synchronizeWorkers=*/true);
+
             // return a reasonable learning rate based on the initial minibatchSize
             double newLearningRatePerSample = SearchForBestLearnRate(net, refNet, refNode, i, learnRatePerSample,
                                                                      trainSetDataReader, featureNodes, labelNodes,
@@ -412,6 +740,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 // the parallel training nodes from colliding to write the same file
                 if ((m_mpi == nullptr) || m_mpi->IsMainNode())
                     net->Save(m_modelPath);
+                SaveModelParallelShard(m_modelPath, learnableNodes, smoothedGradients);
             }
             break;
         }
@@ -423,7 +752,13 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // basis for a set number of epochs.  For epochs after that point, m_mbSize.size(), either
         // we just keep using
         // the last minibatch size, or we use tuning to try and find a better one.
-        if (m_autoAdjustMinibatch && i >= m_mbSize.size())
+        if (resumingEpoch)
+        {
+            chosenMinibatchSize = m_midEpochCheckPoint->minibatchSize;
+            if (m_autoAdjustMinibatch && i >= m_mbSize.size())
+                m_prevChosenMinibatchSize = chosenMinibatchSize;
+        }
+        else if (m_autoAdjustMinibatch && i >= m_mbSize.size())
         {
             size_t numFramesToUseInSearch = m_numMiniBatch4LRSearch[i] * m_mbSize[i];
             if (m_epochSize != requestDataSize)
@@ -433,6 +768,8 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             }
 
             // Use tuning to try and find a better minibatch size
+            // This reloads the model of the previous epoch, which may still be written in the background.
+            WaitForCheckPointWrite(/*synchronizeWorkers=*/true);
             chosenMinibatchSize = AdaptiveMinibatchSizing(net, refNet, refNode, i,
                                                           numFramesToUseInSearch,
                                                           trainSetDataReader, learnRatePerSample,
@@ -475,7 +812,8 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                       evaluationNodes,
                       inputMatrices,
                       learnableNodes, smoothedGradients,
-                      epochCriterion, epochEvalErrors);
+                      epochCriterion, epochEvalErrors,
+                      /*prefixMsg=*/"", /*midEpochCheckPoints=*/true);
         totalTrainingSamplesSeen += epochCriterion.second; // aggregate #training samples, for logging purposes only
 
         timer.Stop();
@@ -493,6 +831,13 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         for (size_t j = 0; j < epochEvalErrors.size(); j++)
             epochEvalErrors[j].LogCriterion(evaluationNodes[j]->NodeName());
         fprintf(stderr, "totalSamplesSeen = %d; learningRatePerSample = %.8g; epochTime=%.6gs\n", (int)totalTrainingSamplesSeen, learnRatePerSample, epochTime);
+        if (m_traceLevel > 0 && net->GetDeviceId() >= 0 && TracingGPUMemoryAllocator::IsCachingEnabled())
+        {
+            let cacheStats = TracingGPUMemoryAllocator::GetCacheStatistics(net->GetDeviceId());
+            LOGPRINTF(stderr, "GPU memory cache: %d hits, %d misses; %.1f MB cached in %d free buffers of %.1f MB allocated\n",
+                      (int) cacheStats.numHits, (int) cacheStats.numMisses, cacheStats.cachedBytes / (1024.0 * 1024.0),
+                      (int) cacheStats.numCachedBuffers, cacheStats.allocatedBytes / (1024.0 * 1024.0));
+        }
 #if 0
         // TODO: This was only printed if >1 eval criterion. Why? Needed?
         LOGPRINTF(stderr, "Finished Epoch[%2d of %d]:     Criterion Node [%ls] Per Sample = %.8g\n",
@@ -507,7 +852,8 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
 
         if (validationSetDataReader != trainSetDataReader && validationSetDataReader != nullptr)
         {
-            SimpleEvaluator<ElemType> evalforvalidation(net, m_mpi, m_enableDistributedMBReading);
+            // (with model parallelism, all workers evaluate all of the data, as the criterion needs all of them for every minibatch)
+            SimpleEvaluator<ElemType> evalforvalidation(net, UsingModelParallelism() ? nullptr : m_mpi, m_enableDistributedMBReading && !UsingModelParallelism());
             vector<wstring> cvSetTrainAndEvalNodes;
             if (criterionNodes.size() > 0)
             {
@@ -538,7 +884,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // broadcast epochCriterion to make sure each processor will have the same learning rate schedule
         if ((GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD 
             ||
-            GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD) 
+            GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD
+            ||
+            GetParallelizationMethod() == ParallelizationMethod::asyncParameterServerSGD) 
             && (m_mpi->NumNodesInUse() > 1))
         {
             m_mpi->Bcast(&epochCriterion.first,  1, m_mpi->MainNodeRank());
@@ -569,6 +917,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 {
                     // roll back
                     auto bestModelPath = GetModelNameForEpoch(i - m_learnRateAdjustInterval);
+                    WaitForCheckPointWrite(/*synchronizeWorkers=*/true);
                     LOGPRINTF(stderr, "Loading (rolling back to) previous model with best training-criterion value: %ls.\n", bestModelPath.c_str());
                     net->RereadPersistableParameters<ElemType>(bestModelPath);
                     LoadCheckPointInfo(i - m_learnRateAdjustInterval,
@@ -577,6 +926,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                                        smoothedGradients,
                                        /*out*/ prevCriterion,
                                        /*out*/ m_prevChosenMinibatchSize);
+                    LoadModelParallelShard(bestModelPath, learnableNodes, smoothedGradients);
                     loadedPrevModel = true;
                 }
             }
@@ -597,6 +947,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                         // the parallel training nodes from colliding to write the same file
                         if ((m_mpi == nullptr) || m_mpi->IsMainNode())
                             net->Save(GetModelNameForEpoch(i, true));
+                        SaveModelParallelShard(GetModelNameForEpoch(i, true), learnableNodes, smoothedGradients);
 
                         LOGPRINTF(stderr, "Finished training and saved final model\n\n");
                         break;
@@ -648,11 +999,26 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             m_mpi->WaitAll();
         }
 
+        // With sharded checkpoints, all workers first write their shards, to which the checkpoint file then refers
+        if (UsesShardedCheckPoints())
+        {
+            EventTracer::Scope scope("SaveCheckPointShard", "io");
+            SaveCheckPointShard(loadedPrevModel ? i - m_learnRateAdjustInterval : i, smoothedGradients);
+            m_mpi->WaitAll();
+        }
+
         // Persist model and check-point info
         if ((m_mpi == nullptr) || m_mpi->IsMainNode())
         {
+            // at most one checkpoint is written at a time, and the files written must be complete before they are deleted
+            WaitForCheckPointWrite(/*synchronizeWorkers=*/false);
+            // the mid-epoch checkpoints of this epoch are obsolete once its checkpoint is written
+            auto midEpochFiles = GetMidEpochCheckPointFiles(i);
             if (loadedPrevModel)
             {
+                for (const auto& file : midEpochFiles)
+                    _wunlink(file.c_str());
+
                 // If previous best model is loaded, we will first remove epochs that lead to worse results
                 for (int j = 1; j < m_learnRateAdjustInterval; j++)
                 {
@@ -660,6 +1026,10 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                     LOGPRINTF(stderr, "SGD: removing model and checkpoint files for epoch %d after rollback to epoch %lu\n", epochToDelete + 1, (size_t)(i - m_learnRateAdjustInterval) + 1);  // report 1 based epoch number
                     _wunlink(GetModelNameForEpoch(epochToDelete).c_str());
                     _wunlink(GetCheckPointFileNameForEpoch(epochToDelete).c_str());
+                    for (size_t shard = 0; UsesShardedCheckPoints() && (shard < m_mpi->NumNodesInUse()); shard++)
+                        _wunlink(GetCheckPointShardFileName(GetCheckPointFileNameForEpoch(epochToDelete), shard).c_str());
+                    for (size_t rank = 1; UsingModelParallelism() && (rank < m_mpi->NumNodesInUse()); rank++)
+                        _wunlink(GetModelParallelShardFileName(GetModelNameForEpoch(epochToDelete), rank).c_str());
                 }
 
                 // Set i back to the loaded model
@@ -669,29 +1039,49 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             }
             else
             {
-                SaveCheckPointInfo(i, totalTrainingSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize);
-                auto modelName = GetModelNameForEpoch(i);
-                LOGPRINTF(stderr, "SGD: Saving checkpoint model '%ls'\n", modelName.c_str());
-                net->Save(modelName);
+                // previous checkpoint files to delete to save space, once this one is written
+                std::vector<wstring> obsoleteFiles;
                 if (!m_keepCheckPointFiles)
                 {
-                    // delete previous checkpoint file to save space
                     if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::AdjustAfterEpoch && m_loadBestModel)
                     {
                         if (epochsSinceLastLearnRateAdjust != 1)
                         {
-                            _wunlink(GetCheckPointFileNameForEpoch(i - 1).c_str());
+                            obsoleteFiles.push_back(GetCheckPointFileNameForEpoch(i - 1));
                         }
                         if (epochsSinceLastLearnRateAdjust == m_learnRateAdjustInterval)
                         {
-                            _wunlink(GetCheckPointFileNameForEpoch(i - m_learnRateAdjustInterval).c_str());
+                            obsoleteFiles.push_back(GetCheckPointFileNameForEpoch(i - m_learnRateAdjustInterval));
                         }
                     }
                     else
                     {
-                        _wunlink(GetCheckPointFileNameForEpoch(i - 1).c_str());
+                        obsoleteFiles.push_back(GetCheckPointFileNameForEpoch(i - 1));
+                    }
+                    for (size_t k = 0, numCheckPointFiles = obsoleteFiles.size(); UsesShardedCheckPoints() && (k < numCheckPointFiles); k++)
+                    {
+                        for (size_t shard = 0; shard < m_mpi->NumNodesInUse(); shard++)
+                            obsoleteFiles.push_back(GetCheckPointShardFileName(obsoleteFiles[k], shard));
                     }
                 }
+
+                obsoleteFiles.insert(obsoleteFiles.end(), midEpochFiles.begin(), midEpochFiles.end());
+
+                auto modelName = GetModelNameForEpoch(i);
+                // the state of model averaging is written by its helper from the live objects, hence synchronously
+                if (m_asyncCheckpointing && !m_pMASGDHelper)
+                {
+                    SaveCheckPointInBackground(net, modelName, i, totalTrainingSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize, obsoleteFiles);
+                }
+                else
+                {
+                    EventTracer::Scope scope("SaveCheckPoint", "io");
+                    SaveCheckPointInfo(i, totalTrainingSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, chosenMinibatchSize);
+                    LOGPRINTF(stderr, "SGD: Saving checkpoint model '%ls'\n", modelName.c_str());
+                    net->Save(modelName);
+                    for (const auto& file : obsoleteFiles)
+                        _wunlink(file.c_str());
+                }
             }
         }
         else
@@ -701,6 +1091,10 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 // Set i back to the loaded model
                 i -= m_learnRateAdjustInterval;
             }
+            else
+            {
+                SaveModelParallelShard(GetModelNameForEpoch(i), learnableNodes, smoothedGradients);
+            }
         }
 
         if (learnRatePerSample < 1e-12)
@@ -711,6 +1105,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     }
     // --- END OF MAIN EPOCH LOOP
 
+    WaitForCheckPointWrite(/*synchronizeWorkers=*/false);
+    EventTracer::Flush();
+
     // Synchronize all ranks before proceeding to ensure that
     // rank 0 has finished writing the model file
     if (m_mpi != nullptr)
@@ -723,7 +1120,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     ProgressTracing::TraceTrainLoss(m_lastFinishedEpochTrainLoss);
 
     // since we linked feature nodes. we need to remove it from the deletion
-    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode != nullptr)
+    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode != nullptr && refNet)
     {
         for (size_t i = 0; i < refFeatureNodes.size(); i++)
         {
@@ -757,8 +1154,21 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                                     std::list<Matrix<ElemType>>& smoothedGradients,
                                     /*out*/ EpochCriterion& epochCriterion,
                                     /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
-                                    const std::string& prefixMsg)
+                                    const std::string& prefixMsg,
+                                    bool midEpochCheckPoints)
 {
+    midEpochCheckPoints = midEpochCheckPoints && m_numMBsToCheckpoint > 0;
+    if (midEpochCheckPoints && (m_hogwildThreads > 1 || UsingModelAggregation(epochNumber) || m_bufferedAsyncGradientAggregation || UsingModelParallelism()))
+    {
+        fprintf(stderr, "WARNING: numMBsToCheckpoint is ignored with hogwildThreads, model averaging, block momentum, asynchronous SGD, "
+                        "useBufferedAsyncGradientAggregation and modelParallelSGD, whose state is not in the mid-epoch checkpoint.\n");
+        midEpochCheckPoints = false;
+    }
+
+    if (m_hogwildThreads > 1)
+        return TrainOneEpochHogwild(net, epochNumber, epochSize, trainSetDataReader, learnRatePerSample, tunedMBSize, featureNodes, labelNodes,
+                                    criterionNodes, evaluationNodes, inputMatrices, learnableNodes, smoothedGradients, epochCriterion, epochEvalErrors);
+
     ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
 
     // bring our 'out' values into consistent state
@@ -804,9 +1214,31 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         trainSetDataReader->StartMinibatchLoop(tunedMBSize, epochNumber, epochSize);
     }
 
+    // continue where the mid-epoch checkpoint of this epoch left off
+    // Without gradient aggregation, the criteria of the minibatches before it are added to the accumulators when read out.
+    EpochCriterion epochCriterionBeforeResume(0);
+    std::vector<EpochCriterion> epochEvalErrorsBeforeResume(epochEvalErrors.size(), EpochCriterion(0));
+    if (midEpochCheckPoints && m_midEpochCheckPoint && m_midEpochCheckPoint->epoch == epochNumber)
+    {
+        trainSetDataReader->SetState(m_midEpochCheckPoint->readerState);
+        numMBsRun         = (int)m_midEpochCheckPoint->numMBsRun;
+        totalEpochSamples = m_midEpochCheckPoint->totalEpochSamples;
+        epochCriterion    = m_midEpochCheckPoint->epochCriterion;
+        epochEvalErrors   = m_midEpochCheckPoint->epochEvalErrors;
+        m_lossScale       = m_midEpochCheckPoint->lossScale;
+        m_numUpdatesSinceLossScaleChange = m_midEpochCheckPoint->numUpdatesSinceLossScaleChange;
+        if (!useGradientAggregation)
+        {
+            epochCriterionBeforeResume  = epochCriterion;
+            epochEvalErrorsBeforeResume = epochEvalErrors;
+        }
+        LOGPRINTF(stderr, "Continuing Epoch %d after minibatch %d from its mid-epoch checkpoint.\n", epochNumber + 1, numMBsRun);
+        m_midEpochCheckPoint.reset();
+    }
+
     net->StartEvaluateMinibatchLoop(evaluationNodes);
     net->StartEvaluateMinibatchLoop(criterionNodes);
-    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode)
+    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode && refNet)
     {
         refNet->StartEvaluateMinibatchLoop(refNode);
     }
@@ -817,8 +1249,43 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     size_t numSubminibatchesNeeded = DataReaderHelpers::GetNumSubminibatchesNeeded<ElemType>(trainSetDataReader, m_maxSamplesInRAM, m_numSubminiBatches, tunedMBSize);
 
     // this is non-trivial, we need a manager object to handle this
-    if (numSubminibatchesNeeded > 1)
+    // (also to recover from running out of GPU memory, which needs to know the stateful nodes)
+    bool mayRecoverFromOutOfMemory = m_recoverFromOutOfMemory && net->GetDeviceId() >= 0;
+    if (numSubminibatchesNeeded > 1 || m_autoSubminibatches || mayRecoverFromOutOfMemory)
         smbDispatcher.Init(net, learnableNodes, criterionNodes, evaluationNodes);
+    bool subminibatchesPerMinibatch = m_autoSubminibatches && !smbDispatcher.HasStatefulNodes();
+    std::vector<ComputationNodeBasePtr> inputNodes(featureNodes.begin(), featureNodes.end());
+
+    // With a model-parallel output layer, all workers run the criterion of each minibatch together; those without data
+    // take part through ForwardAndBackpropWithoutLocalData(). Sub-minibatches, whose number may differ between the workers, cannot be used.
+    shared_ptr<ModelParallelCrossEntropyWithSoftmaxNode<ElemType>> modelParallelCriterion;
+    if (UsingModelParallelism())
+    {
+        if (numSubminibatchesNeeded > 1 || m_autoSubminibatches)
+            InvalidArgument("modelParallelSGD cannot be combined with maxSamplesInRAM, numSubminibatches or autoSubminibatches!");
+        modelParallelCriterion = dynamic_pointer_cast<ModelParallelCrossEntropyWithSoftmaxNode<ElemType>>(criterionNodes[0]);
+    }
+    inputNodes.insert(inputNodes.end(), labelNodes.begin(), labelNodes.end());
+
+    // Synchronized batch normalization statistics need all workers to run every minibatch. They are not synchronized for the
+    // minibatches that some worker has no data for, nor with sub-minibatches, whose number may differ between the workers.
+    bool syncBatchNormalization = useGradientAggregation && m_syncBatchNormalizationStatistics && numSubminibatchesNeeded <= 1 && !subminibatchesPerMinibatch;
+
+    // A minibatch that runs out of GPU memory is retried in more sub-minibatches; for the same reasons, not with model parallelism
+    // or synchronized batch normalization, nor if gradients may already be on their way to the other workers, nor with stateful nodes.
+    // Nor with batch normalization at all: its forward propagation updates the running statistics, which the retry would count twice.
+    bool recoverFromOutOfMemory = mayRecoverFromOutOfMemory && !UsingModelParallelism() && !syncBatchNormalization && !smbDispatcher.HasStatefulNodes() &&
+                                  !(useGradientAggregation && m_distGradAgg->OverlapsAggregationWithBackprop()) &&
+                                  net->GetNodesWithType(OperationNameOf(BatchNormalizationNode), criterionNodes[0]).empty();
+    if (mayRecoverFromOutOfMemory && !recoverFromOutOfMemory)
+        fprintf(stderr, "WARNING: recoverFromOutOfMemory is ignored with this network or parallelization.\n");
+    bool batchNormalizationSynchronized = false;
+    if (m_syncBatchNormalizationStatistics)
+    {
+        if (useGradientAggregation && !syncBatchNormalization)
+            fprintf(stderr, "WARNING: syncBatchNormalizationStatistics is ignored with sub-minibatches.\n");
+        ComputationNetwork::SetBatchNormalizationSynchronization<ElemType>(net, criterionNodes[0], nullptr);
+    }
 
     // The following is a special feature only supported by the Kaldi2Reader for more efficient sequence training.
     // This attemps to compute the error signal for the whole utterance, which will
@@ -839,6 +1306,27 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         {
             fprintf(stderr, ", BufferedAsyncGradientAggregation is ENABLED");
         }
+
+        if (m_sparseGradientDensity > 0)
+        {
+            fprintf(stderr, ", SparseGradientDensity = %g", m_sparseGradientDensity);
+        }
+
+        if (m_gradientBucketSizeInBytes > 0)
+        {
+            fprintf(stderr, ", aggregation overlapped with backprop in buckets of %d bytes", (int) m_gradientBucketSizeInBytes);
+        }
+
+        if (m_gradientCommunicationBackend == GradientCommunicationBackend::cudaAwareMPI)
+        {
+            fprintf(stderr, ", communication through CUDA-aware MPI");
+            if (!MPIWrapper::IsCUDAAware())
+                fprintf(stderr, " (not confirmed by the MPI library)");
+        }
+        else if (m_gradientCommunicationBackend == GradientCommunicationBackend::nccl)
+        {
+            fprintf(stderr, ", communication through NCCL");
+        }
     }
 
     if (useDistributedMBReading)
@@ -846,7 +1334,16 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         fprintf(stderr, ", distributed reading is ENABLED");
     }
 
-    if (numSubminibatchesNeeded > 1)
+    if (syncBatchNormalization)
+    {
+        fprintf(stderr, ", batch normalization statistics are synchronized");
+    }
+
+    if (subminibatchesPerMinibatch)
+    {
+        fprintf(stderr, ", with subminibatches sized to the GPU memory");
+    }
+    else if (numSubminibatchesNeeded > 1)
     {
         if (m_maxSamplesInRAM < SIZE_MAX)
             fprintf(stderr, ", with maximum %d samples in RAM", (int)m_maxSamplesInRAM);
@@ -855,6 +1352,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     }
     fprintf(stderr, ".\n");
 
+    MatrixTransferStatistics::Reset();
+    MatrixTransferStatistics::SetCheck(m_implicitTransferCheck);
+
     Timer timer;
     timer.Start();
 
@@ -864,18 +1364,36 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     CriterionAccumulator<ElemType> localEpochCriterion(1, net->GetDeviceId());
     CriterionAccumulator<ElemType> localEpochEvalErrors(epochEvalErrors.size(), net->GetDeviceId());
 
+    // With useCudaGraphs, the forward and backward pass is captured as a GPU graph and replayed for as long as the
+    // minibatches keep their shapes. This only applies to steps whose work does not depend on anything but the inputs.
+    bool useStepGraph = m_useCudaGraphs && net->GetDeviceId() >= 0 && GPUGraph::IsSupported() &&
+                        !useGradientAggregation && !m_doGradientCheck && !m_needAdaptRegularization && !m_dynamicLossScaling &&
+                        numSubminibatchesNeeded <= 1 && !m_autoSubminibatches && !modelParallelCriterion && !syncBatchNormalization &&
+                        net->GetNodesWithType(OperationNameOf(DropoutNode), criterionNodes[0]).empty() &&
+                        net->GetNodesWithType(OperationNameOf(BatchNormalizationNode), criterionNodes[0]).empty();
+    if (m_useCudaGraphs && !useStepGraph)
+        fprintf(stderr, "WARNING: useCudaGraphs is ignored, since the network or the training setup does not allow to replay its steps.\n");
+    ComputationNetwork::StepGraph stepGraph(net->GetDeviceId());
+    std::vector<ComputationNodeBasePtr> stepGraphInputNodes(featureNodes.begin(), featureNodes.end());
+    stepGraphInputNodes.insert(stepGraphInputNodes.end(), labelNodes.begin(), labelNodes.end());
+
     // --- MAIN MINIBATCH LOOP
 
     // for differential logging, we keep the previous criterion values around
     EpochCriterion         epochCriterionLastLogged  = epochCriterion;
     vector<EpochCriterion> epochEvalErrorsLastLogged = epochEvalErrors;
 
+    // and the counters of the reader pipeline, if the reader keeps them
+    ReaderStatistics readerStatisticsLastLogged;
+    bool hasReaderStatistics = trainSetDataReader->GetReaderStatistics(readerStatisticsLastLogged);
+
     bool noMoreSamplesToProcess = false;
     for (;;)
     {
         // get minibatch
         // TODO: is it guaranteed that the GPU is already completed at this point, is it safe to overwrite the buffers?
         size_t actualMBSize = 0;
+        size_t samplesInRAM = 0; // of the largest sub-minibatch
         bool wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, net, criterionNodes[0],
                                                                                 useDistributedMBReading, useParallelTrain, *inputMatrices, actualMBSize, m_mpi);
         if (!wasDataRead && (!useDistributedMBReading || noMoreSamplesToProcess)) // in case of distributed reading, we do a few more loops until all ranks have completed
@@ -889,6 +1407,26 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
         nSamplesSinceLastModelSync += actualMBSize;
 
+        bool runCriterionWithoutLocalData = false;
+        if (modelParallelCriterion)
+        {
+            int numWorkersWithData = actualMBSize > 0 ? 1 : 0;
+            m_mpi->AllReduce(&numWorkersWithData, 1);
+            runCriterionWithoutLocalData = (actualMBSize == 0) && (numWorkersWithData > 0);
+        }
+
+        if (syncBatchNormalization)
+        {
+            int numWorkersWithData = actualMBSize > 0 ? 1 : 0;
+            m_mpi->AllReduce(&numWorkersWithData, 1);
+            bool synchronize = numWorkersWithData == (int)m_mpi->NumNodesInUse();
+            if (synchronize != batchNormalizationSynchronized)
+            {
+                ComputationNetwork::SetBatchNormalizationSynchronization<ElemType>(net, criterionNodes[0], synchronize ? m_mpi : nullptr);
+                batchNormalizationSynchronized = synchronize;
+            }
+        }
+
         // Dropout nodes have an implicit input in the form of the random mask that is applied to its explicit input
         // This mask is regerated every minibatch and hence dropout nodes with a non-zero dropout rate must me marked outdated
         // w.r.t. inputs to force evaluation in each minibatch
@@ -912,13 +1450,16 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             // TODO: currently we only support one node for regularization
             if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode)
             {
-                size_t actualMBSize2 = refNet->DetermineActualMBSizeFromFeatures();
-                refNet->GetMBLayoutPtrOfNetwork()->CopyFrom(net->GetMBLayoutPtrOfNetwork()); // TODO: This is UNTESTED (before this was missing, seemingly inconsistently)
+                if (refNet) // (otherwise refNode is the adaptationRegRefInput, which was just read with the minibatch)
+                {
+                    size_t actualMBSize2 = refNet->DetermineActualMBSizeFromFeatures();
+                    refNet->GetMBLayoutPtrOfNetwork()->CopyFrom(net->GetMBLayoutPtrOfNetwork()); // TODO: This is UNTESTED (before this was missing, seemingly inconsistently)
 
-                if (actualMBSize2 != actualMBSize)
-                    LogicError("TrainOneEpoch: refNet has different MB size than main net??");
+                    if (actualMBSize2 != actualMBSize)
+                        LogicError("TrainOneEpoch: refNet has different MB size than main net??");
 
-                refNet->ForwardProp(refNode);
+                    refNet->ForwardProp(refNode);
+                }
                 Matrix<ElemType>::ScaleAndAdd((ElemType) m_adaptationRegWeight,
                                               dynamic_pointer_cast<ComputationNode<ElemType>>(refNode)->Value(),
                                               (ElemType)(1.0 - m_adaptationRegWeight),
@@ -929,44 +1470,108 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
             // We optionally break the minibatch into sub-minibatches.
             // This, when enabled, is used when a full minibatch does not fit into GPU RAM.
-            size_t actualNumSubminibatches = numSubminibatchesNeeded <= 1 ? 1 : smbDispatcher.GetMinibatchIntoCache(*trainSetDataReader, *net, *inputMatrices, numSubminibatchesNeeded);
-            for (size_t ismb = 0; ismb < actualNumSubminibatches; ismb++)
+            // BUGBUG (Issue #95): Access to net MBLayout can no longer be done if we have multiple input layouts
+            let& pMBLayout = net->GetMBLayoutPtrOfNetwork();
+            if (subminibatchesPerMinibatch)
+                numSubminibatchesNeeded = m_maxSamplesInRAM < SIZE_MAX ? (pMBLayout->GetNumCols() + m_maxSamplesInRAM - 1) / m_maxSamplesInRAM : 1;
+            size_t numSubminibatchesToTry = numSubminibatchesNeeded;
+            size_t actualNumSubminibatches = 1;
+            NodeProfiler::BeginMinibatch();
+            for (;;) // until the minibatch fits into the device memory, see m_recoverFromOutOfMemory
             {
-                if (actualNumSubminibatches > 1)
+                try
                 {
-                    smbDispatcher.GetSubMinibatchToNet(ismb); // get sub-minibatch from full-size one
-                    ComputationNetwork::BumpEvalTimeStamp(featureNodes);
-                    ComputationNetwork::BumpEvalTimeStamp(labelNodes);
-                }
-
-                // ===========================================================
-                // forward prop for evaluate eval nodes
-                // ===========================================================
-
-                // compute eval node first since when gradient is computed the forward function values
-                // may be changed and need to be recomputed when gradient and function value share the same matrix
-                net->ForwardProp(evaluationNodes); // the bulk of this evaluation is reused in ComputeGradient() below
-
-                // ===========================================================
-                // forward prop for training criterion
-                // ===========================================================
-
-                net->ForwardProp(criterionNodes[0]);
-
-                // ===========================================================
-                // backprop
-                // ===========================================================
-
-                if (learnRatePerSample > 0.01 * m_minLearnRate) // only compute gradient when learning rate is large enough
-                    net->Backprop(criterionNodes[0]);
+                    actualNumSubminibatches = numSubminibatchesToTry <= 1 ? 1 : smbDispatcher.GetMinibatchIntoCache(*trainSetDataReader, *net, *inputMatrices, numSubminibatchesToTry);
+                    // (sub-minibatches are cut at the parallel sequences)
+                    samplesInRAM = pMBLayout->GetNumTimeSteps() * ((pMBLayout->GetNumParallelSequences() + actualNumSubminibatches - 1) / actualNumSubminibatches);
+                    for (size_t ismb = 0; ismb < actualNumSubminibatches; ismb++)
+                    {
+                        if (actualNumSubminibatches > 1)
+                        {
+                            smbDispatcher.GetSubMinibatchToNet(ismb); // get sub-minibatch from full-size one
+                            ComputationNetwork::BumpEvalTimeStamp(featureNodes);
+                            ComputationNetwork::BumpEvalTimeStamp(labelNodes);
+                        }
 
-                // house-keeping for sub-minibatching
-                if (actualNumSubminibatches > 1)
-                    smbDispatcher.DoneWithCurrentSubMinibatch(ismb); // page state out
-            }                                                        // end sub-minibatch loop
+                        bool computeGradient = learnRatePerSample > 0.01 * m_minLearnRate;
+                        auto forwardAndBackprop = [&]()
+                        {
+                            // ===========================================================
+                            // forward prop for evaluate eval nodes
+                            // ===========================================================
+
+                            // compute eval node first since when gradient is computed the forward function values
+                            // may be changed and need to be recomputed when gradient and function value share the same matrix
+                            {
+                                EventTracer::Scope scope("ForwardProp", "compute");
+                                net->ForwardProp(evaluationNodes); // the bulk of this evaluation is reused in ComputeGradient() below
+                            }
+
+                            // ===========================================================
+                            // forward prop for training criterion
+                            // ===========================================================
+
+                            {
+                                EventTracer::Scope scope("ForwardProp", "compute");
+                                net->ForwardProp(criterionNodes[0]);
+                            }
+
+                            // ===========================================================
+                            // backprop
+                            // ===========================================================
+
+                            if (computeGradient) // only compute gradient when learning rate is large enough
+                            {
+                                // with overlapped aggregation, each gradient starts being aggregated as soon as it is complete
+                                // (not with sub-minibatches, whose gradients are accumulated outside of the nodes)
+                                std::function<void(const ComputationNodeBasePtr&)> onParameterGradientCompleted;
+                                if (useGradientAggregation && m_distGradAgg->OverlapsAggregationWithBackprop() && actualNumSubminibatches <= 1)
+                                {
+                                    onParameterGradientCompleted = [this](const ComputationNodeBasePtr& node)
+                                    {
+                                        m_distGradAgg->OnGradientCompleted(&dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient());
+                                    };
+                                }
+                                EventTracer::Scope scope("Backprop", "compute");
+                                net->Backprop(criterionNodes[0], m_dynamicLossScaling ? m_lossScale : 1.0, onParameterGradientCompleted);
+                            }
+                        };
+                        if (useStepGraph && actualNumSubminibatches <= 1)
+                            stepGraph.Run(stepGraphInputNodes, { computeGradient ? 1.0 : 0.0 }, forwardAndBackprop);
+                        else
+                            forwardAndBackprop();
+
+                        // house-keeping for sub-minibatching
+                        if (actualNumSubminibatches > 1)
+                            smbDispatcher.DoneWithCurrentSubMinibatch(ismb); // page state out
+                    } // end sub-minibatch loop
+                    break;
+                }
+                catch (const OutOfDeviceMemoryError&)
+                {
+                    if (!recoverFromOutOfMemory)
+                        throw;
+                    if (actualNumSubminibatches > 1)
+                        smbDispatcher.AbandonCurrentMinibatch();
+                    if (actualNumSubminibatches >= pMBLayout->GetNumParallelSequences()) // cannot be split any further
+                        throw;
+                    numSubminibatchesToTry = 2 * actualNumSubminibatches;
+                    fprintf(stderr, "WARNING: Out of GPU memory in minibatch %d of epoch %d (%d samples), retrying it in %d sub-minibatches.\n",
+                            (int) numMBsRun + 1, (int) epochNumber + 1, (int) pMBLayout->GetNumCols(), (int) numSubminibatchesToTry);
+                    net->ReleaseSharedMatrixBuffers(); // (which also drops values that are up to date, so all are computed again)
+                    net->ResetEvalTimeStamps();
+                    TracingGPUMemoryAllocator::ReleaseCachedMemory(net->GetDeviceId());
+                }
+            }
+            NodeProfiler::EndMinibatch();
             if (actualNumSubminibatches > 1)
                 smbDispatcher.DoneWithCurrentMinibatch();
         } // if (actualMBSize > 0)
+        else if (runCriterionWithoutLocalData)
+        {
+            EventTracer::Scope scope("ForwardProp", "compute");
+            modelParallelCriterion->ForwardAndBackpropWithoutLocalData(learnRatePerSample > 0.01 * m_minLearnRate);
+        }
 
         // for momentum/clipping/regularization/etc., as well as for progress and statistics, we should only count frames that are not gaps
         // #samples according to the default dynamic axis, for use with criterion nodes that do not have an MBLayout
@@ -998,7 +1603,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++)
                 {
                     ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
-                    if (node->IsParameterUpdateRequired())
+                    if (node->IsParameterUpdateRequired() && !IsModelParallelWeight(node)) // (the gradients of the weight shards are complete)
                     {
                         Matrix<ElemType>* currParamsGradient = &(node->Gradient()); // TODO: we can use shared_ptrs now
 
@@ -1027,7 +1632,13 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             for (size_t i = 0; i < evaluationNodes.size(); i++)
                 m_gradHeader->evalErrors[i] = localEpochEvalErrors.GetCriterion(i);
 
-            bool samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader.get(), epochNumber);
+            bool samplesProcessed;
+            {
+                EventTracer::Scope scope("AggregateGradients", "communication");
+                static auto& aggregationSeconds = Metrics::GetHistogram("cntk_gradient_aggregation_seconds", "Wall time of the gradient aggregation of a minibatch");
+                Metrics::Timer metricsTimer(aggregationSeconds);
+                samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader.get(), epochNumber);
+            }
             noMoreSamplesToProcess = !samplesProcessed;
 
             aggregateNumSamples          = m_gradHeader->numSamples;
@@ -1037,9 +1648,15 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 epochEvalErrors[i] += m_gradHeader->evalErrors[i];
         }
 
+        // with loss scaling, bring the (aggregated) gradients back to their scale, or skip this update if they overflowed
+        bool gradientsFinite = true;
+        if (m_dynamicLossScaling && (aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
+            gradientsFinite = UnscaleGradients(learnableNodes);
+
         // update model parameters
-        if ((aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
+        if (gradientsFinite && (aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
         {
+            EventTracer::Scope scope("UpdateWeights", "compute");
 #if 1       // BUGBUG: We must skip gaps in our momentum, clipping, regularization etc. criteria.
             // This will break test cases. So for now, we will only enable this for per-sample criteria.
             size_t numSamplesInMinibatch = aggregateNumSamples;
@@ -1050,35 +1667,49 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             if (numSamplesInMinibatch != aggregateNumSamples)
                 fprintf(stderr, "SGD: using true #samples %d instead of MB size %d\n", (int)numSamplesInMinibatch, (int)aggregateNumSamples);
 #endif
-            auto smoothedGradientIter = smoothedGradients.begin();
-            for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+            if (m_fusedParameterUpdate && GradUpdateType() == GradientsUpdateType::None && GradientUpdateNoiseStd() == 0)
+            {
+                // BUGBUG (Issue #95): Access to net MBLayout can no longer be done if we have multiple input layouts
+                UpdateWeightsMultiTensor(learnableNodes, smoothedGradients, learnRatePerSample,
+                                         GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences()), numSamplesInMinibatch);
+            }
+            else
             {
-                ComputationNodeBasePtr node = *nodeIter;
-                if (node->IsParameterUpdateRequired())
+                auto smoothedGradientIter = smoothedGradients.begin();
+                for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
                 {
-                    Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
+                    ComputationNodeBasePtr node = *nodeIter;
+                    if (node->IsParameterUpdateRequired())
+                    {
+                        Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
 #ifdef _DEBUG
-                    if (smoothedGradient.HasNan("TrainOneEpoch/UpdateWeights(): "))
-                        LogicError("%ls %ls operation has NaNs in smoothedGradient.", node->NodeName().c_str(), node->OperationName().c_str());
+                        if (smoothedGradient.HasNan("TrainOneEpoch/UpdateWeights(): "))
+                            LogicError("%ls %ls operation has NaNs in smoothedGradient.", node->NodeName().c_str(), node->OperationName().c_str());
 #endif
-                    // BUGBUG (Issue #95): Access to net MBLayout can no longer be done if we have multiple input layouts
-                    UpdateWeights(node, smoothedGradient, learnRatePerSample,
-                                  GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences()), numSamplesInMinibatch,
-                                  m_L2RegWeight, m_L1RegWeight,
-                                  m_needAveMultiplier, m_useNesterovMomentum);
+                        // BUGBUG (Issue #95): Access to net MBLayout can no longer be done if we have multiple input layouts
+                        UpdateWeights(node, smoothedGradient, learnRatePerSample,
+                                      GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences()), numSamplesInMinibatch,
+                                      m_L2RegWeight, m_L1RegWeight,
+                                      m_needAveMultiplier, m_useNesterovMomentum);
 #ifdef _DEBUG
-                    if (dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().HasNan("TrainOneEpoch/UpdateWeights(): "))
-                        LogicError("%ls %ls operation has NaNs in functionValues after parameter update.", node->NodeName().c_str(), node->OperationName().c_str());
+                        if (dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().HasNan("TrainOneEpoch/UpdateWeights(): "))
+                            LogicError("%ls %ls operation has NaNs in functionValues after parameter update.", node->NodeName().c_str(), node->OperationName().c_str());
 #endif
+                    }
                 }
             }
         }
 
+        // the peak memory of this minibatch is known now, as it is counted when the buffers are allocated
+        if (m_autoSubminibatches)
+            FitMaxSamplesInRAMToPeakMemory(net, learnableNodes, inputNodes, samplesInRAM);
+
         // aggregation by model averaging or block momentum 
         if (useModelAggregation)
         {
             if (nSamplesSinceLastModelSync >= blockSizePerWorker)
             {
+                EventTracer::Scope scope("ModelAggregation", "communication");
                 bool synced = m_pMASGDHelper->OnArrivingAtSyncPoint(learnableNodes, smoothedGradients, nSamplesSinceLastModelSync);
                 if (synced)
                 {
@@ -1096,6 +1727,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         numMBsRun++;
 
         totalTimeInMBs += timer.ElapsedSeconds();
+        UpdateMinibatchMetrics(net->GetDeviceId(), actualMBSize, timer.ElapsedSeconds());
         //trainSamplesSinceLastLogged += (int)aggregateNumSamplesWithLabel; // now inside epochCriterionLastLogged
 
         // log
@@ -1108,8 +1740,12 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 // if no aggregation, we directly get the values from the minibatch accumulators
                 timer.Restart();
                 epochCriterion = localEpochCriterion.GetCriterion(0);
+                epochCriterion += epochCriterionBeforeResume;
                 for (size_t i = 0; i < epochEvalErrors.size(); i++)
+                {
                     epochEvalErrors[i] = localEpochEvalErrors.GetCriterion(i);
+                    epochEvalErrors[i] += epochEvalErrorsBeforeResume[i];
+                }
                 timer.Stop();
 
                 // Add the last trailing compute
@@ -1139,6 +1775,17 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
             // progress tracing for compute cluster management
             let wasProgressPrinted = ProgressTracing::TraceProgressPercentage(epochNumber, mbProg, false);
+            static auto& samplesPerSecond = Metrics::GetGauge("cntk_train_samples_per_second", "Training samples per second of this worker, over the minibatches since the last progress log");
+            samplesPerSecond.Set(trainSamplesSinceLastLogged / totalTimeInMBs);
+            ReaderStatistics readerMetricsStatistics;
+            if (hasReaderStatistics && trainSetDataReader->GetReaderStatistics(readerMetricsStatistics))
+            {
+                // the reader counters live in the reader module, so they are brought over here
+                static auto& readerStallSeconds = Metrics::GetGauge("cntk_reader_stall_seconds", "Total time the training waited for the reader to deliver a prefetched minibatch");
+                static auto& readerBytes = Metrics::GetGauge("cntk_reader_bytes_read", "Total bytes the reader read from its input files");
+                readerStallSeconds.Set(readerMetricsStatistics.m_prefetchWaitSeconds);
+                readerBytes.Set((double) readerMetricsStatistics.m_bytesRead);
+            }
 
             // progress tracing for regular log
             if (m_traceLevel > 0)
@@ -1156,6 +1803,21 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
                 fprintf(stderr, ("time = " + GeneratePaddedFloatOrExpFormat(0, 4, totalTimeInMBs) + "s; samplesPerSecond = %.1f\n").c_str(),
                         totalTimeInMBs, trainSamplesSinceLastLogged / totalTimeInMBs);
+
+                // where the reader spent its time since the last log, on a line of its own (which the test baselines do not match)
+                ReaderStatistics readerStatistics;
+                if (hasReaderStatistics && trainSetDataReader->GetReaderStatistics(readerStatistics))
+                {
+                    let readerStatisticsSinceLastLogged = readerStatistics - readerStatisticsLastLogged;
+                    PREPENDTS(stderr);
+                    fprintf(stderr, "%s Reader: chunkLoad = %.3fs; transform = %.3fs; pack = %.3fs; prefetchWait = %.3fs; chunkCache = %d hits, %d misses; read = %.1f MB\n",
+                            prefixMsg.c_str(),
+                            readerStatisticsSinceLastLogged.m_chunkLoadSeconds, readerStatisticsSinceLastLogged.m_transformSeconds,
+                            readerStatisticsSinceLastLogged.m_packSeconds, readerStatisticsSinceLastLogged.m_prefetchWaitSeconds,
+                            (int)readerStatisticsSinceLastLogged.m_chunkCacheHits, (int)readerStatisticsSinceLastLogged.m_chunkCacheMisses,
+                            readerStatisticsSinceLastLogged.m_bytesRead / 1e6);
+                    readerStatisticsLastLogged = readerStatistics;
+                }
             }
 
             // progress tracing for compute cluster management
@@ -1190,24 +1852,79 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         // TODO: move the two-forward-pass support out of the reader.
         AttemptUtteranceDerivativeFeatures(net, trainSetDataReader, featureNodes, inputMatrices);
 
+        // mid-epoch checkpoint, if all workers' readers can tell their position
+        if (midEpochCheckPoints && (numMBsRun % m_numMBsToCheckpoint == 0))
+        {
+            MidEpochCheckPoint checkPoint;
+            int noReaderState = trainSetDataReader->GetState(checkPoint.readerState) ? 0 : 1;
+            if (m_mpi != nullptr)
+                m_mpi->AllReduceMax(&noReaderState, 1);
+            if (noReaderState)
+            {
+                fprintf(stderr, "WARNING: numMBsToCheckpoint is ignored, since the reader cannot restore its position in the epoch.\n");
+                midEpochCheckPoints = false;
+            }
+            else
+            {
+                checkPoint.epoch             = epochNumber;
+                checkPoint.numMBsRun         = numMBsRun;
+                checkPoint.numWorkers        = (m_mpi == nullptr) ? 1 : m_mpi->NumNodesInUse();
+                checkPoint.totalEpochSamples = totalEpochSamples;
+                if (!useGradientAggregation)
+                {
+                    epochCriterion = localEpochCriterion.GetCriterion(0);
+                    epochCriterion += epochCriterionBeforeResume;
+                    for (size_t i = 0; i < epochEvalErrors.size(); i++)
+                    {
+                        epochEvalErrors[i] = localEpochEvalErrors.GetCriterion(i);
+                        epochEvalErrors[i] += epochEvalErrorsBeforeResume[i];
+                    }
+                }
+                checkPoint.epochCriterion     = epochCriterion;
+                checkPoint.epochEvalErrors    = epochEvalErrors;
+                checkPoint.learnRatePerSample = learnRatePerSample;
+                checkPoint.minibatchSize      = tunedMBSize;
+                checkPoint.lossScale          = m_lossScale;
+                checkPoint.numUpdatesSinceLossScaleChange = m_numUpdatesSinceLossScaleChange;
+                EventTracer::Scope scope("SaveMidEpochCheckPoint", "io");
+                SaveMidEpochCheckPoint(net, checkPoint, smoothedGradients);
+            }
+        }
+
         profiler.NextSample();
     }
 
     // --- END MAIN MINIBATCH LOOP
 
+    MatrixTransferStatistics::SetCheck(MatrixTransferCheck::none);
+    if (MatrixTransferStatistics::GetTotal().numTransfers > 0 && (m_traceLevel > 0 || m_implicitTransferCheck != MatrixTransferCheck::none))
+        MatrixTransferStatistics::Print(stderr);
+
+    if (NodeProfiler::IsEnabled())
+    {
+        NodeProfiler::PrintStatistics(stderr);
+        NodeProfiler::WriteTrace();
+    }
+
     if (useModelAggregation )
     {
+        EventTracer::Scope scope("ModelAggregation", "communication");
         m_pMASGDHelper->OnEpochEnd(learnableNodes, smoothedGradients, nSamplesSinceLastModelSync);
         nSamplesSinceLastModelSync = 0;
     }
+    EventTracer::Flush(); // (rewritten after each epoch, so that a killed job leaves a trace)
 
     // hoist the accumulated criterion value from GPU side to our 'out'  variables
     // (unless we useGradientAggregation, in which case they are accumulated in the 'out' variables directly)
     if (!useGradientAggregation)
     {
         epochCriterion = localEpochCriterion.GetCriterion(0);
+        epochCriterion += epochCriterionBeforeResume;
         for (size_t i = 0; i < epochEvalErrors.size(); i++)
+        {
             epochEvalErrors[i] = localEpochEvalErrors.GetCriterion(i);
+            epochEvalErrors[i] += epochEvalErrorsBeforeResume[i];
+        }
     }
 
     // in case of model averaging, do one more final aggregation of criteria
@@ -1247,42 +1964,316 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 }
 
 // -----------------------------------------------------------------------
-// subroutines and helpers follow below
+// TrainOneEpochHogwild() -- train one epoch with lock-free updates from multiple threads (hogwildThreads)
 // -----------------------------------------------------------------------
 
-static double MomentumPerMB(double momentumPerSample, size_t minibatchSize)
-{
-    return pow(momentumPerSample, minibatchSize);
-}
-
-// Get{Train,Eval}CriterionNodes() return a reference that is, unfortunately, dependent on the network.
-// So we hold those inside here. Not very nice. Also not thread-safe. This may go away once we fix sequence-to-sequence models properly.
-// TODO: merge them into one.
-static map<ComputationNetworkPtr, vector<ComputationNodeBasePtr>> tmpCriterionNodeSets;
-// TODO: test this, then remove this comment
-
 template <class ElemType>
-const std::vector<ComputationNodeBasePtr>& SGD<ElemType>::GetTrainCriterionNodes(ComputationNetworkPtr net)
+void SGD<ElemType>::CreateHogwildReplicas(ComputationNetworkPtr net,
+                                          const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                          const std::vector<ComputationNodeBasePtr>& evaluationNodes)
 {
-    if (!m_trainCriterionNodeName.empty())
+    if (net->GetDeviceId() != CPUDEVICE)
+        InvalidArgument("hogwildThreads: Hogwild training is only supported on the CPU.");
+    if (GetParallelizationMethod() != ParallelizationMethod::none || m_needAdaptRegularization || m_dynamicLossScaling ||
+        m_autoSubminibatches || m_numSubminiBatches > 1 || m_maxSamplesInRAM < SIZE_MAX || m_doGradientCheck)
+        InvalidArgument("hogwildThreads cannot be combined with parallel training, adaptation regularization, dynamic loss scaling, sub-minibatches or the gradient check.");
+
+    auto nodesByName = [](const ComputationNetworkPtr& replicaNet, const std::vector<ComputationNodeBasePtr>& nodes)
     {
-        tmpCriterionNodeSets[net] = net->CriterionNodesFrom(m_trainCriterionNodeName);
-        return tmpCriterionNodeSets[net];
+        std::vector<ComputationNodeBasePtr> replicaNodes;
+        for (const auto& node : nodes)
+            replicaNodes.push_back(replicaNet->GetNodeFromName(node->NodeName()));
+        return replicaNodes;
+    };
+
+    wstring tempModelFileName = m_modelPath + L".hogwild.tmp";
+    net->Save(tempModelFileName);
+    for (size_t k = 1; k < m_hogwildThreads; k++)
+    {
+        std::unique_ptr<HogwildReplica> replica(new HogwildReplica());
+        replica->net = ComputationNetwork::CreateFromFile<ElemType>(net->GetDeviceId(), tempModelFileName);
+        replica->featureNodes = nodesByName(replica->net, net->FeatureNodes());
+        replica->labelNodes = nodesByName(replica->net, net->LabelNodes());
+        replica->criterionNodes = nodesByName(replica->net, criterionNodes);
+        replica->evaluationNodes = nodesByName(replica->net, evaluationNodes);
+        replica->learnableNodes = replica->net->LearnableParameterNodes(replica->criterionNodes[0]);
+        for (const auto& node : replica->learnableNodes)
+        {
+            auto parameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(node);
+            auto sharedParameter = dynamic_pointer_cast<LearnableParameter<ElemType>>(net->GetNodeFromName(node->NodeName()));
+            if (!parameter || !sharedParameter)
+                LogicError("CreateHogwildReplicas: %ls %ls operation is not a LearnableParameter.", node->NodeName().c_str(), node->OperationName().c_str());
+            parameter->ShareValueWith(*sharedParameter);
+            replica->smoothedGradients.push_back(Matrix<ElemType>(parameter->Value().GetNumRows(), parameter->Value().GetNumCols(), net->GetDeviceId()));
+        }
+        auto& outputNodes = replica->net->OutputNodes();
+        replica->net->AllocateAllMatrices(replica->evaluationNodes, std::vector<ComputationNodeBasePtr>(outputNodes.begin(), outputNodes.end()), replica->criterionNodes[0]);
+        for (size_t pass = 0; pass < 2; pass++)
+        {
+            for (const auto& node : (pass == 0) ? replica->featureNodes : replica->labelNodes)
+                replica->inputMatrices.AddInput(node->NodeName(), node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
+        }
+        m_hogwildReplicas.push_back(std::move(replica));
     }
-    else
-        return net->FinalCriterionNodes();
+    _wunlink(tempModelFileName.c_str());
+    LOGPRINTF(stderr, "Created %d network replicas for hogwild training.\n", (int) m_hogwildReplicas.size());
 }
 
 template <class ElemType>
-const std::vector<ComputationNodeBasePtr>& SGD<ElemType>::GetEvalCriterionNodes(ComputationNetworkPtr net)
+size_t SGD<ElemType>::TrainOneEpochHogwild(ComputationNetworkPtr net,
+                                           const int epochNumber,
+                                           const size_t epochSize,
+                                           IDataReader* trainSetDataReader,
+                                           const double learnRatePerSample,
+                                           size_t tunedMBSize,
+                                           const std::vector<ComputationNodeBasePtr>& featureNodes,
+                                           const std::vector<ComputationNodeBasePtr>& labelNodes,
+                                           const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                           const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                           StreamMinibatchInputs* inputMatrices,
+                                           const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                           std::list<Matrix<ElemType>>& smoothedGradients,
+                                           /*out*/ EpochCriterion& epochCriterion,
+                                           /*out*/ std::vector<EpochCriterion>& epochEvalErrors)
 {
-    if (!m_evalCriterionNodeName.empty())
+    if (m_hogwildReplicas.empty())
+        CreateHogwildReplicas(net, criterionNodes, evaluationNodes);
+
+    std::mutex readerMutex;
+    std::vector<EpochCriterion> threadCriteria(m_hogwildThreads, EpochCriterion(0));
+    std::vector<std::vector<EpochCriterion>> threadEvalErrors(m_hogwildThreads, std::vector<EpochCriterion>(epochEvalErrors.size(), EpochCriterion(0)));
+    std::vector<size_t> threadSamples(m_hogwildThreads, 0);
+    std::vector<std::exception_ptr> threadErrors(m_hogwildThreads);
+
+    auto trainOnThread = [&](size_t k, ComputationNetworkPtr workerNet,
+                             const std::vector<ComputationNodeBasePtr>& workerFeatureNodes, const std::vector<ComputationNodeBasePtr>& workerLabelNodes,
+                             const std::vector<ComputationNodeBasePtr>& workerCriterionNodes, const std::vector<ComputationNodeBasePtr>& workerEvaluationNodes,
+                             StreamMinibatchInputs& workerInputMatrices,
+                             const std::list<ComputationNodeBasePtr>& workerLearnableNodes, std::list<Matrix<ElemType>>& workerSmoothedGradients)
     {
-        tmpCriterionNodeSets[net] = net->CriterionNodesFrom(m_evalCriterionNodeName);
-        return tmpCriterionNodeSets[net];
-    }
-    else
-        return net->EvaluationNodes();
+        try
+        {
+#ifdef _OPENMP
+            omp_set_num_threads(1); // the parallelism is in the threads
+#endif
+            ScopedNetworkOperationMode modeGuard(workerNet, NetworkOperationMode::training);
+            workerNet->StartEvaluateMinibatchLoop(workerEvaluationNodes);
+            workerNet->StartEvaluateMinibatchLoop(workerCriterionNodes);
+            CriterionAccumulator<ElemType> localEpochCriterion(1, workerNet->GetDeviceId());
+            CriterionAccumulator<ElemType> localEpochEvalErrors(workerEvaluationNodes.size(), workerNet->GetDeviceId());
+            for (;;)
+            {
+                size_t actualMBSize = 0;
+                {
+                    std::lock_guard<std::mutex> lock(readerMutex);
+                    if (!DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, workerNet, workerCriterionNodes[0],
+                                                                              /*useDistributedMBReading=*/false, /*useParallelTrain=*/false, workerInputMatrices, actualMBSize, m_mpi))
+                        break;
+                    trainSetDataReader->DataEnd();
+                }
+                if (actualMBSize == 0)
+                    continue;
+
+                MarkDropoutNodesEvalTimeStampAsOutdated(workerNet, workerCriterionNodes[0]);
+                ComputationNetwork::BumpEvalTimeStamp(workerFeatureNodes);
+                ComputationNetwork::BumpEvalTimeStamp(workerLabelNodes);
+                workerNet->ForwardProp(workerEvaluationNodes);
+                workerNet->ForwardProp(workerCriterionNodes[0]);
+                bool updateParameters = learnRatePerSample > 0.01 * m_minLearnRate;
+                if (updateParameters)
+                    workerNet->Backprop(workerCriterionNodes[0]);
+
+                size_t numSamplesWithLabelOfNetwork = workerNet->GetNumSamplesWithLabelOfNetwork(actualMBSize);
+                size_t numSamplesWithLabel = CriterionAccumulator<ElemType>::GetNumSamples(workerCriterionNodes[0], numSamplesWithLabelOfNetwork);
+                localEpochCriterion.Add(workerCriterionNodes, 0, numSamplesWithLabelOfNetwork);
+                for (size_t i = 0; i < workerEvaluationNodes.size(); i++)
+                    localEpochEvalErrors.Add(workerEvaluationNodes, i, numSamplesWithLabelOfNetwork);
+                threadSamples[k] += numSamplesWithLabel;
+                if (!updateParameters)
+                    continue;
+
+                // update the shared parameters, without locking against the other threads
+                size_t numSamplesInMinibatch = workerCriterionNodes[0]->HasMBLayout() ? numSamplesWithLabel : actualMBSize;
+                double momentumPerSample = GetMomentumPerSample(epochNumber, workerNet->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences());
+                auto smoothedGradientIter = workerSmoothedGradients.begin();
+                for (auto nodeIter = workerLearnableNodes.begin(); nodeIter != workerLearnableNodes.end(); nodeIter++, smoothedGradientIter++)
+                {
+                    if ((*nodeIter)->IsParameterUpdateRequired())
+                        UpdateWeights(*nodeIter, *smoothedGradientIter, learnRatePerSample, momentumPerSample, numSamplesInMinibatch,
+                                      m_L2RegWeight, m_L1RegWeight, m_needAveMultiplier, m_useNesterovMomentum);
+                }
+            }
+            threadCriteria[k] = localEpochCriterion.GetCriterion(0);
+            for (size_t i = 0; i < workerEvaluationNodes.size(); i++)
+                threadEvalErrors[k][i] = localEpochEvalErrors.GetCriterion(i);
+        }
+        catch (...)
+        {
+            threadErrors[k] = std::current_exception();
+        }
+    };
+
+    // no parallel loops within the operations, while the threads run
+    int numCPUThreads = (int) CPUThreadPool::GetNumThreads();
+    CPUMatrix<ElemType>::SetNumThreads(1);
+
+    trainSetDataReader->StartMinibatchLoop(tunedMBSize, epochNumber, epochSize);
+    fprintf(stderr, "\n");
+    LOGPRINTF(stderr, "Starting minibatch loop, hogwild training with %d threads.\n", (int) m_hogwildThreads);
+    std::vector<std::thread> threads;
+    for (size_t k = 1; k < m_hogwildThreads; k++)
+    {
+        threads.emplace_back([&, k]()
+        {
+            auto& replica = *m_hogwildReplicas[k - 1];
+            trainOnThread(k, replica.net, replica.featureNodes, replica.labelNodes, replica.criterionNodes, replica.evaluationNodes,
+                          replica.inputMatrices, replica.learnableNodes, replica.smoothedGradients);
+        });
+    }
+    trainOnThread(0, net, featureNodes, labelNodes, criterionNodes, evaluationNodes, *inputMatrices, learnableNodes, smoothedGradients);
+    for (auto& thread : threads)
+        thread.join();
+
+    CPUMatrix<ElemType>::SetNumThreads(numCPUThreads);
+    for (const auto& error : threadErrors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // the parameters were updated behind the back of the network
+    for (const auto& node : learnableNodes)
+        node->BumpEvalTimeStamp();
+
+    size_t totalEpochSamples = 0;
+    epochCriterion = EpochCriterion(0);
+    epochEvalErrors.assign(epochEvalErrors.size(), EpochCriterion(0));
+    for (size_t k = 0; k < m_hogwildThreads; k++)
+    {
+        totalEpochSamples += threadSamples[k];
+        epochCriterion += threadCriteria[k];
+        for (size_t i = 0; i < epochEvalErrors.size(); i++)
+            epochEvalErrors[i] += threadEvalErrors[k][i];
+    }
+    return totalEpochSamples;
+}
+
+// -----------------------------------------------------------------------
+// subroutines and helpers follow below
+// -----------------------------------------------------------------------
+
+static double MomentumPerMB(double momentumPerSample, size_t minibatchSize)
+{
+    return pow(momentumPerSample, minibatchSize);
+}
+
+// Get{Train,Eval}CriterionNodes() return a reference that is, unfortunately, dependent on the network.
+// So we hold those inside here. Not very nice. Also not thread-safe. This may go away once we fix sequence-to-sequence models properly.
+// TODO: merge them into one.
+static map<ComputationNetworkPtr, vector<ComputationNodeBasePtr>> tmpCriterionNodeSets;
+// TODO: test this, then remove this comment
+
+template <class ElemType>
+const std::vector<ComputationNodeBasePtr>& SGD<ElemType>::GetTrainCriterionNodes(ComputationNetworkPtr net)
+{
+    if (!m_trainCriterionNodeName.empty())
+    {
+        tmpCriterionNodeSets[net] = net->CriterionNodesFrom(m_trainCriterionNodeName);
+        return tmpCriterionNodeSets[net];
+    }
+    else
+        return net->FinalCriterionNodes();
+}
+
+template <class ElemType>
+const std::vector<ComputationNodeBasePtr>& SGD<ElemType>::GetEvalCriterionNodes(ComputationNetworkPtr net)
+{
+    if (!m_evalCriterionNodeName.empty())
+    {
+        tmpCriterionNodeSets[net] = net->CriterionNodesFrom(m_evalCriterionNodeName);
+        return tmpCriterionNodeSets[net];
+    }
+    else
+        return net->EvaluationNodes();
+}
+
+template <class ElemType>
+ComputationNetwork::MemoryEstimate SGD<ElemType>::EstimateMemory(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                                 const std::vector<ComputationNodeBasePtr>& inputNodes, size_t minibatchSize) const
+{
+    auto estimate = net->EstimateMemory(minibatchSize);
+
+    // the smoothed gradients; FSAdaGrad and RmsProp keep 2 resp. 3 values per parameter in them
+    size_t learnerStateFactor = GradUpdateType() == GradientsUpdateType::RmsProp ? 3 : GradUpdateType() == GradientsUpdateType::FSAdaGrad ? 2 : 1;
+    for (const auto& node : learnableNodes)
+        estimate.AddBytes(node->GetDeviceId(), "learner state", node->GetSampleLayout().GetNumElements() * sizeof(ElemType) * learnerStateFactor);
+
+    // the host copy of the inputs that the reader fills; its own buffers (chunks, prefetch) come on top
+    for (const auto& node : inputNodes)
+        estimate.AddBytes(CPUDEVICE, "reader buffers", node->GetSampleLayout().GetNumElements() * minibatchSize * sizeof(ElemType));
+    return estimate;
+}
+
+template <class ElemType>
+void SGD<ElemType>::FitMaxSamplesInRAMToGPUMemory(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                   const std::vector<ComputationNodeBasePtr>& inputNodes, size_t minibatchSize)
+{
+    if (net->GetDeviceId() == CPUDEVICE)
+    {
+        LOGPRINTF(stderr, "autoMaxSamplesInRAM: ignored, since the network runs on the CPU.\n");
+        return;
+    }
+
+    // The parameters are already allocated, so they count as free. 10% are kept for what is not estimated: cuDNN workspaces,
+    // matrices that nodes allocate themselves, and fragmentation.
+    size_t parameterBytes = net->EstimateMemory(1).deviceBytes["parameters"];
+    double budget = 0.9 * (GPUWatcher::GetFreeMemoryOnCUDADevice(net->GetDeviceId()) + parameterBytes);
+    auto fits = [&](size_t numSamples)
+    {
+        return ComputationNetwork::MemoryEstimate::GetTotal(EstimateMemory(net, learnableNodes, inputNodes, numSamples).deviceBytes) <= budget;
+    };
+
+    size_t numSamples = min(minibatchSize, m_maxSamplesInRAM);
+    if (fits(numSamples))
+        return;
+    if (!fits(1))
+        RuntimeError("autoMaxSamplesInRAM: The network does not fit into the %.1f MB of free GPU memory even for a single sample.", budget / 1048576.0);
+
+    // the estimate grows with the number of samples, so the largest that fits is found by bisection
+    size_t lo = 1, hi = numSamples; // fits(lo), !fits(hi)
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        (fits(mid) ? lo : hi) = mid;
+    }
+    m_maxSamplesInRAM = lo;
+    LOGPRINTF(stderr, "autoMaxSamplesInRAM: Minibatches of up to %d samples are estimated to fit into %.1f MB of GPU memory; maxSamplesInRAM is set to %d.\n",
+              (int) minibatchSize, budget / 1048576.0, (int) m_maxSamplesInRAM);
+}
+
+template <class ElemType>
+void SGD<ElemType>::FitMaxSamplesInRAMToPeakMemory(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                    const std::vector<ComputationNodeBasePtr>& inputNodes, size_t samplesInRAM)
+{
+    auto& probe = m_peakMemoryProbe;
+    probe.largestSamplesInRAM = max(probe.largestSamplesInRAM, samplesInRAM);
+    if (probe.largestSamplesInRAM == 0)
+        return;
+
+    // What was in use at the peak beyond the planned fixed part is attributed to the samples, which also covers what the plan
+    // does not know of (cuDNN workspaces, matrices that nodes allocate themselves, the reader's device buffers).
+    let deviceId = net->GetDeviceId();
+    let statistics = TracingGPUMemoryAllocator::GetCacheStatistics(deviceId);
+    double bytesPerSample = max(probe.plannedBytesPerSample, ((double) statistics.peakInUseBytes - probe.fixedBytes) / probe.largestSamplesInRAM);
+
+    // the memory available to us is what is free on the device, plus all that the cache holds, in use or not
+    double budget = (1 - m_autoSubminibatchesMemoryMargin) * (GPUWatcher::GetFreeMemoryOnCUDADevice(deviceId) + statistics.allocatedBytes);
+    size_t maxSamplesInRAM = budget > probe.fixedBytes + bytesPerSample ? (size_t) ((budget - probe.fixedBytes) / bytesPerSample) : 1;
+    maxSamplesInRAM = min(maxSamplesInRAM, probe.configuredMaxSamplesInRAM);
+    if (m_traceLevel > 0 && maxSamplesInRAM != m_maxSamplesInRAM)
+        LOGPRINTF(stderr, "autoSubminibatches: peak %.1f MB in use for up to %d samples in RAM, %.1f KB per sample; maxSamplesInRAM is set to %d.\n",
+                  statistics.peakInUseBytes / 1048576.0, (int) probe.largestSamplesInRAM, bytesPerSample / 1024.0, (int) maxSamplesInRAM);
+    m_maxSamplesInRAM = maxSamplesInRAM;
 }
 
 // execute PreComputeNodes
@@ -1312,14 +2303,37 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     // compute
     ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::preComputing);
 
+    // With several workers, each reads a disjoint share of the data (by distributed reading if the reader supports it, else by decimation),
+    // and the accumulators are combined at the end. All PreCompute nodes accumulate in this one pass.
+    bool useParallelPreCompute = m_mpi != nullptr && m_mpi->NumNodesInUse() > 1;
+    bool useDistributedMBReading = useParallelPreCompute && m_enableDistributedMBReading && trainSetDataReader->SupportsDistributedMBRead();
+
+    if (!m_preComputeCache.empty())
+    {
+        bool loadedFromCache = LoadPreComputeCache(nodes);
+        if (useParallelPreCompute) // all workers must agree, since otherwise some of them would wait for the others in AggregateAcrossWorkers()
+        {
+            std::vector<int> numMisses(1, loadedFromCache ? 0 : 1);
+            m_mpi->AllReduce(numMisses);
+            loadedFromCache = numMisses[0] == 0;
+        }
+        if (loadedFromCache)
+        {
+            LOGPRINTF(stderr, "Precomputing --> Loaded the values from %ls.\n\n", m_preComputeCache.c_str());
+            return true;
+        }
+    }
+
     // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , requestDataSize);
     // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , m_epochSize); // only based on one epoch
     // To support large dataset, we usually partition whole dataset into several epoch's,
     // so we need to use all the data to do precomputing
-    if (m_useAllDataForPreComputedNode) // using all the data
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0);
-    else // using only one epoch. Note: One epoch is often enough for feature mean/stddev, but not for estimating priors.
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, m_epochSize);
+    // Note: One epoch is often enough for feature mean/stddev, but not for estimating priors.
+    size_t epochSize = m_useAllDataForPreComputedNode ? requestDataSize : m_epochSize;
+    if (useDistributedMBReading)
+        trainSetDataReader->StartDistributedMinibatchLoop(m_mbSize[0], 0, m_mpi->CurrentNodeRank(), m_mpi->NumNodesInUse(), epochSize);
+    else
+        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, epochSize);
     net->StartEvaluateMinibatchLoop(nodes);
 
     // initialize
@@ -1329,7 +2343,7 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     const size_t numIterationsBeforePrintingProgress = 100;
     size_t numItersSinceLastPrintOfProgress = 0;
     size_t actualMBSizeDummy;
-    while (DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, net, nullptr, false, false, *inputMatrices, actualMBSizeDummy, m_mpi))
+    while (DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, net, nullptr, useDistributedMBReading, useParallelPreCompute, *inputMatrices, actualMBSizeDummy, m_mpi))
     {
         // TODO: move these into GetMinibatchIntoNetwork()  --but those are passed around; necessary? Can't we get them from 'net'?
         ComputationNetwork::BumpEvalTimeStamp(featureNodes);
@@ -1342,14 +2356,93 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
 
     // finalize
     for (auto & node : nodes)
-        dynamic_pointer_cast<IPreComputeNode>(node)->MarkComputed(true /*done accumulating*/);
+    {
+        auto pcNode = dynamic_pointer_cast<IPreComputeNode>(node);
+        if (useParallelPreCompute)
+            pcNode->AggregateAcrossWorkers(m_mpi);
+        pcNode->MarkComputed(true /*done accumulating*/);
+    }
 
     fprintf(stderr, "\n");
     LOGPRINTF(stderr, "Precomputing --> Completed.\n\n");
 
+    if (!m_preComputeCache.empty())
+        SavePreComputeCache(nodes);
+
     return true;
 }
 
+// The preComputeCache is valid for the same PreCompute nodes (names, operations, inputs, shapes),
+// the same reader configuration, and the same amount of data.
+template <class ElemType>
+wstring SGD<ElemType>::PreComputeCacheKey(const std::list<ComputationNodeBasePtr>& nodes) const
+{
+    wstring key = m_readerConfigDescription;
+    key += L"\nepochSize=" + (m_useAllDataForPreComputedNode ? wstring(L"all") : std::to_wstring(m_epochSize));
+    for (const auto& node : nodes)
+    {
+        key += L"\n" + node->NodeName() + L" = " + node->OperationName() + L"(";
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+            key += (i > 0 ? L", " : L"") + node->Input(i)->NodeName();
+        key += L") " + msra::strfun::utf16(string(node->GetSampleLayout()));
+    }
+    return key;
+}
+
+// returns false if there is no cache, or if it was made for a different configuration
+template <class ElemType>
+bool SGD<ElemType>::LoadPreComputeCache(const std::list<ComputationNodeBasePtr>& nodes)
+{
+    if (!fexists(m_preComputeCache))
+        return false;
+
+    File fstream(m_preComputeCache, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BPreComputeCache");
+    wstring key;
+    fstream >> key;
+    if (key != PreComputeCacheKey(nodes))
+    {
+        LOGPRINTF(stderr, "Precomputing --> %ls was made for a different reader configuration or network, recomputing.\n", m_preComputeCache.c_str());
+        return false;
+    }
+
+    // the key lists the nodes in order
+    vector<Matrix<ElemType>> values;
+    values.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        values.emplace_back(CPUDEVICE);
+        fstream >> values.back();
+    }
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EPreComputeCache");
+
+    auto valueIter = values.begin();
+    for (const auto& node : nodes)
+        dynamic_pointer_cast<PreComputedNodeBase<ElemType>>(node)->SideLoadPreComputedValue(*valueIter++);
+    return true;
+}
+
+template <class ElemType>
+void SGD<ElemType>::SavePreComputeCache(const std::list<ComputationNodeBasePtr>& nodes) const
+{
+    if (m_mpi != nullptr && !m_mpi->IsMainNode()) // all workers have the same values
+        return;
+    if (m_readerConfigDescription.empty())
+        LOGPRINTF(stderr, "Precomputing --> WARNING: The reader configuration is not known, the key of %ls consists of the PreCompute nodes only.\n", m_preComputeCache.c_str());
+
+    wstring tempFileName = m_preComputeCache + L".tmp";
+    {
+        File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BPreComputeCache");
+        fstream << PreComputeCacheKey(nodes);
+        for (const auto& node : nodes)
+            fstream << dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EPreComputeCache");
+    }
+    renameOrDie(tempFileName, m_preComputeCache);
+    LOGPRINTF(stderr, "Precomputing --> Saved the values to %ls.\n\n", m_preComputeCache.c_str());
+}
+
 // return a reasonable initial learning rate based on the initial mbsize
 template <class ElemType>
 double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
@@ -1399,45 +2492,96 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                        /*out*/ prevCriterion,
                        /*out*/ dummyMinibatchSize);
 
+    // all trials go back to this in memory, rather than rereading the model
+    TakeTrialSnapshot(net, smoothedGradients);
+
     // if model is not changed this is what we will get
     EpochCriterion baseCriterion;
     vector<EpochCriterion> epochEvalErrors(evaluationNodes.size(), EpochCriterion::Infinity()); // these are ignored in this entire method
-    TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                    numFramesToUseInSearch, trainSetDataReader, 0, m_mbSize[epochNumber],
-                                    featureNodes, labelNodes,
-                                    criterionNodes, evaluationNodes,
-                                    inputMatrices, learnableNodes,
-                                    smoothedGradients,
-                                    /*out*/ baseCriterion, /*out*/ epochEvalErrors,
-                                    "BaseAdaptiveLearnRateSearch:");
-
-    if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::SearchBeforeEpoch)
+    auto interpolateBaseCriterion = [&]()
     {
-        if (prevCriterion == numeric_limits<double>::infinity())
-            prevCriterion = baseCriterion.Average();
+        if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::SearchBeforeEpoch)
+        {
+            if (prevCriterion == numeric_limits<double>::infinity())
+                prevCriterion = baseCriterion.Average();
 
-        double ratio = 0.3;
+            double ratio = 0.3;
 
-        if (m_epochSize != requestDataSize)
-            ratio = pow(((double) numFramesToUseInSearch) / m_epochSize, 1.0f / 2);
+            if (m_epochSize != requestDataSize)
+                ratio = pow(((double) numFramesToUseInSearch) / m_epochSize, 1.0f / 2);
 
-        // interpolate prevCriterion into 'baseCriterion'
-        baseCriterion.first = baseCriterion.second * max(ratio * prevCriterion + (1 - ratio) * baseCriterion.Average(), baseCriterion.Average());
-    }
+            // interpolate prevCriterion into 'baseCriterion'
+            baseCriterion.first = baseCriterion.second * max(ratio * prevCriterion + (1 - ratio) * baseCriterion.Average(), baseCriterion.Average());
+        }
+    };
 
     EpochCriterion epochCriterion(EpochCriterion::Infinity());
-    do
+    if (UsingParallelLearnRateSearch())
+    {
+        // The base trial and the candidates of the descent below are trained side by side, one per worker, in rounds,
+        // until a round contains the candidate that the sequential descent would stop at. The result is the same.
+        double candidateLearnRatePerSample = learnRatePerSample;
+        bool moreCandidates = true;
+        std::vector<double> trialLearnRates(1, 0.0); // the first round starts with the base trial
+        bool baseTrialPending = true;
+        for (bool found = false; !found;)
+        {
+            while (moreCandidates && trialLearnRates.size() < m_mpi->NumNodesInUse())
+            {
+                candidateLearnRatePerSample *= 0.618;
+                trialLearnRates.push_back(candidateLearnRatePerSample);
+                moreCandidates = candidateLearnRatePerSample > minLearnRate; // the descent ends with the first one at or below minLearnRate
+            }
+            std::vector<EpochCriterion> trialCriteria;
+            TrainMiniEpochsInParallel(net, refNet, refNode, epochNumber,
+                                      numFramesToUseInSearch, trainSetDataReader,
+                                      trialLearnRates, m_mbSize[epochNumber], featureNodes,
+                                      labelNodes, criterionNodes,
+                                      evaluationNodes, inputMatrices,
+                                      learnableNodes, smoothedGradients,
+                                      /*out*/ trialCriteria,
+                                      "AdaptiveLearnRateSearch:");
+            size_t k = 0;
+            if (baseTrialPending)
+            {
+                baseCriterion = trialCriteria[k++];
+                interpolateBaseCriterion();
+                baseTrialPending = false;
+            }
+            for (; k < trialLearnRates.size() && !found; k++)
+            {
+                learnRatePerSample = trialLearnRates[k];
+                epochCriterion = trialCriteria[k];
+                found = !(epochCriterion.IsNan() || (epochCriterion.Average() > baseCriterion.Average() && learnRatePerSample > minLearnRate));
+            }
+            trialLearnRates.clear();
+        }
+    }
+    else
     {
-        learnRatePerSample *= 0.618;
         TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
-                                        numFramesToUseInSearch, trainSetDataReader,
-                                        learnRatePerSample, m_mbSize[epochNumber], featureNodes,
-                                        labelNodes, criterionNodes,
-                                        evaluationNodes, inputMatrices,
-                                        learnableNodes, smoothedGradients,
-                                        /*out*/ epochCriterion, /*out*/ epochEvalErrors,
-                                        "AdaptiveLearnRateSearch:");
-    } while (epochCriterion.IsNan() || (epochCriterion.Average() > baseCriterion.Average() && learnRatePerSample > minLearnRate));
+                                        numFramesToUseInSearch, trainSetDataReader, 0, m_mbSize[epochNumber],
+                                        featureNodes, labelNodes,
+                                        criterionNodes, evaluationNodes,
+                                        inputMatrices, learnableNodes,
+                                        smoothedGradients,
+                                        /*out*/ baseCriterion, /*out*/ epochEvalErrors,
+                                        "BaseAdaptiveLearnRateSearch:");
+        interpolateBaseCriterion();
+
+        do
+        {
+            learnRatePerSample *= 0.618;
+            TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
+                                            numFramesToUseInSearch, trainSetDataReader,
+                                            learnRatePerSample, m_mbSize[epochNumber], featureNodes,
+                                            labelNodes, criterionNodes,
+                                            evaluationNodes, inputMatrices,
+                                            learnableNodes, smoothedGradients,
+                                            /*out*/ epochCriterion, /*out*/ epochEvalErrors,
+                                            "AdaptiveLearnRateSearch:");
+        } while (epochCriterion.IsNan() || (epochCriterion.Average() > baseCriterion.Average() && learnRatePerSample > minLearnRate));
+    }
 
     bestLearnRatePerSample = learnRatePerSample;
 
@@ -1502,6 +2646,8 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
         bestLearnRatePerSample = (leftCriterion.Average() < rightCriterion.Average()) ? leftLearnRatePerSample : rightLearnRatePerSample;
     }
 
+    DropTrialSnapshot();
+
     LOGPRINTF(stderr, "Best Learn Rate Per Sample for Epoch[%d] = %.10g  baseCriterion=%.10g\n",
               epochNumber + 1, bestLearnRatePerSample, baseCriterion.Average());
 
@@ -1640,6 +2786,9 @@ size_t SGD<ElemType>::SearchForBestMinibatchSize(ComputationNetworkPtr net,
         return maxMinibatchSize;
     }
 
+    // all trials go back to the current model, kept in memory
+    TakeTrialSnapshot(net, smoothedGradients);
+
     size_t trialMinibatchSize = 0;
     bool isFirstIteration = true;
     EpochCriterion baseCriterion(0);
@@ -1705,6 +2854,8 @@ size_t SGD<ElemType>::SearchForBestMinibatchSize(ComputationNetworkPtr net,
             }
         }
     }
+    DropTrialSnapshot();
+
     LOGPRINTF(stderr, "AdaptiveMinibatchSearch: Search successful. New minibatchSize is %d. epochCriterion = %.8f vs baseCriterion = %.8f\n\n",
               (int) lastTriedTrialMinibatchSize, lastTriedTrialEpochCriterion.Average(), baseCriterion.Average());
 
@@ -1744,6 +2895,12 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
     fprintf(stderr, "learningRatePerSample = %.8g\n", learnRatePerSample);
 
     // go back to where we came from
+    if (m_trialSnapshot)
+    {
+        RestoreTrialSnapshot(net, smoothedGradients);
+        return;
+    }
+
     int baseModelEpoch = epochNumber - 1;
     net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(baseModelEpoch));
 
@@ -1759,6 +2916,230 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
                        /*out*/ dummyMinibatchSize);
 }
 
+template <class ElemType>
+bool SGD<ElemType>::UsingParallelLearnRateSearch() const
+{
+    return m_parallelLearnRateSearch && m_mpi != nullptr && m_mpi->NumNodesInUse() > 1 && !UsingModelParallelism();
+}
+
+template <class ElemType>
+void SGD<ElemType>::TrainMiniEpochsInParallel(ComputationNetworkPtr net,
+                                              ComputationNetworkPtr refNet,
+                                              const ComputationNodeBasePtr& refNode, const int epochNumber,
+                                              const size_t epochSize, IDataReader* trainSetDataReader,
+                                              const std::vector<double>& learnRatesPerSample,
+                                              const size_t minibatchSize,
+                                              const std::vector<ComputationNodeBasePtr>& featureNodes,
+                                              const std::vector<ComputationNodeBasePtr>& labelNodes,
+                                              const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                              const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                              StreamMinibatchInputs* inputMatrices,
+                                              const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                              std::list<Matrix<ElemType>>& smoothedGradients,
+                                              /*out*/ std::vector<EpochCriterion>& epochCriteria,
+                                              const std::string& prefixMsg)
+{
+    if (!m_trialSnapshot)
+        LogicError("TrainMiniEpochsInParallel: The trials need a snapshot of the model to go back to.");
+
+    // each worker trains its trials without parallel training, i.e. reads all data of the mini-epoch, and updates its own model
+    size_t numWorkers = m_mpi->NumNodesInUse();
+    vector<double> numer(learnRatesPerSample.size(), 0);
+    vector<size_t> denom(learnRatesPerSample.size(), 0);
+    vector<EpochCriterion> epochEvalErrors(evaluationNodes.size(), EpochCriterion::Infinity()); // (ignored)
+    for (size_t k = m_mpi->CurrentNodeRank(); k < learnRatesPerSample.size(); k += numWorkers)
+    {
+        LOGPRINTF(stderr, "%s Worker %d trains trial %d of %d.\n", prefixMsg.c_str(), (int) m_mpi->CurrentNodeRank(), (int) k + 1, (int) learnRatesPerSample.size());
+        EpochCriterion epochCriterion;
+        m_trainingLocalTrial = true;
+        TrainOneMiniEpochAndReloadModel(net, refNet, refNode, epochNumber,
+                                        epochSize, trainSetDataReader,
+                                        learnRatesPerSample[k], minibatchSize, featureNodes,
+                                        labelNodes, criterionNodes,
+                                        evaluationNodes, inputMatrices,
+                                        learnableNodes, smoothedGradients,
+                                        /*out*/ epochCriterion, /*out*/ epochEvalErrors,
+                                        prefixMsg);
+        m_trainingLocalTrial = false;
+        numer[k] = epochCriterion.first;
+        denom[k] = epochCriterion.second;
+    }
+
+    // each trial was trained by exactly one worker
+    m_mpi->AllReduce(numer);
+    m_mpi->AllReduce(denom);
+    epochCriteria.clear();
+    for (size_t k = 0; k < learnRatesPerSample.size(); k++)
+        epochCriteria.push_back(EpochCriterion(numer[k], denom[k]));
+}
+
+template <class ElemType>
+void SGD<ElemType>::TakeTrialSnapshot(ComputationNetworkPtr net, std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    m_trialSnapshot.reset(new TrialSnapshot());
+    m_trialSnapshot->parameters = net->SnapshotParameters();
+    for (const auto& smoothedGradient : smoothedGradients)
+    {
+        m_trialSnapshot->smoothedGradients.emplace_back(CPUDEVICE);
+        m_trialSnapshot->smoothedGradients.back().AssignValuesOf(smoothedGradient);
+    }
+    // batch normalization also counts the minibatches it has seen
+    for (const auto& node : net->GetNodesWithType(OperationNameOf(BatchNormalizationNode)))
+    {
+        auto batchNormalizationNode = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node);
+        if (batchNormalizationNode)
+            m_trialSnapshot->batchNormalizationMBCounts.push_back(make_pair(node, batchNormalizationNode->GetMBCount()));
+    }
+
+    // all workers start from the model of the main worker (except with modelParallelSGD, whose weight shards differ by design)
+    if (m_mpi == nullptr || m_mpi->NumNodesInUse() <= 1 || UsingModelParallelism())
+        return;
+    let root = m_mpi->MainNodeRank();
+    std::vector<Matrix<ElemType>*> matrices;
+    for (auto& iter : m_trialSnapshot->parameters)
+        matrices.push_back(&dynamic_cast<Matrix<ElemType>&>(*iter.second));
+    for (auto& smoothedGradient : m_trialSnapshot->smoothedGradients)
+        matrices.push_back(&smoothedGradient);
+    BroadcastMatrices(matrices, root);
+    for (auto& mbCount : m_trialSnapshot->batchNormalizationMBCounts)
+        m_mpi->Bcast(&mbCount.second, 1, root);
+    RestoreTrialSnapshot(net, smoothedGradients);
+}
+
+template <class ElemType>
+void SGD<ElemType>::SynchronizeInitialModel(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    if (m_mpi == nullptr || m_mpi->NumNodesInUse() <= 1)
+        return;
+
+    // FNV-1a hash of the parameter values
+    std::vector<Matrix<ElemType>*> values;
+    size_t checksum = (size_t) 14695981039346656037ull;
+    std::vector<ElemType> buffer;
+    for (const auto& node : learnableNodes)
+    {
+        auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        values.push_back(&value);
+        buffer.resize(value.GetNumElements());
+        value.CopySection(value.GetNumRows(), value.GetNumCols(), buffer.data(), value.GetNumRows());
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(buffer.data());
+        for (size_t i = 0; i < buffer.size() * sizeof(ElemType); i++)
+            checksum = (checksum ^ bytes[i]) * (size_t) 1099511628211ull;
+    }
+
+    // the maximum of the checksums and that of their complements, i.e. the complement of their minimum
+    size_t range[2] = { checksum, ~checksum };
+    m_mpi->AllReduceMax(range, 2);
+    if (range[0] == checksum && ~range[1] == checksum)
+    {
+        LOGPRINTF(stderr, "All %d workers start from the same model (checksum %016llx).\n", (int) m_mpi->NumNodesInUse(), (unsigned long long) checksum);
+        return;
+    }
+
+    size_t numElements = 0;
+    for (const auto* value : values)
+        numElements += value->GetNumElements();
+    LOGPRINTF(stderr, "The models of the workers differ; broadcasting the %d parameters (%.1f MB) of the main worker.\n",
+              (int) values.size(), numElements * sizeof(ElemType) / 1024.0 / 1024.0);
+    BroadcastMatrices(values, m_mpi->MainNodeRank());
+    net->ResetEvalTimeStamps();
+}
+
+template <class ElemType>
+void SGD<ElemType>::BroadcastMatrices(const std::vector<Matrix<ElemType>*>& matrices, size_t root)
+{
+    if (m_mpi == nullptr || m_mpi->NumNodesInUse() <= 1)
+        return;
+
+    // pack the columns of the matrices into chunks, each a list of column ranges (a column larger than a chunk is one by itself)
+    struct ColumnRange
+    {
+        Matrix<ElemType>* matrix;
+        size_t startColumn;
+        size_t numColumns;
+    };
+    const size_t maxChunkElements = max(m_modelBroadcastChunkSizeInBytes / sizeof(ElemType), (size_t) 1);
+    std::vector<std::vector<ColumnRange>> chunks(1);
+    std::vector<size_t> chunkElements(1, 0);
+    for (auto* matrix : matrices)
+    {
+        size_t numRows = matrix->GetNumRows();
+        size_t numCols = matrix->GetNumCols();
+        if (numRows == 0)
+            continue;
+        for (size_t j = 0; j < numCols;)
+        {
+            if (chunkElements.back() > 0 && chunkElements.back() + numRows > maxChunkElements)
+            {
+                chunks.emplace_back();
+                chunkElements.push_back(0);
+            }
+            size_t n = min(numCols - j, max((maxChunkElements - min(chunkElements.back(), maxChunkElements)) / numRows, (size_t) 1));
+            chunks.back().push_back(ColumnRange{ matrix, j, n });
+            chunkElements.back() += n * numRows;
+            j += n;
+        }
+    }
+    if (chunkElements.back() == 0)
+        chunks.pop_back();
+
+    // copy a chunk between the matrices and its staging buffer
+    const size_t numBuffers = 3;
+    std::vector<std::vector<ElemType>> buffers(numBuffers);
+    std::vector<MPIRequest> requests(numBuffers);
+    auto copyChunk = [&](size_t k, bool toBuffer)
+    {
+        ElemType* p = buffers[k % numBuffers].data();
+        for (const auto& range : chunks[k])
+        {
+            auto slice = range.matrix->ColumnSlice(range.startColumn, range.numColumns);
+            if (toBuffer)
+                slice.CopySection(slice.GetNumRows(), slice.GetNumCols(), p, slice.GetNumRows());
+            else
+                slice.SetValue(slice.GetNumRows(), slice.GetNumCols(), slice.GetDeviceId(), p);
+            p += slice.GetNumElements();
+        }
+    };
+
+    const bool isRoot = m_mpi->CurrentNodeRank() == root;
+    for (size_t k = 0; k < chunks.size(); k++)
+    {
+        // the buffer is free once its previous chunk has been sent (root) or copied out (others, below)
+        auto& buffer = buffers[k % numBuffers];
+        requests[k % numBuffers].Wait();
+        buffer.resize(chunkElements[k]);
+        if (isRoot)
+            copyChunk(k, /*toBuffer=*/true);
+        requests[k % numBuffers] = m_mpi->BcastAsync(buffer.data(), buffer.size(), root);
+        // while the later chunks are on their way, copy out the oldest one
+        if (!isRoot && k + 1 >= numBuffers)
+        {
+            requests[(k + 1) % numBuffers].Wait();
+            copyChunk(k + 1 - numBuffers, /*toBuffer=*/false);
+        }
+    }
+    size_t numPending = isRoot ? numBuffers : numBuffers - 1;
+    for (size_t k = chunks.size() > numPending ? chunks.size() - numPending : 0; k < chunks.size(); k++)
+    {
+        requests[k % numBuffers].Wait();
+        if (!isRoot)
+            copyChunk(k, /*toBuffer=*/false);
+    }
+}
+
+template <class ElemType>
+void SGD<ElemType>::RestoreTrialSnapshot(ComputationNetworkPtr net, std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    if (m_trialSnapshot->smoothedGradients.size() != smoothedGradients.size())
+        LogicError("RestoreTrialSnapshot: The number of smoothed gradients has changed.");
+    net->RestoreParameterSnapshot(m_trialSnapshot->parameters);
+    auto smoothedGradientIter = m_trialSnapshot->smoothedGradients.begin();
+    for (auto& smoothedGradient : smoothedGradients)
+        smoothedGradient.AssignValuesOf(*smoothedGradientIter++);
+    for (const auto& mbCount : m_trialSnapshot->batchNormalizationMBCounts)
+        dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(mbCount.first)->SetMBCount(mbCount.second);
+}
+
 // Attemps to compute the error signal for the whole utterance, which will
 // be fed to the neural network as features. Currently it is a workaround
 // for the two-forward-pass sequence and ctc training, which allows
@@ -1796,7 +3177,19 @@ void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int traceLevel)
 {
     if (GetParallelizationMethod() == ParallelizationMethod::dataParallelSGD)
     {
-        if (m_distGradAgg == nullptr)
+        if (m_distGradAgg == nullptr && (m_gradientBucketSizeInBytes > 0 || m_gradientCommunicationBackend != GradientCommunicationBackend::mpi))
+        {
+            m_distGradAgg = std::make_shared<SimpleDistGradAggregator<ElemType>>(m_mpi, m_bufferedAsyncGradientAggregation, m_syncStatsTrace, m_gradientBucketSizeInBytes, m_gradientCommunicationBackend);
+        }
+        else if (m_distGradAgg == nullptr && m_sparseGradientDensity > 0)
+        {
+            m_distGradAgg = std::make_shared<SparseDistGradAggregator<ElemType>>(m_mpi, m_sparseGradientDensity, m_syncStatsTrace);
+        }
+        else if (m_distGradAgg == nullptr && m_numBackupWorkers > 0)
+        {
+            m_distGradAgg = std::make_shared<BackupWorkerDistGradAggregator<ElemType>>(m_mpi, m_numBackupWorkers, m_deferLateGradients, m_syncStatsTrace);
+        }
+        else if (m_distGradAgg == nullptr)
         {
 #ifdef CNTK_PARALLEL_TRAINING_SUPPORT
             m_distGradAgg = std::make_shared<AllReduceDistGradAggregator<ElemType>>(m_mpi, m_numGradientBits, m_zeroThresholdFor1Bit, true /*useQuantizationForSelfStripe*/, m_bufferedAsyncGradientAggregation, traceLevel, m_syncStatsTrace);
@@ -1828,7 +3221,10 @@ void SGD<ElemType>::InitModelAggregationHandler(int traceLevel, DEVICEID_TYPE de
     }
     if (GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD)
     {
-        m_pMASGDHelper = make_shared<BasicModelAveragingSGD<ElemType>>(m_mpi, traceLevel, devID);
+        if (m_pipelineModelAggregation)
+            m_pMASGDHelper = make_shared<PipelinedModelAveragingSGD<ElemType>>(m_mpi, traceLevel, devID);
+        else
+            m_pMASGDHelper = make_shared<BasicModelAveragingSGD<ElemType>>(m_mpi, traceLevel, devID);
     }
     else if (GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD)
     {
@@ -1841,6 +3237,10 @@ void SGD<ElemType>::InitModelAggregationHandler(int traceLevel, DEVICEID_TYPE de
                                                                  m_modelAggregationBlockSize);
 #endif 
     }
+    else if (GetParallelizationMethod() == ParallelizationMethod::asyncParameterServerSGD)
+    {
+        m_pMASGDHelper = make_shared<AsyncParameterServerSGD<ElemType>>(m_mpi, traceLevel, devID, m_asyncMaxStaleness);
+    }
 }
 // public:
 // UpdateWeightsS - static version of UpdateWeights()
@@ -1890,9 +3290,15 @@ template <class ElemType>
     if (L2RegWeight > 0)
     {
         // multiply by actualMBSize so that it's invariant to minibatch size since learning rate is per sample
-        Matrix<ElemType>::ScaleAndAdd((ElemType)(L2RegWeight * actualMBSize), functionValues, gradientValues);
+        // A block-sparse gradient (e.g. of an embedding with sparse input) stays sparse: only the columns seen in the minibatch decay.
+        if (gradientValues.GetMatrixType() == MatrixType::SPARSE)
+            Matrix<ElemType>::ScaleAndAddOnSparseBlocks((ElemType)(L2RegWeight * actualMBSize), functionValues, gradientValues);
+        else
+            Matrix<ElemType>::ScaleAndAdd((ElemType)(L2RegWeight * actualMBSize), functionValues, gradientValues);
     }
 
+    // With a block-sparse gradient, the updates below only touch the columns of the gradient's blocks, and so does momentum:
+    // the smoothed gradient of the other columns is neither decayed nor applied (lazy momentum).
     if (adpType == GradientsUpdateType::None)
     {
         smoothedGradient.NormalGrad(gradientValues, functionValues,
@@ -1963,6 +3369,103 @@ void SGD<ElemType>::UpdateWeights(const ComputationNodeBasePtr& node,
     node->BumpEvalTimeStamp();
 }
 
+template <class ElemType>
+bool SGD<ElemType>::UnscaleGradients(const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    // detect overflow from the sum of all gradient elements, which is Inf or NaN if any of them is, with a single
+    // transfer from the device. A sum that overflows itself only makes the scale smaller again.
+    // Sparse gradients are not checked, as their sum is not implemented.
+    Matrix<ElemType> sum(CPUDEVICE), partial(CPUDEVICE);
+    bool haveSum = false;
+    for (const auto& nodeBase : learnableNodes)
+    {
+        if (!nodeBase->IsParameterUpdateRequired())
+            continue;
+        auto& gradient = dynamic_pointer_cast<ComputationNode<ElemType>>(nodeBase)->Gradient();
+        if (gradient.IsEmpty() || gradient.GetMatrixType() == MatrixType::SPARSE)
+            continue;
+        if (!haveSum)
+        {
+            sum.TransferToDeviceIfNotThere(gradient.GetDeviceId(), true, false, false);
+            sum.AssignSumOfElements(gradient);
+            partial.TransferToDeviceIfNotThere(gradient.GetDeviceId(), true, false, false);
+            haveSum = true;
+        }
+        else
+        {
+            partial.AssignSumOfElements(gradient);
+            sum += partial;
+        }
+    }
+
+    if (haveSum && !std::isfinite((double) sum.Get00Element()))
+    {
+        m_lossScale = max(m_lossScale / 2, 1.0);
+        m_numUpdatesSinceLossScaleChange = 0;
+        if (m_traceLevel > 0)
+            LOGPRINTF(stderr, "UnscaleGradients: Gradients overflowed, skipping the update and reducing the loss scale to %.9g.\n", m_lossScale);
+        return false;
+    }
+
+    for (const auto& nodeBase : learnableNodes)
+    {
+        if (nodeBase->IsParameterUpdateRequired())
+            Matrix<ElemType>::Scale((ElemType) (1 / m_lossScale), dynamic_pointer_cast<ComputationNode<ElemType>>(nodeBase)->Gradient());
+    }
+
+    if (++m_numUpdatesSinceLossScaleChange >= m_lossScaleGrowthInterval)
+    {
+        m_lossScale *= 2;
+        m_numUpdatesSinceLossScaleChange = 0;
+        if (m_traceLevel > 1)
+            LOGPRINTF(stderr, "UnscaleGradients: Increasing the loss scale to %.9g.\n", m_lossScale);
+    }
+    return true;
+}
+
+template <class ElemType>
+void SGD<ElemType>::UpdateWeightsMultiTensor(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                             std::list<Matrix<ElemType>>& smoothedGradients,
+                                             const double learnRatePerSample,
+                                             const double momentumPerSample,
+                                             const size_t actualMBSize) const
+{
+    assert(GradUpdateType() == GradientsUpdateType::None && GradientUpdateNoiseStd() == 0);
+
+    std::vector<ComputationNodeBasePtr> nodes;
+    std::vector<Matrix<ElemType>*> smoothedGradientMatrices, gradientMatrices, valueMatrices;
+    std::vector<ElemType> learnRatesPerSample;
+    auto smoothedGradientIter = smoothedGradients.begin();
+    for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+    {
+        ComputationNodeBasePtr node = *nodeIter;
+        if (!node->IsParameterUpdateRequired())
+            continue;
+        auto parameter = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+        // block-sparse gradients keep their own update, which only touches the columns seen in the minibatch
+        if (parameter->Gradient().GetMatrixType() != MatrixType::DENSE)
+        {
+            UpdateWeights(node, *smoothedGradientIter, learnRatePerSample, momentumPerSample, actualMBSize,
+                          m_L2RegWeight, m_L1RegWeight, m_needAveMultiplier, m_useNesterovMomentum);
+            continue;
+        }
+        nodes.push_back(node);
+        smoothedGradientMatrices.push_back(&*smoothedGradientIter);
+        gradientMatrices.push_back(&parameter->Gradient());
+        valueMatrices.push_back(&parameter->Value());
+        learnRatesPerSample.push_back((ElemType) (learnRatePerSample * node->GetLearningRateMultiplier()));
+    }
+
+    // as in UpdateWeightsS() and ClipGradient(), the regularization weights and clipping threshold are per minibatch
+    Matrix<ElemType>::MultiTensorNormalGrad(smoothedGradientMatrices, gradientMatrices, valueMatrices, learnRatesPerSample,
+                                            (ElemType) MomentumPerMB(momentumPerSample, actualMBSize), m_useNesterovMomentum,
+                                            (ElemType) (m_clippingThresholdPerSample * actualMBSize), m_gradientClippingWithTruncation,
+                                            (ElemType) (m_L2RegWeight * actualMBSize), (ElemType) (m_L1RegWeight * actualMBSize));
+
+    for (const auto& node : nodes)
+        node->BumpEvalTimeStamp();
+}
+
 template <class ElemType>
 void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const
 {
@@ -2001,7 +3504,7 @@ void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSam
         wstring tempFileName = checkPointFileName + L".tmp";
 
         {
-            File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+            File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite | FileOptions::fileOptionsLargeBuffer);
             fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BVersion"); 
             fstream << (size_t)CURRENT_CNTK_CHECKPOINT_VERSION; 
             fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EVersion");
@@ -2015,15 +3518,28 @@ void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSam
             fstream << minibatchSize;
             fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EMinibatchSize");
 
-            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
-
-            for (auto smoothedGradientIter = smoothedGradients.begin(); smoothedGradientIter != smoothedGradients.end(); smoothedGradientIter++)
+            if (UsesShardedCheckPoints())
             {
-                const Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
-                fstream << smoothedGradient;
+                // the smoothed gradients are in the shard files written by SaveCheckPointShard(); this records which is in which
+                size_t numShards = m_mpi->NumNodesInUse();
+                fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BShardedGradient");
+                fstream << numShards;
+                for (size_t shard : AssignCheckPointShards(smoothedGradients, numShards))
+                    fstream << shard;
+                fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EShardedGradient");
             }
+            else
+            {
+                fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
+
+                for (auto smoothedGradientIter = smoothedGradients.begin(); smoothedGradientIter != smoothedGradients.end(); smoothedGradientIter++)
+                {
+                    const Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
+                    fstream << smoothedGradient;
+                }
 
-            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+                fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+            }
 
             fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ECKP");
             if (m_pMASGDHelper)
@@ -2037,6 +3553,53 @@ void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSam
     }
 }
 
+template <class ElemType>
+void SGD<ElemType>::SaveCheckPointInBackground(ComputationNetworkPtr net, const wstring& modelName,
+                                               const size_t epoch, const size_t totalSamplesSeen,
+                                               const double learnRatePerSample,
+                                               const std::list<Matrix<ElemType>>& smoothedGradients,
+                                               const double prevCriterion,
+                                               const size_t minibatchSize,
+                                               const std::vector<wstring>& obsoleteFiles)
+{
+    WaitForCheckPointWrite(/*synchronizeWorkers=*/false);
+
+    // copy what training keeps updating, and serialize the other nodes here, so that the background thread only writes bytes;
+    // the structure of the network and the SGD state are not changed between epochs
+    auto parameters = net->SnapshotParameters();
+    auto nodeStates = net->SnapshotNodeStates(modelName + L".nodes.tmp");
+    std::list<Matrix<ElemType>> smoothedGradientsCopy;
+    for (const auto& smoothedGradient : smoothedGradients)
+    {
+        smoothedGradientsCopy.emplace_back(CPUDEVICE);
+        smoothedGradientsCopy.back().AssignValuesOf(smoothedGradient);
+    }
+
+    LOGPRINTF(stderr, "SGD: Saving checkpoint model '%ls' in the background\n", modelName.c_str());
+    m_pendingCheckPointWrite = std::async(std::launch::async,
+        [this, net, modelName, epoch, totalSamplesSeen, learnRatePerSample, prevCriterion, minibatchSize, obsoleteFiles]
+        (const ComputationNetwork::ParameterSnapshot& parameters, const ComputationNetwork::NodeStateSnapshot& nodeStates, const std::list<Matrix<ElemType>>& smoothedGradients)
+        {
+            EventTracer::Scope scope("SaveCheckPoint", "io");
+            SaveCheckPointInfo(epoch, totalSamplesSeen, learnRatePerSample, smoothedGradients, prevCriterion, minibatchSize);
+            net->SaveWithParameterSnapshot(modelName, parameters, nodeStates);
+            for (const auto& file : obsoleteFiles)
+                _wunlink(file.c_str());
+        },
+        std::move(parameters), std::move(nodeStates), std::move(smoothedGradientsCopy));
+}
+
+template <class ElemType>
+void SGD<ElemType>::WaitForCheckPointWrite(bool synchronizeWorkers)
+{
+    if (!m_asyncCheckpointing)
+        return;
+    if (m_pendingCheckPointWrite.valid())
+        m_pendingCheckPointWrite.get(); // rethrows an exception of the background write
+    if (synchronizeWorkers && m_mpi != nullptr)
+        m_mpi->WaitAll();
+}
+
 template <class ElemType>
 bool SGD<ElemType>::TryLoadCheckPointInfo(const size_t epochNumber,
                                           /*out*/ size_t& totalSamplesSeen,
@@ -2075,7 +3638,7 @@ void SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
 {
     let checkPointFileName = GetCheckPointFileNameForEpoch(int(epochNumber));
     File fstream(checkPointFileName,
-                 FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+                 FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead | FileOptions::fileOptionsMemoryMapped);
 
     // version info 
     size_t ckpVersion = CNTK_CHECKPOINT_VERSION_1; // if no version info is found -> version 1
@@ -2101,14 +3664,27 @@ void SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
         minibatchSize = m_mbSize[epochNumber];
     }
 
-    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
-
-    for (auto smoothedGradientIter = smoothedGradients.begin(); smoothedGradientIter != smoothedGradients.end(); smoothedGradientIter++)
+    if (fstream.TryGetMarker(FileMarker::fileMarkerBeginSection, L"BShardedGradient"))
+    {
+        size_t numShards;
+        fstream >> numShards;
+        std::vector<size_t> shardOfGradient(smoothedGradients.size());
+        for (auto& shard : shardOfGradient)
+            fstream >> shard;
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EShardedGradient");
+        LoadCheckPointShards(epochNumber, shardOfGradient, numShards, smoothedGradients);
+    }
+    else
     {
-        Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
-        fstream >> smoothedGradient;
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
+
+        for (auto smoothedGradientIter = smoothedGradients.begin(); smoothedGradientIter != smoothedGradients.end(); smoothedGradientIter++)
+        {
+            Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
+            fstream >> smoothedGradient;
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EGradient");
     }
-    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EGradient");
 
     fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ECKP");
 
@@ -2120,12 +3696,394 @@ void SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
     return;
 }
 
+// Partition the smoothed gradients over numShards shards of about equal size: the largest first, each into the smallest shard so far.
+template <class ElemType>
+std::vector<size_t> SGD<ElemType>::AssignCheckPointShards(const std::list<Matrix<ElemType>>& smoothedGradients, size_t numShards) const
+{
+    std::vector<size_t> order(smoothedGradients.size());
+    std::vector<size_t> sizes;
+    for (const auto& smoothedGradient : smoothedGradients)
+        sizes.push_back(smoothedGradient.GetNumElements());
+    for (size_t j = 0; j < order.size(); j++)
+        order[j] = j;
+    std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    std::vector<size_t> shardOfGradient(smoothedGradients.size());
+    std::vector<size_t> shardSizes(numShards, 0);
+    for (size_t j : order)
+    {
+        size_t shard = std::min_element(shardSizes.begin(), shardSizes.end()) - shardSizes.begin();
+        shardOfGradient[j] = shard;
+        shardSizes[shard] += sizes[j];
+    }
+    return shardOfGradient;
+}
+
+// Write the smoothed gradients of this worker's shard. Each shard holds pairs of the index of a smoothed gradient and its value.
+template <class ElemType>
+void SGD<ElemType>::SaveCheckPointShard(const size_t epoch, const std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    size_t numShards = m_mpi->NumNodesInUse();
+    size_t shard = m_mpi->CurrentNodeRank();
+    if (shard >= numShards) // idle worker
+        return;
+
+    auto shardOfGradient = AssignCheckPointShards(smoothedGradients, numShards);
+    wstring shardFileName = GetCheckPointShardFileName(GetCheckPointFileNameForEpoch(int(epoch)), shard);
+    wstring tempFileName = shardFileName + L".tmp";
+    {
+        File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite | FileOptions::fileOptionsLargeBuffer);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BGradientShard");
+        fstream << shard << numShards << (size_t) std::count(shardOfGradient.begin(), shardOfGradient.end(), shard);
+        size_t j = 0;
+        for (auto smoothedGradientIter = smoothedGradients.begin(); smoothedGradientIter != smoothedGradients.end(); smoothedGradientIter++, j++)
+        {
+            if (shardOfGradient[j] == shard)
+                fstream << j << *smoothedGradientIter;
+        }
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EGradientShard");
+        fstream.Flush();
+    }
+    _wunlink(shardFileName.c_str());
+    renameOrDie(tempFileName, shardFileName);
+}
+
+// Read the shards of a sharded checkpoint. Shard s is read by worker s mod the number of workers (which may differ from
+// that of the training that wrote the checkpoint); the workers then broadcast what they read.
+template <class ElemType>
+void SGD<ElemType>::LoadCheckPointShards(const size_t epochNumber, const std::vector<size_t>& shardOfGradient, size_t numShards,
+                                         std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    size_t numReaders = (m_mpi == nullptr) ? 1 : m_mpi->NumNodesInUse();
+    size_t rank = (m_mpi == nullptr) ? 0 : m_mpi->CurrentNodeRank();
+    std::vector<Matrix<ElemType>*> gradients;
+    for (auto& smoothedGradient : smoothedGradients)
+        gradients.push_back(&smoothedGradient);
+
+    let checkPointFileName = GetCheckPointFileNameForEpoch(int(epochNumber));
+    for (size_t shard = rank; shard < numShards; shard += numReaders)
+    {
+        File fstream(GetCheckPointShardFileName(checkPointFileName, shard), FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead | FileOptions::fileOptionsMemoryMapped);
+        size_t shardInFile, numShardsInFile, numGradientsInShard;
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BGradientShard");
+        fstream >> shardInFile >> numShardsInFile >> numGradientsInShard;
+        if (shardInFile != shard || numShardsInFile != numShards)
+            RuntimeError("LoadCheckPointShards: Shard file %d of %d of '%ls' is inconsistent with the checkpoint file.", (int) shard, (int) numShards, checkPointFileName.c_str());
+        for (size_t k = 0; k < numGradientsInShard; k++)
+        {
+            size_t j;
+            fstream >> j;
+            if (j >= gradients.size() || shardOfGradient[j] != shard)
+                RuntimeError("LoadCheckPointShards: Shard file %d of '%ls' has an unexpected smoothed gradient %d.", (int) shard, checkPointFileName.c_str(), (int) j);
+            fstream >> *gradients[j];
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EGradientShard");
+    }
+
+    if (numReaders > 1)
+    {
+        for (size_t j = 0; j < gradients.size(); j++)
+        {
+            size_t root = shardOfGradient[j] % numReaders;
+            Matrix<ElemType> buffer(gradients[j]->GetNumRows(), gradients[j]->GetNumCols(), CPUDEVICE);
+            if (rank == root)
+                buffer.AssignValuesOf(*gradients[j]);
+            m_mpi->Bcast(buffer.Data(), buffer.GetNumElements(), root);
+            if (rank != root)
+                gradients[j]->AssignValuesOf(buffer);
+        }
+    }
+}
+
+template <class ElemType>
+void SGD<ElemType>::SaveMidEpochCheckPoint(ComputationNetworkPtr net, const MidEpochCheckPoint& checkPoint, const std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    bool isMainNode = (m_mpi == nullptr) || m_mpi->IsMainNode();
+    wstring modelFileName = GetMidEpochModelFileName(checkPoint.epoch, checkPoint.numMBsRun);
+    if (isMainNode)
+    {
+        WaitForCheckPointWrite(/*synchronizeWorkers=*/false);
+        LOGPRINTF(stderr, "SGD: Saving mid-epoch checkpoint model '%ls'\n", modelFileName.c_str());
+        net->Save(modelFileName);
+    }
+    // the state files written next refer to a complete model
+    if (m_mpi != nullptr)
+        m_mpi->WaitAll();
+
+    wstring checkPointFileName = GetMidEpochCheckPointFileName(checkPoint.epoch, (m_mpi == nullptr) ? 0 : m_mpi->CurrentNodeRank());
+    wstring tempFileName = checkPointFileName + L".tmp";
+    {
+        File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite | FileOptions::fileOptionsLargeBuffer);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BMidEpoch");
+        fstream << checkPoint.numMBsRun << checkPoint.numWorkers << checkPoint.totalEpochSamples << checkPoint.learnRatePerSample << checkPoint.minibatchSize;
+        fstream << checkPoint.epochCriterion.first << checkPoint.epochCriterion.second << checkPoint.epochEvalErrors.size();
+        for (const auto& evalErrors : checkPoint.epochEvalErrors)
+            fstream << evalErrors.first << evalErrors.second;
+        fstream << checkPoint.lossScale << checkPoint.numUpdatesSinceLossScaleChange;
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EMidEpoch");
+
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BReaderState");
+        fstream << checkPoint.readerState.size();
+        for (size_t value : checkPoint.readerState)
+            fstream << value;
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EReaderState");
+
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
+        for (const auto& smoothedGradient : smoothedGradients)
+            fstream << smoothedGradient;
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+        fstream.Flush();
+    }
+    _wunlink(checkPointFileName.c_str());
+    renameOrDie(tempFileName, checkPointFileName);
+
+    // the model of the previous mid-epoch checkpoint, and the files of workers of a job with more of them,
+    // are no longer referred to once all workers have written theirs
+    if (m_mpi != nullptr)
+        m_mpi->WaitAll();
+    if (isMainNode)
+    {
+        if (!m_midEpochModelFileName.empty() && m_midEpochModelFileName != modelFileName)
+            _wunlink(m_midEpochModelFileName.c_str());
+        m_midEpochModelFileName = modelFileName;
+        for (size_t rank = checkPoint.numWorkers; rank < m_midEpochCheckPointWorkers; rank++)
+            _wunlink(GetMidEpochCheckPointFileName(checkPoint.epoch, rank).c_str());
+    }
+    m_midEpochCheckPointWorkers = checkPoint.numWorkers;
+}
+
+// Read a mid-epoch checkpoint file; the smoothed gradients are only read if asked for.
+template <class ElemType>
+void SGD<ElemType>::ReadMidEpochCheckPoint(const wstring& fileName, MidEpochCheckPoint& checkPoint, std::list<Matrix<ElemType>>* smoothedGradients)
+{
+    File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BMidEpoch");
+    size_t numEvalErrors;
+    fstream >> checkPoint.numMBsRun >> checkPoint.numWorkers >> checkPoint.totalEpochSamples >> checkPoint.learnRatePerSample >> checkPoint.minibatchSize;
+    fstream >> checkPoint.epochCriterion.first >> checkPoint.epochCriterion.second >> numEvalErrors;
+    checkPoint.epochEvalErrors.resize(numEvalErrors);
+    for (auto& evalErrors : checkPoint.epochEvalErrors)
+        fstream >> evalErrors.first >> evalErrors.second;
+    fstream >> checkPoint.lossScale >> checkPoint.numUpdatesSinceLossScaleChange;
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EMidEpoch");
+
+    size_t readerStateSize;
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BReaderState");
+    fstream >> readerStateSize;
+    checkPoint.readerState.resize(readerStateSize);
+    for (auto& value : checkPoint.readerState)
+        fstream >> value;
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EReaderState");
+    if (checkPoint.readerState.empty())
+        RuntimeError("ReadMidEpochCheckPoint: The mid-epoch checkpoint '%ls' has no reader state.", fileName.c_str());
+
+    if (smoothedGradients)
+    {
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
+        for (auto& smoothedGradient : *smoothedGradients)
+            fstream >> smoothedGradient;
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+    }
+}
+
+// Load the mid-epoch checkpoint of the given epoch, if all workers that wrote it have one of the same minibatch.
+// The reader state and the progress of the epoch are kept in m_midEpochCheckPoint, for TrainOneEpoch() to continue from.
+// A job restarted with a different number of workers (elastic restart) continues from the earliest sample position of
+// any of the previous workers, from which the data are partitioned anew; the few sequences between that position and
+// that of each previous worker are trained on again. The model, smoothed gradients and criteria are those of the first
+// worker, which with data-parallel SGD are the same as every other worker's.
+template <class ElemType>
+bool SGD<ElemType>::TryLoadMidEpochCheckPoint(const int epoch, ComputationNetworkPtr net, std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    size_t numWorkers = (m_mpi == nullptr) ? 1 : m_mpi->NumNodesInUse();
+    size_t rank = (m_mpi == nullptr) ? 0 : m_mpi->CurrentNodeRank();
+
+    // the file of the first worker tells how many workers wrote the checkpoint
+    let firstFileName = GetMidEpochCheckPointFileName(epoch, 0);
+    if (!fexists(firstFileName.c_str()))
+        return false;
+    MidEpochCheckPoint first;
+    ReadMidEpochCheckPoint(firstFileName, first, nullptr);
+    m_midEpochCheckPointWorkers = first.numWorkers;
+
+    // a job killed while writing a mid-epoch checkpoint may leave the workers' files at different minibatches
+    int complete = 1;
+    size_t restartPosition = first.readerState[0];
+    for (size_t k = 1; complete && (k < first.numWorkers); k++)
+    {
+        let fileName = GetMidEpochCheckPointFileName(epoch, k);
+        MidEpochCheckPoint other;
+        complete = fexists(fileName.c_str()) ? 1 : 0;
+        if (complete)
+        {
+            ReadMidEpochCheckPoint(fileName, other, nullptr);
+            complete = (other.numMBsRun == first.numMBsRun) && (other.numWorkers == first.numWorkers);
+            restartPosition = std::min(restartPosition, other.readerState[0]);
+        }
+    }
+    if (m_mpi != nullptr)
+    {
+        int incomplete = !complete;
+        m_mpi->AllReduceMax(&incomplete, 1);
+        complete = !incomplete;
+    }
+    if (!complete)
+    {
+        LOGPRINTF(stderr, "Warning: The mid-epoch checkpoints of epoch %d are incomplete. The epoch is started over.\n", epoch + 1);
+        return false;
+    }
+
+    let modelFileName = GetMidEpochModelFileName(epoch, first.numMBsRun);
+    LOGPRINTF(stderr, "Loading mid-epoch checkpoint model '%ls'\n", modelFileName.c_str());
+    net->RereadPersistableParameters<ElemType>(modelFileName);
+    if ((m_mpi == nullptr) || m_mpi->IsMainNode())
+        m_midEpochModelFileName = modelFileName;
+
+    auto checkPoint = make_unique<MidEpochCheckPoint>();
+    if (first.numWorkers == numWorkers)
+    {
+        ReadMidEpochCheckPoint(GetMidEpochCheckPointFileName(epoch, rank), *checkPoint, &smoothedGradients);
+    }
+    else
+    {
+        LOGPRINTF(stderr, "The mid-epoch checkpoint of epoch %d was written by %d workers; %d workers continue it from sample position %d.\n",
+                  epoch + 1, (int) first.numWorkers, (int) numWorkers, (int) restartPosition);
+        ReadMidEpochCheckPoint(firstFileName, *checkPoint, &smoothedGradients);
+        checkPoint->readerState.assign(1, restartPosition);
+    }
+    checkPoint->epoch = epoch;
+    m_midEpochCheckPoint = std::move(checkPoint);
+    return true;
+}
+
+// the mid-epoch checkpoint files of all workers, and the model of the last one
+template <class ElemType>
+std::vector<wstring> SGD<ElemType>::GetMidEpochCheckPointFiles(const int epoch)
+{
+    std::vector<wstring> files;
+    if (m_numMBsToCheckpoint == 0)
+        return files;
+
+    size_t numWorkers = std::max((m_mpi == nullptr) ? 1 : m_mpi->NumNodesInUse(), m_midEpochCheckPointWorkers);
+    for (size_t rank = 0; rank < numWorkers; rank++)
+        files.push_back(GetMidEpochCheckPointFileName(epoch, rank));
+    if (!m_midEpochModelFileName.empty())
+        files.push_back(m_midEpochModelFileName);
+    m_midEpochModelFileName.clear();
+    m_midEpochCheckPointWorkers = 0;
+    return files;
+}
+
+template <class ElemType>
+wstring SGD<ElemType>::GetMidEpochCheckPointFileName(const int epoch, size_t rank)
+{
+    wstring checkPointFileName = GetCheckPointFileNameForEpoch(epoch) + L".mid";
+    if (rank == 0)
+        return checkPointFileName;
+    return msra::strfun::wstrprintf(L"%ls.rank%d", checkPointFileName.c_str(), (int) rank);
+}
+
+template <class ElemType>
+wstring SGD<ElemType>::GetMidEpochModelFileName(const int epoch, size_t numMBsRun)
+{
+    return msra::strfun::wstrprintf(L"%ls.mid%d", GetModelNameForEpoch(epoch).c_str(), (int) numMBsRun);
+}
+
 template <class ElemType>
 wstring SGD<ElemType>::GetCheckPointFileNameForEpoch(const int epoch)
 {
     return GetModelNameForEpoch(epoch) + L".ckp";
 }
 
+template <class ElemType>
+/*static*/ wstring SGD<ElemType>::GetCheckPointShardFileName(const wstring& checkPointFileName, size_t shard)
+{
+    return msra::strfun::wstrprintf(L"%ls.shard%d", checkPointFileName.c_str(), (int) shard);
+}
+
+template <class ElemType>
+bool SGD<ElemType>::IsModelParallelWeight(const ComputationNodeBasePtr& node) const
+{
+    return std::find(m_modelParallelWeights.begin(), m_modelParallelWeights.end(), node) != m_modelParallelWeights.end();
+}
+
+// The workers build identical networks, hence start out with equal weight shards. The other workers permute the
+// elements of theirs, which keeps the distribution of the initialization.
+template <class ElemType>
+void SGD<ElemType>::DecorrelateModelParallelWeights()
+{
+    if (m_mpi->IsMainNode())
+        return;
+
+    std::mt19937 rng((unsigned int) m_mpi->CurrentNodeRank());
+    for (const auto& node : m_modelParallelWeights)
+    {
+        auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        std::vector<ElemType> values(value.GetNumElements());
+        value.CopySection(value.GetNumRows(), value.GetNumCols(), values.data(), value.GetNumRows());
+        std::shuffle(values.begin(), values.end(), rng);
+        value.SetValue(value.GetNumRows(), value.GetNumCols(), value.GetDeviceId(), values.data());
+    }
+}
+
+template <class ElemType>
+void SGD<ElemType>::SaveModelParallelShard(const wstring& modelFileName, const std::list<ComputationNodeBasePtr>& learnableNodes, const std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    if (!UsingModelParallelism() || m_mpi->IsMainNode() || m_mpi->IsIdle())
+        return;
+
+    wstring shardFileName = GetModelParallelShardFileName(modelFileName, m_mpi->CurrentNodeRank());
+    wstring tempFileName = shardFileName + L".tmp";
+    {
+        File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BModelParallelShard");
+        fstream << (size_t) m_modelParallelWeights.size();
+        auto smoothedGradientIter = smoothedGradients.begin();
+        for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+        {
+            if (IsModelParallelWeight(*nodeIter))
+                fstream << (*nodeIter)->NodeName() << dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter)->Value() << *smoothedGradientIter;
+        }
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EModelParallelShard");
+        fstream.Flush();
+    }
+    _wunlink(shardFileName.c_str());
+    renameOrDie(tempFileName, shardFileName);
+}
+
+template <class ElemType>
+void SGD<ElemType>::LoadModelParallelShard(const wstring& modelFileName, const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    if (!UsingModelParallelism() || m_mpi->IsMainNode() || m_mpi->IsIdle())
+        return;
+
+    wstring shardFileName = GetModelParallelShardFileName(modelFileName, m_mpi->CurrentNodeRank());
+    File fstream(shardFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+    fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BModelParallelShard");
+    size_t numWeights;
+    fstream >> numWeights;
+    if (numWeights != m_modelParallelWeights.size())
+        RuntimeError("LoadModelParallelShard: '%ls' has %d weight shards instead of %d.", shardFileName.c_str(), (int) numWeights, (int) m_modelParallelWeights.size());
+    auto smoothedGradientIter = smoothedGradients.begin();
+    for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+    {
+        if (!IsModelParallelWeight(*nodeIter))
+            continue;
+        wstring nodeName;
+        fstream >> nodeName;
+        if (nodeName != (*nodeIter)->NodeName())
+            RuntimeError("LoadModelParallelShard: '%ls' has the weights of %ls instead of %ls.", shardFileName.c_str(), nodeName.c_str(), (*nodeIter)->NodeName().c_str());
+        fstream >> dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter)->Value() >> *smoothedGradientIter;
+    }
+    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EModelParallelShard");
+}
+
+template <class ElemType>
+/*static*/ wstring SGD<ElemType>::GetModelParallelShardFileName(const wstring& modelFileName, size_t rank)
+{
+    return msra::strfun::wstrprintf(L"%ls.shard%d", modelFileName.c_str(), (int) rank);
+}
+
 template <class ElemType>
 wstring SGD<ElemType>::GetModelNameForEpoch(const int epoch, bool bLastModel)
 {
@@ -2207,7 +4165,7 @@ bool SGD<ElemType>::GradientCheck(ComputationNetworkPtr net,
             LOGPRINTF(stderr, "###### d%ls######\n", node->NodeName().c_str());
 
             double eOrg = node->Value()(irow, icol);
-            node->Value().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Value().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             node->BumpEvalTimeStamp();
 
@@ -2224,13 +4182,13 @@ bool SGD<ElemType>::GradientCheck(ComputationNetworkPtr net,
             // TODO: why is this value not used?
             criterionNodes[npos]->Get00Element();
             double eGradErr = node->Gradient()(irow, icol);
-            node->Gradient().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Gradient().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             double ePos = eOrg + EPSILON;
             double eNeg = eOrg - EPSILON;
 
             node->Value()(irow, icol) = (ElemType) ePos;
-            node->Value().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Value().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             node->BumpEvalTimeStamp();
             net->ForwardProp(criterionNodes[npos]);
@@ -2239,7 +4197,7 @@ bool SGD<ElemType>::GradientCheck(ComputationNetworkPtr net,
             double mbEvalCriPos = criterionNodes[npos]->Get00Element(); // TODO: make Get00Element() a function of ComputationNodeBase
 
             node->Value()(irow, icol) = (ElemType) eNeg;
-            node->Value().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Value().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             node->BumpEvalTimeStamp();
             net->ForwardProp(criterionNodes[npos]);
@@ -2249,7 +4207,7 @@ bool SGD<ElemType>::GradientCheck(ComputationNetworkPtr net,
 
             // back to its original parameter value
             node->Value()(irow, icol) = (ElemType) eOrg;
-            node->Value().TransferToDeviceIfNotThere(net->GetDeviceId(), true);
+            node->Value().TransferToDeviceIfNotThere(node->GetDeviceId(), true);
 
             // check if they are consistent
             double eGradNum = ((mbEvalCriPos - mbEvalCriNeg) / (ePos - eNeg));
@@ -2309,13 +4267,37 @@ static GradientsUpdateType ParseGradUpdateType(const wstring& s)
     else InvalidArgument("ParseGradUpdateType: Invalid Gradient Updating Type. Valid values are (none | adagrad | rmsProp | fsAdagrad )");
 }
 
+static CompactElementType ParseValueCompressionType(const wstring& s)
+{
+    if      (EqualCI(s, L"fp16") || EqualCI(s, L"float16")) return CompactElementType::float16;
+    else if (EqualCI(s, L"int8") || EqualCI(s, L"uint8"))   return CompactElementType::uint8;
+    else InvalidArgument("ParseValueCompressionType: Invalid value compression type. Valid values are (fp16 | int8)");
+}
+
 static ParallelizationMethod ParseParallelizationMethod(const wstring& s)
 {
     if      (EqualCI(s, L"") || EqualCI(s, L"none")) return ParallelizationMethod::none;
     else if (EqualCI(s, L"DataParallelSGD"))         return ParallelizationMethod::dataParallelSGD;
     else if (EqualCI(s, L"ModelAveragingSGD"))       return ParallelizationMethod::modelAveragingSGD;
     else if (EqualCI(s, L"BlockMomentumSGD"))        return ParallelizationMethod::blockMomentumSGD;
-    else InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | DataParallelSGD | ModelAveragingSGD | BlockMomentumSGD)");
+    else if (EqualCI(s, L"AsyncParameterServerSGD")) return ParallelizationMethod::asyncParameterServerSGD;
+    else InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | DataParallelSGD | ModelAveragingSGD | BlockMomentumSGD | AsyncParameterServerSGD)");
+}
+
+static GradientCommunicationBackend ParseGradientCommunicationBackend(const wstring& s)
+{
+    if      (EqualCI(s, L"") || EqualCI(s, L"mpi")) return GradientCommunicationBackend::mpi;
+    else if (EqualCI(s, L"cudaAwareMPI"))           return GradientCommunicationBackend::cudaAwareMPI;
+    else if (EqualCI(s, L"nccl"))                   return GradientCommunicationBackend::nccl;
+    else InvalidArgument("communicationBackend: Invalid value. Valid values are (mpi | cudaAwareMPI | nccl)");
+}
+
+static MatrixTransferCheck ParseMatrixTransferCheck(const wstring& s)
+{
+    if      (EqualCI(s, L"") || EqualCI(s, L"none")) return MatrixTransferCheck::none;
+    else if (EqualCI(s, L"warn"))                    return MatrixTransferCheck::warn;
+    else if (EqualCI(s, L"fail"))                    return MatrixTransferCheck::fail;
+    else InvalidArgument("implicitTransferCheck: Invalid value. Valid values are (none | warn | fail)");
 }
 
 static LearningRateSearchAlgorithm ParseLearningRateSearchType(const wstring& s)
@@ -2362,6 +4344,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
 
     m_numPrevLearnRates = configAALR(L"numPrevLearnRates", (size_t) 5);
     m_numBestSearchEpoch = configAALR(L"numBestSearchEpoch", (size_t) 1);
+    m_parallelLearnRateSearch = configAALR(L"parallelLearnRateSearch", false);
     m_loadBestModel = configAALR(L"loadBestModel", true);
     m_useCVSetControlLRIfCVExists = configAALR(L"UseCVSetControlLRIfCVExists", true);
     m_useEvalCriterionControlLR = configAALR(L"UseEvalCriterionControlLR", false);
@@ -2398,12 +4381,24 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
 
     m_traceLevel = configSGD(L"traceLevel", (int) 0);
     m_numMBsToShowResult = configSGD(L"numMBsToShowResult", (size_t)10);
+    m_numMBsToCheckpoint = configSGD(L"numMBsToCheckpoint", (size_t)0);
     m_firstMBsToShowResult = configSGD(L"firstMBsToShowResult", (size_t)0);
     m_numMBsToCUDAProfile = configSGD(L"numMBsToCUDAProfile", (size_t)0);
+    m_nodeProfilingRate = configSGD(L"nodeProfilingRate", 0.0);
+    m_nodeProfilingTraceFile = (const wstring&) configSGD(L"nodeProfilingTraceFile", L"");
+    m_traceTimelineFile = (const wstring&) configSGD(L"traceTimelineFile", L"");
 
     m_gradientClippingWithTruncation = configSGD(L"gradientClippingWithTruncation", true);
     m_clippingThresholdPerSample = configSGD(L"clippingThresholdPerSample", numeric_limits<double>::infinity());
 
+    m_dynamicLossScaling = configSGD(L"dynamicLossScaling", false);
+    m_initialLossScale = configSGD(L"initialLossScale", 32768.0);
+    m_lossScaleGrowthInterval = configSGD(L"lossScaleGrowthInterval", (size_t) 2000);
+    if (m_initialLossScale < 1)
+        InvalidArgument("initialLossScale must be >= 1.");
+    if (m_lossScaleGrowthInterval == 0)
+        InvalidArgument("lossScaleGrowthInterval must be > 0.");
+
     // sequence-training parameters
     m_hSmoothingWeight = configSGD(L"hSmoothingWeight", 0.95);
     m_frameDropThresh = configSGD(L"frameDropThresh", 1e-10);
@@ -2415,6 +4410,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_seqGammarCalcWP = configSGD(L"seqGammarWordPen", 0.0);
 
     m_dropoutRates = configSGD(L"dropoutRate", ConfigRecordType::Array(doubleargvector(vector<double>{0.0})));
+    m_counterBasedDropout = configSGD(L"counterBasedDropout", false);
     m_batchNormalizationTimeConstant = configSGD(L"batchNormalizationTimeConstant", ConfigRecordType::Array(doubleargvector(vector<double>{0})));
     m_batchNormalizationBlendTimeConstant = configSGD(L"batchNormalizationBlendTimeConstant", ConfigRecordType::Array(doubleargvector(vector<double>{0})));
 
@@ -2445,6 +4441,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
 
     m_adaptationRegType = ParseAdaptationRegType(configSGD(L"adaptationRegType", L"None"));
     m_adaptationRegWeight = configSGD(L"adaptationRegWeight", 0.0);
+    m_adaptationRegRefInput = (const wstring&) configSGD(L"adaptationRegRefInput", L"");
 
     // gradient check setup
     m_doGradientCheck = configSGD(L"gradientcheck", false);
@@ -2456,6 +4453,23 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     }
 
     m_useAllDataForPreComputedNode = configSGD(L"UseAllDataForPreComputedNode", true);
+    m_preComputeCache = (const wstring&) configSGD(L"preComputeCache", L"");
+
+    m_implicitTransferCheck = ParseMatrixTransferCheck(configSGD(L"implicitTransferCheck", L"none"));
+    m_fuseAffineActivation = configSGD(L"fuseAffineActivation", false);
+    m_optimizeNetwork = configSGD(L"optimizeNetwork", false);
+    m_offloadToHost = configSGD(L"offloadToHost", false);
+    m_memoryReport = configSGD(L"memoryReport", false);
+    m_dryRun = configSGD(L"dryRun", false);
+    m_autoMaxSamplesInRAM = configSGD(L"autoMaxSamplesInRAM", false);
+    m_autoSubminibatches = configSGD(L"autoSubminibatches", false);
+    m_autoSubminibatchesMemoryMargin = configSGD(L"autoSubminibatchesMemoryMargin", 0.1);
+    m_recoverFromOutOfMemory = configSGD(L"recoverFromOutOfMemory", false);
+    m_peakMemoryProbe = PeakMemoryProbe{ 0, 0, 0, m_maxSamplesInRAM };
+    if (m_autoSubminibatches && m_numSubminiBatches > 1)
+        InvalidArgument("autoSubminibatches cannot be combined with numSubminibatches; maxSamplesInRAM can be given as an upper limit.");
+    if (m_autoSubminibatchesMemoryMargin < 0 || m_autoSubminibatchesMemoryMargin >= 1)
+        InvalidArgument("autoSubminibatchesMemoryMargin must be in [0, 1).");
 
     // consistency checks
     for (size_t i = 0; i < m_mbSize.size(); i++)
@@ -2521,6 +4535,8 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
         m_momentumSpecifiedForMBSize = m_mbSize;
     }
     m_useNesterovMomentum = useNesterovMomentum;
+    m_fusedParameterUpdate = configSGD(L"fusedParameterUpdate", false);
+    m_useCudaGraphs = configSGD(L"useCudaGraphs", false);
 
     for (int i = 0; i < m_momentumParam.size(); i++)
     {
@@ -2558,9 +4574,20 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_numGradientBits = 32;
     m_zeroThresholdFor1Bit = true;
     m_bufferedAsyncGradientAggregation = false;
+    m_sparseGradientDensity = 0;
+    m_gradientBucketSizeInBytes = 0;
+    m_gradientCommunicationBackend = GradientCommunicationBackend::mpi;
+    m_numBackupWorkers = 0;
+    m_deferLateGradients = false;
     m_enableDistributedMBReading = false;
+    m_syncBatchNormalizationStatistics = false;
+    m_hierarchicalAllReduce = false;
+    m_sharedMemoryAllReduce = false;
+    m_modelBroadcastChunkSizeInBytes = 4 * 1024 * 1024;
     m_parallelizationStartEpochNum = 0;
     m_modelAggregationBlockSize = 0; 
+    m_pipelineModelAggregation = false;
+    m_asyncMaxStaleness = 0;
 
     if (configSGD.Exists(L"ParallelTrain"))
     {
@@ -2579,6 +4606,20 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
             m_parallelizationStartEpochNum = configParallelTrain(L"parallelizationStartEpoch", (int)1) - 1; // Epoch numbers internally are 0 based
             m_enableDistributedMBReading = configParallelTrain(L"distributedMBReading", false);
             m_syncStatsTrace = configParallelTrain(L"syncPerfStats", (int)0);
+            m_hierarchicalAllReduce = configParallelTrain(L"hierarchicalAllReduce", false);
+            m_sharedMemoryAllReduce = configParallelTrain(L"sharedMemoryAllReduce", false);
+            if (m_sharedMemoryAllReduce)
+                m_hierarchicalAllReduce = true;
+            double modelBroadcastChunkSizeInMB = configParallelTrain(L"modelBroadcastChunkSizeInMB", 4.0);
+            if (modelBroadcastChunkSizeInMB <= 0)
+                InvalidArgument("modelBroadcastChunkSizeInMB must be > 0!");
+            m_modelBroadcastChunkSizeInBytes = (size_t) (modelBroadcastChunkSizeInMB * 1024 * 1024);
+            if (configParallelTrain(L"modelParallelSGD", false))
+            {
+                if (m_parallelizationMethod != ParallelizationMethod::dataParallelSGD)
+                    InvalidArgument("modelParallelSGD requires parallelizationMethod=DataParallelSGD!");
+                m_parallelizationMethod = (ParallelizationMethod) ((int) m_parallelizationMethod | (int) ParallelizationMethod::modelParallelSGD);
+            }
 
             if (configParallelTrain.Exists(L"DataParallelSGD"))
             {
@@ -2587,10 +4628,58 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
                 m_numGradientBits = configDataParallelSGD(L"gradientBits", defaultGradientBits);
                 m_zeroThresholdFor1Bit = configDataParallelSGD(L"useZeroThresholdFor1BitQuantization", true);
                 m_bufferedAsyncGradientAggregation = configDataParallelSGD(L"useBufferedAsyncGradientAggregation", false);
+                m_syncBatchNormalizationStatistics = configDataParallelSGD(L"syncBatchNormalizationStatistics", false);
                 if ( m_numGradientBits < 1 || m_numGradientBits > (8 * sizeofElemType) )
                 {
                     InvalidArgument("gradientBits must be in the range [1, 32] when using precision=float and in range [1, 64] when using precision=double!");
                 }
+                m_sparseGradientDensity = configDataParallelSGD(L"sparseGradientDensity", 0.0);
+                if (m_sparseGradientDensity < 0 || m_sparseGradientDensity > 1)
+                {
+                    InvalidArgument("sparseGradientDensity must be in the range [0, 1]!");
+                }
+                if (m_sparseGradientDensity > 0 && (m_numGradientBits != (int) defaultGradientBits || m_bufferedAsyncGradientAggregation))
+                {
+                    InvalidArgument("sparseGradientDensity cannot be combined with gradientBits or useBufferedAsyncGradientAggregation!");
+                }
+                if (configDataParallelSGD(L"overlapGradientAggregation", false))
+                {
+                    double bucketSizeInMB = configDataParallelSGD(L"gradientBucketSizeInMB", 16.0);
+                    if (bucketSizeInMB <= 0)
+                        InvalidArgument("gradientBucketSizeInMB must be > 0!");
+                    m_gradientBucketSizeInBytes = (size_t) (bucketSizeInMB * 1024 * 1024);
+                    // (BatchNormalizationNode synchronizes its statistics with collectives during backprop, which would interleave with the buckets)
+                    if (m_numGradientBits != (int) defaultGradientBits || m_bufferedAsyncGradientAggregation || m_sparseGradientDensity > 0 || m_syncBatchNormalizationStatistics)
+                    {
+                        InvalidArgument("overlapGradientAggregation cannot be combined with gradientBits, useBufferedAsyncGradientAggregation, sparseGradientDensity or syncBatchNormalizationStatistics!");
+                    }
+                }
+                m_gradientCommunicationBackend = ParseGradientCommunicationBackend(configDataParallelSGD(L"communicationBackend", L"mpi"));
+                if (m_gradientCommunicationBackend != GradientCommunicationBackend::mpi)
+                {
+                    if (m_numGradientBits != (int) defaultGradientBits || m_sparseGradientDensity > 0 || m_gradientBucketSizeInBytes > 0)
+                        InvalidArgument("communicationBackend other than mpi cannot be combined with gradientBits, sparseGradientDensity or overlapGradientAggregation!");
+                    if (m_gradientCommunicationBackend == GradientCommunicationBackend::nccl && m_bufferedAsyncGradientAggregation)
+                        InvalidArgument("communicationBackend=nccl cannot be combined with useBufferedAsyncGradientAggregation!");
+                    if (m_gradientCommunicationBackend == GradientCommunicationBackend::nccl && !NcclComm::IsAvailable())
+                        InvalidArgument("communicationBackend=nccl requires a build of CNTK with NCCL (NCCL_PATH)!");
+                }
+                if (m_hierarchicalAllReduce && (m_gradientCommunicationBackend == GradientCommunicationBackend::nccl || m_sparseGradientDensity > 0))
+                {
+                    InvalidArgument("hierarchicalAllReduce cannot be combined with communicationBackend=nccl or sparseGradientDensity, which do not use an all-reduce through MPI!");
+                }
+                m_numBackupWorkers = configDataParallelSGD(L"numBackupWorkers", (size_t) 0);
+                m_deferLateGradients = configDataParallelSGD(L"deferLateGradients", false);
+                if (m_numBackupWorkers > 0)
+                {
+                    if (m_numBackupWorkers >= numMPIWorkers)
+                        InvalidArgument("numBackupWorkers must be less than the number of workers!");
+                    if (m_numGradientBits != (int) defaultGradientBits || m_bufferedAsyncGradientAggregation || m_sparseGradientDensity > 0 || m_gradientBucketSizeInBytes > 0 ||
+                        m_gradientCommunicationBackend != GradientCommunicationBackend::mpi || m_hierarchicalAllReduce || m_syncBatchNormalizationStatistics)
+                    {
+                        InvalidArgument("numBackupWorkers cannot be combined with gradientBits, useBufferedAsyncGradientAggregation, sparseGradientDensity, overlapGradientAggregation, communicationBackend, hierarchicalAllReduce or syncBatchNormalizationStatistics!");
+                    }
+                }
             }
             if (configParallelTrain.Exists(L"ModelAveragingSGD"))
             {
@@ -2632,6 +4721,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
                     fprintf(stderr, "WARNING: option syncPeroid in ModelAveragingSGD is going to be deprecated. Please use blockSizePerWorker instead in the future.\n");
                 }
 #endif
+                m_pipelineModelAggregation = configMASGD(L"pipelineModelAggregation", false);
             }
             if (configParallelTrain.Exists(L"BlockMomentumSGD"))
             {
@@ -2696,6 +4786,28 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
                 InitializeAndCheckBlockMomentumSGDParameters();
                 
             }
+            if (configParallelTrain.Exists(L"AsyncParameterServerSGD"))
+            {
+                const ConfigRecordType& configASGD(configParallelTrain(L"AsyncParameterServerSGD", ConfigRecordType::Record()));
+                if (configASGD.Exists(L"blockSizePerWorker") && configASGD.Exists(L"blockSize"))
+                {
+                    InvalidArgument("It is only allowed to set blockSizePerWorker or blockSize, not both of them");
+                }
+                else if (configASGD.Exists(L"blockSize"))
+                {
+                    m_modelAggregationBlockSize = configASGD(L"blockSize");
+                }
+                else if (configASGD.Exists(L"blockSizePerWorker"))
+                {
+                    m_modelAggregationBlockSize = configASGD(L"blockSizePerWorker");
+                    m_modelAggregationBlockSize *= numMPIWorkers;
+                }
+                else
+                {
+                    m_modelAggregationBlockSize = 40000 * numMPIWorkers;    // default value 
+                }
+                m_asyncMaxStaleness = configASGD(L"maxStaleness", (size_t) 4);
+            }
         } // if (!pMPI)
     } // if (configSGD.Exists(L"ParallelTrain"))
 }
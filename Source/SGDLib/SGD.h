@@ -17,14 +17,17 @@
 #include "Config.h"
 #include <chrono>
 #include <random>
+#include <future>
 #include "Profiler.h"
 #include "MASGD.h"
+#include "IDistGradAggregator.h"
 
 using namespace std; // ugh! TODO: get rid of this from .h files!!!
 
 #define CNTK_CHECKPOINT_VERSION_1 1     // 1 -> no version number 
 #define CNTK_CHECKPOINT_VERSION_2 2     
-#define CURRENT_CNTK_CHECKPOINT_VERSION CNTK_CHECKPOINT_VERSION_2
+#define CNTK_CHECKPOINT_VERSION_3 3     // 3 -> smoothed gradients may be in per-worker shard files
+#define CURRENT_CNTK_CHECKPOINT_VERSION CNTK_CHECKPOINT_VERSION_3
 
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -50,8 +53,8 @@ enum class GradientsUpdateType : int
     FSAdaGrad
 };
 
-// modelParallelSGD can be combined with dataParallelSGD/modelAveragingSGD/blockMomentumSGD 
-// but dataParallelSGD/modelAveragingSGD/blockMomentumSGD are mutually exclusive (at least at the moment)
+// modelParallelSGD can be combined with dataParallelSGD/modelAveragingSGD/blockMomentumSGD/asyncParameterServerSGD 
+// but dataParallelSGD/modelAveragingSGD/blockMomentumSGD/asyncParameterServerSGD are mutually exclusive (at least at the moment)
 // we assign the lower 8 bits to the enumerate data parallelization methods 
 // and next 8 bits to model parallelization methods
 enum class ParallelizationMethod : int
@@ -60,7 +63,8 @@ enum class ParallelizationMethod : int
     dataParallelSGD = 1,
     modelAveragingSGD = 2,
     blockMomentumSGD = 3,
-    modelParallelSGD = (1 << 8) // Currently unsupported
+    asyncParameterServerSGD = 4,
+    modelParallelSGD = (1 << 8)
 };
 
 // configuration parameters associated with RMSProp learning algorithm
@@ -117,6 +121,10 @@ protected:
     floatargvector m_momentumParam;
     intargvector m_momentumSpecifiedForMBSize;
     bool m_useNesterovMomentum;
+    // update all dense parameters with one multi-tensor call (momentum SGD only), see SGD::UpdateWeightsMultiTensor()
+    bool m_fusedParameterUpdate;
+    // replay the forward and backward pass of minibatches with unchanged shapes as a GPU graph, see ComputationNetwork::StepGraph
+    bool m_useCudaGraphs;
 
     // Determine the MB size used for mapping a given learning-rate or momentum parameter to a per-sample value.
     // MB size is the number of samples across all time steps and parallel sequences.
@@ -158,7 +166,13 @@ protected:
         if (m_mpi == nullptr)
             return ParallelizationMethod::none;
 
-        return m_parallelizationMethod;
+        return (ParallelizationMethod) ((int) m_parallelizationMethod & 0xff); // (the data-parallel method)
+    }
+
+    // model-parallel output layer (ModelParallelCrossEntropyWithSoftmax), on top of data-parallel SGD
+    bool UsingModelParallelism() const
+    {
+        return (m_mpi != nullptr) && ((int) m_parallelizationMethod & (int) ParallelizationMethod::modelParallelSGD);
     }
 
     // helper function to initialize and check BlockMomentumSGD related parameters
@@ -196,14 +210,28 @@ protected:
     bool m_gradientClippingWithTruncation;
     double m_clippingThresholdPerSample;
 
+    // dynamic loss scaling, for products in reduced precision (halfPrecisionGEMM): the criterion gradient is multiplied by
+    // a loss scale so that small gradients do not flush to zero. If the gradients overflow, the update is skipped and the
+    // scale halved; after lossScaleGrowthInterval updates without overflow, it is doubled.
+    bool m_dynamicLossScaling;
+    double m_initialLossScale;
+    size_t m_lossScaleGrowthInterval;
+
     intargvector m_numMiniBatch4LRSearch;
     size_t m_numBestSearchEpoch;
+    // with several workers, train the trial mini-epochs of the learning-rate search side by side, one per worker,
+    // instead of one after another with all workers (see SearchForBestLearnRate())
+    bool m_parallelLearnRateSearch;
 
     LearningRateSearchAlgorithm m_autoLearnRateSearchType;
 
     AdaptationRegType m_adaptationRegType;
     double m_adaptationRegWeight;
     bool m_needAdaptRegularization;
+    // KL adaptation: name of a feature input of the model that streams the output of the reference network, as computed once
+    // beforehand (e.g. by the 'write' action) and served by the reader as an additional stream; the reference network is
+    // then neither loaded nor evaluated during adaptation
+    std::wstring m_adaptationRegRefInput;
 
     bool m_loadBestModel;
     double m_reduceLearnRateIfImproveLessThan;
@@ -224,6 +252,7 @@ protected:
     size_t m_minibatchSizeTuningMax;
 
     doubleargvector m_dropoutRates;
+    bool m_counterBasedDropout; // dropout masks from the counter-based generator, regenerated for backprop instead of kept (changes the masks)
     doubleargvector m_batchNormalizationTimeConstant;
     doubleargvector m_batchNormalizationBlendTimeConstant;
     size_t m_maxTempMemSizeInSamplesForCNN;
@@ -238,8 +267,14 @@ protected:
     RMSPropInfo m_rpi;
 
     size_t m_numMBsToShowResult = 0;
+    size_t m_numMBsToCheckpoint = 0; // write a mid-epoch checkpoint every this many minibatches (0: only at the end of the epoch)
     size_t m_firstMBsToShowResult = 0;
     int m_numMBsToCUDAProfile;
+    // built-in per-node profiling of this fraction of the minibatches, see NodeProfiler
+    double m_nodeProfilingRate;
+    std::wstring m_nodeProfilingTraceFile;
+    // timeline of reader, compute, communication and I/O in the Chrome trace format, see EventTracer
+    std::wstring m_traceTimelineFile;
 
     bool m_doGradientCheck;
     double m_gradientCheckSigDigit;
@@ -248,10 +283,50 @@ protected:
 
     bool m_useAllDataForPreComputedNode;
 
+    // file that keeps the values of the PreCompute nodes, to be reused by later runs on the same data (empty: none)
+    // The values are reused only if the key recorded with them matches, see PreComputeCacheKey().
+    std::wstring m_preComputeCache;
+
+    // check for matrices that are implicitly moved back and forth between CPU and GPU during training (see MatrixTransferStatistics)
+    MatrixTransferCheck m_implicitTransferCheck;
+
+    // replace Sigmoid/Tanh/RectifiedLinear (Plus (Times (W, x), b)) chains by AffineActivation nodes before training
+    bool m_fuseAffineActivation;
+
+    // fold constant subgraphs, merge duplicate nodes and remove unused ones before training (see ComputationNetwork::OptimizeNetwork())
+    bool m_optimizeNetwork;
+
+    // on a GPU, run the small nodes computed only from data inputs and constants on the CPU where that is estimated to be faster
+    // (see ComputationNetwork::OffloadToHost())
+    bool m_offloadToHost;
+
+    // before training, print the estimated memory per category and node (ComputationNetwork::EstimateMemory()) and, for a dry run, stop there;
+    // with autoMaxSamplesInRAM, lower maxSamplesInRAM to the largest sub-minibatch that is estimated to fit into the free GPU memory
+    bool m_memoryReport;
+    bool m_dryRun;
+    bool m_autoMaxSamplesInRAM;
+
+    // with autoSubminibatches, maxSamplesInRAM is refitted after every minibatch to the peak GPU memory actually in use,
+    // and each minibatch is split into as many sub-minibatches as its size needs (per epoch only, with stateful nodes)
+    bool m_autoSubminibatches;
+    double m_autoSubminibatchesMemoryMargin; // fraction of the GPU memory that is kept free
+
+    // when the GPU runs out of memory in a minibatch, release the shared matrices and cached buffers, and retry it split
+    // into twice as many sub-minibatches (not with stateful or batch-normalization nodes, overlapped gradient aggregation, or model parallelism)
+    bool m_recoverFromOutOfMemory;
+    struct PeakMemoryProbe
+    {
+        double fixedBytes;            // planned device memory that does not grow with the minibatch (parameters, gradients, learner state)
+        double plannedBytesPerSample; // planned growth per sample in RAM, a lower limit of the measured one
+        size_t largestSamplesInRAM;   // largest sub-minibatch so far; as matrices keep their size, the peak is that of this one
+        size_t configuredMaxSamplesInRAM;
+    } m_peakMemoryProbe;
+
     // Parallel training
     MPIWrapperPtr m_mpi;
 
     ParallelizationMethod m_parallelizationMethod;
+    std::vector<ComputationNodeBasePtr> m_modelParallelWeights; // with modelParallelSGD, see ComputationNetwork::SetModelParallelism()
     bool m_enableDistributedMBReading;
     int m_parallelizationStartEpochNum;
 
@@ -261,17 +336,33 @@ protected:
     // n > 1: Show stats after every n sync
     int m_syncStatsTrace;
 
+    // all-reduce gradients and models in two levels, within each machine and among machines (see MPIWrapper::SetHierarchicalAllReduce())
+    bool m_hierarchicalAllReduce;
+    // ... with the workers of a machine summing in shared memory instead of messaging their leader (implies m_hierarchicalAllReduce)
+    bool m_sharedMemoryAllReduce;
+
+    // models are broadcast in chunks of this size, several of them in flight at a time, see BroadcastMatrices()
+    size_t m_modelBroadcastChunkSizeInBytes;
+
     // Data parallel SGD training parameters
     int m_numGradientBits;
     bool m_bufferedAsyncGradientAggregation;
     bool m_zeroThresholdFor1Bit;
+    double m_sparseGradientDensity; // if > 0, only this fraction of the gradient entries (the largest ones) is exchanged, see SparseDistGradAggregator
+    bool m_syncBatchNormalizationStatistics; // batch normalization statistics over the minibatches of all workers, see BatchNormalizationNode
+    size_t m_gradientBucketSizeInBytes;      // if > 0, gradients are all-reduced during backprop in buckets of this size, see SimpleDistGradAggregator
+    GradientCommunicationBackend m_gradientCommunicationBackend;
+    size_t m_numBackupWorkers;               // if > 0, each minibatch only waits for the gradients of the first N - m_numBackupWorkers workers, see BackupWorkerDistGradAggregator
+    bool m_deferLateGradients;
 
     // Parallel training related with MA / BM
     size_t m_modelAggregationBlockSize;
+    bool   m_pipelineModelAggregation; // ModelAveragingSGD: average a block while computing the next, see PipelinedModelAveragingSGD
     bool   m_resetSGDMomentum; 
     bool   m_useNesterovBlockMomentum;
     double m_blockLearningRate; 
     double m_blockMomentumAsTimeConstant;
+    size_t m_asyncMaxStaleness; // AsyncParameterServerSGD: number of syncs a worker may be ahead of the slowest one
 
     bool m_needAveMultiplier;
     double m_L2RegWeight;
@@ -312,13 +403,22 @@ public:
           // TODO: The next few do not belong into SGD any more than the network or reader we operate on. Either move network and reader in here, or move these out.
           m_modelPath((const wstring&) configSGD(L"modelPath")),
           m_keepCheckPointFiles(configSGD(L"keepCheckPointFiles", false)),
+          m_asyncCheckpointing(configSGD(L"asyncCheckpointing", false)),
+          m_shardedCheckpoints(configSGD(L"shardedCheckpoints", false)),
+          m_hogwildThreads(configSGD(L"hogwildThreads", (size_t) 1)),
           m_trainCriterionNodeName((const wstring&) configSGD(L"trainCriterionNodeName", L"")),
           m_evalCriterionNodeName ((const wstring&) configSGD(L"evalCriterionNodeName", L"")),
           m_traceNodeNamesReal    (configSGD(L"traceNodeNamesReal",     ConfigRecordType::Array(stringargvector()))),
           m_traceNodeNamesCategory(configSGD(L"traceNodeNamesCategory", ConfigRecordType::Array(stringargvector()))),
           m_traceNodeNamesSparse  (configSGD(L"traceNodeNamesSparse",   ConfigRecordType::Array(stringargvector()))),
+          m_gradientCheckpointInterval(configSGD(L"gradientCheckpointInterval", (size_t) 0)),
+          m_recomputeNodeNames    (configSGD(L"recomputeNodeNames",     ConfigRecordType::Array(stringargvector()))),
+          m_compressedNodeNames   (configSGD(L"compressedNodeNames",    ConfigRecordType::Array(stringargvector()))),
+          m_valueCompression((const wstring&) configSGD(L"valueCompression", L"fp16")),
           m_prevChosenMinibatchSize(0),
           m_lastFinishedEpochTrainLoss(0.0),
+          m_lossScale(m_initialLossScale),
+          m_numUpdatesSinceLossScaleChange(0),
           m_distGradAgg(nullptr),
           m_gradHeader(nullptr)
     {
@@ -340,6 +440,12 @@ public:
             m_parallelizationMethod = ParallelizationMethod::none;
     }
 
+    // description of the training reader, which is part of the key of the preComputeCache (for CNTK config, the text of the reader section)
+    void SetReaderConfigDescription(const std::wstring& description)
+    {
+        m_readerConfigDescription = description;
+    }
+
     void Train(function<ComputationNetworkPtr(DEVICEID_TYPE)> createNetworkFn, DEVICEID_TYPE deviceId,
                IDataReader* trainSetDataReader,
                IDataReader* validationSetDataReader,
@@ -349,6 +455,13 @@ public:
                IDataReader* validationSetDataReader,
                const DEVICEID_TYPE deviceID, const bool makeMode = true);
 
+    // time numWarmupSteps + numSteps training steps (forward, backward, aggregation in data-parallel training, update)
+    // without a reader or checkpoints, for the "benchmark" action. 'fillInputs' sets the values and MBLayouts of
+    // the given input nodes for the next minibatch and returns its number of samples.
+    void Benchmark(ComputationNetworkPtr net,
+                   const function<size_t(const std::vector<ComputationNodeBasePtr>& inputNodes)>& fillInputs,
+                   size_t numSteps, size_t numWarmupSteps);
+
 protected:
 
     const std::vector<ComputationNodeBasePtr>& GetTrainCriterionNodes(ComputationNetworkPtr net);
@@ -363,12 +476,26 @@ protected:
 
 protected:
 
+    // the network's memory estimate, plus the learner state and the reader's host copy of the inputs
+    ComputationNetwork::MemoryEstimate EstimateMemory(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                      const std::vector<ComputationNodeBasePtr>& inputNodes, size_t minibatchSize) const;
+    // lower m_maxSamplesInRAM so that the estimate fits into the free memory of the GPU
+    void FitMaxSamplesInRAMToGPUMemory(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                       const std::vector<ComputationNodeBasePtr>& inputNodes, size_t minibatchSize);
+    // with autoSubminibatches: after a minibatch whose sub-minibatches had up to samplesInRAM samples, set m_maxSamplesInRAM
+    // from the peak GPU memory in use so far
+    void FitMaxSamplesInRAMToPeakMemory(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                        const std::vector<ComputationNodeBasePtr>& inputNodes, size_t samplesInRAM);
+
     // return true if precomputation is executed.
     bool PreCompute(ComputationNetworkPtr net,
                     IDataReader* trainSetDataReader,
                     const std::vector<ComputationNodeBasePtr>& featureNodes,
                     const std::vector<ComputationNodeBasePtr>& labelNodes,
                     StreamMinibatchInputs* inputMatrices);
+    std::wstring PreComputeCacheKey(const std::list<ComputationNodeBasePtr>& nodes) const;
+    bool LoadPreComputeCache(const std::list<ComputationNodeBasePtr>& nodes);
+    void SavePreComputeCache(const std::list<ComputationNodeBasePtr>& nodes) const;
 
     // return a reasonable initial learning rate based on the initial mbsize
     double SearchForBestLearnRate(ComputationNetworkPtr net,
@@ -403,6 +530,39 @@ protected:
                                          /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
                                          std::string prefixMsg = "");
 
+    // parallelLearnRateSearch: train a trial mini-epoch for each of the learning rates, where each worker trains every
+    // NumNodesInUse()-th by itself, on the same data as the others; then all-reduce the criteria so that every worker has all of them
+    bool UsingParallelLearnRateSearch() const;
+    void TrainMiniEpochsInParallel(ComputationNetworkPtr net,
+                                   ComputationNetworkPtr refNet,
+                                   const ComputationNodeBasePtr& refNode, const int epochNumber,
+                                   const size_t epochSize, IDataReader* trainSetDataReader,
+                                   const std::vector<double>& learnRatesPerSample,
+                                   const size_t minibatchSize,
+                                   const std::vector<ComputationNodeBasePtr>& featureNodes,
+                                   const std::vector<ComputationNodeBasePtr>& labelNodes,
+                                   const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                   const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                   StreamMinibatchInputs* inputMatrices,
+                                   const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                   std::list<Matrix<ElemType>>& smoothedGradients,
+                                   /*out*/ std::vector<EpochCriterion>& epochCriteria,
+                                   const std::string& prefixMsg);
+
+    // The trial mini-epochs of the learning-rate and minibatch-size searches all start from the model the search started with.
+    // It is kept in CPU memory (with several workers: that of the main worker, broadcast to all), and restored after each trial.
+    void TakeTrialSnapshot(ComputationNetworkPtr net, std::list<Matrix<ElemType>>& smoothedGradients);
+    void RestoreTrialSnapshot(ComputationNetworkPtr net, std::list<Matrix<ElemType>>& smoothedGradients);
+    void DropTrialSnapshot() { m_trialSnapshot.reset(); }
+
+    // All workers must start training from the same model. Each has created or loaded it by itself, which normally gives
+    // the same values; so they compare a checksum of their parameters, and only if it differs the main worker broadcasts its own.
+    void SynchronizeInitialModel(ComputationNetworkPtr net, const std::list<ComputationNodeBasePtr>& learnableNodes);
+    // Broadcast the matrices of the root worker to all others, in chunks of m_modelBroadcastChunkSizeInBytes that are sent
+    // one after the other by MPI_Ibcast. While chunks are on their way, the root copies the next one out of device memory,
+    // and the others copy the oldest received one back into it; so the host transfers overlap with the network transfer.
+    void BroadcastMatrices(const std::vector<Matrix<ElemType>*>& matrices, size_t root);
+
     size_t AdaptiveMinibatchSizing(ComputationNetworkPtr net,
                                    ComputationNetworkPtr refNet,
                                    const ComputationNodeBasePtr& refNode,
@@ -465,7 +625,32 @@ protected:
                          std::list<Matrix<ElemType>>& smoothedGradients,
                          /*out*/ EpochCriterion& epochCriterion,
                          /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
-                         const std::string& prefixMsg = "");
+                         const std::string& prefixMsg = "",
+                         bool midEpochCheckPoints = false);
+
+    // Hogwild training (hogwildThreads > 1, CPU only): each thread trains a replica of the network on minibatches of its own,
+    // taken in turn from the one reader, and updates the shared parameters without locking. Thread 0 uses the network
+    // itself, the others the replicas, whose LearnableParameters share the value matrices of the network's.
+    // Each thread keeps its own smoothed gradients; only those of thread 0 are saved in checkpoints.
+    // The replicas are created for the first epoch, after the precomputation, from a copy of the network saved to a file.
+    void CreateHogwildReplicas(ComputationNetworkPtr net,
+                               const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                               const std::vector<ComputationNodeBasePtr>& evaluationNodes);
+    size_t TrainOneEpochHogwild(ComputationNetworkPtr net,
+                                const int epochNumber,
+                                const size_t epochSize,
+                                IDataReader* trainSetDataReader,
+                                const double learnRatePerSample,
+                                size_t tunedMBSize,
+                                const std::vector<ComputationNodeBasePtr>& featureNodes,
+                                const std::vector<ComputationNodeBasePtr>& labelNodes,
+                                const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                StreamMinibatchInputs* inputMatrices,
+                                const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                std::list<Matrix<ElemType>>& smoothedGradients,
+                                /*out*/ EpochCriterion& epochCriterion,
+                                /*out*/ std::vector<EpochCriterion>& epochEvalErrors);
 
     void InitDistGradAgg(int numEvalNodes, int traceLevel);
     void InitModelAggregationHandler(int traceLevel, DEVICEID_TYPE devID);
@@ -493,14 +678,59 @@ protected:
                        const bool needAveMultiplier,
                        const bool useNesterovMomentum) const;
 
+    // UpdateWeights() of all learnable nodes for momentum SGD without gradient noise (fusedParameterUpdate): the dense
+    // parameters are updated by one Matrix::MultiTensorNormalGrad() call with clipping and regularization folded in.
+    void UpdateWeightsMultiTensor(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                  std::list<Matrix<ElemType>>& smoothedGradients,
+                                  const double learnRatePerSample,
+                                  const double momentumPerSample,
+                                  const size_t actualMBSize) const;
+
     void ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const;
 
+    // With dynamic loss scaling: divide the gradients of the learnable nodes by the loss scale and adapt the scale.
+    // Returns false, with the gradients left as they are, if they overflowed; the update must then be skipped.
+    bool UnscaleGradients(const std::list<ComputationNodeBasePtr>& learnableNodes);
+
     void SaveCheckPointInfo(const size_t epoch, const size_t totalSamplesSeen, // TODO: combine totalSamplesSeen and prevCriterion into a EpochCriterion type
                             const double learnRatePerSample,
                             const std::list<Matrix<ElemType>>& smoothedGradients,
                             const double prevCriterion,
                             const size_t minibatchSize);
 
+    // With asyncCheckpointing: copy the parameters and smoothed gradients into CPU memory and write the model and
+    // checkpoint files from these copies on a background thread, then delete the given files of earlier checkpoints.
+    // At most one checkpoint is written at a time; this first waits for the previous one.
+    void SaveCheckPointInBackground(ComputationNetworkPtr net, const wstring& modelName,
+                                    const size_t epoch, const size_t totalSamplesSeen,
+                                    const double learnRatePerSample,
+                                    const std::list<Matrix<ElemType>>& smoothedGradients,
+                                    const double prevCriterion,
+                                    const size_t minibatchSize,
+                                    const std::vector<wstring>& obsoleteFiles);
+    // Wait for the checkpoint being written in the background, if any, and rethrow its error. With synchronizeWorkers,
+    // this is a barrier for all workers, so that all of them can read the files afterwards; all must then call it.
+    void WaitForCheckPointWrite(bool synchronizeWorkers);
+
+    // With shardedCheckpoints in parallel training, the smoothed gradients are partitioned over the workers, and each worker
+    // writes its partition into a shard file next to the checkpoint file, which only records the partitioning.
+    // On restore, each shard file is read by one worker, which broadcasts its smoothed gradients to the others.
+    bool UsesShardedCheckPoints() const { return m_shardedCheckpoints && (m_mpi != nullptr); }
+    std::vector<size_t> AssignCheckPointShards(const std::list<Matrix<ElemType>>& smoothedGradients, size_t numShards) const;
+    void SaveCheckPointShard(const size_t epoch, const std::list<Matrix<ElemType>>& smoothedGradients);
+    void LoadCheckPointShards(const size_t epochNumber, const std::vector<size_t>& shardOfGradient, size_t numShards,
+                              std::list<Matrix<ElemType>>& smoothedGradients);
+    static wstring GetCheckPointShardFileName(const wstring& checkPointFileName, size_t shard);
+
+    // With modelParallelSGD, the weight shards of the output layer differ between the workers. The model and checkpoint
+    // files hold those of the main worker; each other worker writes its weight shards and their smoothed gradients into
+    // a shard file next to each model file it could be restored from.
+    bool IsModelParallelWeight(const ComputationNodeBasePtr& node) const;
+    void DecorrelateModelParallelWeights();
+    void SaveModelParallelShard(const wstring& modelFileName, const std::list<ComputationNodeBasePtr>& learnableNodes, const std::list<Matrix<ElemType>>& smoothedGradients);
+    void LoadModelParallelShard(const wstring& modelFileName, const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients);
+    static wstring GetModelParallelShardFileName(const wstring& modelFileName, size_t rank);
+
     bool TryLoadCheckPointInfo(const size_t epochNumber,
                                /*out*/ size_t& totalSamplesSeen,
                                /*out*/ double& learnRatePerSample,
@@ -514,6 +744,31 @@ protected:
                             /*out*/ double& prevCriterion,
                             /*out*/ size_t& minibatchSize);
 
+    // Mid-epoch checkpoints (numMBsToCheckpoint): each worker writes the position of its reader, the progress of the epoch and
+    // its smoothed gradients into a file of its own; the main worker writes the model under a name that holds the number of
+    // minibatches, so that a state file always refers to a complete model. A restarted job continues the epoch from there,
+    // also with a different number of workers, see TryLoadMidEpochCheckPoint().
+    struct MidEpochCheckPoint
+    {
+        int epoch;
+        size_t numMBsRun;
+        size_t numWorkers;
+        size_t totalEpochSamples;
+        EpochCriterion epochCriterion;
+        std::vector<EpochCriterion> epochEvalErrors;
+        double learnRatePerSample;
+        size_t minibatchSize;
+        double lossScale;
+        size_t numUpdatesSinceLossScaleChange;
+        std::vector<size_t> readerState;
+    };
+    void SaveMidEpochCheckPoint(ComputationNetworkPtr net, const MidEpochCheckPoint& checkPoint, const std::list<Matrix<ElemType>>& smoothedGradients);
+    void ReadMidEpochCheckPoint(const wstring& fileName, MidEpochCheckPoint& checkPoint, std::list<Matrix<ElemType>>* smoothedGradients);
+    bool TryLoadMidEpochCheckPoint(const int epoch, ComputationNetworkPtr net, std::list<Matrix<ElemType>>& smoothedGradients);
+    std::vector<wstring> GetMidEpochCheckPointFiles(const int epoch);
+    wstring GetMidEpochCheckPointFileName(const int epoch, size_t rank);
+    wstring GetMidEpochModelFileName(const int epoch, size_t numMBsRun);
+
     wstring GetCheckPointFileNameForEpoch(const int epoch);
     wstring GetModelNameForEpoch(const int epoch, bool bLastModel = false);
 
@@ -539,7 +794,22 @@ public:
 
 protected:
     std::wstring m_modelPath;
+    std::wstring m_readerConfigDescription;
     bool m_keepCheckPointFiles;
+    bool m_asyncCheckpointing;
+    bool m_shardedCheckpoints;
+
+    // hogwild training, see CreateHogwildReplicas()
+    struct HogwildReplica
+    {
+        ComputationNetworkPtr net;
+        std::vector<ComputationNodeBasePtr> featureNodes, labelNodes, criterionNodes, evaluationNodes;
+        std::list<ComputationNodeBasePtr> learnableNodes;
+        StreamMinibatchInputs inputMatrices;
+        std::list<Matrix<ElemType>> smoothedGradients;
+    };
+    size_t m_hogwildThreads;
+    std::vector<std::unique_ptr<HogwildReplica>> m_hogwildReplicas;
 
     std::wstring m_trainCriterionNodeName;
     std::wstring m_evalCriterionNodeName;
@@ -549,26 +819,57 @@ protected:
     std::vector<std::wstring> m_traceNodeNamesCategory;
     std::vector<std::wstring> m_traceNodeNamesSparse;
 
+    // gradient checkpointing: values to recompute in backprop instead of keeping them (see ComputationNetwork::SetGradientCheckpointing())
+    size_t m_gradientCheckpointInterval;
+    std::vector<std::wstring> m_recomputeNodeNames;
+
+    // value compression: values to keep compressed for backprop instead, to "fp16" or "int8" (see ComputationNetwork::SetValueCompression())
+    std::vector<std::wstring> m_compressedNodeNames;
+    std::wstring m_valueCompression;
+
     size_t m_prevChosenMinibatchSize;
     double m_lastFinishedEpochTrainLoss;
 
+    // the model the trial mini-epochs go back to, see TakeTrialSnapshot()
+    struct TrialSnapshot
+    {
+        ComputationNetwork::ParameterSnapshot parameters;
+        std::list<Matrix<ElemType>> smoothedGradients;
+        std::vector<std::pair<ComputationNodeBasePtr, size_t>> batchNormalizationMBCounts;
+    };
+    std::unique_ptr<TrialSnapshot> m_trialSnapshot;
+    bool m_trainingLocalTrial = false; // a worker is training a trial mini-epoch by itself (parallelLearnRateSearch)
+
+    // the mid-epoch checkpoint a restarted job continues from, until its epoch starts; and the model of the last one written
+    std::unique_ptr<MidEpochCheckPoint> m_midEpochCheckPoint;
+    wstring m_midEpochModelFileName;
+    size_t m_midEpochCheckPointWorkers = 0; // the number of workers whose mid-epoch checkpoint files exist
+
+    // current dynamic loss scale, see m_dynamicLossScaling
+    double m_lossScale;
+    size_t m_numUpdatesSinceLossScaleChange;
+
     std::shared_ptr<IDistGradAggregator<ElemType>> m_distGradAgg;
     std::shared_ptr<struct DistGradHeader> m_gradHeader;
 
     shared_ptr<IMASGD<ElemType>> m_pMASGDHelper;
 
+    // the checkpoint being written in the background (asyncCheckpointing); last, so that it is waited for first on destruction
+    std::future<void> m_pendingCheckPointWrite;
+
 private:
     void MarkDropoutNodesEvalTimeStampAsOutdated(const ComputationNetworkPtr& net, const ComputationNodeBasePtr& criterionNode);
 
     bool UsingGradientAggregation(size_t epochNumber) const
     {
-        return ((GetParallelizationMethod() == ParallelizationMethod::dataParallelSGD) && (epochNumber >= m_parallelizationStartEpochNum));
+        return ((GetParallelizationMethod() == ParallelizationMethod::dataParallelSGD) && (epochNumber >= m_parallelizationStartEpochNum) && !m_trainingLocalTrial);
     }
     bool UsingModelAggregation(size_t epochNumber) const
     {
         return ((GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD ||
-                 GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD) &&
-                (epochNumber >= m_parallelizationStartEpochNum));
+                 GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD ||
+                 GetParallelizationMethod() == ParallelizationMethod::asyncParameterServerSGD) &&
+                (epochNumber >= m_parallelizationStartEpochNum) && !m_trainingLocalTrial);
     }
     bool UsingParallelTrain(size_t epochNumber) const
     {
@@ -3,9 +3,13 @@
 #include "IDistGradAggregator.h"
 #include "CUDAPageLockedMemAllocator.h"
 #include <future>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
 #include "GPUDataTransferer.h"
 #include "TimerUtility.h"
 #include "MatrixQuantizerImpl.h"
+#include "NcclComm.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -15,13 +19,28 @@ class SimpleDistGradAggregator : public IDistGradAggregator<ElemType>
     UsingIDistGradAggregatorMembers;
 
 public:
-    SimpleDistGradAggregator(const MPIWrapperPtr& mpi, bool useAsyncAggregation, int syncStatsTrace)
-        : IDistGradAggregator<ElemType>(mpi), m_useAsyncAggregation(useAsyncAggregation), m_currentEpochNumber(-1), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0)
+    // overlapBucketSizeInBytes: if > 0, the gradients are all-reduced during backprop in buckets of at least this size,
+    // see OnGradientCompleted(); not combinable with useAsyncAggregation or a backend other than mpi
+    // backend: how gradients on a GPU are exchanged; for gradients on the CPU, MPI is always used
+    SimpleDistGradAggregator(const MPIWrapperPtr& mpi, bool useAsyncAggregation, int syncStatsTrace, size_t overlapBucketSizeInBytes = 0,
+                             GradientCommunicationBackend backend = GradientCommunicationBackend::mpi)
+        : IDistGradAggregator<ElemType>(mpi), m_useAsyncAggregation(useAsyncAggregation), m_currentEpochNumber(-1), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0),
+          m_backend(backend), m_overlapBucketSizeInBytes(overlapBucketSizeInBytes), m_numGradientsInBuckets(0), m_currentBucketSizeInBytes(0)
     {
+        if (m_useAsyncAggregation && m_overlapBucketSizeInBytes > 0)
+            LogicError("SimpleDistGradAggregator: Asynchronous aggregation cannot be overlapped with backprop.");
+        if (m_backend != GradientCommunicationBackend::mpi && m_overlapBucketSizeInBytes > 0)
+            LogicError("SimpleDistGradAggregator: Aggregation overlapped with backprop requires the mpi backend.");
+        if (m_backend == GradientCommunicationBackend::nccl && m_useAsyncAggregation)
+            LogicError("SimpleDistGradAggregator: Asynchronous aggregation cannot use the nccl backend.");
     }
 
     ~SimpleDistGradAggregator()
     {
+        // the helper threads must not outlive the buffers they reduce
+        if (m_pendingBucketReductions.valid())
+            m_pendingBucketReductions.wait();
+
         for (size_t i = 0; i < m_recvHeaders.size(); ++i)
         {
             DistGradHeader::Destroy(m_recvHeaders[i]);
@@ -40,7 +59,12 @@ public:
         bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
         m_iterationCount++;
 
-        if (m_useAsyncAggregation)
+        if (m_overlapBucketSizeInBytes > 0)
+        {
+            AggregateGradientsOverlapped(gradients, headerCPU, showSyncPerfStats);
+            return (headerCPU->numSamples != 0);
+        }
+        else if (m_useAsyncAggregation)
         {
             // If we are performing async gradient aggregation, let's wait for the pending gradient aggregation to finish
             // then swap the contents of the buffered gradients and the new gradient matrices and fire an async aggreagation
@@ -122,6 +146,23 @@ public:
         }
     }
 
+    // Starts the transfer of the gradient to the CPU and hands the gradients that are ready to the all-reduce.
+    void OnGradientCompleted(Matrix<ElemType>* gradient) override
+    {
+        // before the first AggregateGradients() call the gradients are not known; they are then all aggregated there
+        auto iter = m_gradientIndices.find(gradient);
+        if (iter == m_gradientIndices.end())
+            return;
+
+        StartGradientTransfer(iter->second);
+        LaunchReadyBuckets(/*flush=*/false);
+    }
+
+    bool OverlapsAggregationWithBackprop() const override
+    {
+        return m_overlapBucketSizeInBytes > 0;
+    }
+
 private:
     std::shared_ptr<ElemType> AllocateIntermediateBuffer(int deviceID, size_t numElements)
     {
@@ -143,20 +184,42 @@ private:
         if (m_currentEpochNumber == -1)
         {
             int deviceId = gradients[0]->GetDeviceId();
-            if (deviceId != CPUDEVICE)
+            if (UsesHostBuffers(deviceId))
             {
                 m_allocator.reset(new CUDAPageLockedMemAllocator(deviceId));
             }
+            else if (deviceId != CPUDEVICE && m_backend == GradientCommunicationBackend::nccl)
+            {
+                MPIWrapperPtr mpi = m_mpi;
+                m_nccl.reset(new NcclComm(deviceId, MyRank(), NumProc(), [mpi](void* data, size_t size)
+                                          {
+                                              mpi->Bcast((char*) data, size, 0);
+                                          }));
+            }
 
             for (size_t i = 0; i < gradients.size(); i++)
             {
-                // Make sure none of the gradient matrixes are sparse - we currently do not support aggregation of sparse gradient matrices
-                if (gradients[i]->GetMatrixType() != DENSE)
-                    RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
+                // Of the sparse gradients, only block-sparse columns (e.g. of embeddings) are supported, see AggregateSparseGradient()
+                if (IsSparseBlockColumns(*gradients[i]))
+                {
+                    if (m_useAsyncAggregation || (m_overlapBucketSizeInBytes > 0) || (m_backend != GradientCommunicationBackend::mpi))
+                        RuntimeError("Block-sparse gradients can only be aggregated synchronously with the mpi backend!");
+
+                    // (not staged in a host buffer of the size of the dense matrix)
+                    if (UsesHostBuffers(deviceId))
+                    {
+                        m_gpuDataTransferers.push_back(nullptr);
+                        m_intermediateCPUBuffers.push_back(nullptr);
+                    }
+                    continue;
+                }
+                else if (gradients[i]->GetMatrixType() != DENSE)
+                    RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported except for block-sparse columns!");
 
-                if (deviceId != CPUDEVICE)
+                if (UsesHostBuffers(deviceId))
                 {
-                    m_gpuDataTransferers.push_back(std::unique_ptr<GPUDataTransferer<ElemType>>(new GPUDataTransferer<ElemType>(deviceId, m_useAsyncAggregation)));
+                    bool useConcurrentStreams = m_useAsyncAggregation || (m_overlapBucketSizeInBytes > 0);
+                    m_gpuDataTransferers.push_back(std::unique_ptr<GPUDataTransferer<ElemType>>(new GPUDataTransferer<ElemType>(deviceId, useConcurrentStreams)));
                     m_intermediateCPUBuffers.push_back(AllocateIntermediateBuffer(deviceId, gradients[i]->GetNumElements()));
                 }
 
@@ -164,7 +227,14 @@ private:
                 {
                     m_bufferedGradients[gradients[i]].reset(new Matrix<ElemType>(gradients[i]->GetNumRows(), gradients[i]->GetNumCols(), deviceId));
                 }
+
+                if (m_overlapBucketSizeInBytes > 0)
+                {
+                    m_gradients.push_back(gradients[i]);
+                    m_gradientIndices[gradients[i]] = i;
+                }
             }
+            m_gradientTransferStarted.assign(m_gradients.size(), false);
 
             if (m_useAsyncAggregation)
             {
@@ -206,6 +276,17 @@ private:
         return isNewEpoch;
     }
 
+    static bool IsSparseBlockColumns(const Matrix<ElemType>& gradient)
+    {
+        return (gradient.GetMatrixType() == SPARSE) && (gradient.GetFormat() == matrixFormatSparseBlockCol);
+    }
+
+    // whether GPU gradients are staged in host memory for MPI
+    bool UsesHostBuffers(int deviceId) const
+    {
+        return (deviceId != CPUDEVICE) && (m_backend == GradientCommunicationBackend::mpi);
+    }
+
     void AggregateGradientsImpl(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool showSyncPerfStats)
     {
         Timer aggregationTimer;
@@ -228,7 +309,10 @@ private:
             // If the current node did not process any samples, the gradients should be zero'd
             for (size_t i = 0; i < numGradMatrices; ++i)
             {
-                gradients[i]->SetValue(0);
+                if (IsSparseBlockColumns(*gradients[i]))
+                    gradients[i]->SetSparseBlockColumns(gradients[i]->GetNumRows(), gradients[i]->GetNumCols(), {}, {});
+                else
+                    gradients[i]->SetValue(0);
             }
 
             if (m_useAsyncAggregation)
@@ -238,12 +322,40 @@ private:
             }
         }
 
+        // With NCCL, the gradients are reduced in place on the compute stream, which orders them after their
+        // computation and before their use. Only the header goes through MPI.
+        if (m_nccl)
+        {
+            for (size_t i = 0; i < numGradMatrices; ++i)
+                m_nccl->AllReduce(gradients[i]->Data(), gradients[i]->GetNumElements());
+
+            AggregateHeaders(headerCPU, numGradMatrices);
+
+            if (showSyncPerfStats)
+            {
+                std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+                mainStreamSyncEvent->SynchronizeEvent();
+                aggregationTimer.Stop();
+                double epochTime = aggregationTimer.ElapsedSeconds();
+                fprintf(stderr, "Actual gradient aggregation time: %.6g\n", epochTime);
+            }
+            return;
+        }
+
+        // A CUDA-aware MPI reads the device buffers, which must have been computed by then
+        if (deviceId >= 0 && !UsesHostBuffers(deviceId))
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+            mainStreamSyncEvent->SynchronizeEvent();
+        }
+
         // Initiate transfer of the gradient matrices to the CPU if needed
-        if (deviceId >= 0)
+        if (UsesHostBuffers(deviceId))
         {
             for (size_t i = 0; i < numGradMatrices; ++i)
             {
-                m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->Data(), gradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
+                if (!IsSparseBlockColumns(*gradients[i]))
+                    m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->Data(), gradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
             }
         }
 
@@ -267,18 +379,31 @@ private:
         }
 
         // Perform MPI async allreduce on the gradient data
-        std::vector<MPI_Request> allReduceRequests(numGradMatrices);
+        // (A hierarchical all-reduce completes right away and leaves its request null.)
+        std::vector<MPIRequest> allReduceRequests(numGradMatrices);
         for (size_t i = 0; i < numGradMatrices; ++i)
         {
+            if (IsSparseBlockColumns(*gradients[i]))
+                continue;
+
             ElemType* reductionBuffer = gradients[i]->Data();
-            if (deviceId >= 0)
+            if (UsesHostBuffers(deviceId))
             {
                 m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
                 reductionBuffer = m_intermediateCPUBuffers[i].get();
             }
 
-            // On Windows this async MPI_Iallreduce call requires MS MPI v7 or higher to be installed
-            MPI_Iallreduce(MPI_IN_PLACE, reductionBuffer, gradients[i]->GetNumElements(), MPIWrapper::GetDataType(reductionBuffer), MPI_SUM, m_mpi->Communicator(), &allReduceRequests[i]) || MpiFail("MPI_Iallreduce");
+            if (m_mpi->UsesHierarchicalAllReduce())
+                m_mpi->AllReduce(reductionBuffer, gradients[i]->GetNumElements());
+            else
+                allReduceRequests[i] = m_mpi->AllReduceAsync(reductionBuffer, gradients[i]->GetNumElements());
+        }
+
+        // The block-sparse gradients are exchanged while the dense ones are being reduced
+        for (size_t i = 0; i < numGradMatrices; ++i)
+        {
+            if (IsSparseBlockColumns(*gradients[i]))
+                AggregateSparseGradient(*gradients[i]);
         }
 
         // On the main node wait for the headers to arrive and aggregate
@@ -324,8 +449,8 @@ private:
         // Wait for the allreduce operations to finish and initiate transfer back to the GPU if needed
         for (size_t i = 0; i < numGradMatrices; ++i)
         {
-            MPI_Wait(&allReduceRequests[i], MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
-            if (deviceId >= 0)
+            allReduceRequests[i].Wait();
+            if (UsesHostBuffers(deviceId) && !IsSparseBlockColumns(*gradients[i]))
             {
                 m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), gradients[i]->GetNumElements(), gradients[i]->Data());
             }
@@ -338,11 +463,12 @@ private:
         }
 
         // Wait for all the transfers to finish
-        if (deviceId >= 0)
+        if (UsesHostBuffers(deviceId))
         {
             for (size_t i = 0; i < numGradMatrices; ++i)
             {
-                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+                if (!IsSparseBlockColumns(*gradients[i]))
+                    m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
             }
         }
 
@@ -364,7 +490,261 @@ private:
         }
     }
 
+    // -----------------------------------------------------------------------
+    // block-sparse gradients, e.g. of an embedding, with a nonzero column for each word in the minibatch
+    //
+    // Instead of the all-reduce of the mostly zero dense matrix, the workers exchange the ids of their nonzero columns
+    // and merge them into their sorted union. Where the workers touch mostly different columns, the values of all their
+    // columns are gathered and summed up column by column. Where they mostly share them (the sum of the numbers of columns
+    // of the workers exceeds twice the size of the union), the columns are scattered into a dense buffer of the union's
+    // columns, which is all-reduced like a dense gradient. The result has the columns of the union.
+    // -----------------------------------------------------------------------
+
+    void AggregateSparseGradient(Matrix<ElemType>& gradient)
+    {
+        const size_t numRows = gradient.GetNumRows();
+        if (gradient.GetNumCols() > INT_MAX)
+            RuntimeError("AggregateSparseGradient: The gradient has too many columns for int column ids.");
+
+        // the gradient must have been computed before it is read on the CPU
+        if (gradient.GetDeviceId() >= 0)
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(gradient.GetDeviceId()));
+            mainStreamSyncEvent->SynchronizeEvent();
+        }
+        std::vector<size_t> columnIds;
+        gradient.GetSparseBlockColumns(columnIds, m_sparseValues);
+
+        // exchange the column ids
+        int numColumns = (int) columnIds.size();
+        std::vector<int> counts(NumProc());
+        std::vector<int> displacements(NumProc());
+        MPI_Allgather(&numColumns, 1, MPI_INT, counts.data(), 1, MPI_INT, m_mpi->Communicator()) || MpiFail("MPI_Allgather");
+        size_t numAllColumns = 0;
+        for (size_t j = 0; j < NumProc(); ++j)
+        {
+            displacements[j] = (int) numAllColumns;
+            numAllColumns += counts[j];
+        }
+        std::vector<int> localColumnIds(columnIds.begin(), columnIds.end());
+        m_allSparseColumnIds.resize(numAllColumns);
+        MPI_Allgatherv(localColumnIds.data(), numColumns, MPI_INT, m_allSparseColumnIds.data(), counts.data(), displacements.data(), MPI_INT, m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+
+        // the union, the same on all workers
+        std::vector<size_t> unionIds(m_allSparseColumnIds.begin(), m_allSparseColumnIds.end());
+        std::sort(unionIds.begin(), unionIds.end());
+        unionIds.erase(std::unique(unionIds.begin(), unionIds.end()), unionIds.end());
+        auto addColumn = [&](size_t columnId, const ElemType* column)
+        {
+            ElemType* target = m_aggregatedSparseValues.data() + (std::lower_bound(unionIds.begin(), unionIds.end(), columnId) - unionIds.begin()) * numRows;
+            for (size_t r = 0; r < numRows; r++)
+                target[r] += column[r];
+        };
+        m_aggregatedSparseValues.assign(unionIds.size() * numRows, 0);
+
+        if (2 * unionIds.size() < numAllColumns) // mostly shared columns: all-reduce them densely
+        {
+            for (size_t k = 0; k < columnIds.size(); k++)
+                addColumn(columnIds[k], m_sparseValues.data() + k * numRows);
+            m_mpi->AllReduce(m_aggregatedSparseValues.data(), m_aggregatedSparseValues.size());
+        }
+        else // gather the columns of all workers, and sum up the duplicates in rank order
+        {
+            if (numAllColumns * numRows > INT_MAX)
+                RuntimeError("AggregateSparseGradient: Too many gradient values to exchange.");
+            for (size_t j = 0; j < NumProc(); ++j)
+            {
+                counts[j] *= (int) numRows;
+                displacements[j] *= (int) numRows;
+            }
+            m_allSparseValues.resize(numAllColumns * numRows);
+            MPI_Allgatherv(m_sparseValues.data(), numColumns * (int) numRows, MPIWrapper::GetDataType(m_sparseValues.data()),
+                           m_allSparseValues.data(), counts.data(), displacements.data(), MPIWrapper::GetDataType(m_allSparseValues.data()), m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+            for (size_t k = 0; k < numAllColumns; k++)
+                addColumn(m_allSparseColumnIds[k], m_allSparseValues.data() + k * numRows);
+        }
+
+        gradient.SetSparseBlockColumns(numRows, gradient.GetNumCols(), unionIds, m_aggregatedSparseValues);
+    }
+
+    // -----------------------------------------------------------------------
+    // aggregation overlapped with backprop
+    //
+    // All workers must issue the all-reduce collectives in the same order. The gradients are therefore reduced in a fixed
+    // order, last one first, which is about the order in which backprop completes them; a gradient that is completed
+    // earlier waits for those before it. The buckets of a minibatch are reduced one after another on helper threads, as
+    // MPI is initialized for serialized calls only; the main thread makes no MPI calls until they are done.
+    // -----------------------------------------------------------------------
+
+    // copy gradient i to the CPU once the main compute stream has computed it
+    void StartGradientTransfer(size_t i)
+    {
+        if (m_gradientTransferStarted[i])
+            return;
+        m_gradientTransferStarted[i] = true;
+
+        Matrix<ElemType>* gradient = m_gradients[i];
+        int deviceId = gradient->GetDeviceId();
+        if (deviceId >= 0)
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+            mainStreamSyncEvent->SynchronizeDataTransferFetchStreamWithEvent<ElemType>();
+            m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradient->Data(), gradient->GetNumElements(), m_intermediateCPUBuffers[i].get());
+        }
+    }
+
+    // append the completed gradients, in reduction order, to the current bucket, and launch its reduction when it is full
+    // (with flush, also if it is not)
+    void LaunchReadyBuckets(bool flush)
+    {
+        size_t numGradMatrices = m_gradients.size();
+        while (m_numGradientsInBuckets < numGradMatrices)
+        {
+            size_t i = numGradMatrices - 1 - m_numGradientsInBuckets;
+            if (!m_gradientTransferStarted[i])
+                break;
+
+            m_currentBucket.push_back(i);
+            m_currentBucketSizeInBytes += m_gradients[i]->GetNumElements() * sizeof(ElemType);
+            m_numGradientsInBuckets++;
+            if (m_currentBucketSizeInBytes >= m_overlapBucketSizeInBytes)
+                LaunchBucket();
+        }
+
+        if (flush && !m_currentBucket.empty())
+            LaunchBucket();
+    }
+
+    void LaunchBucket()
+    {
+        std::vector<size_t> bucket;
+        bucket.swap(m_currentBucket);
+        m_currentBucketSizeInBytes = 0;
+
+        int deviceId = m_gradients[0]->GetDeviceId();
+        std::shared_future<void> previousBuckets = m_pendingBucketReductions;
+        m_pendingBucketReductions = std::async(std::launch::async, [this, bucket, previousBuckets, deviceId]
+                                               {
+                                                   if (previousBuckets.valid())
+                                                       previousBuckets.get(); // (passes on their errors)
+
+                                                   // We are on a new thread. Make sure it uses the right device
+                                                   if (deviceId >= 0)
+                                                       Matrix<ElemType>::SetDevice(deviceId);
+
+                                                   ReduceBucket(bucket, deviceId);
+                                               }).share();
+    }
+
+    void ReduceBucket(const std::vector<size_t>& bucket, int deviceId)
+    {
+        std::vector<MPIRequest> allReduceRequests(bucket.size());
+        for (size_t k = 0; k < bucket.size(); ++k)
+        {
+            size_t i = bucket[k];
+            ElemType* reductionBuffer = m_gradients[i]->Data();
+            if (deviceId >= 0)
+            {
+                m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
+                reductionBuffer = m_intermediateCPUBuffers[i].get();
+            }
+
+            if (m_mpi->UsesHierarchicalAllReduce())
+                m_mpi->AllReduce(reductionBuffer, m_gradients[i]->GetNumElements());
+            else
+                allReduceRequests[k] = m_mpi->AllReduceAsync(reductionBuffer, m_gradients[i]->GetNumElements());
+        }
+
+        for (size_t k = 0; k < bucket.size(); ++k)
+        {
+            size_t i = bucket[k];
+            allReduceRequests[k].Wait();
+            if (deviceId >= 0)
+            {
+                m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), m_gradients[i]->GetNumElements(), m_gradients[i]->Data());
+            }
+        }
+    }
+
+    void AggregateGradientsOverlapped(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool showSyncPerfStats)
+    {
+        if (gradients.size() != m_gradients.size())
+            LogicError("AggregateGradients: Called with a different set of gradients than before.");
+
+        Timer aggregationTimer;
+        if (showSyncPerfStats)
+            aggregationTimer.Start();
+
+        if (headerCPU->numSamples == 0)
+        {
+            // no backprop happened, so none of the gradients has been handed to the reduction yet
+            assert(m_numGradientsInBuckets == 0);
+            headerCPU->criterion = 0.0;
+            for (int i = 0; i < headerCPU->numEvalNode; ++i)
+                headerCPU->evalErrors[i] = { 0.0, 0 };
+
+            for (size_t i = 0; i < gradients.size(); ++i)
+                gradients[i]->SetValue(0);
+        }
+
+        // gradients that were not reported during backprop are reduced now
+        for (size_t i = gradients.size(); i-- > 0;)
+            StartGradientTransfer(i);
+        LaunchReadyBuckets(/*flush=*/true);
+
+        if (m_pendingBucketReductions.valid())
+            m_pendingBucketReductions.get();
+        m_pendingBucketReductions = std::shared_future<void>();
+
+        AggregateHeaders(headerCPU, gradients.size());
+
+        if (gradients[0]->GetDeviceId() >= 0)
+        {
+            for (size_t i = 0; i < gradients.size(); ++i)
+                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+        }
+
+        // ready for the next minibatch
+        m_gradientTransferStarted.assign(m_gradients.size(), false);
+        m_numGradientsInBuckets = 0;
+
+        if (showSyncPerfStats)
+        {
+            aggregationTimer.Stop();
+            double epochTime = aggregationTimer.ElapsedSeconds();
+            fprintf(stderr, "Gradient aggregation time after backprop: %.6g\n", epochTime);
+        }
+    }
+
+    // sum up the headers on the main node and send the result back, using the same tags as AggregateGradientsImpl()
+    void AggregateHeaders(DistGradHeader* headerCPU, size_t numGradMatrices)
+    {
+        if (m_mpi->IsMainNode())
+        {
+            for (size_t j = 0; j < NumProc() - 1; ++j)
+            {
+                int source = (j >= MyRank()) ? (j + 1) : j;
+                MPI_Recv(m_recvHeaders[j], m_recvHeaders[j]->Size(), MPI_CHAR, source, numGradMatrices, m_mpi->Communicator(), MPI_STATUS_IGNORE) || MpiFail("MPI_Recv");
+                headerCPU->Aggregate(m_recvHeaders[j], true);
+            }
+
+            for (size_t j = 0; j < NumProc() - 1; ++j)
+            {
+                int dest = (j >= MyRank()) ? (j + 1) : j;
+                MPI_Send(headerCPU, headerCPU->Size(), MPI_CHAR, dest, numGradMatrices + 1 + numGradMatrices, m_mpi->Communicator()) || MpiFail("MPI_Send");
+            }
+        }
+        else
+        {
+            MPI_Send(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), numGradMatrices, m_mpi->Communicator()) || MpiFail("MPI_Send");
+            MPI_Recv(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), numGradMatrices + 1 + numGradMatrices, m_mpi->Communicator(), MPI_STATUS_IGNORE) || MpiFail("MPI_Recv");
+        }
+    }
+
 private:
+    GradientCommunicationBackend m_backend;
+    std::unique_ptr<NcclComm> m_nccl; // for the nccl backend on a GPU
+
     std::unique_ptr<CUDAPageLockedMemAllocator> m_allocator;
     std::vector<std::shared_ptr<ElemType>> m_intermediateCPUBuffers;
 
@@ -372,6 +752,12 @@ private:
 
     std::vector<DistGradHeader*> m_recvHeaders;
 
+    // buffers of AggregateSparseGradient()
+    std::vector<ElemType> m_sparseValues;
+    std::vector<int> m_allSparseColumnIds;
+    std::vector<ElemType> m_allSparseValues;
+    std::vector<ElemType> m_aggregatedSparseValues;
+
     // Perform aysnchronous gradient aggregation using double buffering of the gradient matrices
     bool m_useAsyncAggregation;
 
@@ -388,5 +774,15 @@ private:
     size_t m_iterationCount;
 
     int m_currentEpochNumber;
+
+    // aggregation overlapped with backprop (if m_overlapBucketSizeInBytes > 0)
+    size_t m_overlapBucketSizeInBytes;
+    std::vector<Matrix<ElemType>*> m_gradients;                      // as passed to AggregateGradients(); reduced last one first
+    std::unordered_map<Matrix<ElemType>*, size_t> m_gradientIndices; // index of each gradient in m_gradients
+    std::vector<bool> m_gradientTransferStarted;                     // per gradient, for the current minibatch
+    size_t m_numGradientsInBuckets;                                  // number of gradients handed to buckets, in reduction order
+    std::vector<size_t> m_currentBucket;                             // gradients collected for the next bucket
+    size_t m_currentBucketSizeInBytes;
+    std::shared_future<void> m_pendingBucketReductions;             // the last launched bucket; waits for the ones before it
 };
 } } }
@@ -11,9 +11,6 @@
 #include "DataReaderHelpers.h"
 #include "TrainingNodes.h" // TODO: we should move the functions that depend on these to the .cpp
 #include "ProgressTracing.h"
-#include "DistGradHeader.h"
-#include "IDistGradAggregator.h"
-#include "SimpleDistGradAggregator.h"
 #include "Criterion.h"
 
 #include <vector>
@@ -24,9 +21,6 @@ using namespace std;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-template <class ElemType>
-class IDistGradAggregator;
-
 // TODO: get rid of dependency on ElemType
 template <class ElemType>
 class SimpleEvaluator
@@ -41,8 +35,6 @@ public:
         m_maxSamplesInRAM(maxSamplesInRAM), 
         m_numSubminiBatches(numSubminiBatches), 
         m_mpi(mpi), 
-        m_distGradAgg(nullptr),
-        m_gradHeader(nullptr),
         m_enableDistributedMBReading(enableDistributedMBReading)
     {
     }
@@ -50,62 +42,87 @@ public:
     // returns evaluation node values per sample determined by evalNodeNames (which can include both training and eval criterion nodes)
     vector<EpochCriterion> Evaluate(IDataReader* dataReader, const vector<wstring>& evalNodeNames, const size_t mbSize, const size_t testSize = requestDataSize)
     {
-        ScopedNetworkOperationMode modeGuard(m_net, NetworkOperationMode::inferring);
-
-        // determine nodes to evaluate
-        std::vector<ComputationNodeBasePtr> evalNodes;
+        return Evaluate(dataReader, vector<ComputationNetworkPtr>{ m_net }, evalNodeNames, mbSize, testSize)[0];
+    }
 
-        set<ComputationNodeBasePtr> criteriaLogged; // (keeps track ot duplicates to avoid we don't double-log critera)
-        if (evalNodeNames.size() == 0)
-        {
-            fprintf(stderr, "evalNodeNames are not specified, using all the default evalnodes and training criterion nodes.\n");
-            if (m_net->EvaluationNodes().empty() && m_net->FinalCriterionNodes().empty())
-                InvalidArgument("There is no default evaluation node or training criterion specified in the network.");
+    // same for several networks with the same inputs (e.g. the checkpoints of a training run), in a single pass over the data
+    // Each minibatch is read into the first network and copied into the inputs of the others, which may live on other devices.
+    // Returns the results of each network; the network of the constructor is not used.
+    vector<vector<EpochCriterion>> Evaluate(IDataReader* dataReader, const vector<ComputationNetworkPtr>& nets, const vector<wstring>& evalNodeNames, const size_t mbSize, const size_t testSize = requestDataSize)
+    {
+        if (nets.empty())
+            InvalidArgument("Evaluate: No network to evaluate.");
 
-            for (const auto& node : m_net->EvaluationNodes())
-                if (criteriaLogged.insert(node).second)
-                    evalNodes.push_back(node);
+        vector<shared_ptr<ScopedNetworkOperationMode>> modeGuards;
+        for (const auto& net : nets)
+            modeGuards.push_back(make_shared<ScopedNetworkOperationMode>(net, NetworkOperationMode::inferring));
 
-            for (const auto& node : m_net->FinalCriterionNodes())
-                if (criteriaLogged.insert(node).second)
-                    evalNodes.push_back(node);
-        }
-        else
+        // determine nodes to evaluate
+        vector<vector<ComputationNodeBasePtr>> evalNodes(nets.size());
+        for (size_t k = 0; k < nets.size(); k++)
         {
-            for (int i = 0; i < evalNodeNames.size(); i++)
+            const auto& net = nets[k];
+            set<ComputationNodeBasePtr> criteriaLogged; // (keeps track ot duplicates to avoid we don't double-log critera)
+            if (evalNodeNames.size() == 0)
+            {
+                if (k == 0)
+                    fprintf(stderr, "evalNodeNames are not specified, using all the default evalnodes and training criterion nodes.\n");
+                if (net->EvaluationNodes().empty() && net->FinalCriterionNodes().empty())
+                    InvalidArgument("There is no default evaluation node or training criterion specified in the network.");
+
+                for (const auto& node : net->EvaluationNodes())
+                    if (criteriaLogged.insert(node).second)
+                        evalNodes[k].push_back(node);
+
+                for (const auto& node : net->FinalCriterionNodes())
+                    if (criteriaLogged.insert(node).second)
+                        evalNodes[k].push_back(node);
+            }
+            else
             {
-                const auto& node = m_net->GetNodeFromName(evalNodeNames[i]);
-                if (!criteriaLogged.insert(node).second)
-                    continue;
-                if (node->GetSampleLayout().GetNumElements() != 1)
-                    InvalidArgument("Criterion nodes to evaluate must have dimension 1x1.");
-                evalNodes.push_back(node);
+                for (int i = 0; i < evalNodeNames.size(); i++)
+                {
+                    const auto& node = net->GetNodeFromName(evalNodeNames[i]);
+                    if (!criteriaLogged.insert(node).second)
+                        continue;
+                    if (node->GetSampleLayout().GetNumElements() != 1)
+                        InvalidArgument("Criterion nodes to evaluate must have dimension 1x1.");
+                    evalNodes[k].push_back(node);
+                }
             }
+            if (k > 0 && evalNodes[k].size() != evalNodes[0].size())
+                InvalidArgument("Evaluate: All networks must have the same evaluation nodes.");
         }
 
-        // initialize eval results
-        std::vector<EpochCriterion> evalResults(evalNodes.size(), EpochCriterion(0));
-
         // allocate memory for forward computation
-        m_net->AllocateAllMatrices(evalNodes, {}, nullptr);
+        for (size_t k = 0; k < nets.size(); k++)
+            nets[k]->AllocateAllMatrices(evalNodes[k], {}, nullptr);
 
         // prepare features and labels
-        auto& featureNodes = m_net->FeatureNodes();
-        auto& labelNodes = m_net->LabelNodes();
+        vector<StreamMinibatchInputs> inputMatrices(nets.size());
+        for (size_t k = 0; k < nets.size(); k++)
+        {
+            for (auto& node : nets[k]->FeatureNodes())
+                inputMatrices[k].AddInput(node->NodeName(), node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
+            for (auto& node : nets[k]->LabelNodes())
+                inputMatrices[k].AddInput(node->NodeName(), node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
+            for (const auto& input : inputMatrices[k])
+            {
+                if (k > 0 && !inputMatrices[0].HasInput(input.first))
+                    InvalidArgument("Evaluate: Input '%ls' is not an input of the first network; all networks must have the same inputs.", input.first.c_str());
+            }
+        }
 
-        StreamMinibatchInputs inputMatrices;
-        for (auto& node : featureNodes)
-            inputMatrices.AddInput(node->NodeName(), node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
-        for (auto& node : labelNodes)
-            inputMatrices.AddInput(node->NodeName(), node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
+        // initialize eval results
+        vector<vector<EpochCriterion>> evalResults(nets.size(), vector<EpochCriterion>(evalNodes[0].size(), EpochCriterion(0)));
 
         // evaluate through minibatches
-        size_t totalEpochSamples = 0;
+        vector<size_t> totalEpochSamples(nets.size(), 0);
         size_t numMBsRun = 0;
-        size_t numSamplesLastLogged = 0;
+        vector<size_t> numSamplesLastLogged(nets.size(), 0);
         size_t numMBsRunLastLogged = 0; // MBs run before this display
 
-        std::vector<EpochCriterion> evalResultsLastLogged(evalResults.size(), EpochCriterion(0));
+        vector<vector<EpochCriterion>> evalResultsLastLogged = evalResults;
 
         bool useParallelTrain = (m_mpi != nullptr);
         bool useDistributedMBReading = useParallelTrain && m_enableDistributedMBReading && dataReader->SupportsDistributedMBRead();
@@ -114,123 +131,105 @@ public:
         else
         dataReader->StartMinibatchLoop(mbSize, 0, testSize);
 
-        m_net->StartEvaluateMinibatchLoop(evalNodes);
+        for (size_t k = 0; k < nets.size(); k++)
+            nets[k]->StartEvaluateMinibatchLoop(evalNodes[k]);
 
-        std::vector<Matrix<ElemType>*> learnParamsGradients;
-        DataReaderHelpers::SubminibatchDispatcher<ElemType> smbDispatcher;
+        vector<DataReaderHelpers::SubminibatchDispatcher<ElemType>> smbDispatchers(nets.size());
         size_t numSubminibatchesNeeded = DataReaderHelpers::GetNumSubminibatchesNeeded<ElemType>(dataReader, m_maxSamplesInRAM, m_numSubminiBatches, mbSize);
 
         // Passing in two empty node lists so the dispatcher can work for the evalNodes.
         std::list<ComputationNodeBasePtr> learnableNodes;
         std::vector<ComputationNodeBasePtr> criterionNodes;
         if (numSubminibatchesNeeded > 1)
-            smbDispatcher.Init(m_net, learnableNodes, criterionNodes, evalNodes);
+        {
+            for (size_t k = 0; k < nets.size(); k++)
+            {
+                ComputationNetworkPtr net = nets[k];
+                smbDispatchers[k].Init(net, learnableNodes, criterionNodes, evalNodes[k]);
+            }
+        }
 
-        CriterionAccumulator<ElemType> localEpochEvalErrors(evalNodes.size(), m_net->GetDeviceId());
+        vector<CriterionAccumulator<ElemType>> localEpochEvalErrors;
+        for (size_t k = 0; k < nets.size(); k++)
+            localEpochEvalErrors.push_back(CriterionAccumulator<ElemType>(evalNodes[k].size(), nets[k]->GetDeviceId()));
 
         const size_t numIterationsBeforePrintingProgress = 100;
         size_t numItersSinceLastPrintOfProgress = 0;
-        bool noMoreSamplesToProcess = false;
         for (;;)
         {
+            // With several workers, each evaluates its share of the data: its shard with distributed reading, else its
+            // share of the sequences of each minibatch. The workers do not communicate until all are done.
             size_t actualMBSize = 0;
-            bool wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*dataReader, m_net, nullptr, useDistributedMBReading, useParallelTrain, inputMatrices, actualMBSize, m_mpi);
-            // in case of distributed reading, we do a few more loops until all ranks have completed
-            // end of epoch
-            if (!wasDataRead && (!useDistributedMBReading || noMoreSamplesToProcess)) 
+            bool wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*dataReader, nets[0], nullptr, useDistributedMBReading, useParallelTrain, inputMatrices[0], actualMBSize, m_mpi);
+            if (!wasDataRead) // end of epoch
                 break;
 
-            // Note: If !wasDataRead then the data that GetMinibatchIntoNetwork() was supposed to full in are undefined.
-            // Must not touch them.
-            if (!wasDataRead)
-                actualMBSize = 0; // (undefined if !wasDataRead)
-
-            if (actualMBSize > 0)
-        {
-
-            size_t actualNumSubminibatches = numSubminibatchesNeeded <= 1 ? 1 : smbDispatcher.GetMinibatchIntoCache(*dataReader, *m_net, inputMatrices, numSubminibatchesNeeded);
-            for (size_t ismb = 0; ismb < actualNumSubminibatches; ismb++)
-            {
-                if (actualNumSubminibatches > 1)
-                {
-                    smbDispatcher.GetSubMinibatchToNet(ismb); // get sub-minibatch from full-size one
-                }
-
-                ComputationNetwork::BumpEvalTimeStamp(featureNodes);
-                ComputationNetwork::BumpEvalTimeStamp(labelNodes);
-
-                m_net->ForwardProp(evalNodes);
-
-                // house-keeping for sub-minibatching
-                if (actualNumSubminibatches > 1)
-                    smbDispatcher.DoneWithCurrentSubMinibatch(ismb); // page state out
-            } // end sub-minibatch loop
-
-            if (actualNumSubminibatches > 1)
-                smbDispatcher.DoneWithCurrentMinibatch();
-            } // if (actualMBSize > 0)
-
-            // BUGBUG (Issue #95): Once we have multiple layouts, this must be done on a per-node basis.
-            size_t numSamplesWithLabel = wasDataRead ? m_net->GetNumSamplesWithLabelOfNetwork(actualMBSize) : 0;
-            size_t aggregateNumSamplesWithLabel = numSamplesWithLabel;
-            if (useParallelTrain)
+            for (size_t k = 0; k < nets.size(); k++)
             {
-                if (m_gradHeader == nullptr)
+                const auto& net = nets[k];
+                if (k > 0) // copy the minibatch of the first network
                 {
-                    m_gradHeader.reset(DistGradHeader::Create(evalNodes.size()), [](DistGradHeader* ptr) {
-                        DistGradHeader::Destroy(ptr);
-                    });
-                    m_distGradAgg = make_shared<SimpleDistGradAggregator<ElemType>>(m_mpi, false, m_traceLevel);
+                    for (const auto& input : inputMatrices[k])
+                    {
+                        const auto& source = inputMatrices[0].GetInput(input.first);
+                        input.second.GetMatrix<ElemType>().AssignValuesOf(source.GetMatrix<ElemType>());
+                        input.second.pMBLayout->CopyFrom(source.pMBLayout);
+                    }
+                    DataReaderHelpers::NotifyChangedNodes<ElemType>(net, inputMatrices[k]);
+                    net->DetermineActualMBSizeFromFeatures();
                 }
 
-                m_gradHeader->numEvalNode = evalNodes.size();
-                m_gradHeader->numSamples = actualMBSize;
-                m_gradHeader->numSamplesWithLabel = numSamplesWithLabel;
-                m_gradHeader->criterion = 0.0; // (not used here)
-                for (size_t i = 0; i < evalNodes.size(); i++)
-                    m_gradHeader->evalErrors[i] = localEpochEvalErrors.Assign(evalNodes, i, numSamplesWithLabel).GetCriterion(i);
-
-                // TODO: We are reusing the aggregation logic inside SimpleDistGradAggregator, which has a heavy dependency
-                // on the gradient matrix. At some point we should refactor the aggregator class to be able to only calculating
-                // eval results and then remove this hack.
-                if (learnParamsGradients.size() == 0)
+                if (actualMBSize > 0)
                 {
-                    Matrix<ElemType>* matrix = new Matrix<ElemType>((DEVICEID_TYPE)m_net->GetDeviceId());
-                    learnParamsGradients.push_back(matrix);
-                }
-
-                // Using SimpleDistAggregator for eval results only. At some point we should rename the class to be just
-                // IDistAggregator and SimpleDistAggregator.
-                bool samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader.get(), 0);
-                noMoreSamplesToProcess = !samplesProcessed;
-
-                aggregateNumSamplesWithLabel = m_gradHeader->numSamplesWithLabel;
-                for (size_t i = 0; i < evalResults.size(); i++)
-                    evalResults[i] += m_gradHeader->evalErrors[i];
-            }
-            else
-            {
+                    size_t actualNumSubminibatches = numSubminibatchesNeeded <= 1 ? 1 : smbDispatchers[k].GetMinibatchIntoCache(*dataReader, *net, inputMatrices[k], numSubminibatchesNeeded);
+                    for (size_t ismb = 0; ismb < actualNumSubminibatches; ismb++)
+                    {
+                        if (actualNumSubminibatches > 1)
+                        {
+                            smbDispatchers[k].GetSubMinibatchToNet(ismb); // get sub-minibatch from full-size one
+                        }
+
+                        ComputationNetwork::BumpEvalTimeStamp(net->FeatureNodes());
+                        ComputationNetwork::BumpEvalTimeStamp(net->LabelNodes());
+
+                        net->ForwardProp(evalNodes[k]);
+
+                        // house-keeping for sub-minibatching
+                        if (actualNumSubminibatches > 1)
+                            smbDispatchers[k].DoneWithCurrentSubMinibatch(ismb); // page state out
+                    } // end sub-minibatch loop
+
+                    if (actualNumSubminibatches > 1)
+                        smbDispatchers[k].DoneWithCurrentMinibatch();
+                } // if (actualMBSize > 0)
+
+                // BUGBUG (Issue #95): Once we have multiple layouts, this must be done on a per-node basis.
+                // (accumulated on the device, so that nothing is read back per minibatch)
+                size_t numSamplesWithLabel = net->GetNumSamplesWithLabelOfNetwork(actualMBSize);
                 if (actualMBSize != 0)
                 {
-                for (int i = 0; i < evalNodes.size(); i++)
-                    evalResults[i] += localEpochEvalErrors.Assign(evalNodes, i, numSamplesWithLabel).GetCriterion(i);
+                    for (int i = 0; i < evalNodes[k].size(); i++)
+                        localEpochEvalErrors[k].Add(evalNodes[k], i, numSamplesWithLabel);
                 }
-            }
 
-            totalEpochSamples += aggregateNumSamplesWithLabel;
+                totalEpochSamples[k] += numSamplesWithLabel;
+                numSamplesLastLogged[k] += numSamplesWithLabel; // with several workers, these are the results of this worker's share
+            }
             numMBsRun++;
 
             if (m_traceLevel > 0)
             {
-                numSamplesLastLogged += aggregateNumSamplesWithLabel;
-
                 if (numMBsRun <= m_firstMBsToShowResult || (m_numMBsToShowResult && (numMBsRun % m_numMBsToShowResult == 0)))
                 {
-                    DisplayEvalStatistics(numMBsRunLastLogged + 1, numMBsRun, numSamplesLastLogged, evalNodes, evalResults, evalResultsLastLogged);
-
-                    for (int i = 0; i < evalResults.size(); i++)
-                        evalResultsLastLogged[i] = evalResults[i];
-                    numSamplesLastLogged = 0;
+                    for (size_t k = 0; k < nets.size(); k++)
+                    {
+                        for (size_t i = 0; i < evalResults[k].size(); i++)
+                            evalResults[k][i] = localEpochEvalErrors[k].GetCriterion(i);
+                        DisplayEvalStatistics(numMBsRunLastLogged + 1, numMBsRun, numSamplesLastLogged[k], evalNodes[k], evalResults[k], evalResultsLastLogged[k], false, false, nets.size() > 1 ? (int) k : -1);
+
+                        evalResultsLastLogged[k] = evalResults[k];
+                        numSamplesLastLogged[k] = 0;
+                    }
                     numMBsRunLastLogged = numMBsRun;
                 }
             }
@@ -242,17 +241,46 @@ public:
             dataReader->DataEnd();
         }
 
-        // show last batch of results
-        if (m_traceLevel > 0 && numSamplesLastLogged > 0)
+        for (size_t k = 0; k < nets.size(); k++)
+        {
+            for (size_t i = 0; i < evalResults[k].size(); i++)
+                evalResults[k][i] = localEpochEvalErrors[k].GetCriterion(i);
+
+            // show last batch of results
+            if (m_traceLevel > 0 && numSamplesLastLogged[k] > 0)
+            {
+                DisplayEvalStatistics(numMBsRunLastLogged + 1, numMBsRun, numSamplesLastLogged[k], evalNodes[k], evalResults[k], evalResultsLastLogged[k], false, false, nets.size() > 1 ? (int) k : -1);
+            }
+        }
+
+        // sum up the shares of all workers, in a single all-reduce
+        if (useParallelTrain)
         {
-            DisplayEvalStatistics(numMBsRunLastLogged + 1, numMBsRun, numSamplesLastLogged, evalNodes, evalResults, evalResultsLastLogged);
+            vector<double> sums;
+            for (size_t k = 0; k < nets.size(); k++)
+            {
+                sums.push_back((double) totalEpochSamples[k]);
+                for (size_t i = 0; i < evalResults[k].size(); i++)
+                {
+                    sums.push_back(evalResults[k][i].first);
+                    sums.push_back((double) evalResults[k][i].second);
+                }
+            }
+            m_mpi->AllReduce(sums);
+            for (size_t k = 0, j = 0; k < nets.size(); k++)
+            {
+                totalEpochSamples[k] = (size_t) sums[j++];
+                for (size_t i = 0; i < evalResults[k].size(); i++, j += 2)
+                    evalResults[k][i] = EpochCriterion(sums[j], (size_t) sums[j + 1]);
+            }
         }
 
         // final statistics
-        for (int i = 0; i < evalResultsLastLogged.size(); i++)
-            evalResultsLastLogged[i] = EpochCriterion(0); // clear this since statistics display will subtract the previous value
-
-        DisplayEvalStatistics(1, numMBsRun, totalEpochSamples, evalNodes, evalResults, evalResultsLastLogged, true, /*isFinal=*/true);
+        for (size_t k = 0; k < nets.size(); k++)
+        {
+            vector<EpochCriterion> zeros(evalResults[k].size(), EpochCriterion(0)); // since statistics display will subtract the previous value
+            DisplayEvalStatistics(1, numMBsRun, totalEpochSamples[k], evalNodes[k], evalResults[k], zeros, true, /*isFinal=*/true, nets.size() > 1 ? (int) k : -1);
+        }
 
         return evalResults;
     }
@@ -266,9 +294,13 @@ protected:
     }
 
     void DisplayEvalStatistics(const size_t startMBNum, const size_t endMBNum, const size_t numSamplesLastLogged, const vector<ComputationNodeBasePtr>& evalNodes,
-                               const vector<EpochCriterion>& evalResults, const vector<EpochCriterion>& evalResultsLastLogged, bool displayConvertedValue = false, bool isFinal = false)
+                               const vector<EpochCriterion>& evalResults, const vector<EpochCriterion>& evalResultsLastLogged, bool displayConvertedValue = false, bool isFinal = false,
+                               int networkIndex = -1) // when evaluating several networks, the index of the one displayed
     {
-        LOGPRINTF(stderr, "%sMinibatch[%lu-%lu]: ", isFinal ? "Final Results: " : "", startMBNum, endMBNum);
+        if (networkIndex >= 0)
+            LOGPRINTF(stderr, "%sNetwork[%d] Minibatch[%lu-%lu]: ", isFinal ? "Final Results: " : "", networkIndex + 1, startMBNum, endMBNum);
+        else
+            LOGPRINTF(stderr, "%sMinibatch[%lu-%lu]: ", isFinal ? "Final Results: " : "", startMBNum, endMBNum);
 
         for (size_t i = 0; i < evalResults.size(); i++)
         {
@@ -300,9 +332,6 @@ protected:
     size_t m_numSubminiBatches;
     MPIWrapperPtr m_mpi;
     bool m_enableDistributedMBReading;
-
-    std::shared_ptr<IDistGradAggregator<ElemType>> m_distGradAgg;
-    std::shared_ptr<struct DistGradHeader> m_gradHeader;
     int m_traceLevel;
     void operator=(const SimpleEvaluator&); // (not assignable)
 };
@@ -18,6 +18,10 @@
 #include <cstdio>
 #include "ProgressTracing.h"
 #include "ComputationNetworkBuilder.h"
+#include "BinaryOutputFile.h"
+#include "GPUDataTransferer.h"
+#include "CUDAPageLockedMemAllocator.h"
+#include "MatrixQuantizerImpl.h"
 
 using namespace std;
 
@@ -30,8 +34,14 @@ class SimpleOutputWriter
     typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
 
 public:
-    SimpleOutputWriter(ComputationNetworkPtr net, int verbosity = 0)
-        : m_net(net), m_verbosity(verbosity)
+    // With an MPI wrapper of several workers, WriteOutput() to an outputPath is sharded: each worker writes its share of the data
+    // (its shard with distributed reading, else its share of the sequences of each minibatch) to files suffixed with '.rank<N>'.
+    // The main worker then lists these files with the number of samples in each in '<outputPath>.<node>.manifest'.
+    // With 'mergeShards', the reader is not distributed, and the main worker instead merges the text shards of each node
+    // into '<outputPath>.<node>' in input order, as written by a single worker, and deletes them. The shards must be
+    // visible to the main worker, e.g. with all workers on one machine.
+    SimpleOutputWriter(ComputationNetworkPtr net, int verbosity = 0, const MPIWrapperPtr& mpi = nullptr, bool mergeShards = false)
+        : m_net(net), m_verbosity(verbosity), m_mpi(mpi), m_mergeShards(mergeShards)
     {
     }
 
@@ -121,7 +131,7 @@ public:
 
     void WriteMinibatch(FILE* f, ComputationNodePtr node, 
         const WriteFormattingOptions & formattingOptions, char formatChar, std::string valueFormatString, std::vector<std::string>& labelMapping,
-        size_t numMBsRun, bool gradient)
+        size_t numMBsRun, bool gradient, std::vector<std::pair<size_t, size_t>>* sequenceExtents = nullptr)
     {
         const auto sequenceSeparator = formattingOptions.Processed(node->NodeName(), formattingOptions.sequenceSeparator, numMBsRun);
         const auto sequencePrologue =  formattingOptions.Processed(node->NodeName(), formattingOptions.sequencePrologue,  numMBsRun);
@@ -131,7 +141,7 @@ public:
 
         node->WriteMinibatchWithFormatting(f, FrameRange(), SIZE_MAX, SIZE_MAX, formattingOptions.transpose, formattingOptions.isCategoryLabel, formattingOptions.isSparse, labelMapping,
             sequenceSeparator, sequencePrologue, sequenceEpilogue, elementSeparator, sampleSeparator,
-            valueFormatString, gradient);
+            valueFormatString, gradient, sequenceExtents);
     }
 
     void InsertNode(std::vector<ComputationNodeBasePtr>& allNodes, ComputationNodeBasePtr parent, ComputationNodeBasePtr newNode)
@@ -197,7 +207,22 @@ public:
         }
 
         StreamMinibatchInputs inputMatrices = DataReaderHelpers::RetrieveInputMatrices(inputNodes);
-        
+
+        bool useParallelWrite = m_mpi != nullptr && m_mpi->NumNodesInUse() > 1;
+        bool mergeShards = useParallelWrite && m_mergeShards;
+        bool useDistributedMBReading = useParallelWrite && !mergeShards && dataReader.SupportsDistributedMBRead();
+        if (useParallelWrite && outputPath == L"-")
+            InvalidArgument("WriteOutput: Output to stdout cannot be sharded over several workers; please specify an outputPath.");
+
+        if (formattingOptions.isBinary)
+        {
+            if (nodeUnitTest || outputPath == L"-")
+                InvalidArgument("WriteOutput: Binary output needs an outputPath and cannot be used for the node unit test.");
+            if (mergeShards)
+                InvalidArgument("WriteOutput: Binary output cannot be merged; its shards are listed in the manifest of each node.");
+            return WriteBinaryOutput(dataReader, mbSize, outputPath, outputNodes, inputNodes, inputMatrices, numOutputSamples, useDistributedMBReading, useParallelWrite);
+        }
+
         // load a label mapping if requested
         std::vector<std::string> labelMapping;
         if ((formattingOptions.isCategoryLabel || formattingOptions.isSparse) && !formattingOptions.labelMappingFile.empty())
@@ -211,12 +236,17 @@ public:
             std::wstring nodeOutputPath = outputPath;
             if (nodeOutputPath != L"-")
                 nodeOutputPath += L"." + onode->NodeName();
+            if (useParallelWrite)
+                nodeOutputPath += msra::strfun::wstrprintf(L".rank%d", (int) m_mpi->CurrentNodeRank());
             auto f = make_shared<File>(nodeOutputPath, fileOptionsWrite | fileOptionsText);
             outputStreams[onode] = f;
         }
 
         // evaluate with minibatches
-        dataReader.StartMinibatchLoop(mbSize, 0, numOutputSamples);
+        if (useDistributedMBReading)
+            dataReader.StartDistributedMinibatchLoop(mbSize, 0, m_mpi->CurrentNodeRank(), m_mpi->NumNodesInUse(), numOutputSamples);
+        else
+            dataReader.StartMinibatchLoop(mbSize, 0, numOutputSamples);
 
         m_net->StartEvaluateMinibatchLoop(outputNodes);
 
@@ -229,12 +259,76 @@ public:
         }
 
         size_t actualMBSize;
+
+        // For merging the shards, each minibatch is read whole and decimated here, to know which worker writes which of its
+        // sequences: 'runs' are the (worker, number of sequences) of the runs of consecutive sequences of the same worker.
+        // For each stream, 'positions' are the file positions of the end of the prologue, of the begin and end of each run of
+        // this worker, and of the begin of the epilogue. See MergeTextShards().
+        std::vector<std::pair<size_t, size_t>> runs;
+        std::vector<size_t> runWorkers, numRunsOfMinibatches;
+        std::map<ComputationNodeBasePtr, std::vector<size_t>> positions;
+        std::vector<std::pair<size_t, size_t>> sequenceExtents;
+        if (mergeShards)
+        {
+            if (nodeUnitTest)
+                InvalidArgument("WriteOutput: mergeShards cannot be used for the node unit test.");
+            for (auto& onode : allOutputNodes)
+            {
+                if (onode->GetMBLayout() != m_net->GetMBLayoutPtrOfNetwork())
+                    InvalidArgument("WriteOutput: mergeShards needs output nodes with the MBLayout of the inputs, which '%ls' does not have.", onode->NodeName().c_str());
+            }
+            for (auto& stream : outputStreams)
+                positions[stream.first].push_back((size_t) stream.second->GetPosition());
+        }
+        let getMinibatch = [&]() -> bool
+        {
+            if (!mergeShards)
+                return DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(dataReader, m_net, nullptr, useDistributedMBReading, useParallelWrite, inputMatrices, actualMBSize, m_mpi);
+            if (!DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(dataReader, m_net, nullptr, false, false, inputMatrices, actualMBSize, nullptr))
+                return false;
+            let& pMBLayout = m_net->GetMBLayoutPtrOfNetwork();
+            runs.clear();
+            for (const auto& seq : pMBLayout->GetAllSequences())
+            {
+                if (seq.seqId == GAP_SEQUENCE_ID)
+                    continue;
+                size_t worker = DataReaderHelpers::DecimationRank(seq.s, pMBLayout->GetNumParallelSequences(), m_mpi->NumNodesInUse());
+                if (runs.empty() || runs.back().first != worker)
+                    runs.push_back(make_pair(worker, (size_t) 0));
+                runs.back().second++;
+            }
+            for (const auto& run : runs)
+                runWorkers.push_back(run.first);
+            numRunsOfMinibatches.push_back(runs.size());
+            DataReaderHelpers::DecimateMinibatchInPlace<ElemType>(inputMatrices, m_mpi->NumNodesInUse(), m_mpi->CurrentNodeRank(), pMBLayout);
+            DataReaderHelpers::NotifyChangedNodes<ElemType>(m_net, inputMatrices);
+            actualMBSize = m_net->DetermineActualMBSizeFromFeatures();
+            return true;
+        };
+        // add the positions of this worker's runs from the extents of the sequences it wrote
+        let addRunPositions = [&](std::vector<size_t>& streamPositions)
+        {
+            size_t k = 0;
+            for (const auto& run : runs)
+            {
+                if (run.first != m_mpi->CurrentNodeRank())
+                    continue;
+                if (k + run.second > sequenceExtents.size())
+                    LogicError("WriteOutput: Fewer sequences were written than were decimated for this worker.");
+                streamPositions.push_back(sequenceExtents[k].first);
+                streamPositions.push_back(sequenceExtents[k + run.second - 1].second);
+                k += run.second;
+            }
+            if (k != sequenceExtents.size())
+                LogicError("WriteOutput: More sequences were written than were decimated for this worker.");
+        };
+
         const size_t numIterationsBeforePrintingProgress = 100;
         size_t numItersSinceLastPrintOfProgress = 0;
         char formatChar = !formattingOptions.isCategoryLabel ? 'f' : !formattingOptions.labelMappingFile.empty() ? 's' : 'u';
         std::string valueFormatString = "%" + formattingOptions.precisionFormat + formatChar; // format string used in fprintf() for formatting the values
 
-        for (size_t numMBsRun = 0; DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(dataReader, m_net, nullptr, false, false, inputMatrices, actualMBSize, nullptr); numMBsRun++)
+        for (size_t numMBsRun = 0; getMinibatch(); numMBsRun++)
         {
             ComputationNetwork::BumpEvalTimeStamp(inputNodes);
 
@@ -245,7 +339,11 @@ public:
                 m_net->ForwardProp(onode);
 
                 FILE* file = *outputStreams[onode];
-                WriteMinibatch(file, dynamic_pointer_cast<ComputationNode<ElemType>>(onode), formattingOptions, formatChar, valueFormatString, labelMapping, numMBsRun, /* gradient */ false);
+                sequenceExtents.clear();
+                WriteMinibatch(file, dynamic_pointer_cast<ComputationNode<ElemType>>(onode), formattingOptions, formatChar, valueFormatString, labelMapping, numMBsRun, /* gradient */ false,
+                               mergeShards ? &sequenceExtents : nullptr);
+                if (mergeShards)
+                    addRunPositions(positions[onode]);
 
                 if (nodeUnitTest)
                     m_net->Backprop(onode);
@@ -281,20 +379,277 @@ public:
 
         for (auto & stream : outputStreams)
         {
+            if (mergeShards)
+                positions[stream.first].push_back((size_t) stream.second->GetPosition());
             FILE* f = *stream.second;
             fprintfOrDie(f, "%s", formattingOptions.epilogue.c_str());
         }
 
-        fprintf(stderr, "Written to %ls*\nTotal Samples Evaluated = %lu\n", outputPath.c_str(), totalEpochSamples);
+        if (useParallelWrite)
+            fprintf(stderr, "Written to %ls*.rank%d\nTotal Samples Evaluated by this worker = %lu\n", outputPath.c_str(), (int) m_mpi->CurrentNodeRank(), totalEpochSamples);
+        else
+            fprintf(stderr, "Written to %ls*\nTotal Samples Evaluated = %lu\n", outputPath.c_str(), totalEpochSamples);
 
         // flush all files (where we can catch errors) so that we can then destruct the handle cleanly without error
         for (auto & iter : outputStreams)
             iter.second->Flush();
+
+        if (mergeShards)
+        {
+            outputStreams.clear(); // close the shards
+            for (auto& onode : allOutputNodes)
+                MergeTextShards(outputPath + L"." + onode->NodeName(), onode->NodeName(), positions[onode], runWorkers, numRunsOfMinibatches, formattingOptions);
+        }
+        else if (useParallelWrite)
+            WriteShardManifests(outputPath, allOutputNodes, totalEpochSamples);
     }
 
 private:
+    // write the values of the output nodes in the binary format of BinaryOutputFile, one file per node.
+    // The outputs go through a two-slot pipeline: the device-to-host copy of minibatch N into pinned memory runs
+    // while minibatch N+1 is read and computed, and the files are written by background tasks.
+    void WriteBinaryOutput(IDataReader& dataReader, size_t mbSize, const std::wstring& outputPath,
+                           const std::vector<ComputationNodeBasePtr>& outputNodes, const std::vector<ComputationNodeBasePtr>& inputNodes,
+                           StreamMinibatchInputs& inputMatrices, size_t numOutputSamples, bool useDistributedMBReading, bool useParallelWrite)
+    {
+        int deviceId = m_net->GetDeviceId();
+
+        File::MakeIntermediateDirs(outputPath);
+        std::vector<std::unique_ptr<BinaryOutputFile>> outputFiles;
+        for (auto& onode : outputNodes)
+        {
+            std::wstring nodeOutputPath = outputPath + L"." + onode->NodeName();
+            if (useParallelWrite)
+                nodeOutputPath += msra::strfun::wstrprintf(L".rank%d", (int) m_mpi->CurrentNodeRank());
+            outputFiles.emplace_back(new BinaryOutputFile(nodeOutputPath, sizeof(ElemType), onode->GetSampleLayout().GetNumElements()));
+        }
+
+        // the output of one node in one minibatch, on its way to the host
+        struct StagedOutput
+        {
+            std::shared_ptr<ElemType> hostBuffer; // pinned
+            size_t capacity = 0;
+            std::unique_ptr<GPUDataTransferer<ElemType>> transferer;
+            MBLayoutPtr pMBLayout;
+            size_t numRows = 0;     // elements per column
+            size_t frameStride = 0; // elements between consecutive frames of a sequence
+        };
+        std::unique_ptr<CUDAPageLockedMemAllocator> pinnedAllocator(deviceId != CPUDEVICE ? new CUDAPageLockedMemAllocator(deviceId) : nullptr);
+        std::vector<std::vector<StagedOutput>> slots(2); // declared after the allocator, which must outlive the buffers
+        for (auto& slot : slots)
+            slot.resize(outputNodes.size());
+
+        let appendSequences = [&](size_t i, const ElemType* data, const StagedOutput& staged)
+        {
+            for (const auto& seq : staged.pMBLayout->GetAllSequences())
+            {
+                if (seq.seqId == GAP_SEQUENCE_ID)
+                    continue;
+                size_t tBegin = seq.tBegin < 0 ? (size_t) -seq.tBegin : 0; // the part of the sequence inside this minibatch
+                size_t tEnd = min(seq.GetNumTimeSteps(), (size_t) ((ptrdiff_t) staged.pMBLayout->GetNumTimeSteps() - seq.tBegin));
+                const ElemType* firstFrame = data + staged.pMBLayout->GetColumnIndex(seq, tBegin) * staged.numRows;
+                outputFiles[i]->AppendSequence(seq.seqId, (const char*) firstFrame, tEnd - tBegin, staged.frameStride);
+            }
+        };
+        let finishSlot = [&](std::vector<StagedOutput>& slot)
+        {
+            for (size_t i = 0; i < slot.size(); i++)
+            {
+                slot[i].transferer->WaitForCopyGPUToCPUAsync();
+                appendSequences(i, slot[i].hostBuffer.get(), slot[i]);
+            }
+        };
+
+        if (useDistributedMBReading)
+            dataReader.StartDistributedMinibatchLoop(mbSize, 0, m_mpi->CurrentNodeRank(), m_mpi->NumNodesInUse(), numOutputSamples);
+        else
+            dataReader.StartMinibatchLoop(mbSize, 0, numOutputSamples);
+        m_net->StartEvaluateMinibatchLoop(outputNodes);
+
+        size_t totalEpochSamples = 0;
+        size_t actualMBSize;
+        const size_t numIterationsBeforePrintingProgress = 100;
+        size_t numItersSinceLastPrintOfProgress = 0;
+        size_t numMBsRun = 0;
+        for (; DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(dataReader, m_net, nullptr, useDistributedMBReading, useParallelWrite, inputMatrices, actualMBSize, m_mpi); numMBsRun++)
+        {
+            ComputationNetwork::BumpEvalTimeStamp(inputNodes);
+
+            auto& slot = slots[numMBsRun % 2];
+            for (size_t i = 0; i < outputNodes.size(); i++)
+            {
+                m_net->ForwardProp(outputNodes[i]);
+
+                auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(outputNodes[i]);
+                const Matrix<ElemType>& value = node->Value();
+                if (value.GetMatrixType() != MatrixType::DENSE)
+                    InvalidArgument("WriteOutput: Binary output of the sparse node '%ls' is not supported.", node->NodeName().c_str());
+
+                // keep the layout of this minibatch until its data have been written
+                auto& staged = slot[i];
+                staged.pMBLayout = make_shared<MBLayout>();
+                if (node->HasMBLayout())
+                {
+                    if (value.GetNumRows() != node->GetSampleLayout().GetNumElements())
+                        LogicError("WriteOutput: Node '%ls' has %d rows but a sample dimension of %d.", node->NodeName().c_str(), (int) value.GetNumRows(), (int) node->GetSampleLayout().GetNumElements());
+                    staged.pMBLayout->CopyFrom(node->GetMBLayout());
+                    staged.numRows = value.GetNumRows();
+                    staged.frameStride = value.GetNumRows() * staged.pMBLayout->GetNumParallelSequences();
+                }
+                else // a single sample
+                {
+                    staged.pMBLayout->InitAsFrameMode(1);
+                    staged.numRows = staged.frameStride = value.GetNumElements();
+                }
+
+                if (deviceId == CPUDEVICE)
+                {
+                    appendSequences(i, value.Data(), staged);
+                    continue;
+                }
+
+                size_t numElements = value.GetNumElements();
+                if (numElements > staged.capacity)
+                {
+                    staged.capacity = numElements + numElements / 4; // some headroom for the variable minibatch sizes
+                    auto allocator = pinnedAllocator.get();
+                    staged.hostBuffer.reset((ElemType*) allocator->Malloc(sizeof(ElemType) * staged.capacity), [allocator](ElemType* p) { allocator->Free(p); });
+                }
+                if (!staged.transferer)
+                    staged.transferer.reset(new GPUDataTransferer<ElemType>(deviceId, /*useConcurrentStreams=*/false));
+                // the copy may run on the fetch stream of the gradient aggregation, which must first wait for the forward pass
+                std::unique_ptr<MatrixComputeStreamEvent> computeDoneEvent(MatrixComputeStreamEvent::Create(deviceId));
+                computeDoneEvent->SynchronizeDataTransferFetchStreamWithEvent<ElemType>();
+                staged.transferer->CopyGPUToCPUAsync(value.Data(), numElements, staged.hostBuffer.get());
+            }
+
+            // the outputs of the previous minibatch have arrived in the meantime
+            if (deviceId != CPUDEVICE && numMBsRun > 0)
+                finishSlot(slots[(numMBsRun - 1) % 2]);
+
+            totalEpochSamples += actualMBSize;
+            fprintf(stderr, "Minibatch[%lu]: ActualMBSize = %lu\n", numMBsRun, actualMBSize);
+            numItersSinceLastPrintOfProgress = ProgressTracing::TraceFakeProgress(numIterationsBeforePrintingProgress, numItersSinceLastPrintOfProgress);
+            dataReader.DataEnd();
+        }
+        if (deviceId != CPUDEVICE && numMBsRun > 0)
+            finishSlot(slots[(numMBsRun - 1) % 2]);
+
+        size_t numSequences = 0;
+        for (auto& f : outputFiles)
+        {
+            f->Close();
+            numSequences += f->GetNumSequences();
+        }
+
+        if (useParallelWrite)
+            fprintf(stderr, "Written to %ls*.rank%d (binary)\nTotal Samples Evaluated by this worker = %lu\n", outputPath.c_str(), (int) m_mpi->CurrentNodeRank(), totalEpochSamples);
+        else
+            fprintf(stderr, "Written to %ls* (binary)\nTotal Samples Evaluated = %lu\n", outputPath.c_str(), totalEpochSamples);
+
+        if (useParallelWrite)
+            WriteShardManifests(outputPath, outputNodes, totalEpochSamples);
+    }
+
+    // on the main worker, write '<outputPath>.<node>.manifest' for each node: the shard files in the order of the ranks,
+    // each with the number of samples of its worker, separated by a tab
+    void WriteShardManifests(const std::wstring& outputPath, const std::vector<ComputationNodeBasePtr>& nodes, size_t numSamples)
+    {
+        std::vector<size_t> samplesOfWorkers;
+        std::vector<int> counts;
+        m_mpi->AllGather(&numSamples, 1, samplesOfWorkers, counts);
+        if (m_mpi->IsMainNode())
+        {
+            for (auto& node : nodes)
+            {
+                std::wstring nodeOutputPath = outputPath + L"." + node->NodeName();
+                File manifest(nodeOutputPath + L".manifest", fileOptionsWrite | fileOptionsText);
+                for (size_t rank = 0; rank < samplesOfWorkers.size(); rank++)
+                    fprintfOrDie(manifest, "%ls.rank%d\t%lu\n", nodeOutputPath.c_str(), (int) rank, (unsigned long) samplesOfWorkers[rank]);
+                manifest.Flush();
+            }
+            fprintf(stderr, "Shards listed in %ls*.manifest\n", outputPath.c_str());
+        }
+        m_mpi->WaitAll();
+    }
+
+    // Merge the text shards '<nodeOutputPath>.rank<N>' of a node into nodeOutputPath, in the order of a single worker, and delete them.
+    // Minibatch by minibatch, the runs of consecutive sequences of the same worker (runWorkers, numRunsOfMinibatches) are copied
+    // from the shards of their workers, joined by the sequence separator; the prologue and epilogue come from the main worker.
+    // positions: of this worker's shard, see WriteOutput()
+    void MergeTextShards(const std::wstring& nodeOutputPath, const std::wstring& nodeName, const std::vector<size_t>& positions,
+                         const std::vector<size_t>& runWorkers, const std::vector<size_t>& numRunsOfMinibatches,
+                         const WriteFormattingOptions& formattingOptions)
+    {
+        std::vector<size_t> allPositions;
+        std::vector<int> counts;
+        m_mpi->AllGather(positions.data(), positions.size(), allPositions, counts);
+        if (m_mpi->IsMainNode())
+        {
+            // next[rank]: index in allPositions of the begin of the next run of that worker, last[rank]: of the begin of its epilogue
+            std::vector<size_t> next(counts.size()), last(counts.size());
+            for (size_t rank = 0, begin = 0; rank < counts.size(); begin += counts[rank], rank++)
+            {
+                next[rank] = begin + 1;
+                last[rank] = begin + counts[rank] - 1;
+            }
+
+            std::vector<FILE*> shards;
+            for (size_t rank = 0; rank < counts.size(); rank++)
+                shards.push_back(fopenOrDie(nodeOutputPath + msra::strfun::wstrprintf(L".rank%d", (int) rank), L"rb"));
+            FILE* merged = fopenOrDie(nodeOutputPath, L"wb");
+            std::vector<char> buffer(1 << 20);
+            let copyRange = [&](FILE* shard, size_t begin, size_t end)
+            {
+                fsetpos(shard, begin);
+                while (begin < end)
+                {
+                    size_t n = min(end - begin, buffer.size());
+                    freadOrDie(buffer.data(), 1, n, shard);
+                    fwriteOrDie(buffer.data(), 1, n, merged);
+                    begin += n;
+                }
+            };
+
+            copyRange(shards[0], 0, allPositions[next[0] - 1]); // prologue
+            size_t run = 0;
+            for (size_t mb = 0; mb < numRunsOfMinibatches.size(); mb++)
+            {
+                const auto sequenceSeparator = formattingOptions.Processed(nodeName, formattingOptions.sequenceSeparator, mb);
+                for (size_t k = 0; k < numRunsOfMinibatches[mb]; k++, run++)
+                {
+                    size_t rank = runWorkers[run];
+                    if (next[rank] >= last[rank])
+                        LogicError("MergeTextShards: Worker %d wrote fewer runs of sequences than expected.", (int) rank);
+                    if (k > 0)
+                        fwriteOrDie(sequenceSeparator.data(), 1, sequenceSeparator.size(), merged);
+                    copyRange(shards[rank], allPositions[next[rank]], allPositions[next[rank] + 1]);
+                    next[rank] += 2;
+                }
+            }
+            for (size_t rank = 0; rank < counts.size(); rank++)
+            {
+                if (next[rank] != last[rank])
+                    LogicError("MergeTextShards: Worker %d wrote more runs of sequences than expected.", (int) rank);
+            }
+            copyRange(shards[0], allPositions[last[0]], filesize(shards[0])); // epilogue
+
+            fflushOrDie(merged);
+            fcloseOrDie(merged);
+            for (size_t rank = 0; rank < shards.size(); rank++)
+            {
+                fcloseOrDie(shards[rank]);
+                unlinkOrDie(nodeOutputPath + msra::strfun::wstrprintf(L".rank%d", (int) rank));
+            }
+            fprintf(stderr, "Merged the shards of %d workers into %ls\n", (int) shards.size(), nodeOutputPath.c_str());
+        }
+        m_mpi->WaitAll();
+    }
+
     ComputationNetworkPtr m_net;
     int m_verbosity;
+    MPIWrapperPtr m_mpi;
+    bool m_mergeShards;
     void operator=(const SimpleOutputWriter&); // (not assignable)
 };
 
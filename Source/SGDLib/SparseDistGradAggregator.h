@@ -0,0 +1,210 @@
+#pragma once
+
+#include "IDistGradAggregator.h"
+#include "TimerUtility.h"
+#include <climits>
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Gradient aggregation that exchanges only the largest-magnitude gradient entries (top-k sparsification).
+// Every worker adds its gradient to a local residual, sends the entries of the residual with |x| >= threshold as
+// (index, value) pairs to all other workers, and keeps the rest of the residual for later minibatches, similar to
+// the error feedback of 1-bit SGD. The threshold is adapted per gradient matrix so that about 'density' of the
+// entries are selected; the selection runs on the device of the gradients (see Matrix::ExtractAbsAboveThreshold),
+// so only the selected entries are copied to the CPU.
+template <class ElemType>
+class SparseDistGradAggregator : public IDistGradAggregator<ElemType>
+{
+    UsingIDistGradAggregatorMembers;
+
+    // number of passes that only count the selected entries to adjust the threshold before extracting them
+    static const size_t MaxThresholdSearchPasses = 3;
+
+public:
+    SparseDistGradAggregator(const MPIWrapperPtr& mpi, double density, int syncStatsTrace)
+        : IDistGradAggregator<ElemType>(mpi), m_density(density), m_currentEpochNumber(-1), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0)
+    {
+        if (density <= 0 || density > 1)
+            InvalidArgument("SparseDistGradAggregator: density must be in (0, 1].");
+    }
+
+    // Aggregate the gradient matrices across all nodes
+    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int epochNumber) override
+    {
+        ResetCurrentEpoch(gradients, epochNumber);
+        bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        m_iterationCount++;
+
+        Timer aggregationTimer;
+        if (showSyncPerfStats)
+            aggregationTimer.Start();
+
+        size_t numGradMatrices = gradients.size();
+        if (headerCPU->numSamples == 0)
+        {
+            headerCPU->criterion = 0.0;
+            for (int i = 0; i < headerCPU->numEvalNode; ++i)
+                headerCPU->evalErrors[i] = { 0.0, 0 };
+
+            // If the current node did not process any samples, the gradients should be zero'd
+            for (size_t i = 0; i < numGradMatrices; ++i)
+                gradients[i]->SetValue(0);
+        }
+
+        // Select the entries to send
+        int numSend = 0;
+        for (size_t i = 0; i < numGradMatrices; ++i)
+        {
+            Matrix<ElemType>& residual = *m_residuals[i];
+            residual += *gradients[i];
+            size_t capacity = m_capacities[i];
+            ElemType threshold = FindThreshold(i, capacity);
+            if (threshold < 0)
+                continue;
+
+            size_t numSelected = residual.ExtractAbsAboveThreshold(threshold, capacity, m_sendIndices.data() + numSend, m_sendValues.data() + numSend);
+            numSelected = std::min(numSelected, capacity);
+            for (size_t j = 0; j < numSelected; j++)
+                m_sendIndices[numSend + j] += (int) m_offsets[i];
+            numSend += (int) numSelected;
+        }
+
+        // Exchange the headers; every node aggregates all of them in rank order, so that all nodes get the same result
+        size_t headerSize = headerCPU->Size();
+        m_recvHeaders.resize(NumProc() * headerSize);
+        MPI_Allgather(headerCPU, (int) headerSize, MPI_CHAR, m_recvHeaders.data(), (int) headerSize, MPI_CHAR, m_mpi->Communicator()) || MpiFail("MPI_Allgather");
+        for (size_t j = 0; j < NumProc(); ++j)
+            headerCPU->Aggregate((DistGradHeader*) &m_recvHeaders[j * headerSize], j > 0);
+
+        // Exchange the selected entries
+        std::vector<int> recvCounts(NumProc());
+        MPI_Allgather(&numSend, 1, MPI_INT, recvCounts.data(), 1, MPI_INT, m_mpi->Communicator()) || MpiFail("MPI_Allgather");
+        std::vector<int> displacements(NumProc());
+        size_t numRecv = 0;
+        for (size_t j = 0; j < NumProc(); ++j)
+        {
+            if (numRecv + recvCounts[j] > INT_MAX)
+                RuntimeError("SparseDistGradAggregator: too many gradient entries to exchange; reduce the density.");
+            displacements[j] = (int) numRecv;
+            numRecv += recvCounts[j];
+        }
+        m_recvIndices.resize(numRecv);
+        m_recvValues.resize(numRecv);
+        MPI_Allgatherv(m_sendIndices.data(), numSend, MPI_INT, m_recvIndices.data(), recvCounts.data(), displacements.data(), MPI_INT, m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+        MPI_Allgatherv(m_sendValues.data(), numSend, MPIWrapper::GetDataType(m_sendValues.data()), m_recvValues.data(), recvCounts.data(), displacements.data(), MPIWrapper::GetDataType(m_recvValues.data()), m_mpi->Communicator()) || MpiFail("MPI_Allgatherv");
+
+        // Sum up the entries of all nodes and copy the result back into the gradients
+        std::fill(m_aggregated.begin(), m_aggregated.end(), (ElemType) 0);
+        for (size_t j = 0; j < numRecv; ++j)
+            m_aggregated[m_recvIndices[j]] += m_recvValues[j];
+        for (size_t i = 0; i < numGradMatrices; ++i)
+            gradients[i]->SetValue(gradients[i]->GetNumRows(), gradients[i]->GetNumCols(), gradients[i]->GetDeviceId(), m_aggregated.data() + m_offsets[i]);
+
+        if (showSyncPerfStats)
+        {
+            aggregationTimer.Stop();
+            double epochTime = aggregationTimer.ElapsedSeconds();
+            fprintf(stderr, "Actual gradient aggregation time: %.6g, sent %d of %d gradient entries\n", epochTime, numSend, (int) m_aggregated.size());
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+private:
+    void ResetCurrentEpoch(const std::vector<Matrix<ElemType>*>& gradients, int epochNumber)
+    {
+        // When called the first time let's setup the residuals and the buffers
+        if (m_currentEpochNumber == -1)
+        {
+            size_t numElements = 0;
+            size_t numSend = 0;
+            for (size_t i = 0; i < gradients.size(); i++)
+            {
+                // Make sure none of the gradient matrixes are sparse - we currently do not support aggregation of sparse gradient matrices
+                if (gradients[i]->GetMatrixType() != DENSE)
+                    RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
+
+                m_residuals.push_back(std::unique_ptr<Matrix<ElemType>>(new Matrix<ElemType>(gradients[i]->GetNumRows(), gradients[i]->GetNumCols(), gradients[i]->GetDeviceId())));
+                m_residuals.back()->SetValue(0);
+                m_thresholds.push_back(-1);
+
+                // small matrices (e.g. biases) are sent completely, since an (index, value) pair takes twice the space of a value
+                size_t n = gradients[i]->GetNumElements();
+                size_t capacity = std::max((size_t) 1, (size_t) (n * m_density));
+                if (2 * capacity >= n)
+                    capacity = n;
+                m_capacities.push_back(capacity);
+                m_offsets.push_back(numElements);
+                numElements += n;
+                numSend += capacity;
+            }
+
+            if (numElements > INT_MAX)
+                RuntimeError("SparseDistGradAggregator: the model has too many parameters for int gradient indices.");
+            m_aggregated.resize(numElements);
+            m_sendIndices.resize(numSend);
+            m_sendValues.resize(numSend);
+        }
+
+        m_currentEpochNumber = epochNumber;
+    }
+
+    // Returns the threshold for selecting about 'capacity' entries of residual i, or -1 if there is nothing to send.
+    ElemType FindThreshold(size_t i, size_t capacity)
+    {
+        Matrix<ElemType>& residual = *m_residuals[i];
+        if (capacity == residual.GetNumElements())
+            return 0;
+
+        // initialize with the mean magnitude; afterwards the threshold of the previous minibatch is a good start
+        ElemType& threshold = m_thresholds[i];
+        if (threshold <= 0)
+        {
+            threshold = residual.SumOfAbsElements() / residual.GetNumElements();
+            if (threshold <= 0)
+                return -1;
+        }
+
+        const ElemType thresholdStep = 1.5;
+        for (size_t pass = 0; pass < MaxThresholdSearchPasses; pass++)
+        {
+            size_t count = residual.ExtractAbsAboveThreshold(threshold, 0, nullptr, nullptr);
+            if (count > capacity)
+                threshold *= thresholdStep;
+            else if (count < capacity / 2)
+                threshold /= thresholdStep;
+            else
+                break;
+        }
+        return threshold;
+    }
+
+private:
+    // fraction of the gradient entries to send
+    double m_density;
+
+    // per gradient matrix: the part of the gradients that was not sent yet, the current threshold,
+    // the maximum number of entries to send, and the offset of its entries in the concatenation of all gradients
+    std::vector<std::unique_ptr<Matrix<ElemType>>> m_residuals;
+    std::vector<ElemType> m_thresholds;
+    std::vector<size_t> m_capacities;
+    std::vector<size_t> m_offsets;
+
+    // indices of the (index, value) pairs refer to the concatenation of all gradients
+    std::vector<int> m_sendIndices;
+    std::vector<ElemType> m_sendValues;
+    std::vector<int> m_recvIndices;
+    std::vector<ElemType> m_recvValues;
+    std::vector<char> m_recvHeaders;
+    std::vector<ElemType> m_aggregated;
+
+    int m_syncStatsTrace;
+
+    // Only used for controlling frequency of measuring/showing gradient aggregation perf stats
+    size_t m_iterationCount;
+
+    int m_currentEpochNumber;
+};
+} } }
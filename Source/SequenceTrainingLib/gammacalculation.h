@@ -7,6 +7,7 @@
 #include "ssematrix.h"
 #include "Matrix.h"
 #include "CUDAPageLockedMemAllocator.h"
+#include "CPUThreadPool.h"
 
 #include <memory>
 #include <vector>
@@ -100,7 +101,6 @@ public:
     {
         // check total frame number to be added ?
         // int deviceid = loglikelihood.GetDeviceId();
-        size_t boundaryframenum;
         std::vector<size_t> validframes; // [s] cursor pointing to next utterance begin within a single parallel sequence [s]
         validframes.assign(samplesInRecurrentStep, 0);
         ElemType objectValue = 0.0;
@@ -126,15 +126,30 @@ public:
             assert(T == pMBLayout->GetNumTimeSteps());
         }
 
-        size_t mapi = 0; // parallel-sequence index for utterance [i]
-        // cal gamma for each utterance
+        // On the GPU, all lattices of the minibatch are processed at once if the parallel state supports it (batched);
+        // otherwise they are processed one by one, since the parallel state then holds one lattice at a time.
+        // On the CPU, and when batched, we first copy the LLs of all of them in, then run forward-backward on all lattices
+        // (in parallel; each has its own stripes of pred, dengammas and uids), and then copy the gammas out in order.
+        const bool batched = (m_deviceid != CPUDEVICE) && parallellattice.batchenabled();
+        Microsoft::MSR::CNTK::Matrix<ElemType> batchloglls(m_deviceid); // LLs of all lattices, concatenated (if batched and multiple parallel sequences)
+        if (batched && samplesInRecurrentStep > 1)
+        {
+            size_t totalframes = 0;
+            for (const auto& lattice : lattices)
+                totalframes += lattice->getnumframes();
+            batchloglls.Resize(numrows, totalframes);
+        }
+
+        std::vector<utterancestripe> stripes(lattices.size());
         size_t ts = 0;
         for (size_t i = 0; i < lattices.size(); i++)
         {
-            const size_t numframes = lattices[i]->getnumframes();
+            utterancestripe& u = stripes[i];
+            u.ts = ts;
+            u.numframes = lattices[i]->getnumframes();
+            const size_t numframes = u.numframes;
 
-            msra::dbn::matrixstripe predstripe(pred, ts, numframes);           // logLLs for this utterance
-            msra::dbn::matrixstripe dengammasstripe(dengammas, ts, numframes); // denominator gammas
+            msra::dbn::matrixstripe predstripe(pred, ts, numframes); // logLLs for this utterance
 
             if (samplesInRecurrentStep == 1) // no sequence parallelism
             {
@@ -144,22 +159,23 @@ public:
                     CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
                 }
 
-                if (m_deviceid != CPUDEVICE)
+                if (m_deviceid != CPUDEVICE && !batched)
                     parallellattice.setloglls(tempmatrix);
             }
             else // multiple parallel sequences
             {
                 // get number of frames for the utterance
-                mapi = extrauttmap[i]; // parallel-sequence index; in case of >1 utterance within this parallel sequence, this is in order of concatenation
+                u.mapi = extrauttmap[i]; // parallel-sequence index; in case of >1 utterance within this parallel sequence, this is in order of concatenation
+                u.mapts = validframes[u.mapi];
 
                 // scan MBLayout for end of utterance
                 size_t mapframenum = SIZE_MAX; // duration of utterance [i] as determined from MBLayout
-                for (size_t t = validframes[mapi]; t < T; t++)
+                for (size_t t = u.mapts; t < T; t++)
                 {
                     // TODO: Adapt this to new MBLayout, m_sequences would be easier to work off.
-                    if (pMBLayout->IsEnd(mapi, t))
+                    if (pMBLayout->IsEnd(u.mapi, t))
                     {
-                        mapframenum = t - validframes[mapi] + 1;
+                        mapframenum = t - u.mapts + 1;
                         break;
                     }
                 }
@@ -172,7 +188,7 @@ public:
                 if (numframes > tempmatrix.GetNumCols())
                     tempmatrix.Resize(numrows, numframes);
 
-                Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+                Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(u.mapi + (u.mapts * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
                 tempmatrix.CopyColumnsStrided(loglikelihoodForCurrentParallelUtterance, numframes, samplesInRecurrentStep, 1);
 
                 // if (doreferencealign || m_deviceid == CPUDEVICE)
@@ -180,77 +196,154 @@ public:
                     CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
                 }
 
-                if (m_deviceid != CPUDEVICE)
+                if (batched)
+                    batchloglls.SetColumnSlice(tempmatrix, ts, numframes);
+                else if (m_deviceid != CPUDEVICE)
                 {
                     parallellattice.setloglls(tempmatrix);
                 }
+                validframes[u.mapi] += numframes; // advance the cursor within the parallel sequence
             }
 
             array_ref<size_t> uidsstripe(&uids[ts], numframes);
 
-            if (doreferencealign)
+            u.numavlogp = 0;
+            foreach_column (t, predstripe) // we do not allocate memory for numgamma now, should be the same as numgammasstripe
             {
-                boundaryframenum = numframes;
+                const size_t s = uidsstripe[t];
+                u.numavlogp += predstripe(s, t) / amf;
             }
-            else
-                boundaryframenum = 0;
-            array_ref<size_t> boundariesstripe(&boundaries[ts], boundaryframenum);
+            u.numavlogp /= numframes;
 
-            double numavlogp = 0;
-            foreach_column (t, dengammasstripe) // we do not allocate memory for numgamma now, should be the same as numgammasstripe
+            if (m_deviceid != CPUDEVICE && !batched)
             {
-                const size_t s = uidsstripe[t];
-                numavlogp += predstripe(s, t) / amf;
+                u.denavlogp = forwardbackward(*lattices[i], u, uids, boundaries, doreferencealign);
+                copygammas(u, numrows, samplesInRecurrentStep, tempmatrix, gammafromlattice, labels, uids, doreferencealign, false, objectValue);
             }
-            numavlogp /= numframes;
-
-            // auto_timer dengammatimer;
-            double denavlogp = lattices[i]->second.forwardbackward(parallellattice,
-                                                                   (const msra::math::ssematrixbase&) predstripe, (const msra::asr::simplesenonehmm&) m_hset,
-                                                                   (msra::math::ssematrixbase&) dengammasstripe, (msra::math::ssematrixbase&) gammasbuffer /*empty, not used*/,
-                                                                   lmf, wp, amf, boostmmifactor, seqsMBRmode, uidsstripe, boundariesstripe);
-            objectValue += (ElemType)((numavlogp - denavlogp) * numframes);
+            ts += numframes;
+        }
 
+        if (batched)
+        {
             if (samplesInRecurrentStep == 1)
+                parallellattice.setloglls(loglikelihood.ColumnSlice(0, ts));
+            else
+                parallellattice.setloglls(batchloglls);
+            if (doreferencealign) // the reference alignment runs on the CPU, on pred
             {
-                tempmatrix = gammafromlattice.ColumnSlice(ts, numframes);
+                Microsoft::MSR::CNTK::CPUThreadPool::ParallelFor(0, lattices.size(), Microsoft::MSR::CNTK::CPUThreadPool::MinWorkPerChunk, [&](int64_t i)
+                {
+                    const utterancestripe& u = stripes[i];
+                    msra::dbn::matrixstripe predstripe(pred, u.ts, u.numframes);
+                    msra::lattices::lattice::alignreference(m_hset, predstripe, array_ref<size_t>(&uids[u.ts], u.numframes),
+                                                            const_array_ref<size_t>(&boundaries[u.ts], u.numframes));
+                });
             }
-
-            // copy gamma to tempmatrix
-            if (m_deviceid == CPUDEVICE)
+            std::vector<const msra::lattices::lattice*> batchlattices(lattices.size());
+            for (size_t i = 0; i < lattices.size(); i++)
+                batchlattices[i] = &lattices[i]->second;
+            std::vector<double> results;
+            msra::lattices::lattice::parallelforwardbackwardbatch(parallellattice, batchlattices, m_hset, const_array_ref<size_t>(uids.data(), ts),
+                                                                  lmf, wp, amf, boostmmifactor, seqsMBRmode, results);
+            for (size_t i = 0; i < lattices.size(); i++)
             {
-                CopyFromSSEMatrixToCNTKMatrix(dengammas, numrows, numframes, tempmatrix, gammafromlattice.GetDeviceId());
+                stripes[i].denavlogp = results[i];
+                copygammas(stripes[i], numrows, samplesInRecurrentStep, tempmatrix, gammafromlattice, labels, uids, doreferencealign, true, objectValue);
             }
-            else
-                parallellattice.getgamma(tempmatrix);
+        }
 
-            // set gamma for multi channel
-            if (samplesInRecurrentStep > 1)
+        if (m_deviceid == CPUDEVICE)
+        {
+            // one lattice per chunk; the per-edge loops inside forwardbackward() then run serially on their thread
+            Microsoft::MSR::CNTK::CPUThreadPool::ParallelFor(0, lattices.size(), Microsoft::MSR::CNTK::CPUThreadPool::MinWorkPerChunk, [&](int64_t i)
             {
-                Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
-                gammaFromLatticeForCurrentParallelUtterance.CopyColumnsStrided(tempmatrix, numframes, 1, samplesInRecurrentStep);
-            }
+                stripes[i].denavlogp = forwardbackward(*lattices[i], stripes[i], uids, boundaries, doreferencealign);
+            });
+            for (const auto& u : stripes)
+                copygammas(u, numrows, samplesInRecurrentStep, tempmatrix, gammafromlattice, labels, uids, doreferencealign, false, objectValue);
+        }
+        functionValues.SetValue(objectValue);
+    }
+
+private:
+    // where an utterance of the minibatch is, and its results
+    struct utterancestripe
+    {
+        size_t ts;        // first column in pred, dengammas, uids and boundaries
+        size_t numframes;
+        size_t mapi;      // parallel-sequence index (if samplesInRecurrentStep > 1)
+        size_t mapts;     // first time step within that parallel sequence
+        double numavlogp; // av. log likelihood of the reference
+        double denavlogp; // returned by forwardbackward()
+        utterancestripe()
+            : ts(0), numframes(0), mapi(0), mapts(0), numavlogp(0), denavlogp(0)
+        {
+        }
+    };
+
+    // denominator forward-backward for one utterance, whose LLs are in pred; writes its stripe of dengammas (and of uids if doreferencealign)
+    // This only touches the stripes of the utterance, so that it can run for several utterances in parallel on the CPU.
+    double forwardbackward(const msra::dbn::latticepair& lattice, const utterancestripe& u,
+                           std::vector<size_t>& uids, std::vector<size_t>& boundaries, bool doreferencealign)
+    {
+        msra::dbn::matrixstripe predstripe(pred, u.ts, u.numframes);           // logLLs for this utterance
+        msra::dbn::matrixstripe dengammasstripe(dengammas, u.ts, u.numframes); // denominator gammas
+        array_ref<size_t> uidsstripe(&uids[u.ts], u.numframes);
+        array_ref<size_t> boundariesstripe(&boundaries[u.ts], doreferencealign ? u.numframes : 0);
+
+        // auto_timer dengammatimer;
+        return lattice.second.forwardbackward(parallellattice,
+                                              (const msra::math::ssematrixbase&) predstripe, (const msra::asr::simplesenonehmm&) m_hset,
+                                              (msra::math::ssematrixbase&) dengammasstripe, (msra::math::ssematrixbase&) gammasbuffer /*empty, not used*/,
+                                              lmf, wp, amf, boostmmifactor, seqsMBRmode, uidsstripe, boundariesstripe);
+    }
+
+    // copy the gammas of one utterance to gammafromlattice (and its reference alignment to labels), and add up its objective
+    // 'batched': the GPU parallel state holds the gammas of the whole minibatch, from parallelforwardbackwardbatch()
+    void copygammas(const utterancestripe& u, size_t numrows, size_t samplesInRecurrentStep,
+                    Microsoft::MSR::CNTK::Matrix<ElemType>& tempmatrix, Microsoft::MSR::CNTK::Matrix<ElemType>& gammafromlattice,
+                    Microsoft::MSR::CNTK::Matrix<ElemType>& labels, const std::vector<size_t>& uids, bool doreferencealign, bool batched, ElemType& objectValue)
+    {
+        const size_t numframes = u.numframes;
+        objectValue += (ElemType)((u.numavlogp - u.denavlogp) * numframes);
+
+        if (samplesInRecurrentStep == 1)
+        {
+            tempmatrix = gammafromlattice.ColumnSlice(u.ts, numframes);
+        }
+
+        // copy gamma to tempmatrix
+        if (m_deviceid == CPUDEVICE)
+        {
+            msra::dbn::matrixstripe dengammasstripe(dengammas, u.ts, numframes);
+            CopyFromSSEMatrixToCNTKMatrix(dengammasstripe, numrows, numframes, tempmatrix, gammafromlattice.GetDeviceId());
+        }
+        else if (batched)
+            parallellattice.getgamma(tempmatrix, u.ts, numframes);
+        else
+            parallellattice.getgamma(tempmatrix);
+
+        // set gamma for multi channel
+        if (samplesInRecurrentStep > 1)
+        {
+            Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(u.mapi + (u.mapts * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+            gammaFromLatticeForCurrentParallelUtterance.CopyColumnsStrided(tempmatrix, numframes, 1, samplesInRecurrentStep);
+        }
 
-            if (doreferencealign)
+        if (doreferencealign)
+        {
+            for (size_t nframe = 0; nframe < numframes; nframe++)
             {
-                for (size_t nframe = 0; nframe < numframes; nframe++)
-                {
-                    size_t uid = uidsstripe[nframe];
-                    if (samplesInRecurrentStep > 1)
-                        labels(uid, (nframe + validframes[mapi]) * samplesInRecurrentStep + mapi) = 1.0;
-                    else
-                        labels(uid, ts + nframe) = 1.0;
-                }
+                size_t uid = uids[u.ts + nframe];
+                if (samplesInRecurrentStep > 1)
+                    labels(uid, (nframe + u.mapts) * samplesInRecurrentStep + u.mapi) = 1.0;
+                else
+                    labels(uid, u.ts + nframe) = 1.0;
             }
-            if (samplesInRecurrentStep > 1)
-                validframes[mapi] += numframes; // advance the cursor within the parallel sequence
-            fprintf(stderr, "dengamma value %f\n", denavlogp);
-            ts += numframes;
         }
-        functionValues.SetValue(objectValue);
+        fprintf(stderr, "dengamma value %f\n", u.denavlogp);
     }
 
-private:
     // Helper methods for copying between ssematrix objects and CNTK matrices
     void CopyFromCNTKMatrixToSSEMatrix(const Microsoft::MSR::CNTK::Matrix<ElemType>& src, size_t numCols, msra::math::ssematrixbase& dest)
     {
@@ -57,6 +57,46 @@ void latticefunctionsops::stateposteriors(const vectorref<unsigned short>& align
 {
 }
 
+void latticefunctionsops::edgealignmentbatch(const vectorref<latticebatchinfo>& lattices, const vectorref<lrhmmdef>& hmms, const vectorref<lr3transP>& transPs,
+                                             const size_t spalignunitid, const size_t silalignunitid, const matrixref<float>& logLLs,
+                                             const vectorref<msra::lattices::nodeinfo>& nodes, const vectorref<msra::lattices::edgeinfowithscores>& edges,
+                                             const vectorref<msra::lattices::aligninfo>& aligns, const vectorref<unsigned int>& alignoffsets,
+                                             vectorref<unsigned short>& backptrstorage, const vectorref<size_t>& backptroffsets,
+                                             vectorref<unsigned short>& alignresult, vectorref<float>& edgeacscores) const
+{
+}
+
+void latticefunctionsops::forwardbackwardlatticebatch(const vectorref<latticebatchinfo>& lattices,
+                                                      const size_t* batchsizeforward, const size_t* batchsizebackward,
+                                                      const size_t numlaunchforward, const size_t numlaunchbackward,
+                                                      const vectorref<unsigned int>& forwardorder, const vectorref<unsigned int>& backwardorder,
+                                                      const size_t spalignunitid, const size_t silalignunitid,
+                                                      const vectorref<float>& edgeacscores, const vectorref<msra::lattices::edgeinfowithscores>& edges,
+                                                      const vectorref<msra::lattices::nodeinfo>& nodes,
+                                                      const vectorref<msra::lattices::aligninfo>& aligns, const vectorref<unsigned short>& aligments,
+                                                      const vectorref<unsigned int>& aligmentoffsets,
+                                                      vectorref<double>& logpps, vectorref<double>& logalphas, vectorref<double>& logbetas,
+                                                      const float lmf, const float wp, const float amf, const float boostingfactor, const bool returnEframescorrect,
+                                                      const vectorref<unsigned short>& uids, const vectorref<unsigned short>& senone2classmap,
+                                                      vectorref<double>& logaccalphas, vectorref<double>& logaccbetas,
+                                                      vectorref<double>& logframescorrectedge, vectorref<double>& logEframescorrect,
+                                                      const size_t alphabetanoderatio, vectorref<double>& totals) const
+{
+}
+
+void latticefunctionsops::sMBRerrorsignalbatch(const vectorref<latticebatchinfo>& lattices, const vectorref<unsigned short>& alignstateids, const vectorref<unsigned int>& alignoffsets,
+                                               const vectorref<msra::lattices::edgeinfowithscores>& edges, const vectorref<msra::lattices::nodeinfo>& nodes,
+                                               const vectorref<double>& logpps, const float amf, const vectorref<double>& logEframescorrect, const vectorref<double>& totals,
+                                               matrixref<float>& errorsignal, matrixref<float>& errorsignalneg) const
+{
+}
+
+void latticefunctionsops::mmierrorsignalbatch(const vectorref<latticebatchinfo>& lattices, const vectorref<unsigned short>& alignstateids, const vectorref<unsigned int>& alignoffsets,
+                                              const vectorref<msra::lattices::edgeinfowithscores>& edges, const vectorref<msra::lattices::nodeinfo>& nodes,
+                                              const vectorref<double>& logpps, const vectorref<double>& totals, matrixref<float>& errorsignal) const
+{
+}
+
 latticefunctions* newlatticefunctions(size_t deviceid)
 {
     return nullptr;
@@ -102,6 +142,10 @@ aligninfovector* newaligninfovector(size_t deviceid)
 {
     return nullptr;
 }
+latticebatchinfovector* newlatticebatchinfovector(size_t deviceid)
+{
+    return nullptr;
+}
 }
 }
 
@@ -12,6 +12,7 @@
 #include "simplesenonehmm.h" // the model
 #include "ssematrix.h"       // the matrices
 #include "latticestorage.h"
+#include "CPUThreadPool.h"
 #include <unordered_map>
 #include <list>
 #include <stdexcept>
@@ -74,6 +75,10 @@ public:
         totalallocated += elementsneeded;
         return matrix;
     }
+    size_t gettotalallocated() const
+    {
+        return totalallocated;
+    }
 };
 
 const size_t littlematrixheap::CHUNKSIZE = 256 * 1024; // 1 MB
@@ -517,6 +522,12 @@ double lattice::forwardbackwardlattice(const std::vector<float> &edgeacscores, p
     logbetas.assign(nodes.size(), LOGZERO);
     logbetas.back() = 0.0f;
 
+    // scaled LM plus acoustic score of each edge, used by both passes
+    // This is a flat loop without dependencies, unlike the passes themselves, which chain through the nodes.
+    std::vector<double> edgescores(edges.size());
+    foreach_index (j, edges)
+        edgescores[j] = (edges[j].l * lmf + wp + edgeacscores[j]) / amf; // note: edgeacscores[j] == LOGZERO if edge was pruned
+
     // --- sMBR version
 
     if (sMBRmode)
@@ -535,7 +546,7 @@ double lattice::forwardbackwardlattice(const std::vector<float> &edgeacscores, p
                 continue;
             const auto &e = edges[j];
             const double inscore = logalphas[e.S];
-            const double edgescore = (e.l * lmf + wp + edgeacscores[j]) / amf;
+            const double edgescore = edgescores[j];
             const double pathscore = inscore + edgescore;
             logadd(logalphas[e.E], pathscore);
 
@@ -568,7 +579,7 @@ double lattice::forwardbackwardlattice(const std::vector<float> &edgeacscores, p
                 continue;
             const auto &e = edges[j];
             const double inscore = logbetas[e.E];
-            const double edgescore = (e.l * lmf + wp + edgeacscores[j]) / amf;
+            const double edgescore = edgescores[j];
             const double pathscore = inscore + edgescore;
             logadd(logbetas[e.S], pathscore);
 
@@ -610,7 +621,7 @@ double lattice::forwardbackwardlattice(const std::vector<float> &edgeacscores, p
     {
         const auto &e = edges[j];
         const double inscore = logalphas[e.S];
-        const double edgescore = (e.l * lmf + wp + edgeacscores[j]) / amf; // note: edgeacscores[j] == LOGZERO if edge was pruned
+        const double edgescore = edgescores[j];
         const double pathscore = inscore + edgescore;
         logadd(logalphas[e.E], pathscore);
     }
@@ -627,7 +638,7 @@ double lattice::forwardbackwardlattice(const std::vector<float> &edgeacscores, p
     {
         const auto &e = edges[j];
         const double inscore = logbetas[e.E];
-        const double edgescore = (e.l * lmf + wp + edgeacscores[j]) / amf;
+        const double edgescore = edgescores[j];
         const double pathscore = inscore + edgescore;
         logadd(logbetas[e.S], pathscore);
 
@@ -788,6 +799,53 @@ double lattice::bestpathlattice(const std::vector<float> &edgeacscores, std::vec
     return totalfwscore;
 }
 
+// ---------------------------------------------------------------------------
+// alignreference() -- align the frames to the reference phone sequence given by bounds, replacing uids
+// zhaorui align to reference mlf; part of forwardbackwardalign(), and done before parallelforwardbackwardbatch()
+// ---------------------------------------------------------------------------
+/*static*/ void lattice::alignreference(const msra::asr::simplesenonehmm &hset, const msra::math::ssematrixbase &logLLs,
+                                       array_ref<size_t> uids, const_array_ref<size_t> bounds)
+{
+    size_t framenum = bounds.size();
+
+    msra::math::ssematrixbase *refabcs;
+    size_t ts, te, t;
+    ts = te = 0;
+
+    vector<aligninfo> refinfo(1);
+    vector<unsigned short> refalign(framenum);
+
+    array_ref<aligninfo> refunits(refinfo.data(), 1);
+    array_ref<unsigned short> refedgealignmentsj(refalign.data(), framenum);
+
+    while (te < framenum)
+    {
+        // found one phone's boundary (ts, te)
+        t = ts + 1;
+        while (t < framenum && bounds[t] == 0)
+            t++;
+        te = t;
+
+        // make one phone unit
+        size_t phoneid = bounds[ts] - 1;
+        refunits[0].unit = phoneid;
+        refunits[0].frames = te - ts;
+
+        size_t edgestates = hset.gethmm(phoneid).getnumstates();
+        littlematrixheap refmatrixheap(1); // for abcs
+        refabcs = &refmatrixheap.newmatrix(edgestates, te - ts + 2);
+        const auto edgeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase &>(logLLs), ts, te - ts);
+        // do alignment
+        alignedge((const_array_ref<aligninfo>) refunits, hset, edgeLLs, *refabcs, 0, true, refedgealignmentsj);
+
+        for (t = ts; t < te; t++)
+        {
+            uids[t] = (size_t) refedgealignmentsj[t - ts];
+        }
+        ts = te;
+    }
+}
+
 // ---------------------------------------------------------------------------
 // forwardbackwardalign() -- compute the statelevel gammas or viterbi alignments
 // the first phase of lattice::forwardbackward
@@ -899,46 +957,7 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
 
     // zhaorui align to reference mlf
     if (bounds.size() > 0)
-    {
-        size_t framenum = bounds.size();
-
-        msra::math::ssematrixbase *refabcs;
-        size_t ts, te, t;
-        ts = te = 0;
-
-        vector<aligninfo> refinfo(1);
-        vector<unsigned short> refalign(framenum);
-
-        array_ref<aligninfo> refunits(refinfo.data(), 1);
-        array_ref<unsigned short> refedgealignmentsj(refalign.data(), framenum);
-
-        while (te < framenum)
-        {
-            // found one phone's boundary (ts, te)
-            t = ts + 1;
-            while (t < framenum && bounds[t] == 0)
-                t++;
-            te = t;
-
-            // make one phone unit
-            size_t phoneid = bounds[ts] - 1;
-            refunits[0].unit = phoneid;
-            refunits[0].frames = te - ts;
-
-            size_t edgestates = hset.gethmm(phoneid).getnumstates();
-            littlematrixheap refmatrixheap(1); // for abcs
-            refabcs = &refmatrixheap.newmatrix(edgestates, te - ts + 2);
-            const auto edgeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase &>(logLLs), ts, te - ts);
-            // do alignment
-            alignedge((const_array_ref<aligninfo>) refunits, hset, edgeLLs, *refabcs, 0, true, refedgealignmentsj);
-
-            for (t = ts; t < te; t++)
-            {
-                uids[t] = (size_t) refedgealignmentsj[t - ts];
-            }
-            ts = te;
-        }
-    }
+        alignreference(hset, logLLs, uids, bounds);
 
     // Phase 4: alignment or forwardbackward on CPU for non parallel mode or verification
 
@@ -952,7 +971,10 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
             parallelstate.getedgeacscores(edgeacscoresgpu);
             parallelstate.copyalignments(thisedgealignmentsgpu);
         }
-        foreach_index (j, edges)
+        // the edges are independent: each has its own trellis in abcs[j] and its own range of the alignments,
+        // so we align them in parallel (serially if we are already running in parallel across lattices, see calgammaformb())
+        thisedgealignments.getalignmentsbuffer(); // allocate it up front; operator[] would do it lazily, which is not thread-safe
+        auto alignoneedge = [&](int64_t j)
         {
             const edgeinfowithscores &e = edges[j];
             const size_t ts = nodes[e.S].t;
@@ -970,29 +992,44 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
                 else
                     edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, returnsenoneids, thisedgealignments[j]);
             }
-            if (cpuverification)
+        };
+        if (!cpuverification)
+        {
+            // work per edge: its trellis, i.e. states x frames, each with a few transitions
+            const size_t workperedge = edges.empty() ? 0 : 4 * (matrixheap.gettotalallocated() / edges.size());
+            Microsoft::MSR::CNTK::CPUThreadPool::ParallelFor(0, edges.size(), workperedge, alignoneedge);
+        }
+        else // verification: align serially and compare edge by edge
+        {
+            foreach_index (j, edges)
             {
-                const auto &aligntokens = getaligninfo(j); // get alignment tokens
-                bool edgehassil = false;
-                foreach_index (i, aligntokens)
+                alignoneedge(j);
                 {
-                    if (aligntokens[i].unit == silunitid)
-                        edgehassil = true;
-                }
-                if (fabs(edgeacscores[j] - edgeacscoresgpu[j]) > 1e-3)
-                {
-                    fprintf(stderr, "edge %d, sil ? %d, edgeacscores / edgeacscoresgpu MISMATCH %f v.s. %f, diff %e\n",
-                            j, edgehassil ? 1 : 0, (float) edgeacscores[j], (float) edgeacscoresgpu[j],
-                            (float) (edgeacscores[j] - edgeacscoresgpu[j]));
-                    fprintf(stderr, "aligntokens: ");
+                    const edgeinfowithscores &e = edges[j];
+                    const size_t ts = nodes[e.S].t;
+                    const size_t te = nodes[e.E].t;
+                    const auto &aligntokens = getaligninfo(j); // get alignment tokens
+                    bool edgehassil = false;
                     foreach_index (i, aligntokens)
-                        fprintf(stderr, "%d %d; ", i, aligntokens[i].unit);
-                    fprintf(stderr, "\n");
-                }
-                for (size_t t = ts; t < te; t++)
-                {
-                    if (thisedgealignments[j][t - ts] != thisedgealignmentsgpu[j][t - ts])
-                        fprintf(stderr, "edge %d, sil ? %d, time %d, alignment / alignmentgpu MISMATCH %d v.s. %d\n", j, edgehassil ? 1 : 0, (int) (t - ts), thisedgealignments[j][t - ts], thisedgealignmentsgpu[j][t - ts]);
+                    {
+                        if (aligntokens[i].unit == silunitid)
+                            edgehassil = true;
+                    }
+                    if (fabs(edgeacscores[j] - edgeacscoresgpu[j]) > 1e-3)
+                    {
+                        fprintf(stderr, "edge %d, sil ? %d, edgeacscores / edgeacscoresgpu MISMATCH %f v.s. %f, diff %e\n",
+                                j, edgehassil ? 1 : 0, (float) edgeacscores[j], (float) edgeacscoresgpu[j],
+                                (float) (edgeacscores[j] - edgeacscoresgpu[j]));
+                        fprintf(stderr, "aligntokens: ");
+                        foreach_index (i, aligntokens)
+                            fprintf(stderr, "%d %d; ", i, aligntokens[i].unit);
+                        fprintf(stderr, "\n");
+                    }
+                    for (size_t t = ts; t < te; t++)
+                    {
+                        if (thisedgealignments[j][t - ts] != thisedgealignmentsgpu[j][t - ts])
+                            fprintf(stderr, "edge %d, sil ? %d, time %d, alignment / alignmentgpu MISMATCH %d v.s. %d\n", j, edgehassil ? 1 : 0, (int) (t - ts), thisedgealignments[j][t - ts], thisedgealignmentsgpu[j][t - ts]);
+                    }
                 }
             }
         }
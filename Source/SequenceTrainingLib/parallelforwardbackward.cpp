@@ -5,6 +5,7 @@
 #define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
 
 #include "BestGpu.h"        // for CPUONLY
+#include "GPUWatcher.h"     // for the budget of the resident lattices (before ssematrix.h, whose foreach_coord must win)
 #include "latticearchive.h" // we implement parts of class lattice
 #include "simple_checked_arrays.h"
 #include "simplesenonehmm.h" // the model
@@ -13,6 +14,7 @@
 #include "latticefunctionskernels.h" // for emulation
 #include "cudalatticeops.h"
 #include <numeric> // for debug
+#include <unordered_map>
 #include "cudalib.h"
 #include "Basics.h"
 
@@ -360,6 +362,47 @@ static void emulatemmierrorsignal(const std::vector<unsigned short>& alignstatei
                 });
 }
 
+// split the edges into the batches of consecutive edges that one kernel launch can process without data dependency
+// Forward batches go from the first edge, backward batches from the last one.
+template <class edgestype>
+static void getlaunchbatches(const edgestype& edges, std::vector<size_t>& batchsizeforward, std::vector<size_t>& batchsizebackward)
+{
+    batchsizeforward.clear();
+    batchsizebackward.clear();
+
+    size_t endindexforward = edges[0].E;
+    size_t countbatchforward = 0;
+
+    size_t endindexbackward = edges.back().S;
+    size_t countbatchbackward = 0;
+    foreach_index (j, edges) // compute the batch size info for kernel launches
+    {
+        if (edges[j].S < endindexforward)
+            countbatchforward++; // note: we don't check forward because the order of end node is assured.
+        else
+        {
+            batchsizeforward.push_back(countbatchforward);
+            countbatchforward = 1;
+            endindexforward = edges[j].E;
+        }
+        const size_t backj = edges.size() - 1 - j;
+        if (edges[backj].E > endindexbackward)
+        {
+            countbatchbackward++;
+            if (endindexbackward < edges[backj].S)
+                endindexbackward = edges[backj].S;
+        }
+        else
+        {
+            batchsizebackward.push_back(countbatchbackward);
+            countbatchbackward = 1;
+            endindexbackward = edges[backj].S;
+        }
+    }
+    batchsizeforward.push_back(countbatchforward);
+    batchsizebackward.push_back(countbatchbackward);
+}
+
 // -----------------------------------------------------------------------
 // parallelstate (-impl) --holds variables for CUDA access
 // -----------------------------------------------------------------------
@@ -398,7 +441,19 @@ struct parallelstateimpl
           errorsignalgpustorage(new Microsoft::MSR::CNTK::Matrix<float>((int) deviceid)),
           errorsignalneggpustorage(new Microsoft::MSR::CNTK::Matrix<float>((int) deviceid)),
           backptrstoragegpu(msra::cuda::newushortvector(deviceid)),
-          backptroffsetsgpu(msra::cuda::newsizetvector(deviceid))
+          backptroffsetsgpu(msra::cuda::newsizetvector(deviceid)),
+          // lattices of the minibatch
+          residentbytes(0),
+          residentbudget(0),
+          residentedgesgpu(msra::cuda::newedgeinfovector(deviceid)),
+          residentnodesgpu(msra::cuda::newnodeinfovector(deviceid)),
+          residentaligngpu(msra::cuda::newaligninfovector(deviceid)),
+          residentalignoffsetsgpu(msra::cuda::newuintvector(deviceid)),
+          residentbackptroffsetsgpu(msra::cuda::newsizetvector(deviceid)),
+          latticebatchinfogpu(msra::cuda::newlatticebatchinfovector(deviceid)),
+          forwardordergpu(msra::cuda::newuintvector(deviceid)),
+          backwardordergpu(msra::cuda::newuintvector(deviceid)),
+          totalsgpu(msra::cuda::newdoublevector(deviceid))
     {
     }
 
@@ -581,6 +636,10 @@ struct parallelstateimpl
     {
         loglls.SetValue(*errorsignalgpu);
     }
+    void getgamma(Microsoft::MSR::CNTK::Matrix<float>& loglls, const size_t firstframe, const size_t numframes)
+    {
+        loglls.SetValue(errorsignalgpu->ColumnSlice(firstframe, numframes));
+    }
     template <class edgealignments>
     void copyalignments(edgealignments& edgeAlignments)
     {
@@ -589,32 +648,32 @@ struct parallelstateimpl
 
     // [v-hansu] allocate memory for vectors relating to forward-backward
     // allocateaccvectors implies return Eframecorrect
-    template <class edgestype, class nodestype>
-    void allocfwbwvectors(const edgestype& edges, const nodestype& nodes, const std::vector<unsigned short>& uids,
+    // (for a minibatch in parallelforwardbackwardbatch(), numedges and numnodes are the totals over its lattices)
+    void allocfwbwvectors(const size_t numedges, const size_t numnodes, const std::vector<unsigned short>& uids,
                           const bool allocateframescorrect, const bool copyuids, const bool allocateaccvectors)
     {
-        logppsgpu->allocate(edges.size());
+        logppsgpu->allocate(numedges);
 #ifndef TWO_CHANNEL
         const size_t alphabetanoderatio = 1;
 #else
         const size_t alphabetanoderatio = 2;
 #endif
-        logalphasgpu->allocate(alphabetanoderatio * nodes.size());
-        logbetasgpu->allocate(alphabetanoderatio * nodes.size());
+        logalphasgpu->allocate(alphabetanoderatio * numnodes);
+        logbetasgpu->allocate(alphabetanoderatio * numnodes);
 
         if (allocateframescorrect)
-            logframescorrectedgegpu->allocate(edges.size());
+            logframescorrectedgegpu->allocate(numedges);
 
         if (copyuids)
             uidsgpu->assign(uids, true);
 
         if (allocateaccvectors)
         {
-            logaccalphasgpu->allocate(alphabetanoderatio * nodes.size());
-            logaccbetasgpu->allocate(alphabetanoderatio * nodes.size());
+            logaccalphasgpu->allocate(alphabetanoderatio * numnodes);
+            logaccbetasgpu->allocate(alphabetanoderatio * numnodes);
 
-            Eframescorrectbufgpu->allocate(edges.size());
-            logEframescorrectgpu->allocate(edges.size());
+            Eframescorrectbufgpu->allocate(numedges);
+            logEframescorrectgpu->allocate(numedges);
         }
     }
 
@@ -625,29 +684,33 @@ struct parallelstateimpl
     // we can then reset errorsignalgpu to be the result.
     void cacheerrorsignal(const msra::math::ssematrixbase& errorsignal, const bool cacheerrsignalneg)
     {
-        if (errorsignalgpustorage->GetNumRows() != 0 && errorsignalgpustorage->GetNumRows() != errorsignal.rows())
+        cacheerrorsignal(errorsignal.rows(), errorsignal.cols(), cacheerrsignalneg);
+    }
+    void cacheerrorsignal(const size_t rows, const size_t cols, const bool cacheerrsignalneg)
+    {
+        if (errorsignalgpustorage->GetNumRows() != 0 && errorsignalgpustorage->GetNumRows() != rows)
             LogicError("gpumatrixstorage->rows() shall be fixed once allocated");
-        if (errorsignalgpustorage->GetNumCols() < errorsignal.cols())
+        if (errorsignalgpustorage->GetNumCols() < cols)
         {
             // Note: This is required because otherwise errorsignalgpustorage will be a view of the storage object in
             // errorsignalgpustorage, and thuse it can't resize. This is perhaps not the optimal way to do this, but
             // how else? Why do these two matrices exist? Why not just one?
             errorsignalgpu = nullptr;
-            errorsignalgpustorage->Resize(errorsignal.rows(), errorsignal.cols());
+            errorsignalgpustorage->Resize(rows, cols);
         }
-        errorsignalgpu = make_unique<Microsoft::MSR::CNTK::Matrix<float>>(errorsignalgpustorage->ColumnSlice(0, errorsignal.cols()));
+        errorsignalgpu = make_unique<Microsoft::MSR::CNTK::Matrix<float>>(errorsignalgpustorage->ColumnSlice(0, cols));
 
         if (cacheerrsignalneg)
         {
-            if (errorsignalneggpustorage->GetNumRows() != 0 && errorsignalneggpustorage->GetNumRows() != errorsignal.rows())
+            if (errorsignalneggpustorage->GetNumRows() != 0 && errorsignalneggpustorage->GetNumRows() != rows)
                 LogicError("gpumatrixstorage->rows() shall be fixed once allocated");
-            if (errorsignalneggpustorage->GetNumCols() < errorsignal.cols())
+            if (errorsignalneggpustorage->GetNumCols() < cols)
             {
                 // Same as above.
                 errorsignalneggpu = nullptr;
-                errorsignalneggpustorage->Resize(errorsignal.rows(), errorsignal.cols());
+                errorsignalneggpustorage->Resize(rows, cols);
             }
-            errorsignalneggpu = make_unique<Microsoft::MSR::CNTK::Matrix<float>>(errorsignalneggpustorage->ColumnSlice(0, errorsignal.cols()));
+            errorsignalneggpu = make_unique<Microsoft::MSR::CNTK::Matrix<float>>(errorsignalneggpustorage->ColumnSlice(0, cols));
         }
     }
 
@@ -662,6 +725,93 @@ struct parallelstateimpl
         edgealignments.resize(alignresult->size());
         alignresult->fetch(edgealignments, true);
     }
+
+    // lattices of the minibatch, for parallelforwardbackwardbatch()
+    // Their edges, nodes, aligns and offsets are kept on the device across minibatches (and thus epochs), by lattice key,
+    // within a budget of a quarter of the device memory that is free when they are first needed.
+    // A minibatch whose new lattices do not fit into what is left starts the buffers over.
+    struct residentlattice
+    {
+        size_t edgesoffset, nodesoffset, alignsoffset, alignoffsetsoffset, backptroffsetsoffset;
+        size_t numedges, numnodes, numaligns;
+        size_t alignbufsize, backptrbufsize;
+        std::vector<size_t> batchsizeforward, batchsizebackward; // see getlaunchbatches()
+    };
+    std::unordered_map<std::wstring, residentlattice> residentlattices;
+    size_t residentbytes;  // used by residentlattices
+    size_t residentbudget; // 0 until first needed
+    std::unique_ptr<edgeinfowithscoresvector> residentedgesgpu;
+    std::unique_ptr<nodeinfovector> residentnodesgpu;
+    std::unique_ptr<aligninfovector> residentaligngpu;
+    std::unique_ptr<msra::cuda::uintvector> residentalignoffsetsgpu;
+    std::unique_ptr<sizetvector> residentbackptroffsetsgpu;
+
+    std::unique_ptr<latticebatchinfovector> latticebatchinfogpu;
+    std::unique_ptr<msra::cuda::uintvector> forwardordergpu;  // batch edge indices in forward launch order
+    std::unique_ptr<msra::cuda::uintvector> backwardordergpu; // and in backward launch order
+    std::unique_ptr<doublevector> totalsgpu;                  // [4 * k + ...] fw/bw scores and accs of lattice k
+
+    template <class edgestype, class nodestype, class aligntype>
+    static size_t residentlatticebytes(const edgestype& edges, const nodestype& nodes, const aligntype& align)
+    {
+        return edges.size() * sizeof(edgeinfowithscores) + nodes.size() * sizeof(nodeinfo) + align.size() * sizeof(aligninfo) +
+               (edges.size() + 1) * (sizeof(unsigned int) + sizeof(size_t));
+    }
+
+    // true if 'bytes' more fit into the budget
+    bool fitsresident(const size_t bytes)
+    {
+        if (residentbudget == 0)
+            residentbudget = std::max(GPUWatcher::GetFreeMemoryOnCUDADevice((int) deviceid) / 4, (size_t) 1);
+        return residentbytes + bytes <= residentbudget;
+    }
+
+    // forget all resident lattices (keeping the allocations for the next ones)
+    void resetresidentlattices()
+    {
+        residentlattices.clear();
+        residentbytes = 0;
+        residentedgesgpu->allocate(0);
+        residentnodesgpu->allocate(0);
+        residentaligngpu->allocate(0);
+        residentalignoffsetsgpu->allocate(0);
+        residentbackptroffsetsgpu->allocate(0);
+    }
+
+    // the resident copy of a lattice, or NULL if it has to be uploaded (not there, or a different lattice under the same key)
+    const residentlattice* findresidentlattice(const std::wstring& key, const size_t numedges, const size_t numnodes) const
+    {
+        auto iter = residentlattices.find(key);
+        if (iter == residentlattices.end() || iter->second.numedges != numedges || iter->second.numnodes != numnodes)
+            return NULL;
+        return &iter->second;
+    }
+
+    template <class edgestype, class nodestype, class aligntype, class edgealignments, class backpointers>
+    const residentlattice& addresidentlattice(const std::wstring& key, const edgestype& edges, const nodestype& nodes, const aligntype& align,
+                                              const edgealignments& edgeAlignments, const backpointers& backPointers)
+    {
+        residentlattice& L = residentlattices[key];
+        L.edgesoffset = residentedgesgpu->size();
+        L.nodesoffset = residentnodesgpu->size();
+        L.alignsoffset = residentaligngpu->size();
+        L.alignoffsetsoffset = residentalignoffsetsgpu->size();
+        L.backptroffsetsoffset = residentbackptroffsetsgpu->size();
+        L.numedges = edges.size();
+        L.numnodes = nodes.size();
+        L.numaligns = align.size();
+        L.alignbufsize = edgeAlignments.getalignbuffersize();
+        L.backptrbufsize = backPointers.getbackptrstoragesize();
+        getlaunchbatches(edges, L.batchsizeforward, L.batchsizebackward);
+
+        residentedgesgpu->append(edges, false);
+        residentnodesgpu->append(nodes, false);
+        residentaligngpu->append(align, false);
+        residentalignoffsetsgpu->append(edgeAlignments.getalignoffsets(), false);
+        residentbackptroffsetsgpu->append(backPointers.getbackptroffsets(), false);
+        residentbytes += residentlatticebytes(edges, nodes, align);
+        return L;
+    }
 };
 
 void lattice::parallelstate::setdevice(size_t deviceid)
@@ -746,6 +896,26 @@ void lattice::parallelstate::getgamma(Microsoft::MSR::CNTK::Matrix<double>& /*lo
     throw ::logic_error("Double precision not supported for sequence training");
 }
 
+void lattice::parallelstate::getgamma(Microsoft::MSR::CNTK::Matrix<float>& loglls, size_t firstframe, size_t numframes)
+{
+    pimpl->getgamma(loglls, firstframe, numframes);
+}
+
+// TODO: Overload to enable compilation for DoublePrecision though its currently unsupported
+void lattice::parallelstate::getgamma(Microsoft::MSR::CNTK::Matrix<double>& /*loglls*/, size_t /*firstframe*/, size_t /*numframes*/)
+{
+    throw ::logic_error("Double precision not supported for sequence training");
+}
+
+bool lattice::parallelstate::batchenabled() const
+{
+#ifdef PARALLEL_SIL // otherwise /sil/ edges are aligned on the CPU, lattice by lattice
+    return pimpl != NULL && !pimpl->emulation;
+#else
+    return false;
+#endif
+}
+
 // -----------------------------------------------------------------------
 // parallel implementations of key processing steps
 // -----------------------------------------------------------------------
@@ -799,38 +969,7 @@ double lattice::parallelforwardbackwardlattice(parallelstate& parallelstate, con
 {                                     // ^^ TODO: remove this
     vector<size_t> batchsizeforward;  // record the batch size that exclude the data dependency for forward
     vector<size_t> batchsizebackward; // record the batch size that exclude the data dependency for backward
-
-    size_t endindexforward = edges[0].E;
-    size_t countbatchforward = 0;
-
-    size_t endindexbackward = edges.back().S;
-    size_t countbatchbackward = 0;
-    foreach_index (j, edges) // compute the batch size info for kernel launches
-    {
-        if (edges[j].S < endindexforward)
-            countbatchforward++; // note: we don't check forward because the order of end node is assured.
-        else
-        {
-            batchsizeforward.push_back(countbatchforward);
-            countbatchforward = 1;
-            endindexforward = edges[j].E;
-        }
-        const size_t backj = edges.size() - 1 - j;
-        if (edges[backj].E > endindexbackward)
-        {
-            countbatchbackward++;
-            if (endindexbackward < edges[backj].S)
-                endindexbackward = edges[backj].S;
-        }
-        else
-        {
-            batchsizebackward.push_back(countbatchbackward);
-            countbatchbackward = 1;
-            endindexbackward = edges[backj].S;
-        }
-    }
-    batchsizeforward.push_back(countbatchforward);
-    batchsizebackward.push_back(countbatchbackward);
+    getlaunchbatches(edges, batchsizeforward, batchsizebackward);
 
     std::vector<unsigned short> uidsuint(uids.size()); // actually we shall not do this, but as it will not take much time, let us just leave it here now.
     foreach_index (i, uidsuint)
@@ -845,7 +984,7 @@ double lattice::parallelforwardbackwardlattice(parallelstate& parallelstate, con
         const bool allocateframescorrect = (returnEframescorrect || boostingfactor != 0.0f);
         const bool copyuids = (returnEframescorrect || boostingfactor != 0.0f);
         const bool allocateaccvectors = returnEframescorrect;
-        parallelstate->allocfwbwvectors(edges, nodes, uidsuint, allocateframescorrect, copyuids, allocateaccvectors);
+        parallelstate->allocfwbwvectors(edges.size(), nodes.size(), uidsuint, allocateframescorrect, copyuids, allocateaccvectors);
 
         std::unique_ptr<latticefunctions> latticefunctions(msra::cuda::newlatticefunctions(parallelstate.getdevice())); // final CUDA call
         latticefunctions->forwardbackwardlattice(&batchsizeforward[0], &batchsizebackward[0], batchsizeforward.size(), batchsizebackward.size(),
@@ -897,6 +1036,207 @@ double lattice::parallelforwardbackwardlattice(parallelstate& parallelstate, con
     return totalfwscore;
 }
 
+// parallelforwardbackwardbatch() -- edge alignment, lattice-level forward-backward and error signals of all lattices of a minibatch at once
+// The concatenated LLs of the lattices must have been passed to setloglls(), and 'uids' are their concatenated reference state ids.
+// The edges of all lattices go into the same launches: launch i processes the i-th forward (backward) batch of every lattice,
+// so the number of launches is that of the largest lattice rather than the sum over the lattices.
+// results[k] is what forwardbackward() returns for lattice k; the gammas of all lattices are left for getgamma(.., firstframe, numframes).
+/*static*/ void lattice::parallelforwardbackwardbatch(parallelstate& parallelstate, const std::vector<const lattice*>& lattices,
+                                                     const msra::asr::simplesenonehmm& hset, const_array_ref<size_t> uids,
+                                                     const float lmf, const float wp, const float amf, const float boostingfactor,
+                                                     const bool sMBRmode, std::vector<double>& results)
+{
+    parallelstate->validatehset(hset); // ensure the models have been correctly cached on the GPU already
+#ifndef TWO_CHANNEL
+    const size_t alphabetanoderatio = 1;
+#else
+    const size_t alphabetanoderatio = 2;
+#endif
+    results.assign(lattices.size(), LOGZERO);
+    if (lattices.empty())
+        return;
+
+    // bring the lattices to the GPU unless they are still there from an earlier minibatch
+    size_t missingbytes = 0;
+    foreach_index (k, lattices)
+    {
+        const lattice& L = *lattices[k];
+        if (!parallelstate->findresidentlattice(L.key, L.edges.size(), L.nodes.size()))
+            missingbytes += parallelstateimpl::residentlatticebytes(L.edges, L.nodes, L.align);
+    }
+    if (missingbytes > 0 && !parallelstate->fitsresident(missingbytes))
+        parallelstate->resetresidentlattices();
+
+    std::vector<parallelstateimpl::residentlattice> resident;
+    resident.reserve(lattices.size());
+    foreach_index (k, lattices)
+    {
+        const lattice& L = *lattices[k];
+        const parallelstateimpl::residentlattice* R = parallelstate->findresidentlattice(L.key, L.edges.size(), L.nodes.size());
+        if (R)
+            resident.push_back(*R);
+        else
+            resident.push_back(parallelstate->addresidentlattice(L.key, L.edges, L.nodes, L.align, edgealignments(L), backpointers(L, hset)));
+    }
+
+    // where each lattice is in the minibatch
+    std::vector<latticebatchinfo> batchinfo(lattices.size());
+    size_t numedges = 0, numnodes = 0, alignbufsize = 0, backptrbufsize = 0, numframes = 0;
+    size_t numlaunchforward = 0, numlaunchbackward = 0;
+    foreach_index (k, lattices)
+    {
+        const parallelstateimpl::residentlattice& R = resident[k];
+        latticebatchinfo& info = batchinfo[k];
+        info.edgesoffset = R.edgesoffset;
+        info.nodesoffset = R.nodesoffset;
+        info.alignsoffset = R.alignsoffset;
+        info.alignoffsetsoffset = R.alignoffsetsoffset;
+        info.backptroffsetsoffset = R.backptroffsetsoffset;
+        info.numedges = R.numedges;
+        info.numnodes = R.numnodes;
+        info.numaligns = R.numaligns;
+        info.edgeoffset = numedges;
+        info.alphabetaoffset = alphabetanoderatio * numnodes;
+        info.alignbufoffset = alignbufsize;
+        info.alignbufsize = R.alignbufsize;
+        info.backptrbufoffset = backptrbufsize;
+        info.backptrbufsize = R.backptrbufsize;
+        info.frameoffset = numframes;
+        info.numframes = lattices[k]->info.numframes;
+
+        numedges += info.numedges;
+        numnodes += info.numnodes;
+        alignbufsize += info.alignbufsize;
+        backptrbufsize += info.backptrbufsize;
+        numframes += info.numframes;
+        numlaunchforward = max(numlaunchforward, R.batchsizeforward.size());
+        numlaunchbackward = max(numlaunchbackward, R.batchsizebackward.size());
+    }
+    if (numframes != uids.size() || numframes != parallelstate->cudalogLLs->GetNumCols())
+        LogicError("parallelforwardbackwardbatch: #frames mismatch between lattices (%d), uids (%d) and LLs (%d)",
+                   (int) numframes, (int) uids.size(), (int) parallelstate->cudalogLLs->GetNumCols());
+
+    // merge launch i of all lattices
+    std::vector<size_t> batchsizeforward(numlaunchforward, 0);
+    std::vector<size_t> batchsizebackward(numlaunchbackward, 0);
+    std::vector<unsigned int> forwardorder;
+    std::vector<unsigned int> backwardorder;
+    forwardorder.reserve(numedges);
+    backwardorder.reserve(numedges);
+    std::vector<size_t> fwcursor(lattices.size(), 0); // next forward edge of each lattice
+    std::vector<size_t> bwcursor(lattices.size());    // end of the next backward batch of each lattice
+    foreach_index (k, lattices)
+        bwcursor[k] = batchinfo[k].numedges;
+    for (size_t i = 0; i < max(numlaunchforward, numlaunchbackward); i++)
+    {
+        foreach_index (k, lattices)
+        {
+            const parallelstateimpl::residentlattice& R = resident[k];
+            const size_t edgeoffset = batchinfo[k].edgeoffset;
+            if (i < R.batchsizeforward.size())
+            {
+                for (size_t j = fwcursor[k]; j < fwcursor[k] + R.batchsizeforward[i]; j++)
+                    forwardorder.push_back((unsigned int) (edgeoffset + j));
+                fwcursor[k] += R.batchsizeforward[i];
+                batchsizeforward[i] += R.batchsizeforward[i];
+            }
+            if (i < R.batchsizebackward.size())
+            {
+                bwcursor[k] -= R.batchsizebackward[i];
+                for (size_t j = bwcursor[k]; j < bwcursor[k] + R.batchsizebackward[i]; j++)
+                    backwardorder.push_back((unsigned int) (edgeoffset + j));
+                batchsizebackward[i] += R.batchsizebackward[i];
+            }
+        }
+    }
+
+    std::vector<unsigned short> uidsuint(uids.size());
+    foreach_index (t, uidsuint)
+        uidsuint[t] = (unsigned short) uids[t];
+
+    if (lattices[0]->verbosity >= 2)
+        fprintf(stderr, "parallelforwardbackwardbatch: %d lattices, %d launches for forward, %d launches for backward\n", (int) lattices.size(), (int) numlaunchforward, (int) numlaunchbackward);
+
+    // per-minibatch buffers
+    const bool returnEframescorrect = sMBRmode;
+    const bool allocateframescorrect = (returnEframescorrect || boostingfactor != 0.0f);
+    const bool copyuids = (returnEframescorrect || boostingfactor != 0.0f);
+    parallelstate->latticebatchinfogpu->assign(batchinfo, false);
+    parallelstate->forwardordergpu->assign(forwardorder, false);
+    parallelstate->backwardordergpu->assign(backwardorder, false);
+    parallelstate->totalsgpu->allocate(4 * lattices.size());
+    parallelstate->alignresult->allocate(alignbufsize);
+    parallelstate->backptrstoragegpu->allocate(backptrbufsize);
+    parallelstate->edgeacscoresgpu->allocate(numedges);
+    parallelstate->allocfwbwvectors(numedges, numnodes, uidsuint, allocateframescorrect, copyuids, returnEframescorrect /*allocateaccvectors*/);
+
+    std::unique_ptr<latticefunctions> latticefunctions(msra::cuda::newlatticefunctions(parallelstate.getdevice()));
+    latticefunctions->edgealignmentbatch(*parallelstate->latticebatchinfogpu.get(), *parallelstate->hmmsgpu.get(), *parallelstate->lr3transPgpu.get(),
+                                         parallelstate->spalignunitid, parallelstate->silalignunitid, *parallelstate->cudalogLLs.get(),
+                                         *parallelstate->residentnodesgpu.get(), *parallelstate->residentedgesgpu.get(), *parallelstate->residentaligngpu.get(),
+                                         *parallelstate->residentalignoffsetsgpu.get(),
+                                         *parallelstate->backptrstoragegpu.get(), *parallelstate->residentbackptroffsetsgpu.get(),
+                                         *parallelstate->alignresult.get(), *parallelstate->edgeacscoresgpu.get());
+
+    latticefunctions->forwardbackwardlatticebatch(*parallelstate->latticebatchinfogpu.get(), &batchsizeforward[0], &batchsizebackward[0],
+                                                  numlaunchforward, numlaunchbackward,
+                                                  *parallelstate->forwardordergpu.get(), *parallelstate->backwardordergpu.get(),
+                                                  parallelstate->spalignunitid, parallelstate->silalignunitid,
+                                                  *parallelstate->edgeacscoresgpu.get(), *parallelstate->residentedgesgpu.get(),
+                                                  *parallelstate->residentnodesgpu.get(), *parallelstate->residentaligngpu.get(),
+                                                  *parallelstate->alignresult.get(), *parallelstate->residentalignoffsetsgpu.get(),
+                                                  *parallelstate->logppsgpu.get(), *parallelstate->logalphasgpu.get(),
+                                                  *parallelstate->logbetasgpu.get(), lmf, wp, amf, boostingfactor,
+                                                  returnEframescorrect, *parallelstate->uidsgpu.get(), *parallelstate->senone2classmapgpu.get(),
+                                                  *parallelstate->logaccalphasgpu.get(), *parallelstate->logaccbetasgpu.get(),
+                                                  *parallelstate->logframescorrectedgegpu.get(), *parallelstate->logEframescorrectgpu.get(),
+                                                  alphabetanoderatio, *parallelstate->totalsgpu.get());
+
+    std::vector<double> totals;
+    parallelstate->totalsgpu->fetch(totals, true);
+    foreach_index (k, lattices)
+    {
+        const lattice& L = *lattices[k];
+        const double totalfwscore = totals[4 * k];
+        const double totalfwacc = totals[4 * k + 1];
+        const double totalbwscore = totals[4 * k + 2];
+        const double totalbwacc = totals[4 * k + 3];
+        if (fabs(totalfwscore - totalbwscore) / L.nodes.size() > 1e-4)
+            fprintf(stderr, "forwardbackward: WARNING: lattice fw and bw scores %.10f vs. %.10f (%d nodes/%d edges)\n", (float) totalfwscore, (float) totalbwscore, (int) L.nodes.size(), (int) L.edges.size());
+        if (returnEframescorrect && fabs(totalfwacc - totalbwacc) / L.nodes.size() > 1e-4)
+            fprintf(stderr, "forwardbackward: WARNING: lattice fw and bw acc %.10f vs. %.10f (%d nodes/%d edges)\n", (float) totalfwacc, (float) totalbwacc, (int) L.nodes.size(), (int) L.edges.size());
+        if (totalfwscore < LOGZERO / 2) // (islogzero())
+        {
+            fprintf(stderr, "forwardbackward: WARNING: no path found in lattice (%d nodes/%d edges)\n", (int) L.nodes.size(), (int) L.edges.size());
+            continue; // results[k] stays LOGZERO, and its gammas zero
+        }
+        const size_t latticeframes = batchinfo[k].numframes;
+        results[k] = sMBRmode ? exp(totalbwacc) / latticeframes : totalfwscore / latticeframes; // as forwardbackward()
+    }
+
+    // state-level error signals
+    const size_t numsenones = parallelstate->cudalogLLs->GetNumRows();
+    if (!sMBRmode)
+    {
+        parallelstate->cacheerrorsignal(numsenones, numframes, false /*cacheerrsignalneg*/);
+        latticefunctions->mmierrorsignalbatch(*parallelstate->latticebatchinfogpu.get(), *parallelstate->alignresult.get(),
+                                              *parallelstate->residentalignoffsetsgpu.get(), *parallelstate->residentedgesgpu.get(),
+                                              *parallelstate->residentnodesgpu.get(), *parallelstate->logppsgpu.get(), *parallelstate->totalsgpu.get(),
+                                              *parallelstate->errorsignalgpu.get());
+    }
+    else
+    {
+        parallelstate->cacheerrorsignal(numsenones, numframes, true /*cacheerrsignalneg*/);
+        latticefunctions->sMBRerrorsignalbatch(*parallelstate->latticebatchinfogpu.get(), *parallelstate->alignresult.get(),
+                                               *parallelstate->residentalignoffsetsgpu.get(), *parallelstate->residentedgesgpu.get(),
+                                               *parallelstate->residentnodesgpu.get(), *parallelstate->logppsgpu.get(), amf,
+                                               *parallelstate->logEframescorrectgpu.get(), *parallelstate->totalsgpu.get(),
+                                               *parallelstate->errorsignalgpu.get(), *parallelstate->errorsignalneggpu.get());
+
+        static bool dummyvariable = (fprintf(stderr, "note: new version with kappa adjustment, kappa = %.2f\n", 1 / amf), true); // we only print once
+    }
+}
+
 // ------------------------------------------------------------------------
 // parallel implementations of sMBR error updating step
 // ------------------------------------------------------------------------
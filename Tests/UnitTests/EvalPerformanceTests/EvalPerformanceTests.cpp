@@ -0,0 +1,388 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalPerformanceTests.cpp : latency and throughput benchmark of a model through the extended evaluation interface.
+//
+// Loads a model with GetEvalExtendedF(), and lets a number of client threads, each with a clone of the evaluator,
+// call ForwardPass() with synthetic inputs derived from GetInputSchema(): random values for dense inputs, and one
+// random one-hot vector per sample for sparse inputs. With -batchSize > 1, each call evaluates that many sequences
+// as one minibatch through ForwardPassStreams().
+//
+// Usage: EvalPerformanceTests -model <path> [-config <config>] [-output <node name>] [-batchSize <n>] [-seqLength <n>]
+//                             [-threads <n>] [-warmup <n>] [-iterations <n>] [-format json|csv] [-out <file>]
+//
+// -config is passed to Init() and CreateNetwork(), e.g. "deviceId=-1 numEvalThreads=1". The latency per call is reported
+// as percentiles over all calls of all threads, the throughput over the wall time of the timed calls, and the memory as
+// the peak host memory of the process. Results go to stdout (or -out) as JSON (default) or CSV; progress is printed to stderr.
+//
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Basics.h"
+#include "Eval.h"
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+typedef void (*GetEvalExtendedProc)(IEvaluateModelExtended<float>**);
+
+struct EvalBenchmarkOptions
+{
+    wstring modelPath;
+    string config;
+    wstring outputName; // all outputs if empty
+    size_t batchSize = 1;
+    size_t seqLength = 1;
+    size_t numThreads = 1;
+    size_t warmupIterations = 10;
+    size_t iterations = 100; // per thread
+};
+
+struct EvalBenchmarkResult
+{
+    size_t numCalls = 0;
+    double p50Ms = 0;
+    double p90Ms = 0;
+    double p99Ms = 0;
+    double maxMs = 0;
+    double meanMs = 0;
+    double callsPerSecond = 0;
+    double samplesPerSecond = 0;
+    double peakMemoryMB = 0;
+};
+
+// peak host memory of the process so far
+static double PeakMemoryMB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss / 1024.0; // in KB
+#endif
+}
+
+// nearest-rank percentile of sorted values
+static double Percentile(const vector<double>& sorted, double p)
+{
+    size_t rank = (size_t) ceil(p * sorted.size());
+    return sorted[max(rank, (size_t) 1) - 1];
+}
+
+// synthetic values of one sequence of numSamples samples for an input
+static ValueBuffer<float, Vector> CreateInput(const VariableLayout& layout, size_t numSamples, mt19937& rng)
+{
+    ValueBuffer<float, Vector> buffer;
+    if (layout.m_storageType == VariableLayout::Sparse)
+    {
+        uniform_int_distribution<int> index(0, layout.m_numElements - 1);
+        for (size_t t = 0; t < numSamples; t++)
+        {
+            buffer.m_colIndices.push_back((int) t);
+            buffer.m_indices.push_back(index(rng));
+            buffer.m_buffer.push_back(1);
+        }
+        buffer.m_colIndices.push_back((int) numSamples);
+    }
+    else
+    {
+        uniform_real_distribution<float> value(0, 1);
+        buffer.m_buffer.resize(layout.m_numElements * numSamples);
+        for (auto& v : buffer.m_buffer)
+            v = value(rng);
+    }
+    return buffer;
+}
+
+// output buffers for one sequence of numSamples samples
+static Values<float> CreateOutputs(const VariableSchema& outputSchema, size_t numSamples)
+{
+    Values<float> outputs(outputSchema.size());
+    for (size_t i = 0; i < outputSchema.size(); i++)
+        outputs[i].m_buffer.reserve(outputSchema[i].m_numElements * numSamples);
+    return outputs;
+}
+
+// the calls of one client thread on its own clone of the evaluator
+class EvalClient
+{
+public:
+    EvalClient(IEvaluateModelExtended<float>* eval, const EvalBenchmarkOptions& options, size_t seed)
+        : m_eval(eval), m_options(options), m_rng((unsigned int) seed)
+    {
+        VariableSchema inputSchema = m_eval->GetInputSchema();
+        VariableSchema outputSchema = m_eval->GetOutputSchema();
+        m_inputs.resize(m_options.batchSize);
+        m_outputs.resize(m_options.batchSize);
+        for (size_t s = 0; s < m_options.batchSize; s++)
+        {
+            for (const auto& layout : inputSchema)
+                m_inputs[s].push_back(CreateInput(layout, m_options.seqLength, m_rng));
+            m_outputs[s] = CreateOutputs(outputSchema, m_options.seqLength);
+            if (m_options.batchSize > 1)
+            {
+                m_eval->BeginStream(s);
+                m_streamIds.push_back(s);
+            }
+        }
+    }
+
+    ~EvalClient()
+    {
+        for (auto streamId : m_streamIds)
+            m_eval->EndStream(streamId);
+        m_eval->Destroy();
+    }
+
+    void Call()
+    {
+        if (m_options.batchSize > 1)
+            m_eval->ForwardPassStreams(m_streamIds, m_inputs, m_outputs);
+        else
+            m_eval->ForwardPass(m_inputs[0], m_outputs[0]);
+    }
+
+    // runs the warmup calls, waits for all clients to be warmed up, and then times the calls
+    void Run(atomic<size_t>& numReady)
+    {
+        for (size_t i = 0; i < m_options.warmupIterations; i++)
+            Call();
+        numReady++;
+        while (numReady < m_options.numThreads)
+            this_thread::yield();
+
+        m_latencies.reserve(m_options.iterations);
+        for (size_t i = 0; i < m_options.iterations; i++)
+        {
+            auto start = chrono::high_resolution_clock::now();
+            Call();
+            auto end = chrono::high_resolution_clock::now();
+            m_latencies.push_back(chrono::duration<double, milli>(end - start).count());
+        }
+    }
+
+    const vector<double>& Latencies() const { return m_latencies; }
+    const exception_ptr& Error() const { return m_error; }
+    void SetError(exception_ptr error) { m_error = error; }
+
+private:
+    IEvaluateModelExtended<float>* m_eval;
+    const EvalBenchmarkOptions& m_options;
+    mt19937 m_rng;
+    vector<Values<float>> m_inputs; // per sequence of a call
+    vector<Values<float>> m_outputs;
+    vector<size_t> m_streamIds;
+    vector<double> m_latencies;
+    exception_ptr m_error;
+};
+
+static EvalBenchmarkResult RunBenchmark(const EvalBenchmarkOptions& options)
+{
+    Plugin plugin;
+    auto getEvalProc = (GetEvalExtendedProc) plugin.Load(L"EvalDll", "GetEvalExtendedF");
+    IEvaluateModelExtended<float>* eval;
+    getEvalProc(&eval);
+
+    auto loadStart = chrono::high_resolution_clock::now();
+    eval->Init(options.config);
+    eval->CreateNetwork(options.config + "\nmodelPath=\"" + msra::strfun::utf8(options.modelPath) + "\"");
+    auto loadEnd = chrono::high_resolution_clock::now();
+    fprintf(stderr, "Loaded model '%ls' in %.1f ms.\n", options.modelPath.c_str(), chrono::duration<double, milli>(loadEnd - loadStart).count());
+
+    vector<wstring> outputNames;
+    if (!options.outputName.empty())
+        outputNames.push_back(options.outputName);
+    else
+    {
+        for (const auto& layout : eval->GetOutputSchema())
+            outputNames.push_back(layout.m_name);
+    }
+    eval->StartForwardEvaluation(outputNames);
+    for (const auto& layout : eval->GetInputSchema())
+        fprintf(stderr, "Input  %-30ls %6d elements, %s\n", layout.m_name.c_str(), layout.m_numElements, layout.m_storageType == VariableLayout::Sparse ? "sparse" : "dense");
+    for (const auto& layout : eval->GetOutputSchema())
+        fprintf(stderr, "Output %-30ls %6d elements\n", layout.m_name.c_str(), layout.m_numElements);
+
+    // each thread evaluates a clone, which shares the parameters of the model
+    vector<unique_ptr<EvalClient>> clients;
+    for (size_t t = 0; t < options.numThreads; t++)
+        clients.push_back(unique_ptr<EvalClient>(new EvalClient(eval->Clone(), options, t)));
+    eval->Destroy();
+
+    atomic<size_t> numReady(0);
+    vector<thread> threads;
+    for (auto& client : clients)
+    {
+        EvalClient* c = client.get();
+        threads.push_back(thread([c, &numReady]
+        {
+            try
+            {
+                c->Run(numReady);
+            }
+            catch (...)
+            {
+                c->SetError(current_exception());
+                numReady = SIZE_MAX / 2; // releases the others from waiting
+            }
+        }));
+    }
+    while (numReady < options.numThreads)
+        this_thread::yield();
+    auto start = chrono::high_resolution_clock::now();
+    for (auto& thread : threads)
+        thread.join();
+    auto end = chrono::high_resolution_clock::now();
+
+    vector<double> latencies;
+    for (const auto& client : clients)
+    {
+        if (client->Error())
+            rethrow_exception(client->Error());
+        latencies.insert(latencies.end(), client->Latencies().begin(), client->Latencies().end());
+    }
+    clients.clear();
+    if (latencies.empty())
+        InvalidArgument("No calls were timed; -iterations must be at least 1.");
+
+    sort(latencies.begin(), latencies.end());
+    EvalBenchmarkResult result;
+    double seconds = chrono::duration<double>(end - start).count();
+    result.numCalls = latencies.size();
+    result.p50Ms = Percentile(latencies, 0.5);
+    result.p90Ms = Percentile(latencies, 0.9);
+    result.p99Ms = Percentile(latencies, 0.99);
+    result.maxMs = latencies.back();
+    result.meanMs = accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+    result.callsPerSecond = seconds > 0 ? latencies.size() / seconds : 0;
+    result.samplesPerSecond = result.callsPerSecond * options.batchSize * options.seqLength;
+    result.peakMemoryMB = PeakMemoryMB();
+    return result;
+}
+
+static void WriteJson(FILE* f, const EvalBenchmarkOptions& options, const EvalBenchmarkResult& r)
+{
+    string model = msra::strfun::utf8(options.modelPath);
+    string escapedModel;
+    for (char c : model)
+    {
+        if (c == '"' || c == '\\')
+            escapedModel += '\\';
+        escapedModel += c;
+    }
+    fprintf(f, "{\n  \"timestamp\": %lld,\n  \"model\": \"%s\", \"batchSize\": %d, \"seqLength\": %d, \"threads\": %d,\n"
+               "  \"calls\": %d, \"p50Ms\": %.6g, \"p90Ms\": %.6g, \"p99Ms\": %.6g, \"maxMs\": %.6g, \"meanMs\": %.6g,\n"
+               "  \"callsPerSecond\": %.6g, \"samplesPerSecond\": %.6g, \"peakMemoryMB\": %.6g\n}\n",
+            (long long) time(nullptr), escapedModel.c_str(), (int) options.batchSize, (int) options.seqLength, (int) options.numThreads,
+            (int) r.numCalls, r.p50Ms, r.p90Ms, r.p99Ms, r.maxMs, r.meanMs, r.callsPerSecond, r.samplesPerSecond, r.peakMemoryMB);
+}
+
+static void WriteCsv(FILE* f, const EvalBenchmarkOptions& options, const EvalBenchmarkResult& r)
+{
+    fprintf(f, "batchSize,seqLength,threads,calls,p50Ms,p90Ms,p99Ms,maxMs,meanMs,callsPerSecond,samplesPerSecond,peakMemoryMB\n");
+    fprintf(f, "%d,%d,%d,%d,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n",
+            (int) options.batchSize, (int) options.seqLength, (int) options.numThreads,
+            (int) r.numCalls, r.p50Ms, r.p90Ms, r.p99Ms, r.maxMs, r.meanMs, r.callsPerSecond, r.samplesPerSecond, r.peakMemoryMB);
+}
+
+static void Usage()
+{
+    fprintf(stderr, "Usage: EvalPerformanceTests -model <path> [-config <config>] [-output <node name>] [-batchSize <n>] [-seqLength <n>]\n"
+                    "                            [-threads <n>] [-warmup <n>] [-iterations <n>] [-format json|csv] [-out <file>]\n");
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    try
+    {
+        EvalBenchmarkOptions options;
+        wstring format = L"json";
+        wstring outPath;
+        for (int i = 1; i < argc; i++)
+        {
+            wstring arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                Usage();
+                return EXIT_FAILURE;
+            }
+            wstring value = argv[++i];
+            if (arg == L"-model")
+                options.modelPath = value;
+            else if (arg == L"-config")
+                options.config = msra::strfun::utf8(value);
+            else if (arg == L"-output")
+                options.outputName = value;
+            else if (arg == L"-batchSize")
+                options.batchSize = (size_t) stoul(value);
+            else if (arg == L"-seqLength")
+                options.seqLength = (size_t) stoul(value);
+            else if (arg == L"-threads")
+                options.numThreads = (size_t) stoul(value);
+            else if (arg == L"-warmup")
+                options.warmupIterations = (size_t) stoul(value);
+            else if (arg == L"-iterations")
+                options.iterations = (size_t) stoul(value);
+            else if (arg == L"-format")
+                format = value;
+            else if (arg == L"-out")
+                outPath = value;
+            else
+            {
+                Usage();
+                return EXIT_FAILURE;
+            }
+        }
+        if (options.modelPath.empty() || options.batchSize == 0 || options.seqLength == 0 || options.numThreads == 0 ||
+            (format != L"json" && format != L"csv"))
+        {
+            Usage();
+            return EXIT_FAILURE;
+        }
+
+        EvalBenchmarkResult result = RunBenchmark(options);
+        fprintf(stderr, "%d calls of %d x %d samples on %d threads: p50 %.3f ms, p99 %.3f ms, %.1f calls/s, %.1f samples/s, peak memory %.1f MB\n",
+                (int) result.numCalls, (int) options.batchSize, (int) options.seqLength, (int) options.numThreads,
+                result.p50Ms, result.p99Ms, result.callsPerSecond, result.samplesPerSecond, result.peakMemoryMB);
+
+        FILE* f = stdout;
+        if (!outPath.empty())
+        {
+            f = _wfopen(outPath.c_str(), L"w");
+            if (!f)
+                RuntimeError("Cannot open output file '%ls'.", outPath.c_str());
+        }
+        if (format == L"csv")
+            WriteCsv(f, options, result);
+        else
+            WriteJson(f, options, result);
+        if (f != stdout)
+            fclose(f);
+    }
+    catch (const exception& e)
+    {
+        fprintf(stderr, "EXCEPTION occurred: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -5,6 +5,7 @@
 
 #include "stdafx.h"
 #include "EvalTestHelper.h"
+#include <thread>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -19,7 +20,7 @@ typedef std::map<std::wstring, std::vector<float>*> Variables;
 
 BOOST_FIXTURE_TEST_SUITE(EvalTestSuite, EvalFixture)
 
-IEvaluateModelExtended<float>* SetupNetworkAndGetLayouts(std::string modelDefinition, VariableSchema& inputLayouts, VariableSchema& outputLayouts)
+IEvaluateModelExtended<float>* SetupNetworkAndGetLayouts(std::string modelDefinition, VariableSchema& inputLayouts, VariableSchema& outputLayouts, const std::string& config = "")
 {
     // Load the eval library
     auto hModule = LoadLibrary(L"evaldll.dll");
@@ -40,6 +41,8 @@ IEvaluateModelExtended<float>* SetupNetworkAndGetLayouts(std::string modelDefini
 
     try
     {
+        if (!config.empty())
+            eval->Init(config);
         eval->CreateNetwork(modelDefinition);
     }
     catch (std::exception& ex)
@@ -294,5 +297,358 @@ BOOST_AUTO_TEST_CASE(EvalSparseTimesTest)
     eval->Destroy();
 }
 
+BOOST_AUTO_TEST_CASE(EvalCloneTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(4) \n"
+        "o1 = Times(Constant(2, rows=1, cols=4), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // The clones are started for the same outputs and outlive the evaluator they were cloned from.
+    const size_t numClones = 4;
+    std::vector<IEvaluateModelExtended<float>*> clones;
+    for (size_t i = 0; i < numClones; i++)
+        clones.push_back(eval->Clone());
+    eval->Destroy();
+
+    // Evaluate the clones concurrently, each on different inputs.
+    std::vector<std::vector<float>> outputs(numClones);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numClones; i++)
+    {
+        threads.push_back(std::thread([&, i]()
+        {
+            Values<float> inputBuffer(1);
+            Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 1 });
+            for (size_t j = 0; j < 100; j++)
+            {
+                inputBuffer[0].m_buffer = { (float)i, (float)j, 0, 1 };
+                clones[i]->ForwardPass(inputBuffer, outputBuffer);
+                outputs[i].push_back(outputBuffer[0].m_buffer[0]);
+            }
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < numClones; i++)
+    {
+        BOOST_REQUIRE_EQUAL(outputs[i].size(), 100);
+        for (size_t j = 0; j < 100; j++)
+            BOOST_CHECK_EQUAL(outputs[i][j], (float)(2 * (i + j + 1)));
+        clones[i]->Destroy();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EvalPrivateThreadPoolTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(4) \n"
+        "o1 = Times(Constant(2, rows=1, cols=4), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    // Core ids must exist.
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    BOOST_REQUIRE_THROW(SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts, "cpuCores=100000"), std::exception);
+
+    // Two evaluators, each with a thread pool of its own pinned to the first core, evaluated concurrently.
+    const size_t numEvaluators = 2;
+    std::vector<IEvaluateModelExtended<float>*> evals;
+    for (size_t i = 0; i < numEvaluators; i++)
+        evals.push_back(SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts, "numEvalThreads=2 cpuCores=0"));
+
+    std::vector<std::vector<float>> outputs(numEvaluators);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numEvaluators; i++)
+    {
+        threads.push_back(std::thread([&, i]()
+        {
+            Values<float> inputBuffer(1);
+            Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 1 });
+            for (size_t j = 0; j < 100; j++)
+            {
+                inputBuffer[0].m_buffer = { (float)i, (float)j, 0, 1 };
+                evals[i]->ForwardPass(inputBuffer, outputBuffer);
+                outputs[i].push_back(outputBuffer[0].m_buffer[0]);
+            }
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < numEvaluators; i++)
+    {
+        BOOST_REQUIRE_EQUAL(outputs[i].size(), 100);
+        for (size_t j = 0; j < 100; j++)
+            BOOST_CHECK_EQUAL(outputs[i][j], (float)(2 * (i + j + 1)));
+        evals[i]->Destroy();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EvalBatchedTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(4) \n"
+        "o1 = Times(Constant(2, rows=1, cols=4), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // Requests of different lengths from concurrent callers are batched; each gets the outputs of its own samples.
+    const size_t numThreads = 8;
+    std::vector<int> correct(numThreads, 1);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numThreads; i++)
+    {
+        threads.push_back(std::thread([&, i]()
+        {
+            Values<float> inputBuffer(1);
+            Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ numThreads });
+            for (size_t j = 0; j < 50; j++)
+            {
+                size_t length = 1 + (i + j) % numThreads;
+                inputBuffer[0].m_buffer.clear();
+                for (size_t t = 0; t < length; t++)
+                    inputBuffer[0].m_buffer.insert(inputBuffer[0].m_buffer.end(), { (float)i, (float)t, 0, 1 });
+                eval->ForwardPassBatched(inputBuffer, outputBuffer);
+
+                auto& buf = outputBuffer[0].m_buffer;
+                correct[i] = correct[i] && buf.size() == length;
+                for (size_t t = 0; t < buf.size(); t++)
+                    correct[i] = correct[i] && buf[t] == (float)(2 * (i + t + 1));
+            }
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < numThreads; i++)
+        BOOST_CHECK(correct[i]);
+
+    // A request with too small an output buffer fails on its own.
+    Values<float> inputBuffer(1);
+    inputBuffer[0].m_buffer = { 1, 2, 3, 4, 1, 2, 3, 4 };
+    Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 1 });
+    BOOST_REQUIRE_THROW(eval->ForwardPassBatched(inputBuffer, outputBuffer), std::exception);
+
+    eval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalWarmUpTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(4) \n"
+        "o1 = Times(Constant(2, rows=1, cols=4), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    // The warm-up of StartForwardEvaluation() and an explicit one leave the results of the requests unchanged.
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts, "warmUpBatchSizes=1:4 warmUpSequenceLengths=3:1");
+    eval->WarmUp({ 2, 8 }, { 5 });
+
+    Values<float> inputBuffer(1);
+    inputBuffer[0].m_buffer = { 1, 2, 3, 4, 0, 0, 0, 1 };
+    Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 2 });
+    eval->ForwardPass(inputBuffer, outputBuffer);
+    BOOST_REQUIRE_EQUAL(outputBuffer[0].m_buffer.size(), 2);
+    BOOST_CHECK_EQUAL(outputBuffer[0].m_buffer[0], 20);
+    BOOST_CHECK_EQUAL(outputBuffer[0].m_buffer[1], 2);
+
+    eval->ForwardPassBatched(inputBuffer, outputBuffer);
+    BOOST_CHECK_EQUAL(outputBuffer[0].m_buffer[0], 20);
+
+    BOOST_REQUIRE_THROW(eval->WarmUp({ 0 }, { 1 }), std::exception);
+
+    eval->Destroy();
+
+    BOOST_REQUIRE_THROW(SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts, "warmUpBatchSizes=0"), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(EvalBoundBuffersTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(4) \n"
+        "o1 = Times(Constant(2, rows=1, cols=4), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    BOOST_REQUIRE_THROW(eval->ForwardPassBound(), std::exception); // Nothing bound
+
+    // Buffers for up to 2 samples
+    float* input = eval->AllocateHostBuffer(8);
+    float* output = eval->AllocateHostBuffer(2);
+    ValueRefs<float> inputRefs(1);
+    inputRefs[0].m_buffer.m_vector = input;
+    inputRefs[0].m_buffer.m_capacity = 8;
+    ValueRefs<float> outputRefs(1);
+    outputRefs[0].m_buffer.m_vector = output;
+    outputRefs[0].m_buffer.m_capacity = 2;
+
+    ValueRefs<float> noOutputRefs(0);
+    BOOST_REQUIRE_THROW(eval->BindBuffers(inputRefs, noOutputRefs), std::exception); // Outputs must adhere to the schema
+    eval->BindBuffers(inputRefs, outputRefs);
+
+    std::vector<float> values{ 1, 2, 3, 4, 5, 6, 7, 8 };
+    std::copy(values.begin(), values.end(), input);
+    inputRefs[0].m_buffer.m_size = 8;
+    eval->ForwardPassBound();
+    std::vector<float> expected{ 20, 52 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(output, output + outputRefs[0].m_buffer.size(), expected.begin(), expected.end());
+
+    // The contents and size of the bound inputs are read by every call.
+    input[0] = 2;
+    inputRefs[0].m_buffer.m_size = 4;
+    eval->ForwardPassBound();
+    expected = { 22 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(output, output + outputRefs[0].m_buffer.size(), expected.begin(), expected.end());
+
+    // Unbound evaluation must not write into the bound buffers.
+    Values<float> inputBuffer(1);
+    inputBuffer[0].m_buffer = { 1, 1, 1, 1 };
+    Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 1 });
+    eval->ForwardPass(inputBuffer, outputBuffer);
+    expected = { 8 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputBuffer[0].m_buffer.begin(), outputBuffer[0].m_buffer.end(), expected.begin(), expected.end());
+    values[0] = 2;
+    BOOST_CHECK_EQUAL_COLLECTIONS(input, input + 8, values.begin(), values.end());
+
+    inputRefs[0].m_buffer.m_size = 8;
+    eval->ForwardPassBound();
+    expected = { 22, 52 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(output, output + outputRefs[0].m_buffer.size(), expected.begin(), expected.end());
+
+    eval->FreeHostBuffer(input);
+    eval->FreeHostBuffer(output);
+    eval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalStreamingTest)
+{
+    // o1 is the running sum of the input
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "p1 = PastValue(1, o1, timeStep=1, defaultHiddenActivity=0) \n"
+        "o1 = Plus(i1, p1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    auto createBuffers = [&](const std::vector<std::vector<float>>& chunks, std::vector<Values<float>>& inputs, std::vector<Values<float>>& outputs)
+    {
+        inputs.clear();
+        outputs.clear();
+        for (const auto& chunk : chunks)
+        {
+            inputs.push_back(Values<float>(1));
+            inputs.back()[0].m_buffer = chunk;
+            outputs.push_back(outputLayouts.CreateBuffers<float>({ 10 }));
+        }
+    };
+    std::vector<Values<float>> inputs;
+    std::vector<Values<float>> outputs;
+
+    createBuffers({ { 1 } }, inputs, outputs);
+    BOOST_REQUIRE_THROW(eval->ForwardPassStreams({ 1 }, inputs, outputs), std::exception); // Stream not begun
+
+    eval->BeginStream(1);
+    eval->BeginStream(2);
+    BOOST_REQUIRE_THROW(eval->BeginStream(1), std::exception); // Stream already begun
+
+    createBuffers({ { 1, 2 }, { 10 } }, inputs, outputs);
+    eval->ForwardPassStreams({ 1, 2 }, inputs, outputs);
+    std::vector<float> expected1{ 1, 3 };
+    std::vector<float> expected2{ 10 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputs[0][0].m_buffer.begin(), outputs[0][0].m_buffer.end(), expected1.begin(), expected1.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputs[1][0].m_buffer.begin(), outputs[1][0].m_buffer.end(), expected2.begin(), expected2.end());
+
+    // A stream keeps its state while other streams are evaluated, in any parallel sequence.
+    createBuffers({ { 3 } }, inputs, outputs);
+    eval->ForwardPassStreams({ 1 }, inputs, outputs);
+    expected1 = { 6 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputs[0][0].m_buffer.begin(), outputs[0][0].m_buffer.end(), expected1.begin(), expected1.end());
+
+    createBuffers({ { 5, 5 }, { 1 } }, inputs, outputs);
+    eval->ForwardPassStreams({ 2, 1 }, inputs, outputs);
+    expected1 = { 7 };
+    expected2 = { 15, 20 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputs[0][0].m_buffer.begin(), outputs[0][0].m_buffer.end(), expected2.begin(), expected2.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputs[1][0].m_buffer.begin(), outputs[1][0].m_buffer.end(), expected1.begin(), expected1.end());
+
+    // Evaluation without streams does not see their state.
+    Values<float> inputBuffer(1);
+    inputBuffer[0].m_buffer = { 1, 2 };
+    Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 2 });
+    eval->ForwardPass(inputBuffer, outputBuffer);
+    expected1 = { 1, 3 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputBuffer[0].m_buffer.begin(), outputBuffer[0].m_buffer.end(), expected1.begin(), expected1.end());
+
+    // A stream begun again has no past.
+    eval->EndStream(1);
+    BOOST_REQUIRE_THROW(eval->EndStream(1), std::exception); // Stream not begun
+    eval->BeginStream(1);
+    createBuffers({ { 4 }, { 1 } }, inputs, outputs);
+    eval->ForwardPassStreams({ 1, 2 }, inputs, outputs);
+    expected1 = { 4 };
+    expected2 = { 21 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputs[0][0].m_buffer.begin(), outputs[0][0].m_buffer.end(), expected1.begin(), expected1.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(outputs[1][0].m_buffer.begin(), outputs[1][0].m_buffer.end(), expected2.begin(), expected2.end());
+
+    eval->Destroy();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }}}}
\ No newline at end of file
@@ -0,0 +1,208 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Benchmark.h -- minimal micro-benchmark harness used by MathPerformanceTests
+//
+// Each benchmark is a body (the operation to time) and a sync function that waits for the device to finish it.
+// The runner repeats the body until both a minimum iteration count and a minimum run time are reached,
+// and records min/median/mean time per call. Results are written as JSON or CSV, one record per
+// (group, name, device, element type), so that two CNTK builds can be compared run against run.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <exception>
+#include <functional>
+#include <numeric>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+struct BenchmarkOptions
+{
+    size_t warmupIterations = 2;
+    size_t minIterations = 5;
+    size_t maxIterations = 10000;
+    double minTimeInSeconds = 0.5;
+    std::string filter; // only run benchmarks whose full name "group/name" contains this substring
+};
+
+struct BenchmarkResult
+{
+    std::string group;    // e.g. "GEMM"
+    std::string name;     // benchmark case within the group, including its shape
+    std::string device;   // "CPU" or "GPU<id>"
+    std::string elemType; // "float" or "double"
+    std::string status;   // "ok", "skipped" or "failed"
+    std::string message;  // reason for skipped/failed
+    size_t iterations = 0;
+    double minMs = 0;
+    double medianMs = 0;
+    double meanMs = 0;
+    double workPerCall = 0; // floating-point operations or bytes per call; 0 if not meaningful
+    std::string workUnit;   // "GFLOP/s" or "GB/s"
+
+    // work per second in units of 1e9, based on the median time
+    double Throughput() const
+    {
+        return (medianMs > 0 && workPerCall > 0) ? workPerCall / (medianMs * 1e6) : 0;
+    }
+};
+
+class BenchmarkRunner
+{
+public:
+    BenchmarkRunner(const BenchmarkOptions& options)
+        : m_options(options)
+    {
+    }
+
+    bool IsEnabled(const std::string& group, const std::string& name) const
+    {
+        return m_options.filter.empty() || (group + "/" + name).find(m_options.filter) != std::string::npos;
+    }
+
+    // time body() followed by sync(); exceptions are recorded as a failed result, not propagated
+    void Run(const std::string& group, const std::string& name, const std::string& device, const std::string& elemType,
+             double workPerCall, const std::string& workUnit,
+             const std::function<void()>& body, const std::function<void()>& sync)
+    {
+        if (!IsEnabled(group, name))
+            return;
+
+        BenchmarkResult result = MakeResult(group, name, device, elemType);
+        result.workPerCall = workPerCall;
+        result.workUnit = workUnit;
+        try
+        {
+            for (size_t i = 0; i < m_options.warmupIterations; i++)
+                body();
+            sync();
+
+            std::vector<double> times;
+            double totalSeconds = 0;
+            while (times.size() < m_options.maxIterations &&
+                   (times.size() < m_options.minIterations || totalSeconds < m_options.minTimeInSeconds))
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                body();
+                sync();
+                auto end = std::chrono::high_resolution_clock::now();
+                double seconds = std::chrono::duration<double>(end - start).count();
+                times.push_back(seconds * 1000);
+                totalSeconds += seconds;
+            }
+
+            std::sort(times.begin(), times.end());
+            result.status = "ok";
+            result.iterations = times.size();
+            result.minMs = times.front();
+            result.medianMs = times.size() % 2 ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+            result.meanMs = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+            fprintf(stderr, "%-12s %-56s %-5s %-6s %10.4f ms", group.c_str(), name.c_str(), device.c_str(), elemType.c_str(), result.medianMs);
+            if (result.Throughput() > 0)
+                fprintf(stderr, " %10.2f %s", result.Throughput(), workUnit.c_str());
+            fprintf(stderr, "\n");
+        }
+        catch (const std::exception& e)
+        {
+            result.status = "failed";
+            result.message = e.what();
+            fprintf(stderr, "%-12s %-56s %-5s %-6s FAILED: %s\n", group.c_str(), name.c_str(), device.c_str(), elemType.c_str(), e.what());
+        }
+        m_results.push_back(result);
+    }
+
+    // record a benchmark that does not apply to this configuration (e.g. cuDNN engine on the CPU)
+    void Skip(const std::string& group, const std::string& name, const std::string& device, const std::string& elemType, const std::string& reason)
+    {
+        if (!IsEnabled(group, name))
+            return;
+
+        BenchmarkResult result = MakeResult(group, name, device, elemType);
+        result.status = "skipped";
+        result.message = reason;
+        m_results.push_back(result);
+    }
+
+    const std::vector<BenchmarkResult>& Results() const { return m_results; }
+
+    void WriteJson(FILE* f) const
+    {
+        fprintf(f, "{\n  \"timestamp\": %lld,\n  \"results\": [", (long long) time(nullptr));
+        for (size_t i = 0; i < m_results.size(); i++)
+        {
+            const auto& r = m_results[i];
+            fprintf(f, "%s\n    {\"group\": %s, \"name\": %s, \"device\": %s, \"elemType\": %s, \"status\": %s, \"message\": %s, "
+                       "\"iterations\": %d, \"minMs\": %.6g, \"medianMs\": %.6g, \"meanMs\": %.6g, \"throughput\": %.6g, \"throughputUnit\": %s}",
+                    i > 0 ? "," : "",
+                    JsonString(r.group).c_str(), JsonString(r.name).c_str(), JsonString(r.device).c_str(), JsonString(r.elemType).c_str(),
+                    JsonString(r.status).c_str(), JsonString(r.message).c_str(),
+                    (int) r.iterations, r.minMs, r.medianMs, r.meanMs, r.Throughput(), JsonString(r.workUnit).c_str());
+        }
+        fprintf(f, "\n  ]\n}\n");
+    }
+
+    void WriteCsv(FILE* f) const
+    {
+        fprintf(f, "group,name,device,elemType,status,message,iterations,minMs,medianMs,meanMs,throughput,throughputUnit\n");
+        for (const auto& r : m_results)
+        {
+            fprintf(f, "%s,%s,%s,%s,%s,%s,%d,%.6g,%.6g,%.6g,%.6g,%s\n",
+                    CsvString(r.group).c_str(), CsvString(r.name).c_str(), CsvString(r.device).c_str(), CsvString(r.elemType).c_str(),
+                    CsvString(r.status).c_str(), CsvString(r.message).c_str(),
+                    (int) r.iterations, r.minMs, r.medianMs, r.meanMs, r.Throughput(), CsvString(r.workUnit).c_str());
+        }
+    }
+
+private:
+    static BenchmarkResult MakeResult(const std::string& group, const std::string& name, const std::string& device, const std::string& elemType)
+    {
+        BenchmarkResult result;
+        result.group = group;
+        result.name = name;
+        result.device = device;
+        result.elemType = elemType;
+        return result;
+    }
+
+    static std::string JsonString(const std::string& s)
+    {
+        std::string res = "\"";
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                res += '\\';
+            if ((unsigned char) c < ' ')
+                c = ' ';
+            res += c;
+        }
+        return res + "\"";
+    }
+
+    // quote only if needed; embedded quotes are doubled
+    static std::string CsvString(const std::string& s)
+    {
+        if (s.find_first_of(",\"\n") == std::string::npos)
+            return s;
+        std::string res = "\"";
+        for (char c : s)
+        {
+            if (c == '"')
+                res += '"';
+            res += c;
+        }
+        return res + "\"";
+    }
+
+    BenchmarkOptions m_options;
+    std::vector<BenchmarkResult> m_results;
+};
+
+}}}}
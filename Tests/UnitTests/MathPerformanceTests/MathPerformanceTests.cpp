@@ -2,463 +2,505 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
 //
-// MathPerformanceTests.cpp : Defines the entry point for the console application.
+// MathPerformanceTests.cpp : micro-benchmarks for the Math library with machine-readable output.
+//
+// Covers GEMM, TensorView element-wise ops and reductions, sparse x dense products, the convolution engines,
+// the batch normalization engines and 1-bit quantization, on CPU and GPU, for float and double.
+//
+// Usage: MathPerformanceTests [-device cpu|gpu|all] [-gpu <id>] [-type float|double|all] [-filter <substring>]
+//                             [-minTime <seconds>] [-minIterations <n>] [-format json|csv] [-out <file>]
+//
+// Results go to stdout (or -out) as JSON (default) or CSV; progress is printed to stderr.
 //
 #include "stdafx.h"
-#define NOMINMAX
-#include "Windows.h"
-#include <chrono>
-#include <iostream>
-#include <vector>
+#include <memory>
+#include <random>
+#include "Basics.h"
 #include "Matrix.h"
-#include "CPUMatrix.h"
-#include "Sequences.h"
+#include "TensorView.h"
+#include "ConvolutionEngine.h"
+#include "BatchNormalizationEngine.h"
+#include "MatrixQuantizerImpl.h"
+#include "QuantizedMatrix.h"
+#include "CUDAPageLockedMemAllocator.h"
+#include "Benchmark.h"
+
 using namespace Microsoft::MSR::CNTK;
+using namespace Microsoft::MSR::CNTK::Test;
 using namespace std;
 
 template <class ElemType>
-void SetToInitStateValueForResetSeg(const Matrix<ElemType>& sentenceBegin,
-                                    size_t nStream, ElemType initStateValue, Matrix<ElemType>& newprevstate)
+static const char* ElemTypeName();
+template <>
+const char* ElemTypeName<float>() { return "float"; }
+template <>
+const char* ElemTypeName<double>() { return "double"; }
+
+static string DeviceName(DEVICEID_TYPE deviceId)
 {
-    Matrix<ElemType> colSeg(sentenceBegin.GetDeviceId());
-    colSeg.Resize(nStream, nStream);
-    size_t nStateRow = newprevstate.GetNumRows();
-
-    assert(nStream == sentenceBegin.GetNumRows());
-
-    // only set state to init state value for segmentation = 0, and -1
-    // e.g., -1 0 1 -> 0 0 1 -> 0 0 -1 -> 1 1 0
-
-    Matrix<ElemType> colPos(sentenceBegin.GetDeviceId());
-    colPos.SetValue(sentenceBegin);                                                     // -1 0 1
-    colPos.InplaceTruncateBottom(1 << 0 /*(int)MinibatchPackingFlags::SequenceStart*/); // TODO: these flags no longer exist, this test probably no longer applies
-    Matrix<ElemType>::Scale((ElemType) -1.0, colPos);
-    colPos += 0; // (int)MinibatchPackingFlags::None; // TODO: these flags no longer exist, this test probably no longer applies
-    colSeg.SetDiagonalValue(colPos);
-    Matrix<ElemType> ones(sentenceBegin.GetDeviceId());
-    ones.Resize(nStateRow, nStream);
-    ones.SetValue((ElemType) 1);
-    // add default state value if it is for reset
-    Matrix<ElemType>::MultiplyAndWeightedAdd(initStateValue, ones, false, colSeg, false, 1.0, newprevstate); // += [0 initStateValue 0 ]
+    return deviceId < 0 ? "CPU" : "GPU" + to_string(deviceId);
 }
 
+// Wait until all work queued on the matrix's device has completed. Reading back an element goes through the
+// same stream as the computation, so it returns only after the preceding kernels are done.
 template <class ElemType>
-void rnnForwardPropSRP(Matrix<ElemType>& functionValues, size_t mNbr, Matrix<ElemType>& pastActivity, Matrix<ElemType>& inputFunctionValues, Matrix<ElemType>& colBegin, const Matrix<ElemType>& needToCompute)
+static function<void()> SyncOn(const Matrix<ElemType>& m)
 {
-    size_t ncol = functionValues.GetNumCols();
-    size_t ntime = ncol / mNbr;
-    Matrix<ElemType> out = functionValues.ColumnSlice(0, mNbr);
-    Matrix<ElemType> inp((DEVICEID_TYPE) functionValues.GetDeviceId());
-
-    for (size_t d = 0; d < ntime; d++)
+    return [&m]
     {
-        if (d == 0)
-            inp = pastActivity.ColumnSlice(d, mNbr);
-        else
-            inp = inputFunctionValues.ColumnSlice(d, mNbr);
-
-        if (needToCompute.ColumnSlice(d, 1).Get00Element() == 1)
-        {
-            Matrix<ElemType> colSegPastActivity((DEVICEID_TYPE) functionValues.GetDeviceId());
-            Matrix<ElemType> colSeg((DEVICEID_TYPE) functionValues.GetDeviceId());
-            colSeg.Resize(mNbr, mNbr);
-            colSeg.SetValue(0);
-            colSegPastActivity.SetValue(colBegin);
-            colSegPastActivity.InplaceTruncateBottom(1 << 0 /*(int)MinibatchPackingFlags::SequenceStart*/); // TODO: these flags no longer exist, this test probably no longer applies
-            colSeg.SetDiagonalValue(colSegPastActivity);
-            Matrix<ElemType>::Multiply(inp, false, colSeg, false, out);
-            ElemType initStateValue = (ElemType) 0.1;
-            SetToInitStateValueForResetSeg<ElemType>(colBegin, mNbr, initStateValue, out);
-        }
-    }
+        if (m.GetDeviceId() >= 0)
+            m.Get00Element();
+    };
 }
 
-template <class ElemType>
-void oldRnnForwardPropSRP(Matrix<ElemType>& functionValues, size_t mNbr, Matrix<ElemType>& pastActivity, Matrix<ElemType>& inputFunctionValues)
+// -----------------------------------------------------------------------
+// GEMM, with shapes from real models
+// -----------------------------------------------------------------------
+
+struct GemmShape
 {
-    size_t ncol = functionValues.GetNumCols();
-    size_t ntime = ncol / mNbr;
-    for (size_t timeIdxInSeq = 0; timeIdxInSeq < ntime; timeIdxInSeq++)
-    {
-        for (size_t i = 0; i < mNbr; i++)
-        {
-            bool reset = false;
+    const char* model;
+    size_t m, k, n;
+    bool transA, transB;
+};
 
-            if (timeIdxInSeq == 0)
-            {
-                reset = true;
-            }
-            oldRNNForwardPropSRP<ElemType>(timeIdxInSeq, 1, reset, (ElemType) 0.1, functionValues, pastActivity, inputFunctionValues, i, mNbr);
-        }
-    }
-}
+// C[m x n] = op(A)[m x k] * op(B)[k x n]; forward, backward-data and weight-gradient products of typical layers
+static const GemmShape s_gemmShapes[] =
+{
+    { "DNN 2048 hidden, fwd",          2048, 2048,  256, false, false },
+    { "DNN 2048 hidden, bwd data",     2048, 2048,  256, true,  false },
+    { "DNN 2048 hidden, bwd weight",   2048,  256, 2048, false, true  },
+    { "DNN 9304 senone output, fwd",   9304, 2048,  256, false, false },
+    { "LSTM 1024 cell, 4 gates, fwd",  4096, 1024,   64, false, false },
+    { "LSTM 1024 cell, bwd weight",    4096,   64, 1024, false, true  },
+    { "LM 10k vocab softmax, fwd",    10000,  512,  128, false, false },
+    { "Square 4096",                   4096, 4096, 4096, false, false },
+};
 
 template <class ElemType>
-void oldRNNForwardPropSRP(const size_t timeIdxInSeq, const int delay, const bool reset, const ElemType default_activity, Matrix<ElemType>& functionValues, const Matrix<ElemType>& pastActivity, const Matrix<ElemType>& inputFunctionValues, const size_t indexInBatch, const size_t mNbr)
+static void BenchmarkGemm(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
 {
-    assert(delay > 0);
-
-    if (functionValues.GetNumRows() != inputFunctionValues.GetNumRows() ||
-        functionValues.GetNumCols() != inputFunctionValues.GetNumCols())
-        functionValues.Resize(inputFunctionValues.GetNumRows(),
-                              inputFunctionValues.GetNumCols());
-
-    int iPastIndex = (int) ((int) timeIdxInSeq - (int) delay) * (int) mNbr;
-    int d = iPastIndex;
-    if (d < 0)
-        d = (int) functionValues.Mod((float) iPastIndex, (float) pastActivity.GetNumCols());
-    // this can point to the past activity of the previous mninibatch
-
-    Matrix<ElemType> out = functionValues.ColumnSlice(timeIdxInSeq * mNbr + indexInBatch, 1);
-    Matrix<ElemType> inp((DEVICEID_TYPE) functionValues.GetDeviceId());
-
-    if (reset)
-        out.SetValue(default_activity);
-    else
+    for (const auto& s : s_gemmShapes)
     {
-        if (iPastIndex < 0)
-            inp = pastActivity.ColumnSlice(d + indexInBatch, 1);
-        else
-            inp = inputFunctionValues.ColumnSlice(d + indexInBatch, 1);
-        out.AssignValuesOf(inp);
+        string name = string(s.model) + " [" + to_string(s.m) + "x" + to_string(s.k) + "x" + to_string(s.n) + "]";
+        if (!runner.IsEnabled("GEMM", name))
+            continue;
+
+        auto a = s.transA ? Matrix<ElemType>::RandomUniform(s.k, s.m, deviceId, -1, 1, 1) : Matrix<ElemType>::RandomUniform(s.m, s.k, deviceId, -1, 1, 1);
+        auto b = s.transB ? Matrix<ElemType>::RandomUniform(s.n, s.k, deviceId, -1, 1, 2) : Matrix<ElemType>::RandomUniform(s.k, s.n, deviceId, -1, 1, 2);
+        Matrix<ElemType> c(s.m, s.n, deviceId);
+        c.SetValue(0);
+        runner.Run("GEMM", name, DeviceName(deviceId), ElemTypeName<ElemType>(), 2.0 * s.m * s.n * s.k, "GFLOP/s",
+                   [&] { Matrix<ElemType>::MultiplyAndWeightedAdd(1, a, s.transA, b, s.transB, 0, c); },
+                   SyncOn(c));
     }
 }
 
-/**
-The new way of resetting RNN state. 
-*/
+// -----------------------------------------------------------------------
+// TensorView element-wise ops and reductions
+// -----------------------------------------------------------------------
+
 template <class ElemType>
-void TestRnnForwardPropSRP(size_t nRow = 100, size_t nCol = 1000, size_t mNbr = 10, DEVICEID_TYPE deviceID = 0)
+static void BenchmarkTensorView(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
 {
-    Matrix<ElemType> functionValues(deviceID);
-    Matrix<ElemType> colBegin(deviceID);
-    Matrix<ElemType> pastActivity(deviceID);
-    Matrix<ElemType> inputFunctionValues(deviceID);
-    Matrix<ElemType> needToCompute(deviceID);
-
-    functionValues.Resize(nRow, nCol);
-    colBegin.Resize(mNbr, 1);
-    pastActivity.Resize(nRow, nCol);
-    inputFunctionValues.Resize(nRow, nCol);
-    needToCompute.Resize(1, nCol / mNbr);
-    needToCompute.SetValue(0);
-    needToCompute.ColumnSlice(0, 1).SetValue(1);
-    auto t_start = clock();
-    rnnForwardPropSRP<ElemType>(functionValues, mNbr, pastActivity, inputFunctionValues, colBegin, needToCompute);
-    auto t_end = clock();
-    std::cout << "testRnnForwardPropSRP: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
+    const size_t rows = 2048;
+    const size_t cols = 512;
+    const double n = (double) rows * cols;
+    const double elemSize = sizeof(ElemType);
+    const string shape = " [" + to_string(rows) + "x" + to_string(cols) + "]";
+
+    auto am = make_shared<Matrix<ElemType>>(Matrix<ElemType>::RandomUniform(rows, cols, deviceId, -1, 1, 1));
+    auto bm = make_shared<Matrix<ElemType>>(Matrix<ElemType>::RandomUniform(rows, cols, deviceId, -1, 1, 2));
+    auto cm = make_shared<Matrix<ElemType>>(rows, cols, deviceId);
+    auto biasm = make_shared<Matrix<ElemType>>(Matrix<ElemType>::RandomUniform(rows, 1, deviceId, -1, 1, 3));
+    auto colSumm = make_shared<Matrix<ElemType>>(rows, 1, deviceId);
+    auto rowSumm = make_shared<Matrix<ElemType>>(1, cols, deviceId);
+    cm->SetValue(0);
+
+    TensorView<ElemType> a(am, TensorShape(rows, cols));
+    TensorView<ElemType> b(bm, TensorShape(rows, cols));
+    TensorView<ElemType> c(cm, TensorShape(rows, cols));
+    TensorView<ElemType> bias(biasm, TensorShape(rows, 1));
+    TensorView<ElemType> colSum(colSumm, TensorShape(rows, 1));
+    TensorView<ElemType> rowSum(rowSumm, TensorShape(1, cols));
+
+    const string device = DeviceName(deviceId);
+    const char* type = ElemTypeName<ElemType>();
+    // work is the memory traffic, since these ops are bandwidth bound
+    runner.Run("TensorView", "Copy" + shape,                     device, type, 2 * n * elemSize, "GB/s", [&] { c.AssignCopyOf(a); }, SyncOn(*cm));
+    runner.Run("TensorView", "Sum" + shape,                      device, type, 3 * n * elemSize, "GB/s", [&] { c.AssignSumOf(a, b); }, SyncOn(*cm));
+    runner.Run("TensorView", "ElementwiseProduct" + shape,       device, type, 3 * n * elemSize, "GB/s", [&] { c.AssignElementwiseProductOf(a, b); }, SyncOn(*cm));
+    runner.Run("TensorView", "Sum with broadcast bias" + shape,  device, type, 2 * n * elemSize, "GB/s", [&] { c.AssignSumOf(a, bias); }, SyncOn(*cm));
+    runner.Run("TensorView", "Sigmoid" + shape,                  device, type, 2 * n * elemSize, "GB/s", [&] { c.AssignSigmoidOf(a); }, SyncOn(*cm));
+    runner.Run("TensorView", "Tanh" + shape,                     device, type, 2 * n * elemSize, "GB/s", [&] { c.AssignTanhOf(a); }, SyncOn(*cm));
+    runner.Run("TensorView", "Exp" + shape,                      device, type, 2 * n * elemSize, "GB/s", [&] { c.AssignExpOf(a); }, SyncOn(*cm));
+    runner.Run("TensorView", "SigmoidDerivative, add" + shape,   device, type, 4 * n * elemSize, "GB/s", [&] { c.AddElementwiseProductWithSigmoidDerivativeFromOutputOf(a, b); }, SyncOn(*cm));
+    runner.Run("TensorView", "Reduce over columns (bias grad)" + shape, device, type, n * elemSize, "GB/s", [&] { colSum.AssignCopyOf(a); }, SyncOn(*colSumm));
+    runner.Run("TensorView", "Reduce over rows" + shape,         device, type, n * elemSize, "GB/s", [&] { rowSum.AssignCopyOf(a); }, SyncOn(*rowSumm));
+    runner.Run("TensorView", "Reduce SqrOfDifference" + shape,   device, type, 2 * n * elemSize, "GB/s", [&] { rowSum.AssignSqrOfDifferenceOf(a, b); }, SyncOn(*rowSumm));
 }
 
-/**
-The old way of resetting RNN state, which used if statement. Also only supports up to two sentences within a minibatch
-*/
+// -----------------------------------------------------------------------
+// sparse x dense products, e.g. one-hot word inputs times an embedding matrix
+// -----------------------------------------------------------------------
+
 template <class ElemType>
-void TestOldRnnForwardPropSRP(size_t nRow = 100, size_t nCol = 1000, size_t mNbr = 10, DEVICEID_TYPE deviceID = 0)
+static void BenchmarkSparseDense(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
 {
-    Matrix<ElemType> functionValues(deviceID);
-    Matrix<ElemType> colBegin(deviceID);
-    Matrix<ElemType> pastActivity(deviceID);
-    Matrix<ElemType> inputFunctionValues(deviceID);
-
-    functionValues.Resize(nRow, nCol);
-    colBegin.Resize(mNbr, 1);
-    pastActivity.Resize(nRow, nCol);
-    inputFunctionValues.Resize(nRow, nCol);
-    auto t_start = clock();
-    oldRnnForwardPropSRP<ElemType>(functionValues, mNbr, pastActivity, inputFunctionValues);
-    auto t_end = clock();
-    std::cout << "TestOldRnnForwardPropSRP: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
+    const size_t vocab = 50000;
+    const size_t hidden = 512;
+    const size_t mbSize = 256;
+    const size_t nnzPerCol = 1;
+
+    // one-hot columns; CSC is the format both the CPU and GPU implementations support for the sparse operand
+    std::mt19937 rng(1);
+    vector<ElemType> oneHot(vocab * mbSize, 0);
+    for (size_t j = 0; j < mbSize; j++)
+        oneHot[j * vocab + rng() % vocab] = 1;
+    Matrix<ElemType> x(vocab, mbSize, oneHot.data(), deviceId, matrixFlagNormal);
+    x.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseCSC, true);
+
+    auto w = Matrix<ElemType>::RandomUniform(hidden, vocab, deviceId, -1, 1, 1);
+    auto g = Matrix<ElemType>::RandomUniform(hidden, mbSize, deviceId, -1, 1, 2);
+    Matrix<ElemType> h(hidden, mbSize, deviceId);
+    Matrix<ElemType> wGrad(hidden, vocab, deviceId);
+    h.SetValue(0);
+    wGrad.SetValue(0);
+
+    const string shape = " [" + to_string(hidden) + "x" + to_string(vocab) + "x" + to_string(mbSize) + "]";
+    const double flops = 2.0 * hidden * nnzPerCol * mbSize;
+    runner.Run("SparseDense", "Dense x SparseCSC (embedding fwd)" + shape, DeviceName(deviceId), ElemTypeName<ElemType>(), flops, "GFLOP/s",
+               [&] { Matrix<ElemType>::MultiplyAndWeightedAdd(1, w, false, x, false, 0, h); },
+               SyncOn(h));
+    runner.Run("SparseDense", "Dense x SparseCSC^T, add (embedding grad)" + shape, DeviceName(deviceId), ElemTypeName<ElemType>(), flops, "GFLOP/s",
+               [&] { Matrix<ElemType>::MultiplyAndWeightedAdd(1, g, false, x, true, 1, wGrad); },
+               SyncOn(wGrad));
 }
 
-template <class ElemType>
-void randomInitializeCPUMatrix(CPUMatrix<ElemType>& M, float min = -10, float max = 10)
+// -----------------------------------------------------------------------
+// convolution engines, forward and backward, for each ConvolutionEngineKind
+// -----------------------------------------------------------------------
+
+struct ConvShape
 {
-    foreach_coord (i, j, M)
-    {
-        M(i, j) = (1.0 * rand() / RAND_MAX) * max + min;
-    }
-}
+    const char* model;
+    size_t w, h, c;   // input
+    size_t kW, kH;    // kernel
+    size_t mapCount;  // output channels
+    size_t stride;
+    size_t batchSize;
+};
+
+static const ConvShape s_convShapes[] =
+{
+    { "CIFAR ResNet 3x3x16",   32, 32, 16, 3, 3, 16, 1, 64 },
+    { "CIFAR ResNet 3x3x64",    8,  8, 64, 3, 3, 64, 1, 64 },
+    { "ImageNet ResNet 1x1",   28, 28, 128, 1, 1, 512, 1, 16 },
+    { "ImageNet ResNet 3x3/2", 56, 56, 64, 3, 3, 128, 2, 16 },
+};
+
+static const pair<ConvolutionEngineKind, const char*> s_convEngineKinds[] =
+{
+    { ConvolutionEngineKind::Reference, "Reference" },
+    { ConvolutionEngineKind::CuDnn,     "CuDnn" },
+    { ConvolutionEngineKind::Legacy,    "Legacy" },
+    { ConvolutionEngineKind::Gemm,      "Gemm" },
+};
 
 template <class ElemType>
-void randomInitializeMatrix(Matrix<ElemType>& M, float min = -10, float max = 10)
+static void BenchmarkConvolution(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
 {
-    foreach_coord (i, j, M)
+    const string device = DeviceName(deviceId);
+    const char* type = ElemTypeName<ElemType>();
+    for (const auto& s : s_convShapes)
     {
-        M(i, j) = (1.0 * rand() / RAND_MAX) * max + min;
+        auto geometry = make_shared<ConvolveGeometry>(TensorShape(s.w, s.h, s.c), TensorShape(s.kW, s.kH, s.c), TensorShape(s.mapCount),
+                                                      TensorShape(s.stride, s.stride, s.c),
+                                                      ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true, true, false},
+                                                      TensorShape(0), TensorShape(0));
+        const size_t inSize = geometry->InputShape().GetNumElements();
+        const size_t outSize = geometry->OutputShape().GetNumElements();
+        const size_t kernelSize = geometry->KernelShape().GetNumElements();
+        const double flops = 2.0 * outSize * kernelSize * s.batchSize;
+        const string shape = " [" + to_string(s.w) + "x" + to_string(s.h) + "x" + to_string(s.c) + " * " + to_string(s.kW) + "x" + to_string(s.kH) +
+                             " -> " + to_string(s.mapCount) + ", stride " + to_string(s.stride) + ", mb " + to_string(s.batchSize) + "]";
+
+        for (const auto& kind : s_convEngineKinds)
+        {
+            const string name = string(s.model) + " " + kind.second;
+            if (!runner.IsEnabled("Convolution", name + " Forward" + shape) &&
+                !runner.IsEnabled("Convolution", name + " BackwardData" + shape) &&
+                !runner.IsEnabled("Convolution", name + " BackwardKernel" + shape))
+                continue;
+
+            // only the legacy engine handles (and requires) the HWC layout
+            ImageLayoutKind layout = kind.first == ConvolutionEngineKind::Legacy ? ImageLayoutKind::HWC : ImageLayoutKind::CHW;
+            unique_ptr<ConvolutionEngine<ElemType>> engine;
+            try
+            {
+                engine = ConvolutionEngine<ElemType>::Create(geometry, deviceId, layout, 0, PoolKind::None, kind.first);
+            }
+            catch (const exception& e)
+            {
+                for (const char* pass : {" Forward", " BackwardData", " BackwardKernel"})
+                    runner.Skip("Convolution", name + pass + shape, device, type, e.what());
+                continue;
+            }
+
+            auto in = Matrix<ElemType>::RandomUniform(inSize, s.batchSize, deviceId, -1, 1, 1);
+            auto kernel = Matrix<ElemType>::RandomUniform(s.mapCount, kernelSize, deviceId, -1, 1, 2);
+            auto srcGrad = Matrix<ElemType>::RandomUniform(outSize, s.batchSize, deviceId, -1, 1, 3);
+            Matrix<ElemType> out(outSize, s.batchSize, deviceId);
+            Matrix<ElemType> grad(inSize, s.batchSize, deviceId);
+            Matrix<ElemType> kernelGrad(s.mapCount, kernelSize, deviceId);
+            Matrix<ElemType> workspace(deviceId);
+            grad.SetValue(0);
+            kernelGrad.SetValue(0);
+
+            runner.Run("Convolution", name + " Forward" + shape, device, type, flops, "GFLOP/s",
+                       [&] { engine->Forward(in, kernel, out, workspace); }, SyncOn(out));
+            runner.Run("Convolution", name + " BackwardData" + shape, device, type, flops, "GFLOP/s",
+                       [&] { engine->BackwardData(srcGrad, kernel, grad, workspace); }, SyncOn(grad));
+            runner.Run("Convolution", name + " BackwardKernel" + shape, device, type, flops, "GFLOP/s",
+                       [&] { engine->BackwardKernel(srcGrad, in, kernelGrad, false, workspace); }, SyncOn(kernelGrad));
+        }
     }
 }
 
-template <class ElemType>
-void MultiplyAndWeightedAddTest(int n, int k, int m)
-{
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << k << ") and B(" << k << "," << m << ")" << endl;
-    CPUMatrix<ElemType> A(n, k);
-    randomInitializeCPUMatrix<ElemType>(A);
-    CPUMatrix<ElemType> B(k, m);
-    randomInitializeCPUMatrix<ElemType>(B);
-    CPUMatrix<ElemType> C(n, m);
-    auto t_start = clock();
-    CPUMatrix<ElemType>::MultiplyAndWeightedAdd(0.324, A, false, B, false, 0.632, C);
-    auto t_end = clock();
-    std::cout << "CPU Matrix in: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
-    std::cout << n << " " << k << " " << m << endl;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> AG((size_t) n, (size_t) k);
-    randomInitializeMatrix<ElemType>(AG);
-    Matrix<ElemType> BG((size_t) k, (size_t) m);
-    randomInitializeMatrix<ElemType>(BG);
-    Matrix<ElemType> CG((size_t) n, (size_t) m);
-    auto t_startG = clock();
-    Matrix<ElemType>::MultiplyAndWeightedAdd(0.324, AG, false, BG, false, 0.632, CG);
-    auto t_endG = clock();
-    std::cout << "Matrix in: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
-}
+// -----------------------------------------------------------------------
+// batch normalization engines
+// -----------------------------------------------------------------------
 
-template <class ElemType>
-void AddMultiplyAndInplaceSigmoidTest(int n, int k, int m)
+static const pair<BatchNormEngineKind, const char*> s_batchNormEngineKinds[] =
 {
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << k << ") and B(" << k << "," << m << ")" << endl;
-    CPUMatrix<ElemType> A(n, k);
-    randomInitializeCPUMatrix<ElemType>(A);
-    CPUMatrix<ElemType> B(k, m);
-    randomInitializeCPUMatrix<ElemType>(B);
-    CPUMatrix<ElemType> D(n, m);
-    randomInitializeCPUMatrix<ElemType>(D);
-    CPUMatrix<ElemType> C(n, m);
-    auto t_start = clock();
-    C = A * B + D;
-    // C.InplaceSigmoid();
-    auto t_end = clock();
-    std::cout << "CPU Matrix in: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
-    std::cout << n << " " << k << " " << m << endl;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> AG((size_t) n, (size_t) k);
-    randomInitializeMatrix<ElemType>(AG);
-    Matrix<ElemType> BG((size_t) k, (size_t) m);
-    randomInitializeMatrix<ElemType>(BG);
-    Matrix<ElemType> DG((size_t) n, (size_t) m);
-    randomInitializeMatrix<ElemType>(DG);
-    Matrix<ElemType> CG((size_t) n, (size_t) m);
-    auto t_startG = clock();
-    CG = AG * BG + DG;
-    // CG.InplaceSigmoid();
-    auto t_endG = clock();
-    std::cout << "Matrix in: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
-}
+    { BatchNormEngineKind::Cntk,  "Cntk" },
+    { BatchNormEngineKind::CuDnn, "CuDnn" },
+};
 
 template <class ElemType>
-void ColumnSliceMultAndAddTest(int n, int k, int m, DEVICEID_TYPE deviceID)
+static void BenchmarkBatchNorm(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
 {
-    cout << "Testing Matrix" << endl;
-
-    Matrix<ElemType> AG((size_t) n, (size_t) k, deviceID);
-    AG.SetUniformRandomValue(-1, 1);
-
-    Matrix<ElemType> BG((size_t) k, (size_t) m, deviceID);
-    BG.SetUniformRandomValue(-1, 1);
-
-    Matrix<ElemType> CG((size_t) n, (size_t) m, deviceID);
-    Matrix<ElemType> DG((size_t) n, (size_t) m, deviceID);
-
-    auto t_startG = clock();
-    Matrix<ElemType>::MultiplyAndAdd(AG, false, BG, false, CG);
-    auto t_endG = clock();
-    std::cout << "MultiplyAndAdd Directly: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
-
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
+    const string device = DeviceName(deviceId);
+    const char* type = ElemTypeName<ElemType>();
+    // (input shape, minibatch size, spatial)
+    const tuple<TensorShape, size_t, bool> configs[] =
     {
-        Matrix<ElemType> col_BG = BG.ColumnSlice(i, 1);
-        Matrix<ElemType> col_CG = CG.ColumnSlice(i, 1);
-        Matrix<ElemType>::MultiplyAndAdd(AG, false, col_BG, false, col_CG);
-    }
-    t_endG = clock();
-    std::cout << "MultiplyAndAdd With ColumnSlice: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
+        make_tuple(TensorShape(32, 32, 16), 64, true),   // after a CIFAR ResNet convolution
+        make_tuple(TensorShape(14, 14, 256), 32, true),  // after an ImageNet ResNet convolution
+        make_tuple(TensorShape(2048), 256, false),       // after a fully connected layer
+    };
 
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
+    for (const auto& cfg : configs)
     {
-        Matrix<ElemType> col_BG = BG.ColumnSlice(i, 1);
-        Matrix<ElemType> col_CG = CG.ColumnSlice(i, 1);
-        Matrix<ElemType>::MultiplyAndAdd(AG, false, col_BG, false, col_CG);
-    }
-    t_endG = clock();
-    std::cout << "MultiplyAndAdd With ColumnSlice&: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
+        const auto& inOutT = get<0>(cfg);
+        const size_t batchSize = get<1>(cfg);
+        const bool spatial = get<2>(cfg);
+        const size_t crow = inOutT.GetNumElements();
+        const size_t crowScaleBias = spatial ? inOutT[2] : crow;
+        const double bytes = 2.0 * crow * batchSize * sizeof(ElemType);
+        const string shape = " [" + (string) inOutT + ", mb " + to_string(batchSize) + (spatial ? ", spatial" : "") + "]";
+
+        for (const auto& kind : s_batchNormEngineKinds)
+        {
+            const string name = string(kind.second);
+            if (!runner.IsEnabled("BatchNorm", name + " Forward" + shape) && !runner.IsEnabled("BatchNorm", name + " Backward" + shape))
+                continue;
 
-    Matrix<ElemType> col_BG1(0), col_CG1(0);
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
-    {
-        col_BG1.AssignColumnSlice(BG, i, 1);
-        col_CG1.AssignColumnSlice(CG, i, 1);
-        Matrix<ElemType>::MultiplyAndAdd(AG, false, col_BG1, false, col_CG1);
-    }
-    t_endG = clock();
-    std::cout << "MultiplyAndAdd With AssignColumnSlice: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
+            unique_ptr<BatchNormEngine<ElemType>> engine;
+            try
+            {
+                engine = BatchNormEngine<ElemType>::Create(deviceId, inOutT, spatial, ImageLayoutKind::CHW, kind.first);
+            }
+            catch (const exception& e)
+            {
+                runner.Skip("BatchNorm", name + " Forward" + shape, device, type, e.what());
+                runner.Skip("BatchNorm", name + " Backward" + shape, device, type, e.what());
+                continue;
+            }
 
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
-    {
-        Matrix<ElemType> col_CG = CG.ColumnSlice(i, 1);
-        Matrix<ElemType> col_DG = DG.ColumnSlice(i, 1);
-        col_DG.AssignSigmoidOf(col_CG);
+            auto in = Matrix<ElemType>::RandomUniform(crow, batchSize, deviceId, -1, 1, 1);
+            auto srcGrad = Matrix<ElemType>::RandomUniform(crow, batchSize, deviceId, -1, 1, 2);
+            auto scale = Matrix<ElemType>::RandomUniform(crowScaleBias, 1, deviceId, 0.5, 1.5, 3);
+            auto bias = Matrix<ElemType>::RandomUniform(crowScaleBias, 1, deviceId, -1, 1, 4);
+            Matrix<ElemType> out(crow, batchSize, deviceId);
+            Matrix<ElemType> grad(crow, batchSize, deviceId);
+            Matrix<ElemType> runMean(crowScaleBias, 1, deviceId);
+            Matrix<ElemType> runInvStdDev(crowScaleBias, 1, deviceId);
+            Matrix<ElemType> saveMean(crowScaleBias, 1, deviceId);
+            Matrix<ElemType> saveInvStdDev(crowScaleBias, 1, deviceId);
+            Matrix<ElemType> scaleGrad(crowScaleBias, 1, deviceId);
+            Matrix<ElemType> biasGrad(crowScaleBias, 1, deviceId);
+            runMean.SetValue(0);
+            runInvStdDev.SetValue(1);
+            grad.SetValue(0);
+
+            // training mode: expAvgFactor = 1 (use the minibatch statistics), blendFactor = 0; cuDNN supports only this or inference
+            runner.Run("BatchNorm", name + " Forward" + shape, device, type, bytes, "GB/s",
+                       [&] { engine->Forward(in, scale, bias, 1, 0, runMean, runInvStdDev, out, 1e-5, saveMean, saveInvStdDev); }, SyncOn(out));
+            runner.Run("BatchNorm", name + " Backward" + shape, device, type, 1.5 * bytes, "GB/s",
+                       [&] { engine->Backward(in, srcGrad, grad, scale, saveMean, saveInvStdDev, scaleGrad, biasGrad); }, SyncOn(grad));
+        }
     }
-    t_endG = clock();
-    std::cout << "AssignSigmoidOf With ColumnSlice: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
+}
+
+// -----------------------------------------------------------------------
+// 1-bit quantization, as used by 1-bit SGD
+// -----------------------------------------------------------------------
 
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
+template <class ElemType>
+static void BenchmarkQuantizer(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
+{
+    const string device = DeviceName(deviceId);
+    const char* type = ElemTypeName<ElemType>();
+    const size_t numBits = 1;
+    // gradients of a 2048x2048 hidden layer and of a 9304x2048 output layer
+    for (const auto& dims : { make_pair<size_t, size_t>(2048, 2048), make_pair<size_t, size_t>(2048, 9304) })
     {
-        col_BG1.AssignColumnSlice(BG, i, 1);
-        col_CG1.AssignColumnSlice(CG, i, 1);
-        col_BG1.AssignSigmoidOf(col_CG1);
+        const size_t rows = dims.first;
+        const size_t cols = dims.second;
+        const string shape = " [" + to_string(rows) + "x" + to_string(cols) + "]";
+        if (!runner.IsEnabled("Quantizer", "1-bit Quantize" + shape) && !runner.IsEnabled("Quantizer", "1-bit Unquantize" + shape))
+            continue;
+
+        unique_ptr<MemAllocator> allocator(deviceId == CPUDEVICE ? nullptr : new CUDAPageLockedMemAllocator(deviceId));
+        unique_ptr<MatrixQuantizerImpl<ElemType>> quantizer(MatrixQuantizerImpl<ElemType>::Create(deviceId, false /*useAsync*/));
+        auto in = Matrix<ElemType>::RandomUniform(rows, cols, deviceId, -1, 1, 1);
+        Matrix<ElemType> residual(rows, cols, deviceId);
+        Matrix<ElemType> out(rows, cols, deviceId);
+        residual.SetValue(0);
+        out.SetValue(0);
+        QuantizedMatrix<ElemType> quantized(rows, cols, numBits, CPUDEVICE, allocator.get());
+
+        // the quantized buffer lives in (page-locked) CPU memory, so this includes the device-to-host transfer
+        const double bytes = (double) rows * cols * sizeof(ElemType);
+        runner.Run("Quantizer", "1-bit Quantize" + shape, device, type, bytes, "GB/s",
+                   [&]
+                   {
+                       quantizer->QuantizeAsync(in, residual, quantized, residual, false /*zeroThresholdFor1Bit*/);
+                       quantizer->WaitQuantizeAsyncDone();
+                   },
+                   SyncOn(residual));
+        runner.Run("Quantizer", "1-bit Unquantize" + shape, device, type, bytes, "GB/s",
+                   [&]
+                   {
+                       quantizer->UnquantizeAsync(quantized, out, false /*add*/);
+                       quantizer->WaitUnquantizeAsyncDone();
+                   },
+                   SyncOn(out));
     }
-    t_endG = clock();
-    std::cout << "AssignSigmoidOf With AssignColumnSlice: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
 }
 
+// -----------------------------------------------------------------------
+// main
+// -----------------------------------------------------------------------
+
 template <class ElemType>
-void SquareMultiplyAndAdd10TimesAvgTest(int n, int count)
+static void RunAllBenchmarks(BenchmarkRunner& runner, DEVICEID_TYPE deviceId)
 {
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << n << ") and B(" << n << "," << n << ")" << endl;
+    BenchmarkGemm<ElemType>(runner, deviceId);
+    BenchmarkTensorView<ElemType>(runner, deviceId);
+    BenchmarkSparseDense<ElemType>(runner, deviceId);
+    BenchmarkConvolution<ElemType>(runner, deviceId);
+    BenchmarkBatchNorm<ElemType>(runner, deviceId);
+    BenchmarkQuantizer<ElemType>(runner, deviceId);
+}
 
-    double cpu_avg = 0;
-    for (int i = 0; i < count; ++i)
+static void Usage()
+{
+    fprintf(stderr, "Usage: MathPerformanceTests [-device cpu|gpu|all] [-gpu <id>] [-type float|double|all] [-filter <substring>]\n"
+                    "                            [-minTime <seconds>] [-minIterations <n>] [-format json|csv] [-out <file>]\n");
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    try
     {
-        CPUMatrix<ElemType> A(n, n);
-        randomInitializeCPUMatrix<ElemType>(A);
-        CPUMatrix<ElemType> B(n, n);
-        randomInitializeCPUMatrix<ElemType>(B);
-        CPUMatrix<ElemType> C(n, n);
-        auto t_start = clock();
-        CPUMatrix<ElemType>::MultiplyAndWeightedAdd(0.324, A, false, B, false, 0.632, C);
-        auto t_end = clock();
-        double val = 1.0 * (t_end - t_start) / CLOCKS_PER_SEC;
-        if (i == 0)
+        BenchmarkOptions options;
+        wstring devices = L"all";
+        wstring types = L"all";
+        wstring format = L"json";
+        wstring outPath;
+        DEVICEID_TYPE gpuId = 0;
+        for (int i = 1; i < argc; i++)
         {
-            cpu_avg = val;
+            wstring arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                Usage();
+                return EXIT_FAILURE;
+            }
+            wstring value = argv[++i];
+            if (arg == L"-device")
+                devices = value;
+            else if (arg == L"-gpu")
+                gpuId = (DEVICEID_TYPE) stoi(value);
+            else if (arg == L"-type")
+                types = value;
+            else if (arg == L"-filter")
+                options.filter = msra::strfun::utf8(value);
+            else if (arg == L"-minTime")
+                options.minTimeInSeconds = stod(value);
+            else if (arg == L"-minIterations")
+                options.minIterations = (size_t) stoul(value);
+            else if (arg == L"-format")
+                format = value;
+            else if (arg == L"-out")
+                outPath = value;
+            else
+            {
+                Usage();
+                return EXIT_FAILURE;
+            }
         }
-        else
+        if (format != L"json" && format != L"csv")
         {
-            cpu_avg = cpu_avg * (i - 1) / i + val / i;
+            Usage();
+            return EXIT_FAILURE;
         }
-    }
 
-    cout << "Testing Matrix" << endl;
-    double m_avg = 0;
-    for (int i = 0; i < count; ++i)
-    {
-        Matrix<ElemType> AG((size_t) n, (size_t) n);
-        randomInitializeMatrix<ElemType>(AG);
-        Matrix<ElemType> BG((size_t) n, (size_t) n);
-        randomInitializeMatrix<ElemType>(BG);
-        Matrix<ElemType> CG((size_t) n, (size_t) n);
-        auto t_startG = clock();
-        Matrix<ElemType>::MultiplyAndWeightedAdd(0.324, AG, false, BG, false, 0.632, CG);
-        auto t_endG = clock();
-        double val = 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC;
-        if (i == 0)
+        vector<DEVICEID_TYPE> deviceIds;
+        if (devices == L"cpu" || devices == L"all")
+            deviceIds.push_back(CPUDEVICE);
+        if (devices == L"gpu" || devices == L"all")
+            deviceIds.push_back(gpuId);
+
+        BenchmarkRunner runner(options);
+        for (auto deviceId : deviceIds)
         {
-            m_avg = val;
+            // a CPU-only build or a machine without a GPU cannot create GPU matrices
+            try
+            {
+                Matrix<float> probe(1, 1, deviceId);
+            }
+            catch (const exception& e)
+            {
+                fprintf(stderr, "Skipping device %s: %s\n", DeviceName(deviceId).c_str(), e.what());
+                continue;
+            }
+            if (types == L"float" || types == L"all")
+                RunAllBenchmarks<float>(runner, deviceId);
+            if (types == L"double" || types == L"all")
+                RunAllBenchmarks<double>(runner, deviceId);
         }
-        else
+
+        FILE* f = stdout;
+        if (!outPath.empty())
         {
-            m_avg = m_avg * (i - 1) / i + val / i;
+            f = _wfopen(outPath.c_str(), L"w");
+            if (!f)
+                RuntimeError("Cannot open output file '%ls'.", outPath.c_str());
         }
+        if (format == L"csv")
+            runner.WriteCsv(f);
+        else
+            runner.WriteJson(f);
+        if (f != stdout)
+            fclose(f);
     }
-
-    cout << "Based on " << count << " runs:" << endl;
-    cout << "Average time for CPUMatrix is: " << cpu_avg << " seconds" << endl;
-    cout << "Average time for Matrix is: " << m_avg << " seconds" << endl;
-    cout << "CPUMatrix/Matrix ratio is: " << cpu_avg / m_avg << " seconds" << endl;
-}
-
-template <class ElemType>
-void MandSTest(int count, int devId)
-{
-    ElemType* arr = new ElemType[count];
-    for (int i = 0; i < count; ++i)
-        arr[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data1 = new ElemType[1024 * 4096];
-    for (int i = 0; i < 1024 * 4096; ++i)
-        data1[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data2 = new ElemType[1024 * 4096];
-    for (int i = 0; i < 1024 * 4096; ++i)
-        data2[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data3 = new ElemType[1024];
-    for (int i = 0; i < 1024; ++i)
-        data3[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> A(1024, 4096, data1, true, devId);
-    Matrix<ElemType> B(4096, 1024, data2, true, devId);
-    Matrix<ElemType> V(1024, 1, data3, true, devId);
-    Matrix<ElemType> C(1024, 1024, devId);
-
-    auto t_startG = clock();
-    for (int i = 0; i < count; ++i)
-    {
-        // Matrix<ElemType>::MultiplyAndWeightedAdd(arr[i],A,false,B,false,3.2*arr[i],C);
-        C += (A * arr[i]) * (B * (arr[i] * 2.3));
-    }
-    auto t_endG = clock();
-    double valM = 1.0 * (t_endG - t_startG) / (CLOCKS_PER_SEC * count);
-    cout << "Matrix C+=alpha*A*beta*B in: " << valM << " seconds" << endl;
-
-    cout << "Testing CPUMatrix" << endl;
-    CPUMatrix<ElemType> AC(1024, 4096, data1, true);
-    CPUMatrix<ElemType> BC(4096, 1024, data2, true);
-    CPUMatrix<ElemType> VC(1024, 1, data3, true);
-    CPUMatrix<ElemType> CC(1024, 1024);
-
-    auto t_startC = clock();
-    for (int i = 0; i < count; ++i)
+    catch (const exception& e)
     {
-        CPUMatrix<ElemType>::MultiplyAndWeightedAdd(arr[i], AC, false, BC, false, 3.2 * arr[i], CC);
-        // CC+=(arr[i]*AC)*((arr[i]*2.3)*BC);
+        fprintf(stderr, "EXCEPTION occurred: %s\n", e.what());
+        return EXIT_FAILURE;
     }
-    auto t_endC = clock();
-    double valMC = 1.0 * (t_endC - t_startC) / (CLOCKS_PER_SEC * count);
-    cout << "CPUMatrix C+=alpha*A*beta*B in: " << valMC << " seconds" << endl;
-
-    delete[] arr;
-    delete[] data1;
-    delete[] data2;
-    delete[] data3;
-}
-
-int wmain()
-{
-    ColumnSliceMultAndAddTest<float>(2048, 2048, 256, 0);
-
-    TestRnnForwardPropSRP<float>();
-
-    TestOldRnnForwardPropSRP<float>();
-
-    // MandSTest<float>(100, 2);
-
-    /*cout<<endl<<"********************Matrix SquareMultiplyAndWeightedAdd10TimesAvg TEST********************"<<endl;
-    SquareMultiplyAndAdd10TimesAvgTest<float>(4096,10);
-
-    cout<<endl<<"********************Matrix AddMultiplyAndInplaceSigmoid TEST********************"<<endl;    
-    AddMultiplyAndInplaceSigmoidTest<float>(11,10,12);    
-    AddMultiplyAndInplaceSigmoidTest<float>(110,100,120);    
-    AddMultiplyAndInplaceSigmoidTest<float>(1100,1000,1200);    
-    AddMultiplyAndInplaceSigmoidTest<float>(11000,10000,1200);
-
-    cout<<endl<<"********************Matrix MultiplyAndWeightedAdd TEST********************"<<endl;    
-    MultiplyAndWeightedAddTest<float>(11,10,12);    
-    MultiplyAndWeightedAddTest<float>(110,100,120);    
-    MultiplyAndWeightedAddTest<float>(1100,1000,1200);    
-    MultiplyAndWeightedAddTest<float>(11000,10000,12000);*/
-
-    return 0;
+    return EXIT_SUCCESS;
 }
@@ -89,7 +89,7 @@ BOOST_AUTO_TEST_CASE(BatchNormalizationForward)
     };
 
     int baseDeviceId = 0;
-    for (int deviceId : {0})
+    for (int deviceId : {0, -1})
     {
         for (const auto& cfg : GenerateBNTestConfigs())
         {
@@ -304,7 +304,7 @@ BOOST_AUTO_TEST_CASE(BatchNormalizationBackward)
     };
 
     int baseDeviceId = 0;
-    for (int deviceId : {0})
+    for (int deviceId : {0, -1})
     {
         for (const auto& cfg : GenerateBNTestConfigs())
         {
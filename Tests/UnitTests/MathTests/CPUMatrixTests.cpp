@@ -4,6 +4,11 @@
 //
 #include "stdafx.h"
 #include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/CPUVectorizedTensorOps.h"
+#include "../../../Source/Math/CPUThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -220,6 +225,44 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixMultiplyAndDiv, RandomSeedFixture)
     BOOST_CHECK(m3.IsEqualTo(m2));
 }
 
+// products with up to 8 columns use the specialized kernels instead of BLAS; compare them with the definition
+BOOST_FIXTURE_TEST_CASE(CPUMatrixMultiplyFewColumns, RandomSeedFixture)
+{
+    const size_t m = 150; // (more than two blocks of rows)
+    const size_t k = 37;
+    for (size_t n = 1; n <= 9; n++)
+    {
+        for (int transposes = 0; transposes < 4; transposes++)
+        {
+            const bool transposeA = (transposes & 1) != 0;
+            const bool transposeB = (transposes & 2) != 0;
+            auto a = DMatrix::RandomUniform(transposeA ? k : m, transposeA ? m : k, -1, 1, IncrementCounter());
+            auto b = DMatrix::RandomUniform(transposeB ? n : k, transposeB ? k : n, -1, 1, IncrementCounter());
+            auto c = DMatrix::RandomUniform(m, n, -1, 1, IncrementCounter());
+            DMatrix product(m, n);
+            DMatrix expected(m, n);
+            for (size_t i = 0; i < m; i++)
+            {
+                for (size_t j = 0; j < n; j++)
+                {
+                    double sum = 0;
+                    for (size_t p = 0; p < k; p++)
+                        sum += (transposeA ? a(p, i) : a(i, p)) * (transposeB ? b(j, p) : b(p, j));
+                    product(i, j) = sum;
+                    expected(i, j) = 0.5 * sum + 2 * c(i, j);
+                }
+            }
+            DMatrix::MultiplyAndWeightedAdd(0.5, a, transposeA, b, transposeB, 2, c);
+            BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE4));
+
+            // with beta = 0, the previous values of c are not used, even if they are not numbers
+            c.SetValue(std::numeric_limits<double>::quiet_NaN());
+            DMatrix::MultiplyAndWeightedAdd(1, a, transposeA, b, transposeB, 0, c);
+            BOOST_CHECK(c.IsEqualTo(product, c_epsilonFloatE4));
+        }
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixElementOperations, RandomSeedFixture)
 {
     // TODO: consider splitting this large test
@@ -568,6 +611,27 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixTranspose, RandomSeedFixture)
     BOOST_CHECK(m2.IsEqualTo(m0, c_epsilonFloatE4));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixCopySection, RandomSeedFixture)
+{
+    DMatrix m0(3, 2);
+    foreach_coord (i, j, m0)
+    {
+        m0(i, j) = 10.0 * i + j;
+    }
+
+    // the top-left 2 x 2 section into a buffer with a column stride of 3; the gaps must stay untouched
+    std::vector<double> buffer(6, -1);
+    m0.CopySection(2, 2, buffer.data(), 3);
+    std::vector<double> expected = {0, 10, -1, 1, 11, -1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(buffer.begin(), buffer.end(), expected.begin(), expected.end());
+
+    // a column slice copies its own columns
+    DMatrix m1 = m0.ColumnSlice(1, 1);
+    m1.CopySection(3, 1, buffer.data(), 3);
+    BOOST_CHECK_EQUAL(buffer[0], 1);
+    BOOST_CHECK_EQUAL(buffer[2], 21);
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixColumnSlice, RandomSeedFixture)
 {
     DMatrix m0(2, 3);
@@ -898,6 +962,144 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixTensorOpVectorized, RandomSeedFixture)
+{
+    // odd sizes, so that the vectorized kernels also run their scalar tail
+    const size_t rows = 37;
+    const size_t cols = 13;
+    SMatrix a = SMatrix::RandomUniform(rows, cols, -3, 3, IncrementCounter());
+    SMatrix b = SMatrix::RandomUniform(rows, cols, -3, 3, IncrementCounter());
+
+    const SmallVector<size_t> opDims{ rows * cols };
+    const SmallVector<ptrdiff_t> unitStrides{ 1 };
+    const std::array<SmallVector<ptrdiff_t>, 3> regularStrides = { unitStrides, unitStrides, unitStrides };
+    const std::array<SmallVector<ptrdiff_t>, 3> noStrides;
+
+    // reduce each column to a single element
+    const SmallVector<size_t> columnDims{ cols };
+    const SmallVector<size_t> rowDims{ rows };
+    const SmallVector<ptrdiff_t> columnStrides{ (ptrdiff_t) rows };
+    const std::array<SmallVector<ptrdiff_t>, 3> reducingColumnStrides = { columnStrides, columnStrides, SmallVector<ptrdiff_t>{ 1 } };
+    const std::array<SmallVector<ptrdiff_t>, 3> reducingRowStrides = { unitStrides, unitStrides, SmallVector<ptrdiff_t>{ 0 } };
+
+    auto compute = [&](ElementWiseOperator op, SMatrix& c, SMatrix& r)
+    {
+        c.SetValue(1);
+        c.TensorOp(0.5f, a, b, 2.0f, op, ElementWiseOperator::opSum, std::array<size_t, 3>{ 0, 0, 0 }, opDims, regularStrides, SmallVector<size_t>(), noStrides);
+        r.SetValue(1);
+        r.TensorOp(0.5f, a, b, 2.0f, op, ElementWiseOperator::opSum, std::array<size_t, 3>{ 0, 0, 0 }, columnDims, reducingColumnStrides, rowDims, reducingRowStrides);
+    };
+
+    const CPUVectorInstructionSet instructionSet = GetCPUVectorInstructionSet();
+    for (auto op : { ElementWiseOperator::opSum, ElementWiseOperator::opElementwiseProduct, ElementWiseOperator::opElementwiseQuotient, ElementWiseOperator::opMax })
+    {
+        SMatrix c(rows, cols), r(1, cols);
+        compute(op, c, r);
+
+        LimitCPUVectorInstructionSet(CPUVectorInstructionSet::None);
+        SMatrix cScalar(rows, cols), rScalar(1, cols);
+        compute(op, cScalar, rScalar);
+        LimitCPUVectorInstructionSet(instructionSet);
+
+        // elementwise results are bit-identical; reductions are summed in a different order
+        BOOST_CHECK(c.IsEqualTo(cScalar, 0));
+        BOOST_CHECK(r.IsEqualTo(rScalar, c_epsilonFloatE4));
+    }
+}
+
+// the approximations of the transcendental ops are only used in an enabled scope, and are close to the exact ops
+BOOST_FIXTURE_TEST_CASE(CPUMatrixTensorOpApproximateMath, RandomSeedFixture)
+{
+    const size_t n = 1001;
+    SMatrix a = SMatrix::RandomUniform(n, 1, -20, 20, IncrementCounter());
+    SMatrix positive = SMatrix::RandomUniform(n, 1, 1e-6f, 1e6f, IncrementCounter());
+
+    const SmallVector<size_t> opDims{ n };
+    const SmallVector<ptrdiff_t> unitStrides{ 1 };
+    const std::array<SmallVector<ptrdiff_t>, 2> regularStrides = { unitStrides, unitStrides };
+    const std::array<SmallVector<ptrdiff_t>, 2> noStrides;
+    auto compute = [&](ElementWiseOperator op, const SMatrix& input, SMatrix& c)
+    {
+        c.TensorOp(0, input, 1, op, ElementWiseOperator::opSum, std::array<size_t, 2>{ 0, 0 }, opDims, regularStrides, SmallVector<size_t>(), noStrides);
+    };
+
+    for (auto op : { ElementWiseOperator::opExp, ElementWiseOperator::opLog, ElementWiseOperator::opSigmoid, ElementWiseOperator::opTanh })
+    {
+        const SMatrix& input = op == ElementWiseOperator::opLog ? positive : a;
+        SMatrix exact(n, 1), approximate(n, 1), outside(n, 1);
+        compute(op, input, exact);
+        {
+            CPUApproximateMathScope scope(true);
+            BOOST_CHECK(IsCPUApproximateMathEnabled());
+            compute(op, input, approximate);
+        }
+        BOOST_CHECK(!IsCPUApproximateMathEnabled());
+        compute(op, input, outside);
+
+        BOOST_CHECK(outside.IsEqualTo(exact, 0));
+        for (size_t i = 0; i < n; i++)
+        {
+            const float tolerance = 2e-6f * std::max(fabs(exact(i, 0)), 1e-30f);
+            BOOST_CHECK_SMALL(approximate(i, 0) - exact(i, 0), tolerance);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixNumaPlacement, RandomSeedFixture)
+{
+    // large enough to be placed according to the policy
+    const size_t rows = 1024, cols = 513;
+    for (auto policy : { NumaPolicy::firstTouch, NumaPolicy::interleave })
+    {
+        CPUNumaPlacement::SetPolicy(policy);
+        SMatrix m(rows, cols);
+        CPUNumaPlacement::SetPolicy(NumaPolicy::none);
+        BOOST_CHECK_EQUAL(m.SumOfAbsElements(), 0);
+
+        m.SetValue(2);
+        BOOST_CHECK_EQUAL(m.SumOfElements(), 2.0f * rows * cols);
+    }
+
+    BOOST_CHECK(CPUNumaPlacement::Parse(L"FirstTouch") == NumaPolicy::firstTouch);
+    BOOST_CHECK_THROW(CPUNumaPlacement::Parse(L"local"), std::invalid_argument);
+    BOOST_CHECK(!CPUNumaPlacement::BindThreadsToNode(CPUNumaPlacement::GetNumNodes()));
+}
+
+BOOST_AUTO_TEST_CASE(CPUThreadPoolParallelFor)
+{
+    const size_t numThreads = CPUThreadPool::GetNumThreads();
+    CPUThreadPool::SetNumThreads(4);
+
+    // every iteration runs exactly once, also with loops nested inside of the chunks
+    const int64_t n = 1000;
+    std::vector<std::atomic<int>> counts(n * n);
+    for (auto& count : counts)
+        count = 0;
+    CPUThreadPool::ParallelFor(0, n, CPUThreadPool::MinWorkPerChunk, [&](int64_t i)
+    {
+        CPUThreadPool::ParallelFor(0, n, CPUThreadPool::MinWorkPerChunk, [&](int64_t j)
+        {
+            counts[i * n + j]++;
+        });
+    });
+    BOOST_CHECK(std::all_of(counts.begin(), counts.end(), [](const std::atomic<int>& count) { return count == 1; }));
+
+    // exceptions are passed on to the caller
+    BOOST_CHECK_THROW(CPUThreadPool::ParallelFor(0, n, CPUThreadPool::MinWorkPerChunk, [](int64_t i)
+    {
+        if (i == 500)
+            RuntimeError("iteration %d failed", (int) i);
+    }), std::runtime_error);
+
+    // the pool is still usable after an exception and after changing its size
+    CPUThreadPool::SetNumThreads(2);
+    std::atomic<int64_t> sum(0);
+    CPUThreadPool::ParallelFor(0, n, CPUThreadPool::MinWorkPerChunk, [&](int64_t i) { sum += i; });
+    BOOST_CHECK_EQUAL(sum, n * (n - 1) / 2);
+
+    CPUThreadPool::SetNumThreads(numThreads);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
@@ -0,0 +1,208 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include "../../../Source/Math/Matrix.h"
+#include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/GPUMatrix.h"
+#include "common.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// Two parallel sequences over 4 time steps: stream 0 holds a sequence of 2 frames and one of 2,
+// stream 1 one of 3 frames and a gap.
+static const size_t numLabels = 3;
+static const size_t numParallelSequences = 2;
+static const size_t numTimeSteps = 4;
+static const size_t numCols = numParallelSequences * numTimeSteps;
+static const size_t gapCol = 3 * numParallelSequences + 1;
+static std::vector<SequenceInMinibatch> GetTestSequences()
+{
+    return { {0, 0, 2}, {0, 2, 4}, {1, 0, 3} };
+}
+
+struct CRFTestData
+{
+    DoubleMatrix lbls;
+    DoubleMatrix pos;
+    DoubleMatrix pair;
+    std::vector<size_t> labelOf; // label of each column, unused for the gap
+
+    CRFTestData(std::mt19937& rng)
+        : lbls(numLabels, numCols, -1), pos(numLabels, numCols, -1), pair(numLabels, numLabels, -1), labelOf(numCols)
+    {
+        std::uniform_real_distribution<double> ud(-2, 2);
+        for (size_t c = 0; c < numCols; c++)
+        {
+            labelOf[c] = rng() % numLabels;
+            for (size_t k = 0; k < numLabels; k++)
+            {
+                lbls(k, c) = (c != gapCol && k == labelOf[c]) ? 1 : 0;
+                pos(k, c) = c == gapCol ? std::numeric_limits<double>::quiet_NaN() : ud(rng); // the gap must not matter
+            }
+        }
+        for (size_t i = 0; i < numLabels * numLabels; i++)
+            pair(i % numLabels, i / numLabels) = ud(rng);
+    }
+
+    // calls f(path, score) for all label paths of the sequence, where score includes the transition from the first
+    // label into the first frame, as the forward algorithm does
+    template <class F>
+    void ForAllPaths(const SequenceInMinibatch& seq, F f) const
+    {
+        const size_t len = seq.tEnd - seq.tBegin;
+        const size_t firstLabel = labelOf[seq.tBegin * numParallelSequences + seq.s];
+        size_t numPaths = 1;
+        for (size_t t = 0; t < len; t++)
+            numPaths *= numLabels;
+        std::vector<size_t> path(len);
+        for (size_t p = 0; p < numPaths; p++)
+        {
+            double score = 0;
+            for (size_t t = 0, q = p; t < len; t++, q /= numLabels)
+            {
+                path[t] = q % numLabels;
+                score += pos(path[t], (seq.tBegin + t) * numParallelSequences + seq.s) + pair(path[t], t == 0 ? firstLabel : path[t - 1]);
+            }
+            f(path, score);
+        }
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(CRFSuite)
+
+// Compares the forward-backward results and the transition gradient with brute-force enumeration of all label paths.
+BOOST_AUTO_TEST_CASE(CRFForwardBackwardCPU)
+{
+    std::mt19937 rng(0);
+    CRFTestData d(rng);
+    DoubleMatrix alpha(-1), beta(-1), postProb(-1), sequenceScores(-1);
+    DoubleMatrix::CRFForwardBackward(d.lbls, d.pos, d.pair, numParallelSequences, GetTestSequences(), alpha, beta, postProb, sequenceScores);
+    DoubleMatrix grd(numLabels, numLabels, -1);
+    grd.SetValue(0);
+    DoubleMatrix::CRFTransitionGradient(d.lbls, d.pos, d.pair, numParallelSequences, GetTestSequences(), alpha, beta, grd);
+
+    BOOST_REQUIRE_EQUAL(sequenceScores.GetNumCols(), GetTestSequences().size());
+    for (size_t k = 0; k < numLabels; k++)
+        BOOST_CHECK_EQUAL(postProb(k, gapCol), 0);
+
+    std::vector<double> expectedGrd(numLabels * numLabels, 0);
+    const auto sequences = GetTestSequences();
+    for (size_t q = 0; q < sequences.size(); q++)
+    {
+        const auto& seq = sequences[q];
+        const size_t len = seq.tEnd - seq.tBegin;
+        auto col = [&](size_t t) { return (seq.tBegin + t) * numParallelSequences + seq.s; };
+
+        double z = 0;
+        d.ForAllPaths(seq, [&](const std::vector<size_t>&, double score) { z += exp(score); });
+        std::vector<double> marginals(numLabels * len, 0);
+        d.ForAllPaths(seq, [&](const std::vector<size_t>& path, double score)
+        {
+            double p = exp(score) / z;
+            for (size_t t = 0; t < len; t++)
+            {
+                marginals[t * numLabels + path[t]] += p;
+                expectedGrd[path[t] + numLabels * (t == 0 ? d.labelOf[col(0)] : path[t - 1])] += p;
+            }
+        });
+
+        double labelScore = 0;
+        for (size_t t = 0; t < len; t++)
+        {
+            labelScore += d.pos(d.labelOf[col(t)], col(t)) + d.pair(d.labelOf[col(t)], d.labelOf[col(t == 0 ? 0 : t - 1)]);
+            expectedGrd[d.labelOf[col(t)] + numLabels * d.labelOf[col(t == 0 ? 0 : t - 1)]] -= 1;
+        }
+        BOOST_CHECK_MESSAGE(AreEqual(sequenceScores(0, q), log(z) - labelScore, 1e-10, 1e-12),
+                            "sequence score " << q << " = " << sequenceScores(0, q) << ", expected " << log(z) - labelScore);
+
+        for (size_t t = 0; t < len; t++)
+            for (size_t k = 0; k < numLabels; k++)
+                BOOST_CHECK_MESSAGE(AreEqual(postProb(k, col(t)), marginals[t * numLabels + k], 1e-10, 1e-12),
+                                    "posterior of label " << k << " at column " << col(t) << " = " << postProb(k, col(t)) << ", expected " << marginals[t * numLabels + k]);
+    }
+
+    for (size_t i = 0; i < numLabels * numLabels; i++)
+        BOOST_CHECK_MESSAGE(AreEqual(grd(i % numLabels, i / numLabels), expectedGrd[i], 1e-10, 1e-12),
+                            "transition gradient [" << i << "] = " << grd(i % numLabels, i / numLabels) << ", expected " << expectedGrd[i]);
+}
+
+// The decoded path is the best path that starts with the label of the first frame and ends with the label of the last.
+BOOST_AUTO_TEST_CASE(CRFViterbiDecodeCPU)
+{
+    std::mt19937 rng(1);
+    CRFTestData d(rng);
+    DoubleMatrix alpha(-1), backtrace(-1), decodedPath(-1);
+    DoubleMatrix::CRFViterbiDecode(d.lbls, d.pos, d.pair, numParallelSequences, GetTestSequences(), alpha, backtrace, decodedPath);
+
+    for (size_t k = 0; k < numLabels; k++)
+        BOOST_CHECK_EQUAL(decodedPath(k, gapCol), 0);
+
+    for (const auto& seq : GetTestSequences())
+    {
+        const size_t len = seq.tEnd - seq.tBegin;
+        auto col = [&](size_t t) { return (seq.tBegin + t) * numParallelSequences + seq.s; };
+
+        double bestScore = -std::numeric_limits<double>::infinity();
+        std::vector<size_t> bestPath;
+        d.ForAllPaths(seq, [&](const std::vector<size_t>& path, double score)
+        {
+            if (path[0] != d.labelOf[col(0)] || path[len - 1] != d.labelOf[col(len - 1)])
+                return;
+            score -= d.pair(path[0], d.labelOf[col(0)]); // Viterbi does not score the transition into the first frame
+            if (score > bestScore)
+            {
+                bestScore = score;
+                bestPath = path;
+            }
+        });
+
+        for (size_t t = 0; t < len; t++)
+            for (size_t k = 0; k < numLabels; k++)
+                BOOST_CHECK_MESSAGE(decodedPath(k, col(t)) == (k == bestPath[t] ? 1 : 0),
+                                    "decoded path at column " << col(t) << " differs from the best path, which has label " << bestPath[t]);
+    }
+}
+
+// The GPU computes the same as the CPU.
+BOOST_AUTO_TEST_CASE(CRFGPU)
+{
+    std::mt19937 rng(2);
+    CRFTestData d(rng);
+    const DEVICEID_TYPE deviceId = 0;
+    DoubleMatrix lblsB(d.lbls.DeepClone(), deviceId);
+    DoubleMatrix posB(d.pos.DeepClone(), deviceId);
+    DoubleMatrix pairB(d.pair.DeepClone(), deviceId);
+
+    DoubleMatrix alpha(-1), beta(-1), postProb(-1), sequenceScores(-1);
+    DoubleMatrix alphaB(deviceId), betaB(deviceId), postProbB(deviceId), sequenceScoresB(deviceId);
+    DoubleMatrix::CRFForwardBackward(d.lbls, d.pos, d.pair, numParallelSequences, GetTestSequences(), alpha, beta, postProb, sequenceScores);
+    DoubleMatrix::CRFForwardBackward(lblsB, posB, pairB, numParallelSequences, GetTestSequences(), alphaB, betaB, postProbB, sequenceScoresB);
+
+    DoubleMatrix grd(numLabels, numLabels, -1);
+    grd.SetValue(0);
+    DoubleMatrix grdB(numLabels, numLabels, deviceId);
+    grdB.SetValue(0);
+    DoubleMatrix::CRFTransitionGradient(d.lbls, d.pos, d.pair, numParallelSequences, GetTestSequences(), alpha, beta, grd);
+    DoubleMatrix::CRFTransitionGradient(lblsB, posB, pairB, numParallelSequences, GetTestSequences(), alphaB, betaB, grdB);
+
+    DoubleMatrix backtrace(-1), decodedPath(-1);
+    DoubleMatrix backtraceB(deviceId), decodedPathB(deviceId);
+    DoubleMatrix::CRFViterbiDecode(d.lbls, d.pos, d.pair, numParallelSequences, GetTestSequences(), alpha, backtrace, decodedPath);
+    DoubleMatrix::CRFViterbiDecode(lblsB, posB, pairB, numParallelSequences, GetTestSequences(), alphaB, backtraceB, decodedPathB);
+
+    std::string emsg;
+    BOOST_REQUIRE_MESSAGE(CheckEqual(postProb, DoubleMatrix(postProbB.DeepClone(), -1), emsg, 1e-10, 1e-12), "postProb are not equal. " << emsg);
+    BOOST_REQUIRE_MESSAGE(CheckEqual(sequenceScores, DoubleMatrix(sequenceScoresB.DeepClone(), -1), emsg, 1e-10, 1e-12), "sequenceScores are not equal. " << emsg);
+    BOOST_REQUIRE_MESSAGE(CheckEqual(grd, DoubleMatrix(grdB.DeepClone(), -1), emsg, 1e-10, 1e-12), "grd are not equal. " << emsg);
+    BOOST_REQUIRE_MESSAGE(CheckEqual(decodedPath, DoubleMatrix(decodedPathB.DeepClone(), -1), emsg, 0.0, 0.0), "decodedPath are not equal. " << emsg);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
@@ -12,6 +12,7 @@
 #include "../../../Source/Math/GPUMatrix.h"
 #include "../../../Source/Math/ConvolutionEngine.h"
 #include "../../../Source/Math/CuDnnFactories.h"
+#include "../../../Source/Math/CuDnnAlgorithmCache.h"
 #include "common.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
@@ -59,6 +60,19 @@ std::vector<std::tuple<ConvolutionEngineKind, DEVICEID_TYPE, size_t>> GetTestEng
     res.push_back(std::make_tuple(ConvolutionEngineKind::Gemm, -1, 0));
     res.push_back(std::make_tuple(ConvolutionEngineKind::Gemm, -1, 1));
     res.push_back(std::make_tuple(ConvolutionEngineKind::Gemm, -1, 3));
+
+    // Direct engine. CPU only, does not use temp memory for 2D geometries but falls back to Gemm for the others.
+    res.push_back(std::make_tuple(ConvolutionEngineKind::Direct, -1, 0));
+    res.push_back(std::make_tuple(ConvolutionEngineKind::Direct, -1, 1));
+    return res;
+}
+
+std::vector<std::tuple<ConvolutionEngineKind, DEVICEID_TYPE>> GetTestPoolEngineConfigs()
+{
+    std::vector<std::tuple<ConvolutionEngineKind, DEVICEID_TYPE>> res;
+    res.push_back(std::make_tuple(ConvolutionEngineKind::Reference, -1));
+    res.push_back(std::make_tuple(ConvolutionEngineKind::Reference, 0));
+    res.push_back(std::make_tuple(ConvolutionEngineKind::Direct, -1));
     return res;
 }
 
@@ -384,11 +398,12 @@ BOOST_AUTO_TEST_CASE(PoolingForward)
     };
 
     int baseDeviceId = 0;
-    auto engKind = ConvolutionEngineKind::Reference;
     for (auto kind : {PoolKind::Max, PoolKind::Average})
     {
-        for (int deviceId : {-1, 0})
+        for (const auto& engCfg : GetTestPoolEngineConfigs())
         {
+            auto engKind = std::get<0>(engCfg);
+            auto deviceId = std::get<1>(engCfg);
             for (const auto& g : GeneratePoolTestConfigs())
             {
                 auto baseEng = ConvEng::Create(g, baseDeviceId, ImageLayoutKind::CHW, 0, kind, ConvolutionEngineKind::CuDnn);
@@ -444,11 +459,12 @@ BOOST_AUTO_TEST_CASE(PoolingBackward)
     };
 
     int baseDeviceId = 0;
-    auto engKind = ConvolutionEngineKind::Reference;
     for (auto kind : {PoolKind::Max, PoolKind::Average})
     {
-        for (int deviceId : {-1, 0})
+        for (const auto& engCfg : GetTestPoolEngineConfigs())
         {
+            auto engKind = std::get<0>(engCfg);
+            auto deviceId = std::get<1>(engCfg);
             for (const auto& g : GeneratePoolTestConfigs())
             {
                 auto baseEng = ConvEng::Create(g, baseDeviceId, ImageLayoutKind::CHW, 0, kind, ConvolutionEngineKind::CuDnn);
@@ -580,6 +596,108 @@ BOOST_AUTO_TEST_CASE(MaxUnpooling)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ConvolutionForwardInt8)
+{
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<> batchSizeG(1, 8);
+    std::normal_distribution<float> nd;
+
+    int deviceId = -1;
+    for (auto engKind : {ConvolutionEngineKind::Gemm, ConvolutionEngineKind::Direct})
+    {
+        for (size_t maxTempMem : {0, 1})
+        {
+            for (const auto& g : GenerateConvTestConfigs())
+            {
+                auto eng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, maxTempMem, PoolKind::None, engKind);
+                BOOST_REQUIRE(eng->SupportsInt8Forward());
+
+                size_t n = batchSizeG(rng);
+                vec buf(g->InputShape().GetNumElements() * n);
+                std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+                SingleMatrix in(g->InputShape().GetNumElements(), n, buf.data(), deviceId, matrixFlagNormal);
+
+                size_t mapCount = g->GetMapCount(g->InputShape().GetRank() - 1);
+                buf.resize(g->KernelShape().GetNumElements() * mapCount);
+                std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+                SingleMatrix kernel(mapCount, g->KernelShape().GetNumElements(), buf.data(), deviceId, matrixFlagNormal);
+                // weights are a row-major [mapCount x kernel size] matrix
+                Int8QuantizedMatrix<float> kernelInt8;
+                kernelInt8.Quantize(kernel, kernel.GetNumRows(), kernel.GetNumCols(), /*transpose=*/true);
+
+                size_t crowOut = g->OutputShape().GetNumElements();
+                SingleMatrix out(crowOut, n, deviceId);
+                SingleMatrix outRef(crowOut, n, deviceId);
+                SingleMatrix workspace(deviceId);
+                eng->ForwardInt8(in, kernelInt8, out, workspace);
+                eng->Forward(in, kernel, outRef, workspace);
+
+                // Quantization adds an error of about 1% of the output range.
+                float range = std::max(outRef.MatrixNormInf(), 1e-3f);
+                SingleMatrix diff(outRef.DeepClone(), deviceId);
+                diff -= out;
+                BOOST_REQUIRE_MESSAGE(diff.MatrixNormInf() <= 0.03f * range,
+                                      "Geometry: " << (std::string)(*g) << ", Batch: " << n << ", MaxTempMem: " << maxTempMem
+                                      << ", diff: " << diff.MatrixNormInf() << ", range: " << range);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CuDnnAlgorithmCacheRoundTrip)
+{
+    // keys are unique to this test, since the cache is process-wide
+    CuDnnAlgorithmCacheEntry fwd = { 1, 4096, 0 };
+    CuDnnAlgorithmCache::Add("test fwd gpu=Some GPU batch=32", fwd);
+
+    // entries of another rank, with a comment and a malformed line that are skipped
+    CuDnnAlgorithmCache::Deserialize("# comment\n5 0 5 test bwdData gpu=Some GPU batch=32\nnot an entry\n");
+
+    // the file written by the main node, read back as another process would
+    std::wstring fileName(L"CuDnnAlgorithmCache.txt");
+    if (fexists(fileName))
+        _wunlink(fileName.c_str());
+    CuDnnAlgorithmCache::Open(fileName, /*writable=*/true);
+    CuDnnAlgorithmCacheEntry bwdFilter = { 3, 12345678, 1 };
+    CuDnnAlgorithmCache::Add("test bwdFilter gpu=Some GPU batch=64", bwdFilter);
+    FILE* f = fopenOrDie(fileName, L"rb");
+    std::string contents = fgetline(f); // header
+    contents = fgetline(f);
+    fclose(f);
+    BOOST_CHECK_EQUAL(contents, "3 12345678 1 test bwdFilter gpu=Some GPU batch=64");
+
+    std::string serialized = CuDnnAlgorithmCache::Serialize();
+    BOOST_CHECK(serialized.find("1 4096 0 test fwd gpu=Some GPU batch=32\n") != std::string::npos);
+    CuDnnAlgorithmCache::Deserialize(serialized);
+
+    CuDnnAlgorithmCacheEntry found;
+    BOOST_REQUIRE(CuDnnAlgorithmCache::Find("test bwdData gpu=Some GPU batch=32", found));
+    BOOST_CHECK_EQUAL(found.algo, 5);
+    BOOST_CHECK_EQUAL(found.memory, 0);
+    BOOST_CHECK_EQUAL(found.noWorkspaceAlgo, 5);
+    BOOST_REQUIRE(CuDnnAlgorithmCache::Find("test bwdFilter gpu=Some GPU batch=64", found));
+    BOOST_CHECK_EQUAL(found.memory, 12345678);
+    BOOST_CHECK(!CuDnnAlgorithmCache::Find("test fwd gpu=Some GPU batch=64", found));
+}
+
+BOOST_AUTO_TEST_CASE(ConvolveGeometrySharing)
+{
+    auto get = [](size_t mapCount)
+    {
+        return ConvolveGeometry::Get(TensorShape(16, 16, 2), TensorShape(3, 3, 2), TensorShape(mapCount), TensorShape(1),
+                                     ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true, true, false},
+                                     TensorShape(0), TensorShape(0));
+    };
+    auto g1 = get(4);
+    auto g2 = get(4);
+    auto g3 = get(8);
+    BOOST_CHECK(g1 == g2);
+    BOOST_CHECK(g1 != g3);
+    BOOST_CHECK_EQUAL((std::string)(*g1), (std::string)(*std::make_shared<ConvolveGeometry>(TensorShape(16, 16, 2),
+        TensorShape(3, 3, 2), TensorShape(4), TensorShape(1), ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true, true, false},
+        TensorShape(0), TensorShape(0))));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
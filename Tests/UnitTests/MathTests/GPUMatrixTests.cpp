@@ -537,6 +537,121 @@ BOOST_FIXTURE_TEST_CASE(GPUMatrixCurandSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+BOOST_FIXTURE_TEST_CASE(GPUMatrixMemoryCacheReuse, RandomSeedFixture)
+{
+    TracingGPUMemoryAllocator::ReleaseCachedMemory(c_deviceIdZero);
+    const auto before = TracingGPUMemoryAllocator::GetCacheStatistics(c_deviceIdZero);
+    {
+        GPUMatrix<float> m0(123, 45, c_deviceIdZero);
+    }
+    {
+        // slightly different size within the same size class must be served from the cache
+        GPUMatrix<float> m1(124, 45, c_deviceIdZero);
+        const auto during = TracingGPUMemoryAllocator::GetCacheStatistics(c_deviceIdZero);
+        BOOST_CHECK_EQUAL(before.numMisses + 1, during.numMisses);
+        BOOST_CHECK_EQUAL(before.numHits + 1, during.numHits);
+    }
+    const auto after = TracingGPUMemoryAllocator::GetCacheStatistics(c_deviceIdZero);
+    BOOST_CHECK_EQUAL(1, after.numCachedBuffers);
+
+    TracingGPUMemoryAllocator::ReleaseCachedMemory(c_deviceIdZero);
+    BOOST_CHECK_EQUAL(0, TracingGPUMemoryAllocator::GetCacheStatistics(c_deviceIdZero).numCachedBuffers);
+    BOOST_CHECK_EQUAL(0, TracingGPUMemoryAllocator::GetCacheStatistics(c_deviceIdZero).cachedBytes);
+}
+
+BOOST_FIXTURE_TEST_CASE(GPUMatrixMemoryCachePeakInUse, RandomSeedFixture)
+{
+    TracingGPUMemoryAllocator::ReleaseCachedMemory(c_deviceIdZero);
+    TracingGPUMemoryAllocator::ResetPeakInUseBytes(c_deviceIdZero);
+    const auto before = TracingGPUMemoryAllocator::GetCacheStatistics(c_deviceIdZero);
+    {
+        GPUMatrix<float> m0(256, 256, c_deviceIdZero);
+        GPUMatrix<float> m1(256, 256, c_deviceIdZero);
+    }
+    // the freed buffers are no longer in use, but the high-water mark remembers them
+    const auto after = TracingGPUMemoryAllocator::GetCacheStatistics(c_deviceIdZero);
+    BOOST_CHECK_EQUAL(before.allocatedBytes - before.cachedBytes, after.allocatedBytes - after.cachedBytes);
+    BOOST_CHECK_EQUAL(before.peakInUseBytes + 2 * 256 * 256 * sizeof(float), after.peakInUseBytes);
+
+    TracingGPUMemoryAllocator::ResetPeakInUseBytes(c_deviceIdZero);
+    BOOST_CHECK_EQUAL(after.allocatedBytes - after.cachedBytes, TracingGPUMemoryAllocator::GetCacheStatistics(c_deviceIdZero).peakInUseBytes);
+}
+
+BOOST_FIXTURE_TEST_CASE(GPUMatrixHalfPrecisionMultiply, RandomSeedFixture)
+{
+    GPUMatrix<float> a = GPUMatrix<float>::RandomUniform(64, 128, c_deviceIdZero, -1, 1, IncrementCounter());
+    GPUMatrix<float> b = GPUMatrix<float>::RandomUniform(32, 128, c_deviceIdZero, -1, 1, IncrementCounter());
+    GPUMatrix<float> c(c_deviceIdZero);
+    GPUMatrix<float> cHalf(c_deviceIdZero);
+
+    GPUMatrix<float>::Multiply(a, false, b, true, c);
+    GPUHalfPrecision::SetHalfPrecisionGEMM(true);
+    GPUMatrix<float>::Multiply(a, false, b, true, cHalf);
+    GPUHalfPrecision::SetHalfPrecisionGEMM(false);
+
+    // operands are rounded to 11 bits of mantissa, the 128 products are accumulated in FP32
+    BOOST_CHECK_EQUAL(cHalf.GetNumRows(), 64);
+    BOOST_CHECK_EQUAL(cHalf.GetNumCols(), 32);
+    BOOST_CHECK(cHalf.IsEqualTo(c, c_epsilonFloatE1));
+}
+
+BOOST_FIXTURE_TEST_CASE(GPUMatrixConcurrentStreams, RandomSeedFixture)
+{
+    GPUMatrix<float> a = GPUMatrix<float>::RandomUniform(256, 512, c_deviceIdZero, -1, 1, IncrementCounter());
+    GPUMatrix<float> b = GPUMatrix<float>::RandomUniform(128, 512, c_deviceIdZero, -1, 1, IncrementCounter());
+
+    // reference on the default stream
+    GPUMatrix<float> expected(c_deviceIdZero);
+    GPUMatrix<float>::Multiply(a, false, b, true, expected);
+    expected.InplaceSigmoid();
+
+    // product on one stream, sigmoid of it on another one that waits for it
+    GPUStream stream1(c_deviceIdZero);
+    GPUStream stream2(c_deviceIdZero);
+    GPUEvent productDone(c_deviceIdZero);
+    GPUMatrix<float> product(c_deviceIdZero);
+    GPUMatrix<float> actual(c_deviceIdZero);
+
+    stream1.MakeCurrent();
+    GPUMatrix<float>::Multiply(a, false, b, true, product);
+    productDone.Record();
+
+    stream2.MakeCurrent();
+    productDone.MakeCurrentStreamWait();
+    actual.AssignSigmoidOf(product);
+    stream2.Synchronize();
+
+    GPUStream::MakeDefaultCurrent();
+    BOOST_CHECK(actual.IsEqualTo(expected, c_epsilonFloatE5));
+}
+
+BOOST_FIXTURE_TEST_CASE(GPUMatrixPrefetchDataTransferer, RandomSeedFixture)
+{
+    const size_t numRows = 64;
+    PrefetchGPUDataTransferer transferer(c_deviceIdZero);
+
+    // more batches than pinned buffers, and growing sizes, so that both the ring and the device buffers get reused and reallocated
+    for (size_t batch = 0; batch < 5; batch++)
+    {
+        size_t numCols = 10 + 20 * batch;
+        GPUMatrix<float> source = GPUMatrix<float>::RandomUniform(numRows, numCols, c_deviceIdZero, -1, 1, IncrementCounter());
+        unique_ptr<float[]> expected(source.CopyToArray());
+
+        transferer.BeginBatch();
+        const void* deviceData = transferer.CopyCPUToGPUAsync(0, expected.get(), numRows * numCols * sizeof(float));
+        transferer.EndBatch();
+
+        transferer.WaitForCopyCPUToGPUAsync();
+        GPUMatrix<float> actual(c_deviceIdZero);
+        actual.SetValue(numRows, numCols, c_deviceIdZero, (float*) deviceData, matrixFlagSetValueOnDevice);
+        transferer.RecordBuffersConsumed();
+
+        unique_ptr<float[]> result(actual.CopyToArray());
+        for (size_t i = 0; i < numRows * numCols; i++)
+            BOOST_CHECK_EQUAL(result[i], expected[i]);
+    }
+}
+
 #if 0 // Temporarily disabling
 BOOST_FIXTURE_TEST_CASE(GPUMatrixLargeInequality, RandomSeedFixture)
 {
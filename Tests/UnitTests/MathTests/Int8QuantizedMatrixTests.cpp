@@ -0,0 +1,87 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include <algorithm>
+#include <random>
+#include "../../../Source/Math/Int8QuantizedMatrix.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// Quantization adds an error of about 1% of the result range for normal distributed inputs.
+static bool CheckInt8Product(const SingleMatrix& c, const SingleMatrix& cRef, float tolerance, std::string& emsg)
+{
+    SingleMatrix diff(cRef.DeepClone(), cRef.GetDeviceId());
+    diff -= c;
+    float range = cRef.MatrixNormInf();
+    if (diff.MatrixNormInf() <= tolerance * range)
+        return true;
+    std::stringstream msg;
+    msg << "Max difference " << diff.MatrixNormInf() << ", range " << range;
+    emsg = msg.str();
+    return false;
+}
+
+BOOST_AUTO_TEST_SUITE(Int8QuantizedMatrixSuite)
+
+BOOST_AUTO_TEST_CASE(Int8QuantizedMatrixMultiply)
+{
+    std::mt19937 rng(0);
+    std::normal_distribution<float> nd;
+    const int deviceId = CPUDEVICE;
+
+    for (bool transpose : {false, true})
+    {
+        for (size_t calibrationMinibatches : {0, 1})
+        {
+            size_t rows = 37, cols = 200, numCols = 70;
+            std::vector<float> buf(rows * cols);
+            std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+            SingleMatrix a(transpose ? cols : rows, transpose ? rows : cols, buf.data(), deviceId, matrixFlagNormal);
+            buf.resize(cols * numCols);
+            std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+            SingleMatrix b(cols, numCols, buf.data(), deviceId, matrixFlagNormal);
+
+            SingleMatrix cRef(rows, numCols, deviceId);
+            SingleMatrix::Multiply(a, transpose, b, false, cRef);
+
+            Int8QuantizedMatrix<float> aq(calibrationMinibatches);
+            aq.Quantize(a, rows, cols, transpose);
+            BOOST_REQUIRE(aq.IsQuantized());
+            BOOST_REQUIRE_EQUAL(aq.IsCalibrating(), calibrationMinibatches > 0);
+            if (calibrationMinibatches > 0)
+                aq.Calibrate(b);
+            BOOST_REQUIRE(!aq.IsCalibrating());
+
+            SingleMatrix c(rows, numCols, deviceId);
+            aq.Multiply(b, c);
+            std::string emsg;
+            BOOST_REQUIRE_MESSAGE(CheckInt8Product(c, cRef, 0.03f, emsg), "Transpose: " << transpose << ", calibration: " << calibrationMinibatches << ". " << emsg);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Int8QuantizedMatrixCalibratedClipping)
+{
+    const int deviceId = CPUDEVICE;
+    std::vector<float> ones(4, 1.0f);
+    SingleMatrix a(1, 4, ones.data(), deviceId, matrixFlagNormal);
+    std::vector<float> calib{0.5f, -0.5f, 0.25f, 0};
+    SingleMatrix b(4, 1, calib.data(), deviceId, matrixFlagNormal);
+
+    Int8QuantizedMatrix<float> aq(1);
+    aq.Quantize(a, 1, 4, false);
+    aq.Calibrate(b);
+
+    // Values outside of the calibrated range [-0.5, 0.5] are clipped.
+    std::vector<float> input{2, 0.5f, -0.25f, 0};
+    SingleMatrix x(4, 1, input.data(), deviceId, matrixFlagNormal);
+    SingleMatrix c(1, 1, deviceId);
+    aq.Multiply(x, c);
+    BOOST_CHECK_CLOSE(c.Get00Element(), 0.75f, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -37,6 +37,47 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixFileWriteRead, RandomSeedFixture)
     BOOST_CHECK(matrixCpuCopy.IsEqualTo(matrixCpuRead, c_epsilonFloatE5));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixFileWriteReadBinary, RandomSeedFixture)
+{
+    CPUMatrix<float> matrixCpu = CPUMatrix<float>::RandomUniform(43, 10, -26.3f, 30.2f, IncrementCounter());
+    CPUMatrix<float> matrixCpuCopy = matrixCpu;
+
+    std::wstring fileNameCpu(L"MCPU.bin");
+    File fileCpu(fileNameCpu, fileOptionsBinary | fileOptionsReadWrite);
+
+    // the marker after the matrix must be found where the matrix elements end
+    fileCpu << matrixCpu << 42;
+    fileCpu.SetPosition(0);
+
+    CPUMatrix<float> matrixCpuRead(3, 2);
+    int marker;
+    fileCpu >> matrixCpuRead >> marker;
+
+    BOOST_CHECK_EQUAL(42, marker);
+    BOOST_CHECK(matrixCpuCopy.IsEqualTo(matrixCpuRead, 0));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixFileWriteReadMapped, RandomSeedFixture)
+{
+    CPUMatrix<float> matrixCpu = CPUMatrix<float>::RandomUniform(43, 10, -26.3f, 30.2f, IncrementCounter());
+    CPUMatrix<float> matrixCpuCopy = matrixCpu;
+
+    std::wstring fileNameCpu(L"MCPUMapped.bin");
+    {
+        File fileCpu(fileNameCpu, fileOptionsBinary | fileOptionsWrite | fileOptionsLargeBuffer);
+        fileCpu << matrixCpu << 42;
+    }
+
+    File fileCpu(fileNameCpu, fileOptionsBinary | fileOptionsRead | fileOptionsMemoryMapped);
+
+    CPUMatrix<float> matrixCpuRead(3, 2);
+    int marker;
+    fileCpu >> matrixCpuRead >> marker;
+
+    BOOST_CHECK_EQUAL(42, marker);
+    BOOST_CHECK(matrixCpuCopy.IsEqualTo(matrixCpuRead, 0));
+}
+
 BOOST_FIXTURE_TEST_CASE(MatrixFileWriteRead, RandomSeedFixture)
 {
     // Test Matrix in Dense mode
@@ -94,6 +135,27 @@ BOOST_FIXTURE_TEST_CASE(GPUMatrixFileWriteRead, RandomSeedFixture)
     BOOST_CHECK(matrixGpuCopy.IsEqualTo(matrixGpuRead, c_epsilonFloatE5));
 }
 
+BOOST_FIXTURE_TEST_CASE(GPUMatrixFileWriteReadMapped, RandomSeedFixture)
+{
+    GPUMatrix<float> matrixGpu = GPUMatrix<float>::RandomUniform(43, 10, c_deviceIdZero, -26.3f, 30.2f, IncrementCounter());
+    GPUMatrix<float> matrixGpuCopy = matrixGpu;
+
+    std::wstring filenameGpu(L"MGPUMapped.bin");
+    {
+        File fileGpu(filenameGpu, fileOptionsBinary | fileOptionsWrite | fileOptionsLargeBuffer);
+        fileGpu << matrixGpu << 42;
+    }
+
+    File fileGpu(filenameGpu, fileOptionsBinary | fileOptionsRead | fileOptionsMemoryMapped);
+
+    GPUMatrix<float> matrixGpuRead(c_deviceIdZero);
+    int marker;
+    fileGpu >> matrixGpuRead >> marker;
+
+    BOOST_CHECK_EQUAL(42, marker);
+    BOOST_CHECK(matrixGpuCopy.IsEqualTo(matrixGpuRead, 0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
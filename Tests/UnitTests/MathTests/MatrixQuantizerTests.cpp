@@ -462,6 +462,16 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrix1BitQuantizeDouble, RandomSeedFixture)
     TestQuantization<double>(CPUDEVICE, 100, 50, -0.5f, +0.5f, 2915, 5);
 }
 
+// large enough for the columns to be quantized in parallel
+BOOST_FIXTURE_TEST_CASE(CPUMatrixQuantizeLarge, RandomSeedFixture)
+{
+    RedirectStdErrAndStdOut(createDebugOut);
+
+    TestQuantization<float>(CPUDEVICE, 737, 373, -0.5f, +0.5f, 3015, 3);
+    TestQuantization<double>(CPUDEVICE, 737, 373, -0.5f, +0.5f, 3115, 3);
+    TestQuantization<float>(CPUDEVICE, 4, 8192, -1.0f, +1.0f, 3215, 3);
+}
+
 /*
         Original test cases were using these parameter:
 
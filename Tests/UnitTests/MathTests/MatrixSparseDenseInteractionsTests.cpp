@@ -125,6 +125,32 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparse, RandomSeedFixture)
     BOOST_CHECK(mD.IsEqualTo(mC, c_epsilonFloatE4));
 }
 
+// dimensions large enough to span several row blocks and output columns of the multithreaded kernels
+BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparseMultithreaded, RandomSeedFixture)
+{
+    const size_t rows = 2500, inner = 300, cols = 64;
+    Matrix<float> mAdense(CPUDEVICE);
+    mAdense.AssignTruncateBottomOf(Matrix<float>::RandomUniform(inner, cols, CPUDEVICE, -3.0f, 0.1f, IncrementCounter()), 0);
+    Matrix<float> mAsparse(mAdense.DeepClone());
+    mAsparse.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseCSC, true);
+
+    // lhs * A
+    Matrix<float> mB = Matrix<float>::RandomGaussian(rows, inner, CPUDEVICE, 1, 4, IncrementCounter());
+    Matrix<float> mC = Matrix<float>::RandomGaussian(rows, cols, CPUDEVICE, 1, 2, IncrementCounter());
+    Matrix<float> mD(mC.DeepClone());
+    Matrix<float>::MultiplyAndWeightedAdd(0.7f, mB, false, mAdense, false, 1.3f, mC);
+    Matrix<float>::MultiplyAndWeightedAdd(0.7f, mB, false, mAsparse, false, 1.3f, mD);
+    BOOST_CHECK(mD.IsEqualTo(mC, c_epsilonFloatE4));
+
+    // lhs * A'
+    Matrix<float> mE = Matrix<float>::RandomGaussian(rows, cols, CPUDEVICE, 1, 4, IncrementCounter());
+    Matrix<float> mF(rows, inner, CPUDEVICE);
+    Matrix<float> mG(rows, inner, CPUDEVICE);
+    Matrix<float>::MultiplyAndWeightedAdd(0.7f, mE, false, mAdense, true, 0.0f, mF);
+    Matrix<float>::MultiplyAndWeightedAdd(0.7f, mE, false, mAsparse, true, 0.0f, mG);
+    BOOST_CHECK(mG.IsEqualTo(mF, c_epsilonFloatE4));
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparseAsSparse, RandomSeedFixture)
 {
 #if 0
@@ -153,6 +179,84 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparseAsSparse, RandomSeedFixture)
 #endif
 }
 
+// the block-sparse gradient of an embedding: products accumulate into the blocks, and weight decay only touches them
+BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparseAsBlockSparseAccumulates, RandomSeedFixture)
+{
+    // few nonzeros in many rows, as for a large vocabulary
+    const size_t rows = 20, vocab = 20000, cols = 8;
+    Matrix<float> mEmbedding = Matrix<float>::RandomGaussian(rows, vocab, CPUDEVICE, 0, 1, IncrementCounter());
+    Matrix<float> mExpected(rows, vocab, CPUDEVICE);
+    mExpected.SetValue(0);
+    Matrix<float> mDblock(CPUDEVICE);
+    mDblock.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseBlockCol, false);
+    for (size_t i = 0; i < 2; i++)
+    {
+        Matrix<float> mAdense(CPUDEVICE);
+        mAdense.AssignTruncateBottomOf(Matrix<float>::RandomUniform(vocab, cols, CPUDEVICE, -30.0f, 0.1f, IncrementCounter()), 0);
+        Matrix<float> mAsparse(mAdense.DeepClone());
+        mAsparse.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseCSC, true);
+        Matrix<float> mB = Matrix<float>::RandomGaussian(rows, cols, CPUDEVICE, 1, 4, IncrementCounter());
+
+        Matrix<float>::MultiplyAndWeightedAdd(0.7f, mB, false, mAdense, true, 1.0f, mExpected);
+        Matrix<float>::MultiplyAndWeightedAdd(0.7f, mB, false, mAsparse, true, i == 0 ? 0.0f : 1.0f, mDblock);
+    }
+    Matrix<float> mDdense(rows, vocab, CPUDEVICE);
+    mDdense.SetValue(0);
+    Matrix<float>::ScaleAndAdd(1.0f, mDblock, mDdense);
+    BOOST_CHECK(mDdense.IsEqualTo(mExpected, c_epsilonFloatE4));
+
+    // decay of the columns in the blocks only
+    Matrix<float>::ScaleAndAddOnSparseBlocks(0.5f, mEmbedding, mDblock);
+    Matrix<float> mTouched(1, vocab, CPUDEVICE);
+    mTouched.AssignVectorNorm1Of(mExpected, true);
+    for (size_t j = 0; j < vocab; j++)
+    {
+        if (mTouched(0, j) != 0)
+        {
+            Matrix<float> expectedColumn = mExpected.ColumnSlice(j, 1);
+            Matrix<float>::ScaleAndAdd(0.5f, mEmbedding.ColumnSlice(j, 1), expectedColumn);
+        }
+    }
+    mDdense.SetValue(0);
+    Matrix<float>::ScaleAndAdd(1.0f, mDblock, mDdense);
+    BOOST_CHECK(mDdense.IsEqualTo(mExpected, c_epsilonFloatE4));
+}
+
+// the columns of a block-sparse matrix as exchanged by the gradient aggregation
+BOOST_FIXTURE_TEST_CASE(CPUMatrixSparseBlockColumnsRoundTrip, RandomSeedFixture)
+{
+    const size_t rows = 5, vocab = 1000;
+    std::vector<size_t> columnIds = { 3, 17, 999, 400 };
+    Matrix<float> mValues = Matrix<float>::RandomGaussian(rows, columnIds.size(), CPUDEVICE, 0, 1, IncrementCounter());
+    std::vector<float> values(mValues.Data(), mValues.Data() + mValues.GetNumElements());
+
+    Matrix<float> mBlock(CPUDEVICE);
+    mBlock.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseBlockCol, false);
+    mBlock.SetSparseBlockColumns(rows, vocab, columnIds, values);
+    BOOST_CHECK_EQUAL(mBlock.GetNumRows(), rows);
+    BOOST_CHECK_EQUAL(mBlock.GetNumCols(), vocab);
+
+    Matrix<float> mDense(rows, vocab, CPUDEVICE);
+    mDense.SetValue(0);
+    Matrix<float>::ScaleAndAdd(1.0f, mBlock, mDense);
+    Matrix<float> mTouched(1, vocab, CPUDEVICE);
+    mTouched.AssignVectorNorm1Of(mDense, true);
+    BOOST_CHECK_CLOSE(mTouched.SumOfElements(), mValues.SumOfAbsElements(), 1e-3); // nothing outside the blocks
+    for (size_t k = 0; k < columnIds.size(); k++)
+        BOOST_CHECK(mDense.ColumnSlice(columnIds[k], 1).IsEqualTo(mValues.ColumnSlice(k, 1), c_epsilonFloatE5));
+
+    std::vector<size_t> columnIdsBack;
+    std::vector<float> valuesBack;
+    mBlock.GetSparseBlockColumns(columnIdsBack, valuesBack);
+    BOOST_CHECK(columnIdsBack == columnIds);
+    BOOST_CHECK(valuesBack == values);
+
+    // no columns
+    mBlock.SetSparseBlockColumns(rows, vocab, {}, {});
+    mBlock.GetSparseBlockColumns(columnIdsBack, valuesBack);
+    BOOST_CHECK(columnIdsBack.empty() && valuesBack.empty());
+}
+
 BOOST_FIXTURE_TEST_CASE(MatrixSparseTimesSparse, RandomSeedFixture)
 {
     Matrix<float> mAdense(c_deviceIdZero);
@@ -6,6 +6,9 @@
 #include "../../../Source/Math/Matrix.h"
 #include "../../../Source/Math/CPUMatrix.h"
 #include "../../../Source/Math/Helpers.h"
+#include "../../../Source/Math/TensorView.h"
+#include "../../../Source/Common/Include/Float16.h"
+#include <map>
 
 #define IDX2C(i, j, ld) (((j) * (ld)) + (i)) // 0 based indexing
 
@@ -855,6 +858,36 @@ BOOST_FIXTURE_TEST_CASE(MatrixSumOfElements, RandomSeedFixture)
     BOOST_CHECK_EQUAL(-1 * 3 * 2, sum2);
 }
 
+BOOST_FIXTURE_TEST_CASE(MatrixExtractAbsAboveThreshold, RandomSeedFixture)
+{
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        std::array<float, 6> arr = {0.5f, -3, 1, 0, 2, -0.25f};
+        Matrix<float> m(2, 3, arr.data(), deviceId, matrixFlagNormal);
+
+        // capacity 0 only counts
+        std::array<int, 3> indices;
+        std::array<float, 3> values;
+        BOOST_CHECK_EQUAL(3, m.ExtractAbsAboveThreshold(1, 0, indices.data(), values.data()));
+        BOOST_CHECK(m.IsEqualTo(Matrix<float>(2, 3, arr.data(), deviceId, matrixFlagNormal)));
+
+        BOOST_CHECK_EQUAL(3, m.ExtractAbsAboveThreshold(1, 3, indices.data(), values.data()));
+        std::map<int, float> extracted;
+        for (size_t i = 0; i < indices.size(); i++)
+            extracted[indices[i]] = values[i];
+        BOOST_CHECK(extracted == (std::map<int, float>{{1, -3.0f}, {2, 1.0f}, {4, 2.0f}}));
+
+        std::array<float, 6> remaining = {0.5f, 0, 0, 0, 0, -0.25f};
+        BOOST_CHECK(m.IsEqualTo(Matrix<float>(2, 3, remaining.data(), deviceId, matrixFlagNormal)));
+
+        // entries that do not fit stay in place
+        BOOST_CHECK_EQUAL(2, m.ExtractAbsAboveThreshold(0.25f, 1, indices.data(), values.data()));
+        BOOST_CHECK_EQUAL(0, m.ExtractAbsAboveThreshold(0.75f, 1, indices.data(), values.data()));
+        BOOST_CHECK_EQUAL(1, m.ExtractAbsAboveThreshold(0.25f, 1, indices.data(), values.data()));
+        BOOST_CHECK_EQUAL(0, m.MatrixNormInf());
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(MatrixColumnSlice, RandomSeedFixture)
 {
     std::array<float, 6> arr = {1, 2, 3, 4, 5, 6};
@@ -1116,6 +1149,779 @@ BOOST_FIXTURE_TEST_CASE(MatrixAssignNumOfDiff, RandomSeedFixture)
         BOOST_CHECK_EQUAL(expectedDiff, actual.Get00Element());
     }
 }
+
+BOOST_FIXTURE_TEST_CASE(MatrixAssignNumOfTopKErrors, RandomSeedFixture)
+{
+    // Matrices are stored as column-major so below are 4x3 matrices.
+    // The label of the 1st column has the largest prediction, that of the 2nd the second largest,
+    // and that of the 3rd ties with a lower row and is below another, which makes it third.
+    float labels[] = {
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f};
+    float predictions[] = {
+        0.1f, 0.7f, 0.2f, 0.0f,
+        0.5f, 0.1f, 0.3f, 0.1f,
+        0.2f, 0.2f, 0.2f, 0.4f};
+    float classIndices[] = {1.0f, 2.0f, 1.0f};
+    float outOfRangeClassIndices[] = {1.0f, 7.0f, -1.0f};
+    char mask[] = {1, 0, 1};
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        Matrix<float> lbl(4, 3, labels, deviceId, matrixFlagNormal);
+        Matrix<float> pred(4, 3, predictions, deviceId, matrixFlagNormal);
+        Matrix<float> idx(1, 3, classIndices, deviceId, matrixFlagNormal);
+        Matrix<float> outOfRangeIdx(1, 3, outOfRangeClassIndices, deviceId, matrixFlagNormal);
+        Matrix<char> columnsMask(1, 3, mask, deviceId, matrixFlagNormal);
+
+        Matrix<float> actual(deviceId);
+        for (int topK = 1; topK <= 4; topK++)
+        {
+            float expected = (float) std::max(0, 3 - topK);
+            BOOST_CHECK_EQUAL(expected, actual.AssignNumOfTopKErrors(lbl, pred, topK, false).Get00Element());
+            BOOST_CHECK_EQUAL(expected, actual.AssignNumOfTopKErrors(idx, pred, topK, true).Get00Element());
+        }
+        BOOST_CHECK_EQUAL(1, actual.AssignNumOfTopKErrors(lbl, pred, 1, false, &columnsMask).Get00Element());
+        BOOST_CHECK_EQUAL(2, actual.AssignNumOfTopKErrors(outOfRangeIdx, pred, 1, true).Get00Element());
+        BOOST_CHECK_THROW(actual.AssignNumOfTopKErrors(lbl, pred, 0, false), std::exception);
+
+        // same count as the multi-pass arg max and comparison it replaces
+        const int numRows = 50, numCols = 64;
+        Matrix<float> randomPred = Matrix<float>::RandomUniform(numRows, numCols, deviceId, -1.0f, 1.0f, IncrementCounter());
+        Matrix<float> randomLbl = Matrix<float>::RandomUniform(numRows, numCols, deviceId, -1.0f, 1.0f, IncrementCounter());
+        Matrix<float> lblIdx(deviceId), predIdx(deviceId), maxValues(deviceId), expected(deviceId);
+        randomLbl.VectorMax(lblIdx, maxValues, true);
+        for (int topK : {1, 3})
+        {
+            randomPred.VectorMax(predIdx, maxValues, true, topK);
+            expected.AssignNumOfDiff(lblIdx, predIdx, topK > 1);
+            BOOST_CHECK_EQUAL(expected.Get00Element(), actual.AssignNumOfTopKErrors(randomLbl, randomPred, topK, false).Get00Element());
+            BOOST_CHECK_EQUAL(expected.Get00Element(), actual.AssignNumOfTopKErrors(lblIdx, randomPred, topK, true).Get00Element());
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixTopNHardmax, RandomSeedFixture)
+{
+    // Matrices are stored as column-major so below is 4x2 matrix; the second column has a tie.
+    float src[] = {
+        1.0f, 7.0f, 3.0f, 5.0f,
+        2.0f, 9.0f, 2.0f, 4.0f};
+
+    // 3 planes of 4 rows each per column: one-hot of the largest, the 2nd and the 3rd largest
+    float expected[] = {
+        0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f};
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        Matrix<float> exp(12, 2, expected, deviceId, matrixFlagNormal);
+        Matrix<float> input(4, 2, src, deviceId, matrixFlagNormal);
+        Matrix<float> actual(deviceId);
+
+        actual.AssignTopNHardmaxOf(input, 3);
+        BOOST_CHECK(actual.IsEqualTo(exp));
+
+        // n = 1 is the same as Hardmax
+        Matrix<float> hardmax(deviceId);
+        hardmax.SetValue(input);
+        hardmax.InplaceHardmax(true);
+        actual.AssignTopNHardmaxOf(input, 1);
+        BOOST_CHECK(actual.IsEqualTo(hardmax));
+
+        // random input: each plane must agree with repeated Hardmax after masking out the earlier winners
+        const size_t rows = 53, cols = 17, n = 5;
+        Matrix<float> scores = Matrix<float>::RandomUniform(rows, cols, deviceId, -1.0f, 1.0f, IncrementCounter());
+        actual.AssignTopNHardmaxOf(scores, n);
+        BOOST_CHECK_EQUAL(actual.GetNumRows(), rows * n);
+        BOOST_CHECK_EQUAL(actual.GetNumCols(), cols);
+        Matrix<float> best(deviceId);
+        Matrix<float> plane(deviceId);
+        for (size_t k = 0; k < n; k++)
+        {
+            best.SetValue(scores);
+            best.InplaceHardmax(true);
+            plane.AssignRowSliceValuesOf(actual, k * rows, rows);
+            BOOST_CHECK(plane.IsEqualTo(best));
+            Matrix<float>::ScaleAndAdd(-1e30f, best, scores);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixFusedElementwiseOp, RandomSeedFixture)
+{
+    // LSTM-style chain: sigmoid(a) .* tanh(b) + c
+    FusedElementwiseProgram program(3);
+    program.Binary(opSum, program.Binary(opElementwiseProduct, program.Unary(opSigmoid, 0), program.Unary(opTanh, 1)), 2);
+
+    const size_t rows = 17, cols = 23;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        auto a = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(rows, cols, deviceId, -3.0f, 3.0f, IncrementCounter()));
+        auto b = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(rows, cols, deviceId, -3.0f, 3.0f, IncrementCounter()));
+        auto c = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(rows, cols, deviceId, -3.0f, 3.0f, IncrementCounter()));
+        auto cColumn = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(rows, 1, deviceId, -3.0f, 3.0f, IncrementCounter()));
+        const TensorShape shape(rows, cols);
+
+        for (auto addend : {c, cColumn})
+        {
+            // reference: one op at a time
+            auto sigmoidA = make_shared<SingleMatrix>(rows, cols, deviceId);
+            auto tanhB = make_shared<SingleMatrix>(rows, cols, deviceId);
+            auto expected = make_shared<SingleMatrix>(rows, cols, deviceId);
+            TensorView<float>(sigmoidA, shape).AssignSigmoidOf(TensorView<float>(a, shape));
+            TensorView<float>(tanhB, shape).AssignTanhOf(TensorView<float>(b, shape));
+            TensorView<float> expectedView(expected, shape);
+            expectedView.AssignElementwiseProductOf(TensorView<float>(sigmoidA, shape), TensorView<float>(tanhB, shape));
+            expectedView.AddCopyOf(TensorView<float>(addend, TensorShape(rows, addend->GetNumCols())));
+
+            // fused; with the column addend, this takes the op-by-op path for broadcasting
+            auto actual = make_shared<SingleMatrix>(rows, cols, deviceId);
+            vector<TensorView<float>> inputs{TensorView<float>(a, shape), TensorView<float>(b, shape), TensorView<float>(addend, TensorShape(rows, addend->GetNumCols()))};
+            TensorView<float>(actual, shape).DoFusedElementwiseOf(0, inputs, program, 1);
+
+            BOOST_CHECK(actual->IsEqualTo(*expected, c_epsilonFloatE5));
+        }
+
+        // beta/alpha and offsets at the Matrix level: second column = 2 * second column + 0.5 * program(...)
+        SingleMatrix out = SingleMatrix::RandomUniform(rows, cols, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix expectedOut(out.DeepClone());
+        {
+            auto expectedColumn = make_shared<SingleMatrix>(expectedOut.ColumnSlice(1, 1));
+            auto t = make_shared<SingleMatrix>(rows, 1, deviceId);
+            const TensorShape columnShape(rows, 1);
+            TensorView<float> tView(t, columnShape);
+            tView.AssignSigmoidOf(TensorView<float>(make_shared<SingleMatrix>(a->ColumnSlice(1, 1)), columnShape));
+            auto u = make_shared<SingleMatrix>(rows, 1, deviceId);
+            TensorView<float>(u, columnShape).AssignTanhOf(TensorView<float>(make_shared<SingleMatrix>(b->ColumnSlice(1, 1)), columnShape));
+            tView.AssignElementwiseProductOf(tView, TensorView<float>(u, columnShape));
+            tView.AddCopyOf(TensorView<float>(make_shared<SingleMatrix>(c->ColumnSlice(1, 1)), columnShape));
+            TensorView<float>(expectedColumn, columnShape).DoCopyOf(2.0f, tView, 0.5f);
+        }
+        out.FusedElementwiseOp(2.0f, {a.get(), b.get(), c.get()}, {rows, rows, rows, rows}, rows, program, 0.5f);
+        BOOST_CHECK(out.IsEqualTo(expectedOut, c_epsilonFloatE5));
+    }
+}
+BOOST_FIXTURE_TEST_CASE(MatrixCounterBasedUniformRandomMask, RandomSeedFixture)
+{
+    const size_t rows = 100, cols = 50;
+    const float maskRate = 0.3f, scaleValue = 2.0f;
+    SingleMatrix cpuMask(CPUDEVICE);
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        auto rng = RNGHandle::Create(deviceId, 42);
+        SingleMatrix mask(rows, cols, deviceId);
+        mask.SetCounterBasedUniformRandomMask(maskRate, scaleValue, *rng);
+
+        SingleMatrix hostMask(mask.DeepClone(), CPUDEVICE);
+        size_t numMasked = 0;
+        for (size_t j = 0; j < cols; j++)
+        {
+            for (size_t i = 0; i < rows; i++)
+            {
+                float v = hostMask(i, j);
+                BOOST_CHECK(v == 0 || v == scaleValue);
+                numMasked += (v == 0);
+            }
+        }
+        BOOST_CHECK_CLOSE((double) numMasked / (rows * cols), maskRate, 10);
+
+        // the stream of a seed does not depend on how it is split into calls
+        auto rng2 = RNGHandle::Create(deviceId, 42);
+        SingleMatrix mask2(rows, cols, deviceId);
+        SingleMatrix left = mask2.ColumnSlice(0, 20);
+        SingleMatrix right = mask2.ColumnSlice(20, cols - 20);
+        left.SetCounterBasedUniformRandomMask(maskRate, scaleValue, *rng2);
+        right.SetCounterBasedUniformRandomMask(maskRate, scaleValue, *rng2);
+        BOOST_CHECK(mask2.IsEqualTo(mask));
+
+        // and CPU and GPU produce the same masks
+        if (deviceId == CPUDEVICE)
+            cpuMask.SetValue(hostMask);
+        else
+            BOOST_CHECK(hostMask.IsEqualTo(cpuMask));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixElementProductOfUniformRandomMask, RandomSeedFixture)
+{
+    const size_t rows = 37, cols = 50; // not a multiple of 4, so that column slices do not start at a counter boundary
+    const float maskRate = 0.3f, scaleValue = 2.0f;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        auto rng = RNGHandle::Create(deviceId, 42);
+        rng->ReserveCounters(5);
+        const uint64_t firstCounter = rng->ReserveCounters(0);
+        SingleMatrix mask(rows, cols, deviceId);
+        mask.SetCounterBasedUniformRandomMask(maskRate, scaleValue, *rng);
+
+        SingleMatrix a = SingleMatrix::RandomUniform(rows, cols, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix expected(deviceId);
+        expected.AssignElementProductOf(mask, a);
+
+        // the mask is regenerated from the counters
+        SingleMatrix actual(deviceId);
+        actual.AssignElementProductOfUniformRandomMask(a, maskRate, scaleValue, rng->Seed(), firstCounter, 0);
+        BOOST_CHECK(actual.IsEqualTo(expected, c_epsilonFloatE5));
+
+        // also for column slices, given the index of their first element
+        SingleMatrix sliced(rows, cols, deviceId);
+        for (size_t j = 0; j < cols; j += 7)
+        {
+            size_t n = std::min((size_t) 7, cols - j);
+            SingleMatrix slice = sliced.ColumnSlice(j, n);
+            slice.AssignElementProductOfUniformRandomMask(a.ColumnSlice(j, n), maskRate, scaleValue, rng->Seed(), firstCounter, j * rows);
+        }
+        BOOST_CHECK(sliced.IsEqualTo(expected, c_epsilonFloatE5));
+
+        // beta = 1 adds to the target
+        SingleMatrix sum = SingleMatrix::Ones(rows, cols, deviceId);
+        sum.AssignElementProductOfUniformRandomMask(a, maskRate, scaleValue, rng->Seed(), firstCounter, 0, 1.0f);
+        expected += SingleMatrix::Ones(rows, cols, deviceId);
+        BOOST_CHECK(sum.IsEqualTo(expected, c_epsilonFloatE5));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixCounterBasedRandomValue, RandomSeedFixture)
+{
+    const size_t rows = 301, cols = 70; // not a multiple of 4
+    const float low = -0.5f, high = 1.5f, mean = 1.0f, sigma = 2.0f;
+    SingleMatrix cpuUniform(CPUDEVICE), cpuGaussian(CPUDEVICE);
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix uniform(rows, cols, deviceId);
+        uniform.SetCounterBasedUniformRandomValue(low, high, 42);
+        SingleMatrix gaussian(rows, cols, deviceId);
+        gaussian.SetCounterBasedGaussianRandomValue(mean, sigma, 42);
+
+        SingleMatrix hostUniform(uniform.DeepClone(), CPUDEVICE);
+        SingleMatrix hostGaussian(gaussian.DeepClone(), CPUDEVICE);
+        double sum = 0, sumGaussian = 0, sumSqrGaussian = 0;
+        foreach_coord (i, j, hostUniform)
+        {
+            BOOST_CHECK(hostUniform(i, j) >= low && hostUniform(i, j) < high);
+            sum += hostUniform(i, j);
+            sumGaussian += hostGaussian(i, j);
+            sumSqrGaussian += (double) hostGaussian(i, j) * hostGaussian(i, j);
+        }
+        const double n = rows * cols;
+        BOOST_CHECK_LE(fabs(sum / n - (low + high) / 2), c_epsilonFloatE1);
+        BOOST_CHECK_LE(fabs(sumGaussian / n - mean), c_epsilonFloatE1);
+        BOOST_CHECK_LE(fabs(sqrt(sumSqrGaussian / n - (sumGaussian / n) * (sumGaussian / n)) - sigma), c_epsilonFloatE1);
+
+        // the values depend only on the seed
+        SingleMatrix again(rows, cols, deviceId);
+        again.SetCounterBasedUniformRandomValue(low, high, 42);
+        BOOST_CHECK(again.IsEqualTo(uniform));
+        again.SetCounterBasedUniformRandomValue(low, high, 43);
+        BOOST_CHECK(!again.IsEqualTo(uniform));
+
+        // and CPU and GPU produce the same values (up to rounding)
+        if (deviceId == CPUDEVICE)
+        {
+            cpuUniform.SetValue(hostUniform);
+            cpuGaussian.SetValue(hostGaussian);
+        }
+        else
+        {
+            BOOST_CHECK(hostUniform.IsEqualTo(cpuUniform, c_epsilonFloatE5));
+            BOOST_CHECK(hostGaussian.IsEqualTo(cpuGaussian, c_epsilonFloatE4));
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixImplicitTransferStatistics, RandomSeedFixture)
+{
+    const size_t rows = 4, cols = 3;
+    SingleMatrix a = SingleMatrix::RandomUniform(rows, cols, c_deviceIdZero, -1.0f, 1.0f, IncrementCounter());
+    MatrixTransferStatistics::Reset();
+    {
+        MatrixTransferScope scope(L"test");
+        // element access copies the data to the CPU and leaves it on both devices; the second read needs no copy
+        const SingleMatrix& constA = a;
+        float v = constA(1, 2);
+        BOOST_CHECK_EQUAL(constA(1, 2), v);
+    }
+    BOOST_CHECK_EQUAL(a.GetNumImplicitTransfers(), 1);
+    BOOST_CHECK_EQUAL(a.GetNumImplicitTransferBytes(), rows * cols * sizeof(float));
+    BOOST_CHECK_EQUAL(MatrixTransferStatistics::GetTotal().numTransfers, 1);
+    BOOST_CHECK_EQUAL(MatrixTransferStatistics::GetPerScope()[L"test"].numBytes, rows * cols * sizeof(float));
+
+    // explicit moves are not counted; moving to the CPU when the data is on both devices keeps the values
+    SingleMatrix b(a.DeepClone(), c_deviceIdZero);
+    a.TransferToDeviceIfNotThere(CPUDEVICE, true);
+    BOOST_CHECK_EQUAL(a.GetCurrentMatrixLocation(), CurrentDataLocation::CPU);
+    b.TransferToDeviceIfNotThere(CPUDEVICE, true);
+    BOOST_CHECK(a.IsEqualTo(b, c_epsilonFloatE5));
+    BOOST_CHECK_EQUAL(MatrixTransferStatistics::GetTotal().numTransfers, 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixBatchMatMul, RandomSeedFixture)
+{
+    const size_t m = 3, k = 5, n = 2, batchSize = 7;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        for (bool transposeA : {false, true})
+        {
+            for (bool broadcastB : {false, true})
+            {
+                // each column holds one matrix; a_j is [m x k], or [k x m] if transposed, b_j is [n x k] (used transposed)
+                SingleMatrix a = SingleMatrix::RandomUniform(m * k, batchSize, deviceId, -1.0f, 1.0f, IncrementCounter());
+                SingleMatrix b = SingleMatrix::RandomUniform(k * n, broadcastB ? 1 : batchSize, deviceId, -1.0f, 1.0f, IncrementCounter());
+                SingleMatrix c = SingleMatrix::RandomUniform(m * n, batchSize, deviceId, -1.0f, 1.0f, IncrementCounter());
+                SingleMatrix expected(c.DeepClone(), deviceId);
+                for (size_t j = 0; j < batchSize; j++)
+                {
+                    SingleMatrix aj = a.ColumnSlice(j, 1).Reshaped(transposeA ? k : m, transposeA ? m : k);
+                    SingleMatrix bj = b.ColumnSlice(broadcastB ? 0 : j, 1).Reshaped(n, k);
+                    SingleMatrix cj = expected.ColumnSlice(j, 1).Reshaped(m, n);
+                    SingleMatrix::MultiplyAndWeightedAdd(2.0f, aj, transposeA, bj, true, 0.5f, cj);
+                }
+
+                SingleMatrix::BatchMatMul(2.0f, a, transposeA ? k : m, transposeA, b, n, true, 0.5f, c);
+                BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE5));
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixAffineAndActivation, RandomSeedFixture)
+{
+    const size_t m = 13, k = 7, n = 5;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        for (auto activation : {opSigmoid, opTanh, opLinearRectifier})
+        {
+            SingleMatrix a = SingleMatrix::RandomUniform(m, k, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix b = SingleMatrix::RandomUniform(k, n, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix bias = SingleMatrix::RandomUniform(m, 1, deviceId, -1.0f, 1.0f, IncrementCounter());
+
+            // reference: product, bias and activation in separate passes
+            SingleMatrix expected(deviceId);
+            SingleMatrix::Multiply(a, b, expected);
+            SingleMatrix::ScaleAndAdd(1.0f, bias, expected);
+            if (activation == opSigmoid)
+                expected.InplaceSigmoid();
+            else if (activation == opTanh)
+                expected.InplaceTanh();
+            else
+                expected.InplaceTruncateBottom(0);
+
+            SingleMatrix c(deviceId);
+            SingleMatrix::AffineAndActivation(a, b, bias, activation, c);
+            BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE5));
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixSoftmaxCrossEntropy, RandomSeedFixture)
+{
+    // more rows than threads per column on the GPU, and large logits to check the stability of the online softmax
+    const size_t rows = 700, cols = 9;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix logits = SingleMatrix::RandomUniform(rows, cols, deviceId, -50.0f, 50.0f, IncrementCounter());
+        SingleMatrix labels = SingleMatrix::RandomUniform(rows, cols, deviceId, 0.0f, 1.0f, IncrementCounter());
+        SingleMatrix alpha(1, 1, deviceId);
+        alpha.SetValue(0.5f);
+
+        // reference: separate log softmax and inner product
+        SingleMatrix logSoftmax(deviceId);
+        logSoftmax.AssignLogSoftmaxOf(logits, true);
+        SingleMatrix product(deviceId);
+        product.AssignElementProductOf(labels, logSoftmax);
+        SingleMatrix expectedCrossEntropy(deviceId);
+        expectedCrossEntropy.AssignSumOfElements(product);
+        SingleMatrix softmax(logSoftmax.DeepClone(), deviceId);
+        softmax.InplaceExp();
+        SingleMatrix expectedGradient = SingleMatrix::Ones(rows, cols, deviceId);
+        SingleMatrix::AddScaledDifference(alpha, softmax, labels, expectedGradient);
+
+        SingleMatrix logSumExp(deviceId), crossEntropy(deviceId);
+        SingleMatrix::SoftmaxCrossEntropy(labels, logits, logSumExp, crossEntropy);
+        BOOST_CHECK_EQUAL(crossEntropy.GetNumRows(), 1);
+        BOOST_CHECK_EQUAL(crossEntropy.GetNumCols(), cols);
+        BOOST_CHECK_CLOSE(crossEntropy.SumOfElements(), -expectedCrossEntropy.Get00Element(), 0.01);
+
+        SingleMatrix gradient = SingleMatrix::Ones(rows, cols, deviceId);
+        SingleMatrix::AddSoftmaxCrossEntropyGradient(alpha, labels, logits, logSumExp, gradient);
+        BOOST_CHECK(gradient.IsEqualTo(expectedGradient, c_epsilonFloatE4));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixSoftmaxCrossEntropyWithIndices, RandomSeedFixture)
+{
+    const size_t rows = 700, cols = 9;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix logits = SingleMatrix::RandomUniform(rows, cols, deviceId, -50.0f, 50.0f, IncrementCounter());
+        SingleMatrix alpha(1, 1, deviceId);
+        alpha.SetValue(0.5f);
+
+        // the last column is a gap
+        std::vector<float> indices(cols);
+        for (size_t j = 0; j < cols; j++)
+            indices[j] = (float) ((j * 97 + 13) % rows);
+        indices[cols - 1] = -1;
+        SingleMatrix labelIndices(1, cols, indices.data(), deviceId);
+        SingleMatrix labels = SingleMatrix::Zeros(rows, cols, deviceId);
+        labels.TransferToDeviceIfNotThere(CPUDEVICE, true);
+        for (size_t j = 0; j + 1 < cols; j++)
+            labels.SetValue((size_t) indices[j], j, 1.0f);
+        labels.TransferToDeviceIfNotThere(deviceId, true);
+
+        // reference: the same with one-hot labels, whose gap column is all zeros
+        SingleMatrix expectedLogSumExp(deviceId), expectedCrossEntropy(deviceId);
+        SingleMatrix::SoftmaxCrossEntropy(labels, logits, expectedLogSumExp, expectedCrossEntropy);
+        SingleMatrix expectedGradient = SingleMatrix::Ones(rows, cols, deviceId);
+        SingleMatrix::AddSoftmaxCrossEntropyGradient(alpha, labels, logits, expectedLogSumExp, expectedGradient);
+        expectedGradient.SetColumn(1.0f, cols - 1);
+
+        SingleMatrix logSumExp(deviceId), crossEntropy(deviceId);
+        SingleMatrix::SoftmaxCrossEntropyWithIndices(labelIndices, logits, logSumExp, crossEntropy);
+        BOOST_CHECK(logSumExp.IsEqualTo(expectedLogSumExp, c_epsilonFloatE4));
+        BOOST_CHECK(crossEntropy.IsEqualTo(expectedCrossEntropy, c_epsilonFloatE3));
+
+        SingleMatrix gradient = SingleMatrix::Ones(rows, cols, deviceId);
+        SingleMatrix::AddSoftmaxCrossEntropyGradientWithIndices(alpha, labelIndices, logits, logSumExp, gradient);
+        BOOST_CHECK(gradient.IsEqualTo(expectedGradient, c_epsilonFloatE4));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixMultiTensorNormalGrad, RandomSeedFixture)
+{
+    // more tensors than fit into one GPU launch, and one with more chunks than that
+    std::vector<std::pair<size_t, size_t>> shapes = { {7, 3}, {1, 1}, {2100, 1024}, {64, 1} };
+    for (size_t i = 0; i < 36; i++)
+        shapes.push_back({5, i + 1});
+    const float momentum = 0.9f, clippingThreshold = 5.0f, l2RegWeight = 0.01f, l1RegWeight = 0.001f;
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    for (bool clipByTruncation : {false, true})
+    for (bool useNesterovMomentum : {false, true})
+    {
+        std::vector<SingleMatrix> smoothedGradients, gradients, values, expectedSmoothedGradients, expectedValues;
+        std::vector<float> learnRatesPerSample;
+        for (const auto& shape : shapes)
+        {
+            smoothedGradients.push_back(SingleMatrix::RandomUniform(shape.first, shape.second, deviceId, -0.1f, 0.1f, IncrementCounter()));
+            gradients.push_back(SingleMatrix::RandomUniform(shape.first, shape.second, deviceId, -8.0f, 8.0f, IncrementCounter()));
+            values.push_back(SingleMatrix::RandomUniform(shape.first, shape.second, deviceId, -1.0f, 1.0f, IncrementCounter()));
+            learnRatesPerSample.push_back(0.05f * (1 + learnRatesPerSample.size() % 3));
+        }
+
+        // reference: the separate steps of SGD::UpdateWeightsS()
+        for (size_t i = 0; i < shapes.size(); i++)
+        {
+            SingleMatrix smoothedGradient(smoothedGradients[i].DeepClone(), deviceId);
+            SingleMatrix gradient(gradients[i].DeepClone(), deviceId);
+            SingleMatrix value(values[i].DeepClone(), deviceId);
+            if (clipByTruncation)
+                gradient.InplaceTruncate(clippingThreshold);
+            else
+            {
+                double gradientNorm = gradient.FrobeniusNorm();
+                if (gradientNorm > clippingThreshold)
+                    gradient *= (float) (clippingThreshold / gradientNorm);
+            }
+            SingleMatrix::ScaleAndAdd(l2RegWeight, value, gradient);
+            smoothedGradient.NormalGrad(gradient, value, learnRatesPerSample[i], momentum, useNesterovMomentum);
+            value.InplaceSoftThreshold(learnRatesPerSample[i] * l1RegWeight);
+            expectedSmoothedGradients.push_back(std::move(smoothedGradient));
+            expectedValues.push_back(std::move(value));
+        }
+
+        std::vector<SingleMatrix*> smoothedGradientPointers, gradientPointers, valuePointers;
+        for (size_t i = 0; i < shapes.size(); i++)
+        {
+            smoothedGradientPointers.push_back(&smoothedGradients[i]);
+            gradientPointers.push_back(&gradients[i]);
+            valuePointers.push_back(&values[i]);
+        }
+        SingleMatrix::MultiTensorNormalGrad(smoothedGradientPointers, gradientPointers, valuePointers, learnRatesPerSample,
+                                            momentum, useNesterovMomentum, clippingThreshold, clipByTruncation, l2RegWeight, l1RegWeight);
+
+        for (size_t i = 0; i < shapes.size(); i++)
+        {
+            BOOST_CHECK_MESSAGE(smoothedGradients[i].IsEqualTo(expectedSmoothedGradients[i], c_epsilonFloatE4), "smoothed gradient " << i << " differs");
+            BOOST_CHECK_MESSAGE(values[i].IsEqualTo(expectedValues[i], c_epsilonFloatE4), "value " << i << " differs");
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixTensorTransposeCopy, RandomSeedFixture)
+{
+    // [I x J x K] with the first two axes swapped; sizes not multiples of the tile size
+    const size_t I = 45, J = 70, K = 3;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        auto a = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(I, J * K, deviceId, -1.0f, 1.0f, IncrementCounter()));
+        auto b = make_shared<SingleMatrix>(SingleMatrix::RandomUniform(J, I * K, deviceId, -1.0f, 1.0f, IncrementCounter()));
+        SingleMatrix hostA(a->DeepClone(), CPUDEVICE);
+        SingleMatrix hostB(b->DeepClone(), CPUDEVICE);
+
+        TensorShape transposedShape(I, J, K);
+        transposedShape.SwapDimsInPlace(0, 1);
+
+        // forward: reads along the second axis, writes along the first; b = 0.5 b + 2 a^T
+        TensorView<float>(b, TensorShape(J, I, K)).DoCopyOf(0.5f, TensorView<float>(a, transposedShape), 2.0f);
+        SingleMatrix resultB(b->DeepClone(), CPUDEVICE);
+        for (size_t k = 0; k < K; k++)
+            for (size_t i = 0; i < I; i++)
+                for (size_t j = 0; j < J; j++)
+                    BOOST_CHECK_SMALL(resultB(j, i + k * I) - (0.5f * hostB(j, i + k * I) + 2.0f * hostA(i, j + k * J)), c_epsilonFloatE4);
+
+        // backward: reads along the first axis, writes along the second; a += b^T
+        TensorView<float>(a, transposedShape).AddCopyOf(TensorView<float>(b, TensorShape(J, I, K)));
+        SingleMatrix resultA(a->DeepClone(), CPUDEVICE);
+        for (size_t k = 0; k < K; k++)
+            for (size_t i = 0; i < I; i++)
+                for (size_t j = 0; j < J; j++)
+                    BOOST_CHECK_SMALL(resultA(i, j + k * J) - (hostA(i, j + k * J) + resultB(j, i + k * I)), c_epsilonFloatE4);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixCosDistanceWithNegativeSamples, RandomSeedFixture)
+{
+    // n small enough for the shifted documents to wrap around
+    const size_t m = 20, n = 7, shift = 2, negNumber = 3;
+
+    // sum(cGrad .* c) of the cosine similarities of q against d, computed directly from the definition
+    auto objective = [&](const SingleMatrix& q, const SingleMatrix& d, const SingleMatrix& cGrad)
+    {
+        double sum = 0;
+        for (size_t j = 0; j < n; j++)
+            for (size_t i = 0; i <= negNumber; i++)
+            {
+                size_t k = i == 0 ? j : (j + shift + i - 1) % n;
+                double dot = 0, qq = 0, dd = 0;
+                for (size_t r = 0; r < m; r++)
+                {
+                    dot += q(r, j) * d(r, k);
+                    qq += q(r, j) * q(r, j);
+                    dd += d(r, k) * d(r, k);
+                }
+                sum += cGrad(i, j) * dot / sqrt(qq * dd);
+            }
+        return sum;
+    };
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix q = SingleMatrix::RandomUniform(m, n, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix d = SingleMatrix::RandomUniform(m, n, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix cGrad = SingleMatrix::RandomUniform(negNumber + 1, n, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix invNormQ(deviceId), invNormD(deviceId), c(deviceId);
+        SingleMatrix::CosDistanceWithNegativeSamples(q, d, shift, negNumber, invNormQ, invNormD, c);
+
+        // forward: same as the unfused computation
+        SingleMatrix unfusedInvNormQ(deviceId), unfusedInvNormD(deviceId), normProducts(deviceId), dots(deviceId);
+        unfusedInvNormQ.AssignVectorNorm2Of(q, true);
+        unfusedInvNormQ.AssignElementInverseOf(unfusedInvNormQ);
+        unfusedInvNormD.AssignVectorNorm2Of(d, true);
+        unfusedInvNormD.AssignElementInverseOf(unfusedInvNormD);
+        BOOST_CHECK(invNormQ.IsEqualTo(unfusedInvNormQ, c_epsilonFloatE4));
+        BOOST_CHECK(invNormD.IsEqualTo(unfusedInvNormD, c_epsilonFloatE4));
+        normProducts.AssignElementProductOfWithShiftNeg(unfusedInvNormQ, unfusedInvNormD, shift, negNumber);
+        dots.AssignInnerProductOfWithShiftNeg(q, d, true, shift, negNumber);
+        SingleMatrix expected(deviceId);
+        expected.AssignElementProductOf(normProducts, dots);
+        BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE4));
+
+        // backward: the gradients added to random matrices match central differences along a random direction
+        SingleMatrix hostQ(q.DeepClone(), CPUDEVICE), hostD(d.DeepClone(), CPUDEVICE), hostCGrad(cGrad.DeepClone(), CPUDEVICE);
+        for (bool wrtQuery : {true, false})
+        {
+            SingleMatrix grad = SingleMatrix::RandomUniform(m, n, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix hostInitialGrad(grad.DeepClone(), CPUDEVICE);
+            SingleMatrix::CosDistanceWithNegativeSamplesGradient(wrtQuery, q, d, shift, negNumber, invNormQ, invNormD, c, cGrad, grad);
+            SingleMatrix hostGrad(grad.DeepClone(), CPUDEVICE);
+
+            SingleMatrix direction = SingleMatrix::RandomUniform(m, n, CPUDEVICE, -1.0f, 1.0f, IncrementCounter());
+            const float eps = 1e-2f;
+            SingleMatrix plus(wrtQuery ? hostQ.DeepClone() : hostD.DeepClone()), minus(plus.DeepClone());
+            plus.AddWithScaleOf(eps, direction);
+            minus.AddWithScaleOf(-eps, direction);
+            double numeric = wrtQuery ? (objective(plus, hostD, hostCGrad) - objective(minus, hostD, hostCGrad)) / (2 * eps)
+                                      : (objective(hostQ, plus, hostCGrad) - objective(hostQ, minus, hostCGrad)) / (2 * eps);
+            double analytic = 0;
+            for (size_t j = 0; j < n; j++)
+                for (size_t r = 0; r < m; r++)
+                    analytic += (hostGrad(r, j) - hostInitialGrad(r, j)) * direction(r, j);
+            BOOST_CHECK_SMALL(analytic - numeric, 1e-3);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixGMMLogLikelihood, RandomSeedFixture)
+{
+    const size_t numComponents = 5, featureDim = 6, numSamples = 9;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        // mixture parameters shared by all samples (the GEMM path) and one set per sample
+        for (size_t paramCols : {(size_t) 1, numSamples})
+        {
+            SingleMatrix unnormedPrior = SingleMatrix::RandomUniform(numComponents, paramCols, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix means = SingleMatrix::RandomUniform(numComponents * featureDim, paramCols, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix logStdDevs = SingleMatrix::RandomUniform(numComponents, paramCols, deviceId, -0.5f, 0.5f, IncrementCounter());
+            SingleMatrix features = SingleMatrix::RandomUniform(featureDim, numSamples, deviceId, -1.0f, 1.0f, IncrementCounter());
+            SingleMatrix logLikelihood(deviceId), posterior(deviceId), normedDeviation(deviceId);
+            SingleMatrix::GMMLogLikelihood(unnormedPrior, means, logStdDevs, features, logLikelihood, posterior, normedDeviation);
+
+            SingleMatrix hostPrior(unnormedPrior.DeepClone(), CPUDEVICE), hostMeans(means.DeepClone(), CPUDEVICE), hostLogStdDevs(logStdDevs.DeepClone(), CPUDEVICE);
+            SingleMatrix hostFeatures(features.DeepClone(), CPUDEVICE), hostLogLikelihood(logLikelihood.DeepClone(), CPUDEVICE);
+            SingleMatrix hostPosterior(posterior.DeepClone(), CPUDEVICE), hostNormedDeviation(normedDeviation.DeepClone(), CPUDEVICE);
+            for (size_t t = 0; t < numSamples; t++)
+            {
+                const size_t p = paramCols == 1 ? 0 : t;
+                double priorSum = 0, likelihood = 0;
+                std::vector<double> joint(numComponents);
+                for (size_t c = 0; c < numComponents; c++)
+                    priorSum += exp(hostPrior(c, p));
+                for (size_t c = 0; c < numComponents; c++)
+                {
+                    double dist = 0, variance = exp(2.0 * hostLogStdDevs(c, p));
+                    for (size_t r = 0; r < featureDim; r++)
+                        dist += pow(hostFeatures(r, t) - hostMeans(c * featureDim + r, p), 2);
+                    BOOST_CHECK_SMALL((float) (hostNormedDeviation(c, t) - dist / variance), c_epsilonFloatE4);
+                    joint[c] = exp(hostPrior(c, p)) / priorSum * exp(-dist / variance / 2) / pow(TWO_PI * variance, featureDim / 2.0);
+                    likelihood += joint[c];
+                }
+                BOOST_CHECK_SMALL((float) (hostLogLikelihood(0, t) - log(likelihood)), c_epsilonFloatE4);
+                for (size_t c = 0; c < numComponents; c++)
+                    BOOST_CHECK_SMALL((float) (hostPosterior(c, t) - joint[c] / likelihood), c_epsilonFloatE4);
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixGatherScatterColumnsOf, RandomSeedFixture)
+{
+    // row count not a multiple of the warp size
+    const size_t numRows = 70, numCols = 6;
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix a = SingleMatrix::RandomUniform(numRows, numCols, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix us = SingleMatrix::RandomUniform(numRows, numCols, deviceId, -1.0f, 1.0f, IncrementCounter());
+        SingleMatrix hostA(a.DeepClone(), CPUDEVICE), hostUs(us.DeepClone(), CPUDEVICE);
+
+        // gather with a gap and a repeated column
+        std::vector<float> gatherIdx = { 3, -1, 0, 3, 5, 1 };
+        SingleMatrix idx(deviceId);
+        idx.SetValue(1, numCols, deviceId, gatherIdx.data());
+        SingleMatrix gathered(us.DeepClone());
+        gathered.DoGatherColumnsOf(0.5f, idx, a, 2.0f);
+        SingleMatrix hostGathered(gathered.DeepClone(), CPUDEVICE);
+        for (size_t j = 0; j < numCols; j++)
+            for (size_t i = 0; i < numRows; i++)
+                BOOST_CHECK_SMALL(hostGathered(i, j) - (gatherIdx[j] < 0 ? hostUs(i, j) : 0.5f * hostUs(i, j) + 2.0f * hostA(i, (size_t)gatherIdx[j])), c_epsilonFloatE4);
+
+        // scatter with repeated targets (summed up), and with unique ones (a permutation, with a gap)
+        for (bool idxIsUnique : {false, true})
+        {
+            std::vector<float> scatterIdx = idxIsUnique ? std::vector<float>{ 4, 0, -1, 5, 2, 1 } : std::vector<float>{ 2, 2, -1, 0, 2, 5 };
+            idx.SetValue(1, numCols, deviceId, scatterIdx.data());
+            for (float beta : {0.0f, 1.0f, 0.5f})
+            {
+                SingleMatrix scattered(us.DeepClone());
+                scattered.DoScatterColumnsOf(beta, idx, a, 2.0f, idxIsUnique);
+                SingleMatrix hostScattered(scattered.DeepClone(), CPUDEVICE);
+                for (size_t j = 0; j < numCols; j++)
+                    for (size_t i = 0; i < numRows; i++)
+                    {
+                        float expected = beta * hostUs(i, j);
+                        for (size_t jIn = 0; jIn < numCols; jIn++)
+                            if (scatterIdx[jIn] == (float)j)
+                                expected += 2.0f * hostA(i, jIn);
+                        BOOST_CHECK_SMALL(hostScattered(i, j) - expected, c_epsilonFloatE4);
+                    }
+            }
+        }
+
+        // packed indices: two source sequences, in parallel sequences 1 and 0 of 2, the second one starting before the minibatch
+        // (column 2 is a gap, column 3 refers to the first time step of the second sequence inside the minibatch)
+        std::vector<float> index = { 0, 2, 1, 2 };
+        std::vector<float> sequenceMap = { 1, 0, 3,    1, 0, 3,    std::numeric_limits<float>::quiet_NaN(), 0, 0,    -4, 2, 4 };
+        SingleMatrix indexMatrix(deviceId), sequenceMapMatrix(deviceId), packed(deviceId);
+        indexMatrix.SetValue(1, index.size(), deviceId, index.data());
+        sequenceMapMatrix.SetValue(3, index.size(), deviceId, sequenceMap.data());
+        packed.AssignPackedIndicesOf(indexMatrix, sequenceMapMatrix, 2);
+        SingleMatrix hostPacked(packed.DeepClone(), CPUDEVICE);
+        BOOST_CHECK_EQUAL(hostPacked(0, 0), 1.0f);
+        BOOST_CHECK_EQUAL(hostPacked(0, 1), 5.0f);
+        BOOST_CHECK_EQUAL(hostPacked(0, 2), -1.0f);
+        BOOST_CHECK_EQUAL(hostPacked(0, 3), 0.0f);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixSetValueFromCompact, RandomSeedFixture)
+{
+    const size_t numRows = 3, numCols = 5;
+    std::vector<unsigned char> pixels(numRows * numCols);
+    std::vector<uint16_t> halves(numRows * numCols);
+    for (size_t k = 0; k < pixels.size(); k++)
+    {
+        pixels[k] = (unsigned char)(k * 17);
+        halves[k] = FloatToHalf(0.25f * k - 1.0f); // exactly representable
+    }
+    std::vector<float> offsets = { 1.0f, -2.0f, 0.5f };
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix offset(deviceId);
+        offset.SetValue(numRows, 1, deviceId, offsets.data());
+        for (bool withOffset : {false, true})
+        {
+            SingleMatrix fromPixels(deviceId), fromHalves(deviceId);
+            fromPixels.SetValueFromCompact(numRows, numCols, pixels.data(), CompactElementType::uint8, 0.5f, withOffset ? &offset : nullptr);
+            fromHalves.SetValueFromCompact(numRows, numCols, halves.data(), CompactElementType::float16, 2.0f, withOffset ? &offset : nullptr);
+            SingleMatrix hostPixels(fromPixels.DeepClone(), CPUDEVICE), hostHalves(fromHalves.DeepClone(), CPUDEVICE);
+            BOOST_CHECK_EQUAL(hostPixels.GetNumRows(), numRows);
+            BOOST_CHECK_EQUAL(hostHalves.GetNumCols(), numCols);
+            for (size_t j = 0; j < numCols; j++)
+                for (size_t i = 0; i < numRows; i++)
+                {
+                    size_t k = i + j * numRows;
+                    float o = withOffset ? offsets[i] : 0.0f;
+                    BOOST_CHECK_EQUAL(hostPixels(i, j), (pixels[k] - o) * 0.5f);
+                    BOOST_CHECK_EQUAL(hostHalves(i, j), (0.25f * k - 1.0f - o) * 2.0f);
+                }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixCompressColumns, RandomSeedFixture)
+{
+    const size_t numRows = 7, numCols = 4; // odd number of rows, so that the packed halves are padded
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix a = SingleMatrix::RandomUniform(numRows, numCols, deviceId, -3.0f, 3.0f, IncrementCounter());
+        a.SetColumn(0.0f, 1); // an all-zero column must not produce a zero scale
+        SingleMatrix hostA(a.DeepClone(), CPUDEVICE);
+        for (auto type : {CompactElementType::uint8, CompactElementType::float16})
+        {
+            SingleMatrix compressed(deviceId), restored(deviceId);
+            compressed.AssignCompressedOf(a, type);
+            BOOST_CHECK_EQUAL(compressed.GetNumRows(), GetCompressedNumRows<float>(numRows, type));
+            BOOST_CHECK_EQUAL(compressed.GetNumCols(), numCols);
+            restored.AssignDecompressedOf(compressed, numRows, type);
+            SingleMatrix hostRestored(restored.DeepClone(), CPUDEVICE);
+            BOOST_CHECK_EQUAL(hostRestored.GetNumRows(), numRows);
+            for (size_t j = 0; j < numCols; j++)
+            {
+                float maxAbs = 0;
+                for (size_t i = 0; i < numRows; i++)
+                    maxAbs = std::max(maxAbs, fabs(hostA(i, j)));
+                // uint8 rounds to half a step of max |v| / 127, FP16 keeps 11 significant bits
+                float tolerance = type == CompactElementType::uint8 ? maxAbs / 254 * 1.001f : maxAbs / 1024;
+                for (size_t i = 0; i < numRows; i++)
+                    BOOST_CHECK_SMALL(hostRestored(i, j) - hostA(i, j), tolerance + 1e-7f);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
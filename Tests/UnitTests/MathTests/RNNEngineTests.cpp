@@ -0,0 +1,203 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include <algorithm>
+#include <limits>
+#include <random>
+#include "../../../Source/Math/Matrix.h"
+#include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/GPUMatrix.h"
+#include "../../../Source/Math/RNNEngine.h"
+#include "../../../Source/Math/CuDnnFactories.h"
+#include "common.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// Returns vector of stack configs: <kind, hidden size, number of layers, bidirectional>
+std::vector<std::tuple<RNNKind, size_t, size_t, bool>> GenerateRNNTestConfigs()
+{
+    std::vector<std::tuple<RNNKind, size_t, size_t, bool>> res;
+    for (auto kind : {RNNKind::LSTM, RNNKind::GRU})
+    {
+        res.push_back(std::make_tuple(kind, 3, 1, false));
+        res.push_back(std::make_tuple(kind, 4, 2, true));
+    }
+    return res;
+}
+
+// Two parallel sequences over 5 time steps: stream 0 holds a sequence of 2 frames and one of 3,
+// stream 1 one of 4 frames and a gap.
+static const size_t numParallelSequences = 2;
+static const size_t numTimeSteps = 5;
+static std::vector<RNNSequence> GetTestSequences()
+{
+    return { {0, 0, 2}, {0, 2, 5}, {1, 0, 4} };
+}
+
+template <class ElemType>
+static Matrix<ElemType> RandomMatrix(size_t rows, size_t cols, std::mt19937& rng, DEVICEID_TYPE deviceId)
+{
+    std::uniform_real_distribution<ElemType> ud(-1, 1);
+    std::vector<ElemType> buf(rows * cols);
+    std::generate(begin(buf), end(buf), [&] { return ud(rng); });
+    return Matrix<ElemType>(rows, cols, buf.data(), deviceId, matrixFlagNormal);
+}
+
+BOOST_AUTO_TEST_SUITE(RNNSuite)
+
+// Compares the gradients of the GEMM engine with the numerical gradients of a linear function of the output.
+BOOST_AUTO_TEST_CASE(RNNGemmGradients)
+{
+    std::mt19937 rng(0);
+    DEVICEID_TYPE deviceId = -1;
+    const size_t inputDim = 3;
+    const size_t numCols = numParallelSequences * numTimeSteps;
+    const double delta = 1e-5;
+    for (const auto& cfg : GenerateRNNTestConfigs())
+    {
+        RNNAttributes attributes(std::get<0>(cfg), std::get<1>(cfg), std::get<2>(cfg), std::get<3>(cfg));
+        auto eng = RNNEngine<double>::Create(deviceId, attributes, inputDim, RNNEngineKind::Gemm);
+
+        DoubleMatrix in = RandomMatrix<double>(inputDim, numCols, rng, deviceId);
+        // the gap must not matter
+        in.ColumnSlice(4 * numParallelSequences + 1, 1).SetValue(std::numeric_limits<double>::quiet_NaN());
+        DoubleMatrix weights = RandomMatrix<double>(attributes.GetNumParameters(inputDim), 1, rng, deviceId);
+        DoubleMatrix outGrad = RandomMatrix<double>(attributes.GetOutputDim(), numCols, rng, deviceId);
+        DoubleMatrix out(attributes.GetOutputDim(), numCols, deviceId);
+        DoubleMatrix reserve(deviceId);
+
+        // loss = sum(out .* outGrad)
+        auto loss = [&]() -> double
+        {
+            eng->Forward(in, weights, out, numParallelSequences, GetTestSequences(), reserve);
+            DoubleMatrix prod(deviceId);
+            prod.AssignElementProductOf(out, outGrad);
+            return prod.SumOfElements();
+        };
+
+        loss();
+        BOOST_REQUIRE_MESSAGE(!out.HasNan("out"), "out has NaNs");
+        BOOST_REQUIRE_MESSAGE(out.ColumnSlice(4 * numParallelSequences + 1, 1).FrobeniusNorm() == 0, "out of the gap is not zero");
+
+        DoubleMatrix inGrad(inputDim, numCols, deviceId);
+        inGrad.SetValue(0);
+        DoubleMatrix weightsGrad(weights.GetNumRows(), 1, deviceId);
+        weightsGrad.SetValue(0);
+        eng->BackwardData(out, outGrad, weights, inGrad, reserve);
+        eng->BackwardWeights(in, out, weightsGrad, reserve);
+        BOOST_REQUIRE_MESSAGE(inGrad.ColumnSlice(4 * numParallelSequences + 1, 1).FrobeniusNorm() == 0, "inGrad of the gap is not zero");
+
+        auto checkNumericalGradient = [&](DoubleMatrix& param, const DoubleMatrix& grad, size_t i, const char* name)
+        {
+            double value = param(i % param.GetNumRows(), i / param.GetNumRows());
+            param.SetValue(i % param.GetNumRows(), i / param.GetNumRows(), value + delta);
+            double lossPlus = loss();
+            param.SetValue(i % param.GetNumRows(), i / param.GetNumRows(), value - delta);
+            double lossMinus = loss();
+            param.SetValue(i % param.GetNumRows(), i / param.GetNumRows(), value);
+            double expected = (lossPlus - lossMinus) / (2 * delta);
+            double actual = grad(i % grad.GetNumRows(), i / grad.GetNumRows());
+            BOOST_REQUIRE_MESSAGE(AreEqual(actual, expected, 1e-4, 1e-7),
+                                  name << "[" << i << "] = " << actual << ", numerical gradient = " << expected << ", " << (attributes.m_kind == RNNKind::LSTM ? "lstm" : "gru")
+                                       << " with " << attributes.m_numLayers << " layers of " << attributes.m_hiddenSize);
+        };
+        for (size_t i = 0; i < in.GetNumElements(); i++)
+        {
+            if (i / inputDim != 4 * numParallelSequences + 1)
+                checkNumericalGradient(in, inGrad, i, "inGrad");
+        }
+        for (size_t i = 0; i < weights.GetNumElements(); i++)
+            checkNumericalGradient(weights, weightsGrad, i, "weightsGrad");
+    }
+}
+
+// A sequence gives the same output whether it runs alone or after another one in the same stream.
+BOOST_AUTO_TEST_CASE(RNNGemmSequenceReset)
+{
+    std::mt19937 rng(0);
+    DEVICEID_TYPE deviceId = -1;
+    const size_t inputDim = 5;
+    const size_t numCols = numParallelSequences * numTimeSteps;
+    for (const auto& cfg : GenerateRNNTestConfigs())
+    {
+        RNNAttributes attributes(std::get<0>(cfg), std::get<1>(cfg), std::get<2>(cfg), std::get<3>(cfg));
+        auto eng = RNNEngine<float>::Create(deviceId, attributes, inputDim, RNNEngineKind::Gemm);
+
+        SingleMatrix in = RandomMatrix<float>(inputDim, numCols, rng, deviceId);
+        SingleMatrix weights = RandomMatrix<float>(attributes.GetNumParameters(inputDim), 1, rng, deviceId);
+        SingleMatrix out(attributes.GetOutputDim(), numCols, deviceId);
+        SingleMatrix reserve(deviceId);
+        eng->Forward(in, weights, out, numParallelSequences, GetTestSequences(), reserve);
+
+        // the second sequence of stream 0 alone, in a minibatch of one stream
+        SingleMatrix inAlone(inputDim, 3, deviceId);
+        SingleMatrix outAlone(attributes.GetOutputDim(), 3, deviceId);
+        for (size_t t = 0; t < 3; t++)
+            inAlone.ColumnSlice(t, 1).AssignValuesOf(in.ColumnSlice((t + 2) * numParallelSequences, 1));
+        eng->Forward(inAlone, weights, outAlone, 1, { {0, 0, 3} }, reserve);
+
+        for (size_t t = 0; t < 3; t++)
+        {
+            std::string emsg;
+            BOOST_REQUIRE_MESSAGE(CheckEqual(SingleMatrix(out.ColumnSlice((t + 2) * numParallelSequences, 1).DeepClone()), SingleMatrix(outAlone.ColumnSlice(t, 1).DeepClone()),
+                                             emsg, Err<float>::Rel * 10, Err<float>::Abs * 10),
+                                  "out at step " << t << " differs from the sequence run alone, " << (attributes.m_kind == RNNKind::LSTM ? "lstm" : "gru") << ". " << emsg);
+        }
+    }
+}
+
+// The cuDNN engine computes the same as the GEMM engine.
+BOOST_AUTO_TEST_CASE(RNNCuDnnForwardBackward)
+{
+    std::mt19937 rng(0);
+    DEVICEID_TYPE baseDeviceId = 0;
+    const size_t inputDim = 7;
+    const size_t numCols = numParallelSequences * numTimeSteps;
+    for (const auto& cfg : GenerateRNNTestConfigs())
+    {
+        RNNAttributes attributes(std::get<0>(cfg), std::get<1>(cfg), std::get<2>(cfg), std::get<3>(cfg));
+        auto engGemm = RNNEngine<float>::Create(-1, attributes, inputDim, RNNEngineKind::Gemm);
+        auto engCudnn = RNNEngine<float>::Create(baseDeviceId, attributes, inputDim, RNNEngineKind::CuDnn);
+
+        SingleMatrix in = RandomMatrix<float>(inputDim, numCols, rng, -1);
+        SingleMatrix weights = RandomMatrix<float>(attributes.GetNumParameters(inputDim), 1, rng, -1);
+        SingleMatrix outGrad = RandomMatrix<float>(attributes.GetOutputDim(), numCols, rng, -1);
+        SingleMatrix inB(in.DeepClone(), baseDeviceId);
+        SingleMatrix weightsB(weights.DeepClone(), baseDeviceId);
+        SingleMatrix outGradB(outGrad.DeepClone(), baseDeviceId);
+
+        SingleMatrix out(attributes.GetOutputDim(), numCols, -1);
+        SingleMatrix outB(attributes.GetOutputDim(), numCols, baseDeviceId);
+        SingleMatrix reserve(-1);
+        SingleMatrix reserveB(baseDeviceId);
+        engGemm->Forward(in, weights, out, numParallelSequences, GetTestSequences(), reserve);
+        engCudnn->Forward(inB, weightsB, outB, numParallelSequences, GetTestSequences(), reserveB);
+
+        SingleMatrix inGrad(inputDim, numCols, -1);
+        inGrad.SetValue(0);
+        SingleMatrix inGradB(inputDim, numCols, baseDeviceId);
+        inGradB.SetValue(0);
+        SingleMatrix weightsGrad(weights.GetNumRows(), 1, -1);
+        weightsGrad.SetValue(0);
+        SingleMatrix weightsGradB(weights.GetNumRows(), 1, baseDeviceId);
+        weightsGradB.SetValue(0);
+        engGemm->BackwardData(out, outGrad, weights, inGrad, reserve);
+        engGemm->BackwardWeights(in, out, weightsGrad, reserve);
+        engCudnn->BackwardData(outB, outGradB, weightsB, inGradB, reserveB);
+        engCudnn->BackwardWeights(inB, outB, weightsGradB, reserveB);
+
+        std::string emsg;
+        std::string msg = std::string(" are not equal, ") + (attributes.m_kind == RNNKind::LSTM ? "lstm" : "gru");
+        float relErr = Err<float>::Rel * 100;
+        float absErr = Err<float>::Abs * 100;
+        BOOST_REQUIRE_MESSAGE(CheckEqual(out, SingleMatrix(outB.DeepClone(), -1), emsg, relErr, absErr), "out" << msg << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(inGrad, SingleMatrix(inGradB.DeepClone(), -1), emsg, relErr, absErr), "inGrad" << msg << ". " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(weightsGrad, SingleMatrix(weightsGradB.DeepClone(), -1), emsg, relErr, absErr), "weightsGrad" << msg << ". " << emsg);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
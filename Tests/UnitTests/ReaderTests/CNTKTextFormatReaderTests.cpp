@@ -24,19 +24,34 @@ public:
     ChunkPtr m_chunk;
 
     CNTKTextFormatReaderTestRunner(const string& filename,
-        const vector<StreamDescriptor>& streams, unsigned int maxErrors) :
+        const vector<StreamDescriptor>& streams, unsigned int maxErrors,
+        size_t chunkSize = SIZE_MAX, bool cacheIndex = false, unsigned int numParsingThreads = 1) :
         m_parser(std::make_shared<CorpusDescriptor>(), wstring(filename.begin(), filename.end()), streams)
     {
         m_parser.SetMaxAllowedErrors(maxErrors);
         m_parser.SetTraceLevel(TextParser<ElemType>::TraceLevel::Info);
-        m_parser.SetChunkSize(SIZE_MAX);
+        m_parser.SetChunkSize(chunkSize);
         m_parser.SetNumRetries(0);
+        m_parser.SetCacheIndex(cacheIndex);
+        m_parser.SetNumParsingThreads(numParsingThreads);
         m_parser.Initialize();
     }
+
+    ChunkDescriptions GetChunkDescriptions()
+    {
+        return m_parser.GetChunkDescriptions();
+    }
+
+    vector<SequenceDescription> GetSequencesForChunk(ChunkIdType chunkId)
+    {
+        vector<SequenceDescription> result;
+        m_parser.GetSequencesForChunk(chunkId, result);
+        return result;
+    }
     // Retrieves a chunk of data.
-    void LoadChunk()
+    void LoadChunk(ChunkIdType chunkId = 0)
     {
-        m_chunk = m_parser.GetChunk(0);
+        m_chunk = m_parser.GetChunk(chunkId);
     }
 };
 
@@ -94,6 +109,24 @@ BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_Simple_dense)
         1);
 };
 
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_Simple_dense_prefetch_queue)
+{
+    // same minibatches when several of them are read ahead
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/CNTKTextFormatReader/dense.cntk",
+        testDataPath() + "/Control/CNTKTextFormatReader/Simple_dense.txt",
+        testDataPath() + "/Control/CNTKTextFormatReader/Simple_dense_prefetch_queue_Output.txt",
+        "Simple_prefetch_queue",
+        "reader",
+        1000, // epoch size
+        250,  // mb size
+        10,   // num epochs 
+        1,
+        1,
+        0,
+        1);
+};
+
 
 BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_MNIST_dense)
 {
@@ -662,6 +695,86 @@ BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_invalid_input)
     CheckFilesEquivalent(control, output);
 };
 
+// the index read back from the cache file describes the same chunks and sequences as the one built from the input
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_index_cache)
+{
+    vector<StreamDescriptor> streams(1);
+    streams[0].m_alias = "F0";
+    streams[0].m_name = L"F0";
+    streams[0].m_storageType = StorageType::dense;
+    streams[0].m_sampleDimension = 5;
+
+    const string input = "10x10_dense_index_cache.txt";
+    const string cache = input + ".ctfindex";
+    boost::filesystem::remove(cache);
+    boost::filesystem::copy_file("10x10_dense.txt", input, boost::filesystem::copy_option::overwrite_if_exists);
+    BOOST_SCOPE_EXIT(&input, &cache)
+    {
+        boost::filesystem::remove(input);
+        boost::filesystem::remove(cache);
+    } BOOST_SCOPE_EXIT_END
+
+    const size_t chunkSize = 1024; // several chunks
+    CNTKTextFormatReaderTestRunner<float> indexed(input, streams, 0, chunkSize, /*cacheIndex=*/true);
+    BOOST_REQUIRE(boost::filesystem::exists(cache));
+    CNTKTextFormatReaderTestRunner<float> cached(input, streams, 0, chunkSize, /*cacheIndex=*/true);
+
+    auto expectedChunks = indexed.GetChunkDescriptions();
+    auto chunks = cached.GetChunkDescriptions();
+    BOOST_REQUIRE_GT(expectedChunks.size(), 1);
+    BOOST_REQUIRE_EQUAL(chunks.size(), expectedChunks.size());
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(chunks[i]->m_id, expectedChunks[i]->m_id);
+        BOOST_CHECK_EQUAL(chunks[i]->m_numberOfSamples, expectedChunks[i]->m_numberOfSamples);
+        BOOST_CHECK_EQUAL(chunks[i]->m_numberOfSequences, expectedChunks[i]->m_numberOfSequences);
+
+        auto expectedSequences = indexed.GetSequencesForChunk(chunks[i]->m_id);
+        auto sequences = cached.GetSequencesForChunk(chunks[i]->m_id);
+        BOOST_REQUIRE_EQUAL(sequences.size(), expectedSequences.size());
+        for (size_t j = 0; j < sequences.size(); j++)
+        {
+            BOOST_CHECK_EQUAL(sequences[j].m_id, expectedSequences[j].m_id);
+            BOOST_CHECK_EQUAL(sequences[j].m_numberOfSamples, expectedSequences[j].m_numberOfSamples);
+            BOOST_CHECK_EQUAL((size_t) sequences[j].m_key.m_sequence, (size_t) expectedSequences[j].m_key.m_sequence);
+        }
+    }
+};
+
+// sequences parsed by several threads are the same as parsed by one
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_parallel_parsing)
+{
+    vector<StreamDescriptor> streams(1);
+    streams[0].m_alias = "F0";
+    streams[0].m_name = L"F0";
+    streams[0].m_storageType = StorageType::dense;
+    streams[0].m_sampleDimension = 5;
+
+    const size_t chunkSize = 1024;
+    CNTKTextFormatReaderTestRunner<double> sequential("10x10_dense.txt", streams, 0, chunkSize, false, 1);
+    CNTKTextFormatReaderTestRunner<double> parallel("10x10_dense.txt", streams, 0, chunkSize, false, 3);
+
+    auto chunks = sequential.GetChunkDescriptions();
+    BOOST_REQUIRE_EQUAL(parallel.GetChunkDescriptions().size(), chunks.size());
+    for (const auto& chunk : chunks)
+    {
+        sequential.LoadChunk(chunk->m_id);
+        parallel.LoadChunk(chunk->m_id);
+        for (const auto& s : sequential.GetSequencesForChunk(chunk->m_id))
+        {
+            vector<SequenceDataPtr> expected, actual;
+            sequential.m_chunk->GetSequence(s.m_id, expected);
+            parallel.m_chunk->GetSequence(s.m_id, actual);
+            BOOST_REQUIRE_EQUAL(actual.size(), 1);
+            BOOST_REQUIRE_EQUAL(actual[0]->m_numberOfSamples, expected[0]->m_numberOfSamples);
+            const double* expectedValues = static_cast<const double*>(expected[0]->m_data);
+            const double* actualValues = static_cast<const double*>(actual[0]->m_data);
+            BOOST_CHECK_EQUAL_COLLECTIONS(actualValues, actualValues + 5 * actual[0]->m_numberOfSamples,
+                expectedValues, expectedValues + 5 * expected[0]->m_numberOfSamples);
+        }
+    }
+};
+
 // 100 sequences with N samples for each of 3 inputs, where N is chosen at random
 // from [1, 100] for each sequence
 BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_100x100x3)
@@ -6,12 +6,24 @@
 #include "stdafx.h"
 
 #include "NoRandomizer.h"
+#include "ShuffleBufferRandomizer.h"
 #include "DataDeserializer.h"
 #include "BlockRandomizer.h"
 #include "CorpusDescriptor.h"
+#include "SequenceLengthBucketer.h"
+#include "ChunkCache.h"
+#include "ReaderCounters.h"
+#include "WordSequenceDeserializer.h"
+#include "Lz4Codec.h"
+#include "DataReader.h"
+#include "TransformController.h"
+#include "CPUThreadPool.h"
 
 #include <numeric>
 #include <random>
+#include <set>
+#include <thread>
+#include <tuple>
 
 using namespace Microsoft::MSR::CNTK;
 using namespace std;
@@ -104,13 +116,13 @@ public:
             }));
         }
 
-        m_streams.push_back(make_shared<StreamDescription>(StreamDescription{
+        m_streams.push_back(make_shared<StreamDescription>(
             L"input",
             0,
             StorageType::dense,
             ElementType::tfloat,
             m_sampleLayout
-        }));
+        ));
 
 
     };
@@ -327,6 +339,118 @@ BOOST_AUTO_TEST_CASE(BlockRandomizerChaosMonkey)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BlockRandomizerPrefetchChunks)
+{
+    const int numChunks = 20;
+    const int numSequencesPerChunk = 5;
+    const int windowSize = 12;
+    vector<float> data(numChunks * numSequencesPerChunk);
+    iota(data.begin(), data.end(), 0.0f);
+
+    auto mockDeserializer = make_shared<MockDeserializer>(numChunks, numSequencesPerChunk, data);
+
+    // Returns the sequences of several epochs, across sweeps and for several workers.
+    // (The randomizers are run one after the other, as the sequence randomization uses the global rand().)
+    auto getSequences = [&](size_t numPrefetchChunks)
+    {
+        auto randomizer = make_shared<BlockRandomizer>(0, windowSize, mockDeserializer, BlockRandomizer::DecimationMode::chunk, false, false, numPrefetchChunks);
+        vector<float> result;
+        for (size_t numberOfWorkers = 1; numberOfWorkers <= 2; numberOfWorkers++)
+        {
+            for (size_t epochIndex = 0; epochIndex < 3; epochIndex++)
+            {
+                EpochConfiguration epochConfiguration;
+                epochConfiguration.m_numberOfWorkers = numberOfWorkers;
+                epochConfiguration.m_workerRank = numberOfWorkers - 1;
+                epochConfiguration.m_minibatchSizeInSamples = 0;
+                epochConfiguration.m_totalEpochSizeInSamples = data.size() * 2 / 3;
+                epochConfiguration.m_epochIndex = epochIndex;
+                randomizer->StartEpoch(epochConfiguration);
+
+                Sequences sequences;
+                do
+                {
+                    sequences = randomizer->GetNextSequences(3);
+                    for (const auto& s : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+                        result.push_back(*((float*)reinterpret_cast<DenseSequenceData&>(*s).m_data));
+                } while (!sequences.m_endOfEpoch);
+            }
+        }
+        return result;
+    };
+
+    // Loading chunks ahead must not change what is returned.
+    vector<float> expected = getSequences(0);
+    vector<float> actual = getSequences(3);
+    BOOST_CHECK(!expected.empty());
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                  actual.begin(), actual.end());
+}
+
+BOOST_AUTO_TEST_CASE(BlockRandomizerSmallWindowsAcrossSweeps)
+{
+    const int numChunks = 10;
+    const int numSequencesPerChunk = 3;
+    vector<float> data(numChunks * numSequencesPerChunk);
+    iota(data.begin(), data.end(), 0.0f);
+
+    auto mockDeserializer = make_shared<MockDeserializer>(numChunks, numSequencesPerChunk, data);
+
+    // Returns the sequences of the epochs from 'firstEpochIndex' to the third, each two thirds of a sweep.
+    auto getSequences = [&](size_t windowSize, bool useLegacyRandomization, size_t firstEpochIndex)
+    {
+        auto randomizer = make_shared<BlockRandomizer>(0, windowSize, mockDeserializer, BlockRandomizer::DecimationMode::chunk, useLegacyRandomization);
+        vector<float> result;
+        for (size_t epochIndex = firstEpochIndex; epochIndex < 3; epochIndex++)
+        {
+            EpochConfiguration epochConfiguration;
+            epochConfiguration.m_numberOfWorkers = 1;
+            epochConfiguration.m_workerRank = 0;
+            epochConfiguration.m_minibatchSizeInSamples = 0;
+            epochConfiguration.m_totalEpochSizeInSamples = data.size() * 2 / 3;
+            epochConfiguration.m_epochIndex = epochIndex;
+            randomizer->StartEpoch(epochConfiguration);
+
+            Sequences sequences;
+            do
+            {
+                sequences = randomizer->GetNextSequences(4);
+                for (const auto& s : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+                    result.push_back(*((float*)reinterpret_cast<DenseSequenceData&>(*s).m_data));
+            } while (!sequences.m_endOfEpoch);
+        }
+        return result;
+    };
+
+    // The orders for randomization windows of a few chunks, which the randomizer keeps rolling over the chunks of each sweep.
+    const vector<tuple<size_t, bool, vector<float>>> expectedSequences = {
+        make_tuple(4, true, vector<float> { 13, 12, 14, 22, 23, 21, 3, 4, 5, 0, 2, 1, 10, 9, 11, 17, 16, 15, 26, 24,
+                                            25, 18, 20, 19, 29, 28, 27, 8, 6, 7, 12, 13, 14, 23, 21, 22, 3, 5, 4, 1,
+                                            0, 2, 11, 9, 10, 15, 17, 16, 26, 25, 24, 20, 18, 19, 28, 27, 29, 8, 7, 6 }),
+        make_tuple(4, false, vector<float> { 1, 0, 2, 7, 8, 6, 3, 4, 5, 15, 17, 16, 28, 27, 29, 26, 25, 24, 14, 12,
+                                             13, 21, 23, 22, 20, 19, 18, 11, 9, 10, 27, 28, 29, 2, 0, 1, 6, 8, 7, 16,
+                                             15, 17, 23, 21, 22, 12, 14, 13, 20, 19, 18, 11, 9, 10, 4, 3, 5, 26, 25, 24 }),
+        make_tuple(9, true, vector<float> { 13, 12, 14, 23, 21, 22, 4, 5, 3, 2, 1, 0, 9, 11, 10, 17, 16, 15, 25, 26,
+                                            24, 20, 19, 18, 28, 27, 29, 7, 8, 6, 12, 13, 14, 21, 23, 22, 4, 3, 5, 0,
+                                            1, 2, 9, 11, 10, 17, 16, 15, 24, 25, 26, 18, 20, 19, 27, 28, 29, 6, 8, 7 }),
+        make_tuple(9, false, vector<float> { 1, 0, 2, 8, 6, 7, 4, 5, 3, 17, 16, 15, 27, 29, 28, 26, 25, 24, 13, 14,
+                                             12, 23, 22, 21, 19, 18, 20, 10, 11, 9, 27, 28, 29, 0, 2, 1, 7, 6, 8, 15,
+                                             16, 17, 21, 23, 22, 14, 13, 12, 18, 19, 20, 9, 11, 10, 3, 4, 5, 24, 26, 25 }),
+    };
+
+    for (const auto& expected : expectedSequences)
+    {
+        vector<float> actual = getSequences(get<0>(expected), get<1>(expected), 0);
+        BOOST_CHECK_EQUAL_COLLECTIONS(get<2>(expected).begin(), get<2>(expected).end(),
+                                      actual.begin(), actual.end());
+
+        // starting at a later epoch, in the middle of the first sweep, must not change its sequences
+        vector<float> resumed = getSequences(get<0>(expected), get<1>(expected), 1);
+        BOOST_CHECK_EQUAL_COLLECTIONS(get<2>(expected).begin() + data.size() * 2 / 3, get<2>(expected).end(),
+                                      resumed.begin(), resumed.end());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(BlockRandomizerOneEpochLegacyRandomization)
 {
     vector<float> data(10);
@@ -404,6 +528,623 @@ BOOST_AUTO_TEST_CASE(NoRandomizerOneEpoch)
                                   actual.begin(), actual.end());
 }
 
+// Returns one sequence per call, with the given lengths; the data of a sequence is its index.
+class MockSequenceEnumerator : public SequenceEnumerator
+{
+private:
+    vector<uint32_t> m_lengths;
+    vector<float> m_ids;
+    vector<StreamDescriptionPtr> m_streams;
+    size_t m_position;
+
+public:
+    MockSequenceEnumerator(const vector<uint32_t>& lengths)
+        : m_lengths(lengths), m_ids(lengths.size()), m_position(0)
+    {
+        iota(m_ids.begin(), m_ids.end(), 0.0f);
+        m_streams.push_back(make_shared<StreamDescription>(
+            L"input",
+            0,
+            StorageType::dense,
+            ElementType::tfloat,
+            make_shared<TensorShape>(1)
+        ));
+    }
+
+    vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_streams;
+    }
+
+    void StartEpoch(const EpochConfiguration&) override
+    {
+        m_position = 0;
+    }
+
+    Sequences GetNextSequences(size_t) override
+    {
+        Sequences result;
+        if (m_position < m_lengths.size())
+        {
+            auto data = make_shared<DenseSequenceData>();
+            data->m_data = &m_ids[m_position];
+            data->m_numberOfSamples = m_lengths[m_position];
+            result.m_data.push_back(vector<SequenceDataPtr>{ data });
+            m_position++;
+        }
+        result.m_endOfEpoch = m_position == m_lengths.size();
+        return result;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(SequenceLengthBucketerOneEpoch)
+{
+    const size_t minibatchSize = 20;
+    vector<uint32_t> lengths;
+    mt19937 rng(7);
+    for (size_t i = 0; i < 100; i++)
+    {
+        lengths.push_back(1 + rng() % 10);
+    }
+
+    auto bucketer = make_shared<SequenceLengthBucketer>(make_shared<MockSequenceEnumerator>(lengths), 8);
+
+    EpochConfiguration epochConfiguration;
+    epochConfiguration.m_numberOfWorkers = 1;
+    epochConfiguration.m_workerRank = 0;
+    epochConfiguration.m_minibatchSizeInSamples = minibatchSize;
+    epochConfiguration.m_totalEpochSizeInSamples = accumulate(lengths.begin(), lengths.end(), (size_t)0);
+    epochConfiguration.m_epochIndex = 0;
+    bucketer->StartEpoch(epochConfiguration);
+
+    // Each sequence is returned once, in minibatches of up to the requested samples. As a window is sorted by length
+    // before it is cut, the length ranges of its minibatches add up to at most the range of all lengths (9).
+    const size_t windowSizeInSamples = 8 * minibatchSize;
+    vector<float> actual;
+    size_t sumOfLengthRanges = 0;
+    bool endOfEpoch = false;
+    while (!endOfEpoch)
+    {
+        Sequences sequences = bucketer->GetNextSequences(minibatchSize);
+        endOfEpoch = sequences.m_endOfEpoch;
+        BOOST_REQUIRE_EQUAL(sequences.m_data.size(), 1);
+        BOOST_REQUIRE(!sequences.m_data[0].empty());
+
+        size_t numSamples = 0;
+        uint32_t minLength = UINT32_MAX, maxLength = 0;
+        for (const auto& sequence : sequences.m_data[0])
+        {
+            actual.push_back(*reinterpret_cast<const float*>(sequence->m_data));
+            numSamples += sequence->m_numberOfSamples;
+            minLength = min(minLength, sequence->m_numberOfSamples);
+            maxLength = max(maxLength, sequence->m_numberOfSamples);
+        }
+        BOOST_CHECK(numSamples <= minibatchSize);
+        sumOfLengthRanges += maxLength - minLength;
+    }
+
+    // all windows but the last hold at least windowSizeInSamples samples
+    size_t maxNumWindows = epochConfiguration.m_totalEpochSizeInSamples / windowSizeInSamples + 1;
+    BOOST_CHECK_LE(sumOfLengthRanges, 9 * maxNumWindows);
+
+    BOOST_CHECK_EQUAL(actual.size(), lengths.size());
+    sort(actual.begin(), actual.end());
+    for (size_t i = 0; i < actual.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(actual[i], (float)i);
+    }
+
+    Sequences sequences = bucketer->GetNextSequences(minibatchSize);
+    BOOST_CHECK(sequences.m_data.empty());
+    BOOST_CHECK(sequences.m_endOfEpoch);
+}
+
+BOOST_AUTO_TEST_CASE(SequenceLengthBucketerLimitsPaddedSamples)
+{
+    const size_t minibatchSize = 30;
+    vector<uint32_t> lengths;
+    mt19937 rng(11);
+    for (size_t i = 0; i < 100; i++)
+    {
+        lengths.push_back(1 + rng() % 12);
+    }
+
+    auto bucketer = make_shared<SequenceLengthBucketer>(make_shared<MockSequenceEnumerator>(lengths), 4, true);
+
+    EpochConfiguration epochConfiguration;
+    epochConfiguration.m_numberOfWorkers = 1;
+    epochConfiguration.m_workerRank = 0;
+    epochConfiguration.m_minibatchSizeInSamples = minibatchSize;
+    epochConfiguration.m_totalEpochSizeInSamples = accumulate(lengths.begin(), lengths.end(), (size_t)0);
+    epochConfiguration.m_epochIndex = 0;
+    bucketer->StartEpoch(epochConfiguration);
+
+    // Each sequence is returned once, and the number of sequences times the longest one stays within the minibatch size.
+    size_t numSequences = 0;
+    bool endOfEpoch = false;
+    while (!endOfEpoch)
+    {
+        Sequences sequences = bucketer->GetNextSequences(minibatchSize);
+        endOfEpoch = sequences.m_endOfEpoch;
+        BOOST_REQUIRE_EQUAL(sequences.m_data.size(), 1);
+        BOOST_REQUIRE(!sequences.m_data[0].empty());
+
+        uint32_t maxLength = 0;
+        for (const auto& sequence : sequences.m_data[0])
+        {
+            maxLength = max(maxLength, sequence->m_numberOfSamples);
+        }
+        BOOST_CHECK_LE(sequences.m_data[0].size() * maxLength, minibatchSize);
+        numSequences += sequences.m_data[0].size();
+    }
+
+    BOOST_CHECK_EQUAL(numSequences, lengths.size());
+}
+
+BOOST_AUTO_TEST_CASE(BlockRandomizerPartitionsChunks)
+{
+    vector<float> data(20);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(10, 2, data);
+
+    const size_t numberOfWorkers = 3;
+    vector<size_t> timesRead(data.size(), 0);
+    for (size_t rank = 0; rank < numberOfWorkers; rank++)
+    {
+        auto randomizer = make_shared<BlockRandomizer>(0, 4, mockDeserializer, BlockRandomizer::DecimationMode::partition, false);
+        for (size_t epoch = 0; epoch < 2; epoch++)
+        {
+            EpochConfiguration epochConfiguration;
+            epochConfiguration.m_numberOfWorkers = numberOfWorkers;
+            epochConfiguration.m_workerRank = rank;
+            epochConfiguration.m_minibatchSizeInSamples = 0;
+            epochConfiguration.m_totalEpochSizeInSamples = data.size();
+            epochConfiguration.m_epochIndex = epoch;
+            randomizer->StartEpoch(epochConfiguration);
+
+            // each worker reads its chunks (original chunk id modulo the number of workers) in every sweep
+            for (;;)
+            {
+                Sequences sequences = randomizer->GetNextSequences(3);
+                for (const auto& sequence : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+                {
+                    size_t value = (size_t)*reinterpret_cast<const float*>(sequence->m_data);
+                    BOOST_CHECK_EQUAL((value / 2) % numberOfWorkers, rank);
+                    timesRead[value]++;
+                }
+                if (sequences.m_endOfEpoch)
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    // all sequences once per epoch, over all workers
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(timesRead[i], 2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SequenceEnumeratorsRestoreSamplePosition)
+{
+    const int sequenceLength = 3;
+    const int numChunks = 100;
+    const int numSequencesPerChunk = 10;
+    vector<float> data(numChunks * numSequencesPerChunk);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(numChunks, numSequencesPerChunk, data, sequenceLength);
+
+    // an epoch that starts in the middle of a sweep and extends into the next one
+    EpochConfiguration epochConfiguration;
+    epochConfiguration.m_numberOfWorkers = 2;
+    epochConfiguration.m_workerRank = 1;
+    epochConfiguration.m_minibatchSizeInSamples = 0;
+    epochConfiguration.m_totalEpochSizeInSamples = data.size() * sequenceLength * 3 / 5;
+    epochConfiguration.m_epochIndex = 1;
+
+    for (bool randomize : { true, false })
+    {
+        auto create = [&]() -> SequenceEnumeratorPtr
+        {
+            if (randomize)
+                return make_shared<BlockRandomizer>(0, 60, mockDeserializer, BlockRandomizer::DecimationMode::chunk, false);
+            return make_shared<NoRandomizer>(mockDeserializer);
+        };
+
+        // the positions before each read, and the sequences read
+        auto randomizer = create();
+        randomizer->StartEpoch(epochConfiguration);
+        vector<size_t> positions;
+        vector<vector<float>> reads;
+        for (;;)
+        {
+            positions.push_back(randomizer->GetCurrentSamplePosition());
+            Sequences sequences = randomizer->GetNextSequences(7);
+            reads.push_back(vector<float>());
+            for (const auto& sequence : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+            {
+                reads.back().push_back(*reinterpret_cast<const float*>(sequence->m_data));
+            }
+            if (sequences.m_endOfEpoch)
+            {
+                break;
+            }
+        }
+        BOOST_CHECK_GT(reads.size(), 100);
+
+        // a new enumerator continues from each of those positions with the same sequences
+        for (size_t k : { (size_t)0, (size_t)13, reads.size() / 2, reads.size() - 2 })
+        {
+            auto restored = create();
+            restored->StartEpoch(epochConfiguration);
+            restored->SetCurrentSamplePosition(positions[k]);
+            for (size_t i = k; i < reads.size(); i++)
+            {
+                BOOST_CHECK_EQUAL(restored->GetCurrentSamplePosition(), positions[i]);
+                Sequences sequences = restored->GetNextSequences(7);
+                vector<float> actual;
+                for (const auto& sequence : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+                {
+                    actual.push_back(*reinterpret_cast<const float*>(sequence->m_data));
+                }
+                BOOST_CHECK_EQUAL_COLLECTIONS(reads[i].begin(), reads[i].end(), actual.begin(), actual.end());
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SequenceEnumeratorsContinueOnOtherNumberOfWorkers)
+{
+    const int sequenceLength = 3;
+    vector<float> data(1000);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(100, 10, data, sequenceLength);
+
+    for (bool randomize : { true, false })
+    {
+        auto start = [&](size_t rank, size_t numberOfWorkers)
+        {
+            SequenceEnumeratorPtr randomizer;
+            if (randomize)
+                randomizer = make_shared<BlockRandomizer>(0, 60, mockDeserializer, BlockRandomizer::DecimationMode::chunk, false);
+            else
+                randomizer = make_shared<NoRandomizer>(mockDeserializer);
+
+            EpochConfiguration epochConfiguration;
+            epochConfiguration.m_numberOfWorkers = numberOfWorkers;
+            epochConfiguration.m_workerRank = rank;
+            epochConfiguration.m_minibatchSizeInSamples = 0;
+            epochConfiguration.m_totalEpochSizeInSamples = data.size() * sequenceLength * 3 / 5;
+            epochConfiguration.m_epochIndex = 1;
+            randomizer->StartEpoch(epochConfiguration);
+            return randomizer;
+        };
+        auto read = [](SequenceEnumeratorPtr randomizer, size_t maxReads, set<float>& values)
+        {
+            for (size_t i = 0; i < maxReads; i++)
+            {
+                Sequences sequences = randomizer->GetNextSequences(7);
+                for (const auto& sequence : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+                {
+                    values.insert(*reinterpret_cast<const float*>(sequence->m_data));
+                }
+                if (sequences.m_endOfEpoch)
+                {
+                    break;
+                }
+            }
+        };
+
+        set<float> expected;
+        for (size_t rank = 0; rank < 2; rank++)
+        {
+            read(start(rank, 2), SIZE_MAX, expected);
+        }
+
+        // two workers read part of the epoch, three continue it from the earliest position of the two
+        set<float> actual;
+        size_t position = SIZE_MAX;
+        for (size_t rank = 0; rank < 2; rank++)
+        {
+            auto randomizer = start(rank, 2);
+            read(randomizer, 20 + rank, actual);
+            position = min(position, randomizer->GetCurrentSamplePosition());
+        }
+        size_t numRead = actual.size();
+        for (size_t rank = 0; rank < 3; rank++)
+        {
+            auto randomizer = start(rank, 3);
+            randomizer->SetCurrentSamplePosition(position);
+            read(randomizer, SIZE_MAX, actual);
+        }
+
+        BOOST_CHECK_GT(numRead, 30);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ShuffleBufferRandomizerStripesStream)
+{
+    vector<float> data(20);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(10, 2, data);
+
+    auto readEpoch = [&](ShuffleBufferRandomizer& randomizer, size_t rank, size_t numberOfWorkers, size_t epochSize, size_t epoch)
+    {
+        EpochConfiguration epochConfiguration;
+        epochConfiguration.m_numberOfWorkers = numberOfWorkers;
+        epochConfiguration.m_workerRank = rank;
+        epochConfiguration.m_minibatchSizeInSamples = 0;
+        epochConfiguration.m_totalEpochSizeInSamples = epochSize;
+        epochConfiguration.m_epochIndex = epoch;
+        randomizer.StartEpoch(epochConfiguration);
+
+        vector<size_t> values;
+        for (;;)
+        {
+            Sequences sequences = randomizer.GetNextSequences(3);
+            for (const auto& sequence : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+            {
+                values.push_back((size_t)*reinterpret_cast<const float*>(sequence->m_data));
+            }
+            if (sequences.m_endOfEpoch)
+            {
+                break;
+            }
+        }
+        return values;
+    };
+
+    // each worker reads its chunks (chunk id modulo the number of workers) once per sweep epoch
+    const size_t numberOfWorkers = 2;
+    vector<size_t> timesRead(data.size(), 0);
+    bool shuffled = false;
+    for (size_t rank = 0; rank < numberOfWorkers; rank++)
+    {
+        ShuffleBufferRandomizer randomizer(mockDeserializer, 4);
+        for (size_t epoch = 0; epoch < 2; epoch++)
+        {
+            auto values = readEpoch(randomizer, rank, numberOfWorkers, requestDataSize, epoch);
+            BOOST_CHECK_EQUAL(values.size(), data.size() / numberOfWorkers);
+            for (size_t value : values)
+            {
+                BOOST_CHECK_EQUAL((value / 2) % numberOfWorkers, rank);
+                timesRead[value]++;
+            }
+            shuffled |= !is_sorted(values.begin(), values.end());
+        }
+    }
+
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(timesRead[i], 2);
+    }
+    BOOST_CHECK(shuffled);
+
+    // epochs of a fixed size continue the stream, restarting at an epoch replays it
+    ShuffleBufferRandomizer continuous(mockDeserializer, 4);
+    vector<size_t> epoch0 = readEpoch(continuous, 0, 1, 7, 0);
+    vector<size_t> epoch1 = readEpoch(continuous, 0, 1, 7, 1);
+    BOOST_CHECK_GE(epoch0.size(), 7);
+
+    ShuffleBufferRandomizer restarted(mockDeserializer, 4);
+    vector<size_t> replayed = readEpoch(restarted, 0, 1, 7, 1);
+    BOOST_CHECK_EQUAL_COLLECTIONS(epoch1.begin(), epoch1.end(), replayed.begin(), replayed.end());
+}
+
+// Numbers the sequences it transforms, starting at its seed times 1000.
+class MockCountingTransformer : public Transformer
+{
+private:
+    unsigned int m_seed;
+    size_t m_count;
+
+public:
+    explicit MockCountingTransformer(unsigned int seed) : m_seed(seed), m_count(0)
+    {
+    }
+
+    void StartEpoch(const EpochConfiguration&) override {}
+
+    StreamDescription Transform(const StreamDescription& inputStream) override
+    {
+        return inputStream;
+    }
+
+    SequenceDataPtr Transform(SequenceDataPtr inputSequence) override
+    {
+        auto result = make_shared<DenseSequenceData>(static_cast<const DenseSequenceData&>(*inputSequence));
+        result->m_id = m_seed * 1000 + m_count++;
+        return result;
+    }
+
+    TransformerPtr Clone(unsigned int seedOffset) const override
+    {
+        return make_shared<MockCountingTransformer>(m_seed + seedOffset);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(TransformControllerChainsAreDeterministic)
+{
+    vector<float> data(20);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(10, 2, data);
+
+    const size_t numChains = 3;
+    auto readEpoch = [&](size_t numThreads)
+    {
+        CPUThreadPool::SetNumThreads(numThreads);
+        vector<Transformation> transformations{ Transformation{ make_shared<MockCountingTransformer>(0), L"input" } };
+        TransformController controller(transformations, make_shared<NoRandomizer>(mockDeserializer), numChains);
+
+        EpochConfiguration epochConfiguration;
+        epochConfiguration.m_numberOfWorkers = 1;
+        epochConfiguration.m_workerRank = 0;
+        epochConfiguration.m_minibatchSizeInSamples = 0;
+        epochConfiguration.m_totalEpochSizeInSamples = data.size();
+        epochConfiguration.m_epochIndex = 0;
+        controller.StartEpoch(epochConfiguration);
+
+        vector<size_t> ids;
+        for (size_t i = 0; i < 2; i++)
+        {
+            Sequences sequences = controller.GetNextSequences(data.size() / 2);
+            BOOST_CHECK_EQUAL(sequences.m_data[0].size(), data.size() / 2);
+            for (const auto& sequence : sequences.m_data[0])
+            {
+                ids.push_back(sequence->m_id);
+            }
+        }
+        return ids;
+    };
+
+    // the sequence j of a minibatch is transformed by the chain j modulo the number of chains, each with its own seed
+    vector<size_t> expected;
+    vector<size_t> counts(numChains, 0);
+    for (size_t i = 0; i < 2; i++)
+    {
+        for (size_t j = 0; j < data.size() / 2; j++)
+        {
+            expected.push_back((j % numChains) * 1000 + counts[j % numChains]++);
+        }
+    }
+
+    vector<size_t> serial = readEpoch(1);
+    vector<size_t> parallel = readEpoch(4);
+    CPUThreadPool::SetNumThreads(0);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), serial.begin(), serial.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), parallel.begin(), parallel.end());
+}
+
+BOOST_AUTO_TEST_CASE(ChunkCacheEvictsLeastRecentlyUsed)
+{
+    vector<float> data(10);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(5, 2, data);
+
+    // A chunk holds two float samples (8 bytes), so the budget fits two chunks.
+    ChunkCache cache(mockDeserializer, 16);
+
+    // The mock creates a new chunk on every request, so a cache hit returns the same pointer.
+    auto chunk0 = cache.GetChunk(0);
+    auto chunk1 = cache.GetChunk(1);
+    BOOST_CHECK(cache.GetChunk(0) == chunk0);
+    cache.GetChunk(2); // evicts chunk 1, the least recently used one
+    BOOST_CHECK(cache.GetChunk(0) == chunk0);
+    BOOST_CHECK(cache.GetChunk(1) != chunk1);
+
+    auto statistics = cache.GetStatistics();
+    BOOST_CHECK_EQUAL(statistics.m_hits, 2);
+    BOOST_CHECK_EQUAL(statistics.m_misses, 4);
+    BOOST_CHECK_EQUAL(statistics.m_evictions, 2);
+    BOOST_CHECK_EQUAL(statistics.m_cachedChunks, 2);
+    BOOST_CHECK_EQUAL(statistics.m_cachedBytes, 16);
+
+    // Without a budget, all chunks are kept.
+    ChunkCache unlimitedCache(mockDeserializer);
+    for (ChunkIdType i = 0; i < 5; i++)
+    {
+        unlimitedCache.GetChunk(i);
+    }
+    BOOST_CHECK(unlimitedCache.GetChunk(1) == unlimitedCache.GetChunk(1));
+    BOOST_CHECK_EQUAL(unlimitedCache.GetStatistics().m_evictions, 0);
+    BOOST_CHECK_EQUAL(unlimitedCache.GetStatistics().m_cachedChunks, 5);
+}
+
+BOOST_AUTO_TEST_CASE(ReaderCountersCountPipelineStages)
+{
+    vector<float> data(10);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(5, 2, data);
+
+    // the counters are process-wide, so only their increments are checked
+    auto before = ReaderCounters::Get();
+    ChunkCache cache(mockDeserializer);
+    cache.GetChunk(0);
+    cache.GetChunk(0);
+    cache.GetChunk(1);
+    {
+        ReaderCounters::Timer timer(ReaderCounters::packMicroseconds);
+        this_thread::sleep_for(chrono::milliseconds(2));
+    }
+    ReaderCounters::Add(ReaderCounters::bytesRead, 1000);
+
+    auto increments = ReaderCounters::Get() - before;
+    BOOST_CHECK_EQUAL(increments.m_chunkCacheHits, 1);
+    BOOST_CHECK_EQUAL(increments.m_chunkCacheMisses, 2);
+    BOOST_CHECK_EQUAL(increments.m_bytesRead, 1000);
+    BOOST_CHECK_GE(increments.m_packSeconds, 0.002);
+    BOOST_CHECK_EQUAL(increments.m_transformSeconds, 0);
+}
+
+BOOST_AUTO_TEST_CASE(ChunkCacheCompressesChunks)
+{
+    vector<float> data(250);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = (float)(i % 7);
+    }
+    auto mockDeserializer = make_shared<MockDeserializer>(10, 25, data, 4);
+    ChunkCache cache(mockDeserializer, 0, 0, true);
+
+    auto statistics = cache.GetStatistics();
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (ChunkIdType i = 0; i < 10; i++)
+        {
+            // the first pass returns the chunks of the deserializer, the second one decompressed chunks
+            auto chunk = cache.GetChunk(i);
+            for (size_t j = i * 25; j < (i + 1) * 25; j++)
+            {
+                vector<SequenceDataPtr> sequence;
+                chunk->GetSequence(j, sequence);
+                BOOST_REQUIRE_EQUAL(sequence.size(), 1);
+                BOOST_REQUIRE_EQUAL(sequence[0]->m_numberOfSamples, 4);
+                const float* values = reinterpret_cast<const float*>(sequence[0]->m_data);
+                for (size_t k = 0; k < 4; k++)
+                {
+                    BOOST_CHECK_EQUAL(values[k], data[j]);
+                }
+            }
+        }
+    }
+
+    statistics = cache.GetStatistics();
+    BOOST_CHECK_EQUAL(statistics.m_hits, 10);
+    BOOST_CHECK_EQUAL(statistics.m_misses, 10);
+    BOOST_CHECK_EQUAL(statistics.m_uncompressedBytes, 250 * 4 * sizeof(float));
+    BOOST_CHECK_LT(statistics.m_cachedBytes, statistics.m_uncompressedBytes / 4);
+}
+
+BOOST_AUTO_TEST_CASE(Lz4RoundTrip)
+{
+    mt19937 rng(7);
+    for (size_t size : { 0, 1, 12, 13, 100, 70000, 300000 })
+    {
+        // runs of repeated bytes, random bytes in between
+        vector<char> input(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            input[i] = (i / 64) % 3 == 0 ? (char)rng() : (char)(i / 200);
+        }
+
+        vector<char> compressed;
+        Lz4Compress(input.data(), input.size(), compressed);
+        BOOST_CHECK_LE(compressed.size(), Lz4CompressBound(size));
+
+        vector<char> output(size);
+        Lz4Decompress(compressed.data(), compressed.size(), output.data(), output.size());
+        BOOST_CHECK(output == input);
+
+        if (size > 0)
+        {
+            BOOST_CHECK_THROW(Lz4Decompress(compressed.data(), compressed.size() - 1, output.data(), output.size()), std::exception);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(DefaultCorpusDescriptor)
 {
     const int seed = 13;
@@ -436,6 +1177,117 @@ BOOST_AUTO_TEST_CASE(CorpusDescriptorFromFile)
     remove("test.tmp");
 }
 
+// The ids of the one-hot samples of a sequence.
+static vector<IndexType> GetIds(const SequenceDataPtr& data)
+{
+    auto sparse = static_pointer_cast<SparseSequenceData>(data);
+    BOOST_REQUIRE_EQUAL(sparse->m_totalNnzCount, (IndexType)sparse->m_numberOfSamples);
+    const float* values = reinterpret_cast<const float*>(sparse->m_data);
+    BOOST_CHECK(all_of(values, values + sparse->m_totalNnzCount, [](float v) { return v == 1.0f; }));
+    return vector<IndexType>(sparse->m_indices, sparse->m_indices + sparse->m_totalNnzCount);
+}
+
+BOOST_AUTO_TEST_CASE(WordSequenceDeserializerReadsLMAndLUFormats)
+{
+    FILE* test = fopen("test.tmp", "wb");
+    fputs("a b c\n\nd e", test);
+    fclose(test);
+
+    // a sentence per line, the label of a word is the next one
+    ConfigParameters config;
+    config.Insert("file", "test.tmp");
+    config.Insert("beginSequence", "<s>");
+    config.Insert("endSequence", "</s>");
+    auto corpus = make_shared<CorpusDescriptor>();
+    WordSequenceDeserializer lm(corpus, config, WordSequenceDeserializer::Format::sentencePerLine);
+
+    auto streams = lm.GetStreamDescriptions();
+    BOOST_REQUIRE_EQUAL(streams.size(), 2);
+    BOOST_CHECK(streams[0]->m_name == L"features" && streams[1]->m_name == L"labels");
+    BOOST_CHECK_EQUAL(streams[0]->m_sampleLayout->GetNumElements(), 7); // <s> a b c </s> d e
+    BOOST_CHECK_EQUAL(streams[1]->m_sampleLayout->GetNumElements(), 7);
+
+    auto chunks = lm.GetChunkDescriptions();
+    BOOST_REQUIRE_EQUAL(chunks.size(), 1);
+    BOOST_CHECK_EQUAL(chunks[0]->m_numberOfSequences, 2);
+    BOOST_CHECK_EQUAL(chunks[0]->m_numberOfSamples, 7);
+
+    vector<SequenceDescription> sequences;
+    lm.GetSequencesForChunk(0, sequences);
+    BOOST_REQUIRE_EQUAL(sequences.size(), 2);
+    BOOST_CHECK_EQUAL(sequences[1].m_numberOfSamples, 3);
+
+    auto chunk = lm.GetChunk(0);
+    vector<SequenceDataPtr> data;
+    chunk->GetSequence(sequences[0].m_id, data);
+    BOOST_REQUIRE_EQUAL(data.size(), 2);
+    BOOST_CHECK(GetIds(data[0]) == (vector<IndexType>{ 0, 1, 2, 3 }));
+    BOOST_CHECK(GetIds(data[1]) == (vector<IndexType>{ 1, 2, 3, 4 }));
+    data.clear();
+    chunk->GetSequence(sequences[1].m_id, data);
+    BOOST_CHECK(GetIds(data[0]) == (vector<IndexType>{ 0, 5, 6 }));
+    BOOST_CHECK(GetIds(data[1]) == (vector<IndexType>{ 5, 6, 4 }));
+
+    SequenceDescription description;
+    BOOST_CHECK(lm.GetSequenceDescriptionByKey(sequences[1].m_key, description));
+    BOOST_CHECK_EQUAL(description.m_id, sequences[1].m_id);
+
+    // a word and its label per line, with a vocabulary file for the words
+    test = fopen("test.tmp", "wb");
+    fputs("<s> O\nshow B-act\nfoo O\n</s> O\n<s> O\nme O\n\n", test);
+    fclose(test);
+    FILE* vocabulary = fopen("vocabulary.tmp", "wb");
+    fputs("<s>\n</s>\n<unk>\nshow\nme\n", vocabulary);
+    fclose(vocabulary);
+
+    ConfigParameters luConfig;
+    luConfig.Insert("file", "test.tmp");
+    luConfig.Insert("vocabulary", "vocabulary.tmp");
+    WordSequenceDeserializer lu(make_shared<CorpusDescriptor>(), luConfig, WordSequenceDeserializer::Format::wordPerLine);
+
+    streams = lu.GetStreamDescriptions();
+    BOOST_CHECK_EQUAL(streams[0]->m_sampleLayout->GetNumElements(), 5);
+    BOOST_CHECK_EQUAL(streams[1]->m_sampleLayout->GetNumElements(), 2); // O B-act
+
+    sequences.clear();
+    lu.GetSequencesForChunk(0, sequences);
+    BOOST_REQUIRE_EQUAL(sequences.size(), 2);
+    data.clear();
+    lu.GetChunk(0)->GetSequence(sequences[0].m_id, data);
+    BOOST_CHECK(GetIds(data[0]) == (vector<IndexType>{ 0, 3, 2, 1 })); // foo is unknown
+    BOOST_CHECK(GetIds(data[1]) == (vector<IndexType>{ 0, 1, 0, 0 }));
+    BOOST_CHECK_EQUAL(sequences[1].m_numberOfSamples, 2);
+
+    remove("test.tmp");
+    remove("vocabulary.tmp");
+}
+
+BOOST_AUTO_TEST_CASE(StringToIdMapInternsKeys)
+{
+    StringToIdMap registry;
+    const size_t numKeys = 5000; // several times the initial table size
+    for (size_t i = 0; i < numKeys; i++)
+    {
+        BOOST_CHECK_EQUAL(registry["utterance_" + to_string(i)], i);
+    }
+    BOOST_CHECK_EQUAL(registry.Size(), numKeys);
+    BOOST_CHECK_EQUAL(registry.AddValue("utterance_42"), 42);
+    BOOST_CHECK_EQUAL(registry[""], numKeys);
+
+    for (size_t i = 0; i < numKeys; i++)
+    {
+        size_t id;
+        BOOST_CHECK(registry.TryGet("utterance_" + to_string(i), id));
+        BOOST_CHECK_EQUAL(id, i);
+        BOOST_CHECK_EQUAL(registry[i], "utterance_" + to_string(i));
+    }
+    BOOST_CHECK_EQUAL(registry[numKeys], "");
+
+    size_t id;
+    BOOST_CHECK(!registry.TryGet("utterance_" + to_string(numKeys), id));
+    BOOST_CHECK(!registry.Contains("utterance"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
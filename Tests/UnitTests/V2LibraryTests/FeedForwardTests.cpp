@@ -233,6 +233,163 @@ void TestTimesAndPlus(size_t inputDim,
     }
 }
 
+// Several ForwardAsync and BackwardAsync calls are enqueued before any of them is waited for: they must be carried out in
+// the order of enqueueing, the futures must rethrow the errors of the computations, and the Function may be released
+// before its computations are done (typically, the last of them then releases it on the Function's own thread).
+void TestForwardAndBackwardAsync(const DeviceDescriptor& device)
+{
+    const size_t inputDim = 13;
+    const size_t outputDim = 5;
+    const size_t numSamples = 64;
+    const size_t numForwards = 3;
+
+    Parameter timesParam(new NDArrayView(0.5f, { outputDim, inputDim }, device));
+    Parameter plusParam(new NDArrayView(1.2f, { outputDim }, device));
+    Variable inputVar({ inputDim }, DataType::Float, L"input");
+    auto timesAndPlusFunc = Plus(plusParam, Times(timesParam, inputVar));
+    auto outputVar = timesAndPlusFunc->Output();
+
+    NDShape inputShape = { inputDim, 1, numSamples };
+    NDShape outputShape = { outputDim, 1, numSamples };
+    srand(1);
+    std::vector<std::vector<float>> inputData(numForwards + 1, std::vector<float>(inputShape.TotalSize()));
+    std::vector<ValuePtr> inputValues;
+    for (auto& data : inputData)
+    {
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = ((float)rand()) / RAND_MAX;
+        inputValues.push_back(new Value(new NDArrayView(inputShape, data.data(), data.size(), DeviceDescriptor::CPUDevice(), true)));
+    }
+
+    std::vector<float> rootGradientsData(outputShape.TotalSize(), 1);
+    NDArrayViewPtr cpuRootGradientArrayView = new NDArrayView(outputShape, rootGradientsData.data(), rootGradientsData.size(), DeviceDescriptor::CPUDevice(), true);
+    NDArrayViewPtr rootGradientArrayView = new NDArrayView(DataType::Float, outputShape, device);
+    rootGradientArrayView->CopyFrom(*cpuRootGradientArrayView);
+    ValuePtr rootGradientValue = new Value(rootGradientArrayView);
+
+    // each computation gets its own output buffers, on the CPU
+    std::vector<std::vector<float>> outputData(numForwards + 1, std::vector<float>(outputShape.TotalSize()));
+    std::vector<std::unordered_map<Variable, ValuePtr>> outputs;
+    for (auto& data : outputData)
+        outputs.push_back({ { outputVar, new Value(new NDArrayView(outputShape, data.data(), data.size(), DeviceDescriptor::CPUDevice(), false)) } });
+
+    std::vector<float> timesParameterGradientData(timesParam.Shape().TotalSize());
+    std::unordered_map<Variable, ValuePtr> paramGradients = { { timesParam, new Value(new NDArrayView(timesParam.Shape(), timesParameterGradientData.data(), timesParameterGradientData.size(), DeviceDescriptor::CPUDevice(), false)) } };
+    std::unordered_map<Variable, ValuePtr> staleParamGradients = { { timesParam, nullptr } };
+
+    auto verifyOutputs = [&](size_t i)
+    {
+        std::vector<float> expectedOutputValues(outputShape.TotalSize());
+        for (size_t j = 0; j < numSamples; ++j)
+        {
+            float expectedVal = 1.2f;
+            for (size_t k = 0; k < inputDim; ++k)
+                expectedVal += inputData[i][j * inputDim + k] * 0.5f;
+
+            for (size_t k = 0; k < outputDim; ++k)
+                expectedOutputValues[j * outputDim + k] = expectedVal;
+        }
+
+        FloatingPointVectorCompare(outputData[i], expectedOutputValues, "TestForwardAndBackwardAsync: Forward prop results do not match expected results");
+    };
+
+    // all forward computations are enqueued before any of them is waited for; only the state of the last one can be backpropagated
+    std::vector<std::future<BackPropStatePtr>> forwards;
+    for (size_t i = 0; i < numForwards; ++i)
+        forwards.push_back(timesAndPlusFunc->ForwardAsync({ { inputVar, inputValues[i] } }, outputs[i], device, { outputVar }));
+    std::vector<BackPropStatePtr> backpropStates;
+    for (auto& forward : forwards)
+        backpropStates.push_back(forward.get());
+
+    for (size_t i = 0; i < numForwards; ++i)
+        verifyOutputs(i);
+
+    // Backward with the state of the last Forward must run before the Forward enqueued after it, after which the state of the
+    // first Forward is stale: its Backward fails, and the future rethrows the error.
+    auto backward = timesAndPlusFunc->BackwardAsync(backpropStates.back(), { { outputVar, rootGradientValue } }, paramGradients);
+    auto lastForward = timesAndPlusFunc->ForwardAsync({ { inputVar, inputValues[numForwards] } }, outputs[numForwards], device, { outputVar });
+    auto staleBackward = timesAndPlusFunc->BackwardAsync(backpropStates.front(), { { outputVar, rootGradientValue } }, staleParamGradients);
+
+    // release the Function while its computations may still be enqueued
+    timesAndPlusFunc = nullptr;
+    backpropStates.clear();
+
+    backward.get();
+    lastForward.get();
+    bool staleBackwardFailed = false;
+    try
+    {
+        staleBackward.get();
+    }
+    catch (const std::logic_error&)
+    {
+        staleBackwardFailed = true;
+    }
+
+    if (!staleBackwardFailed)
+        throw std::runtime_error("TestForwardAndBackwardAsync: Backward with the state of an earlier Forward did not fail");
+
+    verifyOutputs(numForwards);
+
+    std::vector<float> expectedTimesParamsGradientValues(timesParam.Shape().TotalSize());
+    for (size_t i = 0; i < inputDim; ++i)
+    {
+        float expectedVal = 0;
+        for (size_t j = 0; j < numSamples; ++j)
+            expectedVal += inputData[numForwards - 1][j * inputDim + i];
+
+        for (size_t j = 0; j < outputDim; ++j)
+            expectedTimesParamsGradientValues[i * outputDim + j] = expectedVal;
+    }
+
+    FloatingPointVectorCompare(timesParameterGradientData, expectedTimesParamsGradientValues, "TestForwardAndBackwardAsync: Backprop prop results do not match expected results for Times params gradients");
+}
+
+void TestSaveAndLoadModel(const DeviceDescriptor& device)
+{
+    using namespace std::placeholders;
+
+    const size_t inputDim = 37;
+    const size_t numOutputClasses = 11;
+    const size_t hiddenLayersDim = 64;
+    const size_t numSamples = 5;
+
+    Variable inputVar({ inputDim }, DataType::Float, L"Features");
+    auto classifierOutputFunction = FullyConnectedFeedForwardClassifierNet(inputVar, numOutputClasses, hiddenLayersDim, 2, device, std::bind(Sigmoid, _1, L""));
+
+    const std::wstring modelFile = L"FeedForwardTests.model";
+    SaveModel(classifierOutputFunction, modelFile);
+    auto loadedFunction = LoadModel(modelFile, device);
+
+    if (loadedFunction->Parameters().size() != classifierOutputFunction->Parameters().size())
+        throw std::runtime_error("TestSaveAndLoadModel: Loaded Function does not have expected Parameter count");
+
+    auto loadedArguments = loadedFunction->Arguments();
+    if ((loadedArguments.size() != 1) || (loadedArguments.begin()->Name() != inputVar.Name()) || (loadedArguments.begin()->Shape() != inputVar.Shape()))
+        throw std::runtime_error("TestSaveAndLoadModel: Loaded Function does not have expected Arguments");
+
+    std::vector<float> inputData(inputDim * numSamples);
+    for (size_t i = 0; i < inputData.size(); ++i)
+        inputData[i] = ((float)rand()) / RAND_MAX;
+
+    NDShape inputShape = { inputDim, 1, numSamples };
+    ValuePtr inputValue = new Value(new NDArrayView(inputShape, inputData.data(), inputData.size(), DeviceDescriptor::CPUDevice(), true));
+
+    NDShape outputShape = { numOutputClasses, 1, numSamples };
+    std::vector<float> outputData(outputShape.TotalSize());
+    std::vector<float> loadedOutputData(outputShape.TotalSize());
+    ValuePtr outputValue = new Value(new NDArrayView(outputShape, outputData.data(), outputData.size(), DeviceDescriptor::CPUDevice(), false));
+    ValuePtr loadedOutputValue = new Value(new NDArrayView(outputShape, loadedOutputData.data(), loadedOutputData.size(), DeviceDescriptor::CPUDevice(), false));
+
+    std::unordered_map<Variable, ValuePtr> outputs = { { classifierOutputFunction->Output(), outputValue } };
+    classifierOutputFunction->Forward({ { inputVar, inputValue } }, outputs, device);
+
+    std::unordered_map<Variable, ValuePtr> loadedOutputs = { { loadedFunction->Output(), loadedOutputValue } };
+    loadedFunction->Forward({ { *loadedArguments.begin(), inputValue } }, loadedOutputs, device);
+
+    FloatingPointVectorCompare(loadedOutputData, outputData, "TestSaveAndLoadModel: Forward prop results of the loaded Function do not match those of the saved one");
+}
+
 void FeedForwardTests()
 {
     TestTimesAndPlus<double>(4, 2, 5, DeviceDescriptor::CPUDevice(), 3, true, true);
@@ -241,4 +398,10 @@ void FeedForwardTests()
 
     TestFeedForwardNetworkCreation(DeviceDescriptor::GPUDevice(0));
     TestFeedForwardNetworkCreation(DeviceDescriptor::CPUDevice());
+
+    TestForwardAndBackwardAsync(DeviceDescriptor::CPUDevice());
+    TestForwardAndBackwardAsync(DeviceDescriptor::GPUDevice(0));
+
+    TestSaveAndLoadModel(DeviceDescriptor::CPUDevice());
+    TestSaveAndLoadModel(DeviceDescriptor::GPUDevice(0));
 }
@@ -0,0 +1,155 @@
+#include "CNTKLibrary.h"
+#include <functional>
+#include <cmath>
+#include "Common.h"
+
+using namespace CNTK;
+
+template <typename ElementType>
+std::vector<ElementType> RandomData(size_t numElements)
+{
+    std::vector<ElementType> data(numElements);
+    for (size_t i = 0; i < numElements; ++i)
+        data[i] = -1 + ((((ElementType)rand()) / RAND_MAX) * 2);
+
+    return data;
+}
+
+template <typename ElementType>
+NDArrayViewPtr CreateView(const NDShape& shape, std::vector<ElementType>& data, const DeviceDescriptor& device)
+{
+    NDArrayViewPtr cpuView = new NDArrayView(shape, data);
+    if (device.Type() == DeviceType::CPU)
+        return cpuView;
+
+    NDArrayViewPtr view = new NDArrayView(AsDataType<ElementType>(), shape, device);
+    view->CopyFrom(*cpuView);
+    return view;
+}
+
+template <typename ElementType>
+std::vector<ElementType> ParameterValue(const Parameter& parameter)
+{
+    auto value = parameter.Value();
+    std::vector<ElementType> data(value->Shape().TotalSize());
+    NDArrayViewPtr cpuView = new NDArrayView(value->Shape(), data);
+    cpuView->CopyFrom(*value);
+    return data;
+}
+
+template <typename ElementType>
+std::unordered_map<Variable, ValuePtr> Gradients(const std::vector<Parameter>& parameters, std::vector<std::vector<ElementType>>& gradientData, const DeviceDescriptor& device)
+{
+    std::unordered_map<Variable, ValuePtr> gradientValues;
+    for (size_t i = 0; i < parameters.size(); ++i)
+        gradientValues[parameters[i]] = new Value(CreateView(parameters[i].Shape(), gradientData[i], device));
+
+    return gradientValues;
+}
+
+template <typename ElementType>
+void TestLearner(const DeviceDescriptor& device,
+                 const std::function<LearnerPtr(const std::unordered_set<Parameter>&)>& createLearner,
+                 const std::function<void(std::vector<ElementType>& value, const std::vector<ElementType>& gradient, std::vector<ElementType>& state, size_t trainingSampleCount)>& expectedUpdate)
+{
+    srand(1);
+
+    const size_t numSteps = 3;
+    const std::vector<size_t> trainingSampleCounts = { 16, 7, 32 };
+    const std::vector<NDShape> shapes = { { 5, 3 }, { 5 }, { 2, 3, 4 } };
+
+    std::vector<Parameter> parameters;
+    std::vector<std::vector<ElementType>> expectedValues, states;
+    for (auto& shape : shapes)
+    {
+        auto initialValue = RandomData<ElementType>(shape.TotalSize());
+        parameters.push_back(Parameter(CreateView(shape, initialValue, device)));
+        expectedValues.push_back(initialValue);
+        states.push_back(std::vector<ElementType>(shape.TotalSize(), 0));
+    }
+
+    auto learner = createLearner(std::unordered_set<Parameter>(parameters.begin(), parameters.end()));
+    if (learner->Parameters().size() != parameters.size())
+        throw std::runtime_error("The learner does not report the Parameters it was created for");
+
+    for (size_t step = 0; step < numSteps; ++step)
+    {
+        std::vector<std::vector<ElementType>> gradientData;
+        for (auto& shape : shapes)
+            gradientData.push_back(RandomData<ElementType>(shape.TotalSize()));
+
+        for (size_t i = 0; i < parameters.size(); ++i)
+            expectedUpdate(expectedValues[i], gradientData[i], states[i], trainingSampleCounts[step]);
+
+        if (!learner->Update(Gradients(parameters, gradientData, device), trainingSampleCounts[step]))
+            throw std::runtime_error("The learner did not update any Parameter");
+
+        for (size_t i = 0; i < parameters.size(); ++i)
+            FloatingPointVectorCompare(ParameterValue<ElementType>(parameters[i]), expectedValues[i], "The Parameter value after a learner update does not match the expected value");
+    }
+
+    // Parameters without a gradient are left alone
+    auto valueBefore = ParameterValue<ElementType>(parameters[0]);
+    if (learner->Update(std::unordered_map<Variable, ValuePtr>(), trainingSampleCounts[0]))
+        throw std::runtime_error("The learner reported an update without any gradients");
+
+    FloatingPointVectorCompare(ParameterValue<ElementType>(parameters[0]), valueBefore, "A learner modified a Parameter that has no gradient");
+}
+
+template <typename ElementType>
+void TestLearners(const DeviceDescriptor& device)
+{
+    const double learningRatePerSample = 0.01;
+    const double momentumPerSample = 0.99;
+
+    TestLearner<ElementType>(device,
+                             [&](const std::unordered_set<Parameter>& parameters) { return SGDLearner(parameters, learningRatePerSample); },
+                             [&](std::vector<ElementType>& value, const std::vector<ElementType>& gradient, std::vector<ElementType>&, size_t) {
+                                 for (size_t j = 0; j < value.size(); ++j)
+                                     value[j] -= (ElementType)learningRatePerSample * gradient[j];
+                             });
+
+    // smoothed = (1 - momentum) * learningRate * gradient + momentum * smoothed, with momentum = momentumPerSample ^ trainingSampleCount
+    TestLearner<ElementType>(device,
+                             [&](const std::unordered_set<Parameter>& parameters) { return MomentumSGDLearner(parameters, learningRatePerSample, momentumPerSample); },
+                             [&](std::vector<ElementType>& value, const std::vector<ElementType>& gradient, std::vector<ElementType>& smoothedGradient, size_t trainingSampleCount) {
+                                 ElementType momentum = (ElementType)pow(momentumPerSample, trainingSampleCount);
+                                 for (size_t j = 0; j < value.size(); ++j)
+                                 {
+                                     smoothedGradient[j] = (1 - momentum) * (ElementType)learningRatePerSample * gradient[j] + momentum * smoothedGradient[j];
+                                     value[j] -= smoothedGradient[j];
+                                 }
+                             });
+
+    // with L2 regularization, the gradient is first increased by l2RegularizationWeight * trainingSampleCount * value
+    AdditionalLearningOptions options;
+    options.l2RegularizationWeight = 0.001;
+    TestLearner<ElementType>(device,
+                             [&](const std::unordered_set<Parameter>& parameters) { return MomentumSGDLearner(parameters, learningRatePerSample, momentumPerSample, false, options); },
+                             [&](std::vector<ElementType>& value, const std::vector<ElementType>& gradient, std::vector<ElementType>& smoothedGradient, size_t trainingSampleCount) {
+                                 ElementType momentum = (ElementType)pow(momentumPerSample, trainingSampleCount);
+                                 for (size_t j = 0; j < value.size(); ++j)
+                                 {
+                                     ElementType regularizedGradient = gradient[j] + (ElementType)(options.l2RegularizationWeight * trainingSampleCount) * value[j];
+                                     smoothedGradient[j] = (1 - momentum) * (ElementType)learningRatePerSample * regularizedGradient + momentum * smoothedGradient[j];
+                                     value[j] -= smoothedGradient[j];
+                                 }
+                             });
+
+    TestLearner<ElementType>(device,
+                             [&](const std::unordered_set<Parameter>& parameters) { return AdaGradLearner(parameters, learningRatePerSample, /*needAveMultiplier =*/ false); },
+                             [&](std::vector<ElementType>& value, const std::vector<ElementType>& gradient, std::vector<ElementType>& accumulatedSquares, size_t) {
+                                 for (size_t j = 0; j < value.size(); ++j)
+                                 {
+                                     accumulatedSquares[j] += gradient[j] * gradient[j];
+                                     value[j] -= (ElementType)learningRatePerSample * gradient[j] / std::sqrt(accumulatedSquares[j] + (ElementType)1e-16f);
+                                 }
+                             });
+}
+
+void LearnerTests()
+{
+    TestLearners<float>(DeviceDescriptor::CPUDevice());
+    TestLearners<double>(DeviceDescriptor::CPUDevice());
+    TestLearners<float>(DeviceDescriptor::GPUDevice(0));
+}
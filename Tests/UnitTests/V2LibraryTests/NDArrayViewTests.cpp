@@ -1,6 +1,7 @@
 #include "CNTKLibrary.h"
 #include <functional>
 #include <array>
+#include <algorithm>
 
 using namespace CNTK;
 
@@ -128,6 +129,18 @@ void TestNDArrayView(size_t numAxes, const DeviceDescriptor& device)
     verifyException([&aliasView, &dataView]() {
         aliasView->CopyFrom(*dataView);
     });
+
+    // Test asynchronous copies, to the device and back, and their errors
+    NDArrayViewPtr asyncDeviceView = new NDArrayView(AsDataType<ElementType>(), viewShape, device);
+    NDArrayViewPtr asyncCpuDataView = new NDArrayView(AsDataType<ElementType>(), viewShape, DeviceDescriptor::CPUDevice());
+    asyncDeviceView->CopyFromAsync(*cpuDataView).get();
+    asyncCpuDataView->CopyFromAsync(*asyncDeviceView).get();
+    if (!std::equal(data.begin(), data.end(), asyncCpuDataView->DataBuffer<ElementType>()))
+        throw std::runtime_error("The contents of the view copied asynchronously to the device and back do not match the original buffer");
+
+    verifyException([&aliasView, &dataView]() {
+        aliasView->CopyFromAsync(*dataView).get();
+    });
 }
 
 template <typename ElementType>
@@ -194,8 +207,43 @@ void TestSparseCSCArrayView(size_t numAxes, const DeviceDescriptor& device)
         throw std::runtime_error("The contents of the dense vector that the sparse NDArrayView is copied into do not match the expected values");
 }
 
+template <typename ElementType>
+void TestNDArrayViewOverUserBuffer()
+{
+    NDShape viewShape = { 3, 4 };
+    ElementType* buffer = new ElementType[viewShape.TotalSize()];
+    for (size_t i = 0; i < viewShape.TotalSize(); ++i)
+        buffer[i] = (ElementType)i;
+
+    size_t numDeleterCalls = 0;
+    auto deleter = [](void* dataBuffer, void* deleterContext) {
+        delete[] (ElementType*)dataBuffer;
+        (*(size_t*)deleterContext)++;
+    };
+
+    NDArrayViewPtr view = new NDArrayView(AsDataType<ElementType>(), viewShape, buffer, viewShape.TotalSize() * sizeof(ElementType), DeviceDescriptor::CPUDevice(), deleter, &numDeleterCalls);
+    if (view->DataBuffer<ElementType>() != buffer)
+        throw std::runtime_error("The DataBuffer of the NDArrayView does not match the user buffer it was created over");
+
+    // The buffer must be released once, when the last of the view and its aliases is gone
+    NDArrayViewPtr aliasView = view->Alias(true);
+    view = nullptr;
+    if (numDeleterCalls != 0)
+        throw std::runtime_error("The user buffer of an NDArrayView was released while an alias of the view still refers to it");
+
+    if (aliasView->DataBuffer<ElementType>()[5] != (ElementType)5)
+        throw std::runtime_error("The contents of the alias of an NDArrayView over a user buffer do not match the buffer");
+
+    aliasView = nullptr;
+    if (numDeleterCalls != 1)
+        throw std::runtime_error("The user buffer of an NDArrayView was not released exactly once after the view and its aliases were destructed");
+}
+
 void NDArrayViewTests()
 {
+    TestNDArrayViewOverUserBuffer<float>();
+    TestNDArrayViewOverUserBuffer<double>();
+
     TestNDArrayView<float>(2, DeviceDescriptor::CPUDevice());
     TestNDArrayView<float>(0, DeviceDescriptor::GPUDevice(0));
     TestNDArrayView<double>(4, DeviceDescriptor::GPUDevice(0));